@@ -533,6 +533,21 @@ endif ()
 ###########################################################################
 
 
+###########################################################################
+# OpenCL setup
+
+if (USE_OPENCL)
+    find_package (OpenCL)
+    if (OpenCL_FOUND)
+        include_directories (${OpenCL_INCLUDE_DIRS})
+        add_definitions ("-DUSE_OPENCL")
+    endif ()
+endif ()
+
+# end OpenCL setup
+###########################################################################
+
+
 ###########################################################################
 # Freetype setup
 
@@ -555,6 +570,23 @@ endif ()
 ###########################################################################
 
 
+###########################################################################
+# libdeflate setup
+
+if (USE_LIBDEFLATE)
+    find_package (Libdeflate)
+    if (LIBDEFLATE_FOUND)
+        include_directories (${LIBDEFLATE_INCLUDE_DIR})
+        add_definitions ("-DUSE_LIBDEFLATE=1")
+    endif ()
+else ()
+    message (STATUS "Not using libdeflate")
+endif ()
+
+# end libdeflate setup
+###########################################################################
+
+
 ###########################################################################
 # OpenSSL Setup
 
@@ -0,0 +1,31 @@
+# Find the libdeflate compression library.
+#
+# Sets the usual variables expected for find_package scripts:
+#
+# LIBDEFLATE_INCLUDE_DIR - header location
+# LIBDEFLATE_LIBRARIES - library to link against
+# LIBDEFLATE_FOUND - true if libdeflate was found.
+
+find_path (LIBDEFLATE_INCLUDE_DIR
+           NAMES libdeflate.h
+           PATHS ${LIBDEFLATE_HOME}/include)
+find_library (LIBDEFLATE_LIBRARY
+              NAMES deflate
+              PATHS ${LIBDEFLATE_HOME}/lib)
+
+# Support the REQUIRED and QUIET arguments, and set LIBDEFLATE_FOUND if found.
+include (FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS (Libdeflate DEFAULT_MSG LIBDEFLATE_LIBRARY
+                                   LIBDEFLATE_INCLUDE_DIR)
+
+if (LIBDEFLATE_FOUND)
+    set (LIBDEFLATE_LIBRARIES ${LIBDEFLATE_LIBRARY})
+    if (NOT Libdeflate_FIND_QUIETLY)
+        message (STATUS "libdeflate include = ${LIBDEFLATE_INCLUDE_DIR}")
+        message (STATUS "libdeflate library = ${LIBDEFLATE_LIBRARY}")
+    endif ()
+else ()
+    message (STATUS "No libdeflate found")
+endif()
+
+mark_as_advanced (LIBDEFLATE_LIBRARY LIBDEFLATE_INCLUDE_DIR)
@@ -48,6 +48,23 @@ namespace DDS_pvt {
 #define DDS_4CC_DXT3            DDS_MAKE4CC('D', 'X', 'T', '3')
 #define DDS_4CC_DXT4            DDS_MAKE4CC('D', 'X', 'T', '4')
 #define DDS_4CC_DXT5            DDS_MAKE4CC('D', 'X', 'T', '5')
+#define DDS_4CC_ATI1            DDS_MAKE4CC('A', 'T', 'I', '1')
+#define DDS_4CC_ATI2            DDS_MAKE4CC('A', 'T', 'I', '2')
+#define DDS_4CC_BC4U            DDS_MAKE4CC('B', 'C', '4', 'U')
+#define DDS_4CC_BC5U            DDS_MAKE4CC('B', 'C', '5', 'U')
+
+/// Block-compressed pixel formats we can read and write.  Each block
+/// holds 4x4 pixels.
+///
+enum BCFormat { BC1 = 1, BC2, BC3, BC4, BC5 };
+
+/// Bytes per block of the given BCFormat.
+///
+inline int
+bc_block_bytes (int bcformat)
+{
+    return (bcformat == BC1 || bcformat == BC4) ? 8 : 16;
+}
 
 /// DDS pixel format flags. Channel flags are only applicable for uncompressed
 /// images.
@@ -38,8 +38,8 @@
 #include "OpenImageIO/typedesc.h"
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/fmath.h"
-
-#include "squish/squish.h"
+#include "OpenImageIO/simd.h"
+#include "OpenImageIO/thread.h"
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
 
@@ -69,6 +69,8 @@ private:
     int m_miplevel;
     int m_nchans;                     ///< Number of colour channels in image
     int m_nfaces;                     ///< Number of cube map sides in image
+    int m_bcformat;                   ///< Block compression, or 0 if none
+    int m_face;                       ///< Cube map face held in m_buf
     int m_Bpp;                        ///< Number of bytes per pixel
     int m_redL, m_redR;               ///< Bit shifts to extract red channel
     int m_greenL, m_greenR;           ///< Bit shifts to extract green channel
@@ -83,6 +85,7 @@ private:
         m_file = NULL;
         m_subimage = -1;
         m_miplevel = -1;
+        m_face = -1;
         m_buf.clear ();
     }
 
@@ -98,6 +101,10 @@ private:
     ///
     inline void calc_shifts (int mask, int& left, int& right);
 
+    /// Helper function: the number of bytes one image (a MIP level of a
+    /// face) of the given size takes up in the file.
+    size_t level_bytes (unsigned int w, unsigned int h, unsigned int d) const;
+
     /// Helper function: performs the actual file seeking.
     ///
     void internal_seek_subimage (int cubeface, int miplevel, unsigned int& w,
@@ -135,6 +142,187 @@ OIIO_PLUGIN_EXPORTS_END
 
 
 
+namespace {
+
+// Expand a 5:6:5 color to 8 bits per channel (replicating the high bits
+// into the low ones, as squish does), as (r,g,b,255).
+inline simd::int4
+unpack565 (int c)
+{
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    return simd::int4 ((r << 3) | (r >> 2), (g << 2) | (g >> 4),
+                       (b << 3) | (b >> 2), 255);
+}
+
+
+
+// Pack 8-bit RGBA channel values into the word holding those bytes.
+inline int
+pack_rgba (const simd::int4 &c)
+{
+    unsigned char bytes[4];
+    c.store (bytes);
+    int word;
+    memcpy (&word, bytes, 4);
+    return word;
+}
+
+
+
+// Decode the color half of a BC1-3 block into 16 RGBA pixels (a word
+// per pixel, rows of 4).  The palette is interpolated for all four
+// channels at once, and then each row is selected from it four pixels
+// at a time.  Only BC1 has the 3-color + transparent black mode.
+inline void
+decode_color_block (const unsigned char *block, bool bc1, int *rgba)
+{
+    using namespace simd;
+    int c0 = block[0] | (block[1] << 8);
+    int c1 = block[2] | (block[3] << 8);
+    int4 a = unpack565 (c0), b = unpack565 (c1);
+    int4 ab, ba;
+    if (bc1 && c0 <= c1) {
+        ab = srl (a + b, 1);
+        ba = int4 (0);
+    } else {
+        // x/3 == (x * 0xAAAB) >> 17 for any x < 2^16
+        ab = srl ((a + a + b) * int4 (0xAAAB), 17);
+        ba = srl ((a + b + b) * int4 (0xAAAB), 17);
+    }
+    int4 p0 (pack_rgba (a)), p1 (pack_rgba (b));
+    int4 p2 (pack_rgba (ab)), p3 (pack_rgba (ba));
+    // Each row's byte holds 2-bit indices, pixel 0 in the low bits;
+    // multiplying shifts the one for each lane up to the same place.
+    const int4 lanes (64, 16, 4, 1);
+    for (int y = 0;  y < 4;  ++y) {
+        int4 index = srl (int4 (block[4+y]) * lanes, 6) & int4 (3);
+        int4 lo = select (index == int4 (1), p1, p0);
+        int4 hi = select (index == int4 (3), p3, p2);
+        select (index >= int4 (2), hi, lo).store (rgba + 4*y);
+    }
+}
+
+
+
+// Decode a BC3 alpha (or BC4/BC5 channel) block into 16 values, stored
+// stride bytes apart.
+inline void
+decode_alpha_block (const unsigned char *block, unsigned char *dst, int stride)
+{
+    int a0 = block[0], a1 = block[1];
+    unsigned char codes[8];
+    codes[0] = (unsigned char) a0;
+    codes[1] = (unsigned char) a1;
+    if (a0 <= a1) {
+        for (int i = 1;  i < 5;  ++i)
+            codes[1+i] = (unsigned char) (((5-i)*a0 + i*a1) / 5);
+        codes[6] = 0;
+        codes[7] = 255;
+    } else {
+        for (int i = 1;  i < 7;  ++i)
+            codes[1+i] = (unsigned char) (((7-i)*a0 + i*a1) / 7);
+    }
+    // 3-bit indices, 8 pixels to each group of 3 bytes
+    for (int half = 0;  half < 2;  ++half) {
+        const unsigned char *b = block + 2 + 3*half;
+        int bits = b[0] | (b[1] << 8) | (b[2] << 16);
+        for (int j = 0;  j < 8;  ++j)
+            dst[(8*half+j) * stride] = codes[(bits >> (3*j)) & 7];
+    }
+}
+
+
+
+// Decode a BC2 explicit 4-bit alpha block into 16 values, stored stride
+// bytes apart.
+inline void
+decode_explicit_alpha (const unsigned char *block, unsigned char *dst,
+                       int stride)
+{
+    for (int i = 0;  i < 8;  ++i) {
+        dst[(2*i) * stride] = (unsigned char) ((block[i] & 0x0f) * 17);
+        dst[(2*i+1) * stride] = (unsigned char) ((block[i] >> 4) * 17);
+    }
+}
+
+
+
+// Decode one block into its 16 pixels (rows of 4), with 4 (BC1-3), 1
+// (BC4) or 2 (BC5) bytes per pixel.
+inline void
+decode_block (int bcformat, const unsigned char *block, int *pixels)
+{
+    unsigned char *bytes = (unsigned char *) pixels;
+    switch (bcformat) {
+    case BC1:
+        decode_color_block (block, true, pixels);
+        break;
+    case BC2:
+        decode_color_block (block+8, false, pixels);
+        decode_explicit_alpha (block, bytes+3, 4);
+        break;
+    case BC3:
+        decode_color_block (block+8, false, pixels);
+        decode_alpha_block (block, bytes+3, 4);
+        break;
+    case BC4:
+        decode_alpha_block (block, bytes, 1);
+        break;
+    case BC5:
+        decode_alpha_block (block, bytes, 2);
+        decode_alpha_block (block+8, bytes+1, 2);
+        break;
+    }
+}
+
+
+
+// Task for internal_readimg: decode a range of rows of blocks of a
+// block-compressed image (whose slices, if it's a volume, are numbered
+// consecutively) into the whole image's pixels.
+struct BlockRowDecodeTask {
+    const unsigned char *src;    // All the blocks of the image
+    int bcformat;
+    int width, height, nchans;
+    bool unpremult;              // Undo DXT2/DXT4 premultiplied alpha?
+    int rbegin, rend;            // Rows of blocks to decode
+    unsigned char *dst;          // Pixel 0 of the image
+
+    void operator() () {
+        int bw = (width + 3) / 4, bh = (height + 3) / 4;
+        size_t blockbytes = bc_block_bytes (bcformat);
+        size_t ystride = size_t(width) * nchans;
+        int pixels[16];
+        for (int r = rbegin;  r < rend;  ++r) {
+            int z = r / bh, y0 = (r % bh) * 4;
+            int ny = std::min (4, height - y0);
+            const unsigned char *block = src + size_t(r) * bw * blockbytes;
+            unsigned char *row = dst + (size_t(z) * height + y0) * ystride;
+            for (int bx = 0;  bx < bw;  ++bx, block += blockbytes) {
+                decode_block (bcformat, block, pixels);
+                const unsigned char *p = (const unsigned char *) pixels;
+                int nx = std::min (4, width - bx*4);
+                for (int y = 0;  y < ny;  ++y)
+                    memcpy (row + y*ystride + bx*4*nchans,
+                            p + y*4*nchans, nx*nchans);
+            }
+            if (unpremult) {
+                for (size_t i = 0, e = ny * ystride;  i < e;  i += 4) {
+                    int a = row[i+3];
+                    if (a)
+                        for (int c = 0;  c < 3;  ++c)
+                            row[i+c] = (unsigned char)
+                                std::min (255, int(row[i+c]) * 255 / a);
+                }
+            }
+        }
+    }
+};
+
+}  // end anon namespace
+
+
+
 bool
 DDSInput::open (const std::string &name, ImageSpec &newspec)
 {
@@ -256,18 +444,44 @@ DDSInput::open (const std::string &name, ImageSpec &newspec)
         && m_dds.fmt.fourCC != DDS_4CC_DXT2
         && m_dds.fmt.fourCC != DDS_4CC_DXT3
         && m_dds.fmt.fourCC != DDS_4CC_DXT4
-        && m_dds.fmt.fourCC != DDS_4CC_DXT5) {
+        && m_dds.fmt.fourCC != DDS_4CC_DXT5
+        && m_dds.fmt.fourCC != DDS_4CC_ATI1
+        && m_dds.fmt.fourCC != DDS_4CC_BC4U
+        && m_dds.fmt.fourCC != DDS_4CC_ATI2
+        && m_dds.fmt.fourCC != DDS_4CC_BC5U) {
         error ("Unsupported compression type");
         return false;
     }
 
     // determine the number of channels we have
+    m_bcformat = 0;
+    m_Bpp = 0;
     if (m_dds.fmt.flags & DDS_PF_FOURCC) {
-        // squish decompresses everything to RGBA anyway
-        /*if (m_dds.fmt.fourCC == DDS_4CC_DXT1)
-            m_nchans = 3; // no alpha in DXT1
-        else*/
-            m_nchans = 4;
+        switch (m_dds.fmt.fourCC) {
+            case DDS_4CC_DXT1:
+                m_bcformat = BC1;
+                break;
+            // DXT2 and 3 are the same, only 2 has pre-multiplied alpha
+            case DDS_4CC_DXT2:
+            case DDS_4CC_DXT3:
+                m_bcformat = BC2;
+                break;
+            // DXT4 and 5 are the same, only 4 has pre-multiplied alpha
+            case DDS_4CC_DXT4:
+            case DDS_4CC_DXT5:
+                m_bcformat = BC3;
+                break;
+            case DDS_4CC_ATI1:
+            case DDS_4CC_BC4U:
+                m_bcformat = BC4;
+                break;
+            case DDS_4CC_ATI2:
+            case DDS_4CC_BC5U:
+                m_bcformat = BC5;
+                break;
+        }
+        // BC1-3 always decode to RGBA (DXT1 may have 1-bit alpha)
+        m_nchans = m_bcformat == BC4 ? 1 : (m_bcformat == BC5 ? 2 : 4);
     } else {
         m_nchans = ((m_dds.fmt.flags & DDS_PF_LUMINANCE) ? 1 : 3)
                 + ((m_dds.fmt.flags & DDS_PF_ALPHA) ? 1 : 0);
@@ -286,7 +500,7 @@ DDSInput::open (const std::string &name, ImageSpec &newspec)
         m_dds.pitch = m_dds.width * m_Bpp;
     if (!(m_dds.caps.flags2 & DDS_CAPS2_VOLUME))
         m_dds.depth = 1;
-    if (!(m_dds.flags & DDS_MIPMAPCOUNT))
+    if (!(m_dds.flags & DDS_MIPMAPCOUNT) || !m_dds.mipmaps)
         m_dds.mipmaps = 1;
     // count cube map faces
     if (m_dds.caps.flags2 & DDS_CAPS2_CUBEMAP) {
@@ -331,14 +545,26 @@ DDSInput::calc_shifts (int mask, int& left, int& right)
 
 
 
+size_t
+DDSInput::level_bytes (unsigned int w, unsigned int h, unsigned int d) const
+{
+    if (m_bcformat)
+        return size_t((w + 3) / 4) * ((h + 3) / 4) * d
+             * bc_block_bytes (m_bcformat);
+    return size_t(w) * h * d * m_Bpp;
+}
+
+
+
 // NOTE: This function has no sanity checks! It's a private method and relies
 // on the input being correct and valid!
 void
 DDSInput::internal_seek_subimage (int cubeface, int miplevel, unsigned int& w,
                                  unsigned int& h, unsigned int& d)
 {
+    bool cubemap = (m_dds.caps.flags2 & DDS_CAPS2_CUBEMAP);
     // early out for cubemaps that don't contain the requested face
-    if (m_dds.caps.flags2 & DDS_CAPS2_CUBEMAP
+    if (cubemap
         && !(m_dds.caps.flags2 & (DDS_CAPS2_CUBEMAP_POSITIVEX << cubeface))) {
         w = h = d = 0;
         return;
@@ -346,53 +572,28 @@ DDSInput::internal_seek_subimage (int cubeface, int miplevel, unsigned int& w,
     // we can easily calculate the offsets because both compressed and
     // uncompressed images have predictable length
     // calculate the offset; start with after the header
-    unsigned int ofs = 128;
-    unsigned int len;
+    size_t ofs = 128;
     // this loop is used to iterate over cube map sides, or run once in the
-    // case of ordinary 2D or 3D images
+    // case of ordinary 2D or 3D images; each face present in the file is
+    // stored with its whole mip chain before the next one
     for (int j = 0; j <= cubeface; j++) {
+        if (cubemap && j < cubeface
+            && !(m_dds.caps.flags2 & (DDS_CAPS2_CUBEMAP_POSITIVEX << j)))
+            continue;
         w = m_dds.width;
         h = m_dds.height;
         d = m_dds.depth;
-        // skip subimages preceding the one we're seeking to
-        // if we have no mipmaps, the modulo formula doesn't work and we
-        // don't skip at all, so just add the offset and continue
-        if (m_dds.mipmaps < 2) {
-            if (j > 0) {
-                if (m_dds.fmt.flags & DDS_PF_FOURCC)
-                    // only check for DXT1 - all other formats have same block
-                    // size
-                    len = squish::GetStorageRequirements(w, h,
-                        m_dds.fmt.fourCC == DDS_4CC_DXT1 ? squish::kDxt1
-                        : squish::kDxt5);
-                else
-                     len = w * h * d * m_Bpp;
-                ofs += len;
-            }
-            continue;
-        }
-        for (int i = 0; i < miplevel; i++) {
-            if (m_dds.fmt.flags & DDS_PF_FOURCC)
-                // only check for DXT1 - all other formats have same block size
-                len = squish::GetStorageRequirements(w, h,
-                    m_dds.fmt.fourCC == DDS_4CC_DXT1 ? squish::kDxt1
-                    : squish::kDxt5);
-            else
-                len = w * h * d * m_Bpp;
-            ofs += len;
-            w >>= 1;
-            if (!w)
-                w = 1;
-            h >>= 1;
-            if (!h)
-                h = 1;
-            d >>= 1;
-            if (!d)
-                d = 1;
+        // skip the mip levels preceding the one we're seeking to
+        int nlevels = j < cubeface ? int(m_dds.mipmaps) : miplevel;
+        for (int i = 0; i < nlevels; i++) {
+            ofs += level_bytes (w, h, d);
+            w = std::max (w >> 1, 1u);
+            h = std::max (h >> 1, 1u);
+            d = std::max (d >> 1, 1u);
         }
     }
     // seek to the offset we've found
-    fseek (m_file, ofs, SEEK_SET);
+    fseek (m_file, long(ofs), SEEK_SET);
 }
 
 
@@ -417,6 +618,7 @@ DDSInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
 
     // clear buffer so that readimage is called
     m_buf.clear();
+    m_face = -1;
 
     // for cube maps, the seek will be performed when reading a tile instead
     unsigned int w = 0, h = 0, d = 0;
@@ -425,7 +627,7 @@ DDSInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
         w = m_dds.width;
         h = m_dds.height;
         d = m_dds.depth;
-        for (int i = 1; i < miplevel; i++) {
+        for (int i = 0; i < miplevel; i++) {
             w >>= 1;
             if (w < 1)
                 w = 1;
@@ -517,53 +719,43 @@ DDSInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
 
 bool
 DDSInput::internal_readimg (unsigned char *dst, int w, int h, int d) {
-    if (m_dds.fmt.flags & DDS_PF_FOURCC) {
-        // compressed image
-        int flags = 0;
-        switch (m_dds.fmt.fourCC) {
-            case DDS_4CC_DXT1:
-                flags = squish::kDxt1;
-                break;
-            // DXT2 and 3 are the same, only 2 has pre-multiplied alpha
-            case DDS_4CC_DXT2:
-            case DDS_4CC_DXT3:
-                flags = squish::kDxt3;
-                break;
-            // DXT4 and 5 are the same, only 4 has pre-multiplied alpha
-            case DDS_4CC_DXT4:
-            case DDS_4CC_DXT5:
-                flags = squish::kDxt5;
-                break;
-        }
-        // create source buffer
-        std::vector<squish::u8> tmp(squish::GetStorageRequirements
-                                    (w, h, flags));
-        // load image into buffer
+    if (m_bcformat) {
+        // compressed image: read all the blocks, then decode them in
+        // parallel, a band of block rows per task
+        std::vector<unsigned char> tmp (level_bytes (w, h, d));
         if (! fread (&tmp[0], tmp.size(), 1))
             return false;
-        // decompress image
-        squish::DecompressImage (dst, w, h,
-                                 &tmp[0], flags);
-        tmp.clear();
-        // correct pre-multiplied alpha, if necessary
-        if (m_dds.fmt.fourCC == DDS_4CC_DXT2
-            || m_dds.fmt.fourCC == DDS_4CC_DXT4) {
-            int k;
-            for (int y = 0; y < h; y++) {
-                for (int x = 0; x < w; x++) {
-                    k = (y * w + x) * 4;
-                    dst[k + 0] =
-                        (unsigned char)((int)dst[k + 0] * 255
-                            / (int)dst[k + 3]);
-                    dst[k + 1] =
-                        (unsigned char)((int)dst[k + 1] * 255
-                            / (int)dst[k + 3]);
-                    dst[k + 2] =
-                        (unsigned char)((int)dst[k + 2] * 255
-                            / (int)dst[k + 3]);
-                }
-            }
+        BlockRowDecodeTask task;
+        task.src = &tmp[0];
+        task.bcformat = m_bcformat;
+        task.width = w;
+        task.height = h;
+        task.nchans = m_nchans;
+        task.unpremult = (m_dds.fmt.fourCC == DDS_4CC_DXT2
+                          || m_dds.fmt.fourCC == DDS_4CC_DXT4);
+        task.dst = dst;
+        int nrows = d * ((h + 3) / 4);
+        int nthreads = threads();
+        if (nthreads <= 0)
+            OIIO::getattribute ("threads", nthreads);
+        // Small images (like most MIP levels) aren't worth the overhead:
+        // give each task at least 4096 blocks
+        size_t nblocks = size_t(nrows) * ((w + 3) / 4);
+        nthreads = (int) std::min (size_t(nthreads), nblocks / 4096);
+        if (nthreads < 2) {
+            task.rbegin = 0;
+            task.rend = nrows;
+            task ();
+            return true;
         }
+        int per_task = (nrows + nthreads - 1) / nthreads;
+        task_set tasks;
+        for (int r = 0;  r < nrows;  r += per_task) {
+            task.rbegin = r;
+            task.rend = std::min (r + per_task, nrows);
+            tasks.push (task);
+        }
+        tasks.wait ();
     } else {
         // uncompressed image
         
@@ -642,8 +834,8 @@ DDSInput::read_native_scanline (int y, int z, void *data)
     // don't proceed if a cube map - use tiles then instead
     if (m_dds.caps.flags2 & DDS_CAPS2_CUBEMAP)
         return false;
-    if (m_buf.empty ())
-        readimg_scanlines ();
+    if (m_buf.empty () && ! readimg_scanlines ())
+        return false;
 
     size_t size = spec().scanline_bytes();
     memcpy (data, &m_buf[0] + z * m_spec.height * size + y * size, size);
@@ -655,35 +847,33 @@ DDSInput::read_native_scanline (int y, int z, void *data)
 bool
 DDSInput::read_native_tile (int x, int y, int z, void *data)
 {
-    // static ints to keep track of the current cube face and re-seek and
-    // re-read face
-    static int lastx = -1, lasty = -1, lastz = -1; 
     // don't proceed if not a cube map - use scanlines then instead
     if (!(m_dds.caps.flags2 & DDS_CAPS2_CUBEMAP))
         return false;
     // make sure we get the right dimensions
     if (x % m_spec.tile_width
         || y % m_spec.tile_height
-        || z % m_spec.tile_width)
+        || z % m_spec.tile_depth)
         return false;
-    if (m_buf.empty() || x != lastx || y != lasty || z != lastz) {
-        lastx = x;
-        lasty = y;
-        lastz = z;
-        unsigned int w = 0, h = 0, d = 0;
+    // each face is a tile; only seek and decode when it's a different
+    // face than the one we already hold
 #ifdef DDS_3X2_CUBE_MAP_LAYOUT
-        internal_seek_subimage (((x / m_spec.tile_width) << 1)
-                                + y / m_spec.tile_height,
-                                m_miplevel, w, h, d);
+    int face = ((x / m_spec.tile_width) << 1) + y / m_spec.tile_height;
 #else   // 1x6 layout
-        internal_seek_subimage (y / m_spec.tile_height,
-                                m_miplevel, w, h, d);
+    int face = y / m_spec.tile_height;
 #endif // DDS_3X2_CUBE_MAP_LAYOUT
-        if (!w && !h && !d)
+    if (m_buf.empty() || face != m_face) {
+        m_face = -1;
+        unsigned int w = 0, h = 0, d = 0;
+        internal_seek_subimage (face, m_miplevel, w, h, d);
+        if (!w && !h && !d) {
             // face not present in file, black-pad the image
-            memset (&m_buf[0], 0, m_spec.tile_bytes());
-        else
-            readimg_tiles ();
+            m_buf.assign (m_spec.tile_bytes(), 0);
+        } else if (! readimg_tiles ()) {
+            m_buf.clear ();
+            return false;
+        }
+        m_face = face;
     }
 
     memcpy (data, &m_buf[0], m_spec.tile_bytes());
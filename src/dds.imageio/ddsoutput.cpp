@@ -27,7 +27,6 @@
 
   (This is the Modified BSD License)
 */
-
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
@@ -38,6 +37,11 @@
 #include "OpenImageIO/typedesc.h"
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/fmath.h"
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/thread.h"
+
+#include "squish/squish.h"
+#include "squish/alpha.h"
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
 
@@ -48,20 +52,62 @@ public:
     DDSOutput ();
     virtual ~DDSOutput ();
     virtual const char * format_name (void) const { return "dds"; }
+    virtual int supports (string_view feature) const {
+        // Tiles are emulated by buffering the whole MIP level.
+        return (feature == "tiles" || feature == "mipmap" ||
+                feature == "alpha");
+    }
     virtual bool open (const std::string &name, const ImageSpec &spec,
                        OpenMode mode);
     virtual bool close ();
     virtual bool write_scanline (int y, int z, TypeDesc format,
                                  const void *data, stride_t xstride);
+    virtual bool write_tile (int x, int y, int z, TypeDesc format,
+                             const void *data, stride_t xstride,
+                             stride_t ystride, stride_t zstride);
 
 private:
     std::string m_filename;           ///< Stash the filename
     FILE *m_file;                     ///< Open image handle
     std::vector<unsigned char> m_scratch;
+    std::vector<unsigned char> m_buf; ///< Pixels of the current MIP level
+    int m_bcformat;                   ///< Block compression, or 0 if none
+    int m_squishflags;                ///< Fit quality flags for squish
+    int m_nmiplevels;                 ///< MIP levels opened so far
+    int m_toplevel_width, m_toplevel_height;
+    unsigned int m_dither;
 
     // Initialize private members to pre-opened state
     void init (void) {
         m_file = NULL;
+        m_bcformat = 0;
+        m_nmiplevels = 0;
+        std::vector<unsigned char>().swap (m_buf);
+    }
+
+    /// Helper: (re)write the file header, for the top level's size and
+    /// the number of MIP levels written.
+    bool write_header ();
+
+    /// Helper: encode the buffered pixels of the current level and
+    /// append them to the file.
+    bool write_level ();
+
+    /// Helper: write, with error detection
+    ///
+    bool fwrite (const void *buf, size_t itemsize, size_t nitems) {
+        size_t n = ::fwrite (buf, itemsize, nitems, m_file);
+        if (n != nitems)
+            error ("Write error");
+        return n == nitems;
+    }
+
+    /// Helper: write a little-endian 32 bit value
+    ///
+    bool write_u32 (uint32_t val) {
+        if (bigendian())
+            swap_endian (&val);
+        return fwrite (&val, sizeof (val), 1);
     }
 };
 
@@ -83,6 +129,71 @@ OIIO_PLUGIN_EXPORTS_END
 
 
 
+namespace {
+
+// Task for write_level: compress a range of rows of blocks of an 8-bit
+// image with 1-4 channels.  Pixels of partial blocks at the right and
+// bottom edges are masked out of the fit.
+struct BlockRowEncodeTask {
+    const unsigned char *src;    // Pixel 0 of the image
+    int width, height, nchans;
+    int bcformat, squishflags;
+    int rbegin, rend;            // Rows of blocks to encode
+    unsigned char *dst;          // Block 0 of the compressed image
+
+    void operator() () {
+        int bw = (width + 3) / 4;
+        size_t blockbytes = bc_block_bytes (bcformat);
+        unsigned char rgba[64], other[64];
+        for (int r = rbegin;  r < rend;  ++r) {
+            unsigned char *block = dst + size_t(r) * bw * blockbytes;
+            for (int bx = 0;  bx < bw;  ++bx, block += blockbytes) {
+                int mask = 0;
+                memset (rgba, 0, sizeof(rgba));
+                memset (other, 0, sizeof(other));
+                for (int py = 0;  py < 4;  ++py) {
+                    int y = r*4 + py;
+                    for (int px = 0;  px < 4;  ++px) {
+                        int x = bx*4 + px;
+                        if (x >= width || y >= height)
+                            continue;
+                        int i = py*4 + px;
+                        mask |= 1 << i;
+                        const unsigned char *p = src +
+                            (size_t(y) * width + x) * nchans;
+                        unsigned char *q = rgba + 4*i;
+                        if (bcformat >= BC4) {
+                            // One channel (two for BC5) in the alpha slot,
+                            // which is all squish's BC3 alpha fit looks at
+                            q[3] = p[0];
+                            other[4*i+3] = nchans > 1 ? p[1] : 0;
+                        } else if (nchans >= 3) {
+                            q[0] = p[0];  q[1] = p[1];  q[2] = p[2];
+                            q[3] = nchans > 3 ? p[3] : 255;
+                        } else {
+                            // Gray, or gray + alpha
+                            q[0] = q[1] = q[2] = p[0];
+                            q[3] = nchans > 1 ? p[1] : 255;
+                        }
+                    }
+                }
+                if (bcformat == BC4) {
+                    squish::CompressAlphaDxt5 (rgba, mask, block);
+                } else if (bcformat == BC5) {
+                    squish::CompressAlphaDxt5 (rgba, mask, block);
+                    squish::CompressAlphaDxt5 (other, mask, block + 8);
+                } else {
+                    squish::CompressMasked (rgba, mask, block, squishflags);
+                }
+            }
+        }
+    }
+};
+
+}  // end anon namespace
+
+
+
 DDSOutput::DDSOutput ()
 {
     init ();
@@ -102,9 +213,239 @@ bool
 DDSOutput::open (const std::string &name, const ImageSpec &userspec,
                  OpenMode mode)
 {
-    error ("DDS writing is not supported yet, please poke Leszek in the "
-        "mailing list");
-    return false;
+    if (mode == AppendSubimage) {
+        error ("%s does not support subimages", format_name());
+        return false;
+    }
+
+    if (mode == AppendMIPLevel) {
+        // Each level must halve the previous one, down to 1x1
+        if (! m_file) {
+            error ("Cannot append a MIP level to a file that isn't open");
+            return false;
+        }
+        int w = std::max (1, m_spec.width / 2);
+        int h = std::max (1, m_spec.height / 2);
+        if (userspec.width != w || userspec.height != h ||
+            userspec.nchannels != m_spec.nchannels) {
+            error ("%s MIP level %d must be %dx%d with %d channels",
+                   format_name(), m_nmiplevels, w, h, m_spec.nchannels);
+            return false;
+        }
+        if (! write_level ())
+            return false;
+        int bcformat = m_bcformat, squishflags = m_squishflags;
+        m_spec = userspec;
+        m_spec.set_format (TypeDesc::UINT8);
+        m_bcformat = bcformat;
+        m_squishflags = squishflags;
+        m_buf.assign (m_spec.image_bytes(), 0);
+        ++m_nmiplevels;
+        return true;
+    }
+
+    close ();  // Close any already-opened file
+    m_spec = userspec;  // Stash the spec
+    m_filename = name;
+
+    if (m_spec.depth > 1) {
+        error ("%s does not support volume images", format_name());
+        return false;
+    }
+    if (m_spec.nchannels < 1 || m_spec.nchannels > 4) {
+        error ("%s does not support %d-channel images", format_name(),
+               m_spec.nchannels);
+        return false;
+    }
+    m_spec.set_format (TypeDesc::UINT8);
+    m_dither = m_spec.get_int_attribute ("oiio:dither", 0);
+
+    // "compression" picks the block format: "none" (the default), or
+    // "dxt1"/"bc1", "dxt3"/"bc2", "dxt5"/"bc3", "ati1"/"bc4", or
+    // "ati2"/"bc5".  DXT2 and DXT4 are written as DXT3 and DXT5, since
+    // we don't premultiply.
+    std::string compression = m_spec.get_string_attribute ("compression");
+    m_bcformat = 0;
+    if (Strutil::iequals (compression, "dxt1") ||
+        Strutil::iequals (compression, "bc1"))
+        m_bcformat = BC1;
+    else if (Strutil::iequals (compression, "dxt2") ||
+             Strutil::iequals (compression, "dxt3") ||
+             Strutil::iequals (compression, "bc2"))
+        m_bcformat = BC2;
+    else if (Strutil::iequals (compression, "dxt4") ||
+             Strutil::iequals (compression, "dxt5") ||
+             Strutil::iequals (compression, "bc3"))
+        m_bcformat = BC3;
+    else if (Strutil::iequals (compression, "ati1") ||
+             Strutil::iequals (compression, "bc4") ||
+             Strutil::iequals (compression, "bc4u"))
+        m_bcformat = BC4;
+    else if (Strutil::iequals (compression, "ati2") ||
+             Strutil::iequals (compression, "bc5") ||
+             Strutil::iequals (compression, "bc5u"))
+        m_bcformat = BC5;
+    else if (compression.size() && ! Strutil::iequals (compression, "none")) {
+        error ("%s does not support \"%s\" compression", format_name(),
+               compression);
+        return false;
+    }
+
+    // "CompressionQuality" trades speed for fidelity of the BC1-3 color
+    // fit: up to 33 is a quick range fit, up to 90 (or unspecified) a
+    // cluster fit, and above that an iterative cluster fit.
+    int quality = m_spec.get_int_attribute ("CompressionQuality", 90);
+    m_squishflags = quality <= 33 ? squish::kColourRangeFit
+                  : (quality <= 90 ? squish::kColourClusterFit
+                                   : squish::kColourIterativeClusterFit);
+    m_squishflags |= (m_bcformat == BC1 ? squish::kDxt1
+                      : (m_bcformat == BC2 ? squish::kDxt3 : squish::kDxt5));
+
+    m_file = Filesystem::fopen (name, "wb");
+    if (! m_file) {
+        error ("Could not open file \"%s\"", name.c_str());
+        return false;
+    }
+    m_toplevel_width = m_spec.width;
+    m_toplevel_height = m_spec.height;
+    m_nmiplevels = 1;
+    if (! write_header ()) {
+        close ();
+        return false;
+    }
+    m_buf.assign (m_spec.image_bytes(), 0);
+    return true;
+}
+
+
+
+bool
+DDSOutput::write_header ()
+{
+    int nchans = m_spec.nchannels;
+    bool alpha = (nchans == 2 || nchans == 4);
+    uint32_t flags = DDS_CAPS | DDS_HEIGHT | DDS_WIDTH | DDS_PIXELFORMAT;
+    uint32_t pitch, fourCC = 0, pfflags, bpp = 0;
+    uint32_t rmask = 0, gmask = 0, bmask = 0, amask = 0;
+    if (m_bcformat) {
+        flags |= DDS_LINEARSIZE;
+        pitch = uint32_t(((m_toplevel_width + 3) / 4)
+                         * ((m_toplevel_height + 3) / 4)
+                         * bc_block_bytes (m_bcformat));
+        static const uint32_t codes[] = { 0, DDS_4CC_DXT1, DDS_4CC_DXT3,
+                                          DDS_4CC_DXT5, DDS_4CC_ATI1,
+                                          DDS_4CC_ATI2 };
+        fourCC = codes[m_bcformat];
+        pfflags = DDS_PF_FOURCC;
+    } else {
+        // Uncompressed: gray (+ alpha) as luminance, color as BGR(A)
+        flags |= DDS_PITCH;
+        bpp = 8 * nchans;
+        pitch = uint32_t(m_toplevel_width * nchans);
+        if (nchans <= 2) {
+            pfflags = DDS_PF_LUMINANCE;
+            rmask = 0xff;
+            amask = alpha ? 0xff00 : 0;
+        } else {
+            pfflags = DDS_PF_RGB;
+            rmask = 0x00ff0000;
+            gmask = 0x0000ff00;
+            bmask = 0x000000ff;
+            amask = alpha ? 0xff000000 : 0;
+        }
+        if (alpha)
+            pfflags |= DDS_PF_ALPHA;
+    }
+    uint32_t caps1 = DDS_CAPS1_TEXTURE;
+    if (m_nmiplevels > 1) {
+        flags |= DDS_MIPMAPCOUNT;
+        caps1 |= DDS_CAPS1_COMPLEX | DDS_CAPS1_MIPMAP;
+    }
+
+    if (fseek (m_file, 0, SEEK_SET) != 0) {
+        error ("Could not seek to the header");
+        return false;
+    }
+    bool ok = write_u32 (DDS_MAKE4CC('D', 'D', 'S', ' '))
+        && write_u32 (124) && write_u32 (flags)
+        && write_u32 (m_toplevel_height) && write_u32 (m_toplevel_width)
+        && write_u32 (pitch) && write_u32 (0) && write_u32 (m_nmiplevels);
+    // 11 reserved fields
+    for (int i = 0;  i < 11 && ok;  ++i)
+        ok &= write_u32 (0);
+    // pixel format struct
+    ok = ok && write_u32 (32) && write_u32 (pfflags)
+        && fwrite (&fourCC, sizeof (fourCC), 1) && write_u32 (bpp)
+        && write_u32 (rmask) && write_u32 (gmask) && write_u32 (bmask)
+        && write_u32 (amask);
+    // caps, then caps3, caps4 and one more reserved field
+    ok = ok && write_u32 (caps1) && write_u32 (0)
+        && write_u32 (0) && write_u32 (0) && write_u32 (0);
+    return ok;
+}
+
+
+
+bool
+DDSOutput::write_level ()
+{
+    int w = m_spec.width, h = m_spec.height, nchans = m_spec.nchannels;
+    if (fseek (m_file, 0, SEEK_END) != 0) {
+        error ("Could not seek to the end of the file");
+        return false;
+    }
+
+    if (! m_bcformat) {
+        if (nchans <= 2)   // luminance (+ alpha) is stored as is
+            return fwrite (&m_buf[0], m_buf.size(), 1);
+        // color is stored as BGR(A)
+        std::vector<unsigned char> row (size_t(w) * nchans);
+        for (int y = 0;  y < h;  ++y) {
+            const unsigned char *p = &m_buf[size_t(y) * w * nchans];
+            for (int x = 0;  x < w;  ++x, p += nchans) {
+                unsigned char *q = &row[size_t(x) * nchans];
+                q[0] = p[2];  q[1] = p[1];  q[2] = p[0];
+                if (nchans == 4)
+                    q[3] = p[3];
+            }
+            if (! fwrite (&row[0], row.size(), 1))
+                return false;
+        }
+        return true;
+    }
+
+    // Compress the rows of blocks in parallel bands
+    int bw = (w + 3) / 4, bh = (h + 3) / 4;
+    std::vector<unsigned char> blocks (size_t(bw) * bh
+                                       * bc_block_bytes (m_bcformat));
+    BlockRowEncodeTask task;
+    task.src = &m_buf[0];
+    task.width = w;
+    task.height = h;
+    task.nchans = nchans;
+    task.bcformat = m_bcformat;
+    task.squishflags = m_squishflags;
+    task.dst = &blocks[0];
+    int nthreads = threads();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    // Fitting is slow enough that 256 blocks are worth a task
+    nthreads = (int) std::min (size_t(nthreads), size_t(bw) * bh / 256);
+    if (nthreads < 2) {
+        task.rbegin = 0;
+        task.rend = bh;
+        task ();
+    } else {
+        int per_task = (bh + nthreads - 1) / nthreads;
+        task_set tasks;
+        for (int r = 0;  r < bh;  r += per_task) {
+            task.rbegin = r;
+            task.rend = std::min (r + per_task, bh);
+            tasks.push (task);
+        }
+        tasks.wait ();
+    }
+    return fwrite (&blocks[0], blocks.size(), 1);
 }
 
 
@@ -112,7 +453,20 @@ DDSOutput::open (const std::string &name, const ImageSpec &userspec,
 bool
 DDSOutput::close ()
 {
-    return false;
+    if (! m_file) {   // already closed
+        init ();
+        return true;
+    }
+
+    // Write the last level, then fix up the header's MIP level count
+    bool ok = m_buf.size() ? write_level () : false;
+    if (ok && m_nmiplevels > 1)
+        ok = write_header ();
+    fclose (m_file);
+    m_file = NULL;
+
+    init ();      // re-initialize
+    return ok;
 }
 
 
@@ -121,7 +475,29 @@ bool
 DDSOutput::write_scanline (int y, int z, TypeDesc format,
                             const void *data, stride_t xstride)
 {
-    return false;
+    y -= m_spec.y;
+    if (y < 0 || y >= m_spec.height) {
+        error ("Attempt to write scanline %d out of range", y + m_spec.y);
+        return false;
+    }
+    m_spec.auto_stride (xstride, format, spec().nchannels);
+    data = to_native_scanline (format, data, xstride, m_scratch,
+                               m_dither, y, z);
+    memcpy (&m_buf[y * m_spec.scanline_bytes()], data,
+            m_spec.scanline_bytes());
+    return true;
+}
+
+
+
+bool
+DDSOutput::write_tile (int x, int y, int z, TypeDesc format,
+                       const void *data, stride_t xstride,
+                       stride_t ystride, stride_t zstride)
+{
+    // Emulate tiles by buffering the whole level
+    return copy_tile_to_image_buffer (x, y, z, format, data, xstride,
+                                      ystride, zstride, &m_buf[0]);
 }
 
 OIIO_PLUGIN_NAMESPACE_END
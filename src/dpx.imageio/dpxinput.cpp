@@ -28,30 +28,123 @@
   (This is the Modified BSD License)
 */
 
+#include <OpenEXR/half.h>   // before simd.h, for float4 <-> half
+
 #include "libdpx/DPX.h"
 #include "libdpx/DPXColorConverter.h"
+#include "libdpx/EndianSwap.h"
 #include <OpenEXR/ImfTimeCode.h> //For TimeCode support
 
 #include "OpenImageIO/typedesc.h"
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/fmath.h"
+#include "OpenImageIO/simd.h"
 #include "OpenImageIO/strutil.h"
 #include <iomanip>
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
 
 
+namespace {
+
+// Store four 10-bit values as 16 bits, the way libdpx widens them (the
+// high bits replicated into the low ones), or as that 16 bit value
+// converted to float or half.
+inline void
+store_10bit (const simd::int4 &v, unsigned short *out)
+{
+    ((v << 6) | srl (v, 4)).store (out);
+}
+
+inline void
+store_10bit (const simd::int4 &v, float *out)
+{
+    (simd::float4 ((v << 6) | srl (v, 4)) * simd::float4 (1.0f/65535.0f)).store (out);
+}
+
+inline void
+store_10bit (const simd::int4 &v, half *out)
+{
+    (simd::float4 ((v << 6) | srl (v, 4)) * simd::float4 (1.0f/65535.0f)).store (out);
+}
+
+inline void
+store_10bit (unsigned int v, unsigned short *out)
+{
+    *out = (unsigned short) ((v << 6) | (v >> 4));
+}
+
+inline void
+store_10bit (unsigned int v, float *out)
+{
+    *out = ((v << 6) | (v >> 4)) * (1.0f/65535.0f);
+}
+
+inline void
+store_10bit (unsigned int v, half *out)
+{
+    *out = ((v << 6) | (v >> 4)) * (1.0f/65535.0f);
+}
+
+
+
+// Unpack nvals datums of a line of 10-bit "filled" DPX data -- three
+// datums to a 32 bit word, the first in the high bits, with method A's
+// two padding bits at the bottom (padbits=2) or method B's at the top
+// (padbits=0).  libdpx reads single-channel files with the datums of a
+// word in the opposite order, so 'reversed' does the same.
+template<typename T>
+void
+unpack_10bit_filled (const unsigned int *words, T *out, int nvals,
+                     int padbits, bool reversed)
+{
+    int shift[3] = { 20+padbits, 10+padbits, padbits };
+    if (reversed)
+        std::swap (shift[0], shift[2]);
+    // The vector shifts only take one count for all lanes, so a datum is
+    // moved to the top of its word by multiplying, then down to the
+    // bottom with a single shift.  Four words hold 12 datums.
+    int m0 = 1 << (22-shift[0]), m1 = 1 << (22-shift[1]), m2 = 1 << (22-shift[2]);
+    simd::int4 mul0 (m0, m1, m2, m0);
+    simd::int4 mul1 (m1, m2, m0, m1);
+    simd::int4 mul2 (m2, m0, m1, m2);
+    int i = 0;
+    for ( ;  i + 12 <= nvals;  i += 12, words += 4, out += 12) {
+        simd::int4 w ((const int *)words);
+        store_10bit (srl (simd::shuffle<0,0,0,1>(w) * mul0, 22), out);
+        store_10bit (srl (simd::shuffle<1,1,2,2>(w) * mul1, 22), out+4);
+        store_10bit (srl (simd::shuffle<2,3,3,3>(w) * mul2, 22), out+8);
+    }
+    for (int j = 0;  i < nvals;  ++i, ++j)
+        store_10bit ((words[j/3] >> shift[j%3]) & 0x3ff, out+j);
+}
+
+}  // anon namespace
+
+
+
 class DPXInput : public ImageInput {
 public:
     DPXInput () : m_stream(NULL), m_dataPtr(NULL) { init(); }
     virtual ~DPXInput () { close(); }
     virtual const char * format_name (void) const { return "dpx"; }
+    virtual int supports (string_view feature) const {
+        return (feature == "random_access");
+    }
     virtual bool valid_file (const std::string &filename) const;
     virtual bool open (const std::string &name, ImageSpec &newspec);
+    virtual bool open (const std::string &name, ImageSpec &newspec,
+                       const ImageSpec &config);
     virtual bool close ();
     virtual int current_subimage (void) const { return m_subimage; }
     virtual bool seek_subimage (int subimage, int miplevel, ImageSpec &newspec);
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
+    virtual bool read_scanlines (int ybegin, int yend, int z,
+                                 int chbegin, int chend,
+                                 TypeDesc format, void *data,
+                                 stride_t xstride, stride_t ystride);
 
 private:
     int m_subimage;
@@ -59,7 +152,9 @@ private:
     dpx::Reader m_dpx;
     std::vector<unsigned char> m_userBuf;
     bool m_wantRaw;
+    bool m_headerOnly;     // Caller only wants the spec, not the pixels
     unsigned char *m_dataPtr;
+    std::vector<unsigned int> m_packed;   // Packed words of a band of lines
 
     /// Reset everything to initial state
     ///
@@ -72,8 +167,19 @@ private:
         delete m_dataPtr;
         m_dataPtr = NULL;
         m_userBuf.clear ();
+        m_headerOnly = false;
     }
 
+    /// Is the current element 10-bit filled data that we can unpack
+    /// ourselves, a whole band of scanlines at a time?
+    bool is_10bit_filled () const;
+
+    /// Read scanlines [ybegin,yend) of 10-bit filled data with a single
+    /// read, and unpack them into data as T (unsigned short, float, or
+    /// half).  No color conversion is done.
+    template<typename T>
+    bool read_10bit_filled (int ybegin, int yend, T *data);
+
     /// Helper function - retrieve string for libdpx characteristic
     ///
     std::string get_characteristic_string (dpx::Characteristic c);
@@ -152,6 +258,18 @@ DPXInput::open (const std::string &name, ImageSpec &newspec)
 
 
 
+bool
+DPXInput::open (const std::string &name, ImageSpec &newspec,
+                const ImageSpec &config)
+{
+    // "oiio:HeaderOnly" promises that the pixels won't be read, so we
+    // needn't allocate the buffers for converting them.
+    m_headerOnly = config.get_int_attribute ("oiio:HeaderOnly", 0) != 0;
+    return open (name, newspec);
+}
+
+
+
 bool
 DPXInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
 {
@@ -588,7 +706,7 @@ DPXInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
     if (bufsize == 0 && !m_wantRaw) {
         error ("Unable to deliver RGB data from source data");
         return false;
-    } else if (!m_wantRaw && bufsize > 0)
+    } else if (!m_wantRaw && bufsize > 0 && !m_headerOnly)
         m_dataPtr = new unsigned char[bufsize];
     else
         // no need to allocate another buffer
@@ -612,6 +730,10 @@ DPXInput::close ()
 bool
 DPXInput::read_native_scanline (int y, int z, void *data)
 {
+    if (m_headerOnly) {
+        error ("DPX file was opened for its header only");
+        return false;
+    }
     dpx::Block block(0, y-m_spec.y, m_dpx.header.Width () - 1, y-m_spec.y);
 
     if (m_wantRaw) {
@@ -634,6 +756,113 @@ DPXInput::read_native_scanline (int y, int z, void *data)
 
 
 
+bool
+DPXInput::is_10bit_filled () const
+{
+    const dpx::Header &header (m_dpx.header);
+    return header.BitDepth (m_subimage) == 10 &&
+        header.ComponentDataSize (m_subimage) == dpx::kWord &&
+        header.ImageEncoding (m_subimage) != dpx::kRLE &&
+        header.EndOfLinePadding (m_subimage) == 0 &&
+        (header.ImagePacking (m_subimage) == dpx::kFilledMethodA ||
+         header.ImagePacking (m_subimage) == dpx::kFilledMethodB) &&
+        (m_wantRaw || m_dataPtr == NULL);  // No separate RGB buffer
+}
+
+
+
+template<typename T>
+bool
+DPXInput::read_10bit_filled (int ybegin, int yend, T *data)
+{
+    const dpx::Header &header (m_dpx.header);
+    const int datums = header.Width () * header.ImageElementComponentCount (m_subimage);
+    const size_t linewords = (datums + 2) / 3;
+    const size_t nwords = linewords * (yend - ybegin);
+    m_packed.resize (nwords);
+    long offset = header.DataOffset (m_subimage)
+                + long (ybegin - m_spec.y) * long (linewords * 4);
+    if (! m_stream->Seek (offset, InStream::kStart) ||
+        m_stream->ReadDirect (&m_packed[0], nwords * 4) != nwords * 4)
+        return false;
+    if (header.RequiresByteSwap ())
+        dpx::EndianSwapImageBuffer<dpx::kInt> (&m_packed[0], int (nwords));
+    int padbits = (header.ImagePacking (m_subimage) == dpx::kFilledMethodA) ? 2 : 0;
+    bool reversed = (header.ImageElementComponentCount (m_subimage) == 1);
+    for (int y = 0;  y < yend - ybegin;  ++y)
+        unpack_10bit_filled (&m_packed[y * linewords], data + size_t(y) * datums,
+                             datums, padbits, reversed);
+    return true;
+}
+
+
+
+bool
+DPXInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
+{
+    if (m_headerOnly) {
+        error ("DPX file was opened for its header only");
+        return false;
+    }
+    yend = std::min (yend, m_spec.y + m_spec.height);
+    if (ybegin >= yend)
+        return true;
+    if (is_10bit_filled ()) {
+        if (! read_10bit_filled (ybegin, yend, (unsigned short *)data))
+            return false;
+    } else if (m_wantRaw || m_dataPtr == NULL) {
+        // Let libdpx read the whole band at once (a single read, if the
+        // data needs no unpacking)
+        dpx::Block block (0, ybegin - m_spec.y, m_dpx.header.Width () - 1,
+                          yend - 1 - m_spec.y);
+        if (! m_dpx.ReadBlock (m_subimage, (unsigned char *)data, block))
+            return false;
+    } else {
+        // Needs a separate buffer for the RGB conversion -- one line at a time
+        return ImageInput::read_native_scanlines (ybegin, yend, z, data);
+    }
+    if (! m_wantRaw) {
+        // In place conversion (a no-op for RGB and RGBA)
+        dpx::Block block (0, ybegin - m_spec.y, m_dpx.header.Width () - 1,
+                          yend - 1 - m_spec.y);
+        if (! dpx::ConvertToRGB (m_dpx.header, m_subimage, data, data, block))
+            return false;
+    }
+    return true;
+}
+
+
+
+bool
+DPXInput::read_scanlines (int ybegin, int yend, int z,
+                          int chbegin, int chend,
+                          TypeDesc format, void *data,
+                          stride_t xstride, stride_t ystride)
+{
+    // 10-bit RGB(A) that is wanted as float or half (and contiguous) is
+    // unpacked straight into the caller's buffer, skipping the trip
+    // through 16 bits.
+    chend = clamp (chend, chbegin+1, m_spec.nchannels);
+    yend = std::min (yend, m_spec.y + m_spec.height);
+    dpx::Descriptor desc = m_dpx.header.ImageDescriptor (m_subimage);
+    stride_t pixelbytes = stride_t (format.size() * m_spec.nchannels);
+    if ((format == TypeDesc::FLOAT || format == TypeDesc::HALF) &&
+        chbegin == 0 && chend == m_spec.nchannels &&
+        (xstride == AutoStride || xstride == pixelbytes) &&
+        (ystride == AutoStride || ystride == pixelbytes * m_spec.width) &&
+        is_10bit_filled () &&
+        (m_wantRaw || desc == dpx::kRGB || desc == dpx::kRGBA) &&
+        ybegin < yend) {
+        return format == TypeDesc::FLOAT
+            ? read_10bit_filled (ybegin, yend, (float *)data)
+            : read_10bit_filled (ybegin, yend, (half *)data);
+    }
+    return ImageInput::read_scanlines (ybegin, yend, z, chbegin, chend,
+                                       format, data, xstride, ystride);
+}
+
+
+
 std::string
 DPXInput::get_characteristic_string (dpx::Characteristic c)
 {
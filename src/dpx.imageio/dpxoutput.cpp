@@ -35,11 +35,14 @@
 
 #include "libdpx/DPX.h"
 #include "libdpx/DPXColorConverter.h"
+#include "libdpx/EndianSwap.h"
 
 #include "OpenImageIO/typedesc.h"
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/fmath.h"
+#include "OpenImageIO/simd.h"
 #include "OpenImageIO/strutil.h"
+#include "OpenImageIO/thread.h"
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
 
@@ -74,6 +77,12 @@ public:
     virtual bool write_tile (int x, int y, int z, TypeDesc format,
                              const void *data, stride_t xstride,
                              stride_t ystride, stride_t zstride);
+    virtual bool write_image (TypeDesc format, const void *data,
+                              stride_t xstride=AutoStride,
+                              stride_t ystride=AutoStride,
+                              stride_t zstride=AutoStride,
+                              ProgressCallback progress_callback=NULL,
+                              void *progress_callback_data=NULL);
 
 private:
     OutStream *m_stream;
@@ -115,6 +124,13 @@ private:
     // flush the pending buffer
     bool write_buffer ();
 
+    // Is the current subimage 10-bit "filled" data that we can pack
+    // ourselves rather than a line at a time through libdpx?
+    bool is_10bit_filled () const;
+
+    // Pack the buffered 10-bit subimage in parallel and write it at once.
+    bool write_10bit_filled ();
+
     bool prep_subimage (int s, bool allocate);
 
     /// Helper function - retrieve libdpx descriptor for string
@@ -133,6 +149,64 @@ private:
 
 
 
+namespace {
+
+// Pack nvals 16 bit values, keeping their high 10 bits, into a line of
+// "filled" DPX words -- three datums to a 32 bit word, the first in the
+// low bits, or in the high bits if 'reversed', with method A's two
+// padding bits at the bottom (padbits=2) or method B's at the top
+// (padbits=0).  This matches libdpx's WritePackedMethodAB_10bit.
+void
+pack_10bit_filled (const unsigned short *in, unsigned int *words,
+                   int nvals, int padbits, bool reversed)
+{
+    int shift[3] = { padbits, 10+padbits, 20+padbits };
+    if (reversed)
+        std::swap (shift[0], shift[2]);
+    // Gathering every third value lines up the datums that share a
+    // position in four consecutive words, so each takes a single shift.
+    int i = 0;
+    for ( ;  i + 12 <= nvals;  i += 12, in += 12, words += 4) {
+        simd::int4 d0 (in[0], in[3], in[6], in[9]);
+        simd::int4 d1 (in[1], in[4], in[7], in[10]);
+        simd::int4 d2 (in[2], in[5], in[8], in[11]);
+        simd::int4 w = (srl (d0, 6) << shift[0]) | (srl (d1, 6) << shift[1])
+                     | (srl (d2, 6) << shift[2]);
+        w.store ((int *)words);
+    }
+    for (int j = 0;  i < nvals;  ++i, ++j) {
+        if (j % 3 == 0)
+            words[j/3] = 0;
+        words[j/3] |= (unsigned int)(in[j] >> 6) << shift[j%3];
+    }
+}
+
+
+
+// Pack rows [ybegin,yend) of the subimage buffer.
+struct DPXPackTask {
+    const unsigned char *src;
+    size_t srcrowbytes;
+    unsigned int *dst;
+    int linewords, nvals, padbits;
+    bool reversed, swap;
+    int ybegin, yend;
+
+    void operator() () {
+        for (int y = ybegin;  y < yend;  ++y) {
+            unsigned int *line = dst + size_t(y) * linewords;
+            pack_10bit_filled ((const unsigned short *)(src + y * srcrowbytes),
+                               line, nvals, padbits, reversed);
+            if (swap)
+                dpx::EndianSwapImageBuffer<dpx::kInt> (line, linewords);
+        }
+    }
+};
+
+}  // anon namespace
+
+
+
 // Obligatory material to make this a recognizeable imageio plugin:
 OIIO_PLUGIN_EXPORTS_BEGIN
 
@@ -552,10 +626,80 @@ DPXOutput::prep_subimage (int s, bool allocate)
 bool
 DPXOutput::write_buffer ()
 {
+    bool ok = true;
     if (m_write_pending) {
-        m_dpx.WriteElement (m_subimage, &m_buf[0], m_datasize);
+        if (is_10bit_filled ())
+            ok = write_10bit_filled ();
+        else
+            m_dpx.WriteElement (m_subimage, &m_buf[0], m_datasize);
         m_write_pending = false;
     }
+    return ok;
+}
+
+
+
+bool
+DPXOutput::is_10bit_filled () const
+{
+    const dpx::Header &header (m_dpx.header);
+    int noc = header.ImageElementComponentCount (m_subimage);
+    return m_bitdepth == 10 && m_datasize == dpx::kWord
+        && (m_packing == dpx::kFilledMethodA || m_packing == dpx::kFilledMethodB)
+        && header.ImageEncoding (m_subimage) != dpx::kRLE
+        && header.EndOfLinePadding (m_subimage) == 0
+        && header.EndOfImagePadding (m_subimage) == 0
+        && m_bytes >= m_spec.width * noc * 2;
+}
+
+
+
+bool
+DPXOutput::write_10bit_filled ()
+{
+    const dpx::Header &header (m_dpx.header);
+    int noc = header.ImageElementComponentCount (m_subimage);
+    DPXPackTask task;
+    task.src = &m_buf[0];
+    task.srcrowbytes = m_bytes;
+    task.nvals = m_spec.width * noc;
+    task.linewords = (task.nvals + 2) / 3;
+    task.padbits = (m_packing == dpx::kFilledMethodA) ? 2 : 0;
+    // Same datum order as libdpx: swapped for RGB, and again (it says
+    // the order is otherwise wrong) for four channels.
+    task.reversed = (header.ImageDescriptor (m_subimage) == dpx::kRGB
+                     && header.DatumSwap (m_subimage));
+    if (noc == 4)
+        task.reversed = !task.reversed;
+    task.swap = header.RequiresByteSwap ();
+    std::vector<unsigned int> packed (size_t(task.linewords) * m_spec.height);
+    task.dst = &packed[0];
+
+    int nthreads = threads();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    int height = m_spec.height;
+    nthreads = std::max (nthreads, 1);
+    int rows_per_task = std::max (64, (height + nthreads - 1) / nthreads);
+    if (rows_per_task >= height) {
+        task.ybegin = 0;
+        task.yend = height;
+        task ();
+    } else {
+        task_set tasks;
+        for (int y = 0;  y < height;  y += rows_per_task) {
+            task.ybegin = y;
+            task.yend = std::min (y + rows_per_task, height);
+            tasks.push (task);
+        }
+        tasks.wait ();
+    }
+
+    if (! m_dpx.WriteElement (m_subimage, &packed[0],
+                              long (packed.size() * sizeof(unsigned int)))) {
+        error ("Failed to write DPX image data");
+        return false;
+    }
     return true;
 }
 
@@ -627,6 +771,43 @@ DPXOutput::write_tile (int x, int y, int z, TypeDesc format,
 
 
 
+bool
+DPXOutput::write_image (TypeDesc format, const void *data,
+                        stride_t xstride, stride_t ystride, stride_t zstride,
+                        ProgressCallback progress_callback,
+                        void *progress_callback_data)
+{
+    // When the buffer holds the pixels as given, the whole image can be
+    // converted into it in parallel, leaving write_buffer() to pack and
+    // write it at close.  Anything needing dither, per-channel formats,
+    // or a conversion to the native layout goes a scanline at a time.
+    if (m_spec.tile_width || m_spec.depth > 1 || ! m_wantRaw
+          || m_dither || m_spec.channelformats.size() || m_buf.empty())
+        return ImageOutput::write_image (format, data, xstride, ystride,
+                                         zstride, progress_callback,
+                                         progress_callback_data);
+
+    if (format == TypeDesc::UNKNOWN)
+        format = m_spec.format;
+    m_spec.auto_stride (xstride, ystride, zstride, format,
+                        m_spec.nchannels, m_spec.width, m_spec.height);
+    if (progress_callback && progress_callback (progress_callback_data, 0.0f))
+        return true;
+    if (! parallel_convert_image (m_spec.nchannels, m_spec.width, m_spec.height,
+                                  1, data, format, xstride, ystride, zstride,
+                                  &m_buf[0], m_spec.format, m_spec.pixel_bytes(),
+                                  m_bytes, AutoStride, -1, -1, threads())) {
+        error ("Unable to convert pixels to the DPX data format");
+        return false;
+    }
+    m_write_pending = true;
+    if (progress_callback)
+        progress_callback (progress_callback_data, 1.0f);
+    return true;
+}
+
+
+
 dpx::Characteristic
 DPXOutput::get_characteristic_from_string (const std::string &str)
 {
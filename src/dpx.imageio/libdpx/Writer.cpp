@@ -209,6 +209,8 @@ bool dpx::Writer::WriteElement(const int element, void *data, const long count)
 		return false;
 
 	// update file ptr
+	if (element == 0)
+		this->header.SetImageOffset(this->fileLoc);
 	this->header.SetDataOffset(element, this->fileLoc);
 	this->fileLoc += count;
 		
@@ -36,6 +36,11 @@ extern "C" { // ffmpeg is a C api
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57,24,0)
 # include <libavutil/imgutils.h>
 #endif
+// Hardware decoding through hwdevice contexts arrived with ffmpeg 4.0
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(58,18,100)
+# define USE_HWACCEL 1
+# include <libavutil/hwcontext.h>
+#endif
 }
 
 
@@ -92,6 +97,7 @@ inline int avpicture_fill(AVPicture *picture, uint8_t *ptr,
 #include <boost/thread/once.hpp>
 
 #include "OpenImageIO/imageio.h"
+#include "OpenImageIO/strutil.h"
 #include  <iostream>
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
@@ -103,6 +109,8 @@ public:
     virtual ~FFmpegInput();
     virtual const char *format_name (void) const { return "FFmpeg movie"; }
     virtual bool open (const std::string &name, ImageSpec &spec);
+    virtual bool open (const std::string &name, ImageSpec &spec,
+                       const ImageSpec &config);
     virtual bool close (void);
     virtual int current_subimage (void) const { return m_subimage; }
     virtual bool seek_subimage (int subimage, int miplevel, ImageSpec &newspec);
@@ -138,6 +146,16 @@ private:
     bool m_codec_cap_delay;
     bool m_read_frame;
     int64_t m_start_time;
+    std::string m_hwaccel;       // requested hardware decoder, if any
+#ifdef USE_HWACCEL
+    AVBufferRef *m_hw_device;
+    AVPixelFormat m_hw_pix_format;
+    AVFrame *m_sw_frame;         // hw frames are downloaded into this
+
+    bool open_hwaccel ();
+    static AVPixelFormat get_hw_format (AVCodecContext *ctx,
+                                        const AVPixelFormat *formats);
+#endif
 
     // init to initialize state
     void init (void) {
@@ -154,12 +172,18 @@ private:
         m_video_stream = -1;
         m_frames = 0;
         m_last_search_pos = 0;
-        m_last_decoded_pos = 0;
+        m_last_decoded_pos = -1;
         m_offset_time = true;
         m_read_frame = false;
         m_codec_cap_delay = false;
         m_subimage = 0;
         m_start_time = 0;
+        m_hwaccel.clear ();
+#ifdef USE_HWACCEL
+        m_hw_device = NULL;
+        m_hw_pix_format = AV_PIX_FMT_NONE;
+        m_sw_frame = NULL;
+#endif
     }
 };
 
@@ -189,6 +213,22 @@ OIIO_PLUGIN_EXPORTS_END
 
 
 
+// The JPEG-range YUV formats are deprecated in swscale in favor of the
+// plain ones.
+static AVPixelFormat
+sws_source_format (AVPixelFormat format)
+{
+    switch (format) {
+        case AV_PIX_FMT_YUVJ420P: return AV_PIX_FMT_YUV420P;
+        case AV_PIX_FMT_YUVJ422P: return AV_PIX_FMT_YUV422P;
+        case AV_PIX_FMT_YUVJ444P: return AV_PIX_FMT_YUV444P;
+        case AV_PIX_FMT_YUVJ440P: return AV_PIX_FMT_YUV440P;
+        default:                  return format;
+    }
+}
+
+
+
 FFmpegInput::FFmpegInput ()
 {
     init();
@@ -203,6 +243,20 @@ FFmpegInput::~FFmpegInput()
 
 
 
+bool
+FFmpegInput::open (const std::string &name, ImageSpec &spec,
+                   const ImageSpec &config)
+{
+    // "ffmpeg:hwaccel" names a hardware decoder ("vaapi", "cuda",
+    // "videotoolbox", ...), or "auto" for the first one that works.
+    m_hwaccel = config.get_string_attribute ("ffmpeg:hwaccel");
+    if (m_hwaccel == "none")
+        m_hwaccel.clear ();
+    return open (name, spec);
+}
+
+
+
 bool
 FFmpegInput::open (const std::string &name, ImageSpec &spec)
 {
@@ -259,6 +313,16 @@ FFmpegInput::open (const std::string &name, ImageSpec &spec)
         error ("\"%s\" unsupported codec", file_name);
         return false;
     }
+    // Let the decoder use frame and/or slice threads, as the codec allows.
+    int nthreads = threads ();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    m_codec_context->thread_count = std::max (nthreads, 0);  // 0 == auto
+    m_codec_context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+#ifdef USE_HWACCEL
+    if (! m_hwaccel.empty ())
+        open_hwaccel ();   // falls back to software decoding on failure
+#endif
     if (avcodec_open2 (m_codec_context, m_codec, NULL) < 0) {
         error ("\"%s\" could not open codec", file_name);
         return false;
@@ -294,28 +358,17 @@ FFmpegInput::open (const std::string &name, ImageSpec &spec)
             av_free_packet (&pkt); //Always free before format_context usage
         }
         m_frames = max_pts;
+        // Rewind, so that the first frame may be read without seeking
+        seek (0);
     }
     m_frame = av_frame_alloc();
     m_rgb_frame = av_frame_alloc();
+#ifdef USE_HWACCEL
+    if (m_hw_device)
+        m_sw_frame = av_frame_alloc();
+#endif
 
-    AVPixelFormat src_pix_format;
-    switch (m_codec_context->pix_fmt) { // deprecation warning for YUV formats
-        case AV_PIX_FMT_YUVJ420P:
-            src_pix_format = AV_PIX_FMT_YUV420P;
-            break;
-        case AV_PIX_FMT_YUVJ422P:
-            src_pix_format = AV_PIX_FMT_YUV422P;
-            break;
-        case AV_PIX_FMT_YUVJ444P:
-            src_pix_format = AV_PIX_FMT_YUV444P;
-            break;
-        case AV_PIX_FMT_YUVJ440P:
-            src_pix_format = AV_PIX_FMT_YUV440P;
-            break;
-        default:
-            src_pix_format = m_codec_context->pix_fmt;
-            break;
-    }
+    AVPixelFormat src_pix_format = sws_source_format (m_codec_context->pix_fmt);
 
     m_spec = ImageSpec (m_codec_context->width, m_codec_context->height, 3);
 
@@ -418,6 +471,12 @@ FFmpegInput::close (void)
     av_free (m_format_context); // will free m_codec and m_codec_context
     av_frame_free (&m_frame); // free after close input
     av_frame_free (&m_rgb_frame);
+#ifdef USE_HWACCEL
+    if (m_sw_frame)
+        av_frame_free (&m_sw_frame);
+    if (m_hw_device)
+        av_buffer_unref (&m_hw_device);
+#endif
     sws_freeContext (m_sws_rgb_context);
     init ();
     return true;
@@ -428,18 +487,31 @@ FFmpegInput::close (void)
 void
 FFmpegInput::read_frame(int frame)
 {
+    // The frame we converted last is still in m_rgb_buffer
+    if (frame == m_last_decoded_pos && m_last_decoded_pos >= 0) {
+        m_read_frame = true;
+        return;
+    }
+    // Sequential access just keeps decoding from where we are; only
+    // seek (and throw away the decoder state) for random access.
     if (m_last_decoded_pos + 1 != frame ) {
         seek (frame);
     }
+    // Unknown until we convert a frame; a failed search forces a seek
+    // on the next read.
+    m_last_decoded_pos = -2;
     AVPacket pkt;
     int finished = 0;
     int ret = 0;
     while ((ret = av_read_frame (m_format_context, &pkt)) == 0 || m_codec_cap_delay ) {
+        if (ret < 0) {
+            // End of file: drain the frames the decoder still holds
+            av_init_packet (&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+            pkt.stream_index = m_video_stream;
+        }
         if (pkt.stream_index == m_video_stream) {
-            if (ret < 0 && m_codec_cap_delay) {
-                pkt.data = NULL;
-                pkt.size = 0;
-            }
 
             avcodec_decode_video2 (m_codec_context, m_frame, &finished, &pkt);
 
@@ -452,8 +524,41 @@ FFmpegInput::read_frame(int frame)
             //current_frame =   m_frame->display_picture_number;
             m_last_search_pos = current_frame;
 
+            if (ret < 0 && !finished) {
+                // Nothing left to drain
+                av_free_packet (&pkt);
+                break;
+            }
+
             if( current_frame == frame && finished)
             {
+                const AVFrame *src_frame = m_frame;
+#ifdef USE_HWACCEL
+                if (m_sw_frame && m_frame->format == m_hw_pix_format) {
+                    // Download the frame from the device
+                    if (av_hwframe_transfer_data (m_sw_frame, m_frame, 0) < 0) {
+                        av_free_packet (&pkt);
+                        break;
+                    }
+                    src_frame = m_sw_frame;
+                }
+#endif
+                // The decoded format is only certain once we have a
+                // frame (hw decoders hand back e.g. NV12 or P010).
+                m_sws_rgb_context = sws_getCachedContext
+                (
+                    m_sws_rgb_context,
+                    m_codec_context->width,
+                    m_codec_context->height,
+                    sws_source_format (AVPixelFormat (src_frame->format)),
+                    m_codec_context->width,
+                    m_codec_context->height,
+                    m_dst_pix_format,
+                    SWS_AREA,
+                    NULL,
+                    NULL,
+                    NULL
+                );
                 avpicture_fill
                 (
                     reinterpret_cast<AVPicture*>(m_rgb_frame),
@@ -465,8 +570,8 @@ FFmpegInput::read_frame(int frame)
                 sws_scale
                 (
                     m_sws_rgb_context,
-                    static_cast<uint8_t const * const *> (m_frame->data),
-                    m_frame->linesize,
+                    static_cast<uint8_t const * const *> (src_frame->data),
+                    src_frame->linesize,
                     0,
                     m_codec_context->height,
                     m_rgb_frame->data,
@@ -484,6 +589,62 @@ FFmpegInput::read_frame(int frame)
 
 
 
+#ifdef USE_HWACCEL
+AVPixelFormat
+FFmpegInput::get_hw_format (AVCodecContext *ctx, const AVPixelFormat *formats)
+{
+    const FFmpegInput *self = static_cast<const FFmpegInput *> (ctx->opaque);
+    for (const AVPixelFormat *f = formats; *f != AV_PIX_FMT_NONE; ++f)
+        if (*f == self->m_hw_pix_format)
+            return *f;
+    // The device can't decode this stream, use the software decoder
+    return avcodec_default_get_format (ctx, formats);
+}
+
+
+
+bool
+FFmpegInput::open_hwaccel ()
+{
+    std::vector<AVHWDeviceType> types;
+    if (m_hwaccel == "auto") {
+        AVHWDeviceType t = AV_HWDEVICE_TYPE_NONE;
+        while ((t = av_hwdevice_iterate_types (t)) != AV_HWDEVICE_TYPE_NONE)
+            types.push_back (t);
+    } else {
+        AVHWDeviceType t = av_hwdevice_find_type_by_name (m_hwaccel.c_str());
+        if (t != AV_HWDEVICE_TYPE_NONE)
+            types.push_back (t);
+    }
+    for (size_t i = 0; i < types.size(); ++i) {
+        // Does this decoder support the device type?
+        AVPixelFormat hw_format = AV_PIX_FMT_NONE;
+        for (int c = 0; ; ++c) {
+            const AVCodecHWConfig *config = avcodec_get_hw_config (m_codec, c);
+            if (! config)
+                break;
+            if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX)
+                  && config->device_type == types[i]) {
+                hw_format = config->pix_fmt;
+                break;
+            }
+        }
+        if (hw_format == AV_PIX_FMT_NONE)
+            continue;
+        if (av_hwdevice_ctx_create (&m_hw_device, types[i], NULL, NULL, 0) < 0)
+            continue;
+        m_hw_pix_format = hw_format;
+        m_codec_context->hw_device_ctx = av_buffer_ref (m_hw_device);
+        m_codec_context->opaque = this;
+        m_codec_context->get_format = get_hw_format;
+        return true;
+    }
+    return false;
+}
+#endif
+
+
+
 #if 0
 const char *
 FFmpegInput::metadata (const char * key)
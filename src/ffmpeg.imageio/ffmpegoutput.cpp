@@ -28,7 +28,22 @@
   (This is the Modified BSD License)
 */
 
+
+extern "C" { // ffmpeg is a C api
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+// The send/receive encoding API and AVCodecParameters are needed to write
+#define USE_ENCODER (LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57,37,100))
+
+#include <map>
+#include <boost/thread/once.hpp>
+
 #include "OpenImageIO/imageio.h"
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/strutil.h"
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
 
@@ -44,11 +59,62 @@ public:
     virtual bool write_scanline (int y, int z, TypeDesc format,
                                  const void *data, stride_t xstride);
 private:
-    FILE *m_fd;
     std::string m_filename;
+#if USE_ENCODER
+    AVFormatContext *m_format_context;
+    AVCodecContext *m_codec_context;
+    AVStream *m_stream;
+    AVPixelFormat m_src_pix_format;     // packed RGB(A) we are handed
+    std::vector<unsigned char> m_pixels; // the frame being written
+    std::vector<unsigned char> m_scratch;
+    int m_frame;                        // index of the frame being written
+    bool m_frame_pending;               // m_pixels holds unsent scanlines
+    int m_queue_depth;                  // max frames in flight
+
+    // Frames are converted to the codec's pixel format by tasks on the
+    // thread pool, and handed to the codec strictly in order by
+    // whichever task finds the next frame ready.  State below is
+    // guarded by m_mutex.
+    task_set m_tasks;
+    mutex m_mutex;
+    std::map<int, AVFrame *> m_ready;   // converted, awaiting the codec
+    int m_next_encode;                  // next frame the codec expects
+    bool m_encoding;                    // a task is feeding the codec
+    atomic_int m_inflight;              // frames queued but not encoded
+    std::string m_encode_error;
+
+    struct ConvertTask {
+        FFmpegOutput *out;
+        std::vector<unsigned char> *pixels;
+        int frame;
+        void operator() () { out->convert_and_encode (*pixels, frame);
+                             delete pixels; }
+    };
+
+    bool open_movie (const std::string &name);
+    bool finish_frame ();
+    void convert_and_encode (const std::vector<unsigned char> &pixels,
+                             int frame);
+    bool encode (AVFrame *frame, std::string &err);
+    bool check_encode_error ();
+#endif
+
     void init (void) {
-        m_fd = NULL;
         m_filename.clear ();
+#if USE_ENCODER
+        m_format_context = NULL;
+        m_codec_context = NULL;
+        m_stream = NULL;
+        m_pixels.clear ();
+        m_frame = 0;
+        m_frame_pending = false;
+        m_queue_depth = 4;
+        m_ready.clear ();
+        m_next_encode = 0;
+        m_encoding = false;
+        m_inflight = 0;
+        m_encode_error.clear ();
+#endif
     }
 };
 
@@ -71,17 +137,25 @@ OIIO_PLUGIN_EXPORTS_END
 int
 FFmpegOutput::supports (string_view feature) const
 {
+#if USE_ENCODER
+    // Each subimage is a frame of the movie
+    if (feature == "multiimage" || feature == "appendsubimage")
+        return true;
+#endif
     // Everything else, we either don't support or don't know about
     return false;
 }
 
 
 
+#if ! USE_ENCODER
+
 bool 
 FFmpegOutput::open (const std::string &name, const ImageSpec &spec,
                  OpenMode mode)
 {
-    return true;
+    error ("Writing movies requires libavcodec 57.37 or newer");
+    return false;
 }
 
 
@@ -95,12 +169,324 @@ FFmpegOutput::write_scanline (int y, int z, TypeDesc format, const void *data,
 
 
 
-inline bool
+bool
 FFmpegOutput::close (void)
 {
+    init ();
     return true;
 }
 
+#else
+
+
+
+bool 
+FFmpegOutput::open (const std::string &name, const ImageSpec &spec,
+                 OpenMode mode)
+{
+    if (mode == AppendMIPLevel) {
+        error ("%s does not support MIP levels", format_name());
+        return false;
+    }
+    if (mode == AppendSubimage) {
+        if (! m_format_context) {
+            error ("%s: no movie is open to append to", format_name());
+            return false;
+        }
+        if (spec.width != m_spec.width || spec.height != m_spec.height
+              || spec.nchannels != m_spec.nchannels) {
+            error ("%s: every frame must have the same resolution and "
+                   "channels", format_name());
+            return false;
+        }
+        // Hand off the previous frame and start the next one
+        if (m_frame_pending && ! finish_frame ())
+            return false;
+        ++m_frame;
+        return check_encode_error ();
+    }
+
+    if (m_format_context)
+        close ();
+    m_spec = spec;
+    if (m_spec.nchannels != 3 && m_spec.nchannels != 4) {
+        error ("%s: only RGB and RGBA images may be written (not %d channels)",
+               format_name(), m_spec.nchannels);
+        return false;
+    }
+    bool bits16 = m_spec.format.size() > 1;
+    m_spec.set_format (bits16 ? TypeDesc::UINT16 : TypeDesc::UINT8);
+    if (m_spec.nchannels == 3)
+        m_src_pix_format = bits16 ? AV_PIX_FMT_RGB48 : AV_PIX_FMT_RGB24;
+    else
+        m_src_pix_format = bits16 ? AV_PIX_FMT_RGBA64 : AV_PIX_FMT_RGBA;
+    m_queue_depth = std::max (1, m_spec.get_int_attribute ("ffmpeg:queue", 4));
+    if (! open_movie (name)) {
+        close ();
+        return false;
+    }
+    m_filename = name;
+    m_frame = 0;
+    return true;
+}
+
+
+
+bool
+FFmpegOutput::open_movie (const std::string &name)
+{
+    static boost::once_flag init_flag = BOOST_ONCE_INIT;
+    boost::call_once (&av_register_all, init_flag);
+    av_log_set_level (AV_LOG_FATAL);
+
+    if (avformat_alloc_output_context2 (&m_format_context, NULL, NULL,
+                                        name.c_str()) < 0
+          || ! m_format_context) {
+        error ("\"%s\" could not create output", name);
+        return false;
+    }
+    // "ffmpeg:codec" names the encoder, otherwise use the container's
+    std::string codec_name = m_spec.get_string_attribute ("ffmpeg:codec");
+    AVCodec *codec = codec_name.size()
+                   ? avcodec_find_encoder_by_name (codec_name.c_str())
+                   : avcodec_find_encoder (m_format_context->oformat->video_codec);
+    if (! codec) {
+        error ("\"%s\" unsupported codec \"%s\"", name, codec_name);
+        return false;
+    }
+    m_stream = avformat_new_stream (m_format_context, NULL);
+    m_codec_context = avcodec_alloc_context3 (codec);
+    if (! m_stream || ! m_codec_context) {
+        error ("\"%s\" could not allocate the video stream", name);
+        return false;
+    }
+
+    float fps = m_spec.get_float_attribute ("FramesPerSecond", 24.0f);
+    AVRational frame_rate = av_d2q (fps > 0.0f ? fps : 24.0f, 100000);
+    m_codec_context->width = m_spec.width;
+    m_codec_context->height = m_spec.height;
+    m_codec_context->time_base = av_inv_q (frame_rate);
+    m_codec_context->framerate = frame_rate;
+    m_stream->time_base = m_codec_context->time_base;
+    m_codec_context->pix_fmt = codec->pix_fmts
+        ? avcodec_find_best_pix_fmt_of_list (codec->pix_fmts,
+                                             m_src_pix_format, 0, NULL)
+        : AV_PIX_FMT_YUV420P;
+    int bitrate = m_spec.get_int_attribute ("ffmpeg:bitrate", 0);
+    if (bitrate > 0)
+        m_codec_context->bit_rate = bitrate;
+    if (m_format_context->oformat->flags & AVFMT_GLOBALHEADER)
+        m_codec_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    // Let the codec use frame and/or slice threads
+    int nthreads = threads ();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    m_codec_context->thread_count = std::max (nthreads, 0);  // 0 == auto
+    m_codec_context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+    if (avcodec_open2 (m_codec_context, codec, NULL) < 0) {
+        error ("\"%s\" could not open codec", name);
+        return false;
+    }
+    if (avcodec_parameters_from_context (m_stream->codecpar,
+                                         m_codec_context) < 0) {
+        error ("\"%s\" could not set stream parameters", name);
+        return false;
+    }
+    if (! (m_format_context->oformat->flags & AVFMT_NOFILE)
+          && avio_open (&m_format_context->pb, name.c_str(),
+                        AVIO_FLAG_WRITE) < 0) {
+        error ("\"%s\" could not open file", name);
+        return false;
+    }
+    if (avformat_write_header (m_format_context, NULL) < 0) {
+        error ("\"%s\" could not write header", name);
+        return false;
+    }
+    return true;
+}
+
+
+
+bool 
+FFmpegOutput::write_scanline (int y, int z, TypeDesc format, const void *data,
+                           stride_t xstride)
+{
+    if (! m_format_context)
+        return false;
+    if (y < 0 || y >= m_spec.height) {
+        error ("Attempt to write scanline %d out of range", y);
+        return false;
+    }
+    data = to_native_scanline (format, data, xstride, m_scratch);
+    size_t row = m_spec.scanline_bytes ();
+    if (m_pixels.size () != row * m_spec.height)
+        m_pixels.resize (row * m_spec.height);
+    memcpy (&m_pixels[y * row], data, row);
+    m_frame_pending = true;
+    return true;
+}
+
+
+
+bool
+FFmpegOutput::finish_frame ()
+{
+    // Don't let the queue grow without bound if the codec can't keep up;
+    // help with the pool's work while waiting.
+    atomic_backoff backoff;
+    while (m_inflight >= m_queue_depth) {
+        if (! m_tasks.pool()->run_one_task ())
+            backoff ();
+    }
+    ConvertTask task;
+    task.out = this;
+    task.pixels = new std::vector<unsigned char>;
+    task.pixels->swap (m_pixels);
+    task.frame = m_frame;
+    ++m_inflight;
+    m_tasks.push (task);
+    m_frame_pending = false;
+    return true;
+}
+
+
+
+void
+FFmpegOutput::convert_and_encode (const std::vector<unsigned char> &pixels,
+                                  int frame)
+{
+    std::string err;
+    AVFrame *yuv = av_frame_alloc ();
+    if (yuv) {
+        yuv->format = m_codec_context->pix_fmt;
+        yuv->width = m_spec.width;
+        yuv->height = m_spec.height;
+        yuv->pts = frame;
+        // Each task has its own scaler, so frames convert concurrently
+        SwsContext *sws = sws_getContext (m_spec.width, m_spec.height,
+                                          m_src_pix_format,
+                                          m_spec.width, m_spec.height,
+                                          m_codec_context->pix_fmt,
+                                          SWS_BICUBIC, NULL, NULL, NULL);
+        if (sws && av_frame_get_buffer (yuv, 32) >= 0) {
+            const uint8_t *src[1] = { &pixels[0] };
+            int src_stride[1] = { (int) m_spec.scanline_bytes() };
+            sws_scale (sws, src, src_stride, 0, m_spec.height,
+                       yuv->data, yuv->linesize);
+        } else {
+            err = "could not convert frame";
+        }
+        sws_freeContext (sws);
+    } else {
+        err = "could not allocate frame";
+    }
+
+    lock_guard lock (m_mutex);
+    if (err.size() && m_encode_error.empty())
+        m_encode_error = err;
+    m_ready[frame] = yuv;
+    if (m_encoding)
+        return;   // the task already feeding the codec will take it
+    m_encoding = true;
+    std::map<int, AVFrame *>::iterator it;
+    while ((it = m_ready.find (m_next_encode)) != m_ready.end()) {
+        AVFrame *f = it->second;
+        m_ready.erase (it);
+        bool ok = m_encode_error.empty();
+        m_mutex.unlock ();
+        if (ok && f)
+            ok = encode (f, err);
+        av_frame_free (&f);
+        m_mutex.lock ();
+        if (! ok && m_encode_error.empty())
+            m_encode_error = err.size() ? err : std::string("encoding failed");
+        ++m_next_encode;
+        --m_inflight;
+    }
+    m_encoding = false;
+}
+
+
+
+bool
+FFmpegOutput::encode (AVFrame *frame, std::string &err)
+{
+    // A NULL frame flushes the frames the codec is still holding
+    if (avcodec_send_frame (m_codec_context, frame) < 0) {
+        err = "could not send frame to the encoder";
+        return false;
+    }
+    AVPacket pkt;
+    av_init_packet (&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    int ret;
+    while ((ret = avcodec_receive_packet (m_codec_context, &pkt)) == 0) {
+        av_packet_rescale_ts (&pkt, m_codec_context->time_base,
+                              m_stream->time_base);
+        pkt.stream_index = m_stream->index;
+        ret = av_interleaved_write_frame (m_format_context, &pkt);
+        av_packet_unref (&pkt);
+        if (ret < 0) {
+            err = "could not write frame";
+            return false;
+        }
+    }
+    if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+        err = "encoding failed";
+        return false;
+    }
+    return true;
+}
+
+
+
+bool
+FFmpegOutput::check_encode_error ()
+{
+    lock_guard lock (m_mutex);
+    if (m_encode_error.empty())
+        return true;
+    error ("%s", m_encode_error);
+    m_encode_error.clear ();
+    return false;
+}
+
+
+
+bool
+FFmpegOutput::close (void)
+{
+    bool ok = true;
+    if (m_format_context) {
+        if (m_codec_context && avcodec_is_open (m_codec_context)) {
+            if (m_frame_pending)
+                ok &= finish_frame ();
+            m_tasks.wait ();
+            ok &= check_encode_error ();
+            std::string err;
+            if (! encode (NULL, err)) {
+                error ("%s", err);
+                ok = false;
+            }
+            if (m_format_context->pb)
+                av_write_trailer (m_format_context);
+        }
+        if (m_format_context->pb
+              && ! (m_format_context->oformat->flags & AVFMT_NOFILE))
+            avio_closep (&m_format_context->pb);
+        avformat_free_context (m_format_context);
+    }
+    if (m_codec_context)
+        avcodec_free_context (&m_codec_context);
+    init ();
+    return ok;
+}
+
+#endif
+
 
 
 OIIO_PLUGIN_NAMESPACE_END
@@ -31,6 +31,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cmath>
+#include <map>
 
 #include "OpenImageIO/dassert.h"
 #include "OpenImageIO/imageio.h"
@@ -151,7 +152,7 @@ inline int blocksize (FieldRes::Ptr &f)
     typename SparseField<T>::Ptr sf (field_dynamic_cast<SparseField<T> >(f));
     if (sf)
         return sf->blockSize();
-    typename SparseField<T>::Ptr vsf (field_dynamic_cast<SparseField<T> >(f));
+    typename SparseField<FIELD3D_VEC3_T<T> >::Ptr vsf (field_dynamic_cast<SparseField<FIELD3D_VEC3_T<T> > >(f));
     if (vsf)
         return vsf->blockSize();
     return 0;
@@ -159,6 +160,87 @@ inline int blocksize (FieldRes::Ptr &f)
 
 
 
+// Channel values of a voxel, as floats.
+template<typename T>
+inline void voxel_channels (const T &v, float *c)
+{
+    c[0] = float(v);
+}
+
+template<typename T>
+inline void voxel_channels (const FIELD3D_VEC3_T<T> &v, float *c)
+{
+    c[0] = float(v.x);  c[1] = float(v.y);  c[2] = float(v.z);
+}
+
+
+
+// Build the "oiio:ConstantTiles" table (in the format that maketx
+// writes, see maketexture.cpp) recording which blocks of the sparse
+// field f were never allocated, and so hold only the block's empty
+// value.  Since the tiles we present are exactly the blocks, this lets
+// the ImageCache share a single constant tile for all of the empty
+// blocks, and texture3d skip them, without ever reading their voxels.
+// Return the empty string if no blocks are empty.
+template<typename T>
+static std::string
+empty_block_table (FieldRes::Ptr &field, int nchannels)
+{
+    typename SparseField<T>::Ptr f (field_dynamic_cast<SparseField<T> >(field));
+    if (! f)
+        return std::string();
+    const int maxcolors = 256;  // Further values are stored as ordinary tiles
+    V3i res = f->blockRes();
+    std::map<std::vector<float>, int> palette;
+    std::vector<float> palettecolors;
+    std::vector<std::pair<size_t,int> > runs;
+    std::vector<float> c (nchannels);
+    for (int bk = 0;  bk < res.z;  ++bk) {
+        for (int bj = 0;  bj < res.y;  ++bj) {
+            for (int bi = 0;  bi < res.x;  ++bi) {
+                int index = -1;
+                if (! f->blockIsAllocated (bi, bj, bk)) {
+                    voxel_channels (f->getBlockEmptyValue (bi, bj, bk), &c[0]);
+                    std::map<std::vector<float>, int>::iterator found = palette.find (c);
+                    if (found != palette.end()) {
+                        index = found->second;
+                    } else if ((int)palette.size() < maxcolors) {
+                        index = (int) palette.size();
+                        palette[c] = index;
+                        palettecolors.insert (palettecolors.end(), c.begin(), c.end());
+                    }
+                }
+                if (runs.size() && runs.back().second == index)
+                    ++runs.back().first;
+                else
+                    runs.push_back (std::make_pair (size_t(1), index));
+            }
+        }
+    }
+    if (palette.empty())
+        return std::string();
+
+    std::string table = Strutil::format ("%d,%d,%d,%d,%d", res.x, res.y, res.z,
+                                         nchannels, (int)palette.size());
+    for (size_t i = 0;  i < palettecolors.size();  ++i)
+        table += Strutil::format (",%.9g", palettecolors[i]);
+    for (size_t i = 0;  i < runs.size();  ++i)
+        table += Strutil::format (",%d,%d", (int)runs[i].first, runs[i].second);
+    return table;
+}
+
+
+
+template<typename T>
+static std::string
+empty_block_table (FieldRes::Ptr &field, int nchannels, bool vecfield)
+{
+    return vecfield ? empty_block_table<FIELD3D_VEC3_T<T> > (field, nchannels)
+                    : empty_block_table<T> (field, nchannels);
+}
+
+
+
 template <class M>
 static void
 read_metadata (const M &meta, ImageSpec &spec)
@@ -260,6 +342,19 @@ Field3DInput::read_one_layer (FieldRes::Ptr field, layerrecord &lay,
     ASSERT (lay.spec.tile_width > 0 && lay.spec.tile_height > 0 &&
             lay.spec.tile_depth > 0);
 
+    if (b) {
+        // Tell the ImageCache which blocks are empty
+        std::string table;
+        if (datatype == TypeDesc::FLOAT)
+            table = empty_block_table<float> (field, lay.spec.nchannels, lay.vecfield);
+        else if (datatype == TypeDesc::HALF)
+            table = empty_block_table<FIELD3D_NS::half> (field, lay.spec.nchannels, lay.vecfield);
+        else if (datatype == TypeDesc::DOUBLE)
+            table = empty_block_table<double> (field, lay.spec.nchannels, lay.vecfield);
+        if (table.size())
+            lay.spec.attribute ("oiio:ConstantTiles", table);
+    }
+
     lay.spec.attribute ("ImageDescription", lay.unique_name);
     lay.spec.attribute ("oiio:subimagename", lay.unique_name);
     lay.spec.attribute ("field3d:partition", lay.name);
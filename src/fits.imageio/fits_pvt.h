@@ -78,10 +78,15 @@ class FitsInput : public ImageInput {
     virtual bool open (const std::string &name, ImageSpec &spec);
     virtual bool close (void);
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
     virtual bool seek_subimage (int subimage, int miplevel, ImageSpec &newspec);
     virtual int current_subimage () const { return m_cur_subimage; }
  private:
     FILE *m_fd;
+    Filesystem::IOProxy *m_io;   // Mapped file, or IOFile wrapping m_fd
+    int64_t m_dataoffset;       // file offset of the image data
+    std::vector<unsigned char> m_block; // scratch for unmapped reads
     std::string m_filename;
     int m_cur_subimage;
     int m_bitpix; // number of bits that represents data value;
@@ -100,6 +105,8 @@ class FitsInput : public ImageInput {
     
     void init (void) {
         m_fd = NULL;
+        m_io = NULL;
+        m_dataoffset = 0;
         m_filename.clear ();
         m_cur_subimage = 0;
         m_bitpix = 0;
@@ -98,6 +98,14 @@ FitsInput::open (const std::string &name, ImageSpec &spec)
     // moving back to the start of the file
     fseek (m_fd, 0, SEEK_SET);
 
+    // Uncompressed image data can be used straight from a mapping of
+    // the file; failing that, fetch it with positioned reads.
+    m_io = new Filesystem::IOMappedFile (m_filename);
+    if (! m_io->opened ()) {
+        delete m_io;
+        m_io = new Filesystem::IOFile (m_fd, Filesystem::IOProxy::Read);
+    }
+
     subimage_search ();
 
     if (! set_spec_info ())
@@ -112,46 +120,55 @@ FitsInput::open (const std::string &name, ImageSpec &spec)
 
 bool
 FitsInput::read_native_scanline (int y, int z, void *data)
+{
+    return read_native_scanlines (y, y+1, z, data);
+}
+
+
+
+bool
+FitsInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
 {
     // we return true just to support 0x0 images
     if (!m_naxes)
         return true;
 
-    std::vector<unsigned char> data_tmp (m_spec.scanline_bytes ());
-    long scanline_off = (m_spec.height - y) * m_spec.scanline_bytes ();
-    fseek (m_fd, scanline_off, SEEK_CUR);
-    size_t n = fread (&data_tmp[0], 1, m_spec.scanline_bytes(), m_fd);
-    if (n != m_spec.scanline_bytes()) {
-        if (feof (m_fd))
-            error ("Hit end of file unexpectedly");
-        else
-            error ("read error");
+    // Scanlines are stored bottom to top, so [ybegin,yend) is one
+    // contiguous run of the file, with row yend-1 first.  Fetch it in a
+    // single read (or use the mapped file in place).
+    size_t scanline_bytes = m_spec.scanline_bytes ();
+    size_t nbytes = size_t(yend - ybegin) * scanline_bytes;
+    int64_t offset = m_dataoffset
+                   + int64_t(m_spec.height - (yend - 1)) * scanline_bytes;
+    const unsigned char *block = NULL;
+    if (m_io->mmap ()) {
+        if (offset + int64_t(nbytes) <= int64_t(m_io->size ()))
+            block = (const unsigned char *) m_io->mmap () + offset;
+    } else {
+        m_block.resize (nbytes);
+        if (m_io->pread (&m_block[0], nbytes, offset) == nbytes)
+            block = &m_block[0];
+    }
+    if (! block) {
+        error ("Hit end of file unexpectedly");
         return false;   // Read failed
     }
 
     // in FITS image data is stored in big-endian so we have to switch to
     // little-endian on little-endian machines
-    if (littleendian ()) {
-        if (m_spec.format == TypeDesc::USHORT)
-            swap_endian ((unsigned short*)&data_tmp[0],
-                         data_tmp.size () / sizeof (unsigned short));
-        else if (m_spec.format == TypeDesc::UINT)
-            swap_endian ((unsigned int*)&data_tmp[0],
-                         data_tmp.size () / sizeof (unsigned int));
-        else if (m_spec.format == TypeDesc::FLOAT)
-            swap_endian ((float*)&data_tmp[0],
-                         data_tmp.size () / sizeof (float));
-        else if (m_spec.format == TypeDesc::DOUBLE)
-            swap_endian ((double*)&data_tmp[0],
-                         data_tmp.size () / sizeof (double));
+    int itemsize = (int) m_spec.format.size ();
+    bool swap = littleendian () && itemsize > 1;
+    for (int y = ybegin;  y < yend;  ++y) {
+        const unsigned char *in = block + size_t(yend - 1 - y) * scanline_bytes;
+        unsigned char *out = (unsigned char *)data
+                           + size_t(y - ybegin) * scanline_bytes;
+        if (swap)
+            swap_endian_copy (in, out, scanline_bytes / itemsize, itemsize);
+        else
+            memcpy (out, in, scanline_bytes);
     }
-
-    memcpy (data, &data_tmp[0], data_tmp.size ());
-
-    // after reading scanline we set file pointer to the start of image data
-    fsetpos (m_fd, &m_filepos);
     return true;
-};
+}
 
 
 
@@ -205,6 +222,7 @@ FitsInput::set_spec_info ()
     // this is the start of the image data
     // we will need it in the read_native_scanline method
     fgetpos(m_fd, &m_filepos);
+    m_dataoffset = ftell (m_fd);
 
     if (m_bitpix == 8)
         m_spec.set_format (TypeDesc::UCHAR);
@@ -224,6 +242,7 @@ FitsInput::set_spec_info ()
 bool
 FitsInput::close (void)
 {
+    delete m_io;
     if (m_fd)
         fclose (m_fd);
     init ();
@@ -37,6 +37,7 @@
 
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/platform.h"
+#include "OpenImageIO/thread.h"
 
 namespace {
 #define GIF_TEMP_MALLOC malloc
@@ -69,6 +70,16 @@ class GIFOutput : public ImageOutput {
     virtual bool close ();
 
  private:
+    // A finished frame on its way to the file: the canvas, and then its
+    // palette and quantized pixels (palette index in the alpha byte).
+    struct Frame {
+        std::vector<uint8_t> pixels;
+        std::vector<uint8_t> quantized;
+        GifPalette palette;
+        uint32_t width, height;
+        int delay;
+    };
+
     std::string m_filename;
     int m_subimage;                  // Current subimage index
     int m_nsubimages;
@@ -77,16 +88,51 @@ class GIFOutput : public ImageOutput {
     GifWriter m_gifwriter;
     std::vector<uint8_t> m_canvas;   // Image canvas, accumulating output
     int m_delay;
+    bool m_global_palette;           // One palette for all frames?
+    std::vector<Frame *> m_frames;   // Finished, not yet quantized
+    std::vector<Frame *> m_encoding; // Quantized, being written
+    std::vector<uint8_t> m_lastframe;    // Last frame written, for deltas
+    task_set m_encoder;              // The frame writing in progress
+    bool m_encode_ok;
 
     void init (void) {
         m_filename.clear ();
         m_subimage = 0;
         m_canvas.clear ();
         m_pending_write = false;
+        m_global_palette = false;
+        m_gifwriter.f = NULL;
+        m_lastframe.clear ();
+        m_encode_ok = true;
     }
 
     bool start_subimage ();
     bool finish_subimage ();
+    // Quantize the finished frames in parallel, then hand them to a
+    // background task that writes them, in order, while we go on.
+    void quantize_frames ();
+    // Wait for the frames being written and free them.
+    bool finish_encoding ();
+    // Write m_encoding's frames (runs in the background).
+    void encode_frames ();
+
+    struct QuantizeTask {
+        Frame *frame;
+        bool make_palette;
+        void operator() () {
+            if (make_palette)
+                GifMakePalette (NULL, &frame->pixels[0], frame->width,
+                                frame->height, 8, true, &frame->palette);
+            frame->quantized.resize (frame->pixels.size());
+            GifDitherImage (NULL, &frame->pixels[0], &frame->quantized[0],
+                            frame->width, frame->height, &frame->palette);
+            std::vector<uint8_t>().swap (frame->pixels);
+        }
+    };
+    struct EncodeTask {
+        GIFOutput *out;
+        void operator() () { out->encode_frames (); }
+    };
 };
 
 
@@ -147,6 +193,7 @@ GIFOutput::open (const std::string &name, int subimages,
     m_spec = specs[0];
     float fps = m_spec.get_float_attribute ("FramesPerSecond", 1.0f);
     m_delay = (fps == 0.0f ? 0 : (int)(100.0f/fps));
+    m_global_palette = m_spec.get_int_attribute ("gif:GlobalPalette", 0) != 0;
     return start_subimage ();
 }
 
@@ -155,12 +202,19 @@ GIFOutput::open (const std::string &name, int subimages,
 bool
 GIFOutput::close ()
 {
-    if (m_pending_write) {
+    bool ok = true;
+    if (m_pending_write)
         finish_subimage ();
+    if (m_gifwriter.f) {
+        quantize_frames ();
+        ok = finish_encoding ();
         GifEnd (&m_gifwriter);
     }
+    for (size_t f = 0;  f < m_frames.size();  ++f)
+        delete m_frames[f];
+    m_frames.clear ();
     init ();
-    return true;
+    return ok;
 }
 
 
@@ -212,11 +266,104 @@ GIFOutput::finish_subimage ()
     if (! m_pending_write)
         return true;
 
-    bool ok = GifWriteFrame (&m_gifwriter, &m_canvas[0],
-                             spec().width, spec().height,
-                             m_delay, 8 /*bitdepth*/, true /*dither*/);
+    Frame *frame = new Frame;
+    frame->pixels.swap (m_canvas);
+    frame->width = spec().width;
+    frame->height = spec().height;
+    frame->delay = m_delay;
+    m_frames.push_back (frame);
     m_pending_write = false;
-    return ok;
+
+    // With a palette per frame, quantize a batch whenever there's enough
+    // to keep the threads busy; a global palette needs every frame first.
+    int nthreads = threads();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    if (! m_global_palette && int(m_frames.size()) >= std::max (1, nthreads))
+        quantize_frames ();
+    return m_encode_ok;
+}
+
+
+
+void
+GIFOutput::quantize_frames ()
+{
+    if (m_frames.empty())
+        return;
+
+    GifPalette global;
+    if (m_global_palette) {
+        // Build one palette from a sampling of all the frames' pixels
+        const size_t maxsamples = 1 << 22;
+        size_t npixels = size_t(m_frames[0]->width) * m_frames[0]->height;
+        size_t total = npixels * m_frames.size();
+        size_t step = std::max (size_t(1), total / maxsamples);
+        std::vector<uint8_t> samples;
+        samples.reserve (4 * (total / step + 1));
+        for (size_t i = 0;  i < total;  i += step) {
+            const uint8_t *p = &m_frames[i / npixels]->pixels[4 * (i % npixels)];
+            samples.insert (samples.end(), p, p+4);
+        }
+        GifMakePalette (NULL, &samples[0], uint32_t(samples.size()/4), 1,
+                        8, true, &global);
+    }
+
+    QuantizeTask task;
+    task.make_palette = ! m_global_palette;
+    task_set tasks;
+    for (size_t f = 0;  f < m_frames.size();  ++f) {
+        task.frame = m_frames[f];
+        if (m_global_palette)
+            task.frame->palette = global;
+        tasks.push (task);
+    }
+    tasks.wait ();
+
+    // Writing is sequential (each frame is delta coded against the last),
+    // so it waits for the previous batch, then goes on in the background.
+    finish_encoding ();
+    m_encoding.swap (m_frames);
+    EncodeTask encode;
+    encode.out = this;
+    m_encoder.push (encode);
+}
+
+
+
+bool
+GIFOutput::finish_encoding ()
+{
+    m_encoder.wait ();
+    for (size_t f = 0;  f < m_encoding.size();  ++f)
+        delete m_encoding[f];
+    m_encoding.clear ();
+    return m_encode_ok;
+}
+
+
+
+void
+GIFOutput::encode_frames ()
+{
+    for (size_t f = 0;  f < m_encoding.size();  ++f) {
+        uint32_t width = m_encoding[f]->width, height = m_encoding[f]->height;
+        size_t nbytes = size_t(width) * height * 4;
+        std::vector<uint8_t> &q (m_encoding[f]->quantized);
+        if (m_lastframe.size() == nbytes) {
+            // Pixels that look just like last frame's become transparent
+            for (size_t i = 0;  i < nbytes;  i += 4)
+                if (q[i] == m_lastframe[i] && q[i+1] == m_lastframe[i+1] &&
+                    q[i+2] == m_lastframe[i+2])
+                    q[i+3] = kGifTransIndex;
+        }
+        GifWriteLzwImage (m_gifwriter.f, &q[0], 0, 0, width, height,
+                          m_encoding[f]->delay, &m_encoding[f]->palette);
+        m_lastframe.swap (q);
+        std::vector<uint8_t>().swap (q);
+    }
+    if (ferror (m_gifwriter.f))
+        m_encode_ok = false;
 }
 
 
@@ -31,11 +31,15 @@
 
 #include <cassert>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/fmath.h"
+#include "OpenImageIO/simd.h"
+#include "OpenImageIO/thread.h"
 #include "rgbe.h"
 
 
@@ -62,6 +66,8 @@ public:
     virtual const char * format_name (void) const { return "hdr"; }
     virtual bool open (const std::string &name, ImageSpec &spec);
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
     virtual bool close ();
     virtual int current_subimage (void) const { return m_subimage; }
     virtual bool seek_subimage (int subimage, int miplevel, ImageSpec &newspec);
@@ -70,19 +76,178 @@ private:
     std::string m_filename;       ///< File name
     FILE *m_fd;                   ///< The open file handle
     int m_subimage;               ///< What subimage are we looking at?
-    int m_next_scanline;          ///< Next scanline to read
     char rgbe_error[1024];        ///< Buffer for RGBE library error msgs
+    std::vector<unsigned char> m_data;  ///< All the pixel data, once read
+    bool m_data_loaded;           ///< Has m_data been read?
+    std::vector<size_t> m_offsets;  ///< Scanline offsets within m_data
+    int m_nindexed;               ///< Scanlines [0,m_nindexed) have offsets
 
     void init () {
         m_fd = NULL;
         m_subimage = -1;
-        m_next_scanline = 0;
+        std::vector<unsigned char>().swap (m_data);
+        m_data_loaded = false;
+        m_offsets.clear ();
+        m_nindexed = 0;
     }
 
+    // Read all of the pixel data (everything after the header) into
+    // m_data, in large chunks.
+    bool load_pixel_data ();
+
+    // Find the offsets of all scanlines up to and including y.
+    bool index_scanlines (int y);
+
 };
 
 
 
+namespace {
+
+// Decode -- or, if planes is NULL, just measure -- the RGBE scanline of
+// the given width that starts at p, with 'avail' bytes of data after it.
+// The r, g, b and exponent bytes go to four successive rows of 'width'
+// bytes in planes.  Return the number of bytes the scanline takes in the
+// file, or 0 (setting err) if it is bad or truncated.  Like rgbe.cpp, a
+// scanline that doesn't start with a run length encoding marker is taken
+// to be flat.
+size_t
+rgbe_scanline (const unsigned char *p, size_t avail, int width,
+               unsigned char *planes, const char *&err)
+{
+    if (width < 8 || width > 0x7fff || avail < 4 ||
+          p[0] != 2 || p[1] != 2 || (p[2] & 0x80)) {
+        size_t flat = 4 * size_t(width);
+        if (avail < flat) {
+            err = "RGBE read error";
+            return 0;
+        }
+        if (planes)
+            for (int x = 0;  x < width;  ++x, p += 4)
+                for (int c = 0;  c < 4;  ++c)
+                    planes[c*width+x] = p[c];
+        return flat;
+    }
+    if ((int(p[2]) << 8 | p[3]) != width) {
+        err = "RGBE bad file format: wrong scanline width";
+        return 0;
+    }
+    const unsigned char *start = p, *end = p + avail;
+    p += 4;
+    for (int c = 0;  c < 4;  ++c) {
+        unsigned char *row = planes ? planes + c*width : NULL;
+        for (int x = 0;  x < width;  ) {
+            if (end - p < 2) {
+                err = "RGBE read error";
+                return 0;
+            }
+            int count = p[0];
+            if (count > 128) {
+                // a run of the same value
+                count -= 128;
+                if (count > width - x) {
+                    err = "RGBE bad file format: bad scanline data";
+                    return 0;
+                }
+                if (row)
+                    memset (row + x, p[1], count);
+                p += 2;
+            } else {
+                // a non-run
+                if (count == 0 || count > width - x) {
+                    err = "RGBE bad file format: bad scanline data";
+                    return 0;
+                }
+                if (end - p < 1 + count) {
+                    err = "RGBE read error";
+                    return 0;
+                }
+                if (row)
+                    memcpy (row + x, p + 1, count);
+                p += 1 + count;
+            }
+            x += count;
+        }
+    }
+    return size_t (p - start);
+}
+
+
+
+// Convert a scanline of planar RGBE bytes to RGB floats, the same way as
+// rgbe2float: rgb * 2^(e-136), or 0 when e == 0.
+void
+rgbe_to_float (const unsigned char *planes, int width, float *out)
+{
+    const unsigned char *r = planes, *g = r + width, *b = g + width;
+    const unsigned char *e = b + width;
+    int x = 0;
+    for ( ;  x + 4 <= width;  x += 4, out += 12) {
+        simd::int4 E;
+        E.load (e + x);
+        // Build 2^(e-136) directly as float bits.  The few exponents that
+        // would make it denormal are left to the scalar code below.
+        if (simd::any ((simd::int4::Zero() < E) & (E < simd::int4(10))))
+            break;
+        simd::int4 bits = (E - simd::int4(9)) << 23;
+        simd::float4 f = simd::blend0 (simd::bitcast_to_float4 (bits),
+                                       E != simd::int4::Zero());
+        simd::float4 R, G, B, A (0.0f);
+        R.load (r + x);
+        G.load (g + x);
+        B.load (b + x);
+        R *= f;  G *= f;  B *= f;
+        simd::transpose (R, G, B, A);
+        // Each pixel's stray fourth value is overwritten by the next.
+        R.store (out);
+        G.store (out + 3);
+        B.store (out + 6);
+        A.store (out + 9, 3);
+    }
+    for ( ;  x < width;  ++x, out += 3) {
+        if (e[x]) {
+            float f = ldexpf (1.0f, e[x] - (int)(128+8));
+            out[0] = r[x] * f;
+            out[1] = g[x] * f;
+            out[2] = b[x] * f;
+        } else {
+            out[0] = out[1] = out[2] = 0.0f;
+        }
+    }
+}
+
+
+
+// Decode scanlines [ybegin,yend), whose offsets are known.
+struct HdrDecodeTask {
+    const unsigned char *data;
+    size_t size;
+    const size_t *offsets;
+    int width;
+    int ybegin, yend;
+    float *out;                 // Output for scanline ybegin
+    atomic_int *failures;
+
+    void operator() () {
+        std::vector<unsigned char> planes (4 * size_t(width));
+        const char *err = NULL;
+        for (int y = ybegin;  y < yend;  ++y) {
+            size_t off = offsets[y];
+            if (! rgbe_scanline (data + off, size - off, width,
+                                 &planes[0], err)) {
+                ++(*failures);
+                return;
+            }
+            rgbe_to_float (&planes[0], width,
+                           out + size_t(y - ybegin) * 3 * width);
+        }
+    }
+};
+
+}  // anon namespace
+
+
+
 // Export version number and create function symbols
 OIIO_PLUGIN_EXPORTS_BEGIN
 
@@ -150,7 +315,6 @@ HdrInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
     // pixaspect, primaries?  (N.B. rgbe.c doesn't even handle most of them)
 
     m_subimage = subimage;
-    m_next_scanline = 0;
     newspec = m_spec;
     return true;
 }
@@ -158,29 +322,113 @@ HdrInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
 
 
 bool
-HdrInput::read_native_scanline (int y, int z, void *data)
+HdrInput::load_pixel_data ()
+{
+    if (m_data_loaded)
+        return true;
+    long start = ftell (m_fd);
+    uint64_t filesize = Filesystem::file_size (m_filename);
+    if (start >= 0 && filesize > uint64_t(start))
+        m_data.reserve (filesize - start);
+    const size_t chunk = 4 << 20;
+    for (;;) {
+        size_t n = m_data.size ();
+        m_data.resize (n + chunk);
+        size_t r = fread (&m_data[n], 1, chunk, m_fd);
+        m_data.resize (n + r);
+        if (r < chunk)
+            break;
+    }
+    if (ferror (m_fd)) {
+        error ("RGBE read error");
+        return false;
+    }
+    // Everything after this takes the address of m_data[0]
+    if (m_data.empty()) {
+        error ("RGBE file has no pixel data");
+        return false;
+    }
+    fclose (m_fd);
+    m_fd = NULL;
+    m_offsets.assign (m_spec.height + 1, 0);
+    m_nindexed = 1;
+    m_data_loaded = true;
+    return true;
+}
+
+
+
+bool
+HdrInput::index_scanlines (int y)
 {
-    if (m_next_scanline > y) {
-        // User is trying to read an earlier scanline than the one we're
-        // up to.  Easy fix: close the file and re-open.
-        ImageSpec dummyspec;
-        int subimage = current_subimage();
-        int miplevel = current_miplevel();
-        if (! close ()  ||
-            ! open (m_filename, dummyspec)  ||
-            ! seek_subimage (subimage, miplevel, dummyspec))
-            return false;    // Somehow, the re-open failed
-        assert (m_next_scanline == 0 && current_subimage() == subimage &&
-                current_miplevel() == miplevel);
-    }
-    while (m_next_scanline <= y) {
-        // Keep reading until we're read the scanline we really need
-        int r = RGBE_ReadPixels_RLE (m_fd, (float *)data, m_spec.width, 1, rgbe_error);
-        ++m_next_scanline;
-        if (r != RGBE_RETURN_SUCCESS) {
-            error ("%s", rgbe_error);
+    const char *err = NULL;
+    for ( ;  m_nindexed <= y;  ++m_nindexed) {
+        size_t off = m_offsets[m_nindexed-1];
+        size_t len = rgbe_scanline (&m_data[0] + off, m_data.size() - off,
+                                    m_spec.width, NULL, err);
+        if (! len) {
+            error ("%s", err);
             return false;
         }
+        m_offsets[m_nindexed] = off + len;
+    }
+    return true;
+}
+
+
+
+bool
+HdrInput::read_native_scanline (int y, int z, void *data)
+{
+    return read_native_scanlines (y, y+1, z, data);
+}
+
+
+
+bool
+HdrInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
+{
+    yend = std::min (yend, m_spec.y+m_spec.height);
+    if (ybegin < m_spec.y || ybegin >= yend)
+        return ybegin == yend;
+    // The pixel data is read into memory all at once, and scanlines are
+    // found by skipping through the run lengths of the ones before them
+    // (which is cheap, and only ever done once), so any scanlines may be
+    // read in any order.  A band of them can then be decoded in parallel.
+    if (! load_pixel_data () || ! index_scanlines (yend - 1 - m_spec.y))
+        return false;
+
+    atomic_int failures (0);
+    HdrDecodeTask task;
+    task.data = &m_data[0];
+    task.size = m_data.size ();
+    task.offsets = &m_offsets[0];
+    task.width = m_spec.width;
+    task.failures = &failures;
+    int nthreads = threads ();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    nthreads = std::max (nthreads, 1);
+    int nlines = yend - ybegin;
+    int lines_per_task = std::max (16, (nlines + nthreads - 1) / nthreads);
+    if (lines_per_task >= nlines) {
+        task.ybegin = ybegin - m_spec.y;
+        task.yend = yend - m_spec.y;
+        task.out = (float *)data;
+        task ();
+    } else {
+        task_set tasks;
+        for (int y = ybegin;  y < yend;  y += lines_per_task) {
+            task.ybegin = y - m_spec.y;
+            task.yend = std::min (y + lines_per_task, yend) - m_spec.y;
+            task.out = (float *)data + size_t(y - ybegin) * 3 * m_spec.width;
+            tasks.push (task);
+        }
+        tasks.wait ();
+    }
+    if (failures) {
+        error ("RGBE read error");
+        return false;
     }
     return true;
 }
@@ -153,6 +153,7 @@ private:
     std::string m_filename;
     iff_pvt::IffFileHeader m_iff_header;
     std::vector<uint8_t> m_buf;
+    Filesystem::IOBufferedReader m_reader;
     
     uint32_t m_tbmp_start;
     
@@ -166,8 +167,11 @@ private:
     // helper to read an image
     bool readimg (void);
     
-    // helper to uncompress a rle channel
-    size_t uncompress_rle_channel(const uint8_t *in, uint8_t * out, int size);
+    // helper to uncompress a rle channel from in[] (ending before inend)
+    // into size bytes of out; returns the number of bytes of in used, or
+    // 0 if the encoded data ran out first
+    size_t uncompress_rle_channel(const uint8_t *in, const uint8_t *inend,
+                                  uint8_t * out, int size);
 };
 
 
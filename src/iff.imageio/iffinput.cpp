@@ -84,6 +84,7 @@ IffInput::open (const std::string &name, ImageSpec &spec)
         error ("Could not open file \"%s\"", name.c_str());
         return false;
     }
+    m_reader.reset (m_fd);
     
     // we read header of the file that we think is IFF file
     if (!m_iff_header.read_header (m_fd)) {
@@ -158,8 +159,10 @@ IffInput::read_native_scanline (int y, int z, void *data)
 bool
 IffInput::read_native_tile (int x, int y, int z, void *data)
 {
-    if (m_buf.empty ())
-        readimg ();
+    if (m_buf.empty () && ! readimg ()) {
+        m_buf.clear ();
+        return false;
+    }
 
     // tile size
     int w = m_spec.width;
@@ -190,6 +193,7 @@ IffInput::read_native_tile (int x, int y, int z, void *data)
 bool
 inline IffInput::close (void)
 {
+    m_reader.reset ((Filesystem::IOProxy *)NULL);
     if (m_fd) {
         fclose (m_fd);
         m_fd = NULL;
@@ -208,8 +212,9 @@ IffInput::readimg()
     uint32_t chunksize;
   
     // seek pos
-    // set position tile may be called randomly
-    fseek (m_fd, m_tbmp_start, SEEK_SET);
+    // set position tile may be called randomly; the chunks are then
+    // read (and decoded in place) through m_reader's large buffer
+    m_reader.seek (m_tbmp_start);
   
     // resize buffer
     m_buf.resize (m_spec.image_bytes());
@@ -217,10 +222,12 @@ IffInput::readimg()
     for (unsigned int t=0; t<m_iff_header.tiles;)
     {  
         // get type
-        if (!fread (&type, 1, sizeof (type), m_fd) ||
+        if (!m_reader.read (&type, sizeof (type)) ||
             // get length
-            !fread (&size, 1, sizeof (size), m_fd))
-        return false;
+            !m_reader.read (&size, sizeof (size))) {
+            error ("\"%s\": read error", m_filename.c_str());
+            return false;
+        }
 
         if (littleendian())
             swap_endian (&size);
@@ -235,11 +242,13 @@ IffInput::readimg()
          
         // get tile coordinates.
         uint16_t xmin, xmax, ymin, ymax;
-        if (!fread (&xmin, 1, sizeof (xmin), m_fd) ||
-            !fread (&ymin, 1, sizeof (ymin), m_fd) ||
-            !fread (&xmax, 1, sizeof (xmax), m_fd) ||
-            !fread (&ymax, 1, sizeof (ymax), m_fd))
-        return false;
+        if (!m_reader.read (&xmin, sizeof (xmin)) ||
+            !m_reader.read (&ymin, sizeof (ymin)) ||
+            !m_reader.read (&xmax, sizeof (xmax)) ||
+            !m_reader.read (&ymax, sizeof (ymax))) {
+            error ("\"%s\": read error", m_filename.c_str());
+            return false;
+        }
 
         // swap endianness
         if (littleendian()) {
@@ -263,9 +272,19 @@ IffInput::readimg()
             xmax >= m_spec.width || 
             ymax >= m_spec.height ||
             !tw ||
-            !th) {
+            !th ||
+            chunksize < 8) {
+            error ("\"%s\": bad tile", m_filename.c_str());
+            return false;
+        }
+
+        // the tile's data, used in place
+        const uint8_t *p = m_reader.take (image_size);
+        if (!p) {
+            error ("\"%s\": read error", m_filename.c_str());
             return false;
         }
+        const uint8_t *pend = p + image_size;
 
         // tile compress
         bool tile_compress = false;
@@ -291,27 +310,21 @@ IffInput::readimg()
         // handle 8-bit data.
         if (m_iff_header.pixel_bits == 8) {
 
-            std::vector<uint8_t> scratch;
-        
-            // set bytes.
-            scratch.resize (image_size);
-        
-            if (!fread (&scratch[0], 1, scratch.size(), m_fd))
-                return false;
-        
-            // set tile data
-            uint8_t * p = static_cast<uint8_t*>(&scratch[0]);
-
             // tile compress.
             if (tile_compress) {
 
                 // map BGR(A) to RGB(A)
+                std::vector<uint8_t> in (tw * th);
                 for (int c =(channels * m_spec.channel_bytes()) - 1; c>=0; --c) {
-                    std::vector<uint8_t> in (tw * th);
                     uint8_t *in_p = &in[0];
           
                     // uncompress and increment
-                    p += uncompress_rle_channel (p, in_p, tw * th);
+                    size_t used = uncompress_rle_channel (p, pend, in_p, tw * th);
+                    if (!used) {
+                        error ("\"%s\": corrupt RLE data", m_filename.c_str());
+                        return false;
+                    }
+                    p += used;
             
                     // set tile
                     for (uint16_t py=ymin; py<=ymax; py++) {
@@ -337,13 +350,13 @@ IffInput::readimg()
                     // set tile
                     int sx=0;
                     for (uint16_t px=xmin; px<=xmax; px++) {
-                        uint8_t *in_p = p + 
+                        const uint8_t *in_p = p + 
                                         (sy * tw + sx) * 
                                         m_spec.pixel_bytes();
                   
                         // map BGR(A) to RGB(A)
                         for (int c=channels - 1; c>=0; --c) {
-                            uint8_t *out_p = in_p + (c * m_spec.channel_bytes());
+                            const uint8_t *out_p = in_p + (c * m_spec.channel_bytes());
                             *out_dy++ = *out_p;
                         }
                         sx++;
@@ -355,17 +368,6 @@ IffInput::readimg()
         // handle 16-bit data.
         else if (m_iff_header.pixel_bits == 16) {
 
-            std::vector<uint8_t> scratch;
-          
-            // set bytes.
-            scratch.resize (image_size);
-          
-            if (!fread (&scratch[0], 1, scratch.size(), m_fd))
-                return false;
-          
-            // set tile data
-            uint8_t * p = static_cast<uint8_t*>(&scratch[0]);
-          
             if (tile_compress) {
 
                 // set map
@@ -391,14 +393,19 @@ IffInput::readimg()
                 }
             
                 // map BGR(A)BGR(A) to RRGGBB(AA)
+                std::vector<uint8_t> in (tw * th);
                 for (int c =(channels * m_spec.channel_bytes()) - 1; c>=0; --c) {
                     int mc = map[c];
 
-                    std::vector<uint8_t> in (tw * th);
                     uint8_t *in_p = &in[0];
               
                     // uncompress and increment
-                    p += uncompress_rle_channel (p, in_p, tw * th);
+                    size_t used = uncompress_rle_channel (p, pend, in_p, tw * th);
+                    if (!used) {
+                        error ("\"%s\": corrupt RLE data", m_filename.c_str());
+                        return false;
+                    }
+                    p += used;
 
                     // set tile
                     for (uint16_t py=ymin; py<=ymax; py++) {
@@ -428,14 +435,14 @@ IffInput::readimg()
                     // set tile
                     int sx=0;
                     for (uint16_t px=xmin; px<=xmax; px++) {
-                        uint8_t *in_p = p + 
+                        const uint8_t *in_p = p + 
                                         (sy * tw + sx) * 
                                         m_spec.pixel_bytes();
                 
                         // map BGR(A) to RGB(A)
                         for (int c=channels - 1; c>=0; --c) {
                             uint16_t pixel;
-                            uint8_t * out_p = in_p + (c * m_spec.channel_bytes());
+                            const uint8_t * out_p = in_p + (c * m_spec.channel_bytes());
                             memcpy (&pixel, out_p, 2);
                             // swap endianness
                             if (littleendian()) {
@@ -461,8 +468,7 @@ IffInput::readimg()
         
     } else { 
         // skip to the next block
-        if (fseek (m_fd, chunksize, SEEK_CUR))
-            return false;
+        m_reader.skip (chunksize);
         }
     }
   
@@ -489,29 +495,34 @@ IffInput::readimg()
 
 size_t
 IffInput::uncompress_rle_channel(
-    const uint8_t * in, uint8_t * out, int size
+    const uint8_t * in, const uint8_t * inend, uint8_t * out, int size
 )
 {
     const uint8_t * const _in = in;
     const uint8_t * const end = out + size;
 
     while (out < end) {
+        if (in >= inend)
+            return 0;
         // information.
-        const uint8_t count = (*in & 0x7f) + 1;
+        const int count = std::min ((*in & 0x7f) + 1, int(end - out));
         const bool run = (*in & 0x80) ? true : false;
         ++in;
 
         // find runs
         if (!run) {
             // verbatim
-            for (int i=0; i<count; i++)
-            *out++ = *in++;
+            if (inend - in < count)
+                return 0;
+            memcpy (out, in, count);
+            in += count;
         } else {
             // duplicate
-            const uint8_t p = *in++;
-            for (int i=0; i<count; i++)
-                *out++ = p;
+            if (in >= inend)
+                return 0;
+            memset (out, *in++, count);
         }
+        out += count;
     }
     const size_t r = in - _in;
     return r;
@@ -36,7 +36,6 @@
 #include <iostream>
 #include <iterator>
 
-#include <boost/scoped_ptr.hpp>
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
 
@@ -44,6 +43,7 @@
 #include "OpenImageIO/strutil.h"
 #include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/imageio.h"
+#include "OpenImageIO/thread.h"
 
 OIIO_NAMESPACE_USING;
 
@@ -56,39 +56,64 @@ static bool file_match = false;
 static bool print_dirs = false;
 static bool all_subimages = false;
 static bool extended_regex = false;
+static int nthreads = 1;
 static std::string pattern;
 static std::vector<std::string> filenames;
 
 
 
-static bool
-grep_file (const std::string &filename, boost::regex &re,
-           bool ignore_nonimage_files=false)
-{
-    if (! Filesystem::exists (filename)) {
-        std::cerr << "igrep: " << filename << ": No such file or directory\n";
-        return false;
+// One file (or directory) to search, and, once it's been opened, its
+// ImageInput or the error from trying.
+struct GrepItem {
+    std::string filename;
+    bool isdir;
+    bool ignore_nonimage;   // Found by recursion, not named by the user
+    ImageInput *in;
+    std::string err;
+};
+
+
+
+// Open items [begin,end) of the list, several threads at once, each
+// taking the next unopened one.
+struct OpenTask {
+    std::vector<GrepItem> *items;
+    atomic_int *next;
+    int end;
+
+    void operator() () {
+        for (int i = (*next)++;  i < end;  i = (*next)++) {
+            GrepItem &item ((*items)[i]);
+            if (item.isdir)
+                continue;
+            // Only the metadata is searched, so the readers needn't get
+            // ready to decode pixels.
+            ImageSpec config;
+            config.attribute ("oiio:HeaderOnly", 1);
+            item.in = ImageInput::open (item.filename, &config);
+            if (! item.in)
+                item.err = geterror();
+        }
     }
+};
+
+
 
-    if (Filesystem::is_directory (filename)) {
-        if (! recursive)
-            return false;
+static bool
+grep_input (const GrepItem &item, boost::regex &re)
+{
+    const std::string &filename (item.filename);
+    if (item.isdir) {
         if (print_dirs) {
             std::cout << "(" << filename << "/)\n";
             std::cout.flush();
         }
-        bool r = false;
-        std::vector<std::string> directory_entries;
-        Filesystem::get_directory_entries (filename, directory_entries);
-        for (size_t i = 0, e = directory_entries.size(); i < e; ++i)
-            r |= grep_file (directory_entries[i], re, true);
-        return r;
+        return false;
     }
-
-    boost::scoped_ptr<ImageInput> in (ImageInput::open (filename.c_str()));
-    if (! in.get()) {
-        if (! ignore_nonimage_files)
-            std::cerr << geterror() << "\n";
+    ImageInput *in = item.in;
+    if (! in) {
+        if (! item.ignore_nonimage)
+            std::cerr << item.err << "\n";
         return false;
     }
     ImageSpec spec = in->spec();
@@ -136,6 +161,38 @@ grep_file (const std::string &filename, boost::regex &re,
 
 
 
+// Add the file or directory to the list of things to search (with
+// everything below it, for a directory when recursing).
+static void
+add_items (const std::string &filename, std::vector<GrepItem> &items)
+{
+    if (! Filesystem::exists (filename)) {
+        std::cerr << "igrep: " << filename << ": No such file or directory\n";
+        return;
+    }
+    GrepItem item;
+    item.filename = filename;
+    item.isdir = Filesystem::is_directory (filename);
+    item.ignore_nonimage = false;
+    item.in = NULL;
+    if (item.isdir && ! recursive)
+        return;
+    items.push_back (item);
+    if (item.isdir) {
+        std::vector<std::string> entries;
+        std::vector<bool> isdir;
+        Filesystem::walk_directory (filename, entries, &isdir, nthreads);
+        item.ignore_nonimage = true;
+        for (size_t i = 0, e = entries.size(); i < e; ++i) {
+            item.filename = entries[i];
+            item.isdir = isdir[i];
+            items.push_back (item);
+        }
+    }
+}
+
+
+
 static int
 parse_files (int argc, const char *argv[])
 {
@@ -167,6 +224,7 @@ main (int argc, const char *argv[])
                 "-r", &recursive, "Recurse into directories",
                 "-d", &print_dirs, "Print directories (when recursive)",
                 "-a", &all_subimages, "Search all subimages of each file",
+                "-j %d", &nthreads, "Number of threads opening files at once",
                 "--help", &help, "Print help message",
                 NULL);
     if (ap.parse(argc, argv) < 0 || pattern.empty() || filenames.empty()) {
@@ -185,8 +243,34 @@ main (int argc, const char *argv[])
     if (ignore_case)
         flag |= boost::regex_constants::icase;
     boost::regex re (pattern, flag);
-    BOOST_FOREACH (const std::string &s, filenames) {
-        grep_file (s, re);
+    std::vector<GrepItem> items;
+    BOOST_FOREACH (const std::string &s, filenames)
+        add_items (s, items);
+
+    // Open a window of files at a time in parallel, then search them in
+    // order, so the output is the same however many threads there are.
+    nthreads = std::max (1, nthreads);
+    int window = nthreads > 1 ? 16 * nthreads : 1;
+    for (int begin = 0;  begin < (int)items.size();  begin += window) {
+        int end = std::min (begin + window, (int)items.size());
+        atomic_int next (begin);
+        OpenTask task;
+        task.items = &items;
+        task.next = &next;
+        task.end = end;
+        if (nthreads == 1) {
+            task ();
+        } else {
+            thread_group threads;
+            for (int t = 0;  t < nthreads;  ++t)
+                threads.create_thread (task);
+            threads.join_all ();
+        }
+        for (int i = begin;  i < end;  ++i) {
+            grep_input (items[i], re);
+            delete items[i].in;
+            items[i].in = NULL;
+        }
     }
 
     return 0;
@@ -48,6 +48,7 @@
 #include "OpenImageIO/deepdata.h"
 #include "OpenImageIO/hash.h"
 #include "OpenImageIO/filesystem.h"
+#include "OpenImageIO/thread.h"
 
 OIIO_NAMESPACE_USING;
 
@@ -64,6 +65,7 @@ static boost::regex field_re;
 static bool subimages = false;
 static bool compute_sha1 = false;
 static bool compute_stats = false;
+static int nthreads = 1;
 
 
 
@@ -276,6 +278,11 @@ print_stats (const std::string &filename,
         printf ("%sTotal deep samples in all pixels: %llu\n", indent, (unsigned long long)totalsamples);
         printf ("%sPixels with deep samples   : %llu\n", indent, (unsigned long long)(npixels-emptypixels));
         printf ("%sPixels with no deep samples: %llu\n", indent, (unsigned long long)emptypixels);
+        std::string chtypes;
+        for (int c = 0; c < dd->channels(); ++c)
+            chtypes += Strutil::format ("%s%s", c ? "," : "", dd->channeltype(c));
+        printf ("%sDeep data memory: %s (%s)\n", indent,
+                Strutil::memformat (dd->memsize()).c_str(), chtypes.c_str());
     } else {
         std::vector<float> constantValues(input.spec().nchannels);
         if (isConstantColor(input, &constantValues[0])) {
@@ -632,6 +639,34 @@ parse_files (int argc, const char *argv[])
 
 
 
+// A file opened ahead of printing, or the error from trying.
+struct OpenedFile {
+    OpenedFile () : in(NULL) { }
+    ImageInput *in;
+    std::string err;
+};
+
+
+
+// Open n files, several threads at once, each taking the next unopened
+// one.
+struct OpenTask {
+    const std::string *filenames;
+    OpenedFile *opened;
+    atomic_int *next;
+    int n;
+    const ImageSpec *config;
+
+    void operator() () {
+        for (int i = (*next)++;  i < n;  i = (*next)++) {
+            opened[i].in = ImageInput::open (filenames[i], config);
+            opened[i].err = opened[i].in ? std::string() : geterror();
+        }
+    }
+};
+
+
+
 int
 main (int argc, const char *argv[])
 {
@@ -649,6 +684,7 @@ main (int argc, const char *argv[])
                 "-a", &subimages, "Print info about all subimages",
                 "--hash", &compute_sha1, "Print SHA-1 hash of pixel values",
                 "--stats", &compute_stats, "Print image pixel statistics (data window)",
+                "-j %d", &nthreads, "Number of threads opening files at once",
                 NULL);
     if (ap.parse(argc, argv) < 0 || filenames.empty()) {
         std::cerr << ap.geterror() << std::endl;
@@ -670,20 +706,53 @@ main (int argc, const char *argv[])
         longestname = std::max (longestname, s.length());
     longestname = std::min (longestname, (size_t)40);
 
+    // Unless we're hashing the pixels (which reads them through the same
+    // ImageInput), ask the readers to parse only the headers.  --stats
+    // reads the pixels separately, through an ImageBuf.
+    ImageSpec config;
+    if (! compute_sha1)
+        config.attribute ("oiio:HeaderOnly", 1);
+
+    // Open a window of files at a time in parallel, then print them in
+    // order, so the output is the same however many threads there are.
     long long totalsize = 0;
-    BOOST_FOREACH (const std::string &s, filenames) {
-        ImageInput *in = ImageInput::open (s.c_str());
-        if (! in) {
-            std::string err = geterror();
-            if (err.empty())
-                err = Strutil::format ("Could not open \"%s\"", s.c_str());
-            std::cerr << "iinfo: " << err << "\n";
-            continue;
+    nthreads = std::max (1, nthreads);
+    int nfiles = (int) filenames.size();
+    int window = nthreads > 1 ? 16 * nthreads : 1;
+    std::vector<OpenedFile> opened (std::min (window, nfiles));
+    for (int begin = 0;  begin < nfiles;  begin += window) {
+        int end = std::min (begin + window, nfiles);
+        atomic_int next (0);
+        OpenTask task;
+        task.filenames = &filenames[begin];
+        task.opened = &opened[0];
+        task.next = &next;
+        task.n = end - begin;
+        task.config = &config;
+        if (nthreads == 1) {
+            task ();
+        } else {
+            thread_group threads;
+            for (int t = 0;  t < nthreads;  ++t)
+                threads.create_thread (task);
+            threads.join_all ();
+        }
+        for (int i = 0;  i < end - begin;  ++i) {
+            const std::string &s (filenames[begin+i]);
+            ImageInput *in = opened[i].in;
+            if (! in) {
+                std::string err = opened[i].err;
+                if (err.empty())
+                    err = Strutil::format ("Could not open \"%s\"", s.c_str());
+                std::cerr << "iinfo: " << err << "\n";
+                continue;
+            }
+            ImageSpec spec = in->spec();
+            print_info (s, longestname, in, spec, verbose, sum, totalsize);
+            in->close ();
+            delete in;
+            opened[i].in = NULL;
         }
-        ImageSpec spec = in->spec();
-        print_info (s, longestname, in, spec, verbose, sum, totalsize);
-        in->close ();
-        delete in;
     }
 
     if (sum) {
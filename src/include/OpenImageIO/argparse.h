@@ -44,10 +44,12 @@
 #endif
 
 #include <vector>
+#include <map>
 
 #include "export.h"
 #include "oiioversion.h"
 #include "tinyformat.h"
+#include "string_view.h"
 
 
 OIIO_NAMESPACE_BEGIN
@@ -164,6 +166,14 @@ public:
     /// (and clear any error flags).  If no error has occurred since the
     /// last time geterror() was called, it will return an empty string.
     std::string geterror () const;
+
+    /// Called from an option's callback, stop parse() from going on to
+    /// the rest of the command line; parse() then returns 0 right after
+    /// that callback.  Each call to parse() starts out not aborted.
+    void abort (bool aborted = true) { m_aborted = aborted; }
+
+    /// Was the last (or current) parse() stopped by abort()?
+    bool aborted () const { return m_aborted; }
     
     /// Print the usage message to stdout.  The usage message is
     /// generated and formatted automatically based on the command and
@@ -184,10 +194,14 @@ private:
     const char **m_argv;                  // a copy of the command line argv
     mutable std::string m_errmessage;     // error message
     ArgOption *m_global;                  // option for extra cmd line arguments
+    bool m_aborted;                       // a callback called abort()
     std::string m_intro;
     std::vector<ArgOption *> m_option;
+    // Options by name, and by name without its leading dash or two
+    // (first declared wins), for matching "-foo" to "--foo" and back.
+    std::map<string_view,ArgOption *> m_byname, m_byundashed;
 
-    ArgOption *find_option(const char *name);
+    ArgOption *find_option (string_view name);
     // void error (const char *format, ...)
     TINYFORMAT_WRAP_FORMAT (void, error, /**/,
         std::ostringstream msg;, msg, m_errmessage = msg.str();)
@@ -57,6 +57,8 @@ class OIIO_API ColorProcessor;
 ///
 /// NOTE: ColorConfig(s) and ColorProcessor(s) are potentially heavy-weight.
 /// Their construction / destruction should be kept to a minimum.
+/// A ColorConfig caches the processors it constructs, so asking it again
+/// for the same transform is cheap (until reset() loads a new config).
 
 class OIIO_API ColorConfig
 {
@@ -67,12 +67,19 @@ public:
     /// Deallocate all space in the vectors
     void free ();
 
-    /// Initialize size and allocate nsamples, pointers.
+    /// Initialize size and allocate nsamples, pointers. If linepixels
+    /// > 0, the pixels are scanlines of linepixels pixels each, and the
+    /// sample data is stored separately per scanline: changing the
+    /// capacity of a pixel only moves data within its scanline, and
+    /// threads working on separate scanlines may insert and erase
+    /// samples simultaneously.
     void init (int npix, int nchan, array_view<const TypeDesc> channeltypes,
-               array_view<const std::string> channelnames);
+               array_view<const std::string> channelnames,
+               int linepixels = 0);
 
     /// Initialize size and allocate nsamples based on the number
-    /// of pixels, channels, and channel types in the ImageSpec.
+    /// of pixels, channels, and channel types in the ImageSpec. The
+    /// sample data is stored per scanline of the spec.
     void init (const ImageSpec &spec);
 
     /// Retrieve the total number of pixels.
@@ -128,6 +135,17 @@ public:
     /// Set deep sample value within a pixel, as a uint32.
     void set_deep_value (int pixel, int channel, int sample, uint32_t value);
 
+    /// Retrieve all the sample values of a pixel, converted to float,
+    /// into values[s*channels()+c], which must have room for
+    /// samples(pixel)*channels() floats.  This is much faster than
+    /// calling deep_value() for each one, converting whole runs at once
+    /// (with SIMD for half and float data).
+    void get_pixel_values (int pixel, float *values) const;
+
+    /// Set all the sample values of a pixel from the floats in
+    /// values[s*channels()+c], converting them to each channel's type.
+    void set_pixel_values (int pixel, const float *values);
+
     /// Retrieve the pointer to a given pixel/channel/sample, or NULL if
     /// there are no samples for that pixel. Use with care, and note that
     /// calls to insert_samples and erase_samples can invalidate pointers
@@ -137,12 +155,21 @@ public:
 
     array_view<const TypeDesc> all_channeltypes () const;
     array_view<const unsigned int> all_samples () const;
+    /// All the sample data, for all pixels in order (each pixel's
+    /// samples occupying its full capacity). If the data is stored per
+    /// scanline, this is a contiguous copy that is only valid until the
+    /// next call to all_data or any change to the DeepData.
     array_view<const char> all_data () const;
 
     /// Fill in the vector with pointers to the start of the first
     /// channel for each pixel.
     void get_pointers (std::vector<void*> &pointers) const;
 
+    /// The total memory, in bytes, held for the sample data (at each
+    /// pixel's capacity, in each channel's own type) and the per-pixel
+    /// sample count tables.
+    size_t memsize () const;
+
     /// Copy the designated sample from a source DeepData into this
     /// DeepData. The two DeepData structures need to have the same channel
     /// layout.
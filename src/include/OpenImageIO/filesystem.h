@@ -44,6 +44,7 @@
 
 #include <stdint.h>
 #include <cstdio>
+#include <cstring>
 #include <ctime>
 #include <fstream>
 #include <string>
@@ -134,6 +135,36 @@ OIIO_API bool get_directory_entries (const std::string &dirname,
                                bool recursive = false,
                                const std::string &filter_regex=std::string());
 
+/// Callback for walk_directory, given each entry found below the
+/// directory being walked.  For a directory, returning false keeps the
+/// walk from descending into it (the return value is ignored for other
+/// entries).  It may be called from several threads at once.
+typedef bool (*DirectoryWalkCallback) (void *opaque_data,
+                                       const std::string &path,
+                                       bool is_directory);
+
+/// Walk the whole tree below directory dirname, calling callback for
+/// every entry (in no particular order).  Directories are listed by
+/// nthreads threads at once (0 means one per hardware thread), sharing
+/// a queue of directories still to list, which pays off greatly when
+/// the file system has high latency, such as over NFS.  Symbolic links
+/// to directories are reported but not followed.  Return true if ok,
+/// false if dirname is not a directory.
+OIIO_API bool walk_directory (const std::string &dirname,
+                              DirectoryWalkCallback callback,
+                              void *opaque_data, int nthreads = 0);
+
+/// Fill filenames with every entry below directory dirname, like
+/// get_directory_entries (dirname, filenames, true), but listing
+/// directories in parallel as walk_directory does.  The names are
+/// sorted so that each directory is directly followed by its contents.
+/// If isdir is not NULL, it receives, for each name, whether that
+/// entry is a directory.
+OIIO_API bool walk_directory (const std::string &dirname,
+                              std::vector<std::string> &filenames,
+                              std::vector<bool> *isdir = NULL,
+                              int nthreads = 0);
+
 /// Return true if the path is an "absolute" (not relative) path.
 /// If 'dot_is_absolute' is true, consider "./foo" absolute.
 OIIO_API bool path_is_absolute (const std::string &path,
@@ -245,6 +276,19 @@ OIIO_API void last_write_time (const std::string& path, std::time_t time);
 /// error.
 OIIO_API uint64_t file_size (string_view path);
 
+/// Return a SHA-1 based hash of the entire contents of the named file,
+/// as a 40 character hex string, or an empty string if the file can't be
+/// read.  The file is hashed as chunksize byte pieces (the last may be
+/// shorter), which nthreads threads (0 means one per hardware thread)
+/// hash in parallel, several at a time with SHA1::hash_many.  The result
+/// is the SHA-1 of the chunk digests, concatenated in order (a file of
+/// just one chunk gets its plain SHA-1).  So it is as strong as SHA-1,
+/// and depends only on the contents and chunksize, but it is not the
+/// file's SHA-1 once the file is larger than one chunk.
+OIIO_API std::string hash_file (string_view filename,
+                                size_t chunksize = 4*1024*1024,
+                                int nthreads = 0);
+
 /// Ensure command line arguments are UTF-8 everywhere
 ///
 OIIO_API void convert_native_arguments (int argc, const char *argv[]);
@@ -323,6 +367,266 @@ OIIO_API bool scan_for_matching_filenames (const std::string &pattern,
                                            std::vector<int> &numbers,
                                            std::vector<std::string> &filenames);
 
+
+
+/// IOProxy is an abstract source or destination of bytes, so that image
+/// readers and writers that support it (those whose supports("ioproxy")
+/// is true) can use something other than a named disk file: a buffer in
+/// memory, a memory-mapped region, or an application's own storage.
+/// An IOProxy is given to ImageInput::open() as the "oiio:ioproxy"
+/// attribute (of type TypeDesc::PTR) of the configuration spec, or to
+/// ImageOutput::open() as that attribute of the spec being written.  The
+/// reader or writer does not take ownership of it, so it must outlive
+/// the ImageInput or ImageOutput.
+///
+/// Subclasses must provide at least pread() (for reading) or pwrite()
+/// (for writing), and size(); read() and write() work through them at
+/// the current position.
+class OIIO_API IOProxy {
+public:
+    enum Mode { Closed = 0, Read = 'r', Write = 'w' };
+
+    IOProxy () : m_mode(Closed), m_pos(0) { }
+    IOProxy (string_view filename, Mode mode)
+        : m_filename(filename), m_mode(mode), m_pos(0) { }
+    virtual ~IOProxy () { }
+
+    /// A short name for the kind of proxy, such as "file" or "memreader".
+    virtual const char *proxytype () const = 0;
+
+    virtual void close () { m_mode = Closed; }
+    virtual bool opened () const { return m_mode != Closed; }
+    Mode mode () const { return m_mode; }
+    /// The name of the file (if any) or other source, for messages.
+    const std::string &filename () const { return m_filename; }
+
+    /// The current position, used by read() and write().
+    virtual int64_t tell () { return m_pos; }
+    /// Set the current position, returning true if ok.
+    virtual bool seek (int64_t offset) { m_pos = offset; return true; }
+    /// Set the current position relative to the start (SEEK_SET), the
+    /// current position (SEEK_CUR), or the end (SEEK_END).
+    bool seek (int64_t offset, int origin);
+
+    /// Read up to size bytes at the current position and advance it,
+    /// returning the number of bytes read.
+    virtual size_t read (void *buf, size_t size);
+    /// Write size bytes at the current position and advance it,
+    /// returning the number of bytes written.
+    virtual size_t write (const void *buf, size_t size);
+
+    /// Read up to size bytes at the given offset, neither using nor
+    /// changing the current position, and return the number read.
+    ///
+    /// Every subclass must make this safe to call from several threads
+    /// at once, and while another thread is in read(), seek() or tell()
+    /// on the same proxy: a reader answering supports("concurrent_reads")
+    /// fetches tiles with pread() from any number of threads (see
+    /// ImageInput::read_native_tile_at) while its other calls go on
+    /// moving the current position under the caller's lock.  Nothing may
+    /// call close() or write to the proxy meanwhile.  IOMemReader and
+    /// IOMappedFile meet this contract, and so does IOFile, except on
+    /// Windows, where its pread() may only race other pread() calls.
+    virtual size_t pread (void *buf, size_t size, int64_t offset) = 0;
+    /// Write size bytes at the given offset, neither using nor changing
+    /// the current position, and return the number written.
+    virtual size_t pwrite (const void *buf, size_t size, int64_t offset) {
+        return 0;
+    }
+
+    /// Total size, in bytes.
+    virtual size_t size () const = 0;
+    virtual void flush () { }
+
+    /// If all of the bytes are directly addressable in memory (such as
+    /// a buffer, or a memory-mapped file), return a pointer to the first
+    /// of them (there are size() in all), so that a reader may use them
+    /// in place.  Otherwise return NULL.
+    virtual const void *mmap () const { return NULL; }
+
+protected:
+    std::string m_filename;
+    Mode m_mode;
+    int64_t m_pos;
+
+private:
+    IOProxy (const IOProxy &);            // Do not implement
+    IOProxy& operator= (const IOProxy &); // Do not implement
+};
+
+
+
+/// IOProxy for a disk file, either opened by name (and closed by the
+/// proxy) or an already open FILE* (which is not closed).
+class OIIO_API IOFile : public IOProxy {
+public:
+    IOFile (string_view filename, Mode mode);
+    IOFile (FILE *file, Mode mode);
+    virtual ~IOFile ();
+    virtual const char *proxytype () const { return "file"; }
+    virtual void close ();
+    virtual bool seek (int64_t offset);
+    virtual size_t read (void *buf, size_t size);
+    virtual size_t write (const void *buf, size_t size);
+    virtual size_t pread (void *buf, size_t size, int64_t offset);
+    virtual size_t pwrite (const void *buf, size_t size, int64_t offset);
+    virtual size_t size () const;
+    virtual void flush ();
+    FILE *handle () const { return m_file; }
+
+private:
+    FILE *m_file;
+    bool m_auto_close;
+    int64_t m_filepos;       ///< Where the FILE* is positioned
+};
+
+
+
+/// IOProxy for reading from a buffer in memory (or a memory-mapped
+/// region), which is not copied, and must outlive the proxy.
+class OIIO_API IOMemReader : public IOProxy {
+public:
+    IOMemReader (const void *buf, size_t size)
+        : IOProxy ("", Read), m_buf((const char *)buf), m_size(size) { }
+    virtual const char *proxytype () const { return "memreader"; }
+    virtual size_t pread (void *buf, size_t size, int64_t offset);
+    virtual size_t size () const { return m_size; }
+    virtual const void *mmap () const { return m_buf; }
+
+private:
+    const char *m_buf;
+    size_t m_size;
+};
+
+
+
+/// IOProxy that memory-maps a whole disk file for reading, so that
+/// mmap() hands readers the file's bytes in place.  If the file can't be
+/// opened or mapped (or is empty), opened() is false and the caller
+/// should fall back to an IOFile.
+class OIIO_API IOMappedFile : public IOProxy {
+public:
+    IOMappedFile (string_view filename);
+    virtual ~IOMappedFile ();
+    virtual const char *proxytype () const { return "mappedfile"; }
+    virtual void close ();
+    virtual size_t pread (void *buf, size_t size, int64_t offset);
+    virtual size_t size () const { return m_size; }
+    virtual const void *mmap () const { return m_buf; }
+
+private:
+    const char *m_buf;
+    size_t m_size;
+#ifdef _WIN32
+    void *m_mapping;         ///< HANDLE of the file mapping object
+#endif
+};
+
+
+
+/// IOProxy for writing into a std::vector<unsigned char>, either one
+/// given by the caller (which must outlive the proxy) or the proxy's
+/// own, growing it as needed.
+class OIIO_API IOVecOutput : public IOProxy {
+public:
+    IOVecOutput () : IOProxy ("", Write), m_buf(m_local) { }
+    IOVecOutput (std::vector<unsigned char> &buf)
+        : IOProxy ("", Write), m_buf(buf) { }
+    virtual const char *proxytype () const { return "vecoutput"; }
+    virtual size_t pread (void *buf, size_t size, int64_t offset);
+    virtual size_t pwrite (const void *buf, size_t size, int64_t offset);
+    virtual size_t size () const { return m_buf.size(); }
+    virtual const void *mmap () const {
+        return m_buf.size() ? &m_buf[0] : NULL;
+    }
+    /// The bytes written so far.
+    std::vector<unsigned char> &buffer () const { return m_buf; }
+
+private:
+    std::vector<unsigned char> &m_buf;
+    std::vector<unsigned char> m_local;
+};
+
+
+
+/// Sequential reader of an IOProxy (or a FILE*) through a large buffer,
+/// for decoders that consume their input a few bytes at a time, such as
+/// RLE.  It fetches with pread, so it neither uses nor changes the
+/// proxy's (or FILE's) own position; tell() and seek() are the reader's.
+/// Reads start small after each seek and grow while access continues
+/// sequentially, and seeking backward through the input, a little at a
+/// time, fills from before the requested spot, so both forward and
+/// backward scanline order mostly hit the buffer.  If the proxy is
+/// memory mapped, its bytes are used in place.
+class OIIO_API IOBufferedReader {
+public:
+    /// A reader with a buffer of up to bufsize bytes, which reads
+    /// nothing until it's reset() to a proxy or file.
+    IOBufferedReader (size_t bufsize = 1024*1024);
+    ~IOBufferedReader ();
+
+    /// Read from the given proxy (not owned), starting at offset 0.
+    void reset (IOProxy *io);
+    /// Read from the given open FILE* (not closed by the reader),
+    /// starting at offset 0.
+    void reset (FILE *file);
+
+    /// Read size bytes into buf, returning false if the input ended
+    /// first (in which case what there was has been read).
+    bool read (void *buf, size_t size) {
+        if (size_t(m_end - m_next) >= size) {
+            memcpy (buf, m_next, size);
+            m_next += size;
+            return true;
+        }
+        return read_slow (buf, size);
+    }
+
+    /// Return a pointer to the next size bytes, which are valid until
+    /// the next call that moves the reader, and skip past them.  Return
+    /// NULL (without moving) if the input ends first.
+    const unsigned char *take (size_t size) {
+        if (size_t(m_end - m_next) >= size) {
+            const unsigned char *p = m_next;
+            m_next += size;
+            return p;
+        }
+        return take_slow (size);
+    }
+
+    /// Return the next byte, or -1 at the end of the input.
+    int getc () {
+        if (m_next < m_end)
+            return *m_next++;
+        const unsigned char *p = take_slow (1);
+        return p ? *p : -1;
+    }
+
+    /// Position the reader at the given offset.
+    void seek (int64_t offset);
+    /// Skip ahead n bytes.
+    void skip (int64_t n) { seek (tell() + n); }
+    /// The offset of the next byte the reader will return.
+    int64_t tell () const { return m_bufpos + (m_next - m_start); }
+
+private:
+    IOProxy *m_io;
+    IOProxy *m_owned;            ///< Wrapper for a FILE*, which we delete
+    std::vector<unsigned char> m_buf;
+    size_t m_bufsize;            ///< Most to hold at once (unless asked)
+    size_t m_chunk;              ///< Size of the next read
+    int64_t m_bufpos;            ///< Offset of m_start in the input
+    const unsigned char *m_start, *m_next, *m_end;
+    bool m_mapped;               ///< m_start..m_end is the whole input
+    int64_t m_back_limit;        ///< If >= 0, fill backward from here
+
+    bool fill (size_t need);
+    bool read_slow (void *buf, size_t size);
+    const unsigned char *take_slow (size_t size);
+    IOBufferedReader (const IOBufferedReader &);            // Do not implement
+    IOBufferedReader& operator= (const IOBufferedReader &); // Do not implement
+};
+
 };  // namespace Filesystem
 
 OIIO_NAMESPACE_END
@@ -33,9 +33,12 @@
 #ifndef OPENIMAGEIO_FILTER_H
 #define OPENIMAGEIO_FILTER_H
 
+#include <vector>
+
 #include "oiioversion.h"
 #include "export.h"
 #include "string_view.h"
+#include "simd.h"
 
 
 OIIO_NAMESPACE_BEGIN
@@ -145,6 +148,80 @@ protected:
 };
 
 
+
+/// FilterTable1D is a tabulated copy of a 1D filter, or of the horizontal
+/// or vertical part of a separable 2D filter.  The filter is sampled once,
+/// evenly across its support, and thereafter evaluated by a table lookup
+/// and linear interpolation -- inline, with no virtual call and none of
+/// the trig or exp that filters like lanczos3, sinc, or blackman-harris
+/// need per tap.  Outside the support it returns 0, as the filters do.
+/// With the default resolution it matches the filter it came from to
+/// within about 1e-5 (absolute) for the smooth filters.
+class OIIO_API FilterTable1D {
+public:
+    /// Number of intervals the support is divided into, by default.
+    enum { DefaultResolution = 4096 };
+
+    /// Construct an empty table, which evaluates to 0 everywhere.
+    FilterTable1D () : m_radius(0.0f), m_scale(0.0f), m_umax(-1.0f) { }
+
+    /// Construct a table for a 1D filter.
+    FilterTable1D (const Filter1D &filter,
+                   int resolution = DefaultResolution) {
+        init (filter, resolution);
+    }
+
+    /// (Re-)tabulate a 1D filter over [-width/2, width/2].
+    void init (const Filter1D &filter, int resolution = DefaultResolution);
+
+    /// (Re-)tabulate the xfilt (if axis is 0) or yfilt (if axis is 1) of
+    /// a 2D filter, over [-width/2, width/2] or [-height/2, height/2].
+    void init (const Filter2D &filter, int axis,
+               int resolution = DefaultResolution);
+
+    /// Half the width of the tabulated support.
+    float radius () const { return m_radius; }
+
+    /// Is the table empty (never initialized)?
+    bool empty () const { return m_table.empty(); }
+
+    /// Evaluate the tabulated filter at x (relative to filter center).
+    float operator() (float x) const {
+        float u = (x + m_radius) * m_scale;
+        if (! (u >= 0.0f && u <= m_umax))   // also catches NaN
+            return 0.0f;
+        int i = int(u);
+        float f = u - float(i);
+        const float *t = &m_table[i];
+        return t[0] + f * (t[1] - t[0]);
+    }
+
+    /// Evaluate the tabulated filter at 8 positions at once, gathering
+    /// from the table.
+    simd::float8 operator() (const simd::float8 &x) const {
+        simd::float8 u = (x + simd::float8(m_radius)) * simd::float8(m_scale);
+        simd::mask8 inside = (u >= simd::float8::Zero())
+                           & (u <= simd::float8(m_umax));
+        u = simd::blend0 (u, inside);
+        simd::int8 i = simd::floori (u);
+        simd::float8 f = u - simd::float8(i);
+        simd::float8 t0 = simd::gather (&m_table[0], i);
+        simd::float8 t1 = simd::gather (&m_table[1], i);
+        return simd::blend0 (t0 + f * (t1 - t0), inside);
+    }
+
+private:
+    float m_radius;               ///< Half width of the support
+    float m_scale;                ///< Table intervals per unit of x
+    float m_umax;                 ///< Table position of x == m_radius
+    std::vector<float> m_table;   ///< resolution+1 samples, plus 1 pad
+
+    // Fill m_table from filt(x), given the radius and resolution.
+    template<class FUNC> void tabulate (const FUNC &filt, float radius,
+                                        int resolution);
+};
+
+
 OIIO_NAMESPACE_END
 
 #endif // OPENIMAGEIO_FILTER_H
@@ -581,6 +581,41 @@ inline OUT_TYPE bit_cast (const IN_TYPE in) {
 
 
 
+/// Copy n items that are each itemsize (2, 4, or 8) bytes from src to
+/// dst, reversing the byte order of each.  src and dst may be the same
+/// (but must not otherwise overlap).  Uses SSSE3 byte shuffles, 16
+/// bytes at a time, where available.
+inline void
+swap_endian_copy (const void *src, void *dst, size_t n, int itemsize)
+{
+    const unsigned char *in = (const unsigned char *) src;
+    unsigned char *out = (unsigned char *) dst;
+    size_t nbytes = n * itemsize;
+    size_t i = 0;
+#if OIIO_SIMD_SSE >= 3
+    if (itemsize == 2 || itemsize == 4 || itemsize == 8) {
+        const __m128i order = (itemsize == 2)
+            ? _mm_setr_epi8 (1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14)
+            : (itemsize == 4)
+            ? _mm_setr_epi8 (3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12)
+            : _mm_setr_epi8 (7,6,5,4,3,2,1,0, 15,14,13,12,11,10,9,8);
+        for ( ;  i + 16 <= nbytes;  i += 16) {
+            __m128i v = _mm_loadu_si128 ((const __m128i *)(in + i));
+            _mm_storeu_si128 ((__m128i *)(out + i), _mm_shuffle_epi8 (v, order));
+        }
+    }
+#endif
+    for ( ;  i < nbytes;  i += itemsize) {
+        for (int b = 0;  b < itemsize/2;  ++b) {
+            unsigned char t = in[i+b];
+            out[i+b] = in[i+itemsize-1-b];
+            out[i+itemsize-1-b] = t;
+        }
+    }
+}
+
+
+
 /// Change endian-ness of one or more data items that are each 2, 4,
 /// or 8 bytes.  This should work for any of short, unsigned short, int,
 /// unsigned int, float, long long, pointers.
@@ -588,6 +623,10 @@ template<class T>
 inline void
 swap_endian (T *f, int len=1)
 {
+    if (len >= 16 && (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)) {
+        swap_endian_copy (f, f, size_t(len), int(sizeof(T)));
+        return;
+    }
     for (char *c = (char *) f;  len--;  c += sizeof(T)) {
         if (sizeof(T) == 2) {
             std::swap (c[0], c[1]);
@@ -749,6 +788,12 @@ inline void convert_type<half,float> (const half *src,
                                       float *dst, size_t n,
                                       float _min, float _max)
 {
+#if OIIO_SIMD_AVX
+    for ( ; n >= 8; n -= 8, src += 8, dst += 8) {
+        simd::float8 s_simd (src);
+        s_simd.store (dst);
+    }
+#endif
     for ( ; n >= 4; n -= 4, src += 4, dst += 4) {
         simd::float4 s_simd (src);
         s_simd.store (dst);
@@ -768,13 +813,32 @@ convert_type<float,uint16_t> (const float *src, uint16_t *dst, size_t n,
     float min = std::numeric_limits<uint16_t>::min();
     float max = std::numeric_limits<uint16_t>::max();
     float scale = max;
+    // Scale, clamp, and round by adding 0.5 and truncating, exactly like
+    // scaled_conversion does for the leftovers.
     simd::float4 max_simd (max);
     simd::float4 one_half_simd (0.5f);
     simd::float4 zero_simd (0.0f);
+#if OIIO_SIMD_AVX >= 2
+    // 16 at a time.  The saturating pack works within 128-bit lanes, so
+    // a final permute puts the values back in order.
+    simd::float8 max8 (max), zero8 (0.0f), half8 (0.5f);
+    for ( ; n >= 16; n -= 16, src += 16, dst += 16) {
+        __m256i i0 = _mm256_cvttps_epi32 (simd::min (max8, simd::max (zero8, simd::float8(src) * max8)) + half8);
+        __m256i i1 = _mm256_cvttps_epi32 (simd::min (max8, simd::max (zero8, simd::float8(src+8) * max8)) + half8);
+        __m256i p = _mm256_packus_epi32 (i0, i1);
+        _mm256_storeu_si256 ((__m256i *)dst, _mm256_permute4x64_epi64 (p, 0xd8));
+    }
+#endif
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
+    for ( ; n >= 8; n -= 8, src += 8, dst += 8) {
+        __m128i i0 = _mm_cvttps_epi32 (clamp (simd::float4(src) * max_simd, zero_simd, max_simd) + one_half_simd);
+        __m128i i1 = _mm_cvttps_epi32 (clamp (simd::float4(src+4) * max_simd, zero_simd, max_simd) + one_half_simd);
+        _mm_storeu_si128 ((__m128i *)dst, _mm_packus_epi32 (i0, i1));
+    }
+#endif
     for ( ; n >= 4; n -= 4, src += 4, dst += 4) {
-        simd::float4 scaled = simd::round (simd::float4(src) * max_simd);
-        simd::float4 clamped = clamp (scaled, zero_simd, max_simd);
-        simd::int4 i (clamped);
+        simd::float4 clamped = clamp (simd::float4(src) * max_simd, zero_simd, max_simd);
+        simd::int4 i (clamped + one_half_simd);
         i.store (dst);
     }
     while (n--)
@@ -790,13 +854,40 @@ convert_type<float,uint8_t> (const float *src, uint8_t *dst, size_t n,
     float min = std::numeric_limits<uint8_t>::min();
     float max = std::numeric_limits<uint8_t>::max();
     float scale = max;
+    // Scale, clamp, and round by adding 0.5 and truncating, exactly like
+    // scaled_conversion does for the leftovers.
     simd::float4 max_simd (max);
     simd::float4 one_half_simd (0.5f);
     simd::float4 zero_simd (0.0f);
+#if OIIO_SIMD_AVX >= 2
+    // 32 at a time.  The saturating packs work within 128-bit lanes, so
+    // a final permute puts the bytes back in order.
+    simd::float8 max8 (max), zero8 (0.0f), half8 (0.5f);
+    const __m256i order = _mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7);
+    for ( ; n >= 32; n -= 32, src += 32, dst += 32) {
+        __m256i i0 = _mm256_cvttps_epi32 (simd::min (max8, simd::max (zero8, simd::float8(src) * max8)) + half8);
+        __m256i i1 = _mm256_cvttps_epi32 (simd::min (max8, simd::max (zero8, simd::float8(src+8) * max8)) + half8);
+        __m256i i2 = _mm256_cvttps_epi32 (simd::min (max8, simd::max (zero8, simd::float8(src+16) * max8)) + half8);
+        __m256i i3 = _mm256_cvttps_epi32 (simd::min (max8, simd::max (zero8, simd::float8(src+24) * max8)) + half8);
+        __m256i b = _mm256_packus_epi16 (_mm256_packs_epi32 (i0, i1),
+                                         _mm256_packs_epi32 (i2, i3));
+        _mm256_storeu_si256 ((__m256i *)dst, _mm256_permutevar8x32_epi32 (b, order));
+    }
+#endif
+#if defined(OIIO_SIMD_SSE)
+    for ( ; n >= 16; n -= 16, src += 16, dst += 16) {
+        __m128i i0 = _mm_cvttps_epi32 (clamp (simd::float4(src) * max_simd, zero_simd, max_simd) + one_half_simd);
+        __m128i i1 = _mm_cvttps_epi32 (clamp (simd::float4(src+4) * max_simd, zero_simd, max_simd) + one_half_simd);
+        __m128i i2 = _mm_cvttps_epi32 (clamp (simd::float4(src+8) * max_simd, zero_simd, max_simd) + one_half_simd);
+        __m128i i3 = _mm_cvttps_epi32 (clamp (simd::float4(src+12) * max_simd, zero_simd, max_simd) + one_half_simd);
+        __m128i b = _mm_packus_epi16 (_mm_packs_epi32 (i0, i1),
+                                      _mm_packs_epi32 (i2, i3));
+        _mm_storeu_si128 ((__m128i *)dst, b);
+    }
+#endif
     for ( ; n >= 4; n -= 4, src += 4, dst += 4) {
-        simd::float4 scaled = simd::round (simd::float4(src) * max_simd);
-        simd::float4 clamped = clamp (scaled, zero_simd, max_simd);
-        simd::int4 i (clamped);
+        simd::float4 clamped = clamp (simd::float4(src) * max_simd, zero_simd, max_simd);
+        simd::int4 i (clamped + one_half_simd);
         i.store (dst);
     }
     while (n--)
@@ -810,6 +901,12 @@ inline void
 convert_type<float,half> (const float *src, half *dst, size_t n,
                           half _min, half _max)
 {
+#if OIIO_SIMD_AVX
+    for ( ; n >= 8; n -= 8, src += 8, dst += 8) {
+        simd::float8 s (src);
+        s.store (dst);
+    }
+#endif
     for ( ; n >= 4; n -= 4, src += 4, dst += 4) {
         simd::float4 s (src);
         s.store (dst);
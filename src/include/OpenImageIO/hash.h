@@ -523,6 +523,19 @@ public:
         SHA1 s (data, size);  return s.digest();
     }
 
+    /// Return the hex string form of a Hash, just as digest() gives it.
+    static std::string hex_digest (const Hash &h);
+
+    /// Compute the SHA-1 hashes of n independent buffers (data[i], which
+    /// is size[i] bytes) into hashes[0..n-1], just as hashing each one
+    /// on its own would.  Buffers are hashed together in SIMD lanes, 8
+    /// at a time with AVX2 or 4 with SSE, which is several times faster
+    /// than one at a time, most of all when the sizes are equal.  When
+    /// built with the SHA extensions (SHA-NI), which already speed up
+    /// every SHA1, they are simply hashed one after another.
+    static void hash_many (int n, const void * const *data,
+                           const size_t *size, Hash *hashes);
+
 private:
     CSHA1 *m_csha1;
     bool m_final;
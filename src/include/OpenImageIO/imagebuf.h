@@ -203,18 +203,43 @@ public:
 
     /// Construct an ImageBuf that "wraps" a memory buffer owned by the
     /// calling application.  It can write pixels to this buffer, but
-    /// can't change its resolution or data type.
-    ImageBuf (const ImageSpec &spec, void *buffer);
+    /// can't change its resolution or data type.  buffer points to the
+    /// first pixel of the data window, and the strides give the number
+    /// of bytes between successive pixels, scanlines, and image planes
+    /// (AutoStride meaning the usual contiguous layout).  They may be
+    /// larger than the pixel data, as for padded rows or interleaved
+    /// framebuffers, or negative, as for bottom-up scanline order.
+    ImageBuf (const ImageSpec &spec, void *buffer,
+              stride_t xstride=AutoStride, stride_t ystride=AutoStride,
+              stride_t zstride=AutoStride);
 
     /// Construct an ImageBuf that "wraps" a memory buffer owned by the
-    /// calling application.  It can write pixels to this buffer, but
-    /// can't change its resolution or data type.
-    ImageBuf (string_view name, const ImageSpec &spec, void *buffer);
-
-    /// Construct a copy of an ImageBuf.
-    ///
+    /// calling application, with strides as above.
+    ImageBuf (string_view name, const ImageSpec &spec, void *buffer,
+              stride_t xstride=AutoStride, stride_t ystride=AutoStride,
+              stride_t zstride=AutoStride);
+
+    /// Construct a copy of an ImageBuf.  Local pixel memory is shared
+    /// with src (copy-on-write), so this is inexpensive until either
+    /// image's pixels are modified.
     ImageBuf (const ImageBuf &src);
 
+#if OIIO_CPLUSPLUS_VERSION >= 11
+    /// Move constructor: take over src's pixels and state, leaving src
+    /// uninitialized.
+    ImageBuf (ImageBuf &&src) : ImageBuf() { swap (src); }
+
+    /// Move assignment: take over src's pixels and state, leaving src
+    /// uninitialized.
+    const ImageBuf& operator= (ImageBuf &&src) {
+        if (this != &src) {
+            swap (src);
+            src.clear ();
+        }
+        return *this;
+    }
+#endif
+
     /// Destructor for an ImageBuf.
     ///
     ~ImageBuf ();
@@ -290,6 +315,26 @@ public:
     /// any subsequent write().
     void set_write_tiles (int width=0, int height=0, int depth=0);
 
+    /// Choose how the local pixel memory is laid out: in width x height
+    /// blocks of pixels (both powers of 2, height defaulting to width),
+    /// each block holding its pixels in scanline order and the blocks
+    /// themselves stored left to right, top to bottom; or, for width 0,
+    /// the usual scanline order.  Local pixels are rearranged right away;
+    /// for an ImageCache-backed image the layout takes effect when (and
+    /// if) the pixels are read into local memory.  A blocked layout keeps
+    /// 2D neighborhoods compact in memory for filters, resizes and warps
+    /// of very wide images, and is written to a file whose tiles are the
+    /// same size without any rearrangement.  Iterators (and therefore
+    /// all ImageBufAlgo functions) handle either layout.  Return false
+    /// (with an error) for an invalid size, a deep image, per-channel
+    /// formats, or an ImageBuf that wraps an application buffer.
+    bool set_local_tiles (int width, int height=0);
+
+    /// The block size of the local pixel layout set by set_local_tiles(),
+    /// or 0 if the local pixels are in scanline order (or not local).
+    int local_tile_width () const;
+    int local_tile_height () const;
+
     /// Write the image to the open ImageOutput 'out'.  Return true if
     /// all went ok, false if there were errors writing.  It does NOT
     /// close the file when it's done (and so may be called in a loop to
@@ -301,7 +346,9 @@ public:
     /// Force the ImageBuf to be writeable. That means that if it was
     /// previously backed by ImageCache (storage was IMAGECACHE), it will
     /// force a full read so that the whole image is in local memory. This
-    /// will invalidate any current iterators on the image. It has no effect
+    /// will invalidate any current iterators on the image. If the local
+    /// pixel memory is shared copy-on-write with another ImageBuf, this
+    /// ImageBuf will get its own private copy. It has no other effect
     /// if the image storage not IMAGECACHE.  Return true if it works
     /// (including if no read was necessary), false if something went
     /// horribly wrong. If keep_cache_type is true, it preserves any IC-
@@ -335,11 +382,28 @@ public:
     /// the app-owned buffer is already the correct resolution and
     /// number of channels.  The data type of the pixels will be
     /// converted automatically to the data type of the app buffer.
+    ///
+    /// If src holds its pixels in local memory and no data type change
+    /// is needed, the pixel memory is shared copy-on-write rather than
+    /// duplicated, and is only copied when one of the images is modified.
     bool copy (const ImageBuf &src);
 
     /// copy(src), but with optional override of pixel data type
     bool copy (const ImageBuf &src, TypeDesc format /*= TypeDesc::UNKNOWN*/);
 
+    /// Make *this a lightweight "view" of the pixels of src within roi
+    /// (by default, all of src): its data window is the pixel region of
+    /// roi and its channels are src's [roi.chbegin,roi.chend), referring
+    /// to src's own pixel memory rather than a copy, with the rest of
+    /// src's spec and metadata.  As with copy(), the memory is shared
+    /// copy-on-write, so writing to either image first gives the writer
+    /// its own (contiguous) copy.  Return true on success, or false
+    /// (leaving *this unchanged) if it can't be a view: src's pixels
+    /// must be held in local memory that src owns (not cached, deep, or
+    /// an app buffer), in a single data type, and roi must lie within
+    /// src's data window.
+    bool make_view (const ImageBuf &src, ROI roi=ROI::All());
+
     /// Swap with another ImageBuf
     void swap (ImageBuf &other) { std::swap (m_impl, other.m_impl); }
 
@@ -625,13 +689,53 @@ public:
     /// A raw pointer to "local" pixel memory, if they are fully in RAM
     /// and not backed by an ImageCache, or NULL otherwise.  You can
     /// also test it like a bool to find out if pixels are local.
+    ///
+    /// The non-const version first gives this ImageBuf its own copy of
+    /// any pixels it shares copy-on-write, so they may be written through
+    /// the pointer.  But the pointer is beyond copy-on-write's reach: a
+    /// copy of this ImageBuf made later shares the same memory, and keeps
+    /// seeing what is written through the pointer until one of the two
+    /// is modified through the ImageBuf interface.  Finish writing through
+    /// raw pointers before copying the ImageBuf, or ask again for the
+    /// pointer after copying.  The same goes for pixeladdr().
     void *localpixels ();
     const void *localpixels () const;
 
+    /// The number of bytes between successive pixels, scanlines, and
+    /// image planes of the local pixel memory.  These are the contiguous
+    /// strides unless the ImageBuf wraps an application buffer that was
+    /// given other strides.  For a blocked layout (see set_local_tiles),
+    /// the scanline stride is between the rows of one block, and raw
+    /// pixel pointers may only be stepped within a block.
+    stride_t pixel_stride () const;
+    stride_t scanline_stride () const;
+    stride_t z_stride () const;
+
+    /// Are the local pixels laid out contiguously, as they would be if
+    /// the ImageBuf had allocated them itself?
+    bool contiguous () const;
+
     /// Are the pixels backed by an ImageCache, rather than the whole
     /// image being in RAM somewhere?
     bool cachedpixels () const;
 
+    /// For an ImageBuf backed by an ImageCache, take references to all
+    /// the cache tiles overlapping roi (by default, the whole data
+    /// window) and hold them until unpin_tiles() or until the ImageBuf is
+    /// cleared, reset, or read into local memory.  While pinned, those
+    /// tiles can't be evicted, and iterators (and thus ImageBufAlgo
+    /// functions reading this image) compute directly from their memory
+    /// without consulting the cache at all -- a read-only, zero-copy
+    /// view of the cached image.  Pinned tiles may push the cache past
+    /// its "max_memory_MB".  Pinning or unpinning must not happen while
+    /// any iterators on the image are in use.  It does nothing for an
+    /// image that is not cache-backed.  Return true if all the tiles
+    /// could be pinned.
+    bool pin_tiles (ROI roi = ROI::All());
+
+    /// Release any tiles held by pin_tiles().
+    void unpin_tiles ();
+
     ImageCache *imagecache () const;
 
     /// Return the address where pixel (x,y,z) is stored in the image buffer.
@@ -767,14 +871,14 @@ public:
 
         ~IteratorBase () {
             if (m_tile)
-                m_ib->imagecache()->release_tile (m_tile);
+                m_ib->release_tile (m_tile);
         }
 
         /// Assign one IteratorBase to another
         ///
         const IteratorBase & assign_base (const IteratorBase &i) {
             if (m_tile)
-                m_ib->imagecache()->release_tile (m_tile);
+                m_ib->release_tile (m_tile);
             m_tile = NULL;
             m_proxydata = i.m_proxydata;
             m_ib = i.m_ib;
@@ -854,9 +958,12 @@ public:
             bool v = valid(x_,y_,z_);
             bool e = exists(x_,y_,z_);
             if (m_localpixels) {
-                if (e)
+                if (e) {
                     m_proxydata = (char *)m_ib->pixeladdr (x_, y_, z_);
-                else {  // pixel not in data window
+                    if (m_blockmask)  // end of this block row
+                        m_tilexend = std::min (m_img_xend,
+                                 ((x_ - m_img_xbegin) | m_blockmask) + 1 + m_img_xbegin);
+                } else {  // pixel not in data window
                     m_x = x_;  m_y = y_;  m_z = z_;
                     if (m_wrap == WrapBlack) {
                         m_proxydata = (char *)m_ib->blackpixel();
@@ -936,6 +1043,53 @@ public:
             pos (xbegin, ybegin, zbegin);
         }
 
+        /// Span iteration: return the number of pixels, starting with
+        /// the current one and proceeding in +x, that lie within the
+        /// iteration range and are laid out contiguously in memory (with
+        /// a stride of pixel_bytes()) starting at the current raw data
+        /// pointer.  For an image in local memory that is the rest of
+        /// the scanline within the range (or just 1 if it wraps an
+        /// application buffer whose pixels are not packed together
+        /// within a scanline, or the rest of the block row for a blocked
+        /// layout); for an ImageCache-backed image
+        /// it's the rest of the current tile row, so that the cache is
+        /// consulted once per tile row rather than once per pixel.  It is
+        /// 1 for a pixel outside the data window (whose data is the
+        /// black or wrapped pixel), and 0 when done() or for deep images.
+        /// A typical loop looks like:
+        /// \code
+        ///   for (ImageBuf::ConstIterator<float> s (src, roi);  ! s.done(); ) {
+        ///       int n = s.span_length ();
+        ///       const float *p = (const float *) s.rawptr ();
+        ///       ... process n pixels at p, p+nchannels, ... ...
+        ///       s.span_advance (n);
+        ///   }
+        /// \endcode
+        int span_length () const {
+            if (! m_valid || m_deep || ! m_proxydata)
+                return 0;
+            if (! m_exists || ! m_xpacked)
+                return 1;
+            if (! m_localpixels && ! m_tile)
+                return 1;   // failed tile read: just the black pixel
+            // For local pixels, m_tilexend is the end of the scanline, or
+            // of the block row for a blocked layout.
+            return std::min (m_rng_xend, m_tilexend) - m_x;
+        }
+
+        /// Advance the iterator by n pixels, where 0 < n <= span_length().
+        void span_advance (int n) {
+            DASSERT (n > 0 && n <= span_length());
+            if (n > 1) {
+                m_x += n-1;
+                m_proxydata += (n-1) * m_pixel_bytes;
+            }
+            ++(*this);
+        }
+
+        /// The number of bytes from one pixel to the next within a span.
+        stride_t pixel_bytes () const { return m_pixel_bytes; }
+
     protected:
         friend class ImageBuf;
         friend class ImageBufImpl;
@@ -954,7 +1108,9 @@ public:
         int m_tilexbegin, m_tileybegin, m_tilezbegin;
         int m_tilexend;
         int m_nchannels;
-        size_t m_pixel_bytes;
+        stride_t m_pixel_bytes;
+        bool m_xpacked;         // pixels adjacent within a scanline
+        int m_blockmask;        // local block width - 1, or 0 for scanlines
         char *m_proxydata;
         WrapMode m_wrap;
 
@@ -969,7 +1125,12 @@ public:
             m_img_zbegin = spec.z; m_img_zend = spec.z+spec.depth;
             m_nchannels = spec.nchannels;
 //            m_tilewidth = spec.tile_width;
-            m_pixel_bytes = spec.pixel_bytes();
+            m_pixel_bytes = m_localpixels ? m_ib->pixel_stride()
+                                          : (stride_t) spec.pixel_bytes();
+            m_xpacked = (m_pixel_bytes == (stride_t) spec.pixel_bytes());
+            m_blockmask = m_localpixels ? std::max (0, m_ib->local_tile_width() - 1) : 0;
+            if (m_localpixels)
+                m_tilexend = m_img_xend;
             m_x = 1<<31;
             m_y = 1<<31;
             m_z = 1<<31;
@@ -992,7 +1153,14 @@ public:
             DASSERT (valid(m_x,m_y,m_z));    // should be true by definition
             m_proxydata += m_pixel_bytes;
             if (m_localpixels) {
-                if (OIIO_UNLIKELY(m_x >= m_img_xend)) {
+                if (OIIO_UNLIKELY(m_x >= m_tilexend)) {
+                    if (m_x < m_img_xend) {
+                        // Crossed into the next block of a blocked layout
+                        m_proxydata = (char *)m_ib->pixeladdr (m_x, m_y, m_z);
+                        m_tilexend = std::min (m_tilexend + m_blockmask + 1,
+                                               m_img_xend);
+                        return;
+                    }
                     // Ran off the end of the row
                     m_exists = false;
                     if (m_wrap == WrapBlack) {
@@ -1030,8 +1198,11 @@ public:
 
         // Make sure it's writeable. Use with caution!
         void make_writeable () {
-            if (! m_localpixels) {
-                const_cast<ImageBuf*>(m_ib)->make_writeable (true);
+            // N.B. ImageBuf::make_writeable also un-shares local pixels
+            // that are shared copy-on-write with another ImageBuf.
+            const_cast<ImageBuf*>(m_ib)->make_writeable (true);
+            // (Un-sharing a view also changes its pixel layout.)
+            if (! m_localpixels || m_pixel_bytes != m_ib->pixel_stride()) {
                 DASSERT (m_ib->storage() != IMAGECACHE);
                 m_tile = NULL;
                 m_proxydata = NULL;
@@ -1275,6 +1446,10 @@ protected:
                          int &tilexend, bool exists,
                          WrapMode wrap=WrapDefault) const;
 
+    // Release a tile reference obtained from retile (which does nothing
+    // for a tile held by pin_tiles).
+    void release_tile (ImageCache::Tile *tile) const;
+
     const void *blackpixel () const;
 
     // Given x,y,z known to be outside the pixel data range, and a wrap
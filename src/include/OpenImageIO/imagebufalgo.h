@@ -42,6 +42,7 @@
 #include "imagebuf.h"
 #include "fmath.h"
 #include "color.h"
+#include "refcnt.h"
 
 #include <OpenEXR/ImathMatrix.h>       /* because we need M33f */
 
@@ -50,6 +51,7 @@
 #ifndef __OPENCV_CORE_TYPES_H__
 struct IplImage;  // Forward declaration; used by Intel Image lib & OpenCV
 #endif
+namespace cv { class Mat; }  // Forward declaration; OpenCV's image class
 
 
 
@@ -185,7 +187,9 @@ bool OIIO_API checker (ImageBuf &dst, int width, int height, int depth,
 /// of dst or the ROI. Choosing different seed values will result in a
 /// different pattern, but for the same seed value, the noise at a  given
 /// pixel coordinate (x,y,z) channel c will is completely deterministic and
-/// repeatable.
+/// repeatable. There is no sequential generator state, so the result is
+/// also bit-for-bit identical regardless of nthreads or how the ROI is
+/// split among threads.
 ///
 /// If dst is uninitialized, it will be resized to be a float ImageBuf
 /// large enough to hold the region specified by roi.  It is an error
@@ -1117,6 +1121,84 @@ bool OIIO_API premult (ImageBuf &dst, const ImageBuf &src,
 
 
 
+/// Expr is a deferred chain (or more generally, a DAG) of per-pixel
+/// operations on images and constants, which is evaluated with all of its
+/// operations fused into a single parallel pass over the pixels, without
+/// the full-image intermediate ImageBufs (and the memory traffic) that
+/// the equivalent sequence of ImageBufAlgo calls would need.  For example,
+///
+///     using namespace ImageBufAlgo;
+///     Expr graded = clamp (Expr(A) * 1.2f + Expr(B) * 0.3f - 0.05f, 0.0f, 1.0f);
+///     graded.eval (R);
+///
+/// computes R = clamp(A*1.2 + B*0.3 - 0.05, 0, 1) by evaluating the whole
+/// expression on one small block of pixels at a time (in float), so that
+/// the intermediate values stay in cache.  Subexpressions that are used
+/// more than once are computed only once per block.
+///
+/// An Expr only refers to its images, which must remain valid (and
+/// unchanged, except that the destination of eval() may be one of them)
+/// until evaluation.  Each operation behaves like its ImageBufAlgo
+/// counterpart: channel c of a constant applies to channel c of the
+/// image, and channels that an image lacks read as 0.
+class OIIO_API Expr {
+public:
+    /// The pixels of an image.
+    explicit Expr (const ImageBuf &img);
+    /// A constant value for all channels.
+    Expr (float value);
+    /// A constant with per-channel values[0..nvalues-1].
+    Expr (const float *values, int nvalues);
+    ~Expr ();
+
+    /// Evaluate the expression for the pixels and channels of roi, in
+    /// parallel, storing the results in dst.  If dst is uninitialized,
+    /// it is allocated (as float) much as an ImageBufAlgo function with
+    /// the Expr's images as inputs would.  If roi is not defined, it is
+    /// all of dst if dst is initialized, or otherwise the union of the
+    /// data windows of the images.  Return true on success, false on
+    /// error (with an appropriate error message set in dst).
+    bool eval (ImageBuf &dst, ROI roi = ROI::All(), int nthreads = 0) const;
+
+    /// The number of operations (including images and constants) in the
+    /// expression.
+    int nodes () const;
+
+    struct Node;
+    explicit Expr (const shared_ptr<Node> &node) : m_node(node) { }
+    const shared_ptr<Node> &node () const { return m_node; }
+private:
+    shared_ptr<Node> m_node;
+};
+
+Expr OIIO_API operator+ (const Expr &a, const Expr &b);
+Expr OIIO_API operator- (const Expr &a, const Expr &b);
+Expr OIIO_API operator* (const Expr &a, const Expr &b);
+/// Division by zero gives zero, as ImageBufAlgo::div does.
+Expr OIIO_API operator/ (const Expr &a, const Expr &b);
+/// a*b + c.
+Expr OIIO_API mad (const Expr &a, const Expr &b, const Expr &c);
+Expr OIIO_API abs (const Expr &a);
+/// 1 - a, as ImageBufAlgo::invert does.
+Expr OIIO_API invert (const Expr &a);
+/// Raise channel c to the power b[c].
+Expr OIIO_API pow (const Expr &a, const float *b, int nvalues);
+Expr OIIO_API pow (const Expr &a, float b);
+/// Clamp channel c to [min[c], max[c]].
+Expr OIIO_API clamp (const Expr &a, const float *min, const float *max,
+                     int nvalues);
+Expr OIIO_API clamp (const Expr &a, float min, float max);
+/// Premultiply/unpremultiply the color channels by the alpha channel of
+/// the (first) image in a.
+Expr OIIO_API premult (const Expr &a);
+Expr OIIO_API unpremult (const Expr &a);
+/// Apply a color transform to the first 4 channels, as ImageBufAlgo::
+/// colorconvert does.  The processor must remain valid until evaluation.
+Expr OIIO_API colorconvert (const Expr &a, const ColorProcessor *processor,
+                            bool unpremult=false);
+
+
+
 struct OIIO_API PixelStats {
     std::vector<float> min;
     std::vector<float> max;
@@ -1143,6 +1225,39 @@ bool OIIO_API computePixelStats (PixelStats &stats, const ImageBuf &src,
                                  ROI roi=ROI::All(), int nthreads=0);
 
 
+/// Struct holding all the results computed by ImageBufAlgo::analyze().
+/// stats are the same as computePixelStats would give.  monochrome is
+/// true if every pixel has equal values in all channels of the ROI.
+/// nonfinite_pixels is the number of pixels having a NaN or Inf in any
+/// channel, and nonfinite_x/y/value record the first few of them (in
+/// scanline order) and the offending value.
+struct OIIO_API ImageAnalysis {
+    PixelStats stats;
+    bool monochrome;
+    imagesize_t nonfinite_pixels;
+    std::vector<int> nonfinite_x, nonfinite_y;
+    std::vector<float> nonfinite_value;
+};
+
+/// Compute, in a single pass over the ROI of src, everything that
+/// computePixelStats, isMonochrome and a search for nonfinite values
+/// would find separately.  From the results, the image is a constant
+/// color if stats.min == stats.max, and a channel is constant if its
+/// min and max are equal.  At most max_locations nonfinite pixels will
+/// have their locations recorded.  Deep images are not supported.
+///
+/// The nthreads parameter specifies how many threads (potentially) may
+/// be used, but it's not a guarantee.  If nthreads == 0, it will use
+/// the global OIIO attribute "nthreads".  If nthreads == 1, it
+/// guarantees that it will not launch any new threads.
+///
+/// Return true on success, false on error (with an appropriate error
+/// message set in src).
+bool OIIO_API analyze (ImageAnalysis &result, const ImageBuf &src,
+                       ROI roi=ROI::All(), int nthreads=0,
+                       int max_locations=3);
+
+
 /// Struct holding all the results computed by ImageBufAlgo::compare().
 /// (maxx,maxy,maxz,maxc) gives the pixel coordintes (x,y,z) and color
 /// channel of the pixel that differed maximally between the two images.
@@ -1322,6 +1437,20 @@ std::string OIIO_API computePixelHashSHA1 (const ImageBuf &src,
                                            ROI roi = ROI::All(),
                                            int blocksize = 0, int nthreads=0);
 
+/// Compute a hash of all the pixels in the specified region of the image,
+/// using the named algorithm, and return it as a hex string (or an empty
+/// string if the algorithm is unknown).  The algorithms are "sha1" (the
+/// same as computePixelHashSHA1) and "xxhash64", a non-cryptographic
+/// 64 bit hash that is many times faster to compute.  The blocksize,
+/// extrainfo, and nthreads parameters are as for computePixelHashSHA1;
+/// the result depends on the blocksize but never on the number of
+/// threads.
+std::string OIIO_API computePixelHash (const ImageBuf &src,
+                                       string_view algorithm,
+                                       string_view extrainfo = "",
+                                       ROI roi = ROI::All(),
+                                       int blocksize = 0, int nthreads=0);
+
 
 /// Warp the src image using the supplied 3x3 transformation matrix.
 ///
@@ -1339,6 +1468,8 @@ std::string OIIO_API computePixelHashSHA1 (const ImageBuf &src,
 /// the empty string is passed, and a reasonable filter width if filterwidth
 /// is 0. (Note that some filter choices only make sense with particular
 /// width, in which case this filterwidth parameter may be ignored.)
+/// For an affine M that doesn't shrink the image, the "triangle" filter
+/// of width 2 is plain bilinear interpolation, which is much the fastest.
 ///
 /// The nthreads parameter specifies how many threads (potentially) may
 /// be used, but it's not a guarantee.  If nthreads == 0, it will use
@@ -1486,6 +1617,10 @@ bool OIIO_API resample (ImageBuf &dst, const ImageBuf &src,
 /// normalized is true, the kernel will be normalized for the 
 /// convolution, otherwise the original values will be used.
 ///
+/// Separable kernels (such as most of those from make_kernel) are
+/// applied as two 1D passes, and big non-separable 2D kernels by way of
+/// the FFT when that's estimated to be faster.
+///
 /// The nthreads parameter specifies how many threads (potentially) may
 /// be used, but it's not a guarantee.  If nthreads == 0, it will use
 /// the global OIIO attribute "nthreads".  If nthreads == 1, it
@@ -1642,6 +1777,82 @@ bool OIIO_API erode (ImageBuf &dst, const ImageBuf &src,
                      ROI roi = ROI::All(), int nthreads = 0);
 
 
+/// Replace the given ROI of dst with a blurred version of the
+/// corresponding region of src, each pixel being the average of the
+/// width x height box of src pixels around it (if height is <= 0, it
+/// will be set to width).  This gives the same result as convolve()
+/// with a normalized box of ones, but uses running sums so that its
+/// cost doesn't depend on the size of the box.
+///
+/// If roi is not defined, it defaults to the full size of dst (or src,
+/// if dst was undefined).  If dst is uninitialized, it will be
+/// allocated to be the size specified by roi.
+///
+/// The nthreads parameter specifies how many threads (potentially) may
+/// be used, but it's not a guarantee.  If nthreads == 0, it will use
+/// the global OIIO attribute "nthreads".  If nthreads == 1, it
+/// guarantees that it will not launch any new threads.
+///
+/// Return true on success, false on error (with an appropriate error
+/// message set in dst).
+bool OIIO_API box_blur (ImageBuf &dst, const ImageBuf &src,
+                        int width = 3, int height = -1,
+                        ROI roi = ROI::All(), int nthreads = 0);
+
+
+/// Replace the given ROI of dst with a Gaussian-blurred version of the
+/// corresponding region of src, with standard deviation sigmax pixels
+/// horizontally and sigmay vertically (if sigmay < 0, it will be the
+/// same as sigmax; a sigma of 0 doesn't blur in that direction).  This
+/// uses a recursive filter that closely approximates the Gaussian in
+/// time that doesn't depend on sigma, which is much faster than
+/// convolve() for large blurs.
+///
+/// If roi is not defined, it defaults to the full size of dst (or src,
+/// if dst was undefined).  If dst is uninitialized, it will be
+/// allocated to be the size specified by roi.
+///
+/// The nthreads parameter specifies how many threads (potentially) may
+/// be used, but it's not a guarantee.  If nthreads == 0, it will use
+/// the global OIIO attribute "nthreads".  If nthreads == 1, it
+/// guarantees that it will not launch any new threads.
+///
+/// Return true on success, false on error (with an appropriate error
+/// message set in dst).
+bool OIIO_API gaussian_blur (ImageBuf &dst, const ImageBuf &src,
+                             float sigmax, float sigmay = -1.0f,
+                             ROI roi = ROI::All(), int nthreads = 0);
+
+
+/// Set the given ROI of dst to the summed-area table (integral image) of
+/// the corresponding region of src: each pixel (x,y) of dst is the sum of
+/// all the src pixels in [roi.xbegin..x] x [roi.ybegin..y].  If dst is
+/// uninitialized, it will be allocated to be the size of roi with DOUBLE
+/// pixels, so that large sums of float data don't lose precision.  Once
+/// made, area_sum() can find the sum over any rectangle in O(1) time.
+///
+/// If roi is not defined, it defaults to the full size of dst (or src,
+/// if dst was undefined).
+///
+/// The nthreads parameter specifies how many threads (potentially) may
+/// be used, but it's not a guarantee.  If nthreads == 0, it will use
+/// the global OIIO attribute "nthreads".  If nthreads == 1, it
+/// guarantees that it will not launch any new threads.
+///
+/// Return true on success, false on error (with an appropriate error
+/// message set in dst).
+bool OIIO_API integral_image (ImageBuf &dst, const ImageBuf &src,
+                              ROI roi = ROI::All(), int nthreads = 0);
+
+/// Given a summed-area table sat made by integral_image() (over its
+/// whole data window), store into sum[chbegin..chend-1] the sum of the
+/// original image's pixel values over the region roi (clipped to sat's
+/// data window), by looking up just its four corners.  If roi is not
+/// defined, it's the whole image.  Return true on success, false on
+/// error (with an appropriate error message set in sat).
+bool OIIO_API area_sum (const ImageBuf &sat, ROI roi, float *sum);
+
+
 /// Take the discrete Fourier transform (DFT) of the section of src
 /// denoted by roi, store it in dst.  If roi is not defined, it will be
 /// all of src's pixels.  Only one channel of src may be FFT'd at a
@@ -1796,6 +2007,38 @@ bool OIIO_API from_IplImage (ImageBuf &dst, const IplImage *ipl,
 /// calling application.
 OIIO_API IplImage* to_IplImage (const ImageBuf &src);
 
+/// Set dst to a copy of the OpenCV cv::Mat, converting to data type
+/// convert (if not UNKNOWN) and from OpenCV's BGR(A) channel order to
+/// RGB(A), all in one parallel pass.  Return true if ok, false (with an
+/// error set in dst) for a Mat type that can't be handled or if
+/// OpenImageIO was compiled without OpenCV support.
+bool OIIO_API from_OpenCV (ImageBuf &dst, const cv::Mat &mat,
+                           TypeDesc convert=TypeDesc::UNKNOWN,
+                           int nthreads = 0);
+
+/// Set dst to a new cv::Mat holding a copy of src, converted to BGR(A)
+/// channel order (and to float for half images, which OpenCV can't
+/// represent).  Return true if ok, false if there's no matching OpenCV
+/// type or no OpenCV support.
+bool OIIO_API to_OpenCV (cv::Mat &dst, const ImageBuf &src,
+                         int nthreads = 0);
+
+/// Make dst an ImageBuf that wraps the pixel memory of mat, with its
+/// row stride, without copying anything: the channels are left in
+/// mat's order, and so are named "B", "G", "R" (and "A") for 3 or 4
+/// channels.  mat must stay alive, and keep its buffer, while dst
+/// uses it.  Return true if ok, false if mat's type or shape can't be
+/// expressed as an ImageBuf or there's no OpenCV support.
+bool OIIO_API wrap_OpenCV (ImageBuf &dst, cv::Mat &mat);
+
+/// Make dst a cv::Mat header that shares the local pixel memory of src
+/// without copying, in src's channel order.  This is only possible for
+/// an ImageBuf whose pixels are in local memory in the usual scanline
+/// layout, with a single data type that OpenCV has (so not half), and
+/// it returns false otherwise (or with no OpenCV support).  src must
+/// stay alive, and not be reallocated, while dst uses its memory.
+bool OIIO_API wrap_OpenCV (cv::Mat &dst, ImageBuf &src);
+
 /// Capture a still image from a designated camera.  If able to do so,
 /// store the image in dst and return true.  If there is no such device,
 /// or support for camera capture is not available (such as if OpenCV
@@ -1804,6 +2047,45 @@ OIIO_API IplImage* to_IplImage (const ImageBuf &src);
 bool OIIO_API capture_image (ImageBuf &dst, int cameranum = 0,
                               TypeDesc convert=TypeDesc::UNKNOWN);
 
+/// Continuous capture from a camera.  A thread of its own grabs frames
+/// as fast as the camera delivers them, converting each (with a single
+/// copy) into the next ImageBuf of a ring of frames; next_frame() hands
+/// the oldest waiting frame to the caller by swapping buffers, so that
+/// frames are never copied again and the ring's buffers are reused.
+/// If the caller falls behind, the oldest waiting frame is dropped.
+class OIIO_API CaptureStream {
+public:
+    /// Open the camera and start capturing into a ring of nframes
+    /// frames, converted to data type convert (if not UNKNOWN).
+    CaptureStream (int cameranum = 0, int nframes = 4,
+                   TypeDesc convert = TypeDesc::UNKNOWN);
+    /// Stop capturing and close the camera.
+    ~CaptureStream ();
+
+    /// Is the stream still capturing?
+    bool running () const;
+
+    /// Stop capturing (frames already in the ring can still be had).
+    void stop ();
+
+    /// Swap the oldest frame not yet returned into dst, waiting for one
+    /// if need be, and return true; return false if no more frames will
+    /// come because the stream stopped or failed.
+    bool next_frame (ImageBuf &dst);
+
+    /// How many frames have been dropped because the ring was full.
+    int frames_dropped () const;
+
+    /// The error that stopped the stream, if any.
+    std::string geterror () const;
+
+private:
+    class Impl;
+    Impl *m_impl;
+    CaptureStream (const CaptureStream &);  // Do not implement
+    const CaptureStream& operator= (const CaptureStream &); // Do not implement
+};
+
 
 
 /// Set dst to the composite of A over B using the Porter/Duff definition
@@ -1842,6 +2124,18 @@ bool OIIO_API capture_image (ImageBuf &dst, int cameranum = 0,
 bool OIIO_API over (ImageBuf &dst, const ImageBuf &A, const ImageBuf &B,
                     ROI roi = ROI::All(), int nthreads = 0);
 
+/// Composite a whole stack of images in one pass: layers[0] over
+/// layers[1] over ... over layers[n-1] (that is, ordered front to back).
+/// The result is the same as that of a chain of two-image over()
+/// operations (up to floating point rounding), but each pixel of each
+/// layer is read at most once, layers are not visited at all in regions
+/// outside their pixel data windows, and layers behind pixels that have
+/// already become opaque are not visited, so it is much faster for deep
+/// stacks.  The requirements on channels match over(); if dst is not
+/// already initialized, it is sized to the union of all the layers.
+bool OIIO_API over (ImageBuf &dst, array_view<const ImageBuf *> layers,
+                    ROI roi = ROI::All(), int nthreads = 0);
+
 
 /// Just like ImageBufAlgo::over(), but inputs A and B must have
 /// designated 'z' channels, and on a pixel-by-pixel basis, the z values
@@ -1915,11 +2209,14 @@ bool OIIO_API render_text (ImageBuf &dst, int x, int y,
 /// roi         - Only pixels in this region of the image are histogramed. If
 ///               roi is not defined then the full size image will be
 ///               histogramed.
+/// nthreads    - Number of threads to use (0 means use the global
+///               OIIO "threads" attribute).
 /// --------------------------------------------------------------------------
 bool OIIO_API histogram (const ImageBuf &src, int channel,
                          std::vector<imagesize_t> &histogram, int bins=256,
                          float min=0, float max=1, imagesize_t *submin=NULL,
-                         imagesize_t *supermax=NULL, ROI roi=ROI::All());
+                         imagesize_t *supermax=NULL, ROI roi=ROI::All(),
+                         int nthreads=0);
 
 
 
@@ -1938,6 +2235,7 @@ bool OIIO_API histogram_draw (ImageBuf &dst,
 enum OIIO_API MakeTextureMode {
     MakeTxTexture, MakeTxShadow, MakeTxEnvLatl,
     MakeTxEnvLatlFromLightProbe,
+    MakeTxEnvCube,
     _MakeTxLast
 };
 
@@ -1948,6 +2246,9 @@ enum OIIO_API MakeTextureMode {
 ///    MakeTxEnvLatl    Latitude-longitude environment map
 ///    MakeTxEnvLatlFromLightProbe   Latitude-longitude environment map
 ///                     constructed from a "light probe" image.
+///    MakeTxEnvCube    Cube-face environment map, stored as a 1x6 stack
+///                     of the faces (px, nx, py, ny, pz, nz), made from
+///                     either such a stack or a 2x1 lat-long image.
 ///
 /// If the outstream pointer is not NULL, it should point to a stream
 /// (for example, &std::out, or a pointer to a local std::stringstream
@@ -1982,11 +2283,23 @@ enum OIIO_API MakeTextureMode {
 ///    maketx:updatemode (int) If nonzero, write new output only if the
 ///                              output file doesn't already exist, or is
 ///                              older than the input file, or was created
-///                              with different command-line arguments. (0)
+///                              with different command-line arguments.
+///                              Textures whose "oiio:SourceHash" shows
+///                              they were made from identical pixels with
+///                              identical settings are also kept. (0)
 ///    maketx:constant_color_detect (int)
 ///                           If nonzero, detect images that are entirely
 ///                             one color, and change them to be low
 ///                             resolution (default: 0).
+///    maketx:constant_tiles (int)
+///                           If nonzero, record the tiles of each MIP
+///                             level that are a single color, so the
+///                             ImageCache can share their pixels (0).
+///    maketx:tile_hashes (int)
+///                           If nonzero, record content hashes of the
+///                             tiles of each MIP level that are identical
+///                             to others, so the ImageCache can share
+///                             their pixels (0).
 ///    maketx:monochrome_detect (int)
 ///                           If nonzero, change RGB images which have 
 ///                              R==G==B everywhere to single-channel 
@@ -2066,6 +2379,11 @@ enum OIIO_API MakeTextureMode {
 ///                               if it is smaller than this threshold. Zero
 ///                               causes the system to make a good guess at
 ///                               a reasonable threshold (e.g. 1 GB). (0)
+///    maketx:stream (int)
+///                           If nonzero, never read the input locally, and
+///                               if it needs no resize, write the top level
+///                               straight from the ImageCache rather than
+///                               from an in-memory copy. (0)
 ///    maketx:forcefloat (int)
 ///                           Forces a conversion through float data for
 ///                               the sake of ImageBuf math. (1)
@@ -2076,6 +2394,25 @@ enum OIIO_API MakeTextureMode {
 ///                               The fastest path may result in a slight shift
 ///                               in the image, accumulated for each mip level
 ///                               with an odd resolution. (0)
+///    maketx:envlatl_importance (int)
+///                           If nonzero, for lat-long environment maps,
+///                               bake importance sampling tables of this
+///                               width (and half this height) into the
+///                               "oiio:EnvImportance" metadata, for use by
+///                               TextureSystem::environment_sample(). (0)
+///    maketx:minmax (string)
+///                           If set to "min", "max", or "minmax", append
+///                               channels holding conservative per-MIP-level
+///                               minimum and/or maximum values of the
+///                               texture, for use by
+///                               TextureSystem::texture_bounds(). ("")
+///    maketx:lean (string)
+///                           If set to "bump" (a height map), "normal"
+///                               (a tangent-space normal map in [-1,1]), or
+///                               "normal01" (one stored as 0.5*n+0.5),
+///                               append five channels of LEAN slope
+///                               moments, for use by
+///                               TextureSystem::texture_slopes(). ("")
 ///
 bool OIIO_API make_texture (MakeTextureMode mode,
                             const ImageBuf &input,
@@ -62,7 +62,45 @@ using boost::this_thread::get_id;
 
 namespace ImageBufAlgo {
 
-enum SplitDir { Split_X, Split_Y, Split_Z, Split_Biggest };
+enum SplitDir { Split_X, Split_Y, Split_Z, Split_Biggest, Split_Tile };
+
+
+
+/// Shared state for parallel_image's Split_Tile mode: the ROI is carved
+/// into ntiles tiles, and next is the index of the next unclaimed tile.
+struct ParallelTileSchedule {
+    ROI roi;
+    int tilew, tileh, ntx, nty, ntiles;
+    atomic_int next;
+};
+
+/// Helper functor for parallel_image's Split_Tile mode.  Each worker
+/// keeps claiming the next unclaimed tile until there are none left, so
+/// threads that finish cheap tiles early simply take more of them.
+template <class Func>
+struct ParallelTileTask {
+    ParallelTileTask (const Func &f, ParallelTileSchedule *sched)
+        : f(f), sched(sched) { }
+    void operator() () {
+        const ROI &roi (sched->roi);
+        int tiles_per_slice = sched->ntx * sched->nty;
+        for (int t = sched->next++;  t < sched->ntiles;  t = sched->next++) {
+            ROI r = roi;
+            int slice = t / tiles_per_slice, tt = t % tiles_per_slice;
+            r.xbegin = roi.xbegin + (tt % sched->ntx) * sched->tilew;
+            r.xend = std::min (r.xbegin + sched->tilew, roi.xend);
+            r.ybegin = roi.ybegin + (tt / sched->ntx) * sched->tileh;
+            r.yend = std::min (r.ybegin + sched->tileh, roi.yend);
+            if (roi.depth() > 1) {
+                r.zbegin = roi.zbegin + slice;
+                r.zend = r.zbegin + 1;
+            }
+            f (r);
+        }
+    }
+    Func f;
+    ParallelTileSchedule *sched;
+};
 
 /// Helper template for generalized multithreading for image processing
 /// functions.  Some function/functor f is applied to every pixel the
@@ -76,6 +114,16 @@ enum SplitDir { Split_X, Split_Y, Split_Z, Split_Biggest };
 /// algorithms where it's better to split in X, Z, or along the longest
 /// axis.
 ///
+/// Split_Tile is different: rather than one band per thread, the region
+/// is carved into many small tiles that are handed out on demand, so
+/// threads that finish early keep taking more work.  This is the better
+/// choice when the per-pixel cost varies a lot across the image (for
+/// example, warps, or compositing over a mostly-empty foreground).  The
+/// optional pixelcost is a rough relative cost of computing one pixel
+/// (1 = trivial, such as a simple arithmetic op); more expensive
+/// operations are allowed more threads for small regions and get smaller
+/// tiles.
+///
 /// Most image operations will require additional arguments, including
 /// additional input and output images or other parameters.  The
 /// parallel_image template can still be used by employing the
@@ -90,22 +138,57 @@ enum SplitDir { Split_X, Split_Y, Split_Z, Split_Biggest };
 ///
 template <class Func>
 void
-parallel_image (Func f, ROI roi, int nthreads=0, SplitDir splitdir=Split_Y)
+parallel_image (Func f, ROI roi, int nthreads=0, SplitDir splitdir=Split_Y,
+                int pixelcost=1)
 {
     // Special case: threads <= 0 means to use the "threads" attribute
     if (nthreads <= 0)
         OIIO::getattribute ("threads", nthreads);
-    // Try not to assign a thread less than 16k pixels, or it's not worth
-    // the thread startup/teardown cost.
-    nthreads = std::min (nthreads, 1 + int(roi.npixels() / size_t(16384)));
+    // Try not to assign a thread less than 16k pixels (of unit cost), or
+    // it's not worth the cost of handing off the work.
+    pixelcost = std::max (pixelcost, 1);
+    imagesize_t work = roi.npixels() * imagesize_t(pixelcost);
+    nthreads = int (std::min (imagesize_t(nthreads), 1 + work/16384));
     if (nthreads <= 1) {
         // Just one thread, or a small image region: use this thread only
         f (roi);
         return;
     }
 
+    if (splitdir == Split_Tile) {
+        // Aim for several tiles per thread so the load balances, but
+        // don't let tiles get so small that handing them out dominates.
+        ParallelTileSchedule sched;
+        sched.roi = roi;
+        imagesize_t minpixels = std::max (256, 16384 / pixelcost);
+        int tilepixels = int (std::min (imagesize_t(1<<20),
+                std::max (minpixels, roi.npixels() / roi.depth() /
+                                     imagesize_t(8*nthreads))));
+        // Prefer full-width strips, which are kindest to the cache, unless
+        // that would make them too short to be worth it.
+        sched.tilew = roi.width();
+        sched.tileh = std::max (1, tilepixels / sched.tilew);
+        if (sched.tileh < 4) {
+            sched.tilew = std::min (roi.width(),
+                          std::max (16, int(sqrtf(float(tilepixels)))));
+            sched.tileh = std::max (1, tilepixels / sched.tilew);
+        }
+        sched.ntx = (roi.width() + sched.tilew - 1) / sched.tilew;
+        sched.nty = (roi.height() + sched.tileh - 1) / sched.tileh;
+        sched.ntiles = sched.ntx * sched.nty * roi.depth();
+        sched.next = 0;
+        nthreads = std::min (nthreads, sched.ntiles);
+        task_set tasks;
+        for (int i = 0;  i < nthreads-1;  ++i)
+            tasks.push (ParallelTileTask<Func> (f, &sched));
+        ParallelTileTask<Func> mytask (f, &sched);
+        mytask ();   // the calling thread takes tiles, too
+        tasks.wait ();
+        return;
+    }
+
     // If splitdir was not explicit, find the longest edge.
-    if (splitdir >= Split_Biggest)
+    if (splitdir == Split_Biggest)
         splitdir = roi.width() > roi.height() ? Split_X : Split_Y;
     int minmax[6] = { roi.xbegin, roi.xend, roi.ybegin, roi.yend,
                       roi.zbegin, roi.zend };
@@ -114,8 +197,9 @@ parallel_image (Func f, ROI roi, int nthreads=0, SplitDir splitdir=Split_Y)
     int splitlen = roi_end - roi_begin;
     nthreads = std::min (nthreads, splitlen);
 
-    // Spawn threads by dividing the region into bands.
-    OIIO::thread_group threads;
+    // Divide the region into bands and hand them to the shared thread
+    // pool, rather than paying to launch and join fresh threads.
+    task_set tasks;
     int blocksize = std::max (1, (splitlen + nthreads - 1) / nthreads);
     for (int i = 0;  i < nthreads;  i++) {
         if (splitdir == Split_Y) {
@@ -135,11 +219,84 @@ parallel_image (Func f, ROI roi, int nthreads=0, SplitDir splitdir=Split_Y)
                 break;   // no more work to dole out
         }
         if (i < nthreads-1)
-            threads.add_thread (new OIIO::thread (f, roi));
+            tasks.push (bind (f, roi));
         else
             f (roi);   // Run the last one in the calling thread
     }
-    threads.join_all ();
+    tasks.wait ();
+}
+
+
+
+
+/// Helper template for parallel reductions over an image region, such as
+/// statistics or comparisons.  The region is split into bands as for
+/// parallel_image, and each band is passed, along with its own copy of
+/// init, to f(roi, partial), which accumulates into that partial result
+/// with no need for locks or atomics.  When all are done, the partial
+/// results are combined into result with merge(result, partial), always
+/// in band order, so the answer doesn't depend on thread timing.  For
+/// example:
+///     void sum_op (const ImageBuf &A, ROI roi, double &sum);
+///     void add (double &total, const double &partial) { total += partial; }
+///     double total = 0.0;
+///     parallel_reduce (bind(sum_op, cref(A), _1, _2), add, 0.0, total, roi);
+///
+/// Split_Tile is treated as Split_Y (and Split_Biggest picks the longer
+/// of X and Y), since each band needs an accumulator of its own.
+template <class Result, class Func, class Merge>
+void
+parallel_reduce (Func f, Merge merge, const Result &init, Result &result,
+                 ROI roi, int nthreads=0, SplitDir splitdir=Split_Y,
+                 int pixelcost=1)
+{
+    // Special case: threads <= 0 means to use the "threads" attribute
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    pixelcost = std::max (pixelcost, 1);
+    imagesize_t work = roi.npixels() * imagesize_t(pixelcost);
+    nthreads = int (std::min (imagesize_t(nthreads), 1 + work/16384));
+    if (nthreads <= 1) {
+        Result partial (init);
+        f (roi, partial);
+        merge (result, partial);
+        return;
+    }
+
+    if (splitdir == Split_Tile)
+        splitdir = Split_Y;
+    else if (splitdir == Split_Biggest)
+        splitdir = roi.width() > roi.height() ? Split_X : Split_Y;
+    int minmax[6] = { roi.xbegin, roi.xend, roi.ybegin, roi.yend,
+                      roi.zbegin, roi.zend };
+    int roi_begin = minmax[2*int(splitdir)];
+    int roi_end = minmax[2*int(splitdir)+1];
+    int splitlen = roi_end - roi_begin;
+    nthreads = std::min (nthreads, splitlen);
+
+    std::vector<Result> partials (nthreads, init);
+    task_set tasks;
+    int blocksize = std::max (1, (splitlen + nthreads - 1) / nthreads);
+    int nbands = 0;
+    for (int i = 0;  i < nthreads;  i++) {
+        ROI r = roi;
+        int *range = (splitdir == Split_X) ? &r.xbegin
+                   : (splitdir == Split_Y) ? &r.ybegin : &r.zbegin;
+        int *rangeend = (splitdir == Split_X) ? &r.xend
+                      : (splitdir == Split_Y) ? &r.yend : &r.zend;
+        *range = roi_begin + i * blocksize;
+        *rangeend = std::min (*range + blocksize, roi_end);
+        if (*range >= *rangeend)
+            break;   // no more work to dole out
+        ++nbands;
+        if (i < nthreads-1)
+            tasks.push (bind (f, r, ref(partials[i])));
+        else
+            f (r, partials[i]);   // Run the last one in the calling thread
+    }
+    tasks.wait ();
+    for (int i = 0;  i < nbands;  ++i)
+        merge (result, partials[i]);
 }
 
 
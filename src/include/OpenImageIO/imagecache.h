@@ -85,6 +85,9 @@ public:
     /// if the name and type were recognized and the attrib was set.
     /// Documented attributes:
     ///     int max_open_files : maximum number of file handles held open
+    ///     int max_open_files_expensive : max handles of the files that
+    ///                  were slowest to open, closed before others only
+    ///                  when there are more than this (default=25)
     ///     float max_memory_MB : maximum tile cache size, in MB
     ///     string searchpath : colon-separated search path for images
     ///     string plugin_searchpath : colon-separated search path for plugins
@@ -98,8 +101,19 @@ public:
     ///     int forcefloat : if nonzero, convert all to float.
     ///     int failure_retries : number of times to retry a read before fail.
     ///     int deduplicate : if nonzero, detect duplicate textures (default=1)
+    ///     int deduplicate_tiles : if nonzero, share the pixels of tiles
+    ///                  that maketx hashed as identical (default=1)
+    ///     int mmap_tiles : if nonzero, use uncompressed tiles straight
+    ///                  from a memory mapping of the file (default=0)
+    ///     int compress_tiles : if nonzero, keep 8- and 16-bit tiles
+    ///                  compressed in memory (default=0)
+    ///     int cache_channel_subsets : if nonzero, get_pixels of a subset
+    ///                  of channels reads and caches only those channels
+    ///                  (default=0)
     ///     string substitute_image : uses the named image in place of all
     ///                               texture and image references.
+    ///     string metadata_index : file that keeps the specs of files
+    ///                  opened, to skip opening them in later runs
     ///     int unassociatedalpha : if nonzero, keep unassociated alpha images
     ///     int max_errors_per_file : Limits how many errors to issue for
     ///                               issue for each (default: 100)
@@ -175,6 +189,19 @@ public:
     /// get_image_handle()) is a valid image that can be subsequently read.
     virtual bool good (ImageHandle *file) = 0;
 
+    /// Retrieve handles for many images at once, resolving their names
+    /// with the search path and reading their headers in parallel, using
+    /// up to nthreads threads (including the calling one), or the shared
+    /// OIIO thread pool if nthreads is 0.  Returns when all of them are
+    /// done, with one handle for each filename, in the same order, just
+    /// as get_image_handle() would have returned it (use good() to find
+    /// out if each could be opened).  This is meant for applications
+    /// that know up front all the images they will use, so the header
+    /// I/O can overlap instead of being paid serially on first touch.
+    virtual std::vector<ImageHandle *>
+        preload_files (array_view<const ustring> filenames,
+                       int nthreads = 0) = 0;
+
     /// Given possibly-relative 'filename', resolve it using the search
     /// path rules and return the full resolved filename.
     virtual std::string resolve_filename (const std::string &filename) const=0;
@@ -299,6 +326,24 @@ public:
                              int x, int y, int z,
                              int chbegin = 0, int chend = -1) = 0;
 
+    /// Find all the tiles of the given subimage and MIP level that overlap
+    /// the region roi (pixel coordinates and channel range; an undefined
+    /// roi means the whole image and all its channels), reading any that
+    /// are not yet cached, and store pointers to them in tiles, ordered by
+    /// z, then y, then x.  This is the zero-copy counterpart of
+    /// get_pixels: the pixels may be used in place via tile_pixels() and
+    /// tile_roi(), and each tile must be handed back with release_tile().
+    /// Like get_pixels, a region spanning many tiles (see the
+    /// "get_pixels_parallel" attribute) is read using the thread pool.
+    ///
+    /// Return true if every tile was found.  Otherwise, release any that
+    /// were, leave tiles empty, and return false.
+    virtual bool get_tiles (ustring filename, int subimage, int miplevel,
+                            const ROI &roi, std::vector<Tile *> &tiles) = 0;
+    virtual bool get_tiles (ImageHandle *file, Perthread *thread_info,
+                            int subimage, int miplevel, const ROI &roi,
+                            std::vector<Tile *> &tiles) = 0;
+
     /// After finishing with a tile, release_tile will allow it to
     /// once again be purged from the tile cache if required.
     virtual void release_tile (Tile *tile) const = 0;
@@ -317,6 +362,42 @@ public:
     /// the data type of the pixels in the disk file).
     virtual const void * tile_pixels (Tile *tile, TypeDesc &format) const = 0;
 
+    /// Ask for all the tiles of the given subimage and MIP level that
+    /// overlap the region roi (pixel coordinates and channel range) to be
+    /// read into the cache asynchronously by the cache's I/O threads.
+    /// This only queues the reads and returns immediately, so that
+    /// callers who know their upcoming footprint can overlap the disk
+    /// I/O with other work.  Tiles already in the cache are skipped.  An
+    /// undefined roi (the default) means the whole image and all its
+    /// channels.  The channel range only matters when the
+    /// "cache_channel_subsets" attribute is nonzero; otherwise tiles
+    /// always hold all the channels.  If the "io_threads" attribute is
+    /// 0, this is a no-op.
+    ///
+    /// Return true if the file is found and could be opened, and the
+    /// subimage and miplevel exist, otherwise return false.
+    virtual bool prefetch_tiles (ustring filename, int subimage, int miplevel,
+                                 const ROI &roi) = 0;
+    virtual bool prefetch_tiles (ImageHandle *file, Perthread *thread_info,
+                                 int subimage, int miplevel,
+                                 const ROI &roi) = 0;
+
+    /// Set the cache priority class of the named image, and optionally a
+    /// quota on the bytes of tile memory it may hold.  When the cache is
+    /// over its "max_memory_MB", tiles of files over their quota are
+    /// evicted first, used or not, and higher priority classes survive
+    /// that many more sweeps of neglect than the default class 0 (lower
+    /// classes, as many fewer; a file whose class leaves its tiles no
+    /// credit at all has them evicted whenever the sweep reaches them).
+    /// The priority is clamped to [-2,2].  A quota of 0 means no quota.
+    ///
+    /// Return true if the file is found and could be opened, otherwise
+    /// return false.
+    virtual bool set_file_priority (ustring filename, int priority,
+                                    imagesize_t quota = 0) = 0;
+    virtual bool set_file_priority (ImageHandle *file, int priority,
+                                    imagesize_t quota = 0) = 0;
+
     /// The add_file() call causes a file to be opened or added to the
     /// cache. There is no reason to use this method unless you are
     /// supplying a custom creator, or configuration, or both.
@@ -346,6 +427,45 @@ public:
     virtual bool add_file (ustring filename, ImageInput::Creator creator=NULL,
                            const ImageSpec *config=NULL) = 0;
 
+    /// Application code that generates the tiles of a procedural image
+    /// (see add_procedural_file) on demand.
+    class TileProvider {
+    public:
+        virtual ~TileProvider () { }
+        /// Describe the given subimage and MIP level in spec, which must
+        /// be tiled, and return true; or return false if there is no such
+        /// subimage or level.  The levels of a subimage are asked for in
+        /// order until one is refused.
+        virtual bool get_spec (int subimage, int miplevel,
+                               ImageSpec &spec) = 0;
+        /// Generate channels [chbegin,chend) of the tile whose origin is
+        /// (x,y,z), contiguously into data, in the given format (the
+        /// spec's format, or FLOAT for types the cache doesn't store
+        /// natively).  data is the memory of the cached tile itself.
+        /// This may be called concurrently from many threads, including
+        /// the ImageCache's I/O threads, and again for a tile that was
+        /// evicted.  Return false if the tile could not be made.
+        virtual bool fill_tile (int subimage, int miplevel,
+                                int x, int y, int z, int chbegin, int chend,
+                                TypeDesc format, void *data) = 0;
+    };
+
+    /// Add a procedural image to the cache, whose tiles are not read
+    /// from a file but generated by provider->fill_tile() whenever a
+    /// tile that isn't in the cache is needed (on misses, prefetches, or
+    /// by the I/O threads), straight into the tile's memory.  They are
+    /// cached and evicted like the tiles of any other image.  Unlike a
+    /// custom ImageInput::Creator, tiles of one image may be generated by
+    /// many threads at once.  The ImageCache does not take ownership of
+    /// the provider, which must stay valid until the image is
+    /// invalidated or the cache is destroyed.  As with add_file, this has
+    /// no effect if there's already an image by the same name.
+    ///
+    /// Return true if the image could be set up (get_spec accepted
+    /// subimage 0, MIP level 0), otherwise return false.
+    virtual bool add_procedural_file (ustring filename,
+                                      TileProvider *provider) = 0;
+
     /// Preemptively add a tile corresponding to the named image, at the
     /// given subimage, MIP level, and channel range.  The tile added is the
     /// one whose corner is (x,y,z), and buffer points to the pixels (in the
@@ -378,6 +498,78 @@ public:
     ///
     virtual std::string getstats (int level=1) const = 0;
 
+    /// Durations sorted into buckets of geometrically increasing width,
+    /// four per doubling from one microsecond up (in the manner of an HDR
+    /// histogram), so that a value read from it is within 19% of the
+    /// true one however long or short it is.
+    struct LatencyHistogram {
+        /// upper[i] is the upper bound (in seconds) of bucket i, and
+        /// counts[i] is how many durations fell in it.  Bucket 0 also
+        /// takes everything shorter, the last one everything longer.
+        std::vector<double> upper;
+        std::vector<long long> counts;
+        long long count;      ///< Total number of durations
+        double sum;           ///< Their total (seconds)
+        double max;           ///< The longest of them (seconds)
+
+        LatencyHistogram () : count(0), sum(0.0), max(0.0) { }
+
+        /// Return the duration (seconds) that fraction p of the recorded
+        /// durations did not exceed, e.g. percentile(0.99).
+        double percentile (double p) const {
+            double target = p * count;
+            long long n = 0;
+            for (size_t i = 0;  i < counts.size();  ++i) {
+                n += counts[i];
+                if (n && n >= target)
+                    return upper[i] < max ? upper[i] : max;
+            }
+            return max;
+        }
+    };
+
+    /// A snapshot of the health of the cache, for services that keep a
+    /// cache for a long time and want to watch it.  Counts and times are
+    /// totals since the cache was created or reset_stats() was last
+    /// called (except for tiles_created, files_opened and files_closed,
+    /// which count from creation); comparing two snapshots gives rates
+    /// such as the hit rate or the I/O bandwidth between them.
+    struct Metrics {
+        double time;                  ///< Seconds since cache creation
+        long long tile_lookups;       ///< Tile lookups
+        long long tile_misses;        ///< ... that weren't in memory
+        LatencyHistogram miss_latency; ///< Time to bring in a missed tile
+        LatencyHistogram open_latency; ///< Time to open a file
+        long long bytes_read;         ///< Pixel data read from files
+        double fileio_time;           ///< Seconds spent on file I/O
+        long long memory_used;        ///< Tile memory in use
+        long long memory_limit;       ///< The "max_memory_MB" limit, in bytes
+        /// Tile memory of the files in each priority class (see
+        /// set_file_priority), lowest class first.
+        std::vector<long long> memory_by_priority;
+        int tiles;                    ///< Tiles in memory
+        long long tiles_created;      ///< Tiles ever created
+        int files;                    ///< Files the cache knows about
+        int open_files;               ///< Files currently open
+        long long files_opened;       ///< ImageInputs created
+        long long files_closed;       ///< ImageInputs closed again
+    };
+
+    /// Fill in metrics with the current state of the cache.  This takes
+    /// no locks that lookups need, so it is cheap enough to be called
+    /// every few seconds by a monitoring thread.
+    virtual void get_metrics (Metrics &metrics) const = 0;
+
+    /// Return metrics as text for a monitoring system, with every name
+    /// beginning with prefix.  The format may be "prometheus" (the text
+    /// exposition format, with the latencies as histograms) or "statsd"
+    /// (one gauge per line, the latencies as their count and 50th, 90th
+    /// and 99th percentiles).  For any other format, return an empty
+    /// string, with an error message that OIIO::geterror() retrieves.
+    static std::string format_metrics (const Metrics &metrics,
+                                       string_view format="prometheus",
+                                       string_view prefix="oiio_imagecache");
+
     /// Reset most statistics to be as they were with a fresh
     /// ImageCache.  Caveat emptor: this does not flush the cache itelf,
     /// so the resulting statistics from the next set of texture
@@ -461,6 +461,17 @@ public:
     ///    "iptc"           Can this format store IPTC data?
     ///    "procedural"     Can this format create images without reading
     ///                        from a disk file?
+    ///    "ioproxy"        Can this format read from a Filesystem::IOProxy
+    ///                        (given by the "oiio:ioproxy" attribute of
+    ///                        the config spec passed to open())?
+    ///    "concurrent_reads" May read_native_tile_at() be called from many
+    ///                        threads at once?  Asked of an open file,
+    ///                        the answer is for all of that file.
+    ///    "random_access"  Can scanlines be read in any order without
+    ///                        decoding all of those before them, so that
+    ///                        several ImageInputs open on the same file
+    ///                        can each read their own band of scanlines?
+    ///                        Asked of an open file.
     ///
     /// Note that main advantage of this approach, versus having
     /// separate individual supports_foo() methods, is that this allows
@@ -780,6 +791,38 @@ public:
     /// spec.depth pixels, all channels, into deepdata.
     virtual bool read_native_deep_image (DeepData &deepdata);
 
+    /// Read the entire deep data image, but only channels
+    /// [chbegin,chend), into deepdata.  Reading just the channels that
+    /// are needed (for example only A and Z for holdouts) saves both
+    /// the decoding time and the memory of the others.
+    bool read_native_deep_image (int chbegin, int chend, DeepData &deepdata);
+
+    /// If the tile containing pixel (x,y,z) of the current subimage and
+    /// MIP level is stored in the file uncompressed, with exactly the
+    /// bytes that read_native_tile would return (all channels
+    /// contiguous, native byte order, no conversions of any kind), set
+    /// offset to the position of its first byte within the file and
+    /// return true.  Otherwise return false, which is all the default
+    /// implementation does.  This lets a client such as the ImageCache
+    /// map the tiles of the file directly into memory.
+    virtual bool native_tile_offset (int x, int y, int z,
+                                     imagesize_t &offset);
+
+    /// Read the native tile containing pixel (x,y,z) of the given
+    /// subimage and MIP level into data, just as read_native_tile would
+    /// after seek_subimage (subimage, miplevel).  If the open file
+    /// answers supports("concurrent_reads") with nonzero, this neither
+    /// uses nor changes the current subimage, and may be called from
+    /// many threads at once and while other calls are in progress (but
+    /// not close()); a failure then records no error message, so retry
+    /// through the ordinary calls to learn what went wrong.  Otherwise
+    /// (and in the default implementation, which seeks and calls
+    /// read_native_tile) it must be serialized like any other call.
+    /// The hint "oiio:ConcurrentReads" in the configuration spec given
+    /// to open() asks the reader to get ready for this up front.
+    virtual bool read_native_tile_at (int subimage, int miplevel,
+                                      int x, int y, int z, void *data);
+
 
     /// General message passing between client and image input server
     ///
@@ -907,6 +950,9 @@ public:
     ///                        arbitrary names and types?
     ///    "exif"           Can this format store Exif camera data?
     ///    "iptc"           Can this format store IPTC data?
+    ///    "ioproxy"        Can this format write to a Filesystem::IOProxy
+    ///                        (given by the "oiio:ioproxy" attribute of
+    ///                        the spec passed to open())?
     ///
     /// Note that main advantage of this approach, versus having
     /// separate individual supports_foo() methods, is that this allows
@@ -1109,7 +1155,10 @@ public:
     /// file type and the same data format.  This can be more efficient
     /// than in->read_image followed by out->write_image, and avoids any
     /// unintended pixel alterations, especially for formats that use
-    /// lossy compression.
+    /// lossy compression.  JPEG, OpenEXR, and TIFF all copy the
+    /// compressed data without decoding it when the two files' data
+    /// layout, tiling, and compression match.  Call copy_image right
+    /// after opening the output, before writing any other pixels.
     virtual bool copy_image (ImageInput *in);
 
     /// General message passing between client and image output server
@@ -1237,11 +1286,14 @@ OIIO_API std::string geterror ();
 ///             by spawning threads (default=0, meaning to use the full
 ///             available hardware concurrency detected).
 ///     int exr_threads
-///             The size of the internal OpenEXR thread pool. The default
-///             is to use the full available hardware concurrency detected.
-///             Default is 0 meaning to use full available hardware
-///             concurrency detected, -1 means to disable usage of the OpenEXR
-///             thread pool and execute everything in the caller thread.
+///             OpenEXR's use of threads.  The default, 0, means to
+///             share OIIO's own thread pool (with OpenEXR 2.3 or newer --
+///             older versions get a pool of their own with as many
+///             threads as the "threads" attribute), so that total
+///             concurrency does not exceed "threads".  -1 means to
+///             execute everything in the caller thread, and any other
+///             value caps how many of the pool's threads OpenEXR may
+///             occupy at once.
 ///     string plugin_searchpath
 ///             Colon-separated list of directories to search for 
 ///             dynamically-loaded format plugins.
@@ -1254,6 +1306,15 @@ OIIO_API std::string geterror ();
 ///             are presumed to be used for that format.  Semicolons
 ///             separate the lists for formats.  For example,
 ///                "tiff:tif;jpeg:jpg,jpeg;openexr:exr"
+///     string hw:simd          (for 'getattribute' only, cannot set)
+///             Comma-separated list of the SIMD instruction set
+///             extensions that this CPU supports, e.g. "sse2,...,avx2".
+///     string simd_kernels     (for 'getattribute' only, cannot set)
+///             Which of the runtime-selected SIMD kernel sets ("avx512",
+///             "avx2", "sse4", or "baseline") is used for pixel type
+///             conversion and simple pixel math on this CPU.  The
+///             OPENIMAGEIO_SIMD env variable can cap it at a lower level
+///             (or "0" for none).
 ///     int read_chunk
 ///             The number of scanlines that will be attempted to read at
 ///             once for read_image calls (default: 256).
@@ -1266,6 +1327,31 @@ OIIO_API std::string geterror ();
 ///             When nonzero, allows TIFF to write 'half' pixel data.
 ///             N.B. Most apps may not read these correctly, but OIIO will.
 ///             That's why the default is not to support it.
+///     int color:lut3d_size
+///             When >= 2, color processors made by ColorConfig (and thus
+///             used by ImageBufAlgo::colorconvert, ociolook, etc.) are
+///             baked into a 3D LUT of this many points per axis (33 or 65
+///             are typical), which is much faster for complex transforms
+///             but only approximates them, and clamps color inputs to
+///             [0,256].  The default, 0, applies the transforms exactly.
+///     int imagebuf:hugepages
+///             When nonzero, large ImageBuf local pixel allocations are
+///             aligned to 2MB and (on Linux) marked for transparent huge
+///             pages, reducing TLB misses for very large images.
+///             Default is 0.  Local pixels are always 64-byte aligned.
+///     int imagebuf:parallel_first_touch
+///             When nonzero, new large ImageBuf local pixel memory is
+///             zeroed by multiple threads, split the same way as
+///             ImageBufAlgo::parallel_image, so that on NUMA systems with
+///             first-touch placement the pages are spread across the
+///             memory nodes of the threads that will process them.
+///             Default is 0 (pixels are left uninitialized).
+///     int imagebuf:parallel_read
+///             When nonzero (the default), ImageBuf::read() of a large
+///             scanline file, in a format whose readers can start at any
+///             scanline (see ImageInput::supports("random_access")),
+///             decodes disjoint bands of scanlines at once with several
+///             ImageInputs, following the ImageBuf's thread policy.
 ///
 OIIO_API bool attribute (string_view name, TypeDesc type, const void *val);
 // Shortcuts for common types
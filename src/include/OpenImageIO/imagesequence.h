@@ -0,0 +1,139 @@
+/*
+  Copyright 2016 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+/// \file
+/// ImageSequenceReader -- read the frames of an image sequence in order,
+/// with the next few frames being read in the background.
+
+
+#ifndef OPENIMAGEIO_IMAGESEQUENCE_H
+#define OPENIMAGEIO_IMAGESEQUENCE_H
+
+#include <string>
+#include <vector>
+
+#include "imageio.h"
+#include "imagebuf.h"
+
+
+OIIO_NAMESPACE_BEGIN
+
+
+/// ImageSequenceReader reads the frames of an image sequence one after
+/// another into ImageBufs.  While the caller works on one frame, the
+/// next few are already being read by tasks on the shared thread pool
+/// (see default_thread_pool()) into a bounded ring of buffers, so that
+/// walking a sequence on a high-latency file system runs at the rate
+/// the storage can deliver, not one open-and-read round trip at a time.
+///
+/// Each frame is read in its entirety, using ImageInput directly (not
+/// the ImageCache).  An ImageSequenceReader is meant to be driven by a
+/// single thread.
+///
+/// Typical use:
+///     ImageSequenceReader seq;
+///     if (! seq.open ("shot.1-100#.exr", "", 4))
+///         error (seq.geterror());
+///     ImageBuf frame;
+///     while (seq.next (frame))
+///         ... do something with frame ...
+///
+class OIIO_API ImageSequenceReader {
+public:
+    ImageSequenceReader ();
+
+    /// Cancels any reads still in progress and waits for them.
+    ~ImageSequenceReader ();
+
+    /// Open a sequence given a file pattern, such as "foo.#.exr",
+    /// "foo.1-100#.exr" or "foo.%04d.exr" (see Filesystem::parse_pattern).
+    /// The frames are given by framespec if it is not empty (for example
+    /// "1-100" or "1-100x2"), otherwise by the range in the pattern, and
+    /// if the pattern has no range either, by the matching files found on
+    /// disk.  Up to 'ahead' frames beyond the current one are read in the
+    /// background; 0 reads each frame only when it's asked for.  Pixels
+    /// are converted to format, or are left in the file's data format if
+    /// it is UNKNOWN.  Return true if the sequence has at least one frame.
+    bool open (string_view pattern, string_view framespec = string_view(),
+               int ahead = 4, TypeDesc format = TypeDesc::UNKNOWN);
+
+    /// Open a sequence of explicitly-named files, which are numbered
+    /// from 0.
+    bool open (const std::vector<std::string> &filenames, int ahead = 4,
+               TypeDesc format = TypeDesc::UNKNOWN);
+
+    /// Cancel and wait for outstanding reads and forget the sequence.
+    void close ();
+
+    /// Number of frames in the sequence.
+    int nframes () const;
+
+    /// Frame number and filename of the index-th frame of the sequence
+    /// (index is in [0,nframes())).
+    int frame_number (int index) const;
+    const std::string &filename (int index) const;
+
+    /// Index of the frame that the next call to next() will return.
+    int current () const;
+
+    /// Read the current frame into buf (whose previous contents, if any,
+    /// are discarded), advance to the following frame and keep the read
+    /// ahead going.  Return false if there was an error reading the frame
+    /// (retrieve it with geterror(); next() may be called again to
+    /// continue with the frame after it) or if there are no more frames
+    /// (current() == nframes()).
+    bool next (ImageBuf &buf);
+
+    /// Make index the current frame.  Background reads of frames that
+    /// are not within the new read-ahead window are cancelled, and those
+    /// that are within it are kept.  Return false if index is out of
+    /// range.
+    bool seek (int index);
+
+    /// Cancel all background reads.  Reading ahead resumes with the
+    /// next call to next() or seek().
+    void cancel ();
+
+    /// Return the text of all error messages since geterror() was last
+    /// called, and clear them.
+    std::string geterror () const;
+
+    class Impl;
+private:
+    Impl *m_impl;
+    ImageSequenceReader (const ImageSequenceReader &); // Do not implement
+    const ImageSequenceReader& operator= (const ImageSequenceReader &); // Do not implement
+};
+
+
+OIIO_NAMESPACE_END
+
+#endif // OPENIMAGEIO_IMAGESEQUENCE_H
@@ -164,10 +164,31 @@ private:
 
 /// A list of ParamValue entries, that can be iterated over or searched.
 ///
+/// Once a list is long enough, find() builds a hashed index of the names
+/// on demand, so that lookups by name don't scan the whole list.
+/// The index is never copied along with the list.  Calls that add or
+/// remove entries keep it up to date (push_back()) or discard it to be
+/// rebuilt by the next find() (grow(), resize(), erase(), clear(),
+/// free(), assignment).  Changing an entry's value or type in place, via
+/// an iterator or operator[], needs nothing further, but after renaming
+/// an entry in place, call reindex() before looking it up by its new
+/// name.  As with a std::vector, any number of threads may look up or
+/// walk a list (through const or non-const accessors alike) so long as
+/// none is adding, removing, or renaming entries.
 class OIIO_API ParamValueList {
     typedef std::vector<ParamValue> Rep;
 public:
-    ParamValueList () { }
+    ParamValueList () : m_index(NULL) { }
+    ParamValueList (const ParamValueList &p) : m_vals(p.m_vals), m_index(NULL) { }
+    ~ParamValueList () { invalidate_index (); }
+
+    const ParamValueList& operator= (const ParamValueList &p) {
+        if (this != &p) {
+            invalidate_index ();
+            m_vals = p.m_vals;
+        }
+        return *this;
+    }
 
     typedef Rep::iterator        iterator;
     typedef Rep::const_iterator  const_iterator;
@@ -194,7 +215,7 @@ public:
     reference operator[] (size_t i) { return m_vals[i]; }
     const_reference operator[] (size_t i) const { return m_vals[i]; }
 
-    void resize (size_t newsize) { m_vals.resize (newsize); }
+    void resize (size_t newsize) { invalidate_index(); m_vals.resize (newsize); }
     size_t size () const { return m_vals.size(); }
 
     /// Add space for one more ParamValue to the list, and return a
@@ -206,11 +227,16 @@ public:
 
     /// Add a ParamValue to the end of the list.
     ///
-    void push_back (const ParamValue &p) { m_vals.push_back (p); }
-    
+    void push_back (const ParamValue &p) {
+        m_vals.push_back (p);
+        if (m_index)
+            index_appended ();
+    }
+
     /// Find the first entry with matching name, and if type != UNKNOWN,
     /// then also with matching type. The name search is case sensitive if
-    /// casesensitive == true.
+    /// casesensitive == true. Searches of long lists use the name index
+    /// and take constant time.
     iterator find (string_view name, TypeDesc type = TypeDesc::UNKNOWN,
                    bool casesensitive = true);
     iterator find (ustring name, TypeDesc type = TypeDesc::UNKNOWN,
@@ -222,22 +248,42 @@ public:
 
     /// Removes from the ParamValueList container a single element.
     /// 
-    iterator erase (iterator position) { return m_vals.erase (position); }
+    iterator erase (iterator position) {
+        invalidate_index ();
+        return m_vals.erase (position);
+    }
     
     /// Removes from the ParamValueList container a range of elements ([first,last)).
     /// 
-    iterator erase (iterator first, iterator last) { return m_vals.erase (first, last); }
+    iterator erase (iterator first, iterator last) {
+        invalidate_index ();
+        return m_vals.erase (first, last);
+    }
     
     /// Remove all the values in the list.
     ///
-    void clear () { m_vals.clear(); }
+    void clear () { invalidate_index(); m_vals.clear(); }
 
     /// Even more radical than clear, free ALL memory associated with the
     /// list itself.
-    void free () { Rep tmp; std::swap (m_vals, tmp); }
+    void free () { invalidate_index(); Rep tmp; std::swap (m_vals, tmp); }
+
+    /// Discard the name index, to be rebuilt by the next find().  Needed
+    /// only after renaming entries in place, which the index can't see.
+    void reindex () { invalidate_index(); }
 
 private:
+    struct Index;
     Rep m_vals;
+    mutable Index * volatile m_index;  ///< Name index, built on demand
+
+    // Return the name index, building it if necessary, or NULL if the
+    // list is too short to bother indexing.
+    const Index *get_index () const;
+    // Add the last entry, just appended, to an existing index.
+    void index_appended ();
+    void invalidate_index () { if (m_index) free_index(); }
+    void free_index ();
 };
 
 
@@ -45,6 +45,7 @@
 # include <memory>
 #else
 # include <boost/shared_ptr.hpp>
+# include <boost/weak_ptr.hpp>
 #endif
 
 
@@ -53,8 +54,10 @@ OIIO_NAMESPACE_BEGIN
 
 #if OIIO_CPLUSPLUS_VERSION < 11
 using boost::shared_ptr;
+using boost::weak_ptr;
 #else
 using std::shared_ptr;
+using std::weak_ptr;
 #endif
 
 
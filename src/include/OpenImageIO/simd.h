@@ -89,19 +89,27 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #  endif
 #  define OIIO_SIMD 1
 #  define OIIO_SIMD_MASK_BYTE_WIDTH 4
-#  define OIIO_SIMD_MAX_SIZE_BYTES 16
 #  define OIIO_SIMD_ALIGN OIIO_ALIGN(16)
 #  define OIIO_SIMD4_ALIGN OIIO_ALIGN(16)
 #  define OIIO_SSE_ALIGN OIIO_ALIGN(16)
 #endif
 
-// FIXME Future: support AVX
 #if defined(__AVX__) && !defined(OIIO_NO_AVX)
-   // N.B. Any machine with AVX will also have SSE
-#  define OIIO_SIMD_AVX 1
+   // N.B. Any machine with AVX will also have SSE. OIIO_SIMD_AVX is 1
+   // for AVX, 2 for AVX2 (needed for 8-wide integer math), and 512 for
+   // AVX-512F (native 16-wide vectors).
+#  if defined(__AVX512F__) && !defined(OIIO_NO_AVX512)
+#    define OIIO_SIMD_AVX 512
+#  elif defined(__AVX2__)
+#    define OIIO_SIMD_AVX 2
+#  else
+#    define OIIO_SIMD_AVX 1
+#  endif
+#  define OIIO_SIMD8_ALIGN OIIO_ALIGN(32)
+#  if OIIO_SIMD_AVX >= 512
+#    define OIIO_SIMD16_ALIGN OIIO_ALIGN(64)
+#  endif
 // #  define OIIO_SIMD_MASK_BYTE_WIDTH 4
-// #  undef OIIO_SIMD_MAX_SIZE_BYTES
-// #  define OIIO_SIMD_MAX_SIZE_BYTES 32
 // #  undef OIIO_SIMD_ALIGN
 // #  define OIIO_SIMD_ALIGN OIIO_ALIGN(32)
 // #  define OIIO_AVX_ALIGN OIIO_ALIGN(32)
@@ -118,7 +126,6 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #  define OIIO_SIMD 1
 #  define OIIO_SIMD_NEON 1
 #  define OIIO_SIMD_MASK_BYTE_WIDTH 4
-#  define OIIO_SIMD_MAX_SIZE_BYTES 16
 #  define OIIO_SIMD_ALIGN OIIO_ALIGN(16)
 #  define OIIO_SIMD4_ALIGN OIIO_ALIGN(16)
 #  define OIIO_SSE_ALIGN OIIO_ALIGN(16)
@@ -129,7 +136,18 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #  define OIIO_SIMD 0
 #  define OIIO_SIMD_ALIGN
 #  define OIIO_SIMD4_ALIGN
-#  define OIIO_SIMD_MAX_SIZE_BYTES 16
+#endif
+
+// The widest load done by any of the types below.  float16 and friends
+// are available (if emulated) whatever the ISA, and a load of one reads
+// 64 bytes, so buffers padded for SIMD loads must allow for that much.
+#define OIIO_SIMD_MAX_SIZE_BYTES 64
+
+#ifndef OIIO_SIMD8_ALIGN
+#  define OIIO_SIMD8_ALIGN
+#endif
+#ifndef OIIO_SIMD16_ALIGN
+#  define OIIO_SIMD16_ALIGN
 #endif
 
 
@@ -146,6 +164,12 @@ class float4;
 class mask4;
 class float3;
 class matrix44;
+class int8;
+class float8;
+class mask8;
+class int16;
+class float16;
+class mask16;
 
 
 //////////////////////////////////////////////////////////////////////////
@@ -170,7 +194,7 @@ template<> struct simd_bool_t<8> { typedef __m256 type; };
 #if OIIO_SIMD_AVX >= 512
 template<> struct simd_raw_t<int,16> { typedef __m512i type; };
 template<> struct simd_raw_t<float,16> { typedef __m512 type; };
-template<> struct simd_bool_t<16> { typedef __m512 type; };
+template<> struct simd_bool_t<16> { typedef __mmask16 type; };
 #endif
 
 #if OIIO_SIMD_NEON
@@ -187,6 +211,12 @@ template<> struct VecType<int,4>   { typedef int4 type; };
 template<> struct VecType<float,4> { typedef float4 type; };
 template<> struct VecType<float,3> { typedef float3 type; };
 template<> struct VecType<bool,4>  { typedef mask4 type; };
+template<> struct VecType<int,8>   { typedef int8 type; };
+template<> struct VecType<float,8> { typedef float8 type; };
+template<> struct VecType<bool,8>  { typedef mask8 type; };
+template<> struct VecType<int,16>   { typedef int16 type; };
+template<> struct VecType<float,16> { typedef float16 type; };
+template<> struct VecType<bool,16>  { typedef mask16 type; };
 
 /// Template to retrieve the SIMD size of a SIMD type. Rigged to be 1 for
 /// anything but our SIMD types.
@@ -195,6 +225,12 @@ template<> struct SimdSize<int4>     { static const int size = 4; };
 template<> struct SimdSize<float4>   { static const int size = 4; };
 template<> struct SimdSize<float3>   { static const int size = 4; };
 template<> struct SimdSize<mask4>    { static const int size = 4; };
+template<> struct SimdSize<int8>     { static const int size = 8; };
+template<> struct SimdSize<float8>   { static const int size = 8; };
+template<> struct SimdSize<mask8>    { static const int size = 8; };
+template<> struct SimdSize<int16>    { static const int size = 16; };
+template<> struct SimdSize<float16>  { static const int size = 16; };
+template<> struct SimdSize<mask16>   { static const int size = 16; };
 
 /// Template to retrieve the number of elements size of a SIMD type. Rigged
 /// to be 1 for anything but our SIMD types.
@@ -1199,790 +1235,3074 @@ float3 transformvT (const Imath::M44f &M, const float3 &V);
 
 
 
+/// mask8: A mask 8-vector, whose elements act mostly like bools,
+/// accelerated by AVX instructions when available. This is what is
+/// naturally produced by SIMD comparison operators on the float8 and
+/// int8 types.
+class mask8 {
+public:
+    static const char* type_name() { return "mask8"; }
+    typedef bool value_t;     ///< Underlying equivalent scalar value type
+    enum { elements = 8 };    ///< Number of scalar elements
+    enum { paddedelements = 8 }; ///< Number of scalar elements for full pad
+    enum { bits = 256 };      ///< Total number of bits
+    typedef simd_bool_t<8>::type simd_t;  ///< the native SIMD type used
 
+    /// Default constructor (contents undefined)
+    mask8 () { }
 
-//////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////
-//
-// Gory implementation details follow.
-//
-// ^^^ All declarations and documention is above ^^^
-//
-// vvv Below is the implementation, often considerably cluttered with
-//     #if's for each architeture, and unapologitic use of intrinsics and
-//     every manner of dirty trick we can think of to make things fast.
-//     Some of this isn't pretty. We won't recapitulate comments or
-//     documentation of what the functions are supposed to do, please
-//     consult the declarations above for that.
-//
-//     Here be dragons.
-//
-//////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////////////////////
+    /// Construct from a single value (store it in all slots)
+    mask8 (bool a) { load(a); }
 
+    /// Construct from 8 values
+    mask8 (bool a, bool b, bool c, bool d, bool e, bool f, bool g, bool h);
 
+    /// Construct from two mask4's (the low and high halves)
+    mask8 (const mask4 &lo, const mask4 &hi);
 
-//////////////////////////////////////////////////////////////////////
-// mask4 implementation
+    /// Copy construct from another mask8
+    mask8 (const mask8 &other) { m_vec = other.m_vec; }
 
+    /// Construct from the underlying SIMD type
+    mask8 (const simd_t& m) : m_vec(m) { }
 
-OIIO_FORCEINLINE void mask4::clear () {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_setzero_ps();
-#else
-    *this = false;
-#endif
-}
+    /// Return the raw SIMD type
+    operator simd_t () const { return m_vec; }
+    simd_t simd () const { return m_vec; }
 
-OIIO_FORCEINLINE const mask4 mask4::False () {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_setzero_ps();
-#else
-    return mask4(false);
-#endif
-}
+    /// Return a mask8 that is 'false' for all values
+    static const mask8 False ();
 
-OIIO_FORCEINLINE const mask4 mask4::True () {
-#if defined(OIIO_SIMD_SSE)
-    // Fastest way to fill an __m128 with all 1 bits is to cmpeq_epi8
-    // any value to itself.
-# if defined(OIIO_SIMD_AVX) && (OIIO_GNUC_VERSION > 50000)
-    __m128i anyval = _mm_undefined_si128();
-# else
-    __m128i anyval = _mm_castps_si128 (_mm_setzero_ps());
-# endif
-    return _mm_castsi128_ps (_mm_cmpeq_epi8 (anyval, anyval));
-#else
-    return mask4(true);
-#endif
-}
+    /// Return a mask8 that is 'true' for all values
+    static const mask8 True ();
 
-OIIO_FORCEINLINE const mask4 & mask4::operator= (bool a) { load(a); return *this; }
+    /// Construct from the low 8 bits of an int, bit i giving element i.
+    static const mask8 from_bitmask (int bitmask);
 
-OIIO_FORCEINLINE const mask4 & mask4::operator= (const mask4 & other) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = other.m_vec;
-#else
-    SIMD_CONSTRUCT (other.m_val[i]);
-#endif
-    return *this;
-}
+    /// Assignment of another mask8
+    const mask8 & operator= (const mask8 & other);
 
-OIIO_FORCEINLINE bool mask4::operator[] (int i) const {
-    DASSERT(i >= 0 && i < 4);
-#if defined(OIIO_SIMD_SSE)
-    return (_mm_movemask_ps(m_vec) >> i) & 1;
-#else
-    return bool(m_val[i]);
-#endif
-}
+    /// Component access (get)
+    bool operator[] (int i) const;
 
-OIIO_FORCEINLINE int& mask4::operator[] (int i) {
-    DASSERT(i >= 0 && i < 4);
-    return m_val[i];
-}
+    /// The low or high 4 elements, as a mask4.
+    mask4 lo () const;
+    mask4 hi () const;
 
-OIIO_FORCEINLINE void mask4::load (bool a) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_castsi128_ps(_mm_set1_epi32(a ? -1 : 0));
-#else
-    int val = a ? -1 : 0;
-    SIMD_CONSTRUCT (val);
-#endif
-}
+    /// Helper: load a single value into all components.
+    void load (bool a);
 
-OIIO_FORCEINLINE void mask4::load (bool a, bool b, bool c, bool d) {
-#if defined(OIIO_SIMD_SSE)
-    // N.B. -- we need to reverse the order because of our convention
-    // of storing a,b,c,d in the same order in memory.
-    m_vec = _mm_castsi128_ps(_mm_set_epi32(d ? -1 : 0,
-                                           c ? -1 : 0,
-                                           b ? -1 : 0,
-                                           a ? -1 : 0));
-#else
-    m_val[0] = a ? -1 : 0;
-    m_val[1] = b ? -1 : 0;
-    m_val[2] = c ? -1 : 0;
-    m_val[3] = d ? -1 : 0;
-#endif
-}
+    /// Return an int whose bit i is set if element i is true.
+    int bitmask () const;
 
-OIIO_FORCEINLINE void mask4::store (bool *values) const {
-#if 0 && defined(OIIO_SIMD_SSE)
-    // FIXME: is there a more efficient way to do this?
-#else
-    SIMD_DO (values[i] = m_val[i] ? true : false);
-#endif
-}
+    /// Logical/bitwise operators, component-by-component
+    friend mask8 operator! (const mask8 & a);
+    friend mask8 operator& (const mask8 & a, const mask8 & b);
+    const mask8& operator&= (const mask8 & b);
+    friend mask8 operator| (const mask8 & a, const mask8 & b);
+    const mask8& operator|= (const mask8 & a);
+    friend mask8 operator^ (const mask8& a, const mask8& b);
+    mask8 operator~ () const;
 
-OIIO_FORCEINLINE void mask4::store (bool *values, int n) const {
-    DASSERT (n >= 0 && n <= elements);
-    for (int i = 0; i < n; ++i)
-        values[i] = m_val[i] ? true : false;
-}
+    /// Comparison operators, component by component
+    friend const mask8 operator== (const mask8 & a, const mask8 & b);
+    friend const mask8 operator!= (const mask8 & a, const mask8 & b);
 
-OIIO_FORCEINLINE mask4 operator! (const mask4 & a) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_xor_ps (a.m_vec, mask4::True());
-#else
-    SIMD_RETURN (mask4, a.m_val[i] ^ (-1));
-#endif
-}
+    /// Stream output
+    friend inline std::ostream& operator<< (std::ostream& cout, const mask8 & a);
 
-OIIO_FORCEINLINE mask4 operator& (const mask4 & a, const mask4 & b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_and_ps (a.m_vec, b.m_vec);
-#else
-    SIMD_RETURN (mask4, a.m_val[i] & b.m_val[i]);
-#endif
-}
+private:
+    // The actual data representation
+    union {
+        simd_t m_vec;
+        int m_val[paddedelements];
+    };
+};
 
-OIIO_FORCEINLINE const mask4& mask4::operator&= (const mask4 & b) {
-    return *this = *this & b;
-}
+bool reduce_and (const mask8& v);
+bool reduce_or (const mask8& v);
+OIIO_FORCEINLINE bool all  (const mask8& v) { return reduce_and(v) == true; }
+OIIO_FORCEINLINE bool any  (const mask8& v) { return reduce_or(v) == true; }
+OIIO_FORCEINLINE bool none (const mask8& v) { return reduce_or(v) == false; }
 
-OIIO_FORCEINLINE mask4 operator| (const mask4 & a, const mask4 & b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_or_ps (a.m_vec, b.m_vec);
-#else
-    SIMD_RETURN (mask4, a.m_val[i] | b.m_val[i]);
-#endif
-}
 
-OIIO_FORCEINLINE const mask4& mask4::operator|= (const mask4 & a) {
-    return *this = *this | a;
-}
 
-OIIO_FORCEINLINE mask4 operator^ (const mask4& a, const mask4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_xor_ps (a.m_vec, b.m_vec);
-#else
-    SIMD_RETURN (mask4, a.m_val[i] ^ b.m_val[i]);
-#endif
-}
 
-OIIO_FORCEINLINE const mask4 & mask4::operator^= (const mask4& a) {
-    return *this = *this ^ a;
-}
+/// Integer 8-vector, accelerated by AVX2 instructions when available,
+/// otherwise done as two int4 halves.
+class int8 {
+public:
+    static const char* type_name() { return "int8"; }
+    typedef int value_t;      ///< Underlying equivalent scalar value type
+    typedef mask8 mask_t;     ///< SIMD mask type
+    enum { elements = 8 };    ///< Number of scalar elements
+    enum { paddedelements = 8 }; ///< Number of scalar elements for full pad
+    enum { bits = 256 };      ///< Total number of bits
+    typedef simd_raw_t<int,8>::type simd_t;  ///< the native SIMD type used
 
-OIIO_FORCEINLINE mask4 mask4::operator~ () {
-#if defined(OIIO_SIMD_SSE)
-    // Fastest way to bit-complement in SSE is to xor with 0xffffffff.
-    // Fastest way to fill an __m128 with all 1 bits is to cmpeq_epi8
-    // any value to itself.
-# if defined(OIIO_SIMD_AVX) && (OIIO_GNUC_VERSION > 50000)
-    __m128i anyval = _mm_undefined_si128(); // AVX only, sigh
-# else
-    __m128i anyval = _mm_castps_si128 (m_vec);
-# endif
-    __m128 all_one_bits = _mm_castsi128_ps (_mm_cmpeq_epi8 (anyval, anyval));
-    return _mm_xor_ps (m_vec, all_one_bits);
-#else
-    SIMD_RETURN (mask4, ~m_val[i]);
-#endif
-}
+    /// Default constructor (contents undefined)
+    int8 () { }
 
-OIIO_FORCEINLINE const mask4 operator== (const mask4 & a, const mask4 & b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_castsi128_ps (_mm_cmpeq_epi32 (_mm_castps_si128 (a.m_vec), _mm_castps_si128(b.m_vec)));
-#else
-    SIMD_RETURN (mask4, a.m_val[i] == b.m_val[i] ? -1 : 0);
-#endif
-}
+    /// Construct from a single value (store it in all slots)
+    int8 (int a) { load(a); }
 
-OIIO_FORCEINLINE const mask4 operator!= (const mask4 & a, const mask4 & b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_xor_ps (a.m_vec, b.m_vec);
-#else
-    SIMD_RETURN (mask4, a.m_val[i] != b.m_val[i] ? -1 : 0);
-#endif
-}
+    /// Construct from 8 values
+    int8 (int a, int b, int c, int d, int e, int f, int g, int h);
 
-inline std::ostream& operator<< (std::ostream& cout, const mask4 & a) {
-    cout << a[0];
-    for (int i = 1; i < a.elements; ++i)
-        cout << ' ' << a[i];
-    return cout;
-}
+    /// Construct from a pointer to 8 values
+    int8 (const int *vals) { load (vals); }
 
+    /// Construct from two int4's (the low and high halves)
+    int8 (const int4 &lo, const int4 &hi);
 
+    /// Copy construct from another int8
+    int8 (const int8 & other) { m_vec = other.m_vec; }
 
-#if defined(OIIO_SIMD_SSE)
-// Shuffling. Use like this:  x = shuffle<3,2,1,0>(b)
-template<int i0, int i1, int i2, int i3>
-OIIO_FORCEINLINE __m128i shuffle_sse (__m128i v) {
-    return _mm_shuffle_epi32(v, _MM_SHUFFLE(i3, i2, i1, i0));
-}
-#endif
+    /// Convert a float8 to an int8. Equivalent to i = (int)f;
+    explicit int8 (const float8& f);
 
-#if OIIO_SIMD_SSE >= 3
-// SSE3 has intrinsics for a few special cases
-template<> OIIO_FORCEINLINE __m128i shuffle_sse<0, 0, 2, 2> (__m128i a) {
-    return _mm_castps_si128(_mm_moveldup_ps(_mm_castsi128_ps(a)));
-}
-template<> OIIO_FORCEINLINE __m128i shuffle_sse<1, 1, 3, 3> (__m128i a) {
-    return _mm_castps_si128(_mm_movehdup_ps(_mm_castsi128_ps(a)));
-}
-template<> OIIO_FORCEINLINE __m128i shuffle_sse<0, 1, 0, 1> (__m128i a) {
-    return _mm_castpd_si128(_mm_movedup_pd(_mm_castsi128_pd(a)));
-}
-#endif
+    /// Construct from the underlying SIMD type
+    int8 (const simd_t& m) : m_vec(m) { }
 
-#if defined(OIIO_SIMD_SSE)
-template<int i0, int i1, int i2, int i3>
-OIIO_FORCEINLINE __m128 shuffle_sse (__m128 a) {
-    return _mm_castsi128_ps(_mm_shuffle_epi32(_mm_castps_si128(a), _MM_SHUFFLE(i3, i2, i1, i0)));
-}
-#endif
+    /// Return the raw SIMD type
+    operator simd_t () const { return m_vec; }
+    simd_t simd () const { return m_vec; }
 
-#if OIIO_SIMD_SSE >= 3
-// SSE3 has intrinsics for a few special cases
-template<> OIIO_FORCEINLINE __m128 shuffle_sse<0, 0, 2, 2> (__m128 a) {
-    return _mm_moveldup_ps(a);
-}
-template<> OIIO_FORCEINLINE __m128 shuffle_sse<1, 1, 3, 3> (__m128 a) {
-    return _mm_movehdup_ps(a);
-}
-template<> OIIO_FORCEINLINE __m128 shuffle_sse<0, 1, 0, 1> (__m128 a) {
-    return _mm_castpd_ps(_mm_movedup_pd(_mm_castps_pd(a)));
-}
-#endif
+    /// Set all components to 0
+    void clear ();
 
+    /// Return an int8 with all components set to 0
+    static const int8 Zero ();
 
-/// Helper: shuffle/swizzle with constant (templated) indices.
-/// Example: shuffle<1,1,2,2>(mask4(a,b,c,d)) returns (b,b,c,c)
-template<int i0, int i1, int i2, int i3>
-OIIO_FORCEINLINE mask4 shuffle (const mask4& a) {
-#if defined(OIIO_SIMD_SSE)
+    /// Return an int8 with all components set to 1
+    static const int8 One ();
+
+    /// Return an int8 with all components set to -1 (aka 0xffffffff)
+    static const int8 NegOne ();
+
+    /// Return an int8 with incremented components (e.g., 0,1,2,...,7).
+    /// Optional argument can give a non-zero starting point.
+    static const int8 Iota (int value=0);
+
+    /// Assign one value to all components.
+    const int8 & operator= (int a);
+
+    /// Assignment from another int8
+    const int8 & operator= (const int8 &other);
+
+    /// Component access (set)
+    int& operator[] (int i);
+
+    /// Component access (get)
+    int operator[] (int i) const;
+
+    /// The low or high 4 elements, as an int4.
+    int4 lo () const;
+    int4 hi () const;
+
+    /// Helper: load a single int into all components
+    void load (int a);
+
+    /// Load from an array of 8 values
+    void load (const int *values);
+
+    /// Load the first n values from an array, the rest are set to 0.
+    void load (const int *values, int n);
+
+    /// Store the values into memory
+    void store (int *values) const;
+
+    /// Store the first n values into memory
+    void store (int *values, int n) const;
+
+    /// Store only the elements whose mask is true.
+    void store (int *values, const mask8 &mask) const;
+
+    // Arithmetic operators (component-by-component)
+    friend int8 operator+ (const int8& a, const int8& b);
+    const int8 & operator+= (const int8& a);
+    int8 operator- () const;
+    friend int8 operator- (const int8& a, const int8& b);
+    const int8 & operator-= (const int8& a);
+    friend int8 operator* (const int8& a, const int8& b);
+    const int8 & operator*= (const int8& a);
+
+    // Bitwise operators (component-by-component)
+    friend int8 operator& (const int8& a, const int8& b);
+    friend int8 operator| (const int8& a, const int8& b);
+    friend int8 operator^ (const int8& a, const int8& b);
+    int8 operator~ () const;
+    int8 operator<< (const unsigned int bits) const;
+    int8 operator>> (const unsigned int bits) const;
+
+    // Shift right logical -- unsigned shift (see int4 srl).
+    friend int8 srl (const int8& val, const unsigned int bits);
+
+    // Comparison operators (component-by-component)
+    friend mask8 operator== (const int8& a, const int8& b);
+    friend mask8 operator!= (const int8& a, const int8& b);
+    friend mask8 operator< (const int8& a, const int8& b);
+    friend mask8 operator>  (const int8& a, const int8& b);
+    friend mask8 operator>= (const int8& a, const int8& b);
+    friend mask8 operator<= (const int8& a, const int8& b);
+
+    /// Stream output
+    friend inline std::ostream& operator<< (std::ostream& cout, const int8& val);
+
+private:
+    // The actual data representation
+    union {
+        simd_t  m_vec;
+        value_t m_val[paddedelements];
+    };
+};
+
+/// The sum of all components, returned as a scalar.
+int reduce_add (const int8& v);
+
+/// Per-element select, blend, and blend0 (see the int4 versions).
+int8 blend (const int8& a, const int8& b, const mask8& mask);
+int8 blend0 (const int8& a, const mask8& mask);
+int8 select (const mask8& mask, const int8& a, const int8& b);
+
+int8 abs (const int8& a);                     ///< Per-element absolute value
+int8 min (const int8& a, const int8& b);      ///< Per-element min
+int8 max (const int8& a, const int8& b);      ///< Per-element max
+
+// Circular bit rotate by k bits, for 8 values at once.
+int8 rotl32 (const int8& x, const unsigned int k);
+
+/// Bitcast back and forth int8 (not a convert -- move the bits!)
+int8 bitcast_to_int8 (const mask8& x);
+int8 bitcast_to_int8 (const float8& x);
+float8 bitcast_to_float8 (const int8& x);
+
+/// Gather: return base[index[i]] for each element (only where mask[i]
+/// is true, 0 elsewhere, for the masked version).
+int8 gather (const int *base, const int8 &index);
+int8 gather (const int *base, const int8 &index, const mask8 &mask);
+
+
+
+
+/// Floating point 8-vector, accelerated by AVX instructions when
+/// available, otherwise done as two float4 halves.
+class float8 {
+public:
+    static const char* type_name() { return "float8"; }
+    typedef float value_t;    ///< Underlying equivalent scalar value type
+    typedef mask8 mask_t;     ///< SIMD mask type
+    enum { elements = 8 };    ///< Number of scalar elements
+    enum { paddedelements = 8 }; ///< Number of scalar elements for full pad
+    enum { bits = 256 };      ///< Total number of bits
+    typedef simd_raw_t<float,8>::type simd_t;  ///< the native SIMD type used
+
+    /// Default constructor (contents undefined)
+    float8 () { }
+
+    /// Construct from a single value (store it in all slots)
+    float8 (float a) { load(a); }
+
+    /// Construct from 8 values
+    float8 (float a, float b, float c, float d,
+            float e, float f, float g, float h);
+
+    /// Construct from a pointer to 8 values
+    float8 (const float *f) { load (f); }
+
+#ifdef _HALF_H_
+    /// Construct from a pointer to 8 half values, converted to float
+    explicit float8 (const half *f) { load (f); }
+#endif
+
+    /// Construct from two float4's (the low and high halves)
+    float8 (const float4 &lo, const float4 &hi);
+
+    /// Copy construct from another float8
+    float8 (const float8 &other) { m_vec = other.m_vec; }
+
+    /// Convert an int8 to a float8
+    explicit float8 (const int8& i);
+
+    /// Construct from the underlying SIMD type
+    float8 (const simd_t& m) : m_vec(m) { }
+
+    /// Return the raw SIMD type
+    operator simd_t () const { return m_vec; }
+    simd_t simd () const { return m_vec; }
+
+    /// Return a float8 with all components set to 0.0
+    static const float8 Zero ();
+
+    /// Return a float8 with all components set to 1.0
+    static const float8 One ();
+
+    /// Return a float8 with incremented components (e.g., 0,1,2,...,7).
+    /// Optional argument can give a non-zero starting point.
+    static const float8 Iota (float value=0.0f);
+
+    /// Set all components to 0.0
+    void clear ();
+
+    /// Assign a single value to all components
+    const float8 & operator= (float a) { load(a); return *this; }
+
+    /// Assign a float8
+    const float8 & operator= (const float8 &other);
+
+    /// Component access (set)
+    float& operator[] (int i);
+
+    /// Component access (get)
+    float operator[] (int i) const;
+
+    /// The low or high 4 elements, as a float4.
+    float4 lo () const;
+    float4 hi () const;
+
+    /// Helper: load a single value into all components
+    void load (float val);
+
+    /// Load from an array of 8 values
+    void load (const float *values);
+
+    /// Load the first n values from an array, the rest are set to 0.
+    void load (const float *values, int n);
+
+#ifdef _HALF_H_
+    /// Load from an array of 8 half values, convert to float
+    void load (const half *values);
+#endif
+
+    /// Store the values into memory
+    void store (float *values) const;
+
+    /// Store the first n values into memory
+    void store (float *values, int n) const;
+
+    /// Store only the elements whose mask is true.
+    void store (float *values, const mask8 &mask) const;
+
+#ifdef _HALF_H_
+    /// Convert to half and store 8 values into memory
+    void store (half *values) const;
+#endif
+
+    // Arithmetic operators
+    friend float8 operator+ (const float8& a, const float8& b);
+    const float8 & operator+= (const float8& a);
+    float8 operator- () const;
+    friend float8 operator- (const float8& a, const float8& b);
+    const float8 & operator-= (const float8& a);
+    friend float8 operator* (const float8& a, const float8& b);
+    const float8 & operator*= (const float8& a);
+    friend float8 operator/ (const float8& a, const float8& b);
+    const float8 & operator/= (const float8& a);
+
+    // Comparison operations
+    friend mask8 operator== (const float8& a, const float8& b);
+    friend mask8 operator!= (const float8& a, const float8& b);
+    friend mask8 operator< (const float8& a, const float8& b);
+    friend mask8 operator>  (const float8& a, const float8& b);
+    friend mask8 operator>= (const float8& a, const float8& b);
+    friend mask8 operator<= (const float8& a, const float8& b);
+
+    /// Stream output
+    friend inline std::ostream& operator<< (std::ostream& cout, const float8& val);
+
+protected:
+    // The actual data representation
+    union {
+        simd_t  m_vec;
+        value_t m_val[paddedelements];
+    };
+};
+
+/// The sum of all components, returned as a scalar.
+float reduce_add (const float8& v);
+
+/// Per-element select, blend, and blend0 (see the float4 versions).
+float8 blend (const float8& a, const float8& b, const mask8& mask);
+float8 blend0 (const float8& a, const mask8& mask);
+float8 select (const mask8& mask, const float8& a, const float8& b);
+
+float8 abs (const float8& a);    ///< absolute value (float)
+float8 ceil (const float8& a);
+float8 floor (const float8& a);
+float8 round (const float8& a);
+int8 floori (const float8& a);   ///< (int)floor
+float8 sqrt (const float8 &a);
+float8 rsqrt (const float8 &a);  ///< Fully accurate 1/sqrt
+float8 rsqrt_fast (const float8 &a);  ///< Fast, approximate 1/sqrt
+float8 rcp_fast (const float8 &a);    ///< Fast, approximate 1/a
+float8 min (const float8& a, const float8& b); ///< Per-element min
+float8 max (const float8& a, const float8& b); ///< Per-element max
+
+// Fused multiply and add (or subtract):
+float8 madd (const float8& a, const float8& b, const float8& c); // a*b + c
+float8 msub (const float8& a, const float8& b, const float8& c); // a*b - c
+float8 nmadd (const float8& a, const float8& b, const float8& c); // -a*b + c
+float8 nmsub (const float8& a, const float8& b, const float8& c); // -a*b - c
+
+/// Full precision exp() and log() of all components.
+float8 exp (const float8& v);
+float8 log (const float8& v);
+
+/// Gather: return base[index[i]] for each element (only where mask[i]
+/// is true, 0 elsewhere, for the masked version).
+float8 gather (const float *base, const int8 &index);
+float8 gather (const float *base, const int8 &index, const mask8 &mask);
+
+
+
+
+/// mask16: A mask 16-vector, accelerated by AVX-512 mask registers when
+/// available. It is stored as a bit mask (bit i for element i).
+class mask16 {
+public:
+    static const char* type_name() { return "mask16"; }
+    typedef bool value_t;     ///< Underlying equivalent scalar value type
+    enum { elements = 16 };   ///< Number of scalar elements
+    enum { paddedelements = 16 }; ///< Number of scalar elements for full pad
+    enum { bits = 16 };       ///< Total number of bits
+
+    /// Default constructor (contents undefined)
+    mask16 () { }
+
+    /// Construct from a single value (store it in all slots)
+    mask16 (bool a) : m_bits(a ? 0xffff : 0) { }
+
+    /// Construct from two mask8's (the low and high halves)
+    mask16 (const mask8 &lo, const mask8 &hi)
+        : m_bits(lo.bitmask() | (hi.bitmask() << 8)) { }
+
+    /// Return a mask16 that is 'false' for all values
+    static const mask16 False () { return mask16(false); }
+
+    /// Return a mask16 that is 'true' for all values
+    static const mask16 True () { return mask16(true); }
+
+    /// Construct from the low 16 bits of an int, bit i giving element i.
+    static const mask16 from_bitmask (int bitmask) {
+        mask16 m;  m.m_bits = bitmask & 0xffff;  return m;
+    }
+
+    /// Component access (get)
+    bool operator[] (int i) const { return (m_bits >> i) & 1; }
+
+    /// The low or high 8 elements, as a mask8.
+    mask8 lo () const { return mask8::from_bitmask (m_bits); }
+    mask8 hi () const { return mask8::from_bitmask (m_bits >> 8); }
+
+    /// Return an int whose bit i is set if element i is true.
+    int bitmask () const { return m_bits; }
+
+    /// Logical/bitwise operators, component-by-component
+    friend mask16 operator! (const mask16 & a) { return from_bitmask(~a.m_bits); }
+    friend mask16 operator& (const mask16 & a, const mask16 & b) { return from_bitmask(a.m_bits & b.m_bits); }
+    friend mask16 operator| (const mask16 & a, const mask16 & b) { return from_bitmask(a.m_bits | b.m_bits); }
+    friend mask16 operator^ (const mask16 & a, const mask16 & b) { return from_bitmask(a.m_bits ^ b.m_bits); }
+    mask16 operator~ () const { return from_bitmask(~m_bits); }
+
+    /// Comparison operators, component by component
+    friend const mask16 operator== (const mask16 & a, const mask16 & b) { return from_bitmask(~(a.m_bits ^ b.m_bits)); }
+    friend const mask16 operator!= (const mask16 & a, const mask16 & b) { return from_bitmask(a.m_bits ^ b.m_bits); }
+
+    /// Stream output
+    friend inline std::ostream& operator<< (std::ostream& cout, const mask16 & a);
+
+private:
+    unsigned int m_bits;
+};
+
+OIIO_FORCEINLINE bool reduce_and (const mask16& v) { return v.bitmask() == 0xffff; }
+OIIO_FORCEINLINE bool reduce_or (const mask16& v) { return v.bitmask() != 0; }
+OIIO_FORCEINLINE bool all  (const mask16& v) { return reduce_and(v) == true; }
+OIIO_FORCEINLINE bool any  (const mask16& v) { return reduce_or(v) == true; }
+OIIO_FORCEINLINE bool none (const mask16& v) { return reduce_or(v) == false; }
+
+
+
+
+/// Integer 16-vector, accelerated by AVX-512 instructions when
+/// available, otherwise done as two int8 halves.
+class int16 {
+public:
+    static const char* type_name() { return "int16"; }
+    typedef int value_t;      ///< Underlying equivalent scalar value type
+    typedef mask16 mask_t;    ///< SIMD mask type
+    enum { elements = 16 };   ///< Number of scalar elements
+    enum { paddedelements = 16 }; ///< Number of scalar elements for full pad
+    enum { bits = 512 };      ///< Total number of bits
+    typedef simd_raw_t<int,16>::type simd_t;  ///< the native SIMD type used
+
+    /// Default constructor (contents undefined)
+    int16 () { }
+
+    /// Construct from a single value (store it in all slots)
+    int16 (int a) { load(a); }
+
+    /// Construct from a pointer to 16 values
+    int16 (const int *vals) { load (vals); }
+
+    /// Construct from two int8's (the low and high halves)
+    int16 (const int8 &lo, const int8 &hi);
+
+    /// Copy construct from another int16
+    int16 (const int16 & other) { m_vec = other.m_vec; }
+
+    /// Convert a float16 to an int16. Equivalent to i = (int)f;
+    explicit int16 (const float16& f);
+
+    /// Construct from the underlying SIMD type
+    int16 (const simd_t& m) : m_vec(m) { }
+
+    /// Return the raw SIMD type
+    operator simd_t () const { return m_vec; }
+    simd_t simd () const { return m_vec; }
+
+    /// Return an int16 with all components set to 0
+    static const int16 Zero () { return int16(0); }
+
+    /// Return an int16 with all components set to 1
+    static const int16 One () { return int16(1); }
+
+    /// Return an int16 with incremented components (e.g., 0,1,2,...,15).
+    /// Optional argument can give a non-zero starting point.
+    static const int16 Iota (int value=0);
+
+    /// Assignment from another int16
+    const int16 & operator= (const int16 &other);
+
+    /// Component access (set)
+    int& operator[] (int i);
+
+    /// Component access (get)
+    int operator[] (int i) const;
+
+    /// The low or high 8 elements, as an int8.
+    int8 lo () const;
+    int8 hi () const;
+
+    /// Helper: load a single int into all components
+    void load (int a);
+
+    /// Load from an array of 16 values
+    void load (const int *values);
+
+    /// Load the first n values from an array, the rest are set to 0.
+    void load (const int *values, int n);
+
+    /// Store the values into memory
+    void store (int *values) const;
+
+    /// Store the first n values into memory
+    void store (int *values, int n) const;
+
+    /// Store only the elements whose mask is true.
+    void store (int *values, const mask16 &mask) const;
+
+    // Arithmetic operators (component-by-component)
+    friend int16 operator+ (const int16& a, const int16& b);
+    const int16 & operator+= (const int16& a);
+    int16 operator- () const;
+    friend int16 operator- (const int16& a, const int16& b);
+    const int16 & operator-= (const int16& a);
+    friend int16 operator* (const int16& a, const int16& b);
+    const int16 & operator*= (const int16& a);
+
+    // Bitwise operators (component-by-component)
+    friend int16 operator& (const int16& a, const int16& b);
+    friend int16 operator| (const int16& a, const int16& b);
+    friend int16 operator^ (const int16& a, const int16& b);
+    int16 operator~ () const;
+    int16 operator<< (const unsigned int bits) const;
+    int16 operator>> (const unsigned int bits) const;
+
+    // Shift right logical -- unsigned shift (see int4 srl).
+    friend int16 srl (const int16& val, const unsigned int bits);
+
+    // Comparison operators (component-by-component)
+    friend mask16 operator== (const int16& a, const int16& b);
+    friend mask16 operator!= (const int16& a, const int16& b);
+    friend mask16 operator< (const int16& a, const int16& b);
+    friend mask16 operator>  (const int16& a, const int16& b);
+    friend mask16 operator>= (const int16& a, const int16& b);
+    friend mask16 operator<= (const int16& a, const int16& b);
+
+    /// Stream output
+    friend inline std::ostream& operator<< (std::ostream& cout, const int16& val);
+
+private:
+    // The actual data representation
+    union {
+        simd_t  m_vec;
+        value_t m_val[paddedelements];
+    };
+};
+
+int reduce_add (const int16& v);
+int16 blend (const int16& a, const int16& b, const mask16& mask);
+int16 blend0 (const int16& a, const mask16& mask);
+int16 select (const mask16& mask, const int16& a, const int16& b);
+int16 abs (const int16& a);
+int16 min (const int16& a, const int16& b);
+int16 max (const int16& a, const int16& b);
+int16 bitcast_to_int16 (const float16& x);
+float16 bitcast_to_float16 (const int16& x);
+int16 gather (const int *base, const int16 &index);
+int16 gather (const int *base, const int16 &index, const mask16 &mask);
+
+
+
+
+/// Floating point 16-vector, accelerated by AVX-512 instructions when
+/// available, otherwise done as two float8 halves.
+class float16 {
+public:
+    static const char* type_name() { return "float16"; }
+    typedef float value_t;    ///< Underlying equivalent scalar value type
+    typedef mask16 mask_t;    ///< SIMD mask type
+    enum { elements = 16 };   ///< Number of scalar elements
+    enum { paddedelements = 16 }; ///< Number of scalar elements for full pad
+    enum { bits = 512 };      ///< Total number of bits
+    typedef simd_raw_t<float,16>::type simd_t;  ///< the native SIMD type used
+
+    /// Default constructor (contents undefined)
+    float16 () { }
+
+    /// Construct from a single value (store it in all slots)
+    float16 (float a) { load(a); }
+
+    /// Construct from a pointer to 16 values
+    float16 (const float *f) { load (f); }
+
+    /// Construct from two float8's (the low and high halves)
+    float16 (const float8 &lo, const float8 &hi);
+
+    /// Copy construct from another float16
+    float16 (const float16 &other) { m_vec = other.m_vec; }
+
+    /// Convert an int16 to a float16
+    explicit float16 (const int16& i);
+
+    /// Construct from the underlying SIMD type
+    float16 (const simd_t& m) : m_vec(m) { }
+
+    /// Return the raw SIMD type
+    operator simd_t () const { return m_vec; }
+    simd_t simd () const { return m_vec; }
+
+    /// Return a float16 with all components set to 0.0
+    static const float16 Zero () { return float16(0.0f); }
+
+    /// Return a float16 with all components set to 1.0
+    static const float16 One () { return float16(1.0f); }
+
+    /// Return a float16 with incremented components (e.g., 0,1,2,...,15).
+    /// Optional argument can give a non-zero starting point.
+    static const float16 Iota (float value=0.0f);
+
+    /// Assign a single value to all components
+    const float16 & operator= (float a) { load(a); return *this; }
+
+    /// Assign a float16
+    const float16 & operator= (const float16 &other);
+
+    /// Component access (set)
+    float& operator[] (int i);
+
+    /// Component access (get)
+    float operator[] (int i) const;
+
+    /// The low or high 8 elements, as a float8.
+    float8 lo () const;
+    float8 hi () const;
+
+    /// Helper: load a single value into all components
+    void load (float val);
+
+    /// Load from an array of 16 values
+    void load (const float *values);
+
+    /// Load the first n values from an array, the rest are set to 0.
+    void load (const float *values, int n);
+
+    /// Store the values into memory
+    void store (float *values) const;
+
+    /// Store the first n values into memory
+    void store (float *values, int n) const;
+
+    /// Store only the elements whose mask is true.
+    void store (float *values, const mask16 &mask) const;
+
+    // Arithmetic operators
+    friend float16 operator+ (const float16& a, const float16& b);
+    const float16 & operator+= (const float16& a);
+    float16 operator- () const;
+    friend float16 operator- (const float16& a, const float16& b);
+    const float16 & operator-= (const float16& a);
+    friend float16 operator* (const float16& a, const float16& b);
+    const float16 & operator*= (const float16& a);
+    friend float16 operator/ (const float16& a, const float16& b);
+    const float16 & operator/= (const float16& a);
+
+    // Comparison operations
+    friend mask16 operator== (const float16& a, const float16& b);
+    friend mask16 operator!= (const float16& a, const float16& b);
+    friend mask16 operator< (const float16& a, const float16& b);
+    friend mask16 operator>  (const float16& a, const float16& b);
+    friend mask16 operator>= (const float16& a, const float16& b);
+    friend mask16 operator<= (const float16& a, const float16& b);
+
+    /// Stream output
+    friend inline std::ostream& operator<< (std::ostream& cout, const float16& val);
+
+protected:
+    // The actual data representation
+    union {
+        simd_t  m_vec;
+        value_t m_val[paddedelements];
+    };
+};
+
+float reduce_add (const float16& v);
+float16 blend (const float16& a, const float16& b, const mask16& mask);
+float16 blend0 (const float16& a, const mask16& mask);
+float16 select (const mask16& mask, const float16& a, const float16& b);
+float16 abs (const float16& a);
+float16 ceil (const float16& a);
+float16 floor (const float16& a);
+float16 round (const float16& a);
+int16 floori (const float16& a);
+float16 sqrt (const float16 &a);
+float16 rsqrt (const float16 &a);
+float16 rsqrt_fast (const float16 &a);
+float16 rcp_fast (const float16 &a);
+float16 min (const float16& a, const float16& b);
+float16 max (const float16& a, const float16& b);
+float16 madd (const float16& a, const float16& b, const float16& c);
+float16 msub (const float16& a, const float16& b, const float16& c);
+float16 nmadd (const float16& a, const float16& b, const float16& c);
+float16 nmsub (const float16& a, const float16& b, const float16& c);
+float16 exp (const float16& v);
+float16 log (const float16& v);
+float16 gather (const float *base, const int16 &index);
+float16 gather (const float *base, const int16 &index, const mask16 &mask);
+
+
+
+
+
+
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//
+// Gory implementation details follow.
+//
+// ^^^ All declarations and documention is above ^^^
+//
+// vvv Below is the implementation, often considerably cluttered with
+//     #if's for each architeture, and unapologitic use of intrinsics and
+//     every manner of dirty trick we can think of to make things fast.
+//     Some of this isn't pretty. We won't recapitulate comments or
+//     documentation of what the functions are supposed to do, please
+//     consult the declarations above for that.
+//
+//     Here be dragons.
+//
+//////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+
+
+
+//////////////////////////////////////////////////////////////////////
+// mask4 implementation
+
+
+OIIO_FORCEINLINE void mask4::clear () {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_setzero_ps();
+#else
+    *this = false;
+#endif
+}
+
+OIIO_FORCEINLINE const mask4 mask4::False () {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_setzero_ps();
+#else
+    return mask4(false);
+#endif
+}
+
+OIIO_FORCEINLINE const mask4 mask4::True () {
+#if defined(OIIO_SIMD_SSE)
+    // Fastest way to fill an __m128 with all 1 bits is to cmpeq_epi8
+    // any value to itself.
+# if defined(OIIO_SIMD_AVX) && (OIIO_GNUC_VERSION > 50000)
+    __m128i anyval = _mm_undefined_si128();
+# else
+    __m128i anyval = _mm_castps_si128 (_mm_setzero_ps());
+# endif
+    return _mm_castsi128_ps (_mm_cmpeq_epi8 (anyval, anyval));
+#else
+    return mask4(true);
+#endif
+}
+
+OIIO_FORCEINLINE const mask4 & mask4::operator= (bool a) { load(a); return *this; }
+
+OIIO_FORCEINLINE const mask4 & mask4::operator= (const mask4 & other) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = other.m_vec;
+#else
+    SIMD_CONSTRUCT (other.m_val[i]);
+#endif
+    return *this;
+}
+
+OIIO_FORCEINLINE bool mask4::operator[] (int i) const {
+    DASSERT(i >= 0 && i < 4);
+#if defined(OIIO_SIMD_SSE)
+    return (_mm_movemask_ps(m_vec) >> i) & 1;
+#else
+    return bool(m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE int& mask4::operator[] (int i) {
+    DASSERT(i >= 0 && i < 4);
+    return m_val[i];
+}
+
+OIIO_FORCEINLINE void mask4::load (bool a) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_castsi128_ps(_mm_set1_epi32(a ? -1 : 0));
+#else
+    int val = a ? -1 : 0;
+    SIMD_CONSTRUCT (val);
+#endif
+}
+
+OIIO_FORCEINLINE void mask4::load (bool a, bool b, bool c, bool d) {
+#if defined(OIIO_SIMD_SSE)
+    // N.B. -- we need to reverse the order because of our convention
+    // of storing a,b,c,d in the same order in memory.
+    m_vec = _mm_castsi128_ps(_mm_set_epi32(d ? -1 : 0,
+                                           c ? -1 : 0,
+                                           b ? -1 : 0,
+                                           a ? -1 : 0));
+#else
+    m_val[0] = a ? -1 : 0;
+    m_val[1] = b ? -1 : 0;
+    m_val[2] = c ? -1 : 0;
+    m_val[3] = d ? -1 : 0;
+#endif
+}
+
+OIIO_FORCEINLINE void mask4::store (bool *values) const {
+#if 0 && defined(OIIO_SIMD_SSE)
+    // FIXME: is there a more efficient way to do this?
+#else
+    SIMD_DO (values[i] = m_val[i] ? true : false);
+#endif
+}
+
+OIIO_FORCEINLINE void mask4::store (bool *values, int n) const {
+    DASSERT (n >= 0 && n <= elements);
+    for (int i = 0; i < n; ++i)
+        values[i] = m_val[i] ? true : false;
+}
+
+OIIO_FORCEINLINE mask4 operator! (const mask4 & a) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_xor_ps (a.m_vec, mask4::True());
+#else
+    SIMD_RETURN (mask4, a.m_val[i] ^ (-1));
+#endif
+}
+
+OIIO_FORCEINLINE mask4 operator& (const mask4 & a, const mask4 & b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_and_ps (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (mask4, a.m_val[i] & b.m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const mask4& mask4::operator&= (const mask4 & b) {
+    return *this = *this & b;
+}
+
+OIIO_FORCEINLINE mask4 operator| (const mask4 & a, const mask4 & b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_or_ps (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (mask4, a.m_val[i] | b.m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const mask4& mask4::operator|= (const mask4 & a) {
+    return *this = *this | a;
+}
+
+OIIO_FORCEINLINE mask4 operator^ (const mask4& a, const mask4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_xor_ps (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (mask4, a.m_val[i] ^ b.m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const mask4 & mask4::operator^= (const mask4& a) {
+    return *this = *this ^ a;
+}
+
+OIIO_FORCEINLINE mask4 mask4::operator~ () {
+#if defined(OIIO_SIMD_SSE)
+    // Fastest way to bit-complement in SSE is to xor with 0xffffffff.
+    // Fastest way to fill an __m128 with all 1 bits is to cmpeq_epi8
+    // any value to itself.
+# if defined(OIIO_SIMD_AVX) && (OIIO_GNUC_VERSION > 50000)
+    __m128i anyval = _mm_undefined_si128(); // AVX only, sigh
+# else
+    __m128i anyval = _mm_castps_si128 (m_vec);
+# endif
+    __m128 all_one_bits = _mm_castsi128_ps (_mm_cmpeq_epi8 (anyval, anyval));
+    return _mm_xor_ps (m_vec, all_one_bits);
+#else
+    SIMD_RETURN (mask4, ~m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const mask4 operator== (const mask4 & a, const mask4 & b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_castsi128_ps (_mm_cmpeq_epi32 (_mm_castps_si128 (a.m_vec), _mm_castps_si128(b.m_vec)));
+#else
+    SIMD_RETURN (mask4, a.m_val[i] == b.m_val[i] ? -1 : 0);
+#endif
+}
+
+OIIO_FORCEINLINE const mask4 operator!= (const mask4 & a, const mask4 & b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_xor_ps (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (mask4, a.m_val[i] != b.m_val[i] ? -1 : 0);
+#endif
+}
+
+inline std::ostream& operator<< (std::ostream& cout, const mask4 & a) {
+    cout << a[0];
+    for (int i = 1; i < a.elements; ++i)
+        cout << ' ' << a[i];
+    return cout;
+}
+
+
+
+#if defined(OIIO_SIMD_SSE)
+// Shuffling. Use like this:  x = shuffle<3,2,1,0>(b)
+template<int i0, int i1, int i2, int i3>
+OIIO_FORCEINLINE __m128i shuffle_sse (__m128i v) {
+    return _mm_shuffle_epi32(v, _MM_SHUFFLE(i3, i2, i1, i0));
+}
+#endif
+
+#if OIIO_SIMD_SSE >= 3
+// SSE3 has intrinsics for a few special cases
+template<> OIIO_FORCEINLINE __m128i shuffle_sse<0, 0, 2, 2> (__m128i a) {
+    return _mm_castps_si128(_mm_moveldup_ps(_mm_castsi128_ps(a)));
+}
+template<> OIIO_FORCEINLINE __m128i shuffle_sse<1, 1, 3, 3> (__m128i a) {
+    return _mm_castps_si128(_mm_movehdup_ps(_mm_castsi128_ps(a)));
+}
+template<> OIIO_FORCEINLINE __m128i shuffle_sse<0, 1, 0, 1> (__m128i a) {
+    return _mm_castpd_si128(_mm_movedup_pd(_mm_castsi128_pd(a)));
+}
+#endif
+
+#if defined(OIIO_SIMD_SSE)
+template<int i0, int i1, int i2, int i3>
+OIIO_FORCEINLINE __m128 shuffle_sse (__m128 a) {
+    return _mm_castsi128_ps(_mm_shuffle_epi32(_mm_castps_si128(a), _MM_SHUFFLE(i3, i2, i1, i0)));
+}
+#endif
+
+#if OIIO_SIMD_SSE >= 3
+// SSE3 has intrinsics for a few special cases
+template<> OIIO_FORCEINLINE __m128 shuffle_sse<0, 0, 2, 2> (__m128 a) {
+    return _mm_moveldup_ps(a);
+}
+template<> OIIO_FORCEINLINE __m128 shuffle_sse<1, 1, 3, 3> (__m128 a) {
+    return _mm_movehdup_ps(a);
+}
+template<> OIIO_FORCEINLINE __m128 shuffle_sse<0, 1, 0, 1> (__m128 a) {
+    return _mm_castpd_ps(_mm_movedup_pd(_mm_castps_pd(a)));
+}
+#endif
+
+
+/// Helper: shuffle/swizzle with constant (templated) indices.
+/// Example: shuffle<1,1,2,2>(mask4(a,b,c,d)) returns (b,b,c,c)
+template<int i0, int i1, int i2, int i3>
+OIIO_FORCEINLINE mask4 shuffle (const mask4& a) {
+#if defined(OIIO_SIMD_SSE)
     return shuffle_sse<i0,i1,i2,i3> (a.simd());
 #else
-    return mask4(a[i0], a[i1], a[i2], a[i3]);
+    return mask4(a[i0], a[i1], a[i2], a[i3]);
+#endif
+}
+
+/// shuffle<i>(a) is the same as shuffle<i,i,i,i>(a)
+template<int i> OIIO_FORCEINLINE mask4 shuffle (const mask4& a) { return shuffle<i,i,i,i>(a); }
+
+
+/// Helper: as rapid as possible extraction of one component, when the
+/// index is fixed.
+template<int i>
+OIIO_FORCEINLINE bool extract (const mask4& a) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
+    return _mm_extract_epi32(_mm_castps_si128(a.simd()), i);  // SSE4.1 only
+#else
+    return a[i];
+#endif
+}
+
+/// Helper: substitute val for a[i]
+template<int i>
+OIIO_FORCEINLINE mask4 insert (const mask4& a, bool val) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
+    int ival = val ? -1 : 0;
+    return _mm_castsi128_ps (_mm_insert_epi32 (_mm_castps_si128(a), ival, i));
+#else
+    mask4 tmp = a;
+    tmp[i] = val ? -1 : 0;
+    return tmp;
+#endif
+}
+
+
+OIIO_FORCEINLINE bool reduce_and (const mask4& v) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_movemask_ps(v.simd()) == 0xf;
+#else
+    return v[0] & v[1] & v[2] & v[3];
+#endif
+}
+
+
+OIIO_FORCEINLINE bool reduce_or (const mask4& v) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_movemask_ps(v) != 0;
+#else
+    return v[0] | v[1] | v[2] | v[3];
+#endif
+}
+
+
+
+//////////////////////////////////////////////////////////////////////
+// int4 implementation
+
+
+OIIO_FORCEINLINE void int4::clear () {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_setzero_si128();
+#else
+    *this = 0.0f;
+#endif
+}
+
+OIIO_FORCEINLINE const int4 int4::Zero () {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_setzero_si128();
+#else
+    return int4(0);
+#endif
+}
+
+OIIO_FORCEINLINE const int4 int4::One () { return int4(1); }
+
+OIIO_FORCEINLINE const int4 int4::NegOne () {
+#if defined(OIIO_SIMD_SSE)
+    // Fastest way to fill an __m128 with all 1 bits is to cmpeq_epi8
+    // any value to itself.
+# if defined(OIIO_SIMD_AVX) && (OIIO_GNUC_VERSION > 50000)
+    __m128i anyval = _mm_undefined_si128();
+# else
+    __m128i anyval = _mm_castps_si128 (_mm_setzero_ps());
+# endif
+    return _mm_cmpeq_epi8 (anyval, anyval);
+#else
+    return int4(-1);
+#endif
+}
+
+OIIO_FORCEINLINE const int4 int4::Iota (int value) {
+    return int4(value,value+1,value+2,value+3);
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator= (int a) { load(a); return *this; }
+
+OIIO_FORCEINLINE const int4 & int4::operator= (int4 other) {
+    m_vec = other.m_vec;
+    return *this;
+}
+
+OIIO_FORCEINLINE int& int4::operator[] (int i) {
+    DASSERT(i<elements);
+    return m_val[i];
+}
+
+OIIO_FORCEINLINE int int4::operator[] (int i) const {
+    DASSERT(i<elements);
+    return m_val[i];
+}
+
+
+OIIO_FORCEINLINE void int4::load (int a) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_set1_epi32 (a);
+#else
+    SIMD_CONSTRUCT (a);
+#endif
+}
+
+OIIO_FORCEINLINE void int4::load (int a, int b, int c, int d) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_set_epi32 (d, c, b, a);
+#else
+    m_val[0] = a;
+    m_val[1] = b;
+    m_val[2] = c;
+    m_val[3] = d;
+#endif
+}
+
+OIIO_FORCEINLINE void int4::load (const int *values) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_loadu_si128 ((const simd_t *)values);
+#else
+    SIMD_CONSTRUCT (values[i]);
+#endif
+}
+
+OIIO_FORCEINLINE void int4::load (const int *values, int n)
+{
+#if defined(OIIO_SIMD_SSE)
+    switch (n) {
+    case 1:
+        m_vec = _mm_castps_si128 (_mm_load_ss ((const float *)values));
+        break;
+    case 2:
+            // Trickery: load one double worth of bits!
+        m_vec = _mm_castpd_si128 (_mm_load_sd ((const double*)values));
+        break;
+    case 3:
+        // Trickery: load one double worth of bits, then a float,
+        // and combine, casting to ints.
+        m_vec = _mm_castps_si128 (_mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double*)values)),
+                                                _mm_load_ss ((const float *)values + 2)));
+        break;
+    case 4:
+        m_vec = _mm_loadu_si128 ((const simd_t *)values);
+        break;
+    default:
+        break;
+    }
+#endif
+    for (int i = 0; i < n; ++i)
+        m_val[i] = values[i];
+    for (int i = n; i < elements; ++i)
+        m_val[i] = 0;
+}
+
+OIIO_FORCEINLINE void int4::load (const unsigned short *values) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
+    // Trickery: load one double worth of bits = 4 uint16's!
+    simd_t a = _mm_castpd_si128 (_mm_load_sd ((const double *)values));
+    m_vec = _mm_cvtepu16_epi32 (a);
+#else
+    SIMD_CONSTRUCT (values[i]);
+#endif
+}
+
+OIIO_FORCEINLINE void int4::load (const short *values) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
+    // Trickery: load one double worth of bits = 4 int16's!
+    simd_t a = _mm_castpd_si128 (_mm_load_sd ((const double *)values));
+    m_vec = _mm_cvtepi16_epi32 (a);
+#else
+    SIMD_CONSTRUCT (values[i]);
+#endif
+}
+
+OIIO_FORCEINLINE void int4::load (const unsigned char *values) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
+    // Trickery: load one float worth of bits = 4 uint8's!
+    simd_t a = _mm_castps_si128 (_mm_load_ss ((const float *)values));
+    m_vec = _mm_cvtepu8_epi32 (a);
+#else
+    SIMD_CONSTRUCT (values[i]);
+#endif
+}
+
+OIIO_FORCEINLINE void int4::load (const char *values) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
+    // Trickery: load one float worth of bits = 4 uint8's!
+    simd_t a = _mm_castps_si128 (_mm_load_ss ((const float *)values));
+    m_vec = _mm_cvtepi8_epi32 (a);
+#else
+    SIMD_CONSTRUCT (values[i]);
+#endif
+}
+
+OIIO_FORCEINLINE void int4::store (int *values) const {
+#if defined(OIIO_SIMD_SSE)
+    // Use an unaligned store -- it's just as fast when the memory turns
+    // out to be aligned, nearly as fast even when unaligned. Not worth
+    // the headache of using stores that require alignment.
+    _mm_storeu_si128 ((simd_t *)values, m_vec);
+#else
+    SIMD_DO (values[i] = m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE void int4::store (int *values, int n) const {
+    DASSERT (n >= 0 && n <= elements);
+#if defined(OIIO_SIMD)
+    // For full SIMD, there is a speed advantage to storing all components.
+    if (n == elements)
+        store (values);
+    else
+#endif
+        for (int i = 0; i < n; ++i)
+            values[i] = m_val[i];
+}
+
+OIIO_FORCEINLINE void int4::store (unsigned short *values) const {
+#if defined(OIIO_SIMD_SSE)
+    // Expressed as half-words and considering little endianness, we
+    // currently have xAxBxCxD (the 'x' means don't care).
+    int4 clamped = m_val & int4(0xffff);   // A0B0C0D0
+    int4 low = _mm_shufflelo_epi16 (clamped, (0<<0) | (2<<2) | (1<<4) | (1<<6));
+                    // low = AB00xxxx
+    int4 high = _mm_shufflehi_epi16 (clamped, (1<<0) | (1<<2) | (0<<4) | (2<<6));
+                    // high = xxxx00CD
+    int4 highswapped = shuffle_sse<2,3,0,1>(high);  // 00CDxxxx
+    int4 result = low | highswapped;   // ABCDxxxx
+    _mm_storel_pd ((double *)values, _mm_castsi128_pd(result));
+    // At this point, values[] should hold A,B,C,D
+#else
+    SIMD_DO (values[i] = m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE void int4::store (unsigned char *values) const {
+#if defined(OIIO_SIMD_SSE)
+    // Expressed as bytes and considering little endianness, we
+    // currently have xAxBxCxD (the 'x' means don't care).
+    int4 clamped = m_val & int4(0xff);            // A000 B000 C000 D000
+    int4 swapped = shuffle_sse<1,0,3,2>(clamped); // B000 A000 D000 C000
+    int4 shifted = swapped << 8;                  // 0B00 0A00 0D00 0C00
+    int4 merged = clamped | shifted;              // AB00 xxxx CD00 xxxx
+    int4 merged2 = shuffle_sse<2,2,2,2>(merged);  // CD00 ...
+    int4 shifted2 = merged2 << 16;                // 00CD ...
+    int4 result = merged | shifted2;              // ABCD ...
+    *(int*)values = result[0]; //extract<0>(result);
+    // At this point, values[] should hold A,B,C,D
+#else
+    SIMD_DO (values[i] = m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE int4 operator+ (const int4& a, const int4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_add_epi32 (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (int4, a[i] + b[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator+= (const int4& a) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_add_epi32 (m_vec, a.m_vec);
+#else
+    SIMD_DO (m_val[i] += a[i]);
+#endif
+    return *this;
+}
+
+OIIO_FORCEINLINE int4 int4::operator- () const {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_sub_epi32 (_mm_setzero_si128(), m_vec);
+#else
+    SIMD_RETURN (int4, -m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE int4 operator- (const int4& a, const int4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_sub_epi32 (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (int4, a[i] - b[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator-= (const int4& a) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_sub_epi32 (m_vec, a.m_vec);
+#else
+    SIMD_DO (m_val[i] -= a[i]);
+#endif
+        return *this;
+}
+
+
+#if defined(OIIO_SIMD_SSE)
+// Shamelessly lifted from Syrah which lifted from Manta which lifted it
+// from intel.com
+OIIO_FORCEINLINE __m128i mm_mul_epi32 (__m128i a, __m128i b) {
+#if OIIO_SIMD_SSE >= 4  /* SSE >= 4.1 */
+    return _mm_mullo_epi32(a, b);
+#else
+    // Prior to SSE 4.1, there is no _mm_mullo_epi32 instruction, so we have
+    // to fake it.
+    __m128i t0;
+    __m128i t1;
+    t0 = _mm_mul_epu32 (a, b);
+    t1 = _mm_mul_epu32 (_mm_shuffle_epi32 (a, 0xB1),
+                        _mm_shuffle_epi32 (b, 0xB1));
+    t0 = _mm_shuffle_epi32 (t0, 0xD8);
+    t1 = _mm_shuffle_epi32 (t1, 0xD8);
+    return _mm_unpacklo_epi32 (t0, t1);
+#endif
+}
+#endif
+
+
+OIIO_FORCEINLINE int4 operator* (const int4& a, const int4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return mm_mul_epi32 (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (int4, a[i] * b[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator*= (const int4& a) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = mm_mul_epi32 (m_vec, a.m_vec);
+#else
+    SIMD_DO (m_val[i] *= a[i]);
+#endif
+    return *this;
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator*= (int val) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = mm_mul_epi32 (m_vec, _mm_set1_epi32(val));
+#else
+    SIMD_DO (m_val[i] *= val);
+#endif
+    return *this;
+}
+
+OIIO_FORCEINLINE int4 operator/ (const int4& a, const int4& b) {
+    // NO INTEGER DIVISION IN SSE!
+    SIMD_RETURN (int4, a[i] / b[i]);
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator/= (const int4& a) {
+    // NO INTEGER DIVISION IN SSE!
+    SIMD_DO (m_val[i] /= a[i]);
+    return *this;
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator/= (int val) {
+    // NO INTEGER DIVISION IN SSE!
+    SIMD_DO (m_val[i] /= val);
+    return *this;
+}
+
+OIIO_FORCEINLINE int4 operator% (const int4& a, const int4& b) {
+    // NO INTEGER MODULUS in SSE!
+    SIMD_RETURN (int4, a[i] % b[i]);
+    }
+
+OIIO_FORCEINLINE const int4 & int4::operator%= (const int4& a) {
+    // NO INTEGER MODULUS in SSE!
+    SIMD_DO (m_val[i] %= a[i]);
+    return *this;
+}
+
+OIIO_FORCEINLINE int4 operator% (const int4& a, int w) {
+    // NO INTEGER MODULUS in SSE!
+    SIMD_RETURN (int4, a[i] % w);
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator%= (int a) {
+    // NO INTEGER MODULUS IN SSE!
+    SIMD_DO (m_val[i] %= a);
+    return *this;
+}
+
+OIIO_FORCEINLINE int4 operator% (int a, const int4& b) {
+    // NO INTEGER MODULUS in SSE!
+    SIMD_RETURN (int4, a % b[i]);
+}
+
+
+OIIO_FORCEINLINE int4 operator& (const int4& a, const int4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_and_si128 (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (int4, a[i] & b[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator&= (const int4& a) {
+    return *this = *this & a;
+}
+
+
+OIIO_FORCEINLINE int4 operator| (const int4& a, const int4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_or_si128 (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (int4, a[i] | b[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator|= (const int4& a) {
+    return *this = *this | a;
+}
+
+OIIO_FORCEINLINE int4 operator^ (const int4& a, const int4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_xor_si128 (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (int4, a[i] ^ b[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator^= (const int4& a) {
+    return *this = *this ^ a;
+}
+
+OIIO_FORCEINLINE int4 int4::operator~ () {
+#if defined(OIIO_SIMD_SSE)
+    // Fastest way to bit-complement in SSE is to xor with 0xffffffff.
+    // Fastest way to fill an __m128 with all 1 bits is to cmpeq_epi8
+    // any value to itself.
+# if defined(OIIO_SIMD_AVX) && (OIIO_GNUC_VERSION > 50000)
+    __m128i anyval = _mm_undefined_si128(); // AVX only, sigh
+    __m128i all_one_bits = _mm_cmpeq_epi8 (anyval, anyval);
+# else
+    __m128i all_one_bits = _mm_cmpeq_epi8 (m_vec, m_vec);
+# endif
+    return _mm_xor_si128 (m_vec, all_one_bits);
+#else
+    SIMD_RETURN (int4, ~m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE int4 int4::operator<< (const unsigned int bits) const {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_slli_epi32 (m_vec, bits);
+#else
+    SIMD_RETURN (int4, m_val[i] << bits);
+#endif
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator<<= (const unsigned int bits) {
+    return *this = *this << bits;
+}
+
+OIIO_FORCEINLINE int4 int4::operator>> (const unsigned int bits) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_srai_epi32 (m_vec, bits);
+#else
+    SIMD_RETURN (int4, m_val[i] >> bits);
+#endif
+}
+
+OIIO_FORCEINLINE const int4 & int4::operator>>= (const unsigned int bits) {
+    return *this = *this >> bits;
+}
+
+OIIO_FORCEINLINE int4 srl (const int4& val, const unsigned int bits) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_srli_epi32 (val.m_vec, bits);
+#else
+    SIMD_RETURN (int4, int ((unsigned int)(val[i]) >> bits));
+#endif
+}
+
+
+OIIO_FORCEINLINE mask4 operator== (const int4& a, const int4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_castsi128_ps(_mm_cmpeq_epi32 (a.m_vec, b.m_vec));
+#else
+    SIMD_RETURN (mask4, a[i] == b[i] ? -1 : 0);
+#endif
+}
+
+OIIO_FORCEINLINE mask4 operator!= (const int4& a, const int4& b) {
+        return ! (a == b);
+}
+
+OIIO_FORCEINLINE mask4 operator< (const int4& a, const int4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_castsi128_ps(_mm_cmplt_epi32 (a.m_vec, b.m_vec));
+#else
+    SIMD_RETURN (mask4, a[i] < b[i] ? -1 : 0);
+#endif
+}
+
+OIIO_FORCEINLINE mask4 operator>  (const int4& a, const int4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_castsi128_ps(_mm_cmpgt_epi32 (a.m_vec, b.m_vec));
+#else
+    SIMD_RETURN (mask4, a[i] > b[i] ? -1 : 0);
+#endif
+}
+
+OIIO_FORCEINLINE mask4 operator>= (const int4& a, const int4& b) {
+    return !(a < b);
+}
+
+OIIO_FORCEINLINE mask4 operator<= (const int4& a, const int4& b) {
+    return !(a > b);
+}
+
+inline std::ostream& operator<< (std::ostream& cout, const int4& val) {
+    cout << val[0];
+    for (int i = 1; i < val.elements; ++i)
+        cout << ' ' << val[i];
+    return cout;
+}
+
+
+
+template<int i0, int i1, int i2, int i3>
+OIIO_FORCEINLINE int4 shuffle (const int4& a) {
+#if defined(OIIO_SIMD_SSE)
+    return shuffle_sse<i0,i1,i2,i3> (__m128i(a));
+#else
+    return int4(a[i0], a[i1], a[i2], a[i3]);
+#endif
+}
+
+template<int i> OIIO_FORCEINLINE int4 shuffle (const int4& a) { return shuffle<i,i,i,i>(a); }
+
+
+template<int i>
+OIIO_FORCEINLINE int extract (const int4& v) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
+    return _mm_extract_epi32(v.simd(), i);  // SSE4.1 only
+#else
+    return v[i];
+#endif
+}
+
+
+template<int i>
+OIIO_FORCEINLINE int4 insert (const int4& a, int val) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
+    return _mm_insert_epi32 (a, val, i);
+#else
+    int4 tmp = a;
+    tmp[i] = val;
+    return tmp;
+#endif
+}
+
+
+
+OIIO_FORCEINLINE int int4::x () const { return extract<0>(*this); }
+OIIO_FORCEINLINE int int4::y () const { return extract<1>(*this); }
+OIIO_FORCEINLINE int int4::z () const { return extract<2>(*this); }
+OIIO_FORCEINLINE int int4::w () const { return extract<3>(*this); }
+OIIO_FORCEINLINE void int4::set_x (int val) { *this = insert<0>(*this, val); }
+OIIO_FORCEINLINE void int4::set_y (int val) { *this = insert<1>(*this, val); }
+OIIO_FORCEINLINE void int4::set_z (int val) { *this = insert<2>(*this, val); }
+OIIO_FORCEINLINE void int4::set_w (int val) { *this = insert<3>(*this, val); }
+
+
+OIIO_FORCEINLINE int4 bitcast_to_int4 (const mask4& x)
+{
+#if defined(OIIO_SIMD_SSE)
+    return _mm_castps_si128 (x.simd());
+#else
+    return *(int4 *)&x;
+#endif
+}
+
+
+OIIO_FORCEINLINE int4 vreduce_add (const int4& v) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 3
+    // People seem to agree that SSE3 does add reduction best with 2
+    // horizontal adds.
+    // suppose v = (a, b, c, d)
+    simd::int4 ab_cd = _mm_hadd_epi32 (v.simd(), v.simd());
+    // ab_cd = (a+b, c+d, a+b, c+d)
+    simd::int4 abcd = _mm_hadd_epi32 (ab_cd.simd(), ab_cd.simd());
+    // all abcd elements are a+b+c+d, return an element as fast as possible
+    return abcd;
+#elif defined(OIIO_SIMD_SSE)
+    // I think this is the best we can do for SSE2, and I'm still not sure
+    // it's faster than the default scalar operation. But anyway...
+    // suppose v = (a, b, c, d)
+    int4 ab_ab_cd_cd = shuffle<1,0,3,2>(v) + v;
+    // ab_ab_cd_cd = (b,a,d,c) + (a,b,c,d) = (a+b,a+b,c+d,c+d)
+    int4 cd_cd_ab_ab = shuffle<2,3,0,1>(ab_ab_cd_cd);
+    // cd_cd_ab_ab = (c+d,c+d,a+b,a+b)
+    int4 abcd = ab_ab_cd_cd + cd_cd_ab_ab;   // a+b+c+d in all components
+    return abcd;
+#else
+    return int4(v[0] + v[1] + v[2] + v[3]);
+#endif
+}
+
+
+OIIO_FORCEINLINE int reduce_add (const int4& v) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_cvtsi128_si32(vreduce_add(v));
+#else
+    return v[0] + v[1] + v[2] + v[3];
+#endif
+}
+
+
+OIIO_FORCEINLINE int reduce_and (const int4& v) {
+#if defined(OIIO_SIMD_SSE)
+    // I think this is the best we can do for SSE, and I'm still not sure
+    // it's faster than the default scalar operation. But anyway...
+    // suppose v = (a, b, c, d)
+    int4 x = shuffle<1,0,3,2>(v) & v;
+    return extract<0>(x) & extract<2>(x);
+#else
+    return v[0] & v[1] & v[2] & v[3];
+#endif
+}
+
+
+OIIO_FORCEINLINE int reduce_or (const int4& v) {
+#if defined(OIIO_SIMD_SSE)
+    // I think this is the best we can do for SSE, and I'm still not sure
+    // it's faster than the default scalar operation. But anyway...
+    // suppose v = (a, b, c, d)
+    int4 x = shuffle<1,0,3,2>(v) | v;
+    return extract<0>(x) | extract<2>(x);
+#else
+    return v[0] | v[1] | v[2] | v[3];
+#endif
+}
+
+OIIO_FORCEINLINE int4 blend (const int4& a, const int4& b, const mask4& mask)
+{
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4 /* SSE >= 4.1 */
+    return _mm_blendv_epi8 (a.simd(), b.simd(), _mm_castps_si128(mask));
+#elif defined(OIIO_SIMD_SSE) /* SSE2 */
+    return _mm_or_si128 (_mm_and_si128(_mm_castps_si128(mask.simd()), b.simd()),
+                         _mm_andnot_si128(_mm_castps_si128(mask.simd()), a.simd()));
+#else
+    SIMD_RETURN (int4, mask[i] ? b[i] : a[i]);
+#endif
+}
+
+
+
+OIIO_FORCEINLINE int4 blend0 (const int4& a, const mask4& mask)
+{
+#if defined(OIIO_SIMD_SSE)
+    return _mm_and_si128(_mm_castps_si128(mask), a.simd());
+#else
+    SIMD_RETURN (int4, mask[i] ? a[i] : 0.0f);
+#endif
+}
+
+
+
+OIIO_FORCEINLINE int4 blend0not (const int4& a, const mask4& mask)
+{
+#if defined(OIIO_SIMD_SSE)
+    return _mm_andnot_si128(_mm_castps_si128(mask), a.simd());
+#else
+    SIMD_RETURN (int4, mask[i] ? 0.0f : a[i]);
+#endif
+}
+
+
+OIIO_FORCEINLINE int4 select (const mask4& mask, const int4& a, const int4& b)
+{
+    return blend (b, a, mask);
+}
+
+
+
+OIIO_FORCEINLINE int4 abs (const int4& a)
+{
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 3
+    return _mm_abs_epi32(a.simd());
+#else
+    return int4 (std::abs(a[0]), std::abs(a[1]), std::abs(a[2]), std::abs(a[3]));
+#endif
+}
+
+OIIO_FORCEINLINE int4 min (const int4& a, const int4& b)
+{
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4 /* SSE >= 4.1 */
+    return _mm_min_epi32 (a, b);
+#else
+    SIMD_RETURN (int4, std::min (a[i], b[i]));
+#endif
+}
+
+OIIO_FORCEINLINE int4 max (const int4& a, const int4& b)
+{
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4 /* SSE >= 4.1 */
+    return _mm_max_epi32 (a, b);
+#else
+    SIMD_RETURN (int4, std::max (a[i], b[i]));
+#endif
+}
+
+
+OIIO_FORCEINLINE int4 rotl32 (const int4& x, const unsigned int k)
+{
+    return (x<<k) | srl(x,32-k);
+}
+
+
+
+OIIO_FORCEINLINE int4 andnot (const int4& a, const int4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_andnot_si128 (a.simd(), b.simd());
+#else
+    SIMD_RETURN (int4, ~(a[i]) & b[i]);
+#endif
+}
+
+
+// Implementation had to be after the definition of int4.
+OIIO_FORCEINLINE mask4::mask4 (const int4& ival)
+{
+#if defined(OIIO_SIMD_SSE)
+    m_vec = (ival != int4::Zero());
+#else
+    SIMD_CONSTRUCT (ival[i] ? -1 : 0);
+#endif
+}
+
+
+
+
+//////////////////////////////////////////////////////////////////////
+// float4 implementation
+
+
+OIIO_FORCEINLINE float4::float4 (const int4& ival) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_cvtepi32_ps (ival.simd());
+#else
+    SIMD_CONSTRUCT (float(ival[i]));
+#endif
+}
+
+
+OIIO_FORCEINLINE const float4 float4::Zero () {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_setzero_ps();
+#else
+    return float4(0.0f);
+#endif
+}
+
+OIIO_FORCEINLINE const float4 float4::One () {
+    return float4(1.0f);
+}
+
+OIIO_FORCEINLINE const float4 float4::Iota (float value) {
+    return float4(value,value+1.0f,value+2.0f,value+3.0f);
+}
+
+    /// Set all components to 0.0
+OIIO_FORCEINLINE void float4::clear () {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_setzero_ps();
+#else
+    load (0.0f);
+#endif
+}
+
+#if defined(ILMBASE_VERSION_MAJOR) && ILMBASE_VERSION_MAJOR >= 2
+OIIO_FORCEINLINE const float4 & float4::operator= (const Imath::V4f &v) {
+    load ((const float *)&v);
+    return *this;
+}
+#endif
+
+OIIO_FORCEINLINE const float4 & float4::operator= (const Imath::V3f &v) {
+    load (v[0], v[1], v[2], 0.0f);
+    return *this;
+}
+
+OIIO_FORCEINLINE float& float4::operator[] (int i) {
+    DASSERT(i<elements);
+    return m_val[i];
+}
+
+OIIO_FORCEINLINE float float4::operator[] (int i) const {
+    DASSERT(i<elements);
+    return m_val[i];
+}
+
+
+OIIO_FORCEINLINE void float4::load (float val) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_set1_ps (val);
+#elif defined(OIIO_SIMD_NEON)
+    m_vec = vdupq_n_f32 (val);
+#else
+    SIMD_CONSTRUCT (val);
+#endif
+}
+
+OIIO_FORCEINLINE void float4::load (float a, float b, float c, float d) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_set_ps (d, c, b, a);
+#elif defined(OIIO_SIMD_NEON)
+    float values[4] = { a, b, c, d };
+    m_vec = vld1q_f32 (values);
+#else
+    m_val[0] = a;
+    m_val[1] = b;
+    m_val[2] = c;
+    m_val[3] = d;
+#endif
+}
+
+    /// Load from an array of 4 values
+OIIO_FORCEINLINE void float4::load (const float *values) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_loadu_ps (values);
+#elif defined(OIIO_SIMD_NEON)
+    m_vec = vld1q_f32 (values);
+#else
+    SIMD_CONSTRUCT (values[i]);
+#endif
+}
+
+    /// Load from a partial array of <=4 values. Unassigned values are
+    /// undefined.
+OIIO_FORCEINLINE void float4::load (const float *values, int n) {
+#if defined(OIIO_SIMD_SSE)
+    switch (n) {
+    case 1:
+        m_vec = _mm_load_ss (values);
+        break;
+    case 2:
+        // Trickery: load one double worth of bits!
+        m_vec = _mm_castpd_ps (_mm_load_sd ((const double*)values));
+        break;
+    case 3:
+        m_vec = _mm_setr_ps (values[0], values[1], values[2], 0.0f);
+        // This looks wasteful, but benchmarks show that it's the
+        // fastest way to set 3 values with the 4th getting zero.
+        // Actually, gcc and clang both turn it into something more
+        // efficient than _mm_setr_ps. The version below looks smart,
+        // but was much more expensive as the _mm_setr_ps!
+        //   __m128 xy = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)values));
+        //   m_vec = _mm_movelh_ps(xy, _mm_load_ss (values + 2));
+        break;
+    case 4:
+        m_vec = _mm_loadu_ps (values);
+        break;
+    default:
+        break;
+    }
+#elif defined(OIIO_SIMD_NEON)
+    switch (n) {
+    case 1: m_vec = vdupq_n_f32 (val);                    break;
+    case 2: load (values[0], values[1], 0.0f, 0.0f);      break;
+    case 3: load (values[0], values[1], values[2], 0.0f); break;
+    case 4: m_vec = vld1q_f32 (values);                   break;
+    default: break;
+    }
+#else
+    for (int i = 0; i < n; ++i)
+        m_val[i] = values[i];
+    for (int i = n; i < paddedelements; ++i)
+        m_val[i] = 0;
+#endif
+}
+
+    /// Load from an array of 4 unsigned short values, convert to float
+OIIO_FORCEINLINE void float4::load (const unsigned short *values) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 2
+    m_vec = _mm_cvtepi32_ps (int4(values).simd());
+    // You might guess that the following is faster, but it's NOT:
+    //   NO!  m_vec = _mm_cvtpu16_ps (*(__m64*)values);
+#else
+    SIMD_CONSTRUCT (values[i]);
+#endif
+}
+
+    /// Load from an array of 4 short values, convert to float
+OIIO_FORCEINLINE void float4::load (const short *values) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 2
+    m_vec = _mm_cvtepi32_ps (int4(values).simd());
+#else
+    SIMD_CONSTRUCT (values[i]);
+#endif
+}
+
+    /// Load from an array of 4 unsigned char values, convert to float
+OIIO_FORCEINLINE void float4::load (const unsigned char *values) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 2
+    m_vec = _mm_cvtepi32_ps (int4(values).simd());
+#else
+    SIMD_CONSTRUCT (values[i]);
+#endif
+}
+
+    /// Load from an array of 4 char values, convert to float
+OIIO_FORCEINLINE void float4::load (const char *values) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 2
+    m_vec = _mm_cvtepi32_ps (int4(values).simd());
+#else
+    SIMD_CONSTRUCT (values[i]);
+#endif
+}
+
+#ifdef _HALF_H_
+OIIO_FORCEINLINE void float4::load (const half *values) {
+#if defined(__F16C__) && defined(OIIO_SIMD_SSE)
+    /* Enabled 16 bit float instructions! */
+    __m128i a = _mm_castpd_si128 (_mm_load_sd ((const double *)values));
+    m_vec = _mm_cvtph_ps (a);
+#elif defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 2
+    // SSE half-to-float by Fabian "ryg" Giesen. Public domain.
+    // https://gist.github.com/rygorous/2144712
+    int4 h ((const unsigned short *)values);
+# define CONSTI(name) *(const __m128i *)&name
+# define CONSTF(name) *(const __m128 *)&name
+    OIIO_SIMD_UINT4_CONST(mask_nosign, 0x7fff);
+    OIIO_SIMD_UINT4_CONST(magic,       (254 - 15) << 23);
+    OIIO_SIMD_UINT4_CONST(was_infnan,  0x7bff);
+    OIIO_SIMD_UINT4_CONST(exp_infnan,  255 << 23);
+    __m128i mnosign     = CONSTI(mask_nosign);
+    __m128i expmant     = _mm_and_si128(mnosign, h);
+    __m128i justsign    = _mm_xor_si128(h, expmant);
+    __m128i expmant2    = expmant; // copy (just here for counting purposes)
+    __m128i shifted     = _mm_slli_epi32(expmant, 13);
+    __m128  scaled      = _mm_mul_ps(_mm_castsi128_ps(shifted), *(const __m128 *)&magic);
+    __m128i b_wasinfnan = _mm_cmpgt_epi32(expmant2, CONSTI(was_infnan));
+    __m128i sign        = _mm_slli_epi32(justsign, 16);
+    __m128  infnanexp   = _mm_and_ps(_mm_castsi128_ps(b_wasinfnan), CONSTF(exp_infnan));
+    __m128  sign_inf    = _mm_or_ps(_mm_castsi128_ps(sign), infnanexp);
+    __m128  final       = _mm_or_ps(scaled, sign_inf);
+    // ~11 SSE2 ops.
+    m_vec = final;
+# undef CONSTI
+# undef CONSTF
+#else /* No SIMD defined: */
+    SIMD_CONSTRUCT (values[i]);
+#endif
+}
+#endif /* _HALF_H_ */
+
+OIIO_FORCEINLINE void float4::store (float *values) const {
+#if defined(OIIO_SIMD_SSE)
+    // Use an unaligned store -- it's just as fast when the memory turns
+    // out to be aligned, nearly as fast even when unaligned. Not worth
+    // the headache of using stores that require alignment.
+    _mm_storeu_ps (values, m_vec);
+#elif defined(OIIO_SIMD_NEON)
+    vst1q_f32 (values, m_vec);
+#else
+    SIMD_DO (values[i] = m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE void float4::store (float *values, int n) const {
+    DASSERT (n >= 0 && n <= 4);
+#if defined(OIIO_SIMD_SSE)
+    switch (n) {
+        case 1:
+        _mm_store_ss (values, m_vec);
+        break;
+    case 2:
+        // Trickery: store two floats as a double worth of bits
+        _mm_store_sd ((double*)values, _mm_castps_pd(m_vec));
+        break;
+    case 3:
+        values[0] = m_val[0];
+        values[1] = m_val[1];
+        values[2] = m_val[2];
+        // This looks wasteful, but benchmarks show that it's the
+        // fastest way to store 3 values, in benchmarks was faster than
+        // this, below:
+        //   _mm_store_sd ((double*)values, _mm_castps_pd(m_vec));
+        //   _mm_store_ss (values + 2, _mm_movehl_ps(m_vec,m_vec));
+        break;
+    case 4:
+        store (values);
+        break;
+    default:
+        break;
+    }
+#elif defined(OIIO_SIMD_NEON)
+    switch (n) {
+    case 1:
+        vst1q_lane_f32 (values, m_vec, 0);
+        break;
+    case 2:
+        vst1q_lane_f32 (values++, m_vec, 0);
+        vst1q_lane_f32 (values, m_vec, 1);
+        break;
+    case 3:
+        vst1q_lane_f32 (values++, m_vec, 0);
+        vst1q_lane_f32 (values++, m_vec, 1);
+        vst1q_lane_f32 (values, m_vec, 2);
+        break;
+    case 4:
+        vst1q_f32 (values, m_vec); break;
+    default:
+        break;
+    }
+#else
+    for (int i = 0; i < n; ++i)
+        values[i] = m_val[i];
+#endif
+}
+
+#ifdef _HALF_H_
+OIIO_FORCEINLINE void float4::store (half *values) const {
+#if defined(__F16C__) && defined(OIIO_SIMD_SSE)
+    __m128i h = _mm_cvtps_ph (m_vec, (_MM_FROUND_TO_NEAREST_INT |_MM_FROUND_NO_EXC));
+    _mm_store_sd ((double *)values, _mm_castsi128_pd(h));
+    #else
+    SIMD_DO (values[i] = m_val[i]);
+#endif
+}
+#endif
+
+OIIO_FORCEINLINE float4 operator+ (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_add_ps (a.m_vec, b.m_vec);
+#elif defined(OIIO_SIMD_NEON)
+    return vaddq_f32 (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (float4, a[i] + b[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const float4 & float4::operator+= (const float4& a) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_add_ps (m_vec, a.m_vec);
+#elif defined(OIIO_SIMD_NEON)
+    m_vec = vaddq_f32 (m_vec, a.m_vec);
+#else
+    SIMD_DO (m_val[i] += a[i]);
+#endif
+    return *this;
+    }
+
+OIIO_FORCEINLINE float4 float4::operator- () const {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_sub_ps (_mm_setzero_ps(), m_vec);
+#elif defined(OIIO_SIMD_NEON)
+    return vsubq_f32 (Zero(), m_vec);
+#else
+    SIMD_RETURN (float4, -m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE float4 operator- (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_sub_ps (a.m_vec, b.m_vec);
+#elif defined(OIIO_SIMD_NEON)
+    return vsubq_f32 (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (float4, a[i] - b[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const float4 & float4::operator-= (const float4& a) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_sub_ps (m_vec, a.m_vec);
+#elif defined(OIIO_SIMD_NEON)
+    m_vec = vsubq_f32 (m_vec, a.m_vec);
+#else
+    SIMD_DO (m_val[i] -= a[i]);
+#endif
+    return *this;
+}
+
+OIIO_FORCEINLINE float4 operator* (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_mul_ps (a.m_vec, b.m_vec);
+#elif defined(OIIO_SIMD_NEON)
+    return vmulq_f32 (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (float4, a[i] * b[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const float4 & float4::operator*= (const float4& a) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_mul_ps (m_vec, a.m_vec);
+#elif defined(OIIO_SIMD_NEON)
+    m_vec = vmulq_f32 (m_vec, a.m_vec);
+#else
+    SIMD_DO (m_val[i] *= a[i]);
+#endif
+    return *this;
+}
+
+OIIO_FORCEINLINE const float4 & float4::operator*= (float val) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_mul_ps (m_vec, _mm_set1_ps(val));
+#elif defined(OIIO_SIMD_NEON)
+    m_vec = vmulq_f32 (m_vec, vdupq_n_f32(val));
+#else
+    SIMD_DO (m_val[i] *= val);
+#endif
+    return *this;
+}
+
+OIIO_FORCEINLINE float4 operator/ (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_div_ps (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (float4, a[i] / b[i]);
+#endif
+}
+
+OIIO_FORCEINLINE const float4 & float4::operator/= (const float4& a) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_div_ps (m_vec, a.m_vec);
+#else
+    SIMD_DO (m_val[i] /= a[i]);
+#endif
+    return *this;
+}
+
+OIIO_FORCEINLINE const float4 & float4::operator/= (float val) {
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_div_ps (m_vec, _mm_set1_ps(val));
+#else
+    SIMD_DO (m_val[i] /= val);
+#endif
+    return *this;
+}
+
+OIIO_FORCEINLINE mask4 operator== (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_cmpeq_ps (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (mask4, a[i] == b[i] ? -1 : 0);
+#endif
+}
+
+OIIO_FORCEINLINE mask4 operator!= (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_cmpneq_ps (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (mask4, a[i] != b[i] ? -1 : 0);
+#endif
+}
+
+OIIO_FORCEINLINE mask4 operator< (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_cmplt_ps (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (mask4, a[i] < b[i] ? -1 : 0);
+#endif
+}
+
+OIIO_FORCEINLINE mask4 operator>  (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_cmpgt_ps (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (mask4, a[i] > b[i] ? -1 : 0);
+#endif
+}
+
+OIIO_FORCEINLINE mask4 operator>= (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_cmpge_ps (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (mask4, a[i] >= b[i] ? -1 : 0);
+#endif
+}
+
+OIIO_FORCEINLINE mask4 operator<= (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_cmple_ps (a.m_vec, b.m_vec);
+#else
+    SIMD_RETURN (mask4, a[i] <= b[i] ? -1 : 0);
+#endif
+}
+
+OIIO_FORCEINLINE float4 AxyBxy (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_movelh_ps (a.m_vec, b.m_vec);
+#else
+    return float4 (a[0], a[1], b[0], b[1]);
+#endif
+}
+
+OIIO_FORCEINLINE float4 AxBxAyBy (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_unpacklo_ps (a.m_vec, b.m_vec);
+#else
+    return float4 (a[0], b[0], a[1], b[1]);
+#endif
+}
+
+OIIO_FORCEINLINE float4 float4::xyz0 () const {
+    return insert<3>(*this, 0.0f);
+}
+
+OIIO_FORCEINLINE float4 float4::xyz1 () const {
+    return insert<3>(*this, 1.0f);
+}
+
+inline std::ostream& operator<< (std::ostream& cout, const float4& val) {
+    cout << val[0];
+    for (int i = 1; i < val.elements; ++i)
+        cout << ' ' << val[i];
+    return cout;
+}
+
+
+// Implementation had to be after the definition of float4.
+OIIO_FORCEINLINE int4::int4 (const float4& f)
+{
+#if defined(OIIO_SIMD_SSE)
+    m_vec = _mm_cvttps_epi32(f.simd());
+#else
+    SIMD_CONSTRUCT ((int) f[i]);
+#endif
+}
+
+
+
+template<int i0, int i1, int i2, int i3>
+OIIO_FORCEINLINE float4 shuffle (const float4& a) {
+#if defined(OIIO_SIMD_SSE)
+    return shuffle_sse<i0,i1,i2,i3> (__m128(a));
+#else
+    return float4(a[i0], a[i1], a[i2], a[i3]);
+#endif
+}
+
+template<int i> OIIO_FORCEINLINE float4 shuffle (const float4& a) { return shuffle<i,i,i,i>(a); }
+
+#if defined(OIIO_SIMD_NEON)
+template<> OIIO_FORCEINLINE float4 shuffle<0> (const float4& a) {
+    float32x2_t t = vget_low_f32(a.m_vec); return vdupq_lane_f32(t,0);
+}
+template<> OIIO_FORCEINLINE float4 shuffle<1> (const float4& a) {
+    float32x2_t t = vget_low_f32(a.m_vec); return vdupq_lane_f32(t,1);
+}
+template<> OIIO_FORCEINLINE float4 shuffle<2> (const float4& a) {
+    float32x2_t t = vget_high_f32(a.m_vec); return vdupq_lane_f32(t,0);
+}
+template<> OIIO_FORCEINLINE float4 shuffle<3> (const float4& a) {
+    float32x2_t t = vget_high_f32(a.m_vec); return vdupq_lane_f32(t,1);
+}
+#endif
+
+
+
+/// Helper: as rapid as possible extraction of one component, when the
+/// index is fixed.
+template<int i>
+OIIO_FORCEINLINE float extract (const float4& a) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_cvtss_f32(shuffle_sse<i,i,i,i>(a.simd()));
+#else
+    return a[i];
+#endif
+}
+
+#if defined(OIIO_SIMD_SSE)
+template<> OIIO_FORCEINLINE float extract<0> (const float4& a) {
+    return _mm_cvtss_f32(a.simd());
+}
+#endif
+
+
+/// Helper: substitute val for a[i]
+template<int i>
+OIIO_FORCEINLINE float4 insert (const float4& a, float val) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
+    return _mm_insert_ps (a, _mm_set_ss(val), i<<4);
+#else
+    float4 tmp = a;
+    tmp[i] = val;
+    return tmp;
+#endif
+}
+
+#if defined(OIIO_SIMD_SSE)
+// Slightly faster special cases for SSE
+template<> OIIO_FORCEINLINE float4 insert<0> (const float4& a, float val) {
+    return _mm_move_ss (a.simd(), _mm_set_ss(val));
+}
+#endif
+
+
+OIIO_FORCEINLINE float float4::x () const { return extract<0>(*this); }
+OIIO_FORCEINLINE float float4::y () const { return extract<1>(*this); }
+OIIO_FORCEINLINE float float4::z () const { return extract<2>(*this); }
+OIIO_FORCEINLINE float float4::w () const { return extract<3>(*this); }
+OIIO_FORCEINLINE void float4::set_x (float val) { *this = insert<0>(*this, val); }
+OIIO_FORCEINLINE void float4::set_y (float val) { *this = insert<1>(*this, val); }
+OIIO_FORCEINLINE void float4::set_z (float val) { *this = insert<2>(*this, val); }
+OIIO_FORCEINLINE void float4::set_w (float val) { *this = insert<3>(*this, val); }
+
+
+OIIO_FORCEINLINE int4 bitcast_to_int4 (const float4& x)
+{
+#if defined(OIIO_SIMD_SSE)
+    return _mm_castps_si128 (x.simd());
+#else
+    return *(int4 *)&x;
+#endif
+}
+
+OIIO_FORCEINLINE float4 bitcast_to_float4 (const int4& x)
+{
+#if defined(OIIO_SIMD_SSE)
+    return _mm_castsi128_ps (x.simd());
+#else
+    return *(float4 *)&x;
+#endif
+}
+
+
+OIIO_FORCEINLINE float4 vreduce_add (const float4& v) {
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 3
+    // People seem to agree that SSE3 does add reduction best with 2
+    // horizontal adds.
+    // suppose v = (a, b, c, d)
+    simd::float4 ab_cd = _mm_hadd_ps (v.simd(), v.simd());
+    // ab_cd = (a+b, c+d, a+b, c+d)
+    simd::float4 abcd = _mm_hadd_ps (ab_cd.simd(), ab_cd.simd());
+    // all abcd elements are a+b+c+d
+    return abcd;
+#elif defined(OIIO_SIMD_SSE)
+    // I think this is the best we can do for SSE2, and I'm still not sure
+    // it's faster than the default scalar operation. But anyway...
+    // suppose v = (a, b, c, d)
+    float4 ab_ab_cd_cd = shuffle<1,0,3,2>(v) + v;
+    // now x = (b,a,d,c) + (a,b,c,d) = (a+b,a+b,c+d,c+d)
+    float4 cd_cd_ab_ab = shuffle<2,3,0,1>(ab_ab_cd_cd);
+    // now y = (c+d,c+d,a+b,a+b)
+    float4 abcd = ab_ab_cd_cd + cd_cd_ab_ab;   // a+b+c+d in all components
+    return abcd;
+#else
+    return float4 (v[0] + v[1] + v[2] + v[3]);
 #endif
 }
 
-/// shuffle<i>(a) is the same as shuffle<i,i,i,i>(a)
-template<int i> OIIO_FORCEINLINE mask4 shuffle (const mask4& a) { return shuffle<i,i,i,i>(a); }
 
+OIIO_FORCEINLINE float reduce_add (const float4& v) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_cvtss_f32(vreduce_add (v));
+#else
+    return v[0] + v[1] + v[2] + v[3];
+#endif
+}
+
+OIIO_FORCEINLINE float4 vdot (const float4 &a, const float4 &b) {
+#if OIIO_SIMD_SSE >= 4
+    return _mm_dp_ps (a.simd(), b.simd(), 0xff);
+#elif OIIO_SIMD_NEON
+    float32x4_t ab = vmulq_f32(a, b);
+    float32x4_t sum1 = vaddq_f32(ab, vrev64q_f32(ab));
+    return vaddq_f32(sum1, vcombine_f32(vget_high_f32(sum1), vget_low_f32(sum1)));
+#else
+    return vreduce_add (a*b);
+#endif
+}
 
-/// Helper: as rapid as possible extraction of one component, when the
-/// index is fixed.
-template<int i>
-OIIO_FORCEINLINE bool extract (const mask4& a) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
-    return _mm_extract_epi32(_mm_castps_si128(a.simd()), i);  // SSE4.1 only
+OIIO_FORCEINLINE float dot (const float4 &a, const float4 &b) {
+#if OIIO_SIMD_SSE >= 4
+    return _mm_cvtss_f32 (_mm_dp_ps (a.simd(), b.simd(), 0xff));
 #else
-    return a[i];
+    return reduce_add (a*b);
 #endif
 }
 
-/// Helper: substitute val for a[i]
-template<int i>
-OIIO_FORCEINLINE mask4 insert (const mask4& a, bool val) {
+OIIO_FORCEINLINE float4 vdot3 (const float4 &a, const float4 &b) {
+#if OIIO_SIMD_SSE >= 4
+    return _mm_dp_ps (a.simd(), b.simd(), 0x7f);
+#else
+    return vreduce_add((a*b).xyz0());
+#endif
+}
+
+OIIO_FORCEINLINE float dot3 (const float4 &a, const float4 &b) {
+#if OIIO_SIMD_SSE >= 4
+    return _mm_cvtss_f32 (_mm_dp_ps (a.simd(), b.simd(), 0x77));
+#else
+    return reduce_add ((a*b).xyz0());
+#endif
+}
+
+
+OIIO_FORCEINLINE float4 blend (const float4& a, const float4& b, const mask4& mask)
+{
 #if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
-    int ival = val ? -1 : 0;
-    return _mm_castsi128_ps (_mm_insert_epi32 (_mm_castps_si128(a), ival, i));
+    // SSE >= 4.1 only
+    return _mm_blendv_ps (a.simd(), b.simd(), mask.simd());
+#elif defined(OIIO_SIMD_SSE)
+    // Trick for SSE < 4.1
+    return _mm_or_ps (_mm_and_ps(mask.simd(), b.simd()),
+                      _mm_andnot_ps(mask.simd(), a.simd()));
 #else
-    mask4 tmp = a;
-    tmp[i] = val ? -1 : 0;
-    return tmp;
+    return float4 (mask[0] ? b[0] : a[0],
+                   mask[1] ? b[1] : a[1],
+                   mask[2] ? b[2] : a[2],
+                   mask[3] ? b[3] : a[3]);
 #endif
 }
 
 
-OIIO_FORCEINLINE bool reduce_and (const mask4& v) {
+OIIO_FORCEINLINE float4 blend0 (const float4& a, const mask4& mask)
+{
 #if defined(OIIO_SIMD_SSE)
-    return _mm_movemask_ps(v.simd()) == 0xf;
+    return _mm_and_ps(mask.simd(), a.simd());
 #else
-    return v[0] & v[1] & v[2] & v[3];
+    return float4 (mask[0] ? a[0] : 0.0f,
+                   mask[1] ? a[1] : 0.0f,
+                   mask[2] ? a[2] : 0.0f,
+                   mask[3] ? a[3] : 0.0f);
 #endif
 }
 
 
-OIIO_FORCEINLINE bool reduce_or (const mask4& v) {
+OIIO_FORCEINLINE float4 blend0not (const float4& a, const mask4& mask)
+{
 #if defined(OIIO_SIMD_SSE)
-    return _mm_movemask_ps(v) != 0;
+    return _mm_andnot_ps(mask.simd(), a.simd());
 #else
-    return v[0] | v[1] | v[2] | v[3];
+    return float4 (mask[0] ? 0.0f : a[0],
+                   mask[1] ? 0.0f : a[1],
+                   mask[2] ? 0.0f : a[2],
+                   mask[3] ? 0.0f : a[3]);
 #endif
 }
 
 
-
-//////////////////////////////////////////////////////////////////////
-// int4 implementation
+OIIO_FORCEINLINE float4 safe_div (const float4 &a, const float4 &b) {
+#if defined(OIIO_SIMD_SSE)
+    return blend0not (a/b, b == float4::Zero());
+#else
+    return float4 (b[0] == 0.0f ? 0.0f : a[0] / b[0],
+                   b[1] == 0.0f ? 0.0f : a[1] / b[1],
+                   b[2] == 0.0f ? 0.0f : a[2] / b[2],
+                   b[3] == 0.0f ? 0.0f : a[3] / b[3]);
+#endif
+}
 
 
-OIIO_FORCEINLINE void int4::clear () {
+OIIO_FORCEINLINE float3 hdiv (const float4 &a)
+{
 #if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_setzero_si128();
+    return float3(safe_div(a, shuffle<3>(a)).xyz0());
 #else
-    *this = 0.0f;
+    float d = a[3];
+    return d == 0.0f ? float3 (0.0f) : float3 (a[0]/d, a[1]/d, a[2]/d);
 #endif
 }
 
-OIIO_FORCEINLINE const int4 int4::Zero () {
+
+
+OIIO_FORCEINLINE float4 select (const mask4& mask, const float4& a, const float4& b)
+{
+    return blend (b, a, mask);
+}
+
+
+OIIO_FORCEINLINE float4 abs (const float4& a)
+{
 #if defined(OIIO_SIMD_SSE)
-    return _mm_setzero_si128();
+    // Just clear the sign bit for cheap fabsf
+    return _mm_and_ps (a.simd(), _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
 #else
-    return int4(0);
+    return float4 (fabsf(a[0]), fabsf(a[1]), fabsf(a[2]), fabsf(a[3]));
 #endif
 }
 
-OIIO_FORCEINLINE const int4 int4::One () { return int4(1); }
 
-OIIO_FORCEINLINE const int4 int4::NegOne () {
-#if defined(OIIO_SIMD_SSE)
-    // Fastest way to fill an __m128 with all 1 bits is to cmpeq_epi8
-    // any value to itself.
-# if defined(OIIO_SIMD_AVX) && (OIIO_GNUC_VERSION > 50000)
-    __m128i anyval = _mm_undefined_si128();
-# else
-    __m128i anyval = _mm_castps_si128 (_mm_setzero_ps());
-# endif
-    return _mm_cmpeq_epi8 (anyval, anyval);
+OIIO_FORCEINLINE float4 sign (const float4& a)
+{
+    float4 one(1.0f);
+    return blend (one, -one, a < float4::Zero());
+}
+
+
+OIIO_FORCEINLINE float4 ceil (const float4& a)
+{
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4  /* SSE >= 4.1 */
+    return _mm_ceil_ps (a);
 #else
-    return int4(-1);
+    return float4 (ceilf(a[0]), ceilf(a[1]), ceilf(a[2]), ceilf(a[3]));
 #endif
 }
 
-OIIO_FORCEINLINE const int4 int4::Iota (int value) {
-    return int4(value,value+1,value+2,value+3);
+OIIO_FORCEINLINE float4 floor (const float4& a)
+{
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4  /* SSE >= 4.1 */
+    return _mm_floor_ps (a);
+#else
+    return float4 (floorf(a[0]), floorf(a[1]), floorf(a[2]), floorf(a[3]));
+#endif
 }
 
-OIIO_FORCEINLINE const int4 & int4::operator= (int a) { load(a); return *this; }
+OIIO_FORCEINLINE float4 round (const float4& a)
+{
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4  /* SSE >= 4.1 */
+    return _mm_round_ps (a, (_MM_FROUND_TO_NEAREST_INT |_MM_FROUND_NO_EXC));
+#else
+    return float4 (roundf(a[0]), roundf(a[1]), roundf(a[2]), roundf(a[3]));
+#endif
+}
 
-OIIO_FORCEINLINE const int4 & int4::operator= (int4 other) {
-    m_vec = other.m_vec;
-    return *this;
+OIIO_FORCEINLINE int4 floori (const float4& a)
+{
+#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4  /* SSE >= 4.1 */
+    return int4(floor(a));
+#elif defined(OIIO_SIMD_SSE)   /* SSE2/3 */
+    int4 i (a);  // truncates
+    int4 isneg = bitcast_to_int4 (a < float4::Zero());
+    return i + isneg;
+    // The trick here (thanks, Cycles, for letting me spy on your code) is
+    // that the comparison will return (int)-1 for components that are less
+    // than zero, and adding that is the same as subtracting one!
+#else
+    return int4 ((int)floorf(a[0]), (int)floorf(a[1]),
+                 (int)floorf(a[2]), (int)floorf(a[3]));
+#endif
 }
 
-OIIO_FORCEINLINE int& int4::operator[] (int i) {
-    DASSERT(i<elements);
-    return m_val[i];
+
+OIIO_FORCEINLINE int4 rint (const float4& a)
+{
+    return int4 (round(a));
 }
 
-OIIO_FORCEINLINE int int4::operator[] (int i) const {
-    DASSERT(i<elements);
-    return m_val[i];
+
+
+OIIO_FORCEINLINE float4 sqrt (const float4 &a)
+{
+#if OIIO_SIMD_SSE
+    return _mm_sqrt_ps (a.simd());
+#else
+    return float4 (sqrtf(a[0]), sqrtf(a[1]), sqrtf(a[2]), sqrtf(a[3]));
+#endif
 }
 
 
-OIIO_FORCEINLINE void int4::load (int a) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_set1_epi32 (a);
+
+OIIO_FORCEINLINE float4 rsqrt (const float4 &a)
+{
+#if OIIO_SIMD_SSE
+    return _mm_div_ps (_mm_set1_ps(1.0f), _mm_sqrt_ps (a.simd()));
 #else
-    SIMD_CONSTRUCT (a);
+    return float4 (1.0f/sqrtf(a[0]), 1.0f/sqrtf(a[1]),
+                   1.0f/sqrtf(a[2]), 1.0f/sqrtf(a[3]));
 #endif
 }
 
-OIIO_FORCEINLINE void int4::load (int a, int b, int c, int d) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_set_epi32 (d, c, b, a);
+
+
+OIIO_FORCEINLINE float4 rsqrt_fast (const float4 &a)
+{
+#if OIIO_SIMD_SSE
+    return _mm_rsqrt_ps (a.simd());
 #else
-    m_val[0] = a;
-    m_val[1] = b;
-    m_val[2] = c;
-    m_val[3] = d;
+    return float4 (1.0f/sqrtf(a[0]), 1.0f/sqrtf(a[1]),
+                   1.0f/sqrtf(a[2]), 1.0f/sqrtf(a[3]));
 #endif
 }
 
-OIIO_FORCEINLINE void int4::load (const int *values) {
+
+
+OIIO_FORCEINLINE float4 min (const float4& a, const float4& b)
+{
 #if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_loadu_si128 ((const simd_t *)values);
+    return _mm_min_ps (a, b);
 #else
-    SIMD_CONSTRUCT (values[i]);
+    return float4 (std::min (a[0], b[0]),
+                   std::min (a[1], b[1]),
+                   std::min (a[2], b[2]),
+                   std::min (a[3], b[3]));
 #endif
 }
 
-OIIO_FORCEINLINE void int4::load (const int *values, int n)
+OIIO_FORCEINLINE float4 max (const float4& a, const float4& b)
 {
 #if defined(OIIO_SIMD_SSE)
-    switch (n) {
-    case 1:
-        m_vec = _mm_castps_si128 (_mm_load_ss ((const float *)values));
-        break;
-    case 2:
-            // Trickery: load one double worth of bits!
-        m_vec = _mm_castpd_si128 (_mm_load_sd ((const double*)values));
-        break;
-    case 3:
-        // Trickery: load one double worth of bits, then a float,
-        // and combine, casting to ints.
-        m_vec = _mm_castps_si128 (_mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double*)values)),
-                                                _mm_load_ss ((const float *)values + 2)));
-        break;
-    case 4:
-        m_vec = _mm_loadu_si128 ((const simd_t *)values);
-        break;
-    default:
-        break;
-    }
+    return _mm_max_ps (a, b);
+#else
+    return float4 (std::max (a[0], b[0]),
+                   std::max (a[1], b[1]),
+                   std::max (a[2], b[2]),
+                   std::max (a[3], b[3]));
 #endif
-    for (int i = 0; i < n; ++i)
-        m_val[i] = values[i];
-    for (int i = n; i < elements; ++i)
-        m_val[i] = 0;
 }
 
-OIIO_FORCEINLINE void int4::load (const unsigned short *values) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
-    // Trickery: load one double worth of bits = 4 uint16's!
-    simd_t a = _mm_castpd_si128 (_mm_load_sd ((const double *)values));
-    m_vec = _mm_cvtepu16_epi32 (a);
+
+
+OIIO_FORCEINLINE float4 andnot (const float4& a, const float4& b) {
+#if defined(OIIO_SIMD_SSE)
+    return _mm_andnot_ps (a.simd(), b.simd());
 #else
-    SIMD_CONSTRUCT (values[i]);
+    const int *ai = (const int *)&a;
+    const int *bi = (const int *)&b;
+    return bitcast_to_float4 (int4(~(ai[0]) & bi[0],
+                                   ~(ai[1]) & bi[1],
+                                   ~(ai[2]) & bi[2],
+                                   ~(ai[3]) & bi[3]));
 #endif
 }
 
-OIIO_FORCEINLINE void int4::load (const short *values) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
-    // Trickery: load one double worth of bits = 4 int16's!
-    simd_t a = _mm_castpd_si128 (_mm_load_sd ((const double *)values));
-    m_vec = _mm_cvtepi16_epi32 (a);
+
+
+OIIO_FORCEINLINE float4 madd (const simd::float4& a, const simd::float4& b,
+                              const simd::float4& c)
+{
+#if OIIO_SIMD_SSE && OIIO_FMA_ENABLED
+    // If we are sure _mm_fmadd_ps intrinsic is available, use it.
+    return _mm_fmadd_ps (a, b, c);
+#elif OIIO_SIMD_SSE && !defined(_MSC_VER)
+    // If we directly access the underlying __m128, on some platforms and
+    // compiler flags, it will turn into fma anyway, even if we don't use
+    // the intrinsic.
+    return a.simd() * b.simd() + c.simd();
 #else
-    SIMD_CONSTRUCT (values[i]);
+    // Fallback: just use regular math and hope for the best.
+    return a * b + c;
 #endif
 }
 
-OIIO_FORCEINLINE void int4::load (const unsigned char *values) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
-    // Trickery: load one float worth of bits = 4 uint8's!
-    simd_t a = _mm_castps_si128 (_mm_load_ss ((const float *)values));
-    m_vec = _mm_cvtepu8_epi32 (a);
+
+OIIO_FORCEINLINE float4 msub (const simd::float4& a, const simd::float4& b,
+                              const simd::float4& c)
+{
+#if OIIO_SIMD_SSE && OIIO_FMA_ENABLED
+    // If we are sure _mm_fnmsub_ps intrinsic is available, use it.
+    return _mm_fmsub_ps (a, b, c);
+#elif OIIO_SIMD_SSE && !defined(_MSC_VER)
+    // If we directly access the underlying __m128, on some platforms and
+    // compiler flags, it will turn into fma anyway, even if we don't use
+    // the intrinsic.
+    return a.simd() * b.simd() - c.simd();
 #else
-    SIMD_CONSTRUCT (values[i]);
+    // Fallback: just use regular math and hope for the best.
+    return a * b - c;
 #endif
 }
 
-OIIO_FORCEINLINE void int4::load (const char *values) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
-    // Trickery: load one float worth of bits = 4 uint8's!
-    simd_t a = _mm_castps_si128 (_mm_load_ss ((const float *)values));
-    m_vec = _mm_cvtepi8_epi32 (a);
+
+
+OIIO_FORCEINLINE float4 nmadd (const simd::float4& a, const simd::float4& b,
+                               const simd::float4& c)
+{
+#if OIIO_SIMD_SSE && OIIO_FMA_ENABLED
+    // If we are sure _mm_fnmadd_ps intrinsic is available, use it.
+    return _mm_fnmadd_ps (a, b, c);
+#elif OIIO_SIMD_SSE && !defined(_MSC_VER)
+    // If we directly access the underlying __m128, on some platforms and
+    // compiler flags, it will turn into fma anyway, even if we don't use
+    // the intrinsic.
+    return c.simd() - a.simd() * b.simd();
 #else
-    SIMD_CONSTRUCT (values[i]);
+    // Fallback: just use regular math and hope for the best.
+    return c - a * b;
 #endif
 }
 
-OIIO_FORCEINLINE void int4::store (int *values) const {
-#if defined(OIIO_SIMD_SSE)
-    // Use an unaligned store -- it's just as fast when the memory turns
-    // out to be aligned, nearly as fast even when unaligned. Not worth
-    // the headache of using stores that require alignment.
-    _mm_storeu_si128 ((simd_t *)values, m_vec);
+
+
+OIIO_FORCEINLINE float4 nmsub (const simd::float4& a, const simd::float4& b,
+                               const simd::float4& c)
+{
+#if OIIO_SIMD_SSE && OIIO_FMA_ENABLED
+    // If we are sure _mm_fnmsub_ps intrinsic is available, use it.
+    return _mm_fnmsub_ps (a, b, c);
+#elif OIIO_SIMD_SSE && !defined(_MSC_VER)
+    // If we directly access the underlying __m128, on some platforms and
+    // compiler flags, it will turn into fma anyway, even if we don't use
+    // the intrinsic.
+    return -(a.simd() * b.simd()) - c.simd();
 #else
-    SIMD_DO (values[i] = m_val[i]);
+    // Fallback: just use regular math and hope for the best.
+    return -(a * b) - c;
 #endif
 }
 
-OIIO_FORCEINLINE void int4::store (int *values, int n) const {
-    DASSERT (n >= 0 && n <= elements);
-#if defined(OIIO_SIMD)
-    // For full SIMD, there is a speed advantage to storing all components.
-    if (n == elements)
-        store (values);
-    else
+
+
+// Full precision exp() of all components of a SIMD vector.
+OIIO_FORCEINLINE float4 exp (const float4& v)
+{
+#if OIIO_SIMD_SSE
+    // Implementation inspired by:
+    // https://github.com/embree/embree/blob/master/common/simd/sse_special.h
+    // Which is listed as Copyright (C) 2007  Julien Pommier and distributed
+    // under the zlib license.
+    float4 x = v;
+    OIIO_SIMD_FLOAT4_CONST (exp_hi,  88.3762626647949f);
+    OIIO_SIMD_FLOAT4_CONST (exp_lo,  -88.3762626647949f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_LOG2EF, 1.44269504088896341f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_exp_C1, 0.693359375f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_exp_C2, -2.12194440e-4f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_exp_p0, 1.9875691500E-4f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_exp_p1, 1.3981999507E-3f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_exp_p2, 8.3334519073E-3f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_exp_p3, 4.1665795894E-2f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_exp_p4, 1.6666665459E-1f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_exp_p5, 5.0000001201E-1f);
+    float4 tmp (0.0f);
+    float4 one (1.0f);
+    x = min (x, float4(exp_hi));
+    x = max (x, float4(exp_lo));
+    float4 fx = madd (x, float4(cephes_LOG2EF), float4(0.5f));
+    int4 emm0 = int4(fx);
+    tmp = float4(emm0);
+    float4 mask = bitcast_to_float4 (bitcast_to_int4(tmp > fx) & bitcast_to_int4(one));
+    fx = tmp - mask;
+    tmp = fx * float4(cephes_exp_C1);
+    float4 z = fx * float4(cephes_exp_C2);
+    x = x - tmp;
+    x = x - z;
+    z = x * x;
+    float4 y = float4(cephes_exp_p0);
+    y = madd (y, x, float4(cephes_exp_p1));
+    y = madd (y, x, float4(cephes_exp_p2));
+    y = madd (y, x, float4(cephes_exp_p3));
+    y = madd (y, x, float4(cephes_exp_p4));
+    y = madd (y, x, float4(cephes_exp_p5));
+    y = madd (y, z, x);
+    y = y + one;
+    emm0 = (int4(fx) + int4(0x7f)) << 23;
+    float4 pow2n = bitcast_to_float4(emm0);
+    y = y * pow2n;
+    return y;
+
+#else
+    return float4 (expf(v[0]), expf(v[1]), expf(v[2]), expf(v[3]));
 #endif
-        for (int i = 0; i < n; ++i)
-            values[i] = m_val[i];
 }
 
-OIIO_FORCEINLINE void int4::store (unsigned short *values) const {
-#if defined(OIIO_SIMD_SSE)
-    // Expressed as half-words and considering little endianness, we
-    // currently have xAxBxCxD (the 'x' means don't care).
-    int4 clamped = m_val & int4(0xffff);   // A0B0C0D0
-    int4 low = _mm_shufflelo_epi16 (clamped, (0<<0) | (2<<2) | (1<<4) | (1<<6));
-                    // low = AB00xxxx
-    int4 high = _mm_shufflehi_epi16 (clamped, (1<<0) | (1<<2) | (0<<4) | (2<<6));
-                    // high = xxxx00CD
-    int4 highswapped = shuffle_sse<2,3,0,1>(high);  // 00CDxxxx
-    int4 result = low | highswapped;   // ABCDxxxx
-    _mm_storel_pd ((double *)values, _mm_castsi128_pd(result));
-    // At this point, values[] should hold A,B,C,D
+
+
+// Full precision log() of all components of a SIMD vector.
+OIIO_FORCEINLINE float4 log (const float4& v)
+{
+#if OIIO_SIMD_SSE
+    // Implementation inspired by:
+    // https://github.com/embree/embree/blob/master/common/simd/sse_special.h
+    // Which is listed as Copyright (C) 2007  Julien Pommier and distributed
+    // under the zlib license.
+    float4 x = v;
+    int4 emm0;
+    float4 zero (float4::Zero());
+    float4 one (1.0f);
+    mask4 invalid_mask = (x <= zero);
+    OIIO_SIMD_INT4_CONST (min_norm_pos, (int)0x00800000);
+    OIIO_SIMD_INT4_CONST (inv_mant_mask, (int)~0x7f800000);
+    x = max(x, bitcast_to_float4(int4(min_norm_pos)));  /* cut off denormalized stuff */
+    emm0 = srl (bitcast_to_int4(x), 23);
+    /* keep only the fractional part */
+    x = bitcast_to_float4 (bitcast_to_int4(x) & int4(inv_mant_mask));
+    x = bitcast_to_float4 (bitcast_to_int4(x) | bitcast_to_int4(float4(0.5f)));
+    emm0 = emm0 - int4(0x7f);
+    float4 e (emm0);
+    e = e + one;
+    OIIO_SIMD_FLOAT4_CONST (cephes_SQRTHF, 0.707106781186547524f);
+    mask4 mask = (x < float4(cephes_SQRTHF));
+    float4 tmp = bitcast_to_float4 (bitcast_to_int4(x) & bitcast_to_int4(mask));
+    x = x - one;
+    e = e - bitcast_to_float4 (bitcast_to_int4(one) & bitcast_to_int4(mask));
+    x = x + tmp;
+    float4 z = x * x;
+    OIIO_SIMD_FLOAT4_CONST (cephes_log_p0, 7.0376836292E-2f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_log_p1, - 1.1514610310E-1f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_log_p2, 1.1676998740E-1f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_log_p3, - 1.2420140846E-1f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_log_p4, + 1.4249322787E-1f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_log_p5, - 1.6668057665E-1f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_log_p6, + 2.0000714765E-1f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_log_p7, - 2.4999993993E-1f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_log_p8, + 3.3333331174E-1f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_log_q1, -2.12194440e-4f);
+    OIIO_SIMD_FLOAT4_CONST (cephes_log_q2, 0.693359375f);
+    float4 y = *(float4*)cephes_log_p0;
+    y = madd (y, x, float4(cephes_log_p1));
+    y = madd (y, x, float4(cephes_log_p2));
+    y = madd (y, x, float4(cephes_log_p3));
+    y = madd (y, x, float4(cephes_log_p4));
+    y = madd (y, x, float4(cephes_log_p5));
+    y = madd (y, x, float4(cephes_log_p6));
+    y = madd (y, x, float4(cephes_log_p7));
+    y = madd (y, x, float4(cephes_log_p8));
+    y = y * x;
+    y = y * z;
+    y = madd(e, float4(cephes_log_q1), y);
+    y = nmadd (z, 0.5f, y);
+    x = x + y;
+    x = madd (e, float4(cephes_log_q2), x);
+    x = bitcast_to_float4 (bitcast_to_int4(x) | bitcast_to_int4(invalid_mask)); // negative arg will be NAN
+    return x;
 #else
-    SIMD_DO (values[i] = m_val[i]);
+    return float4 (logf(v[0]), logf(v[1]), logf(v[2]), logf(v[3]));
 #endif
 }
 
-OIIO_FORCEINLINE void int4::store (unsigned char *values) const {
-#if defined(OIIO_SIMD_SSE)
-    // Expressed as bytes and considering little endianness, we
-    // currently have xAxBxCxD (the 'x' means don't care).
-    int4 clamped = m_val & int4(0xff);            // A000 B000 C000 D000
-    int4 swapped = shuffle_sse<1,0,3,2>(clamped); // B000 A000 D000 C000
-    int4 shifted = swapped << 8;                  // 0B00 0A00 0D00 0C00
-    int4 merged = clamped | shifted;              // AB00 xxxx CD00 xxxx
-    int4 merged2 = shuffle_sse<2,2,2,2>(merged);  // CD00 ...
-    int4 shifted2 = merged2 << 16;                // 00CD ...
-    int4 result = merged | shifted2;              // ABCD ...
-    *(int*)values = result[0]; //extract<0>(result);
-    // At this point, values[] should hold A,B,C,D
-#else
-    SIMD_DO (values[i] = m_val[i]);
-#endif
-}
 
-OIIO_FORCEINLINE int4 operator+ (const int4& a, const int4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_add_epi32 (a.m_vec, b.m_vec);
-#else
-    SIMD_RETURN (int4, a[i] + b[i]);
-#endif
-}
 
-OIIO_FORCEINLINE const int4 & int4::operator+= (const int4& a) {
+OIIO_FORCEINLINE void transpose (float4 &a, float4 &b, float4 &c, float4 &d)
+{
 #if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_add_epi32 (m_vec, a.m_vec);
+    _MM_TRANSPOSE4_PS (a, b, c, d);
 #else
-    SIMD_DO (m_val[i] += a[i]);
+    float4 A (a[0], b[0], c[0], d[0]);
+    float4 B (a[1], b[1], c[1], d[1]);
+    float4 C (a[2], b[2], c[2], d[2]);
+    float4 D (a[3], b[3], c[3], d[3]);
+    a = A;  b = B;  c = C;  d = D;
 #endif
-    return *this;
 }
 
-OIIO_FORCEINLINE int4 int4::operator- () const {
+
+OIIO_FORCEINLINE void transpose (const float4& a, const float4& b, const float4& c, const float4& d,
+                                 float4 &r0, float4 &r1, float4 &r2, float4 &r3)
+{
 #if defined(OIIO_SIMD_SSE)
-    return _mm_sub_epi32 (_mm_setzero_si128(), m_vec);
+    //_MM_TRANSPOSE4_PS (a, b, c, d);
+    float4 l02 = _mm_unpacklo_ps (a, c);
+    float4 h02 = _mm_unpackhi_ps (a, c);
+    float4 l13 = _mm_unpacklo_ps (b, d);
+    float4 h13 = _mm_unpackhi_ps (b, d);
+    r0 = _mm_unpacklo_ps (l02, l13);
+    r1 = _mm_unpackhi_ps (l02, l13);
+    r2 = _mm_unpacklo_ps (h02, h13);
+    r3 = _mm_unpackhi_ps (h02, h13);
 #else
-    SIMD_RETURN (int4, -m_val[i]);
+    r0.load (a[0], b[0], c[0], d[0]);
+    r1.load (a[1], b[1], c[1], d[1]);
+    r2.load (a[2], b[2], c[2], d[2]);
+    r3.load (a[3], b[3], c[3], d[3]);
 #endif
 }
 
-OIIO_FORCEINLINE int4 operator- (const int4& a, const int4& b) {
+
+OIIO_FORCEINLINE void transpose (int4 &a, int4 &b, int4 &c, int4 &d)
+{
 #if defined(OIIO_SIMD_SSE)
-    return _mm_sub_epi32 (a.m_vec, b.m_vec);
+    __m128 A = _mm_castsi128_ps (a);
+    __m128 B = _mm_castsi128_ps (b);
+    __m128 C = _mm_castsi128_ps (c);
+    __m128 D = _mm_castsi128_ps (d);
+    _MM_TRANSPOSE4_PS (A, B, C, D);
+    a = _mm_castps_si128 (A);
+    b = _mm_castps_si128 (B);
+    c = _mm_castps_si128 (C);
+    d = _mm_castps_si128 (D);
 #else
-    SIMD_RETURN (int4, a[i] - b[i]);
+    int4 A (a[0], b[0], c[0], d[0]);
+    int4 B (a[1], b[1], c[1], d[1]);
+    int4 C (a[2], b[2], c[2], d[2]);
+    int4 D (a[3], b[3], c[3], d[3]);
+    a = A;  b = B;  c = C;  d = D;
 #endif
 }
 
-OIIO_FORCEINLINE const int4 & int4::operator-= (const int4& a) {
+OIIO_FORCEINLINE void transpose (const int4& a, const int4& b, const int4& c, const int4& d,
+                                 int4 &r0, int4 &r1, int4 &r2, int4 &r3)
+{
 #if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_sub_epi32 (m_vec, a.m_vec);
+    //_MM_TRANSPOSE4_PS (a, b, c, d);
+    __m128 A = _mm_castsi128_ps (a);
+    __m128 B = _mm_castsi128_ps (b);
+    __m128 C = _mm_castsi128_ps (c);
+    __m128 D = _mm_castsi128_ps (d);
+    _MM_TRANSPOSE4_PS (A, B, C, D);
+    r0 = _mm_castps_si128 (A);
+    r1 = _mm_castps_si128 (B);
+    r2 = _mm_castps_si128 (C);
+    r3 = _mm_castps_si128 (D);
 #else
-    SIMD_DO (m_val[i] -= a[i]);
+    r0.load (a[0], b[0], c[0], d[0]);
+    r1.load (a[1], b[1], c[1], d[1]);
+    r2.load (a[2], b[2], c[2], d[2]);
+    r3.load (a[3], b[3], c[3], d[3]);
 #endif
-        return *this;
 }
 
 
+OIIO_FORCEINLINE float4 AxBxCxDx (const float4& a, const float4& b,
+                                  const float4& c, const float4& d)
+{
 #if defined(OIIO_SIMD_SSE)
-// Shamelessly lifted from Syrah which lifted from Manta which lifted it
-// from intel.com
-OIIO_FORCEINLINE __m128i mm_mul_epi32 (__m128i a, __m128i b) {
-#if OIIO_SIMD_SSE >= 4  /* SSE >= 4.1 */
-    return _mm_mullo_epi32(a, b);
+    float4 l02 = _mm_unpacklo_ps (a, c);
+    float4 l13 = _mm_unpacklo_ps (b, d);
+    return _mm_unpacklo_ps (l02, l13);
 #else
-    // Prior to SSE 4.1, there is no _mm_mullo_epi32 instruction, so we have
-    // to fake it.
-    __m128i t0;
-    __m128i t1;
-    t0 = _mm_mul_epu32 (a, b);
-    t1 = _mm_mul_epu32 (_mm_shuffle_epi32 (a, 0xB1),
-                        _mm_shuffle_epi32 (b, 0xB1));
-    t0 = _mm_shuffle_epi32 (t0, 0xD8);
-    t1 = _mm_shuffle_epi32 (t1, 0xD8);
-    return _mm_unpacklo_epi32 (t0, t1);
+    return float4 (a[0], b[0], c[0], d[0]);
 #endif
 }
-#endif
 
 
-OIIO_FORCEINLINE int4 operator* (const int4& a, const int4& b) {
+OIIO_FORCEINLINE int4 AxBxCxDx (const int4& a, const int4& b,
+                                const int4& c, const int4& d)
+{
 #if defined(OIIO_SIMD_SSE)
-    return mm_mul_epi32 (a.m_vec, b.m_vec);
+    int4 l02 = _mm_unpacklo_epi32 (a, c);
+    int4 l13 = _mm_unpacklo_epi32 (b, d);
+    return _mm_unpacklo_epi32 (l02, l13);
 #else
-    SIMD_RETURN (int4, a[i] * b[i]);
+    return int4 (a[0], b[0], c[0], d[0]);
 #endif
 }
 
-OIIO_FORCEINLINE const int4 & int4::operator*= (const int4& a) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = mm_mul_epi32 (m_vec, a.m_vec);
+
+
+//////////////////////////////////////////////////////////////////////
+// float3 implementation
+
+OIIO_FORCEINLINE float3::float3 (const float3 &other) {
+#if defined(OIIO_SIMD_SSE) || defined(OIIO_SIMD_NEON)
+    m_vec = other.m_vec;
 #else
-    SIMD_DO (m_val[i] *= a[i]);
+    SIMD_CONSTRUCT_PAD (other[i]);
 #endif
-    return *this;
 }
 
-OIIO_FORCEINLINE const int4 & int4::operator*= (int val) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = mm_mul_epi32 (m_vec, _mm_set1_epi32(val));
+OIIO_FORCEINLINE float3::float3 (const float4 &other) {
+#if defined(OIIO_SIMD_SSE) || defined(OIIO_SIMD_NEON)
+    m_vec = other.simd();
 #else
-    SIMD_DO (m_val[i] *= val);
+    SIMD_CONSTRUCT_PAD (other[i]);
+    m_val[3] = 0.0f;
 #endif
-    return *this;
 }
 
-OIIO_FORCEINLINE int4 operator/ (const int4& a, const int4& b) {
-    // NO INTEGER DIVISION IN SSE!
-    SIMD_RETURN (int4, a[i] / b[i]);
-}
+OIIO_FORCEINLINE const float3 float3::Zero () { return float3(float4::Zero()); }
 
-OIIO_FORCEINLINE const int4 & int4::operator/= (const int4& a) {
-    // NO INTEGER DIVISION IN SSE!
-    SIMD_DO (m_val[i] /= a[i]);
-    return *this;
-}
+OIIO_FORCEINLINE const float3 float3::One () { return float3(1.0f); }
 
-OIIO_FORCEINLINE const int4 & int4::operator/= (int val) {
-    // NO INTEGER DIVISION IN SSE!
-    SIMD_DO (m_val[i] /= val);
-    return *this;
+OIIO_FORCEINLINE const float3 float3::Iota (float value) {
+    return float3(value,value+1.0f,value+2.0f);
 }
 
-OIIO_FORCEINLINE int4 operator% (const int4& a, const int4& b) {
-    // NO INTEGER MODULUS in SSE!
-    SIMD_RETURN (int4, a[i] % b[i]);
-    }
 
-OIIO_FORCEINLINE const int4 & int4::operator%= (const int4& a) {
-    // NO INTEGER MODULUS in SSE!
-    SIMD_DO (m_val[i] %= a[i]);
-    return *this;
-}
+OIIO_FORCEINLINE void float3::load (float val) { float4::load (val, val, val, 0.0f); }
 
-OIIO_FORCEINLINE int4 operator% (const int4& a, int w) {
-    // NO INTEGER MODULUS in SSE!
-    SIMD_RETURN (int4, a[i] % w);
-}
+OIIO_FORCEINLINE void float3::load (const float *values) { float4::load (values, 3); }
 
-OIIO_FORCEINLINE const int4 & int4::operator%= (int a) {
-    // NO INTEGER MODULUS IN SSE!
-    SIMD_DO (m_val[i] %= a);
-    return *this;
+OIIO_FORCEINLINE void float3::load (const float *values, int n) {
+    float4::load (values, n);
 }
 
-OIIO_FORCEINLINE int4 operator% (int a, const int4& b) {
-    // NO INTEGER MODULUS in SSE!
-    SIMD_RETURN (int4, a % b[i]);
+OIIO_FORCEINLINE void float3::load (const unsigned short *values) {
+    float4::load (float(values[0]), float(values[1]), float(values[2]));
 }
 
-
-OIIO_FORCEINLINE int4 operator& (const int4& a, const int4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_and_si128 (a.m_vec, b.m_vec);
-#else
-    SIMD_RETURN (int4, a[i] & b[i]);
-#endif
+OIIO_FORCEINLINE void float3::load (const short *values) {
+    float4::load (float(values[0]), float(values[1]), float(values[2]));
 }
 
-OIIO_FORCEINLINE const int4 & int4::operator&= (const int4& a) {
-    return *this = *this & a;
+OIIO_FORCEINLINE void float3::load (const unsigned char *values) {
+    float4::load (float(values[0]), float(values[1]), float(values[2]));
 }
 
-
-OIIO_FORCEINLINE int4 operator| (const int4& a, const int4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_or_si128 (a.m_vec, b.m_vec);
-#else
-    SIMD_RETURN (int4, a[i] | b[i]);
-#endif
+OIIO_FORCEINLINE void float3::load (const char *values) {
+    float4::load (float(values[0]), float(values[1]), float(values[2]));
 }
 
-OIIO_FORCEINLINE const int4 & int4::operator|= (const int4& a) {
-    return *this = *this | a;
+#ifdef _HALF_H_
+OIIO_FORCEINLINE void float3::load (const half *values) {
+    float4::load (float(values[0]), float(values[1]), float(values[2]));
 }
+#endif /* _HALF_H_ */
 
-OIIO_FORCEINLINE int4 operator^ (const int4& a, const int4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_xor_si128 (a.m_vec, b.m_vec);
-#else
-    SIMD_RETURN (int4, a[i] ^ b[i]);
-#endif
+OIIO_FORCEINLINE void float3::store (float *values) const {
+    float4::store (values, 3);
 }
 
-OIIO_FORCEINLINE const int4 & int4::operator^= (const int4& a) {
-    return *this = *this ^ a;
+OIIO_FORCEINLINE void float3::store (float *values, int n) const {
+    float4::store (values, n);
 }
 
-OIIO_FORCEINLINE int4 int4::operator~ () {
-#if defined(OIIO_SIMD_SSE)
-    // Fastest way to bit-complement in SSE is to xor with 0xffffffff.
-    // Fastest way to fill an __m128 with all 1 bits is to cmpeq_epi8
-    // any value to itself.
-# if defined(OIIO_SIMD_AVX) && (OIIO_GNUC_VERSION > 50000)
-    __m128i anyval = _mm_undefined_si128(); // AVX only, sigh
-    __m128i all_one_bits = _mm_cmpeq_epi8 (anyval, anyval);
-# else
-    __m128i all_one_bits = _mm_cmpeq_epi8 (m_vec, m_vec);
-# endif
-    return _mm_xor_si128 (m_vec, all_one_bits);
-#else
-    SIMD_RETURN (int4, ~m_val[i]);
-#endif
+#ifdef _HALF_H_
+OIIO_FORCEINLINE void float3::store (half *values) const {
+    SIMD_DO (values[i] = m_val[i]);
 }
-
-OIIO_FORCEINLINE int4 int4::operator<< (const unsigned int bits) const {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_slli_epi32 (m_vec, bits);
-#else
-    SIMD_RETURN (int4, m_val[i] << bits);
 #endif
+
+OIIO_FORCEINLINE void float3::store (Imath::V3f &vec) const {
+    store ((float *)&vec);
 }
 
-OIIO_FORCEINLINE const int4 & int4::operator<<= (const unsigned int bits) {
-    return *this = *this << bits;
+OIIO_FORCEINLINE float3 operator+ (const float3& a, const float3& b) {
+    return float3 (float4(a) + float4(b));
 }
 
-OIIO_FORCEINLINE int4 int4::operator>> (const unsigned int bits) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_srai_epi32 (m_vec, bits);
-#else
-    SIMD_RETURN (int4, m_val[i] >> bits);
-#endif
+OIIO_FORCEINLINE const float3 & float3::operator+= (const float3& a) {
+    *this = *this + a; return *this;
 }
 
-OIIO_FORCEINLINE const int4 & int4::operator>>= (const unsigned int bits) {
-    return *this = *this >> bits;
+OIIO_FORCEINLINE float3 float3::operator- () const {
+    return float3 (-float4(*this));
 }
 
-OIIO_FORCEINLINE int4 srl (const int4& val, const unsigned int bits) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_srli_epi32 (val.m_vec, bits);
-#else
-    SIMD_RETURN (int4, int ((unsigned int)(val[i]) >> bits));
-#endif
+OIIO_FORCEINLINE float3 operator- (const float3& a, const float3& b) {
+    return float3 (float4(a) - float4(b));
 }
 
+OIIO_FORCEINLINE const float3 & float3::operator-= (const float3& a) {
+    *this = *this - a; return *this;
+}
 
-OIIO_FORCEINLINE mask4 operator== (const int4& a, const int4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_castsi128_ps(_mm_cmpeq_epi32 (a.m_vec, b.m_vec));
-#else
-    SIMD_RETURN (mask4, a[i] == b[i] ? -1 : 0);
-#endif
+OIIO_FORCEINLINE float3 operator* (const float3& a, const float3& b) {
+    return float3 (float4(a) * float4(b));
 }
 
-OIIO_FORCEINLINE mask4 operator!= (const int4& a, const int4& b) {
-        return ! (a == b);
+OIIO_FORCEINLINE const float3 & float3::operator*= (const float3& a) {
+    *this = *this * a; return *this;
 }
 
-OIIO_FORCEINLINE mask4 operator< (const int4& a, const int4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_castsi128_ps(_mm_cmplt_epi32 (a.m_vec, b.m_vec));
-#else
-    SIMD_RETURN (mask4, a[i] < b[i] ? -1 : 0);
-#endif
+OIIO_FORCEINLINE const float3 & float3::operator*= (float a) {
+    *this = *this * a; return *this;
 }
 
-OIIO_FORCEINLINE mask4 operator>  (const int4& a, const int4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_castsi128_ps(_mm_cmpgt_epi32 (a.m_vec, b.m_vec));
-#else
-    SIMD_RETURN (mask4, a[i] > b[i] ? -1 : 0);
-#endif
+OIIO_FORCEINLINE float3 operator/ (const float3& a, const float3& b) {
+    return float3 (float4(a) / b.xyz1()); // Avoid divide by zero!
 }
 
-OIIO_FORCEINLINE mask4 operator>= (const int4& a, const int4& b) {
-    return !(a < b);
+OIIO_FORCEINLINE const float3 & float3::operator/= (const float3& a) {
+    *this = *this / a; return *this;
 }
 
-OIIO_FORCEINLINE mask4 operator<= (const int4& a, const int4& b) {
-    return !(a > b);
+OIIO_FORCEINLINE const float3 & float3::operator/= (float a) {
+    *this = *this / a; return *this;
 }
 
-inline std::ostream& operator<< (std::ostream& cout, const int4& val) {
+
+inline std::ostream& operator<< (std::ostream& cout, const float3& val) {
     cout << val[0];
     for (int i = 1; i < val.elements; ++i)
         cout << ' ' << val[i];
@@ -1990,1834 +4310,2009 @@ inline std::ostream& operator<< (std::ostream& cout, const int4& val) {
 }
 
 
-
-template<int i0, int i1, int i2, int i3>
-OIIO_FORCEINLINE int4 shuffle (const int4& a) {
+OIIO_FORCEINLINE float3 vreduce_add (const float3& v) {
 #if defined(OIIO_SIMD_SSE)
-    return shuffle_sse<i0,i1,i2,i3> (__m128i(a));
+    return float3 ((vreduce_add(float4(v))).xyz0());
 #else
-    return int4(a[i0], a[i1], a[i2], a[i3]);
+    return float3 (v[0] + v[1] + v[2]);
 #endif
 }
 
-template<int i> OIIO_FORCEINLINE int4 shuffle (const int4& a) { return shuffle<i,i,i,i>(a); }
-
 
-template<int i>
-OIIO_FORCEINLINE int extract (const int4& v) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
-    return _mm_extract_epi32(v.simd(), i);  // SSE4.1 only
+OIIO_FORCEINLINE float3 vdot (const float3 &a, const float3 &b) {
+#if OIIO_SIMD_SSE >= 4
+    return float3(_mm_dp_ps (a.simd(), b.simd(), 0x77));
 #else
-    return v[i];
+    return vreduce_add (a*b);
 #endif
 }
 
 
-template<int i>
-OIIO_FORCEINLINE int4 insert (const int4& a, int val) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
-    return _mm_insert_epi32 (a, val, i);
+OIIO_FORCEINLINE float dot (const float3 &a, const float3 &b) {
+#if OIIO_SIMD_SSE >= 4
+    return _mm_cvtss_f32 (_mm_dp_ps (a.simd(), b.simd(), 0x77));
 #else
-    int4 tmp = a;
-    tmp[i] = val;
-    return tmp;
+    return reduce_add (a*b);
 #endif
 }
 
 
+OIIO_FORCEINLINE float3 vdot3 (const float3 &a, const float3 &b) {
+#if OIIO_SIMD_SSE >= 4
+    return float3(_mm_dp_ps (a.simd(), b.simd(), 0x77));
+#else
+    return float3 (vreduce_add((a*b).xyz0()).xyz0());
+#endif
+}
 
-OIIO_FORCEINLINE int int4::x () const { return extract<0>(*this); }
-OIIO_FORCEINLINE int int4::y () const { return extract<1>(*this); }
-OIIO_FORCEINLINE int int4::z () const { return extract<2>(*this); }
-OIIO_FORCEINLINE int int4::w () const { return extract<3>(*this); }
-OIIO_FORCEINLINE void int4::set_x (int val) { *this = insert<0>(*this, val); }
-OIIO_FORCEINLINE void int4::set_y (int val) { *this = insert<1>(*this, val); }
-OIIO_FORCEINLINE void int4::set_z (int val) { *this = insert<2>(*this, val); }
-OIIO_FORCEINLINE void int4::set_w (int val) { *this = insert<3>(*this, val); }
+OIIO_FORCEINLINE float3 float3::normalized () const
+{
+#if OIIO_SIMD
+    float3 len2 = vdot3 (*this, *this);
+    return float3 (safe_div (*this, sqrt(len2)));
+#else
+    float len2 = dot (*this, *this);
+    return len2 > 0.0f ? (*this) / sqrtf(len2) : float3::Zero();
+#endif
+}
 
 
-OIIO_FORCEINLINE int4 bitcast_to_int4 (const mask4& x)
+OIIO_FORCEINLINE float3 float3::normalized_fast () const
 {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_castps_si128 (x.simd());
+#if OIIO_SIMD
+    float3 len2 = vdot3 (*this, *this);
+    float4 invlen = blend0not (rsqrt_fast (len2), len2 == float4::Zero());
+    return float3 ((*this) * invlen);
 #else
-    return *(int4 *)&x;
+    float len2 = dot (*this, *this);
+    return len2 > 0.0f ? (*this) / sqrtf(len2) : float3::Zero();
 #endif
 }
 
 
-OIIO_FORCEINLINE int4 vreduce_add (const int4& v) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 3
-    // People seem to agree that SSE3 does add reduction best with 2
-    // horizontal adds.
-    // suppose v = (a, b, c, d)
-    simd::int4 ab_cd = _mm_hadd_epi32 (v.simd(), v.simd());
-    // ab_cd = (a+b, c+d, a+b, c+d)
-    simd::int4 abcd = _mm_hadd_epi32 (ab_cd.simd(), ab_cd.simd());
-    // all abcd elements are a+b+c+d, return an element as fast as possible
-    return abcd;
-#elif defined(OIIO_SIMD_SSE)
-    // I think this is the best we can do for SSE2, and I'm still not sure
-    // it's faster than the default scalar operation. But anyway...
-    // suppose v = (a, b, c, d)
-    int4 ab_ab_cd_cd = shuffle<1,0,3,2>(v) + v;
-    // ab_ab_cd_cd = (b,a,d,c) + (a,b,c,d) = (a+b,a+b,c+d,c+d)
-    int4 cd_cd_ab_ab = shuffle<2,3,0,1>(ab_ab_cd_cd);
-    // cd_cd_ab_ab = (c+d,c+d,a+b,a+b)
-    int4 abcd = ab_ab_cd_cd + cd_cd_ab_ab;   // a+b+c+d in all components
-    return abcd;
+
+//////////////////////////////////////////////////////////////////////
+// matrix44 implementation
+
+
+OIIO_FORCEINLINE const Imath::M44f& matrix44::M44f() const {
+    return *(Imath::M44f*)this;
+}
+
+
+OIIO_FORCEINLINE float4 matrix44::operator[] (int i) const {
+#if OIIO_SIMD_SSE
+    return m_row[i];
 #else
-    return int4(v[0] + v[1] + v[2] + v[3]);
+    return float4 (m_mat[i]);
 #endif
 }
 
 
-OIIO_FORCEINLINE int reduce_add (const int4& v) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_cvtsi128_si32(vreduce_add(v));
+OIIO_FORCEINLINE matrix44 matrix44::transposed () const {
+    matrix44 T;
+#if OIIO_SIMD_SSE
+    simd::transpose (m_row[0], m_row[1], m_row[2], m_row[3],
+                     T.m_row[0], T.m_row[1], T.m_row[2], T.m_row[3]);
 #else
-    return v[0] + v[1] + v[2] + v[3];
+    T = m_mat.transposed();
 #endif
+    return T;
 }
 
-
-OIIO_FORCEINLINE int reduce_and (const int4& v) {
-#if defined(OIIO_SIMD_SSE)
-    // I think this is the best we can do for SSE, and I'm still not sure
-    // it's faster than the default scalar operation. But anyway...
-    // suppose v = (a, b, c, d)
-    int4 x = shuffle<1,0,3,2>(v) & v;
-    return extract<0>(x) & extract<2>(x);
+OIIO_FORCEINLINE float3 matrix44::transformp (const float3 &V) const {
+#if OIIO_SIMD_SSE
+    float4 R = shuffle<0>(V) * m_row[0] + shuffle<1>(V) * m_row[1] +
+               shuffle<2>(V) * m_row[2] + m_row[3];
+    R = R / shuffle<3>(R);
+    return float3 (R.xyz0());
 #else
-    return v[0] & v[1] & v[2] & v[3];
+    Imath::V3f R;
+    m_mat.multVecMatrix (*(Imath::V3f *)&V, R);
+    return float3(R);
 #endif
 }
 
+OIIO_FORCEINLINE float3 matrix44::transformv (const float3 &V) const {
+#if OIIO_SIMD_SSE
+    float4 R = shuffle<0>(V) * m_row[0] + shuffle<1>(V) * m_row[1] +
+               shuffle<2>(V) * m_row[2];
+    return float3 (R.xyz0());
+#else
+    Imath::V3f R;
+    m_mat.multDirMatrix (*(Imath::V3f *)&V, R);
+    return float3(R);
+#endif
+}
 
-OIIO_FORCEINLINE int reduce_or (const int4& v) {
-#if defined(OIIO_SIMD_SSE)
-    // I think this is the best we can do for SSE, and I'm still not sure
-    // it's faster than the default scalar operation. But anyway...
-    // suppose v = (a, b, c, d)
-    int4 x = shuffle<1,0,3,2>(v) | v;
-    return extract<0>(x) | extract<2>(x);
+OIIO_FORCEINLINE float3 matrix44::transformvT (const float3 &V) const {
+#if OIIO_SIMD_SSE
+    matrix44 T = transposed();
+    float4 R = shuffle<0>(V) * T[0] + shuffle<1>(V) * T[1] +
+               shuffle<2>(V) * T[2];
+    return float3 (R.xyz0());
 #else
-    return v[0] | v[1] | v[2] | v[3];
+    Imath::V3f R;
+    m_mat.transposed().multDirMatrix (*(Imath::V3f *)&V, R);
+    return float3(R);
 #endif
 }
 
-OIIO_FORCEINLINE int4 blend (const int4& a, const int4& b, const mask4& mask)
-{
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4 /* SSE >= 4.1 */
-    return _mm_blendv_epi8 (a.simd(), b.simd(), _mm_castps_si128(mask));
-#elif defined(OIIO_SIMD_SSE) /* SSE2 */
-    return _mm_or_si128 (_mm_and_si128(_mm_castps_si128(mask.simd()), b.simd()),
-                         _mm_andnot_si128(_mm_castps_si128(mask.simd()), a.simd()));
+OIIO_FORCEINLINE bool matrix44::operator== (const matrix44& m) const {
+#if OIIO_SIMD_SSE
+    mask4 b0 = (m_row[0] == m[0]);
+    mask4 b1 = (m_row[1] == m[1]);
+    mask4 b2 = (m_row[2] == m[2]);
+    mask4 b3 = (m_row[3] == m[3]);
+    return simd::all (b0 & b1 & b2 & b3);
 #else
-    SIMD_RETURN (int4, mask[i] ? b[i] : a[i]);
+    return memcmp(this, &m, 16*sizeof(float)) == 0;
 #endif
 }
 
+OIIO_FORCEINLINE bool matrix44::operator== (const Imath::M44f& m) const {
+    return memcmp(this, &m, 16*sizeof(float)) == 0;
+}
 
+OIIO_FORCEINLINE bool operator== (const Imath::M44f& a, const matrix44 &b) {
+    return (b == a);
+}
 
-OIIO_FORCEINLINE int4 blend0 (const int4& a, const mask4& mask)
-{
-#if defined(OIIO_SIMD_SSE)
-    return _mm_and_si128(_mm_castps_si128(mask), a.simd());
+OIIO_FORCEINLINE bool matrix44::operator!= (const matrix44& m) const {
+#if OIIO_SIMD_SSE
+    mask4 b0 = (m_row[0] != m[0]);
+    mask4 b1 = (m_row[1] != m[1]);
+    mask4 b2 = (m_row[2] != m[2]);
+    mask4 b3 = (m_row[3] != m[3]);
+    return simd::any (b0 | b1 | b2 | b3);
 #else
-    SIMD_RETURN (int4, mask[i] ? a[i] : 0.0f);
+    return memcmp(this, &m, 16*sizeof(float)) != 0;
 #endif
 }
 
+OIIO_FORCEINLINE bool matrix44::operator!= (const Imath::M44f& m) const {
+    return memcmp(this, &m, 16*sizeof(float)) != 0;
+}
 
+OIIO_FORCEINLINE bool operator!= (const Imath::M44f& a, const matrix44 &b) {
+    return (b != a);
+}
 
-OIIO_FORCEINLINE int4 blend0not (const int4& a, const mask4& mask)
-{
-#if defined(OIIO_SIMD_SSE)
-    return _mm_andnot_si128(_mm_castps_si128(mask), a.simd());
+OIIO_FORCEINLINE matrix44 matrix44::inverse() const {
+#if OIIO_SIMD_SSE
+    // Adapted from this code from Intel:
+    // ftp://download.intel.com/design/pentiumiii/sml/24504301.pdf
+    float4 minor0, minor1, minor2, minor3;
+    float4 row0, row1, row2, row3;
+    float4 det, tmp1;
+    const float *src = (const float *)this;
+    float4 zero = float4::Zero();
+    tmp1 = _mm_loadh_pi(_mm_loadl_pi(zero, (__m64*)(src)), (__m64*)(src+ 4));
+    row1 = _mm_loadh_pi(_mm_loadl_pi(zero, (__m64*)(src+8)), (__m64*)(src+12));
+    row0 = _mm_shuffle_ps(tmp1, row1, 0x88);
+    row1 = _mm_shuffle_ps(row1, tmp1, 0xDD);
+    tmp1 = _mm_loadh_pi(_mm_loadl_pi(tmp1, (__m64*)(src+ 2)), (__m64*)(src+ 6));
+    row3 = _mm_loadh_pi(_mm_loadl_pi(zero, (__m64*)(src+10)), (__m64*)(src+14));
+    row2 = _mm_shuffle_ps(tmp1, row3, 0x88);
+    row3 = _mm_shuffle_ps(row3, tmp1, 0xDD);
+    // -----------------------------------------------
+    tmp1 = row2 * row3;
+    tmp1 = shuffle<1,0,3,2>(tmp1);
+    minor0 = row1 * tmp1;
+    minor1 = row0 * tmp1;
+    tmp1 = shuffle<2,3,0,1>(tmp1);
+    minor0 = (row1 * tmp1) - minor0;
+    minor1 = (row0 * tmp1) - minor1;
+    minor1 = shuffle<2,3,0,1>(minor1);
+    // -----------------------------------------------
+    tmp1 = row1 * row2;
+    tmp1 = shuffle<1,0,3,2>(tmp1);
+    minor0 = (row3 * tmp1) + minor0;
+    minor3 = row0 * tmp1;
+    tmp1 = shuffle<2,3,0,1>(tmp1);
+    minor0 = minor0 - (row3 * tmp1);
+    minor3 = (row0 * tmp1) - minor3;
+    minor3 = shuffle<2,3,0,1>(minor3);
+    // -----------------------------------------------
+    tmp1 = shuffle<2,3,0,1>(row1) * row3;
+    tmp1 = shuffle<1,0,3,2>(tmp1);
+    row2 = shuffle<2,3,0,1>(row2);
+    minor0 = (row2 * tmp1) + minor0;
+    minor2 = row0 * tmp1;
+    tmp1 = shuffle<2,3,0,1>(tmp1);
+    minor0 = minor0 - (row2 * tmp1);
+    minor2 = (row0 * tmp1) - minor2;
+    minor2 = shuffle<2,3,0,1>(minor2);
+    // -----------------------------------------------
+    tmp1 = row0 * row1;
+    tmp1 = shuffle<1,0,3,2>(tmp1);
+    minor2 = (row3 * tmp1) + minor2;
+    minor3 = (row2 * tmp1) - minor3;
+    tmp1 = shuffle<2,3,0,1>(tmp1);
+    minor2 = (row3 * tmp1) - minor2;
+    minor3 = minor3 - (row2 * tmp1);
+    // -----------------------------------------------
+    tmp1 = row0 * row3;
+    tmp1 = shuffle<1,0,3,2>(tmp1);
+    minor1 = minor1 - (row2 * tmp1);
+    minor2 = (row1 * tmp1) + minor2;
+    tmp1 = shuffle<2,3,0,1>(tmp1);
+    minor1 = (row2 * tmp1) + minor1;
+    minor2 = minor2 - (row1 * tmp1);
+    // -----------------------------------------------
+    tmp1 = row0 * row2;
+    tmp1 = shuffle<1,0,3,2>(tmp1);
+    minor1 = (row3 * tmp1) + minor1;
+    minor3 = minor3 - (row1 * tmp1);
+    tmp1 = shuffle<2,3,0,1>(tmp1);
+    minor1 = minor1 - (row3 * tmp1);
+    minor3 = (row1 * tmp1) + minor3;
+    // -----------------------------------------------
+    det = row0 * minor0;
+    det = shuffle<2,3,0,1>(det) + det;
+    det = _mm_add_ss(shuffle<1,0,3,2>(det), det);
+    tmp1 = _mm_rcp_ss(det);
+    det = _mm_sub_ss(_mm_add_ss(tmp1, tmp1), _mm_mul_ss(det, _mm_mul_ss(tmp1, tmp1)));
+    det = shuffle<0>(det);
+    return matrix44 (det*minor0, det*minor1, det*minor2, det*minor3);
 #else
-    SIMD_RETURN (int4, mask[i] ? 0.0f : a[i]);
+    return m_mat.inverse();
 #endif
 }
 
 
-OIIO_FORCEINLINE int4 select (const mask4& mask, const int4& a, const int4& b)
-{
-    return blend (b, a, mask);
+inline std::ostream& operator<< (std::ostream& cout, const matrix44 &M) {
+    const float *m = (const float *)&M;
+    cout << m[0];
+    for (int i = 1; i < 16; ++i)
+        cout << ' ' << m[i];
+    return cout;
 }
 
 
 
-OIIO_FORCEINLINE int4 abs (const int4& a)
-{
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 3
-    return _mm_abs_epi32(a.simd());
-#else
-    return int4 (std::abs(a[0]), std::abs(a[1]), std::abs(a[2]), std::abs(a[3]));
-#endif
-}
-
-OIIO_FORCEINLINE int4 min (const int4& a, const int4& b)
-{
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4 /* SSE >= 4.1 */
-    return _mm_min_epi32 (a, b);
-#else
-    SIMD_RETURN (int4, std::min (a[i], b[i]));
-#endif
+OIIO_FORCEINLINE float3 transformp (const matrix44 &M, const float3 &V) {
+    return M.transformp (V);
 }
 
-OIIO_FORCEINLINE int4 max (const int4& a, const int4& b)
+OIIO_FORCEINLINE float3 transformp (const Imath::M44f &M, const float3 &V)
 {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4 /* SSE >= 4.1 */
-    return _mm_max_epi32 (a, b);
+#if OIIO_SIMD
+    return matrix44(M).transformp (V);
 #else
-    SIMD_RETURN (int4, std::max (a[i], b[i]));
+    Imath::V3f R;
+    M.multVecMatrix (*(Imath::V3f *)&V, R);
+    return float3(R);
 #endif
 }
 
 
-OIIO_FORCEINLINE int4 rotl32 (const int4& x, const unsigned int k)
-{
-    return (x<<k) | srl(x,32-k);
+OIIO_FORCEINLINE float3 transformv (const matrix44 &M, const float3 &V) {
+    return M.transformv (V);
 }
 
-
-
-OIIO_FORCEINLINE int4 andnot (const int4& a, const int4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_andnot_si128 (a.simd(), b.simd());
+OIIO_FORCEINLINE float3 transformv (const Imath::M44f &M, const float3 &V)
+{
+#if OIIO_SIMD
+    return matrix44(M).transformv (V);
 #else
-    SIMD_RETURN (int4, ~(a[i]) & b[i]);
+    Imath::V3f R;
+    M.multDirMatrix (*(Imath::V3f *)&V, R);
+    return float3(R);
 #endif
 }
 
+OIIO_FORCEINLINE float3 transformvT (const matrix44 &M, const float3 &V)
+{
+    return M.transformvT (V);
+}
 
-// Implementation had to be after the definition of int4.
-OIIO_FORCEINLINE mask4::mask4 (const int4& ival)
+OIIO_FORCEINLINE float3 transformvT (const Imath::M44f &M, const float3 &V)
 {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = (ival != int4::Zero());
+#if OIIO_SIMD
+    return matrix44(M).transformvT(V);
 #else
-    SIMD_CONSTRUCT (ival[i] ? -1 : 0);
+    return transformv (M.transposed(), V);
 #endif
 }
 
 
 
-
 //////////////////////////////////////////////////////////////////////
-// float4 implementation
+// mask8 implementation
 
+OIIO_FORCEINLINE mask8::mask8 (bool a, bool b, bool c, bool d,
+                               bool e, bool f, bool g, bool h) {
+    m_val[0] = -int(a);  m_val[1] = -int(b);
+    m_val[2] = -int(c);  m_val[3] = -int(d);
+    m_val[4] = -int(e);  m_val[5] = -int(f);
+    m_val[6] = -int(g);  m_val[7] = -int(h);
+}
 
-OIIO_FORCEINLINE float4::float4 (const int4& ival) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_cvtepi32_ps (ival.simd());
+OIIO_FORCEINLINE mask8::mask8 (const mask4 &lo, const mask4 &hi) {
+#if OIIO_SIMD_AVX
+    m_vec = _mm256_insertf128_ps (_mm256_castps128_ps256 (lo), hi, 1);
 #else
-    SIMD_CONSTRUCT (float(ival[i]));
+    bitcast_to_int4(lo).store (m_val);
+    bitcast_to_int4(hi).store (m_val+4);
 #endif
 }
 
-
-OIIO_FORCEINLINE const float4 float4::Zero () {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_setzero_ps();
+OIIO_FORCEINLINE const mask8 mask8::False () {
+#if OIIO_SIMD_AVX
+    return _mm256_setzero_ps();
 #else
-    return float4(0.0f);
+    return mask8(false);
 #endif
 }
 
-OIIO_FORCEINLINE const float4 float4::One () {
-    return float4(1.0f);
-}
-
-OIIO_FORCEINLINE const float4 float4::Iota (float value) {
-    return float4(value,value+1.0f,value+2.0f,value+3.0f);
-}
-
-    /// Set all components to 0.0
-OIIO_FORCEINLINE void float4::clear () {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_setzero_ps();
+OIIO_FORCEINLINE const mask8 mask8::True () {
+#if OIIO_SIMD_AVX
+    __m256 zero = _mm256_setzero_ps();
+    return _mm256_cmp_ps (zero, zero, _CMP_EQ_OQ);
 #else
-    load (0.0f);
+    return mask8(true);
 #endif
 }
 
-#if defined(ILMBASE_VERSION_MAJOR) && ILMBASE_VERSION_MAJOR >= 2
-OIIO_FORCEINLINE const float4 & float4::operator= (const Imath::V4f &v) {
-    load ((const float *)&v);
-    return *this;
-}
+OIIO_FORCEINLINE const mask8 mask8::from_bitmask (int bitmask) {
+#if OIIO_SIMD_AVX >= 2
+    __m256i bit = _mm256_setr_epi32 (1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i b = _mm256_and_si256 (_mm256_set1_epi32 (bitmask), bit);
+    return _mm256_castsi256_ps (_mm256_cmpeq_epi32 (b, bit));
+#else
+    mask8 m;
+    for (int i = 0; i < elements; ++i)
+        m.m_val[i] = (bitmask & (1<<i)) ? -1 : 0;
+    return m;
 #endif
-
-OIIO_FORCEINLINE const float4 & float4::operator= (const Imath::V3f &v) {
-    load (v[0], v[1], v[2], 0.0f);
-    return *this;
-}
-
-OIIO_FORCEINLINE float& float4::operator[] (int i) {
-    DASSERT(i<elements);
-    return m_val[i];
 }
 
-OIIO_FORCEINLINE float float4::operator[] (int i) const {
-    DASSERT(i<elements);
-    return m_val[i];
+OIIO_FORCEINLINE const mask8 & mask8::operator= (const mask8 & other) {
+    m_vec = other.m_vec;
+    return *this;
 }
 
-
-OIIO_FORCEINLINE void float4::load (float val) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_set1_ps (val);
-#elif defined(OIIO_SIMD_NEON)
-    m_vec = vdupq_n_f32 (val);
-#else
-    SIMD_CONSTRUCT (val);
-#endif
+OIIO_FORCEINLINE bool mask8::operator[] (int i) const {
+    DASSERT(i >= 0 && i < elements);
+    return m_val[i] != 0;
 }
-
-OIIO_FORCEINLINE void float4::load (float a, float b, float c, float d) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_set_ps (d, c, b, a);
-#elif defined(OIIO_SIMD_NEON)
-    float values[4] = { a, b, c, d };
-    m_vec = vld1q_f32 (values);
+
+OIIO_FORCEINLINE mask4 mask8::lo () const {
+#if OIIO_SIMD_AVX
+    return _mm256_castps256_ps128 (m_vec);
 #else
-    m_val[0] = a;
-    m_val[1] = b;
-    m_val[2] = c;
-    m_val[3] = d;
+    return mask4 (int4 (m_val));
 #endif
 }
 
-    /// Load from an array of 4 values
-OIIO_FORCEINLINE void float4::load (const float *values) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_loadu_ps (values);
-#elif defined(OIIO_SIMD_NEON)
-    m_vec = vld1q_f32 (values);
+OIIO_FORCEINLINE mask4 mask8::hi () const {
+#if OIIO_SIMD_AVX
+    return _mm256_extractf128_ps (m_vec, 1);
 #else
-    SIMD_CONSTRUCT (values[i]);
+    return mask4 (int4 (m_val+4));
 #endif
 }
 
-    /// Load from a partial array of <=4 values. Unassigned values are
-    /// undefined.
-OIIO_FORCEINLINE void float4::load (const float *values, int n) {
-#if defined(OIIO_SIMD_SSE)
-    switch (n) {
-    case 1:
-        m_vec = _mm_load_ss (values);
-        break;
-    case 2:
-        // Trickery: load one double worth of bits!
-        m_vec = _mm_castpd_ps (_mm_load_sd ((const double*)values));
-        break;
-    case 3:
-        m_vec = _mm_setr_ps (values[0], values[1], values[2], 0.0f);
-        // This looks wasteful, but benchmarks show that it's the
-        // fastest way to set 3 values with the 4th getting zero.
-        // Actually, gcc and clang both turn it into something more
-        // efficient than _mm_setr_ps. The version below looks smart,
-        // but was much more expensive as the _mm_setr_ps!
-        //   __m128 xy = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)values));
-        //   m_vec = _mm_movelh_ps(xy, _mm_load_ss (values + 2));
-        break;
-    case 4:
-        m_vec = _mm_loadu_ps (values);
-        break;
-    default:
-        break;
-    }
-#elif defined(OIIO_SIMD_NEON)
-    switch (n) {
-    case 1: m_vec = vdupq_n_f32 (val);                    break;
-    case 2: load (values[0], values[1], 0.0f, 0.0f);      break;
-    case 3: load (values[0], values[1], values[2], 0.0f); break;
-    case 4: m_vec = vld1q_f32 (values);                   break;
-    default: break;
-    }
+OIIO_FORCEINLINE void mask8::load (bool a) {
+#if OIIO_SIMD_AVX
+    m_vec = _mm256_castsi256_ps (_mm256_set1_epi32 (-int(a)));
 #else
-    for (int i = 0; i < n; ++i)
-        m_val[i] = values[i];
-    for (int i = n; i < paddedelements; ++i)
-        m_val[i] = 0;
+    for (int i = 0; i < elements; ++i)
+        m_val[i] = -int(a);
 #endif
 }
 
-    /// Load from an array of 4 unsigned short values, convert to float
-OIIO_FORCEINLINE void float4::load (const unsigned short *values) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 2
-    m_vec = _mm_cvtepi32_ps (int4(values).simd());
-    // You might guess that the following is faster, but it's NOT:
-    //   NO!  m_vec = _mm_cvtpu16_ps (*(__m64*)values);
+OIIO_FORCEINLINE int mask8::bitmask () const {
+#if OIIO_SIMD_AVX
+    return _mm256_movemask_ps (m_vec);
 #else
-    SIMD_CONSTRUCT (values[i]);
+    int r = 0;
+    for (int i = 0; i < elements; ++i)
+        if (m_val[i])
+            r |= 1<<i;
+    return r;
 #endif
 }
 
-    /// Load from an array of 4 short values, convert to float
-OIIO_FORCEINLINE void float4::load (const short *values) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 2
-    m_vec = _mm_cvtepi32_ps (int4(values).simd());
+OIIO_FORCEINLINE mask8 operator! (const mask8 & a) {
+#if OIIO_SIMD_AVX
+    return _mm256_xor_ps (mask8::True(), a);
 #else
-    SIMD_CONSTRUCT (values[i]);
+    return mask8 (!a.lo(), !a.hi());
 #endif
 }
 
-    /// Load from an array of 4 unsigned char values, convert to float
-OIIO_FORCEINLINE void float4::load (const unsigned char *values) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 2
-    m_vec = _mm_cvtepi32_ps (int4(values).simd());
+OIIO_FORCEINLINE mask8 operator& (const mask8 & a, const mask8 & b) {
+#if OIIO_SIMD_AVX
+    return _mm256_and_ps (a, b);
 #else
-    SIMD_CONSTRUCT (values[i]);
+    return mask8 (a.lo() & b.lo(), a.hi() & b.hi());
 #endif
 }
 
-    /// Load from an array of 4 char values, convert to float
-OIIO_FORCEINLINE void float4::load (const char *values) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 2
-    m_vec = _mm_cvtepi32_ps (int4(values).simd());
+OIIO_FORCEINLINE const mask8& mask8::operator&= (const mask8 & b) {
+    return *this = *this & b;
+}
+
+OIIO_FORCEINLINE mask8 operator| (const mask8 & a, const mask8 & b) {
+#if OIIO_SIMD_AVX
+    return _mm256_or_ps (a, b);
 #else
-    SIMD_CONSTRUCT (values[i]);
+    return mask8 (a.lo() | b.lo(), a.hi() | b.hi());
 #endif
 }
 
-#ifdef _HALF_H_
-OIIO_FORCEINLINE void float4::load (const half *values) {
-#if defined(__F16C__) && defined(OIIO_SIMD_SSE)
-    /* Enabled 16 bit float instructions! */
-    __m128i a = _mm_castpd_si128 (_mm_load_sd ((const double *)values));
-    m_vec = _mm_cvtph_ps (a);
-#elif defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 2
-    // SSE half-to-float by Fabian "ryg" Giesen. Public domain.
-    // https://gist.github.com/rygorous/2144712
-    int4 h ((const unsigned short *)values);
-# define CONSTI(name) *(const __m128i *)&name
-# define CONSTF(name) *(const __m128 *)&name
-    OIIO_SIMD_UINT4_CONST(mask_nosign, 0x7fff);
-    OIIO_SIMD_UINT4_CONST(magic,       (254 - 15) << 23);
-    OIIO_SIMD_UINT4_CONST(was_infnan,  0x7bff);
-    OIIO_SIMD_UINT4_CONST(exp_infnan,  255 << 23);
-    __m128i mnosign     = CONSTI(mask_nosign);
-    __m128i expmant     = _mm_and_si128(mnosign, h);
-    __m128i justsign    = _mm_xor_si128(h, expmant);
-    __m128i expmant2    = expmant; // copy (just here for counting purposes)
-    __m128i shifted     = _mm_slli_epi32(expmant, 13);
-    __m128  scaled      = _mm_mul_ps(_mm_castsi128_ps(shifted), *(const __m128 *)&magic);
-    __m128i b_wasinfnan = _mm_cmpgt_epi32(expmant2, CONSTI(was_infnan));
-    __m128i sign        = _mm_slli_epi32(justsign, 16);
-    __m128  infnanexp   = _mm_and_ps(_mm_castsi128_ps(b_wasinfnan), CONSTF(exp_infnan));
-    __m128  sign_inf    = _mm_or_ps(_mm_castsi128_ps(sign), infnanexp);
-    __m128  final       = _mm_or_ps(scaled, sign_inf);
-    // ~11 SSE2 ops.
-    m_vec = final;
-# undef CONSTI
-# undef CONSTF
-#else /* No SIMD defined: */
-    SIMD_CONSTRUCT (values[i]);
+OIIO_FORCEINLINE const mask8& mask8::operator|= (const mask8 & b) {
+    return *this = *this | b;
+}
+
+OIIO_FORCEINLINE mask8 operator^ (const mask8& a, const mask8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_xor_ps (a, b);
+#else
+    return mask8 (a.lo() ^ b.lo(), a.hi() ^ b.hi());
 #endif
 }
-#endif /* _HALF_H_ */
 
-OIIO_FORCEINLINE void float4::store (float *values) const {
-#if defined(OIIO_SIMD_SSE)
-    // Use an unaligned store -- it's just as fast when the memory turns
-    // out to be aligned, nearly as fast even when unaligned. Not worth
-    // the headache of using stores that require alignment.
-    _mm_storeu_ps (values, m_vec);
-#elif defined(OIIO_SIMD_NEON)
-    vst1q_f32 (values, m_vec);
+OIIO_FORCEINLINE mask8 mask8::operator~ () const {
+    return !(*this);
+}
+
+OIIO_FORCEINLINE const mask8 operator== (const mask8 & a, const mask8 & b) {
+    return !(a ^ b);
+}
+
+OIIO_FORCEINLINE const mask8 operator!= (const mask8 & a, const mask8 & b) {
+    return a ^ b;
+}
+
+inline std::ostream& operator<< (std::ostream& cout, const mask8 & a) {
+    cout << a[0];
+    for (int i = 1; i < a.elements; ++i)
+        cout << ' ' << a[i];
+    return cout;
+}
+
+OIIO_FORCEINLINE bool reduce_and (const mask8& v) {
+    return v.bitmask() == 0xff;
+}
+
+OIIO_FORCEINLINE bool reduce_or (const mask8& v) {
+    return v.bitmask() != 0;
+}
+
+
+
+//////////////////////////////////////////////////////////////////////
+// int8 implementation
+
+OIIO_FORCEINLINE int8::int8 (int a, int b, int c, int d,
+                             int e, int f, int g, int h) {
+#if OIIO_SIMD_AVX
+    m_vec = _mm256_setr_epi32 (a, b, c, d, e, f, g, h);
 #else
-    SIMD_DO (values[i] = m_val[i]);
+    m_val[0] = a;  m_val[1] = b;  m_val[2] = c;  m_val[3] = d;
+    m_val[4] = e;  m_val[5] = f;  m_val[6] = g;  m_val[7] = h;
 #endif
 }
 
-OIIO_FORCEINLINE void float4::store (float *values, int n) const {
-    DASSERT (n >= 0 && n <= 4);
-#if defined(OIIO_SIMD_SSE)
-    switch (n) {
-        case 1:
-        _mm_store_ss (values, m_vec);
-        break;
-    case 2:
-        // Trickery: store two floats as a double worth of bits
-        _mm_store_sd ((double*)values, _mm_castps_pd(m_vec));
-        break;
-    case 3:
-        values[0] = m_val[0];
-        values[1] = m_val[1];
-        values[2] = m_val[2];
-        // This looks wasteful, but benchmarks show that it's the
-        // fastest way to store 3 values, in benchmarks was faster than
-        // this, below:
-        //   _mm_store_sd ((double*)values, _mm_castps_pd(m_vec));
-        //   _mm_store_ss (values + 2, _mm_movehl_ps(m_vec,m_vec));
-        break;
-    case 4:
-        store (values);
-        break;
-    default:
-        break;
-    }
-#elif defined(OIIO_SIMD_NEON)
-    switch (n) {
-    case 1:
-        vst1q_lane_f32 (values, m_vec, 0);
-        break;
-    case 2:
-        vst1q_lane_f32 (values++, m_vec, 0);
-        vst1q_lane_f32 (values, m_vec, 1);
-        break;
-    case 3:
-        vst1q_lane_f32 (values++, m_vec, 0);
-        vst1q_lane_f32 (values++, m_vec, 1);
-        vst1q_lane_f32 (values, m_vec, 2);
-        break;
-    case 4:
-        vst1q_f32 (values, m_vec); break;
-    default:
-        break;
-    }
+OIIO_FORCEINLINE int8::int8 (const int4 &lo, const int4 &hi) {
+#if OIIO_SIMD_AVX
+    m_vec = _mm256_insertf128_si256 (_mm256_castsi128_si256 (lo), hi, 1);
 #else
-    for (int i = 0; i < n; ++i)
-        values[i] = m_val[i];
+    lo.store (m_val);
+    hi.store (m_val+4);
 #endif
 }
 
-#ifdef _HALF_H_
-OIIO_FORCEINLINE void float4::store (half *values) const {
-#if defined(__F16C__) && defined(OIIO_SIMD_SSE)
-    __m128i h = _mm_cvtps_ph (m_vec, (_MM_FROUND_TO_NEAREST_INT |_MM_FROUND_NO_EXC));
-    _mm_store_sd ((double *)values, _mm_castsi128_pd(h));
-    #else
-    SIMD_DO (values[i] = m_val[i]);
+OIIO_FORCEINLINE void int8::clear () { load (0); }
+
+OIIO_FORCEINLINE const int8 int8::Zero () {
+#if OIIO_SIMD_AVX
+    return _mm256_setzero_si256();
+#else
+    return int8(0);
 #endif
 }
+
+OIIO_FORCEINLINE const int8 int8::One () { return int8(1); }
+
+OIIO_FORCEINLINE const int8 int8::NegOne () { return int8(-1); }
+
+OIIO_FORCEINLINE const int8 int8::Iota (int value) {
+    return int8 (value, value+1, value+2, value+3,
+                 value+4, value+5, value+6, value+7);
+}
+
+OIIO_FORCEINLINE const int8 & int8::operator= (int a) { load(a); return *this; }
+
+OIIO_FORCEINLINE const int8 & int8::operator= (const int8 &other) {
+    m_vec = other.m_vec;
+    return *this;
+}
+
+OIIO_FORCEINLINE int& int8::operator[] (int i) {
+    DASSERT(i >= 0 && i < elements);
+    return m_val[i];
+}
+
+OIIO_FORCEINLINE int int8::operator[] (int i) const {
+    DASSERT(i >= 0 && i < elements);
+    return m_val[i];
+}
+
+OIIO_FORCEINLINE int4 int8::lo () const {
+#if OIIO_SIMD_AVX
+    return _mm256_castsi256_si128 (m_vec);
+#else
+    return int4 (m_val);
 #endif
+}
 
-OIIO_FORCEINLINE float4 operator+ (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_add_ps (a.m_vec, b.m_vec);
-#elif defined(OIIO_SIMD_NEON)
-    return vaddq_f32 (a.m_vec, b.m_vec);
+OIIO_FORCEINLINE int4 int8::hi () const {
+#if OIIO_SIMD_AVX
+    return _mm256_extractf128_si256 (m_vec, 1);
 #else
-    SIMD_RETURN (float4, a[i] + b[i]);
+    return int4 (m_val+4);
 #endif
 }
 
-OIIO_FORCEINLINE const float4 & float4::operator+= (const float4& a) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_add_ps (m_vec, a.m_vec);
-#elif defined(OIIO_SIMD_NEON)
-    m_vec = vaddq_f32 (m_vec, a.m_vec);
+OIIO_FORCEINLINE void int8::load (int a) {
+#if OIIO_SIMD_AVX
+    m_vec = _mm256_set1_epi32 (a);
 #else
-    SIMD_DO (m_val[i] += a[i]);
+    SIMD_CONSTRUCT (a);
 #endif
-    return *this;
-    }
+}
 
-OIIO_FORCEINLINE float4 float4::operator- () const {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_sub_ps (_mm_setzero_ps(), m_vec);
-#elif defined(OIIO_SIMD_NEON)
-    return vsubq_f32 (Zero(), m_vec);
+OIIO_FORCEINLINE void int8::load (const int *values) {
+#if OIIO_SIMD_AVX
+    m_vec = _mm256_loadu_si256 ((const __m256i *)values);
 #else
-    SIMD_RETURN (float4, -m_val[i]);
+    SIMD_CONSTRUCT (values[i]);
 #endif
 }
 
-OIIO_FORCEINLINE float4 operator- (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_sub_ps (a.m_vec, b.m_vec);
-#elif defined(OIIO_SIMD_NEON)
-    return vsubq_f32 (a.m_vec, b.m_vec);
+OIIO_FORCEINLINE void int8::load (const int *values, int n) {
+    DASSERT (n >= 0 && n <= elements);
+#if OIIO_SIMD_AVX
+    __m256i mask = _mm256_castps_si256 (float8::Iota() < float8(float(n)));
+    m_vec = _mm256_castps_si256 (_mm256_maskload_ps ((const float *)values, mask));
 #else
-    SIMD_RETURN (float4, a[i] - b[i]);
+    for (int i = 0; i < n; ++i)
+        m_val[i] = values[i];
+    for (int i = n; i < elements; ++i)
+        m_val[i] = 0;
 #endif
 }
 
-OIIO_FORCEINLINE const float4 & float4::operator-= (const float4& a) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_sub_ps (m_vec, a.m_vec);
-#elif defined(OIIO_SIMD_NEON)
-    m_vec = vsubq_f32 (m_vec, a.m_vec);
+OIIO_FORCEINLINE void int8::store (int *values) const {
+#if OIIO_SIMD_AVX
+    _mm256_storeu_si256 ((__m256i *)values, m_vec);
 #else
-    SIMD_DO (m_val[i] -= a[i]);
+    SIMD_DO (values[i] = m_val[i]);
 #endif
-    return *this;
 }
 
-OIIO_FORCEINLINE float4 operator* (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_mul_ps (a.m_vec, b.m_vec);
-#elif defined(OIIO_SIMD_NEON)
-    return vmulq_f32 (a.m_vec, b.m_vec);
+OIIO_FORCEINLINE void int8::store (int *values, int n) const {
+    DASSERT (n >= 0 && n <= elements);
+#if OIIO_SIMD_AVX
+    __m256i mask = _mm256_castps_si256 (float8::Iota() < float8(float(n)));
+    _mm256_maskstore_ps ((float *)values, mask, _mm256_castsi256_ps (m_vec));
 #else
-    SIMD_RETURN (float4, a[i] * b[i]);
+    for (int i = 0; i < n; ++i)
+        values[i] = m_val[i];
 #endif
 }
 
-OIIO_FORCEINLINE const float4 & float4::operator*= (const float4& a) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_mul_ps (m_vec, a.m_vec);
-#elif defined(OIIO_SIMD_NEON)
-    m_vec = vmulq_f32 (m_vec, a.m_vec);
+OIIO_FORCEINLINE void int8::store (int *values, const mask8 &mask) const {
+#if OIIO_SIMD_AVX
+    _mm256_maskstore_ps ((float *)values, _mm256_castps_si256 (mask),
+                         _mm256_castsi256_ps (m_vec));
 #else
-    SIMD_DO (m_val[i] *= a[i]);
+    SIMD_DO (if (mask[i]) values[i] = m_val[i]);
 #endif
-    return *this;
 }
 
-OIIO_FORCEINLINE const float4 & float4::operator*= (float val) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_mul_ps (m_vec, _mm_set1_ps(val));
-#elif defined(OIIO_SIMD_NEON)
-    m_vec = vmulq_f32 (m_vec, vdupq_n_f32(val));
+OIIO_FORCEINLINE int8 operator+ (const int8& a, const int8& b) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_add_epi32 (a.m_vec, b.m_vec);
 #else
-    SIMD_DO (m_val[i] *= val);
+    return int8 (a.lo() + b.lo(), a.hi() + b.hi());
 #endif
-    return *this;
 }
 
-OIIO_FORCEINLINE float4 operator/ (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_div_ps (a.m_vec, b.m_vec);
-#else
-    SIMD_RETURN (float4, a[i] / b[i]);
-#endif
+OIIO_FORCEINLINE const int8 & int8::operator+= (const int8& a) {
+    return *this = *this + a;
 }
 
-OIIO_FORCEINLINE const float4 & float4::operator/= (const float4& a) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_div_ps (m_vec, a.m_vec);
+OIIO_FORCEINLINE int8 int8::operator- () const {
+    return int8::Zero() - *this;
+}
+
+OIIO_FORCEINLINE int8 operator- (const int8& a, const int8& b) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_sub_epi32 (a.m_vec, b.m_vec);
 #else
-    SIMD_DO (m_val[i] /= a[i]);
+    return int8 (a.lo() - b.lo(), a.hi() - b.hi());
 #endif
-    return *this;
 }
 
-OIIO_FORCEINLINE const float4 & float4::operator/= (float val) {
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_div_ps (m_vec, _mm_set1_ps(val));
+OIIO_FORCEINLINE const int8 & int8::operator-= (const int8& a) {
+    return *this = *this - a;
+}
+
+OIIO_FORCEINLINE int8 operator* (const int8& a, const int8& b) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_mullo_epi32 (a.m_vec, b.m_vec);
 #else
-    SIMD_DO (m_val[i] /= val);
+    return int8 (a.lo() * b.lo(), a.hi() * b.hi());
 #endif
-    return *this;
 }
 
-OIIO_FORCEINLINE mask4 operator== (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_cmpeq_ps (a.m_vec, b.m_vec);
+OIIO_FORCEINLINE const int8 & int8::operator*= (const int8& a) {
+    return *this = *this * a;
+}
+
+OIIO_FORCEINLINE int8 operator& (const int8& a, const int8& b) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_and_si256 (a.m_vec, b.m_vec);
 #else
-    SIMD_RETURN (mask4, a[i] == b[i] ? -1 : 0);
+    return int8 (a.lo() & b.lo(), a.hi() & b.hi());
 #endif
 }
 
-OIIO_FORCEINLINE mask4 operator!= (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_cmpneq_ps (a.m_vec, b.m_vec);
+OIIO_FORCEINLINE int8 operator| (const int8& a, const int8& b) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_or_si256 (a.m_vec, b.m_vec);
 #else
-    SIMD_RETURN (mask4, a[i] != b[i] ? -1 : 0);
+    return int8 (a.lo() | b.lo(), a.hi() | b.hi());
 #endif
 }
 
-OIIO_FORCEINLINE mask4 operator< (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_cmplt_ps (a.m_vec, b.m_vec);
+OIIO_FORCEINLINE int8 operator^ (const int8& a, const int8& b) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_xor_si256 (a.m_vec, b.m_vec);
 #else
-    SIMD_RETURN (mask4, a[i] < b[i] ? -1 : 0);
+    return int8 (a.lo() ^ b.lo(), a.hi() ^ b.hi());
 #endif
 }
 
-OIIO_FORCEINLINE mask4 operator>  (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_cmpgt_ps (a.m_vec, b.m_vec);
+OIIO_FORCEINLINE int8 int8::operator~ () const {
+    return (*this) ^ NegOne();
+}
+
+OIIO_FORCEINLINE int8 int8::operator<< (const unsigned int bits) const {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_sll_epi32 (m_vec, _mm_cvtsi32_si128 (bits));
 #else
-    SIMD_RETURN (mask4, a[i] > b[i] ? -1 : 0);
+    return int8 (lo() << bits, hi() << bits);
 #endif
 }
 
-OIIO_FORCEINLINE mask4 operator>= (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_cmpge_ps (a.m_vec, b.m_vec);
+OIIO_FORCEINLINE int8 int8::operator>> (const unsigned int bits) const {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_sra_epi32 (m_vec, _mm_cvtsi32_si128 (bits));
 #else
-    SIMD_RETURN (mask4, a[i] >= b[i] ? -1 : 0);
+    int4 l = lo(), h = hi();   // int4::operator>> is non-const
+    return int8 (l >> bits, h >> bits);
 #endif
 }
 
-OIIO_FORCEINLINE mask4 operator<= (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_cmple_ps (a.m_vec, b.m_vec);
+OIIO_FORCEINLINE int8 srl (const int8& val, const unsigned int bits) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_srl_epi32 (val.m_vec, _mm_cvtsi32_si128 (bits));
 #else
-    SIMD_RETURN (mask4, a[i] <= b[i] ? -1 : 0);
+    return int8 (srl (val.lo(), bits), srl (val.hi(), bits));
 #endif
 }
 
-OIIO_FORCEINLINE float4 AxyBxy (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_movelh_ps (a.m_vec, b.m_vec);
+OIIO_FORCEINLINE mask8 operator== (const int8& a, const int8& b) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_castsi256_ps (_mm256_cmpeq_epi32 (a.m_vec, b.m_vec));
 #else
-    return float4 (a[0], a[1], b[0], b[1]);
+    return mask8 (a.lo() == b.lo(), a.hi() == b.hi());
 #endif
 }
 
-OIIO_FORCEINLINE float4 AxBxAyBy (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_unpacklo_ps (a.m_vec, b.m_vec);
+OIIO_FORCEINLINE mask8 operator!= (const int8& a, const int8& b) {
+    return ! (a == b);
+}
+
+OIIO_FORCEINLINE mask8 operator> (const int8& a, const int8& b) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_castsi256_ps (_mm256_cmpgt_epi32 (a.m_vec, b.m_vec));
 #else
-    return float4 (a[0], b[0], a[1], b[1]);
+    return mask8 (a.lo() > b.lo(), a.hi() > b.hi());
 #endif
 }
 
-OIIO_FORCEINLINE float4 float4::xyz0 () const {
-    return insert<3>(*this, 0.0f);
+OIIO_FORCEINLINE mask8 operator< (const int8& a, const int8& b) {
+    return b > a;
 }
 
-OIIO_FORCEINLINE float4 float4::xyz1 () const {
-    return insert<3>(*this, 1.0f);
+OIIO_FORCEINLINE mask8 operator>= (const int8& a, const int8& b) {
+    return ! (b > a);
 }
 
-inline std::ostream& operator<< (std::ostream& cout, const float4& val) {
+OIIO_FORCEINLINE mask8 operator<= (const int8& a, const int8& b) {
+    return ! (a > b);
+}
+
+inline std::ostream& operator<< (std::ostream& cout, const int8& val) {
     cout << val[0];
     for (int i = 1; i < val.elements; ++i)
         cout << ' ' << val[i];
     return cout;
 }
 
+OIIO_FORCEINLINE int reduce_add (const int8& v) {
+    return reduce_add (v.lo() + v.hi());
+}
 
-// Implementation had to be after the definition of float4.
-OIIO_FORCEINLINE int4::int4 (const float4& f)
-{
-#if defined(OIIO_SIMD_SSE)
-    m_vec = _mm_cvttps_epi32(f.simd());
+OIIO_FORCEINLINE int8 blend (const int8& a, const int8& b, const mask8& mask) {
+#if OIIO_SIMD_AVX
+    return _mm256_castps_si256 (_mm256_blendv_ps (_mm256_castsi256_ps (a.simd()),
+                                                  _mm256_castsi256_ps (b.simd()),
+                                                  mask));
 #else
-    SIMD_CONSTRUCT ((int) f[i]);
+    return int8 (blend (a.lo(), b.lo(), mask.lo()),
+                 blend (a.hi(), b.hi(), mask.hi()));
 #endif
 }
 
+OIIO_FORCEINLINE int8 blend0 (const int8& a, const mask8& mask) {
+#if OIIO_SIMD_AVX
+    return _mm256_castps_si256 (_mm256_and_ps (_mm256_castsi256_ps (a.simd()), mask));
+#else
+    return int8 (blend0 (a.lo(), mask.lo()), blend0 (a.hi(), mask.hi()));
+#endif
+}
 
+OIIO_FORCEINLINE int8 select (const mask8& mask, const int8& a, const int8& b) {
+    return blend (b, a, mask);
+}
 
-template<int i0, int i1, int i2, int i3>
-OIIO_FORCEINLINE float4 shuffle (const float4& a) {
-#if defined(OIIO_SIMD_SSE)
-    return shuffle_sse<i0,i1,i2,i3> (__m128(a));
+OIIO_FORCEINLINE int8 abs (const int8& a) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_abs_epi32 (a.simd());
 #else
-    return float4(a[i0], a[i1], a[i2], a[i3]);
+    return int8 (abs (a.lo()), abs (a.hi()));
 #endif
 }
 
-template<int i> OIIO_FORCEINLINE float4 shuffle (const float4& a) { return shuffle<i,i,i,i>(a); }
+OIIO_FORCEINLINE int8 min (const int8& a, const int8& b) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_min_epi32 (a.simd(), b.simd());
+#else
+    return int8 (min (a.lo(), b.lo()), min (a.hi(), b.hi()));
+#endif
+}
 
-#if defined(OIIO_SIMD_NEON)
-template<> OIIO_FORCEINLINE float4 shuffle<0> (const float4& a) {
-    float32x2_t t = vget_low_f32(a.m_vec); return vdupq_lane_f32(t,0);
+OIIO_FORCEINLINE int8 max (const int8& a, const int8& b) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_max_epi32 (a.simd(), b.simd());
+#else
+    return int8 (max (a.lo(), b.lo()), max (a.hi(), b.hi()));
+#endif
 }
-template<> OIIO_FORCEINLINE float4 shuffle<1> (const float4& a) {
-    float32x2_t t = vget_low_f32(a.m_vec); return vdupq_lane_f32(t,1);
+
+OIIO_FORCEINLINE int8 rotl32 (const int8& x, const unsigned int k) {
+    return (x<<k) | srl(x,32-k);
 }
-template<> OIIO_FORCEINLINE float4 shuffle<2> (const float4& a) {
-    float32x2_t t = vget_high_f32(a.m_vec); return vdupq_lane_f32(t,0);
+
+OIIO_FORCEINLINE int8 bitcast_to_int8 (const mask8& x) {
+#if OIIO_SIMD_AVX
+    return _mm256_castps_si256 (x.simd());
+#else
+    return int8 (bitcast_to_int4 (x.lo()), bitcast_to_int4 (x.hi()));
+#endif
 }
-template<> OIIO_FORCEINLINE float4 shuffle<3> (const float4& a) {
-    float32x2_t t = vget_high_f32(a.m_vec); return vdupq_lane_f32(t,1);
+
+OIIO_FORCEINLINE int8 bitcast_to_int8 (const float8& x) {
+#if OIIO_SIMD_AVX
+    return _mm256_castps_si256 (x.simd());
+#else
+    return int8 (bitcast_to_int4 (x.lo()), bitcast_to_int4 (x.hi()));
+#endif
+}
+
+OIIO_FORCEINLINE float8 bitcast_to_float8 (const int8& x) {
+#if OIIO_SIMD_AVX
+    return _mm256_castsi256_ps (x.simd());
+#else
+    return float8 (bitcast_to_float4 (x.lo()), bitcast_to_float4 (x.hi()));
+#endif
 }
+
+OIIO_FORCEINLINE int8 gather (const int *base, const int8 &index) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_i32gather_epi32 (base, index, 4);
+#else
+    int8 r;
+    for (int i = 0; i < r.elements; ++i)
+        r[i] = base[index[i]];
+    return r;
 #endif
+}
 
+OIIO_FORCEINLINE int8 gather (const int *base, const int8 &index,
+                              const mask8 &mask) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_mask_i32gather_epi32 (_mm256_setzero_si256(), base, index,
+                                        bitcast_to_int8 (mask), 4);
+#else
+    int8 r;
+    for (int i = 0; i < r.elements; ++i)
+        r[i] = mask[i] ? base[index[i]] : 0;
+    return r;
+#endif
+}
 
 
-/// Helper: as rapid as possible extraction of one component, when the
-/// index is fixed.
-template<int i>
-OIIO_FORCEINLINE float extract (const float4& a) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_cvtss_f32(shuffle_sse<i,i,i,i>(a.simd()));
+
+//////////////////////////////////////////////////////////////////////
+// float8 implementation
+
+OIIO_FORCEINLINE float8::float8 (float a, float b, float c, float d,
+                                 float e, float f, float g, float h) {
+#if OIIO_SIMD_AVX
+    m_vec = _mm256_setr_ps (a, b, c, d, e, f, g, h);
 #else
-    return a[i];
+    m_val[0] = a;  m_val[1] = b;  m_val[2] = c;  m_val[3] = d;
+    m_val[4] = e;  m_val[5] = f;  m_val[6] = g;  m_val[7] = h;
 #endif
 }
 
-#if defined(OIIO_SIMD_SSE)
-template<> OIIO_FORCEINLINE float extract<0> (const float4& a) {
-    return _mm_cvtss_f32(a.simd());
+OIIO_FORCEINLINE float8::float8 (const float4 &lo, const float4 &hi) {
+#if OIIO_SIMD_AVX
+    m_vec = _mm256_insertf128_ps (_mm256_castps128_ps256 (lo), hi, 1);
+#else
+    lo.store (m_val);
+    hi.store (m_val+4);
+#endif
 }
+
+OIIO_FORCEINLINE float8::float8 (const int8& ival) {
+#if OIIO_SIMD_AVX
+    m_vec = _mm256_cvtepi32_ps (ival);
+#else
+    *this = float8 (float4 (ival.lo()), float4 (ival.hi()));
 #endif
+}
 
+OIIO_FORCEINLINE int8::int8 (const float8& f) {
+#if OIIO_SIMD_AVX
+    m_vec = _mm256_cvttps_epi32 (f);
+#else
+    *this = int8 (int4 (f.lo()), int4 (f.hi()));
+#endif
+}
 
-/// Helper: substitute val for a[i]
-template<int i>
-OIIO_FORCEINLINE float4 insert (const float4& a, float val) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
-    return _mm_insert_ps (a, _mm_set_ss(val), i<<4);
+OIIO_FORCEINLINE const float8 float8::Zero () {
+#if OIIO_SIMD_AVX
+    return _mm256_setzero_ps();
 #else
-    float4 tmp = a;
-    tmp[i] = val;
-    return tmp;
+    return float8(0.0f);
 #endif
 }
 
-#if defined(OIIO_SIMD_SSE)
-// Slightly faster special cases for SSE
-template<> OIIO_FORCEINLINE float4 insert<0> (const float4& a, float val) {
-    return _mm_move_ss (a.simd(), _mm_set_ss(val));
+OIIO_FORCEINLINE const float8 float8::One () {
+    return float8(1.0f);
 }
-#endif
 
+OIIO_FORCEINLINE const float8 float8::Iota (float value) {
+    return float8 (value, value+1.0f, value+2.0f, value+3.0f,
+                   value+4.0f, value+5.0f, value+6.0f, value+7.0f);
+}
 
-OIIO_FORCEINLINE float float4::x () const { return extract<0>(*this); }
-OIIO_FORCEINLINE float float4::y () const { return extract<1>(*this); }
-OIIO_FORCEINLINE float float4::z () const { return extract<2>(*this); }
-OIIO_FORCEINLINE float float4::w () const { return extract<3>(*this); }
-OIIO_FORCEINLINE void float4::set_x (float val) { *this = insert<0>(*this, val); }
-OIIO_FORCEINLINE void float4::set_y (float val) { *this = insert<1>(*this, val); }
-OIIO_FORCEINLINE void float4::set_z (float val) { *this = insert<2>(*this, val); }
-OIIO_FORCEINLINE void float4::set_w (float val) { *this = insert<3>(*this, val); }
+OIIO_FORCEINLINE void float8::clear () {
+    *this = Zero();
+}
 
+OIIO_FORCEINLINE const float8 & float8::operator= (const float8 &other) {
+    m_vec = other.m_vec;
+    return *this;
+}
 
-OIIO_FORCEINLINE int4 bitcast_to_int4 (const float4& x)
-{
-#if defined(OIIO_SIMD_SSE)
-    return _mm_castps_si128 (x.simd());
-#else
-    return *(int4 *)&x;
-#endif
+OIIO_FORCEINLINE float& float8::operator[] (int i) {
+    DASSERT(i >= 0 && i < elements);
+    return m_val[i];
 }
 
-OIIO_FORCEINLINE float4 bitcast_to_float4 (const int4& x)
-{
-#if defined(OIIO_SIMD_SSE)
-    return _mm_castsi128_ps (x.simd());
+OIIO_FORCEINLINE float float8::operator[] (int i) const {
+    DASSERT(i >= 0 && i < elements);
+    return m_val[i];
+}
+
+OIIO_FORCEINLINE float4 float8::lo () const {
+#if OIIO_SIMD_AVX
+    return _mm256_castps256_ps128 (m_vec);
 #else
-    return *(float4 *)&x;
+    return float4 (m_val);
 #endif
 }
 
-
-OIIO_FORCEINLINE float4 vreduce_add (const float4& v) {
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 3
-    // People seem to agree that SSE3 does add reduction best with 2
-    // horizontal adds.
-    // suppose v = (a, b, c, d)
-    simd::float4 ab_cd = _mm_hadd_ps (v.simd(), v.simd());
-    // ab_cd = (a+b, c+d, a+b, c+d)
-    simd::float4 abcd = _mm_hadd_ps (ab_cd.simd(), ab_cd.simd());
-    // all abcd elements are a+b+c+d
-    return abcd;
-#elif defined(OIIO_SIMD_SSE)
-    // I think this is the best we can do for SSE2, and I'm still not sure
-    // it's faster than the default scalar operation. But anyway...
-    // suppose v = (a, b, c, d)
-    float4 ab_ab_cd_cd = shuffle<1,0,3,2>(v) + v;
-    // now x = (b,a,d,c) + (a,b,c,d) = (a+b,a+b,c+d,c+d)
-    float4 cd_cd_ab_ab = shuffle<2,3,0,1>(ab_ab_cd_cd);
-    // now y = (c+d,c+d,a+b,a+b)
-    float4 abcd = ab_ab_cd_cd + cd_cd_ab_ab;   // a+b+c+d in all components
-    return abcd;
+OIIO_FORCEINLINE float4 float8::hi () const {
+#if OIIO_SIMD_AVX
+    return _mm256_extractf128_ps (m_vec, 1);
 #else
-    return float4 (v[0] + v[1] + v[2] + v[3]);
+    return float4 (m_val+4);
 #endif
 }
 
-
-OIIO_FORCEINLINE float reduce_add (const float4& v) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_cvtss_f32(vreduce_add (v));
+OIIO_FORCEINLINE void float8::load (float val) {
+#if OIIO_SIMD_AVX
+    m_vec = _mm256_set1_ps (val);
 #else
-    return v[0] + v[1] + v[2] + v[3];
+    SIMD_CONSTRUCT (val);
 #endif
 }
 
-OIIO_FORCEINLINE float4 vdot (const float4 &a, const float4 &b) {
-#if OIIO_SIMD_SSE >= 4
-    return _mm_dp_ps (a.simd(), b.simd(), 0xff);
-#elif OIIO_SIMD_NEON
-    float32x4_t ab = vmulq_f32(a, b);
-    float32x4_t sum1 = vaddq_f32(ab, vrev64q_f32(ab));
-    return vaddq_f32(sum1, vcombine_f32(vget_high_f32(sum1), vget_low_f32(sum1)));
+OIIO_FORCEINLINE void float8::load (const float *values) {
+#if OIIO_SIMD_AVX
+    m_vec = _mm256_loadu_ps (values);
 #else
-    return vreduce_add (a*b);
+    SIMD_CONSTRUCT (values[i]);
 #endif
 }
 
-OIIO_FORCEINLINE float dot (const float4 &a, const float4 &b) {
-#if OIIO_SIMD_SSE >= 4
-    return _mm_cvtss_f32 (_mm_dp_ps (a.simd(), b.simd(), 0xff));
+OIIO_FORCEINLINE void float8::load (const float *values, int n) {
+    DASSERT (n >= 0 && n <= elements);
+#if OIIO_SIMD_AVX
+    __m256i mask = _mm256_castps_si256 (Iota() < float8(float(n)));
+    m_vec = _mm256_maskload_ps (values, mask);
 #else
-    return reduce_add (a*b);
+    for (int i = 0; i < n; ++i)
+        m_val[i] = values[i];
+    for (int i = n; i < elements; ++i)
+        m_val[i] = 0.0f;
 #endif
 }
 
-OIIO_FORCEINLINE float4 vdot3 (const float4 &a, const float4 &b) {
-#if OIIO_SIMD_SSE >= 4
-    return _mm_dp_ps (a.simd(), b.simd(), 0x7f);
+OIIO_FORCEINLINE void float8::store (float *values) const {
+#if OIIO_SIMD_AVX
+    _mm256_storeu_ps (values, m_vec);
 #else
-    return vreduce_add((a*b).xyz0());
+    SIMD_DO (values[i] = m_val[i]);
 #endif
 }
 
-OIIO_FORCEINLINE float dot3 (const float4 &a, const float4 &b) {
-#if OIIO_SIMD_SSE >= 4
-    return _mm_cvtss_f32 (_mm_dp_ps (a.simd(), b.simd(), 0x77));
+OIIO_FORCEINLINE void float8::store (float *values, int n) const {
+    DASSERT (n >= 0 && n <= elements);
+#if OIIO_SIMD_AVX
+    __m256i mask = _mm256_castps_si256 (Iota() < float8(float(n)));
+    _mm256_maskstore_ps (values, mask, m_vec);
 #else
-    return reduce_add ((a*b).xyz0());
+    for (int i = 0; i < n; ++i)
+        values[i] = m_val[i];
 #endif
 }
 
-
-OIIO_FORCEINLINE float4 blend (const float4& a, const float4& b, const mask4& mask)
-{
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4
-    // SSE >= 4.1 only
-    return _mm_blendv_ps (a.simd(), b.simd(), mask.simd());
-#elif defined(OIIO_SIMD_SSE)
-    // Trick for SSE < 4.1
-    return _mm_or_ps (_mm_and_ps(mask.simd(), b.simd()),
-                      _mm_andnot_ps(mask.simd(), a.simd()));
+OIIO_FORCEINLINE void float8::store (float *values, const mask8 &mask) const {
+#if OIIO_SIMD_AVX
+    _mm256_maskstore_ps (values, _mm256_castps_si256 (mask), m_vec);
 #else
-    return float4 (mask[0] ? b[0] : a[0],
-                   mask[1] ? b[1] : a[1],
-                   mask[2] ? b[2] : a[2],
-                   mask[3] ? b[3] : a[3]);
+    SIMD_DO (if (mask[i]) values[i] = m_val[i]);
 #endif
 }
 
-
-OIIO_FORCEINLINE float4 blend0 (const float4& a, const mask4& mask)
-{
-#if defined(OIIO_SIMD_SSE)
-    return _mm_and_ps(mask.simd(), a.simd());
+#ifdef _HALF_H_
+OIIO_FORCEINLINE void float8::load (const half *values) {
+#if OIIO_SIMD_AVX && defined(__F16C__)
+    m_vec = _mm256_cvtph_ps (_mm_loadu_si128 ((const __m128i *)values));
 #else
-    return float4 (mask[0] ? a[0] : 0.0f,
-                   mask[1] ? a[1] : 0.0f,
-                   mask[2] ? a[2] : 0.0f,
-                   mask[3] ? a[3] : 0.0f);
+    *this = float8 (float4(values), float4(values+4));
 #endif
 }
 
-
-OIIO_FORCEINLINE float4 blend0not (const float4& a, const mask4& mask)
-{
-#if defined(OIIO_SIMD_SSE)
-    return _mm_andnot_ps(mask.simd(), a.simd());
+OIIO_FORCEINLINE void float8::store (half *values) const {
+#if OIIO_SIMD_AVX && defined(__F16C__)
+    __m128i h = _mm256_cvtps_ph (m_vec, (_MM_FROUND_TO_NEAREST_INT |_MM_FROUND_NO_EXC));
+    _mm_storeu_si128 ((__m128i *)values, h);
 #else
-    return float4 (mask[0] ? 0.0f : a[0],
-                   mask[1] ? 0.0f : a[1],
-                   mask[2] ? 0.0f : a[2],
-                   mask[3] ? 0.0f : a[3]);
+    lo().store (values);
+    hi().store (values+4);
 #endif
 }
+#endif
 
-
-OIIO_FORCEINLINE float4 safe_div (const float4 &a, const float4 &b) {
-#if defined(OIIO_SIMD_SSE)
-    return blend0not (a/b, b == float4::Zero());
+OIIO_FORCEINLINE float8 operator+ (const float8& a, const float8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_add_ps (a.m_vec, b.m_vec);
 #else
-    return float4 (b[0] == 0.0f ? 0.0f : a[0] / b[0],
-                   b[1] == 0.0f ? 0.0f : a[1] / b[1],
-                   b[2] == 0.0f ? 0.0f : a[2] / b[2],
-                   b[3] == 0.0f ? 0.0f : a[3] / b[3]);
+    return float8 (a.lo() + b.lo(), a.hi() + b.hi());
 #endif
 }
 
+OIIO_FORCEINLINE const float8 & float8::operator+= (const float8& a) {
+    return *this = *this + a;
+}
 
-OIIO_FORCEINLINE float3 hdiv (const float4 &a)
-{
-#if defined(OIIO_SIMD_SSE)
-    return float3(safe_div(a, shuffle<3>(a)).xyz0());
+OIIO_FORCEINLINE float8 float8::operator- () const {
+#if OIIO_SIMD_AVX
+    return _mm256_sub_ps (_mm256_setzero_ps(), m_vec);
 #else
-    float d = a[3];
-    return d == 0.0f ? float3 (0.0f) : float3 (a[0]/d, a[1]/d, a[2]/d);
+    return float8 (-lo(), -hi());
 #endif
 }
 
+OIIO_FORCEINLINE float8 operator- (const float8& a, const float8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_sub_ps (a.m_vec, b.m_vec);
+#else
+    return float8 (a.lo() - b.lo(), a.hi() - b.hi());
+#endif
+}
 
+OIIO_FORCEINLINE const float8 & float8::operator-= (const float8& a) {
+    return *this = *this - a;
+}
 
-OIIO_FORCEINLINE float4 select (const mask4& mask, const float4& a, const float4& b)
-{
-    return blend (b, a, mask);
+OIIO_FORCEINLINE float8 operator* (const float8& a, const float8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_mul_ps (a.m_vec, b.m_vec);
+#else
+    return float8 (a.lo() * b.lo(), a.hi() * b.hi());
+#endif
 }
 
+OIIO_FORCEINLINE const float8 & float8::operator*= (const float8& a) {
+    return *this = *this * a;
+}
 
-OIIO_FORCEINLINE float4 abs (const float4& a)
-{
-#if defined(OIIO_SIMD_SSE)
-    // Just clear the sign bit for cheap fabsf
-    return _mm_and_ps (a.simd(), _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+OIIO_FORCEINLINE float8 operator/ (const float8& a, const float8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_div_ps (a.m_vec, b.m_vec);
 #else
-    return float4 (fabsf(a[0]), fabsf(a[1]), fabsf(a[2]), fabsf(a[3]));
+    return float8 (a.lo() / b.lo(), a.hi() / b.hi());
 #endif
 }
 
+OIIO_FORCEINLINE const float8 & float8::operator/= (const float8& a) {
+    return *this = *this / a;
+}
 
-OIIO_FORCEINLINE float4 sign (const float4& a)
-{
-    float4 one(1.0f);
-    return blend (one, -one, a < float4::Zero());
+OIIO_FORCEINLINE mask8 operator== (const float8& a, const float8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_cmp_ps (a.m_vec, b.m_vec, _CMP_EQ_OQ);
+#else
+    return mask8 (a.lo() == b.lo(), a.hi() == b.hi());
+#endif
 }
 
+OIIO_FORCEINLINE mask8 operator!= (const float8& a, const float8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_cmp_ps (a.m_vec, b.m_vec, _CMP_NEQ_UQ);
+#else
+    return mask8 (a.lo() != b.lo(), a.hi() != b.hi());
+#endif
+}
 
-OIIO_FORCEINLINE float4 ceil (const float4& a)
-{
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4  /* SSE >= 4.1 */
-    return _mm_ceil_ps (a);
+OIIO_FORCEINLINE mask8 operator< (const float8& a, const float8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_cmp_ps (a.m_vec, b.m_vec, _CMP_LT_OQ);
 #else
-    return float4 (ceilf(a[0]), ceilf(a[1]), ceilf(a[2]), ceilf(a[3]));
+    return mask8 (a.lo() < b.lo(), a.hi() < b.hi());
 #endif
 }
 
-OIIO_FORCEINLINE float4 floor (const float4& a)
-{
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4  /* SSE >= 4.1 */
-    return _mm_floor_ps (a);
+OIIO_FORCEINLINE mask8 operator> (const float8& a, const float8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_cmp_ps (a.m_vec, b.m_vec, _CMP_GT_OQ);
 #else
-    return float4 (floorf(a[0]), floorf(a[1]), floorf(a[2]), floorf(a[3]));
+    return mask8 (a.lo() > b.lo(), a.hi() > b.hi());
 #endif
 }
 
-OIIO_FORCEINLINE float4 round (const float4& a)
-{
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4  /* SSE >= 4.1 */
-    return _mm_round_ps (a, (_MM_FROUND_TO_NEAREST_INT |_MM_FROUND_NO_EXC));
+OIIO_FORCEINLINE mask8 operator>= (const float8& a, const float8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_cmp_ps (a.m_vec, b.m_vec, _CMP_GE_OQ);
 #else
-    return float4 (roundf(a[0]), roundf(a[1]), roundf(a[2]), roundf(a[3]));
+    return mask8 (a.lo() >= b.lo(), a.hi() >= b.hi());
 #endif
 }
 
-OIIO_FORCEINLINE int4 floori (const float4& a)
-{
-#if defined(OIIO_SIMD_SSE) && OIIO_SIMD_SSE >= 4  /* SSE >= 4.1 */
-    return int4(floor(a));
-#elif defined(OIIO_SIMD_SSE)   /* SSE2/3 */
-    int4 i (a);  // truncates
-    int4 isneg = bitcast_to_int4 (a < float4::Zero());
-    return i + isneg;
-    // The trick here (thanks, Cycles, for letting me spy on your code) is
-    // that the comparison will return (int)-1 for components that are less
-    // than zero, and adding that is the same as subtracting one!
+OIIO_FORCEINLINE mask8 operator<= (const float8& a, const float8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_cmp_ps (a.m_vec, b.m_vec, _CMP_LE_OQ);
 #else
-    return int4 ((int)floorf(a[0]), (int)floorf(a[1]),
-                 (int)floorf(a[2]), (int)floorf(a[3]));
+    return mask8 (a.lo() <= b.lo(), a.hi() <= b.hi());
 #endif
 }
 
+inline std::ostream& operator<< (std::ostream& cout, const float8& val) {
+    cout << val[0];
+    for (int i = 1; i < val.elements; ++i)
+        cout << ' ' << val[i];
+    return cout;
+}
+
+OIIO_FORCEINLINE float reduce_add (const float8& v) {
+    return reduce_add (v.lo() + v.hi());
+}
 
-OIIO_FORCEINLINE int4 rint (const float4& a)
-{
-    return int4 (round(a));
+OIIO_FORCEINLINE float8 blend (const float8& a, const float8& b, const mask8& mask) {
+#if OIIO_SIMD_AVX
+    return _mm256_blendv_ps (a, b, mask);
+#else
+    return float8 (blend (a.lo(), b.lo(), mask.lo()),
+                   blend (a.hi(), b.hi(), mask.hi()));
+#endif
 }
 
+OIIO_FORCEINLINE float8 blend0 (const float8& a, const mask8& mask) {
+#if OIIO_SIMD_AVX
+    return _mm256_and_ps (a, mask);
+#else
+    return float8 (blend0 (a.lo(), mask.lo()), blend0 (a.hi(), mask.hi()));
+#endif
+}
 
+OIIO_FORCEINLINE float8 select (const mask8& mask, const float8& a, const float8& b) {
+    return blend (b, a, mask);
+}
 
-OIIO_FORCEINLINE float4 sqrt (const float4 &a)
-{
-#if OIIO_SIMD_SSE
-    return _mm_sqrt_ps (a.simd());
+OIIO_FORCEINLINE float8 abs (const float8& a) {
+#if OIIO_SIMD_AVX
+    return _mm256_and_ps (a, _mm256_castsi256_ps (_mm256_set1_epi32 (0x7fffffff)));
 #else
-    return float4 (sqrtf(a[0]), sqrtf(a[1]), sqrtf(a[2]), sqrtf(a[3]));
+    return float8 (abs (a.lo()), abs (a.hi()));
 #endif
 }
 
+OIIO_FORCEINLINE float8 ceil (const float8& a) {
+#if OIIO_SIMD_AVX
+    return _mm256_ceil_ps (a);
+#else
+    return float8 (ceil (a.lo()), ceil (a.hi()));
+#endif
+}
 
+OIIO_FORCEINLINE float8 floor (const float8& a) {
+#if OIIO_SIMD_AVX
+    return _mm256_floor_ps (a);
+#else
+    return float8 (floor (a.lo()), floor (a.hi()));
+#endif
+}
 
-OIIO_FORCEINLINE float4 rsqrt (const float4 &a)
-{
-#if OIIO_SIMD_SSE
-    return _mm_div_ps (_mm_set1_ps(1.0f), _mm_sqrt_ps (a.simd()));
+OIIO_FORCEINLINE float8 round (const float8& a) {
+#if OIIO_SIMD_AVX
+    return _mm256_round_ps (a, (_MM_FROUND_TO_NEAREST_INT |_MM_FROUND_NO_EXC));
 #else
-    return float4 (1.0f/sqrtf(a[0]), 1.0f/sqrtf(a[1]),
-                   1.0f/sqrtf(a[2]), 1.0f/sqrtf(a[3]));
+    return float8 (round (a.lo()), round (a.hi()));
 #endif
 }
 
+OIIO_FORCEINLINE int8 floori (const float8& a) {
+#if OIIO_SIMD_AVX
+    return int8 (floor (a));
+#else
+    return int8 (floori (a.lo()), floori (a.hi()));
+#endif
+}
 
+OIIO_FORCEINLINE float8 sqrt (const float8 &a) {
+#if OIIO_SIMD_AVX
+    return _mm256_sqrt_ps (a);
+#else
+    return float8 (sqrt (a.lo()), sqrt (a.hi()));
+#endif
+}
 
-OIIO_FORCEINLINE float4 rsqrt_fast (const float4 &a)
-{
-#if OIIO_SIMD_SSE
-    return _mm_rsqrt_ps (a.simd());
+OIIO_FORCEINLINE float8 rsqrt (const float8 &a) {
+#if OIIO_SIMD_AVX
+    return _mm256_div_ps (_mm256_set1_ps (1.0f), _mm256_sqrt_ps (a));
 #else
-    return float4 (1.0f/sqrtf(a[0]), 1.0f/sqrtf(a[1]),
-                   1.0f/sqrtf(a[2]), 1.0f/sqrtf(a[3]));
+    return float8 (rsqrt (a.lo()), rsqrt (a.hi()));
 #endif
 }
 
+OIIO_FORCEINLINE float8 rsqrt_fast (const float8 &a) {
+#if OIIO_SIMD_AVX
+    return _mm256_rsqrt_ps (a);
+#else
+    return float8 (rsqrt_fast (a.lo()), rsqrt_fast (a.hi()));
+#endif
+}
 
+OIIO_FORCEINLINE float8 rcp_fast (const float8 &a) {
+#if OIIO_SIMD_AVX
+    return _mm256_rcp_ps (a);
+#elif defined(OIIO_SIMD_SSE)
+    return float8 (float4 (_mm_rcp_ps (a.lo())), float4 (_mm_rcp_ps (a.hi())));
+#else
+    return float8(1.0f) / a;
+#endif
+}
 
-OIIO_FORCEINLINE float4 min (const float4& a, const float4& b)
-{
-#if defined(OIIO_SIMD_SSE)
-    return _mm_min_ps (a, b);
+OIIO_FORCEINLINE float8 min (const float8& a, const float8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_min_ps (a, b);
 #else
-    return float4 (std::min (a[0], b[0]),
-                   std::min (a[1], b[1]),
-                   std::min (a[2], b[2]),
-                   std::min (a[3], b[3]));
+    return float8 (min (a.lo(), b.lo()), min (a.hi(), b.hi()));
 #endif
 }
 
-OIIO_FORCEINLINE float4 max (const float4& a, const float4& b)
-{
-#if defined(OIIO_SIMD_SSE)
-    return _mm_max_ps (a, b);
+OIIO_FORCEINLINE float8 max (const float8& a, const float8& b) {
+#if OIIO_SIMD_AVX
+    return _mm256_max_ps (a, b);
 #else
-    return float4 (std::max (a[0], b[0]),
-                   std::max (a[1], b[1]),
-                   std::max (a[2], b[2]),
-                   std::max (a[3], b[3]));
+    return float8 (max (a.lo(), b.lo()), max (a.hi(), b.hi()));
 #endif
 }
 
+OIIO_FORCEINLINE float8 madd (const float8& a, const float8& b, const float8& c) {
+#if OIIO_SIMD_AVX && OIIO_FMA_ENABLED
+    return _mm256_fmadd_ps (a, b, c);
+#else
+    return a * b + c;
+#endif
+}
 
+OIIO_FORCEINLINE float8 msub (const float8& a, const float8& b, const float8& c) {
+#if OIIO_SIMD_AVX && OIIO_FMA_ENABLED
+    return _mm256_fmsub_ps (a, b, c);
+#else
+    return a * b - c;
+#endif
+}
 
-OIIO_FORCEINLINE float4 andnot (const float4& a, const float4& b) {
-#if defined(OIIO_SIMD_SSE)
-    return _mm_andnot_ps (a.simd(), b.simd());
+OIIO_FORCEINLINE float8 nmadd (const float8& a, const float8& b, const float8& c) {
+#if OIIO_SIMD_AVX && OIIO_FMA_ENABLED
+    return _mm256_fnmadd_ps (a, b, c);
 #else
-    const int *ai = (const int *)&a;
-    const int *bi = (const int *)&b;
-    return bitcast_to_float4 (int4(~(ai[0]) & bi[0],
-                                   ~(ai[1]) & bi[1],
-                                   ~(ai[2]) & bi[2],
-                                   ~(ai[3]) & bi[3]));
+    return c - a * b;
 #endif
 }
 
+OIIO_FORCEINLINE float8 nmsub (const float8& a, const float8& b, const float8& c) {
+#if OIIO_SIMD_AVX && OIIO_FMA_ENABLED
+    return _mm256_fnmsub_ps (a, b, c);
+#else
+    return -(a * b) - c;
+#endif
+}
 
+OIIO_FORCEINLINE float8 exp (const float8& v) {
+    // FIXME: a native 8-wide version of the float4 polynomial
+    return float8 (exp (v.lo()), exp (v.hi()));
+}
 
-OIIO_FORCEINLINE float4 madd (const simd::float4& a, const simd::float4& b,
-                              const simd::float4& c)
-{
-#if OIIO_SIMD_SSE && OIIO_FMA_ENABLED
-    // If we are sure _mm_fmadd_ps intrinsic is available, use it.
-    return _mm_fmadd_ps (a, b, c);
-#elif OIIO_SIMD_SSE && !defined(_MSC_VER)
-    // If we directly access the underlying __m128, on some platforms and
-    // compiler flags, it will turn into fma anyway, even if we don't use
-    // the intrinsic.
-    return a.simd() * b.simd() + c.simd();
+OIIO_FORCEINLINE float8 log (const float8& v) {
+    return float8 (log (v.lo()), log (v.hi()));
+}
+
+OIIO_FORCEINLINE float8 gather (const float *base, const int8 &index) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_i32gather_ps (base, index, 4);
 #else
-    // Fallback: just use regular math and hope for the best.
-    return a * b + c;
+    float8 r;
+    for (int i = 0; i < r.elements; ++i)
+        r[i] = base[index[i]];
+    return r;
 #endif
 }
 
-
-OIIO_FORCEINLINE float4 msub (const simd::float4& a, const simd::float4& b,
-                              const simd::float4& c)
-{
-#if OIIO_SIMD_SSE && OIIO_FMA_ENABLED
-    // If we are sure _mm_fnmsub_ps intrinsic is available, use it.
-    return _mm_fmsub_ps (a, b, c);
-#elif OIIO_SIMD_SSE && !defined(_MSC_VER)
-    // If we directly access the underlying __m128, on some platforms and
-    // compiler flags, it will turn into fma anyway, even if we don't use
-    // the intrinsic.
-    return a.simd() * b.simd() - c.simd();
+OIIO_FORCEINLINE float8 gather (const float *base, const int8 &index,
+                                const mask8 &mask) {
+#if OIIO_SIMD_AVX >= 2
+    return _mm256_mask_i32gather_ps (_mm256_setzero_ps(), base, index, mask, 4);
 #else
-    // Fallback: just use regular math and hope for the best.
-    return a * b - c;
+    float8 r;
+    for (int i = 0; i < r.elements; ++i)
+        r[i] = mask[i] ? base[index[i]] : 0.0f;
+    return r;
 #endif
 }
 
 
 
-OIIO_FORCEINLINE float4 nmadd (const simd::float4& a, const simd::float4& b,
-                               const simd::float4& c)
-{
-#if OIIO_SIMD_SSE && OIIO_FMA_ENABLED
-    // If we are sure _mm_fnmadd_ps intrinsic is available, use it.
-    return _mm_fnmadd_ps (a, b, c);
-#elif OIIO_SIMD_SSE && !defined(_MSC_VER)
-    // If we directly access the underlying __m128, on some platforms and
-    // compiler flags, it will turn into fma anyway, even if we don't use
-    // the intrinsic.
-    return c.simd() - a.simd() * b.simd();
-#else
-    // Fallback: just use regular math and hope for the best.
-    return c - a * b;
-#endif
+//////////////////////////////////////////////////////////////////////
+// mask16 implementation
+
+inline std::ostream& operator<< (std::ostream& cout, const mask16 & a) {
+    cout << a[0];
+    for (int i = 1; i < a.elements; ++i)
+        cout << ' ' << a[i];
+    return cout;
 }
 
 
 
-OIIO_FORCEINLINE float4 nmsub (const simd::float4& a, const simd::float4& b,
-                               const simd::float4& c)
-{
-#if OIIO_SIMD_SSE && OIIO_FMA_ENABLED
-    // If we are sure _mm_fnmsub_ps intrinsic is available, use it.
-    return _mm_fnmsub_ps (a, b, c);
-#elif OIIO_SIMD_SSE && !defined(_MSC_VER)
-    // If we directly access the underlying __m128, on some platforms and
-    // compiler flags, it will turn into fma anyway, even if we don't use
-    // the intrinsic.
-    return -(a.simd() * b.simd()) - c.simd();
+//////////////////////////////////////////////////////////////////////
+// int16 implementation
+
+OIIO_FORCEINLINE int16::int16 (const int8 &lo, const int8 &hi) {
+#if OIIO_SIMD_AVX >= 512
+    m_vec = _mm512_inserti64x4 (_mm512_inserti64x4 (_mm512_setzero_si512(), lo, 0), hi, 1);
 #else
-    // Fallback: just use regular math and hope for the best.
-    return -(a * b) - c;
+    lo.store (m_val);
+    hi.store (m_val+8);
 #endif
 }
 
+OIIO_FORCEINLINE const int16 int16::Iota (int value) {
+    return int16 (int8::Iota (value), int8::Iota (value+8));
+}
 
+OIIO_FORCEINLINE const int16 & int16::operator= (const int16 &other) {
+    m_vec = other.m_vec;
+    return *this;
+}
 
-// Full precision exp() of all components of a SIMD vector.
-OIIO_FORCEINLINE float4 exp (const float4& v)
-{
-#if OIIO_SIMD_SSE
-    // Implementation inspired by:
-    // https://github.com/embree/embree/blob/master/common/simd/sse_special.h
-    // Which is listed as Copyright (C) 2007  Julien Pommier and distributed
-    // under the zlib license.
-    float4 x = v;
-    OIIO_SIMD_FLOAT4_CONST (exp_hi,  88.3762626647949f);
-    OIIO_SIMD_FLOAT4_CONST (exp_lo,  -88.3762626647949f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_LOG2EF, 1.44269504088896341f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_exp_C1, 0.693359375f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_exp_C2, -2.12194440e-4f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_exp_p0, 1.9875691500E-4f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_exp_p1, 1.3981999507E-3f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_exp_p2, 8.3334519073E-3f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_exp_p3, 4.1665795894E-2f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_exp_p4, 1.6666665459E-1f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_exp_p5, 5.0000001201E-1f);
-    float4 tmp (0.0f);
-    float4 one (1.0f);
-    x = min (x, float4(exp_hi));
-    x = max (x, float4(exp_lo));
-    float4 fx = madd (x, float4(cephes_LOG2EF), float4(0.5f));
-    int4 emm0 = int4(fx);
-    tmp = float4(emm0);
-    float4 mask = bitcast_to_float4 (bitcast_to_int4(tmp > fx) & bitcast_to_int4(one));
-    fx = tmp - mask;
-    tmp = fx * float4(cephes_exp_C1);
-    float4 z = fx * float4(cephes_exp_C2);
-    x = x - tmp;
-    x = x - z;
-    z = x * x;
-    float4 y = float4(cephes_exp_p0);
-    y = madd (y, x, float4(cephes_exp_p1));
-    y = madd (y, x, float4(cephes_exp_p2));
-    y = madd (y, x, float4(cephes_exp_p3));
-    y = madd (y, x, float4(cephes_exp_p4));
-    y = madd (y, x, float4(cephes_exp_p5));
-    y = madd (y, z, x);
-    y = y + one;
-    emm0 = (int4(fx) + int4(0x7f)) << 23;
-    float4 pow2n = bitcast_to_float4(emm0);
-    y = y * pow2n;
-    return y;
+OIIO_FORCEINLINE int& int16::operator[] (int i) {
+    DASSERT(i >= 0 && i < elements);
+    return m_val[i];
+}
 
+OIIO_FORCEINLINE int int16::operator[] (int i) const {
+    DASSERT(i >= 0 && i < elements);
+    return m_val[i];
+}
+
+OIIO_FORCEINLINE int8 int16::lo () const {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_castsi512_si256 (m_vec);
 #else
-    return float4 (expf(v[0]), expf(v[1]), expf(v[2]), expf(v[3]));
+    return int8 (m_val);
 #endif
 }
 
+OIIO_FORCEINLINE int8 int16::hi () const {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_extracti64x4_epi64 (m_vec, 1);
+#else
+    return int8 (m_val+8);
+#endif
+}
 
+OIIO_FORCEINLINE void int16::load (int a) {
+#if OIIO_SIMD_AVX >= 512
+    m_vec = _mm512_set1_epi32 (a);
+#else
+    SIMD_CONSTRUCT (a);
+#endif
+}
 
-// Full precision log() of all components of a SIMD vector.
-OIIO_FORCEINLINE float4 log (const float4& v)
-{
-#if OIIO_SIMD_SSE
-    // Implementation inspired by:
-    // https://github.com/embree/embree/blob/master/common/simd/sse_special.h
-    // Which is listed as Copyright (C) 2007  Julien Pommier and distributed
-    // under the zlib license.
-    float4 x = v;
-    int4 emm0;
-    float4 zero (float4::Zero());
-    float4 one (1.0f);
-    mask4 invalid_mask = (x <= zero);
-    OIIO_SIMD_INT4_CONST (min_norm_pos, (int)0x00800000);
-    OIIO_SIMD_INT4_CONST (inv_mant_mask, (int)~0x7f800000);
-    x = max(x, bitcast_to_float4(int4(min_norm_pos)));  /* cut off denormalized stuff */
-    emm0 = srl (bitcast_to_int4(x), 23);
-    /* keep only the fractional part */
-    x = bitcast_to_float4 (bitcast_to_int4(x) & int4(inv_mant_mask));
-    x = bitcast_to_float4 (bitcast_to_int4(x) | bitcast_to_int4(float4(0.5f)));
-    emm0 = emm0 - int4(0x7f);
-    float4 e (emm0);
-    e = e + one;
-    OIIO_SIMD_FLOAT4_CONST (cephes_SQRTHF, 0.707106781186547524f);
-    mask4 mask = (x < float4(cephes_SQRTHF));
-    float4 tmp = bitcast_to_float4 (bitcast_to_int4(x) & bitcast_to_int4(mask));
-    x = x - one;
-    e = e - bitcast_to_float4 (bitcast_to_int4(one) & bitcast_to_int4(mask));
-    x = x + tmp;
-    float4 z = x * x;
-    OIIO_SIMD_FLOAT4_CONST (cephes_log_p0, 7.0376836292E-2f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_log_p1, - 1.1514610310E-1f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_log_p2, 1.1676998740E-1f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_log_p3, - 1.2420140846E-1f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_log_p4, + 1.4249322787E-1f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_log_p5, - 1.6668057665E-1f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_log_p6, + 2.0000714765E-1f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_log_p7, - 2.4999993993E-1f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_log_p8, + 3.3333331174E-1f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_log_q1, -2.12194440e-4f);
-    OIIO_SIMD_FLOAT4_CONST (cephes_log_q2, 0.693359375f);
-    float4 y = *(float4*)cephes_log_p0;
-    y = madd (y, x, float4(cephes_log_p1));
-    y = madd (y, x, float4(cephes_log_p2));
-    y = madd (y, x, float4(cephes_log_p3));
-    y = madd (y, x, float4(cephes_log_p4));
-    y = madd (y, x, float4(cephes_log_p5));
-    y = madd (y, x, float4(cephes_log_p6));
-    y = madd (y, x, float4(cephes_log_p7));
-    y = madd (y, x, float4(cephes_log_p8));
-    y = y * x;
-    y = y * z;
-    y = madd(e, float4(cephes_log_q1), y);
-    y = nmadd (z, 0.5f, y);
-    x = x + y;
-    x = madd (e, float4(cephes_log_q2), x);
-    x = bitcast_to_float4 (bitcast_to_int4(x) | bitcast_to_int4(invalid_mask)); // negative arg will be NAN
-    return x;
+OIIO_FORCEINLINE void int16::load (const int *values) {
+#if OIIO_SIMD_AVX >= 512
+    m_vec = _mm512_loadu_si512 ((const void *)values);
 #else
-    return float4 (logf(v[0]), logf(v[1]), logf(v[2]), logf(v[3]));
+    SIMD_CONSTRUCT (values[i]);
 #endif
 }
 
+OIIO_FORCEINLINE void int16::load (const int *values, int n) {
+    DASSERT (n >= 0 && n <= elements);
+#if OIIO_SIMD_AVX >= 512
+    m_vec = _mm512_maskz_loadu_epi32 (__mmask16((1<<n)-1), (const void *)values);
+#else
+    for (int i = 0; i < n; ++i)
+        m_val[i] = values[i];
+    for (int i = n; i < elements; ++i)
+        m_val[i] = 0;
+#endif
+}
 
+OIIO_FORCEINLINE void int16::store (int *values) const {
+#if OIIO_SIMD_AVX >= 512
+    _mm512_storeu_si512 ((void *)values, m_vec);
+#else
+    SIMD_DO (values[i] = m_val[i]);
+#endif
+}
 
-OIIO_FORCEINLINE void transpose (float4 &a, float4 &b, float4 &c, float4 &d)
-{
-#if defined(OIIO_SIMD_SSE)
-    _MM_TRANSPOSE4_PS (a, b, c, d);
+OIIO_FORCEINLINE void int16::store (int *values, int n) const {
+    DASSERT (n >= 0 && n <= elements);
+#if OIIO_SIMD_AVX >= 512
+    _mm512_mask_storeu_epi32 ((void *)values, __mmask16((1<<n)-1), m_vec);
 #else
-    float4 A (a[0], b[0], c[0], d[0]);
-    float4 B (a[1], b[1], c[1], d[1]);
-    float4 C (a[2], b[2], c[2], d[2]);
-    float4 D (a[3], b[3], c[3], d[3]);
-    a = A;  b = B;  c = C;  d = D;
+    for (int i = 0; i < n; ++i)
+        values[i] = m_val[i];
 #endif
 }
 
+OIIO_FORCEINLINE void int16::store (int *values, const mask16 &mask) const {
+#if OIIO_SIMD_AVX >= 512
+    _mm512_mask_storeu_epi32 ((void *)values, __mmask16(mask.bitmask()), m_vec);
+#else
+    lo().store (values, mask.lo());
+    hi().store (values+8, mask.hi());
+#endif
+}
 
-OIIO_FORCEINLINE void transpose (const float4& a, const float4& b, const float4& c, const float4& d,
-                                 float4 &r0, float4 &r1, float4 &r2, float4 &r3)
-{
-#if defined(OIIO_SIMD_SSE)
-    //_MM_TRANSPOSE4_PS (a, b, c, d);
-    float4 l02 = _mm_unpacklo_ps (a, c);
-    float4 h02 = _mm_unpackhi_ps (a, c);
-    float4 l13 = _mm_unpacklo_ps (b, d);
-    float4 h13 = _mm_unpackhi_ps (b, d);
-    r0 = _mm_unpacklo_ps (l02, l13);
-    r1 = _mm_unpackhi_ps (l02, l13);
-    r2 = _mm_unpacklo_ps (h02, h13);
-    r3 = _mm_unpackhi_ps (h02, h13);
+OIIO_FORCEINLINE int16 operator+ (const int16& a, const int16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_add_epi32 (a.m_vec, b.m_vec);
 #else
-    r0.load (a[0], b[0], c[0], d[0]);
-    r1.load (a[1], b[1], c[1], d[1]);
-    r2.load (a[2], b[2], c[2], d[2]);
-    r3.load (a[3], b[3], c[3], d[3]);
+    return int16 (a.lo() + b.lo(), a.hi() + b.hi());
+#endif
+}
+
+OIIO_FORCEINLINE const int16 & int16::operator+= (const int16& a) {
+    return *this = *this + a;
+}
+
+OIIO_FORCEINLINE int16 int16::operator- () const {
+    return int16::Zero() - *this;
+}
+
+OIIO_FORCEINLINE int16 operator- (const int16& a, const int16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_sub_epi32 (a.m_vec, b.m_vec);
+#else
+    return int16 (a.lo() - b.lo(), a.hi() - b.hi());
 #endif
 }
 
+OIIO_FORCEINLINE const int16 & int16::operator-= (const int16& a) {
+    return *this = *this - a;
+}
 
-OIIO_FORCEINLINE void transpose (int4 &a, int4 &b, int4 &c, int4 &d)
-{
-#if defined(OIIO_SIMD_SSE)
-    __m128 A = _mm_castsi128_ps (a);
-    __m128 B = _mm_castsi128_ps (b);
-    __m128 C = _mm_castsi128_ps (c);
-    __m128 D = _mm_castsi128_ps (d);
-    _MM_TRANSPOSE4_PS (A, B, C, D);
-    a = _mm_castps_si128 (A);
-    b = _mm_castps_si128 (B);
-    c = _mm_castps_si128 (C);
-    d = _mm_castps_si128 (D);
+OIIO_FORCEINLINE int16 operator* (const int16& a, const int16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_mullo_epi32 (a.m_vec, b.m_vec);
 #else
-    int4 A (a[0], b[0], c[0], d[0]);
-    int4 B (a[1], b[1], c[1], d[1]);
-    int4 C (a[2], b[2], c[2], d[2]);
-    int4 D (a[3], b[3], c[3], d[3]);
-    a = A;  b = B;  c = C;  d = D;
+    return int16 (a.lo() * b.lo(), a.hi() * b.hi());
 #endif
 }
 
-OIIO_FORCEINLINE void transpose (const int4& a, const int4& b, const int4& c, const int4& d,
-                                 int4 &r0, int4 &r1, int4 &r2, int4 &r3)
-{
-#if defined(OIIO_SIMD_SSE)
-    //_MM_TRANSPOSE4_PS (a, b, c, d);
-    __m128 A = _mm_castsi128_ps (a);
-    __m128 B = _mm_castsi128_ps (b);
-    __m128 C = _mm_castsi128_ps (c);
-    __m128 D = _mm_castsi128_ps (d);
-    _MM_TRANSPOSE4_PS (A, B, C, D);
-    r0 = _mm_castps_si128 (A);
-    r1 = _mm_castps_si128 (B);
-    r2 = _mm_castps_si128 (C);
-    r3 = _mm_castps_si128 (D);
+OIIO_FORCEINLINE const int16 & int16::operator*= (const int16& a) {
+    return *this = *this * a;
+}
+
+OIIO_FORCEINLINE int16 operator& (const int16& a, const int16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_and_si512 (a.m_vec, b.m_vec);
 #else
-    r0.load (a[0], b[0], c[0], d[0]);
-    r1.load (a[1], b[1], c[1], d[1]);
-    r2.load (a[2], b[2], c[2], d[2]);
-    r3.load (a[3], b[3], c[3], d[3]);
+    return int16 (a.lo() & b.lo(), a.hi() & b.hi());
 #endif
 }
 
+OIIO_FORCEINLINE int16 operator| (const int16& a, const int16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_or_si512 (a.m_vec, b.m_vec);
+#else
+    return int16 (a.lo() | b.lo(), a.hi() | b.hi());
+#endif
+}
 
-OIIO_FORCEINLINE float4 AxBxCxDx (const float4& a, const float4& b,
-                                  const float4& c, const float4& d)
-{
-#if defined(OIIO_SIMD_SSE)
-    float4 l02 = _mm_unpacklo_ps (a, c);
-    float4 l13 = _mm_unpacklo_ps (b, d);
-    return _mm_unpacklo_ps (l02, l13);
+OIIO_FORCEINLINE int16 operator^ (const int16& a, const int16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_xor_si512 (a.m_vec, b.m_vec);
 #else
-    return float4 (a[0], b[0], c[0], d[0]);
+    return int16 (a.lo() ^ b.lo(), a.hi() ^ b.hi());
 #endif
 }
 
+OIIO_FORCEINLINE int16 int16::operator~ () const {
+    return (*this) ^ int16(-1);
+}
 
-OIIO_FORCEINLINE int4 AxBxCxDx (const int4& a, const int4& b,
-                                const int4& c, const int4& d)
-{
-#if defined(OIIO_SIMD_SSE)
-    int4 l02 = _mm_unpacklo_epi32 (a, c);
-    int4 l13 = _mm_unpacklo_epi32 (b, d);
-    return _mm_unpacklo_epi32 (l02, l13);
+OIIO_FORCEINLINE int16 int16::operator<< (const unsigned int bits) const {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_sll_epi32 (m_vec, _mm_cvtsi32_si128 (bits));
 #else
-    return int4 (a[0], b[0], c[0], d[0]);
+    return int16 (lo() << bits, hi() << bits);
 #endif
 }
 
+OIIO_FORCEINLINE int16 int16::operator>> (const unsigned int bits) const {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_sra_epi32 (m_vec, _mm_cvtsi32_si128 (bits));
+#else
+    return int16 (lo() >> bits, hi() >> bits);
+#endif
+}
 
+OIIO_FORCEINLINE int16 srl (const int16& val, const unsigned int bits) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_srl_epi32 (val.m_vec, _mm_cvtsi32_si128 (bits));
+#else
+    return int16 (srl (val.lo(), bits), srl (val.hi(), bits));
+#endif
+}
 
-//////////////////////////////////////////////////////////////////////
-// float3 implementation
-
-OIIO_FORCEINLINE float3::float3 (const float3 &other) {
-#if defined(OIIO_SIMD_SSE) || defined(OIIO_SIMD_NEON)
-    m_vec = other.m_vec;
+OIIO_FORCEINLINE mask16 operator== (const int16& a, const int16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return mask16::from_bitmask (_mm512_cmpeq_epi32_mask (a.m_vec, b.m_vec));
 #else
-    SIMD_CONSTRUCT_PAD (other[i]);
+    return mask16 (a.lo() == b.lo(), a.hi() == b.hi());
 #endif
 }
 
-OIIO_FORCEINLINE float3::float3 (const float4 &other) {
-#if defined(OIIO_SIMD_SSE) || defined(OIIO_SIMD_NEON)
-    m_vec = other.simd();
+OIIO_FORCEINLINE mask16 operator!= (const int16& a, const int16& b) {
+    return ! (a == b);
+}
+
+OIIO_FORCEINLINE mask16 operator> (const int16& a, const int16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return mask16::from_bitmask (_mm512_cmpgt_epi32_mask (a.m_vec, b.m_vec));
 #else
-    SIMD_CONSTRUCT_PAD (other[i]);
-    m_val[3] = 0.0f;
+    return mask16 (a.lo() > b.lo(), a.hi() > b.hi());
 #endif
 }
 
-OIIO_FORCEINLINE const float3 float3::Zero () { return float3(float4::Zero()); }
+OIIO_FORCEINLINE mask16 operator< (const int16& a, const int16& b) {
+    return b > a;
+}
 
-OIIO_FORCEINLINE const float3 float3::One () { return float3(1.0f); }
+OIIO_FORCEINLINE mask16 operator>= (const int16& a, const int16& b) {
+    return ! (b > a);
+}
 
-OIIO_FORCEINLINE const float3 float3::Iota (float value) {
-    return float3(value,value+1.0f,value+2.0f);
+OIIO_FORCEINLINE mask16 operator<= (const int16& a, const int16& b) {
+    return ! (a > b);
 }
 
+inline std::ostream& operator<< (std::ostream& cout, const int16& val) {
+    cout << val[0];
+    for (int i = 1; i < val.elements; ++i)
+        cout << ' ' << val[i];
+    return cout;
+}
 
-OIIO_FORCEINLINE void float3::load (float val) { float4::load (val, val, val, 0.0f); }
+OIIO_FORCEINLINE int reduce_add (const int16& v) {
+    return reduce_add (v.lo() + v.hi());
+}
 
-OIIO_FORCEINLINE void float3::load (const float *values) { float4::load (values, 3); }
+OIIO_FORCEINLINE int16 blend (const int16& a, const int16& b, const mask16& mask) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_mask_blend_epi32 (__mmask16(mask.bitmask()), a.simd(), b.simd());
+#else
+    return int16 (blend (a.lo(), b.lo(), mask.lo()),
+                  blend (a.hi(), b.hi(), mask.hi()));
+#endif
+}
 
-OIIO_FORCEINLINE void float3::load (const float *values, int n) {
-    float4::load (values, n);
+OIIO_FORCEINLINE int16 blend0 (const int16& a, const mask16& mask) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_maskz_mov_epi32 (__mmask16(mask.bitmask()), a.simd());
+#else
+    return int16 (blend0 (a.lo(), mask.lo()), blend0 (a.hi(), mask.hi()));
+#endif
 }
 
-OIIO_FORCEINLINE void float3::load (const unsigned short *values) {
-    float4::load (float(values[0]), float(values[1]), float(values[2]));
+OIIO_FORCEINLINE int16 select (const mask16& mask, const int16& a, const int16& b) {
+    return blend (b, a, mask);
 }
 
-OIIO_FORCEINLINE void float3::load (const short *values) {
-    float4::load (float(values[0]), float(values[1]), float(values[2]));
+OIIO_FORCEINLINE int16 abs (const int16& a) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_abs_epi32 (a.simd());
+#else
+    return int16 (abs (a.lo()), abs (a.hi()));
+#endif
 }
 
-OIIO_FORCEINLINE void float3::load (const unsigned char *values) {
-    float4::load (float(values[0]), float(values[1]), float(values[2]));
+OIIO_FORCEINLINE int16 min (const int16& a, const int16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_min_epi32 (a.simd(), b.simd());
+#else
+    return int16 (min (a.lo(), b.lo()), min (a.hi(), b.hi()));
+#endif
 }
 
-OIIO_FORCEINLINE void float3::load (const char *values) {
-    float4::load (float(values[0]), float(values[1]), float(values[2]));
+OIIO_FORCEINLINE int16 max (const int16& a, const int16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_max_epi32 (a.simd(), b.simd());
+#else
+    return int16 (max (a.lo(), b.lo()), max (a.hi(), b.hi()));
+#endif
 }
 
-#ifdef _HALF_H_
-OIIO_FORCEINLINE void float3::load (const half *values) {
-    float4::load (float(values[0]), float(values[1]), float(values[2]));
+OIIO_FORCEINLINE int16 bitcast_to_int16 (const float16& x) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_castps_si512 (x.simd());
+#else
+    return int16 (bitcast_to_int8 (x.lo()), bitcast_to_int8 (x.hi()));
+#endif
 }
-#endif /* _HALF_H_ */
 
-OIIO_FORCEINLINE void float3::store (float *values) const {
-    float4::store (values, 3);
+OIIO_FORCEINLINE float16 bitcast_to_float16 (const int16& x) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_castsi512_ps (x.simd());
+#else
+    return float16 (bitcast_to_float8 (x.lo()), bitcast_to_float8 (x.hi()));
+#endif
 }
 
-OIIO_FORCEINLINE void float3::store (float *values, int n) const {
-    float4::store (values, n);
+OIIO_FORCEINLINE int16 gather (const int *base, const int16 &index) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_i32gather_epi32 (index, base, 4);
+#else
+    return int16 (gather (base, index.lo()), gather (base, index.hi()));
+#endif
 }
 
-#ifdef _HALF_H_
-OIIO_FORCEINLINE void float3::store (half *values) const {
-    SIMD_DO (values[i] = m_val[i]);
+OIIO_FORCEINLINE int16 gather (const int *base, const int16 &index,
+                               const mask16 &mask) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_mask_i32gather_epi32 (_mm512_setzero_si512(),
+                                        __mmask16(mask.bitmask()),
+                                        index, base, 4);
+#else
+    return int16 (gather (base, index.lo(), mask.lo()),
+                  gather (base, index.hi(), mask.hi()));
+#endif
 }
+
+
+
+//////////////////////////////////////////////////////////////////////
+// float16 implementation
+
+OIIO_FORCEINLINE float16::float16 (const float8 &lo, const float8 &hi) {
+#if OIIO_SIMD_AVX >= 512
+    __m512d r = _mm512_insertf64x4 (_mm512_setzero_pd(), _mm256_castps_pd (lo), 0);
+    m_vec = _mm512_castpd_ps (_mm512_insertf64x4 (r, _mm256_castps_pd (hi), 1));
+#else
+    lo.store (m_val);
+    hi.store (m_val+8);
 #endif
+}
 
-OIIO_FORCEINLINE void float3::store (Imath::V3f &vec) const {
-    store ((float *)&vec);
+OIIO_FORCEINLINE float16::float16 (const int16& ival) {
+#if OIIO_SIMD_AVX >= 512
+    m_vec = _mm512_cvtepi32_ps (ival);
+#else
+    *this = float16 (float8 (ival.lo()), float8 (ival.hi()));
+#endif
 }
 
-OIIO_FORCEINLINE float3 operator+ (const float3& a, const float3& b) {
-    return float3 (float4(a) + float4(b));
+OIIO_FORCEINLINE int16::int16 (const float16& f) {
+#if OIIO_SIMD_AVX >= 512
+    m_vec = _mm512_cvttps_epi32 (f);
+#else
+    *this = int16 (int8 (f.lo()), int8 (f.hi()));
+#endif
 }
 
-OIIO_FORCEINLINE const float3 & float3::operator+= (const float3& a) {
-    *this = *this + a; return *this;
+OIIO_FORCEINLINE const float16 float16::Iota (float value) {
+    return float16 (float8::Iota (value), float8::Iota (value+8.0f));
 }
 
-OIIO_FORCEINLINE float3 float3::operator- () const {
-    return float3 (-float4(*this));
+OIIO_FORCEINLINE const float16 & float16::operator= (const float16 &other) {
+    m_vec = other.m_vec;
+    return *this;
 }
 
-OIIO_FORCEINLINE float3 operator- (const float3& a, const float3& b) {
-    return float3 (float4(a) - float4(b));
+OIIO_FORCEINLINE float& float16::operator[] (int i) {
+    DASSERT(i >= 0 && i < elements);
+    return m_val[i];
 }
 
-OIIO_FORCEINLINE const float3 & float3::operator-= (const float3& a) {
-    *this = *this - a; return *this;
+OIIO_FORCEINLINE float float16::operator[] (int i) const {
+    DASSERT(i >= 0 && i < elements);
+    return m_val[i];
 }
 
-OIIO_FORCEINLINE float3 operator* (const float3& a, const float3& b) {
-    return float3 (float4(a) * float4(b));
+OIIO_FORCEINLINE float8 float16::lo () const {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_castps512_ps256 (m_vec);
+#else
+    return float8 (m_val);
+#endif
 }
 
-OIIO_FORCEINLINE const float3 & float3::operator*= (const float3& a) {
-    *this = *this * a; return *this;
+OIIO_FORCEINLINE float8 float16::hi () const {
+#if OIIO_SIMD_AVX >= 512
+    return _mm256_castpd_ps (_mm512_extractf64x4_pd (_mm512_castps_pd (m_vec), 1));
+#else
+    return float8 (m_val+8);
+#endif
 }
 
-OIIO_FORCEINLINE const float3 & float3::operator*= (float a) {
-    *this = *this * a; return *this;
+OIIO_FORCEINLINE void float16::load (float val) {
+#if OIIO_SIMD_AVX >= 512
+    m_vec = _mm512_set1_ps (val);
+#else
+    SIMD_CONSTRUCT (val);
+#endif
 }
 
-OIIO_FORCEINLINE float3 operator/ (const float3& a, const float3& b) {
-    return float3 (float4(a) / b.xyz1()); // Avoid divide by zero!
+OIIO_FORCEINLINE void float16::load (const float *values) {
+#if OIIO_SIMD_AVX >= 512
+    m_vec = _mm512_loadu_ps (values);
+#else
+    SIMD_CONSTRUCT (values[i]);
+#endif
 }
 
-OIIO_FORCEINLINE const float3 & float3::operator/= (const float3& a) {
-    *this = *this / a; return *this;
+OIIO_FORCEINLINE void float16::load (const float *values, int n) {
+    DASSERT (n >= 0 && n <= elements);
+#if OIIO_SIMD_AVX >= 512
+    m_vec = _mm512_maskz_loadu_ps (__mmask16((1<<n)-1), values);
+#else
+    for (int i = 0; i < n; ++i)
+        m_val[i] = values[i];
+    for (int i = n; i < elements; ++i)
+        m_val[i] = 0.0f;
+#endif
 }
 
-OIIO_FORCEINLINE const float3 & float3::operator/= (float a) {
-    *this = *this / a; return *this;
+OIIO_FORCEINLINE void float16::store (float *values) const {
+#if OIIO_SIMD_AVX >= 512
+    _mm512_storeu_ps (values, m_vec);
+#else
+    SIMD_DO (values[i] = m_val[i]);
+#endif
+}
+
+OIIO_FORCEINLINE void float16::store (float *values, int n) const {
+    DASSERT (n >= 0 && n <= elements);
+#if OIIO_SIMD_AVX >= 512
+    _mm512_mask_storeu_ps (values, __mmask16((1<<n)-1), m_vec);
+#else
+    for (int i = 0; i < n; ++i)
+        values[i] = m_val[i];
+#endif
 }
 
+OIIO_FORCEINLINE void float16::store (float *values, const mask16 &mask) const {
+#if OIIO_SIMD_AVX >= 512
+    _mm512_mask_storeu_ps (values, __mmask16(mask.bitmask()), m_vec);
+#else
+    lo().store (values, mask.lo());
+    hi().store (values+8, mask.hi());
+#endif
+}
 
-inline std::ostream& operator<< (std::ostream& cout, const float3& val) {
-    cout << val[0];
-    for (int i = 1; i < val.elements; ++i)
-        cout << ' ' << val[i];
-    return cout;
+OIIO_FORCEINLINE float16 operator+ (const float16& a, const float16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_add_ps (a.m_vec, b.m_vec);
+#else
+    return float16 (a.lo() + b.lo(), a.hi() + b.hi());
+#endif
+}
+
+OIIO_FORCEINLINE const float16 & float16::operator+= (const float16& a) {
+    return *this = *this + a;
 }
 
+OIIO_FORCEINLINE float16 float16::operator- () const {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_sub_ps (_mm512_setzero_ps(), m_vec);
+#else
+    return float16 (-lo(), -hi());
+#endif
+}
 
-OIIO_FORCEINLINE float3 vreduce_add (const float3& v) {
-#if defined(OIIO_SIMD_SSE)
-    return float3 ((vreduce_add(float4(v))).xyz0());
+OIIO_FORCEINLINE float16 operator- (const float16& a, const float16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_sub_ps (a.m_vec, b.m_vec);
 #else
-    return float3 (v[0] + v[1] + v[2]);
+    return float16 (a.lo() - b.lo(), a.hi() - b.hi());
 #endif
 }
 
+OIIO_FORCEINLINE const float16 & float16::operator-= (const float16& a) {
+    return *this = *this - a;
+}
 
-OIIO_FORCEINLINE float3 vdot (const float3 &a, const float3 &b) {
-#if OIIO_SIMD_SSE >= 4
-    return float3(_mm_dp_ps (a.simd(), b.simd(), 0x77));
+OIIO_FORCEINLINE float16 operator* (const float16& a, const float16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_mul_ps (a.m_vec, b.m_vec);
 #else
-    return vreduce_add (a*b);
+    return float16 (a.lo() * b.lo(), a.hi() * b.hi());
 #endif
 }
 
+OIIO_FORCEINLINE const float16 & float16::operator*= (const float16& a) {
+    return *this = *this * a;
+}
 
-OIIO_FORCEINLINE float dot (const float3 &a, const float3 &b) {
-#if OIIO_SIMD_SSE >= 4
-    return _mm_cvtss_f32 (_mm_dp_ps (a.simd(), b.simd(), 0x77));
+OIIO_FORCEINLINE float16 operator/ (const float16& a, const float16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_div_ps (a.m_vec, b.m_vec);
 #else
-    return reduce_add (a*b);
+    return float16 (a.lo() / b.lo(), a.hi() / b.hi());
 #endif
 }
 
+OIIO_FORCEINLINE const float16 & float16::operator/= (const float16& a) {
+    return *this = *this / a;
+}
 
-OIIO_FORCEINLINE float3 vdot3 (const float3 &a, const float3 &b) {
-#if OIIO_SIMD_SSE >= 4
-    return float3(_mm_dp_ps (a.simd(), b.simd(), 0x77));
+#if OIIO_SIMD_AVX >= 512
+#define OIIO_FLOAT16_CMP(op,imm)                                        \
+OIIO_FORCEINLINE mask16 operator op (const float16& a, const float16& b) { \
+    return mask16::from_bitmask (_mm512_cmp_ps_mask (a.m_vec, b.m_vec, imm)); \
+}
 #else
-    return float3 (vreduce_add((a*b).xyz0()).xyz0());
+#define OIIO_FLOAT16_CMP(op,imm)                                        \
+OIIO_FORCEINLINE mask16 operator op (const float16& a, const float16& b) { \
+    return mask16 (a.lo() op b.lo(), a.hi() op b.hi());                 \
+}
 #endif
+OIIO_FLOAT16_CMP(==, _CMP_EQ_OQ)
+OIIO_FLOAT16_CMP(!=, _CMP_NEQ_UQ)
+OIIO_FLOAT16_CMP(<,  _CMP_LT_OQ)
+OIIO_FLOAT16_CMP(>,  _CMP_GT_OQ)
+OIIO_FLOAT16_CMP(>=, _CMP_GE_OQ)
+OIIO_FLOAT16_CMP(<=, _CMP_LE_OQ)
+#undef OIIO_FLOAT16_CMP
+
+inline std::ostream& operator<< (std::ostream& cout, const float16& val) {
+    cout << val[0];
+    for (int i = 1; i < val.elements; ++i)
+        cout << ' ' << val[i];
+    return cout;
 }
 
-OIIO_FORCEINLINE float3 float3::normalized () const
-{
-#if OIIO_SIMD
-    float3 len2 = vdot3 (*this, *this);
-    return float3 (safe_div (*this, sqrt(len2)));
+OIIO_FORCEINLINE float reduce_add (const float16& v) {
+    return reduce_add (v.lo() + v.hi());
+}
+
+OIIO_FORCEINLINE float16 blend (const float16& a, const float16& b, const mask16& mask) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_mask_blend_ps (__mmask16(mask.bitmask()), a, b);
 #else
-    float len2 = dot (*this, *this);
-    return len2 > 0.0f ? (*this) / sqrtf(len2) : float3::Zero();
+    return float16 (blend (a.lo(), b.lo(), mask.lo()),
+                    blend (a.hi(), b.hi(), mask.hi()));
 #endif
 }
 
-
-OIIO_FORCEINLINE float3 float3::normalized_fast () const
-{
-#if OIIO_SIMD
-    float3 len2 = vdot3 (*this, *this);
-    float4 invlen = blend0not (rsqrt_fast (len2), len2 == float4::Zero());
-    return float3 ((*this) * invlen);
+OIIO_FORCEINLINE float16 blend0 (const float16& a, const mask16& mask) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_maskz_mov_ps (__mmask16(mask.bitmask()), a);
 #else
-    float len2 = dot (*this, *this);
-    return len2 > 0.0f ? (*this) / sqrtf(len2) : float3::Zero();
+    return float16 (blend0 (a.lo(), mask.lo()), blend0 (a.hi(), mask.hi()));
 #endif
 }
 
-
-
-//////////////////////////////////////////////////////////////////////
-// matrix44 implementation
-
-
-OIIO_FORCEINLINE const Imath::M44f& matrix44::M44f() const {
-    return *(Imath::M44f*)this;
+OIIO_FORCEINLINE float16 select (const mask16& mask, const float16& a, const float16& b) {
+    return blend (b, a, mask);
 }
 
-
-OIIO_FORCEINLINE float4 matrix44::operator[] (int i) const {
-#if OIIO_SIMD_SSE
-    return m_row[i];
+OIIO_FORCEINLINE float16 abs (const float16& a) {
+#if OIIO_SIMD_AVX >= 512
+    return bitcast_to_float16 (bitcast_to_int16 (a) & int16 (0x7fffffff));
 #else
-    return float4 (m_mat[i]);
+    return float16 (abs (a.lo()), abs (a.hi()));
 #endif
 }
 
-
-OIIO_FORCEINLINE matrix44 matrix44::transposed () const {
-    matrix44 T;
-#if OIIO_SIMD_SSE
-    simd::transpose (m_row[0], m_row[1], m_row[2], m_row[3],
-                     T.m_row[0], T.m_row[1], T.m_row[2], T.m_row[3]);
+OIIO_FORCEINLINE float16 ceil (const float16& a) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_roundscale_ps (a, _MM_FROUND_TO_POS_INF);
 #else
-    T = m_mat.transposed();
+    return float16 (ceil (a.lo()), ceil (a.hi()));
 #endif
-    return T;
 }
 
-OIIO_FORCEINLINE float3 matrix44::transformp (const float3 &V) const {
-#if OIIO_SIMD_SSE
-    float4 R = shuffle<0>(V) * m_row[0] + shuffle<1>(V) * m_row[1] +
-               shuffle<2>(V) * m_row[2] + m_row[3];
-    R = R / shuffle<3>(R);
-    return float3 (R.xyz0());
+OIIO_FORCEINLINE float16 floor (const float16& a) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_roundscale_ps (a, _MM_FROUND_TO_NEG_INF);
 #else
-    Imath::V3f R;
-    m_mat.multVecMatrix (*(Imath::V3f *)&V, R);
-    return float3(R);
+    return float16 (floor (a.lo()), floor (a.hi()));
 #endif
 }
 
-OIIO_FORCEINLINE float3 matrix44::transformv (const float3 &V) const {
-#if OIIO_SIMD_SSE
-    float4 R = shuffle<0>(V) * m_row[0] + shuffle<1>(V) * m_row[1] +
-               shuffle<2>(V) * m_row[2];
-    return float3 (R.xyz0());
+OIIO_FORCEINLINE float16 round (const float16& a) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_roundscale_ps (a, _MM_FROUND_TO_NEAREST_INT);
 #else
-    Imath::V3f R;
-    m_mat.multDirMatrix (*(Imath::V3f *)&V, R);
-    return float3(R);
+    return float16 (round (a.lo()), round (a.hi()));
 #endif
 }
 
-OIIO_FORCEINLINE float3 matrix44::transformvT (const float3 &V) const {
-#if OIIO_SIMD_SSE
-    matrix44 T = transposed();
-    float4 R = shuffle<0>(V) * T[0] + shuffle<1>(V) * T[1] +
-               shuffle<2>(V) * T[2];
-    return float3 (R.xyz0());
+OIIO_FORCEINLINE int16 floori (const float16& a) {
+#if OIIO_SIMD_AVX >= 512
+    return int16 (floor (a));
 #else
-    Imath::V3f R;
-    m_mat.transposed().multDirMatrix (*(Imath::V3f *)&V, R);
-    return float3(R);
+    return int16 (floori (a.lo()), floori (a.hi()));
 #endif
 }
 
-OIIO_FORCEINLINE bool matrix44::operator== (const matrix44& m) const {
-#if OIIO_SIMD_SSE
-    mask4 b0 = (m_row[0] == m[0]);
-    mask4 b1 = (m_row[1] == m[1]);
-    mask4 b2 = (m_row[2] == m[2]);
-    mask4 b3 = (m_row[3] == m[3]);
-    return simd::all (b0 & b1 & b2 & b3);
+OIIO_FORCEINLINE float16 sqrt (const float16 &a) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_sqrt_ps (a);
 #else
-    return memcmp(this, &m, 16*sizeof(float)) == 0;
+    return float16 (sqrt (a.lo()), sqrt (a.hi()));
 #endif
 }
 
-OIIO_FORCEINLINE bool matrix44::operator== (const Imath::M44f& m) const {
-    return memcmp(this, &m, 16*sizeof(float)) == 0;
+OIIO_FORCEINLINE float16 rsqrt (const float16 &a) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_div_ps (_mm512_set1_ps (1.0f), _mm512_sqrt_ps (a));
+#else
+    return float16 (rsqrt (a.lo()), rsqrt (a.hi()));
+#endif
 }
 
-OIIO_FORCEINLINE bool operator== (const Imath::M44f& a, const matrix44 &b) {
-    return (b == a);
+OIIO_FORCEINLINE float16 rsqrt_fast (const float16 &a) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_rsqrt14_ps (a);
+#else
+    return float16 (rsqrt_fast (a.lo()), rsqrt_fast (a.hi()));
+#endif
 }
 
-OIIO_FORCEINLINE bool matrix44::operator!= (const matrix44& m) const {
-#if OIIO_SIMD_SSE
-    mask4 b0 = (m_row[0] != m[0]);
-    mask4 b1 = (m_row[1] != m[1]);
-    mask4 b2 = (m_row[2] != m[2]);
-    mask4 b3 = (m_row[3] != m[3]);
-    return simd::any (b0 | b1 | b2 | b3);
+OIIO_FORCEINLINE float16 rcp_fast (const float16 &a) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_rcp14_ps (a);
 #else
-    return memcmp(this, &m, 16*sizeof(float)) != 0;
+    return float16 (rcp_fast (a.lo()), rcp_fast (a.hi()));
 #endif
 }
 
-OIIO_FORCEINLINE bool matrix44::operator!= (const Imath::M44f& m) const {
-    return memcmp(this, &m, 16*sizeof(float)) != 0;
+OIIO_FORCEINLINE float16 min (const float16& a, const float16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_min_ps (a, b);
+#else
+    return float16 (min (a.lo(), b.lo()), min (a.hi(), b.hi()));
+#endif
 }
 
-OIIO_FORCEINLINE bool operator!= (const Imath::M44f& a, const matrix44 &b) {
-    return (b != a);
+OIIO_FORCEINLINE float16 max (const float16& a, const float16& b) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_max_ps (a, b);
+#else
+    return float16 (max (a.lo(), b.lo()), max (a.hi(), b.hi()));
+#endif
 }
 
-OIIO_FORCEINLINE matrix44 matrix44::inverse() const {
-#if OIIO_SIMD_SSE
-    // Adapted from this code from Intel:
-    // ftp://download.intel.com/design/pentiumiii/sml/24504301.pdf
-    float4 minor0, minor1, minor2, minor3;
-    float4 row0, row1, row2, row3;
-    float4 det, tmp1;
-    const float *src = (const float *)this;
-    float4 zero = float4::Zero();
-    tmp1 = _mm_loadh_pi(_mm_loadl_pi(zero, (__m64*)(src)), (__m64*)(src+ 4));
-    row1 = _mm_loadh_pi(_mm_loadl_pi(zero, (__m64*)(src+8)), (__m64*)(src+12));
-    row0 = _mm_shuffle_ps(tmp1, row1, 0x88);
-    row1 = _mm_shuffle_ps(row1, tmp1, 0xDD);
-    tmp1 = _mm_loadh_pi(_mm_loadl_pi(tmp1, (__m64*)(src+ 2)), (__m64*)(src+ 6));
-    row3 = _mm_loadh_pi(_mm_loadl_pi(zero, (__m64*)(src+10)), (__m64*)(src+14));
-    row2 = _mm_shuffle_ps(tmp1, row3, 0x88);
-    row3 = _mm_shuffle_ps(row3, tmp1, 0xDD);
-    // -----------------------------------------------
-    tmp1 = row2 * row3;
-    tmp1 = shuffle<1,0,3,2>(tmp1);
-    minor0 = row1 * tmp1;
-    minor1 = row0 * tmp1;
-    tmp1 = shuffle<2,3,0,1>(tmp1);
-    minor0 = (row1 * tmp1) - minor0;
-    minor1 = (row0 * tmp1) - minor1;
-    minor1 = shuffle<2,3,0,1>(minor1);
-    // -----------------------------------------------
-    tmp1 = row1 * row2;
-    tmp1 = shuffle<1,0,3,2>(tmp1);
-    minor0 = (row3 * tmp1) + minor0;
-    minor3 = row0 * tmp1;
-    tmp1 = shuffle<2,3,0,1>(tmp1);
-    minor0 = minor0 - (row3 * tmp1);
-    minor3 = (row0 * tmp1) - minor3;
-    minor3 = shuffle<2,3,0,1>(minor3);
-    // -----------------------------------------------
-    tmp1 = shuffle<2,3,0,1>(row1) * row3;
-    tmp1 = shuffle<1,0,3,2>(tmp1);
-    row2 = shuffle<2,3,0,1>(row2);
-    minor0 = (row2 * tmp1) + minor0;
-    minor2 = row0 * tmp1;
-    tmp1 = shuffle<2,3,0,1>(tmp1);
-    minor0 = minor0 - (row2 * tmp1);
-    minor2 = (row0 * tmp1) - minor2;
-    minor2 = shuffle<2,3,0,1>(minor2);
-    // -----------------------------------------------
-    tmp1 = row0 * row1;
-    tmp1 = shuffle<1,0,3,2>(tmp1);
-    minor2 = (row3 * tmp1) + minor2;
-    minor3 = (row2 * tmp1) - minor3;
-    tmp1 = shuffle<2,3,0,1>(tmp1);
-    minor2 = (row3 * tmp1) - minor2;
-    minor3 = minor3 - (row2 * tmp1);
-    // -----------------------------------------------
-    tmp1 = row0 * row3;
-    tmp1 = shuffle<1,0,3,2>(tmp1);
-    minor1 = minor1 - (row2 * tmp1);
-    minor2 = (row1 * tmp1) + minor2;
-    tmp1 = shuffle<2,3,0,1>(tmp1);
-    minor1 = (row2 * tmp1) + minor1;
-    minor2 = minor2 - (row1 * tmp1);
-    // -----------------------------------------------
-    tmp1 = row0 * row2;
-    tmp1 = shuffle<1,0,3,2>(tmp1);
-    minor1 = (row3 * tmp1) + minor1;
-    minor3 = minor3 - (row1 * tmp1);
-    tmp1 = shuffle<2,3,0,1>(tmp1);
-    minor1 = minor1 - (row3 * tmp1);
-    minor3 = (row1 * tmp1) + minor3;
-    // -----------------------------------------------
-    det = row0 * minor0;
-    det = shuffle<2,3,0,1>(det) + det;
-    det = _mm_add_ss(shuffle<1,0,3,2>(det), det);
-    tmp1 = _mm_rcp_ss(det);
-    det = _mm_sub_ss(_mm_add_ss(tmp1, tmp1), _mm_mul_ss(det, _mm_mul_ss(tmp1, tmp1)));
-    det = shuffle<0>(det);
-    return matrix44 (det*minor0, det*minor1, det*minor2, det*minor3);
+OIIO_FORCEINLINE float16 madd (const float16& a, const float16& b, const float16& c) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_fmadd_ps (a, b, c);
 #else
-    return m_mat.inverse();
+    return float16 (madd (a.lo(), b.lo(), c.lo()), madd (a.hi(), b.hi(), c.hi()));
 #endif
 }
 
-
-inline std::ostream& operator<< (std::ostream& cout, const matrix44 &M) {
-    const float *m = (const float *)&M;
-    cout << m[0];
-    for (int i = 1; i < 16; ++i)
-        cout << ' ' << m[i];
-    return cout;
+OIIO_FORCEINLINE float16 msub (const float16& a, const float16& b, const float16& c) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_fmsub_ps (a, b, c);
+#else
+    return float16 (msub (a.lo(), b.lo(), c.lo()), msub (a.hi(), b.hi(), c.hi()));
+#endif
 }
 
-
-
-OIIO_FORCEINLINE float3 transformp (const matrix44 &M, const float3 &V) {
-    return M.transformp (V);
+OIIO_FORCEINLINE float16 nmadd (const float16& a, const float16& b, const float16& c) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_fnmadd_ps (a, b, c);
+#else
+    return float16 (nmadd (a.lo(), b.lo(), c.lo()), nmadd (a.hi(), b.hi(), c.hi()));
+#endif
 }
 
-OIIO_FORCEINLINE float3 transformp (const Imath::M44f &M, const float3 &V)
-{
-#if OIIO_SIMD
-    return matrix44(M).transformp (V);
+OIIO_FORCEINLINE float16 nmsub (const float16& a, const float16& b, const float16& c) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_fnmsub_ps (a, b, c);
 #else
-    Imath::V3f R;
-    M.multVecMatrix (*(Imath::V3f *)&V, R);
-    return float3(R);
+    return float16 (nmsub (a.lo(), b.lo(), c.lo()), nmsub (a.hi(), b.hi(), c.hi()));
 #endif
 }
 
+OIIO_FORCEINLINE float16 exp (const float16& v) {
+    return float16 (exp (v.lo()), exp (v.hi()));
+}
 
-OIIO_FORCEINLINE float3 transformv (const matrix44 &M, const float3 &V) {
-    return M.transformv (V);
+OIIO_FORCEINLINE float16 log (const float16& v) {
+    return float16 (log (v.lo()), log (v.hi()));
 }
 
-OIIO_FORCEINLINE float3 transformv (const Imath::M44f &M, const float3 &V)
-{
-#if OIIO_SIMD
-    return matrix44(M).transformv (V);
+OIIO_FORCEINLINE float16 gather (const float *base, const int16 &index) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_i32gather_ps (index, base, 4);
 #else
-    Imath::V3f R;
-    M.multDirMatrix (*(Imath::V3f *)&V, R);
-    return float3(R);
+    return float16 (gather (base, index.lo()), gather (base, index.hi()));
 #endif
 }
 
-OIIO_FORCEINLINE float3 transformvT (const matrix44 &M, const float3 &V)
-{
-    return M.transformvT (V);
-}
-
-OIIO_FORCEINLINE float3 transformvT (const Imath::M44f &M, const float3 &V)
-{
-#if OIIO_SIMD
-    return matrix44(M).transformvT(V);
+OIIO_FORCEINLINE float16 gather (const float *base, const int16 &index,
+                                 const mask16 &mask) {
+#if OIIO_SIMD_AVX >= 512
+    return _mm512_mask_i32gather_ps (_mm512_setzero_ps(),
+                                     __mmask16(mask.bitmask()),
+                                     index, base, 4);
 #else
-    return transformv (M.transposed(), V);
+    return float16 (gather (base, index.lo(), mask.lo()),
+                    gather (base, index.hi(), mask.hi()));
 #endif
 }
 
@@ -41,6 +41,7 @@
 #define OPENIMAGEIO_STRUTIL_H
 
 #include <cstdarg>
+#include <algorithm>
 #include <string>
 #include <cstring>
 #include <cstdlib>
@@ -239,13 +240,24 @@ template<typename T>
 inline T from_string (string_view s) {
     return T(s); // Generic: assume there is an explicit converter
 }
-// Special case for int
+// Special case for int.  The string_view is often a piece of a longer
+// string (one value of a comma separated list, say), and strtol needs a
+// 0-terminated one, so copy it to a local buffer rather than paying for
+// c_str() to allocate.
 template<> inline int from_string<int> (string_view s) {
-    return s.size() ? strtol (s.c_str(), NULL, 10) : 0;
+    char buf[64];
+    size_t n = std::min (s.size(), sizeof(buf)-1);
+    memcpy (buf, s.data(), n);
+    buf[n] = 0;
+    return n ? strtol (buf, NULL, 10) : 0;
 }
 // Special case for float
 template<> inline float from_string<float> (string_view s) {
-    return s.size() ? (float)strtod (s.c_str(), NULL) : 0.0f;
+    char buf[64];
+    size_t n = std::min (s.size(), sizeof(buf)-1);
+    memcpy (buf, s.data(), n);
+    buf[n] = 0;
+    return n ? (float)strtod (buf, NULL) : 0.0f;
 }
 
 
@@ -106,6 +106,31 @@ OIIO_API unsigned int physical_concurrency ();
 /// Get the maximum number of open file handles allowed on this system.
 OIIO_API size_t max_open_files ();
 
+/// Bit flags for the instruction set extensions reported by
+/// cpu_features().
+enum CPUFeature {
+    CPU_SSE2    = 1 << 0,
+    CPU_SSE3    = 1 << 1,
+    CPU_SSSE3   = 1 << 2,
+    CPU_SSE41   = 1 << 3,
+    CPU_SSE42   = 1 << 4,
+    CPU_AVX     = 1 << 5,
+    CPU_AVX2    = 1 << 6,
+    CPU_FMA     = 1 << 7,
+    CPU_F16C    = 1 << 8,
+    CPU_AVX512F = 1 << 9
+};
+
+/// The instruction set extensions that the CPU we're running on supports
+/// (and, for the AVX family, that the OS saves the registers of), as a
+/// bitwise OR of CPUFeature values.  It is 0 on non-x86 hardware.  This
+/// is determined once and then cached, so it is cheap to call.
+OIIO_API unsigned int cpu_features ();
+
+/// A comma-separated list of the names of the cpu_features(), e.g.
+/// "sse2,sse3,ssse3,sse41,sse42,avx,avx2,fma,f16c".
+OIIO_API std::string cpu_feature_names ();
+
 /// Try to figure out how many columns wide the terminal window is. May not
 /// be correct on all systems, will default to 80 if it can't figure it out.
 OIIO_API int terminal_columns ();
@@ -45,6 +45,8 @@
 
 OIIO_NAMESPACE_BEGIN
 
+struct ROI;
+
 // Forward declaration
 namespace pvt {
 
@@ -109,7 +111,9 @@ public:
         MipModeNoMIP,        ///< Just use highest-res image, no MIP mapping
         MipModeOneLevel,     ///< Use just one mipmap level
         MipModeTrilinear,    ///< Use two MIPmap levels (trilinear)
-        MipModeAniso         ///< Use two MIPmap levels w/ anisotropic
+        MipModeAniso,        ///< Use two MIPmap levels w/ anisotropic
+        MipModeEWA,          ///< Use two MIPmap levels w/ Gaussian EWA
+        MipModeStochastic    ///< One probe of one level, chosen by rnd
     };
 
     /// Interp mode determines how we sample within a mipmap level
@@ -135,7 +139,8 @@ public:
         time(0.0f), // bias(0.0f), samples(1),
         rwrap(WrapDefault), rblur(0.0f), rwidth(1.0f), // dresultdr(NULL),
         // actualchannels(0),
-        envlayout(0)
+        nonblocking(false), approximate(false), priority(0), rnd(0.0f),
+        pointsample(false), envlayout(0)
     { }
 
     /// Convert a TextureOptions for one index into a TextureOpt.
@@ -164,6 +169,31 @@ public:
     float rblur;              ///< Blur amount in the r direction
     float rwidth;             ///< Multiplier for derivatives in r direction
 
+    /// If true, a 2D lookup never waits for a tile to be read: missing
+    /// tiles are queued to the ImageCache's I/O threads and the lookup
+    /// is filtered from the finest coarser MIP level that is resident.
+    bool nonblocking;
+    /// Set to true by a nonblocking lookup that had to use a coarser MIP
+    /// level than it wanted.  Never reset by the lookups themselves.
+    bool approximate;
+    /// Lookups with priority > 0 always get full texture resolution;
+    /// others are limited by the "max_resolution" attribute and, under
+    /// memory pressure, by the ImageCache's "auto_lod".
+    int priority;
+    /// For MipModeStochastic, a uniform random number on [0,1) that
+    /// picks the MIP level and the probe along the anisotropy axis, in
+    /// proportion to the weights the full filter would give them.
+    float rnd;
+    /// If true, the lookup is a point sample: it returns the texel of the
+    /// highest-resolution MIP level closest to (s,t), with no filtering,
+    /// whatever the derivatives, blur and interpmode (the derivatives of
+    /// the result are 0).  This is what data textures such as ID maps
+    /// want, and takes a much shorter path than a filtered lookup.  Point
+    /// samples always wait for their tile, even if nonblocking is set.
+    /// Lookups with InterpClosest, no blur and all-zero derivatives take
+    /// the same path automatically (unless they are nonblocking).
+    bool pointsample;
+
     /// Utility: Return the Wrap enum corresponding to a wrap name:
     /// "default", "black", "clamp", "periodic", "mirror".
     static Wrap decode_wrapmode (const char *name);
@@ -213,7 +243,9 @@ public:
         MipModeNoMIP,        ///< Just use highest-res image, no MIP mapping
         MipModeOneLevel,     ///< Use just one mipmap level
         MipModeTrilinear,    ///< Use two MIPmap levels (trilinear)
-        MipModeAniso         ///< Use two MIPmap levels w/ anisotropic
+        MipModeAniso,        ///< Use two MIPmap levels w/ anisotropic
+        MipModeEWA,          ///< Use two MIPmap levels w/ Gaussian EWA
+        MipModeStochastic    ///< One probe of one level, chosen by rnd
     };
 
     /// Interp mode determines how we sample within a mipmap level
@@ -258,6 +290,8 @@ public:
     VaryingRef<float> rblur;   ///< Blur amount in the r direction
     VaryingRef<float> rwidth;  ///< Multiplier for derivatives in r direction
 
+    VaryingRef<float> rnd;     ///< Random number for MipModeStochastic
+
     /// Utility: Return the Wrap enum corresponding to a wrap name:
     /// "default", "black", "clamp", "periodic", "mirror".
     static Wrap decode_wrapmode (const char *name) {
@@ -336,6 +370,7 @@ public:
     ///     int max_tile_channels : max channels to store all chans in a tile
     ///     string latlong_up : default "up" direction for latlong ("y")
     ///     int flip_t : flip v coord for texture lookups?
+    ///     int batch_sort : group texture_batch lanes by tile (default: 0)
     ///     int max_errors_per_file : Limits how many errors to issue for
     ///                               issue for each (default: 100)
     ///
@@ -456,6 +491,117 @@ public:
                           int nchannels, float *result,
                           float *dresultds=NULL, float *dresultdt=NULL) = 0;
 
+    /// Number of points in the batches taken by texture_batch().
+    enum { BatchWidth = 16 };
+
+    /// Filtered 2D texture lookup for a batch of up to BatchWidth points
+    /// that all share the same (uniform) options.
+    ///
+    /// The inputs are in "structure of arrays" layout: s, t, dsdx, dtdx,
+    /// dsdy, and dtdy each point to BatchWidth floats, one per lane.
+    /// Lane i is only computed if bit i of mask is set.  The results
+    /// are also stored by channel, so that channel c of lane i is found
+    /// in result[c*BatchWidth+i] (and likewise for dresultds and
+    /// dresultdt, if non-NULL); they must therefore have room for
+    /// nchannels*BatchWidth floats.  Result slots for lanes that are
+    /// not in the mask are left untouched.
+    ///
+    /// The filter footprint computations are performed for several
+    /// lanes at once with SIMD, which makes this considerably cheaper
+    /// than the equivalent number of single-point texture() calls.
+    ///
+    /// Return true if the file is found and could be opened by an
+    /// available ImageIO plugin, otherwise return false.
+    virtual bool texture_batch (ustring filename, TextureOpt &options,
+                                unsigned int mask,
+                                const float *s, const float *t,
+                                const float *dsdx, const float *dtdx,
+                                const float *dsdy, const float *dtdy,
+                                int nchannels, float *result,
+                                float *dresultds=NULL,
+                                float *dresultdt=NULL) = 0;
+    virtual bool texture_batch (TextureHandle *texture_handle,
+                                Perthread *thread_info, TextureOpt &options,
+                                unsigned int mask,
+                                const float *s, const float *t,
+                                const float *dsdx, const float *dtdx,
+                                const float *dsdy, const float *dtdy,
+                                int nchannels, float *result,
+                                float *dresultds=NULL,
+                                float *dresultdt=NULL) = 0;
+
+    /// Filtered 2D lookup for a batch of up to BatchWidth points that may
+    /// each be on a different subimage -- for example, the faces of a Ptex
+    /// file, which are presented as one subimage per face.  faceid points
+    /// to BatchWidth subimage indices, one per lane, which override
+    /// options.subimage (and options.subimagename); everything else is as
+    /// for texture_batch().  Lanes on the same face are looked up together.
+    /// A lane naming a face the file doesn't have gets options.fill and
+    /// makes the call return false, with an error message.
+    virtual bool texture_batch_faces (ustring filename, TextureOpt &options,
+                                unsigned int mask, const int *faceid,
+                                const float *s, const float *t,
+                                const float *dsdx, const float *dtdx,
+                                const float *dsdy, const float *dtdy,
+                                int nchannels, float *result,
+                                float *dresultds=NULL,
+                                float *dresultdt=NULL) = 0;
+    virtual bool texture_batch_faces (TextureHandle *texture_handle,
+                                Perthread *thread_info, TextureOpt &options,
+                                unsigned int mask, const int *faceid,
+                                const float *s, const float *t,
+                                const float *dsdx, const float *dtdx,
+                                const float *dsdy, const float *dtdy,
+                                int nchannels, float *result,
+                                float *dresultds=NULL,
+                                float *dresultdt=NULL) = 0;
+
+    /// Retrieve conservative bounds on the values that any 2D texture
+    /// lookup with the given footprint could return, from the min and/or
+    /// max channels that maketx --minmax appended to the texture.  For
+    /// each of the nchannels channels (starting at options.firstchannel),
+    /// minval[c] and maxval[c] receive values no greater (respectively,
+    /// no less) than any texel that could contribute to the lookup.  If
+    /// the texture has only one of the two chains, the other bound is
+    /// set to -FLT_MAX or FLT_MAX.
+    ///
+    /// This is intended for culling and displacement bounding, so it
+    /// trades tightness for speed: it visits at most four texels of a
+    /// single MIP level.
+    ///
+    /// Return true if the file is found and has min/max channels,
+    /// otherwise return false.
+    virtual bool texture_bounds (ustring filename, TextureOpt &options,
+                                 float s, float t, float dsdx, float dtdx,
+                                 float dsdy, float dtdy, int nchannels,
+                                 float *minval, float *maxval) = 0;
+    virtual bool texture_bounds (TextureHandle *texture_handle,
+                                 Perthread *thread_info, TextureOpt &options,
+                                 float s, float t, float dsdx, float dtdx,
+                                 float dsdy, float dtdy, int nchannels,
+                                 float *minval, float *maxval) = 0;
+
+    /// Retrieve the mean slope and slope covariance of a bump or normal
+    /// map over a 2D texture lookup footprint, from the LEAN slope
+    /// moment channels that maketx --lean appended to the texture.
+    /// slope[0..1] receives the mean slope (ds, dt) and variance[0..2]
+    /// receives the variance of each slope component and their
+    /// covariance, suitable for folding into a specular lobe's width.
+    /// Filtering is controlled by options as for texture(), except that
+    /// options.firstchannel is ignored.
+    ///
+    /// Return true if the file is found and has slope moment channels,
+    /// otherwise return false.
+    virtual bool texture_slopes (ustring filename, TextureOpt &options,
+                                 float s, float t, float dsdx, float dtdx,
+                                 float dsdy, float dtdy,
+                                 float *slope, float *variance) = 0;
+    virtual bool texture_slopes (TextureHandle *texture_handle,
+                                 Perthread *thread_info, TextureOpt &options,
+                                 float s, float t, float dsdx, float dtdx,
+                                 float dsdy, float dtdy,
+                                 float *slope, float *variance) = 0;
+
     /// Retrieve a 3D texture lookup at a single point.
     ///
     /// Return true if the file is found and could be opened by an
@@ -501,6 +647,26 @@ public:
                             float *dresultds=NULL, float *dresultdt=NULL,
                             float *dresultdr=NULL) = 0;
 
+    /// Retrieve unfiltered 3D texture lookups at nsteps evenly spaced
+    /// points along a ray, P + i*dPdstep for i = 0..nsteps-1, as needed
+    /// when ray marching through a volume.  The results for step i are
+    /// stored in result[i*nchannels ... (i+1)*nchannels-1].
+    ///
+    /// This is much cheaper than the equivalent series of texture3d()
+    /// calls, since the file, subimage, and wrap modes are resolved just
+    /// once per ray, and successive samples usually reuse the voxel tile
+    /// already found for the previous step.
+    ///
+    /// Return true if the file is found and could be opened by an
+    /// available ImageIO plugin, otherwise return false.
+    virtual bool texture3d_ray (ustring filename, TextureOpt &options,
+                                const Imath::V3f &P, const Imath::V3f &dPdstep,
+                                int nsteps, int nchannels, float *result) = 0;
+    virtual bool texture3d_ray (TextureHandle *texture_handle,
+                                Perthread *thread_info, TextureOpt &options,
+                                const Imath::V3f &P, const Imath::V3f &dPdstep,
+                                int nsteps, int nchannels, float *result) = 0;
+
     /// Retrieve a shadow lookup for a single position P.
     ///
     /// Return true if the file is found and could be opened by an
@@ -576,6 +742,24 @@ public:
                               int nchannels, float *result,
                               float *dresultds=NULL, float *dresultdt=NULL) = 0;
 
+    /// Draw a direction R from a lat-long environment map, with
+    /// probability proportional to the luminance of the map, given two
+    /// uniformly distributed random numbers u1, u2 in [0,1).  The pdf
+    /// of the chosen direction, with respect to solid angle, is stored
+    /// in pdf.  This requires the importance sampling tables that
+    /// maketx bakes into the map when run with --envlatl-importance.
+    ///
+    /// Return true if the direction could be sampled, or false if the
+    /// file could not be opened or has no importance sampling tables.
+    virtual bool environment_sample (ustring filename, TextureOpt &options,
+                                     float u1, float u2,
+                                     Imath::V3f &R, float &pdf) = 0;
+    virtual bool environment_sample (TextureHandle *texture_handle,
+                                     Perthread *thread_info,
+                                     TextureOpt &options,
+                                     float u1, float u2,
+                                     Imath::V3f &R, float &pdf) = 0;
+
     /// Given possibly-relative 'filename', resolve it using the search
     /// path rules and return the full resolved filename.
     virtual std::string resolve_filename (const std::string &filename) const=0;
@@ -649,6 +833,39 @@ public:
                              int chbegin, int chend,
                              TypeDesc format, void *result) = 0;
 
+    /// Retrieve every texel of one MIP level of the given subimage, for
+    /// channels [chbegin,chend), converted to format and stored
+    /// contiguously at result (which must have room for the whole data
+    /// window of the level).  This is like get_texels over the whole
+    /// level, except that all of the level's tiles are first queued for
+    /// the ImageCache's I/O threads to read, so it's the fast way to pull
+    /// whole levels out of a texture for GPU upload or baking.  Channels
+    /// the file doesn't have are filled with 0.
+    ///
+    /// Return true if the file is found and the level could be read,
+    /// otherwise return false.
+    virtual bool get_mip_level (ustring filename, int subimage, int miplevel,
+                                int chbegin, int chend,
+                                TypeDesc format, void *result) = 0;
+    virtual bool get_mip_level (TextureHandle *texture_handle,
+                                Perthread *thread_info, int subimage,
+                                int miplevel, int chbegin, int chend,
+                                TypeDesc format, void *result) = 0;
+
+    /// Hint that the texels of the given subimage and MIP level that lie
+    /// within roi (texel coordinates and channel range) will soon be
+    /// needed, so the underlying ImageCache should start reading their
+    /// tiles asynchronously.  This returns immediately.  An undefined roi
+    /// means the whole MIP level.  See ImageCache::prefetch_tiles().
+    ///
+    /// Return true if the file is found and could be opened by an
+    /// available ImageIO plugin, otherwise return false.
+    virtual bool prefetch (ustring filename, int subimage, int miplevel,
+                           const ROI &roi) = 0;
+    virtual bool prefetch (TextureHandle *texture_handle,
+                           Perthread *thread_info, int subimage,
+                           int miplevel, const ROI &roi) = 0;
+
     /// If any of the API routines returned false indicating an error,
     /// this routine will return the error string (and clear any error
     /// flags).  If no error has occurred since the last time geterror()
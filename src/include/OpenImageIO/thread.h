@@ -41,6 +41,7 @@
 
 #include <vector>
 
+#include "export.h"
 #include "oiioversion.h"
 #include "platform.h"
 #include "atomic.h"
@@ -51,6 +52,7 @@
 # include <thread>
 # include <mutex>
 # include <atomic>
+# include <functional>
 # define not_yet_OIIO_USE_STDATOMIC 1
 #else   /* prior to C++11... */
   // Use Boost mutexes & guards when C++11 is not available
@@ -65,6 +67,7 @@
    // can't restore via push/pop in all versions of gcc (warning push/pop implemented for 4.6+ only)
 #  pragma GCC diagnostic error "-Wunused-variable"
 # endif
+# include <boost/function.hpp>
 #endif
 
 
@@ -434,6 +437,23 @@ public:
     /// Release an exclusive ("writer") lock.
     void unlock () { write_unlock(); }
 
+    /// Try to acquire an exclusive ("writer") lock, returning false
+    /// right away if another writer holds it.  If it returns true, the
+    /// lock is held (having waited, if need be, for any readers already
+    /// inside to leave).
+    bool try_lock () {
+        if (! m_locked.try_lock())
+            return false;
+#if OIIO_THREAD_ALLOW_DCLP
+        while (*(volatile int *)&m_readers > 0)
+                ;
+#else
+        while (m_readers > 0)
+                ;
+#endif
+        return true;
+    }
+
     /// Acquire a shared ("reader") lock.
     void lock_shared () { read_lock(); }
 
@@ -481,6 +501,267 @@ typedef spin_rw_mutex::write_lock_guard spin_rw_write_lock;
 
 
 
+/// Return a hash of the calling thread's ID, for spreading threads over
+/// the slots of per-thread-slot structures such as spin_brw_mutex.
+inline size_t
+this_thread_hash ()
+{
+#if OIIO_CPLUSPLUS_VERSION >= 11
+    size_t h = std::hash<std::thread::id>() (std::this_thread::get_id());
+#else
+    size_t h = boost::hash<boost::thread::id>() (boost::this_thread::get_id());
+#endif
+    // Thread IDs are often aligned addresses; fold in the higher bits.
+    return h ^ (h >> 7) ^ (h >> 13);
+}
+
+
+
+/// A "big reader" spin lock: a reader-writer lock for read-mostly data
+/// that many threads consult at once.  Every spin_rw_mutex reader writes
+/// the same reader count, so that cache line bounces from core to core
+/// even when no writer ever comes; here each reader registers in one of
+/// nslots counters, picked by its thread and each on its own cache line,
+/// so readers on different cores rarely share anything.  The price is
+/// that a writer must wait on every slot, and that the lock takes
+/// nslots+1 cache lines, so keep it for a few hot, rarely changed
+/// structures.  Writers take precedence: once one is waiting, new
+/// readers hold off.
+class spin_brw_mutex {
+public:
+    enum { nslots = 16 };
+
+    /// Default constructor -- initialize to unlocked.
+    ///
+    spin_brw_mutex (void) { init (); }
+
+    ~spin_brw_mutex (void) { }
+
+    /// Copy constructor -- initialize to unlocked.
+    ///
+    spin_brw_mutex (const spin_brw_mutex &) { init (); }
+
+    /// Assignment does not do anything, since lockedness should not
+    /// transfer.
+    const spin_brw_mutex& operator= (const spin_brw_mutex&) { return *this; }
+
+    /// Acquire the reader lock.
+    ///
+    void read_lock () {
+        atomic_int &readers (m_slots[this_thread_hash() % nslots].readers);
+        for (;;) {
+            // Register ourself, then make sure no writer got in first.
+            // (The writer does the mirror image, so one of us will see
+            // the other.)
+            ++readers;
+            if (! m_writer)
+                return;
+            --readers;
+            atomic_backoff backoff;
+            while (m_writer)
+                backoff();
+        }
+    }
+
+    /// Release the reader lock.  Must be called by the same thread
+    /// that acquired it.
+    void read_unlock () {
+        --m_slots[this_thread_hash() % nslots].readers;
+    }
+
+    /// Acquire the writer lock.
+    ///
+    void write_lock () {
+        m_locked.lock ();
+        m_writer = 1;
+        wait_for_readers ();
+    }
+
+    /// Release the writer lock.
+    ///
+    void write_unlock () {
+        m_writer = 0;
+        m_locked.unlock ();
+    }
+
+    /// Acquire an exclusive ("writer") lock.
+    void lock () { write_lock(); }
+
+    /// Release an exclusive ("writer") lock.
+    void unlock () { write_unlock(); }
+
+    /// Try to acquire an exclusive ("writer") lock, returning false
+    /// right away if another writer holds it.  If it returns true, the
+    /// lock is held (having waited, if need be, for any readers already
+    /// inside to leave).
+    bool try_lock () {
+        if (! m_locked.try_lock ())
+            return false;
+        m_writer = 1;
+        wait_for_readers ();
+        return true;
+    }
+
+    /// Acquire a shared ("reader") lock.
+    void lock_shared () { read_lock(); }
+
+    /// Release a shared ("reader") lock.
+    void unlock_shared () { read_unlock(); }
+
+    /// Helper class: scoped read lock for a spin_brw_mutex -- grabs the
+    /// read lock upon construction, releases the lock when it exits scope.
+    class read_lock_guard {
+    public:
+        read_lock_guard (spin_brw_mutex &fm) : m_fm(fm) { m_fm.read_lock(); }
+        ~read_lock_guard () { m_fm.read_unlock(); }
+    private:
+        read_lock_guard(); // Do not implement
+        read_lock_guard(const read_lock_guard& other); // Do not implement
+        read_lock_guard& operator = (const read_lock_guard& other); // Do not implement
+        spin_brw_mutex & m_fm;
+    };
+
+    /// Helper class: scoped write lock for a spin_brw_mutex -- grabs the
+    /// write lock upon construction, releases the lock when it exits scope.
+    class write_lock_guard {
+    public:
+        write_lock_guard (spin_brw_mutex &fm) : m_fm(fm) { m_fm.write_lock(); }
+        ~write_lock_guard () { m_fm.write_unlock(); }
+    private:
+        write_lock_guard(); // Do not implement
+        write_lock_guard(const write_lock_guard& other); // Do not implement
+        write_lock_guard& operator = (const write_lock_guard& other); // Do not implement
+        spin_brw_mutex & m_fm;
+    };
+
+private:
+    void init () {
+        m_writer = 0;
+        for (int i = 0;  i < nslots;  ++i)
+            m_slots[i].readers = 0;
+    }
+
+    void wait_for_readers () {
+        for (int i = 0;  i < nslots;  ++i) {
+            atomic_backoff backoff;
+            while (m_slots[i].readers > 0)
+                backoff();
+        }
+    }
+
+    struct Slot {
+        OIIO_CACHE_ALIGN atomic_int readers;
+        char pad_[OIIO_CACHE_LINE_SIZE-sizeof(atomic_int)];
+    };
+
+    OIIO_CACHE_ALIGN
+    spin_mutex m_locked;   // write lock
+    atomic_int m_writer;   // a writer holds or is waiting for the lock
+    char pad1_[OIIO_CACHE_LINE_SIZE-sizeof(spin_mutex)-sizeof(atomic_int)];
+    Slot m_slots[nslots];  // readers, spread over the slots
+};
+
+
+typedef spin_brw_mutex::read_lock_guard spin_brw_read_lock;
+typedef spin_brw_mutex::write_lock_guard spin_brw_write_lock;
+
+
+
+/// Sequence lock, for small, cheaply copied records that are read far
+/// more often than they're written.  Readers take no lock and write
+/// nothing at all: they copy the data, then retry if a writer changed
+/// it meanwhile.  Writers exclude each other with a spin lock.
+///
+///     // reader                            // writer
+///     Rec r;  int seq;                     seqlock.write_lock ();
+///     do {                                 rec = newvalue;
+///         seq = seqlock.read_begin ();     seqlock.write_unlock ();
+///         r = rec;
+///     } while (seqlock.read_retry (seq));
+///
+/// The record must be safe to copy while it's being changed (plain old
+/// data without pointers that a writer frees), since a reader may see
+/// it torn before it retries.
+class spin_seqlock {
+public:
+    spin_seqlock (void) { m_seq = 0; }
+    spin_seqlock (const spin_seqlock &) { m_seq = 0; }
+    const spin_seqlock& operator= (const spin_seqlock&) { return *this; }
+
+    /// Begin a read, waiting for any writer to finish, and return the
+    /// sequence number to pass to read_retry().
+    int read_begin () const {
+        atomic_backoff backoff;
+        for (;;) {
+            int seq = m_seq;
+            if (! (seq & 1))
+                return seq;
+            backoff();
+        }
+    }
+
+    /// Return true if the data read since the read_begin() that
+    /// returned seq may be inconsistent, and must be read again.
+    bool read_retry (int seq) const {
+        atomic_thread_fence (memory_order_acquire);
+        return m_seq != seq;
+    }
+
+    /// Acquire the writer lock.
+    ///
+    void write_lock () {
+        m_writer.lock ();
+        ++m_seq;   // odd: write in progress
+        atomic_thread_fence (memory_order_release);
+    }
+
+    /// Release the writer lock.
+    ///
+    void write_unlock () {
+        atomic_thread_fence (memory_order_release);
+        ++m_seq;   // even again
+        m_writer.unlock ();
+    }
+
+    /// Acquire an exclusive ("writer") lock.
+    void lock () { write_lock(); }
+
+    /// Release an exclusive ("writer") lock.
+    void unlock () { write_unlock(); }
+
+    /// Helper class: scoped write lock for a spin_seqlock -- grabs the
+    /// write lock upon construction, releases the lock when it exits scope.
+    class write_lock_guard {
+    public:
+        write_lock_guard (spin_seqlock &sl) : m_sl(sl) { m_sl.write_lock(); }
+        ~write_lock_guard () { m_sl.write_unlock(); }
+    private:
+        write_lock_guard(); // Do not implement
+        write_lock_guard(const write_lock_guard& other); // Do not implement
+        write_lock_guard& operator = (const write_lock_guard& other); // Do not implement
+        spin_seqlock & m_sl;
+    };
+
+    /// Return a consistent copy of data protected by this lock.
+    template<class T>
+    T read (const T &data) const {
+        T copy;
+        int seq;
+        do {
+            seq = read_begin ();
+            copy = data;
+        } while (read_retry (seq));
+        return copy;
+    }
+
+private:
+    OIIO_CACHE_ALIGN
+    atomic_int m_seq;      // odd while a writer is changing the data
+    spin_mutex m_writer;   // excludes other writers
+};
+
+
+
 /// Mutex pool. Sometimes, we have lots of objects that need to be
 /// individually locked for thread safety, but two separate objects don't
 /// need to lock against each other. If there are many more objects than
@@ -554,6 +835,124 @@ private:
 };
 
 
+
+class task_set;
+
+/// thread_pool is a persistent collection of worker threads that execute
+/// tasks pushed onto a shared queue.  Using a pool rather than creating
+/// and joining threads for every parallel operation avoids paying the
+/// thread startup/teardown cost over and over, which can dominate the
+/// run time of many small image operations.
+///
+/// The worker threads are not launched until the first task is pushed,
+/// so a pool that is never used costs nothing.  A pool of size 0 has no
+/// workers at all; tasks pushed to it are run by whoever waits on them
+/// (see task_set::wait()).
+class OIIO_API thread_pool {
+public:
+#if OIIO_CPLUSPLUS_VERSION >= 11
+    typedef std::function<void()> Task;
+#else
+    typedef boost::function<void()> Task;
+#endif
+
+    /// Initialize the pool with the given number of worker threads.  A
+    /// value < 0 means to use one fewer than the hardware concurrency
+    /// (the calling thread is expected to do its share of the work).
+    thread_pool (int nthreads = -1);
+
+    /// Stop and join all the worker threads.
+    ~thread_pool ();
+
+    /// How many worker threads the pool will use.
+    int size () const;
+
+    /// Change the number of worker threads.  Growing the pool is lazy
+    /// (new workers are launched by the next push), shrinking it stops
+    /// and joins the current workers.  Tasks already in the queue are
+    /// not lost.  It is not legal to call resize() from within a task
+    /// running on this pool.
+    void resize (int nthreads = -1);
+
+    /// Add a task to the queue.  If ts is not NULL, the task is counted
+    /// as belonging to ts, and ts->wait() will not return until the
+    /// task has completed.  Most callers should use task_set::push()
+    /// rather than calling this directly.
+    void push (const Task &task, task_set *ts = NULL);
+
+    /// If any tasks are waiting in the queue, remove one and run it in
+    /// the calling thread, returning true.  Return false if the queue
+    /// was empty.
+    bool run_one_task ();
+
+    /// Number of tasks waiting in the queue (not including those that
+    /// are currently running).
+    size_t jobs_in_queue () const;
+
+    /// Is the calling thread one of this pool's workers?
+    bool this_thread_is_in_pool () const;
+
+    class Impl;
+private:
+    Impl *m_impl;
+    thread_pool (const thread_pool &); // Do not implement
+    const thread_pool& operator= (const thread_pool &); // Do not implement
+};
+
+
+
+/// Return a pointer to the process-wide shared thread_pool.  It is
+/// created upon first use, sized according to the hardware concurrency,
+/// and resized whenever the global OIIO "threads" attribute is set.
+OIIO_API thread_pool* default_thread_pool ();
+
+
+
+/// task_set is a group of tasks pushed to a thread_pool that the caller
+/// wants to wait for as a unit.  The thread that calls wait() does not
+/// sit idle while the tasks complete -- it will run queued tasks itself,
+/// which also means that it is safe to use a task_set from within a
+/// task that is itself running on the pool (nested parallelism cannot
+/// deadlock waiting for a free worker).
+///
+/// Typical use:
+///     task_set tasks;
+///     for (int i = 0;  i < n;  ++i)
+///         tasks.push (bind (do_work, i));
+///     tasks.wait ();
+///
+class OIIO_API task_set {
+public:
+    /// Make a task_set using the given pool, or the default_thread_pool()
+    /// if pool is NULL.
+    task_set (thread_pool *pool = NULL)
+        : m_pool(pool ? pool : default_thread_pool()), m_pending(0) { }
+
+    ~task_set () { wait(); }
+
+    thread_pool *pool () const { return m_pool; }
+
+    /// Push a task onto the pool's queue as a member of this set.
+    void push (const thread_pool::Task &task) {
+        ++m_pending;
+        m_pool->push (task, this);
+    }
+
+    /// Wait for all of the tasks in the set to complete, helping to run
+    /// queued tasks in the meantime.
+    void wait ();
+
+private:
+    friend class thread_pool::Impl;
+    void task_done () { --m_pending; }
+
+    thread_pool *m_pool;
+    atomic_int m_pending;
+    task_set (const task_set &); // Do not implement
+    const task_set& operator= (const task_set &); // Do not implement
+};
+
+
 OIIO_NAMESPACE_END
 
 #endif // OPENIMAGEIO_THREAD_H
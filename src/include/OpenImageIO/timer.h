@@ -226,6 +226,156 @@ private:
 
 
 
+/// FastTimer has the same interface as Timer, but reads the processor's
+/// cycle counter (the TSC on x86, the virtual counter on ARM64) instead of
+/// asking the OS for the time, making a start/stop pair cost only a few
+/// tens of cycles.  That is cheap enough to leave timing statistics on in
+/// production code around every cache lookup or tile read.
+///
+/// The tick rate is calibrated against the OS clock at first use of
+/// seconds() (taking at most a few tens of ms, and usually nothing since
+/// the calibration interval starts when the library is loaded).  Ticks
+/// are only meaningful as differences on one machine, and assume a
+/// constant-rate counter (true of any x86 CPU since about 2008).  On other
+/// platforms, FastTimer falls back to the same clock as Timer.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# define OIIO_FASTTIMER_CYCLE_COUNTER 1
+#elif (defined(__GNUC__) || defined(__clang__)) && \
+      (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+# define OIIO_FASTTIMER_CYCLE_COUNTER 1
+#else
+# define OIIO_FASTTIMER_CYCLE_COUNTER 0
+#endif
+
+class OIIO_API FastTimer {
+public:
+    typedef long long ticks_t;
+
+    /// Constructor -- reset at zero, and start timing unless optional
+    /// 'startnow' argument is false.
+    FastTimer (bool startnow=true)
+        : m_ticking(false), m_starttime(0), m_elapsed_ticks(0)
+    {
+        if (startnow)
+            start();
+    }
+
+    /// Start (or restart) ticking, if we are not currently.
+    void start () {
+        if (! m_ticking) {
+            m_starttime = now();
+            m_ticking = true;
+        }
+    }
+
+    /// Stop ticking, return the total amount of time that has ticked.
+    double stop () {
+        if (m_ticking) {
+            m_elapsed_ticks += now() - m_starttime;
+            m_ticking = false;
+        }
+        return seconds(m_elapsed_ticks);
+    }
+
+    /// Reset at zero and stop ticking.
+    void reset () {
+        m_elapsed_ticks = 0;
+        m_ticking = false;
+    }
+
+    /// Return just the ticks of the current lap (since the last call to
+    /// start() or lap_ticks()), add that to the previous elapsed time,
+    /// reset current start time to now, keep the timer going.
+    ticks_t lap_ticks () {
+        ticks_t n = now();
+        ticks_t r = m_ticking ? n - m_starttime : ticks_t(0);
+        m_elapsed_ticks += r;
+        m_starttime = n;
+        m_ticking = true;
+        return r;
+    }
+
+    /// Return just the time of the current lap, in seconds.
+    double lap () { return seconds(lap_ticks()); }
+
+    /// Total number of elapsed ticks so far, including both the currently-
+    /// ticking clock as well as any previously elapsed time.
+    ticks_t ticks () const {
+        return (m_ticking ? now() - m_starttime : ticks_t(0)) + m_elapsed_ticks;
+    }
+
+    /// Elapsed time so far, in seconds.
+    double operator() () const { return seconds (ticks()); }
+
+    /// Is the timer currently ticking?
+    bool ticking () const { return m_ticking; }
+
+    /// Current value of the counter.  Only differences are meaningful.
+    static ticks_t now () {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        return (ticks_t) __rdtsc();
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        unsigned int lo, hi;
+        __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+        return (ticks_t) (((unsigned long long)hi << 32) | lo);
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__aarch64__)
+        unsigned long long v;
+        __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r"(v));
+        return (ticks_t) v;
+#else
+        return os_now ();
+#endif
+    }
+
+    /// Convert number of ticks to seconds.
+    static double seconds (ticks_t ticks) { return ticks * seconds_per_tick(); }
+
+    /// The calibrated length of one tick, in seconds.
+    static double seconds_per_tick ();
+
+private:
+    bool m_ticking;          ///< Are we currently ticking?
+    ticks_t m_starttime;     ///< Time since last call to start()
+    ticks_t m_elapsed_ticks; ///< Time elapsed BEFORE the current start().
+
+    // The fallback clock, in Timer ticks.
+    static ticks_t os_now ();
+};
+
+
+
+/// ScopedTimeAccumulator adds the FastTimer time elapsed during its
+/// lifetime to a counter, typically a per-thread statistic so that no
+/// atomics or locks are needed:
+///
+/// \code
+///    {
+///        ScopedTimeAccumulator<double> t (threadstats.io_seconds);
+///        ... do the I/O ...
+///    }   // seconds elapsed are added to threadstats.io_seconds
+/// \endcode
+///
+/// A FastTimer::ticks_t (the default) accumulates raw ticks, which is the
+/// cheapest, and can be converted with FastTimer::seconds() when it is
+/// reported; a double accumulates seconds.
+template<typename T = FastTimer::ticks_t>
+class ScopedTimeAccumulator {
+public:
+    ScopedTimeAccumulator (T &accum)
+        : m_accum(accum), m_start(FastTimer::now()) { }
+    ~ScopedTimeAccumulator () { add (m_accum, FastTimer::now() - m_start); }
+private:
+    T &m_accum;
+    FastTimer::ticks_t m_start;
+    static void add (FastTimer::ticks_t &a, FastTimer::ticks_t t) { a += t; }
+    static void add (double &a, FastTimer::ticks_t t) { a += FastTimer::seconds(t); }
+    // Not copyable
+    ScopedTimeAccumulator (const ScopedTimeAccumulator &);
+    const ScopedTimeAccumulator& operator= (const ScopedTimeAccumulator &);
+};
+
+
+
 /// Helper class that starts and stops a timer when the ScopedTimer goes
 /// in and out of scope.
 class ScopedTimer {
@@ -37,6 +37,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <OpenImageIO/thread.h>
 #include <OpenImageIO/hash.h>
 #include <OpenImageIO/dassert.h>
+#include <OpenImageIO/timer.h>
 
 OIIO_NAMESPACE_BEGIN
 
@@ -82,7 +83,9 @@ public:
     typedef typename BINMAP::iterator BinMap_iterator_t;
 
 public:
-    unordered_map_concurrent () { m_size = 0; }
+    unordered_map_concurrent () : m_waits(NULL), m_wait_ticks(NULL) {
+        m_size = 0;
+    }
 
     ~unordered_map_concurrent () {
 //        for (size_t i = 0;  i < BINS;  ++i)
@@ -192,7 +195,7 @@ public:
         /// Lock the bin we point to, if not already locked.
         void lock () {
             if (m_bin >= 0 && !m_locked) {
-                m_umc->m_bins[m_bin].lock();
+                m_umc->lockbin (m_umc->m_bins[m_bin]);
                 m_locked = true;
             }
         }
@@ -276,7 +279,7 @@ public:
         size_t b = whichbin(key);
         Bin &bin (m_bins[b]);
         if (do_lock)
-            bin.lock ();
+            lockbin (bin);
         typename BinMap_t::iterator it = bin.map.find (key);
         if (it == bin.map.end()) {
             // not found -- return the 'end' iterator
@@ -301,7 +304,7 @@ public:
         size_t b = whichbin(key);
         Bin &bin (m_bins[b]);
         if (do_lock)
-            bin.lock ();
+            lockbin (bin);
         typename BinMap_t::iterator it = bin.map.find (key);
         bool found = (it != bin.map.end());
         if (found)
@@ -321,7 +324,7 @@ public:
         size_t b = whichbin(key);
         Bin &bin (m_bins[b]);
         if (do_lock)
-            bin.lock ();
+            lockbin (bin);
         bool add = (bin.map.find (key) == bin.map.end());
         if (add) {
             // not found -- add it!
@@ -341,7 +344,7 @@ public:
         size_t b = whichbin(key);
         Bin &bin (m_bins[b]);
         if (do_lock)
-            bin.lock ();
+            lockbin (bin);
         typename BinMap_t::iterator it = bin.map.find (key);
         if (it != bin.map.end()) {
             bin.map.erase (it);
@@ -361,7 +364,7 @@ public:
     /// number.
     size_t lock_bin (const KEY &key) {
         size_t b = whichbin(key);
-        m_bins[b].lock ();
+        lockbin (m_bins[b]);
         return b;
     }
 
@@ -371,6 +374,16 @@ public:
         m_bins[bin].unlock ();
     }
 
+    /// Count the bin lock acquisitions that found the bin already locked
+    /// by another thread, adding one to *waits for each and the time
+    /// spent waiting (in Timer ticks) to *wait_ticks.  Passing NULL for
+    /// waits (the default) stops the counting.  Only contended locks are
+    /// timed, so uncontended ones cost the same either way.
+    void count_contention (atomic_ll *waits, atomic_ll *wait_ticks = NULL) {
+        m_wait_ticks = wait_ticks;
+        m_waits = waits;
+    }
+
 private:
     struct Bin {
         OIIO_CACHE_ALIGN             // align bin to cache line
@@ -397,6 +410,15 @@ private:
             DASSERT_MSG (m_nlocks == 1, "oops, m_nlocks = %d", (int)m_nlocks);
 #endif
         }
+        bool try_lock () const {
+            if (! mutex.try_lock())
+                return false;
+#ifndef NDEBUG
+            ++m_nlocks;
+            DASSERT_MSG (m_nlocks == 1, "oops, m_nlocks = %d", (int)m_nlocks);
+#endif
+            return true;
+        }
         void unlock () const {
 #ifndef NDEBUG
             DASSERT_MSG (m_nlocks == 1, "oops, m_nlocks = %d", (int)m_nlocks);
@@ -409,6 +431,23 @@ private:
     HASH m_hash;         // hashing function
     atomic_int m_size;   // total entries in all bins
     Bin m_bins[BINS];    // the bins
+    atomic_ll * volatile m_waits;       // count contended locks here
+    atomic_ll * volatile m_wait_ticks;  // ... and the time they waited
+
+    // Lock the bin, counting the wait if it's contended and somebody
+    // asked for that with count_contention().
+    void lockbin (const Bin &bin) const {
+        atomic_ll *waits = m_waits;
+        if (! waits) {
+            bin.lock ();
+        } else if (! bin.try_lock ()) {
+            Timer timer;
+            bin.lock ();
+            *waits += 1;
+            if (atomic_ll *ticks = m_wait_ticks)
+                *ticks += timer.ticks();
+        }
+    }
 
     // Which bin will this key always appear in?
     size_t whichbin (const KEY &key) {
@@ -649,6 +649,12 @@ public:
     ///
     static size_t memory ();
 
+    /// Retrieve how many insertions of new strings into the ustring
+    /// table found the part of the table they needed locked by another
+    /// thread's insertion, and the total time (in seconds) they spent
+    /// waiting for it.  Lookups of existing strings take no lock.
+    static void insert_contention (long long &waits, double &wait_seconds);
+
     /// Given a string_view, return a pointer to the unique
     /// version kept in the internal table (creating a new table entry
     /// if we haven't seen this sequence of characters before).  
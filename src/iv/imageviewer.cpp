@@ -37,6 +37,7 @@
 #include <unistd.h>
 #endif
 #include <vector>
+#include <deque>
 
 #include <boost/foreach.hpp>
 
@@ -64,6 +65,7 @@
 #include "OpenImageIO/fmath.h"
 #include "OpenImageIO/sysutil.h"
 #include "OpenImageIO/filesystem.h"
+#include "OpenImageIO/thread.h"
 #include "ivutils.h"
 
 
@@ -77,6 +79,124 @@ namespace
 
 
 
+// Reads the images on either side of the current one into the shared
+// ImageCache on a background thread, so that flipping to them finds their
+// pixels already resident and loadCurrentImage doesn't touch the disk.
+// The thread exists only while there is work queued.  A new request (or
+// cancel) bumps the generation, which makes any read in flight give up at
+// its next strip.
+class IvPrefetcher {
+public:
+    struct Item {
+        std::string filename;
+        int subimage, miplevel;
+    };
+
+    IvPrefetcher () : m_generation(0), m_running(false), m_thread(NULL) { }
+    ~IvPrefetcher () { cancel (); }
+
+    /// Replace whatever is queued with items, most wanted first.  Images
+    /// are read whole, skipping any that would take the total read by
+    /// this request beyond budget bytes.
+    void request (const std::vector<Item> &items, imagesize_t budget) {
+        lock_guard lock (m_mutex);
+        ++m_generation;
+        m_queue.assign (items.begin(), items.end());
+        m_budget = budget;
+        m_used = 0;
+        if (! m_running && ! m_queue.empty()) {
+            if (m_thread) {
+                m_thread->join ();
+                delete m_thread;
+            }
+            m_running = true;
+            m_thread = new thread (Runner (this));
+        }
+    }
+
+    /// Drop everything queued and wait for the thread to finish.
+    void cancel () {
+        {
+            lock_guard lock (m_mutex);
+            ++m_generation;
+            m_queue.clear ();
+        }
+        if (m_thread) {
+            m_thread->join ();
+            delete m_thread;
+            m_thread = NULL;
+        }
+    }
+
+private:
+    struct Runner {
+        Runner (IvPrefetcher *prefetcher) : prefetcher(prefetcher) { }
+        void operator() () { prefetcher->run (); }
+        IvPrefetcher *prefetcher;
+    };
+
+    void run () {
+        ImageCache *imagecache = ImageCache::create (true);
+        for (;;) {
+            Item item;
+            int generation;
+            {
+                lock_guard lock (m_mutex);
+                if (m_queue.empty()) {
+                    m_running = false;
+                    return;
+                }
+                item = m_queue.front ();
+                m_queue.pop_front ();
+                generation = m_generation;
+            }
+            ustring name (item.filename);
+            ImageSpec spec;
+            if (! imagecache->get_imagespec (name, spec, item.subimage,
+                                             item.miplevel)) {
+                imagecache->geterror ();  // iv reports it if it's shown
+                continue;
+            }
+            imagesize_t bytes = spec.image_bytes ();
+            {
+                lock_guard lock (m_mutex);
+                if (generation != m_generation ||
+                    m_used + bytes > m_budget)
+                    continue;
+                m_used += bytes;
+            }
+            // Read in strips of whole tiles, so a cancel doesn't have to
+            // wait for an entire image to arrive.
+            int strip = std::max (spec.tile_height, 64);
+            std::vector<char> buf (spec.scanline_bytes() * strip * spec.depth);
+            for (int y = spec.y;  y < spec.y + spec.height;  y += strip) {
+                if (generation != m_generation)
+                    break;
+                int yend = std::min (y + strip, spec.y + spec.height);
+                if (! imagecache->get_pixels (name, item.subimage,
+                                              item.miplevel,
+                                              spec.x, spec.x + spec.width,
+                                              y, yend,
+                                              spec.z, spec.z + spec.depth,
+                                              spec.format, &buf[0])) {
+                    imagecache->geterror ();
+                    break;
+                }
+            }
+        }
+    }
+
+    mutex m_mutex;
+    std::deque<Item> m_queue;    // Waiting to be read
+    atomic_int m_generation;     // Bumped by each request and cancel
+    imagesize_t m_budget;        // Bytes this request may read
+    imagesize_t m_used;          // Bytes this request has read so far
+    bool m_running;              // Is the thread working on the queue?
+    thread *m_thread;
+};
+
+
+
 static const char *s_file_filters = ""
     "Image Files (*.bmp *.cin *.dds *.dpx *.f3d *.fits *.gif *.hdr *.ico *.iff "
     "*.jpg *.jpe *.jpeg *.jif *.jfif *.jfi *.jp2 *.j2k *.exr *.png *.pbm *.pgm "
@@ -112,7 +232,7 @@ ImageViewer::ImageViewer ()
     : infoWindow(NULL), preferenceWindow(NULL), darkPaletteBox(NULL),
       m_current_image(-1), m_current_channel(0), m_color_mode(RGBA),
       m_last_image(-1), m_zoom(1), m_fullscreen(false), m_default_gamma(1),
-      m_darkPalette(false)
+      m_darkPalette(false), m_prefetcher(new IvPrefetcher)
 {
     readSettings (false);
 
@@ -158,6 +278,8 @@ ImageViewer::ImageViewer ()
 
 ImageViewer::~ImageViewer ()
 {
+    delete m_prefetcher;
+    glwin->cancel_loads ();
     BOOST_FOREACH (IvImage *i, m_images)
         delete i;
 }
@@ -421,6 +543,11 @@ ImageViewer::createActions()
     slideShowDuration->setSuffix (" s");
     slideShowDuration->setAccelerated (true);
     connect(slideShowDuration, SIGNAL(valueChanged(int)), this, SLOT(setSlideShowDuration(int)));
+
+    prefetchCountLabel = new QLabel (tr("Read ahead neighbouring images"));
+    prefetchCount = new QSpinBox ();
+    prefetchCount->setRange (0, 16);
+    prefetchCount->setSingleStep (1);
 }
 
 
@@ -605,6 +732,7 @@ ImageViewer::readSettings (bool ui_is_set_up)
     else
         maxMemoryIC->setValue (settings.value ("maxMemoryIC", 2048).toInt());
     slideShowDuration->setValue (settings.value ("slideShowDuration", 10).toInt());
+    prefetchCount->setValue (settings.value ("prefetchCount", 2).toInt());
 
     ImageCache *imagecache = ImageCache::create (true);
     imagecache->attribute ("automip", autoMipmap->isChecked());
@@ -625,6 +753,7 @@ ImageViewer::writeSettings()
     settings.setValue ("autoMipmap", autoMipmap->isChecked());
     settings.setValue ("maxMemoryIC", maxMemoryIC->value());
     settings.setValue ("slideShowDuration", slideShowDuration->value());
+    settings.setValue ("prefetchCount", prefetchCount->value());
     QStringList recent;
     BOOST_FOREACH (const std::string &s, m_recent_files)
         recent.push_front (QString(s.c_str()));
@@ -750,6 +879,7 @@ ImageViewer::reload()
     if (m_images.empty())
         return;
     IvImage *newimage = m_images[m_current_image];
+    glwin->cancel_loads ();
     newimage->invalidate ();
     //glwin->trigger_redraw ();
     displayCurrentImage ();
@@ -921,6 +1051,8 @@ ImageViewer::loadCurrentImage (int subimage, int miplevel)
     }
     IvImage *img = cur ();
     if (img) {
+        // Background tile fetches must not race with (re)reading.
+        glwin->cancel_loads ();
         // We need the spec available to compare the image format with
         // opengl's capabilities.
         if (! img->init_spec (img->name(), subimage, miplevel)) {
@@ -948,16 +1080,10 @@ ImageViewer::loadCurrentImage (int subimage, int miplevel)
                 //std::cerr << "Loading HALF-FLOAT as FLOAT\n";
                 read_format = TypeDesc::FLOAT;
             }
-            if (IsSpecSrgb(image_spec) && !glwin->is_srgb_capable ()) {
-                // If the image is in sRGB, but OpenGL can't load sRGB textures then
-                // we'll need to do the transformation on the CPU after loading the
-                // image. We (so far) can only do this with UINT8 images, so make
-                // sure that it gets loaded in this format.
-                //std::cerr << "Loading as UINT8 to do sRGB\n";
-                read_format = TypeDesc::UINT8;
-                srgb_transform = true;
-                allow_transforms = true;
-            }
+            // Everything else, including decoding sRGB when OpenGL has no
+            // sRGB textures, happens in the shader (see
+            // IvGL::shader_srgb), so the image keeps its own format and
+            // view changes never come back to the CPU.
         } else {
             //std::cerr << "Loading as UINT8\n";
             read_format = TypeDesc::UINT8;
@@ -1041,6 +1167,7 @@ ImageViewer::displayCurrentImage (bool update)
     updateStatusBar();
     if (infoWindow)
         infoWindow->update (img);
+    prefetchNeighbours ();
 
 //    printAct->setEnabled(true);
 //    fitImageToWindowAct->setEnabled(true);
@@ -1050,6 +1177,41 @@ ImageViewer::displayCurrentImage (bool update)
 
 
 
+void
+ImageViewer::prefetchNeighbours ()
+{
+    // Queue the images either side of the current one, nearest first,
+    // alternating next and previous.  Half of the ImageCache is theirs;
+    // asking for more would just evict the image being viewed.
+    int n = (int) m_images.size();
+    std::vector<IvPrefetcher::Item> items;
+    for (int i = 1;  i <= prefetchCount->value() && i < n &&
+                     m_current_image >= 0;  ++i) {
+        for (int dir = 1;  dir >= -1;  dir -= 2) {
+            int index = ((m_current_image + dir * i) % n + n) % n;
+            IvImage *img = m_images[index];
+            if (index == m_current_image || img->image_valid())
+                continue;
+            IvPrefetcher::Item item;
+            item.filename = img->name();
+            item.subimage = std::max (0, img->subimage());
+            item.miplevel = std::max (0, img->miplevel());
+            bool dup = false;
+            for (size_t j = 0;  j < items.size();  ++j)
+                dup |= (items[j].filename == item.filename);
+            if (! dup)
+                items.push_back (item);
+        }
+    }
+    imagesize_t budget = imagesize_t(maxMemoryIC->value()) * 1024 * 1024 / 2;
+    if (items.empty())
+        m_prefetcher->cancel ();
+    else
+        m_prefetcher->request (items, budget);
+}
+
+
+
 void
 ImageViewer::deleteCurrentImage()
 {
@@ -1729,6 +1891,8 @@ ImageViewer::closeImg()
 {
     if (m_images.empty())
         return;
+    m_prefetcher->cancel ();
+    glwin->cancel_loads ();
     delete m_images[m_current_image];
     m_images[m_current_image] = NULL;
     m_images.erase (m_images.begin()+m_current_image);
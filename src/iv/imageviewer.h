@@ -80,6 +80,7 @@ class IvPreferenceWindow;
 class IvCanvas;
 class IvGL;
 class IvImage;
+class IvPrefetcher;
 
 class IvImage : public ImageBuf {
 public:
@@ -310,6 +311,7 @@ private:
     void createMenus ();
     void createToolBars ();
     void createStatusBar ();
+    void prefetchNeighbours ();   ///< Queue read-ahead around current image
     void readSettings (bool ui_is_set_up=true);
     void writeSettings ();
     void updateActions ();
@@ -381,6 +383,8 @@ private:
     QSpinBox *maxMemoryIC;
     QLabel   *slideShowDurationLabel;
     QSpinBox *slideShowDuration;
+    QLabel   *prefetchCountLabel;
+    QSpinBox *prefetchCount;
 
     std::vector<IvImage *> m_images;  ///< List of images
     int m_current_image;              ///< Index of current image, -1 if none
@@ -393,6 +397,7 @@ private:
     float m_default_gamma;            ///< Default gamma of the display
     QPalette m_palette;               ///< Custom palette
     bool m_darkPalette;               ///< Use dark palette?
+    IvPrefetcher *m_prefetcher;       ///< Reads neighbouring images ahead
 
     static const int m_default_width = 640; ///< The default width of the window.
     static const int m_default_height = 480; ///< The default height of the window.
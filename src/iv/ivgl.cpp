@@ -45,6 +45,7 @@
 #include <QtGui/QMouseEvent>
 #include <QtGui/QProgressBar>
 #include <QtOpenGL/QGLFormat>
+#include <QtCore/QMetaObject>
 
 #include <boost/algorithm/string.hpp>
 using boost::algorithm::iequals;
@@ -57,6 +58,10 @@ using boost::algorithm::iequals;
 #include "OpenImageIO/strutil.h"
 #include "OpenImageIO/fmath.h"
 #include "OpenImageIO/timer.h"
+#include "OpenImageIO/thread.h"
+
+#include <cstring>
+#include <deque>
 
 
 static const char *
@@ -81,6 +86,176 @@ gl_err_to_string (GLenum err)
 
 
 
+// Fetches texture tiles (and a low-res proxy of the whole image) from an
+// IvImage on a background thread, so that painting a huge image never
+// waits on the disk.  The thread exists only while there is work queued.
+// Each finished fetch asks the widget to repaint, which uploads it.
+class IvTileLoader {
+public:
+    struct Tile {
+        int x, y, width, height;   // Image region (proxy: its resolution)
+        int chbegin, chend;        // Channels fetched
+        bool proxy;                // Whole image, point-sampled to w x h
+        std::vector<unsigned char> pixels;
+    };
+
+    IvTileLoader (QObject *notify)
+        : m_notify(notify), m_image(NULL), m_running(false), m_thread(NULL)
+    { }
+    ~IvTileLoader () { cancel (); }
+
+    /// Queue a fetch of t from img, unless it's already queued or done.
+    void request (IvImage *img, const Tile &t) {
+        lock_guard lock (m_mutex);
+        if (img != m_image) {
+            m_queue.clear ();
+            m_ready.clear ();
+            m_image = img;
+        }
+        if (find (m_queue, t) || find (m_ready, t) ||
+            (m_running && same (m_fetching, t)))
+            return;
+        m_queue.push_back (t);
+        if (! m_running) {
+            if (m_thread) {
+                m_thread->join ();
+                delete m_thread;
+            }
+            m_running = true;
+            m_thread = new thread (Runner (this));
+        }
+    }
+
+    /// If a fetch matching t has finished, move its pixels into t.pixels
+    /// and return true.
+    bool take (Tile &t) {
+        lock_guard lock (m_mutex);
+        for (size_t i = 0;  i < m_ready.size();  ++i) {
+            if (same (m_ready[i], t)) {
+                t.pixels.swap (m_ready[i].pixels);
+                m_ready.erase (m_ready.begin() + i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Drop all queued and finished fetches and wait for the thread.
+    void cancel () {
+        {
+            lock_guard lock (m_mutex);
+            m_queue.clear ();
+            m_ready.clear ();
+            m_image = NULL;
+        }
+        if (m_thread) {
+            m_thread->join ();
+            delete m_thread;
+            m_thread = NULL;
+        }
+    }
+
+private:
+    struct Runner {
+        Runner (IvTileLoader *loader) : loader(loader) { }
+        void operator() () { loader->run (); }
+        IvTileLoader *loader;
+    };
+
+    static bool same (const Tile &a, const Tile &b) {
+        return a.x == b.x && a.y == b.y && a.width == b.width &&
+               a.height == b.height && a.chbegin == b.chbegin &&
+               a.chend == b.chend && a.proxy == b.proxy;
+    }
+    template<class C> static bool find (const C &tiles, const Tile &t) {
+        for (typename C::const_iterator i = tiles.begin(); i != tiles.end(); ++i)
+            if (same (*i, t))
+                return true;
+        return false;
+    }
+
+    void run () {
+        for (;;) {
+            IvImage *img;
+            {
+                lock_guard lock (m_mutex);
+                if (m_queue.empty() || ! m_image) {
+                    m_running = false;
+                    return;
+                }
+                m_fetching = m_queue.front ();
+                m_queue.pop_front ();
+                img = m_image;
+            }
+            Tile t (m_fetching);
+            fetch (img, t);
+            {
+                lock_guard lock (m_mutex);
+                if (img != m_image)
+                    continue;    // cancelled while we were busy
+                m_ready.push_back (m_fetching);
+                m_ready.back().pixels.swap (t.pixels);
+                m_fetching.width = 0;
+            }
+            QMetaObject::invokeMethod (m_notify, "updateGL",
+                                       Qt::QueuedConnection);
+        }
+    }
+
+    static void fetch (IvImage *img, Tile &t) {
+        const ImageSpec &spec (img->spec());
+        size_t pixelbytes = size_t(t.chend - t.chbegin) * spec.channel_bytes();
+        t.pixels.resize (size_t(t.width) * t.height * pixelbytes);
+        if (! t.proxy) {
+            img->get_pixels (ROI (t.x, t.x+t.width, t.y, t.y+t.height, 0, 1,
+                                  t.chbegin, t.chend),
+                             spec.format, &t.pixels[0]);
+            return;
+        }
+        // Sample the proxy from the smallest MIP level that still has at
+        // least its resolution, or from the image itself.
+        int best = -1;
+        for (int m = img->miplevel()+1;  m < img->nmiplevels();  ++m) {
+            ImageBuf next (img->name(), img->subimage(), m, img->imagecache());
+            if (! next.init_spec (img->name(), img->subimage(), m) ||
+                next.spec().width < t.width || next.spec().height < t.height)
+                break;
+            best = m;
+        }
+        ImageBuf mip;
+        const ImageBuf *level = img;
+        if (best >= 0) {
+            mip.reset (img->name(), img->subimage(), best, img->imagecache());
+            if (mip.init_spec (img->name(), img->subimage(), best))
+                level = &mip;
+        }
+        const ImageSpec &lspec (level->spec());
+        std::vector<unsigned char> row (size_t(lspec.width) * pixelbytes);
+        for (int j = 0;  j < t.height;  ++j) {
+            int y = lspec.y + int ((j + 0.5f) * lspec.height / t.height);
+            level->get_pixels (ROI (lspec.x, lspec.x+lspec.width, y, y+1, 0, 1,
+                                    t.chbegin, t.chend),
+                               spec.format, &row[0]);
+            unsigned char *out = &t.pixels[size_t(j) * t.width * pixelbytes];
+            for (int i = 0;  i < t.width;  ++i) {
+                int x = int ((i + 0.5f) * lspec.width / t.width);
+                memcpy (out + i * pixelbytes, &row[x * pixelbytes], pixelbytes);
+            }
+        }
+    }
+
+    QObject *m_notify;
+    mutex m_mutex;
+    IvImage *m_image;            // Image the queued tiles come from
+    std::deque<Tile> m_queue;    // Waiting to be fetched
+    std::vector<Tile> m_ready;   // Fetched, waiting to be uploaded
+    Tile m_fetching;             // Being fetched now (if m_running)
+    bool m_running;              // Is the thread working on the queue?
+    thread *m_thread;
+};
+
+
+
 IvGL::IvGL (QWidget *parent, ImageViewer &viewer)
     : QGLWidget(parent), m_viewer(viewer), 
       m_shaders_created(false), m_tex_created(false),
@@ -90,7 +265,10 @@ IvGL::IvGL (QWidget *parent, ImageViewer &viewer)
       m_use_srgb(false), m_use_pbo(false), 
       m_texture_width(1), m_texture_height(1), m_last_pbo_used(0), 
       m_current_image(NULL), m_pixelview_left_corner(true),
-      m_last_texbuf_used(0)
+      m_last_texbuf_used(0), m_streaming(false), m_tile_loader(NULL),
+      m_proxy_tex(0), m_proxy_width(0), m_proxy_height(0),
+      m_visible_xbegin(0), m_visible_xend(0),
+      m_visible_ybegin(0), m_visible_yend(0)
 {
 #if 0
     QGLFormat format;
@@ -104,12 +282,22 @@ IvGL::IvGL (QWidget *parent, ImageViewer &viewer)
     m_mouse_activation = false;
     this->setFocusPolicy (Qt::StrongFocus);
     setMouseTracking (true);
+    m_tile_loader = new IvTileLoader (this);
 }
 
 
 
 IvGL::~IvGL ()
 {
+    delete m_tile_loader;
+}
+
+
+
+void
+IvGL::cancel_loads ()
+{
+    m_tile_loader->cancel ();
 }
 
 
@@ -195,6 +383,14 @@ IvGL::create_textures (void)
         m_texbufs.back().height = 0;
     }
 
+    // And one for the low-res proxy of images too big for one texture.
+    glGenTextures (1, &m_proxy_tex);
+    glBindTexture (GL_TEXTURE_2D, m_proxy_tex);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+
     // Create another texture for the pixelview.
     glGenTextures (1, &m_pixelview_tex);
     glBindTexture (GL_TEXTURE_2D, m_pixelview_tex);
@@ -242,6 +438,7 @@ IvGL::create_shaders (void)
         "uniform int linearinterp;\n"
         "uniform int width;\n"
         "uniform int height;\n"
+        "uniform int srgbtolinear;\n"
         "vec4 rgba_mode (vec4 C)\n"
         "{\n"
         "    if (imgchannels <= 2) {\n"
@@ -316,6 +513,11 @@ IvGL::create_shaders (void)
         "        }\n"
         "    }\n"
         "    vec4 C = texture2D (imgtex, st);\n"
+        "    if (srgbtolinear != 0) {\n"
+        "        vec3 lo = C.rgb / 12.92;\n"
+        "        vec3 hi = pow ((C.rgb + 0.055) / 1.055, vec3 (2.4, 2.4, 2.4));\n"
+        "        C.rgb = mix (lo, hi, step (vec3 (0.04045, 0.04045, 0.04045), C.rgb));\n"
+        "    }\n"
         "    C = mix (C, vec4(0.05,0.05,0.05,1.0), black);\n"
         "    if (startchannel < 0)\n"
         "        C = vec4(0.0,0.0,0.0,1.0);\n"
@@ -585,6 +787,23 @@ handle_orientation (int orientation, int width, int height,
 
 
 
+// Resolution of the low-res proxy shown while streaming a huge image:
+// at most 2048 (and maxtexsize) on its long side, keeping the aspect.
+static void
+proxy_size (const ImageSpec &spec, int maxtexsize, int &w, int &h)
+{
+    int maxres = std::min (2048, maxtexsize);
+    int longest = std::max (spec.width, spec.height);
+    w = spec.width;
+    h = spec.height;
+    if (longest > maxres) {
+        w = std::max (1, int ((long long)spec.width * maxres / longest));
+        h = std::max (1, int ((long long)spec.height * maxres / longest));
+    }
+}
+
+
+
 void
 IvGL::paintGL ()
 {
@@ -650,6 +869,9 @@ IvGL::paintGL ()
     yend = std::min (spec.y + spec.height, yend + m_texture_height - (yend % m_texture_height));
     //std::cerr << "(" << xbegin << ',' << ybegin << ") - (" << xend << ',' << yend << ")\n";
 
+    m_visible_xbegin = xbegin;  m_visible_xend = xend;
+    m_visible_ybegin = ybegin;  m_visible_yend = yend;
+
     // Provide some feedback
     int total_tiles = (int) (ceilf(float(xend-xbegin)/m_texture_width) * ceilf(float(yend-ybegin)/m_texture_height));
     float tile_advance = 1.0f/total_tiles;
@@ -657,9 +879,47 @@ IvGL::paintGL ()
     m_viewer.statusViewInfo->hide ();
     m_viewer.statusProgress->show ();
 
-    // FIXME: change the code path so we can take full advantage of async DMA
-    // when using PBO.
-    for (int ystart = ybegin ; ystart < yend; ystart += m_texture_height) {
+    // When streaming, first draw the low-res proxy (slightly behind the
+    // tiles) so it shows wherever tiles haven't arrived yet. Zoomed out
+    // so far that more tiles are visible than we have texture buffers,
+    // the proxy is all we draw -- it has about the resolution shown.
+    int chbegin = 0, nchannels = texture_channels (chbegin);
+    bool tiles_wanted = true;
+    if (m_streaming) {
+        if (! m_proxy_width) {
+            IvTileLoader::Tile proxy;
+            proxy.proxy = true;
+            proxy.x = proxy.y = 0;
+            proxy.chbegin = chbegin;
+            proxy.chend = chbegin + nchannels;
+            proxy_size (spec, m_max_texture_size, proxy.width, proxy.height);
+            if (m_tile_loader->take (proxy)) {
+                GLenum gltype, glformat, glinternalformat;
+                typespec_to_opengl (spec, nchannels, gltype, glformat,
+                                    glinternalformat);
+                if (m_use_pbo)
+                    glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+                glBindTexture (GL_TEXTURE_2D, m_proxy_tex);
+                glTexImage2D (GL_TEXTURE_2D, 0, glinternalformat,
+                              proxy.width, proxy.height, 0,
+                              glformat, gltype, &proxy.pixels[0]);
+                GLERRPRINT ("Loading proxy");
+                m_proxy_width = proxy.width;
+                m_proxy_height = proxy.height;
+            }
+        }
+        if (m_proxy_width) {
+            glBindTexture (GL_TEXTURE_2D, m_proxy_tex);
+            useshader (m_proxy_width, m_proxy_height);
+            gl_rect (spec.x, spec.y, spec.x+spec.width, spec.y+spec.height,
+                     -0.01f);
+            useshader (m_texture_width, m_texture_height);
+        }
+        // Without a proxy yet, don't ask for more tiles than fit.
+        tiles_wanted = total_tiles <= (int)m_texbufs.size();
+    }
+
+    for (int ystart = ybegin ; tiles_wanted && ystart < yend; ystart += m_texture_height) {
         for (int xstart = xbegin ; xstart < xend; xstart += m_texture_width) {
             int tile_width = std::min (xend - xstart, m_texture_width);
             int tile_height = std::min (yend - ystart, m_texture_height);
@@ -669,10 +929,25 @@ IvGL::paintGL ()
             //std::cerr << "xstart: " << xstart << ". ystart: " << ystart << "\n";
             //std::cerr << "tile_width: " << tile_width << ". tile_height: " << tile_height << "\n";
 
-            // FIXME: This can get too slow. Some ideas: avoid sending the tex
-            // images more than necessary, figure an optimum texture size, use
-            // multiple texture objects.
-            load_texture (xstart, ystart, tile_width, tile_height, percent);
+            if (m_streaming) {
+                // Use the tile if it's resident or has just arrived;
+                // otherwise ask for it and let the proxy show through.
+                if (! bind_texture (xstart, ystart, tile_width, tile_height)) {
+                    IvTileLoader::Tile t;
+                    t.proxy = false;
+                    t.x = xstart;  t.y = ystart;
+                    t.width = tile_width;  t.height = tile_height;
+                    t.chbegin = chbegin;  t.chend = chbegin + nchannels;
+                    if (! m_tile_loader->take (t)) {
+                        m_tile_loader->request (img, t);
+                        continue;
+                    }
+                    upload_texture (xstart, ystart, tile_width, tile_height,
+                                    &t.pixels[0]);
+                }
+            } else {
+                load_texture (xstart, ystart, tile_width, tile_height, percent);
+            }
             gl_rect (xstart, ystart, xstart+tile_width, ystart+tile_height, 0,
                      smin, tmin, smax, tmax);
             percent += tile_advance;
@@ -1000,6 +1275,9 @@ IvGL::useshader (int tex_width, int tex_height, bool pixelview)
 
     loc = gl_get_uniform_location ("height");
     gl_uniform (loc, tex_height);
+
+    loc = gl_get_uniform_location ("srgbtolinear");
+    gl_uniform (loc, (int) shader_srgb (spec));
     GLERRPRINT ("After settting uniforms");
 }
 
@@ -1011,6 +1289,9 @@ IvGL::update ()
     //std::cerr << "update image\n";
     
     IvImage* img = m_viewer.cur();
+    m_tile_loader->cancel ();
+    m_proxy_width = m_proxy_height = 0;
+    m_streaming = false;
     if (! img) {
         m_current_image = NULL;
         return;
@@ -1065,6 +1346,22 @@ IvGL::update ()
     // Resize the buffer at once, rather than create one each drawing.
     m_tex_buffer.resize (m_texture_width * m_texture_height * nchannels * spec.channel_bytes());
     m_current_image = img;
+
+    // An image that needs more than one texture is streamed: request its
+    // proxy now, and tiles as they become visible. The CPU-side color
+    // transforms of the non-shader path rewrite the image's pixels, so
+    // that path keeps loading synchronously.
+    if (m_use_shaders && img->image_valid() &&
+        (spec.width > m_texture_width || spec.height > m_texture_height)) {
+        m_streaming = true;
+        IvTileLoader::Tile proxy;
+        proxy.proxy = true;
+        proxy.x = proxy.y = 0;
+        int nchans = texture_channels (proxy.chbegin);
+        proxy.chend = proxy.chbegin + nchans;
+        proxy_size (spec, m_max_texture_size, proxy.width, proxy.height);
+        m_tile_loader->request (img, proxy);
+    }
 }
 
 
@@ -1482,12 +1779,14 @@ IvGL::typespec_to_opengl (const ImageSpec &spec, int nchannels, GLenum &gltype,
         break;
     }
 
-    bool issrgb = iequals (spec.get_string_attribute ("oiio:ColorSpace"), "sRGB");
-    
+    // Use an sRGB texture format only when the shader isn't decoding sRGB.
+    bool srgbtex = m_use_srgb && ! shader_srgb (spec) &&
+        iequals (spec.get_string_attribute ("oiio:ColorSpace"), "sRGB");
+
     glinternalformat = nchannels;
     if (nchannels == 1) {
         glformat = GL_LUMINANCE;
-        if (m_use_srgb && issrgb) {
+        if (srgbtex) {
             if (spec.format.basetype == TypeDesc::UINT8) {
                 glinternalformat = GL_SLUMINANCE8;
             } else {
@@ -1504,7 +1803,7 @@ IvGL::typespec_to_opengl (const ImageSpec &spec, int nchannels, GLenum &gltype,
         }
     } else if (nchannels == 2) {
         glformat = GL_LUMINANCE_ALPHA;
-        if (m_use_srgb && issrgb) {
+        if (srgbtex) {
             if (spec.format.basetype == TypeDesc::UINT8) {
                 glinternalformat = GL_SLUMINANCE8_ALPHA8;
             } else {
@@ -1521,7 +1820,7 @@ IvGL::typespec_to_opengl (const ImageSpec &spec, int nchannels, GLenum &gltype,
         }
     } else if (nchannels == 3) {
         glformat = GL_RGB;
-        if (m_use_srgb && issrgb) {
+        if (srgbtex) {
             if (spec.format.basetype == TypeDesc::UINT8) {
                 glinternalformat = GL_SRGB8;
             } else {
@@ -1538,7 +1837,7 @@ IvGL::typespec_to_opengl (const ImageSpec &spec, int nchannels, GLenum &gltype,
         }
     } else if (nchannels == 4) {
         glformat = GL_RGBA;
-        if (m_use_srgb && issrgb) {
+        if (srgbtex) {
             if (spec.format.basetype == TypeDesc::UINT8) {
                 glinternalformat = GL_SRGB8_ALPHA8;
             } else {
@@ -1561,17 +1860,54 @@ IvGL::typespec_to_opengl (const ImageSpec &spec, int nchannels, GLenum &gltype,
 
 
 
-void
-IvGL::load_texture (int x, int y, int width, int height, float percent)
+bool
+IvGL::shader_srgb (const ImageSpec &spec) const
+{
+    return m_use_shaders &&
+           iequals (spec.get_string_attribute ("oiio:ColorSpace"), "sRGB") &&
+           (! m_use_srgb || spec.format.basetype != TypeDesc::UINT8);
+}
+
+
+
+int
+IvGL::texture_channels (int &chbegin) const
 {
     const ImageSpec &spec = m_current_image->spec ();
+    int nchannels = spec.nchannels;
+    chbegin = 0;
+    // For simplicity, we don't support more than 4 channels without shaders
+    // (yet).
+    if (m_use_shaders) {
+        nchannels = num_channels(m_viewer.current_channel(), nchannels, m_viewer.current_color_mode());
+        chbegin = m_viewer.current_channel();
+    }
+    return nchannels;
+}
+
+
+
+bool
+IvGL::bind_texture (int x, int y, int width, int height)
+{
     // Find if this has already been loaded.
     BOOST_FOREACH (TexBuffer &tb, m_texbufs) {
         if (tb.x == x && tb.y == y && tb.width >= width && tb.height >= height) {
             glBindTexture (GL_TEXTURE_2D, tb.tex_object);
-            return;
+            return true;
         }
     }
+    return false;
+}
+
+
+
+void
+IvGL::load_texture (int x, int y, int width, int height, float percent)
+{
+    const ImageSpec &spec = m_current_image->spec ();
+    if (bind_texture (x, y, width, height))
+        return;
 
     // Make it somewhat obvious to the user that some progress is happening
     // here.
@@ -1581,47 +1917,58 @@ IvGL::load_texture (int x, int y, int width, int height, float percent)
     m_viewer.statusProgress->repaint ();
     setCursor (Qt::WaitCursor);
 
-    int nchannels = spec.nchannels;
-    // For simplicity, we don't support more than 4 channels without shaders
-    // (yet).
-    if (m_use_shaders) {
-        nchannels = num_channels(m_viewer.current_channel(), nchannels, m_viewer.current_color_mode());
-    }
+    // Copy the imagebuf pixels we need, that's the only way we can do
+    // it safely since ImageBuf has a cache underneath and the whole image
+    // may not be resident at once.
+    int chbegin, nchannels = texture_channels (chbegin);
+    m_current_image->get_pixels (ROI (x, x+width, y, y+height, 0, 1,
+                                      chbegin, chbegin + nchannels),
+                                 spec.format, &m_tex_buffer[0]);
+    upload_texture (x, y, width, height, &m_tex_buffer[0]);
+}
+
+
+
+void
+IvGL::upload_texture (int x, int y, int width, int height, const void *pixels)
+{
+    const ImageSpec &spec = m_current_image->spec ();
+    int chbegin, nchannels = texture_channels (chbegin);
     GLenum gltype, glformat, glinternalformat;
     typespec_to_opengl (spec, nchannels, gltype, glformat, glinternalformat);
 
+    // Reuse the next buffer (round robin) that isn't showing some other
+    // part of the region being painted, so that drawing many tiles
+    // doesn't keep evicting ones still on screen.
+    int n = (int) m_texbufs.size();
+    for (int i = 0;  i < n;  ++i) {
+        const TexBuffer &t (m_texbufs[(m_last_texbuf_used + i) % n]);
+        if (t.width == 0 || t.x >= m_visible_xend || t.x + t.width <= m_visible_xbegin ||
+            t.y >= m_visible_yend || t.y + t.height <= m_visible_ybegin) {
+            m_last_texbuf_used = (m_last_texbuf_used + i) % n;
+            break;
+        }
+    }
     TexBuffer &tb = m_texbufs[m_last_texbuf_used];
     tb.x = x;
     tb.y = y;
     tb.width = width;
     tb.height = height;
-    // Copy the imagebuf pixels we need, that's the only way we can do
-    // it safely since ImageBuf has a cache underneath and the whole image
-    // may not be resident at once.
-    if (! m_use_shaders) {
-        m_current_image->get_pixels (ROI (x, x + width, y, y + height),
-                                     spec.format, &m_tex_buffer[0]);
-    } else {
-        m_current_image->get_pixels (ROI (x, x+width, y, y+height, 0, 1,
-                                          m_viewer.current_channel(),
-                                          m_viewer.current_channel() + nchannels),
-                                     spec.format, &m_tex_buffer[0]);
-    }
     if (m_use_pbo) {
         glBindBufferARB (GL_PIXEL_UNPACK_BUFFER_ARB, 
                          m_pbo_objects[m_last_pbo_used]);
         glBufferDataARB (GL_PIXEL_UNPACK_BUFFER_ARB, 
-                         width * height * spec.pixel_bytes(),
-                         &m_tex_buffer[0],
+                         width * height * nchannels * spec.channel_bytes(),
+                         pixels,
                          GL_STREAM_DRAW_ARB);
         GLERRPRINT ("After buffer data");
         m_last_pbo_used = (m_last_pbo_used + 1) & 1;
     }
 
     // When using PBO this is the offset within the buffer.
-    void *data = 0;
+    const void *data = 0;
     if (! m_use_pbo)
-        data = &m_tex_buffer[0];
+        data = pixels;
 
     glBindTexture (GL_TEXTURE_2D, tb.tex_object);
     GLERRPRINT ("After bind texture");
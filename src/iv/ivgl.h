@@ -58,6 +58,7 @@ OIIO_NAMESPACE_USING;
 
 class IvImage;
 class ImageViewer;
+class IvTileLoader;
 
 
 
@@ -108,6 +109,11 @@ public:
 
     void trigger_redraw (void) { glDraw(); }
 
+    /// Drop any texture tiles still being fetched in the background for
+    /// the current image, waiting for one in progress to finish.  Must be
+    /// called before that image's pixels change or it is deleted.
+    void cancel_loads ();
+
     /// Returns true if OpenGL is capable of loading textures in the sRGB color
     /// space.
     bool is_srgb_capable (void) const { return m_use_srgb; }
@@ -120,6 +126,12 @@ public:
     ///
     bool is_half_capable (void) const { return m_use_halffloat; }
 
+    /// Does the shader decode sRGB for this image, rather than OpenGL's
+    /// 8-bit sRGB texture formats or the CPU?  True for sRGB images
+    /// whenever there are shaders, unless the image is UINT8 and sRGB
+    /// textures are available, so the texture keeps the image's format.
+    bool shader_srgb (const ImageSpec &spec) const;
+
     /// Returns true if the image is too big to fit within allocated textures
     /// (i.e., it's recommended to use lower resolution versions when zoomed out).
     bool is_too_big (float width, float height);
@@ -169,6 +181,15 @@ protected:
     };
     std::vector<TexBuffer> m_texbufs;
     int m_last_texbuf_used;
+    /// For images too big for one texture, tiles (and a low-res proxy of
+    /// the whole image, shown until they arrive) are fetched from the
+    /// ImageCache by a background thread rather than while painting.
+    bool m_streaming;
+    IvTileLoader *m_tile_loader;
+    GLuint m_proxy_tex;               ///< Texture with the low-res proxy
+    int m_proxy_width, m_proxy_height;///< Proxy size (0 until it's loaded)
+    int m_visible_xbegin, m_visible_xend; ///< Image region being painted
+    int m_visible_ybegin, m_visible_yend;
     bool m_mouse_activation;          ///< Can we expect the window to be activated by mouse?
 
 
@@ -227,6 +248,19 @@ private:
     /// Loads the given patch of the image, but first figures if it's already
     /// been loaded.
     void load_texture (int x, int y, int width, int height, float percent);
+
+    /// If the given patch of the image is already in a texture buffer,
+    /// bind it and return true.
+    bool bind_texture (int x, int y, int width, int height);
+
+    /// Copy pixels (current channels, in the image's data format) for the
+    /// given patch into a texture buffer not showing any other part of the
+    /// visible region, and leave it bound.
+    void upload_texture (int x, int y, int width, int height,
+                         const void *pixels);
+
+    /// Number of channels (starting at chbegin) the textures hold.
+    int texture_channels (int &chbegin) const;
     
     /// Destroys shaders and selects fixed-function pipeline
     void create_shaders_abort (void);
@@ -64,8 +64,13 @@ IvPreferenceWindow::IvPreferenceWindow (ImageViewer &viewer)
     slideShowLayout->addWidget (viewer.slideShowDurationLabel);
     slideShowLayout->addWidget (viewer.slideShowDuration);
 
+    QLayout *prefetchLayout = new QHBoxLayout;
+    prefetchLayout->addWidget (viewer.prefetchCountLabel);
+    prefetchLayout->addWidget (viewer.prefetchCount);
+
     layout->addLayout (inner_layout);
     layout->addLayout (slideShowLayout);
+    layout->addLayout (prefetchLayout);
     layout->addWidget (closeButton);
     setLayout (layout);
 
@@ -76,13 +76,16 @@ class JpgInput : public ImageInput {
     virtual const char * format_name (void) const { return "jpeg"; }
     virtual int supports (string_view feature) const {
         return (feature == "exif"
-             || feature == "iptc");
+             || feature == "iptc"
+             || feature == "ioproxy");
     }
     virtual bool valid_file (const std::string &filename) const;
     virtual bool open (const std::string &name, ImageSpec &spec);
     virtual bool open (const std::string &name, ImageSpec &spec,
                        const ImageSpec &config);
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
     virtual bool close ();
     const std::string &filename () const { return m_filename; }
     void * coeffs () const { return m_coeffs; }
@@ -96,24 +99,56 @@ class JpgInput : public ImageInput {
     // Called by my_error_exit
     void jpegerror (my_error_ptr myerr, bool fatal=false);
 
+    /// libjpeg source manager that reads from a Filesystem::IOProxy,
+    /// directly from its memory if it has any.
+    struct proxy_source_mgr {
+        struct jpeg_source_mgr pub;
+        Filesystem::IOProxy *io;
+        JOCTET buffer[4096];
+    };
+
  private:
     FILE *m_fd;
+    Filesystem::IOProxy *m_io;  // Caller's proxy (not owned), or NULL
+    proxy_source_mgr m_src;     // Source manager used when m_io is set
     std::string m_filename;
     int m_next_scanline;      // Which scanline is the next to read?
     bool m_raw;               // Read raw coefficients, not scanlines
     bool m_cmyk;              // The input file is cmyk
     bool m_fatalerr;          // JPEG reader hit a fatal error
+    int m_scale_denom;        // Decode at 1/m_scale_denom size (DCT scaling)
     struct jpeg_decompress_struct m_cinfo;
     my_error_mgr m_jerr;
     jvirt_barray_ptr *m_coeffs;
     std::vector<unsigned char> m_cmyk_buf; // For CMYK translation
+    int m_restart_rows;       // Image rows per restart interval, if the
+                              //   intervals can be decoded independently
+    bool m_restart_scanned;   // Have we located the restart intervals?
+    const unsigned char *m_filemem;        // Whole file, in memory
+    size_t m_filesize;
+    std::vector<unsigned char> m_filebuf;  // Holds m_filemem if not mmapped
+    size_t m_sof_height;      // Offset of the frame height in the file
+    size_t m_header_end;      // Offset of the first entropy-coded byte
+    std::vector<size_t> m_rst_begin;       // Extent of each restart
+    std::vector<size_t> m_rst_end;         //   interval's coded data
 
     void init () {
         m_fd = NULL;
+        m_io = NULL;
         m_raw = false;
         m_cmyk = false;
         m_fatalerr = false;
+        m_scale_denom = 1;
         m_coeffs = NULL;
+        m_restart_rows = 0;
+        m_restart_scanned = false;
+        m_filemem = NULL;
+        m_filesize = 0;
+        m_sof_height = 0;
+        m_header_end = 0;
+        std::vector<unsigned char>().swap (m_filebuf);
+        m_rst_begin.clear ();
+        m_rst_end.clear ();
         m_jerr.jpginput = this;
     }
 
@@ -126,6 +161,11 @@ class JpgInput : public ImageInput {
 
     bool read_icc_profile (j_decompress_ptr cinfo, ImageSpec& spec);
 
+    // Load the whole file and find the coded data of each restart
+    // interval.  Return false if the file doesn't look the way we need
+    // it to for decoding the intervals independently.
+    bool find_restart_intervals ();
+
     void close_file () {
         if (m_fd)
             fclose (m_fd);   // N.B. the init() will set m_fd to NULL
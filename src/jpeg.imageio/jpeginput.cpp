@@ -37,6 +37,7 @@
 #include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/fmath.h"
 #include "OpenImageIO/color.h"
+#include "OpenImageIO/thread.h"
 #include "jpeg_pvt.h"
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
@@ -102,6 +103,72 @@ my_output_message (j_common_ptr cinfo)
 
 
 
+// libjpeg source manager callbacks for reading from an IOProxy.  If the
+// proxy's bytes are all in memory, the whole of them is handed to libjpeg
+// at once and nothing is copied.
+
+static void
+proxy_init_source (j_decompress_ptr cinfo)
+{
+    JpgInput::proxy_source_mgr *src = (JpgInput::proxy_source_mgr *) cinfo->src;
+    const void *mem = src->io->mmap ();
+    if (mem) {
+        src->pub.next_input_byte = (const JOCTET *) mem + src->io->tell();
+        src->pub.bytes_in_buffer = src->io->size() - size_t(src->io->tell());
+        src->io->seek (int64_t(src->io->size()));
+    } else {
+        src->pub.next_input_byte = src->buffer;
+        src->pub.bytes_in_buffer = 0;
+    }
+}
+
+
+
+static boolean
+proxy_fill_input_buffer (j_decompress_ptr cinfo)
+{
+    JpgInput::proxy_source_mgr *src = (JpgInput::proxy_source_mgr *) cinfo->src;
+    size_t n = src->io->read (src->buffer, sizeof(src->buffer));
+    if (n == 0) {
+        // Out of data: insert a fake EOI marker, as libjpeg's stdio
+        // source does, so a truncated file decodes what it can.
+        src->buffer[0] = (JOCTET) 0xFF;
+        src->buffer[1] = (JOCTET) JPEG_EOI;
+        n = 2;
+    }
+    src->pub.next_input_byte = src->buffer;
+    src->pub.bytes_in_buffer = n;
+    return TRUE;
+}
+
+
+
+static void
+proxy_skip_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+    JpgInput::proxy_source_mgr *src = (JpgInput::proxy_source_mgr *) cinfo->src;
+    if (num_bytes <= 0)
+        return;
+    if (size_t(num_bytes) <= src->pub.bytes_in_buffer) {
+        src->pub.next_input_byte += num_bytes;
+        src->pub.bytes_in_buffer -= size_t(num_bytes);
+    } else {
+        num_bytes -= long(src->pub.bytes_in_buffer);
+        src->io->seek (std::min (src->io->tell() + num_bytes,
+                                 int64_t(src->io->size())));
+        src->pub.bytes_in_buffer = 0;
+    }
+}
+
+
+
+static void
+proxy_term_source (j_decompress_ptr cinfo)
+{
+}
+
+
+
 static std::string 
 comp_info_to_attr (const jpeg_decompress_struct &cinfo) 
 {   
@@ -174,6 +241,17 @@ JpgInput::open (const std::string &name, ImageSpec &newspec,
     const ImageIOParameter *p = config.find_attribute ("_jpeg:raw",
                                                        TypeDesc::TypeInt);
     m_raw = p && *(int *)p->data();
+    // "jpeg:scale_denom" asks for the image to be decoded at reduced
+    // size by libjpeg's DCT scaling, which is much cheaper than decoding
+    // at full size and resizing.  Only 1, 2, 4, and 8 are supported by
+    // every libjpeg, so round down to one of those.
+    int denom = config.get_int_attribute ("jpeg:scale_denom", 1);
+    m_scale_denom = 1;
+    while (m_scale_denom < 8 && m_scale_denom*2 <= denom)
+        m_scale_denom *= 2;
+    p = config.find_attribute ("oiio:ioproxy", TypeDesc::PTR);
+    if (p)
+        m_io = *(Filesystem::IOProxy * const *) p->data();
     return open (name, newspec);
 }
 
@@ -184,21 +262,27 @@ JpgInput::open (const std::string &name, ImageSpec &newspec)
 {
     // Check that file exists and can be opened
     m_filename = name;
-    m_fd = Filesystem::fopen (name, "rb");
-    if (m_fd == NULL) {
-        error ("Could not open file \"%s\"", name.c_str());
-        return false;
+    if (! m_io) {
+        m_fd = Filesystem::fopen (name, "rb");
+        if (m_fd == NULL) {
+            error ("Could not open file \"%s\"", name.c_str());
+            return false;
+        }
     }
 
     // Check magic number to assure this is a JPEG file
     uint8_t magic[2] = {0, 0};
-    if (fread (magic, sizeof(magic), 1, m_fd) != 1) {
+    if (m_io ? (m_io->pread (magic, sizeof(magic), 0) != sizeof(magic))
+             : (fread (magic, sizeof(magic), 1, m_fd) != 1)) {
         error ("Empty file \"%s\"", name.c_str());
         close_file ();
         return false;
     }
 
-    rewind (m_fd);
+    if (m_io)
+        m_io->seek (0);
+    else
+        rewind (m_fd);
     if (magic[0] != JPEG_MAGIC1 || magic[1] != JPEG_MAGIC2) {
         close_file ();
         error ("\"%s\" is not a JPEG file, magic number doesn't match (was 0x%x%x)",
@@ -220,7 +304,19 @@ JpgInput::open (const std::string &name, ImageSpec &newspec)
     }
 
     jpeg_create_decompress (&m_cinfo);          // initialize decompressor
-    jpeg_stdio_src (&m_cinfo, m_fd);            // specify the data source
+    if (m_io) {                                 // specify the data source
+        m_src.io = m_io;
+        m_src.pub.init_source = proxy_init_source;
+        m_src.pub.fill_input_buffer = proxy_fill_input_buffer;
+        m_src.pub.skip_input_data = proxy_skip_input_data;
+        m_src.pub.resync_to_restart = jpeg_resync_to_restart;
+        m_src.pub.term_source = proxy_term_source;
+        m_src.pub.next_input_byte = NULL;
+        m_src.pub.bytes_in_buffer = 0;
+        m_cinfo.src = &m_src.pub;
+    } else {
+        jpeg_stdio_src (&m_cinfo, m_fd);
+    }
 
     // Request saving of EXIF and other special tags for later spelunking
     for (int mark = 0;  mark < 16;  ++mark)
@@ -245,8 +341,22 @@ JpgInput::open (const std::string &name, ImageSpec &newspec)
 
     if (m_raw)
         m_coeffs = jpeg_read_coefficients (&m_cinfo);
-    else
+    else {
+        if (m_scale_denom > 1) {
+            m_cinfo.scale_num = 1;
+            m_cinfo.scale_denom = m_scale_denom;
+        }
         jpeg_start_decompress (&m_cinfo);       // start working
+        // A single interleaved scan whose restart intervals each span
+        // whole MCU rows can be split into bands of rows that decode
+        // independently of each other (see read_native_scanlines).
+        if (! m_fatalerr && ! m_cinfo.progressive_mode &&
+              m_cinfo.restart_interval > 0 &&
+              m_cinfo.comps_in_scan == m_cinfo.num_components &&
+              m_cinfo.restart_interval % m_cinfo.MCUs_per_row == 0)
+            m_restart_rows = int(m_cinfo.restart_interval / m_cinfo.MCUs_per_row)
+                           * m_cinfo.max_v_samp_factor * DCTSIZE;
+    }
     if (m_fatalerr)
         return false;
     m_next_scanline = 0;                        // next scanline we'll read
@@ -417,8 +527,13 @@ JpgInput::read_native_scanline (int y, int z, void *data)
         // up to.  Easy fix: close the file and re-open.
         ImageSpec dummyspec;
         int subimage = current_subimage();
-        if (! close ()  ||
-            ! open (m_filename, dummyspec)  ||
+        int scale_denom = m_scale_denom;   // close() resets it
+        Filesystem::IOProxy *io = m_io;
+        if (! close ())
+            return false;
+        m_scale_denom = scale_denom;
+        m_io = io;
+        if (! open (m_filename, dummyspec)  ||
             ! seek_subimage (subimage, 0, dummyspec))
             return false;    // Somehow, the re-open failed
         assert (m_next_scanline == 0 && current_subimage() == subimage);
@@ -457,10 +572,358 @@ JpgInput::read_native_scanline (int y, int z, void *data)
 
 
 
+// The pieces of a synthetic JPEG stream -- the file's header with the
+// frame height patched, some of its restart intervals, and an EOI --
+// handed to libjpeg one after another without copying the coded data.
+struct band_source_mgr {
+    struct jpeg_source_mgr pub;
+    const std::pair<const JOCTET *, size_t> *pieces;
+    size_t npieces, next;
+};
+
+// Marker codes jpeglib.h doesn't give us
+static const int JPEG_SOF0 = 0xC0;
+static const int JPEG_SOS = 0xDA;
+
+static const JOCTET eoi_marker[2] = { 0xFF, JPEG_EOI };
+static const JOCTET rst_markers[8][2] = {
+    { 0xFF, JPEG_RST0 }, { 0xFF, JPEG_RST0+1 }, { 0xFF, JPEG_RST0+2 },
+    { 0xFF, JPEG_RST0+3 }, { 0xFF, JPEG_RST0+4 }, { 0xFF, JPEG_RST0+5 },
+    { 0xFF, JPEG_RST0+6 }, { 0xFF, JPEG_RST0+7 }
+};
+
+
+
+static void
+band_init_source (j_decompress_ptr cinfo)
+{
+}
+
+
+
+static boolean
+band_fill_input_buffer (j_decompress_ptr cinfo)
+{
+    band_source_mgr *src = (band_source_mgr *) cinfo->src;
+    while (src->next < src->npieces && ! src->pieces[src->next].second)
+        ++src->next;
+    if (src->next < src->npieces) {
+        src->pub.next_input_byte = src->pieces[src->next].first;
+        src->pub.bytes_in_buffer = src->pieces[src->next].second;
+        ++src->next;
+    } else {
+        src->pub.next_input_byte = eoi_marker;
+        src->pub.bytes_in_buffer = 2;
+    }
+    return TRUE;
+}
+
+
+
+static void
+band_skip_input_data (j_decompress_ptr cinfo, long num_bytes)
+{
+    band_source_mgr *src = (band_source_mgr *) cinfo->src;
+    if (num_bytes <= 0)
+        return;
+    while (size_t(num_bytes) > src->pub.bytes_in_buffer) {
+        num_bytes -= long(src->pub.bytes_in_buffer);
+        band_fill_input_buffer (cinfo);
+    }
+    src->pub.next_input_byte += num_bytes;
+    src->pub.bytes_in_buffer -= size_t(num_bytes);
+}
+
+
+
+struct band_error_mgr {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+};
+
+
+
+static void
+band_error_exit (j_common_ptr cinfo)
+{
+    // Errors are not reported from the band decoders; the caller falls
+    // back to the ordinary sequential read, which reports them.
+    longjmp (((band_error_mgr *) cinfo->err)->setjmp_buffer, 1);
+}
+
+
+
+static void
+band_output_message (j_common_ptr cinfo)
+{
+}
+
+
+
+bool
+JpgInput::find_restart_intervals ()
+{
+    m_restart_scanned = true;
+    if (m_io) {
+        m_filesize = m_io->size ();
+        m_filemem = (const unsigned char *) m_io->mmap ();
+        if (! m_filemem) {
+            m_filebuf.resize (m_filesize);
+            if (! m_filesize ||
+                  m_io->pread (&m_filebuf[0], m_filesize, 0) != m_filesize)
+                return false;
+            m_filemem = &m_filebuf[0];
+        }
+    } else {
+        uint64_t size = Filesystem::file_size (m_filename);
+        if (size == uint64_t(-1) || size < 4 || size != size_t(size))
+            return false;
+        m_filesize = size_t(size);
+        m_filebuf.resize (m_filesize);
+        if (Filesystem::read_bytes (m_filename, &m_filebuf[0], m_filesize)
+              != m_filesize)
+            return false;
+        m_filemem = &m_filebuf[0];
+    }
+
+    // Walk the markers up to the start of scan, noting where the frame
+    // height is stored.
+    const unsigned char *p = m_filemem;
+    size_t pos = 2;
+    while (! m_header_end) {
+        if (pos + 4 > m_filesize || p[pos] != 0xFF)
+            return false;
+        int marker = p[pos+1];
+        if (marker == 0xFF) {   // fill byte
+            ++pos;
+            continue;
+        }
+        size_t len = (size_t(p[pos+2]) << 8) | p[pos+3];
+        if (marker >= JPEG_SOF0 && marker <= JPEG_SOF0+15 &&
+              marker != JPEG_SOF0+4 && marker != JPEG_SOF0+8 &&
+              marker != JPEG_SOF0+12)   // not DHT, JPG, or DAC
+            m_sof_height = pos + 5;
+        pos += 2 + len;
+        if (marker == JPEG_SOS)
+            m_header_end = pos;
+    }
+    if (! m_sof_height || m_header_end >= m_filesize ||
+          ((int(p[m_sof_height]) << 8) | p[m_sof_height+1])
+              != int(m_cinfo.image_height))
+        return false;
+
+    // Split the coded data at the RSTn markers, skipping stuffed zeroes.
+    // The scan must end with the EOI.
+    const unsigned char *end = p + m_filesize;
+    const unsigned char *q = p + m_header_end;
+    m_rst_begin.push_back (m_header_end);
+    for (;;) {
+        q = (const unsigned char *) memchr (q, 0xFF, end - q);
+        if (! q || q + 1 >= end)
+            return false;
+        int marker = q[1];
+        if (marker == 0 || marker == 0xFF) {
+            q += marker ? 1 : 2;
+        } else if (marker >= JPEG_RST0 && marker <= JPEG_RST0+7) {
+            m_rst_end.push_back (q - p);
+            m_rst_begin.push_back (q + 2 - p);
+            q += 2;
+        } else {
+            m_rst_end.push_back (q - p);
+            if (marker != JPEG_EOI)
+                return false;
+            break;
+        }
+    }
+    size_t nmcus = size_t(m_cinfo.MCUs_per_row) * m_cinfo.MCU_rows_in_scan;
+    size_t nintervals = (nmcus + m_cinfo.restart_interval - 1)
+                      / m_cinfo.restart_interval;
+    return m_rst_begin.size() == nintervals;
+}
+
+
+
+namespace {
+
+// Task for read_native_scanlines: decode a run of restart intervals as
+// a JPEG stream of its own, and copy the rows that were asked for to
+// the caller's buffer.  When chroma is subsampled vertically, libjpeg's
+// upsampling looks at the neighboring rows, so the intervals on either
+// side are decoded too (and discarded) to get identical pixels.
+struct RestartDecodeTask {
+    const unsigned char *file;
+    size_t sof_height, header_end;
+    const size_t *rst_begin, *rst_end;
+    int nintervals;
+    int ibegin, iend;            // Intervals whose rows we keep
+    bool context;                // Decode a neighbor interval each side
+    int restart_rows;            // Image rows per interval
+    int out_rows;                // Output (scaled) rows per interval
+    int image_height;
+    const jpeg_decompress_struct *parent;
+    int ybegin, yend;            // Output rows wanted
+    bool cmyk;
+    unsigned char *data;         // Row ybegin of the caller's buffer
+    atomic_int *failures;
+
+    void operator() () {
+        int first = context ? std::max (ibegin - 1, 0) : ibegin;
+        int last = context ? std::min (iend + 1, nintervals) : iend;
+        int rows = std::min (last * restart_rows, image_height)
+                 - first * restart_rows;
+        JOCTET height[2] = { JOCTET(rows >> 8), JOCTET(rows & 0xff) };
+        std::vector<std::pair<const JOCTET *, size_t> > pieces;
+        pieces.push_back (std::make_pair (file, sof_height));
+        pieces.push_back (std::make_pair (height, size_t(2)));
+        pieces.push_back (std::make_pair (file + sof_height + 2,
+                                          header_end - sof_height - 2));
+        for (int i = first;  i < last;  ++i) {
+            if (i > first)
+                pieces.push_back (std::make_pair (rst_markers[(i-first-1) & 7],
+                                                  size_t(2)));
+            pieces.push_back (std::make_pair (file + rst_begin[i],
+                                              rst_end[i] - rst_begin[i]));
+        }
+        pieces.push_back (std::make_pair (eoi_marker, size_t(2)));
+
+        // Output rows [r0,r1) are rows [r0-row0,r1-row0) of the band.
+        int row0 = first * out_rows;
+        int r0 = std::max (ibegin * out_rows, ybegin);
+        int r1 = std::min (iend * out_rows, yend);
+        size_t stride = size_t(parent->output_width) * (cmyk ? 3
+                                            : parent->output_components);
+        std::vector<unsigned char> buf (parent->output_width *
+                                        parent->output_components);
+        if (r0 >= r1 || ! decode (pieces, r0 - row0, r1 - row0,
+                                  data + size_t(r0 - ybegin) * stride,
+                                  stride, buf))
+            ++(*failures);
+    }
+
+    // Decode rows [skip,end) of the band to dst.  Its own function so
+    // that nothing with a destructor lives across the setjmp.
+    bool decode (const std::vector<std::pair<const JOCTET *, size_t> > &pieces,
+                 int skip, int end, unsigned char *dst, size_t stride,
+                 std::vector<unsigned char> &buf) {
+        jpeg_decompress_struct cinfo;
+        band_error_mgr jerr;
+        band_source_mgr src;
+        cinfo.err = jpeg_std_error (&jerr.pub);
+        jerr.pub.error_exit = band_error_exit;
+        jerr.pub.output_message = band_output_message;
+        if (setjmp (jerr.setjmp_buffer)) {
+            jpeg_destroy_decompress (&cinfo);
+            return false;
+        }
+        jpeg_create_decompress (&cinfo);
+        src.pub.init_source = band_init_source;
+        src.pub.fill_input_buffer = band_fill_input_buffer;
+        src.pub.skip_input_data = band_skip_input_data;
+        src.pub.resync_to_restart = jpeg_resync_to_restart;
+        src.pub.term_source = band_init_source;
+        src.pub.next_input_byte = NULL;
+        src.pub.bytes_in_buffer = 0;
+        src.pieces = &pieces[0];
+        src.npieces = pieces.size();
+        src.next = 0;
+        cinfo.src = &src.pub;
+        jpeg_read_header (&cinfo, TRUE);
+        cinfo.out_color_space = parent->out_color_space;
+        cinfo.scale_num = parent->scale_num;
+        cinfo.scale_denom = parent->scale_denom;
+        cinfo.dct_method = parent->dct_method;
+        cinfo.do_fancy_upsampling = parent->do_fancy_upsampling;
+        jpeg_start_decompress (&cinfo);
+        bool ok = (cinfo.output_width == parent->output_width &&
+                   cinfo.output_components == parent->output_components &&
+                   int(cinfo.output_height) >= end);
+        for (int r = 0;  ok && r < end;  ++r) {
+            JSAMPROW row = (r < skip || cmyk) ? &buf[0]
+                         : dst + size_t(r - skip) * stride;
+            ok = (jpeg_read_scanlines (&cinfo, &row, 1) == 1);
+            if (ok && r >= skip && cmyk)
+                cmyk_to_rgb (cinfo.output_width, &buf[0], 4,
+                             dst + size_t(r - skip) * stride, 3);
+        }
+        ok &= (jerr.pub.num_warnings == 0);
+        jpeg_destroy_decompress (&cinfo);
+        return ok;
+    }
+};
+
+}  // end anon namespace
+
+
+
+bool
+JpgInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
+{
+    // Restart intervals that cover whole rows of MCUs decode
+    // independently, so when a big range of rows is wanted, decode bands
+    // of intervals in parallel.  Anything unusual, or any failure, goes
+    // back to libjpeg's ordinary sequential decode.
+    yend = std::min (yend, m_spec.height);
+    int nthreads = threads();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    int out_rows = m_restart_rows / m_scale_denom;
+    if (m_raw || m_fatalerr || nthreads <= 1 || ! out_rows ||
+          ybegin < 0 || ybegin >= yend ||
+          imagesize_t(yend - ybegin) * m_spec.width < (1 << 20) ||
+          yend - ybegin < 2 * out_rows)
+        return ImageInput::read_native_scanlines (ybegin, yend, z, data);
+    if (! m_restart_scanned && ! find_restart_intervals ()) {
+        m_restart_rows = 0;
+        std::vector<unsigned char>().swap (m_filebuf);
+        return ImageInput::read_native_scanlines (ybegin, yend, z, data);
+    }
+
+    int ibegin = ybegin / out_rows;
+    int iend = (yend - 1) / out_rows + 1;
+    bool context = false;
+    for (int c = 0;  c < m_cinfo.num_components;  ++c)
+        if (m_cinfo.comp_info[c].v_samp_factor != m_cinfo.max_v_samp_factor)
+            context = true;
+
+    atomic_int failures (0);
+    RestartDecodeTask task;
+    task.file = m_filemem;
+    task.sof_height = m_sof_height;
+    task.header_end = m_header_end;
+    task.rst_begin = &m_rst_begin[0];
+    task.rst_end = &m_rst_end[0];
+    task.nintervals = int(m_rst_begin.size());
+    task.context = context;
+    task.restart_rows = m_restart_rows;
+    task.out_rows = out_rows;
+    task.image_height = int(m_cinfo.image_height);
+    task.parent = &m_cinfo;
+    task.ybegin = ybegin;
+    task.yend = yend;
+    task.cmyk = m_cmyk;
+    task.data = (unsigned char *) data;
+    task.failures = &failures;
+    int n = iend - ibegin;
+    nthreads = std::min (nthreads, n);
+    int per_task = (n + nthreads - 1) / nthreads;
+    task_set tasks;
+    for (int i = ibegin;  i < iend;  i += per_task) {
+        task.ibegin = i;
+        task.iend = std::min (i + per_task, iend);
+        tasks.push (task);
+    }
+    tasks.wait ();
+    if (failures)
+        return ImageInput::read_native_scanlines (ybegin, yend, z, data);
+    return true;
+}
+
+
+
 bool
 JpgInput::close ()
 {
-    if (m_fd != NULL) {
+    if (m_fd != NULL || m_io != NULL) {
         // unnecessary?  jpeg_abort_decompress (&m_cinfo);
         jpeg_destroy_decompress (&m_cinfo);
         close_file ();
@@ -58,7 +58,8 @@ class JpgOutput : public ImageOutput {
     virtual const char * format_name (void) const { return "jpeg"; }
     virtual int supports (string_view feature) const {
         return (feature == "exif"
-             || feature == "iptc");
+             || feature == "iptc"
+             || feature == "ioproxy");
     }
     virtual bool open (const std::string &name, const ImageSpec &spec,
                        OpenMode mode=Create);
@@ -70,8 +71,18 @@ class JpgOutput : public ImageOutput {
     virtual bool close ();
     virtual bool copy_image (ImageInput *in);
 
+    /// libjpeg destination manager that writes to a Filesystem::IOProxy.
+    struct proxy_dest_mgr {
+        struct jpeg_destination_mgr pub;
+        Filesystem::IOProxy *io;
+        bool ok;
+        JOCTET buffer[4096];
+    };
+
  private:
     FILE *m_fd;
+    Filesystem::IOProxy *m_io;       // Caller's proxy (not owned), or NULL
+    proxy_dest_mgr m_dest;           // Destination used when m_io is set
     std::string m_filename;
     unsigned int m_dither;
     int m_next_scanline;             // Which scanline is the next to write?
@@ -84,6 +95,7 @@ class JpgOutput : public ImageOutput {
 
     void init (void) {
         m_fd = NULL;
+        m_io = NULL;
         m_copy_coeffs = NULL;
         m_copy_decompressor = NULL;
     }
@@ -114,6 +126,43 @@ OIIO_PLUGIN_EXPORTS_END
 
 
 
+// libjpeg destination manager callbacks for writing to an IOProxy.
+
+static void
+proxy_init_destination (j_compress_ptr cinfo)
+{
+    JpgOutput::proxy_dest_mgr *dest = (JpgOutput::proxy_dest_mgr *) cinfo->dest;
+    dest->pub.next_output_byte = dest->buffer;
+    dest->pub.free_in_buffer = sizeof(dest->buffer);
+}
+
+
+
+static boolean
+proxy_empty_output_buffer (j_compress_ptr cinfo)
+{
+    JpgOutput::proxy_dest_mgr *dest = (JpgOutput::proxy_dest_mgr *) cinfo->dest;
+    if (dest->io->write (dest->buffer, sizeof(dest->buffer)) != sizeof(dest->buffer))
+        dest->ok = false;
+    dest->pub.next_output_byte = dest->buffer;
+    dest->pub.free_in_buffer = sizeof(dest->buffer);
+    return TRUE;
+}
+
+
+
+static void
+proxy_term_destination (j_compress_ptr cinfo)
+{
+    JpgOutput::proxy_dest_mgr *dest = (JpgOutput::proxy_dest_mgr *) cinfo->dest;
+    size_t n = sizeof(dest->buffer) - dest->pub.free_in_buffer;
+    if (n && dest->io->write (dest->buffer, n) != n)
+        dest->ok = false;
+    dest->io->flush ();
+}
+
+
+
 bool
 JpgOutput::open (const std::string &name, const ImageSpec &newspec,
                  OpenMode mode)
@@ -147,15 +196,31 @@ JpgOutput::open (const std::string &name, const ImageSpec &newspec,
         return false;
     }
 
-    m_fd = Filesystem::fopen (name, "wb");
-    if (m_fd == NULL) {
-        error ("Unable to open file \"%s\"", name.c_str());
-        return false;
+    const ImageIOParameter *ioparam = m_spec.find_attribute ("oiio:ioproxy",
+                                                             TypeDesc::PTR);
+    if (ioparam) {
+        m_io = *(Filesystem::IOProxy * const *) ioparam->data();
+        m_spec.erase_attribute ("oiio:ioproxy");
+    } else {
+        m_fd = Filesystem::fopen (name, "wb");
+        if (m_fd == NULL) {
+            error ("Unable to open file \"%s\"", name.c_str());
+            return false;
+        }
     }
 
     m_cinfo.err = jpeg_std_error (&c_jerr);             // set error handler
     jpeg_create_compress (&m_cinfo);                    // create compressor
-    jpeg_stdio_dest (&m_cinfo, m_fd);                   // set output stream
+    if (m_io) {                                         // set output stream
+        m_dest.io = m_io;
+        m_dest.ok = true;
+        m_dest.pub.init_destination = proxy_init_destination;
+        m_dest.pub.empty_output_buffer = proxy_empty_output_buffer;
+        m_dest.pub.term_destination = proxy_term_destination;
+        m_cinfo.dest = &m_dest.pub;
+    } else {
+        jpeg_stdio_dest (&m_cinfo, m_fd);
+    }
 
     // Set image and compression parameters
     m_cinfo.image_width = m_spec.width;
@@ -232,6 +297,12 @@ JpgOutput::open (const std::string &name, const ImageSpec &newspec,
                 set_subsampling(JPEG_411_COMP);
         }
         DBG std::cout << "out open: set_colorspace\n";
+
+        // A restart marker every few rows of MCUs lets a reader decode
+        // bands of the image independently (and in parallel).
+        int restart_rows = m_spec.get_int_attribute ("jpeg:restart_rows", 0);
+        if (restart_rows > 0)
+            m_cinfo.restart_in_rows = std::min (restart_rows, 65535);
                 
         jpeg_start_compress (&m_cinfo, TRUE);         // start working
         DBG std::cout << "out open: start_compress\n";
@@ -391,7 +462,7 @@ JpgOutput::write_tile (int x, int y, int z, TypeDesc format,
 bool
 JpgOutput::close ()
 {
-    if (! m_fd) {         // Already closed
+    if (! m_fd && ! m_io) {         // Already closed
         return true;
         init();
     }
@@ -429,7 +500,12 @@ JpgOutput::close ()
     }
     DBG std::cout << "out close: about to destroy_compress\n";
     jpeg_destroy_compress (&m_cinfo);
-    fclose (m_fd);
+    if (m_fd)
+        fclose (m_fd);
+    else if (! m_dest.ok) {
+        error ("Could not write all of \"%s\"", m_filename.c_str());
+        ok = false;
+    }
     m_fd = NULL;
     init();
     
@@ -448,6 +524,7 @@ JpgOutput::copy_image (ImageInput *in)
 
         // Save the original input spec and close it
         ImageSpec orig_in_spec = in->spec();
+        Filesystem::IOProxy *in_io = jpg_in->m_io;
         in->close ();
         DBG std::cout << "Closed old file\n";
 
@@ -457,12 +534,19 @@ JpgOutput::copy_image (ImageInput *in)
         ImageSpec in_spec;
         ImageSpec config_spec;
         config_spec.attribute ("_jpeg:raw", 1);
+        if (in_io)
+            config_spec.attribute ("oiio:ioproxy", TypeDesc::PTR, &in_io);
         in->open (in_name, in_spec, config_spec);
 
         // Re-open the output
         std::string out_name = m_filename;
         ImageSpec orig_out_spec = spec();
+        Filesystem::IOProxy *out_io = m_io;
         close ();
+        if (out_io) {
+            out_io->seek (0);   // Start the file over
+            orig_out_spec.attribute ("oiio:ioproxy", TypeDesc::PTR, &out_io);
+        }
         m_copy_coeffs = (jvirt_barray_ptr *)jpg_in->coeffs();
         m_copy_decompressor = &jpg_in->m_cinfo;
         open (out_name, orig_out_spec);
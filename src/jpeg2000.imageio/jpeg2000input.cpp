@@ -94,9 +94,27 @@ associateAlpha (T * data, int size, int channels, int alpha_channel, float gamma
     }
 }
 
+
+inline int
+ceildivpow2 (int a, int b)
+{
+    return (a + (1 << b) - 1) >> b;
+}
+
 }  // namespace
 
 
+// OpenJpeg 2.2 and later decode only the code-blocks that touch the
+// requested area, so small regions of a single big codestream tile can
+// be read economically.  Before that, a region costs as much as the
+// whole codestream tile(s) it touches.
+#if defined(OPJ_VERSION_MAJOR) && \
+    (OPJ_VERSION_MAJOR*100 + OPJ_VERSION_MINOR >= 202)
+#define OIIO_J2K_SUBTILE_DECODE 1
+#endif
+
+
+
 class Jpeg2000Input : public ImageInput {
  public:
     Jpeg2000Input () { init (); }
@@ -110,20 +128,61 @@ class Jpeg2000Input : public ImageInput {
     virtual bool open (const std::string &name, ImageSpec &newspec,
                        const ImageSpec &config);
     virtual bool close (void);
+    virtual int current_miplevel (void) const { return m_miplevel; }
+    virtual bool seek_subimage (int subimage, int miplevel, ImageSpec &newspec);
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_tile (int x, int y, int z, void *data);
+    virtual bool read_native_tiles (int xbegin, int xend, int ybegin, int yend,
+                                    int zbegin, int zend, void *data);
 
  private:
 
     std::string m_filename;
     std::vector<int> m_bpp;   // per channel bpp
-    opj_image_t *m_image;
+    opj_image_t *m_image;     // Decoded image of the current MIP level
     FILE *m_file;
     opj_codec_t *m_codec;
     opj_stream_t *m_stream;
     bool m_keep_unassociated_alpha;   // Do not convert unassociated alpha
+    int m_miplevel;           // Current MIP level (resolution reduction)
+    int m_nlevels;            // Resolution levels in the codestream
+    bool m_tileable;          // Can regions be decoded (no subsampling)?
+    int m_tx0, m_ty0;         // Codestream tile grid origin...
+    int m_tdx, m_tdy;         //     ... and tile size
+    int m_ntiles;             // Number of codestream tiles
+    int m_x0, m_y0, m_x1, m_y1;   // Image area on the reference grid
+    ROI m_datawindow;         // Full resolution data window
 
     void init (void);
 
+    // Create the codec and stream and read the header into *image.
+    bool start_decompress (opj_image_t **image);
+    void finish_decompress () {
+        destroy_decompressor ();
+        destroy_stream ();
+        if (m_file) {
+            fclose (m_file);
+            m_file = NULL;
+        }
+    }
+
+    // Set up m_spec's geometry (and tiling) for the given MIP level.
+    void set_level_geometry (int miplevel);
+
+    // Decode the whole current MIP level into m_image.
+    bool decode_level ();
+
+    // Decode [xbegin,xend) x [ybegin,yend) of the current MIP level into
+    // data, whose scanlines are ystride pixels apart.
+    bool read_region (int xbegin, int xend, int ybegin, int yend,
+                      void *data, int ystride);
+
+    template<typename T>
+    void copy_region (const opj_image_t *image, int width, int height,
+                      T *data, int ystride);
+
+    void associate_alpha (void *data, int npixels);
+
     bool isJp2File(const int* const p_magicTable) const;
 
     opj_codec_t* create_decompressor();
@@ -150,9 +209,9 @@ class Jpeg2000Input : public ImageInput {
     }
 
     template<typename T>
-    void yuv_to_rgb(T *p_scanline)
+    void yuv_to_rgb(T *p_scanline, int width)
     {
-        for (int x = 0, i = 0; x < m_spec.width; ++x, i += m_spec.nchannels) {
+        for (int x = 0, i = 0; x < width; ++x, i += m_spec.nchannels) {
             float y = convert_type<T,float>(p_scanline[i+0]);
             float u = convert_type<T,float>(p_scanline[i+1])-0.5f;
             float v = convert_type<T,float>(p_scanline[i+2])-0.5f;
@@ -200,22 +259,22 @@ Jpeg2000Input::init (void)
     m_codec = NULL;
     m_stream = NULL;
     m_keep_unassociated_alpha = false;
+    m_miplevel = 0;
+    m_nlevels = 1;
+    m_tileable = false;
+    m_tx0 = m_ty0 = m_tdx = m_tdy = 0;
+    m_ntiles = 1;
+    m_x0 = m_y0 = m_x1 = m_y1 = 0;
 }
 
 
+
 bool
-Jpeg2000Input::open (const std::string &p_name, ImageSpec &p_spec)
+Jpeg2000Input::start_decompress (opj_image_t **image)
 {
-    m_filename = p_name;
-    if (! Filesystem::exists(m_filename)) {
-        error ("Could not open file \"%s\"", m_filename);
-        return false;
-    }
-
     m_codec = create_decompressor();
     if (!m_codec) {
         error ("Could not create Jpeg2000 stream decompressor");
-        close();
         return false;
     }
 
@@ -235,20 +294,57 @@ Jpeg2000Input::open (const std::string &p_name, ImageSpec &p_spec)
 #endif
     if (!m_stream) {
         error ("Could not open Jpeg2000 stream");
-        close();
         return false;
     }
 
-    ASSERT (m_image == NULL);
-    if (! opj_read_header (m_stream, m_codec, &m_image)) {
+    ASSERT (*image == NULL);
+    if (! opj_read_header (m_stream, m_codec, image)) {
         error ("Could not read Jpeg2000 header");
+        return false;
+    }
+    return true;
+}
+
+
+bool
+Jpeg2000Input::open (const std::string &p_name, ImageSpec &p_spec)
+{
+    m_filename = p_name;
+    if (! Filesystem::exists(m_filename)) {
+        error ("Could not open file \"%s\"", m_filename);
+        return false;
+    }
+
+    ASSERT (m_image == NULL);
+    if (! start_decompress (&m_image)) {
         close ();
         return false;
     }
+
+    // The resolution levels become MIP levels, and the codestream's
+    // tiles (if any) our tiles.  Only the coarsest level is decoded now,
+    // which is cheap, but also gets us the color space and ICC profile
+    // that OpenJpeg fills in when decoding.
+    m_nlevels = 1;
+    if (opj_codestream_info_v2_t *info = opj_get_cstr_info (m_codec)) {
+        if (info->m_default_tile_info.tccp_info)
+            for (OPJ_UINT32 c = 0;  c < info->nbcomp;  ++c) {
+                int n = info->m_default_tile_info.tccp_info[c].numresolutions;
+                m_nlevels = c ? std::min (m_nlevels, n) : n;
+            }
+        m_nlevels = std::max (m_nlevels, 1);
+        m_tx0 = info->tx0;
+        m_ty0 = info->ty0;
+        m_tdx = info->tdx;
+        m_tdy = info->tdy;
+        m_ntiles = info->tw * info->th;
+        opj_destroy_cstr_info (&info);
+    }
+    if (m_nlevels > 1)
+        opj_set_decoded_resolution_factor (m_codec, m_nlevels-1);
     opj_decode (m_codec, m_stream, m_image);
 
-    destroy_decompressor ();
-    destroy_stream ();
+    finish_decompress ();
 
     // we support only one, three or four components in image
     const int channelCount = m_image->numcomps;
@@ -262,13 +358,25 @@ Jpeg2000Input::open (const std::string &p_name, ImageSpec &p_spec)
     ROI datawindow;
     m_bpp.clear ();
     m_bpp.reserve (channelCount);
+    m_x0 = m_image->x0;
+    m_y0 = m_image->y0;
+    m_x1 = m_image->x1;
+    m_y1 = m_image->y1;
+    m_tileable = true;
     std::vector<TypeDesc> chantypes (channelCount, TypeDesc::UINT8);
     for (int i = 0; i < channelCount; i++) {
         const opj_image_comp_t &comp (m_image->comps[i]);
         m_bpp.push_back (comp.prec);
         maxPrecision = std::max(comp.prec, maxPrecision);
-        ROI roichan (comp.x0, comp.x0+comp.w*comp.dx,
-                     comp.y0, comp.y0+comp.h*comp.dy);
+        // comp's size is that of the coarse level we decoded, so figure
+        // out the full resolution one from the reference grid.
+        int chan_x0 = (m_x0 + comp.dx - 1) / comp.dx;
+        int chan_y0 = (m_y0 + comp.dy - 1) / comp.dy;
+        int chan_w = (m_x1 + comp.dx - 1) / comp.dx - chan_x0;
+        int chan_h = (m_y1 + comp.dy - 1) / comp.dy - chan_y0;
+        ROI roichan (chan_x0, chan_x0+chan_w*comp.dx,
+                     chan_y0, chan_y0+chan_h*comp.dy);
+        m_tileable &= (comp.dx == 1 && comp.dy == 1);
         datawindow = roi_union (datawindow, roichan);
         // std::cout << "  chan " << i << "\n";
         // std::cout << "     dx=" << comp.dx << " dy=" << comp.dy
@@ -292,6 +400,9 @@ Jpeg2000Input::open (const std::string &p_name, ImageSpec &p_spec)
     m_spec.full_y = m_image->y0;
     m_spec.full_width  = m_image->x1;
     m_spec.full_height = m_image->y1;
+    m_datawindow = datawindow;
+    m_miplevel = 0;
+    set_level_geometry (0);
 
     m_spec.attribute ("oiio:BitsPerSample", maxPrecision);
     m_spec.attribute ("oiio:Orientation", 1);
@@ -306,12 +417,158 @@ Jpeg2000Input::open (const std::string &p_name, ImageSpec &p_spec)
                           m_image->icc_profile_buf);
 #endif
 
+    // The pixels we have are for the coarsest level; the current one is
+    // decoded when first needed.
+    opj_image_destroy (m_image);
+    m_image = NULL;
+
     p_spec = m_spec;
     return true;
 }
 
 
 
+void
+Jpeg2000Input::set_level_geometry (int m)
+{
+    m_spec.x = ceildivpow2 (m_datawindow.xbegin, m);
+    m_spec.y = ceildivpow2 (m_datawindow.ybegin, m);
+    m_spec.width = ceildivpow2 (m_datawindow.xend, m) - m_spec.x;
+    m_spec.height = ceildivpow2 (m_datawindow.yend, m) - m_spec.y;
+    m_spec.full_x = ceildivpow2 (m_x0, m);
+    m_spec.full_y = ceildivpow2 (m_y0, m);
+    m_spec.full_width = ceildivpow2 (m_x1, m);
+    m_spec.full_height = ceildivpow2 (m_y1, m);
+    m_spec.tile_width = 0;
+    m_spec.tile_height = 0;
+    m_spec.tile_depth = 1;
+    if (! m_tileable)
+        return;   // Subsampled channels are only read as scanlines
+    int scale = 1 << m;
+    if (m_ntiles > 1 && m_tx0 == m_x0 && m_ty0 == m_y0 &&
+          m_tdx % scale == 0 && m_tdy % scale == 0 &&
+          m_tdx / scale >= 64 && m_tdy / scale >= 64) {
+        // The codestream's own tiles, each decodable on its own
+        m_spec.tile_width = m_tdx / scale;
+        m_spec.tile_height = m_tdy / scale;
+#ifdef OIIO_J2K_SUBTILE_DECODE
+    } else if (m_spec.width > 512 || m_spec.height > 512) {
+        // Regions of the codestream tiles
+        m_spec.tile_width = 512;
+        m_spec.tile_height = 512;
+#endif
+    } else {
+        // One tile for the whole level
+        m_spec.tile_width = m_spec.width;
+        m_spec.tile_height = m_spec.height;
+    }
+}
+
+
+
+bool
+Jpeg2000Input::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
+{
+    if (subimage != 0 || miplevel < 0 || miplevel >= m_nlevels)
+        return false;
+    if (miplevel != m_miplevel) {
+        if (m_image) {
+            opj_image_destroy (m_image);
+            m_image = NULL;
+        }
+        m_miplevel = miplevel;
+        set_level_geometry (miplevel);
+    }
+    newspec = m_spec;
+    return true;
+}
+
+
+
+bool
+Jpeg2000Input::decode_level ()
+{
+    ASSERT (m_image == NULL);
+    bool ok = start_decompress (&m_image);
+    if (ok && m_miplevel)
+        ok = opj_set_decoded_resolution_factor (m_codec, m_miplevel);
+    ok = ok && opj_decode (m_codec, m_stream, m_image)
+            && opj_end_decompress (m_codec, m_stream);
+    finish_decompress ();
+    if (! ok) {
+        if (m_image) {
+            opj_image_destroy (m_image);
+            m_image = NULL;
+        }
+        error ("Jpeg2000 decode failed");
+    }
+    return ok;
+}
+
+
+
+bool
+Jpeg2000Input::read_region (int xbegin, int xend, int ybegin, int yend,
+                            void *data, int ystride)
+{
+    xend = std::min (xend, m_spec.x + m_spec.width);
+    yend = std::min (yend, m_spec.y + m_spec.height);
+    // The decode area is in full resolution reference grid coordinates,
+    // no matter what resolution we're decoding.
+    int m = m_miplevel;
+    opj_image_t *image = NULL;
+    bool ok = start_decompress (&image);
+    if (ok && m)
+        ok = opj_set_decoded_resolution_factor (m_codec, m);
+    ok = ok && opj_set_decode_area (m_codec, image, xbegin << m, ybegin << m,
+                                    std::min (xend << m, m_x1),
+                                    std::min (yend << m, m_y1))
+            && opj_decode (m_codec, m_stream, image)
+            && opj_end_decompress (m_codec, m_stream);
+    finish_decompress ();
+    if (ok) {
+        int w = xend - xbegin, h = yend - ybegin;
+        if (m_spec.format == TypeDesc::UINT8)
+            copy_region (image, w, h, (uint8_t *)data, ystride);
+        else
+            copy_region (image, w, h, (uint16_t *)data, ystride);
+        associate_alpha (data, ystride * h);
+    } else {
+        error ("Jpeg2000 decode failed");
+    }
+    if (image)
+        opj_image_destroy (image);
+    return ok;
+}
+
+
+
+bool
+Jpeg2000Input::read_native_tiles (int xbegin, int xend, int ybegin, int yend,
+                                  int zbegin, int zend, void *data)
+{
+    // Any run of tiles is a single region to decode.
+    if (! m_spec.tile_width ||
+        ! m_spec.valid_tile_range (xbegin, xend, ybegin, yend, zbegin, zend))
+        return false;
+    return read_region (xbegin, xend, ybegin, yend, data, xend - xbegin);
+}
+
+
+
+bool
+Jpeg2000Input::read_native_tile (int x, int y, int z, void *data)
+{
+    if (! m_spec.tile_width)
+        return false;
+    // Parts of edge tiles outside the image are zero.
+    memset (data, 0, m_spec.tile_bytes());
+    return read_region (x, x + m_spec.tile_width, y, y + m_spec.tile_height,
+                        data, m_spec.tile_width);
+}
+
+
+
 bool
 Jpeg2000Input::open (const std::string &name, ImageSpec &newspec,
                      const ImageSpec &config)
@@ -326,26 +583,36 @@ Jpeg2000Input::open (const std::string &name, ImageSpec &newspec,
 bool
 Jpeg2000Input::read_native_scanline (int y, int z, void *data)
 {
+    if (! m_image && ! decode_level ())
+        return false;
+
     if (m_spec.format == TypeDesc::UINT8)
         read_scanline<uint8_t>(y, z, data);
     else
         read_scanline<uint16_t>(y, z, data);
 
+    associate_alpha (data, m_spec.width);
+    return true;
+}
+
+
+
+void
+Jpeg2000Input::associate_alpha (void *data, int npixels)
+{
     // JPEG2000 specifically dictates unassociated (un-"premultiplied") alpha.
     // Convert to associated unless we were requested not to do so.
     if (m_spec.alpha_channel != -1 && !m_keep_unassociated_alpha) {
         float gamma = m_spec.get_float_attribute ("oiio:Gamma", 2.2f);
         if (m_spec.format == TypeDesc::UINT16)
-            associateAlpha ((unsigned short *)data, m_spec.width,
+            associateAlpha ((unsigned short *)data, npixels,
                             m_spec.nchannels, m_spec.alpha_channel,
                             gamma);
         else
-            associateAlpha ((unsigned char *)data, m_spec.width,
+            associateAlpha ((unsigned char *)data, npixels,
                             m_spec.nchannels, m_spec.alpha_channel,
                             gamma);
     }
-
-    return true;
 }
 
 
@@ -357,12 +624,8 @@ Jpeg2000Input::close (void)
         opj_image_destroy(m_image);
         m_image = NULL;
     }
-    destroy_decompressor ();
-    destroy_stream ();
-    if (m_file) {
-        fclose (m_file);
-        m_file = NULL;
-    }
+    finish_decompress ();
+    init ();
     return true;
 }
 
@@ -440,7 +703,38 @@ Jpeg2000Input::read_scanline(int y, int z, void *data)
         }
     }
     if (m_image->color_space == OPJ_CLRSPC_SYCC)
-        yuv_to_rgb(scanline);
+        yuv_to_rgb(scanline, m_spec.width);
+}
+
+
+
+template<typename T>
+void
+Jpeg2000Input::copy_region (const opj_image_t *image, int width, int height,
+                            T *data, int ystride)
+{
+    // Only used when no channel is subsampled, so every component covers
+    // just the decoded area.
+    int nc = m_spec.nchannels;
+    int bits = sizeof(T)*8;
+    for (int c = 0; c < nc; ++c) {
+        const opj_image_comp_t &comp (image->comps[c]);
+        int w = std::min (width, int(comp.w));
+        int h = std::min (height, int(comp.h));
+        for (int y = 0;  y < h;  ++y) {
+            const OPJ_INT32 *in = comp.data + y*comp.w;
+            T *out = data + y*ystride*nc + c;
+            for (int x = 0;  x < w;  ++x, out += nc) {
+                unsigned int val = in[x];
+                if (comp.sgnd)
+                    val += (1<<(bits/2-1));
+                *out = (T) bit_range_convert (val, comp.prec, bits);
+            }
+        }
+    }
+    if (image->color_space == OPJ_CLRSPC_SYCC)
+        for (int y = 0;  y < height;  ++y)
+            yuv_to_rgb (data + y*ystride*nc, width);
 }
 
 
@@ -31,6 +31,7 @@
 #include <cmath>
 #include <vector>
 #include <string>
+#include <map>
 
 #include <OpenEXR/half.h>
 
@@ -39,6 +40,7 @@
 #include "OpenImageIO/imagebufalgo.h"
 #include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/refcnt.h"
+#include "imageio_pvt.h"
 
 #ifdef USE_OCIO
 #include <OpenColorIO/OpenColorIO.h>
@@ -78,6 +80,23 @@ public:
     void add (const std::string &name, int index) {
         colorspaces.push_back (std::pair<std::string,int> (name, index));
     }
+
+    // Processors already constructed from this config, keyed by the
+    // transform's parameters.  The create*() functions hand out
+    // lightweight references to these, so deleteColorProcessor() on a
+    // result never frees the cached processor itself.  Since reset()
+    // replaces the whole Impl, changing the config empties the cache.
+    typedef std::map<std::string, OIIO::shared_ptr<ColorProcessor> > ProcessorMap;
+    mutable ProcessorMap processor_cache_;
+    mutable mutex processor_cache_mutex_;
+
+    // Return a new reference to the cached processor for key, or NULL
+    // if there is none.
+    ColorProcessor *find_processor (const std::string &key) const;
+    // Cache p (if not NULL) as the processor for key, and return a
+    // reference to whichever processor ends up cached for key.
+    ColorProcessor *add_processor (const std::string &key,
+                                   ColorProcessor *p) const;
 };
 
 
@@ -361,10 +380,43 @@ public:
     virtual void apply (float *data, int width, int height, int channels,
                         stride_t chanstride, stride_t xstride,
                         stride_t ystride) const = 0;
+    // Apply to npixels contiguous RGBA float pixels, optionally dividing
+    // color by alpha before the transform and multiplying it back after.
+    virtual void apply_rgba (float *rgba, int npixels, bool unpremult) const;
 };
 
 
 
+void
+ColorProcessor::apply_rgba (float *rgba, int npixels, bool unpremult) const
+{
+    const float fltmin = std::numeric_limits<float>::min();
+    if (unpremult) {
+        for (int i = 0; i < npixels; ++i) {
+            float alpha = rgba[4*i+3];
+            if (alpha > fltmin) {
+                rgba[4*i+0] /= alpha;
+                rgba[4*i+1] /= alpha;
+                rgba[4*i+2] /= alpha;
+            }
+        }
+    }
+    apply (rgba, npixels, 1, 4, sizeof(float), 4*sizeof(float),
+           npixels*4*sizeof(float));
+    if (unpremult) {
+        for (int i = 0; i < npixels; ++i) {
+            float alpha = rgba[4*i+3];
+            if (alpha > fltmin) {
+                rgba[4*i+0] *= alpha;
+                rgba[4*i+1] *= alpha;
+                rgba[4*i+2] *= alpha;
+            }
+        }
+    }
+}
+
+
+
 #ifdef USE_OCIO
 // Custom ColorProcessor that wraps an OpenColorIO Processor.
 class ColorProcessor_OCIO : public ColorProcessor
@@ -393,6 +445,56 @@ private:
 
 
 
+// Apply a transfer function FUNC (a functor with both float and float4
+// versions) to the first channels (up to 3) of each pixel.  When those are
+// all the channels there are, packed, each scanline is a single run of
+// floats and is done 4 values at a time regardless of pixel boundaries.
+template<class FUNC>
+static void
+apply_transfer (FUNC func, float *data, int width, int height, int channels,
+                stride_t chanstride, stride_t xstride, stride_t ystride)
+{
+    int nc = std::min (channels, 3);
+    bool flat = (chanstride == sizeof(float) &&
+                 xstride == stride_t(channels * sizeof(float)) &&
+                 channels == nc);
+    for (int y = 0;  y < height;  ++y) {
+        char *d = (char *)data + y*ystride;
+        if (flat) {
+            float *f = (float *)d;
+            int n = width * nc, i = 0;
+            for ( ;  i + 4 <= n;  i += 4)
+                func (simd::float4(f+i)).store (f+i);
+            for ( ;  i < n;  ++i)
+                f[i] = func (f[i]);
+        } else if (nc == 3) {
+            for (int x = 0;  x < width;  ++x, d += xstride) {
+                simd::float4 r;
+                r.load ((float *)d, 3);
+                r = func (r);
+                r.store ((float *)d, 3);
+            }
+        } else {
+            for (int x = 0;  x < width;  ++x, d += xstride)
+                for (int c = 0;  c < nc;  ++c)
+                    ((float *)d)[c] = func (((float *)d)[c]);
+        }
+    }
+}
+
+
+struct sRGB_to_linear_func {
+    float operator() (float x) const { return sRGB_to_linear (x); }
+    simd::float4 operator() (const simd::float4 &x) const { return sRGB_to_linear (x); }
+};
+
+struct linear_to_sRGB_func {
+    float operator() (float x) const { return linear_to_sRGB (x); }
+    simd::float4 operator() (const simd::float4 &x) const { return linear_to_sRGB (x); }
+};
+
+
+
 // ColorProcessor that hard-codes sRGB-to-linear
 class ColorProcessor_sRGB_to_linear : public ColorProcessor {
 public:
@@ -403,26 +505,8 @@ public:
                         stride_t chanstride, stride_t xstride,
                         stride_t ystride) const
     {
-        if (channels > 3)
-            channels = 3;
-        if (channels == 3) {
-            for (int y = 0;  y < height;  ++y) {
-                char *d = (char *)data + y*ystride;
-                for (int x = 0;  x < width;  ++x, d += xstride) {
-                    simd::float4 r;
-                    r.load ((float *)d, 3);
-                    r = sRGB_to_linear (simd::float4((float *)d));
-                    r.store ((float *)d, 3);
-                }
-            }
-        } else {
-            for (int y = 0;  y < height;  ++y) {
-                char *d = (char *)data + y*ystride;
-                for (int x = 0;  x < width;  ++x, d += xstride)
-                    for (int c = 0;  c < channels;  ++c)
-                        ((float *)d)[c] = sRGB_to_linear (((float *)d)[c]);
-            }
-        }
+        apply_transfer (sRGB_to_linear_func(), data, width, height, channels,
+                        chanstride, xstride, ystride);
     }
 };
 
@@ -437,26 +521,8 @@ public:
                         stride_t chanstride, stride_t xstride,
                         stride_t ystride) const
     {
-        if (channels > 3)
-            channels = 3;
-        if (channels == 3) {
-            for (int y = 0;  y < height;  ++y) {
-                char *d = (char *)data + y*ystride;
-                for (int x = 0;  x < width;  ++x, d += xstride) {
-                    simd::float4 r;
-                    r.load ((float *)d, 3);
-                    r = linear_to_sRGB (simd::float4((float *)d));
-                    r.store ((float *)d, 3);
-                }
-            }
-        } else {
-            for (int y = 0;  y < height;  ++y) {
-                char *d = (char *)data + y*ystride;
-                for (int x = 0;  x < width;  ++x, d += xstride)
-                    for (int c = 0;  c < channels;  ++c)
-                        ((float *)d)[c] = linear_to_sRGB (((float *)d)[c]);
-            }
-        }
+        apply_transfer (linear_to_sRGB_func(), data, width, height, channels,
+                        chanstride, xstride, ystride);
     }
 };
 
@@ -507,10 +573,239 @@ public:
 
 
 
+// ColorProcessor that evaluates another processor baked into a 3D LUT.
+// The lattice is addressed through a 1D shaper, log2(1+K*x), that is
+// nearly linear near 0 and logarithmic above, so that one table covers
+// both display-referred [0,1] and scene-linear (0..256) inputs.  Inputs
+// are clamped to that range.  The baked processor takes ownership of the
+// original, which still handles images with fewer than 3 channels.
+class ColorProcessor_LUT3D : public ColorProcessor {
+public:
+    ColorProcessor_LUT3D (ColorProcessor *src, int size)
+        : ColorProcessor(), m_src(src), m_size(std::max (size, 2))
+    {
+        int n = m_size;
+        m_lattice.resize (4 * n * n * n);
+        float *d = &m_lattice[0];
+        double norm = log2 (1.0 + shaper_k * shaper_max);
+        for (int b = 0;  b < n;  ++b)
+            for (int g = 0;  g < n;  ++g)
+                for (int r = 0;  r < n;  ++r, d += 4) {
+                    d[0] = unshape (r, n, norm);
+                    d[1] = unshape (g, n, norm);
+                    d[2] = unshape (b, n, norm);
+                    d[3] = 1.0f;
+                }
+        m_src->apply (&m_lattice[0], n*n*n, 1, 4, sizeof(float),
+                      4*sizeof(float), n*n*n*4*sizeof(float));
+        m_scale = float ((n - 1) / norm);
+    }
+    ~ColorProcessor_LUT3D () { delete m_src; }
+
+    virtual bool hasChannelCrosstalk() const {
+        return m_src->hasChannelCrosstalk();
+    }
+
+    virtual void apply (float *data, int width, int height, int channels,
+                        stride_t chanstride, stride_t xstride,
+                        stride_t ystride) const
+    {
+        if (channels < 3 || chanstride != sizeof(float)) {
+            m_src->apply (data, width, height, channels,
+                          chanstride, xstride, ystride);
+            return;
+        }
+        for (int y = 0;  y < height;  ++y) {
+            char *d = (char *)data + y*ystride;
+            for (int x = 0;  x < width;  ++x, d += xstride) {
+                float *f = (float *)d;
+                simd::float4 c = lookup (simd::float4 (f[0], f[1], f[2], 0.0f));
+                c.store (f, 3);
+            }
+        }
+    }
+
+    // Fused unpremult, lookup, and premult.
+    virtual void apply_rgba (float *rgba, int npixels, bool unpremult) const
+    {
+        const float fltmin = std::numeric_limits<float>::min();
+        for (int i = 0;  i < npixels;  ++i, rgba += 4) {
+            simd::float4 p (rgba);
+            float alpha = rgba[3];
+            bool ua = unpremult && alpha > fltmin;
+            if (ua)
+                p = p / simd::float4 (alpha);
+            simd::float4 c = lookup (p);
+            if (ua)
+                c = c * simd::float4 (alpha);
+            c.store (rgba, 3);
+        }
+    }
+
+private:
+    static const float shaper_k, shaper_max;
+    ColorProcessor *m_src;
+    int m_size;
+    float m_scale;                 // shaper output -> lattice coordinate
+    std::vector<float> m_lattice;  // RGBx, red varying fastest
+
+    // Inverse of the shaper, for lattice point i of n.
+    static float unshape (int i, int n, double norm) {
+        return float ((exp2 (norm * i / (n - 1)) - 1.0) / shaper_k);
+    }
+
+    // Shaper and tetrahedral interpolation of the lattice, for the first
+    // three lanes of rgb.
+    simd::float4 lookup (const simd::float4 &rgb) const {
+        using namespace simd;
+        float4 x = clamp (rgb, float4::Zero(), float4(shaper_max));
+        x = fast_log2 (madd (x, float4(shaper_k), float4::One()))
+                * float4(m_scale);
+        int4 i = min (int4 (x), int4 (m_size - 2));
+        float4 f = x - float4 (i);
+        float fr = f[0], fg = f[1], fb = f[2];
+        int n = m_size;
+        int sr = 4, sg = 4*n, sb = 4*n*n;
+        const float *c000 = &m_lattice[i[0]*sr + i[1]*sg + i[2]*sb];
+        float4 v000 (c000), v111 (c000 + sr + sg + sb);
+        if (fr >= fg) {
+            if (fg >= fb) {
+                float4 v100 (c000 + sr), v110 (c000 + sr + sg);
+                return v000 + float4(fr) * (v100 - v000)
+                            + float4(fg) * (v110 - v100)
+                            + float4(fb) * (v111 - v110);
+            } else if (fr >= fb) {
+                float4 v100 (c000 + sr), v101 (c000 + sr + sb);
+                return v000 + float4(fr) * (v100 - v000)
+                            + float4(fb) * (v101 - v100)
+                            + float4(fg) * (v111 - v101);
+            } else {
+                float4 v001 (c000 + sb), v101 (c000 + sr + sb);
+                return v000 + float4(fb) * (v001 - v000)
+                            + float4(fr) * (v101 - v001)
+                            + float4(fg) * (v111 - v101);
+            }
+        } else {
+            if (fb >= fg) {
+                float4 v001 (c000 + sb), v011 (c000 + sg + sb);
+                return v000 + float4(fb) * (v001 - v000)
+                            + float4(fg) * (v011 - v001)
+                            + float4(fr) * (v111 - v011);
+            } else if (fb >= fr) {
+                float4 v010 (c000 + sg), v011 (c000 + sg + sb);
+                return v000 + float4(fg) * (v010 - v000)
+                            + float4(fb) * (v011 - v010)
+                            + float4(fr) * (v111 - v011);
+            } else {
+                float4 v010 (c000 + sg), v110 (c000 + sr + sg);
+                return v000 + float4(fg) * (v010 - v000)
+                            + float4(fr) * (v110 - v010)
+                            + float4(fb) * (v111 - v110);
+            }
+        }
+    }
+};
+
+const float ColorProcessor_LUT3D::shaper_k = 64.0f;
+const float ColorProcessor_LUT3D::shaper_max = 256.0f;
+
+
+
+// If the "color:lut3d_size" attribute asks for it, replace p by a baked
+// 3D LUT version of itself.
+static ColorProcessor *
+bake_lut3d (ColorProcessor *p)
+{
+    int size = pvt::oiio_color_lut3d_size;
+    if (p && size >= 2 && ! p->isNoOp())
+        return new ColorProcessor_LUT3D (p, size);
+    return p;
+}
+
+
+
+// ColorProcessor that refers to one shared through the processor cache.
+class ColorProcessor_Shared : public ColorProcessor {
+public:
+    ColorProcessor_Shared (const OIIO::shared_ptr<ColorProcessor> &p)
+        : ColorProcessor(), m_p(p) { }
+    ~ColorProcessor_Shared () { }
+
+    virtual bool isNoOp() const { return m_p->isNoOp(); }
+    virtual bool hasChannelCrosstalk() const {
+        return m_p->hasChannelCrosstalk();
+    }
+    virtual void apply (float *data, int width, int height, int channels,
+                        stride_t chanstride, stride_t xstride,
+                        stride_t ystride) const
+    {
+        m_p->apply (data, width, height, channels,
+                    chanstride, xstride, ystride);
+    }
+    virtual void apply_rgba (float *rgba, int npixels, bool unpremult) const
+    {
+        m_p->apply_rgba (rgba, npixels, unpremult);
+    }
+
+private:
+    OIIO::shared_ptr<ColorProcessor> m_p;
+};
+
+
+
+ColorProcessor *
+ColorConfig::Impl::find_processor (const std::string &key) const
+{
+    lock_guard lock (processor_cache_mutex_);
+    ProcessorMap::const_iterator found = processor_cache_.find (key);
+    if (found == processor_cache_.end())
+        return NULL;
+    error_ = "";
+    return new ColorProcessor_Shared (found->second);
+}
+
+
+
+ColorProcessor *
+ColorConfig::Impl::add_processor (const std::string &key,
+                                  ColorProcessor *p) const
+{
+    if (! p)
+        return NULL;
+    lock_guard lock (processor_cache_mutex_);
+    // If another thread cached one for this key in the meantime, use
+    // that one and discard ours.
+    OIIO::shared_ptr<ColorProcessor> &cached (processor_cache_[key]);
+    if (cached)
+        delete p;
+    else
+        cached.reset (p);
+    return new ColorProcessor_Shared (cached);
+}
+
+
+
+// Key for the processor cache.  It includes the "color:lut3d_size"
+// attribute, since that changes the processor that gets constructed.
+static std::string
+processor_key (string_view kind, string_view a, string_view b,
+               string_view c = string_view(), string_view d = string_view(),
+               string_view e = string_view(), string_view f = string_view())
+{
+    return Strutil::format ("%s\n%s\n%s\n%s\n%s\n%s\n%s\n%d", kind,
+                            a, b, c, d, e, f, int(pvt::oiio_color_lut3d_size));
+}
+
+
+
 ColorProcessor*
 ColorConfig::createColorProcessor (string_view inputColorSpace,
                                    string_view outputColorSpace) const
 {
+    std::string key = processor_key ("colorspace", inputColorSpace,
+                                     outputColorSpace);
+    if (ColorProcessor *cached = getImpl()->find_processor (key))
+        return cached;
     string_view inputrole, outputrole;
 #ifdef USE_OCIO
     // Ask OCIO to make a Processor that can handle the requested
@@ -548,7 +843,8 @@ ColorConfig::createColorProcessor (string_view inputColorSpace,
             // If we got a valid processor that does something useful,
             // return it now. If it boils down to a no-op, give a second
             // chance below to recognize it as a special case.
-            return new ColorProcessor_OCIO(p);
+            return getImpl()->add_processor (key,
+                                     bake_lut3d (new ColorProcessor_OCIO(p)));
         }
     }
 #endif
@@ -559,27 +855,31 @@ ColorConfig::createColorProcessor (string_view inputColorSpace,
     using namespace Strutil;
     if ((iequals(inputColorSpace,"linear") || iequals(inputrole,"linear")) &&
         iequals(outputColorSpace,"sRGB")) {
-        return new ColorProcessor_linear_to_sRGB;
+        return getImpl()->add_processor (key,
+                         bake_lut3d (new ColorProcessor_linear_to_sRGB));
     }
     if (iequals(inputColorSpace,"sRGB") &&
         (iequals(outputColorSpace,"linear") || iequals(outputrole,"linear"))) {
-        return new ColorProcessor_sRGB_to_linear;
+        return getImpl()->add_processor (key,
+                         bake_lut3d (new ColorProcessor_sRGB_to_linear));
     }
     if ((iequals(inputColorSpace,"linear") || iequals(inputrole,"linear")) &&
         iequals(outputColorSpace,"Rec709")) {
-        return new ColorProcessor_linear_to_Rec709;
+        return getImpl()->add_processor (key,
+                         bake_lut3d (new ColorProcessor_linear_to_Rec709));
     }
     if (iequals(inputColorSpace,"Rec709") &&
         (iequals(outputColorSpace,"linear") || iequals(outputrole,"linear"))) {
         // No OCIO, or the OCIO config doesn't know linear->sRGB
-        return new ColorProcessor_Rec709_to_linear;
+        return getImpl()->add_processor (key,
+                         bake_lut3d (new ColorProcessor_Rec709_to_linear));
     }
 
 #ifdef USE_OCIO
     if (p) {
         // If we found a procesor from OCIO, even if it was a NoOp, and we
         // still don't have a better idea, return it.
-        return new ColorProcessor_OCIO(p);
+        return getImpl()->add_processor (key, new ColorProcessor_OCIO(p));
     }
 #endif
 
@@ -596,6 +896,11 @@ ColorConfig::createLookTransform (string_view looks,
                                   string_view context_key,
                                   string_view context_val) const
 {
+    std::string key = processor_key ("look", looks, inputColorSpace,
+                                     outputColorSpace, inverse ? "1" : "0",
+                                     context_key, context_val);
+    if (ColorProcessor *cached = getImpl()->find_processor (key))
+        return cached;
 #ifdef USE_OCIO
     // Ask OCIO to make a Processor that can handle the requested
     // transformation.
@@ -640,7 +945,8 @@ ColorConfig::createLookTransform (string_view looks,
         }
     
         getImpl()->error_ = "";
-        return new ColorProcessor_OCIO(p);
+        return getImpl()->add_processor (key,
+                                 bake_lut3d (new ColorProcessor_OCIO(p)));
     }
 #endif
 
@@ -657,6 +963,11 @@ ColorConfig::createDisplayTransform (string_view display,
                                      string_view context_key,
                                      string_view context_value) const
 {
+    std::string key = processor_key ("display", display, view,
+                                     inputColorSpace, looks,
+                                     context_key, context_value);
+    if (ColorProcessor *cached = getImpl()->find_processor (key))
+        return cached;
 #ifdef USE_OCIO
     // Ask OCIO to make a Processor that can handle the requested
     // transformation.
@@ -695,7 +1006,8 @@ ColorConfig::createDisplayTransform (string_view display,
         }
     
         getImpl()->error_ = "";
-        return new ColorProcessor_OCIO(p);
+        return getImpl()->add_processor (key,
+                                 bake_lut3d (new ColorProcessor_OCIO(p)));
     }
 #endif
 
@@ -707,6 +1019,9 @@ ColorConfig::createDisplayTransform (string_view display,
 ColorProcessor*
 ColorConfig::createFileTransform (string_view name, bool inverse) const
 {
+    std::string key = processor_key ("file", name, inverse ? "1" : "0");
+    if (ColorProcessor *cached = getImpl()->find_processor (key))
+        return cached;
 #ifdef USE_OCIO
     // Ask OCIO to make a Processor that can handle the requested
     // transformation.
@@ -733,7 +1048,8 @@ ColorConfig::createFileTransform (string_view name, bool inverse) const
         }
     
         getImpl()->error_ = "";
-        return new ColorProcessor_OCIO(p);
+        return getImpl()->add_processor (key,
+                                 bake_lut3d (new ColorProcessor_OCIO(p)));
     }
 #endif
 
@@ -863,7 +1179,7 @@ colorconvert_impl (ImageBuf &R, const ImageBuf &A,
     // black now moves to non-black.
     
     float * dstPtr = NULL;
-    const float fltmin = std::numeric_limits<float>::min();
+    bool unpremult4 = unpremult && channelsToCopy >= 4;
     
     // If the processor has crosstalk, and we'll be using it, we should
     // reset the channels to 0 before loading each scanline.
@@ -885,34 +1201,9 @@ colorconvert_impl (ImageBuf &R, const ImageBuf &A,
                 for (int c = 0; c < channelsToCopy; ++c)
                     dstPtr[c] = a[c];
 
-            // Optionally unpremult
-            if ((channelsToCopy >= 4) && unpremult) {
-                for (int i = 0; i < width; ++i) {
-                    float alpha = scanline[4*i+3];
-                    if (alpha > fltmin) {
-                        scanline[4*i+0] /= alpha;
-                        scanline[4*i+1] /= alpha;
-                        scanline[4*i+2] /= alpha;
-                    }
-                }
-            }
-            
-            // Apply the color transformation in place
-            processor->apply (&scanline[0], width, 1, 4,
-                              sizeof(float), 4*sizeof(float),
-                              width*4*sizeof(float));
-            
-            // Optionally premult
-            if ((channelsToCopy >= 4) && unpremult) {
-                for (int i = 0; i < width; ++i) {
-                    float alpha = scanline[4*i+3];
-                    if (alpha > fltmin) {
-                        scanline[4*i+0] *= alpha;
-                        scanline[4*i+1] *= alpha;
-                        scanline[4*i+2] *= alpha;
-                    }
-                }
-            }
+            // Apply the color transformation in place, optionally
+            // unpremultiplying around it.
+            processor->apply_rgba (&scanline[0], width, unpremult4);
 
             // Store the scanline
             dstPtr = &scanline[0];
@@ -927,6 +1218,130 @@ colorconvert_impl (ImageBuf &R, const ImageBuf &A,
 
 
 
+// Tabulate a processor without channel crosstalk for every code value of
+// an integer type T: channel c of a pixel with value v becomes
+// lut[c*N+v], for the first nc channels, with N = 256 or 65536.  The
+// conversions to and from float are the same ones colorconvert_impl's
+// iterators make, so the results are identical to converting each
+// pixel.
+template<class T>
+static void
+bake_lut1d (const ColorProcessor *processor, int nc, std::vector<T> &lut)
+{
+    const int N = int (std::numeric_limits<T>::max()) + 1;
+    std::vector<float> rgba (4 * N);
+    for (int v = 0;  v < N;  ++v) {
+        float f = convert_type<T,float> (T(v));
+        for (int c = 0;  c < 4;  ++c)
+            rgba[4*v+c] = f;
+    }
+    processor->apply_rgba (&rgba[0], N, false);
+    lut.resize (nc * N);
+    for (int c = 0;  c < nc;  ++c)
+        for (int v = 0;  v < N;  ++v)
+            lut[c*N+v] = convert_type<float,T> (rgba[4*v+c]);
+}
+
+
+
+// Apply 1D LUTs made by bake_lut1d to the first nc channels, directly
+// on the native pixel values.  R must be local; A is read in place if
+// it is local too, otherwise a scanline at a time.
+template<class T>
+static bool
+colorconvert_lut1d_impl (ImageBuf &R, const ImageBuf &A, const T *lut,
+                         int nc, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        ImageBufAlgo::parallel_image (
+            OIIO::bind(colorconvert_lut1d_impl<T>,
+                        OIIO::ref(R), OIIO::cref(A), lut, nc,
+                        _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    const int N = int (std::numeric_limits<T>::max()) + 1;
+    bool alocal = A.localpixels() && ! A.local_tile_width();
+    stride_t rstride = R.pixel_stride() / sizeof(T);
+    std::vector<T> row;
+    if (! alocal)
+        row.resize (size_t(roi.width()) * A.nchannels());
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+            T *r = (T *) R.pixeladdr (roi.xbegin, y, z);
+            const T *a;
+            stride_t astride;
+            if (alocal) {
+                a = (const T *) A.pixeladdr (roi.xbegin, y, z);
+                astride = A.pixel_stride() / sizeof(T);
+            } else {
+                A.get_pixels (ROI (roi.xbegin, roi.xend, y, y+1, z, z+1,
+                                   0, A.nchannels()),
+                              A.spec().format, &row[0]);
+                a = &row[0];
+                astride = A.nchannels();
+            }
+            for (int x = roi.xbegin;  x < roi.xend;  ++x, r += rstride, a += astride)
+                for (int c = 0;  c < nc;  ++c)
+                    r[c] = lut[c*N + a[c]];
+        }
+    }
+    return true;
+}
+
+
+
+// Can colorconvert be done with bake_lut1d tables?  Only for 8 and 16 bit
+// images of the same type, a processor whose channels are independent,
+// no unpremultiplication, and enough pixels to pay for the table.
+static bool
+colorconvert_lut1d_ok (const ImageBuf &dst, const ImageBuf &src,
+                       const ColorProcessor *processor, bool unpremult,
+                       ROI roi)
+{
+    TypeDesc format = src.spec().format;
+    int nc = std::min (4, roi.nchannels());
+    if (format != TypeDesc::UINT8 && format != TypeDesc::UINT16)
+        return false;
+    if (dst.spec().format != format || ! dst.spec().channelformats.empty() ||
+        ! src.spec().channelformats.empty() || src.deep() || dst.deep())
+        return false;
+    if (processor->hasChannelCrosstalk() || (unpremult && nc >= 4))
+        return false;
+    if (! dst.localpixels() || dst.local_tile_width() ||
+        src.nchannels() < nc || dst.nchannels() < nc)
+        return false;
+    // Pixels outside src would have to read as black.
+    ROI sroi = src.roi();
+    if (roi.xbegin < sroi.xbegin || roi.xend > sroi.xend ||
+        roi.ybegin < sroi.ybegin || roi.yend > sroi.yend ||
+        roi.zbegin < sroi.zbegin || roi.zend > sroi.zend)
+        return false;
+    return roi.npixels() >= (format == TypeDesc::UINT8 ? 256 : 65536);
+}
+
+
+
+void
+pvt::colorconvert_pixels (const ColorProcessor *processor, float *data,
+                          int npixels, int nchannels, bool unpremult)
+{
+    // Same steps as colorconvert_impl, but on a contiguous float run.
+    int channelsToCopy = std::min (4, nchannels);
+    std::vector<float> scanline (npixels*4, 0.0f);
+    for (int i = 0; i < npixels; ++i)
+        for (int c = 0; c < channelsToCopy; ++c)
+            scanline[4*i+c] = data[i*nchannels+c];
+    processor->apply_rgba (&scanline[0], npixels,
+                           unpremult && channelsToCopy >= 4);
+    for (int i = 0; i < npixels; ++i)
+        for (int c = 0; c < channelsToCopy; ++c)
+            data[i*nchannels+c] = scanline[4*i+c];
+}
+
+
+
 bool
 ImageBufAlgo::colorconvert (ImageBuf &dst, const ImageBuf &src,
                             const ColorProcessor* processor, bool unpremult,
@@ -954,6 +1369,22 @@ ImageBufAlgo::colorconvert (ImageBuf &dst, const ImageBuf &src,
                                     roi.chbegin, src, roi, nthreads);
     }
 
+    // 8 and 16 bit images with a per-channel transform: tabulate it.
+    if (colorconvert_lut1d_ok (dst, src, processor, unpremult, roi)) {
+        int nc = std::min (4, roi.nchannels());
+        if (src.spec().format == TypeDesc::UINT8) {
+            std::vector<unsigned char> lut;
+            bake_lut1d (processor, nc, lut);
+            return colorconvert_lut1d_impl (dst, src, &lut[0], nc, roi,
+                                            nthreads);
+        } else {
+            std::vector<unsigned short> lut;
+            bake_lut1d (processor, nc, lut);
+            return colorconvert_lut1d_impl (dst, src, &lut[0], nc, roi,
+                                            nthreads);
+        }
+    }
+
     bool ok = true;
     OIIO_DISPATCH_COMMON_TYPES2 (ok, "colorconvert", colorconvert_impl,
                                  dst.spec().format, src.spec().format,
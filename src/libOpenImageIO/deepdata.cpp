@@ -53,6 +53,12 @@ OIIO_NAMESPACE_BEGIN
 // need to lock the mutex. As long as capacity is not changing, threads may
 // change number of samples (inserting or deleting) as well as altering
 // data, simultaneously, as long as they are working on separate pixels.
+//
+// When the pixels are known to be scanlines of an image (linepixels > 0),
+// the sample data is held in a separate chunk for each scanline, with
+// its own lock, so growing the capacity of a pixel only moves the data
+// of the rest of that scanline, and threads working on separate
+// scanlines may change capacities simultaneously as well.
 
 
 
@@ -64,14 +70,18 @@ public:
     std::vector<size_t> m_channeloffsets;  // for each channel [c]
     std::vector<unsigned int> m_nsamples;  // for each pixel [p]
     std::vector<unsigned int> m_capacity;  // for each pixel [p]
-    std::vector<unsigned int> m_cumcapacity;  // cumulative capacity before pixel [p]
-    std::vector<char> m_data;              // for each sample [p][s][c]
+    std::vector<unsigned int> m_cumcapacity;  // capacity before pixel [p] in its chunk
+    std::vector<std::vector<char> > m_chunks; // for each chunk, each sample [p][s][c]
+    std::vector<spin_mutex> m_chunkmutex;  // for each chunk
+    std::vector<char> m_flatdata;          // contiguous copy for all_data()
     std::vector<std::string> m_channelnames; // For each channel[c]
     std::vector<int> m_myalphachannel;     // For each channel[c], its alpha
       // myalphachannel[c] gives the alpha channel corresponding to channel
       // c, or c if it is itself an alpha, or -1 if it doesn't appear to
       // be a color channel at all.
     size_t m_samplesize;
+    TypeDesc m_commontype;                 // type of all channels, or UNKNOWN
+    int m_linepixels;                      // pixels per chunk, 0 = just one
     int m_z_channel, m_zback_channel;
     int m_alpha_channel;
     bool m_allocated;
@@ -86,33 +96,57 @@ public:
         m_nsamples.clear();
         m_capacity.clear();
         m_cumcapacity.clear();
-        m_data.clear();
+        m_chunks.clear();
+        m_chunkmutex.clear();
+        m_flatdata.clear();
         m_channelnames.clear ();
         m_myalphachannel.clear ();
         m_samplesize = 0;
+        m_commontype = TypeDesc::UNKNOWN;
+        m_linepixels = 0;
         m_z_channel = -1;
         m_zback_channel = -1;
         m_alpha_channel = -1;
         m_allocated = false;
     }
 
+    static int nchunks (int npixels, int linepixels) {
+        return linepixels > 0 ? (npixels + linepixels - 1) / linepixels : 1;
+    }
+
+    int chunk_of (int pixel) const {
+        return m_linepixels > 0 ? pixel / m_linepixels : 0;
+    }
+
+    // One past the last pixel of the chunk containing pixel.
+    int chunk_end (int pixel) const {
+        int npixels = int(m_capacity.size());
+        return m_linepixels > 0
+             ? std::min ((chunk_of(pixel)+1) * m_linepixels, npixels)
+             : npixels;
+    }
+
     // If not already done, allocate data and cumcapacity
     void alloc (size_t npixels) {
         if (! m_allocated) {
             spin_lock lock (m_mutex);
             if (! m_allocated) {
-                // m_cumcapacity.resize (npixels);
-                size_t totalcapacity = 0;
-                for (size_t i = 0; i < npixels; ++i) {
-                    m_cumcapacity[i] = totalcapacity;
-                    totalcapacity += m_capacity[i];
+                m_chunks.resize (nchunks (int(npixels), m_linepixels));
+                for (size_t i = 0; i < npixels; ) {
+                    size_t end = chunk_end (int(i));
+                    size_t chunkcapacity = 0;
+                    for ( ; i < end; ++i) {
+                        m_cumcapacity[i] = chunkcapacity;
+                        chunkcapacity += m_capacity[i];
+                    }
+                    m_chunks[chunk_of(int(end-1))].resize (chunkcapacity * m_samplesize);
                 }
-                m_data.resize (totalcapacity * m_samplesize);
                 m_allocated = true;
             }
         }
     }
 
+    // Offset of the data within the chunk containing pixel.
     size_t data_offset (int pixel, int channel, int sample) {
         DASSERT (int(m_cumcapacity.size()) > pixel);
         DASSERT (m_capacity[pixel] >= m_nsamples[pixel]);
@@ -122,12 +156,9 @@ public:
 
     void * data_ptr (int pixel, int channel, int sample) {
         size_t offset = data_offset (pixel, channel, sample);
-        DASSERT (offset < m_data.size());
-        return &m_data[offset];
-    }
-
-    size_t total_capacity () const {
-        return m_cumcapacity.back() + m_capacity.back();
+        std::vector<char> &chunk (m_chunks[chunk_of(pixel)]);
+        DASSERT (offset < chunk.size());
+        return &chunk[offset];
     }
 
     inline void sanity () const {
@@ -138,13 +169,17 @@ public:
         ASSERT (m_nsamples.size() == m_capacity.size());
         ASSERT (m_cumcapacity.size() == m_capacity.size());
         if (m_allocated) {
-            size_t totalcapacity = 0;
-            for (int p = 0; p < npixels; ++p) {
-                ASSERT (m_cumcapacity[p] == totalcapacity);
-                totalcapacity += m_capacity[p];
-                ASSERT (m_capacity[p] >= m_nsamples[p]);
+            ASSERT (int(m_chunks.size()) == nchunks (npixels, m_linepixels));
+            for (int p = 0; p < npixels; ) {
+                int end = chunk_end (p);
+                size_t chunkcapacity = 0;
+                for ( ; p < end; ++p) {
+                    ASSERT (m_cumcapacity[p] == chunkcapacity);
+                    chunkcapacity += m_capacity[p];
+                    ASSERT (m_capacity[p] >= m_nsamples[p]);
+                }
+                ASSERT (chunkcapacity * m_samplesize == m_chunks[chunk_of(end-1)].size());
             }
-            ASSERT (totalcapacity * m_samplesize == m_data.size());
         }
     }
 };
@@ -267,7 +302,7 @@ is_or_endswithdot (string_view name, string_view suffix)
 void
 DeepData::init (int npix, int nchan,
                 array_view<const TypeDesc> channeltypes,
-                array_view<const std::string> channelnames)
+                array_view<const std::string> channelnames, int linepixels)
 {
     clear ();
     m_npixels = npix;
@@ -289,6 +324,8 @@ DeepData::init (int npix, int nchan,
     m_impl->m_nsamples.resize (m_npixels, 0);
     m_impl->m_capacity.resize (m_npixels, 0);
     m_impl->m_cumcapacity.resize (m_npixels, 0);
+    m_impl->m_linepixels = std::max (linepixels, 0);
+    m_impl->m_chunkmutex.resize (Impl::nchunks (m_npixels, m_impl->m_linepixels));
 
     // Channel name hunt
     // First, find Z, Zback, A
@@ -305,6 +342,10 @@ DeepData::init (int npix, int nchan,
         else if (m_impl->m_alpha_channel < 0 && is_or_endswithdot (channelnames[c], "A"))
             m_impl->m_alpha_channel = c;
     }
+    m_impl->m_commontype = m_impl->m_channeltypes[0];
+    for (int c = 1; c < m_nchannels; ++c)
+        if (m_impl->m_channeltypes[c] != m_impl->m_commontype)
+            m_impl->m_commontype = TypeDesc::UNKNOWN;
     // Now try to find which alpha corresponds to each channel
     for (int c = 0; c < m_nchannels; ++c) {
         // Skip non-color channels
@@ -346,10 +387,10 @@ DeepData::init (const ImageSpec &spec)
 {
     if (int(spec.channelformats.size()) == spec.nchannels)
         init ((int) spec.image_pixels(), spec.nchannels, spec.channelformats,
-              spec.channelnames);
+              spec.channelnames, spec.width);
     else
         init ((int) spec.image_pixels(), spec.nchannels, spec.format,
-              spec.channelnames);
+              spec.channelnames, spec.width);
 }
 
 
@@ -392,23 +433,20 @@ DeepData::set_capacity (int pixel, int samps)
     if (pixel < 0 || pixel >= m_npixels)
         return;
     ASSERT (m_impl);
-    spin_lock lock (m_impl->m_mutex);
+    spin_lock lock (m_impl->m_chunkmutex[m_impl->chunk_of(pixel)]);
     if (m_impl->m_allocated) {
         // Data already allocated. Expand capacity if necessary, don't
-        // contract. (FIXME?)
+        // contract. (FIXME?) Only the data of the subsequent pixels of
+        // the same chunk needs to move.
         int n = (int)capacity(pixel);
         if (samps > n) {
             int toadd = samps-n;
-            if (m_impl->m_data.empty()) {
-                size_t newtotal = (m_impl->total_capacity()+toadd);
-                m_impl->m_data.resize (newtotal*samplesize());
-            } else {
-                size_t offset = m_impl->data_offset (pixel, 0, n);
-                m_impl->m_data.insert (m_impl->m_data.begin() + offset,
-                                       toadd*samplesize(), 0);
-            }
-            // Adjust the cumulative prefix sum of samples for subsequent pixels
-            for (int p = pixel+1; p < m_npixels; ++p)
+            std::vector<char> &chunk (m_impl->m_chunks[m_impl->chunk_of(pixel)]);
+            size_t offset = m_impl->data_offset (pixel, 0, n);
+            chunk.insert (chunk.begin() + offset, toadd*samplesize(), 0);
+            // Adjust the cumulative prefix sum of samples for subsequent
+            // pixels of the chunk
+            for (int p = pixel+1, e = m_impl->chunk_end(pixel); p < e; ++p)
                 m_impl->m_cumcapacity[p] += toadd;
             m_impl->m_capacity[pixel] = samps;
         }
@@ -482,11 +520,11 @@ DeepData::insert_samples (int pixel, int samplepos, int n)
     if (m_impl->m_allocated) {
         // Move the data
         if (samplepos < oldsamps) {
+            std::vector<char> &chunk (m_impl->m_chunks[m_impl->chunk_of(pixel)]);
             size_t offset = m_impl->data_offset (pixel, 0, samplepos);
             size_t end = m_impl->data_offset (pixel, 0, oldsamps);
-            std::copy_backward (m_impl->m_data.begin() + offset,
-                                m_impl->m_data.begin() + end,
-                                m_impl->m_data.begin() + end + n*samplesize());
+            std::copy_backward (chunk.begin() + offset, chunk.begin() + end,
+                                chunk.begin() + end + n*samplesize());
         }
     }
     // Add to this pixel's sample count
@@ -504,12 +542,12 @@ DeepData::erase_samples (int pixel, int samplepos, int n)
     n = std::min (n, int(m_impl->m_nsamples[pixel]));
     if (m_impl->m_allocated) {
         // Move the data
+        std::vector<char> &chunk (m_impl->m_chunks[m_impl->chunk_of(pixel)]);
         int oldsamps = samples(pixel);
         size_t offset = m_impl->data_offset (pixel, 0, samplepos);
         size_t end = m_impl->data_offset (pixel, 0, oldsamps);
-        std::copy (m_impl->m_data.begin() + offset + n*samplesize(),
-                   m_impl->m_data.begin() + end,
-                   m_impl->m_data.begin() + offset);
+        std::copy (chunk.begin() + offset + n*samplesize(),
+                   chunk.begin() + end, chunk.begin() + offset);
     }
     m_impl->m_nsamples[pixel] -= n;
 }
@@ -534,7 +572,7 @@ DeepData::data_ptr (int pixel, int channel, int sample) const
 {
     if (pixel < 0 || pixel >= m_npixels ||
             channel < 0 || channel >= m_nchannels ||
-            !m_impl || !m_impl->m_data.size() ||
+            !m_impl || !m_impl->m_allocated ||
             sample < 0 || sample >= int(m_impl->m_nsamples[pixel]))
         return NULL;
     return m_impl->data_ptr (pixel, channel, sample);
@@ -684,6 +722,102 @@ DeepData::set_deep_value (int pixel, int channel, int sample, uint32_t value)
 
 
 
+// Convert n values of type S, stride bytes apart, to floats dststride
+// apart.
+template<typename S>
+static void
+values_to_float (const char *src, size_t stride, float *dst,
+                 size_t dststride, int n)
+{
+    for (int i = 0;  i < n;  ++i, src += stride, dst += dststride)
+        *dst = convert_type<S,float> (*(const S *)src);
+}
+
+
+
+template<typename D>
+static void
+values_from_float (const float *src, size_t srcstride, char *dst,
+                   size_t stride, int n)
+{
+    for (int i = 0;  i < n;  ++i, src += srcstride, dst += stride)
+        *(D *)dst = convert_type<float,D> (*src);
+}
+
+
+
+void
+DeepData::get_pixel_values (int pixel, float *values) const
+{
+    int n = samples (pixel);
+    const char *data = (const char *) data_ptr (pixel, 0, 0);
+    if (! n || ! data)
+        return;
+    int nc = m_nchannels;
+    TypeDesc common = m_impl->m_commontype;
+    if (common == TypeDesc::FLOAT) {
+        memcpy (values, data, size_t(n) * nc * sizeof(float));
+        return;
+    }
+    if (common == TypeDesc::HALF) {
+        convert_type<half,float> ((const half *)data, values, size_t(n) * nc);
+        return;
+    }
+    size_t stride = samplesize();
+    for (int c = 0;  c < nc;  ++c) {
+        const char *src = data + m_impl->m_channeloffsets[c];
+        switch (m_impl->m_channeltypes[c].basetype) {
+        case TypeDesc::FLOAT :
+            values_to_float<float> (src, stride, values+c, nc, n); break;
+        case TypeDesc::HALF  :
+            values_to_float<half> (src, stride, values+c, nc, n); break;
+        case TypeDesc::UINT  :
+            values_to_float<unsigned int> (src, stride, values+c, nc, n); break;
+        default:
+            for (int s = 0;  s < n;  ++s)
+                values[s*nc+c] = deep_value (pixel, c, s);
+        }
+    }
+}
+
+
+
+void
+DeepData::set_pixel_values (int pixel, const float *values)
+{
+    int n = samples (pixel);
+    char *data = (char *) data_ptr (pixel, 0, 0);
+    if (! n || ! data)
+        return;
+    int nc = m_nchannels;
+    TypeDesc common = m_impl->m_commontype;
+    if (common == TypeDesc::FLOAT) {
+        memcpy (data, values, size_t(n) * nc * sizeof(float));
+        return;
+    }
+    if (common == TypeDesc::HALF) {
+        convert_type<float,half> (values, (half *)data, size_t(n) * nc);
+        return;
+    }
+    size_t stride = samplesize();
+    for (int c = 0;  c < nc;  ++c) {
+        char *dst = data + m_impl->m_channeloffsets[c];
+        switch (m_impl->m_channeltypes[c].basetype) {
+        case TypeDesc::FLOAT :
+            values_from_float<float> (values+c, nc, dst, stride, n); break;
+        case TypeDesc::HALF  :
+            values_from_float<half> (values+c, nc, dst, stride, n); break;
+        case TypeDesc::UINT  :
+            values_from_float<unsigned int> (values+c, nc, dst, stride, n); break;
+        default:
+            for (int s = 0;  s < n;  ++s)
+                set_deep_value (pixel, c, s, values[s*nc+c]);
+        }
+    }
+}
+
+
+
 array_view<const TypeDesc>
 DeepData::all_channeltypes () const
 {
@@ -707,7 +841,16 @@ DeepData::all_data () const
 {
     ASSERT (m_impl);
     m_impl->alloc (m_npixels);
-    return m_impl->m_data;
+    if (m_impl->m_chunks.size() == 1)
+        return m_impl->m_chunks[0];
+    // Stored in per-scanline chunks: gather a contiguous copy.
+    spin_lock lock (m_impl->m_mutex);
+    std::vector<char> &flat (m_impl->m_flatdata);
+    flat.clear ();
+    for (size_t i = 0, e = m_impl->m_chunks.size(); i < e; ++i)
+        flat.insert (flat.end(), m_impl->m_chunks[i].begin(),
+                     m_impl->m_chunks[i].end());
+    return flat;
 }
 
 
@@ -730,6 +873,25 @@ DeepData::get_pointers (std::vector<void*> &pointers) const
 
 
 
+size_t
+DeepData::memsize () const
+{
+    if (! m_impl)
+        return 0;
+    size_t bytes = (m_impl->m_nsamples.size() + m_impl->m_capacity.size()
+                    + m_impl->m_cumcapacity.size()) * sizeof(unsigned int);
+    if (m_impl->m_allocated) {
+        for (size_t i = 0, e = m_impl->m_chunks.size(); i < e; ++i)
+            bytes += m_impl->m_chunks[i].size();
+    } else {
+        for (size_t p = 0, e = m_impl->m_capacity.size(); p < e; ++p)
+            bytes += m_impl->m_capacity[p] * m_impl->m_samplesize;
+    }
+    return bytes;
+}
+
+
+
 bool
 DeepData::copy_deep_sample (int pixel, int sample,
                             const DeepData &src, int srcpixel, int srcsample)
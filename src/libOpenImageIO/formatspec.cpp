@@ -284,11 +284,10 @@ ImageSpec::attribute (string_view name, TypeDesc type, const void *value)
 {
     // Don't allow duplicates
     ImageIOParameter *f = find_attribute (name);
-    if (! f) {
-        extra_attribs.resize (extra_attribs.size() + 1);
-        f = &extra_attribs.back();
-    }
-    f->init (name, type, 1, value);
+    if (f)
+        f->init (name, type, 1, value);
+    else   // push_back keeps the name index of extra_attribs current
+        extra_attribs.push_back (ImageIOParameter (name, type, 1, value));
 }
 
 
@@ -362,7 +361,7 @@ ImageSpec::erase_attribute (string_view name, TypeDesc searchtype,
 {
     ImageIOParameterList::iterator iter =
         extra_attribs.find (name, searchtype, casesensitive);
-    if (iter != extra_attribs.end())
+    if (iter != extra_attribs.cend())
         extra_attribs.erase (iter);
 }
 
@@ -373,7 +372,8 @@ ImageSpec::find_attribute (string_view name, TypeDesc searchtype,
 {
     ImageIOParameterList::iterator iter =
         extra_attribs.find (name, searchtype, casesensitive);
-    if (iter != extra_attribs.end())
+    // N.B. compare to cend() -- the non-const end() drops the name index
+    if (iter != extra_attribs.cend())
         return &(*iter);
     return NULL;
 }
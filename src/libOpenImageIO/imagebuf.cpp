@@ -34,11 +34,20 @@
 
 
 #include <iostream>
+#include <cstdlib>
+#include <new>
+#ifdef __linux__
+# include <sys/mman.h>
+#endif
+#ifdef _WIN32
+# include <malloc.h>
+#endif
 
 #include <OpenEXR/ImathFun.h>
 #include <OpenEXR/half.h>
 #include <boost/scoped_ptr.hpp>
 #include <boost/scoped_array.hpp>
+#include <boost/shared_array.hpp>
 
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/deepdata.h"
@@ -51,12 +60,131 @@
 #include "OpenImageIO/fmath.h"
 #include "OpenImageIO/thread.h"
 #include "OpenImageIO/simd.h"
+#include "imageio_pvt.h"
 
 OIIO_NAMESPACE_BEGIN
 
 
+// Local pixel memory allocated and not yet freed.  It's charged to the
+// memory itself rather than to the ImageBufs using it, so that memory
+// shared copy-on-write by several of them is counted once, for as long
+// as any of them still refers to it.
 static atomic_ll IB_local_mem_current;
 
+// Local pixel allocations at least this big may use huge pages and
+// parallel first touch.
+static const size_t huge_page_size = 2*1024*1024;
+
+
+
+// Allocate local pixel memory, honoring the "imagebuf:hugepages" policy.
+// It is always at least cache-line aligned.  Free with PixelMemFree(size).
+static char *
+alloc_pixel_memory (size_t size)
+{
+    size_t requested = size;
+    size_t align = OIIO_CACHE_LINE_SIZE;
+    bool huge = pvt::oiio_imagebuf_hugepages && size >= huge_page_size;
+    if (huge) {
+        align = huge_page_size;
+        size = round_to_multiple_of_pow2 (size, huge_page_size);
+    }
+    void *p = NULL;
+#ifdef _WIN32
+    p = _aligned_malloc (size, align);
+#else
+    if (posix_memalign (&p, align, size) != 0)
+        p = NULL;
+#endif
+    if (! p)
+        throw std::bad_alloc();
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (huge)
+        madvise (p, size, MADV_HUGEPAGE);
+#endif
+    IB_local_mem_current += (long long) requested;
+    return (char *)p;
+}
+
+
+
+// Deleter for boost::shared_array of memory from alloc_pixel_memory,
+// given the size that was asked for.
+struct PixelMemFree {
+    PixelMemFree (size_t size = 0) : size(size) { }
+    void operator() (char *p) const {
+#ifdef _WIN32
+        _aligned_free (p);
+#else
+        free (p);
+#endif
+        if (p)
+            IB_local_mem_current -= (long long) size;
+    }
+    size_t size;
+};
+
+
+
+// Zero the roi portion of local pixel memory laid out as described by
+// spec.  Run via parallel_image, this places the pages of the image on
+// the NUMA nodes of the threads that will later work on them.
+static void
+first_touch_pixels (char *pixels, const ImageSpec &spec, ROI roi)
+{
+    size_t pixel_bytes = spec.pixel_bytes();
+    size_t scanline_bytes = spec.scanline_bytes();
+    size_t plane_bytes = scanline_bytes * spec.height;
+    for (int z = roi.zbegin;  z < roi.zend;  ++z)
+        for (int y = roi.ybegin;  y < roi.yend;  ++y)
+            memset (pixels + (z-spec.z) * plane_bytes
+                           + (y-spec.y) * scanline_bytes
+                           + (roi.xbegin-spec.x) * pixel_bytes,
+                    0, roi.width() * pixel_bytes);
+}
+
+
+
+// One band of scanlines of a parallel read (see ImageBufImpl::read).
+struct ReadBand {
+    int ybegin, yend;
+    bool ok;
+    std::string err;
+};
+
+
+
+// Read the band's scanlines, converted to spec.format, into their place
+// in pixels, the contiguous local memory for the whole image described by
+// spec.  Use the open file 'in' if given; otherwise open the file just
+// for this band.
+static void
+read_band (ImageInput *in, const std::string &filename,
+           const ImageSpec *config, int subimage, int miplevel,
+           const ImageSpec &spec, char *pixels, ReadBand *band)
+{
+    boost::scoped_ptr<ImageInput> mine;
+    if (! in) {
+        mine.reset (ImageInput::open (filename, config));
+        ImageSpec dummyspec;
+        if (! mine || ((subimage || miplevel) &&
+                       ! mine->seek_subimage (subimage, miplevel, dummyspec))) {
+            band->ok = false;
+            band->err = mine ? mine->geterror() : OIIO::geterror();
+            return;
+        }
+        mine->threads (1);   // the bands are the parallelism
+        in = mine.get();
+    }
+    stride_t ystride = spec.scanline_bytes();
+    band->ok = in->read_scanlines (band->ybegin, band->yend, spec.z,
+                                   0, spec.nchannels, spec.format,
+                                   pixels + (band->ybegin - spec.y) * ystride,
+                                   AutoStride, ystride);
+    if (! band->ok)
+        band->err = in->geterror();
+}
+
 
 
 ROI
@@ -142,7 +270,9 @@ class ImageBufImpl {
 public:
     ImageBufImpl (string_view filename, int subimage, int miplevel,
                   ImageCache *imagecache=NULL, const ImageSpec *spec=NULL,
-                  void *buffer=NULL, const ImageSpec *config = NULL);
+                  void *buffer=NULL, const ImageSpec *config = NULL,
+                  stride_t xstride=AutoStride, stride_t ystride=AutoStride,
+                  stride_t zstride=AutoStride);
     ImageBufImpl (const ImageBufImpl &src);
     ~ImageBufImpl ();
 
@@ -158,6 +288,14 @@ public:
                ProgressCallback progress_callback=NULL,
                void *progress_callback_data=NULL);
     void copy_metadata (const ImageBufImpl &src);
+    // Like reset(src.name(),src.spec()) followed by a copy of src's
+    // pixels, but share src's local pixel memory until either is written.
+    void reset_shared (const ImageBufImpl &src);
+    // Make this a copy-on-write view of the roi of src's local pixels.
+    void reset_view (const ImageBufImpl &src, ROI roi);
+    // If our local pixel memory is shared with another ImageBuf, give
+    // ourselves a private copy of it, so that it may be written.
+    void unshare_pixels ();
 
     // Error reporting for ImageBuf: call this with printf-like
     // arguments.  Note however that this is fully typesafe!
@@ -190,9 +328,42 @@ public:
     const void *pixeladdr (int x, int y, int z) const;
     void *pixeladdr (int x, int y, int z);
 
+    // Byte offset of pixel (x,y,z), relative to the data window origin,
+    // within the local pixels.
+    stride_t pixel_offset (int x, int y, int z) const {
+        if (! m_blockw)
+            return y * m_scanline_bytes + x * m_pixel_bytes
+                 + z * m_plane_bytes;
+        return z * m_plane_bytes
+             + stride_t((y >> m_blockh_bits) * m_nxblocks
+                        + (x >> m_blockw_bits)) * m_block_bytes
+             + (y & (m_blockh-1)) * m_scanline_bytes
+             + (x & (m_blockw-1)) * m_pixel_bytes;
+    }
+
+    bool set_local_tiles (int width, int height);
+    void set_layout (int blockw, int blockh);
+    bool read_image_banded (ImageInput *in, int subimage, int miplevel,
+                            TypeDesc convert);
+    void copy_local_rows (const ImageBufImpl &src, ROI roi);
+
+    // The number of pixels from x up to xend that can be stepped through
+    // at m_pixel_bytes without leaving the current block row.
+    int local_run (int x, int xend) const {
+        if (m_pixel_bytes != (stride_t)m_spec.pixel_bytes())
+            return 1;
+        if (! m_blockw)
+            return xend - x;
+        return std::min (xend - x, m_blockw - ((x - m_spec.x) & (m_blockw-1)));
+    }
+
     const void *retile (int x, int y, int z, ImageCache::Tile* &tile,
                     int &tilexbegin, int &tileybegin, int &tilezbegin,
                     int &tilexend, bool exists, ImageBuf::WrapMode wrap) const;
+    void release_tile (ImageCache::Tile *tile) const;
+
+    bool pin_tiles (ROI roi);
+    void unpin_tiles ();
 
     bool do_wrap (int &x, int &y, int &z, ImageBuf::WrapMode wrap) const;
 
@@ -278,26 +449,37 @@ private:
     int m_threads;               ///< thread policy for this image
     ImageSpec m_spec;            ///< Describes the image (size, etc)
     ImageSpec m_nativespec;      ///< Describes the true native image
-    boost::scoped_array<char> m_pixels; ///< Pixel data, if local and we own it
+    boost::shared_array<char> m_pixels; ///< Pixel data, if local and we own it
     char *m_localpixels;         ///< Pointer to local pixels
+    mutable atomic_int m_pixels_shared; ///< m_pixels may be shared (COW)
     mutable spin_mutex m_valid_mutex;
     mutable bool m_spec_valid;   ///< Is the spec valid
     mutable bool m_pixels_valid; ///< Image is valid
     bool m_badfile;              ///< File not found
     float m_pixelaspect;         ///< Pixel aspect ratio of the image
-    size_t m_pixel_bytes;
-    size_t m_scanline_bytes;
-    size_t m_plane_bytes;
+    stride_t m_pixel_bytes;      ///< Strides of the local pixels
+    stride_t m_scanline_bytes;
+    stride_t m_plane_bytes;
+    int m_blockw, m_blockh;      ///< Local block size (0 = scanlines)
+    int m_blockw_bits, m_blockh_bits;  ///< log2 of the block size
+    int m_nxblocks;              ///< Blocks per row of blocks
+    stride_t m_block_bytes;      ///< Bytes per block
     ImageCache *m_imagecache;    ///< ImageCache to use
     TypeDesc m_cachedpixeltype;  ///< Data type stored in the cache
     DeepData m_deepdata;         ///< Deep data
-    size_t m_allocated_size;     ///< How much memory we've allocated
+    size_t m_allocated_size;     ///< Size of m_pixels (perhaps shared)
     std::vector<char> m_blackpixel; ///< Pixel-sized zero bytes
     TypeDesc m_write_format;     /// Format to use for write()
     int m_write_tile_width;
     int m_write_tile_height;
     int m_write_tile_depth;
     boost::scoped_ptr<ImageSpec> m_configspec; // Configuration spec
+    // Tiles held by pin_tiles(), for the box of tile indices starting at
+    // m_pinbegin[] with m_pincount[] tiles along each axis, x fastest.
+    std::vector<ImageCache::Tile *> m_pinned_tiles;
+    std::vector<const char *> m_pinned_pixels;
+    std::vector<ImageCache::Tile *> m_pinned_sorted;  // for release_tile
+    int m_pinbegin[3], m_pincount[3];
     mutable std::string m_err;   ///< Last error message
 
     const ImageBufImpl operator= (const ImageBufImpl &src); // unimplemented
@@ -310,7 +492,9 @@ ImageBufImpl::ImageBufImpl (string_view filename,
                             int subimage, int miplevel,
                             ImageCache *imagecache,
                             const ImageSpec *spec, void *buffer,
-                            const ImageSpec *config)
+                            const ImageSpec *config,
+                            stride_t xstride, stride_t ystride,
+                            stride_t zstride)
     : m_storage(ImageBuf::UNINITIALIZED),
       m_name(filename), m_nsubimages(0),
       m_current_subimage(subimage), m_current_miplevel(miplevel),
@@ -320,6 +504,8 @@ ImageBufImpl::ImageBufImpl (string_view filename,
       m_spec_valid(false), m_pixels_valid(false),
       m_badfile(false), m_pixelaspect(1),
       m_pixel_bytes(0), m_scanline_bytes(0), m_plane_bytes(0),
+      m_blockw(0), m_blockh(0), m_blockw_bits(0), m_blockh_bits(0),
+      m_nxblocks(0), m_block_bytes(0),
       m_imagecache(imagecache), m_allocated_size(0),
       m_write_format(TypeDesc::UNKNOWN), m_write_tile_width(0),
       m_write_tile_height(0), m_write_tile_depth(1)
@@ -336,6 +522,13 @@ ImageBufImpl::ImageBufImpl (string_view filename,
             m_localpixels = (char *)buffer;
             m_storage = ImageBuf::APPBUFFER;
             m_pixels_valid = true;
+            // The app's buffer may have its own layout.
+            if (xstride != AutoStride)
+                m_pixel_bytes = xstride;
+            m_scanline_bytes = (ystride != AutoStride) ? ystride
+                             : m_pixel_bytes * m_spec.width;
+            m_plane_bytes = (zstride != AutoStride) ? zstride
+                          : m_scanline_bytes * m_spec.height;
         } else {
             m_storage = ImageBuf::LOCALBUFFER;
         }
@@ -363,13 +556,16 @@ ImageBufImpl::ImageBufImpl (const ImageBufImpl &src)
       m_nmiplevels(src.m_nmiplevels),
       m_threads(src.m_threads),
       m_spec(src.m_spec), m_nativespec(src.m_nativespec),
-      m_pixels(src.m_localpixels ? new char [src.m_spec.image_bytes()] : NULL),
-      m_localpixels(m_pixels.get()),
+      m_pixels(src.m_pixels),
+      m_localpixels(src.m_pixels ? src.m_localpixels : NULL),
       m_badfile(src.m_badfile),
       m_pixelaspect(src.m_pixelaspect),
       m_pixel_bytes(src.m_pixel_bytes),
       m_scanline_bytes(src.m_scanline_bytes),
       m_plane_bytes(src.m_plane_bytes),
+      m_blockw(src.m_blockw), m_blockh(src.m_blockh),
+      m_blockw_bits(src.m_blockw_bits), m_blockh_bits(src.m_blockh_bits),
+      m_nxblocks(src.m_nxblocks), m_block_bytes(src.m_block_bytes),
       m_imagecache(src.m_imagecache),
       m_cachedpixeltype(src.m_cachedpixeltype),
       m_deepdata(src.m_deepdata),
@@ -381,16 +577,17 @@ ImageBufImpl::ImageBufImpl (const ImageBufImpl &src)
 {
     m_spec_valid = src.m_spec_valid;
     m_pixels_valid = src.m_pixels_valid;
-    m_allocated_size = src.m_localpixels ? src.spec().image_bytes() : 0;
-    IB_local_mem_current += m_allocated_size;
+    // The pixels are not copied now -- copy-on-write, see unshare_pixels
+    m_allocated_size = src.m_allocated_size;
     if (src.m_localpixels) {
         // Source had the image fully in memory (no cache)
         if (m_storage == ImageBuf::APPBUFFER) {
             // Source just wrapped the client app's pixels
             ASSERT (0 && "ImageBuf wrapping client buffer not yet supported");
         } else {
-            // We own our pixels -- copy from source
-            memcpy (m_pixels.get(), src.m_pixels.get(), m_spec.image_bytes());
+            // We own our pixels -- share them with the source
+            m_pixels_shared = 1;
+            src.m_pixels_shared = 1;
         }
     } else {
         // Source was cache-based or deep
@@ -404,11 +601,11 @@ ImageBufImpl::ImageBufImpl (const ImageBufImpl &src)
 
 ImageBufImpl::~ImageBufImpl ()
 {
+    unpin_tiles ();
     // Do NOT destroy m_imagecache here -- either it was created
     // externally and passed to the ImageBuf ctr or reset() method, or
     // else init_spec requested the system-wide shared cache, which
     // does not need to be destroyed.
-    IB_local_mem_current -= m_allocated_size;
 }
 
 
@@ -453,15 +650,19 @@ ImageBuf::ImageBuf (string_view filename, const ImageSpec &spec)
 
 
 ImageBuf::ImageBuf (string_view filename, const ImageSpec &spec,
-                    void *buffer)
-    : m_impl (new ImageBufImpl (filename, 0, 0, NULL, &spec, buffer))
+                    void *buffer, stride_t xstride, stride_t ystride,
+                    stride_t zstride)
+    : m_impl (new ImageBufImpl (filename, 0, 0, NULL, &spec, buffer, NULL,
+                                xstride, ystride, zstride))
 {
 }
 
 
 
-ImageBuf::ImageBuf (const ImageSpec &spec, void *buffer)
-    : m_impl (new ImageBufImpl ("", 0, 0, NULL, &spec, buffer))
+ImageBuf::ImageBuf (const ImageSpec &spec, void *buffer,
+                    stride_t xstride, stride_t ystride, stride_t zstride)
+    : m_impl (new ImageBufImpl ("", 0, 0, NULL, &spec, buffer, NULL,
+                                xstride, ystride, zstride))
 {
 }
 
@@ -536,6 +737,7 @@ ImageBuf::storage () const
 void
 ImageBufImpl::clear ()
 {
+    unpin_tiles ();
     m_storage = ImageBuf::UNINITIALIZED;
     m_name.clear ();
     m_fileformat.clear ();
@@ -545,7 +747,9 @@ ImageBufImpl::clear ()
     m_spec = ImageSpec ();
     m_nativespec = ImageSpec ();
     m_pixels.reset ();
+    m_allocated_size = 0;
     m_localpixels = NULL;
+    m_pixels_shared = 0;
     m_spec_valid = false;
     m_pixels_valid = false;
     m_badfile = false;
@@ -553,6 +757,10 @@ ImageBufImpl::clear ()
     m_pixel_bytes = 0;
     m_scanline_bytes = 0;
     m_plane_bytes = 0;
+    m_blockw = m_blockh = 0;
+    m_blockw_bits = m_blockh_bits = 0;
+    m_nxblocks = 0;
+    m_block_bytes = 0;
     m_imagecache = NULL;
     m_deepdata.free ();
     m_blackpixel.clear ();
@@ -642,20 +850,317 @@ ImageBuf::reset (const ImageSpec &spec)
 
 
 
+void
+ImageBufImpl::reset_shared (const ImageBufImpl &src)
+{
+    DASSERT (src.m_pixels && src.m_localpixels);
+    clear ();
+    m_allocated_size = src.m_allocated_size;
+    m_name = src.m_name;
+    m_current_subimage = 0;
+    m_current_miplevel = 0;
+    m_spec = src.m_spec;
+    m_nativespec = src.m_spec;
+    m_pixels = src.m_pixels;
+    m_localpixels = src.m_localpixels;
+    m_storage = ImageBuf::LOCALBUFFER;
+    m_pixel_bytes = src.m_pixel_bytes;
+    m_scanline_bytes = src.m_scanline_bytes;
+    m_plane_bytes = src.m_plane_bytes;
+    m_blockw = src.m_blockw;
+    m_blockh = src.m_blockh;
+    m_blockw_bits = src.m_blockw_bits;
+    m_blockh_bits = src.m_blockh_bits;
+    m_nxblocks = src.m_nxblocks;
+    m_block_bytes = src.m_block_bytes;
+    m_blackpixel = src.m_blackpixel;
+    m_spec_valid = true;
+    m_pixels_valid = true;
+    m_pixels_shared = 1;
+    src.m_pixels_shared = 1;
+}
+
+
+
+void
+ImageBufImpl::reset_view (const ImageBufImpl &src, ROI roi)
+{
+    DASSERT (src.m_pixels && src.m_localpixels && this != &src);
+    const ImageSpec &srcspec (src.m_spec);
+    ImageSpec spec = srcspec;
+    spec.x = roi.xbegin;  spec.width = roi.width();
+    spec.y = roi.ybegin;  spec.height = roi.height();
+    spec.z = roi.zbegin;  spec.depth = roi.depth();
+    spec.nchannels = roi.nchannels();
+    spec.channelnames.clear ();
+    for (int c = roi.chbegin;  c < roi.chend;  ++c)
+        spec.channelnames.push_back (c < (int)srcspec.channelnames.size()
+                                     ? srcspec.channelnames[c] : std::string());
+    spec.alpha_channel = (srcspec.alpha_channel >= roi.chbegin &&
+                          srcspec.alpha_channel < roi.chend)
+                       ? srcspec.alpha_channel - roi.chbegin : -1;
+    spec.z_channel = (srcspec.z_channel >= roi.chbegin &&
+                      srcspec.z_channel < roi.chend)
+                   ? srcspec.z_channel - roi.chbegin : -1;
+    char *pixels = (char *) src.pixeladdr (roi.xbegin, roi.ybegin, roi.zbegin)
+                 + roi.chbegin * srcspec.format.size();
+
+    clear ();
+    m_allocated_size = src.m_allocated_size;
+    m_name = src.m_name;
+    m_current_subimage = 0;
+    m_current_miplevel = 0;
+    m_spec = spec;
+    m_nativespec = spec;
+    m_pixels = src.m_pixels;
+    m_localpixels = pixels;
+    m_storage = ImageBuf::LOCALBUFFER;
+    m_pixel_bytes = src.m_pixel_bytes;
+    m_scanline_bytes = src.m_scanline_bytes;
+    m_plane_bytes = src.m_plane_bytes;
+    m_blackpixel.resize (round_to_multiple (spec.pixel_bytes(), OIIO_SIMD_MAX_SIZE_BYTES), 0);
+    m_spec_valid = true;
+    m_pixels_valid = true;
+    m_pixels_shared = 1;
+    src.m_pixels_shared = 1;
+}
+
+
+
+bool
+ImageBufImpl::read_image_banded (ImageInput *in, int subimage, int miplevel,
+                                 TypeDesc convert)
+{
+    // Big scanline files whose readers can start anywhere are decoded a
+    // band of scanlines per thread, each band with its own ImageInput
+    // (and converting straight into our pixels), rather than serially.
+    // Bands are multiples of 32 scanlines (or of the TIFF strip height),
+    // so no compressed chunk of the file straddles two of them.
+    const ImageSpec &fspec (in->spec());
+    int nthreads = m_threads;
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    int align = std::max (32, fspec.get_int_attribute ("tiff:RowsPerStrip", 1));
+    int nbands = std::min (nthreads, fspec.height / std::max (64, align));
+    nbands = int (std::min (imagesize_t (nbands),
+                            m_spec.image_bytes() / (1024*1024)));
+    if (nbands < 2 || ! pvt::oiio_imagebuf_parallel_read ||
+          fspec.tile_width || fspec.deep || fspec.depth > 1 ||
+          fspec.channelformats.size() || ! in->supports ("random_access") ||
+          (m_configspec && m_configspec->find_attribute ("oiio:ioproxy")))
+        return in->read_image (convert, m_localpixels);
+
+    int bandheight = round_to_multiple ((fspec.height + nbands - 1) / nbands,
+                                        align);
+    std::vector<ReadBand> bands;
+    for (int y = fspec.y;  y < fspec.y + fspec.height;  y += bandheight) {
+        ReadBand band;
+        band.ybegin = y;
+        band.yend = std::min (y + bandheight, fspec.y + fspec.height);
+        band.ok = true;
+        bands.push_back (band);
+    }
+    in->threads (1);
+    {
+        task_set tasks;
+        for (size_t b = 1;  b < bands.size();  ++b)
+            tasks.push (OIIO::bind (read_band, (ImageInput *)NULL,
+                                    OIIO::cref(m_name.string()),
+                                    m_configspec.get(), subimage, miplevel,
+                                    OIIO::cref(m_spec), m_localpixels,
+                                    &bands[b]));
+        // The already-open file reads the first band in this thread
+        read_band (in, m_name.string(), m_configspec.get(), subimage,
+                   miplevel, m_spec, m_localpixels, &bands[0]);
+        tasks.wait ();
+    }
+    bool ok = true;
+    for (size_t b = 0;  b < bands.size();  ++b) {
+        if (! bands[b].ok) {
+            error ("%s", bands[b].err);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+
+
+void
+ImageBufImpl::set_layout (int blockw, int blockh)
+{
+    m_pixel_bytes = m_spec.pixel_bytes();
+    m_blockw = blockw;
+    m_blockh = blockh;
+    m_blockw_bits = m_blockh_bits = 0;
+    while ((1 << m_blockw_bits) < blockw)
+        ++m_blockw_bits;
+    while ((1 << m_blockh_bits) < blockh)
+        ++m_blockh_bits;
+    if (blockw) {
+        m_nxblocks = (m_spec.width + blockw - 1) >> m_blockw_bits;
+        int nyblocks = (m_spec.height + blockh - 1) >> m_blockh_bits;
+        m_scanline_bytes = blockw * m_pixel_bytes;
+        m_block_bytes = blockh * m_scanline_bytes;
+        m_plane_bytes = m_block_bytes * m_nxblocks * nyblocks;
+    } else {
+        m_nxblocks = 0;
+        m_block_bytes = 0;
+        m_scanline_bytes = m_spec.scanline_bytes();
+        m_plane_bytes = clamped_mult64 (m_scanline_bytes, (imagesize_t)m_spec.height);
+    }
+}
+
+
+
+void
+ImageBufImpl::copy_local_rows (const ImageBufImpl &src, ROI roi)
+{
+    size_t pixelsize = m_spec.pixel_bytes();
+    for (int z = roi.zbegin;  z < roi.zend;  ++z)
+        for (int y = roi.ybegin;  y < roi.yend;  ++y)
+            for (int x = roi.xbegin, n;  x < roi.xend;  x += n) {
+                n = std::min (local_run (x, roi.xend),
+                              src.local_run (x, roi.xend));
+                memcpy (m_localpixels + pixel_offset (x - m_spec.x,
+                                y - m_spec.y, z - m_spec.z),
+                        src.m_localpixels + src.pixel_offset (x - m_spec.x,
+                                y - m_spec.y, z - m_spec.z),
+                        n * pixelsize);
+            }
+}
+
+
+
+bool
+ImageBufImpl::set_local_tiles (int width, int height)
+{
+    if (height <= 0)
+        height = width;
+    if (width < 0 || (width && (! ispow2 (width) || ! ispow2 (height)))) {
+        error ("Invalid local tile size %dx%d (must be powers of 2)",
+               width, height);
+        return false;
+    }
+    if (! width)
+        height = 0;
+    validate_pixels ();
+    if (m_spec.deep || m_spec.channelformats.size() ||
+          m_storage == ImageBuf::APPBUFFER) {
+        error ("set_local_tiles is not supported for %s",
+               m_spec.deep ? "deep images" :
+               m_storage == ImageBuf::APPBUFFER ? "application buffers"
+                                                : "per-channel formats");
+        return false;
+    }
+    if (! m_localpixels) {
+        if (m_storage != ImageBuf::IMAGECACHE) {
+            error ("set_local_tiles: the ImageBuf has no pixels");
+            return false;
+        }
+        // Not in memory yet: read() will lay the pixels out this way.
+        m_blockw = width;
+        m_blockh = height;
+        return true;
+    }
+    if (width == m_blockw && height == m_blockh &&
+          (width || (m_pixel_bytes == (stride_t)m_spec.pixel_bytes() &&
+                     m_scanline_bytes == (stride_t)m_spec.scanline_bytes() &&
+                     m_plane_bytes == m_scanline_bytes * m_spec.height)))
+        return true;   // already laid out that way
+
+    // Lay out a scratch impl the new way, copy the pixels into it, then
+    // take over its memory (the old memory remains for any images
+    // sharing it).
+    ImageBufImpl tmp ("", 0, 0, NULL, &m_spec);
+    tmp.set_layout (width, height);
+    size_t size = width ? size_t(tmp.m_plane_bytes * m_spec.depth)
+                        : size_t(m_spec.image_bytes());
+    tmp.m_pixels.reset (alloc_pixel_memory (size), PixelMemFree (size));
+    tmp.m_localpixels = tmp.m_pixels.get();
+    ImageBufAlgo::parallel_image (
+        OIIO::bind (&ImageBufImpl::copy_local_rows, &tmp, OIIO::cref(*this),
+                    _1 /*roi*/),
+        get_roi (m_spec), m_threads);
+    m_pixels.swap (tmp.m_pixels);
+    m_localpixels = m_pixels.get();
+    m_pixels_shared = 0;
+    m_storage = ImageBuf::LOCALBUFFER;
+    set_layout (width, height);
+    m_allocated_size = size;
+    return true;
+}
+
+
+
+void
+ImageBufImpl::unshare_pixels ()
+{
+    if (! m_pixels_shared)
+        return;
+    spin_lock lock (m_valid_mutex);
+    if (m_pixels_shared && ! m_pixels.unique()) {
+        // Someone else still refers to our pixels, make our own copy
+        // (the other owners keep the original).
+        // A view's pixels may be spread through its parent's, so copy
+        // them into the usual contiguous layout.  A blocked layout is
+        // kept as it is (views of those are never made).
+        size_t size = m_blockw ? size_t(m_plane_bytes * m_spec.depth)
+                               : size_t(m_spec.image_bytes());
+        boost::shared_array<char> pixels (alloc_pixel_memory (size),
+                                          PixelMemFree (size));
+        if (m_blockw) {
+            memcpy (pixels.get(), m_localpixels, size);
+            m_pixels.swap (pixels);
+            m_localpixels = m_pixels.get();
+            m_allocated_size = size;
+            m_pixels_shared = 0;
+            return;
+        }
+        stride_t pixelsize = m_spec.pixel_bytes();
+        stride_t linesize = m_spec.scanline_bytes();
+        if (m_pixel_bytes == pixelsize && m_scanline_bytes == linesize &&
+              m_plane_bytes == linesize * m_spec.height)
+            memcpy (pixels.get(), m_localpixels, size);
+        else
+            copy_image (m_spec.nchannels, m_spec.width, m_spec.height,
+                        m_spec.depth, m_localpixels, pixelsize,
+                        m_pixel_bytes, m_scanline_bytes, m_plane_bytes,
+                        pixels.get(), pixelsize, linesize,
+                        linesize * m_spec.height);
+        m_pixels.swap (pixels);
+        m_localpixels = m_pixels.get();
+        m_pixel_bytes = pixelsize;
+        m_scanline_bytes = linesize;
+        m_plane_bytes = linesize * m_spec.height;
+        m_allocated_size = size;
+    }
+    m_pixels_shared = 0;
+}
+
+
+
 void
 ImageBufImpl::realloc ()
 {
-    IB_local_mem_current -= m_allocated_size;
+    unpin_tiles ();
     m_allocated_size = m_spec.deep ? size_t(0) : m_spec.image_bytes ();
-    IB_local_mem_current += m_allocated_size;
-    m_pixels.reset (m_allocated_size ? new char [m_allocated_size] : NULL);
+    m_pixels.reset (m_allocated_size ? alloc_pixel_memory (m_allocated_size)
+                                     : NULL, PixelMemFree (m_allocated_size));
     m_localpixels = m_pixels.get();
+    m_pixels_shared = 0;
     m_storage = m_allocated_size ? ImageBuf::LOCALBUFFER : ImageBuf::UNINITIALIZED;
     m_pixel_bytes = m_spec.pixel_bytes();
     m_scanline_bytes = m_spec.scanline_bytes();
     m_plane_bytes = clamped_mult64 (m_scanline_bytes, (imagesize_t)m_spec.height);
+    m_blockw = m_blockh = 0;
     m_blackpixel.resize (round_to_multiple (m_pixel_bytes, OIIO_SIMD_MAX_SIZE_BYTES), 0);
     // NB make it big enough for SSE
+    if (m_allocated_size >= huge_page_size && pvt::oiio_imagebuf_first_touch)
+        ImageBufAlgo::parallel_image (
+            OIIO::bind (first_touch_pixels, m_localpixels, OIIO::cref(m_spec),
+                        _1 /*roi*/),
+            get_roi (m_spec), m_threads);
     if (m_allocated_size)
         m_pixels_valid = true;
     if (m_spec.deep) {
@@ -779,6 +1284,7 @@ ImageBufImpl::read (int subimage, int miplevel, bool force, TypeDesc convert,
             subimage == m_current_subimage && miplevel == m_current_miplevel)
         return true;
 
+    unpin_tiles ();
     if (! init_spec (m_name.string(), subimage, miplevel)) {
         m_badfile = true;
         m_spec_valid = false;
@@ -840,6 +1346,9 @@ ImageBufImpl::read (int subimage, int miplevel, bool force, TypeDesc convert,
     else
         m_spec.format = m_nativespec.format;
     m_pixelaspect = m_spec.get_float_attribute ("pixelaspectratio", 1.0f);
+    // The pixels are read in scanline order, then rearranged if a blocked
+    // layout was asked for.
+    int blockw = m_blockw, blockh = m_blockh;
     realloc ();
 
     // If forcing a full read, make sure the spec reflects the nativespec's
@@ -874,10 +1383,12 @@ ImageBufImpl::read (int subimage, int miplevel, bool force, TypeDesc convert,
                 ok &= in->seek_subimage (subimage, miplevel, newspec);
             }
             if (ok)
-                ok &= in->read_image (convert, m_localpixels);
+                ok &= read_image_banded (in, subimage, miplevel, convert);
             in->close ();
             if (ok) {
                 m_pixels_valid = true;
+                if (blockw)
+                    set_local_tiles (blockw, blockh);
             } else {
                 m_pixels_valid = false;
                 error ("%s", in->geterror());
@@ -898,6 +1409,8 @@ ImageBufImpl::read (int subimage, int miplevel, bool force, TypeDesc convert,
                                   m_spec.z, m_spec.z+m_spec.depth,
                                   m_spec.format, m_localpixels)) {
         m_pixels_valid = true;
+        if (blockw)
+            set_local_tiles (blockw, blockh);
     } else {
         m_pixels_valid = false;
         error ("%s", m_imagecache->geterror ());
@@ -919,6 +1432,30 @@ ImageBuf::read (int subimage, int miplevel, bool force, TypeDesc convert,
 
 
 
+bool
+ImageBuf::set_local_tiles (int width, int height)
+{
+    return impl()->set_local_tiles (width, height);
+}
+
+
+
+int
+ImageBuf::local_tile_width () const
+{
+    return impl()->m_localpixels ? impl()->m_blockw : 0;
+}
+
+
+
+int
+ImageBuf::local_tile_height () const
+{
+    return impl()->m_localpixels ? impl()->m_blockh : 0;
+}
+
+
+
 void
 ImageBuf::set_write_format (TypeDesc format)
 {
@@ -936,6 +1473,13 @@ ImageBuf::set_write_tiles (int width, int height, int depth)
 
 
 
+// Defined below, next to get_pixels().
+static bool write_tile_rows (const ImageBuf &buf, ImageOutput *out,
+                             ProgressCallback progress_callback,
+                             void *progress_callback_data);
+
+
+
 bool
 ImageBuf::write (ImageOutput *out,
                  ProgressCallback progress_callback,
@@ -948,10 +1492,58 @@ ImageBuf::write (ImageOutput *out,
     const ImageSpec &bufspec (impl->m_spec);
     const ImageSpec &outspec (out->spec());
     TypeDesc bufformat = spec().format;
-    if (impl->m_localpixels) {
+    const int blockw = impl->m_blockw, blockh = impl->m_blockh;
+    // A tiled file in a different data type than our pixels (or whose
+    // pixels must first come from the ImageCache) is written a few tile
+    // rows at a time, converted to the file's type in parallel while the
+    // previous rows are compressed and written, so no conversion buffer
+    // bigger than a few tile rows is ever needed.
+    bool stream = outspec.tile_width && ! deep() &&
+        (! impl->m_localpixels || bufformat != outspec.format ||
+         blockw != outspec.tile_width || blockh != outspec.tile_height) &&
+        outspec.format != TypeDesc::UNKNOWN &&
+        outspec.channelformats.empty() &&
+        outspec.nchannels == bufspec.nchannels &&
+        outspec.x == bufspec.x && outspec.y == bufspec.y &&
+        outspec.z == bufspec.z && outspec.width == bufspec.width &&
+        outspec.height == bufspec.height &&
+        outspec.depth == bufspec.depth &&
+        out->supports ("tiles") && ! out->supports ("rectangles") &&
+        ! (outspec.get_int_attribute ("oiio:dither") &&
+           bufformat.is_floating_point() &&
+           outspec.format.basetype == TypeDesc::UINT8);
+    if (stream) {
+        ok = write_tile_rows (*this, out, progress_callback,
+                              progress_callback_data);
+    } else if (impl->m_localpixels && ! blockw) {
         // In-core pixel buffer for the whole image
-        ok = out->write_image (bufformat, impl->m_localpixels, as, as, as,
+        ok = out->write_image (bufformat, impl->m_localpixels,
+                               impl->m_pixel_bytes, impl->m_scanline_bytes,
+                               impl->m_plane_bytes,
                                progress_callback, progress_callback_data);
+    } else if (impl->m_localpixels && outspec.tile_width == blockw &&
+               outspec.tile_height == blockh && outspec.tile_depth <= 1 &&
+               outspec.x == bufspec.x && outspec.y == bufspec.y &&
+               outspec.z == bufspec.z && outspec.width == bufspec.width &&
+               outspec.height == bufspec.height &&
+               outspec.depth == bufspec.depth) {
+        // Local blocks that are exactly the file's tiles: each one is
+        // already a whole tile (padded at the edges), so hand it over
+        // as it is.
+        for (int z = 0;  z < bufspec.depth;  ++z) {
+            for (int y = 0;  y < bufspec.height && ok;  y += blockh) {
+                for (int x = 0;  x < bufspec.width && ok;  x += blockw)
+                    ok &= out->write_tile (x+bufspec.x, y+bufspec.y,
+                                     z+bufspec.z, bufformat,
+                                     impl->m_localpixels + impl->pixel_offset (x, y, z),
+                                     impl->m_pixel_bytes, impl->m_scanline_bytes,
+                                     impl->m_block_bytes);
+                if (progress_callback &&
+                    progress_callback (progress_callback_data,
+                                       (float)(z*bufspec.height+y)/(bufspec.height*bufspec.depth)))
+                    return ok;
+            }
+        }
     } else if (deep()) {
         // Deep image record
         ok = out->write_deep_image (impl->m_deepdata);
@@ -959,7 +1551,8 @@ ImageBuf::write (ImageOutput *out,
         // The image we want to write is backed by ImageCache -- we must be
         // immediately writing out a file from disk, possibly with file
         // format or data format conversion, but without any ImageBufAlgo
-        // functions having been applied.
+        // functions having been applied -- or is in local memory in a
+        // blocked layout that doesn't match the file's tiles.
         const imagesize_t budget = 1024*1024*64; // 64 MB
         imagesize_t imagesize = bufspec.image_bytes();
         if (imagesize <= budget) {
@@ -1082,6 +1675,7 @@ ImageBuf::make_writeable (bool keep_cache_type)
         return read (subimage(), miplevel(), true /*force*/,
                      keep_cache_type ? impl()->m_cachedpixeltype : TypeDesc());
     }
+    impl()->unshare_pixels ();
     return true;
 }
 
@@ -1239,6 +1833,7 @@ void *
 ImageBuf::localpixels ()
 {
     impl()->validate_pixels ();
+    impl()->unshare_pixels ();
     return impl()->m_localpixels;
 }
 
@@ -1253,6 +1848,43 @@ ImageBuf::localpixels () const
 
 
 
+stride_t
+ImageBuf::pixel_stride () const
+{
+    return impl()->m_pixel_bytes;
+}
+
+
+
+stride_t
+ImageBuf::scanline_stride () const
+{
+    return impl()->m_scanline_bytes;
+}
+
+
+
+stride_t
+ImageBuf::z_stride () const
+{
+    return impl()->m_plane_bytes;
+}
+
+
+
+bool
+ImageBuf::contiguous () const
+{
+    const ImageBufImpl *ib = impl();
+    const ImageSpec &spec (ib->m_spec);
+    return ! ib->m_blockw &&
+           ib->m_pixel_bytes == (stride_t) spec.pixel_bytes() &&
+           ib->m_scanline_bytes == (stride_t) spec.scanline_bytes() &&
+           ib->m_plane_bytes == ib->m_scanline_bytes * spec.height;
+}
+
+
+
 bool
 ImageBuf::cachedpixels () const
 {
@@ -1336,20 +1968,24 @@ copy_pixels_impl (ImageBuf &dst, const ImageBuf &src, ROI roi, int nthreads=0)
     int nchannels = roi.nchannels();
     if (is_same<D,S>::value) {
         // If both bufs are the same type, just directly copy the values
-        if (src.localpixels() && roi.chbegin == 0 &&
+        if (dst.localpixels() && roi.chbegin == 0 &&
             roi.chend == dst.nchannels() && roi.chend == src.nchannels()) {
-            // Extra shortcut -- totally local pixels for src, copying all
-            // channels, so we can copy memory around line by line, rather
-            // than value by value.
-            int nxvalues = roi.width() * dst.nchannels();
-            for (int z = roi.zbegin; z < roi.zend; ++z)
-                for (int y = roi.ybegin; y < roi.yend; ++y) {
-                    D *draw = (D *) dst.pixeladdr (roi.xbegin, y, z);
-                    const S *sraw = (const S *) src.pixeladdr (roi.xbegin, y, z);
-                    DASSERT (draw && sraw);
-                    for (int x = 0; x < nxvalues; ++x)
-                        draw[x] = sraw[x];
-                }
+            // Extra shortcut -- copying all channels, so we can copy
+            // memory around a span at a time (a whole scanline for local
+            // pixels of src, a tile row for cached ones), rather than
+            // value by value.
+            size_t pixelsize = src.spec().pixel_bytes();
+            bool dpacked = (dst.pixel_stride() == (stride_t)pixelsize);
+            int dblockw = dst.local_tile_width();
+            for (ImageBuf::ConstIterator<S,S> s (src, roi);  ! s.done(); ) {
+                int n = dpacked ? s.span_length () : 1;
+                if (dblockw)   // don't run past the end of a dst block row
+                    n = std::min (n, dblockw - ((s.x() - dst.xbegin()) & (dblockw-1)));
+                D *draw = (D *) dst.pixeladdr (s.x(), s.y(), s.z());
+                DASSERT (draw && s.rawptr());
+                memcpy (draw, s.rawptr(), n * pixelsize);
+                s.span_advance (n);
+            }
         } else {
             ImageBuf::Iterator<D,D> d (dst, roi);
             ImageBuf::ConstIterator<D,D> s (src, roi);
@@ -1399,6 +2035,23 @@ ImageBuf::copy_pixels (const ImageBuf &src)
 
 
 
+bool
+ImageBuf::make_view (const ImageBuf &src, ROI roi)
+{
+    if (! roi.defined())
+        roi = src.roi();
+    roi.chend = std::min (roi.chend, src.nchannels());
+    if (this == &src || src.storage() != LOCALBUFFER || src.deep() ||
+          ! src.localpixels() || src.local_tile_width() ||
+          src.spec().channelformats.size() ||
+          roi.nchannels() < 1 || ! src.contains_roi (roi))
+        return false;
+    impl()->reset_view (*src.impl(), roi);
+    return true;
+}
+
+
+
 bool
 ImageBuf::copy (const ImageBuf &src, TypeDesc format)
 {
@@ -1414,6 +2067,12 @@ ImageBuf::copy (const ImageBuf &src, TypeDesc format)
         impl()->m_deepdata = src.impl()->m_deepdata;
         return true;
     }
+    if ((format.basetype == TypeDesc::UNKNOWN || format == src.spec().format)
+          && src.storage() == LOCALBUFFER && storage() != APPBUFFER) {
+        // Same data type, so just share src's pixel memory, copy-on-write.
+        impl()->reset_shared (*src.impl());
+        return true;
+    }
     if (format.basetype == TypeDesc::UNKNOWN || src.deep())
         reset (src.name(), src.spec());
     else {
@@ -1685,13 +2344,40 @@ get_pixels_ (const ImageBuf &buf, ROI whole_roi, ROI roi, void *r_,
 
     D *r = (D *)r_;
     int nchans = roi.nchannels();
-    for (ImageBuf::ConstIterator<S,D> p (buf, roi); !p.done(); ++p) {
+    if (buf.deep()) {
+        for (ImageBuf::ConstIterator<S,D> p (buf, roi); !p.done(); ++p) {
+            imagesize_t offset = (p.z()-whole_roi.zbegin)*zstride
+                               + (p.y()-whole_roi.ybegin)*ystride
+                               + (p.x()-whole_roi.xbegin)*xstride;
+            D *rc = (D *)((char *)r + offset);
+            for (int c = 0;  c < nchans;  ++c)
+                rc[c] = p[c+roi.chbegin];
+        }
+        return true;
+    }
+
+    // Walk the pixels a contiguous span at a time, so that for a cached
+    // image the ImageCache is consulted once per tile row, not per pixel.
+    int srcnchans = buf.nchannels();
+    for (ImageBuf::ConstIterator<S,D> p (buf, roi); !p.done(); ) {
+        int n = p.span_length ();
         imagesize_t offset = (p.z()-whole_roi.zbegin)*zstride
                            + (p.y()-whole_roi.ybegin)*ystride
                            + (p.x()-whole_roi.xbegin)*xstride;
-        D *rc = (D *)((char *)r + offset);
-        for (int c = 0;  c < nchans;  ++c)
-            rc[c] = p[c+roi.chbegin];
+        char *rc = (char *)r + offset;
+        const S *sp = (const S *)p.rawptr() + roi.chbegin;
+        if (nchans == srcnchans && xstride == stride_t(nchans*sizeof(D)) &&
+            (is_same<S,D>::value || ! std::numeric_limits<D>::is_integer)) {
+            // All channels, contiguous output: convert the whole span
+            // with the array (SIMD) convert_type, which matches the
+            // per-value one for these type pairs.
+            convert_type<S,D> (sp, (D *)rc, size_t(n)*nchans);
+        } else {
+            for (int i = 0;  i < n;  ++i, rc += xstride, sp += srcnchans)
+                for (int c = 0;  c < nchans;  ++c)
+                    ((D *)rc)[c] = convert_type<S,D> (sp[c]);
+        }
+        p.span_advance (n);
     }
     return true;
 }
@@ -1717,6 +2403,93 @@ ImageBuf::get_pixels (ROI roi, TypeDesc format, void *result,
 
 
 
+// Convert the band of pixels in roi to the given format, single
+// threaded, into the contiguous result.
+static void
+get_band (const ImageBuf &buf, ROI roi, TypeDesc format, void *result,
+          int *ok)
+{
+    stride_t xstride = AutoStride, ystride = AutoStride, zstride = AutoStride;
+    ImageSpec::auto_stride (xstride, ystride, zstride, format.size(),
+                            roi.nchannels(), roi.width(), roi.height());
+    bool r;
+    OIIO_DISPATCH_TYPES2 (r, "write", get_pixels_, format, buf.spec().format,
+                          buf, roi, roi, result, xstride, ystride, zstride,
+                          1 /*nthreads*/);
+    *ok = r;
+}
+
+
+
+// Write buf to the tiled file a tile row at a time.  Up to a few rows
+// are being converted to the file's data type (by pool tasks, a row
+// each) while the oldest converted row is handed to write_tiles() in
+// the file's own format, so the plugin only has to compress it.
+static bool
+write_tile_rows (const ImageBuf &buf, ImageOutput *out,
+                 ProgressCallback progress_callback,
+                 void *progress_callback_data)
+{
+    const ImageSpec &outspec (out->spec());
+    TypeDesc format = outspec.format;
+    int tileh = outspec.tile_height;
+    int tiled = std::max (1, outspec.tile_depth);
+    int nyrows = (outspec.height + tileh - 1) / tileh;
+    int nrows = nyrows * ((outspec.depth + tiled - 1) / tiled);
+    imagesize_t rowbytes = imagesize_t(outspec.width) * tileh * tiled
+                         * format.size() * outspec.nchannels;
+
+    int nthreads = buf.threads();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    // Bands in flight: one being written, the rest being converted.
+    int nslots = std::min (clamp (nthreads, 1, 4), nrows);
+    std::vector<ROI> rows (nrows);
+    for (int r = 0;  r < nrows;  ++r) {
+        int z = (r / nyrows) * tiled + outspec.z;
+        int y = (r % nyrows) * tileh + outspec.y;
+        rows[r] = ROI (outspec.x, outspec.x + outspec.width,
+                       y, std::min (y + tileh, outspec.y + outspec.height),
+                       z, std::min (z + tiled, outspec.z + outspec.depth),
+                       0, outspec.nchannels);
+    }
+    boost::scoped_array<char> pixels (new char [rowbytes * nslots]);
+    boost::scoped_array<task_set> tasks (new task_set [nslots]);
+    std::vector<int> rowok (nslots, 1);
+    for (int r = 0;  r < nslots && nslots > 1;  ++r)
+        tasks[r].push (OIIO::bind (get_band, OIIO::cref(buf), rows[r],
+                                   format, &pixels[r*rowbytes], &rowok[r]));
+
+    bool ok = true;
+    for (int r = 0;  r < nrows;  ++r) {
+        int slot = r % nslots;
+        char *p = &pixels[slot*rowbytes];
+        if (nslots > 1)
+            tasks[slot].wait ();
+        else
+            get_band (buf, rows[r], format, p, &rowok[slot]);
+        ok &= (rowok[slot] != 0);
+        const ROI &row (rows[r]);
+        if (ok)
+            ok &= out->write_tiles (row.xbegin, row.xend, row.ybegin,
+                                    row.yend, row.zbegin, row.zend,
+                                    format, p);
+        if (! ok || (progress_callback &&
+                     progress_callback (progress_callback_data,
+                                        float(r+1) / nrows)))
+            break;
+        if (nslots > 1 && r + nslots < nrows)
+            tasks[slot].push (OIIO::bind (get_band, OIIO::cref(buf),
+                                          rows[r+nslots], format, p,
+                                          &rowok[slot]));
+    }
+    for (int s = 0;  s < nslots;  ++s)
+        tasks[s].wait ();
+    return ok;
+}
+
+
+
 // DEPRECATED
 template<typename D>
 bool
@@ -2164,11 +2937,7 @@ ImageBufImpl::pixeladdr (int x, int y, int z) const
     if (cachedpixels())
         return NULL;
     validate_pixels ();
-    x -= m_spec.x;
-    y -= m_spec.y;
-    z -= m_spec.z;
-    size_t p = y * m_scanline_bytes + x * m_pixel_bytes
-             + z * m_plane_bytes;
+    stride_t p = pixel_offset (x - m_spec.x, y - m_spec.y, z - m_spec.z);
     return &(m_localpixels[p]);
 }
 
@@ -2180,11 +2949,8 @@ ImageBufImpl::pixeladdr (int x, int y, int z)
     validate_pixels ();
     if (cachedpixels())
         return NULL;
-    x -= m_spec.x;
-    y -= m_spec.y;
-    z -= m_spec.z;
-    size_t p = y * m_scanline_bytes + x * m_pixel_bytes
-             + z * m_plane_bytes;
+    unshare_pixels ();
+    stride_t p = pixel_offset (x - m_spec.x, y - m_spec.y, z - m_spec.z);
     return &(m_localpixels[p]);
 }
 
@@ -2304,11 +3070,28 @@ ImageBufImpl::retile (int x, int y, int z, ImageCache::Tile* &tile,
                         y < tileybegin || y >= (tileybegin+th) ||
                         z < tilezbegin || z >= (tilezbegin+td)) {
         // not the same tile as before
-        if (tile)
-            m_imagecache->release_tile (tile);
         int xtile = (x-m_spec.x) / tw;
         int ytile = (y-m_spec.y) / th;
         int ztile = (z-m_spec.z) / td;
+        if (m_pinned_tiles.size()) {
+            // A pinned tile is found without asking the ImageCache.
+            int px = xtile - m_pinbegin[0], py = ytile - m_pinbegin[1];
+            int pz = ztile - m_pinbegin[2];
+            if (px >= 0 && px < m_pincount[0] && py >= 0 &&
+                py < m_pincount[1] && pz >= 0 && pz < m_pincount[2]) {
+                size_t p = (size_t(pz) * m_pincount[1] + py) * m_pincount[0] + px;
+                release_tile (tile);
+                tile = m_pinned_tiles[p];
+                tilexbegin = m_spec.x + xtile*tw;
+                tileybegin = m_spec.y + ytile*th;
+                tilezbegin = m_spec.z + ztile*td;
+                tilexend = tilexbegin + tw;
+                size_t offset = ((z - tilezbegin) * (size_t) th + (y - tileybegin)) * (size_t) tw
+                                + (x - tilexbegin);
+                return m_pinned_pixels[p] + offset * m_spec.pixel_bytes();
+            }
+        }
+        release_tile (tile);
         tilexbegin = m_spec.x + xtile*tw;
         tileybegin = m_spec.y + ytile*th;
         tilezbegin = m_spec.z + ztile*td;
@@ -2326,7 +3109,7 @@ ImageBufImpl::retile (int x, int y, int z, ImageCache::Tile* &tile,
     size_t offset = ((z - tilezbegin) * (size_t) th + (y - tileybegin)) * (size_t) tw
                     + (x - tilexbegin);
     offset *= m_spec.pixel_bytes();
-    DASSERTMSG (m_spec.pixel_bytes() == m_pixel_bytes,
+    DASSERTMSG ((stride_t)m_spec.pixel_bytes() == m_pixel_bytes,
                 "%d vs %d", (int)m_spec.pixel_bytes(), (int)m_pixel_bytes);
 
     TypeDesc format;
@@ -2336,6 +3119,105 @@ ImageBufImpl::retile (int x, int y, int z, ImageCache::Tile* &tile,
 
 
 
+void
+ImageBufImpl::release_tile (ImageCache::Tile *tile) const
+{
+    if (tile && ! (m_pinned_sorted.size() &&
+                   std::binary_search (m_pinned_sorted.begin(),
+                                       m_pinned_sorted.end(), tile)))
+        m_imagecache->release_tile (tile);
+}
+
+
+
+void
+ImageBuf::release_tile (ImageCache::Tile *tile) const
+{
+    impl()->release_tile (tile);
+}
+
+
+
+bool
+ImageBufImpl::pin_tiles (ROI roi)
+{
+    unpin_tiles ();
+    if (! validate_pixels() || ! cachedpixels() || m_spec.deep)
+        return true;   // Nothing to do for non-cached images
+    roi = roi.defined() ? roi_intersection (roi, get_roi(m_spec))
+                        : get_roi(m_spec);
+    if (roi.npixels() == 0)
+        return true;
+    int tw = m_spec.tile_width, th = m_spec.tile_height;
+    int td = std::max (1, m_spec.tile_depth);
+    int tilesize[3] = { tw, th, td };
+    int begin[3] = { roi.xbegin - m_spec.x, roi.ybegin - m_spec.y,
+                     roi.zbegin - m_spec.z };
+    int end[3] = { roi.xend - m_spec.x, roi.yend - m_spec.y,
+                   roi.zend - m_spec.z };
+    for (int i = 0;  i < 3;  ++i) {
+        m_pinbegin[i] = begin[i] / tilesize[i];
+        m_pincount[i] = (end[i] - 1) / tilesize[i] + 1 - m_pinbegin[i];
+    }
+    size_t ntiles = size_t(m_pincount[0]) * m_pincount[1] * m_pincount[2];
+    m_pinned_tiles.reserve (ntiles);
+    m_pinned_pixels.reserve (ntiles);
+    for (int tz = 0;  tz < m_pincount[2];  ++tz)
+        for (int ty = 0;  ty < m_pincount[1];  ++ty)
+            for (int tx = 0;  tx < m_pincount[0];  ++tx) {
+                int x = m_spec.x + (m_pinbegin[0] + tx) * tw;
+                int y = m_spec.y + (m_pinbegin[1] + ty) * th;
+                int z = m_spec.z + (m_pinbegin[2] + tz) * td;
+                ImageCache::Tile *tile = m_imagecache->get_tile (m_name,
+                                m_current_subimage, m_current_miplevel, x, y, z);
+                TypeDesc format;
+                const void *pixels = tile ? m_imagecache->tile_pixels (tile, format)
+                                          : NULL;
+                if (! pixels) {
+                    m_imagecache->release_tile (tile);
+                    std::string e = m_imagecache->geterror();
+                    error ("%s", e.size() ? e : "unspecified ImageCache error");
+                    unpin_tiles ();
+                    return false;
+                }
+                m_pinned_tiles.push_back (tile);
+                m_pinned_pixels.push_back ((const char *)pixels);
+            }
+    m_pinned_sorted = m_pinned_tiles;
+    std::sort (m_pinned_sorted.begin(), m_pinned_sorted.end());
+    return true;
+}
+
+
+
+void
+ImageBufImpl::unpin_tiles ()
+{
+    for (size_t i = 0, e = m_pinned_tiles.size();  i < e;  ++i)
+        m_imagecache->release_tile (m_pinned_tiles[i]);
+    m_pinned_tiles.clear ();
+    m_pinned_pixels.clear ();
+    m_pinned_sorted.clear ();
+}
+
+
+
+bool
+ImageBuf::pin_tiles (ROI roi)
+{
+    return impl()->pin_tiles (roi);
+}
+
+
+
+void
+ImageBuf::unpin_tiles ()
+{
+    impl()->unpin_tiles ();
+}
+
+
+
 const void *
 ImageBuf::retile (int x, int y, int z, ImageCache::Tile* &tile,
                   int &tilexbegin, int &tileybegin, int &tilezbegin,
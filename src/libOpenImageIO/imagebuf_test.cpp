@@ -29,9 +29,14 @@
 */
 
 
+#include <OpenEXR/half.h>
+
 #include <OpenImageIO/imageio.h>
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
+#include <OpenImageIO/imagesequence.h>
+#include <OpenImageIO/deepdata.h>
+#include <OpenImageIO/filesystem.h>
 #include <OpenImageIO/unittest.h>
 
 #include <iostream>
@@ -213,6 +218,53 @@ void ImageBuf_test_appbuffer ()
 
 
 
+// Tests ImageBuf wrapping an application buffer with its own strides:
+// RGB pixels interleaved with a fourth value we don't use, and padded
+// rows stored bottom-up.
+void
+test_appbuffer_strided ()
+{
+    std::cout << "test appbuffer strided\n";
+    const int WIDTH = 5, HEIGHT = 4, ROWVALS = 4*WIDTH + 3;
+    float buf[HEIGHT*ROWVALS];
+    for (int i = 0;  i < HEIGHT*ROWVALS;  ++i)
+        buf[i] = -1.0f;
+    for (int y = 0;  y < HEIGHT;  ++y)
+        for (int x = 0;  x < WIDTH;  ++x)
+            for (int c = 0;  c < 3;  ++c)
+                buf[(HEIGHT-1-y)*ROWVALS + 4*x + c] = float (10*y + x + c);
+    ImageSpec spec (WIDTH, HEIGHT, 3, TypeDesc::FLOAT);
+    ImageBuf A (spec, buf + (HEIGHT-1)*ROWVALS, 4*sizeof(float),
+                -stride_t(ROWVALS*sizeof(float)));
+    OIIO_CHECK_ASSERT (! A.contiguous ());
+    OIIO_CHECK_EQUAL (A.pixel_stride(), stride_t(4*sizeof(float)));
+    OIIO_CHECK_EQUAL (A.getchannel (3, 2, 0, 1), 24.0f);
+    bool ok = true;
+    for (ImageBuf::ConstIterator<float> a (A);  ! a.done();  ++a)
+        for (int c = 0;  c < 3;  ++c)
+            ok &= (a[c] == float (10*a.y() + a.x() + c));
+    OIIO_CHECK_ASSERT (ok);
+
+    // Operate in place; the padding must be left untouched
+    ImageBufAlgo::add (A, A, 1.0f);
+    OIIO_CHECK_EQUAL (buf[(HEIGHT-1-2)*ROWVALS + 4*3 + 1], 25.0f);
+    for (int y = 0;  y < HEIGHT;  ++y) {
+        for (int x = 0;  x < WIDTH;  ++x)
+            OIIO_CHECK_EQUAL (buf[y*ROWVALS + 4*x + 3], -1.0f);
+        OIIO_CHECK_EQUAL (buf[y*ROWVALS + ROWVALS-1], -1.0f);
+    }
+
+    // Copying out gives an ordinary contiguous image
+    ImageBuf B;
+    B.copy (A);
+    OIIO_CHECK_ASSERT (B.contiguous ());
+    ImageBufAlgo::CompareResults cr;
+    ImageBufAlgo::compare (A, B, 0.0f, 0.0f, cr);
+    OIIO_CHECK_EQUAL (cr.nfail, 0);
+}
+
+
+
 // Tests histogram computation.
 void histogram_computation_test ()
 {
@@ -325,6 +377,788 @@ test_set_get_pixels ()
 
 
 
+void
+test_sequence_reader ()
+{
+    std::cout << "\nTesting ImageSequenceReader:\n";
+    // Write a short sequence whose pixels hold the frame number.
+    const int nframes = 6;
+    for (int f = 1;  f <= nframes;  ++f) {
+        ImageBuf A (ImageSpec (8, 8, 1, TypeDesc::FLOAT));
+        float val = float(f);
+        ImageBufAlgo::fill (A, &val);
+        A.write (Strutil::format ("seq.%04d.exr", f));
+    }
+
+    ImageSequenceReader seq;
+    OIIO_CHECK_ASSERT (seq.open ("seq.1-6#.exr", "", 2));
+    OIIO_CHECK_EQUAL (seq.nframes(), nframes);
+    OIIO_CHECK_EQUAL (seq.frame_number (0), 1);
+    OIIO_CHECK_EQUAL (seq.filename (5), "seq.0006.exr");
+    ImageBuf frame;
+    int n = 0;
+    while (seq.next (frame)) {
+        OIIO_CHECK_EQUAL (frame.getchannel (3, 3, 0, 0), float(n+1));
+        ++n;
+    }
+    OIIO_CHECK_EQUAL (n, nframes);
+    OIIO_CHECK_EQUAL (seq.current(), nframes);
+
+    // Random access, and a frame range overriding the pattern's.
+    OIIO_CHECK_ASSERT (seq.seek (1));
+    OIIO_CHECK_ASSERT (seq.next (frame));
+    OIIO_CHECK_EQUAL (frame.getchannel (0, 0, 0, 0), 2.0f);
+    OIIO_CHECK_ASSERT (! seq.seek (nframes));
+    seq.geterror ();
+    OIIO_CHECK_ASSERT (seq.open ("seq.#.exr", "2-6x2", 4, TypeDesc::UINT16));
+    OIIO_CHECK_EQUAL (seq.nframes(), 3);
+    seq.cancel ();
+    OIIO_CHECK_ASSERT (seq.seek (2));
+    OIIO_CHECK_ASSERT (seq.next (frame));
+    OIIO_CHECK_EQUAL (frame.spec().format, TypeDesc::UINT16);
+    OIIO_CHECK_EQUAL (seq.frame_number (2), 6);
+
+    // A missing frame is reported, and the sequence carries on.
+    Filesystem::remove ("seq.0003.exr");
+    OIIO_CHECK_ASSERT (seq.open ("seq.1-6#.exr", "", 3));
+    n = 0;
+    int failures = 0;
+    while (seq.current() < seq.nframes()) {
+        if (seq.next (frame))
+            ++n;
+        else
+            ++failures;
+    }
+    OIIO_CHECK_EQUAL (n, nframes-1);
+    OIIO_CHECK_EQUAL (failures, 1);
+    OIIO_CHECK_ASSERT (seq.geterror().size());
+    seq.close ();
+
+    for (int f = 1;  f <= nframes;  ++f)
+        Filesystem::remove (Strutil::format ("seq.%04d.exr", f));
+}
+
+
+
+// Tests span iteration over both local and ImageCache-backed images.
+void
+test_span_iterator ()
+{
+    std::cout << "\nTesting span iteration\n";
+    const int W = 37, H = 21, TW = 16;
+    ImageSpec spec (W, H, 3, TypeDesc::FLOAT);
+    ImageBuf A (spec);
+    for (ImageBuf::Iterator<float> p (A);  ! p.done();  ++p)
+        for (int c = 0;  c < 3;  ++c)
+            p[c] = p.x() + 100.0f * p.y() + 0.25f * c;
+    A.set_write_tiles (TW, TW);
+    A.write ("span.tif");
+
+    ImageCache *ic = ImageCache::create (false);
+    ImageBuf cached ("span.tif", ic);
+    cached.read (0, 0);
+    OIIO_CHECK_ASSERT (cached.localpixels() == NULL);
+    ROI roi (3, 30, 2, 19);
+    ImageBuf *bufs[2] = { &A, &cached };
+    for (int b = 0;  b < 2;  ++b) {
+        int npixels = 0, nspans = 0;
+        for (ImageBuf::ConstIterator<float> s (*bufs[b], roi);  ! s.done(); ) {
+            int n = s.span_length ();
+            OIIO_CHECK_ASSERT (n >= 1 && s.x() + n <= roi.xend);
+            const float *p = (const float *) s.rawptr ();
+            for (int i = 0;  i < n;  ++i, p += 3)
+                OIIO_CHECK_EQUAL (p[2], s.x() + i + 100.0f * s.y() + 0.5f);
+            if (b == 1)  // no span crosses a tile boundary
+                OIIO_CHECK_EQUAL (s.x() / TW, (s.x() + n - 1) / TW);
+            npixels += n;
+            ++nspans;
+            s.span_advance (n);
+        }
+        OIIO_CHECK_EQUAL (npixels, (int) roi.npixels());
+        // One span per row in memory, one per tile row when cached
+        OIIO_CHECK_EQUAL (nspans, b == 0 ? roi.height() : 2 * roi.height());
+    }
+
+    // Cached get_pixels gives the same answer as local.
+    std::vector<float> local (roi.npixels() * 3), fromcache (roi.npixels() * 3);
+    A.get_pixels (roi, TypeDesc::FLOAT, &local[0]);
+    cached.get_pixels (roi, TypeDesc::FLOAT, &fromcache[0]);
+    OIIO_CHECK_ASSERT (local == fromcache);
+    ic->destroy (ic);
+    Filesystem::remove ("span.tif");
+}
+
+
+
+void
+test_pinned_tiles ()
+{
+    std::cout << "\nTesting pinned cache tiles\n";
+    const int W = 37, H = 21, TW = 16;
+    ImageBuf A (ImageSpec (W, H, 3, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> p (A);  ! p.done();  ++p)
+        for (int c = 0;  c < 3;  ++c)
+            p[c] = p.x() + 100.0f * p.y() + 0.25f * c;
+    A.set_write_tiles (TW, TW);
+    A.write ("pinned.tif");
+
+    ImageCache *ic = ImageCache::create (false);
+    ImageBuf cached ("pinned.tif", ic);
+    // Pin only part of the image, so reads mix pinned and unpinned tiles.
+    OIIO_CHECK_ASSERT (cached.pin_tiles (ROI (0, 20, 0, 10)));
+    OIIO_CHECK_ASSERT (cached.localpixels() == NULL);
+    for (int pass = 0;  pass < 2;  ++pass) {
+        std::vector<float> local (W*H*3), fromcache (W*H*3);
+        A.get_pixels (A.roi(), TypeDesc::FLOAT, &local[0]);
+        cached.get_pixels (A.roi(), TypeDesc::FLOAT, &fromcache[0]);
+        OIIO_CHECK_ASSERT (local == fromcache);
+        ImageBufAlgo::CompareResults cr;
+        ImageBufAlgo::compare (A, cached, 0.0f, 0.0f, cr);
+        OIIO_CHECK_EQUAL (cr.nfail, 0);
+        cached.unpin_tiles ();
+        OIIO_CHECK_ASSERT (cached.pin_tiles ());
+    }
+    cached.clear ();
+    ic->destroy (ic);
+    Filesystem::remove ("pinned.tif");
+}
+
+
+
+// Copies share local pixels until one of them is written.
+void
+test_copy_on_write ()
+{
+    std::cout << "\nTesting copy-on-write ImageBuf pixels\n";
+    ImageBuf A (ImageSpec (64, 48, 3, TypeDesc::FLOAT));
+    float gray[3] = { 0.5f, 0.5f, 0.5f };
+    ImageBufAlgo::fill (A, gray);
+    const ImageBuf &Aconst (A);
+
+    ImageBuf B (A);
+    const ImageBuf &Bconst (B);
+    OIIO_CHECK_ASSERT (Bconst.localpixels() == Aconst.localpixels());
+    float one[3] = { 1.0f, 1.0f, 1.0f };
+    B.setpixel (3, 4, one);
+    OIIO_CHECK_ASSERT (Bconst.localpixels() != Aconst.localpixels());
+    OIIO_CHECK_EQUAL (B.getchannel (3, 4, 0, 1), 1.0f);
+    OIIO_CHECK_EQUAL (A.getchannel (3, 4, 0, 1), 0.5f);
+
+    ImageBuf C;
+    C.copy (A);
+    const ImageBuf &Cconst (C);
+    OIIO_CHECK_ASSERT (Cconst.localpixels() == Aconst.localpixels());
+    ImageBufAlgo::add (C, C, 0.25f);
+    OIIO_CHECK_ASSERT (Cconst.localpixels() != Aconst.localpixels());
+    OIIO_CHECK_EQUAL (C.getchannel (10, 10, 0, 2), 0.75f);
+    OIIO_CHECK_EQUAL (A.getchannel (10, 10, 0, 2), 0.5f);
+
+    // Once the copy is gone, writing A needs no copy
+    {
+        ImageBuf D (A);
+    }
+    const void *Apixels = Aconst.localpixels();
+    A.setpixel (0, 0, one);
+    OIIO_CHECK_ASSERT (Aconst.localpixels() == Apixels);
+
+#if OIIO_CPLUSPLUS_VERSION >= 11
+    ImageBuf E (std::move (A));
+    OIIO_CHECK_ASSERT (! A.initialized());
+    OIIO_CHECK_ASSERT (E.localpixels() == Apixels);
+    A = std::move (E);
+    OIIO_CHECK_ASSERT (! E.initialized());
+    OIIO_CHECK_EQUAL (A.getchannel (0, 0, 0, 0), 1.0f);
+#endif
+}
+
+
+
+// Views refer to a region and channel range of their parent's pixels
+// until one of them is written.
+void
+test_views ()
+{
+    std::cout << "\nTesting ImageBuf views\n";
+    ImageSpec spec (32, 24, 5, TypeDesc::FLOAT);
+    spec.channelnames[3] = "A";
+    spec.alpha_channel = 3;
+    ImageBuf A (spec);
+    for (ImageBuf::Iterator<float> p (A);  ! p.done();  ++p)
+        for (int c = 0;  c < 5;  ++c)
+            p[c] = p.x() + 100.0f * p.y() + 0.25f * c;
+    const ImageBuf &Aconst (A);
+
+    // Channels 2..3 of the region [4,20) x [8,16)
+    ImageBuf V;
+    OIIO_CHECK_ASSERT (V.make_view (A, ROI (4, 20, 8, 16, 0, 1, 2, 4)));
+    const ImageBuf &Vconst (V);
+    OIIO_CHECK_EQUAL (V.nchannels(), 2);
+    OIIO_CHECK_EQUAL (V.spec().alpha_channel, 1);
+    OIIO_CHECK_EQUAL (V.spec().channelnames[1], "A");
+    OIIO_CHECK_EQUAL (V.roi(), ROI (4, 20, 8, 16, 0, 1, 0, 2));
+    OIIO_CHECK_ASSERT (Vconst.pixeladdr (4, 8) == (const char *)Aconst.pixeladdr (4, 8) + 2*sizeof(float));
+    OIIO_CHECK_EQUAL (V.getchannel (5, 9, 0, 1), 905.75f);
+    ImageBufAlgo::PixelStats stats;
+    ImageBufAlgo::computePixelStats (stats, V);
+    OIIO_CHECK_EQUAL (stats.min[0], 804.5f);
+    OIIO_CHECK_EQUAL (stats.max[0], 1519.5f);
+
+    // Writing the view gives it its own pixels, and leaves A alone
+    float one[2] = { 1.0f, 1.0f };
+    V.setpixel (5, 9, one);
+    OIIO_CHECK_ASSERT (Vconst.contiguous ());
+    OIIO_CHECK_EQUAL (V.getchannel (5, 9, 0, 1), 1.0f);
+    OIIO_CHECK_EQUAL (V.getchannel (6, 9, 0, 1), 906.75f);
+    OIIO_CHECK_EQUAL (A.getchannel (5, 9, 0, 3), 905.75f);
+
+    // Writing the parent leaves its views alone
+    ImageBuf W;
+    OIIO_CHECK_ASSERT (W.make_view (A, ROI (0, 8, 0, 8)));
+    OIIO_CHECK_EQUAL (W.nchannels(), 5);
+    ImageBufAlgo::zero (A);
+    OIIO_CHECK_EQUAL (W.getchannel (7, 7, 0, 4), 708.0f);
+    OIIO_CHECK_EQUAL (A.getchannel (7, 7, 0, 4), 0.0f);
+
+    // A view must lie within the parent's pixels
+    OIIO_CHECK_ASSERT (! W.make_view (A, ROI (-1, 8, 0, 8)));
+
+    // IBA crop and channels of local images give views
+    ImageBuf C;
+    ImageBufAlgo::crop (C, W, ROI (2, 6, 2, 6));
+    OIIO_CHECK_ASSERT (! C.contiguous ());
+    OIIO_CHECK_EQUAL (C.getchannel (3, 4, 0, 1), 403.25f);
+    int chans[2] = { 1, 2 };
+    ImageBufAlgo::channels (C, W, 2, chans);
+    OIIO_CHECK_ASSERT (! C.contiguous ());
+    OIIO_CHECK_EQUAL (C.getchannel (3, 4, 0, 1), 403.5f);
+}
+
+
+
+// Local pixels stored in blocks rather than scanlines.
+void
+test_local_tiles ()
+{
+    std::cout << "\nTesting blocked local pixel layout\n";
+    const int W = 37, H = 21, BW = 16, BH = 8;
+    ImageSpec spec (W, H, 3, TypeDesc::FLOAT);
+    spec.x = 5;  spec.y = -3;
+    ImageBuf A (spec);
+    for (ImageBuf::Iterator<float> p (A);  ! p.done();  ++p)
+        for (int c = 0;  c < 3;  ++c)
+            p[c] = p.x() + 100.0f * p.y() + 0.25f * c;
+    ImageBuf B (A);
+    OIIO_CHECK_ASSERT (! B.set_local_tiles (12, 8));   // not a power of 2
+    OIIO_CHECK_ASSERT (B.set_local_tiles (BW, BH));
+    OIIO_CHECK_EQUAL (B.local_tile_width(), BW);
+    OIIO_CHECK_EQUAL (B.local_tile_height(), BH);
+    OIIO_CHECK_ASSERT (! B.contiguous ());
+    OIIO_CHECK_EQUAL (A.local_tile_width(), 0);   // A keeps its pixels
+    OIIO_CHECK_EQUAL (B.getchannel (5+20, -3+9, 0, 2), 20 + 5 + 100.0f * 6 + 0.5f);
+
+    // Spans stop at the end of each block row
+    ROI roi (7, 40, -2, 15);
+    int npixels = 0;
+    for (ImageBuf::ConstIterator<float> s (B, roi);  ! s.done(); ) {
+        int n = s.span_length ();
+        OIIO_CHECK_EQUAL ((s.x() - spec.x) / BW, (s.x() - spec.x + n - 1) / BW);
+        const float *p = (const float *) s.rawptr ();
+        for (int i = 0;  i < n;  ++i, p += 3)
+            OIIO_CHECK_EQUAL (p[1], s.x() + i + 100.0f * s.y() + 0.25f);
+        npixels += n;
+        s.span_advance (n);
+    }
+    OIIO_CHECK_EQUAL (npixels, (int) roi.npixels());
+
+    // IBA results don't depend on the layout
+    ImageBuf Asum, Bsum, Bsum2;
+    ImageBufAlgo::add (Asum, A, A);
+    ImageBufAlgo::add (Bsum, B, B);
+    Bsum2.copy (B);
+    ImageBufAlgo::add (Bsum2, Bsum2, B);
+    OIIO_CHECK_EQUAL (Bsum2.local_tile_width(), BW);
+    ImageBufAlgo::CompareResults cr;
+    ImageBufAlgo::compare (Asum, Bsum, 0.0f, 0.0f, cr);
+    OIIO_CHECK_EQUAL (cr.nfail, 0);
+    ImageBufAlgo::compare (Asum, Bsum2, 0.0f, 0.0f, cr);
+    OIIO_CHECK_EQUAL (cr.nfail, 0);
+
+    // Written straight to matching file tiles, and read back blocked
+    B.set_write_tiles (BW, BH);
+    B.write ("blocked.exr");
+    ImageBuf R ("blocked.exr");
+    OIIO_CHECK_ASSERT (R.set_local_tiles (BW, BH));
+    R.read (0, 0, true);
+    OIIO_CHECK_EQUAL (R.local_tile_width(), BW);
+    ImageBufAlgo::compare (A, R, 0.0f, 0.0f, cr);
+    OIIO_CHECK_EQUAL (cr.nfail, 0);
+    Filesystem::remove ("blocked.exr");
+
+    // Back to scanlines: the same bytes as the original
+    OIIO_CHECK_ASSERT (B.set_local_tiles (0));
+    OIIO_CHECK_ASSERT (B.contiguous ());
+    const ImageBuf &Aconst (A), &Bconst (B);
+    OIIO_CHECK_ASSERT (memcmp (Aconst.localpixels(), Bconst.localpixels(),
+                               spec.image_bytes()) == 0);
+}
+
+
+
+// Reading big scanline files a band at a time in parallel gives the
+// same pixels as reading them serially.
+void
+test_parallel_read ()
+{
+    std::cout << "\nTesting parallel banded read\n";
+    const int W = 1024, H = 517;
+    ImageSpec spec (W, H, 3, TypeDesc::FLOAT);
+    spec.y = 10;
+    ImageBuf A (spec);
+    for (ImageBuf::Iterator<float> p (A);  ! p.done();  ++p)
+        for (int c = 0;  c < 3;  ++c)
+            p[c] = p.x() + 1000.0f * p.y() + 0.25f * c;
+    const char *files[2] = { "banded.exr", "banded.tif" };
+    for (int f = 0;  f < 2;  ++f) {
+        A.write (files[f]);
+        ImageBuf B (files[f]);
+        B.threads (4);
+        OIIO_CHECK_ASSERT (B.read (0, 0, true, TypeDesc::HALF));
+        OIIO::attribute ("imagebuf:parallel_read", 0);
+        ImageBuf S (files[f]);
+        OIIO_CHECK_ASSERT (S.read (0, 0, true, TypeDesc::HALF));
+        OIIO::attribute ("imagebuf:parallel_read", 1);
+        OIIO_CHECK_EQUAL (B.spec().format, TypeDesc::HALF);
+        OIIO_CHECK_EQUAL (B.roi(), A.roi());
+        const ImageBuf &Bconst (B), &Sconst (S);
+        OIIO_CHECK_ASSERT (memcmp (Bconst.localpixels(), Sconst.localpixels(),
+                                   B.spec().image_bytes()) == 0);
+        Filesystem::remove (files[f]);
+    }
+}
+
+
+
+// Writing a tiled file in another data type, from local pixels or from
+// the ImageCache, streams converted tile rows to the file and gives the
+// same pixels as converting the whole image first.
+void
+test_streamed_tiled_write ()
+{
+    std::cout << "\nTesting streamed tiled write\n";
+    const int W = 300, H = 333;
+    ImageSpec spec (W, H, 3, TypeDesc::FLOAT);
+    spec.x = 5;
+    ImageBuf A (spec);
+    for (ImageBuf::Iterator<float> p (A);  ! p.done();  ++p)
+        for (int c = 0;  c < 3;  ++c)
+            p[c] = p.x() / 8.0f + p.y() / 1024.0f + 0.25f * c;
+    ImageBuf Ahalf;
+    Ahalf.copy (A, TypeDesc::HALF);
+
+    A.threads (4);
+    A.set_write_format (TypeDesc::HALF);
+    A.set_write_tiles (64, 32);
+    OIIO_CHECK_ASSERT (A.write ("streamed.exr"));
+    // Write again from the cache-backed copy of that file
+    ImageBuf C ("streamed.exr");
+    C.set_write_format (TypeDesc::FLOAT);
+    C.set_write_tiles (32, 64);
+    OIIO_CHECK_ASSERT (C.write ("streamed2.exr"));
+
+    const char *files[2] = { "streamed.exr", "streamed2.exr" };
+    for (int f = 0;  f < 2;  ++f) {
+        ImageBuf B (files[f]);
+        OIIO_CHECK_ASSERT (B.read (0, 0, true, TypeDesc::HALF));
+        OIIO_CHECK_EQUAL (B.spec().tile_width, f ? 32 : 64);
+        OIIO_CHECK_EQUAL (B.roi(), A.roi());
+        const ImageBuf &Bconst (B), &Aconst (Ahalf);
+        OIIO_CHECK_ASSERT (memcmp (Bconst.localpixels(), Aconst.localpixels(),
+                                   B.spec().image_bytes()) == 0);
+    }
+    Filesystem::remove ("streamed.exr");
+    Filesystem::remove ("streamed2.exr");
+}
+
+
+
+// Local pixel allocation policy: alignment, huge pages, first touch.
+void
+test_alloc_policy ()
+{
+    std::cout << "\nTesting ImageBuf allocation policy\n";
+    ImageBuf small (ImageSpec (3, 5, 3, TypeDesc::UINT8));
+    OIIO_CHECK_EQUAL ((size_t)small.localpixels() % 64, 0);
+
+    OIIO::attribute ("imagebuf:hugepages", 1);
+    OIIO::attribute ("imagebuf:parallel_first_touch", 1);
+    ImageBuf big (ImageSpec (1024, 1000, 4, TypeDesc::FLOAT));
+    OIIO_CHECK_EQUAL ((size_t)big.localpixels() % (2*1024*1024), 0);
+    ImageBufAlgo::PixelStats stats;
+    ImageBufAlgo::computePixelStats (stats, big);
+    for (int c = 0;  c < 4;  ++c) {
+        OIIO_CHECK_EQUAL (stats.min[c], 0.0f);
+        OIIO_CHECK_EQUAL (stats.max[c], 0.0f);
+    }
+    // Copy-on-write copies use the same policy
+    ImageBuf bigcopy (big);
+    float one[4] = { 1, 1, 1, 1 };
+    bigcopy.setpixel (0, 0, one);
+    OIIO_CHECK_EQUAL ((size_t)bigcopy.localpixels() % (2*1024*1024), 0);
+    OIIO::attribute ("imagebuf:hugepages", 0);
+    OIIO::attribute ("imagebuf:parallel_first_touch", 0);
+}
+
+
+
+// Check the direct and strided paths of convert_image against
+// per-value convert_type.
+void
+test_convert_image ()
+{
+    std::cout << "\nTesting convert_image:\n";
+    std::vector<unsigned short> u16 (65536);
+    for (int i = 0;  i < 65536;  ++i)
+        u16[i] = (unsigned short) i;
+    std::vector<unsigned char> u8 (65536);
+    convert_types (TypeDesc::UINT16, &u16[0], TypeDesc::UINT8, &u8[0], 65536);
+    int bad = 0;
+    for (int i = 0;  i < 65536;  ++i)
+        bad += (u8[i] != convert_type<unsigned short,unsigned char>(u16[i]));
+    std::vector<unsigned short> back (256);
+    convert_types (TypeDesc::UINT8, &u8[0], TypeDesc::UINT16, &back[0], 256);
+    for (int i = 0;  i < 256;  ++i)
+        bad += (back[i] != convert_type<unsigned char,unsigned short>(u8[i]));
+    OIIO_CHECK_EQUAL (bad, 0);
+
+    // 3 of 4 channels of a half image into an RGB float buffer with a
+    // padded pixel stride.
+    const int w = 7, h = 3;
+    std::vector<half> src (w*h*4);
+    for (size_t i = 0;  i < src.size();  ++i)
+        src[i] = float(i) / 8.0f;
+    std::vector<float> dst (w*h*5, -1.0f);
+    convert_image (3, w, h, 1, &src[0], TypeDesc::HALF, 4*sizeof(half),
+                   AutoStride, AutoStride, &dst[0], TypeDesc::FLOAT,
+                   5*sizeof(float), AutoStride, AutoStride);
+    bad = 0;
+    for (int p = 0;  p < w*h;  ++p) {
+        for (int c = 0;  c < 3;  ++c)
+            bad += (dst[5*p+c] != float(src[4*(p%w) + 4*w*(p/w) + c]));
+        bad += (dst[5*p+3] != -1.0f) + (dst[5*p+4] != -1.0f);
+    }
+    OIIO_CHECK_EQUAL (bad, 0);
+}
+
+
+
+// Deep samples are stored per scanline; make sure inserting into one
+// scanline leaves the others alone, and that a threaded deep_merge
+// (whose threads each own separate scanlines) gives the right answer.
+void
+test_deep_scanline_storage ()
+{
+    std::cout << "\nTesting deep scanline storage\n";
+    ImageSpec spec (64, 32, 3, TypeDesc::FLOAT);
+    spec.channelnames.clear ();
+    spec.channelnames.push_back ("R");
+    spec.channelnames.push_back ("A");
+    spec.channelnames.push_back ("Z");
+    spec.z_channel = 2;
+    spec.deep = true;
+    ImageBuf A (spec), B (spec);
+    for (int y = 0;  y < spec.height;  ++y)
+        for (int x = 0;  x < spec.width;  ++x) {
+            A.set_deep_samples (x, y, 0, 1);
+            B.set_deep_samples (x, y, 0, 1);
+        }
+    for (int y = 0;  y < spec.height;  ++y)
+        for (int x = 0;  x < spec.width;  ++x) {
+            A.set_deep_value (x, y, 0, 0, 0, float(x + 100*y));
+            A.set_deep_value (x, y, 0, 1, 0, 0.5f);
+            A.set_deep_value (x, y, 0, 2, 0, 1.0f);
+            B.set_deep_value (x, y, 0, 0, 0, float(-x - 100*y));
+            B.set_deep_value (x, y, 0, 1, 0, 0.5f);
+            B.set_deep_value (x, y, 0, 2, 0, 2.0f);
+        }
+
+    ImageBuf M;
+    OIIO_CHECK_ASSERT (ImageBufAlgo::deep_merge (M, B, A, false, ROI(), 4));
+    int bad = 0;
+    for (int y = 0;  y < spec.height;  ++y)
+        for (int x = 0;  x < spec.width;  ++x)
+            if (M.deep_samples (x, y, 0) != 2 ||
+                M.deep_value (x, y, 0, 2, 0) != 1.0f ||
+                M.deep_value (x, y, 0, 0, 0) != float(x + 100*y) ||
+                M.deep_value (x, y, 0, 0, 1) != float(-x - 100*y))
+                ++bad;
+    OIIO_CHECK_EQUAL (bad, 0);
+
+    // Growing one pixel doesn't disturb its neighbors or other scanlines
+    A.deep_insert_samples (5, 3, 0, 0, 3);
+    OIIO_CHECK_EQUAL (A.deep_samples (5, 3, 0), 4);
+    OIIO_CHECK_EQUAL (A.deep_value (5, 3, 0, 0, 3), 305.0f);
+    OIIO_CHECK_EQUAL (A.deep_value (6, 3, 0, 0, 0), 306.0f);
+    OIIO_CHECK_EQUAL (A.deep_value (5, 4, 0, 0, 0), 405.0f);
+    const DeepData &dd (*A.deepdata());
+    OIIO_CHECK_EQUAL (dd.all_data().size(),
+                      (spec.image_pixels() + 3) * dd.samplesize());
+}
+
+
+
+// Deep images keep each channel's own type through deepen and
+// deep_merge, and the whole-pixel accessors convert correctly.
+void
+test_deep_types ()
+{
+    std::cout << "\nTesting deep channel types\n";
+    ImageSpec spec (16, 8, 4, TypeDesc::HALF);
+    ImageBuf flat (spec);
+    float red[4] = { 0.5f, 0.25f, 0.125f, 1.0f };
+    ImageBufAlgo::fill (flat, red);
+    ImageBuf D;
+    OIIO_CHECK_ASSERT (ImageBufAlgo::deepen (D, flat, 42.0f));
+    const DeepData &dd (*D.deepdata());
+    OIIO_CHECK_EQUAL (dd.channels(), 5);
+    for (int c = 0;  c < 4;  ++c)
+        OIIO_CHECK_EQUAL (dd.channeltype(c), TypeDesc::HALF);
+    OIIO_CHECK_EQUAL (dd.channeltype(4), TypeDesc::FLOAT);
+    OIIO_CHECK_EQUAL (dd.samplesize(), 4*2 + 4);
+    OIIO_CHECK_EQUAL (D.deep_value (3, 2, 0, 1, 0), 0.25f);
+    OIIO_CHECK_EQUAL (D.deep_value (3, 2, 0, 4, 0), 42.0f);
+    OIIO_CHECK_ASSERT (dd.memsize() >= spec.image_pixels() * dd.samplesize());
+
+    ImageBuf M;
+    OIIO_CHECK_ASSERT (ImageBufAlgo::deep_merge (M, D, D));
+    const DeepData &md (*M.deepdata());
+    OIIO_CHECK_EQUAL (md.channeltype(0), TypeDesc::HALF);
+    OIIO_CHECK_EQUAL (md.channeltype(4), TypeDesc::FLOAT);
+
+    // Whole-pixel access, for mixed and for uniform types
+    DeepData &mixed (*M.deepdata());
+    int p = M.pixelindex (1, 1, 0, true);
+    int n = mixed.samples (p);
+    OIIO_CHECK_ASSERT (n >= 1);
+    std::vector<float> vals (n * 5);
+    mixed.get_pixel_values (p, &vals[0]);
+    OIIO_CHECK_EQUAL (vals[2], 0.125f);
+    OIIO_CHECK_EQUAL (vals[4], 42.0f);
+    for (size_t i = 0;  i < vals.size();  ++i)
+        vals[i] = 0.5f * float(i);
+    mixed.set_pixel_values (p, &vals[0]);
+    OIIO_CHECK_EQUAL (mixed.deep_value (p, 3, 0), 1.5f);
+    OIIO_CHECK_EQUAL (mixed.deep_value (p, 4, n-1), 0.5f * float(n*5-1));
+
+    DeepData uniform;
+    uniform.init (4, 3, TypeDesc(TypeDesc::HALF), spec.channelnames);
+    uniform.set_samples (2, 2);
+    float in[6] = { 1, 2, 3, 4, 5, 6 }, out[6];
+    uniform.set_pixel_values (2, in);
+    uniform.get_pixel_values (2, out);
+    for (int i = 0;  i < 6;  ++i)
+        OIIO_CHECK_EQUAL (out[i], in[i]);
+}
+
+
+
+// Deep files read in parallel bands give the same samples as a serial
+// read, and a channel range reads just those channels.
+void
+test_deep_read ()
+{
+    std::cout << "\nTesting deep file reads\n";
+    ImageSpec spec (300, 517, 3, TypeDesc::FLOAT);
+    spec.channelnames.clear ();
+    spec.channelnames.push_back ("R");
+    spec.channelnames.push_back ("A");
+    spec.channelnames.push_back ("Z");
+    spec.alpha_channel = 1;
+    spec.z_channel = 2;
+    spec.deep = true;
+    ImageBuf A (spec);
+    for (int y = 0;  y < spec.height;  ++y)
+        for (int x = 0;  x < spec.width;  ++x)
+            A.set_deep_samples (x, y, 0, (x + y) % 3);
+    for (int y = 0;  y < spec.height;  ++y)
+        for (int x = 0;  x < spec.width;  ++x)
+            for (int s = 0;  s < (x + y) % 3;  ++s)
+                for (int c = 0;  c < 3;  ++c)
+                    A.set_deep_value (x, y, 0, c, s, float(x + 1000*y + s + 0.25f*c));
+    OIIO_CHECK_ASSERT (A.write ("deepread.exr"));
+
+    ImageInput *in = ImageInput::open ("deepread.exr");
+    OIIO_CHECK_ASSERT (in != NULL);
+    if (! in)
+        return;
+    DeepData banded, serial, az;
+    in->threads (4);
+    OIIO_CHECK_ASSERT (in->read_native_deep_image (banded));
+    in->threads (1);
+    OIIO_CHECK_ASSERT (in->read_native_deep_image (serial));
+    OIIO_CHECK_ASSERT (in->read_native_deep_image (1, 3, az));
+    in->close ();
+    delete in;
+
+    OIIO_CHECK_EQUAL (az.channels(), 2);
+    OIIO_CHECK_EQUAL (az.channelname(0), "A");
+    OIIO_CHECK_EQUAL (az.channelname(1), "Z");
+    int bad = 0;
+    for (int p = 0;  p < int(spec.image_pixels());  ++p) {
+        int x = p % spec.width, y = p / spec.width;
+        if (banded.samples(p) != (x + y) % 3 ||
+            serial.samples(p) != banded.samples(p) ||
+            az.samples(p) != banded.samples(p))
+            ++bad;
+        for (int s = 0;  s < banded.samples(p);  ++s) {
+            for (int c = 0;  c < 3;  ++c)
+                if (banded.deep_value (p, c, s) != float(x + 1000*y + s + 0.25f*c) ||
+                    serial.deep_value (p, c, s) != banded.deep_value (p, c, s))
+                    ++bad;
+            if (az.deep_value (p, 0, s) != banded.deep_value (p, 1, s) ||
+                az.deep_value (p, 1, s) != banded.deep_value (p, 2, s))
+                ++bad;
+        }
+    }
+    OIIO_CHECK_EQUAL (bad, 0);
+    Filesystem::remove ("deepread.exr");
+}
+
+
+
+// Write an image into memory through an IOProxy, and read it back out
+// of that memory through another.
+void
+test_ioproxy (const char *format)
+{
+    std::cout << "Testing " << format << " through an IOProxy\n";
+    const int W = 32, H = 24, NC = 3;
+    ImageSpec spec (W, H, NC, TypeDesc::UINT8);
+    std::vector<unsigned char> pixels (W*H*NC);
+    for (size_t i = 0;  i < pixels.size();  ++i)
+        pixels[i] = (unsigned char)(i * 7);
+
+    ImageOutput *out = ImageOutput::create (format);
+    OIIO_CHECK_ASSERT (out && out->supports ("ioproxy"));
+    if (! out)
+        return;
+    std::vector<unsigned char> file;
+    Filesystem::IOVecOutput vecout (file);
+    Filesystem::IOProxy *io = &vecout;
+    ImageSpec outspec = spec;
+    outspec.attribute ("oiio:ioproxy", TypeDesc::PTR, &io);
+    OIIO_CHECK_ASSERT (out->open ("proxy.out", outspec));
+    OIIO_CHECK_ASSERT (out->write_image (TypeDesc::UINT8, &pixels[0]));
+    OIIO_CHECK_ASSERT (out->close ());
+    ImageOutput::destroy (out);
+    OIIO_CHECK_ASSERT (file.size() > 0);
+    OIIO_CHECK_ASSERT (! Filesystem::exists ("proxy.out"));
+
+    ImageInput *in = ImageInput::create (format);
+    OIIO_CHECK_ASSERT (in && in->supports ("ioproxy"));
+    if (! in)
+        return;
+    Filesystem::IOMemReader memreader (&file[0], file.size());
+    io = &memreader;
+    ImageSpec config, inspec;
+    config.attribute ("oiio:ioproxy", TypeDesc::PTR, &io);
+    OIIO_CHECK_ASSERT (in->open ("proxy.out", inspec, config));
+    OIIO_CHECK_EQUAL (inspec.width, W);
+    OIIO_CHECK_EQUAL (inspec.height, H);
+    OIIO_CHECK_EQUAL (inspec.nchannels, NC);
+    std::vector<unsigned char> readback (W*H*NC);
+    OIIO_CHECK_ASSERT (in->read_image (TypeDesc::UINT8, &readback[0]));
+    in->close ();
+    ImageInput::destroy (in);
+    OIIO_CHECK_ASSERT (readback == pixels);
+}
+
+
+
+// Write a DDS file with a MIP chain in each of its modes (uncompressed
+// and BC1-BC5), and read every level back through the DDS reader. The
+// pixels are a ramp along one direction, which block compression keeps
+// close; uncompressed files must come back exactly.
+void
+test_dds_write ()
+{
+    std::cout << "\nTesting DDS output\n";
+    static const struct { const char *compression; int nchannels;
+                          const char *fourcc; int tolerance; } modes[] = {
+        { "none", 4, "", 0 },
+        { "none", 3, "", 0 },
+        { "none", 1, "", 0 },
+        { "dxt1", 4, "DXT1", 16 },
+        { "dxt3", 4, "DXT3", 16 },
+        { "dxt5", 4, "DXT5", 16 },
+        { "bc4",  1, "ATI1", 16 },
+        { "bc5",  2, "ATI2", 16 },
+    };
+    const int W = 20, H = 12, nlevels = 3;   // 20x12, 10x6, 5x3
+    for (size_t mode = 0;  mode < sizeof(modes)/sizeof(modes[0]);  ++mode) {
+        int nc = modes[mode].nchannels;
+        std::cout << "  " << modes[mode].compression << ", "
+                  << nc << " channels\n";
+        std::vector< std::vector<unsigned char> > levels (nlevels);
+        ImageOutput *out = ImageOutput::create ("dds");
+        OIIO_CHECK_ASSERT (out && out->supports ("mipmap"));
+        if (! out)
+            return;
+        for (int m = 0;  m < nlevels;  ++m) {
+            ImageSpec spec (std::max (1, W >> m), std::max (1, H >> m),
+                            nc, TypeDesc::UINT8);
+            spec.attribute ("compression", modes[mode].compression);
+            std::vector<unsigned char> &pixels (levels[m]);
+            pixels.resize (spec.image_bytes());
+            for (int y = 0;  y < spec.height;  ++y)
+                for (int x = 0;  x < spec.width;  ++x) {
+                    int t = x + 2 * y + m;
+                    for (int c = 0;  c < nc;  ++c)
+                        pixels[(y*spec.width+x)*nc+c] = (unsigned char)(4*t + 16*c);
+                }
+            // DXT1 only has 1-bit alpha
+            if (std::string(modes[mode].fourcc) == "DXT1")
+                for (size_t i = 3;  i < pixels.size();  i += 4)
+                    pixels[i] = 255;
+            OIIO_CHECK_ASSERT (out->open ("ddswrite.dds", spec,
+                          m ? ImageOutput::AppendMIPLevel : ImageOutput::Create));
+            OIIO_CHECK_ASSERT (out->write_image (TypeDesc::UINT8, &pixels[0]));
+        }
+        OIIO_CHECK_ASSERT (out->close ());
+        ImageOutput::destroy (out);
+
+        ImageInput *in = ImageInput::open ("ddswrite.dds");
+        OIIO_CHECK_ASSERT (in);
+        if (! in)
+            return;
+        OIIO_CHECK_EQUAL (in->format_name(), std::string("dds"));
+        for (int m = 0;  m < nlevels;  ++m) {
+            ImageSpec spec;
+            OIIO_CHECK_ASSERT (in->seek_subimage (0, m, spec));
+            OIIO_CHECK_EQUAL (spec.width, std::max (1, W >> m));
+            OIIO_CHECK_EQUAL (spec.height, std::max (1, H >> m));
+            OIIO_CHECK_EQUAL (spec.nchannels, nc);
+            OIIO_CHECK_EQUAL (spec.get_string_attribute ("compression"),
+                              modes[mode].fourcc);
+            if (spec.nchannels != nc)
+                continue;
+            std::vector<unsigned char> readback (spec.image_bytes());
+            OIIO_CHECK_ASSERT (in->read_image (TypeDesc::UINT8, &readback[0]));
+            int maxdiff = 0;
+            for (size_t i = 0;  i < readback.size();  ++i)
+                maxdiff = std::max (maxdiff, std::abs (int(readback[i])
+                                                       - int(levels[m][i])));
+            OIIO_CHECK_ASSERT (maxdiff <= modes[mode].tolerance);
+        }
+        ImageSpec past;
+        OIIO_CHECK_ASSERT (! in->seek_subimage (0, nlevels, past));
+        in->close ();
+        ImageInput::destroy (in);
+    }
+    Filesystem::remove ("ddswrite.dds");
+}
+
+
+
 int
 main (int argc, char **argv)
 {
@@ -341,10 +1175,28 @@ main (int argc, char **argv)
     iterator_wrap_test<ImageBuf::ConstIterator<float> > (ImageBuf::WrapMirror, "mirror");
 
     ImageBuf_test_appbuffer ();
+    test_appbuffer_strided ();
     histogram_computation_test ();
     test_open_with_config ();
 
     test_set_get_pixels ();
+    test_sequence_reader ();
+    test_span_iterator ();
+    test_pinned_tiles ();
+    test_convert_image ();
+    test_copy_on_write ();
+    test_views ();
+    test_local_tiles ();
+    test_parallel_read ();
+    test_streamed_tiled_write ();
+    test_alloc_policy ();
+    test_deep_scanline_storage ();
+    test_deep_types ();
+    test_deep_read ();
+    test_ioproxy ("tiff");
+    test_ioproxy ("png");
+    test_ioproxy ("openexr");
+    test_dds_write ();
 
     return unit_test_failures;
 }
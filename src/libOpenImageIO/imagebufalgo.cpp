@@ -81,6 +81,30 @@
 OIIO_NAMESPACE_BEGIN
 
 
+// Set spec's channel formats so that each channel can hold that channel
+// of all the (deep) inputs without loss.
+static void
+merge_deep_channelformats (ImageSpec &spec, const ImageBuf *A,
+                           const ImageBuf *B, const ImageBuf *C)
+{
+    std::vector<TypeDesc> types (spec.nchannels, TypeDesc::UNKNOWN);
+    const ImageBuf *inputs[3] = { A, B, C };
+    for (int i = 0;  i < 3 && inputs[i];  ++i) {
+        std::vector<TypeDesc> chtypes;
+        inputs[i]->spec().get_channelformats (chtypes);
+        for (int c = 0, e = std::min (int(chtypes.size()), spec.nchannels);  c < e;  ++c)
+            types[c] = ImageBufAlgo::type_merge (types[c], chtypes[c]);
+    }
+    TypeDesc all = types[0];
+    for (int c = 1;  c < spec.nchannels;  ++c)
+        all = ImageBufAlgo::type_merge (all, types[c]);
+    spec.set_format (all);
+    if (std::count (types.begin(), types.end(), all) != spec.nchannels)
+        spec.channelformats = types;
+}
+
+
+
 bool
 ImageBufAlgo::IBAprep (ROI &roi, ImageBuf *dst, const ImageBuf *A,
                        const ImageBuf *B, const ImageBuf *C,
@@ -177,12 +201,20 @@ ImageBufAlgo::IBAprep (ROI &roi, ImageBuf *dst, const ImageBuf *A,
             // For multiple inputs, if they aren't the same data type, punt and
             // allocate a float buffer. If the user wanted something else,
             // they should have pre-allocated dst with their desired format.
-            if ((B && A->spec().format != B->spec().format)
-                    || (prepflags & IBAprep_DST_FLOAT_PIXELS))
-                spec.set_format (TypeDesc::FLOAT);
-            if (C && (A->spec().format != C->spec().format ||
-                      B->spec().format != C->spec().format))
-                spec.set_format (TypeDesc::FLOAT);
+            // Deep inputs instead keep per-channel types, each channel
+            // getting one that holds that channel of all the inputs, so
+            // that (say) half colors with a float Z stay that way.
+            if (B && A->deep() && B->deep() && (! C || C->deep()) &&
+                    ! (prepflags & IBAprep_DST_FLOAT_PIXELS)) {
+                merge_deep_channelformats (spec, A, B, C);
+            } else {
+                if ((B && A->spec().format != B->spec().format)
+                        || (prepflags & IBAprep_DST_FLOAT_PIXELS))
+                    spec.set_format (TypeDesc::FLOAT);
+                if (C && (A->spec().format != C->spec().format ||
+                          B->spec().format != C->spec().format))
+                    spec.set_format (TypeDesc::FLOAT);
+            }
             // No good can come from automatically polluting an ImageBuf
             // with some other ImageBuf's tile sizes.
             spec.tile_width = 0;
@@ -386,6 +418,227 @@ convolve_ (ImageBuf &dst, const ImageBuf &src, const ImageBuf &kernel,
 
 
 
+// The factor that convolve applies to the kernel's weights.
+static float
+kernel_scale (const ImageBuf &kernel, bool normalize)
+{
+    if (! normalize)
+        return 1.0f;
+    float sum = 0.0f;
+    for (ImageBuf::ConstIterator<float> k (kernel); ! k.done(); ++k)
+        sum += k[0];
+    return 1.0f / sum;
+}
+
+
+
+// Read the pixels of src in the region r (including channels), with
+// WrapClamp for pixels outside the data window, just as convolve_ sees
+// them, into contiguous float buf (r.width() * r.nchannels() per row).
+template<typename SRCTYPE>
+static void
+read_wrapped_ (const ImageBuf &src, ROI r, float *buf)
+{
+    for (ImageBuf::ConstIterator<SRCTYPE> s (src, r, ImageBuf::WrapClamp);
+         ! s.done();  ++s)
+        for (int c = r.chbegin;  c < r.chend;  ++c)
+            *buf++ = s[c];
+}
+
+
+
+// Convolution by a separable 2D kernel k(i,j) = hk[i] * vk[j]: a
+// horizontal pass over the rows (including the kernel's apron rows),
+// then a vertical pass, so the cost per pixel is kw+kh rather than kw*kh.
+template<typename DSTTYPE, typename SRCTYPE>
+static bool
+convolve_separable_ (ImageBuf &dst, const ImageBuf &src,
+                     const std::vector<float> &hk, const std::vector<float> &vk,
+                     ROI kroi, float scale, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            OIIO::bind(convolve_separable_<DSTTYPE,SRCTYPE>, OIIO::ref(dst),
+                        OIIO::cref(src), OIIO::cref(hk), OIIO::cref(vk),
+                        kroi, scale, _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads, ImageBufAlgo::Split_Y);
+        return true;
+    }
+
+    // Serial case
+    const int nc = roi.nchannels();
+    const int kw = (int) hk.size(), kh = (int) vk.size();
+    const int w = roi.width();
+    const int exth = roi.height() + kh - 1;   // rows including the apron
+    std::vector<float> row ((w + kw - 1) * nc);
+    std::vector<float> hpass (exth * w * nc);
+    std::vector<float> out (w * nc);
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        // Horizontal pass
+        for (int j = 0;  j < exth;  ++j) {
+            int y = roi.ybegin + kroi.ybegin + j;
+            read_wrapped_<SRCTYPE> (src, ROI (roi.xbegin + kroi.xbegin,
+                                              roi.xend + kroi.xend - 1,
+                                              y, y+1, z, z+1,
+                                              roi.chbegin, roi.chend),
+                                    &row[0]);
+            float *h = &hpass[j * w * nc];
+            for (int x = 0;  x < w;  ++x, h += nc) {
+                const float *r = &row[x * nc];
+                for (int c = 0;  c < nc;  ++c)
+                    h[c] = 0.0f;
+                for (int i = 0;  i < kw;  ++i, r += nc)
+                    for (int c = 0;  c < nc;  ++c)
+                        h[c] += hk[i] * r[c];
+            }
+        }
+        // Vertical pass
+        ImageBuf::Iterator<DSTTYPE> d (dst, roi);
+        for (int y = 0;  y < roi.height();  ++y) {
+            for (int v = 0;  v < w * nc;  ++v)
+                out[v] = 0.0f;
+            for (int j = 0;  j < kh;  ++j) {
+                const float *h = &hpass[(y + j) * w * nc];
+                float kv = vk[j];
+                for (int v = 0;  v < w * nc;  ++v)
+                    out[v] += kv * h[v];
+            }
+            d.rerange (roi.xbegin, roi.xend, roi.ybegin + y,
+                       roi.ybegin + y + 1, z, z+1);
+            for (const float *o = &out[0];  ! d.done();  ++d, o += nc)
+                for (int c = 0;  c < nc;  ++c)
+                    d[c+roi.chbegin] = scale * o[c];
+        }
+    }
+    return true;
+}
+
+
+
+// Is the 2D kernel k (float, local, depth 1) separable into hk[i]*vk[j]?
+// That's the case exactly when it has rank 1, which we check against
+// the row and column through its largest magnitude value.
+static bool
+kernel_separable (const ImageBuf &kernel, std::vector<float> &hk,
+                  std::vector<float> &vk)
+{
+    const ImageSpec &kspec (kernel.spec());
+    if (kspec.depth != 1)
+        return false;
+    int kw = kspec.width, kh = kspec.height, kchans = kspec.nchannels;
+    const float *k = (const float *) kernel.localpixels();
+    int pi = 0, pj = 0;
+    float maxabs = 0.0f;
+    for (int j = 0;  j < kh;  ++j)
+        for (int i = 0;  i < kw;  ++i)
+            if (fabsf (k[(j*kw+i)*kchans]) > maxabs) {
+                maxabs = fabsf (k[(j*kw+i)*kchans]);
+                pi = i;  pj = j;
+            }
+    if (maxabs == 0.0f)
+        return false;
+    float pivot = k[(pj*kw+pi)*kchans];
+    hk.resize (kw);
+    vk.resize (kh);
+    for (int i = 0;  i < kw;  ++i)
+        hk[i] = k[(pj*kw+i)*kchans];
+    for (int j = 0;  j < kh;  ++j)
+        vk[j] = k[(j*kw+pi)*kchans] / pivot;
+    const float tolerance = 1.0e-5f * maxabs;
+    for (int j = 0;  j < kh;  ++j)
+        for (int i = 0;  i < kw;  ++i)
+            if (fabsf (k[(j*kw+i)*kchans] - vk[j] * hk[i]) > tolerance)
+                return false;
+    return true;
+}
+
+
+
+// The next size >= n whose only prime factors are 2, 3 and 5, which
+// kissfft transforms efficiently.
+static int
+fft_good_size (int n)
+{
+    for ( ;  ;  ++n) {
+        int m = n;
+        while (m % 2 == 0) m /= 2;
+        while (m % 3 == 0) m /= 3;
+        while (m % 5 == 0) m /= 5;
+        if (m == 1)
+            return n;
+    }
+}
+
+
+
+// Convolution by way of the FFT, for big kernels: the source region
+// (with the kernel's apron) is padded to an FFT-friendly size, and the
+// result is the correlation IFFT(conj(FFT(kernel)) * FFT(src)), which
+// has no wraparound within the output region.  2D only.
+template<typename DSTTYPE, typename SRCTYPE>
+static bool
+convolve_fft_ (ImageBuf &dst, const ImageBuf &src, const ImageBuf &kernel,
+               float scale, ROI roi, int nthreads)
+{
+    ROI kroi = kernel.roi();
+    int kchans = kernel.nchannels();
+    const int nc = roi.nchannels();
+    const int fw = fft_good_size (roi.width() + kroi.width() - 1);
+    const int fh = fft_good_size (roi.height() + kroi.height() - 1);
+    ImageSpec pspec (fw, fh, nc, TypeDesc::FLOAT);
+    ImageBuf P (pspec);
+    read_wrapped_<SRCTYPE> (src, ROI (roi.xbegin + kroi.xbegin,
+                                      roi.xbegin + kroi.xbegin + fw,
+                                      roi.ybegin + kroi.ybegin,
+                                      roi.ybegin + kroi.ybegin + fh,
+                                      roi.zbegin, roi.zbegin+1,
+                                      roi.chbegin, roi.chend),
+                            (float *) P.localpixels());
+
+    ImageBuf K (ImageSpec (fw, fh, 1, TypeDesc::FLOAT));
+    ImageBufAlgo::zero (K);
+    const float *k = (const float *) kernel.localpixels();
+    for (int j = 0;  j < kroi.height();  ++j)
+        for (int i = 0;  i < kroi.width();  ++i)
+            ((float *)K.pixeladdr (i, j))[0] = k[(j*kroi.width()+i)*kchans];
+    ImageBuf KF;
+    if (! ImageBufAlgo::fft (KF, K, ROI::All(), nthreads)) {
+        dst.error ("%s", KF.geterror());
+        return false;
+    }
+
+    // Both transforms are unitary, so the product needs sqrt(N) to match
+    // the plain correlation sum.
+    scale *= sqrtf (float (fw) * float (fh));
+    const std::complex<float> *kf = (const std::complex<float> *) KF.localpixels();
+    std::vector<ImageBuf> results (nc);
+    for (int c = 0;  c < nc;  ++c) {
+        ImageBuf PF;
+        if (! ImageBufAlgo::fft (PF, P, ROI (0, fw, 0, fh, 0, 1, c, c+1),
+                                 nthreads)) {
+            dst.error ("%s", PF.geterror());
+            return false;
+        }
+        std::complex<float> *pf = (std::complex<float> *) PF.localpixels();
+        for (int i = 0, n = fw*fh;  i < n;  ++i)
+            pf[i] *= std::conj (kf[i]);
+        if (! ImageBufAlgo::ifft (results[c], PF, ROI::All(), nthreads)) {
+            dst.error ("%s", results[c].geterror());
+            return false;
+        }
+    }
+
+    for (ImageBuf::Iterator<DSTTYPE> d (dst, roi);  ! d.done();  ++d)
+        for (int c = 0;  c < nc;  ++c)
+            d[c+roi.chbegin] = scale * results[c].getchannel (d.x() - roi.xbegin,
+                                                              d.y() - roi.ybegin,
+                                                              0, 0);
+    return true;
+}
+
+
+
 bool
 ImageBufAlgo::convolve (ImageBuf &dst, const ImageBuf &src,
                         const ImageBuf &kernel, bool normalize,
@@ -397,10 +650,43 @@ ImageBufAlgo::convolve (ImageBuf &dst, const ImageBuf &src,
     // Ensure that the kernel is float and in local memory
     const ImageBuf *K = &kernel;
     ImageBuf Ktmp;
-    if (kernel.spec().format != TypeDesc::FLOAT || ! kernel.localpixels()) {
+    if (kernel.spec().format != TypeDesc::FLOAT || ! kernel.localpixels() ||
+          ! kernel.contiguous()) {
         Ktmp.copy (kernel, TypeDesc::FLOAT);
+        Ktmp.set_local_tiles (0);   // a shared copy keeps kernel's layout
         K = &Ktmp;
     }
+
+    // Pick the cheapest strategy: two 1D passes for separable kernels
+    // (such as most of those from make_kernel), the FFT for big 2D
+    // kernels when it's estimated to beat the direct sum, and otherwise
+    // the direct sum.
+    ROI kroi = K->roi();
+    std::vector<float> hk, vk;
+    if (kroi.width() > 1 && kroi.height() > 1 && kernel_separable (*K, hk, vk)) {
+        OIIO_DISPATCH_COMMON_TYPES2 (ok, "convolve", convolve_separable_,
+                              dst.spec().format, src.spec().format,
+                              dst, src, hk, vk, kroi,
+                              kernel_scale (*K, normalize), roi, nthreads);
+        return ok;
+    }
+    if (kroi.depth() == 1 && roi.depth() == 1 && kroi.npixels() >= 64) {
+        double fftpixels = double (fft_good_size (roi.width() + kroi.width() - 1))
+                         * fft_good_size (roi.height() + kroi.height() - 1);
+        double direct_cost = double(roi.npixels()) * kroi.npixels() * roi.nchannels();
+        // Each of the 2*nchannels+1 transforms is two passes of 1D FFTs
+        // plus two transposes.
+        double fft_cost = 8.0 * fftpixels * log2 (fftpixels)
+                        * (2 * roi.nchannels() + 1);
+        if (fft_cost < direct_cost) {
+            OIIO_DISPATCH_COMMON_TYPES2 (ok, "convolve", convolve_fft_,
+                                  dst.spec().format, src.spec().format,
+                                  dst, src, *K, kernel_scale (*K, normalize),
+                                  roi, nthreads);
+            return ok;
+        }
+    }
+
     OIIO_DISPATCH_COMMON_TYPES2 (ok, "convolve", convolve_,
                           dst.spec().format, src.spec().format,
                           dst, src, *K, normalize, roi, nthreads);
@@ -594,6 +880,167 @@ ImageBufAlgo::laplacian (ImageBuf &dst, const ImageBuf &src,
 
 
 
+// Read the pixels of src in the region r (including channels) into
+// contiguous float buf, substituting fill for each channel of the pixels
+// that lie outside src's data window.
+template<typename SRCTYPE>
+static void
+read_window_ (const ImageBuf &src, ROI r, float fill, float *buf)
+{
+    for (ImageBuf::ConstIterator<SRCTYPE> s (src, r);  ! s.done();  ++s) {
+        if (s.exists()) {
+            for (int c = r.chbegin;  c < r.chend;  ++c)
+                *buf++ = s[c];
+        } else {
+            for (int c = r.chbegin;  c < r.chend;  ++c)
+                *buf++ = fill;
+        }
+    }
+}
+
+
+
+// Which source types median_filter can do with histograms: the number
+// of distinct values, or 0 if there are too many.
+template<class T> struct median_hist_levels { static const int value = 0; };
+template<> struct median_hist_levels<unsigned char> { static const int value = 256; };
+template<> struct median_hist_levels<unsigned short> { static const int value = 65536; };
+
+
+
+// Median filter by histograms (Perreault & Hebert, "Median Filtering in
+// Constant Time"): one histogram per column of the window's rows, which
+// slide down by adding one pixel and removing another, and a window
+// histogram that slides right by adding and subtracting whole column
+// histograms.  For 16 bit data those histograms are of the high byte,
+// and an exact window histogram of the full values is also kept, one
+// window column at a time, to find the low byte.  Only pixels inside
+// A's data window count, just as for the sorting median_filter_impl.
+template<class Rtype, class Atype>
+static bool
+median_filter_hist (ImageBuf &R, const ImageBuf &A, int width, int height,
+                    int w_2, int h_2, ROI roi)
+{
+    const int levels = median_hist_levels<Atype>::value;
+    const int nbins = std::min (levels, 256);
+    const int shift = (levels > 256) ? 8 : 0;
+    const int nchannels = R.nchannels();
+    const int w = roi.width(), h = roi.height();
+    const int exw = w + width - 1, exh = h + height - 1;
+    std::vector<float> lut (levels);
+    for (int b = 0;  b < levels;  ++b)
+        lut[b] = convert_type<Atype,float> (Atype(b));
+    std::vector<float> buf (size_t(exw) * exh * nchannels);
+    std::vector<int> vals (size_t(exw) * exh);
+    std::vector<unsigned int> colhist (size_t(exw) * nbins), hist (nbins);
+    std::vector<unsigned int> colcount (exw);
+    std::vector<unsigned int> finehist (shift ? levels : 0);
+    std::vector<float> out (size_t(w) * h * nchannels);
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        read_window_<Atype> (A, ROI (roi.xbegin - w_2, roi.xbegin - w_2 + exw,
+                                     roi.ybegin - h_2, roi.ybegin - h_2 + exh,
+                                     z, z+1, 0, nchannels),
+                             -1.0f, &buf[0]);
+        for (int c = 0;  c < nchannels;  ++c) {
+            // Quantize to bins, -1 for pixels that don't exist
+            for (size_t i = 0, e = vals.size();  i < e;  ++i) {
+                float v = buf[i*nchannels+c];
+                vals[i] = v < 0.0f ? -1 : int (v * (levels-1) + 0.5f);
+            }
+            std::fill (colhist.begin(), colhist.end(), 0);
+            std::fill (colcount.begin(), colcount.end(), 0);
+            for (int j = 0;  j < height;  ++j) {
+                const int *v = &vals[size_t(j) * exw];
+                for (int x = 0;  x < exw;  ++x)
+                    if (v[x] >= 0) {
+                        ++colhist[x*nbins + (v[x] >> shift)];
+                        ++colcount[x];
+                    }
+            }
+            for (int y = 0;  y < h;  ++y) {
+                if (y > 0) {
+                    // Slide the column histograms down one row
+                    const int *vold = &vals[size_t(y-1) * exw];
+                    const int *vnew = &vals[size_t(y+height-1) * exw];
+                    for (int x = 0;  x < exw;  ++x) {
+                        if (vold[x] >= 0) {
+                            --colhist[x*nbins + (vold[x] >> shift)];
+                            --colcount[x];
+                        }
+                        if (vnew[x] >= 0) {
+                            ++colhist[x*nbins + (vnew[x] >> shift)];
+                            ++colcount[x];
+                        }
+                    }
+                }
+                std::fill (hist.begin(), hist.end(), 0);
+                std::fill (finehist.begin(), finehist.end(), 0);
+                unsigned int n = 0;
+                for (int x = 0;  x < width - 1;  ++x) {
+                    const unsigned int *ch = &colhist[x*nbins];
+                    for (int b = 0;  b < nbins;  ++b)
+                        hist[b] += ch[b];
+                    n += colcount[x];
+                    if (shift)
+                        for (int j = 0;  j < height;  ++j) {
+                            int v = vals[size_t(y+j) * exw + x];
+                            if (v >= 0)
+                                ++finehist[v];
+                        }
+                }
+                for (int x = 0;  x < w;  ++x) {
+                    // Slide the window right: add the column entering...
+                    int xin = x + width - 1;
+                    const unsigned int *ch = &colhist[xin*nbins];
+                    for (int b = 0;  b < nbins;  ++b)
+                        hist[b] += ch[b];
+                    n += colcount[xin];
+                    if (shift)
+                        for (int j = 0;  j < height;  ++j) {
+                            int v = vals[size_t(y+j) * exw + xin];
+                            if (v >= 0)
+                                ++finehist[v];
+                        }
+                    // ... find the median ...
+                    float result = 0.0f;
+                    if (n) {
+                        unsigned int mid = n/2, sum = 0;
+                        int b = 0;
+                        while (sum + hist[b] <= mid)
+                            sum += hist[b++];
+                        if (shift) {
+                            b <<= shift;
+                            while (sum + finehist[b] <= mid)
+                                sum += finehist[b++];
+                        }
+                        result = lut[b];
+                    }
+                    out[(size_t(y) * w + x) * nchannels + c] = result;
+                    // ... and remove the column leaving.
+                    ch = &colhist[x*nbins];
+                    for (int b = 0;  b < nbins;  ++b)
+                        hist[b] -= ch[b];
+                    n -= colcount[x];
+                    if (shift)
+                        for (int j = 0;  j < height;  ++j) {
+                            int v = vals[size_t(y+j) * exw + x];
+                            if (v >= 0)
+                                --finehist[v];
+                        }
+                }
+            }
+        }
+        ImageBuf::Iterator<Rtype> r (R, roi.xbegin, roi.xend,
+                                     roi.ybegin, roi.yend, z, z+1);
+        for (const float *o = &out[0];  ! r.done();  ++r, o += nchannels)
+            for (int c = 0;  c < nchannels;  ++c)
+                r[c] = o[c];
+    }
+    return true;
+}
+
+
+
 template<class Rtype, class Atype>
 static bool
 median_filter_impl (ImageBuf &R, const ImageBuf &A, int width, int height,
@@ -616,6 +1063,10 @@ median_filter_impl (ImageBuf &R, const ImageBuf &A, int width, int height,
     int w_2 = std::max (1, width/2);
     int h_2 = std::max (1, height/2);
     int windowsize = width*height;
+    // Sorting is quicker than histograms for small windows
+    if (median_hist_levels<Atype>::value && windowsize >= 49)
+        return median_filter_hist<Rtype,Atype> (R, A, width, height,
+                                                w_2, h_2, roi);
     int nchannels = R.nchannels();
     float **chans = OIIO_ALLOCA (float*, nchannels);
     for (int c = 0;  c < nchannels;  ++c)
@@ -671,6 +1122,83 @@ ImageBufAlgo::median_filter (ImageBuf &dst, const ImageBuf &src,
 
 enum MorphOp { MorphDilate, MorphErode };
 
+struct MorphMax {
+    float operator() (float a, float b) const { return std::max (a, b); }
+};
+
+struct MorphMin {
+    float operator() (float a, float b) const { return std::min (a, b); }
+};
+
+
+
+// Running max or min over a window of k values (van Herk, Gil & Werman):
+// out[i*ostride] = op of in[(i..i+k-1)*istride] for i in [0,n), using
+// prefix and suffix extrema within blocks of k, so it takes three
+// comparisons per value no matter how big k is.  g and h are scratch
+// space for n+k-1 values.
+template<class OP>
+static void
+running_extremum (const float *in, int istride, float *out, int ostride,
+                  int n, int k, float *g, float *h, OP op)
+{
+    int len = n + k - 1;
+    for (int b = 0;  b < len;  b += k) {
+        int e = std::min (b + k, len);
+        g[b] = in[b*istride];
+        for (int i = b+1;  i < e;  ++i)
+            g[i] = op (g[i-1], in[i*istride]);
+        h[e-1] = in[(e-1)*istride];
+        for (int i = e-2;  i >= b;  --i)
+            h[i] = op (h[i+1], in[i*istride]);
+    }
+    for (int i = 0;  i < n;  ++i)
+        out[i*ostride] = op (h[i], g[i+k-1]);
+}
+
+
+
+// Rectangular dilate/erode as a horizontal then a vertical running
+// extremum.  Pixels outside A's data window don't count; they are
+// given the value that never wins.
+template<class Rtype, class Atype, class OP>
+static void
+morph_rect (ImageBuf &R, const ImageBuf &A, int width, int height,
+            int w_2, int h_2, float fill, ROI roi, OP op)
+{
+    const int nchannels = R.nchannels();
+    const int w = roi.width(), h = roi.height();
+    const int exw = w + width - 1, exh = h + height - 1;
+    std::vector<float> buf (size_t(exw) * exh * nchannels);
+    std::vector<float> hpass (size_t(w) * exh * nchannels);
+    std::vector<float> out (size_t(w) * h * nchannels);
+    std::vector<float> g (std::max (exw, exh)), hh (std::max (exw, exh));
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        read_window_<Atype> (A, ROI (roi.xbegin - w_2, roi.xbegin - w_2 + exw,
+                                     roi.ybegin - h_2, roi.ybegin - h_2 + exh,
+                                     z, z+1, 0, nchannels),
+                             fill, &buf[0]);
+        for (int j = 0;  j < exh;  ++j)
+            for (int c = 0;  c < nchannels;  ++c)
+                running_extremum (&buf[size_t(j) * exw * nchannels + c],
+                                  nchannels,
+                                  &hpass[size_t(j) * w * nchannels + c],
+                                  nchannels, w, width, &g[0], &hh[0], op);
+        for (int x = 0;  x < w;  ++x)
+            for (int c = 0;  c < nchannels;  ++c)
+                running_extremum (&hpass[x * nchannels + c], w * nchannels,
+                                  &out[x * nchannels + c], w * nchannels,
+                                  h, height, &g[0], &hh[0], op);
+        ImageBuf::Iterator<Rtype> r (R, roi.xbegin, roi.xend,
+                                     roi.ybegin, roi.yend, z, z+1);
+        for (const float *o = &out[0];  ! r.done();  ++r, o += nchannels)
+            for (int c = 0;  c < nchannels;  ++c)
+                r[c] = o[c];
+    }
+}
+
+
+
 template<class Rtype, class Atype>
 static bool
 morph_impl (ImageBuf &R, const ImageBuf &A, int width, int height,
@@ -692,37 +1220,16 @@ morph_impl (ImageBuf &R, const ImageBuf &A, int width, int height,
         height = width;
     int w_2 = std::max (1, width/2);
     int h_2 = std::max (1, height/2);
-    int nchannels = R.nchannels();
-    float *vals = OIIO_ALLOCA (float, nchannels);
-
-    ImageBuf::ConstIterator<Atype> a (A, roi);
-    for (ImageBuf::Iterator<Rtype> r (R, roi);  !r.done();  ++r) {
-        a.rerange (r.x()-w_2, r.x()-w_2+width,
-                   r.y()-h_2, r.y()-h_2+height,
-                   r.z(), r.z()+1, ImageBuf::WrapClamp);
-        if (op == MorphDilate) {
-            for (int c = 0; c < nchannels; ++c)
-                vals[c] = -std::numeric_limits<float>::max();
-            for ( ;  ! a.done(); ++a) {
-                if (a.exists()) {
-                    for (int c = 0;  c < nchannels;  ++c)
-                        vals[c] = std::max(vals[c], a[c]);
-                }
-            }
-        } else if (op == MorphErode) {
-            for (int c = 0; c < nchannels; ++c)
-                vals[c] = std::numeric_limits<float>::max();
-            for ( ;  ! a.done(); ++a) {
-                if (a.exists()) {
-                    for (int c = 0;  c < nchannels;  ++c)
-                        vals[c] = std::min(vals[c], a[c]);
-                }
-            }
-        } else {
-            ASSERT (0 && "Unknown morphological operator");
-        }
-        for (int c = 0;  c < nchannels;  ++c)
-            r[c] = vals[c];
+    if (op == MorphDilate) {
+        morph_rect<Rtype,Atype> (R, A, width, height, w_2, h_2,
+                                 -std::numeric_limits<float>::max(),
+                                 roi, MorphMax());
+    } else if (op == MorphErode) {
+        morph_rect<Rtype,Atype> (R, A, width, height, w_2, h_2,
+                                 std::numeric_limits<float>::max(),
+                                 roi, MorphMin());
+    } else {
+        ASSERT (0 && "Unknown morphological operator");
     }
     return true;
 }
@@ -765,6 +1272,364 @@ ImageBufAlgo::erode (ImageBuf &dst, const ImageBuf &src,
 
 
 
+// Box blur by running sums: a horizontal pass over the rows (including
+// the window's apron rows) then a vertical pass, each adding the value
+// entering the window and subtracting the one leaving, so the cost per
+// pixel doesn't depend on the window size.  Sums are kept in double so
+// that long runs don't drift.
+template<class Rtype, class Atype>
+static bool
+box_blur_ (ImageBuf &R, const ImageBuf &A, int width, int height,
+           ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Possible multiple thread case -- recurse via parallel_image
+        ImageBufAlgo::parallel_image (
+            OIIO::bind(box_blur_<Rtype,Atype>,
+                        OIIO::ref(R), OIIO::cref(A),
+                        width, height, _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads, ImageBufAlgo::Split_Y);
+        return true;
+    }
+
+    // Serial case
+    const int nc = roi.nchannels();
+    const int w = roi.width(), h = roi.height();
+    const int exw = w + width - 1, exh = h + height - 1;
+    const int w_2 = width/2, h_2 = height/2;
+    std::vector<float> buf (size_t(exw) * exh * nc);
+    std::vector<float> hpass (size_t(w) * exh * nc);
+    std::vector<double> sum (size_t(w) * nc);
+    const float scale = 1.0f / (float(width) * float(height));
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        read_wrapped_<Atype> (A, ROI (roi.xbegin - w_2, roi.xbegin - w_2 + exw,
+                                      roi.ybegin - h_2, roi.ybegin - h_2 + exh,
+                                      z, z+1, roi.chbegin, roi.chend),
+                              &buf[0]);
+        // Horizontal pass
+        for (int j = 0;  j < exh;  ++j) {
+            const float *b = &buf[size_t(j) * exw * nc];
+            float *hp = &hpass[size_t(j) * w * nc];
+            for (int c = 0;  c < nc;  ++c) {
+                double s = 0.0;
+                for (int i = 0;  i < width - 1;  ++i)
+                    s += b[i*nc+c];
+                for (int x = 0;  x < w;  ++x) {
+                    s += b[(x+width-1)*nc+c];
+                    hp[x*nc+c] = float(s);
+                    s -= b[x*nc+c];
+                }
+            }
+        }
+        // Vertical pass
+        std::fill (sum.begin(), sum.end(), 0.0);
+        for (int j = 0;  j < height - 1;  ++j) {
+            const float *hp = &hpass[size_t(j) * w * nc];
+            for (int v = 0;  v < w * nc;  ++v)
+                sum[v] += hp[v];
+        }
+        ImageBuf::Iterator<Rtype> r (R, roi);
+        for (int y = 0;  y < h;  ++y) {
+            const float *hin = &hpass[size_t(y+height-1) * w * nc];
+            const float *hout = &hpass[size_t(y) * w * nc];
+            for (int v = 0;  v < w * nc;  ++v)
+                sum[v] += hin[v];
+            r.rerange (roi.xbegin, roi.xend, roi.ybegin + y,
+                       roi.ybegin + y + 1, z, z+1);
+            for (const double *s = &sum[0];  ! r.done();  ++r, s += nc)
+                for (int c = 0;  c < nc;  ++c)
+                    r[c+roi.chbegin] = scale * float(s[c]);
+            for (int v = 0;  v < w * nc;  ++v)
+                sum[v] -= hout[v];
+        }
+    }
+    return true;
+}
+
+
+
+bool
+ImageBufAlgo::box_blur (ImageBuf &dst, const ImageBuf &src,
+                        int width, int height, ROI roi, int nthreads)
+{
+    if (! IBAprep (roi, &dst, &src,
+            IBAprep_REQUIRE_SAME_NCHANNELS | IBAprep_NO_SUPPORT_VOLUME))
+        return false;
+    if (width < 1)
+        width = 1;
+    if (height < 1)
+        height = width;
+
+    bool ok;
+    OIIO_DISPATCH_COMMON_TYPES2 (ok, "box_blur", box_blur_,
+                                 dst.spec().format, src.spec().format,
+                                 dst, src, width, height, roi, nthreads);
+    return ok;
+}
+
+
+
+// Recursive (IIR) approximation to convolution by a Gaussian, from
+// Young & van Vliet, "Recursive implementation of the Gaussian filter",
+// with a causal then an anti-causal third order pass.
+class RecursiveGaussian {
+public:
+    RecursiveGaussian (float sigma) {
+        double q = (sigma >= 2.5f) ? 0.98711 * sigma - 0.96330
+                 : 3.97156 - 4.14554 * sqrt (1.0 - 0.26891 * sigma);
+        double q2 = q * q, q3 = q2 * q;
+        double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+        m_b1 = (2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0;
+        m_b2 = -(1.4281 * q2 + 1.26661 * q3) / b0;
+        m_b3 = (0.422205 * q3) / b0;
+        m_B = 1.0 - (m_b1 + m_b2 + m_b3);
+    }
+
+    // Filter the n values p[i*stride] in place, as if the values beyond
+    // either end were the same as the end value.  w is scratch space for
+    // n values.
+    void operator() (float *p, int stride, int n, double *w) const {
+        double w1 = p[0], w2 = w1, w3 = w1;
+        for (int i = 0;  i < n;  ++i) {
+            double v = m_B * p[i*stride] + m_b1 * w1 + m_b2 * w2 + m_b3 * w3;
+            w[i] = v;
+            w3 = w2;  w2 = w1;  w1 = v;
+        }
+        double y1 = w[n-1], y2 = y1, y3 = y1;
+        for (int i = n-1;  i >= 0;  --i) {
+            double v = m_B * w[i] + m_b1 * y1 + m_b2 * y2 + m_b3 * y3;
+            p[i*stride] = float(v);
+            y3 = y2;  y2 = y1;  y1 = v;
+        }
+    }
+
+    // How far beyond the ROI we read so that the truncated filter's
+    // response (which falls off like the Gaussian) is negligible.
+    static int apron (float sigma) {
+        return sigma > 0.0f ? int (ceilf (5.0f * sigma)) + 3 : 0;
+    }
+
+private:
+    double m_B, m_b1, m_b2, m_b3;
+};
+
+
+
+template<class Rtype, class Atype>
+static bool
+gaussian_blur_ (ImageBuf &R, const ImageBuf &A, float sigmax, float sigmay,
+                ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Possible multiple thread case -- recurse via parallel_image
+        ImageBufAlgo::parallel_image (
+            OIIO::bind(gaussian_blur_<Rtype,Atype>,
+                        OIIO::ref(R), OIIO::cref(A),
+                        sigmax, sigmay, _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads, ImageBufAlgo::Split_Y);
+        return true;
+    }
+
+    // Serial case
+    const int nc = roi.nchannels();
+    const int w = roi.width(), h = roi.height();
+    const int ax = RecursiveGaussian::apron (sigmax);
+    const int ay = RecursiveGaussian::apron (sigmay);
+    const int exw = w + 2*ax, exh = h + 2*ay;
+    std::vector<float> buf (size_t(exw) * exh * nc);
+    std::vector<double> scratch (std::max (exw, exh));
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        read_wrapped_<Atype> (A, ROI (roi.xbegin - ax, roi.xend + ax,
+                                      roi.ybegin - ay, roi.yend + ay,
+                                      z, z+1, roi.chbegin, roi.chend),
+                              &buf[0]);
+        if (sigmax > 0.0f) {
+            RecursiveGaussian g (sigmax);
+            for (int j = 0;  j < exh;  ++j)
+                for (int c = 0;  c < nc;  ++c)
+                    g (&buf[size_t(j) * exw * nc + c], nc, exw, &scratch[0]);
+        }
+        if (sigmay > 0.0f) {
+            RecursiveGaussian g (sigmay);
+            for (int x = ax;  x < ax + w;  ++x)
+                for (int c = 0;  c < nc;  ++c)
+                    g (&buf[x * nc + c], exw * nc, exh, &scratch[0]);
+        }
+        ImageBuf::Iterator<Rtype> r (R, roi);
+        for (int y = 0;  y < h;  ++y) {
+            r.rerange (roi.xbegin, roi.xend, roi.ybegin + y,
+                       roi.ybegin + y + 1, z, z+1);
+            const float *b = &buf[(size_t(y + ay) * exw + ax) * nc];
+            for ( ;  ! r.done();  ++r, b += nc)
+                for (int c = 0;  c < nc;  ++c)
+                    r[c+roi.chbegin] = b[c];
+        }
+    }
+    return true;
+}
+
+
+
+bool
+ImageBufAlgo::gaussian_blur (ImageBuf &dst, const ImageBuf &src,
+                             float sigmax, float sigmay,
+                             ROI roi, int nthreads)
+{
+    if (! IBAprep (roi, &dst, &src,
+            IBAprep_REQUIRE_SAME_NCHANNELS | IBAprep_NO_SUPPORT_VOLUME))
+        return false;
+    if (sigmay < 0.0f)
+        sigmay = sigmax;
+
+    bool ok;
+    OIIO_DISPATCH_COMMON_TYPES2 (ok, "gaussian_blur", gaussian_blur_,
+                                 dst.spec().format, src.spec().format,
+                                 dst, src, sigmax, sigmay, roi, nthreads);
+    return ok;
+}
+
+
+
+// Summed-area table, first pass: running sums along each row.
+template<class Rtype, class Atype>
+static bool
+integral_rows_ (ImageBuf &R, const ImageBuf &A, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Possible multiple thread case -- recurse via parallel_image
+        ImageBufAlgo::parallel_image (
+            OIIO::bind(integral_rows_<Rtype,Atype>,
+                        OIIO::ref(R), OIIO::cref(A),
+                        _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads, ImageBufAlgo::Split_Y);
+        return true;
+    }
+
+    // Serial case
+    double *sum = ALLOCA (double, roi.chend);
+    ImageBuf::ConstIterator<Atype,double> a (A, roi);
+    for (ImageBuf::Iterator<Rtype,double> r (R, roi);  ! r.done();  ++r, ++a) {
+        if (r.x() == roi.xbegin)
+            for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                sum[c] = 0.0;
+        for (int c = roi.chbegin;  c < roi.chend;  ++c) {
+            sum[c] += a[c];
+            r[c] = sum[c];
+        }
+    }
+    return true;
+}
+
+
+
+// Summed-area table, second pass: add each row of row sums to the one
+// below it, in vertical strips so the columns are independent.
+template<class Rtype>
+static bool
+integral_cols_ (ImageBuf &R, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Possible multiple thread case -- recurse via parallel_image
+        ImageBufAlgo::parallel_image (
+            OIIO::bind(integral_cols_<Rtype>, OIIO::ref(R),
+                        _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads, ImageBufAlgo::Split_X);
+        return true;
+    }
+
+    // Serial case
+    ImageBuf::ConstIterator<Rtype,double> above (R, roi);
+    ImageBuf::Iterator<Rtype,double> r (R, roi);
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        for (int y = roi.ybegin+1;  y < roi.yend;  ++y) {
+            above.rerange (roi.xbegin, roi.xend, y-1, y, z, z+1);
+            r.rerange (roi.xbegin, roi.xend, y, y+1, z, z+1);
+            for ( ;  ! r.done();  ++r, ++above)
+                for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                    r[c] = r[c] + above[c];
+        }
+    }
+    return true;
+}
+
+
+
+bool
+ImageBufAlgo::integral_image (ImageBuf &dst, const ImageBuf &src,
+                              ROI roi, int nthreads)
+{
+    ImageSpec force_spec = src.spec();
+    force_spec.set_format (TypeDesc::DOUBLE);
+    force_spec.channelformats.clear();
+    if (! IBAprep (roi, &dst, &src, NULL, &force_spec,
+            IBAprep_REQUIRE_SAME_NCHANNELS | IBAprep_NO_SUPPORT_VOLUME))
+        return false;
+
+    bool ok;
+    OIIO_DISPATCH_TYPES2 (ok, "integral_image", integral_rows_,
+                          dst.spec().format, src.spec().format,
+                          dst, src, roi, nthreads);
+    if (ok)
+        OIIO_DISPATCH_TYPES (ok, "integral_image", integral_cols_,
+                             dst.spec().format, dst, roi, nthreads);
+    return ok;
+}
+
+
+
+template<class T>
+static bool
+area_sum_ (const ImageBuf &sat, ROI roi, float *sum)
+{
+    // Add or subtract the table value at (x,y) for each of the 4 corners
+    // of roi (just outside it, for the left and top), where those outside
+    // the table count as 0.
+    ROI satroi = sat.roi();
+    double *s = ALLOCA (double, roi.chend);
+    for (int c = roi.chbegin;  c < roi.chend;  ++c)
+        s[c] = 0.0;
+    int xs[2] = { roi.xend-1, roi.xbegin-1 };
+    int ys[2] = { roi.yend-1, roi.ybegin-1 };
+    ImageBuf::ConstIterator<T,double> p (sat);
+    for (int j = 0;  j < 2;  ++j) {
+        for (int i = 0;  i < 2;  ++i) {
+            if (xs[i] < satroi.xbegin || ys[j] < satroi.ybegin)
+                continue;
+            p.pos (xs[i], ys[j], roi.zbegin);
+            double sign = (i == j) ? 1.0 : -1.0;
+            for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                s[c] += sign * p[c];
+        }
+    }
+    for (int c = roi.chbegin;  c < roi.chend;  ++c)
+        sum[c] = float (s[c]);
+    return true;
+}
+
+
+
+bool
+ImageBufAlgo::area_sum (const ImageBuf &sat, ROI roi, float *sum)
+{
+    if (! sat.initialized()) {
+        sat.error ("area_sum: uninitialized summed-area table");
+        return false;
+    }
+    roi = roi.defined() ? roi_intersection (roi, sat.roi()) : sat.roi();
+    roi.chend = std::min (roi.chend, sat.nchannels());
+    if (roi.npixels() == 0) {
+        for (int c = roi.chbegin;  c < roi.chend;  ++c)
+            sum[c] = 0.0f;
+        return true;
+    }
+    bool ok;
+    OIIO_DISPATCH_TYPES (ok, "area_sum", area_sum_, sat.spec().format,
+                         sat, roi, sum);
+    return ok;
+}
+
+
+
 // Helper function: fft of the horizontal rows
 static bool
 hfft_ (ImageBuf &dst, const ImageBuf &src, bool inverse, bool unitary,
@@ -808,6 +1673,101 @@ hfft_ (ImageBuf &dst, const ImageBuf &src, bool inverse, bool unitary,
 
 
 
+// Helper function: forward fft of the horizontal rows of src, which is
+// taken to be purely real (its imaginary channel is ignored).  Two real
+// rows a and b are transformed together as the complex row z = a + ib,
+// and their transforms recovered from Z as A[k] = (Z[k] + conj(Z[N-k]))/2
+// and B[k] = (Z[k] - conj(Z[N-k]))/2i, so it takes half as many FFTs.
+static bool
+hfft_real_ (ImageBuf &dst, const ImageBuf &src, bool unitary,
+            ROI roi, int nthreads)
+{
+    ASSERT (dst.spec().format.basetype == TypeDesc::FLOAT &&
+            src.spec().format.basetype == TypeDesc::FLOAT &&
+            dst.spec().nchannels == 2 && src.spec().nchannels == 2 &&
+            dst.roi() == src.roi() &&
+            (dst.storage() == ImageBuf::LOCALBUFFER || dst.storage() == ImageBuf::APPBUFFER) &&
+            (src.storage() == ImageBuf::LOCALBUFFER || src.storage() == ImageBuf::APPBUFFER)
+        );
+
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            OIIO::bind (hfft_real_, OIIO::ref(dst), OIIO::cref(src),
+                         unitary, _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads, ImageBufAlgo::Split_Y);
+        return true;
+    }
+
+    // Serial case
+    int width = roi.width();
+    float rescale = unitary ? sqrtf (1.0f / width) : 1.0f;
+    kissfft<float> F (width, false);
+    std::vector<std::complex<float> > zrow (width), Zrow (width);
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        for (int y = roi.ybegin;  y < roi.yend;  y += 2) {
+            const std::complex<float> *a, *b;
+            std::complex<float> *da, *db;
+            a = (const std::complex<float> *)src.pixeladdr(roi.xbegin, y, z);
+            da = (std::complex<float> *)dst.pixeladdr(roi.xbegin, y, z);
+            if (y+1 == roi.yend) {
+                // Odd row out
+                for (int x = 0;  x < width;  ++x)
+                    zrow[x] = std::complex<float> (a[x].real(), 0.0f);
+                F.transform (&zrow[0], da);
+                for (int x = 0;  x < width;  ++x)
+                    da[x] *= rescale;
+                break;
+            }
+            b = (const std::complex<float> *)src.pixeladdr(roi.xbegin, y+1, z);
+            db = (std::complex<float> *)dst.pixeladdr(roi.xbegin, y+1, z);
+            for (int x = 0;  x < width;  ++x)
+                zrow[x] = std::complex<float> (a[x].real(), b[x].real());
+            F.transform (&zrow[0], &Zrow[0]);
+            for (int k = 0;  k < width;  ++k) {
+                std::complex<float> Z = Zrow[k];
+                std::complex<float> Zc = std::conj (Zrow[k ? width-k : 0]);
+                da[k] = (0.5f * rescale) * (Z + Zc);
+                db[k] = std::complex<float> (0.0f, -0.5f * rescale) * (Z - Zc);
+            }
+        }
+    }
+    return true;
+}
+
+
+
+// Helper function: the 2D transform of real data has X[v][u] ==
+// conj(X[-v][-u]). With dst the transposed transform (row u, column v),
+// fill in the rows u in roi (all > width/2 of the original) from the
+// rows width-u, which must already have been computed.
+static bool
+hermitian_fill_ (ImageBuf &dst, ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            OIIO::bind (hermitian_fill_, OIIO::ref(dst),
+                        _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads, ImageBufAlgo::Split_Y);
+        return true;
+    }
+
+    // Serial case
+    int n = dst.spec().height, m = dst.spec().width;
+    for (int u = roi.ybegin;  u < roi.yend;  ++u) {
+        const std::complex<float> *s;
+        std::complex<float> *d;
+        s = (const std::complex<float> *)dst.pixeladdr(0, n-u, 0);
+        d = (std::complex<float> *)dst.pixeladdr(0, u, 0);
+        for (int v = 0;  v < m;  ++v)
+            d[v] = std::conj (s[v ? m-v : 0]);
+    }
+    return true;
+}
+
+
+
 bool
 ImageBufAlgo::fft (ImageBuf &dst, const ImageBuf &src,
                    ROI roi, int nthreads)
@@ -845,9 +1805,10 @@ ImageBufAlgo::fft (ImageBuf &dst, const ImageBuf &src,
 
     // Copy src to a 2-channel (for "complex") float buffer
     ImageBuf A (spec);
-    if (src.nchannels() < 2) {
-        // If we're pasting fewer than 2 channels, zero out channel 1.
-        ROI r = roi;
+    {
+        // We only paste one channel, so zero out channel 1 (the imaginary
+        // part), whatever the number of channels in src.
+        ROI r = get_roi (spec);
         r.chbegin = 1; r.chend = 2;
         zero (A, r);
     }
@@ -856,19 +1817,27 @@ ImageBufAlgo::fft (ImageBuf &dst, const ImageBuf &src,
         return false;
     }
 
-    // FFT the rows (into temp buffer B).
+    // FFT the rows (into temp buffer B), using the fact that they're
+    // real to do two at once.
     ImageBuf B (spec);
-    hfft_ (B, A, false /*inverse*/, true /*unitary*/,
-           get_roi(B.spec()), nthreads);
+    hfft_real_ (B, A, true /*unitary*/, get_roi(B.spec()), nthreads);
 
     // Transpose and shift back to A
     A.clear ();
     ImageBufAlgo::transpose (A, B, ROI::All(), nthreads);
 
-    // FFT what was originally the columns (back to B)
+    // FFT what was originally the columns (back to B). Because the
+    // input was real, only the first half of them need to be done; the
+    // rest are conjugates of those.
     B.reset (specT);
-    hfft_ (B, A, false /*inverse*/, true /*unitary*/,
-           get_roi(A.spec()), nthreads);
+    ROI half = get_roi(A.spec());
+    half.yend = half.ybegin + spec.width/2 + 1;
+    hfft_ (B, A, false /*inverse*/, true /*unitary*/, half, nthreads);
+    if (half.yend < specT.height) {
+        ROI rest = get_roi(B.spec());
+        rest.ybegin = half.yend;
+        hermitian_fill_ (B, rest, nthreads);
+    }
 
     // Transpose again, into the dest
     ImageBufAlgo::transpose (dst, B, ROI::All(), nthreads);
@@ -911,9 +1880,18 @@ ImageBufAlgo::ifft (ImageBuf &dst, const ImageBuf &src,
     spec.channelnames.push_back ("real");
     spec.channelnames.push_back ("imag");
 
-    // Inverse FFT the rows (into temp buffer B).
+    // Inverse FFT the rows (into temp buffer B).  The transform reads
+    // src's scanlines directly, so they must be local and packed.
+    const ImageBuf *rows = &src;
+    ImageBuf packed;
+    if (! src.localpixels() || src.pixel_stride() != 2*sizeof(float) ||
+          src.local_tile_width()) {
+        packed.copy (src);
+        packed.set_local_tiles (0);   // a shared copy keeps src's layout
+        rows = &packed;
+    }
     ImageBuf B (spec);
-    hfft_ (B, src, true /*inverse*/, true /*unitary*/,
+    hfft_ (B, *rows, true /*inverse*/, true /*unitary*/,
            get_roi(B.spec()), nthreads);
 
     // Transpose and shift back to A
@@ -1045,30 +2023,100 @@ ImageBufAlgo::complex_to_polar (ImageBuf &dst, const ImageBuf &src,
 
 
 
-// Helper for fillholes_pp: for any nonzero alpha pixels in dst, divide
-// all components by alpha.
+// Helper for fillholes_pp: make each pixel of the roi of small the box
+// average of the corresponding 2x2 pixels of big (the last row and
+// column also take in any odd leftover row or column of big), then
+// divide all components of nonzero alpha pixels by alpha.  Both images
+// are local float buffers with the same channels and origin (0,0).
 static bool
-divide_by_alpha (ImageBuf &dst, ROI roi, int nthreads)
+pushpull_reduce (ImageBuf &small, const ImageBuf &big, ROI roi, int nthreads)
 {
     if (nthreads != 1 && roi.npixels() >= 1000) {
         // Lots of pixels and request for multi threads? Parallelize.
         ImageBufAlgo::parallel_image (
-            OIIO::bind(divide_by_alpha, OIIO::ref(dst),
+            OIIO::bind(pushpull_reduce, OIIO::ref(small), OIIO::cref(big),
                         _1 /*roi*/, 1 /*nthreads*/),
             roi, nthreads);
         return true;
     }
 
     // Serial case
-    const ImageSpec &spec (dst.spec());
-    ASSERT (spec.format == TypeDesc::FLOAT);
-    int nc = spec.nchannels;
-    int ac = spec.alpha_channel;
-    for (ImageBuf::Iterator<float> d (dst, roi);  ! d.done();  ++d) {
-        float alpha = d[ac];
-        if (alpha != 0.0f) {
-            for (int c = 0; c < nc; ++c)
-                d[c] = d[c] / alpha;
+    const ImageSpec &sspec (small.spec()), &bspec (big.spec());
+    int nc = sspec.nchannels;
+    int ac = sspec.alpha_channel;
+    int sw = sspec.width, sh = sspec.height, bw = bspec.width, bh = bspec.height;
+    float *spels = (float *) small.localpixels();
+    const float *bpels = (const float *) big.localpixels();
+    float *sum = ALLOCA (float, nc);
+    for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+        int by0 = std::min (2*y, bh-1);
+        int by1 = (y == sh-1) ? bh-1 : std::min (2*y+1, bh-1);
+        for (int x = roi.xbegin;  x < roi.xend;  ++x) {
+            int bx0 = std::min (2*x, bw-1);
+            int bx1 = (x == sw-1) ? bw-1 : std::min (2*x+1, bw-1);
+            for (int c = 0;  c < nc;  ++c)
+                sum[c] = 0.0f;
+            for (int by = by0;  by <= by1;  ++by) {
+                const float *b = bpels + ((imagesize_t)by*bw + bx0) * nc;
+                for (int bx = bx0;  bx <= bx1;  ++bx, b += nc)
+                    for (int c = 0;  c < nc;  ++c)
+                        sum[c] += b[c];
+            }
+            float *d = spels + ((imagesize_t)y*sw + x) * nc;
+            float alpha = sum[ac];
+            float scale = (alpha != 0.0f) ? 1.0f / alpha
+                                          : 1.0f / ((by1-by0+1)*(bx1-bx0+1));
+            for (int c = 0;  c < nc;  ++c)
+                d[c] = sum[c] * scale;
+        }
+    }
+    return true;
+}
+
+
+
+// Helper for fillholes_pp: composite each pixel of the roi of big over
+// the bilinearly magnified small, in place.  Both images are local float
+// buffers with the same channels and origin (0,0).
+static bool
+pushpull_upsample_over (ImageBuf &big, const ImageBuf &small,
+                        ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            OIIO::bind(pushpull_upsample_over, OIIO::ref(big),
+                        OIIO::cref(small), _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    const ImageSpec &sspec (small.spec()), &bspec (big.spec());
+    int nc = bspec.nchannels;
+    int ac = bspec.alpha_channel;
+    int sw = sspec.width, sh = sspec.height, bw = bspec.width, bh = bspec.height;
+    float *bpels = (float *) big.localpixels();
+    const float *spels = (const float *) small.localpixels();
+    float xscale = float(sw) / float(bw), yscale = float(sh) / float(bh);
+    for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+        float sy = clamp ((y + 0.5f) * yscale - 0.5f, 0.0f, float(sh-1));
+        int y0 = std::min ((int) sy, sh-1), y1 = std::min (y0+1, sh-1);
+        float fy = sy - y0;
+        for (int x = roi.xbegin;  x < roi.xend;  ++x) {
+            float sx = clamp ((x + 0.5f) * xscale - 0.5f, 0.0f, float(sw-1));
+            int x0 = std::min ((int) sx, sw-1), x1 = std::min (x0+1, sw-1);
+            float fx = sx - x0;
+            const float *s00 = spels + ((imagesize_t)y0*sw + x0) * nc;
+            const float *s01 = spels + ((imagesize_t)y0*sw + x1) * nc;
+            const float *s10 = spels + ((imagesize_t)y1*sw + x0) * nc;
+            const float *s11 = spels + ((imagesize_t)y1*sw + x1) * nc;
+            float *d = bpels + ((imagesize_t)y*bw + x) * nc;
+            float one_minus_alpha = 1.0f - d[ac];
+            for (int c = 0;  c < nc;  ++c) {
+                float up = bilerp (s00[c], s01[c], s10[c], s11[c], fx, fy);
+                d[c] += one_minus_alpha * up;
+            }
         }
     }
     return true;
@@ -1098,46 +2146,40 @@ ImageBufAlgo::fillholes_pushpull (ImageBuf &dst, const ImageBuf &src,
         return false;
     }
 
-    // We generate a bunch of temp images to form an image pyramid.
-    // These give us a place to stash them and make sure they are
-    // auto-deleted when the function exits.
+    // The whole pyramid is allocated up front: a writeable float copy of
+    // the original image (moved to origin 0,0) as the top level, then
+    // successive x/2 levels down to 1x1.  The shared_ptrs make sure they
+    // are auto-deleted when the function exits.
     std::vector<OIIO::shared_ptr<ImageBuf> > pyramid;
-
-    // First, make a writeable copy of the original image (converting
-    // to float as a convenience) as the top level of the pyramid.
     ImageSpec topspec = src.spec();
     topspec.set_format (TypeDesc::FLOAT);
-    ImageBuf *top = new ImageBuf (topspec);
-    paste (*top, topspec.x, topspec.y, topspec.z, 0, src);
-    pyramid.push_back (OIIO::shared_ptr<ImageBuf>(top));
-
-    // Construct the rest of the pyramid by successive x/2 resizing and
-    // then dividing nonzero alpha pixels by their alpha (this "spreads
-    // out" the defined part of the image).
-    int w = src.spec().width, h = src.spec().height;
+    topspec.x = 0;  topspec.y = 0;  topspec.z = 0;
+    pyramid.push_back (OIIO::shared_ptr<ImageBuf>(new ImageBuf (topspec)));
+    int w = topspec.width, h = topspec.height;
     while (w > 1 || h > 1) {
         w = std::max (1, w/2);
         h = std::max (1, h/2);
         ImageSpec smallspec (w, h, src.nchannels(), TypeDesc::FLOAT);
-        ImageBuf *small = new ImageBuf (smallspec);
-        ImageBufAlgo::resize (*small, *pyramid.back(), "triangle");
-        divide_by_alpha (*small, get_roi(smallspec), nthreads);
-        pyramid.push_back (OIIO::shared_ptr<ImageBuf>(small));
-        //debug small->save();
+        smallspec.alpha_channel = topspec.alpha_channel;
+        pyramid.push_back (OIIO::shared_ptr<ImageBuf>(new ImageBuf (smallspec)));
     }
+    paste (*pyramid[0], 0, 0, 0, 0, src);
+
+    // Fill the rest of the pyramid by 2x box reduction, dividing nonzero
+    // alpha pixels by their alpha as we go (this "spreads out" the
+    // defined part of the image).
+    for (size_t i = 1;  i < pyramid.size();  ++i)
+        pushpull_reduce (*pyramid[i], *pyramid[i-1],
+                         get_roi(pyramid[i]->spec()), nthreads);
 
     // Now pull back up the pyramid by doing an alpha composite of level
-    // i over a resized level i+1, thus filling in the alpha holes.  By
+    // i over a magnified level i+1, thus filling in the alpha holes.  By
     // time we get to the top, pixels whose original alpha are
     // unchanged, those with alpha < 1 are replaced by the blended
     // colors of the higher pyramid levels.
-    for (int i = (int)pyramid.size()-2;  i >= 0;  --i) {
-        ImageBuf &big(*pyramid[i]), &small(*pyramid[i+1]);
-        ImageBuf blowup (big.spec());
-        ImageBufAlgo::resize (blowup, small, "triangle");
-        ImageBufAlgo::over (big, big, blowup);
-        //debug big.save (Strutil::format ("after%d.exr", i));
-    }
+    for (int i = (int)pyramid.size()-2;  i >= 0;  --i)
+        pushpull_upsample_over (*pyramid[i], *pyramid[i+1],
+                                get_roi(pyramid[i]->spec()), nthreads);
 
     // Now copy the completed base layer of the pyramid back to the
     // original requested output.
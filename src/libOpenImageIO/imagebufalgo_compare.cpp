@@ -42,6 +42,9 @@
 #include "OpenImageIO/imagebufalgo.h"
 #include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/dassert.h"
+#include "OpenImageIO/hash.h"
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/thread.h"
 #include "OpenImageIO/SHA1.h"
 
 #ifdef USE_OPENSSL
@@ -130,16 +133,21 @@ finalize (ImageBufAlgo::PixelStats &p)
 
 
 
+struct PixelStatsMerge {
+    void operator() (ImageBufAlgo::PixelStats &sum,
+                     const ImageBufAlgo::PixelStats &p) const {
+        merge (sum, p);
+    }
+};
+
+
+
+// Accumulate the stats of the roi region of src into stats.
 template <class T>
-static bool
-computePixelStats_ (const ImageBuf &src, ImageBufAlgo::PixelStats &stats,
-                    ROI roi, int nthreads)
+static void
+computePixelStats_band_ (const ImageBuf &src, ROI roi,
+                         ImageBufAlgo::PixelStats &stats)
 {
-    if (! roi.defined())
-        roi = get_roi (src.spec());
-    else
-        roi.chend = std::min (roi.chend, src.nchannels());
-
     int nchannels = src.spec().nchannels;
 
     // Use local storage for smaller batches, then merge the batches
@@ -153,7 +161,6 @@ computePixelStats_ (const ImageBuf &src, ImageBufAlgo::PixelStats &stats,
     // number of pixels / batch.
     ImageBufAlgo::PixelStats tmp;
     reset (tmp, nchannels);
-    reset (stats, nchannels);
     
     int PIXELS_PER_BATCH = std::max (1024,
             static_cast<int>(sqrt((double)src.spec().image_pixels())));
@@ -191,6 +198,28 @@ computePixelStats_ (const ImageBuf &src, ImageBufAlgo::PixelStats &stats,
 
     // Merge anything left over
     merge (stats, tmp);
+}
+
+
+
+template <class T>
+static bool
+computePixelStats_ (const ImageBuf &src, ImageBufAlgo::PixelStats &stats,
+                    ROI roi, int nthreads)
+{
+    if (! roi.defined())
+        roi = get_roi (src.spec());
+    else
+        roi.chend = std::min (roi.chend, src.nchannels());
+
+    // Each thread gathers the stats of its own band, which are merged
+    // (just as the batches within a band are) at the end.
+    ImageBufAlgo::PixelStats init;
+    reset (init, src.spec().nchannels);
+    reset (stats, src.spec().nchannels);
+    ImageBufAlgo::parallel_reduce (
+        OIIO::bind (computePixelStats_band_<T>, OIIO::cref(src), _1, _2),
+        PixelStatsMerge(), init, stats, roi, nthreads);
 
     // Compute final results
     finalize (stats);
@@ -222,6 +251,121 @@ ImageBufAlgo::computePixelStats (PixelStats &stats, const ImageBuf &src,
 
 
 
+// Partial results of analyze_ for one band of the image.
+struct AnalysisAccum {
+    ImageBufAlgo::ImageAnalysis result;
+    int max_locations;
+};
+
+struct AnalysisMerge {
+    void operator() (AnalysisAccum &sum, const AnalysisAccum &p) const {
+        ImageBufAlgo::ImageAnalysis &r (sum.result);
+        merge (r.stats, p.result.stats);
+        r.monochrome &= p.result.monochrome;
+        r.nonfinite_pixels += p.result.nonfinite_pixels;
+        for (size_t i = 0, e = p.result.nonfinite_x.size();
+             i < e && (int)r.nonfinite_x.size() < sum.max_locations;  ++i) {
+            r.nonfinite_x.push_back (p.result.nonfinite_x[i]);
+            r.nonfinite_y.push_back (p.result.nonfinite_y[i]);
+            r.nonfinite_value.push_back (p.result.nonfinite_value[i]);
+        }
+    }
+};
+
+
+
+template <class T>
+static void
+analyze_band_ (const ImageBuf &src, ROI roi, AnalysisAccum &accum)
+{
+    ImageBufAlgo::ImageAnalysis &r (accum.result);
+    int nchannels = src.spec().nchannels;
+    // Batch the stats sums as computePixelStats_band_ does.
+    ImageBufAlgo::PixelStats tmp;
+    reset (tmp, nchannels);
+    int PIXELS_PER_BATCH = std::max (1024,
+            static_cast<int>(sqrt((double)src.spec().image_pixels())));
+    int batch = 0;
+    bool monochrome = true;
+    for (ImageBuf::ConstIterator<T> s(src, roi); ! s.done();  ++s) {
+        float first = s[roi.chbegin];
+        bool finite = true;
+        float bad = 0.0f;
+        for (int c = roi.chbegin;  c < roi.chend;  ++c) {
+            float value = s[c];
+            if (! isfinite (value) && finite) {
+                finite = false;
+                bad = value;
+            }
+            monochrome &= (value == first);
+            val (tmp, c, value);
+        }
+        if (! finite) {
+            ++r.nonfinite_pixels;
+            if ((int)r.nonfinite_x.size() < accum.max_locations) {
+                r.nonfinite_x.push_back (s.x());
+                r.nonfinite_y.push_back (s.y());
+                r.nonfinite_value.push_back (bad);
+            }
+        }
+        if (++batch == PIXELS_PER_BATCH) {
+            merge (r.stats, tmp);
+            reset (tmp, nchannels);
+            batch = 0;
+        }
+    }
+    merge (r.stats, tmp);
+    r.monochrome &= monochrome;
+}
+
+
+
+template <class T>
+static bool
+analyze_ (const ImageBuf &src, ImageBufAlgo::ImageAnalysis &result,
+          ROI roi, int nthreads, int max_locations)
+{
+    AnalysisAccum init, accum;
+    init.max_locations = max_locations;
+    reset (init.result.stats, src.nchannels());
+    init.result.monochrome = true;
+    init.result.nonfinite_pixels = 0;
+    accum = init;
+    ImageBufAlgo::parallel_reduce (
+        OIIO::bind (analyze_band_<T>, OIIO::cref(src), _1, _2),
+        AnalysisMerge(), init, accum, roi, nthreads);
+    finalize (accum.result.stats);
+    result = accum.result;
+    return ! src.has_error();
+}
+
+
+
+bool
+ImageBufAlgo::analyze (ImageAnalysis &result, const ImageBuf &src,
+                       ROI roi, int nthreads, int max_locations)
+{
+    if (! roi.defined())
+        roi = get_roi (src.spec());
+    else
+        roi.chend = std::min (roi.chend, src.nchannels());
+    if (src.nchannels() == 0 || roi.nchannels() < 1) {
+        src.error ("%d-channel images not supported", src.nchannels());
+        return false;
+    }
+    if (src.deep()) {
+        src.error ("analyze does not support deep images");
+        return false;
+    }
+
+    bool ok;
+    OIIO_DISPATCH_TYPES (ok, "analyze", analyze_, src.spec().format,
+                         src, result, roi, nthreads, max_locations);
+    return ok;
+}
+
+
+
 template<class BUFT>
 inline void
 compare_value (ImageBuf::ConstIterator<BUFT,float> &a, int chan,
@@ -268,25 +412,51 @@ compare_value (ImageBuf::ConstIterator<BUFT,float> &a, int chan,
 
 
 
+// Partial results of compare_ for one band of the image.
+struct CompareAccum {
+    CompareAccum () : totalerror(0.0), totalsqrerror(0.0), maxval(1.0f) {
+        result.maxerror = 0;
+        result.maxx = 0, result.maxy = 0, result.maxz = 0, result.maxc = 0;
+        result.nfail = 0, result.nwarn = 0;
+    }
+    ImageBufAlgo::CompareResults result;
+    double totalerror, totalsqrerror;
+    float maxval;
+};
+
+// Merge a later band's CompareAccum into the total.  The location of the
+// max error is that of the first band to have it, just as a serial pass
+// would find it.
+struct CompareMerge {
+    void operator() (CompareAccum &sum, const CompareAccum &p) const {
+        if (!(p.result.maxerror <= sum.result.maxerror)) {
+            sum.result.maxerror = p.result.maxerror;
+            sum.result.maxx = p.result.maxx;
+            sum.result.maxy = p.result.maxy;
+            sum.result.maxz = p.result.maxz;
+            sum.result.maxc = p.result.maxc;
+        }
+        sum.result.nfail += p.result.nfail;
+        sum.result.nwarn += p.result.nwarn;
+        sum.totalerror += p.totalerror;
+        sum.totalsqrerror += p.totalsqrerror;
+        sum.maxval = std::max (sum.maxval, p.maxval);
+    }
+};
+
+
+
 template <class Atype, class Btype>
-static bool
-compare_ (const ImageBuf &A, const ImageBuf &B,
-          float failthresh, float warnthresh,
-          ImageBufAlgo::CompareResults &result,
-          ROI roi, int nthreads)
+static void
+compare_band_ (const ImageBuf &A, const ImageBuf &B,
+               float failthresh, float warnthresh,
+               ROI roi, CompareAccum &accum)
 {
-    imagesize_t npels = roi.npixels();
-    imagesize_t nvals = npels * roi.nchannels();
     int Achannels = A.nchannels(), Bchannels = B.nchannels();
-
-    // Compare the two images.
-    //
-    double totalerror = 0;
-    double totalsqrerror = 0;
-    result.maxerror = 0;
-    result.maxx=0, result.maxy=0, result.maxz=0, result.maxc=0;
-    result.nfail = 0, result.nwarn = 0;
-    float maxval = 1.0;  // max possible value
+    ImageBufAlgo::CompareResults &result (accum.result);
+    double &totalerror (accum.totalerror);
+    double &totalsqrerror (accum.totalsqrerror);
+    float &maxval (accum.maxval);
 
     ImageBuf::ConstIterator<Atype> a (A, roi, ImageBuf::WrapBlack);
     ImageBuf::ConstIterator<Btype> b (B, roi, ImageBuf::WrapBlack);
@@ -321,6 +491,36 @@ compare_ (const ImageBuf &A, const ImageBuf &B,
         totalerror += batcherror;
         totalsqrerror += batch_sqrerror;
     }
+}
+
+
+
+template <class Atype, class Btype>
+static bool
+compare_ (const ImageBuf &A, const ImageBuf &B,
+          float failthresh, float warnthresh,
+          ImageBufAlgo::CompareResults &result,
+          ROI roi, int nthreads)
+{
+    imagesize_t npels = roi.npixels();
+    imagesize_t nvals = npels * roi.nchannels();
+
+    // Compare the two images, each thread doing one band.
+    CompareAccum accum;
+    ImageBufAlgo::parallel_reduce (
+        OIIO::bind (compare_band_<Atype,Btype>, OIIO::cref(A), OIIO::cref(B),
+                    failthresh, warnthresh, _1, _2),
+        CompareMerge(), CompareAccum(), accum, roi, nthreads);
+    double totalerror = accum.totalerror;
+    double totalsqrerror = accum.totalsqrerror;
+    float maxval = accum.maxval;
+    result.maxerror = accum.result.maxerror;
+    result.maxx = accum.result.maxx;
+    result.maxy = accum.result.maxy;
+    result.maxz = accum.result.maxz;
+    result.maxc = accum.result.maxc;
+    result.nfail = accum.result.nfail;
+    result.nwarn = accum.result.nwarn;
     result.meanerror = totalerror / nvals;
     result.rms_error = sqrt (totalsqrerror / nvals);
     result.PSNR = 20.0 * log10 (maxval / result.rms_error);
@@ -350,9 +550,6 @@ ImageBufAlgo::compare (const ImageBuf &A, const ImageBuf &B,
                           A.spec().format, B.spec().format,
                           A, B, failthresh, warnthresh, result,
                           roi, nthreads);
-    // FIXME - The nthreads argument is for symmetry with the rest of
-    // ImageBufAlgo and for future expansion. But for right now, we
-    // don't actually split by threads.  Maybe later.
     return ok;
 }
 
@@ -490,27 +687,23 @@ ImageBufAlgo::isMonochrome (const ImageBuf &src, ROI roi, int nthreads)
 
 
 
-template<typename T>
-static bool
-color_count_ (const ImageBuf &src, atomic_ll *count,
-              int ncolors, const float *color, const float *eps,
-              ROI roi, int nthreads)
-{
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Lots of pixels and request for multi threads? Parallelize.
-        ImageBufAlgo::parallel_image (
-            OIIO::bind(color_count_<T>, OIIO::ref(src),
-                        count, ncolors, color, eps,
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
+// Sum per-band vectors of counts.
+struct CountsMerge {
+    void operator() (std::vector<imagesize_t> &sum,
+                     const std::vector<imagesize_t> &p) const {
+        for (size_t i = 0, e = sum.size();  i < e;  ++i)
+            sum[i] += p[i];
     }
+};
 
-    // Serial case
+
+
+template<typename T>
+static void
+color_count_band_ (const ImageBuf &src, int ncolors, const float *color,
+                   const float *eps, ROI roi, std::vector<imagesize_t> &count)
+{
     int nchannels = src.nchannels();
-    long long *n = ALLOCA (long long, ncolors);
-    for (int col = 0;  col < ncolors;  ++col)
-        n[col] = 0;
     for (ImageBuf::ConstIterator<T> p (src, roi);  !p.done();  ++p) {
         int coloffset = 0;
         for (int col = 0;  col < ncolors;  ++col, coloffset += nchannels) {
@@ -521,12 +714,29 @@ color_count_ (const ImageBuf &src, atomic_ll *count,
                     break;
                 }
             }
-            n[col] += match;
+            count[col] += match;
         }
     }
+}
+
 
+
+template<typename T>
+static bool
+color_count_ (const ImageBuf &src, imagesize_t *count,
+              int ncolors, const float *color, const float *eps,
+              ROI roi, int nthreads)
+{
+    // Each band counts into its own vector; no atomics needed.
+    if (roi.npixels() < 1000)
+        nthreads = 1;
+    std::vector<imagesize_t> total (ncolors, 0);
+    ImageBufAlgo::parallel_reduce (
+        OIIO::bind (color_count_band_<T>, OIIO::cref(src), ncolors,
+                    color, eps, _1, _2),
+        CountsMerge(), total, total, roi, nthreads);
     for (int col = 0;  col < ncolors;  ++col)
-        count[col] += n[col];
+        count[col] = total[col];
     return true;
 }
 
@@ -550,36 +760,23 @@ ImageBufAlgo::color_count (const ImageBuf &src, imagesize_t *count,
         eps = localeps;
     }
 
-    for (int col = 0;  col < ncolors;  ++col)
-        count[col] = 0;
     bool ok;
     OIIO_DISPATCH_TYPES (ok, "color_count", color_count_, src.spec().format,
-                         src, (atomic_ll *)count, ncolors, color, eps,
+                         src, count, ncolors, color, eps,
                          roi, nthreads);
     return ok;
 }
 
 
 
+// Per-band vector of {low, high, inrange} counts.
 template<typename T>
-static bool
-color_range_check_ (const ImageBuf &src, atomic_ll *lowcount,
-                    atomic_ll *highcount, atomic_ll *inrangecount,
-                    const float *low, const float *high,
-                    ROI roi, int nthreads)
+static void
+color_range_check_band_ (const ImageBuf &src, const float *low,
+                         const float *high, ROI roi,
+                         std::vector<imagesize_t> &counts)
 {
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Lots of pixels and request for multi threads? Parallelize.
-        ImageBufAlgo::parallel_image (
-            OIIO::bind(color_range_check_<T>, OIIO::ref(src),
-                        lowcount, highcount, inrangecount, low, high,
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    long long lc = 0, hc = 0, inrange = 0;
+    imagesize_t lc = 0, hc = 0, inrange = 0;
     for (ImageBuf::ConstIterator<T> p (src, roi);  !p.done();  ++p) {
         bool lowval = false, highval = false;
         for (int c = roi.chbegin;  c < roi.chend;  ++c) {
@@ -594,13 +791,33 @@ color_range_check_ (const ImageBuf &src, atomic_ll *lowcount,
         if (!lowval && !highval)
             ++inrange;
     }
+    counts[0] += lc;
+    counts[1] += hc;
+    counts[2] += inrange;
+}
+
+
 
+template<typename T>
+static bool
+color_range_check_ (const ImageBuf &src, imagesize_t *lowcount,
+                    imagesize_t *highcount, imagesize_t *inrangecount,
+                    const float *low, const float *high,
+                    ROI roi, int nthreads)
+{
+    if (roi.npixels() < 1000)
+        nthreads = 1;
+    std::vector<imagesize_t> total (3, 0);
+    ImageBufAlgo::parallel_reduce (
+        OIIO::bind (color_range_check_band_<T>, OIIO::cref(src),
+                    low, high, _1, _2),
+        CountsMerge(), total, total, roi, nthreads);
     if (lowcount)
-        *lowcount += lc;
+        *lowcount = total[0];
     if (highcount)
-        *highcount += hc;
+        *highcount = total[1];
     if (inrangecount)
-        *inrangecount += inrange;
+        *inrangecount = total[2];
     return true;
 }
 
@@ -618,18 +835,10 @@ ImageBufAlgo::color_range_check (const ImageBuf &src, imagesize_t *lowcount,
         roi = get_roi(src.spec());
     roi.chend = std::min (roi.chend, src.nchannels());
 
-    if (lowcount)
-        *lowcount = 0;
-    if (highcount)
-        *highcount = 0;
-    if (inrangecount)
-        *inrangecount = 0;
     bool ok;
     OIIO_DISPATCH_TYPES (ok, "color_range_check", color_range_check_,
-                         src.spec().format,
-                         src, (atomic_ll *)lowcount, 
-                         (atomic_ll *)highcount, (atomic_ll *)inrangecount,
-                         low, high, roi, nthreads);
+                         src.spec().format, src, lowcount, highcount,
+                         inrangecount, low, high, roi, nthreads);
     return ok;
 }
 
@@ -725,7 +934,7 @@ simplePixelHashSHA1 (const ImageBuf &src,
     if (! roi.defined())
         roi = get_roi (src.spec());
 
-    bool localpixels = src.localpixels();
+    bool localpixels = src.localpixels() && src.contiguous();
     imagesize_t scanline_bytes = roi.width() * src.spec().pixel_bytes();
     ASSERT (scanline_bytes < std::numeric_limits<unsigned int>::max());
     // Do it a few scanlines at a time
@@ -801,45 +1010,105 @@ simplePixelHashSHA1 (const ImageBuf &src,
 
 
 
-// Wrapper to single-threadedly SHA1 hash a region in blocks and store
+// xxHash64 of the pixels of a region, chained one scanline at a time
+// (so the result doesn't depend on how the pixels are stored), returned
+// as 16 hex digits.
+std::string
+simplePixelHashXXH64 (const ImageBuf &src, string_view extrainfo, ROI roi)
+{
+    if (! roi.defined())
+        roi = get_roi (src.spec());
+
+    bool localpixels = src.localpixels() && src.contiguous();
+    imagesize_t scanline_bytes = roi.width() * src.spec().pixel_bytes();
+    // Do it a few scanlines at a time
+    int chunk = std::max (1, int(16*1024*1024/scanline_bytes));
+
+    std::vector<unsigned char> tmp;
+    if (! localpixels)
+        tmp.resize (chunk*scanline_bytes);
+
+    unsigned long long hash = 0;
+    for (int z = roi.zbegin, zend=roi.zend;  z < zend;  ++z) {
+        for (int y = roi.ybegin, yend=roi.yend;  y < yend;  y += chunk) {
+            int y1 = std::min (y+chunk, yend);
+            if (localpixels) {
+                for (int yy = y;  yy < y1;  ++yy)
+                    hash = xxhash::XXH64 (src.pixeladdr (roi.xbegin, yy, z),
+                                          scanline_bytes, hash);
+            } else {
+                src.get_pixels (ROI (roi.xbegin, roi.xend, y, y1, z, z+1),
+                                src.spec().format, &tmp[0]);
+                for (int yy = 0;  yy < y1-y;  ++yy)
+                    hash = xxhash::XXH64 (&tmp[yy*scanline_bytes],
+                                          scanline_bytes, hash);
+            }
+        }
+    }
+
+    // If extra info is specified, also include it in the hash
+    if (extrainfo.size())
+        hash = xxhash::XXH64 (extrainfo.data(), extrainfo.size(), hash);
+    return Strutil::format ("%016llX", hash);
+}
+
+
+
+// Wrapper to single-threadedly hash a region in blocks and store
 // the results in a designated place.
 static void
-sha1_hasher (const ImageBuf *src, ROI roi, int blocksize,
-             std::string *results, int firstresult)
+block_hasher (const ImageBuf *src, ROI roi, int blocksize, bool xxh64,
+              std::string *results, int firstresult)
 {
+    if (! xxh64 && src->localpixels() && src->contiguous() &&
+        roi.depth() == 1) {
+        // The blocks are in memory: hash several at once, each in its
+        // own SIMD lane, reading just the bytes simplePixelHashSHA1
+        // would.
+        const int group = 8;
+        size_t scanline_bytes = roi.width() * src->spec().pixel_bytes();
+        for (int y = roi.ybegin; y < roi.yend; y += group*blocksize) {
+            const void *data[group];
+            size_t sizes[group];
+            SHA1::Hash hashes[group];
+            int n = 0;
+            for (int yb = y;  n < group && yb < roi.yend;  ++n, yb += blocksize) {
+                data[n] = src->pixeladdr (roi.xbegin, yb, roi.zbegin);
+                sizes[n] = scanline_bytes * (std::min (yb+blocksize, roi.yend) - yb);
+            }
+            SHA1::hash_many (n, data, sizes, hashes);
+            for (int i = 0;  i < n;  ++i)
+                results[firstresult++] = SHA1::hex_digest (hashes[i]);
+        }
+        return;
+    }
     ROI broi = roi;
     for (int y = roi.ybegin; y < roi.yend; y += blocksize) {
         broi.ybegin = y;
         broi.yend = std::min (y+blocksize, roi.yend);
-        std::string s = simplePixelHashSHA1 (*src, "", broi);
+        std::string s = xxh64 ? simplePixelHashXXH64 (*src, "", broi)
+                              : simplePixelHashSHA1 (*src, "", broi);
         results[firstresult++] = s;
     }
 }
 
-} // anon namespace
-
 
 
-std::string
-ImageBufAlgo::computePixelHashSHA1 (const ImageBuf &src,
-                                    string_view extrainfo,
-                                    ROI roi, int blocksize, int nthreads)
+// Hash each blocksize batch of scanlines of roi (in parallel), storing
+// the individual block hashes in results.
+static void
+hash_blocks (const ImageBuf &src, ROI roi, int blocksize, bool xxh64,
+             int nthreads, std::vector<std::string> &results)
 {
-    if (! roi.defined())
-        roi = get_roi (src.spec());
-
-    // Fall back to whole-image hash for only one block
-    if (blocksize <= 0 || blocksize >= roi.height())
-        return simplePixelHashSHA1 (src, extrainfo, roi);
-
     // Request for 0 threads means "use the OIIO global thread count"
     if (nthreads <= 0)
         OIIO::getattribute ("threads", nthreads);
 
     int nblocks = (roi.height()+blocksize-1) / blocksize;
-    std::vector<std::string> results (nblocks);
+    results.clear ();
+    results.resize (nblocks);
     if (nthreads <= 1) {
-        sha1_hasher (&src, roi, blocksize, &results[0], 0);
+        block_hasher (&src, roi, blocksize, xxh64, &results[0], 0);
     } else {
         // parallel case
         OIIO::thread_group threads;
@@ -851,11 +1120,33 @@ ImageBufAlgo::computePixelHashSHA1 (const ImageBuf &src,
                 break;
             broi.ybegin = y;
             broi.yend = std::min (y+blocksize*blocks_per_thread, roi.yend);
-            threads.add_thread (new OIIO::thread (sha1_hasher, &src, broi,
-                                                   blocksize, &results[0], b));
+            threads.add_thread (new OIIO::thread (block_hasher, &src, broi,
+                                                   blocksize, xxh64,
+                                                   &results[0], b));
         }
         threads.join_all ();
     }
+}
+
+} // anon namespace
+
+
+
+std::string
+ImageBufAlgo::computePixelHashSHA1 (const ImageBuf &src,
+                                    string_view extrainfo,
+                                    ROI roi, int blocksize, int nthreads)
+{
+    if (! roi.defined())
+        roi = get_roi (src.spec());
+
+    // Fall back to whole-image hash for only one block
+    if (blocksize <= 0 || blocksize >= roi.height())
+        return simplePixelHashSHA1 (src, extrainfo, roi);
+
+    std::vector<std::string> results;
+    hash_blocks (src, roi, blocksize, false, nthreads, results);
+    int nblocks = (int) results.size();
 
 #ifdef USE_OPENSSL
     // If OpenSSL was available at build time, use its SHA-1
@@ -890,6 +1181,38 @@ ImageBufAlgo::computePixelHashSHA1 (const ImageBuf &src,
 
 
 
+std::string
+ImageBufAlgo::computePixelHash (const ImageBuf &src, string_view algorithm,
+                                string_view extrainfo,
+                                ROI roi, int blocksize, int nthreads)
+{
+    if (Strutil::iequals (algorithm, "sha1") ||
+        Strutil::iequals (algorithm, "sha-1"))
+        return computePixelHashSHA1 (src, extrainfo, roi, blocksize, nthreads);
+    if (! Strutil::iequals (algorithm, "xxhash64"))
+        return std::string();   // unknown algorithm
+
+    if (! roi.defined())
+        roi = get_roi (src.spec());
+
+    // Fall back to whole-image hash for only one block
+    if (blocksize <= 0 || blocksize >= roi.height())
+        return simplePixelHashXXH64 (src, extrainfo, roi);
+
+    // Hash the block hashes in order, so the result only depends on the
+    // blocksize, not on how many threads computed the blocks.
+    std::vector<std::string> results;
+    hash_blocks (src, roi, blocksize, true, nthreads, results);
+    unsigned long long hash = 0;
+    for (size_t b = 0;  b < results.size();  ++b)
+        hash = xxhash::XXH64 (results[b].data(), results[b].size(), hash);
+    if (extrainfo.size())
+        hash = xxhash::XXH64 (extrainfo.data(), extrainfo.size(), hash);
+    return Strutil::format ("%016llX", hash);
+}
+
+
+
 
 /// histogram_impl -----------------------------------------------------------
 /// Fully type-specialized version of histogram.
@@ -901,30 +1224,18 @@ ImageBufAlgo::computePixelHashSHA1 (const ImageBuf &src,
 /// case x==max for which the formula is not used and x is assigned to the
 /// last bin at position (bins-1) in the vector histogram.
 /// --------------------------------------------------------------------------
+// Per-band histogram: the bins, followed by the submin and supermax counts.
 template<class Atype>
-static bool
-histogram_impl (const ImageBuf &A, int channel,
-                std::vector<imagesize_t> &histogram, int bins,
-                float min, float max, imagesize_t *submin,
-                imagesize_t *supermax, ROI roi)
+static void
+histogram_band_ (const ImageBuf &A, int channel, int bins,
+                 float min, float max, ROI roi,
+                 std::vector<imagesize_t> &histogram)
 {
-    // Double check A's type.
-    if (A.spec().format != BaseTypeFromC<Atype>::value) {
-        A.error ("Unsupported pixel data format '%s'", A.spec().format);
-        return false;
-    }
-
-    // Initialize.
     ImageBuf::ConstIterator<Atype, float> a (A, roi);
     float ratio = bins / (max-min);
     int bins_minus_1 = bins-1;
-    bool submin_ok = submin != NULL;
-    bool supermax_ok = supermax != NULL;
-    if (submin_ok)
-        *submin = 0;
-    if (supermax_ok)
-        *supermax = 0;
-    histogram.assign(bins, 0);
+    imagesize_t &submin (histogram[bins]);
+    imagesize_t &supermax (histogram[bins+1]);
 
     // Compute histogram.
     for ( ; ! a.done(); a++) {
@@ -935,12 +1246,41 @@ histogram_impl (const ImageBuf &A, int channel,
         } else if (c == max) {
             histogram[bins_minus_1]++;
         } else {
-            if (submin_ok && c < min)
-                (*submin)++;
-            else if (supermax_ok)
-                (*supermax)++;
+            if (c < min)
+                submin++;
+            else
+                supermax++;
         }
     }
+}
+
+
+
+template<class Atype>
+static bool
+histogram_impl (const ImageBuf &A, int channel,
+                std::vector<imagesize_t> &histogram, int bins,
+                float min, float max, imagesize_t *submin,
+                imagesize_t *supermax, ROI roi, int nthreads)
+{
+    // Double check A's type.
+    if (A.spec().format != BaseTypeFromC<Atype>::value) {
+        A.error ("Unsupported pixel data format '%s'", A.spec().format);
+        return false;
+    }
+
+    // Each band fills its own histogram, and the bands are summed.
+    std::vector<imagesize_t> total (bins+2, 0);
+    ImageBufAlgo::parallel_reduce (
+        OIIO::bind (histogram_band_<Atype>, OIIO::cref(A), channel, bins,
+                    min, max, _1, _2),
+        CountsMerge(), total, total, roi, nthreads);
+    if (submin)
+        *submin = total[bins];
+    if (supermax)
+        *supermax = total[bins+1];
+    total.resize (bins);
+    histogram.swap (total);
     return true;
 }
 
@@ -950,7 +1290,7 @@ bool
 ImageBufAlgo::histogram (const ImageBuf &A, int channel,
                          std::vector<imagesize_t> &histogram, int bins,
                          float min, float max, imagesize_t *submin,
-                         imagesize_t *supermax, ROI roi)
+                         imagesize_t *supermax, ROI roi, int nthreads)
 {
     if (A.spec().format != TypeDesc::TypeFloat) {
         A.error ("Unsupported pixel data format '%s'", A.spec().format);
@@ -983,7 +1323,7 @@ ImageBufAlgo::histogram (const ImageBuf &A, int channel,
         roi = get_roi (A.spec());
 
     histogram_impl<float> (A, channel, histogram, bins, min, max,
-                                  submin, supermax, roi);
+                           submin, supermax, roi, nthreads);
 
     return ! A.has_error();
 }
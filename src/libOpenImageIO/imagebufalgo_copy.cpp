@@ -38,11 +38,14 @@
 #include <cmath>
 #include <iostream>
 
+#include <boost/regex.hpp>
+
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/imagebufalgo.h"
 #include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/deepdata.h"
 #include "OpenImageIO/thread.h"
+#include "OpenImageIO/simd.h"
 
 
 
@@ -195,6 +198,29 @@ bool
 ImageBufAlgo::crop (ImageBuf &dst, const ImageBuf &src,
                     ROI roi, int nthreads)
 {
+    // A crop of all channels within src's pixels needn't copy anything:
+    // dst can be a copy-on-write view of src.  Give it the spec that
+    // IBAprep would have.
+    ROI viewroi = roi.defined() ? roi : src.roi();
+    if (&dst != &src && viewroi.chbegin == 0 &&
+          viewroi.chend >= src.nchannels()) {
+        ImageBuf view;
+        if (view.make_view (src, viewroi)) {
+            ImageSpec &spec (view.specmod());
+            spec.tile_width = 0;
+            spec.tile_height = 0;
+            spec.tile_depth = 0;
+            spec.erase_attribute ("oiio:SHA-1");
+            static boost::regex regex_sha ("SHA-1=[[:xdigit:]]*[ ]*");
+            std::string desc = spec.get_string_attribute ("ImageDescription");
+            if (desc.size())
+                spec.attribute ("ImageDescription",
+                                boost::regex_replace (desc, regex_sha, ""));
+            dst.swap (view);
+            return true;
+        }
+    }
+
     dst.clear ();
     roi.chend = std::min (roi.chend, src.nchannels());
     if (! IBAprep (roi, &dst, &src, IBAprep_SUPPORT_DEEP))
@@ -236,6 +262,168 @@ ImageBufAlgo::cut (ImageBuf &dst, const ImageBuf &src,
 }
 
 
+// Axis-aligned pixel remapping used by the reorientation operations:
+// dst pixel (x,y,z) is copied from src pixel
+// (x0 + xx*x + xy*y, y0 + yx*x + yy*y, z), where the coefficients form
+// a signed permutation matrix (each is -1, 0, or 1).
+struct PixelRemap {
+    int x0, xx, xy;
+    int y0, yx, yy;
+    PixelRemap (int x0, int xx, int xy, int y0, int yx, int yy)
+        : x0(x0), xx(xx), xy(xy), y0(y0), yx(yx), yy(yy) { }
+    int srcx (int x, int y) const { return x0 + xx*x + xy*y; }
+    int srcy (int x, int y) const { return y0 + yx*x + yy*y; }
+
+    // Bounding box of the src pixels that feed the dst region roi.
+    ROI src_roi (ROI roi) const {
+        int ax = srcx (roi.xbegin, roi.ybegin), bx = srcx (roi.xend-1, roi.yend-1);
+        int ay = srcy (roi.xbegin, roi.ybegin), by = srcy (roi.xend-1, roi.yend-1);
+        return ROI (std::min(ax,bx), std::max(ax,bx)+1,
+                    std::min(ay,by), std::max(ay,by)+1,
+                    roi.zbegin, roi.zend, roi.chbegin, roi.chend);
+    }
+
+    // Bounding box of the dst pixels fed by the src region roi (the
+    // inverse of a signed permutation is its transpose).
+    ROI dst_roi (ROI roi) const {
+        int sx[2] = { roi.xbegin - x0, roi.xend-1 - x0 };
+        int sy[2] = { roi.ybegin - y0, roi.yend-1 - y0 };
+        int ax = xx*sx[0] + yx*sy[0], bx = xx*sx[1] + yx*sy[1];
+        int ay = xy*sx[0] + yy*sy[0], by = xy*sx[1] + yy*sy[1];
+        return ROI (std::min(ax,bx), std::max(ax,bx)+1,
+                    std::min(ay,by), std::max(ay,by)+1,
+                    roi.zbegin, roi.zend, roi.chbegin, roi.chend);
+    }
+};
+
+
+
+// Copy n dst pixels, dpixel bytes apart, whose sources are dsx bytes
+// apart. A nonzero PIXBYTES lets the compiler turn the memcpy into a
+// single register move.
+template<int PIXBYTES>
+inline void
+remap_row (char *dp, stride_t dpixel, const char *sp, stride_t dsx,
+           int n, size_t chanbytes)
+{
+    size_t bytes = PIXBYTES ? size_t(PIXBYTES) : chanbytes;
+    for (int i = 0;  i < n;  ++i, dp += dpixel, sp += dsx)
+        memcpy (dp, sp, bytes);
+}
+
+
+
+// Move a 4x4 block of 4-byte pixels through registers. The four sources
+// of dst column i (rows 0..3) start at sp + i*dsx and are dsy = +/- 4
+// bytes apart, so each is one SIMD load, and a 4x4 transpose turns the
+// loaded columns into dst rows.
+inline void
+remap_block4x4 (char *dp, stride_t dline, const char *sp,
+                stride_t dsx, stride_t dsy)
+{
+    simd::int4 r[4];
+    for (int i = 0;  i < 4;  ++i) {
+        if (dsy > 0)
+            r[i].load ((const int *)(sp + i*dsx));
+        else
+            r[i] = simd::shuffle<3,2,1,0> (simd::int4 ((const int *)(sp + i*dsx - 12)));
+    }
+    simd::transpose (r[0], r[1], r[2], r[3]);
+    for (int j = 0;  j < 4;  ++j)
+        r[j].store ((int *)(dp + j*dline));
+}
+
+
+
+static void
+remap_local_ (ImageBuf &dst, const ImageBuf &src, ROI roi, PixelRemap m)
+{
+    const ImageSpec &dspec (dst.spec());
+    size_t chanoffset = dspec.format.size() * roi.chbegin;
+    size_t chanbytes = dspec.format.size() * roi.nchannels();
+    stride_t spixel = src.pixel_stride(), sline = src.scanline_stride();
+    stride_t dpixel = dst.pixel_stride(), dline = dst.scanline_stride();
+    // Bytes stepped through src for a unit step in dst x and in dst y.
+    stride_t dsx = m.xx * spixel + m.yx * sline;
+    stride_t dsy = m.xy * spixel + m.yy * sline;
+    // When dst rows run along src rows (flip, flop, rotate180) there's
+    // nothing to gain from blocking. When they run down src columns, go
+    // in square blocks so the src scanlines touched stay in cache.
+    bool rowwise = (dsx == spixel || dsx == -spixel);
+    const int bw = rowwise ? roi.width() : 32;
+    const int bh = rowwise ? 1 : 32;
+    bool rowcopy = (dsx == spixel && chanbytes == size_t(spixel) &&
+                    chanbytes == size_t(dpixel));
+    bool block4 = (chanbytes == 4 && spixel == 4 && dpixel == 4 &&
+                   (dsy == 4 || dsy == -4));
+    for (int z = roi.zbegin;  z < roi.zend;  ++z)
+        for (int yb = roi.ybegin;  yb < roi.yend;  yb += bh)
+            for (int xb = roi.xbegin;  xb < roi.xend;  xb += bw) {
+                int ye = std::min (yb + bh, roi.yend);
+                int xe = std::min (xb + bw, roi.xend);
+                int y = yb;
+                if (block4) {
+                    for ( ;  y + 4 <= ye;  y += 4) {
+                        char *dp = (char *)dst.pixeladdr (xb, y, z);
+                        const char *sp = (const char *)src.pixeladdr (m.srcx(xb,y), m.srcy(xb,y), z);
+                        int x = xb;
+                        for ( ;  x + 4 <= xe;  x += 4, dp += 16, sp += 4*dsx)
+                            remap_block4x4 (dp, dline, sp, dsx, dsy);
+                        for (int j = 0;  j < 4 && x < xe;  ++j)
+                            remap_row<4> (dp + j*dline, 4, sp + j*dsy, dsx,
+                                          xe - x, 4);
+                    }
+                }
+                for ( ;  y < ye;  ++y) {
+                    char *dp = (char *)dst.pixeladdr (xb, y, z) + chanoffset;
+                    const char *sp = (const char *)src.pixeladdr (m.srcx(xb,y), m.srcy(xb,y), z)
+                                   + chanoffset;
+                    int n = xe - xb;
+                    if (rowcopy) {
+                        memcpy (dp, sp, n * chanbytes);
+                        continue;
+                    }
+                    switch (chanbytes) {
+                    case 1:  remap_row<1>  (dp, dpixel, sp, dsx, n, 1);  break;
+                    case 2:  remap_row<2>  (dp, dpixel, sp, dsx, n, 2);  break;
+                    case 3:  remap_row<3>  (dp, dpixel, sp, dsx, n, 3);  break;
+                    case 4:  remap_row<4>  (dp, dpixel, sp, dsx, n, 4);  break;
+                    case 6:  remap_row<6>  (dp, dpixel, sp, dsx, n, 6);  break;
+                    case 8:  remap_row<8>  (dp, dpixel, sp, dsx, n, 8);  break;
+                    case 12: remap_row<12> (dp, dpixel, sp, dsx, n, 12); break;
+                    case 16: remap_row<16> (dp, dpixel, sp, dsx, n, 16); break;
+                    default: remap_row<0>  (dp, dpixel, sp, dsx, n, chanbytes); break;
+                    }
+                }
+            }
+}
+
+
+
+// Fast path shared by flip, flop, the rotations, transpose, and
+// reorient: when both images are the same data type and hold all the
+// pixels involved in local memory, move raw pixel bytes in cache-sized
+// tiles rather than going through iterators. Returns false (having done
+// nothing) if the fast path doesn't apply.
+static bool
+remap_local (ImageBuf &dst, const ImageBuf &src, ROI dst_roi,
+             const PixelRemap &m, int nthreads)
+{
+    if (dst.spec().format != src.spec().format ||
+        ! src.localpixels() || ! dst.localpixels() ||
+        src.local_tile_width() || dst.local_tile_width() ||
+        src.deep() || dst.deep() ||
+        ! dst.contains_roi (dst_roi) || ! src.contains_roi (m.src_roi (dst_roi)))
+        return false;
+    // Tiles rather than scanline bands, so each thread's slice of src is
+    // a compact block no matter which way the remapping runs.
+    ImageBufAlgo::parallel_image (
+        OIIO::bind (remap_local_, OIIO::ref(dst), OIIO::cref(src), _1, m),
+        dst_roi, nthreads, ImageBufAlgo::Split_Tile);
+    return true;
+}
+
+
 
 template<class D, class S>
 static bool
@@ -279,6 +467,10 @@ ImageBufAlgo::flip(ImageBuf &dst, const ImageBuf &src, ROI roi, int nthreads)
     // the midline of the display window.
     if (! IBAprep (dst_roi, &dst, &src))
         return false;
+    ROI dst_roi_full = dst.roi_full();
+    PixelRemap m (0, 1, 0, src_roi_full.yend-1 + dst_roi_full.ybegin, 0, -1);
+    if (remap_local (dst, src, dst_roi, m, nthreads))
+        return true;
     bool ok;
     OIIO_DISPATCH_TYPES2 (ok, "flip", flip_,
                           dst.spec().format, src.spec().format,
@@ -330,6 +522,10 @@ ImageBufAlgo::flop(ImageBuf &dst, const ImageBuf &src, ROI roi, int nthreads)
     // the midline of the display window.
     if (! IBAprep (dst_roi, &dst, &src))
         return false;
+    ROI dst_roi_full = dst.roi_full();
+    PixelRemap m (src_roi_full.xend-1 + dst_roi_full.xbegin, -1, 0, 0, 0, 1);
+    if (remap_local (dst, src, dst_roi, m, nthreads))
+        return true;
     bool ok;
     OIIO_DISPATCH_TYPES2 (ok, "flop", flop_,
                           dst.spec().format, src.spec().format,
@@ -391,6 +587,9 @@ ImageBufAlgo::rotate90 (ImageBuf &dst, const ImageBuf &src,
     if (! dst_initialized)
         dst.set_roi_full (dst_roi_full);
 
+    PixelRemap m (0, 0, 1, dst.roi_full().xend-1, -1, 0);
+    if (remap_local (dst, src, dst_roi, m, nthreads))
+        return true;
     bool ok;
     OIIO_DISPATCH_TYPES2 (ok, "rotate90", rotate90_,
                           dst.spec().format, src.spec().format,
@@ -448,6 +647,11 @@ ImageBufAlgo::rotate180 (ImageBuf &dst, const ImageBuf &src,
     // the midline of the display window.
     if (! IBAprep (dst_roi, &dst, &src))
         return false;
+    ROI dst_roi_full = dst.roi_full();
+    PixelRemap m (src_roi_full.xend-1 + dst_roi_full.xbegin, -1, 0,
+                  src_roi_full.yend-1 + dst_roi_full.ybegin, 0, -1);
+    if (remap_local (dst, src, dst_roi, m, nthreads))
+        return true;
     bool ok;
     OIIO_DISPATCH_TYPES2 (ok, "rotate180", rotate180_,
                           dst.spec().format, src.spec().format,
@@ -510,6 +714,9 @@ ImageBufAlgo::rotate270 (ImageBuf &dst, const ImageBuf &src,
     if (! dst_initialized)
         dst.set_roi_full (dst_roi_full);
 
+    PixelRemap m (dst.roi_full().yend-1, 0, -1, 0, 1, 0);
+    if (remap_local (dst, src, dst_roi, m, nthreads))
+        return true;
     bool ok;
     OIIO_DISPATCH_TYPES2 (ok, "rotate270", rotate270_,
                           dst.spec().format, src.spec().format,
@@ -524,38 +731,59 @@ ImageBufAlgo::reorient (ImageBuf &dst, const ImageBuf &src, int nthreads)
 {
     ImageBuf tmp;
     bool ok = false;
-    switch (src.orientation()) {
+    int orientation = src.orientation();
+    if ((orientation == 5 || orientation == 7) && &dst != &src &&
+        ! dst.initialized() && src.localpixels() && ! src.deep()) {
+        // The two-step orientations can be done in a single pass of
+        // remap_local, without the intermediate image. The remappings
+        // are the compositions of the pairs of operations below.
+        ROI F = src.roi_full();
+        ROI D (F.xbegin, F.xbegin+F.height(), F.ybegin, F.ybegin+F.width(),
+               F.zbegin, F.zend, F.chbegin, F.chend);
+        PixelRemap m = (orientation == 5)
+                     ? PixelRemap (D.yend-1, 0, -1, D.xend-1 + D.xbegin, -1, 0)
+                     : PixelRemap (0, 0, 1, F.yend + F.ybegin - D.xend, 1, 0);
+        ROI dst_roi = m.dst_roi (src.roi());
+        if (! IBAprep (dst_roi, &dst, &src))
+            return false;
+        dst.set_roi_full (D);
+        if (remap_local (dst, src, dst_roi, m, nthreads)) {
+            dst.set_orientation (1);
+            return true;
+        }
+    }
+    switch (orientation) {
     case 1:
         ok = dst.copy (src);
         break;
     case 2:
-        ok = ImageBufAlgo::flop (dst, src);
+        ok = ImageBufAlgo::flop (dst, src, ROI(), nthreads);
         break;
     case 3:
-        ok = ImageBufAlgo::rotate180 (dst, src);
+        ok = ImageBufAlgo::rotate180 (dst, src, ROI(), nthreads);
         break;
     case 4:
-        ok = ImageBufAlgo::flip (dst, src);
+        ok = ImageBufAlgo::flip (dst, src, ROI(), nthreads);
         break;
     case 5:
-        ok = ImageBufAlgo::rotate270 (tmp, src);
+        ok = ImageBufAlgo::rotate270 (tmp, src, ROI(), nthreads);
         if (ok)
-            ok = ImageBufAlgo::flop (dst, tmp);
+            ok = ImageBufAlgo::flop (dst, tmp, ROI(), nthreads);
         else
             dst.error ("%s", tmp.geterror());
         break;
     case 6:
-        ok = ImageBufAlgo::rotate90 (dst, src);
+        ok = ImageBufAlgo::rotate90 (dst, src, ROI(), nthreads);
         break;
     case 7:
-        ok = ImageBufAlgo::flip (tmp, src);
+        ok = ImageBufAlgo::flip (tmp, src, ROI(), nthreads);
         if (ok)
-            ok = ImageBufAlgo::rotate90 (dst, tmp);
+            ok = ImageBufAlgo::rotate90 (dst, tmp, ROI(), nthreads);
         else
             dst.error ("%s", tmp.geterror());
         break;
     case 8:
-        ok = ImageBufAlgo::rotate270 (dst, src);
+        ok = ImageBufAlgo::rotate270 (dst, src, ROI(), nthreads);
         break;
     }
     dst.set_orientation (1);
@@ -612,6 +840,9 @@ ImageBufAlgo::transpose (ImageBuf &dst, const ImageBuf &src,
                           r.zbegin, r.zend, r.chbegin, r.chend);
         dst.set_roi_full (dst_roi_full);
     }
+    if (remap_local (dst, src, dst_roi, PixelRemap (0, 0, 1, 0, 1, 0),
+                     nthreads))
+        return true;
     bool ok;
     OIIO_DISPATCH_TYPES2 (ok, "transpose", transpose_, dst.spec().format,
                           src.spec().format, dst, src, roi, nthreads);
@@ -785,6 +1016,25 @@ ImageBufAlgo::channels (ImageBuf &dst, const ImageBuf &src,
     if (all_same_type)                      // clear per-chan formats if
         newspec.channelformats.clear();     // they're all the same
 
+    // A consecutive run of src's channels can be a copy-on-write view of
+    // src's pixels rather than a copy.
+    bool consecutive = (&dst != &src && ! src.deep() &&
+                        channelorder[0] >= 0 &&
+                        channelorder[0] + nchannels <= src.nchannels());
+    for (int c = 1;  c < nchannels && consecutive;  ++c)
+        consecutive = (channelorder[c] == channelorder[0] + c);
+    if (consecutive) {
+        ROI viewroi = src.roi();
+        viewroi.chbegin = channelorder[0];
+        viewroi.chend = channelorder[0] + nchannels;
+        ImageBuf view;
+        if (view.make_view (src, viewroi)) {
+            view.specmod() = newspec;
+            dst.swap (view);
+            return true;
+        }
+    }
+
     // Update the image (realloc with the new spec)
     dst.reset (newspec);
 
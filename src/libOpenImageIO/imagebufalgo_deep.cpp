@@ -117,10 +117,16 @@ flatten_ (ImageBuf &dst, const ImageBuf &src,
     float &ARval (AR_channel >= 0 ? val[AR_channel] : val[alpha_channel]);
     float &AGval (AG_channel >= 0 ? val[AG_channel] : val[alpha_channel]);
     float &ABval (AB_channel >= 0 ? val[AB_channel] : val[alpha_channel]);
+    const DeepData &srcdd (*src.deepdata());
+    std::vector<float> samplevals;
 
     for (ImageBuf::Iterator<DSTTYPE> r (dst, roi);  !r.done();  ++r) {
-        int x = r.x(), y = r.y(), z = r.z();
-        int samps = src.deep_samples (x, y, z);
+        // Find src's pixel once, and convert all its samples to float in
+        // one go, rather than for every sample and channel
+        int p = src.pixelindex (r.x(), r.y(), r.z(), true);
+        int samps = srcdd.samples (p);
+        samplevals.resize (size_t(std::max (samps, 1)) * nc);
+        srcdd.get_pixel_values (p, &samplevals[0]);
         // Clear accumulated values for this pixel (0 for colors, big for Z)
         memset (val, 0, nc*sizeof(float));
         if (Z_channel >= 0 && samps == 0)
@@ -133,7 +139,7 @@ flatten_ (ImageBuf &dst, const ImageBuf &src,
             if (alpha >= 1.0f)
                 break;
             for (int c = 0;  c < nc;  ++c) {
-                float v = src.deep_value (x, y, z, c, s);
+                float v = samplevals[s*nc+c];
                 if (c == Z_channel || c == Zback_channel)
                     val[c] *= alpha;  // because Z are not premultiplied
                 float a;
@@ -212,26 +218,39 @@ ImageBufAlgo::deepen (ImageBuf &dst, const ImageBuf &src, float zvalue,
         //               src, roi, nthreads);
     }
 
-    // Construct an ideal spec for dst, which is like src but deep.
+    // Construct an ideal spec for dst, which is like src but deep. Each
+    // channel keeps src's type if deep files can hold it (half, float,
+    // or uint), and is float otherwise; depth is always float.
     const ImageSpec &srcspec (src.spec());
     int nc = srcspec.nchannels;
     int zback_channel = -1;
     ImageSpec force_spec = srcspec;
     force_spec.deep = true;
-    force_spec.set_format (TypeDesc::FLOAT);
-    force_spec.channelformats.clear();
+    std::vector<TypeDesc> chtypes;
+    srcspec.get_channelformats (chtypes);
     for (int c = 0; c < nc; ++c) {
         if (force_spec.channelnames[c] == "Z")
             force_spec.z_channel = c;
         else if (force_spec.channelnames[c] == "Zback")
             zback_channel = c;
+        if ((chtypes[c] != TypeDesc::HALF && chtypes[c] != TypeDesc::UINT) ||
+              c == force_spec.z_channel || c == zback_channel)
+            chtypes[c] = TypeDesc::FLOAT;
     }
     bool add_z_channel = (force_spec.z_channel < 0);
     if (add_z_channel) {
         // No z channel? Make one.
         force_spec.z_channel = force_spec.nchannels++;
         force_spec.channelnames.push_back ("Z");
+        chtypes.push_back (TypeDesc::FLOAT);
     }
+    force_spec.set_format (chtypes[0]);
+    for (int c = 1; c < force_spec.nchannels; ++c)
+        if (chtypes[c] != chtypes[0]) {
+            force_spec.format = TypeDesc::FLOAT;
+            force_spec.channelformats = chtypes;
+            break;
+        }
 
     if (! IBAprep (roi, &dst, &src, NULL, &force_spec,
                    IBAprep_SUPPORT_DEEP | IBAprep_DEEP_MIXED))
@@ -266,17 +285,21 @@ ImageBufAlgo::deepen (ImageBuf &dst, const ImageBuf &src, float zvalue,
             dst.set_deep_samples (x, y, z, 1);
     }
 
-    // Now actually set the values
+    // Now actually set the values, a whole sample at a time
+    DeepData &dstdd (*dst.deepdata());
+    int dstnc = dstdd.channels();
+    float *sample = OIIO_ALLOCA (float, dstnc);
     for (int z = roi.zbegin; z < roi.zend; ++z)
     for (int y = roi.ybegin; y < roi.yend; ++y)
     for (int x = roi.xbegin; x < roi.xend; ++x) {
-        if (dst.deep_samples (x, y, z) == 0)
+        int p = dst.pixelindex (x, y, z, true);
+        if (dstdd.samples (p) == 0)
             continue;
-        for (int c = 0; c < nc; ++c)
-            dst.set_deep_value (x, y, z, c, 0 /*sample*/,
-                                src.getchannel (x, y, z, c));
-        if (add_z_channel)
-            dst.set_deep_value (x, y, z, nc, 0, zvalue);
+        memset (sample, 0, dstnc * sizeof(float));
+        src.getpixel (x, y, z, sample, std::min (nc, dstnc));
+        if (add_z_channel && nc < dstnc)
+            sample[nc] = zvalue;
+        dstdd.set_pixel_values (p, sample);
     }
 
     bool ok = true;
@@ -290,6 +313,40 @@ ImageBufAlgo::deepen (ImageBuf &dst, const ImageBuf &src, float zvalue,
 
 
 
+// Merge B's samples into those already copied into dst from A. DeepData
+// stores an ImageBuf's samples per scanline, so threads working on
+// separate scanlines may split and insert samples independently.
+static bool
+deep_merge_ (ImageBuf &dst, const ImageBuf &B, bool occlusion_cull,
+             ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Possible multiple thread case -- recurse via parallel_image
+        ImageBufAlgo::parallel_image (
+            OIIO::bind(deep_merge_, OIIO::ref(dst), OIIO::cref(B),
+                       occlusion_cull, _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    DeepData &dstdd (*dst.deepdata());
+    const DeepData &Bdd (*B.deepdata());
+    for (int z = roi.zbegin; z < roi.zend; ++z)
+    for (int y = roi.ybegin; y < roi.yend; ++y)
+    for (int x = roi.xbegin; x < roi.xend; ++x) {
+        int dstpixel = dst.pixelindex (x, y, z, true);
+        int Bpixel = B.pixelindex (x, y, z, true);
+        DASSERT (dstpixel >= 0);
+        dstdd.merge_deep_pixels (dstpixel, Bdd, Bpixel);
+        if (occlusion_cull)
+            dstdd.occlusion_cull (dstpixel);
+    }
+    return true;
+}
+
+
+
 bool
 ImageBufAlgo::deep_merge (ImageBuf &dst, const ImageBuf &A,
                           const ImageBuf &B, bool occlusion_cull,
@@ -324,17 +381,8 @@ ImageBufAlgo::deep_merge (ImageBuf &dst, const ImageBuf &A,
     }
 
     bool ok = ImageBufAlgo::copy (dst, A, TypeDesc::UNKNOWN, roi, nthreads);
-
-    for (int z = roi.zbegin; z < roi.zend; ++z)
-    for (int y = roi.ybegin; y < roi.yend; ++y)
-    for (int x = roi.xbegin; x < roi.xend; ++x) {
-        int dstpixel = dst.pixelindex (x, y, z, true);
-        int Bpixel = B.pixelindex (x, y, z, true);
-        DASSERT (dstpixel >= 0);
-        dstdd.merge_deep_pixels (dstpixel, Bdd, Bpixel);
-        if (occlusion_cull)
-            dstdd.occlusion_cull (dstpixel);
-    }
+    if (ok)
+        ok = deep_merge_ (dst, B, occlusion_cull, roi, nthreads);
     return ok;
 }
 
@@ -41,6 +41,8 @@
 #include "OpenImageIO/thread.h"
 #include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/hash.h"
+#include "OpenImageIO/refcnt.h"
+#include "OpenImageIO/simd.h"
 
 #ifdef USE_FREETYPE
 #include <ft2build.h>
@@ -308,6 +310,67 @@ struct IB_drawer {
 
 
 
+template<typename T>
+static bool
+render_box_ (ImageBuf &dst, array_view<const float> color,
+             ROI roi=ROI(), int nthreads=1)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            OIIO::bind(render_box_<T>, OIIO::ref(dst), color,
+                        _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    float alpha = 1.0f;
+    if (dst.spec().alpha_channel >= 0 && dst.spec().alpha_channel < int(color.size()))
+        alpha = color[dst.spec().alpha_channel];
+    else if (int(color.size()) == roi.chend+1)
+        alpha = color[roi.chend];
+
+    if (dst.localpixels() && ! dst.deep() && ! dst.local_tile_width()) {
+        // Local pixels: fill the box a scanline at a time, straight
+        // through pointers.  An opaque box just copies one pixel's worth
+        // of the color (already in the buffer's type) along each row.
+        roi = roi_intersection (roi, get_roi (dst.spec()));
+        int nc = roi.chend - roi.chbegin;
+        stride_t xstride = dst.pixel_stride();
+        T *pixel = ALLOCA (T, std::max (nc, 1));
+        for (int c = 0;  c < nc;  ++c)
+            pixel[c] = convert_type<float,T> (color[roi.chbegin+c]);
+        float keep = 1.0f - alpha;
+        for (int z = roi.zbegin;  z < roi.zend;  ++z)
+            for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+                char *p = (char *)dst.pixeladdr (roi.xbegin, y, z)
+                        + roi.chbegin * sizeof(T);
+                if (alpha == 1.0f) {
+                    for (int x = roi.xbegin;  x < roi.xend;  ++x, p += xstride)
+                        memcpy (p, pixel, nc * sizeof(T));
+                } else {
+                    for (int x = roi.xbegin;  x < roi.xend;  ++x, p += xstride) {
+                        DataArrayProxy<T,float> r ((T *)p);
+                        for (int c = 0;  c < nc;  ++c)
+                            r[c] = color[roi.chbegin+c] + r[c] * keep;  // "over"
+                    }
+                }
+            }
+    } else if (alpha == 1.0f) {
+        for (ImageBuf::Iterator<T> r (dst, roi);  !r.done();  ++r)
+            for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                r[c] = color[c];
+    } else {
+        for (ImageBuf::Iterator<T> r (dst, roi);  !r.done();  ++r)
+            for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                r[c] = color[c] + r[c] * (1.0f-alpha);  // "over"
+    }
+    return true;
+}
+
+
+
 template<typename T>
 static bool
 render_line_ (ImageBuf &dst, int x1, int y1, int x2, int y2,
@@ -349,6 +412,28 @@ ImageBufAlgo::render_line (ImageBuf &dst, int x1, int y1, int x2, int y2,
         alpha = color[roi.chend];
 
     bool ok;
+    if (x1 == x2 || y1 == y2) {
+        // Horizontal and vertical lines (including all the edges of
+        // unfilled boxes) are just 1-pixel-wide boxes: fill them as spans
+        // rather than a point at a time.
+        int xb = std::min (x1, x2), xe = std::max (x1, x2) + 1;
+        int yb = std::min (y1, y2), ye = std::max (y1, y2) + 1;
+        if (skip_first_point) {
+            if (x1 == x2 && y1 == y2)
+                return true;   // the only point is skipped
+            if (y1 == y2)
+                (x1 < x2) ? ++xb : --xe;
+            else
+                (y1 < y2) ? ++yb : --ye;
+        }
+        ROI span = roi_intersection (roi, ROI (xb, xe, yb, ye, roi.zbegin,
+                                               roi.zend, roi.chbegin, roi.chend));
+        if (span.npixels() == 0)
+            return true;
+        OIIO_DISPATCH_TYPES (ok, "render_line", render_box_, dst.spec().format,
+                             dst, color, span, nthreads);
+        return ok;
+    }
     OIIO_DISPATCH_TYPES (ok, "render_line", render_line_, dst.spec().format,
                          dst, x1, y1, x2, y2, color, alpha, skip_first_point,
                          roi, nthreads);
@@ -357,41 +442,6 @@ ImageBufAlgo::render_line (ImageBuf &dst, int x1, int y1, int x2, int y2,
 
 
 
-template<typename T>
-static bool
-render_box_ (ImageBuf &dst, array_view<const float> color,
-             ROI roi=ROI(), int nthreads=1)
-{
-    if (nthreads != 1 && roi.npixels() >= 1000) {
-        // Lots of pixels and request for multi threads? Parallelize.
-        ImageBufAlgo::parallel_image (
-            OIIO::bind(render_box_<T>, OIIO::ref(dst), color,
-                        _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
-        return true;
-    }
-
-    // Serial case
-    float alpha = 1.0f;
-    if (dst.spec().alpha_channel >= 0 && dst.spec().alpha_channel < int(color.size()))
-        alpha = color[dst.spec().alpha_channel];
-    else if (int(color.size()) == roi.chend+1)
-        alpha = color[roi.chend];
-
-    if (alpha == 1.0f) {
-        for (ImageBuf::Iterator<T> r (dst, roi);  !r.done();  ++r)
-            for (int c = roi.chbegin;  c < roi.chend;  ++c)
-                r[c] = color[c];
-    } else {
-        for (ImageBuf::Iterator<T> r (dst, roi);  !r.done();  ++r)
-            for (int c = roi.chbegin;  c < roi.chend;  ++c)
-                r[c] = color[c] + r[c] * (1.0f-alpha);  // "over"
-    }
-    return true;
-}
-
-
-
 bool
 ImageBufAlgo::render_box (ImageBuf &dst, int x1, int y1, int x2, int y2,
                           array_view<const float> color, bool fill,
@@ -496,21 +546,27 @@ hashrand (int x, int y, int z, int c, int seed)
 }
 
 
-// Return a hash-based normal-distributed pseudorandom value.
-// We use the Marsaglia polar method, and hashrand to
-OIIO_FORCEINLINE float
-hashnormal (int x, int y, int z, int c, int seed)
+// Return hash-based normal-distributed pseudorandom values for the four
+// consecutive channels c..c+3 of pixel (x,y,z). We use the Box-Muller
+// transform on two hashrand values per channel, so unlike a rejection
+// method there is no data-dependent loop, and the log/sqrt are done four
+// lanes at a time. Each lane is still a pure function of (x,y,z,c,seed),
+// so the result never depends on how the image was split among threads.
+OIIO_FORCEINLINE simd::float4
+hashnormal4 (int x, int y, int z, int c, int seed)
 {
-    float xr, yr, r2;
-    int s = seed-1;
-    do {
-        s += 1;
-        xr = 2.0 * hashrand(x,y,z,c,s) - 1.0;
-        yr = 2.0 * hashrand(x,y,z,c,s+139) - 1.0;
-        r2 = xr*xr + yr*yr;
-    } while (r2 > 1.0 || r2 == 0.0);
-    float M = sqrt(-2.0 * log(r2) / r2);
-    return xr * M;
+    simd::float4 u1, u2;
+    for (int i = 0;  i < 4;  ++i) {
+        u1[i] = 1.0f - hashrand (x, y, z, c+i, seed);  // (0,1], safe for log
+        u2[i] = hashrand (x, y, z, c+i, seed+139);
+    }
+    simd::float4 r = sqrt (simd::float4(-2.0f) * log (u1));
+    simd::float4 cosine;
+    for (int i = 0;  i < 4;  ++i) {
+        float sine;
+        fast_sincos (float(2.0*M_PI) * u2[i], &sine, &cosine[i]);
+    }
+    return r * cosine;
 }
 
 
@@ -563,11 +619,17 @@ noise_gaussian_ (ImageBuf &dst, float mean, float stddev, bool mono,
     // Serial case
     for (ImageBuf::Iterator<T> p (dst, roi);  !p.done();  ++p) {
         int x = p.x(), y = p.y(), z = p.z();
-        float n = 0.0;
-        for (int c = roi.chbegin;  c < roi.chend;  ++c) {
-            if (c == roi.chbegin || !mono)
-                n = mean + stddev * hashnormal (x, y, z, c, seed);
-            p[c] = p[c] + n;
+        if (mono) {
+            float n = mean + stddev * hashnormal4 (x, y, z, roi.chbegin, seed)[0];
+            for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                p[c] = p[c] + n;
+            continue;
+        }
+        for (int c = roi.chbegin;  c < roi.chend;  c += 4) {
+            simd::float4 n = simd::float4(mean) + simd::float4(stddev)
+                           * hashnormal4 (x, y, z, c, seed);
+            for (int i = 0, e = std::min (4, roi.chend-c);  i < e;  ++i)
+                p[c+i] = p[c+i] + n[i];
         }
     }
     return true;
@@ -641,39 +703,79 @@ static bool ft_broken = false;
 static const char * default_font_name[] = {
         "DroidSans", "cour", "Courier New", "FreeMono", NULL
      };
-} // anon namespace
-#endif
 
+// A rendered glyph: its coverage bitmap (tightly packed, width x rows)
+// plus the metrics needed to place it and advance the pen.
+struct FontGlyph {
+    int width, rows;       // bitmap size
+    int left, top;         // bitmap offset from the pen position
+    int advance;           // horizontal pen advance, in pixels
+    std::vector<unsigned char> bitmap;
+};
+typedef shared_ptr<const FontGlyph> FontGlyphRef;
 
-bool
-ImageBufAlgo::render_text (ImageBuf &R, int x, int y, string_view text,
-                           int fontsize, string_view font_,
-                           const float *textcolor)
-{
-    if (R.spec().depth > 1) {
-        R.error ("ImageBufAlgo::render_text does not support volume images");
-        return false;
-    }
+// Caches (all guarded by ft_mutex) so that repeated burn-ins don't
+// search the font directories, open the face, and rasterize every
+// character anew on each call.  Faces stay open for the life of the
+// process; glyphs are keyed by face (which implies file and size) and
+// code point.
+typedef std::pair<std::string,int> FontFaceKey;
+typedef std::pair<FT_Face,uint32_t> FontGlyphKey;
+static std::map<std::string,std::string> font_path_cache;
+static std::map<FontFaceKey,FT_Face> font_face_cache;
+static std::map<FontGlyphKey,FontGlyphRef> font_glyph_cache;
+static const size_t font_glyph_cache_max = 16384;
 
-#ifdef USE_FREETYPE
-    // If we know FT is broken, don't bother trying again
-    if (ft_broken)
-        return false;
 
-    // Thread safety
-    lock_guard ft_lock (ft_mutex);
-    int error = 0;
 
-    // If FT not yet initialized, do it now.
-    if (! ft_library) {
-        error = FT_Init_FreeType (&ft_library);
-        if (error) {
-            ft_broken = true;
-            R.error ("Could not initialize FreeType for font rendering");
-            return false;
+// Composite one glyph onto the image: R = b*textcolor + (1-b)*R, where
+// b is the glyph coverage.  (x0,y0) is the upper left of the glyph
+// bitmap, and roi is its footprint already clipped to R's data window.
+template<typename T>
+static bool
+blit_glyph_ (ImageBuf &R, const FontGlyph &g, int x0, int y0,
+             const float *textcolor, ROI roi)
+{
+    const ImageSpec &spec (R.spec());
+    int nchannels = spec.nchannels;
+    if (R.localpixels() && spec.format == TypeDesc::FLOAT
+            && nchannels == 4 && R.pixel_stride() == 4*sizeof(float)
+            && ! R.local_tile_width()) {
+        // Common case of a local RGBA float image: composite a whole
+        // pixel at a time with SIMD.
+        simd::float4 tc (textcolor);
+        for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+            const unsigned char *b = &g.bitmap[(y-y0)*g.width + (roi.xbegin-x0)];
+            float *p = (float *)R.pixeladdr (roi.xbegin, y);
+            for (int x = roi.xbegin;  x < roi.xend;  ++x, ++b, p += 4) {
+                if (! *b)
+                    continue;
+                simd::float4 cov (*b * (1.0f/255.0f));
+                simd::float4 pix (p);
+                pix = cov * tc + (simd::float4::One() - cov) * pix;
+                pix.store (p);
+            }
         }
+        return true;
+    }
+    for (ImageBuf::Iterator<T> r (R, roi);  !r.done();  ++r) {
+        int b = g.bitmap[(r.y()-y0)*g.width + (r.x()-x0)];
+        if (! b)
+            continue;
+        float cov = b * (1.0f/255.0f);
+        for (int c = 0;  c < nchannels;  ++c)
+            r[c] = cov * textcolor[c] + (1.0f-cov) * r[c];
     }
+    return true;
+}
 
+
+
+// Find the file for the named font (or a default font if no name is
+// given), searching a set of likely directories.
+static bool
+find_font (ImageBuf &R, string_view font_, std::string &font)
+{
     // A set of likely directories for fonts to live, across several systems.
     std::vector<std::string> search_dirs;
     const char *home = getenv ("HOME");
@@ -704,7 +806,7 @@ ImageBufAlgo::render_text (ImageBuf &R, int x, int y, string_view text,
     }
 
     // Try to find the font.  Experiment with several extensions
-    std::string font = font_;
+    font = font_;
     if (font.empty()) {
         // nothing specified -- look for something to use as a default.
         for (int j = 0;  default_font_name[j] && font.empty(); ++j) {
@@ -738,59 +840,155 @@ ImageBufAlgo::render_text (ImageBuf &R, int x, int y, string_view text,
         R.error ("Could not find font \"%s\"", font);
         return false;
     }
+    return true;
+}
 
-    FT_Face face;      // handle to face object
-    error = FT_New_Face (ft_library, font.c_str(), 0 /* face index */, &face);
-    if (error) {
-        R.error ("Could not set font face to \"%s\"", font);
-        return false;  // couldn't open the face
+
+
+// Get the rendered glyphs for the characters of text (in the given font
+// and size), rasterizing and caching any that aren't already cached.
+// Characters that can't be rendered are left out.  This takes care of
+// all the FreeType calls and the locking they require, so the caller can
+// composite the glyphs without holding the lock.
+static bool
+get_glyphs (ImageBuf &R, string_view text, int fontsize, string_view font_,
+            std::vector<FontGlyphRef> &glyphs)
+{
+    // Thread safety
+    lock_guard ft_lock (ft_mutex);
+    int error = 0;
+
+    // If FT not yet initialized, do it now.
+    if (! ft_library) {
+        error = FT_Init_FreeType (&ft_library);
+        if (error) {
+            ft_broken = true;
+            R.error ("Could not initialize FreeType for font rendering");
+            return false;
+        }
     }
 
-    error = FT_Set_Pixel_Sizes (face,        // handle to face object
-                                0,           // pixel_width
-                                fontsize);   // pixel_heigh
-    if (error) {
-        FT_Done_Face (face);
-        R.error ("Could not set font size to %d", fontsize);
-        return false;  // couldn't set the character size
+    // Resolve the font name to a file, remembering the answer.
+    std::string font;
+    std::map<std::string,std::string>::const_iterator fp
+        = font_path_cache.find (font_);
+    if (fp != font_path_cache.end()) {
+        font = fp->second;
+    } else {
+        if (! find_font (R, font_, font))
+            return false;
+        font_path_cache[font_] = font;
     }
 
-    FT_GlyphSlot slot = face->glyph;  // a small shortcut
-    int nchannels = R.spec().nchannels;
-    float *pixelcolor = ALLOCA (float, nchannels);
-    if (! textcolor) {
-        float *localtextcolor = ALLOCA (float, nchannels);
-        for (int c = 0;  c < nchannels;  ++c)
-            localtextcolor[c] = 1.0f;
-        textcolor = localtextcolor;
+    // Find or open the face at this size
+    FT_Face face;      // handle to face object
+    FontFaceKey facekey (font, fontsize);
+    std::map<FontFaceKey,FT_Face>::const_iterator ff
+        = font_face_cache.find (facekey);
+    if (ff != font_face_cache.end()) {
+        face = ff->second;
+    } else {
+        error = FT_New_Face (ft_library, font.c_str(), 0 /* face index */, &face);
+        if (error) {
+            R.error ("Could not set font face to \"%s\"", font);
+            return false;  // couldn't open the face
+        }
+
+        error = FT_Set_Pixel_Sizes (face,        // handle to face object
+                                    0,           // pixel_width
+                                    fontsize);   // pixel_heigh
+        if (error) {
+            FT_Done_Face (face);
+            R.error ("Could not set font size to %d", fontsize);
+            return false;  // couldn't set the character size
+        }
+        font_face_cache[facekey] = face;
     }
 
     std::vector<uint32_t> utext;
     utext.reserve(text.size()); //Possible overcommit, but most text will be ascii
     Strutil::utf8_to_unicode(text, utext);
 
+    glyphs.reserve (utext.size());
+    if (font_glyph_cache.size() + utext.size() > font_glyph_cache_max)
+        font_glyph_cache.clear ();  // in-use glyphs live on via glyphs[]
+    FT_GlyphSlot slot = face->glyph;  // a small shortcut
     for (size_t n = 0, e = utext.size();  n < e;  ++n) {
-        error = FT_Load_Char (face, utext[n], FT_LOAD_RENDER);
-        if (error)
-            continue;  // ignore errors
-        // now, draw to our target surface
-        for (int j = 0;  j < static_cast<int>(slot->bitmap.rows); ++j) {
-            int ry = y + j - slot->bitmap_top;
-            for (int i = 0;  i < static_cast<int>(slot->bitmap.width); ++i) {
-                int rx = x + i + slot->bitmap_left;
-                float b = slot->bitmap.buffer[slot->bitmap.pitch*j+i] / 255.0f;
-                R.getpixel (rx, ry, pixelcolor);
-                for (int c = 0;  c < nchannels;  ++c)
-                    pixelcolor[c] = b*textcolor[c] + (1.0f-b) * pixelcolor[c];
-                R.setpixel (rx, ry, pixelcolor);
+        FontGlyphRef &g (font_glyph_cache[FontGlyphKey(face, utext[n])]);
+        if (! g) {
+            error = FT_Load_Char (face, utext[n], FT_LOAD_RENDER);
+            if (error) {
+                font_glyph_cache.erase (FontGlyphKey(face, utext[n]));
+                continue;  // ignore errors
             }
+            FontGlyph *newglyph = new FontGlyph;
+            newglyph->width = static_cast<int>(slot->bitmap.width);
+            newglyph->rows = static_cast<int>(slot->bitmap.rows);
+            newglyph->left = slot->bitmap_left;
+            newglyph->top = slot->bitmap_top;
+            newglyph->advance = int(slot->advance.x >> 6);
+            newglyph->bitmap.resize (size_t(newglyph->width) * newglyph->rows);
+            for (int j = 0;  newglyph->width && j < newglyph->rows;  ++j)
+                memcpy (&newglyph->bitmap[j*newglyph->width],
+                        slot->bitmap.buffer + slot->bitmap.pitch*j,
+                        newglyph->width);
+            g.reset (newglyph);
         }
-        // increment pen position
-        x += slot->advance.x >> 6;
+        glyphs.push_back (g);
     }
-
-    FT_Done_Face (face);
     return true;
+}
+
+} // anon namespace
+#endif
+
+
+
+bool
+ImageBufAlgo::render_text (ImageBuf &R, int x, int y, string_view text,
+                           int fontsize, string_view font_,
+                           const float *textcolor)
+{
+    if (R.spec().depth > 1) {
+        R.error ("ImageBufAlgo::render_text does not support volume images");
+        return false;
+    }
+
+#ifdef USE_FREETYPE
+    // If we know FT is broken, don't bother trying again
+    if (ft_broken)
+        return false;
+
+    std::vector<FontGlyphRef> glyphs;
+    if (! get_glyphs (R, text, fontsize, font_, glyphs))
+        return false;
+
+    int nchannels = R.spec().nchannels;
+    if (! textcolor) {
+        float *localtextcolor = ALLOCA (float, nchannels);
+        for (int c = 0;  c < nchannels;  ++c)
+            localtextcolor[c] = 1.0f;
+        textcolor = localtextcolor;
+    }
+
+    // now, draw to our target surface
+    ROI datawin = get_roi (R.spec());
+    bool ok = true;
+    for (size_t n = 0, e = glyphs.size();  n < e && ok;  ++n) {
+        const FontGlyph &g (*glyphs[n]);
+        int x0 = x + g.left, y0 = y - g.top;
+        ROI groi = roi_intersection (datawin, ROI (x0, x0+g.width,
+                                                   y0, y0+g.rows,
+                                                   datawin.zbegin, datawin.zend,
+                                                   0, nchannels));
+        if (groi.npixels())
+            OIIO_DISPATCH_TYPES (ok, "render_text", blit_glyph_,
+                                 R.spec().format, R, g, x0, y0,
+                                 textcolor, groi);
+        // increment pen position
+        x += g.advance;
+    }
+    return ok;
 
 #else
     R.error ("OpenImageIO was not compiled with FreeType for font rendering");
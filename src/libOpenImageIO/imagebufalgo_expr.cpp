@@ -0,0 +1,704 @@
+/*
+  Copyright 2016 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+/// \file
+/// ImageBufAlgo::Expr -- deferred, fused evaluation of chains of
+/// per-pixel ImageBufAlgo operations.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "OpenImageIO/imagebuf.h"
+#include "OpenImageIO/imagebufalgo.h"
+#include "OpenImageIO/imagebufalgo_util.h"
+#include "OpenImageIO/dassert.h"
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/thread.h"
+#include "imageio_pvt.h"
+
+
+OIIO_NAMESPACE_BEGIN
+
+
+struct ImageBufAlgo::Expr::Node {
+    enum Op { IMAGE, CONSTANT, ADD, SUB, MUL, DIV, MAD, ABS, INVERT,
+              POW, CLAMP, PREMULT, UNPREMULT, COLORCONVERT };
+
+    Node (Op op_) : op(op_), img(NULL), processor(NULL), unpremult(false),
+                    alpha_channel(-1), z_channel(-1) { }
+
+    Op op;
+    const ImageBuf *img;               // IMAGE
+    std::vector<float> values;         // CONSTANT, POW exponents, CLAMP min
+    std::vector<float> values2;        // CLAMP max
+    const ColorProcessor *processor;   // COLORCONVERT
+    bool unpremult;                    // COLORCONVERT
+    int alpha_channel, z_channel;      // of the first image below us
+    shared_ptr<Node> arg[3];
+
+    // Per-channel value from a list that is either a single value for
+    // all channels or one per channel, with dflt for the missing ones.
+    static float chanval (const std::vector<float> &v, int c, float dflt) {
+        if (v.size() == 1)
+            return v[0];
+        return c < (int)v.size() ? v[c] : dflt;
+    }
+};
+
+
+
+namespace {
+
+typedef ImageBufAlgo::Expr::Node Node;
+
+
+static shared_ptr<Node>
+make_node (Node::Op op, const ImageBufAlgo::Expr &a,
+           const ImageBufAlgo::Expr *b = NULL,
+           const ImageBufAlgo::Expr *c = NULL)
+{
+    shared_ptr<Node> n (new Node (op));
+    n->arg[0] = a.node();
+    if (b)
+        n->arg[1] = b->node();
+    if (c)
+        n->arg[2] = c->node();
+    for (int i = 0;  i < 3 && n->alpha_channel < 0;  ++i)
+        if (n->arg[i])
+            n->alpha_channel = n->arg[i]->alpha_channel;
+    for (int i = 0;  i < 3 && n->z_channel < 0;  ++i)
+        if (n->arg[i])
+            n->z_channel = n->arg[i]->z_channel;
+    return n;
+}
+
+
+
+// Append n and (first) everything it depends on to order, visiting each
+// distinct node only once, so that order is a topological sort of the
+// DAG in which shared subexpressions appear a single time.
+static void
+flatten_dag (const Node *n, std::vector<const Node *> &order,
+         std::map<const Node *, int> &index)
+{
+    if (index.find(n) != index.end())
+        return;
+    for (int i = 0;  i < 3;  ++i)
+        if (n->arg[i])
+            flatten_dag (n->arg[i].get(), order, index);
+    index[n] = (int) order.size();
+    order.push_back (n);
+}
+
+
+
+// Everything eval_rows needs that is shared by all threads.
+struct ExprProgram {
+    std::vector<const Node *> order;
+    std::vector<int> args;      // 3 per node: index into order, or -1
+    int chbegin, chend;
+};
+
+
+// How many pixels of a row we evaluate at a time.  Small enough that the
+// float buffers of all of the nodes stay in cache, large enough to
+// amortize the per-node overhead.
+static const int CHUNK = 1024;
+
+
+
+static bool
+eval_rows (const ExprProgram &prog, ImageBuf &dst, ROI roi)
+{
+    const int nc = prog.chend - prog.chbegin;
+    const size_t nnodes = prog.order.size();
+    int chunk = std::min (CHUNK, roi.width());
+    std::vector<float> storage (nnodes * nc * chunk);
+    std::vector<float *> buffers (nnodes);
+    for (size_t i = 0;  i < nnodes;  ++i)
+        buffers[i] = &storage[i * nc * chunk];
+
+    for (int z = roi.zbegin;  z < roi.zend;  ++z)
+    for (int y = roi.ybegin;  y < roi.yend;  ++y)
+    for (int x0 = roi.xbegin;  x0 < roi.xend;  x0 += chunk) {
+        int npix = std::min (chunk, roi.xend - x0);
+        int nvals = npix * nc;
+        for (size_t i = 0;  i < nnodes;  ++i) {
+            const Node *n = prog.order[i];
+            float *r = buffers[i];
+            const int *ai = &prog.args[3*i];
+            const float *a = ai[0] >= 0 ? buffers[ai[0]] : NULL;
+            const float *b = ai[1] >= 0 ? buffers[ai[1]] : NULL;
+            const float *c = ai[2] >= 0 ? buffers[ai[2]] : NULL;
+            switch (n->op) {
+            case Node::IMAGE : {
+                int imgchend = std::min (prog.chend, n->img->nchannels());
+                if (imgchend < prog.chend)
+                    memset (r, 0, nvals * sizeof(float));
+                if (imgchend > prog.chbegin)
+                    n->img->get_pixels (ROI (x0, x0+npix, y, y+1, z, z+1,
+                                             prog.chbegin, imgchend),
+                                        TypeDesc::FLOAT, r,
+                                        nc * sizeof(float));
+                break;
+            }
+            case Node::CONSTANT :
+                for (int ch = 0;  ch < nc;  ++ch) {
+                    float v = Node::chanval (n->values, prog.chbegin+ch, 0.0f);
+                    for (int p = 0;  p < npix;  ++p)
+                        r[p*nc+ch] = v;
+                }
+                break;
+            case Node::ADD :
+                for (int v = 0;  v < nvals;  ++v)
+                    r[v] = a[v] + b[v];
+                break;
+            case Node::SUB :
+                for (int v = 0;  v < nvals;  ++v)
+                    r[v] = a[v] - b[v];
+                break;
+            case Node::MUL :
+                for (int v = 0;  v < nvals;  ++v)
+                    r[v] = a[v] * b[v];
+                break;
+            case Node::DIV :
+                for (int v = 0;  v < nvals;  ++v)
+                    r[v] = b[v] == 0.0f ? 0.0f : a[v] / b[v];
+                break;
+            case Node::MAD :
+                for (int v = 0;  v < nvals;  ++v)
+                    r[v] = a[v] * b[v] + c[v];
+                break;
+            case Node::ABS :
+                for (int v = 0;  v < nvals;  ++v)
+                    r[v] = std::abs (a[v]);
+                break;
+            case Node::INVERT :
+                for (int v = 0;  v < nvals;  ++v)
+                    r[v] = 1.0f - a[v];
+                break;
+            case Node::POW :
+                for (int ch = 0;  ch < nc;  ++ch) {
+                    float e = Node::chanval (n->values, prog.chbegin+ch, 1.0f);
+                    for (int p = 0;  p < npix;  ++p)
+                        r[p*nc+ch] = powf (a[p*nc+ch], e);
+                }
+                break;
+            case Node::CLAMP :
+                for (int ch = 0;  ch < nc;  ++ch) {
+                    float lo = Node::chanval (n->values, prog.chbegin+ch,
+                                              -std::numeric_limits<float>::max());
+                    float hi = Node::chanval (n->values2, prog.chbegin+ch,
+                                              std::numeric_limits<float>::max());
+                    for (int p = 0;  p < npix;  ++p)
+                        r[p*nc+ch] = OIIO::clamp (a[p*nc+ch], lo, hi);
+                }
+                break;
+            case Node::PREMULT :
+            case Node::UNPREMULT : {
+                if (r != a)
+                    memcpy (r, a, nvals * sizeof(float));
+                int alpha = n->alpha_channel - prog.chbegin;
+                int zc = n->z_channel - prog.chbegin;
+                if (alpha < 0 || alpha >= nc)
+                    break;   // no alpha in range: pass through, like IBA
+                for (int p = 0;  p < npix;  ++p) {
+                    float *pix = r + p*nc;
+                    float al = pix[alpha];
+                    if (n->op == Node::UNPREMULT) {
+                        if (al == 0.0f || al == 1.0f)
+                            continue;
+                        al = 1.0f / al;
+                    }
+                    for (int ch = 0;  ch < nc;  ++ch)
+                        if (ch != alpha && ch != zc)
+                            pix[ch] *= al;
+                }
+                break;
+            }
+            case Node::COLORCONVERT :
+                memcpy (r, a, nvals * sizeof(float));
+                pvt::colorconvert_pixels (n->processor, r, npix, nc,
+                                          n->unpremult);
+                break;
+            }
+        }
+        dst.set_pixels (ROI (x0, x0+npix, y, y+1, z, z+1,
+                             prog.chbegin, prog.chend),
+                        TypeDesc::FLOAT, buffers[nnodes-1],
+                        nc * sizeof(float));
+    }
+    return true;
+}
+
+
+
+// Smallest evaluation worth sending to the GPU; below this, the copies
+// to and from the device cost more than they save.
+static const imagesize_t gpu_min_pixels = 1 << 16;
+
+// Most floats we put in one device buffer, setting the band height.
+static const size_t gpu_max_band_floats = size_t(1) << 24;
+
+
+
+// A float as an OpenCL C literal.
+static std::string
+cl_float (float v)
+{
+    if (v != v)
+        return "NAN";
+    if (v > std::numeric_limits<float>::max())
+        return "INFINITY";
+    if (v < -std::numeric_limits<float>::max())
+        return "(-INFINITY)";
+    std::string s = Strutil::format ("%.9g", v);
+    if (s.find_first_of (".e") == std::string::npos)
+        s += ".0";
+    return "(" + s + "f)";
+}
+
+
+
+// OpenCL C source for a kernel that evaluates the whole of prog for one
+// pixel per work item, with every value of the DAG in a register:
+// in<j> holds the nc channels of each pixel of images[j], and out gets
+// the results in the same layout.  Return the empty string if the
+// program has an operation we can't run on the GPU.
+static std::string
+gpu_kernel_source (const ExprProgram &prog,
+                   const std::vector<const ImageBuf *> &images)
+{
+    const int nc = prog.chend - prog.chbegin;
+    std::string src = "#pragma OPENCL FP_CONTRACT OFF\n"
+                      "__kernel void oiio_kernel (";
+    for (size_t j = 0;  j < images.size();  ++j)
+        src += Strutil::format ("__global const float *in%d, ", int(j));
+    src += Strutil::format ("__global float *out)\n{\n"
+                            "    size_t p = get_global_id(0) * %d;\n", nc);
+    for (size_t i = 0;  i < prog.order.size();  ++i) {
+        const Node *n = prog.order[i];
+        const int *ai = &prog.args[3*i];
+        int alpha = n->alpha_channel - prog.chbegin;
+        int zc = n->z_channel - prog.chbegin;
+        bool has_alpha = (alpha >= 0 && alpha < nc);
+        for (int ch = 0;  ch < nc;  ++ch) {
+            std::string a = Strutil::format ("v%d_%d", ai[0], ch);
+            std::string b = Strutil::format ("v%d_%d", ai[1], ch);
+            std::string c = Strutil::format ("v%d_%d", ai[2], ch);
+            std::string al = Strutil::format ("v%d_%d", ai[0], alpha);
+            int cc = prog.chbegin + ch;
+            std::string e;
+            switch (n->op) {
+            case Node::IMAGE : {
+                int j = int (std::find (images.begin(), images.end(), n->img)
+                             - images.begin());
+                e = Strutil::format ("in%d[p+%d]", j, ch);
+                break;
+            }
+            case Node::CONSTANT :
+                e = cl_float (Node::chanval (n->values, cc, 0.0f));
+                break;
+            case Node::ADD : e = a + " + " + b;  break;
+            case Node::SUB : e = a + " - " + b;  break;
+            case Node::MUL : e = a + " * " + b;  break;
+            case Node::DIV :
+                e = Strutil::format ("%s == 0.0f ? 0.0f : %s / %s",
+                                     b, a, b);
+                break;
+            case Node::MAD : e = a + " * " + b + " + " + c;  break;
+            case Node::ABS : e = "fabs (" + a + ")";  break;
+            case Node::INVERT : e = "1.0f - " + a;  break;
+            case Node::POW :
+                e = Strutil::format ("pow (%s, %s)", a,
+                                     cl_float (Node::chanval (n->values, cc, 1.0f)));
+                break;
+            case Node::CLAMP : {
+                std::string lo = cl_float (Node::chanval (n->values, cc,
+                                               -std::numeric_limits<float>::max()));
+                std::string hi = cl_float (Node::chanval (n->values2, cc,
+                                               std::numeric_limits<float>::max()));
+                e = Strutil::format ("%s < %s ? %s : (%s > %s ? %s : %s)",
+                                     a, lo, lo, a, hi, hi, a);
+                break;
+            }
+            case Node::PREMULT :
+                e = (! has_alpha || ch == alpha || ch == zc) ? a : a + " * " + al;
+                break;
+            case Node::UNPREMULT :
+                if (! has_alpha || ch == alpha || ch == zc)
+                    e = a;
+                else
+                    e = Strutil::format ("(%s == 0.0f || %s == 1.0f) ? %s"
+                                         " : %s * (1.0f / %s)",
+                                         al, al, a, a, al);
+                break;
+            default :
+                return std::string();   // e.g. COLORCONVERT: CPU only
+            }
+            src += Strutil::format ("    float v%d_%d = %s;\n", int(i), ch, e);
+        }
+    }
+    for (int ch = 0;  ch < nc;  ++ch)
+        src += Strutil::format ("    out[p+%d] = v%d_%d;\n", ch,
+                                int(prog.order.size()-1), ch);
+    src += "}\n";
+    return src;
+}
+
+
+
+// Copy the rows of roi (a band starting at row band.ybegin) of img, as
+// float, into the band buffer whose pixels have nc channels; channels
+// that img lacks are left alone.
+static bool
+gpu_fetch_rows (const ImageBuf *img, ROI band, float *buf, int nc, ROI roi)
+{
+    int chend = std::min (roi.chend, img->nchannels());
+    if (chend <= roi.chbegin)
+        return true;
+    roi.chend = chend;
+    stride_t ystride = stride_t(band.width()) * nc * sizeof(float);
+    return img->get_pixels (roi, TypeDesc::FLOAT,
+                            buf + size_t(roi.ybegin - band.ybegin) * band.width() * nc,
+                            nc * sizeof(float), ystride);
+}
+
+
+
+static bool
+gpu_store_rows (ImageBuf &dst, ROI band, const float *buf, int nc, ROI roi)
+{
+    stride_t ystride = stride_t(band.width()) * nc * sizeof(float);
+    return dst.set_pixels (roi, TypeDesc::FLOAT,
+                           buf + size_t(roi.ybegin - band.ybegin) * band.width() * nc,
+                           nc * sizeof(float), ystride);
+}
+
+
+
+// Evaluate prog for roi on the GPU, a band of rows at a time: the images
+// are uploaded once per band and the whole fused DAG runs in a single
+// kernel, so no intermediate value ever leaves the device.  Return false
+// (having not yet written dst if it's one of the images) if the GPU
+// can't do it, so the caller falls back to the CPU.
+static bool
+gpu_eval (const ExprProgram &prog, const std::vector<const ImageBuf *> &images,
+          ImageBuf &dst, ROI roi, int nthreads)
+{
+    std::string source = gpu_kernel_source (prog, images);
+    if (source.empty())
+        return false;
+    const int nc = roi.nchannels();
+    size_t rowfloats = size_t(roi.width()) * nc;
+    int bandrows = int (std::max (size_t(1), gpu_max_band_floats / rowfloats));
+    bool dst_is_input = std::find (images.begin(), images.end(), &dst)
+                            != images.end();
+    if (dst_is_input && bandrows < roi.height())
+        return false;   // a later band's failure couldn't fall back
+    std::vector<std::vector<float> > inputs (images.size());
+    std::vector<float> result;
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        for (int y = roi.ybegin;  y < roi.yend;  y += bandrows) {
+            ROI band (roi.xbegin, roi.xend, y, std::min (y+bandrows, roi.yend),
+                      z, z+1, roi.chbegin, roi.chend);
+            size_t nfloats = size_t(band.npixels()) * nc;
+            std::vector<pvt::GPUArg> args;
+            for (size_t j = 0;  j < images.size();  ++j) {
+                inputs[j].assign (nfloats, 0.0f);
+                ImageBufAlgo::parallel_image (
+                    OIIO::bind (gpu_fetch_rows, images[j], band,
+                                &inputs[j][0], nc, _1),
+                    band, nthreads);
+                args.push_back (pvt::GPUArg (&inputs[j][0], NULL, nfloats));
+            }
+            result.resize (nfloats);
+            args.push_back (pvt::GPUArg (NULL, &result[0], nfloats));
+            if (! pvt::gpu_run_kernel (source, args, size_t(band.npixels())))
+                return false;
+            ImageBufAlgo::parallel_image (
+                OIIO::bind (gpu_store_rows, OIIO::ref(dst), band,
+                            &result[0], nc, _1),
+                band, nthreads);
+        }
+    }
+    return true;
+}
+
+}  // anon namespace
+
+
+
+ImageBufAlgo::Expr::Expr (const ImageBuf &img)
+    : m_node (new Node (Node::IMAGE))
+{
+    m_node->img = &img;
+    m_node->alpha_channel = img.spec().alpha_channel;
+    m_node->z_channel = img.spec().z_channel;
+}
+
+
+
+ImageBufAlgo::Expr::Expr (float value)
+    : m_node (new Node (Node::CONSTANT))
+{
+    m_node->values.push_back (value);
+}
+
+
+
+ImageBufAlgo::Expr::Expr (const float *values, int nvalues)
+    : m_node (new Node (Node::CONSTANT))
+{
+    m_node->values.assign (values, values + std::max (nvalues, 0));
+    if (m_node->values.empty())
+        m_node->values.push_back (0.0f);
+}
+
+
+
+ImageBufAlgo::Expr::~Expr ()
+{
+}
+
+
+
+int
+ImageBufAlgo::Expr::nodes () const
+{
+    std::vector<const Node *> order;
+    std::map<const Node *, int> index;
+    flatten_dag (m_node.get(), order, index);
+    return (int) order.size();
+}
+
+
+
+bool
+ImageBufAlgo::Expr::eval (ImageBuf &dst, ROI roi, int nthreads) const
+{
+    ExprProgram prog;
+    std::map<const Node *, int> index;
+    flatten_dag (m_node.get(), prog.order, index);
+    prog.args.resize (3 * prog.order.size(), -1);
+    std::vector<const ImageBuf *> images;
+    for (size_t i = 0;  i < prog.order.size();  ++i) {
+        const Node *n = prog.order[i];
+        for (int a = 0;  a < 3;  ++a)
+            if (n->arg[a])
+                prog.args[3*i+a] = index[n->arg[a].get()];
+        if (n->op == Node::IMAGE &&
+            std::find (images.begin(), images.end(), n->img) == images.end())
+            images.push_back (n->img);
+        if (n->op == Node::COLORCONVERT && ! n->processor) {
+            dst.error ("Passed NULL ColorProcessor to Expr colorconvert()");
+            return false;
+        }
+    }
+    for (size_t i = 0;  i < images.size();  ++i) {
+        if (! images[i]->initialized()) {
+            dst.error ("Uninitialized input image");
+            return false;
+        }
+    }
+    if (images.empty() && ! dst.initialized() && ! roi.defined()) {
+        dst.error ("Expr without images needs a defined ROI or destination");
+        return false;
+    }
+
+    // IBAprep can look at up to three inputs; if there are more and we
+    // must allocate dst, settle the region to cover all of them here.
+    if (images.size() > 3 && ! dst.initialized() && ! roi.defined()) {
+        roi = images[0]->roi();
+        for (size_t i = 1;  i < images.size();  ++i)
+            roi = roi_union (roi, images[i]->roi());
+    }
+    if (! IBAprep (roi, &dst,
+                   images.size() > 0 ? images[0] : NULL,
+                   images.size() > 1 ? images[1] : NULL,
+                   images.size() > 2 ? images[2] : NULL,
+                   NULL, IBAprep_DST_FLOAT_PIXELS))
+        return false;
+    prog.chbegin = roi.chbegin;
+    prog.chend = roi.chend;
+    if (prog.chend <= prog.chbegin)
+        return true;
+
+    if (roi.npixels() >= gpu_min_pixels && pvt::gpu_enabled() &&
+        gpu_eval (prog, images, dst, roi, nthreads))
+        return true;
+
+    ImageBufAlgo::parallel_image (OIIO::bind (eval_rows, OIIO::cref(prog),
+                                              OIIO::ref(dst), _1),
+                                  roi, nthreads);
+    return true;
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::operator+ (const Expr &a, const Expr &b)
+{
+    return Expr (make_node (Node::ADD, a, &b));
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::operator- (const Expr &a, const Expr &b)
+{
+    return Expr (make_node (Node::SUB, a, &b));
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::operator* (const Expr &a, const Expr &b)
+{
+    return Expr (make_node (Node::MUL, a, &b));
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::operator/ (const Expr &a, const Expr &b)
+{
+    return Expr (make_node (Node::DIV, a, &b));
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::mad (const Expr &a, const Expr &b, const Expr &c)
+{
+    return Expr (make_node (Node::MAD, a, &b, &c));
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::abs (const Expr &a)
+{
+    return Expr (make_node (Node::ABS, a));
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::invert (const Expr &a)
+{
+    return Expr (make_node (Node::INVERT, a));
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::pow (const Expr &a, const float *b, int nvalues)
+{
+    shared_ptr<Node> n = make_node (Node::POW, a);
+    n->values.assign (b, b + std::max (nvalues, 0));
+    if (n->values.empty())
+        n->values.push_back (1.0f);
+    return Expr (n);
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::pow (const Expr &a, float b)
+{
+    return pow (a, &b, 1);
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::clamp (const Expr &a, const float *min, const float *max,
+                     int nvalues)
+{
+    shared_ptr<Node> n = make_node (Node::CLAMP, a);
+    nvalues = std::max (nvalues, 0);
+    if (min)
+        n->values.assign (min, min + nvalues);
+    else
+        n->values.resize (1, -std::numeric_limits<float>::max());
+    if (max)
+        n->values2.assign (max, max + nvalues);
+    else
+        n->values2.resize (1, std::numeric_limits<float>::max());
+    if (n->values.empty())
+        n->values.push_back (-std::numeric_limits<float>::max());
+    if (n->values2.empty())
+        n->values2.push_back (std::numeric_limits<float>::max());
+    return Expr (n);
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::clamp (const Expr &a, float min, float max)
+{
+    return clamp (a, &min, &max, 1);
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::premult (const Expr &a)
+{
+    return Expr (make_node (Node::PREMULT, a));
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::unpremult (const Expr &a)
+{
+    return Expr (make_node (Node::UNPREMULT, a));
+}
+
+
+
+ImageBufAlgo::Expr
+ImageBufAlgo::colorconvert (const Expr &a, const ColorProcessor *processor,
+                            bool unpremult)
+{
+    shared_ptr<Node> n = make_node (Node::COLORCONVERT, a);
+    n->processor = processor;
+    n->unpremult = unpremult;
+    return Expr (n);
+}
+
+
+OIIO_NAMESPACE_END
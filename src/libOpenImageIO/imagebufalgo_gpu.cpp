@@ -0,0 +1,291 @@
+/*
+  Copyright 2016 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+/// \file
+/// Optional GPU compute for ImageBufAlgo, by way of OpenCL.  This is the
+/// device side only: finding a GPU, compiling (and caching) kernels, and
+/// keeping a pool of device buffers.  It does nothing unless OpenImageIO
+/// was built with USE_OPENCL and OIIO::attribute("gpu",1) is set, and
+/// every failure is reported to the caller, which then computes on the
+/// CPU instead.
+
+#ifdef USE_OPENCL
+# ifdef __APPLE__
+#  include <OpenCL/opencl.h>
+# else
+#  include <CL/cl.h>
+# endif
+#endif
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/strutil.h"
+#include "imageio_pvt.h"
+
+
+OIIO_NAMESPACE_BEGIN
+
+
+#ifdef USE_OPENCL
+namespace {
+
+// Device buffers we keep for reuse, rather than freeing them after each
+// kernel, so that a sequence of similar evaluations allocates once.
+static const size_t max_pooled_buffers = 16;
+
+
+class GPUContext {
+public:
+    GPUContext () : m_ok(false), m_device(NULL), m_context(NULL),
+                    m_queue(NULL), m_maxalloc(0)
+    {
+        cl_platform_id platforms[8];
+        cl_uint nplatforms = 0;
+        if (clGetPlatformIDs (8, platforms, &nplatforms) != CL_SUCCESS)
+            return;
+        for (cl_uint p = 0;  p < nplatforms && ! m_device;  ++p) {
+            cl_device_id dev = NULL;
+            cl_uint ndevices = 0;
+            if (clGetDeviceIDs (platforms[p], CL_DEVICE_TYPE_GPU, 1, &dev,
+                                &ndevices) == CL_SUCCESS && ndevices)
+                m_device = dev;
+        }
+        if (! m_device)
+            return;
+        cl_int err = CL_SUCCESS;
+        m_context = clCreateContext (NULL, 1, &m_device, NULL, NULL, &err);
+        if (err != CL_SUCCESS)
+            return;
+        m_queue = clCreateCommandQueue (m_context, m_device, 0, &err);
+        if (err != CL_SUCCESS)
+            return;
+        cl_ulong maxalloc = 0;
+        clGetDeviceInfo (m_device, CL_DEVICE_MAX_MEM_ALLOC_SIZE,
+                         sizeof(maxalloc), &maxalloc, NULL);
+        m_maxalloc = size_t (maxalloc);
+        m_ok = true;
+    }
+
+    ~GPUContext () {
+        for (kernel_map::iterator k = m_kernels.begin();  k != m_kernels.end();  ++k) {
+            if (k->second.first)
+                clReleaseKernel (k->second.first);
+            if (k->second.second)
+                clReleaseProgram (k->second.second);
+        }
+        for (size_t i = 0;  i < m_pool.size();  ++i)
+            clReleaseMemObject (m_pool[i].second);
+        if (m_queue)
+            clReleaseCommandQueue (m_queue);
+        if (m_context)
+            clReleaseContext (m_context);
+    }
+
+    bool ok () const { return m_ok; }
+    cl_command_queue queue () const { return m_queue; }
+    size_t maxalloc () const { return m_maxalloc; }
+
+    // The kernel "oiio_kernel" of the given source, built the first time
+    // it's asked for.  A source that fails to build is remembered (as
+    // NULL), so it isn't retried each time.
+    cl_kernel kernel (const std::string &source) {
+        kernel_map::iterator found = m_kernels.find (source);
+        if (found != m_kernels.end())
+            return found->second.first;
+        const char *src = source.c_str();
+        cl_int err = CL_SUCCESS;
+        cl_program program = clCreateProgramWithSource (m_context, 1, &src,
+                                                        NULL, &err);
+        cl_kernel kernel = NULL;
+        if (err == CL_SUCCESS &&
+            clBuildProgram (program, 1, &m_device, "", NULL, NULL) == CL_SUCCESS)
+            kernel = clCreateKernel (program, "oiio_kernel", &err);
+        else if (program)
+            debug_build_log (program);
+        if (! kernel && program) {
+            clReleaseProgram (program);
+            program = NULL;
+        }
+        m_kernels[source] = std::make_pair (kernel, program);
+        return kernel;
+    }
+
+    // A device buffer of at least the given size: the smallest one in
+    // the pool that's big enough, or a new one.
+    cl_mem get_buffer (size_t bytes, size_t &capacity) {
+        int best = -1;
+        for (size_t i = 0;  i < m_pool.size();  ++i)
+            if (m_pool[i].first >= bytes &&
+                (best < 0 || m_pool[i].first < m_pool[best].first))
+                best = int(i);
+        if (best >= 0) {
+            cl_mem mem = m_pool[best].second;
+            capacity = m_pool[best].first;
+            m_pool.erase (m_pool.begin() + best);
+            return mem;
+        }
+        cl_int err = CL_SUCCESS;
+        cl_mem mem = clCreateBuffer (m_context, CL_MEM_READ_WRITE, bytes,
+                                     NULL, &err);
+        capacity = bytes;
+        return err == CL_SUCCESS ? mem : NULL;
+    }
+
+    // Return a buffer to the pool, evicting the smallest if it's full.
+    void release_buffer (cl_mem mem, size_t capacity) {
+        m_pool.push_back (std::make_pair (capacity, mem));
+        if (m_pool.size() > max_pooled_buffers) {
+            size_t smallest = 0;
+            for (size_t i = 1;  i < m_pool.size();  ++i)
+                if (m_pool[i].first < m_pool[smallest].first)
+                    smallest = i;
+            clReleaseMemObject (m_pool[smallest].second);
+            m_pool.erase (m_pool.begin() + smallest);
+        }
+    }
+
+private:
+    void debug_build_log (cl_program program) {
+        size_t len = 0;
+        clGetProgramBuildInfo (program, m_device, CL_PROGRAM_BUILD_LOG, 0,
+                               NULL, &len);
+        std::vector<char> log (len + 1, 0);
+        clGetProgramBuildInfo (program, m_device, CL_PROGRAM_BUILD_LOG, len,
+                               &log[0], NULL);
+        debugmsg ("GPU kernel build failed: %s", &log[0]);
+    }
+
+    typedef std::map<std::string, std::pair<cl_kernel,cl_program> > kernel_map;
+    bool m_ok;
+    cl_device_id m_device;
+    cl_context m_context;
+    cl_command_queue m_queue;
+    size_t m_maxalloc;
+    kernel_map m_kernels;
+    std::vector<std::pair<size_t,cl_mem> > m_pool;
+};
+
+
+// There is one context, for the first GPU found, created the first time
+// it's needed and used by one kernel at a time.
+static mutex gpu_mutex;
+static GPUContext *gpu = NULL;
+
+static GPUContext &
+gpu_context ()
+{
+    if (! gpu)
+        gpu = new GPUContext;
+    return *gpu;
+}
+
+}  // anon namespace
+#endif
+
+
+
+bool
+pvt::gpu_enabled ()
+{
+#ifdef USE_OPENCL
+    if (! oiio_gpu)
+        return false;
+    lock_guard lock (gpu_mutex);
+    return gpu_context().ok();
+#else
+    return false;
+#endif
+}
+
+
+
+bool
+pvt::gpu_run_kernel (const std::string &source,
+                     const std::vector<GPUArg> &args, size_t nitems)
+{
+#ifdef USE_OPENCL
+    if (! oiio_gpu || nitems == 0)
+        return false;
+    lock_guard lock (gpu_mutex);
+    GPUContext &ctx (gpu_context());
+    if (! ctx.ok())
+        return false;
+    cl_kernel kernel = ctx.kernel (source);
+    if (! kernel)
+        return false;
+
+    bool ok = true;
+    std::vector<cl_mem> mems (args.size(), (cl_mem)NULL);
+    std::vector<size_t> capacities (args.size(), 0);
+    for (size_t i = 0;  ok && i < args.size();  ++i) {
+        size_t bytes = args[i].nfloats * sizeof(float);
+        if (bytes == 0 || bytes > ctx.maxalloc()) {
+            ok = false;
+            break;
+        }
+        mems[i] = ctx.get_buffer (bytes, capacities[i]);
+        ok = (mems[i] != NULL);
+        if (ok && args[i].in)
+            ok = clEnqueueWriteBuffer (ctx.queue(), mems[i], CL_FALSE, 0,
+                                       bytes, args[i].in, 0, NULL, NULL)
+                     == CL_SUCCESS;
+        if (ok)
+            ok = clSetKernelArg (kernel, cl_uint(i), sizeof(cl_mem),
+                                 &mems[i]) == CL_SUCCESS;
+    }
+    if (ok) {
+        size_t global = nitems;
+        ok = clEnqueueNDRangeKernel (ctx.queue(), kernel, 1, NULL, &global,
+                                     NULL, 0, NULL, NULL) == CL_SUCCESS;
+    }
+    for (size_t i = 0;  ok && i < args.size();  ++i)
+        if (args[i].out)
+            ok = clEnqueueReadBuffer (ctx.queue(), mems[i], CL_FALSE, 0,
+                                      args[i].nfloats * sizeof(float),
+                                      args[i].out, 0, NULL, NULL)
+                     == CL_SUCCESS;
+    // Whatever happened, nothing may still refer to the caller's memory.
+    if (clFinish (ctx.queue()) != CL_SUCCESS)
+        ok = false;
+    for (size_t i = 0;  i < mems.size();  ++i)
+        if (mems[i])
+            ctx.release_buffer (mems[i], capacities[i]);
+    return ok;
+#else
+    return false;
+#endif
+}
+
+
+OIIO_NAMESPACE_END
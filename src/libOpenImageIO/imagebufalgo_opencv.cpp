@@ -36,21 +36,135 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core_c.h>
 #include <opencv2/highgui/highgui_c.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
 #endif
 
 #include <iostream>
 #include <map>
 
+#include <boost/scoped_array.hpp>
+
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/imagebufalgo.h"
+#include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/dassert.h"
 #include "OpenImageIO/thread.h"
 #include "OpenImageIO/sysutil.h"
 
+#if OIIO_CPLUSPLUS_VERSION >= 11
+# include <condition_variable>
+#endif
+
 
 
 OIIO_NAMESPACE_BEGIN
 
+namespace {
+#if OIIO_CPLUSPLUS_VERSION >= 11
+typedef std::condition_variable condition_variable;
+typedef std::unique_lock<mutex> unique_lock;
+#else
+typedef boost::condition_variable condition_variable;
+typedef boost::unique_lock<mutex> unique_lock;
+#endif
+}
+
+
+
+#ifdef USE_OPENCV
+// Copy and convert the rows roi.ybegin..roi.yend of an image between
+// two strided buffers, reversing the order of the first three channels
+// (RGB <-> BGR, the way OpenCV stores color) on the way, all as one
+// pass per channel.
+static bool
+copy_swap_bgr (const char *src, TypeDesc srcformat, stride_t sxstride,
+               stride_t systride, char *dst, TypeDesc dstformat,
+               stride_t dxstride, stride_t dystride, int nchannels,
+               int width, ROI roi)
+{
+    for (int c = 0;  c < nchannels;  ++c) {
+        int sc = (nchannels >= 3 && c < 3) ? 2 - c : c;
+        convert_image (1, width, roi.height(), 1,
+                       src + roi.ybegin*systride + sc*srcformat.size(),
+                       srcformat, sxstride, systride, AutoStride,
+                       dst + roi.ybegin*dystride + c*dstformat.size(),
+                       dstformat, dxstride, dystride, AutoStride);
+    }
+    return true;
+}
+
+
+
+// Run copy_swap_bgr over a whole width x height image, in parallel bands.
+static void
+parallel_copy_swap_bgr (const void *src, TypeDesc srcformat,
+                        stride_t sxstride, stride_t systride,
+                        void *dst, TypeDesc dstformat,
+                        stride_t dxstride, stride_t dystride,
+                        int nchannels, int width, int height, int nthreads)
+{
+    ImageBufAlgo::parallel_image (
+        OIIO::bind (copy_swap_bgr, (const char *)src, srcformat,
+                    sxstride, systride, (char *)dst, dstformat,
+                    dxstride, dystride, nchannels, width, _1),
+        ROI (0, width, 0, height), nthreads);
+}
+
+
+
+// Make dst a local buffer of the given spec, reusing its memory when it
+// already is one of exactly that shape (as for a recycled video frame).
+static void
+reset_for_copy (ImageBuf &dst, const ImageSpec &spec)
+{
+    const ImageSpec &d (dst.spec());
+    if (dst.storage() == ImageBuf::LOCALBUFFER && ! dst.deep() &&
+        dst.local_tile_width() == 0 && d.width == spec.width &&
+        d.height == spec.height && d.depth == 1 &&
+        d.nchannels == spec.nchannels && d.format == spec.format &&
+        d.channelformats.empty() && d.x == 0 && d.y == 0 && d.z == 0) {
+        dst.specmod().extra_attribs.clear();
+        return;
+    }
+    dst.reset (dst.name(), spec);
+}
+
+
+
+static TypeDesc
+typedesc_from_cvdepth (int depth)
+{
+    switch (depth) {
+    case CV_8U  : return TypeDesc::UINT8;
+    case CV_8S  : return TypeDesc::INT8;
+    case CV_16U : return TypeDesc::UINT16;
+    case CV_16S : return TypeDesc::INT16;
+    case CV_32S : return TypeDesc::INT32;
+    case CV_32F : return TypeDesc::FLOAT;
+    case CV_64F : return TypeDesc::DOUBLE;
+    default     : return TypeDesc::UNKNOWN;
+    }
+}
+
+
+
+static int
+cvdepth_from_typedesc (TypeDesc t)
+{
+    switch (t.basetype) {
+    case TypeDesc::UINT8  : return CV_8U;
+    case TypeDesc::INT8   : return CV_8S;
+    case TypeDesc::UINT16 : return CV_16U;
+    case TypeDesc::INT16  : return CV_16S;
+    case TypeDesc::INT32  : return CV_32S;
+    case TypeDesc::FLOAT  : return CV_32F;
+    case TypeDesc::DOUBLE : return CV_64F;
+    default               : return -1;
+    }
+}
+#endif
+
 
 
 bool
@@ -94,35 +208,23 @@ ImageBufAlgo::from_IplImage (ImageBuf &dst, const IplImage *ipl,
         return false;
     }
     
-    dst.reset (dst.name(), spec);
-    size_t pixelsize = srcformat.size()*spec.nchannels;
-    // Account for the origin in the line step size, to end up with the
-    // standard OIIO origin-at-upper-left:
-    size_t linestep = ipl->origin ? -ipl->widthStep : ipl->widthStep;
-    // Block copy and convert
-    convert_image (spec.nchannels, spec.width, spec.height, 1,
-                   ipl->imageData, srcformat,
-                   pixelsize, linestep, 0, 
-                   dst.pixeladdr(0,0), dstformat,
-                   spec.pixel_bytes(), spec.scanline_bytes(), 0);
-    // FIXME - honor dataOrder.  I'm not sure if it is ever used by
-    // OpenCV.  Fix when it becomes a problem.
-
-    // OpenCV uses BGR ordering
-    // FIXME: what do they do with alpha?
-    if (spec.nchannels >= 3) {
-        float pixel[4];
-        for (int y = 0;  y < spec.height;  ++y) {
-            for (int x = 0;  x < spec.width;  ++x) {
-                dst.getpixel (x, y, pixel, 4);
-                float tmp = pixel[0];  pixel[0] = pixel[2]; pixel[2] = tmp;
-                dst.setpixel (x, y, pixel, 4);
-            }
-        }
+    reset_for_copy (dst, spec);
+    stride_t pixelsize = srcformat.size()*spec.nchannels;
+    // Account for the origin, to end up with the standard OIIO
+    // origin-at-upper-left: a bottom-left origin image is read from its
+    // last row upward.
+    const char *start = ipl->imageData;
+    stride_t linestep = ipl->widthStep;
+    if (ipl->origin) {
+        start += stride_t(spec.height-1) * linestep;
+        linestep = -linestep;
     }
-    // FIXME -- the copy and channel swap should happen all as one loop,
-    // probably templated by type.
-
+    // Copy, convert, and swap OpenCV's BGR ordering back to RGB, all as
+    // one pass.  Alpha, if present, is already last.
+    parallel_copy_swap_bgr (start, srcformat, pixelsize, linestep,
+                            dst.localpixels(), dstformat,
+                            dst.pixel_stride(), dst.scanline_stride(),
+                            spec.nchannels, spec.width, spec.height, 0);
     return true;
 #else
     dst.error ("fromIplImage not supported -- no OpenCV support at compile time");
@@ -136,7 +238,39 @@ IplImage *
 ImageBufAlgo::to_IplImage (const ImageBuf &src)
 {
 #ifdef USE_OPENCV
-    return NULL;
+    ImageBuf tmp;
+    const ImageBuf *s = &src;
+    if (! src.localpixels() || src.local_tile_width()) {
+        // Pixels not laid out in local scanlines: make a plain copy.
+        tmp.copy (src);
+        tmp.set_local_tiles (0);
+        s = &tmp;
+    }
+    const ImageSpec &spec (s->spec());
+    if (s->deep() || ! spec.channelformats.empty() || spec.depth > 1)
+        return NULL;
+    int depth;
+    TypeDesc dstformat = spec.format;
+    switch (spec.format.basetype) {
+    case TypeDesc::UINT8  : depth = IPL_DEPTH_8U;  break;
+    case TypeDesc::INT8   : depth = IPL_DEPTH_8S;  break;
+    case TypeDesc::UINT16 : depth = IPL_DEPTH_16U; break;
+    case TypeDesc::INT16  : depth = IPL_DEPTH_16S; break;
+    case TypeDesc::INT32  : depth = IPL_DEPTH_32S; break;
+    case TypeDesc::DOUBLE : depth = IPL_DEPTH_64F; break;
+    default :  // float, and anything else (like half) IplImage lacks
+        depth = IPL_DEPTH_32F;  dstformat = TypeDesc::FLOAT;  break;
+    }
+    IplImage *ipl = cvCreateImage (cvSize (spec.width, spec.height), depth,
+                                   spec.nchannels);
+    if (! ipl)
+        return NULL;
+    parallel_copy_swap_bgr (s->pixeladdr (spec.x, spec.y), spec.format,
+                            s->pixel_stride(), s->scanline_stride(),
+                            ipl->imageData, dstformat,
+                            dstformat.size() * spec.nchannels, ipl->widthStep,
+                            spec.nchannels, spec.width, spec.height, 0);
+    return ipl;
 #else
     return NULL;
 #endif
@@ -144,6 +278,124 @@ ImageBufAlgo::to_IplImage (const ImageBuf &src)
 
 
 
+bool
+ImageBufAlgo::from_OpenCV (ImageBuf &dst, const cv::Mat &mat,
+                           TypeDesc convert, int nthreads)
+{
+#ifdef USE_OPENCV
+    TypeDesc srcformat = typedesc_from_cvdepth (mat.depth());
+    if (srcformat == TypeDesc::UNKNOWN || mat.dims != 2 || mat.empty()) {
+        dst.error ("Unsupported cv::Mat (depth %d, %d dimensions)",
+                   mat.depth(), mat.dims);
+        return false;
+    }
+    TypeDesc dstformat = (convert != TypeDesc::UNKNOWN) ? convert : srcformat;
+    ImageSpec spec (mat.cols, mat.rows, mat.channels(), dstformat);
+    reset_for_copy (dst, spec);
+    parallel_copy_swap_bgr (mat.data, srcformat, stride_t(mat.elemSize()),
+                            stride_t(mat.step[0]), dst.localpixels(),
+                            dstformat, dst.pixel_stride(),
+                            dst.scanline_stride(), spec.nchannels,
+                            spec.width, spec.height, nthreads);
+    return true;
+#else
+    dst.error ("from_OpenCV not supported -- no OpenCV support at compile time");
+    return false;
+#endif
+}
+
+
+
+bool
+ImageBufAlgo::to_OpenCV (cv::Mat &dst, const ImageBuf &src, int nthreads)
+{
+#ifdef USE_OPENCV
+    ImageBuf tmp;
+    const ImageBuf *s = &src;
+    if (! src.localpixels() || src.local_tile_width()) {
+        tmp.copy (src);
+        tmp.set_local_tiles (0);
+        s = &tmp;
+    }
+    const ImageSpec &spec (s->spec());
+    if (s->deep() || ! spec.channelformats.empty() || spec.depth > 1 ||
+        spec.nchannels > CV_CN_MAX)
+        return false;
+    TypeDesc dstformat = spec.format;
+    if (dstformat == TypeDesc::HALF)
+        dstformat = TypeDesc::FLOAT;   // OpenCV has no half
+    int depth = cvdepth_from_typedesc (dstformat);
+    if (depth < 0)
+        return false;
+    dst.create (spec.height, spec.width, CV_MAKETYPE (depth, spec.nchannels));
+    parallel_copy_swap_bgr (s->pixeladdr (spec.x, spec.y), spec.format,
+                            s->pixel_stride(), s->scanline_stride(),
+                            dst.data, dstformat, stride_t(dst.elemSize()),
+                            stride_t(dst.step[0]), spec.nchannels,
+                            spec.width, spec.height, nthreads);
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+
+bool
+ImageBufAlgo::wrap_OpenCV (ImageBuf &dst, cv::Mat &mat)
+{
+#ifdef USE_OPENCV
+    TypeDesc format = typedesc_from_cvdepth (mat.depth());
+    if (format == TypeDesc::UNKNOWN || mat.dims != 2 || mat.empty()) {
+        dst.error ("Unsupported cv::Mat (depth %d, %d dimensions)",
+                   mat.depth(), mat.dims);
+        return false;
+    }
+    ImageSpec spec (mat.cols, mat.rows, mat.channels(), format);
+    if (spec.nchannels == 3 || spec.nchannels == 4) {
+        // The wrapped memory is in OpenCV's order; say so.
+        spec.channelnames[0] = "B";
+        spec.channelnames[2] = "R";
+    }
+    ImageBuf wrapped (dst.name(), spec, mat.data, stride_t(mat.elemSize()),
+                      stride_t(mat.step[0]));
+    dst.swap (wrapped);
+    return true;
+#else
+    dst.error ("wrap_OpenCV not supported -- no OpenCV support at compile time");
+    return false;
+#endif
+}
+
+
+
+bool
+ImageBufAlgo::wrap_OpenCV (cv::Mat &dst, ImageBuf &src)
+{
+#ifdef USE_OPENCV
+    if (src.deep() || src.local_tile_width() != 0)
+        return false;
+    const ImageSpec &spec (src.spec());
+    int depth = cvdepth_from_typedesc (spec.format);
+    if (depth < 0 || ! spec.channelformats.empty() || spec.depth > 1 ||
+        spec.nchannels > CV_CN_MAX ||
+        src.pixel_stride() != stride_t(spec.pixel_bytes()))
+        return false;
+    void *pixels = src.localpixels();   // non-const: unshares the buffer
+    if (! pixels || src.scanline_stride() <= 0)
+        return false;
+    dst = cv::Mat (spec.height, spec.width,
+                   CV_MAKETYPE (depth, spec.nchannels),
+                   src.pixeladdr (spec.x, spec.y),
+                   size_t (src.scanline_stride()));
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+
 namespace {
 
 #ifdef USE_OPENCV
@@ -177,6 +429,24 @@ static CameraHolder cameras;
 }
 
 
+#ifdef USE_OPENCV
+// The current local time, formatted as an EXIF-style DateTime.
+static std::string
+capture_datetime ()
+{
+    time_t now;
+    time (&now);
+    struct tm tmtime;
+    Sysutil::get_local_time (&now, &tmtime);
+    return Strutil::format ("%4d:%02d:%02d %02d:%02d:%02d",
+                            tmtime.tm_year+1900, tmtime.tm_mon+1,
+                            tmtime.tm_mday, tmtime.tm_hour,
+                            tmtime.tm_min, tmtime.tm_sec);
+}
+#endif
+
+
+
 bool
 ImageBufAlgo::capture_image (ImageBuf &dst, int cameranum, TypeDesc convert)
 {
@@ -197,15 +467,7 @@ ImageBufAlgo::capture_image (ImageBuf &dst, int cameranum, TypeDesc convert)
         }
     }
 
-    time_t now;
-    time (&now);
-    struct tm tmtime;
-    Sysutil::get_local_time (&now, &tmtime);
-    std::string datetime = Strutil::format ("%4d:%02d:%02d %02d:%02d:%02d",
-                                   tmtime.tm_year+1900, tmtime.tm_mon+1,
-                                   tmtime.tm_mday, tmtime.tm_hour,
-                                   tmtime.tm_min, tmtime.tm_sec);
-
+    std::string datetime = capture_datetime ();
     bool ok = ImageBufAlgo::from_IplImage (dst, frame, convert);
     // cvReleaseImage (&frame);   // unnecessary?
     if (ok)
@@ -219,4 +481,198 @@ ImageBufAlgo::capture_image (ImageBuf &dst, int cameranum, TypeDesc convert)
 }
 
 
+
+class ImageBufAlgo::CaptureStream::Impl {
+public:
+    Impl (int cameranum, int nframes, TypeDesc convert)
+        : m_ring(new ImageBuf[std::max(nframes,1)]),
+          m_nframes(std::max(nframes,1)), m_head(0), m_count(0),
+          m_dropped(0), m_convert(convert), m_running(false),
+          m_thread(NULL)
+    {
+#ifdef USE_OPENCV
+        if (! m_capture.open (cameranum)) {
+            m_error = Strutil::format ("Could not open camera %d (OpenCV error)",
+                                       cameranum);
+            return;
+        }
+        m_running = true;
+        m_thread = new thread (OIIO::bind (&Impl::run, this));
+#else
+        m_error = "CaptureStream not supported -- no OpenCV support at compile time";
+#endif
+    }
+
+    ~Impl () { stop (); }
+
+    void stop () {
+        {
+            lock_guard lock (m_mutex);
+            m_running = false;
+        }
+        m_cv.notify_all ();
+        if (m_thread) {
+            m_thread->join ();
+            delete m_thread;
+            m_thread = NULL;
+        }
+#ifdef USE_OPENCV
+        if (m_capture.isOpened())
+            m_capture.release ();
+#endif
+    }
+
+    bool next_frame (ImageBuf &dst) {
+        unique_lock lock (m_mutex);
+        while (m_count == 0 && m_running)
+            m_cv.wait (lock);
+        if (m_count == 0)
+            return false;
+        // Hand over the frame by swapping, so the ring slot inherits
+        // dst's old buffer for the capture thread to refill.
+        dst.swap (m_ring[m_head]);
+        m_head = (m_head + 1) % m_nframes;
+        --m_count;
+        return true;
+    }
+
+    bool running () const {
+        lock_guard lock (m_mutex);
+        return m_running;
+    }
+
+    int frames_dropped () const {
+        lock_guard lock (m_mutex);
+        return m_dropped;
+    }
+
+    std::string geterror () const {
+        lock_guard lock (m_mutex);
+        return m_error;
+    }
+
+private:
+#ifdef USE_OPENCV
+    // The capture thread: grab a frame, convert it into the ring slot
+    // just past the waiting frames (outside the lock -- the consumer
+    // only ever touches waiting frames), then publish it.
+    void run () {
+        cv::Mat frame;
+        for (;;) {
+            {
+                lock_guard lock (m_mutex);
+                if (! m_running)
+                    break;
+            }
+            if (! m_capture.read (frame) || frame.empty()) {
+                fail ("Could not read a camera frame (OpenCV error)");
+                break;
+            }
+            int slot;
+            {
+                lock_guard lock (m_mutex);
+                if (m_count == m_nframes) {
+                    // The reader fell behind: drop the oldest frame.
+                    m_head = (m_head + 1) % m_nframes;
+                    --m_count;
+                    ++m_dropped;
+                }
+                slot = (m_head + m_count) % m_nframes;
+            }
+            ImageBuf &buf (m_ring[slot]);
+            if (! from_OpenCV (buf, frame, m_convert, 1)) {
+                fail (buf.geterror());
+                break;
+            }
+            buf.specmod().attribute ("DateTime", capture_datetime());
+            {
+                lock_guard lock (m_mutex);
+                ++m_count;
+            }
+            m_cv.notify_one ();
+        }
+    }
+
+    void fail (const std::string &err) {
+        {
+            lock_guard lock (m_mutex);
+            m_error = err;
+            m_running = false;
+        }
+        m_cv.notify_all ();
+    }
+
+    cv::VideoCapture m_capture;
+#endif
+
+    boost::scoped_array<ImageBuf> m_ring;
+    int m_nframes;             // Ring size
+    int m_head;                // Oldest waiting frame
+    int m_count;               // Number of waiting frames
+    int m_dropped;             // Frames dropped so far
+    TypeDesc m_convert;
+    bool m_running;
+    std::string m_error;
+    mutable mutex m_mutex;
+    condition_variable m_cv;
+    thread *m_thread;
+};
+
+
+
+ImageBufAlgo::CaptureStream::CaptureStream (int cameranum, int nframes,
+                                            TypeDesc convert)
+    : m_impl(new Impl (cameranum, nframes, convert))
+{
+}
+
+
+
+ImageBufAlgo::CaptureStream::~CaptureStream ()
+{
+    delete m_impl;
+}
+
+
+
+bool
+ImageBufAlgo::CaptureStream::running () const
+{
+    return m_impl->running ();
+}
+
+
+
+void
+ImageBufAlgo::CaptureStream::stop ()
+{
+    m_impl->stop ();
+}
+
+
+
+bool
+ImageBufAlgo::CaptureStream::next_frame (ImageBuf &dst)
+{
+    return m_impl->next_frame (dst);
+}
+
+
+
+int
+ImageBufAlgo::CaptureStream::frames_dropped () const
+{
+    return m_impl->frames_dropped ();
+}
+
+
+
+std::string
+ImageBufAlgo::CaptureStream::geterror () const
+{
+    return m_impl->geterror ();
+}
+
+
+
 OIIO_NAMESPACE_END
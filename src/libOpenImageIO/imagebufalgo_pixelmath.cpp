@@ -44,12 +44,317 @@
 #include "OpenImageIO/deepdata.h"
 #include "OpenImageIO/dassert.h"
 #include "OpenImageIO/simd.h"
+#include "simd_dispatch.h"
 
 
 
 OIIO_NAMESPACE_BEGIN
 
 
+namespace {
+
+// Raw-memory fast paths for the per-pixel math below.  When every image
+// involved is an ordinary (not deep) image of a single common type
+// covering the whole ROI, and the ROI spans all of their channels, each
+// span of the ROI (a scanline for local pixels, a tile row for images
+// backed by the ImageCache) is just a contiguous array of values, so we
+// can skip the per-pixel iterator overhead and process 4 values at a
+// time with SIMD.  RawSimd<T> loads and stores 4 consecutive values of type T
+// as floats, normalized and rounded exactly as convert_type would; it's
+// only supported for the common pixel types.
+template<typename T> struct RawSimd {
+    static const bool supported = false;
+    static simd::float4 load (const T *p) {
+        return simd::float4 (convert_type<T,float>(p[0]),
+                             convert_type<T,float>(p[1]),
+                             convert_type<T,float>(p[2]),
+                             convert_type<T,float>(p[3]));
+    }
+    static void store (T *p, const simd::float4 &v) {
+        for (int i = 0;  i < 4;  ++i)
+            p[i] = convert_type<float,T>(v[i]);
+    }
+};
+
+template<> struct RawSimd<float> {
+    static const bool supported = true;
+    static simd::float4 load (const float *p) { return simd::float4 (p); }
+    static void store (float *p, const simd::float4 &v) { v.store (p); }
+};
+
+// N.B. float4's half load and store use the F16C instructions when they
+// are enabled (for example, by building with USE_SIMD=sse4.2,f16c).
+template<> struct RawSimd<half> {
+    static const bool supported = true;
+    static simd::float4 load (const half *p) { return simd::float4 (p); }
+    static void store (half *p, const simd::float4 &v) { v.store (p); }
+};
+
+template<> struct RawSimd<unsigned char> {
+    static const bool supported = true;
+    static simd::float4 load (const unsigned char *p) {
+        return simd::float4 (p) * simd::float4 (1.0f/255.0f);
+    }
+    static void store (unsigned char *p, const simd::float4 &v) {
+        // Same rounding as the scalar convert_type<float,uint8_t> (which
+        // is not quite simd::round, that rounds halves to even).
+        simd::float4 max_simd (255.0f);
+        simd::float4 scaled = v * max_simd + simd::float4 (0.5f);
+        simd::int4 i (clamp (scaled, simd::float4::Zero(), max_simd));
+        i.store (p);
+    }
+};
+
+template<> struct RawSimd<unsigned short> {
+    static const bool supported = true;
+    static simd::float4 load (const unsigned short *p) {
+        return simd::float4 (p) * simd::float4 (1.0f/65535.0f);
+    }
+    static void store (unsigned short *p, const simd::float4 &v) {
+        // Same rounding as the scalar convert_type<float,uint16_t>
+        simd::float4 max_simd (65535.0f);
+        simd::float4 scaled = v * max_simd + simd::float4 (0.5f);
+        simd::int4 i (clamp (scaled, simd::float4::Zero(), max_simd));
+        i.store (p);
+    }
+};
+
+
+
+// Can R = op(A, B, C) over roi use raw_simd_op?  B and C may be NULL
+// (for constant or unused operands).  The caller must already know that
+// all the images are of type T.
+template<typename T>
+static bool
+raw_simd_ok (const ImageBuf &R, const ImageBuf &A, const ImageBuf *B,
+             const ImageBuf *C, ROI roi)
+{
+    if (! RawSimd<T>::supported || R.deep() || A.deep()
+        || roi.chbegin != 0 || roi.chend != R.nchannels()
+        || ! R.localpixels() || ! R.contains_roi(roi)
+        || R.pixel_stride() != stride_t(roi.chend * sizeof(T)))
+        return false;
+    // Each scanline's values must be packed together (the scanlines
+    // themselves may be any distance apart).
+    const ImageBuf *inputs[3] = { &A, B, C };
+    for (int i = 0;  i < 3;  ++i) {
+        const ImageBuf *img = inputs[i];
+        if (img && (img->deep() || ! img->contains_roi(roi)
+                    || img->nchannels() != roi.chend
+                    || (img->localpixels() &&
+                        img->pixel_stride() != stride_t(roi.chend * sizeof(T)))))
+            return false;
+    }
+    return true;
+}
+
+
+
+// The operations for raw_simd_op
+struct SimdAdd {
+    template<class V> V operator() (const V &a, const V &b, const V &) const {
+        return a + b;
+    }
+};
+
+struct SimdSub {
+    template<class V> V operator() (const V &a, const V &b, const V &) const {
+        return a - b;
+    }
+};
+
+struct SimdMul {
+    template<class V> V operator() (const V &a, const V &b, const V &) const {
+        return a * b;
+    }
+};
+
+struct SimdDiv {
+    simd::float4 operator() (const simd::float4 &a, const simd::float4 &b,
+                             const simd::float4 &) const {
+        return simd::safe_div (a, b);
+    }
+    float operator() (float a, float b, float) const {
+        return b == 0.0f ? 0.0f : a / b;
+    }
+};
+
+struct SimdMad {
+    template<class V> V operator() (const V &a, const V &b, const V &c) const {
+        return a * b + c;
+    }
+};
+
+struct SimdClamp {
+    template<class V> V operator() (const V &a, const V &lo, const V &hi) const {
+        return OIIO::clamp (a, lo, hi);
+    }
+};
+
+
+
+// Ops with a float kernel picked at runtime for this CPU (see
+// simd_dispatch.h) run it on whole float runs.  Return false if there
+// isn't one, for this op and type or for this CPU.
+template<typename T, class OP>
+static inline bool
+dispatched_run (T *r, const T *a, const float *b, const float *c,
+                int nvals, const OP &op)
+{
+    return false;
+}
+
+static inline bool
+dispatched_run (float *r, const float *a, const float *b, const float *c,
+                int nvals, const SimdAdd &op)
+{
+    const pvt::SIMDKernels &k (pvt::simd_kernels());
+    if (k.add)
+        k.add (r, a, b, size_t(nvals));
+    return k.add != NULL;
+}
+
+static inline bool
+dispatched_run (float *r, const float *a, const float *b, const float *c,
+                int nvals, const SimdSub &op)
+{
+    const pvt::SIMDKernels &k (pvt::simd_kernels());
+    if (k.sub)
+        k.sub (r, a, b, size_t(nvals));
+    return k.sub != NULL;
+}
+
+static inline bool
+dispatched_run (float *r, const float *a, const float *b, const float *c,
+                int nvals, const SimdMul &op)
+{
+    const pvt::SIMDKernels &k (pvt::simd_kernels());
+    if (k.mul)
+        k.mul (r, a, b, size_t(nvals));
+    return k.mul != NULL;
+}
+
+static inline bool
+dispatched_run (float *r, const float *a, const float *b, const float *c,
+                int nvals, const SimdMad &op)
+{
+    const pvt::SIMDKernels &k (pvt::simd_kernels());
+    if (k.mad)
+        k.mad (r, a, b, c, size_t(nvals));
+    return k.mad != NULL;
+}
+
+
+
+// r[0..nvals-1] = op(a, b, c) for contiguous runs of values, where each
+// of b and c is either a run of T values or (if NULL) of floats bf or cf.
+template<typename T, class OP>
+static void
+raw_simd_run (T *r, const T *a, const T *b, const float *bf,
+              const T *c, const float *cf, int nvals, const OP &op)
+{
+    if (dispatched_run (r, a, b ? (const float *)b : bf,
+                        c ? (const float *)c : cf, nvals, op))
+        return;
+    int x = 0;
+    for (int simdend = nvals & (~3);  x < simdend;  x += 4) {
+        simd::float4 bv = b ? RawSimd<T>::load (b+x) : simd::float4 (bf+x);
+        simd::float4 cv = c ? RawSimd<T>::load (c+x) : simd::float4 (cf+x);
+        RawSimd<T>::store (r+x, op (RawSimd<T>::load (a+x), bv, cv));
+    }
+    for ( ;  x < nvals;  ++x) {
+        float bv = b ? convert_type<T,float>(b[x]) : bf[x];
+        float cv = c ? convert_type<T,float>(c[x]) : cf[x];
+        r[x] = convert_type<float,T> (op (convert_type<T,float>(a[x]), bv, cv));
+    }
+}
+
+
+
+// Compute R = op(A, B, C) over roi directly on the raw pixel memory (see
+// raw_simd_ok), where each of B and C is either an image or, if the image
+// is NULL, the per-channel constant values bconst or cconst.  Operands
+// that op doesn't use may be NULL entirely.  op must provide
+// operator()(float4,float4,float4) and the same on plain floats.
+template<typename T, class OP>
+static void
+raw_simd_op (ImageBuf &R, const ImageBuf &A,
+             const ImageBuf *B, const float *bconst,
+             const ImageBuf *C, const float *cconst,
+             ROI roi, const OP &op)
+{
+    const int nc = R.nchannels();
+    const int nvals = roi.width() * nc;
+    // Constant operands are expanded to a full scanline's worth of
+    // values, so that they can be loaded just like image rows.
+    std::vector<float> brow, crow;
+    if (! B) {
+        brow.resize (nvals, 0.0f);
+        if (bconst)
+            for (int x = 0;  x < nvals;  ++x)
+                brow[x] = bconst[x % nc];
+    }
+    if (! C) {
+        crow.resize (nvals, 0.0f);
+        if (cconst)
+            for (int x = 0;  x < nvals;  ++x)
+                crow[x] = cconst[x % nc];
+    }
+    const int rblockw = R.local_tile_width();
+    if (A.localpixels() && (! B || B->localpixels())
+                        && (! C || C->localpixels()) && ! rblockw
+                        && ! A.local_tile_width()
+                        && ! (B && B->local_tile_width())
+                        && ! (C && C->local_tile_width())) {
+        // All in memory: each scanline is one contiguous run.
+        for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+            for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+                const int x = roi.xbegin;
+                raw_simd_run ((T *) R.pixeladdr (x, y, z),
+                              (const T *) A.pixeladdr (x, y, z),
+                              B ? (const T *) B->pixeladdr (x, y, z) : NULL,
+                              B ? NULL : &brow[0],
+                              C ? (const T *) C->pixeladdr (x, y, z) : NULL,
+                              C ? NULL : &crow[0], nvals, op);
+            }
+        }
+        return;
+    }
+
+    // Some inputs are in the ImageCache or in a blocked layout: walk them
+    // in lock step, one span (the longest run that is contiguous in all
+    // of them, at most a tile or block row) at a time.
+    ImageBuf::ConstIterator<T,T> a (A, roi);
+    ImageBuf::ConstIterator<T,T> b (B ? *B : A, roi);
+    ImageBuf::ConstIterator<T,T> c (C ? *C : A, roi);
+    while (! a.done()) {
+        int n = a.span_length ();
+        if (B)
+            n = std::min (n, b.span_length());
+        if (C)
+            n = std::min (n, c.span_length());
+        if (rblockw)
+            n = std::min (n, rblockw - ((a.x() - R.xbegin()) & (rblockw-1)));
+        int xoff = (a.x() - roi.xbegin) * nc;
+        raw_simd_run ((T *) R.pixeladdr (a.x(), a.y(), a.z()),
+                      (const T *) a.rawptr(),
+                      B ? (const T *) b.rawptr() : NULL,
+                      B ? NULL : &brow[xoff],
+                      C ? (const T *) c.rawptr() : NULL,
+                      C ? NULL : &crow[xoff], n * nc, op);
+        a.span_advance (n);
+        if (B)
+            b.span_advance (n);
+        if (C)
+            c.span_advance (n);
+    }
+}
+
+
+}  // anon namespace
+
+
+
 template<class D, class S>
 static bool
 clamp_ (ImageBuf &dst, const ImageBuf &src,
@@ -67,10 +372,14 @@ clamp_ (ImageBuf &dst, const ImageBuf &src,
     }
 
     // Serial case
-    ImageBuf::ConstIterator<S> s (src, roi);
-    for (ImageBuf::Iterator<D> d (dst, roi);  ! d.done();  ++d, ++s) {
-        for (int c = roi.chbegin;  c < roi.chend;  ++c)
-            d[c] = OIIO::clamp<float> (s[c], min[c], max[c]);
+    if (is_same<D,S>::value && raw_simd_ok<D> (dst, src, NULL, NULL, roi)) {
+        raw_simd_op<D> (dst, src, NULL, min, NULL, max, roi, SimdClamp());
+    } else {
+        ImageBuf::ConstIterator<S> s (src, roi);
+        for (ImageBuf::Iterator<D> d (dst, roi);  ! d.done();  ++d, ++s) {
+            for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                d[c] = OIIO::clamp<float> (s[c], min[c], max[c]);
+        }
     }
     int a = src.spec().alpha_channel;
     if (clampalpha01 && a >= roi.chbegin && a < roi.chend) {
@@ -135,6 +444,11 @@ add_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
     }
 
     // Serial case
+    if (is_same<Rtype,Atype>::value && is_same<Rtype,Btype>::value
+        && raw_simd_ok<Rtype> (R, A, &B, NULL, roi)) {
+        raw_simd_op<Rtype> (R, A, &B, NULL, NULL, NULL, roi, SimdAdd());
+        return true;
+    }
     ImageBuf::Iterator<Rtype> r (R, roi);
     ImageBuf::ConstIterator<Atype> a (A, roi);
     ImageBuf::ConstIterator<Btype> b (B, roi);
@@ -180,6 +494,11 @@ add_impl (ImageBuf &R, const ImageBuf &A, const float *b,
         return true;
     }
 
+    if (is_same<Rtype,Atype>::value
+        && raw_simd_ok<Rtype> (R, A, NULL, NULL, roi)) {
+        raw_simd_op<Rtype> (R, A, NULL, b, NULL, NULL, roi, SimdAdd());
+        return true;
+    }
     ImageBuf::Iterator<Rtype> r (R, roi);
     ImageBuf::ConstIterator<Atype> a (A, roi);
     for ( ;  !r.done();  ++r, ++a)
@@ -278,6 +597,11 @@ sub_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
     }
 
     // Serial case
+    if (is_same<Rtype,Atype>::value && is_same<Rtype,Btype>::value
+        && raw_simd_ok<Rtype> (R, A, &B, NULL, roi)) {
+        raw_simd_op<Rtype> (R, A, &B, NULL, NULL, NULL, roi, SimdSub());
+        return true;
+    }
     ImageBuf::Iterator<Rtype> r (R, roi);
     ImageBuf::ConstIterator<Atype> a (A, roi);
     ImageBuf::ConstIterator<Btype> b (B, roi);
@@ -507,6 +831,11 @@ mul_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
     }
 
     // Serial case
+    if (is_same<Rtype,Atype>::value && is_same<Rtype,Btype>::value
+        && raw_simd_ok<Rtype> (R, A, &B, NULL, roi)) {
+        raw_simd_op<Rtype> (R, A, &B, NULL, NULL, NULL, roi, SimdMul());
+        return true;
+    }
     ImageBuf::Iterator<Rtype> r (R, roi);
     ImageBuf::ConstIterator<Atype> a (A, roi);
     ImageBuf::ConstIterator<Btype> b (B, roi);
@@ -569,6 +898,11 @@ mul_impl (ImageBuf &R, const ImageBuf &A, const float *b,
         return true;
     }
 
+    if (is_same<Rtype,Atype>::value
+        && raw_simd_ok<Rtype> (R, A, NULL, NULL, roi)) {
+        raw_simd_op<Rtype> (R, A, NULL, b, NULL, NULL, roi, SimdMul());
+        return true;
+    }
     ImageBuf::ConstIterator<Atype> a (A, roi);
     for (ImageBuf::Iterator<Rtype> r (R, roi);  !r.done();  ++r, ++a)
         for (int c = roi.chbegin;  c < roi.chend;  ++c)
@@ -633,6 +967,11 @@ div_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
     }
 
     // Serial case
+    if (is_same<Rtype,Atype>::value && is_same<Rtype,Btype>::value
+        && raw_simd_ok<Rtype> (R, A, &B, NULL, roi)) {
+        raw_simd_op<Rtype> (R, A, &B, NULL, NULL, NULL, roi, SimdDiv());
+        return true;
+    }
     ImageBuf::Iterator<Rtype> r (R, roi);
     ImageBuf::ConstIterator<Atype> a (A, roi);
     ImageBuf::ConstIterator<Btype> b (B, roi);
@@ -729,7 +1068,13 @@ mad_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B, const ImageBuf &C,
         && A.contains_roi(roi) && B.contains_roi(roi) && C.contains_roi(roi)
         && roi.chbegin == 0 && roi.chend == R.nchannels()
         && roi.chend == A.nchannels() && roi.chend == B.nchannels()
-        && roi.chend == C.nchannels()) {
+        && roi.chend == C.nchannels()
+        && R.pixel_stride() == (stride_t)R.spec().pixel_bytes()
+        && A.pixel_stride() == (stride_t)A.spec().pixel_bytes()
+        && B.pixel_stride() == (stride_t)B.spec().pixel_bytes()
+        && C.pixel_stride() == (stride_t)C.spec().pixel_bytes()
+        && ! R.local_tile_width() && ! A.local_tile_width()
+        && ! B.local_tile_width() && ! C.local_tile_width()) {
         // Special case when all inputs are either float or half, with in-
         // memory contiguous data and we're operating on the full channel
         // range: skip iterators: For these circumstances, we can operate on
@@ -758,6 +1103,10 @@ mad_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B, const ImageBuf &C,
                 // for (int x = simdend; x < nxvalues; ++x)
                 //     rraw[x] = araw[x] * braw[x] + craw[x];
             }
+    } else if (is_same<Rtype,ABCtype>::value
+               && raw_simd_ok<Rtype> (R, A, &B, &C, roi)) {
+        // The same thing for the integer types, with SIMD conversions.
+        raw_simd_op<Rtype> (R, A, &B, NULL, &C, NULL, roi, SimdMad());
     } else {
         ImageBuf::Iterator<Rtype> r (R, roi);
         ImageBuf::ConstIterator<ABCtype> a (A, roi);
@@ -789,6 +1138,11 @@ mad_implf (ImageBuf &R, const ImageBuf &A, const float *b, const float *c,
     }
 
     // Serial case
+    if (is_same<Rtype,Atype>::value
+        && raw_simd_ok<Rtype> (R, A, NULL, NULL, roi)) {
+        raw_simd_op<Rtype> (R, A, NULL, b, NULL, c, roi, SimdMad());
+        return true;
+    }
     ImageBuf::Iterator<Rtype> r (R, roi);
     ImageBuf::ConstIterator<Atype> a (A, roi);
     for ( ;  !r.done();  ++r, ++a)
@@ -1585,6 +1939,46 @@ decode_over_channels (const ImageBuf &R, int &nchannels,
 
 
 
+// "over" (or, if zcomp, "zover") for runs of npixels contiguous pixels
+// of type T, with RGBA in channels 0-3 and, if nc == 5, Z in channel 4.
+// Each pixel's RGBA is done as one float4, with exactly the same
+// arithmetic as the general case in over_impl.
+template<typename T>
+static void
+over_simd_run (T *r, const T *a, const T *b, int npixels, int nc,
+               bool zcomp, bool z_zeroisinf)
+{
+    const simd::float4 zero = simd::float4::Zero();
+    const simd::float4 one = simd::float4::One();
+    for (int x = 0;  x < npixels;  ++x, r += nc, a += nc, b += nc) {
+        simd::float4 front = RawSimd<T>::load (a);
+        simd::float4 back = RawSimd<T>::load (b);
+        float frontz = 0.0f, backz = 0.0f;
+        if (nc == 5) {
+            frontz = convert_type<T,float> (a[4]);
+            backz = convert_type<T,float> (b[4]);
+            if (zcomp) {
+                float az = frontz, bz = backz;
+                if (z_zeroisinf) {
+                    if (az == 0.0f) az = std::numeric_limits<float>::max();
+                    if (bz == 0.0f) bz = std::numeric_limits<float>::max();
+                }
+                if (! (az <= bz)) {
+                    // B over A -- because we're doing a Z composite
+                    std::swap (front, back);
+                    std::swap (frontz, backz);
+                }
+            }
+        }
+        simd::float4 alpha = clamp (simd::shuffle<3>(front), zero, one);
+        RawSimd<T>::store (r, front + (one - alpha) * back);
+        if (nc == 5)
+            r[4] = convert_type<float,T> (alpha[0] != 0.0f ? frontz : backz);
+    }
+}
+
+
+
 // Fully type-specialized version of over.
 template<class Rtype, class Atype, class Btype>
 static bool
@@ -1597,7 +1991,7 @@ over_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
             OIIO::bind(over_impl<Rtype,Atype,Btype>,
                         OIIO::ref(R), OIIO::cref(A), OIIO::cref(B),
                         zcomp, z_zeroisinf, _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
+            roi, nthreads, ImageBufAlgo::Split_Tile);
         return true;
     }
 
@@ -1610,6 +2004,23 @@ over_impl (ImageBuf &R, const ImageBuf &A, const ImageBuf &B,
                           z_channel, ncolor_channels);
     bool has_z = (z_channel >= 0);
 
+    // Fast path: all the same type, all in memory, covering the roi, and
+    // the usual RGBA or RGBAZ channel layout.
+    if (is_same<Rtype,Atype>::value && is_same<Rtype,Btype>::value &&
+          alpha_channel == 3 &&
+          ((nchannels == 4 && ! has_z) || (nchannels == 5 && z_channel == 4)) &&
+          raw_simd_ok<Rtype> (R, A, &B, NULL, roi) &&
+          A.localpixels() && B.localpixels() && ! R.local_tile_width() &&
+          ! A.local_tile_width() && ! B.local_tile_width()) {
+        for (int z = roi.zbegin;  z < roi.zend;  ++z)
+            for (int y = roi.ybegin;  y < roi.yend;  ++y)
+                over_simd_run ((Rtype *) R.pixeladdr (roi.xbegin, y, z),
+                               (const Rtype *) A.pixeladdr (roi.xbegin, y, z),
+                               (const Rtype *) B.pixeladdr (roi.xbegin, y, z),
+                               roi.width(), nchannels, zcomp, z_zeroisinf);
+        return true;
+    }
+
     ImageBuf::ConstIterator<Atype> a (A, roi);
     ImageBuf::ConstIterator<Btype> b (B, roi);
     ImageBuf::Iterator<Rtype> r (R, roi);
@@ -1663,6 +2074,164 @@ ImageBufAlgo::over (ImageBuf &dst, const ImageBuf &A, const ImageBuf &B,
 
 
 
+// Composite layers[0] over layers[1] over ... front to back, one
+// scanline at a time, keeping the remaining transparency of each pixel
+// so that layers behind opaque pixels are never visited.
+static bool
+over_layers_impl (ImageBuf &R, array_view<const ImageBuf *> layers,
+                  ROI roi, int nthreads)
+{
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Possible multiple thread case -- recurse via parallel_image
+        ImageBufAlgo::parallel_image (
+            OIIO::bind(over_layers_impl, OIIO::ref(R), layers,
+                       _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads, ImageBufAlgo::Split_Tile);
+        return true;
+    }
+
+    // Serial case...
+    int nchannels = 0, alpha_channel = 0, z_channel = 0, ncolor_channels = 0;
+    decode_over_channels (R, nchannels, alpha_channel,
+                          z_channel, ncolor_channels);
+    bool has_z = (z_channel >= 0);
+    bool rgba = (nchannels == 4 && alpha_channel == 3 && ! has_z);
+    int nlayers = (int) layers.size();
+
+    // Layers whose pixel data window doesn't overlap this region are
+    // all zero here, so don't visit them at all.
+    std::vector<int> active;
+    for (int i = 0;  i < nlayers;  ++i) {
+        ROI lroi = roi_intersection (layers[i]->roi(), roi);
+        if (lroi.width() > 0 && lroi.height() > 0 && lroi.depth() > 0)
+            active.push_back (i);
+    }
+
+    int width = roi.width();
+    std::vector<float> result (width*nchannels), pixels (width*nchannels);
+    std::vector<float> transparency (width), zval;
+    std::vector<char> zdone;
+    if (has_z) {
+        zval.resize (width);
+        zdone.resize (width);
+    }
+    for (int z = roi.zbegin;  z < roi.zend;  ++z) {
+        for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+            std::fill (result.begin(), result.end(), 0.0f);
+            std::fill (transparency.begin(), transparency.end(), 1.0f);
+            if (has_z) {
+                std::fill (zval.begin(), zval.end(), 0.0f);
+                std::fill (zdone.begin(), zdone.end(), 0);
+            }
+            int nopaque = 0;   // pixels that nothing more can show through
+            for (size_t l = 0;  l < active.size() && nopaque < width;  ++l) {
+                int layer = active[l];
+                const ImageBuf &L (*layers[layer]);
+                ROI lroi = roi_intersection (L.roi(), ROI (roi.xbegin, roi.xend,
+                                                           y, y+1, z, z+1,
+                                                           0, nchannels));
+                if (lroi.width() <= 0 || lroi.height() <= 0 || lroi.depth() <= 0)
+                    continue;
+                L.get_pixels (lroi, TypeDesc::FLOAT, &pixels[0]);
+                int xoff = lroi.xbegin - roi.xbegin;
+                for (int i = 0, n = lroi.width();  i < n;  ++i) {
+                    int p = xoff + i;
+                    float t = transparency[p];
+                    if (t == 0.0f)
+                        continue;
+                    const float *lpix = &pixels[i*nchannels];
+                    float *rpix = &result[p*nchannels];
+                    float alpha = clamp (lpix[alpha_channel], 0.0f, 1.0f);
+                    if (rgba) {
+                        simd::float4 r (rpix);
+                        r += simd::float4(t) * simd::float4(lpix);
+                        r.store (rpix);
+                    } else {
+                        for (int c = 0;  c < nchannels;  ++c)
+                            rpix[c] += t * lpix[c];
+                    }
+                    if (has_z && ! zdone[p]) {
+                        // z comes from the frontmost layer with nonzero
+                        // alpha, else from the rearmost layer.
+                        if (alpha != 0.0f) {
+                            zval[p] = lpix[z_channel];
+                            zdone[p] = 1;
+                        } else {
+                            zval[p] = (layer == nlayers-1) ? lpix[z_channel] : 0.0f;
+                        }
+                    }
+                    t *= 1.0f - alpha;
+                    transparency[p] = t;
+                    if (t == 0.0f)
+                        ++nopaque;
+                }
+            }
+            if (has_z)
+                for (int p = 0;  p < width;  ++p)
+                    result[p*nchannels+z_channel] = zval[p];
+            R.set_pixels (ROI (roi.xbegin, roi.xend, y, y+1, z, z+1,
+                               roi.chbegin, roi.chend),
+                          TypeDesc::FLOAT, &result[roi.chbegin],
+                          nchannels*sizeof(float));
+        }
+    }
+    return true;
+}
+
+
+
+bool
+ImageBufAlgo::over (ImageBuf &dst, array_view<const ImageBuf *> layers,
+                    ROI roi, int nthreads)
+{
+    if (layers.size() == 0) {
+        dst.error ("over: no input images");
+        return false;
+    }
+    for (size_t i = 0;  i < layers.size();  ++i) {
+        if (! layers[i] || ! layers[i]->initialized()) {
+            dst.error ("Uninitialized input image");
+            return false;
+        }
+        if (layers[i]->deep()) {
+            dst.error ("over: deep images are not supported");
+            return false;
+        }
+    }
+    if (! dst.initialized()) {
+        // Like over(dst,A,B): size dst to the union of the inputs, with the
+        // input data type if they all share it, and float otherwise.
+        ImageSpec spec = layers[0]->spec();
+        ROI datawin = layers[0]->roi(), fullwin = layers[0]->roi_full();
+        for (size_t i = 1;  i < layers.size();  ++i) {
+            datawin = roi_union (datawin, layers[i]->roi());
+            fullwin = roi_union (fullwin, layers[i]->roi_full());
+            if (layers[i]->spec().format != spec.format)
+                spec.set_format (TypeDesc::FLOAT);
+        }
+        if (roi.defined())
+            datawin = roi;
+        set_roi (spec, datawin);
+        set_roi_full (spec, fullwin);
+        spec.nchannels = layers[0]->nchannels();
+        dst.reset (spec);
+    }
+    if (! IBAprep (roi, &dst, layers[0], NULL, NULL,
+                   IBAprep_REQUIRE_ALPHA | IBAprep_REQUIRE_SAME_NCHANNELS))
+        return false;
+    for (size_t i = 1;  i < layers.size();  ++i) {
+        if (layers[i]->nchannels() != dst.nchannels() ||
+              layers[i]->spec().alpha_channel != dst.spec().alpha_channel) {
+            dst.error ("over: all images must have the same channels and alpha");
+            return false;
+        }
+    }
+    bool ok = over_layers_impl (dst, layers, roi, nthreads);
+    return ok && ! dst.has_error();
+}
+
+
+
 bool
 ImageBufAlgo::zover (ImageBuf &dst, const ImageBuf &A, const ImageBuf &B,
                      bool z_zeroisinf, ROI roi, int nthreads)
@@ -35,12 +35,14 @@
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/imagebufalgo.h"
 #include "OpenImageIO/imagebufalgo_util.h"
+#include "OpenImageIO/color.h"
 #include "OpenImageIO/unittest.h"
 
 #include <iostream>
 #include <iomanip>
 #include <string>
 #include <cstdio>
+#include <algorithm>
 
 OIIO_NAMESPACE_USING;
 
@@ -224,6 +226,92 @@ void test_paste ()
 
 
 
+// Where reorient() gets each pixel, for a W x H image with origin 0:
+// dst pixel (x,y) comes from src pixel (sx,sy).
+static void
+reoriented_source (int orientation, int x, int y, int W, int H,
+                   int &sx, int &sy)
+{
+    switch (orientation) {
+    case 2 :  sx = W-1-x;  sy = y;      break;   // flop
+    case 3 :  sx = W-1-x;  sy = H-1-y;  break;   // rotate180
+    case 4 :  sx = x;      sy = H-1-y;  break;   // flip
+    case 5 :  sx = W-1-y;  sy = H-1-x;  break;   // rotate270 + flop
+    case 6 :  sx = y;      sy = H-1-x;  break;   // rotate90
+    case 7 :  sx = y;      sy = x;      break;   // flip + rotate90
+    case 8 :  sx = W-1-y;  sy = x;      break;   // rotate270
+    default : sx = x;      sy = y;      break;
+    }
+}
+
+
+
+static int
+count_misoriented (const ImageBuf &R, const ImageBuf &A, int orientation)
+{
+    int W = A.spec().width, H = A.spec().height, nc = A.nchannels();
+    int bad = 0;
+    std::vector<float> r (nc), a (nc);
+    for (ImageBuf::ConstIterator<float> it (R);  ! it.done();  ++it) {
+        int sx, sy;
+        reoriented_source (orientation, it.x(), it.y(), W, H, sx, sy);
+        A.getpixel (sx, sy, 0, &a[0]);
+        for (int c = 0;  c < nc;  ++c)
+            if (it[c] != a[c])
+                ++bad;
+    }
+    return bad;
+}
+
+
+
+// Test flip/flop/rotate*/transpose/reorient, which share a blocked raw
+// memory fast path. Odd sizes exercise the partial blocks, and the
+// uint8 RGBA case goes through the 4x4 in-register transposes.
+void test_reorient ()
+{
+    std::cout << "test reorient\n";
+    TypeDesc types[] = { TypeDesc::UINT8, TypeDesc::FLOAT };
+    int nchans[] = { 4, 3 };
+    for (int t = 0;  t < 2;  ++t) {
+        ImageSpec spec (37, 23, nchans[t], types[t]);
+        ImageBuf A (spec);
+        for (ImageBuf::Iterator<float> it (A);  ! it.done();  ++it)
+            for (int c = 0;  c < spec.nchannels;  ++c)
+                it[c] = float((it.x() * 7 + it.y() * 13 + c * 3) % 256) / 255.0f;
+
+        ImageBuf R;
+        ImageBufAlgo::flop (R, A);
+        OIIO_CHECK_EQUAL (count_misoriented (R, A, 2), 0);
+        R.clear ();
+        ImageBufAlgo::rotate180 (R, A);
+        OIIO_CHECK_EQUAL (count_misoriented (R, A, 3), 0);
+        R.clear ();
+        ImageBufAlgo::flip (R, A);
+        OIIO_CHECK_EQUAL (count_misoriented (R, A, 4), 0);
+        R.clear ();
+        ImageBufAlgo::rotate90 (R, A);
+        OIIO_CHECK_EQUAL (R.spec().width, spec.height);
+        OIIO_CHECK_EQUAL (count_misoriented (R, A, 6), 0);
+        R.clear ();
+        ImageBufAlgo::rotate270 (R, A);
+        OIIO_CHECK_EQUAL (count_misoriented (R, A, 8), 0);
+        R.clear ();
+        ImageBufAlgo::transpose (R, A);
+        OIIO_CHECK_EQUAL (count_misoriented (R, A, 7), 0);
+
+        // The single-pass reorient must match the per-case remapping,
+        // including the two-step orientations 5 and 7.
+        for (int o = 1;  o <= 8;  ++o) {
+            A.set_orientation (o);
+            R.clear ();
+            OIIO_CHECK_ASSERT (ImageBufAlgo::reorient (R, A));
+            OIIO_CHECK_EQUAL (R.orientation(), 1);
+            OIIO_CHECK_EQUAL (count_misoriented (R, A, o), 0);
+        }
+    }
+}
+
 void test_channel_append ()
 {
     std::cout << "test channel_append\n";
@@ -383,6 +471,414 @@ void test_mad ()
 
 
 
+// Make sure the raw-memory fast paths of the pixel math functions give
+// exactly the same results as the general iterator-based ones (which are
+// used when the ROI covers only some of the channels).
+void test_pixelmath_fastpath ()
+{
+    std::cout << "test pixelmath fast paths\n";
+    TypeDesc types[3] = { TypeDesc::UINT8, TypeDesc::UINT16, TypeDesc::HALF };
+    for (int t = 0;  t < 3;  ++t) {
+        // An odd width and channel count, to exercise the non-SIMD tail
+        ImageSpec spec (7, 5, 3, types[t]);
+        ImageBuf A (spec), B (spec);
+        for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a)
+            for (int c = 0;  c < 3;  ++c)
+                a[c] = 0.1f * a.x() - 0.05f * a.y() + 0.03f * c;
+        for (ImageBuf::Iterator<float> b (B);  ! b.done();  ++b)
+            for (int c = 0;  c < 3;  ++c)
+                b[c] = 0.9f - 0.07f * b.x() * c + 0.02f * b.y();
+        const float bval[3] = { 0.5f, 1.5f, 2.0f };
+        const float cval[3] = { 0.25f, -0.1f, 0.0f };
+        for (int op = 0;  op < 5;  ++op) {
+            ImageBuf fast (spec), general (spec);
+            ROI rois[3] = { ROI::All(), get_roi (spec), get_roi (spec) };
+            rois[1].chend = 2;
+            rois[2].chbegin = 2;
+            for (int r = 0;  r < 3;  ++r) {
+                ImageBuf &dst (r == 0 ? fast : general);
+                switch (op) {
+                case 0 : ImageBufAlgo::add (dst, A, B, rois[r]);  break;
+                case 1 : ImageBufAlgo::mul (dst, A, B, rois[r]);  break;
+                case 2 : ImageBufAlgo::mad (dst, A, bval, cval, rois[r]);  break;
+                case 3 : ImageBufAlgo::sub (dst, A, B, rois[r]);  break;
+                case 4 : ImageBufAlgo::clamp (dst, A, 0.2f, 0.6f, false,
+                                              rois[r]);  break;
+                }
+            }
+            ImageBufAlgo::CompareResults comp;
+            ImageBufAlgo::compare (fast, general, 0.0f, 0.0f, comp);
+            OIIO_CHECK_EQUAL (comp.maxerror, 0.0);
+        }
+    }
+}
+
+
+
+// Fill an RGBA or RGBAZ image with a pattern that includes fully
+// transparent and fully opaque pixels.
+static void
+fill_over_layer (ImageBuf &img, int seed)
+{
+    for (ImageBuf::Iterator<float> p (img);  ! p.done();  ++p) {
+        int v = (p.x() * 5 + p.y() * 3 + seed * 7) % 11;
+        float alpha = clamp (v / 8.0f, 0.0f, 1.0f);
+        for (int c = 0;  c < 3;  ++c)
+            p[c] = alpha * (0.1f * c + 0.05f * seed + 0.2f);
+        p[3] = alpha;
+        if (img.nchannels() == 5)
+            p[4] = float ((p.x() + seed * 3) % 4);
+    }
+}
+
+
+
+// The over and zover fast paths must match the general case exactly,
+// and a multi-layer over must match a chain of two-image overs.
+void test_over ()
+{
+    std::cout << "test over\n";
+    TypeDesc types[3] = { TypeDesc::FLOAT, TypeDesc::HALF, TypeDesc::UINT8 };
+    for (int t = 0;  t < 3;  ++t) {
+        for (int nc = 4;  nc <= 5;  ++nc) {
+            ImageSpec spec (7, 5, nc, types[t]);
+            if (nc == 5) {
+                spec.channelnames[4] = "Z";
+                spec.z_channel = 4;
+            }
+            ImageBuf A (spec), B (spec);
+            fill_over_layer (A, 1);
+            fill_over_layer (B, 2);
+            for (int zcomp = 0;  zcomp < nc-3;  ++zcomp) {
+                ImageBuf fast (spec), general (spec);
+                ROI lo = get_roi (spec), hi = get_roi (spec);
+                lo.chend = 2;
+                hi.chbegin = 2;
+                if (zcomp) {
+                    ImageBufAlgo::zover (fast, A, B);
+                    ImageBufAlgo::zover (general, A, B, false, lo);
+                    ImageBufAlgo::zover (general, A, B, false, hi);
+                } else {
+                    ImageBufAlgo::over (fast, A, B);
+                    ImageBufAlgo::over (general, A, B, lo);
+                    ImageBufAlgo::over (general, A, B, hi);
+                }
+                ImageBufAlgo::CompareResults comp;
+                ImageBufAlgo::compare (fast, general, 0.0f, 0.0f, comp);
+                OIIO_CHECK_EQUAL (comp.maxerror, 0.0);
+            }
+        }
+    }
+
+    // Multi-layer over, including a layer with a smaller data window.
+    ImageSpec spec (64, 40, 4, TypeDesc::FLOAT);
+    ImageBuf L0 (spec), L1 (spec), L2 (spec);
+    fill_over_layer (L0, 0);
+    fill_over_layer (L2, 2);
+    ImageSpec smallspec (spec);
+    smallspec.x = 10;  smallspec.y = 5;
+    smallspec.width = 20;  smallspec.height = 30;
+    L1.reset (smallspec);
+    fill_over_layer (L1, 1);
+    ImageBuf back, chained;
+    ImageBufAlgo::over (back, L1, L2);
+    ImageBufAlgo::over (chained, L0, back);
+    std::vector<const ImageBuf *> layers;
+    layers.push_back (&L0);
+    layers.push_back (&L1);
+    layers.push_back (&L2);
+    ImageBuf stacked;
+    OIIO_CHECK_ASSERT (ImageBufAlgo::over (stacked, layers));
+    OIIO_CHECK_EQUAL (stacked.roi(), chained.roi());
+    ImageBufAlgo::CompareResults comp;
+    ImageBufAlgo::compare (stacked, chained, 1.0e-6f, 1.0e-6f, comp);
+    OIIO_CHECK_EQUAL (comp.nfail, 0);
+}
+
+
+
+// Brute-force reference for convolve, with a normalized kernel.
+static void
+reference_convolve (ImageBuf &R, const ImageBuf &src, const ImageBuf &K)
+{
+    R.reset (ImageSpec (src.spec().width, src.spec().height,
+                        src.nchannels(), TypeDesc::FLOAT));
+    float ksum = 0.0f;
+    for (ImageBuf::ConstIterator<float> k (K);  ! k.done();  ++k)
+        ksum += k[0];
+    for (ImageBuf::Iterator<float> r (R);  ! r.done();  ++r) {
+        for (int c = 0;  c < R.nchannels();  ++c) {
+            float sum = 0.0f;
+            for (ImageBuf::ConstIterator<float> k (K);  ! k.done();  ++k)
+                sum += k[0] * src.getchannel (r.x()+k.x(), r.y()+k.y(), 0, c,
+                                              ImageBuf::WrapClamp);
+            r[c] = sum / ksum;
+        }
+    }
+}
+
+
+
+// Tests ImageBufAlgo::convolve with a separable kernel (which takes the
+// two-pass path) and a large non-separable one (which takes the FFT path).
+void test_convolve ()
+{
+    std::cout << "test convolve\n";
+    ImageBuf A (ImageSpec (64, 48, 2, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a) {
+        a[0] = ((a.x() / 8 + a.y() / 8) & 1) ? 1.0f : 0.0f;
+        a[1] = 0.01f * a.x() + 0.02f * a.y();
+    }
+    const char *kernels[2] = { "gaussian", "disk" };
+    const float kwidths[2] = { 9.0f, 25.0f };
+    for (int k = 0;  k < 2;  ++k) {
+        ImageBuf K, R, Ref;
+        ImageBufAlgo::make_kernel (K, kernels[k], kwidths[k], kwidths[k]);
+        OIIO_CHECK_ASSERT (ImageBufAlgo::convolve (R, A, K));
+        reference_convolve (Ref, A, K);
+        ImageBufAlgo::CompareResults comp;
+        ImageBufAlgo::compare (R, Ref, 1.0e-4f, 1.0e-4f, comp);
+        OIIO_CHECK_EQUAL (comp.nfail, 0);
+    }
+}
+
+
+
+// Brute-force references for median_filter, dilate and erode (op 0, 1,
+// 2), which look only at the window's pixels inside the data window.
+static void
+reference_window_filter (ImageBuf &R, const ImageBuf &src,
+                         int width, int height, int op)
+{
+    R.reset (ImageSpec (src.spec().width, src.spec().height,
+                        src.nchannels(), TypeDesc::FLOAT));
+    const ImageSpec &spec (src.spec());
+    for (ImageBuf::Iterator<float> r (R);  ! r.done();  ++r) {
+        for (int c = 0;  c < R.nchannels();  ++c) {
+            std::vector<float> vals;
+            for (int y = r.y()-height/2;  y < r.y()-height/2+height;  ++y)
+                for (int x = r.x()-width/2;  x < r.x()-width/2+width;  ++x)
+                    if (x >= spec.x && x < spec.x+spec.width &&
+                        y >= spec.y && y < spec.y+spec.height)
+                        vals.push_back (src.getchannel (x, y, 0, c));
+            std::sort (vals.begin(), vals.end());
+            r[c] = op == 0 ? vals[vals.size()/2]
+                 : op == 1 ? vals.back() : vals.front();
+        }
+    }
+}
+
+
+
+// Tests median_filter (whose histogram path is for 8 and 16 bit images
+// and big windows), dilate and erode against brute force.
+void test_median_morph ()
+{
+    std::cout << "test median_filter, dilate, erode\n";
+    const TypeDesc types[3] = { TypeDesc::UINT8, TypeDesc::UINT16,
+                                TypeDesc::FLOAT };
+    for (int t = 0;  t < 3;  ++t) {
+        ImageBuf A (ImageSpec (40, 30, 2, types[t]));
+        for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a) {
+            a[0] = float ((a.x() * 37 + a.y() * 91) % 101) / 100.0f;
+            a[1] = ((a.x() / 5 + a.y() / 3) & 1) ? 0.75f : 0.25f;
+        }
+        for (int op = 0;  op < 3;  ++op) {
+            ImageBuf R, Ref;
+            if (op == 0)
+                ImageBufAlgo::median_filter (R, A, 9, 7);
+            else if (op == 1)
+                ImageBufAlgo::dilate (R, A, 9, 7);
+            else
+                ImageBufAlgo::erode (R, A, 9, 7);
+            reference_window_filter (Ref, A, 9, 7, op);
+            ImageBufAlgo::CompareResults comp;
+            ImageBufAlgo::compare (R, Ref, 0.0f, 0.0f, comp);
+            OIIO_CHECK_EQUAL (comp.nfail, 0);
+        }
+    }
+}
+
+
+
+// Tests box_blur against brute force, and that gaussian_blur keeps flat
+// regions flat and spreads an impulse by about sigma.
+void test_blur ()
+{
+    std::cout << "test box_blur, gaussian_blur\n";
+    ImageBuf A (ImageSpec (64, 48, 2, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a) {
+        a[0] = ((a.x() / 8 + a.y() / 8) & 1) ? 1.0f : 0.0f;
+        a[1] = 0.01f * a.x() + 0.02f * a.y();
+    }
+    ImageBuf B, Ref (ImageSpec (64, 48, 2, TypeDesc::FLOAT));
+    ImageBufAlgo::box_blur (B, A, 7, 5);
+    for (ImageBuf::Iterator<float> r (Ref);  ! r.done();  ++r) {
+        for (int c = 0;  c < 2;  ++c) {
+            float sum = 0.0f;
+            for (int y = -2;  y <= 2;  ++y)
+                for (int x = -3;  x <= 3;  ++x)
+                    sum += A.getchannel (r.x()+x, r.y()+y, 0, c,
+                                         ImageBuf::WrapClamp);
+            r[c] = sum / 35.0f;
+        }
+    }
+    ImageBufAlgo::CompareResults comp;
+    ImageBufAlgo::compare (B, Ref, 1.0e-5f, 1.0e-5f, comp);
+    OIIO_CHECK_EQUAL (comp.nfail, 0);
+
+    const float sigma = 4.0f;
+    ImageBuf Flat (ImageSpec (64, 64, 1, TypeDesc::FLOAT));
+    float half = 0.5f;
+    ImageBufAlgo::fill (Flat, &half);
+    ImageBuf G;
+    ImageBufAlgo::gaussian_blur (G, Flat, sigma);
+    ImageBufAlgo::compare (G, Flat, 1.0e-5f, 1.0e-5f, comp);
+    OIIO_CHECK_EQUAL (comp.nfail, 0);
+
+    ImageBuf Impulse (ImageSpec (64, 64, 1, TypeDesc::FLOAT));
+    ImageBufAlgo::zero (Impulse);
+    float one = 1.0f;
+    Impulse.setpixel (32, 32, &one);
+    ImageBufAlgo::gaussian_blur (G, Impulse, sigma);
+    float peak = G.getchannel (32, 32, 0, 0);
+    float gpeak = 1.0f / (2.0f * float(M_PI) * sigma * sigma);
+    OIIO_CHECK_ASSERT (fabsf (peak - gpeak) < 0.1f * gpeak);
+    ImageBufAlgo::PixelStats stats;
+    ImageBufAlgo::computePixelStats (stats, G);
+    OIIO_CHECK_EQUAL_THRESH (stats.avg[0] * 64 * 64, 1.0f, 1.0e-3f);
+}
+
+
+
+// Tests the separable resize: a constant stays constant, and away from
+// the edges a linear ramp is sampled exactly at the output pixel centers.
+void test_resize ()
+{
+    std::cout << "test resize\n";
+    ImageBuf A (ImageSpec (64, 48, 2, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a) {
+        a[0] = 0.25f;
+        a[1] = float(a.x()) + 2.0f * float(a.y());
+    }
+    ImageBuf R;
+    ImageBufAlgo::resize (R, A, "lanczos3", 0.0f, ROI (0, 16, 0, 12));
+    for (int y = 0;  y < 12;  ++y)
+        for (int x = 0;  x < 16;  ++x) {
+            OIIO_CHECK_EQUAL_THRESH (R.getchannel (x, y, 0, 0), 0.25f, 1.0e-5f);
+            if (x >= 4 && x < 12 && y >= 4 && y < 8) {
+                float sx = (x + 0.5f) * 4.0f - 0.5f;
+                float sy = (y + 0.5f) * 4.0f - 0.5f;
+                OIIO_CHECK_EQUAL_THRESH (R.getchannel (x, y, 0, 1),
+                                         sx + 2.0f * sy, 1.0e-3f);
+            }
+        }
+}
+
+
+
+// Tests the affine warp paths: an integer translation with lanczos3 is
+// an exact shift, and a half pixel translation with the bilinear
+// triangle filter averages neighbors, both in the interior and (for a
+// cached-like, wrapped read) at the edges.
+void test_warp ()
+{
+    std::cout << "test warp\n";
+    ImageBuf A (ImageSpec (32, 24, 3, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a)
+        for (int c = 0;  c < 3;  ++c)
+            a[c] = float ((a.x() * 7 + a.y() * 13 + c * 5) % 17);
+
+    ImageBuf R;
+    Imath::M33f M;
+    M.translate (Imath::V2f (3.0f, 2.0f));
+    ImageBufAlgo::warp (R, A, M, "lanczos3");
+    for (int y = 2;  y < 24;  ++y)
+        for (int x = 3;  x < 32;  ++x)
+            for (int c = 0;  c < 3;  ++c)
+                OIIO_CHECK_EQUAL_THRESH (R.getchannel (x, y, 0, c),
+                                         A.getchannel (x-3, y-2, 0, c), 1.0e-4f);
+
+    M = Imath::M33f().translate (Imath::V2f (0.5f, 0.0f));
+    ImageBufAlgo::warp (R, A, M, "triangle", 0.0f, false,
+                        ImageBuf::WrapClamp);
+    for (int y = 0;  y < 24;  ++y)
+        for (int x = 0;  x < 32;  ++x)
+            for (int c = 0;  c < 3;  ++c) {
+                float expected = 0.5f * (A.getchannel (x-1, y, 0, c, ImageBuf::WrapClamp)
+                                       + A.getchannel (x, y, 0, c, ImageBuf::WrapClamp));
+                OIIO_CHECK_EQUAL_THRESH (R.getchannel (x, y, 0, c),
+                                         expected, 1.0e-5f);
+            }
+}
+
+
+
+// Tests fft (which uses the real-input shortcuts) against a direct DFT,
+// and that ifft gets back to where we started, for odd and even sizes.
+void test_fft ()
+{
+    std::cout << "test fft\n";
+    const int sizes[2][2] = { { 12, 8 }, { 9, 7 } };
+    for (int t = 0;  t < 2;  ++t) {
+        int w = sizes[t][0], h = sizes[t][1];
+        ImageBuf A (ImageSpec (w, h, 1, TypeDesc::FLOAT));
+        for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a)
+            a[0] = sinf (1.7f * (a.y() * w + a.x())) + 0.3f * (a.x() % 5);
+        ImageBuf F, I;
+        OIIO_CHECK_ASSERT (ImageBufAlgo::fft (F, A));
+        double scale = 1.0 / sqrt (double(w * h));
+        for (int v = 0;  v < h;  ++v)
+            for (int u = 0;  u < w;  ++u) {
+                double re = 0.0, im = 0.0;
+                for (int y = 0;  y < h;  ++y)
+                    for (int x = 0;  x < w;  ++x) {
+                        double a = A.getchannel (x, y, 0, 0);
+                        double phase = -2.0 * M_PI * (double(u*x)/w + double(v*y)/h);
+                        re += a * cos (phase);
+                        im += a * sin (phase);
+                    }
+                OIIO_CHECK_EQUAL_THRESH (F.getchannel (u, v, 0, 0), re * scale, 1.0e-4);
+                OIIO_CHECK_EQUAL_THRESH (F.getchannel (u, v, 0, 1), im * scale, 1.0e-4);
+            }
+        OIIO_CHECK_ASSERT (ImageBufAlgo::ifft (I, F));
+        ImageBufAlgo::CompareResults comp;
+        ImageBufAlgo::compare (I, A, 1.0e-5f, 1.0e-5f, comp);
+        OIIO_CHECK_EQUAL (comp.nfail, 0);
+    }
+}
+
+
+
+// Tests integral_image and area_sum against direct sums.
+void test_integral_image ()
+{
+    std::cout << "test integral_image, area_sum\n";
+    ImageBuf A (ImageSpec (50, 40, 2, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a) {
+        a[0] = float ((a.x() * 7 + a.y() * 3) % 11);
+        a[1] = 0.5f;
+    }
+    ImageBuf S;
+    OIIO_CHECK_ASSERT (ImageBufAlgo::integral_image (S, A));
+    OIIO_CHECK_EQUAL (S.spec().format, TypeDesc::DOUBLE);
+    const ROI rois[3] = { ROI (0, 50, 0, 40), ROI (3, 17, 5, 29),
+                          ROI (40, 60, 0, 1) };
+    for (int r = 0;  r < 3;  ++r) {
+        float sum[2];
+        OIIO_CHECK_ASSERT (ImageBufAlgo::area_sum (S, rois[r], sum));
+        ROI clipped = roi_intersection (rois[r], A.roi());
+        float ref[2] = { 0.0f, 0.0f };
+        for (ImageBuf::ConstIterator<float> a (A, clipped);  ! a.done();  ++a)
+            for (int c = 0;  c < 2;  ++c)
+                ref[c] += a[c];
+        OIIO_CHECK_EQUAL (sum[0], ref[0]);
+        OIIO_CHECK_EQUAL (sum[1], ref[1]);
+    }
+}
+
+
+
 // Tests ImageBufAlgo::compare
 void test_compare ()
 {
@@ -532,7 +1028,232 @@ void test_computePixelStats ()
 
 
 
+// Tests ImageBufAlgo::analyze() against the separate queries
+void test_analyze ()
+{
+    std::cout << "test analyze\n";
+    ImageBuf A (ImageSpec (64, 48, 3, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a)
+        a[0] = a[1] = a[2] = float ((a.x() + 3 * a.y()) % 10) / 10.0f;
+    ImageBufAlgo::ImageAnalysis r;
+    OIIO_CHECK_ASSERT (ImageBufAlgo::analyze (r, A, ROI(), 4));
+    OIIO_CHECK_ASSERT (r.monochrome);
+    OIIO_CHECK_EQUAL (r.nonfinite_pixels, 0);
+    ImageBufAlgo::PixelStats stats;
+    ImageBufAlgo::computePixelStats (stats, A);
+    for (int c = 0;  c < 3;  ++c) {
+        OIIO_CHECK_EQUAL (r.stats.min[c], stats.min[c]);
+        OIIO_CHECK_EQUAL (r.stats.max[c], stats.max[c]);
+        OIIO_CHECK_EQUAL_THRESH (r.stats.avg[c], stats.avg[c], 1.0e-6);
+    }
+
+    // Break the monochrome-ness and add some nonfinite pixels
+    float pel[3] = { 0.5f, 0.5f, 0.25f };
+    A.setpixel (10, 20, pel);
+    pel[1] = std::numeric_limits<float>::quiet_NaN();
+    A.setpixel (5, 30, pel);
+    A.setpixel (7, 40, pel);
+    pel[1] = std::numeric_limits<float>::infinity();
+    A.setpixel (60, 2, pel);
+    OIIO_CHECK_ASSERT (ImageBufAlgo::analyze (r, A, ROI(), 4, 2));
+    OIIO_CHECK_ASSERT (! r.monochrome);
+    OIIO_CHECK_EQUAL (r.nonfinite_pixels, 3);
+    OIIO_CHECK_EQUAL (r.nonfinite_x.size(), 2);
+    OIIO_CHECK_EQUAL (r.nonfinite_x[0], 60);   // scanline order
+    OIIO_CHECK_EQUAL (r.nonfinite_y[0], 2);
+    OIIO_CHECK_EQUAL (r.nonfinite_x[1], 5);
+    OIIO_CHECK_EQUAL (r.nonfinite_y[1], 30);
+    OIIO_CHECK_EQUAL (r.stats.nancount[1], 2);
+    OIIO_CHECK_EQUAL (r.stats.infcount[1], 1);
+}
+
+
+
 // Test ability to do a maketx directly from an ImageBuf
+// Tests that a colorconvert baked into a 3D LUT is close to the exact one
+void test_colorconvert_lut3d ()
+{
+    std::cout << "test colorconvert baked to a 3D LUT\n";
+    ImageBuf A (ImageSpec (64, 64, 4, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a) {
+        a[0] = a.x() / 63.0f;
+        a[1] = a.y() / 63.0f;
+        a[2] = ((a.x() + a.y()) % 8) / 7.0f;
+        a[3] = (a.x() & 1) ? 0.5f : 1.0f;
+    }
+    ImageBuf exact, baked;
+    ImageBufAlgo::colorconvert (exact, A, "linear", "sRGB", true);
+    OIIO::attribute ("color:lut3d_size", 33);
+    ImageBufAlgo::colorconvert (baked, A, "linear", "sRGB", true);
+    OIIO::attribute ("color:lut3d_size", 0);
+    ImageBufAlgo::CompareResults cr;
+    ImageBufAlgo::compare (exact, baked, 0.005f, 0.005f, cr);
+    OIIO_CHECK_EQUAL (cr.nfail, 0);
+    OIIO_CHECK_ASSERT (cr.maxerror > 0.0);
+}
+
+
+
+// Tests that 8 and 16 bit colorconverts done with 1D integer LUTs give
+// the same results as converting every pixel through float
+void test_colorconvert_lut1d ()
+{
+    std::cout << "test colorconvert of 8/16 bit images with 1D LUTs\n";
+    ImageBuf F (ImageSpec (300, 260, 3, TypeDesc::FLOAT));
+    for (ImageBuf::Iterator<float> f (F);  ! f.done();  ++f) {
+        f[0] = f.x() / 299.0f;
+        f[1] = f.y() / 259.0f;
+        f[2] = ((f.x() * 7 + f.y()) % 256) / 255.0f;
+    }
+    TypeDesc types[2] = { TypeDesc::UINT8, TypeDesc::UINT16 };
+    for (int t = 0;  t < 2;  ++t) {
+        ImageBuf A;
+        A.copy (F, types[t]);
+        // Reference: float in, the whole transform, then quantize
+        ImageBuf Af, exactf, exact;
+        Af.copy (A, TypeDesc::FLOAT);
+        ImageBufAlgo::colorconvert (exactf, Af, "linear", "sRGB", false);
+        exact.copy (exactf, types[t]);
+        ImageBuf R;
+        OIIO_CHECK_ASSERT (ImageBufAlgo::colorconvert (R, A, "linear",
+                                                       "sRGB", false));
+        OIIO_CHECK_EQUAL (R.spec().format, types[t]);
+        ImageBufAlgo::CompareResults cr;
+        ImageBufAlgo::compare (R, exact, 1.0e-6f, 1.0e-6f, cr);
+        OIIO_CHECK_EQUAL (cr.nfail, 0);
+    }
+}
+
+
+
+// Noise must be a pure function of pixel coordinates, channel and seed,
+// so the thread count must not change a single bit of the result.
+void test_noise ()
+{
+    std::cout << "test noise reproducibility\n";
+    const char *types[] = { "gaussian", "uniform", "salt" };
+    ImageSpec spec (256, 200, 5, TypeDesc::FLOAT);
+    for (int t = 0;  t < 3;  ++t) {
+        for (int mono = 0;  mono < 2;  ++mono) {
+            ImageBuf A (spec), B (spec);
+            ImageBufAlgo::zero (A);
+            ImageBufAlgo::zero (B);
+            ImageBufAlgo::noise (A, types[t], 0.5f, 0.1f, mono, 42,
+                                 ROI::All(), 1);
+            ImageBufAlgo::noise (B, types[t], 0.5f, 0.1f, mono, 42,
+                                 ROI::All(), 8);
+            OIIO_CHECK_EQUAL (ImageBufAlgo::computePixelHashSHA1 (A),
+                              ImageBufAlgo::computePixelHashSHA1 (B));
+        }
+    }
+    // Sanity check the gaussian distribution
+    ImageBuf G (ImageSpec (512, 512, 1, TypeDesc::FLOAT));
+    ImageBufAlgo::zero (G);
+    ImageBufAlgo::noise (G, "gaussian", 0.5f, 0.1f, false, 7);
+    ImageBufAlgo::PixelStats stats;
+    ImageBufAlgo::computePixelStats (stats, G);
+    OIIO_CHECK_ASSERT (fabs (stats.avg[0] - 0.5f) < 0.001f);
+    OIIO_CHECK_ASSERT (fabs (stats.stddev[0] - 0.1f) < 0.001f);
+}
+
+
+
+// Tests that cached color processors stay valid independently
+void test_color_processor_cache ()
+{
+    std::cout << "test ColorConfig processor cache\n";
+    ColorConfig config;
+    ColorProcessor *p1 = config.createColorProcessor ("linear", "sRGB");
+    ColorProcessor *p2 = config.createColorProcessor ("linear", "sRGB");
+    OIIO_CHECK_ASSERT (p1 && p2 && p1 != p2);
+    ColorConfig::deleteColorProcessor (p1);
+    float color[3] = { 0.5f, 0.5f, 0.5f };
+    OIIO_CHECK_ASSERT (ImageBufAlgo::colorconvert (color, 3, p2, false));
+    OIIO_CHECK_EQUAL_THRESH (color[0], linear_to_sRGB (0.5f), 1.0e-5);
+    ColorConfig::deleteColorProcessor (p2);
+}
+
+
+
+// Tests that the reductions give the same answers threaded and serial
+void test_parallel_reduce ()
+{
+    std::cout << "test parallel reductions\n";
+    ImageBuf A (ImageSpec (400, 300, 2, TypeDesc::FLOAT));
+    ImageBuf B (A.spec());
+    for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a) {
+        a[0] = float ((a.x() * 7 + a.y() * 3) % 16) / 16.0f;
+        a[1] = float ((a.x() + a.y()) % 4) / 4.0f;
+    }
+    ImageBufAlgo::copy (B, A);
+    ImageBuf::Iterator<float> b (B, 123, 211);
+    b[0] = b[0] + 0.5f;
+    b.pos (399, 5);
+    b[1] = b[1] + 0.05f;
+
+    ImageBufAlgo::PixelStats s1, sN;
+    ImageBufAlgo::computePixelStats (s1, A, ROI(), 1);
+    ImageBufAlgo::computePixelStats (sN, A, ROI(), 8);
+    for (int c = 0;  c < 2;  ++c) {
+        OIIO_CHECK_EQUAL (s1.min[c], sN.min[c]);
+        OIIO_CHECK_EQUAL (s1.max[c], sN.max[c]);
+        OIIO_CHECK_EQUAL (s1.avg[c], sN.avg[c]);
+        OIIO_CHECK_EQUAL (s1.finitecount[c], sN.finitecount[c]);
+    }
+
+    ImageBufAlgo::CompareResults c1, cN;
+    ImageBufAlgo::compare (A, B, 0.1f, 0.01f, c1, ROI(), 1);
+    ImageBufAlgo::compare (A, B, 0.1f, 0.01f, cN, ROI(), 8);
+    OIIO_CHECK_EQUAL (c1.nfail, cN.nfail);
+    OIIO_CHECK_EQUAL (c1.maxerror, cN.maxerror);
+    OIIO_CHECK_EQUAL (c1.maxx, cN.maxx);
+    OIIO_CHECK_EQUAL (c1.maxy, cN.maxy);
+    OIIO_CHECK_EQUAL (c1.meanerror, cN.meanerror);
+    OIIO_CHECK_EQUAL (cN.maxx, 123);
+
+    std::vector<imagesize_t> h1, hN;
+    ImageBufAlgo::histogram (A, 0, h1, 32, 0.0f, 1.0f, NULL, NULL, ROI(), 1);
+    ImageBufAlgo::histogram (A, 0, hN, 32, 0.0f, 1.0f, NULL, NULL, ROI(), 8);
+    OIIO_CHECK_ASSERT (h1 == hN);
+
+    const float color[2] = { 0.0f, 0.0f };
+    imagesize_t n1 = 0, nN = 0;
+    ImageBufAlgo::color_count (A, &n1, 1, color, NULL, ROI(), 1);
+    ImageBufAlgo::color_count (A, &nN, 1, color, NULL, ROI(), 8);
+    OIIO_CHECK_EQUAL (n1, nN);
+    OIIO_CHECK_ASSERT (nN > 0);
+}
+
+
+
+// Tests the selectable pixel hash algorithms
+void test_computePixelHash ()
+{
+    std::cout << "test computePixelHash\n";
+    ImageBuf A (ImageSpec (200, 150, 3, TypeDesc::UINT8));
+    for (ImageBuf::Iterator<unsigned char> a (A);  ! a.done();  ++a)
+        for (int c = 0;  c < 3;  ++c)
+            a[c] = (unsigned char) ((a.x() * 13 + a.y() * 7 + c) % 256);
+    OIIO_CHECK_EQUAL (ImageBufAlgo::computePixelHash (A, "sha1", "x", ROI(), 16),
+                      ImageBufAlgo::computePixelHashSHA1 (A, "x", ROI(), 16));
+    std::string h1 = ImageBufAlgo::computePixelHash (A, "xxhash64", "x",
+                                                     ROI(), 16, 1);
+    std::string hN = ImageBufAlgo::computePixelHash (A, "xxhash64", "x",
+                                                     ROI(), 16, 8);
+    OIIO_CHECK_EQUAL (h1.size(), 16);
+    OIIO_CHECK_EQUAL (h1, hN);
+    OIIO_CHECK_NE (h1, ImageBufAlgo::computePixelHash (A, "xxhash64", "y",
+                                                       ROI(), 16));
+    OIIO_CHECK_NE (h1, ImageBufAlgo::computePixelHash (A, "xxhash64", "x"));
+    OIIO_CHECK_EQUAL (ImageBufAlgo::computePixelHash (A, "bogus"), "");
+    ImageBuf::Iterator<unsigned char> a (A, 100, 149);
+    a[1] = a[1] + 1;
+    OIIO_CHECK_NE (h1, ImageBufAlgo::computePixelHash (A, "xxhash64", "x",
+                                                       ROI(), 16));
+}
+
+
+
 void
 test_maketx_from_imagebuf()
 {
@@ -632,6 +1353,129 @@ test_IBAprep ()
 
 
 
+// Helper for test_parallel_image: bump every pixel of the ROI by one.
+static void
+bump_pixels (ImageBuf &buf, ROI roi)
+{
+    for (ImageBuf::Iterator<float> p (buf, roi);  ! p.done();  ++p)
+        p[0] = p[0] + 1.0f;
+}
+
+
+
+// Make sure parallel_image visits every pixel exactly once, for each of
+// the ways it can split up the work.
+void
+test_parallel_image ()
+{
+    std::cout << "test parallel_image\n";
+    using namespace ImageBufAlgo;
+    ImageSpec specs[3] = { ImageSpec (1000, 777, 1, TypeDesc::FLOAT),
+                           ImageSpec (10000, 3, 1, TypeDesc::FLOAT),
+                           ImageSpec (64, 64, 1, TypeDesc::FLOAT) };
+    specs[2].depth = 33;
+    SplitDir splits[5] = { Split_X, Split_Y, Split_Z, Split_Biggest, Split_Tile };
+    for (int i = 0;  i < 3;  ++i) {
+        for (int s = 0;  s < 5;  ++s) {
+            ImageBuf buf (specs[i]);
+            ImageBufAlgo::zero (buf);
+            ROI roi = get_roi (buf.spec());
+            parallel_image (OIIO::bind (bump_pixels, OIIO::ref(buf), _1),
+                            roi, 16, splits[s], 4);
+            PixelStats stats;
+            computePixelStats (stats, buf);
+            OIIO_CHECK_EQUAL (stats.min[0], 1.0f);
+            OIIO_CHECK_EQUAL (stats.max[0], 1.0f);
+        }
+    }
+}
+
+
+
+// Tests ImageBufAlgo::Expr against the equivalent sequence of
+// separate ImageBufAlgo calls.
+void
+test_expr ()
+{
+    std::cout << "test Expr\n";
+    using namespace ImageBufAlgo;
+    ImageSpec spec (100, 50, 4, TypeDesc::FLOAT);
+    spec.alpha_channel = 3;
+    ImageBuf A (spec), B (spec);
+    for (ImageBuf::Iterator<float> a (A);  ! a.done();  ++a)
+        for (int c = 0;  c < 4;  ++c)
+            a[c] = 0.01f * a.x() - 0.02f * a.y() + 0.1f * c;
+    for (ImageBuf::Iterator<float> b (B);  ! b.done();  ++b)
+        for (int c = 0;  c < 4;  ++c)
+            b[c] = 0.5f - 0.015f * b.y() + 0.005f * b.x() * c;
+    const float scale[4] = { 1.5f, 0.5f, 2.0f, 1.0f };
+
+    // Step by step
+    ImageBuf T1, T2, T3, T4, T5, T6;
+    mul (T1, A, scale);
+    add (T2, T1, B);
+    premult (T3, T2);
+    ImageBufAlgo::abs (T4, T3);
+    pow (T5, T4, 0.5f);
+    clamp (T6, T5, 0.1f, 0.9f);
+
+    // Fused
+    ImageBuf R;
+    Expr e = clamp (pow (abs (premult (Expr(A) * Expr(scale, 4) + Expr(B))),
+                         0.5f), 0.1f, 0.9f);
+    OIIO_CHECK_ASSERT (e.eval (R));
+    CompareResults comp;
+    compare (R, T6, 1e-6f, 1e-6f, comp);
+    OIIO_CHECK_EQUAL (comp.nfail, 0);
+    OIIO_CHECK_EQUAL (R.spec().format, TypeDesc::FLOAT);
+
+    // Shared subexpressions are only evaluated once, and evaluating in
+    // place into one of the inputs works.
+    Expr ab = Expr(A) * Expr(B);
+    Expr twice = ab + ab;
+    OIIO_CHECK_EQUAL (twice.nodes(), 4);
+    mul (T1, A, B);
+    mul (T2, T1, 2.0f);
+    ImageBuf C (A.spec());
+    paste (C, 0, 0, 0, 0, A);
+    OIIO_CHECK_ASSERT ((Expr(C) * Expr(B) * 2.0f).eval (C));
+    compare (C, T2, 1e-6f, 1e-6f, comp);
+    OIIO_CHECK_EQUAL (comp.nfail, 0);
+
+    // Division by zero gives zero, like div()
+    ImageBuf Z;
+    OIIO_CHECK_ASSERT ((Expr(A) / 0.0f).eval (Z));
+    PixelStats stats;
+    computePixelStats (stats, Z);
+    OIIO_CHECK_EQUAL (stats.min[0], 0.0f);
+    OIIO_CHECK_EQUAL (stats.max[0], 0.0f);
+
+    // With GPU compute requested, a big evaluation gives the same
+    // results, whether it runs on a GPU or falls back to the CPU.
+    ImageSpec bigspec (400, 300, 4, TypeDesc::FLOAT);
+    bigspec.alpha_channel = 3;
+    ImageBuf BA (bigspec), BB (bigspec);
+    const float topa[4] = { 0.25f, 1.0f, 0.5f, 0.0f };
+    const float bottoma[4] = { 0.5f, 0.2f, 0.1f, 0.5f };
+    const float topb[4] = { 0.75f, 0.0f, 0.0f, 1.0f };
+    const float bottomb[4] = { 0.0f, 0.5f, 1.0f, 0.25f };
+    fill (BA, topa, bottoma);
+    fill (BB, topb, bottomb);
+    Expr big = clamp (unpremult (Expr(BA) * Expr(scale, 4) - Expr(BB) / 2.0f),
+                      0.0f, 1.5f);
+    ImageBuf Rcpu, Rgpu;
+    OIIO_CHECK_ASSERT (big.eval (Rcpu));
+    OIIO::attribute ("gpu", 1);
+    int gpu = 0;
+    OIIO_CHECK_ASSERT (OIIO::getattribute ("gpu", gpu) && gpu == 1);
+    OIIO_CHECK_ASSERT (big.eval (Rgpu));
+    OIIO::attribute ("gpu", 0);
+    compare (Rgpu, Rcpu, 1e-6f, 1e-6f, comp);
+    OIIO_CHECK_EQUAL (comp.nfail, 0);
+}
+
+
+
 int
 main (int argc, char **argv)
 {
@@ -639,18 +1483,37 @@ main (int argc, char **argv)
     test_zero_fill ();
     test_crop ();
     test_paste ();
+    test_reorient ();
     test_channel_append ();
     test_add ();
     test_sub ();
     test_mul ();
     test_mad ();
+    test_pixelmath_fastpath ();
+    test_over ();
+    test_convolve ();
+    test_median_morph ();
+    test_blur ();
+    test_resize ();
+    test_warp ();
+    test_fft ();
+    test_integral_image ();
     test_compare ();
     test_isConstantColor ();
     test_isConstantChannel ();
     test_isMonochrome ();
     test_computePixelStats ();
+    test_analyze ();
+    test_parallel_reduce ();
+    test_computePixelHash ();
+    test_colorconvert_lut3d ();
+    test_colorconvert_lut1d ();
+    test_noise ();
+    test_color_processor_cache ();
     test_maketx_from_imagebuf ();
     test_IBAprep ();
+    test_parallel_image ();
+    test_expr ();
     
     return unit_test_failures;
 }
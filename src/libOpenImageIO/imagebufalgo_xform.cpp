@@ -45,6 +45,7 @@
 #include "OpenImageIO/filter.h"
 #include "OpenImageIO/thread.h"
 #include "OpenImageIO/refcnt.h"
+#include "OpenImageIO/simd.h"
 
 OIIO_NAMESPACE_BEGIN
 
@@ -135,6 +136,64 @@ transform (const Imath::M33f &M, ROI roi)
 
 
 
+// The horizontal and vertical parts of a separable filter, tabulated once
+// per resize or warp so that the per-tap evaluations in the inner loops
+// are table lookups instead of virtual calls (which, for lanczos3, sinc,
+// blackman-harris and the like, involve trig or exp).  Box and triangle
+// are already cheap and exact -- and box jumps to 0 right at the edge of
+// its support, where tap positions often land exactly -- so those, and
+// non-separable filters, are still evaluated directly.
+class FilterTables {
+public:
+    FilterTables (const Filter2D *filter)
+        : m_filter(filter), m_tabulated(false)
+    {
+        if (filter->separable() && filter->name() != "box" &&
+                filter->name() != "triangle") {
+            m_x.init (*filter, 0);
+            m_y.init (*filter, 1);
+            m_tabulated = true;
+        }
+    }
+
+    bool tabulated () const { return m_tabulated; }
+
+    float xfilt (float x) const {
+        return m_tabulated ? m_x(x) : m_filter->xfilt(x);
+    }
+    float yfilt (float y) const {
+        return m_tabulated ? m_y(y) : m_filter->yfilt(y);
+    }
+    float operator() (float x, float y) const {
+        return m_tabulated ? m_x(x) * m_y(y) : (*m_filter)(x, y);
+    }
+
+    // Fill w[0..n-1] with xfilt (or yfilt, if axis is 1) evaluated at
+    // (first+i)*scale.  Tabulated filters are evaluated 8 at a time, so
+    // w must have room for n rounded up to a multiple of 8.
+    void fill (int axis, float *w, int n, float first, float scale) const {
+        if (m_tabulated) {
+            const FilterTable1D &table (axis == 0 ? m_x : m_y);
+            for (int i = 0;  i < n;  i += 8) {
+                simd::float8 x = simd::float8::Iota (first + float(i));
+                table (x * simd::float8(scale)).store (w + i);
+            }
+        } else {
+            for (int i = 0;  i < n;  ++i) {
+                float x = (first + float(i)) * scale;
+                w[i] = axis == 0 ? m_filter->xfilt(x) : m_filter->yfilt(x);
+            }
+        }
+    }
+
+private:
+    const Filter2D *m_filter;
+    FilterTable1D m_x, m_y;
+    bool m_tabulated;
+};
+
+
+
 // Given s,t image space coordinates and their derivatives, compute a 
 // filtered sample using the derivatives to guide the size of the filter
 // footprint.
@@ -142,8 +201,8 @@ template<typename SRCTYPE>
 inline void
 filtered_sample (const ImageBuf &src, float s, float t,
                  float dsdx, float dtdx, float dsdy, float dtdy,
-                 const Filter2D *filter, ImageBuf::WrapMode wrap,
-                 float *result)
+                 const Filter2D *filter, const FilterTables &ftab,
+                 ImageBuf::WrapMode wrap, float *result)
 {
     DASSERT (filter);
     // Just use isotropic filtering
@@ -162,7 +221,7 @@ filtered_sample (const ImageBuf &src, float s, float t,
     memset (sum, 0, nc*sizeof(float));
     float total_w = 0.0f;
     for ( ; ! samp.done(); ++samp) {
-        float w = (*filter) (ds_inv*(samp.x()+0.5f-s), dt_inv*(samp.y()+0.5f-t));
+        float w = ftab (ds_inv*(samp.x()+0.5f-s), dt_inv*(samp.y()+0.5f-t));
         for (int c = 0; c < nc; ++c)
             sum[c] += w * samp[c];
         total_w += w;
@@ -183,13 +242,13 @@ filtered_sample (const ImageBuf &src, float s, float t,
 template<typename DSTTYPE, typename SRCTYPE>
 static bool
 resize_ (ImageBuf &dst, const ImageBuf &src,
-         Filter2D *filter, ROI roi, int nthreads)
+         Filter2D *filter, const FilterTables *ftab, ROI roi, int nthreads)
 {
     if (nthreads != 1 && roi.npixels() >= 1000) {
         // Lots of pixels and request for multi threads? Parallelize.
         ImageBufAlgo::parallel_image (
             OIIO::bind(resize_<DSTTYPE,SRCTYPE>, OIIO::ref(dst),
-                        OIIO::cref(src), filter,
+                        OIIO::cref(src), filter, ftab,
                         _1 /*roi*/, 1 /*nthreads*/),
             roi, nthreads);
         return true;
@@ -231,14 +290,12 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
     int xtaps = 2*radi + 1;
     int ytaps = 2*radj + 1;
     bool separable = filter->separable();
-    float *yfiltval = ALLOCA (float, ytaps);
     float *xfiltval_all = NULL;
     if (separable) {
         // For separable filters, horizontal tap weights will be the same
         // for every column. So we precompute all the tap weights for every
-        // x position we'll need. We do the same thing in y, but row by row
-        // inside the loop (since we never revisit a y row). This
-        // substantially speeds up resize.
+        // x position we'll need (and likewise for every y row, below).
+        // This substantially speeds up resize.
         xfiltval_all = ALLOCA (float, xtaps * roi.width());
         for (int x = roi.xbegin;  x < roi.xend;  ++x) {
             float *xfiltval = xfiltval_all + (x-roi.xbegin) * xtaps;
@@ -250,7 +307,7 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
                 pel[c] = 0.0f;
             float totalweight_x = 0.0f;
             for (int i = 0;  i < xtaps;  ++i) {
-                float w = filter->xfilt (xratio * (i-radi-(src_xf_frac-0.5f)));
+                float w = ftab->xfilt (xratio * (i-radi-(src_xf_frac-0.5f)));
                 xfiltval[i] = w;
                 totalweight_x += w;
             }
@@ -302,66 +359,99 @@ resize_ (ImageBuf &dst, const ImageBuf &src,
     //
     // Separate cases for separable and non-separable filters.
     if (separable) {
-        ImageBuf::Iterator<DSTTYPE> out (dst, roi);
-        ImageBuf::ConstIterator<SRCTYPE> srcpel (src, ImageBuf::WrapClamp);
+        // Two passes: first filter horizontally each source row that any
+        // of our output rows needs, giving roi.width() pixels per row,
+        // then filter those rows vertically.  That's xtaps+ytaps rather
+        // than xtaps*ytaps multiplies per output pixel (per source row
+        // needed, for the horizontal pass), and both passes walk memory
+        // contiguously.  The vertical tap weights for every output row
+        // are computed up front, like the horizontal ones.
+        const int w = roi.width(), h = roi.height();
+        std::vector<int> src_xs (w), src_ys (h);
+        std::vector<float> yfiltval_all (size_t(h) * ytaps);
+        std::vector<float> totalweight_y (h, 0.0f);
+        for (int x = roi.xbegin;  x < roi.xend;  ++x) {
+            float s = (x-dstfx+0.5f)*dstpixelwidth;
+            float src_xf = srcfx + s * srcfw;
+            src_xs[x-roi.xbegin] = ifloor (src_xf);
+        }
         for (int y = roi.ybegin;  y < roi.yend;  ++y) {
             float t = (y-dstfy+0.5f)*dstpixelheight;
             float src_yf = srcfy + t * srcfh;
             int src_y;
             float src_yf_frac = floorfrac (src_yf, &src_y);
-            // If using separable filters, our vertical set of filter tap
-            // weights will be the same for the whole scanline we're on.  Just
-            // compute and normalize them once.
-            float totalweight_y = 0.0f;
+            src_ys[y-roi.ybegin] = src_y;
+            float *yfiltval = &yfiltval_all[size_t(y-roi.ybegin) * ytaps];
+            float totalweight = 0.0f;
             for (int j = 0;  j < ytaps;  ++j) {
-                float w = filter->yfilt (yratio * (j-radj-(src_yf_frac-0.5f)));
+                float w = ftab->yfilt (yratio * (j-radj-(src_yf_frac-0.5f)));
                 yfiltval[j] = w;
-                totalweight_y += w;
+                totalweight += w;
             }
-            if (totalweight_y != 0.0f)
-                for (int i = 0;  i < ytaps;  ++i)
-                    yfiltval[i] /= totalweight_y;
+            if (totalweight != 0.0f)
+                for (int j = 0;  j < ytaps;  ++j)
+                    yfiltval[j] /= totalweight;
+            totalweight_y[y-roi.ybegin] = totalweight;
+        }
 
-            for (int x = roi.xbegin;  x < roi.xend;  ++x, ++out) {
-                float s = (x-dstfx+0.5f)*dstpixelwidth;
-                float src_xf = srcfx + s * srcfw;
-                int src_x = ifloor (src_xf);
+        // Horizontal pass
+        const int sx0 = src_xs[0] - radi, sx1 = src_xs[w-1] + radi + 1;
+        const int sy0 = src_ys[0] - radj, sy1 = src_ys[h-1] + radj + 1;
+        const size_t rowsize = size_t(w) * nchannels;
+        std::vector<float> srcrow (size_t(sx1-sx0) * nchannels);
+        std::vector<float> hpass (size_t(sy1-sy0) * rowsize);
+        ImageBuf::ConstIterator<SRCTYPE> srcpel (src, ImageBuf::WrapClamp);
+        for (int sy = sy0;  sy < sy1;  ++sy) {
+            float *r = &srcrow[0];
+            srcpel.rerange (sx0, sx1, sy, sy+1, 0, 1, ImageBuf::WrapClamp);
+            for ( ;  ! srcpel.done();  ++srcpel)
                 for (int c = 0;  c < nchannels;  ++c)
-                    pel[c] = 0.0f;
-                const float *xfiltval = xfiltval_all + (x-roi.xbegin) * xtaps;
-                float totalweight_x = 0.0f;
-                for (int i = 0;  i < xtaps;  ++i)
-                    totalweight_x += xfiltval[i];
-                if (totalweight_x != 0.0f) {
-                    srcpel.rerange (src_x-radi, src_x+radi+1,
-                                    src_y-radj, src_y+radj+1,
-                                    0, 1, ImageBuf::WrapClamp);
-                    for (int j = -radj;  j <= radj;  ++j) {
-                        float wy = yfiltval[j+radj];
-                        if (wy == 0.0f) {
-                            // 0 weight for this y tap -- move to next line
-                            srcpel.pos (srcpel.x(), srcpel.y()+1, srcpel.z());
-                            continue;
-                        }
-                        for (int i = 0;  i < xtaps; ++i, ++srcpel) {
-                            float w = wy * xfiltval[i];
-                            if (w)
-                                for (int c = 0;  c < nchannels;  ++c)
-                                    pel[c] += w * srcpel[c];
-                        }
-                    }
+                    *r++ = srcpel[c];
+            float *hp = &hpass[size_t(sy-sy0) * rowsize];
+            for (int x = 0;  x < w;  ++x, hp += nchannels) {
+                const float *xfiltval = xfiltval_all + x * xtaps;
+                const float *sp = &srcrow[size_t(src_xs[x]-radi-sx0) * nchannels];
+                for (int c = 0;  c < nchannels;  ++c)
+                    hp[c] = 0.0f;
+                for (int i = 0;  i < xtaps;  ++i, sp += nchannels) {
+                    float wx = xfiltval[i];
+                    if (wx)
+                        for (int c = 0;  c < nchannels;  ++c)
+                            hp[c] += wx * sp[c];
                 }
-                // Copy the pixel value (already normalized) to the output.
-                DASSERT (out.x() == x && out.y() == y);
-                if (totalweight_y == 0.0f) {
-                    // zero it out
-                    for (int c = 0;  c < nchannels;  ++c)
-                        out[c] = 0.0f;
-                } else {
-                    for (int c = 0;  c < nchannels;  ++c)
-                        out[c] = pel[c];
+            }
+        }
+
+        // Vertical pass, a whole output row at a time
+        std::vector<float> row (rowsize);
+        ImageBuf::Iterator<DSTTYPE> out (dst, roi);
+        for (int y = 0;  y < h;  ++y) {
+            std::fill (row.begin(), row.end(), 0.0f);
+            if (totalweight_y[y] != 0.0f) {
+                const float *yfiltval = &yfiltval_all[size_t(y) * ytaps];
+                for (int j = 0;  j < ytaps;  ++j) {
+                    float wy = yfiltval[j];
+                    if (wy == 0.0f)
+                        continue;  // 0 weight for this y tap
+                    const float *hp = &hpass[size_t(src_ys[y]-radj+j-sy0) * rowsize];
+                    simd::float4 wy4 (wy);
+                    size_t v = 0;
+                    for ( ;  v + 4 <= rowsize;  v += 4) {
+                        simd::float4 acc (&row[v]);
+                        acc += wy4 * simd::float4 (hp + v);
+                        acc.store (&row[v]);
+                    }
+                    for ( ;  v < rowsize;  ++v)
+                        row[v] += wy * hp[v];
                 }
             }
+            // Copy the row of pixels (already normalized) to the output.
+            for (const float *r = &row[0];  r < &row[0] + rowsize;
+                 r += nchannels, ++out) {
+                DASSERT (out.y() == roi.ybegin + y);
+                for (int c = 0;  c < nchannels;  ++c)
+                    out[c] = r[c];
+            }
         }
 
     } else {
@@ -443,10 +533,11 @@ ImageBufAlgo::resize (ImageBuf &dst, const ImageBuf &src,
         filterptr.reset (filter);
     }
 
+    FilterTables ftab (filter);
     bool ok;
     OIIO_DISPATCH_COMMON_TYPES2 (ok, "resize", resize_,
                           dst.spec().format, src.spec().format,
-                          dst, src, filter, roi, nthreads);
+                          dst, src, filter, &ftab, roi, nthreads);
     return ok;
 }
 
@@ -494,10 +585,11 @@ ImageBufAlgo::resize (ImageBuf &dst, const ImageBuf &src,
         return false;
     }
 
+    FilterTables ftab (filter.get());
     bool ok;
     OIIO_DISPATCH_COMMON_TYPES2 (ok, "resize", resize_,
                           dstspec.format, srcspec.format,
-                          dst, src, filter.get(), roi, nthreads);
+                          dst, src, filter.get(), &ftab, roi, nthreads);
     return ok;
 }
 
@@ -621,27 +713,177 @@ affine_resample_ (ImageBuf &dst, const ImageBuf &src, const Imath::M33f &Minv,
 
 
 
+// warp_ for the common case of an affine transform, where the filter
+// footprint is the same for every pixel and the source position just
+// advances by a constant step along each scanline.  This is the same
+// filtering as filtered_sample, but reuses one iterator, evaluates a
+// separable filter as xtaps+ytaps 1D weights rather than xtaps*ytaps 2D
+// ones, and for a 2 pixel wide triangle filter without minification
+// (which is exactly bilinear interpolation) computes the source positions
+// and weights four pixels at a time and reads only the 2x2 footprint,
+// straight from memory where it can.  Tabulated filters fill in their
+// 1D weights 8 at a time.
+template<typename DSTTYPE, typename SRCTYPE>
+static void
+warp_affine_ (ImageBuf &dst, const ImageBuf &src, const Imath::M33f &Minv,
+              const Filter2D *filter, const FilterTables &ftab,
+              ImageBuf::WrapMode wrap, ROI roi)
+{
+    int nc = src.nchannels();
+    // Derivatives of the source position, the same everywhere
+    float winv = 1.0f / Minv[2][2];
+    float dsdx = Minv[0][0] * winv, dtdx = Minv[0][1] * winv;
+    float dsdy = Minv[1][0] * winv, dtdy = Minv[1][1] * winv;
+    float ds = std::max (1.0f, std::max (fabsf(dsdx), fabsf(dsdy)));
+    float dt = std::max (1.0f, std::max (fabsf(dtdx), fabsf(dtdy)));
+    float ds_inv = 1.0f / ds;
+    float dt_inv = 1.0f / dt;
+    float filterrad_s = 0.5f * ds * filter->width();
+    float filterrad_t = 0.5f * dt * filter->width();
+    bool separable = filter->separable();
+    bool bilinear = (separable && filter->name() == "triangle" &&
+                     filter->width() == 2.0f && filter->height() == 2.0f &&
+                     ds == 1.0f && dt == 1.0f);
+    int maxtaps_s = (int) ceilf (2.0f * filterrad_s) + 2;
+    int maxtaps_t = (int) ceilf (2.0f * filterrad_t) + 2;
+    float *wx = ALLOCA (float, round_to_multiple (maxtaps_s, 8));
+    float *wy = ALLOCA (float, round_to_multiple (maxtaps_t, 8));
+    float *sum = ALLOCA (float, nc);
+    const ImageSpec &srcspec (src.spec());
+    bool srclocal = src.localpixels() != NULL &&
+                    src.pixel_stride() == (stride_t)srcspec.pixel_bytes();
+    // For a blocked src layout, the right-hand neighbors of a pixel at
+    // the end of a block row are in the next block.
+    const int srcblockmask = std::max (0, src.local_tile_width() - 1);
+
+    ImageBuf::Iterator<DSTTYPE> out (dst, roi);
+    ImageBuf::ConstIterator<SRCTYPE> samp (src, wrap);
+    for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+        // Source position of the first pixel center on this scanline
+        float s0 = ((roi.xbegin+0.5f) * Minv[0][0] + (y+0.5f) * Minv[1][0]
+                    + Minv[2][0]) * winv;
+        float t0 = ((roi.xbegin+0.5f) * Minv[0][1] + (y+0.5f) * Minv[1][1]
+                    + Minv[2][1]) * winv;
+        if (bilinear) {
+            // Pixel centers are at integer+0.5, so shift by half a pixel
+            // to get the upper left of the 2x2 footprint and the weights.
+            simd::float4 stepi = simd::float4::Iota();
+            for (int x = roi.xbegin;  x < roi.xend;  x += 4) {
+                simd::float4 i4 = stepi + float(x - roi.xbegin);
+                simd::float4 s4 = simd::float4(s0 - 0.5f) + i4 * dsdx;
+                simd::float4 t4 = simd::float4(t0 - 0.5f) + i4 * dtdx;
+                simd::float4 sf = simd::floor (s4), tf = simd::floor (t4);
+                simd::int4 xi = simd::floori (s4), yi = simd::floori (t4);
+                simd::float4 fx = s4 - sf, fy = t4 - tf;
+                int n = std::min (4, roi.xend - x);
+                for (int k = 0;  k < n;  ++k, ++out) {
+                    int x0 = xi[k], y0 = yi[k];
+                    float w00 = (1.0f-fx[k]) * (1.0f-fy[k]);
+                    float w10 = fx[k] * (1.0f-fy[k]);
+                    float w01 = (1.0f-fx[k]) * fy[k];
+                    float w11 = fx[k] * fy[k];
+                    if (srclocal && x0 >= srcspec.x &&
+                          x0+1 < srcspec.x+srcspec.width &&
+                          y0 >= srcspec.y &&
+                          y0+1 < srcspec.y+srcspec.height) {
+                        const SRCTYPE *p00 = (const SRCTYPE *) src.pixeladdr (x0, y0);
+                        const SRCTYPE *p01 = (const SRCTYPE *) src.pixeladdr (x0, y0+1);
+                        const SRCTYPE *p10 = p00 + nc, *p11 = p01 + nc;
+                        if (srcblockmask &&
+                              ((x0 - srcspec.x) & srcblockmask) == srcblockmask) {
+                            p10 = (const SRCTYPE *) src.pixeladdr (x0+1, y0);
+                            p11 = (const SRCTYPE *) src.pixeladdr (x0+1, y0+1);
+                        }
+                        for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                            out[c] = w00 * convert_type<SRCTYPE,float>(p00[c])
+                                   + w10 * convert_type<SRCTYPE,float>(p10[c])
+                                   + w01 * convert_type<SRCTYPE,float>(p01[c])
+                                   + w11 * convert_type<SRCTYPE,float>(p11[c]);
+                    } else {
+                        samp.rerange (x0, x0+2, y0, y0+2, 0, 1, wrap);
+                        float w[4] = { w00, w10, w01, w11 };
+                        for (int c = 0;  c < nc;  ++c)
+                            sum[c] = 0.0f;
+                        for (int j = 0;  ! samp.done();  ++samp, ++j)
+                            for (int c = 0;  c < nc;  ++c)
+                                sum[c] += w[j] * samp[c];
+                        for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                            out[c] = sum[c];
+                    }
+                }
+            }
+            continue;
+        }
+
+        for (int x = roi.xbegin;  x < roi.xend;  ++x, ++out) {
+            float s = s0 + (x - roi.xbegin) * dsdx;
+            float t = t0 + (x - roi.xbegin) * dtdx;
+            int xbegin = (int)floorf(s-filterrad_s);
+            int xend = (int)ceilf(s+filterrad_s);
+            int ybegin = (int)floorf(t-filterrad_t);
+            int yend = (int)ceilf(t+filterrad_t);
+            for (int c = 0;  c < nc;  ++c)
+                sum[c] = 0.0f;
+            float total_w = 0.0f;
+            samp.rerange (xbegin, xend, ybegin, yend, 0, 1, wrap);
+            if (separable) {
+                ftab.fill (0, wx, xend-xbegin, xbegin+0.5f-s, ds_inv);
+                ftab.fill (1, wy, yend-ybegin, ybegin+0.5f-t, dt_inv);
+                for (int j = 0;  j < yend-ybegin;  ++j) {
+                    for (int i = 0;  i < xend-xbegin;  ++i, ++samp) {
+                        float w = wx[i] * wy[j];
+                        for (int c = 0;  c < nc;  ++c)
+                            sum[c] += w * samp[c];
+                        total_w += w;
+                    }
+                }
+            } else {
+                for ( ; ! samp.done(); ++samp) {
+                    float w = (*filter) (ds_inv*(samp.x()+0.5f-s),
+                                         dt_inv*(samp.y()+0.5f-t));
+                    for (int c = 0;  c < nc;  ++c)
+                        sum[c] += w * samp[c];
+                    total_w += w;
+                }
+            }
+            if (total_w != 0.0f)
+                for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                    out[c] = sum[c] / total_w;
+            else
+                for (int c = roi.chbegin;  c < roi.chend;  ++c)
+                    out[c] = 0.0f;
+        }
+    }
+}
+
+
+
 template<typename DSTTYPE, typename SRCTYPE>
 static bool
 warp_ (ImageBuf &dst, const ImageBuf &src, const Imath::M33f &M,
-       const Filter2D *filter, ImageBuf::WrapMode wrap,
-       ROI roi, int nthreads)
+       const Filter2D *filter, const FilterTables *ftab,
+       ImageBuf::WrapMode wrap, ROI roi, int nthreads)
 {
     if (nthreads != 1 && roi.npixels() >= 1000) {
         // Possible multiple thread case -- recurse via parallel_image
         ImageBufAlgo::parallel_image (
             OIIO::bind(warp_<DSTTYPE,SRCTYPE>,
                         OIIO::ref(dst), OIIO::cref(src), M,
-                        filter, wrap, _1 /*roi*/, 1 /*nthreads*/),
-            roi, nthreads);
+                        filter, ftab, wrap, _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads, ImageBufAlgo::Split_Tile, 16 /*pixelcost*/);
         return true;
     }
 
     // Serial case
+    Imath::M33f Minv = M.inverse();
+    if (Minv[0][2] == 0.0f && Minv[1][2] == 0.0f && Minv[2][2] != 0.0f) {
+        warp_affine_<DSTTYPE,SRCTYPE> (dst, src, Minv, filter, *ftab,
+                                       wrap, roi);
+        return true;
+    }
     int nc = dst.nchannels();
     float *pel = ALLOCA (float, nc);
     memset (pel, 0, nc*sizeof(float));
-    Imath::M33f Minv = M.inverse();
     ImageBuf::Iterator<DSTTYPE> out (dst, roi);
     for (  ;  ! out.done();  ++out) {
         Dual2 x (out.x()+0.5f, 1.0f, 0.0f);
@@ -649,7 +891,7 @@ warp_ (ImageBuf &dst, const ImageBuf &src, const Imath::M33f &M,
         robust_multVecMatrix (Minv, x, y, x, y);
         filtered_sample<SRCTYPE> (src, x.val(), y.val(),
                                   x.dx(), y.dx(), x.dy(), y.dy(),
-                                  filter, wrap, pel);
+                                  filter, *ftab, wrap, pel);
         for (int c = roi.chbegin;  c < roi.chend;  ++c)
             out[c] = pel[c];
  
@@ -690,10 +932,11 @@ ImageBufAlgo::warp (ImageBuf &dst, const ImageBuf &src,
         filter = filterptr.get();
     }
 
+    FilterTables ftab (filter);
     bool ok;
     OIIO_DISPATCH_COMMON_TYPES2 (ok, "warp", warp_,
                           dst.spec().format, src.spec().format,
-                          dst, src, M, filter, wrap, dst_roi, nthreads);
+                          dst, src, M, filter, &ftab, wrap, dst_roi, nthreads);
     return ok;
 }
 
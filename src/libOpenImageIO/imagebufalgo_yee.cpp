@@ -40,6 +40,7 @@
 using Imath::Color3f;
 
 #include "OpenImageIO/fmath.h"
+#include "OpenImageIO/simd.h"
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/imagebufalgo.h"
 #include "OpenImageIO/imagebufalgo_util.h"
@@ -67,13 +68,14 @@ namespace
 class GaussianPyramid
 {
 public:
-    GaussianPyramid (ImageBuf &image)
+    GaussianPyramid (ImageBuf &image, int nthreads=0)
     {
         level[0].swap (image);  // swallow the source as the top level
         ImageBuf kernel;
         ImageBufAlgo::make_kernel (kernel, "gaussian", 5, 5);
         for (int i = 1;  i < PYRAMID_MAX_LEVELS;  ++i)
-            ImageBufAlgo::convolve (level[i], level[i-1], kernel);
+            ImageBufAlgo::convolve (level[i], level[i-1], kernel, true,
+                                    ROI(), nthreads);
     }
 
     ~GaussianPyramid () { }
@@ -95,6 +97,16 @@ public:
         return level[lev].getchannel(x,y,0,1);
     }
 
+    /// The pixels of a level (which are all one-channel float images,
+    /// with their origin at 0).
+    const float *pixels (int lev) const {
+        DASSERT (lev < PYRAMID_MAX_LEVELS);
+        DASSERT (level[lev].localpixels() &&
+                 level[lev].spec().format == TypeDesc::FLOAT &&
+                 level[lev].nchannels() == 1);
+        return (const float *) level[lev].localpixels();
+    }
+
 private:
     ImageBuf level[PYRAMID_MAX_LEVELS];
 };
@@ -237,6 +249,124 @@ tvi (float adaptation_luminance)
 }
 
 
+
+// Everything the per-pixel test needs, shared by all the bands.  The
+// per-level quantities are kept in float8's, one level per lane; only the
+// first PYRAMID_MAX_LEVELS-2 lanes are used (the rest are zero).
+struct YeeParams {
+    const float *la[PYRAMID_MAX_LEVELS], *lb[PYRAMID_MAX_LEVELS];
+    const float *aLAB, *bLAB;
+    int width, height;
+    int adaptation_level;
+    bool luminanceOnly;
+    simd::float8 cpd, F_freq, lanes;
+};
+
+
+
+// Merge a later band's results into the total.  As with compare(), the
+// location of the worst failure is that of the first band to have it,
+// just as a serial pass would find it.
+struct YeeMerge {
+    void operator() (ImageBufAlgo::CompareResults &sum,
+                     const ImageBufAlgo::CompareResults &p) const {
+        if (p.maxerror > sum.maxerror) {
+            sum.maxerror = p.maxerror;
+            sum.maxx = p.maxx;
+            sum.maxy = p.maxy;
+        }
+        sum.nfail += p.nfail;
+    }
+};
+
+
+
+static void
+yee_band (const YeeParams &P, ROI roi, ImageBufAlgo::CompareResults &result)
+{
+    using simd::float8;
+    const float8 one (1.0f), tiny (1.0e-30f);
+    for (int y = roi.ybegin;  y < std::min (roi.yend, P.height);  ++y) {
+        for (int x = roi.xbegin;  x < roi.xend;  ++x) {
+            size_t p = size_t(y) * P.width + x;
+            // This pixel in every level, padded with zeroes so the lanes
+            // for levels i, i+1 and i+2 can be loaded as shifted vectors.
+            float va[PYRAMID_MAX_LEVELS+2], vb[PYRAMID_MAX_LEVELS+2];
+            for (int i = 0;  i < PYRAMID_MAX_LEVELS;  ++i) {
+                va[i] = P.la[i][p];
+                vb[i] = P.lb[i][p];
+            }
+            va[PYRAMID_MAX_LEVELS] = va[PYRAMID_MAX_LEVELS+1] = 0.0f;
+            vb[PYRAMID_MAX_LEVELS] = vb[PYRAMID_MAX_LEVELS+1] = 0.0f;
+
+            float8 numerator = max (abs (float8(va) - float8(va+1)),
+                                    abs (float8(vb) - float8(vb+1)));
+            float8 denominator = max (max (abs (float8(va+2)), abs (float8(vb+2))),
+                                      float8(1.0e-5f));
+            float8 contrast = (numerator / denominator) * P.lanes;
+            float sum_contrast = reduce_add (contrast);
+            if (sum_contrast < 1e-5)
+                sum_contrast = 1e-5f;
+
+            float adapt = va[P.adaptation_level] + vb[P.adaptation_level];
+            adapt *= 0.5f;
+            if (adapt < 1e-5)
+                adapt = 1e-5f;
+
+            // contrast_sensitivity (cpd[i], adapt) for all levels at once;
+            // its coefficients depend only on the adaptation luminance.
+            float a = 440.0f * powf ((1.0f + 0.7f / adapt), -0.2f);
+            float b = 0.3f * powf ((1.0f + 100.0f / adapt), 0.15f);
+            float8 bcpd = float8(b) * P.cpd;
+            float8 csf = float8(a) * P.cpd * exp (-bcpd)
+                       * sqrt (one + float8(0.06f) * exp (bcpd));
+
+            // mask (contrast[i] * csf[i]), with powf(x,y) as
+            // exp(y*log(x)) and the small integer powers multiplied out
+            float8 m = max (float8(392.498f) * contrast * csf, tiny);
+            float8 ma = exp (float8(0.7f) * log (m));
+            float8 mb = float8(0.0153f) * ma;
+            mb = (mb * mb) * (mb * mb);
+            float8 F_mask = sqrt (sqrt (one + mb));
+
+            float factor = reduce_add (contrast * P.F_freq * F_mask) / sum_contrast;
+            factor = Imath::clamp (factor, 1.0f, 10.0f);
+
+            float delta = fabsf (va[0] - vb[0]);
+            bool pass = true;
+            // pure luminance test
+            delta /= tvi(adapt);
+            if (delta > factor) {
+                pass = false;
+            } else if (! P.luminanceOnly) {
+                // CIE delta E test with modifications
+                float color_scale = 1.0f;
+                // ramp down the color test in scotopic regions
+                if (adapt < 10.0f) {
+                    color_scale = 1.0f - (10.0f - color_scale) / 10.0f;
+                    color_scale = color_scale * color_scale;
+                }
+                float da = P.aLAB[3*p+1] - P.bLAB[3*p+1];  // diff in A
+                float db = P.aLAB[3*p+2] - P.bLAB[3*p+2];  // diff in B
+                da = da * da;
+                db = db * db;
+                delta = (da + db) * color_scale;
+                if (delta > factor)
+                    pass = false;
+            }
+            if (!pass) {
+                ++result.nfail;
+                if (factor > result.maxerror) {
+                    result.maxerror = factor;
+                    result.maxx = x;
+                    result.maxy = y;
+                }
+            }
+        }
+    }
+}
+
+
 }
 
 
@@ -286,8 +416,8 @@ ImageBufAlgo::compare_Yee (const ImageBuf &img0, const ImageBuf &img1,
     // Construct Gaussian pyramids (not really pyramids, because they all
     // have the same resolution, but really just a bunch of successively
     // more blurred images).
-    GaussianPyramid la (aLum);
-    GaussianPyramid lb (bLum);
+    GaussianPyramid la (aLum, nthreads);
+    GaussianPyramid lb (bLum, nthreads);
 
     float num_one_degree_pixels = (float) (2 * tan(fov * 0.5 * M_PI / 180) * 180 / M_PI);
     float pixels_per_degree = roi.width() / num_one_degree_pixels;
@@ -308,66 +438,39 @@ ImageBufAlgo::compare_Yee (const ImageBuf &img0, const ImageBuf &img1,
     for (int i = 0; i < PYRAMID_MAX_LEVELS - 2;  ++i)
         F_freq[i] = csf_max / contrast_sensitivity (cpd[i], 100.0f);
 
-    for (int y = 0; y < nscanlines;  ++y) {
-        for (int x = 0;  x < roi.width();  ++x) {
-            float contrast[PYRAMID_MAX_LEVELS - 2];
-            float sum_contrast = 0;
-            for (int i = 0; i < PYRAMID_MAX_LEVELS - 2; i++) {
-                float n1 = fabsf (la.value(x,y,i) - la.value(x,y,i+1));
-                float n2 = fabsf (lb.value(x,y,i) - lb.value(x,y,i+1));
-                float numerator = std::max (n1, n2);
-                float d1 = fabsf (la.value(x,y,i+2));
-                float d2 = fabsf (lb.value(x,y,i+2));
-                float denominator = std::max (std::max (d1, d2), 1.0e-5f);
-                contrast[i] = numerator / denominator;
-                sum_contrast += contrast[i];
-            }
-            if (sum_contrast < 1e-5)
-                sum_contrast = 1e-5f;
-            float F_mask[PYRAMID_MAX_LEVELS - 2];
-            float adapt = la.value(x,y,adaptation_level) + lb.value(x,y,adaptation_level);
-            adapt *= 0.5f;
-            if (adapt < 1e-5)
-                adapt = 1e-5f;
-            for (int i = 0; i < PYRAMID_MAX_LEVELS - 2; i++)
-                F_mask[i] = mask(contrast[i] * contrast_sensitivity(cpd[i], adapt)); 
-            float factor = 0;
-            for (int i = 0; i < PYRAMID_MAX_LEVELS - 2; i++)
-                factor += contrast[i] * F_freq[i] * F_mask[i] / sum_contrast;
-            factor = Imath::clamp (factor, 1.0f, 10.0f);
-            float delta = fabsf (la.value(x,y,0) - lb.value(x,y,0));
-            bool pass = true;
-            // pure luminance test
-            delta /= tvi(adapt);
-            if (delta > factor) {
-                pass = false;
-            } else if (! luminanceOnly) {
-                // CIE delta E test with modifications
-                float color_scale = 1.0f;
-                // ramp down the color test in scotopic regions
-                if (adapt < 10.0f) {
-                    color_scale = 1.0f - (10.0f - color_scale) / 10.0f;
-                    color_scale = color_scale * color_scale;
-                }
-                float da = aLAB.getchannel(x,y,0,1) - bLAB.getchannel(x,y,0,1);  // diff in A
-                float db = aLAB.getchannel(x,y,0,2) - bLAB.getchannel(x,y,0,2);  // diff in B
-                da = da * da;
-                db = db * db;
-                delta = (da + db) * color_scale;
-                if (delta > factor)
-                    pass = false;
-            }
-            if (!pass) {
-                ++result.nfail;
-                if (factor > result.maxerror) {
-                    result.maxerror = factor;
-                    result.maxx = x;
-                    result.maxy = y;
-//                    result.maxz = z;
-                }
-            }
-        }
+    // Test every pixel, each thread taking a band of scanlines.
+    YeeParams P;
+    for (int i = 0;  i < PYRAMID_MAX_LEVELS;  ++i) {
+        P.la[i] = la.pixels (i);
+        P.lb[i] = lb.pixels (i);
+    }
+    P.aLAB = (const float *) aLAB.localpixels();
+    P.bLAB = (const float *) bLAB.localpixels();
+    P.width = roi.width();
+    P.height = roi.height();
+    P.adaptation_level = adaptation_level;
+    P.luminanceOnly = luminanceOnly;
+    float cpd8[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    float F_freq8[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    float lanes8[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    for (int i = 0;  i < PYRAMID_MAX_LEVELS - 2;  ++i) {
+        cpd8[i] = cpd[i];
+        F_freq8[i] = F_freq[i];
+        lanes8[i] = 1.0f;
     }
+    P.cpd.load (cpd8);
+    P.F_freq.load (F_freq8);
+    P.lanes.load (lanes8);
+
+    // nscanlines rows, in case the roi is a volume: the pyramid images
+    // only have the first roi.height() of them, and the rest (being
+    // black in both) can't fail.
+    ROI pixroi (0, roi.width(), 0, nscanlines);
+    CompareResults init = result;
+    ImageBufAlgo::parallel_reduce (
+        OIIO::bind (yee_band, OIIO::cref(P), _1, _2),
+        YeeMerge(), init, result, pixroi, nthreads, Split_Y,
+        32 /* pixel cost relative to compare */);
 
     return result.nfail;
 }
@@ -33,9 +33,19 @@
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
 #include <OpenImageIO/imagecache.h>
+#include <OpenImageIO/texture.h>
+#include <OpenImageIO/sysutil.h>
+#include <OpenImageIO/filesystem.h>
+#include <OpenImageIO/thread.h>
+#include <OpenImageIO/timer.h>
+#include <OpenImageIO/strutil.h>
 #include <OpenImageIO/unittest.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 OIIO_NAMESPACE_USING;
 
@@ -84,15 +94,929 @@ test_get_pixels_cachechannels (int chbegin = 0, int chend = 4,
 
 
 
+void
+test_prefetch_tiles ()
+{
+    std::cout << "\nTesting IC prefetch_tiles\n";
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+
+    // Create a tiled file with 4x4 tiles
+    ustring filename ("prefetch.tif");
+    ImageSpec spec (256, 256, 3, TypeDesc::FLOAT);
+    spec.tile_width = 64;
+    spec.tile_height = 64;
+    ImageBuf A (spec);
+    const float pixelvalue[3] = { 0.25f, 0.5f, 0.75f };
+    ImageBufAlgo::fill (A, pixelvalue);
+    A.write (filename);
+
+    // Prefetch the middle 2x2 tiles, then wait for the I/O threads
+    OIIO_CHECK_ASSERT (imagecache->prefetch_tiles (filename, 0, 0,
+                                                   ROI (64, 192, 64, 192)));
+    int tiles = 0;
+    for (int i = 0;  i < 1000 && tiles < 4;  ++i) {
+        Sysutil::usleep (1000);
+        imagecache->getattribute ("stat:tiles_created", tiles);
+    }
+    OIIO_CHECK_EQUAL (tiles, 4);
+
+    // Asking for those pixels now should not read any more tiles
+    float p[3] = { -1, -1, -1 };
+    OIIO_CHECK_ASSERT (imagecache->get_pixels (filename, 0, 0,
+                                               100, 101, 100, 101, 0, 1,
+                                               TypeDesc::FLOAT, p));
+    for (int c = 0; c < 3; ++c)
+        OIIO_CHECK_EQUAL (p[c], pixelvalue[c]);
+    imagecache->getattribute ("stat:tiles_created", tiles);
+    OIIO_CHECK_EQUAL (tiles, 4);
+
+    // Prefetching just some channels still brings in the all-channel
+    // tiles that lookups use
+    OIIO_CHECK_ASSERT (imagecache->prefetch_tiles (filename, 0, 0,
+                                                   ROI (0, 64, 0, 64, 0, 1, 0, 1)));
+    for (int i = 0;  i < 1000 && tiles < 5;  ++i) {
+        Sysutil::usleep (1000);
+        imagecache->getattribute ("stat:tiles_created", tiles);
+    }
+    OIIO_CHECK_EQUAL (tiles, 5);
+    OIIO_CHECK_ASSERT (imagecache->get_pixels (filename, 0, 0,
+                                               10, 11, 10, 11, 0, 1,
+                                               TypeDesc::FLOAT, p));
+    imagecache->getattribute ("stat:tiles_created", tiles);
+    OIIO_CHECK_EQUAL (tiles, 5);
+
+    // Nonexistent subimages are an error
+    OIIO_CHECK_ASSERT (! imagecache->prefetch_tiles (filename, 1, 0, ROI()));
+
+    ImageCache::destroy (imagecache);
+}
+
+
+
+struct ReadAllTiles {
+    ReadAllTiles (ImageCache *imagecache, ustring filename, int *failures)
+        : imagecache(imagecache), filename(filename), failures(failures) { }
+    void operator() () {
+        for (int y = 0;  y < 256;  y += 64) {
+            for (int x = 0;  x < 256;  x += 64) {
+                float p[3] = { -1, -1, -1 };
+                if (! imagecache->get_pixels (filename, 0, 0, x, x+1, y, y+1,
+                                              0, 1, TypeDesc::FLOAT, p)
+                      || p[0] != 0.25f || p[1] != 0.5f || p[2] != 0.75f)
+                    ++(*failures);
+            }
+        }
+    }
+    ImageCache *imagecache;
+    ustring filename;
+    int *failures;
+};
+
+
+
+void
+test_concurrent_inputs ()
+{
+    std::cout << "\nTesting IC max_inputs_per_file\n";
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    imagecache->attribute ("max_inputs_per_file", 4);
+    ustring filename ("prefetch.tif");  // written by test_prefetch_tiles
+
+    const int nthreads = 8;
+    int failures[nthreads] = { 0 };
+    thread_group threads;
+    for (int i = 0;  i < nthreads;  ++i)
+        threads.create_thread (ReadAllTiles (imagecache, filename,
+                                             &failures[i]));
+    threads.join_all ();
+    for (int i = 0;  i < nthreads;  ++i)
+        OIIO_CHECK_EQUAL (failures[i], 0);
+
+    ImageCache::destroy (imagecache);
+}
+
+
+
+void
+test_concurrent_reads ()
+{
+    std::cout << "\nTesting IC concurrent_reads\n";
+    // A tiled file with 4x4 tiles of the color ReadAllTiles expects
+    ustring filename ("concurrent.tif");
+    ImageSpec spec (256, 256, 3, TypeDesc::FLOAT);
+    spec.tile_width = 64;
+    spec.tile_height = 64;
+    ImageBuf A (spec);
+    const float pixelvalue[3] = { 0.25f, 0.5f, 0.75f };
+    ImageBufAlgo::fill (A, pixelvalue);
+    OIIO_CHECK_ASSERT (A.write (filename));
+    for (int concurrent = 0;  concurrent <= 1;  ++concurrent) {
+        ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+        imagecache->attribute ("concurrent_reads", concurrent);
+        const int nthreads = 8;
+        int failures[nthreads] = { 0 };
+        thread_group threads;
+        for (int i = 0;  i < nthreads;  ++i)
+            threads.create_thread (ReadAllTiles (imagecache, filename,
+                                                 &failures[i]));
+        threads.join_all ();
+        for (int i = 0;  i < nthreads;  ++i)
+            OIIO_CHECK_EQUAL (failures[i], 0);
+
+        // All 16 tiles bypass the file lock if, and only if, it's enabled
+        long long reads = -1;
+        imagecache->getattribute ("stat:concurrent_tile_reads",
+                                  TypeDesc::INT64, &reads);
+        OIIO_CHECK_EQUAL (reads, concurrent ? 16 : 0);
+        ImageCache::destroy (imagecache);
+    }
+    Filesystem::remove (filename.string());
+}
+
+
+
+void
+test_coalesce_tiles ()
+{
+    std::cout << "\nTesting IC coalesce_tiles\n";
+    ustring filename ("prefetch.tif");  // written by test_prefetch_tiles
+    for (int coalesce = 1;  coalesce <= 8;  coalesce *= 8) {
+        ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+        imagecache->attribute ("coalesce_tiles", coalesce);
+        imagecache->attribute ("concurrent_reads", 0);
+        imagecache->attribute ("mmap_tiles", 0);
+        imagecache->attribute ("io_threads", 1);
+        // Prefetch the top row of 4 tiles: the first read picks up the
+        // three queued behind it.
+        OIIO_CHECK_ASSERT (imagecache->prefetch_tiles (filename, 0, 0,
+                                                       ROI (0, 256, 0, 64)));
+        int tiles = 0;
+        for (int i = 0;  i < 1000 && tiles < 4;  ++i) {
+            Sysutil::usleep (1000);
+            imagecache->getattribute ("stat:tiles_created", tiles);
+        }
+        OIIO_CHECK_EQUAL (tiles, 4);
+        long long coalesced = -1;
+        imagecache->getattribute ("stat:tiles_coalesced", TypeDesc::INT64,
+                                  &coalesced);
+        OIIO_CHECK_EQUAL (coalesced, coalesce > 1 ? 3 : 0);
+        int failures = 0;
+        ReadAllTiles (imagecache, filename, &failures) ();
+        OIIO_CHECK_EQUAL (failures, 0);
+        ImageCache::destroy (imagecache);
+    }
+}
+
+
+
+void
+test_eviction_policy ()
+{
+    std::cout << "\nTesting IC eviction_policy\n";
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    std::string policy;
+    OIIO_CHECK_ASSERT (imagecache->getattribute ("eviction_policy", policy));
+    OIIO_CHECK_EQUAL (policy, "clock");
+    OIIO_CHECK_ASSERT (imagecache->attribute ("eviction_policy", "frequency"));
+    imagecache->getattribute ("eviction_policy", policy);
+    OIIO_CHECK_EQUAL (policy, "frequency");
+    OIIO_CHECK_ASSERT (! imagecache->attribute ("eviction_policy", "bogus"));
+
+    // Read every tile of the file with a tiny cache, so that tiles get
+    // evicted under the frequency policy.
+    imagecache->attribute ("max_memory_MB", 1.0f);
+    int failures = 0;
+    ReadAllTiles (imagecache, ustring("prefetch.tif"), &failures) ();
+    OIIO_CHECK_EQUAL (failures, 0);
+
+    ImageCache::destroy (imagecache);
+}
+
+
+
+void
+test_microcache_size ()
+{
+    std::cout << "\nTesting IC microcache_size\n";
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    int size = 0;
+    OIIO_CHECK_ASSERT (imagecache->getattribute ("microcache_size", size));
+    OIIO_CHECK_EQUAL (size, 16);
+
+    // Read every tile through the smallest and a large microcache.
+    int sizes[] = { 1, 64 };
+    for (int i = 0;  i < 2;  ++i) {
+        imagecache->attribute ("microcache_size", sizes[i]);
+        imagecache->getattribute ("microcache_size", size);
+        OIIO_CHECK_EQUAL (size, sizes[i]);
+        int failures = 0;
+        ReadAllTiles (imagecache, ustring("prefetch.tif"), &failures) ();
+        ReadAllTiles (imagecache, ustring("prefetch.tif"), &failures) ();
+        OIIO_CHECK_EQUAL (failures, 0);
+    }
+
+    ImageCache::destroy (imagecache);
+}
+
+
+
+void
+test_texture_profile ()
+{
+    std::cout << "\nTesting IC texture_profile\n";
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    imagecache->attribute ("texture_profile", 1);
+    ustring filename ("prefetch.tif");
+    int failures = 0;
+    ReadAllTiles (imagecache, filename, &failures) ();
+    OIIO_CHECK_EQUAL (failures, 0);
+
+    // Reading the tiles charges tile time, but no filtered lookups.
+    long long lookups = -1, decode_ns = -1;
+    OIIO_CHECK_ASSERT (imagecache->get_image_info (filename, 0, 0,
+                       ustring("stat:lookups"), TypeDesc::INT64, &lookups));
+    OIIO_CHECK_EQUAL (lookups, 0);
+    OIIO_CHECK_ASSERT (imagecache->get_image_info (filename, 0, 0,
+                       ustring("stat:decode_ns"), TypeDesc::INT64, &decode_ns));
+    OIIO_CHECK_ASSERT (decode_ns >= 0);
+    std::string json;
+    OIIO_CHECK_ASSERT (imagecache->getattribute ("stat:texture_profile", json));
+    OIIO_CHECK_ASSERT (Strutil::starts_with (json, "{ \"files\" : ["));
+
+    ImageCache::destroy (imagecache);
+}
+
+
+
+void
+test_texture_get_mip_level ()
+{
+    std::cout << "\nTesting TS get_texels and get_mip_level\n";
+    TextureSystem *texsys = TextureSystem::create (false /*not shared*/);
+    ustring filename ("prefetch.tif");  // written by test_prefetch_tiles
+    const float pixelvalue[3] = { 0.25f, 0.5f, 0.75f };
+
+    // A whole level, asking for one more channel than the file has
+    std::vector<float> level (256*256*4, -1.0f);
+    OIIO_CHECK_ASSERT (texsys->get_mip_level (filename, 0, 0, 0, 4,
+                                              TypeDesc::FLOAT, &level[0]));
+    int bad = 0;
+    for (size_t p = 0;  p < 256*256;  ++p)
+        for (int c = 0;  c < 4;  ++c)
+            bad += (level[p*4+c] != (c < 3 ? pixelvalue[c] : 0.0f));
+    OIIO_CHECK_EQUAL (bad, 0);
+
+    // get_texels of a region straddling the data window: the missing
+    // channel gets the fill only inside the window, all else is 0.
+    TextureOpt options;
+    options.fill = 1.0f;
+    unsigned char texels[2*4*3];   // y 254..255, x 254..257, chans 1..3
+    memset (texels, 0xff, sizeof(texels));
+    OIIO_CHECK_ASSERT (texsys->get_texels (filename, options, 0,
+                                           254, 258, 254, 256, 0, 1, 1, 4,
+                                           TypeDesc::UINT8, texels));
+    const unsigned char *t = texels;
+    OIIO_CHECK_EQUAL ((int)t[0], 128);   // channel 1 of (254,254)
+    OIIO_CHECK_EQUAL ((int)t[1], 191);   // channel 2
+    OIIO_CHECK_EQUAL ((int)t[2], 255);   // fill
+    OIIO_CHECK_EQUAL ((int)t[3*3+2], 0); // (257,254) is outside the window
+    OIIO_CHECK_EQUAL ((int)t[3*3+0], 0);
+
+    // Nonexistent levels are an error
+    OIIO_CHECK_ASSERT (! texsys->get_mip_level (filename, 0, 1, 0, 3,
+                                                TypeDesc::FLOAT, &level[0]));
+    texsys->geterror ();
+
+    TextureSystem::destroy (texsys);
+}
+
+
+
+void
+test_texture_pointsample ()
+{
+    std::cout << "\nTesting TS point sampled lookups\n";
+    TextureSystem *texsys = TextureSystem::create (false /*not shared*/);
+    // A 1-channel "ID map" whose texel (x,y) holds x + 64*y
+    ustring filename ("pointsample.tif");
+    ImageSpec spec (64, 64, 1, TypeDesc::FLOAT);
+    spec.tile_width = 16;
+    spec.tile_height = 16;
+    ImageBuf A (spec);
+    for (ImageBuf::Iterator<float> it (A);  ! it.done();  ++it)
+        it[0] = float (it.x() + 64 * it.y());
+    A.write (filename);
+
+    const int w = TextureSystem::BatchWidth;
+    float s[w], t[w], zero[w], expected[w];
+    for (int i = 0;  i < w;  ++i) {
+        int x = (i * 37) % 64, y = (i * 11 + 5) % 64;
+        s[i] = (x + 0.3f) / 64.0f;
+        t[i] = (y + 0.6f) / 64.0f;
+        zero[i] = 0.0f;
+        expected[i] = float (x + 64 * y);
+    }
+
+    // Explicit point samples ignore the derivatives; the second channel
+    // gets the fill.
+    TextureOpt options;
+    options.pointsample = true;
+    options.fill = 0.5f;
+    int bad = 0;
+    for (int i = 0;  i < w;  ++i) {
+        float r[2] = { -1, -1 }, drds[2] = { -1, -1 }, drdt[2] = { -1, -1 };
+        OIIO_CHECK_ASSERT (texsys->texture (filename, options, s[i], t[i],
+                                            0.1f, 0, 0, 0.1f, 2, r,
+                                            drds, drdt));
+        bad += (r[0] != expected[i] || r[1] != 0.5f || drds[0] != 0.0f
+                || drdt[0] != 0.0f);
+    }
+    OIIO_CHECK_EQUAL (bad, 0);
+
+    // Zero-width closest lookups, one at a time and batched
+    TextureOpt closest;
+    closest.interpmode = TextureOpt::InterpClosest;
+    float batch[w];
+    bad = 0;
+    for (int i = 0;  i < w;  ++i) {
+        float r = -1;
+        OIIO_CHECK_ASSERT (texsys->texture (filename, closest, s[i], t[i],
+                                            0, 0, 0, 0, 1, &r));
+        bad += (r != expected[i]);
+    }
+    OIIO_CHECK_ASSERT (texsys->texture_batch (filename, closest, 0xffff,
+                                              s, t, zero, zero, zero, zero,
+                                              1, batch));
+    for (int i = 0;  i < w;  ++i)
+        bad += (batch[i] != expected[i]);
+    OIIO_CHECK_EQUAL (bad, 0);
+
+    std::string stats = texsys->getstats (1, false);
+    OIIO_CHECK_ASSERT (stats.find ("point samples") != std::string::npos);
+    TextureSystem::destroy (texsys);
+}
+
+
+
+// A procedural 128x128 3-channel image whose pixel (x,y) has values
+// (x, y, subimage).
+class TestTileProvider : public ImageCache::TileProvider {
+public:
+    TestTileProvider () : m_fills(0) { }
+    virtual bool get_spec (int subimage, int miplevel, ImageSpec &spec) {
+        if (subimage != 0 || miplevel != 0)
+            return false;
+        spec = ImageSpec (128, 128, 3, TypeDesc::FLOAT);
+        spec.tile_width = 32;
+        spec.tile_height = 32;
+        return true;
+    }
+    virtual bool fill_tile (int subimage, int miplevel, int x, int y, int z,
+                            int chbegin, int chend, TypeDesc format,
+                            void *data) {
+        if (format != TypeDesc::FLOAT)
+            return false;
+        float *p = (float *)data;
+        for (int j = 0;  j < 32;  ++j)
+            for (int i = 0;  i < 32;  ++i)
+                for (int c = chbegin;  c < chend;  ++c)
+                    *p++ = c == 0 ? float(x+i) : (c == 1 ? float(y+j) : 0.0f);
+        ++m_fills;
+        return true;
+    }
+    atomic_int m_fills;
+};
+
+
+
+void
+test_procedural_tiles ()
+{
+    std::cout << "\nTesting IC procedural tiles\n";
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    TestTileProvider provider;
+    ustring filename ("procedural-test");
+    OIIO_CHECK_ASSERT (imagecache->add_procedural_file (filename, &provider));
+    ImageSpec spec;
+    OIIO_CHECK_ASSERT (imagecache->get_imagespec (filename, spec));
+    OIIO_CHECK_EQUAL (spec.width, 128);
+    OIIO_CHECK_EQUAL (spec.tile_width, 32);
+
+    // A 2x2 tile region generates exactly those tiles, once
+    std::vector<float> pixels (64*64*3);
+    OIIO_CHECK_ASSERT (imagecache->get_pixels (filename, 0, 0, 32, 96, 32, 96,
+                                               0, 1, TypeDesc::FLOAT,
+                                               &pixels[0]));
+    OIIO_CHECK_EQUAL (pixels[0], 32.0f);
+    OIIO_CHECK_EQUAL (pixels[1], 32.0f);
+    OIIO_CHECK_EQUAL (pixels[(63*64+63)*3+0], 95.0f);
+    OIIO_CHECK_EQUAL (pixels[(63*64+63)*3+1], 95.0f);
+    OIIO_CHECK_ASSERT (imagecache->get_pixels (filename, 0, 0, 40, 41, 40, 41,
+                                               0, 1, TypeDesc::FLOAT,
+                                               &pixels[0]));
+    OIIO_CHECK_EQUAL (provider.m_fills, 4);
+    long long generated = 0;
+    imagecache->getattribute ("stat:procedural_tiles", TypeDesc::INT64,
+                              &generated);
+    OIIO_CHECK_EQUAL (generated, 4);
+
+    // Subimages the provider doesn't have are an error
+    OIIO_CHECK_ASSERT (! imagecache->get_pixels (filename, 1, 0, 0, 1, 0, 1,
+                                                 0, 1, TypeDesc::FLOAT,
+                                                 &pixels[0]));
+    imagecache->geterror ();
+    ImageCache::destroy (imagecache);
+}
+
+
+
+void
+test_metrics ()
+{
+    std::cout << "\nTesting IC metrics\n";
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    TestTileProvider provider;
+    ustring filename ("metrics-test");
+    OIIO_CHECK_ASSERT (imagecache->add_procedural_file (filename, &provider));
+    imagecache->set_file_priority (filename, 1);
+    std::vector<float> pixels (64*64*3);
+    OIIO_CHECK_ASSERT (imagecache->get_pixels (filename, 0, 0, 32, 96, 32, 96,
+                                               0, 1, TypeDesc::FLOAT,
+                                               &pixels[0]));
+
+    ImageCache::Metrics metrics;
+    imagecache->get_metrics (metrics);
+    OIIO_CHECK_EQUAL (metrics.tile_misses, 4);
+    OIIO_CHECK_ASSERT (metrics.tile_lookups >= metrics.tile_misses);
+    OIIO_CHECK_EQUAL (metrics.miss_latency.count, 4);
+    OIIO_CHECK_ASSERT (metrics.miss_latency.percentile (0.5)
+                       <= metrics.miss_latency.max);
+    OIIO_CHECK_EQUAL (metrics.tiles, 4);
+    OIIO_CHECK_EQUAL (metrics.files, 1);
+    OIIO_CHECK_EQUAL (metrics.memory_by_priority.size(), size_t(5));
+    OIIO_CHECK_EQUAL (metrics.memory_by_priority[3], metrics.memory_used);
+    OIIO_CHECK_ASSERT (metrics.memory_used > 0);
+
+    std::string prom = ImageCache::format_metrics (metrics);
+    OIIO_CHECK_ASSERT (Strutil::contains (prom, "oiio_imagecache_tile_misses_total 4\n"));
+    OIIO_CHECK_ASSERT (Strutil::contains (prom, "oiio_imagecache_tile_miss_seconds_bucket{le=\"+Inf\"} 4\n"));
+    OIIO_CHECK_ASSERT (Strutil::contains (prom, "oiio_imagecache_memory_priority_bytes{priority=\"1\"}"));
+    std::string statsd = ImageCache::format_metrics (metrics, "statsd", "ic");
+    OIIO_CHECK_ASSERT (Strutil::contains (statsd, "ic.tile_misses:4|g\n"));
+    OIIO_CHECK_ASSERT (Strutil::contains (statsd, "ic.tile_miss_seconds.p99:"));
+    OIIO_CHECK_ASSERT (ImageCache::format_metrics (metrics, "bogus").empty());
+    OIIO_CHECK_ASSERT (Strutil::contains (OIIO::geterror(), "bogus"));
+
+    // reset_stats starts the counts and latencies over
+    imagecache->reset_stats ();
+    imagecache->get_metrics (metrics);
+    OIIO_CHECK_EQUAL (metrics.tile_misses, 0);
+    OIIO_CHECK_EQUAL (metrics.miss_latency.count, 0);
+    OIIO_CHECK_EQUAL (metrics.tiles, 4);
+    ImageCache::destroy (imagecache);
+}
+
+
+
+void
+test_shared_metadata ()
+{
+    std::cout << "\nTesting IC metadata shared between MIP levels\n";
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    imagecache->attribute ("automip", 1);
+    ustring filename ("metadata.tif");
+    ImageSpec spec (64, 64, 3, TypeDesc::UINT8);
+    spec.tile_width = 16;
+    spec.tile_height = 16;
+    spec.attribute ("ImageDescription", "shared by every level");
+    ImageBuf A (spec);
+    A.write (filename);
+
+    // Every level, native or not, still reports the top level's metadata
+    const ImageSpec *s2 = imagecache->imagespec (filename, 0, 2);
+    OIIO_CHECK_ASSERT (s2 != NULL);
+    if (s2) {
+        OIIO_CHECK_EQUAL (s2->width, 16);
+        OIIO_CHECK_EQUAL (s2->get_string_attribute ("ImageDescription"),
+                          "shared by every level");
+        OIIO_CHECK_EQUAL (s2->channelnames.size(), 3);
+    }
+    ImageSpec s1;
+    OIIO_CHECK_ASSERT (imagecache->get_imagespec (filename, s1, 0, 1, true));
+    OIIO_CHECK_EQUAL (s1.width, 32);
+    OIIO_CHECK_EQUAL (s1.get_string_attribute ("ImageDescription"),
+                      "shared by every level");
+    ustring desc;
+    OIIO_CHECK_ASSERT (imagecache->get_image_info (filename, 0, 3,
+                       ustring("ImageDescription"), TypeDesc::TypeString, &desc));
+    OIIO_CHECK_EQUAL (desc, "shared by every level");
+
+    std::string stats = imagecache->getstats (1);
+    OIIO_CHECK_ASSERT (stats.find ("saved by sharing it between MIP levels")
+                       != std::string::npos);
+
+    ImageCache::destroy (imagecache);
+}
+
+
+
+void
+test_lock_stats ()
+{
+    std::cout << "\nTesting IC lock_stats\n";
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    std::string stats = imagecache->getstats (3);
+    OIIO_CHECK_ASSERT (stats.find ("set the \"lock_stats\" attribute")
+                       != std::string::npos);
+
+    imagecache->attribute ("lock_stats", 1);
+    const int nthreads = 8;
+    int failures[nthreads] = { 0 };
+    thread_group threads;
+    for (int i = 0;  i < nthreads;  ++i)
+        threads.create_thread (ReadAllTiles (imagecache, ustring("prefetch.tif"),
+                                             &failures[i]));
+    threads.join_all ();
+    for (int i = 0;  i < nthreads;  ++i)
+        OIIO_CHECK_EQUAL (failures[i], 0);
+
+    // How much contention there was depends on the timing, but every
+    // lock site gets its line.
+    std::string contention;
+    OIIO_CHECK_ASSERT (imagecache->getattribute ("stat:lock_contention",
+                                                 contention));
+    OIIO_CHECK_ASSERT (contention.find ("file input mutexes") != std::string::npos);
+    OIIO_CHECK_ASSERT (contention.find ("tile cache bins") != std::string::npos);
+    OIIO_CHECK_ASSERT (contention.find ("ustring table inserts") != std::string::npos);
+    stats = imagecache->getstats (3);
+    OIIO_CHECK_ASSERT (stats.find (contention) != std::string::npos);
+
+    ImageCache::destroy (imagecache);
+}
+
+
+
+void
+test_trace ()
+{
+    std::cout << "\nTesting IC trace\n";
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    imagecache->attribute ("trace", 1);
+    imagecache->attribute ("trace_file", "trace.json");
+    int failures = 0;
+    ReadAllTiles (imagecache, ustring("prefetch.tif"), &failures) ();
+    OIIO_CHECK_EQUAL (failures, 0);
+
+    std::string json;
+    OIIO_CHECK_ASSERT (imagecache->getattribute ("stat:trace", json));
+    OIIO_CHECK_ASSERT (Strutil::starts_with (json, "{ \"displayTimeUnit\""));
+    OIIO_CHECK_ASSERT (json.find ("\"name\" : \"file open\"") != std::string::npos);
+    OIIO_CHECK_ASSERT (json.find ("\"name\" : \"tile miss\"") != std::string::npos);
+    OIIO_CHECK_ASSERT (json.find ("\"file\" : \"prefetch.tif\"") != std::string::npos);
+
+    // Turning tracing off writes the trace file
+    Filesystem::remove ("trace.json");
+    imagecache->attribute ("trace", 0);
+    OIIO_CHECK_ASSERT (Filesystem::exists ("trace.json"));
+    OIIO_CHECK_EQUAL (Filesystem::file_size ("trace.json"), json.size());
+
+    // A buffer of two events keeps just the latest two
+    imagecache->attribute ("trace_events", 2);
+    imagecache->attribute ("trace_file", "");
+    imagecache->attribute ("trace", 1);
+    imagecache->invalidate_all (true);
+    ReadAllTiles (imagecache, ustring("prefetch.tif"), &failures) ();
+    imagecache->getattribute ("stat:trace", json);
+    size_t events = 0;
+    for (size_t p = json.find ("\"ph\"");  p != std::string::npos;
+         p = json.find ("\"ph\"", p+1))
+        ++events;
+    OIIO_CHECK_EQUAL (events, 2);
+
+    ImageCache::destroy (imagecache);
+}
+
+
+
+void
+test_parallel_get_pixels ()
+{
+    std::cout << "\nTesting IC parallel get_pixels and get_tiles\n";
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    imagecache->attribute ("get_pixels_parallel", 2);
+    ustring filename ("prefetch.tif");  // written by test_prefetch_tiles
+
+    // A region hanging over every edge of the image: the bands covering
+    // the first and last tile rows also fill the rows outside with 0.
+    const int xb = -8, xe = 264, yb = -8, ye = 264;
+    const int w = xe - xb, h = ye - yb;
+    std::vector<float> pixels (w*h*3, -1.0f);
+    OIIO_CHECK_ASSERT (imagecache->get_pixels (filename, 0, 0, xb, xe, yb, ye,
+                                               0, 1, TypeDesc::FLOAT,
+                                               &pixels[0]));
+    const float pixelvalue[3] = { 0.25f, 0.5f, 0.75f };
+    int wrong = 0;
+    for (int y = yb;  y < ye;  ++y)
+        for (int x = xb;  x < xe;  ++x) {
+            bool inside = (x >= 0 && x < 256 && y >= 0 && y < 256);
+            const float *p = &pixels[((y-yb)*w + (x-xb)) * 3];
+            for (int c = 0;  c < 3;  ++c)
+                wrong += (p[c] != (inside ? pixelvalue[c] : 0.0f));
+        }
+    OIIO_CHECK_EQUAL (wrong, 0);
+
+    // Zero-copy: the 3x2 tiles overlapping the region, in row order
+    std::vector<ImageCache::Tile *> tiles;
+    OIIO_CHECK_ASSERT (imagecache->get_tiles (filename, 0, 0,
+                                              ROI (10, 150, 70, 130), tiles));
+    OIIO_CHECK_EQUAL (tiles.size(), 6);
+    for (size_t i = 0;  i < tiles.size();  ++i) {
+        ROI r = imagecache->tile_roi (tiles[i]);
+        OIIO_CHECK_EQUAL (r.xbegin, int(i%3) * 64);
+        OIIO_CHECK_EQUAL (r.ybegin, 64 + int(i/3) * 64);
+        TypeDesc format;
+        const float *p = (const float *) imagecache->tile_pixels (tiles[i],
+                                                                  format);
+        OIIO_CHECK_EQUAL (format, TypeDesc::FLOAT);
+        OIIO_CHECK_EQUAL (p[2], pixelvalue[2]);
+        imagecache->release_tile (tiles[i]);
+    }
+
+    // A missing MIP level fails and leaves no tiles
+    OIIO_CHECK_ASSERT (! imagecache->get_tiles (filename, 0, 1, ROI(), tiles));
+    OIIO_CHECK_ASSERT (tiles.empty());
+
+    ImageCache::destroy (imagecache);
+}
+
+
+
+void
+test_untiled_bands ()
+{
+    std::cout << "\nTesting IC untiled scanline bands\n";
+    // A 24 MB scanline file, more than the cache will hold
+    ustring filename ("untiled.tif");
+    ImageSpec spec (2048, 1024, 3, TypeDesc::FLOAT);
+    ImageBuf A (spec);
+    const float pixelvalue[3] = { 0.25f, 0.5f, 0.75f };
+    ImageBufAlgo::fill (A, pixelvalue);
+    A.write (filename);
+
+    // Big enough untiled images are autotiled even without "autotile"
+    ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+    imagecache->attribute ("autotile_large_MB", 16);
+    const ImageSpec *ispec = imagecache->imagespec (filename);
+    OIIO_CHECK_ASSERT (ispec && ispec->tile_width == 64);
+    imagecache->attribute ("autotile_large_MB", 0);
+    ispec = imagecache->imagespec (filename);
+    OIIO_CHECK_ASSERT (ispec && ispec->tile_width == 2048);
+
+    // Read every tile row, so that many tiles are evicted, then go back
+    // over the first rows: the missing tiles come from kept scanlines.
+    imagecache->attribute ("autotile", 64);
+    imagecache->attribute ("max_memory_MB", 10.0f);
+    imagecache->attribute ("untiled_band_memory_MB", 32);
+    float p[3];
+    for (int y = 0;  y < 1024;  y += 64)
+        imagecache->get_pixels (filename, 0, 0, 0, 1, y, y+1, 0, 1,
+                                TypeDesc::FLOAT, p);
+    long long bytes_read = 0, hits = 0;
+    imagecache->getattribute ("stat:bytes_read", TypeDesc::INT64, &bytes_read);
+    int wrong = 0;
+    for (int y = 0;  y < 256;  y += 64)
+        for (int x = 0;  x < 2048;  x += 64)
+            if (! imagecache->get_pixels (filename, 0, 0, x, x+1, y, y+1,
+                                          0, 1, TypeDesc::FLOAT, p)
+                  || p[1] != pixelvalue[1])
+                ++wrong;
+    OIIO_CHECK_EQUAL (wrong, 0);
+    imagecache->getattribute ("stat:untiled_band_hits", TypeDesc::INT64, &hits);
+    OIIO_CHECK_ASSERT (hits > 0);
+    long long bytes_read_after = 0;
+    imagecache->getattribute ("stat:bytes_read", TypeDesc::INT64,
+                              &bytes_read_after);
+    OIIO_CHECK_EQUAL (bytes_read_after, bytes_read);
+
+    ImageCache::destroy (imagecache);
+    Filesystem::remove (filename.string());
+}
+
+
+
+void
+test_automip_async ()
+{
+    std::cout << "\nTesting IC automip_async\n";
+    // An un-MIPmapped tiled file with varying pixels
+    ustring filename ("automip.tif");
+    ImageSpec spec (128, 128, 3, TypeDesc::FLOAT);
+    spec.tile_width = 32;
+    spec.tile_height = 32;
+    ImageBuf A (spec);
+    const float topleft[3] = { 0, 0, 0 }, topright[3] = { 1, 0, 0 };
+    const float bottomleft[3] = { 0, 1, 0 }, bottomright[3] = { 1, 1, 1 };
+    ImageBufAlgo::fill (A, topleft, topright, bottomleft, bottomright);
+    A.write (filename);
+
+    // Levels made in the background match those made tile by tile
+    ImageCache *ondemand = ImageCache::create (false /*not shared*/);
+    ImageCache *async = ImageCache::create (false /*not shared*/);
+    ondemand->attribute ("automip", 1);
+    async->attribute ("automip", 1);
+    async->attribute ("automip_async", 1);
+    int nlevels = 0;
+    for (int m = 1;  m < 8;  ++m) {
+        int w = 128 >> m;
+        std::vector<float> a (w*w*3, -1.0f), b (w*w*3, -2.0f);
+        if (! ondemand->get_pixels (filename, 0, m, 0, w, 0, w, 0, 1,
+                                    TypeDesc::FLOAT, &a[0]))
+            break;
+        OIIO_CHECK_ASSERT (async->get_pixels (filename, 0, m, 0, w, 0, w, 0, 1,
+                                              TypeDesc::FLOAT, &b[0]));
+        OIIO_CHECK_ASSERT (a == b);
+        ++nlevels;
+    }
+    OIIO_CHECK_EQUAL (nlevels, 7);
+    OIIO_CHECK_ASSERT (async->getstats (2).find ("MIP levels made in the background")
+                       != std::string::npos);
+
+    ImageCache::destroy (ondemand);
+    ImageCache::destroy (async);
+    Filesystem::remove (filename.string());
+}
+
+
+
+// Look up one pixel of every tile of every file, starting at a different
+// place for each thread, over and over.
+struct ScalingWorker {
+    ScalingWorker (ImageCache *imagecache, const std::vector<ustring> &files,
+                   int res, int tile, int passes, int start)
+        : imagecache(imagecache), files(&files), res(res), tile(tile),
+          passes(passes), start(start) { }
+    void operator() () {
+        int ntx = res / tile, ntiles = ntx * ntx;
+        int nf = (int) files->size();
+        for (int pass = 0;  pass < passes;  ++pass) {
+            for (int i = 0;  i < nf * ntiles;  ++i) {
+                int t = (i + start) % (nf * ntiles);
+                int x = (t % ntiles % ntx) * tile, y = (t % ntiles / ntx) * tile;
+                unsigned char p[4];
+                imagecache->get_pixels ((*files)[t / ntiles], 0, 0,
+                                        x, x+1, y, y+1, 0, 1,
+                                        TypeDesc::UINT8, p);
+            }
+        }
+    }
+    ImageCache *imagecache;
+    const std::vector<ustring> *files;
+    int res, tile, passes, start;
+};
+
+
+
+// Not part of the unit tests: "imagecache_test --scaling [maxthreads]"
+// sweeps the number of threads reading tiles through a cache too small
+// to hold them, from files that don't all fit in the open file limit,
+// and reports the speedup along with the contention of each lock, so
+// that a scaling limit can be traced to the lock that causes it.
+void
+scaling_sweep (int maxthreads)
+{
+    const int nfiles = 4, res = 2048, tile = 64, passes = 2;
+    std::vector<ustring> files;
+    for (int f = 0;  f < nfiles;  ++f) {
+        files.push_back (ustring::format ("scaling%d.tif", f));
+        ImageSpec spec (res, res, 4, TypeDesc::UINT8);
+        spec.tile_width = tile;
+        spec.tile_height = tile;
+        ImageBuf A (spec);
+        const float value[4] = { 0.25f, 0.5f, 0.75f, 1.0f };
+        ImageBufAlgo::fill (A, value);
+        A.write (files.back());
+    }
+    std::cout << "Sweeping threads reading " << nfiles << " "
+              << res << "x" << res << " files, " << passes << " passes each\n";
+
+    double onethread = 0;
+    for (int nthreads = 1;  nthreads <= maxthreads;  nthreads *= 2) {
+        ImageCache *imagecache = ImageCache::create (false /*not shared*/);
+        imagecache->attribute ("max_memory_MB", 16.0f);
+        imagecache->attribute ("max_open_files", nfiles / 2);
+        imagecache->attribute ("lock_stats", 1);
+        Timer timer;
+        thread_group threads;
+        int ntiles = nfiles * (res/tile) * (res/tile);
+        for (int i = 0;  i < nthreads;  ++i)
+            threads.create_thread (ScalingWorker (imagecache, files, res, tile,
+                                                  passes, i * ntiles / nthreads));
+        threads.join_all ();
+        double t = timer();
+        if (nthreads == 1)
+            onethread = t;
+        double lookups = double(nthreads) * passes * ntiles;
+        std::cout << Strutil::format ("\n%2d threads: %7.3fs  %5.2fx speedup"
+                                      "  %.2f Mlookups/s\n", nthreads, t,
+                                      onethread / t, lookups / t * 1.0e-6);
+        std::string contention;
+        imagecache->getattribute ("stat:lock_contention", contention);
+        std::cout << contention;
+        ImageCache::destroy (imagecache);
+    }
+}
+
+
+
+// A nonblocking lookup whose level isn't resident yet is answered from a
+// coarser level that is, and says so through TextureOpt::approximate and
+// the "stat:approximate_lookups" count.
+void
+test_texture_nonblocking ()
+{
+    std::cout << "\nTesting TS nonblocking lookups\n";
+    // A MIP-mapped file whose level m is filled with the value m+1
+    ustring filename ("nonblocking.tif");
+    ImageOutput *out = ImageOutput::create (filename.string());
+    OIIO_CHECK_ASSERT (out && out->supports ("mipmap"));
+    if (! out)
+        return;
+    int nlevels = 0;
+    for (int res = 64;  res >= 1;  res /= 2, ++nlevels) {
+        ImageSpec spec (res, res, 1, TypeDesc::FLOAT);
+        spec.tile_width = 16;
+        spec.tile_height = 16;
+        std::vector<float> pixels (res*res, float(nlevels+1));
+        OIIO_CHECK_ASSERT (out->open (filename.string(), spec,
+                      nlevels ? ImageOutput::AppendMIPLevel : ImageOutput::Create));
+        OIIO_CHECK_ASSERT (out->write_image (TypeDesc::FLOAT, &pixels[0]));
+    }
+    out->close ();
+    ImageOutput::destroy (out);
+
+    TextureSystem *texsys = TextureSystem::create (false /*not shared*/);
+    texsys->attribute ("io_threads", 1);
+    // A blocking lookup covering the whole texture reads only the
+    // coarsest levels.
+    TextureOpt options;
+    float r = -1;
+    OIIO_CHECK_ASSERT (texsys->texture (filename, options, 0.5f, 0.5f,
+                                        1.0f, 0, 0, 1.0f, 1, &r));
+    OIIO_CHECK_ASSERT (r > float(nlevels-2));
+    OIIO_CHECK_ASSERT (! options.approximate);
+
+    // A nonblocking lookup wanting level 0 doesn't wait for it
+    long long approx = -1;
+    options.nonblocking = true;
+    r = -1;
+    const float d = 1.0f / 256;
+    OIIO_CHECK_ASSERT (texsys->texture (filename, options, 0.5f, 0.5f,
+                                        d, 0, 0, d, 1, &r));
+    OIIO_CHECK_ASSERT (options.approximate);
+    OIIO_CHECK_ASSERT (r > 1.0f);
+    texsys->getattribute ("stat:approximate_lookups", TypeDesc::INT64, &approx);
+    OIIO_CHECK_EQUAL (approx, 1);
+
+    TextureSystem::destroy (texsys);
+    Filesystem::remove (filename.string());
+}
+
+
+
 int
 main (int argc, char **argv)
 {
+    if (argc > 1 && ! strcmp (argv[1], "--scaling")) {
+        int maxthreads = argc > 2 ? atoi (argv[2])
+                                  : (int) Sysutil::hardware_concurrency();
+        scaling_sweep (std::max (maxthreads, 1));
+        return 0;
+    }
+
     test_get_pixels_cachechannels (0, 10);
     test_get_pixels_cachechannels (0, 4);
     test_get_pixels_cachechannels (0, 4, 0, 6);
     test_get_pixels_cachechannels (0, 4, 0, 4);
     test_get_pixels_cachechannels (6, 9);
     test_get_pixels_cachechannels (6, 9, 6, 9);
+    test_prefetch_tiles ();
+    test_concurrent_inputs ();
+    test_concurrent_reads ();
+    test_procedural_tiles ();
+    test_metrics ();
+    test_coalesce_tiles ();
+    test_eviction_policy ();
+    test_microcache_size ();
+    test_texture_profile ();
+    test_texture_get_mip_level ();
+    test_texture_pointsample ();
+    test_texture_nonblocking ();
+    test_shared_metadata ();
+    test_lock_stats ();
+    test_trace ();
+    test_parallel_get_pixels ();
+    test_untiled_bands ();
+    test_automip_async ();
 
     return unit_test_failures;
 }
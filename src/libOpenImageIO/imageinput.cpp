@@ -447,6 +447,65 @@ ImageInput::read_tiles (int xbegin, int xend, int ybegin, int yend,
                                       chbegin, chend, data);
     }
 
+    if (chbegin != 0 || chend != m_spec.nchannels) {
+        // Just some of the channels: ask for only those, a tile at a
+        // time, so that plugins that can leave the other channels out at
+        // the I/O level don't have to read (and decode) them all.
+        std::vector<char> buf (native_pixel_bytes * m_spec.tile_pixels());
+        bool ok = true;
+        for (int z = zbegin;  ok && z < zend;  z += std::max(1,m_spec.tile_depth)) {
+            int zd = std::min (zend-z, std::max(1,m_spec.tile_depth));
+            for (int y = ybegin;  ok && y < yend;  y += m_spec.tile_height) {
+                int yh = std::min (yend-y, m_spec.tile_height);
+                for (int x = xbegin;  ok && x < xend;  x += m_spec.tile_width) {
+                    int xw = std::min (xend-x, m_spec.tile_width);
+                    // Whole tiles, clamped to the image edge, which is
+                    // also the layout the plugin hands back.
+                    int txend = std::min (x+m_spec.tile_width, m_spec.x+m_spec.width);
+                    int tyend = std::min (y+m_spec.tile_height, m_spec.y+m_spec.height);
+                    int tzend = std::min (z+std::max(1,m_spec.tile_depth), m_spec.z+std::max(1,m_spec.depth));
+                    stride_t subset_ystride = native_pixel_bytes * (txend-x);
+                    stride_t subset_zstride = subset_ystride * (tyend-y);
+                    if (! read_native_tiles (x, txend, y, tyend, z, tzend,
+                                             chbegin, chend, &buf[0]))
+                        return false;
+                    char *tilestart = (char *)data + (z-zbegin)*zstride
+                                    + (y-ybegin)*ystride + (x-xbegin)*xstride;
+                    if (native_data) {
+                        ok = copy_image (nchans, xw, yh, zd, &buf[0],
+                                         native_pixel_bytes, native_pixel_bytes,
+                                         subset_ystride, subset_zstride,
+                                         tilestart, xstride, ystride, zstride);
+                    } else if (! perchanfile) {
+                        ok = convert_image (nchans, xw, yh, zd, &buf[0],
+                                            m_spec.format, native_pixel_bytes,
+                                            subset_ystride, subset_zstride,
+                                            tilestart, format,
+                                            xstride, ystride, zstride);
+                    } else {
+                        // Per-channel formats -- convert channels one at
+                        // a time.
+                        size_t offset = 0;
+                        for (int c = 0;  ok && c < nchans;  ++c) {
+                            TypeDesc chanformat = m_spec.channelformats[c+chbegin];
+                            ok = convert_image (1, xw, yh, zd, &buf[offset],
+                                                chanformat, native_pixel_bytes,
+                                                subset_ystride, subset_zstride,
+                                                tilestart + c*format.size(),
+                                                format, xstride, ystride,
+                                                zstride);
+                            offset += chanformat.size ();
+                        }
+                    }
+                }
+            }
+        }
+        if (! ok)
+            error ("ImageInput::read_tiles : no support for format %s",
+                   m_spec.format.c_str());
+        return ok;
+    }
+
     // No such luck.  Just punt and read tiles individually.
     bool ok = true;
     stride_t pixelsize = native_data ? native_pixel_bytes 
@@ -698,8 +757,38 @@ ImageInput::read_native_deep_tiles (int xbegin, int xend,
 
 
 
+bool
+ImageInput::native_tile_offset (int x, int y, int z, imagesize_t &offset)
+{
+    return false;
+}
+
+
+
+bool
+ImageInput::read_native_tile_at (int subimage, int miplevel,
+                                 int x, int y, int z, void *data)
+{
+    ImageSpec tmp;
+    if ((current_subimage() != subimage || current_miplevel() != miplevel)
+          && ! seek_subimage (subimage, miplevel, tmp))
+        return false;
+    return read_native_tile (x, y, z, data);
+}
+
+
+
 bool
 ImageInput::read_native_deep_image (DeepData &deepdata)
+{
+    return read_native_deep_image (0, m_spec.nchannels, deepdata);
+}
+
+
+
+bool
+ImageInput::read_native_deep_image (int chbegin, int chend,
+                                    DeepData &deepdata)
 {
     if (m_spec.depth > 1) {
         error ("read_native_deep_image is not supported for volume (3D) images.");
@@ -713,11 +802,11 @@ ImageInput::read_native_deep_image (DeepData &deepdata)
         return read_native_deep_tiles (m_spec.x, m_spec.x+m_spec.width,
                                        m_spec.y, m_spec.y+m_spec.height,
                                        m_spec.z, m_spec.z+m_spec.depth,
-                                       0, m_spec.nchannels, deepdata);
+                                       chbegin, chend, deepdata);
     } else {
         // Scanline image
         return read_native_deep_scanlines (m_spec.y, m_spec.y+m_spec.height, 0,
-                                           0, m_spec.nchannels, deepdata);
+                                           chbegin, chend, deepdata);
     }
 }
 
@@ -34,7 +34,6 @@
 #include <OpenEXR/half.h>
 #include <OpenEXR/ImathFun.h>
 
-#include <boost/scoped_array.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/tss.hpp>
 
@@ -47,6 +46,7 @@
 #include "OpenImageIO/hash.h"
 #include "OpenImageIO/imageio.h"
 #include "imageio_pvt.h"
+#include "simd_dispatch.h"
 
 OIIO_NAMESPACE_BEGIN
 
@@ -54,8 +54,13 @@ OIIO_NAMESPACE_BEGIN
 namespace pvt {
 recursive_mutex imageio_mutex;
 atomic_int oiio_threads (Sysutil::hardware_concurrency());
-atomic_int oiio_exr_threads (Sysutil::hardware_concurrency());
+atomic_int oiio_exr_threads (0);
 atomic_int oiio_read_chunk (256);
+atomic_int oiio_color_lut3d_size (0);
+atomic_int oiio_imagebuf_hugepages (0);
+atomic_int oiio_imagebuf_first_touch (0);
+atomic_int oiio_imagebuf_parallel_read (1);
+atomic_int oiio_gpu (0);
 int tiff_half (0);
 ustring plugin_searchpath (OIIO_DEFAULT_PLUGIN_SEARCHPATH);
 std::string format_list;   // comma-separated list of all formats
@@ -148,6 +153,9 @@ attribute (string_view name, TypeDesc type, const void *val)
         if (ot == 0)
             ot = Sysutil::hardware_concurrency();
         oiio_threads = ot;
+        // The calling thread always does its share, so the shared pool
+        // needs one fewer worker than the requested thread count.
+        default_thread_pool()->resize (ot-1);
         return true;
     }
     spin_lock lock (attrib_mutex);
@@ -160,13 +168,33 @@ attribute (string_view name, TypeDesc type, const void *val)
         return true;
     }
     if (name == "exr_threads" && type == TypeDesc::TypeInt) {
-        oiio_exr_threads = Imath::clamp (*(const int *)val, 0, maxthreads);
+        oiio_exr_threads = Imath::clamp (*(const int *)val, -1, maxthreads);
         return true;
     }
     if (name == "tiff:half" && type == TypeDesc::TypeInt) {
         tiff_half = *(const int *)val;
         return true;
     }
+    if (name == "color:lut3d_size" && type == TypeDesc::TypeInt) {
+        oiio_color_lut3d_size = Imath::clamp (*(const int *)val, 0, 129);
+        return true;
+    }
+    if (name == "imagebuf:hugepages" && type == TypeDesc::TypeInt) {
+        oiio_imagebuf_hugepages = *(const int *)val;
+        return true;
+    }
+    if (name == "imagebuf:parallel_first_touch" && type == TypeDesc::TypeInt) {
+        oiio_imagebuf_first_touch = *(const int *)val;
+        return true;
+    }
+    if (name == "imagebuf:parallel_read" && type == TypeDesc::TypeInt) {
+        oiio_imagebuf_parallel_read = *(const int *)val;
+        return true;
+    }
+    if (name == "gpu" && type == TypeDesc::TypeInt) {
+        oiio_gpu = *(const int *)val;
+        return true;
+    }
     if (name == "debug" && type == TypeDesc::TypeInt) {
         print_debug = *(const int *)val;
         return true;
@@ -193,20 +221,22 @@ getattribute (string_view name, TypeDesc type, void *val)
         return true;
     }
     if (name == "format_list" && type == TypeDesc::TypeString) {
-        if (format_list.empty())
-            pvt::catalog_all_plugins (plugin_searchpath.string());
+        // Built-in formats may already be cataloged, but the list must
+        // include any external plugins, too (scanned only once).
+        recursive_lock_guard lock (pvt::imageio_mutex);
+        pvt::catalog_all_plugins (plugin_searchpath.string());
         *(ustring *)val = ustring(format_list);
         return true;
     }
     if (name == "extension_list" && type == TypeDesc::TypeString) {
-        if (extension_list.empty())
-            pvt::catalog_all_plugins (plugin_searchpath.string());
+        recursive_lock_guard lock (pvt::imageio_mutex);
+        pvt::catalog_all_plugins (plugin_searchpath.string());
         *(ustring *)val = ustring(extension_list);
         return true;
     }
     if (name == "library_list" && type == TypeDesc::TypeString) {
-        if (library_list.empty())
-            pvt::catalog_all_plugins (plugin_searchpath.string());
+        recursive_lock_guard lock (pvt::imageio_mutex);
+        pvt::catalog_all_plugins (plugin_searchpath.string());
         *(ustring *)val = ustring(library_list);
         return true;
     }
@@ -218,10 +248,38 @@ getattribute (string_view name, TypeDesc type, void *val)
         *(int *)val = tiff_half;
         return true;
     }
+    if (name == "color:lut3d_size" && type == TypeDesc::TypeInt) {
+        *(int *)val = oiio_color_lut3d_size;
+        return true;
+    }
+    if (name == "imagebuf:hugepages" && type == TypeDesc::TypeInt) {
+        *(int *)val = oiio_imagebuf_hugepages;
+        return true;
+    }
+    if (name == "imagebuf:parallel_first_touch" && type == TypeDesc::TypeInt) {
+        *(int *)val = oiio_imagebuf_first_touch;
+        return true;
+    }
+    if (name == "imagebuf:parallel_read" && type == TypeDesc::TypeInt) {
+        *(int *)val = oiio_imagebuf_parallel_read;
+        return true;
+    }
+    if (name == "gpu" && type == TypeDesc::TypeInt) {
+        *(int *)val = oiio_gpu;
+        return true;
+    }
     if (name == "debug" && type == TypeDesc::TypeInt) {
         *(int *)val = print_debug;
         return true;
     }
+    if (name == "hw:simd" && type == TypeDesc::TypeString) {
+        *(ustring *)val = ustring (Sysutil::cpu_feature_names());
+        return true;
+    }
+    if (name == "simd_kernels" && type == TypeDesc::TypeString) {
+        *(ustring *)val = ustring (simd_kernels().name);
+        return true;
+    }
     return false;
 }
 
@@ -324,6 +382,85 @@ pvt::contiguize (const void *src, int nchannels,
 
 
 
+// Bulk conversions to and from float with the default quantization.
+// The common pixel types use the kernels chosen at runtime for this CPU
+// (see simd_dispatch.h) if there are any.
+template<typename T>
+static inline void
+to_float (const T *src, float *dst, size_t n)
+{
+    convert_type (src, dst, n);
+}
+
+static inline void
+to_float (const unsigned char *src, float *dst, size_t n)
+{
+    const SIMDKernels &k (simd_kernels());
+    if (k.uint8_to_float)
+        k.uint8_to_float (src, dst, n);
+    else
+        convert_type (src, dst, n);
+}
+
+static inline void
+to_float (const unsigned short *src, float *dst, size_t n)
+{
+    const SIMDKernels &k (simd_kernels());
+    if (k.uint16_to_float)
+        k.uint16_to_float (src, dst, n);
+    else
+        convert_type (src, dst, n);
+}
+
+static inline void
+to_float (const half *src, float *dst, size_t n)
+{
+    const SIMDKernels &k (simd_kernels());
+    if (k.half_to_float)
+        k.half_to_float ((const unsigned short *)src, dst, n);
+    else
+        convert_type (src, dst, n);
+}
+
+template<typename T>
+static inline void
+from_float (const float *src, T *dst, size_t n)
+{
+    convert_type (src, dst, n);
+}
+
+static inline void
+from_float (const float *src, unsigned char *dst, size_t n)
+{
+    const SIMDKernels &k (simd_kernels());
+    if (k.float_to_uint8)
+        k.float_to_uint8 (src, dst, n);
+    else
+        convert_type (src, dst, n);
+}
+
+static inline void
+from_float (const float *src, unsigned short *dst, size_t n)
+{
+    const SIMDKernels &k (simd_kernels());
+    if (k.float_to_uint16)
+        k.float_to_uint16 (src, dst, n);
+    else
+        convert_type (src, dst, n);
+}
+
+static inline void
+from_float (const float *src, half *dst, size_t n)
+{
+    const SIMDKernels &k (simd_kernels());
+    if (k.float_to_half)
+        k.float_to_half (src, (unsigned short *)dst, n);
+    else
+        convert_type (src, dst, n);
+}
+
+
+
 const float *
 pvt::convert_to_float (const void *src, float *dst, int nvals,
                        TypeDesc format)
@@ -332,13 +469,13 @@ pvt::convert_to_float (const void *src, float *dst, int nvals,
     case TypeDesc::FLOAT :
         return (float *)src;
     case TypeDesc::UINT8 :
-        convert_type ((const unsigned char *)src, dst, nvals);
+        to_float ((const unsigned char *)src, dst, nvals);
         break;
     case TypeDesc::HALF :
-        convert_type ((const half *)src, dst, nvals);
+        to_float ((const half *)src, dst, nvals);
         break;
     case TypeDesc::UINT16 :
-        convert_type ((const unsigned short *)src, dst, nvals);
+        to_float ((const unsigned short *)src, dst, nvals);
         break;
     case TypeDesc::INT8:
         convert_type ((const char *)src, dst, nvals);
@@ -381,7 +518,15 @@ _from_float (const float *src, T *dst, size_t nvals,
         for (size_t p = 0;  p < nvals;  ++p)
             dst[p] = z;
     } else if (std::numeric_limits <T>::is_integer) {
-        // Convert float to non-float native format, with quantization
+        // Convert float to non-float native format, with quantization.
+        // The default quantization of the 8 and 16 bit unsigned types is
+        // just what the (SIMD) convert_type does.
+        if ((is_same<T,unsigned char>::value || is_same<T,unsigned short>::value)
+              && quant_min == (long long) std::numeric_limits<T>::min()
+              && quant_max == (long long) std::numeric_limits<T>::max()) {
+            from_float (src, dst, nvals);
+            return dst;
+        }
         for (size_t p = 0;  p < nvals;  ++p)
             dst[p] = (T) quantize (src[p], quant_min, quant_max);
     } else {
@@ -392,6 +537,10 @@ _from_float (const float *src, T *dst, size_t nvals,
             return src;
         }
         // Otherwise, it's converting between two fp types
+        if (is_same<T,half>::value) {
+            from_float (src, dst, nvals);
+            return dst;
+        }
         for (size_t p = 0;  p < nvals;  ++p)
             dst[p] = (T) src[p];
     }
@@ -465,24 +614,66 @@ pvt::parallel_convert_from_float (const float *src, void *dst, size_t nvals,
     if (nthreads <= 1)
         return convert_from_float (src, dst, nvals, quant_min, quant_max, format);
 
-    boost::thread_group threads;
+    task_set tasks;
     size_t blocksize = std::max (quanta, size_t((nvals + nthreads - 1) / nthreads));
     for (size_t i = 0;  i < size_t(nthreads);  i++) {
         size_t begin = i * blocksize;
         if (begin >= nvals)
             break;  // no more work to divvy up
         size_t end = std::min (begin + blocksize, nvals);
-        threads.add_thread (new boost::thread (
-                                boost::bind (convert_from_float, src+begin,
-                                             (char *)dst+begin*format.size(),
-                                             end-begin, quant_min, quant_max, format)));
+        tasks.push (boost::bind (convert_from_float, src+begin,
+                                 (char *)dst+begin*format.size(),
+                                 end-begin, quant_min, quant_max, format));
     }
-    threads.join_all ();
+    tasks.wait ();
     return dst;
 }
 
 
 
+// Direct conversions between 8 and 16 bit unsigned values.  They give
+// exactly the same results as going through float (s/255*65535 is s*257,
+// and the rounded s/65535*255 never falls on a tie), without the
+// intermediate buffer, and the loops vectorize.
+static void
+convert_uint8_to_uint16 (const unsigned char *src, unsigned short *dst, int n)
+{
+    for (int i = 0;  i < n;  ++i)
+        dst[i] = (unsigned short)(src[i] * 257);
+}
+
+static void
+convert_uint16_to_uint8 (const unsigned short *src, unsigned char *dst, int n)
+{
+    for (int i = 0;  i < n;  ++i)
+        dst[i] = (unsigned char)((src[i] * 255u + 32767u) / 65535u);
+}
+
+
+
+// Convert n floats to 'dst_type'.
+static bool
+convert_from_float_values (const float *buf, TypeDesc dst_type, void *dst,
+                           int n)
+{
+    switch (dst_type.basetype) {
+    case TypeDesc::UINT8 :  from_float (buf, (unsigned char *)dst, n);  break;
+    case TypeDesc::UINT16 : from_float (buf, (unsigned short *)dst, n); break;
+    case TypeDesc::HALF :   from_float (buf, (half *)dst, n);   break;
+    case TypeDesc::INT8 :   convert_type (buf, (char *)dst, n);   break;
+    case TypeDesc::INT16 :  convert_type (buf, (short *)dst, n);  break;
+    case TypeDesc::INT :    convert_type (buf, (int *)dst, n);  break;
+    case TypeDesc::UINT :   convert_type (buf, (unsigned int *)dst, n);  break;
+    case TypeDesc::INT64 :  convert_type (buf, (long long *)dst, n);  break;
+    case TypeDesc::UINT64 : convert_type (buf, (unsigned long long *)dst, n);  break;
+    case TypeDesc::DOUBLE : convert_type (buf, (double *)dst, n); break;
+        default:            return false;  // unknown format
+    }
+    return true;
+}
+
+
+
 bool
 convert_types (TypeDesc src_type, const void *src, 
                TypeDesc dst_type, void *dst, int n)
@@ -499,36 +690,35 @@ convert_types (TypeDesc src_type, const void *src,
         return true;
     }
 
-    // Conversion is to a non-float type
+    if (src_type == TypeDesc::TypeFloat)
+        return convert_from_float_values ((const float *)src, dst_type,
+                                          dst, n);
 
-    boost::scoped_array<float> tmp;   // In case we need a lot of temp space
-    float *buf = (float *)src;
-    if (src_type != TypeDesc::TypeFloat) {
-        // If src is also not float, convert through an intermediate buffer
-        if (n <= 4096)  // If < 16k, use the stack
-            buf = ALLOCA (float, n);
-        else {
-            tmp.reset (new float[n]);  // Freed when tmp exists its scope
-            buf = tmp.get();
-        }
-        pvt::convert_to_float (src, buf, n, src_type);
+    // Integer pairs we can convert directly
+    if (src_type == TypeDesc::UINT8 && dst_type == TypeDesc::UINT16) {
+        convert_uint8_to_uint16 ((const unsigned char *)src,
+                                 (unsigned short *)dst, n);
+        return true;
     }
-
-    // Convert float to 'dst_type'
-    switch (dst_type.basetype) {
-    case TypeDesc::UINT8 :  convert_type (buf, (unsigned char *)dst, n);  break;
-    case TypeDesc::UINT16 : convert_type (buf, (unsigned short *)dst, n); break;
-    case TypeDesc::HALF :   convert_type (buf, (half *)dst, n);   break;
-    case TypeDesc::INT8 :   convert_type (buf, (char *)dst, n);   break;
-    case TypeDesc::INT16 :  convert_type (buf, (short *)dst, n);  break;
-    case TypeDesc::INT :    convert_type (buf, (int *)dst, n);  break;
-    case TypeDesc::UINT :   convert_type (buf, (unsigned int *)dst, n);  break;
-    case TypeDesc::INT64 :  convert_type (buf, (long long *)dst, n);  break;
-    case TypeDesc::UINT64 : convert_type (buf, (unsigned long long *)dst, n);  break;
-    case TypeDesc::DOUBLE : convert_type (buf, (double *)dst, n); break;
-        default:            return false;  // unknown format
+    if (src_type == TypeDesc::UINT16 && dst_type == TypeDesc::UINT8) {
+        convert_uint16_to_uint8 ((const unsigned short *)src,
+                                 (unsigned char *)dst, n);
+        return true;
     }
 
+    // Neither is float: convert through float, a cache-sized batch at a
+    // time, so the intermediate values never leave the stack.
+    const int batch = 1024;
+    float buf[batch];
+    size_t srcsize = src_type.size(), dstsize = dst_type.size();
+    for (int i = 0;  i < n;  i += batch) {
+        int nb = std::min (batch, n - i);
+        pvt::convert_to_float ((const char *)src + i*srcsize, buf, nb,
+                               src_type);
+        if (! convert_from_float_values (buf, dst_type,
+                                         (char *)dst + i*dstsize, nb))
+            return false;
+    }
     return true;
 }
 
@@ -557,28 +747,34 @@ convert_image (int nchannels, int width, int height, int depth,
     ImageSpec::auto_stride (dst_xstride, dst_ystride, dst_zstride,
                             dst_type, nchannels, width, height);
     bool result = true;
-    bool contig = (src_xstride == stride_t(nchannels * src_type.size()) &&
-                   dst_xstride == stride_t(nchannels * dst_type.size()));
+    stride_t src_pixelsize = nchannels * src_type.size();
+    stride_t dst_pixelsize = nchannels * dst_type.size();
+    bool src_contig = (src_xstride == src_pixelsize);
+    bool dst_contig = (dst_xstride == dst_pixelsize);
+    // Rows with strided pixels are gathered into (or scattered from) a
+    // contiguous row, so that each scanline is still converted as a
+    // single unit rather than one pixel at a time.
+    std::vector<char> srcrow (src_contig ? 0 : width * src_pixelsize);
+    std::vector<char> dstrow (dst_contig ? 0 : width * dst_pixelsize);
     for (int z = 0;  z < depth;  ++z) {
         for (int y = 0;  y < height;  ++y) {
             const char *f = (const char *)src + (z*src_zstride + y*src_ystride);
             char *t = (char *)dst + (z*dst_zstride + y*dst_ystride);
-            if (contig) {
-                // Special case: pixels within each row are contiguous
-                // in both src and dst and we're copying all channels.
-                // Be efficient by converting each scanline as a single
-                // unit.  (Note that within convert_types, a memcpy will
-                // be used if the formats are identical.)
-                result &= convert_types (src_type, f, dst_type, t,
-                                         nchannels*width);
-            } else {
-                // General case -- anything goes with strides.
-                for (int x = 0;  x < width;  ++x) {
-                    result &= convert_types (src_type, f, dst_type, t,
-                                             nchannels);
-                    f += src_xstride;
-                    t += dst_xstride;
-                }
+            if (! src_contig) {
+                for (int x = 0;  x < width;  ++x)
+                    memcpy (&srcrow[x*src_pixelsize], f + x*src_xstride,
+                            src_pixelsize);
+                f = &srcrow[0];
+            }
+            // Note that within convert_types, a memcpy will be used if
+            // the formats are identical.
+            result &= convert_types (src_type, f, dst_type,
+                                     dst_contig ? t : &dstrow[0],
+                                     nchannels*width);
+            if (! dst_contig) {
+                for (int x = 0;  x < width;  ++x)
+                    memcpy (t + x*dst_xstride, &dstrow[x*dst_pixelsize],
+                            dst_pixelsize);
             }
         }
     }
@@ -652,7 +848,7 @@ parallel_convert_image (int nchannels, int width, int height, int depth,
     ImageSpec::auto_stride (dst_xstride, dst_ystride, dst_zstride,
                             dst_type, nchannels, width, height);
 
-    boost::thread_group threads;
+    task_set tasks;
     int blocksize = std::max (1, (height + nthreads - 1) / nthreads);
     for (int i = 0;  i < nthreads;  i++) {
         int ybegin = i * blocksize;
@@ -665,9 +861,9 @@ parallel_convert_image (int nchannels, int width, int height, int depth,
                                    (char *)dst+dst_ystride*ybegin,
                                    dst_type, dst_xstride, dst_ystride, dst_zstride,
                                    alpha_channel, z_channel);
-        threads.add_thread (new boost::thread (ciw));
+        tasks.push (ciw);
     }
-    threads.join_all ();
+    tasks.wait ();
     return true;
 }
 
@@ -711,6 +907,131 @@ copy_image (int nchannels, int width, int height, int depth,
 
 
 
+namespace {
+
+// Run func(z, ybegin, yend) over blocks of scanlines of each of the depth
+// planes of an image, in parallel if the image is big enough.
+template<class FUNC>
+void
+parallel_scanline_blocks (FUNC func, int nchannels, int width, int height,
+                          int depth, int nthreads=0)
+{
+    if (imagesize_t(width)*height*depth*nchannels < 30000)
+        nthreads = 1;
+    if (nthreads <= 0)
+        nthreads = oiio_threads;
+    if (nthreads <= 1) {
+        for (int z = 0;  z < depth;  ++z)
+            func (z, 0, height);
+        return;
+    }
+    // Keep the blocks a multiple of 4 scanlines, for dither_scanlines.
+    int nblocks = std::max (1, (nthreads + depth - 1) / depth);
+    int blocksize = std::max (4, ((height + nblocks - 1) / nblocks + 3) & ~3);
+    task_set tasks;
+    for (int z = 0;  z < depth;  ++z)
+        for (int y = 0;  y < height;  y += blocksize)
+            tasks.push (boost::bind<void> (func, z, y,
+                                           std::min (y + blocksize, height)));
+    tasks.wait ();
+}
+
+
+
+// The bjmix hash on 4 independent states at once.
+inline void
+bjmix (simd::int4 &a, simd::int4 &b, simd::int4 &c)
+{
+    a -= c;  a ^= rotl32(c, 4);  c += b;
+    b -= a;  b ^= rotl32(a, 6);  a += c;
+    c -= b;  c ^= rotl32(b, 8);  b += a;
+    a -= c;  a ^= rotl32(c,16);  c += b;
+    b -= a;  b ^= rotl32(a,19);  a += c;
+    c -= b;  c ^= rotl32(b, 4);  b += a;
+}
+
+
+
+// Add dither to scanlines [ybegin,yend) of one (float) plane, whose
+// absolute coordinates are given by the origins.  The hash state is
+// restarted for every scanline, so four scanlines are done at once, one
+// in each SIMD lane, giving exactly the same dither as doing them one at
+// a time.
+void
+dither_scanlines (int nchannels, int width, int ybegin, int yend,
+                  char *plane, stride_t xstride, stride_t ystride,
+                  float ditheramplitude, int alpha_channel, int z_channel,
+                  unsigned int ditherseed, int chorigin, int xorigin,
+                  int yorigin, int zorigin)
+{
+    const float scale = 1.0f / float(std::numeric_limits<uint32_t>::max());
+    int y = ybegin;
+    for ( ;  y + 4 <= yend;  y += 4) {
+        char *scanline[4] = { plane + y*ystride, plane + (y+1)*ystride,
+                              plane + (y+2)*ystride, plane + (y+3)*ystride };
+        simd::int4 ba = simd::int4 (zorigin*1311 + yorigin + y)
+                      + simd::int4::Iota();
+        simd::int4 bb (int(ditherseed + (chorigin<<24)));
+        simd::int4 bc (xorigin);
+        for (int x = 0;  x < width;  ++x) {
+            for (int c = 0;  c < nchannels;  ++c, bc += simd::int4::One()) {
+                bjmix (ba, bb, bc);
+                int channel = c+chorigin;
+                if (channel == alpha_channel || channel == z_channel)
+                    continue;
+                // bc converted as unsigned, rounded exactly as the
+                // scalar conversion does.
+                simd::float4 u = simd::float4 (srl (bc, 16)) * 65536.0f
+                               + simd::float4 (bc & simd::int4(0xffff));
+                OIIO_SIMD4_ALIGN float dither[4];
+                (u * scale).store (dither);
+                size_t offset = x*xstride + c*sizeof(float);
+                for (int i = 0;  i < 4;  ++i)
+                    *(float *)(scanline[i] + offset) += ditheramplitude * (dither[i] - 0.5f);
+            }
+        }
+    }
+    for ( ;  y < yend;  ++y) {
+        char *pixel = plane + y*ystride;
+        uint32_t ba = zorigin*1311 + yorigin+y;
+        uint32_t bb = ditherseed + (chorigin<<24);
+        uint32_t bc = xorigin;
+        for (int x = 0;  x < width;  ++x, pixel += xstride) {
+            float *val = (float *)pixel;
+            for (int c = 0;  c < nchannels;  ++c, ++val, ++bc) {
+                bjhash::bjmix (ba, bb, bc);
+                int channel = c+chorigin;
+                if (channel == alpha_channel || channel == z_channel)
+                    continue;
+                float dither = bc / float(std::numeric_limits<uint32_t>::max());
+                *val += ditheramplitude * (dither - 0.5f);
+            }
+        }
+    }
+}
+
+
+
+struct add_dither_blocks {
+    int nchannels, width;
+    char *data;
+    stride_t xstride, ystride, zstride;
+    float ditheramplitude;
+    int alpha_channel, z_channel;
+    unsigned int ditherseed;
+    int chorigin, xorigin, yorigin, zorigin;
+    void operator() (int z, int ybegin, int yend) const {
+        dither_scanlines (nchannels, width, ybegin, yend, data + z*zstride,
+                          xstride, ystride, ditheramplitude,
+                          alpha_channel, z_channel, ditherseed,
+                          chorigin, xorigin, yorigin, z + zorigin);
+    }
+};
+
+}  // anon namespace
+
+
+
 void
 add_dither (int nchannels, int width, int height, int depth,
             float *data, stride_t xstride, stride_t ystride, stride_t zstride,
@@ -720,42 +1041,98 @@ add_dither (int nchannels, int width, int height, int depth,
 {
     ImageSpec::auto_stride (xstride, ystride, zstride,
                             sizeof(float), nchannels, width, height);
-    char *plane = (char *)data;
-    for (int z = 0;  z < depth;  ++z, plane += zstride) {
-        char *scanline = plane;
-        for (int y = 0;  y < height;  ++y, scanline += ystride) {
-            char *pixel = scanline;
-            uint32_t ba = (z+zorigin)*1311 + yorigin+y;
-            uint32_t bb = ditherseed + (chorigin<<24);
-            uint32_t bc = xorigin;
-            for (int x = 0;  x < width;  ++x, pixel += xstride) {
-                float *val = (float *)pixel;
-                for (int c = 0;  c < nchannels;  ++c, ++val, ++bc) {
-                    bjhash::bjmix (ba, bb, bc);
-                    int channel = c+chorigin;
-                    if (channel == alpha_channel || channel == z_channel)
-                        continue;
-                    float dither = bc / float(std::numeric_limits<uint32_t>::max());
-                    *val += ditheramplitude * (dither - 0.5f);
-                }
-            }
+    add_dither_blocks f = { nchannels, width, (char *)data,
+                            xstride, ystride, zstride, ditheramplitude,
+                            alpha_channel, z_channel, ditherseed,
+                            chorigin, xorigin, yorigin, zorigin };
+    parallel_scanline_blocks (f, nchannels, width, height, depth);
+}
+
+
+
+namespace {
+
+// One block of scanlines of pvt::parallel_dither_convert_image: convert a
+// few scanlines at a time to float, dither them, and convert them to the
+// destination type, so the image makes only one trip through memory.
+struct dither_convert_blocks {
+    int nchannels, width;
+    const char *src;
+    TypeDesc src_type;
+    stride_t src_xstride, src_ystride, src_zstride;
+    char *dst;
+    TypeDesc dst_type;
+    stride_t dst_xstride, dst_ystride, dst_zstride;
+    float ditheramplitude;
+    int alpha_channel, z_channel;
+    unsigned int ditherseed;
+    int xorigin, yorigin, zorigin;
+    void operator() (int z, int ybegin, int yend) const {
+        const int rows = 4;
+        stride_t pixelsize = nchannels * sizeof(float);
+        std::vector<float> buf (size_t(rows) * width * nchannels);
+        for (int y = ybegin;  y < yend;  y += rows) {
+            int n = std::min (rows, yend - y);
+            convert_image (nchannels, width, n, 1,
+                           src + z*src_zstride + y*src_ystride, src_type,
+                           src_xstride, src_ystride, AutoStride,
+                           &buf[0], TypeDesc::FLOAT,
+                           pixelsize, pixelsize*width, AutoStride);
+            dither_scanlines (nchannels, width, 0, n, (char *)&buf[0],
+                              pixelsize, pixelsize*width, ditheramplitude,
+                              alpha_channel, z_channel, ditherseed, 0,
+                              xorigin, yorigin + y, zorigin + z);
+            convert_image (nchannels, width, n, 1,
+                           &buf[0], TypeDesc::FLOAT,
+                           pixelsize, pixelsize*width, AutoStride,
+                           dst + z*dst_zstride + y*dst_ystride, dst_type,
+                           dst_xstride, dst_ystride, AutoStride);
         }
     }
+};
+
+}  // anon namespace
+
+
+
+bool
+pvt::parallel_dither_convert_image (int nchannels, int width, int height,
+               int depth, const void *src, TypeDesc src_type,
+               stride_t src_xstride, stride_t src_ystride,
+               stride_t src_zstride,
+               void *dst, TypeDesc dst_type,
+               stride_t dst_xstride, stride_t dst_ystride,
+               stride_t dst_zstride, float ditheramplitude,
+               int alpha_channel, int z_channel, unsigned int ditherseed,
+               int xorigin, int yorigin, int zorigin, int nthreads)
+{
+    ImageSpec::auto_stride (src_xstride, src_ystride, src_zstride,
+                            src_type, nchannels, width, height);
+    ImageSpec::auto_stride (dst_xstride, dst_ystride, dst_zstride,
+                            dst_type, nchannels, width, height);
+    dither_convert_blocks f = { nchannels, width, (const char *)src,
+                                src_type, src_xstride, src_ystride,
+                                src_zstride, (char *)dst, dst_type,
+                                dst_xstride, dst_ystride, dst_zstride,
+                                ditheramplitude, alpha_channel, z_channel,
+                                ditherseed, xorigin, yorigin, zorigin };
+    parallel_scanline_blocks (f, nchannels, width, height, depth, nthreads);
+    return true;
 }
 
 
 
+namespace {
+
 template<typename T>
-static void
-premult_impl (int nchannels, int width, int height, int depth,
-              int chbegin, int chend,
-              T *data, stride_t xstride, stride_t ystride, stride_t zstride,
-              int alpha_channel, int z_channel)
-{
-    char *plane = (char *)data;
-    for (int z = 0;  z < depth;  ++z, plane += zstride) {
-        char *scanline = plane;
-        for (int y = 0;  y < height;  ++y, scanline += ystride) {
+struct premult_blocks {
+    int width, chbegin, chend;
+    char *data;
+    stride_t xstride, ystride, zstride;
+    int alpha_channel, z_channel;
+    void operator() (int z, int ybegin, int yend) const {
+        char *scanline = data + z*zstride + ybegin*ystride;
+        for (int y = ybegin;  y < yend;  ++y, scanline += ystride) {
             char *pixel = scanline;
             for (int x = 0;  x < width;  ++x, pixel += xstride) {
                 DataArrayProxy<T,float> val ((T*)pixel);
@@ -768,6 +1145,23 @@ premult_impl (int nchannels, int width, int height, int depth,
             }
         }
     }
+};
+
+}  // anon namespace
+
+
+
+template<typename T>
+static void
+premult_impl (int nchannels, int width, int height, int depth,
+              int chbegin, int chend,
+              T *data, stride_t xstride, stride_t ystride, stride_t zstride,
+              int alpha_channel, int z_channel)
+{
+    premult_blocks<T> f = { width, chbegin, chend, (char *)data,
+                            xstride, ystride, zstride,
+                            alpha_channel, z_channel };
+    parallel_scanline_blocks (f, nchannels, width, height, depth);
 }
 
 
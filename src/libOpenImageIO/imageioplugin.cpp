@@ -31,6 +31,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -67,6 +68,10 @@ static std::map <std::string, Plugin::Handle> plugin_handles;
 static std::map <std::string, std::string> plugin_filepaths;
 // Map format name to underlying implementation library
 static std::map <std::string, std::string> format_library_versions;
+// Have the built-in formats been added to the maps yet?
+static bool builtins_cataloged = false;
+// Plugin search paths that have already been scanned for external plugins
+static std::set<std::string> searched_paths;
 
 
 
@@ -249,68 +254,106 @@ catalog_plugin (const std::string &format_name,
 #endif // defined(EMBED_PLUGINS)
 
 
+#ifdef EMBED_PLUGINS
+
 namespace {
 
-/// Add all the built-in plugins, those compiled right into libOpenImageIO,
-/// to the catalogs.  This does nothing if EMBED_PLUGINS is not defined,
-/// in which case they'll be registered only when read from external
-/// DSO/DLL's.
-static void
-catalog_builtin_plugins ()
-{
-#ifdef EMBED_PLUGINS
-    // Use DECLAREPLUG macro to make this more compact and easy to read.
-#define DECLAREPLUG(name)                                                 \
-    declare_imageio_format (#name,                                        \
-                   (ImageInput::Creator) name ## _input_imageio_create,   \
-                   name ## _input_extensions,                             \
-                   (ImageOutput::Creator) name ## _output_imageio_create, \
-                   name ## _output_extensions,                            \
-                   name ## _imageio_library_version())
-
-    DECLAREPLUG (bmp);
-    DECLAREPLUG (cineon);
-    DECLAREPLUG (dds);
-    DECLAREPLUG (dpx);
+// The formats compiled right into libOpenImageIO. Every entry is made of
+// link-time constants, so the table is built by the compiler and costs
+// nothing at startup; cataloging it is just a few map insertions, with no
+// directory scanning or dlopen.
+struct BuiltinFormat {
+    const char *name;
+    ImageInput::Creator input_creator;
+    const char **input_extensions;
+    ImageOutput::Creator output_creator;
+    const char **output_extensions;
+    PluginLibVersionFunc lib_version;
+};
+
+// Use BUILTINFORMAT macro to make this more compact and easy to read.
+#define BUILTINFORMAT(name)                                   \
+    { #name,                                                  \
+      (ImageInput::Creator) name ## _input_imageio_create,    \
+      name ## _input_extensions,                              \
+      (ImageOutput::Creator) name ## _output_imageio_create,  \
+      name ## _output_extensions,                             \
+      name ## _imageio_library_version }
+
+static const BuiltinFormat builtin_formats[] = {
+    BUILTINFORMAT (bmp),
+    BUILTINFORMAT (cineon),
+    BUILTINFORMAT (dds),
+    BUILTINFORMAT (dpx),
 #ifdef USE_FFMPEG
-    DECLAREPLUG (ffmpeg);
+    BUILTINFORMAT (ffmpeg),
 #endif
 #ifdef USE_FIELD3D
-    DECLAREPLUG (field3d);
+    BUILTINFORMAT (field3d),
 #endif
-    DECLAREPLUG (fits);
+    BUILTINFORMAT (fits),
 #ifdef USE_GIF
-    DECLAREPLUG (gif);
+    BUILTINFORMAT (gif),
 #endif
-    DECLAREPLUG (hdr);
-    DECLAREPLUG (ico);
-    DECLAREPLUG (iff);
-    DECLAREPLUG (jpeg);
+    BUILTINFORMAT (hdr),
+    BUILTINFORMAT (ico),
+    BUILTINFORMAT (iff),
+    BUILTINFORMAT (jpeg),
 #ifdef USE_OPENJPEG
-    DECLAREPLUG (jpeg2000);
+    BUILTINFORMAT (jpeg2000),
 #endif
-    DECLAREPLUG (openexr);
-    DECLAREPLUG (png);
-    DECLAREPLUG (pnm);
-    DECLAREPLUG (psd);
+    BUILTINFORMAT (openexr),
+    BUILTINFORMAT (png),
+    BUILTINFORMAT (pnm),
+    BUILTINFORMAT (psd),
 #ifdef USE_PTEX
-    DECLAREPLUG (ptex);
+    BUILTINFORMAT (ptex),
 #endif
 #ifdef USE_LIBRAW
-    DECLAREPLUG (raw);
+    BUILTINFORMAT (raw),
 #endif
-    DECLAREPLUG (rla);
-    DECLAREPLUG (sgi);
+    BUILTINFORMAT (rla),
+    BUILTINFORMAT (sgi),
 #ifdef USE_BOOST_ASIO
-    DECLAREPLUG (socket);
+    BUILTINFORMAT (socket),
 #endif
-    DECLAREPLUG (softimage);
-    DECLAREPLUG (tiff);
-    DECLAREPLUG (targa);
+    BUILTINFORMAT (softimage),
+    BUILTINFORMAT (tiff),
+    BUILTINFORMAT (targa),
 #ifdef USE_WEBP
-    DECLAREPLUG (webp);
+    BUILTINFORMAT (webp),
 #endif
-    DECLAREPLUG (zfile);
+    BUILTINFORMAT (zfile),
+};
+
+#undef BUILTINFORMAT
+
+} // anon namespace end
+
+#endif // defined(EMBED_PLUGINS)
+
+
+
+namespace {
+
+/// Add all the built-in plugins, those compiled right into libOpenImageIO,
+/// to the catalogs (only the first time it's called).  This does nothing
+/// if EMBED_PLUGINS is not defined, in which case they'll be registered
+/// only when read from external DSO/DLL's.  Should only be called while
+/// imageio_mutex is held.
+static void
+catalog_builtin_plugins ()
+{
+    if (builtins_cataloged)
+        return;
+    builtins_cataloged = true;
+#ifdef EMBED_PLUGINS
+    for (size_t i = 0;  i < sizeof(builtin_formats)/sizeof(builtin_formats[0]);  ++i) {
+        const BuiltinFormat &f (builtin_formats[i]);
+        declare_imageio_format (f.name, f.input_creator, f.input_extensions,
+                                f.output_creator, f.output_extensions,
+                                f.lib_version());
+    }
 #endif
 }
 
@@ -338,8 +381,9 @@ append_if_env_exists (std::string &searchpath, const char *env,
 
 
 /// Look at ALL imageio plugins in the searchpath and add them to the
-/// catalog.  This routine is not reentrant and should only be called
-/// by a routine that is holding a lock on imageio_mutex.
+/// catalog.  Each distinct searchpath is only scanned once.  This routine
+/// is not reentrant and should only be called by a routine that is
+/// holding a lock on imageio_mutex.
 void
 pvt::catalog_all_plugins (std::string searchpath)
 {
@@ -352,6 +396,8 @@ pvt::catalog_all_plugins (std::string searchpath)
 #if defined(__linux__) || defined(__FreeBSD__)
     append_if_env_exists (searchpath, "LD_LIBRARY_PATH");
 #endif
+    if (! searched_paths.insert (searchpath).second)
+        return;   // already scanned this one
 
     size_t patlen = pattern.length();
     std::vector<std::string> dirs;
@@ -393,8 +439,10 @@ ImageOutput::create (const std::string &filename,
     {  // scope the lock:
         recursive_lock_guard lock (imageio_mutex);  // Ensure thread safety
 
-        // See if it's already in the table.  If not, scan all plugins we can
-        // find to populate the table.
+        // See if it's one of the built-in formats.  If not, scan all
+        // plugins we can find to populate the table.  Only an unknown
+        // format pays for searching the plugin path and loading DSOs.
+        catalog_builtin_plugins ();
         Strutil::to_lower (format);
         OutputPluginMap::const_iterator found = output_formats.find (format);
         if (found == output_formats.end()) {
@@ -470,8 +518,10 @@ ImageInput::create (const std::string &filename,
     { // scope the lock:
         recursive_lock_guard lock (imageio_mutex);  // Ensure thread safety
 
-        // See if it's already in the table.  If not, scan all plugins we can
-        // find to populate the table.
+        // See if it's one of the built-in formats.  If not, scan all
+        // plugins we can find to populate the table.  Only an unknown
+        // format pays for searching the plugin path and loading DSOs.
+        catalog_builtin_plugins ();
         Strutil::to_lower (format);
         InputPluginMap::const_iterator found = input_formats.find (format);
         if (found == input_formats.end()) {
@@ -530,6 +580,10 @@ ImageInput::create (const std::string &filename,
         ImageSpec config;
         config.attribute ("nowait", (int)1);
         recursive_lock_guard lock (imageio_mutex);  // Ensure thread safety
+        // Any external plugins might be the one, so make sure they've
+        // been loaded, too.
+        catalog_all_plugins (plugin_searchpath.size() ? plugin_searchpath
+                             : pvt::plugin_searchpath.string());
         for (InputPluginMap::const_iterator plugin = input_formats.begin();
              plugin != input_formats.end(); ++plugin)
         {
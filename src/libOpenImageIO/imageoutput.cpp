@@ -375,6 +375,34 @@ ImageOutput::to_native_rectangle (int xbegin, int xend, int ybegin, int yend,
     // The remaining code is where all channels in the file have the
     // same data type, which may or may not be what the user passed in
     // (cases #3 and #4 above).
+
+    // 8 <-> 16 bit unsigned conversions are done directly (and
+    // identically to the float round trip below), with no dither to
+    // consider since the source isn't floating point.
+    if ((format == TypeDesc::UINT8 && m_spec.format == TypeDesc::UINT16) ||
+        (format == TypeDesc::UINT16 && m_spec.format == TypeDesc::UINT8)) {
+        scratch.resize (rectangle_bytes);
+        parallel_convert_image (m_spec.nchannels, width, height, depth,
+                                data, format, xstride, ystride, zstride,
+                                &scratch[0], m_spec.format,
+                                AutoStride, AutoStride, AutoStride);
+        return &scratch[0];
+    }
+
+    // Dithered float -> 8 bit output converts, dithers, and quantizes in
+    // one parallel pass, straight from the user's buffer.
+    if (dither && format.is_floating_point() &&
+            m_spec.format.basetype == TypeDesc::UINT8) {
+        scratch.resize (rectangle_bytes);
+        pvt::parallel_dither_convert_image (m_spec.nchannels, width, height,
+                            depth, data, format, xstride, ystride, zstride,
+                            &scratch[0], m_spec.format,
+                            AutoStride, AutoStride, AutoStride, 1.0f/255.0f,
+                            m_spec.alpha_channel, m_spec.z_channel,
+                            dither, xorigin, yorigin, zorigin);
+        return &scratch[0];
+    }
+
     imagesize_t contiguoussize = contiguous ? 0 : rectangle_values * native_pixel_bytes;
     contiguoussize = (contiguoussize+3) & (~3); // Round up to 4-byte boundary
     DASSERT ((contiguoussize & 3) == 0);
@@ -400,24 +428,6 @@ ImageOutput::to_native_rectangle (int xbegin, int xend, int ybegin, int yend,
                                 (int)rectangle_values, format);
     }
 
-    if (dither && format.is_floating_point() &&
-            m_spec.format.basetype == TypeDesc::UINT8) {
-        float *ditherarea = (float *)&scratch[contiguoussize];
-        stride_t pixelsize = m_spec.nchannels * sizeof(float);
-        if (buf != ditherarea) {
-            // Need to make a copy for dither so we don't destroy user's data.
-            OIIO::copy_image (m_spec.nchannels, width, height, depth,
-                              buf, pixelsize, pixelsize, pixelsize*width,
-                              pixelsize*width*height, ditherarea,
-                              pixelsize, pixelsize*width, pixelsize*width*height);
-            buf = ditherarea;
-        }
-        OIIO::add_dither (m_spec.nchannels, width, height, depth, ditherarea,
-                          pixelsize, pixelsize*width, pixelsize*width*height,
-                          1.0f/255.0f, m_spec.alpha_channel, m_spec.z_channel,
-                          dither, 0, xorigin, yorigin, zorigin);
-    }
-
     // Convert from float to native format.
     return parallel_convert_from_float (buf, &scratch[contiguoussize+floatsize], 
                                         rectangle_values, m_spec.format);
@@ -561,30 +571,19 @@ ImageOutput::copy_to_image_buffer (int xbegin, int xend, int ybegin, int yend,
                     + (ybegin-spec.y)*buf_ystride
                     + (zbegin-spec.z)*buf_zstride;
     int width = xend-xbegin, height = yend-ybegin, depth = zend-zbegin;
-    imagesize_t npixels = imagesize_t(width) * imagesize_t(height) * imagesize_t(depth);
 
-    // Add dither if requested -- requires making a temporary staging area
-    boost::scoped_array<float> ditherarea;
+    // Add dither if requested, in the same pass as the conversion.
     unsigned int dither = spec.get_int_attribute ("oiio:dither", 0);
     if (dither && format.is_floating_point() &&
             buf_format.basetype == TypeDesc::UINT8) {
-        stride_t pixelsize = spec.nchannels * sizeof(float);
-        ditherarea.reset (new float [pixelsize * npixels]);
-        OIIO::convert_image (spec.nchannels, width, height, depth,
-                             data, format, xstride, ystride, zstride,
-                             ditherarea.get(), TypeDesc::FLOAT,
-                             pixelsize, pixelsize*width,
-                             pixelsize*width*height);
-        data = ditherarea.get();
-        format = TypeDesc::FLOAT;
-        xstride = pixelsize;
-        ystride = xstride * width;
-        zstride = ystride * height;
         float ditheramp = spec.get_float_attribute ("oiio:ditheramplitude", 1.0f/255.0f);
-        OIIO::add_dither (spec.nchannels, width, height, depth, (float *)data,
-                          pixelsize, pixelsize*width, pixelsize*width*height,
-                          ditheramp, spec.alpha_channel, spec.z_channel,
-                          dither, 0, xbegin, ybegin, zbegin);
+        return pvt::parallel_dither_convert_image (spec.nchannels, width,
+                            height, depth, data, format,
+                            xstride, ystride, zstride,
+                            (char *)image_buffer + offset, buf_format,
+                            buf_xstride, buf_ystride, buf_zstride, ditheramp,
+                            spec.alpha_channel, spec.z_channel,
+                            dither, xbegin, ybegin, zbegin);
     }
 
     return OIIO::convert_image (spec.nchannels, width, height, depth,
@@ -0,0 +1,418 @@
+/*
+  Copyright 2016 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/scoped_array.hpp>
+
+#include "OpenImageIO/imageio.h"
+#include "OpenImageIO/imagebuf.h"
+#include "OpenImageIO/imagesequence.h"
+#include "OpenImageIO/filesystem.h"
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/thread.h"
+
+
+OIIO_NAMESPACE_BEGIN
+
+
+class ImageSequenceReader::Impl {
+public:
+    // A slot of the ring holds one frame on its way from the file to
+    // the caller.  The consumer thread owns a slot that is Idle or Done;
+    // a read task owns it while it is Reading, having claimed it by
+    // switching it from Queued.  Whoever gets to a Queued slot first
+    // reads it -- a task ahead of time, or next() if the task has not
+    // started yet.
+    enum SlotState { Idle, Queued, Reading, Done };
+
+    struct Slot {
+        int index;              // Frame index, or -1
+        atomic_int state;       // SlotState
+        atomic_int cancelled;   // Nonzero: give up on the read
+        bool ok;                // Done, and read successfully
+        ImageBuf buf;
+        std::string error;
+        Slot () : index(-1), state(Idle), cancelled(0), ok(false) { }
+    };
+
+    struct ReadTask {
+        Impl *impl;
+        Slot *slot;
+        void operator() () {
+            if (slot->state.bool_compare_and_swap (Queued, Reading)) {
+                impl->read_frame (*slot);
+                slot->state = Done;
+            }
+        }
+    };
+
+    Impl () : m_ahead(0), m_nslots(0), m_current(0) { }
+    ~Impl () { close (); }
+
+    bool open (const std::vector<std::string> &filenames,
+               const std::vector<int> &numbers, int ahead, TypeDesc format) {
+        close ();
+        if (filenames.empty()) {
+            error ("Empty image sequence");
+            return false;
+        }
+        m_filenames = filenames;
+        m_numbers = numbers;
+        m_format = format;
+        m_ahead = std::max (0, std::min (ahead, nframes()-1));
+        m_nslots = m_ahead + 1;
+        m_slots.reset (new Slot[m_nslots]);
+        m_current = 0;
+        fill_window ();
+        return true;
+    }
+
+    void close () {
+        cancel ();
+        m_tasks.wait ();
+        m_slots.reset ();
+        m_nslots = 0;
+        m_filenames.clear ();
+        m_numbers.clear ();
+        m_current = 0;
+    }
+
+    int nframes () const { return int (m_filenames.size()); }
+    int current () const { return m_current; }
+    const std::string &filename (int index) const { return m_filenames[index]; }
+    int frame_number (int index) const {
+        return index < int(m_numbers.size()) ? m_numbers[index] : index;
+    }
+
+    bool next (ImageBuf &buf) {
+        if (m_current >= nframes())
+            return false;
+        fill_window ();
+        Slot &slot (m_slots[m_current % m_nslots]);
+        if (slot.state.bool_compare_and_swap (Queued, Reading)) {
+            // Not started yet -- don't wait for it to reach the front
+            // of the queue.
+            read_frame (slot);
+            slot.state = Done;
+        } else {
+            wait (slot);
+        }
+        bool ok = slot.ok;
+        if (ok)
+            buf.swap (slot.buf);
+        else
+            error (slot.error.size() ? slot.error
+                   : Strutil::format ("Could not read \"%s\"",
+                                      m_filenames[m_current]));
+        release (slot);
+        ++m_current;
+        fill_window ();
+        return ok;
+    }
+
+    bool seek (int index) {
+        if (index < 0 || index >= nframes()) {
+            error ("Frame index %d is outside the sequence [0,%d)",
+                   index, nframes());
+            return false;
+        }
+        m_current = index;
+        for (int s = 0;  s < m_nslots;  ++s) {
+            Slot &slot (m_slots[s]);
+            if (slot.index >= 0 && ! in_window (slot.index))
+                cancel (slot);
+        }
+        fill_window ();
+        return true;
+    }
+
+    void cancel () {
+        for (int s = 0;  s < m_nslots;  ++s)
+            cancel (m_slots[s]);
+    }
+
+    void error (const std::string &message) const {
+        lock_guard lock (m_err_mutex);
+        if (m_err.size() && m_err[m_err.size()-1] != '\n')
+            m_err += '\n';
+        m_err += message;
+    }
+    template<typename T1>
+    void error (const char *fmt, const T1 &v1) const {
+        error (Strutil::format (fmt, v1));
+    }
+    template<typename T1, typename T2>
+    void error (const char *fmt, const T1 &v1, const T2 &v2) const {
+        error (Strutil::format (fmt, v1, v2));
+    }
+
+    std::string geterror () const {
+        lock_guard lock (m_err_mutex);
+        std::string e;
+        std::swap (e, m_err);
+        return e;
+    }
+
+    void read_frame (Slot &slot) {
+        const std::string &name (m_filenames[slot.index]);
+        slot.ok = false;
+        slot.error.clear ();
+        boost::scoped_ptr<ImageInput> in (ImageInput::open (name));
+        if (! in) {
+            slot.error = OIIO::geterror ();
+            return;
+        }
+        ImageSpec spec = in->spec ();
+        if (spec.deep) {
+            slot.error = Strutil::format ("\"%s\": deep images are not "
+                                          "supported", name);
+            return;
+        }
+        TypeDesc format = (m_format != TypeDesc::UNKNOWN) ? m_format : spec.format;
+        spec.set_format (format);
+        spec.channelformats.clear ();
+        slot.buf.reset (name, spec);
+        if (! in->read_image (format, slot.buf.localpixels(), AutoStride,
+                              AutoStride, AutoStride, progress, &slot)) {
+            slot.error = in->geterror ();
+            return;
+        }
+        slot.ok = (slot.cancelled == 0);
+    }
+
+private:
+    std::vector<std::string> m_filenames;
+    std::vector<int> m_numbers;
+    TypeDesc m_format;
+    int m_ahead;                  // Frames to read beyond the current one
+    int m_nslots;                 // m_ahead+1
+    int m_current;                // Index of the frame next() returns
+    boost::scoped_array<Slot> m_slots;
+    task_set m_tasks;
+    mutable mutex m_err_mutex;
+    mutable std::string m_err;
+
+    // The read progress callback doubles as the cancellation check.
+    static bool progress (void *data, float /*done*/) {
+        return ((Slot *)data)->cancelled != 0;
+    }
+
+    bool in_window (int index) const {
+        return index >= m_current && index <= m_current + m_ahead;
+    }
+
+    // Make sure that the current frame and the m_ahead that follow it
+    // are being read.
+    void fill_window () {
+        int end = std::min (m_current + m_ahead + 1, nframes());
+        for (int i = m_current;  i < end;  ++i)
+            schedule (i);
+    }
+
+    void schedule (int index) {
+        Slot &slot (m_slots[index % m_nslots]);
+        if (slot.index == index && slot.state != Idle && ! slot.cancelled)
+            return;   // already read or on its way
+        cancel (slot);
+        wait (slot);
+        release (slot);
+        slot.index = index;
+        slot.cancelled = 0;
+        slot.state = Queued;
+        ReadTask task;
+        task.impl = this;
+        task.slot = &slot;
+        m_tasks.push (task);
+    }
+
+    // Ask for a slot's read to stop, and take it back right away if no
+    // task has started it.  A slot that was already read is left alone.
+    void cancel (Slot &slot) {
+        if (slot.state.bool_compare_and_swap (Queued, Idle))
+            return;
+        if (slot.state == Reading)
+            slot.cancelled = 1;
+    }
+
+    // Wait for a read task to finish with the slot, helping with the
+    // pool's work in the meantime (like task_set::wait).
+    void wait (Slot &slot) {
+        atomic_backoff backoff;
+        while (slot.state == Reading) {
+            if (! m_tasks.pool()->run_one_task ())
+                backoff ();
+        }
+    }
+
+    void release (Slot &slot) {
+        slot.buf.clear ();
+        slot.error.clear ();
+        slot.ok = false;
+        slot.index = -1;
+        slot.state = Idle;
+    }
+};
+
+
+
+ImageSequenceReader::ImageSequenceReader ()
+    : m_impl (new Impl)
+{
+}
+
+
+
+ImageSequenceReader::~ImageSequenceReader ()
+{
+    delete m_impl;
+}
+
+
+
+bool
+ImageSequenceReader::open (string_view pattern, string_view framespec,
+                           int ahead, TypeDesc format)
+{
+    std::string normalized, range;
+    if (! Filesystem::parse_pattern (pattern.c_str(), 0, normalized, range)) {
+        close ();
+        m_impl->error ("\"%s\" is not an image sequence pattern", pattern);
+        return false;
+    }
+    if (framespec.size())
+        range = framespec;
+
+    std::vector<int> numbers;
+    std::vector<std::string> filenames;
+    if (range.size()) {
+        if (! Filesystem::enumerate_sequence (range, numbers)) {
+            close ();
+            m_impl->error ("Invalid frame range \"%s\"", range);
+            return false;
+        }
+        Filesystem::enumerate_file_sequence (normalized, numbers, filenames);
+    } else if (! Filesystem::scan_for_matching_filenames (normalized, numbers,
+                                                          filenames)
+               || filenames.empty()) {
+        close ();
+        m_impl->error ("No files matching \"%s\"", pattern);
+        return false;
+    }
+    return m_impl->open (filenames, numbers, ahead, format);
+}
+
+
+
+bool
+ImageSequenceReader::open (const std::vector<std::string> &filenames,
+                           int ahead, TypeDesc format)
+{
+    return m_impl->open (filenames, std::vector<int>(), ahead, format);
+}
+
+
+
+void
+ImageSequenceReader::close ()
+{
+    m_impl->close ();
+}
+
+
+
+int
+ImageSequenceReader::nframes () const
+{
+    return m_impl->nframes ();
+}
+
+
+
+int
+ImageSequenceReader::frame_number (int index) const
+{
+    return m_impl->frame_number (index);
+}
+
+
+
+const std::string &
+ImageSequenceReader::filename (int index) const
+{
+    return m_impl->filename (index);
+}
+
+
+
+int
+ImageSequenceReader::current () const
+{
+    return m_impl->current ();
+}
+
+
+
+bool
+ImageSequenceReader::next (ImageBuf &buf)
+{
+    return m_impl->next (buf);
+}
+
+
+
+bool
+ImageSequenceReader::seek (int index)
+{
+    return m_impl->seek (index);
+}
+
+
+
+void
+ImageSequenceReader::cancel ()
+{
+    m_impl->cancel ();
+}
+
+
+
+std::string
+ImageSequenceReader::geterror () const
+{
+    return m_impl->geterror ();
+}
+
+
+OIIO_NAMESPACE_END
@@ -31,6 +31,7 @@
 
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/fmath.h"
+#include "OpenImageIO/strutil.h"
 #include "OpenImageIO/unittest.h"
 
 OIIO_NAMESPACE_USING;
@@ -233,12 +234,68 @@ test_get_attribute ()
 
 
 
+// Exercise lookups in metadata lists long enough to be indexed, including
+// names differing only in case, and edits that must keep the index honest.
+static void
+test_attribute_index ()
+{
+    std::cout << "test_attribute_index\n";
+    ImageSpec spec (64, 64, 3, TypeDesc::UINT8);
+    for (int i = 0; i < 200; ++i)
+        spec.attribute (Strutil::format ("attr%d", i), i);
+    spec.attribute ("Dup", 1);
+    float half = 0.5f;
+    ImageIOParameter dup ("dup", TypeDesc::TypeFloat, 1, &half);
+    spec.extra_attribs.push_back (dup);   // bypass the duplicate check
+
+    const ImageSpec &cspec (spec);
+    OIIO_CHECK_EQUAL (cspec.get_int_attribute ("attr0", -1), 0);
+    OIIO_CHECK_EQUAL (cspec.get_int_attribute ("attr137", -1), 137);
+    OIIO_CHECK_EQUAL (cspec.get_int_attribute ("ATTR199", -1), 199);
+    OIIO_CHECK_ASSERT (cspec.find_attribute ("ATTR199", TypeDesc::UNKNOWN, true) == NULL);
+    OIIO_CHECK_ASSERT (cspec.find_attribute ("attr200") == NULL);
+    OIIO_CHECK_EQUAL (cspec.find_attribute ("dup")->name(), "Dup");
+    OIIO_CHECK_EQUAL (cspec.find_attribute ("dup", TypeDesc::UNKNOWN, true)->name(), "dup");
+    OIIO_CHECK_EQUAL (cspec.find_attribute ("DUP", TypeDesc::FLOAT)->name(), "dup");
+    OIIO_CHECK_ASSERT (cspec.find_attribute ("Dup", TypeDesc::FLOAT, true) == NULL);
+    OIIO_CHECK_ASSERT (cspec.extra_attribs.find (ustring("attr42")) != cspec.extra_attribs.cend());
+
+    // Changing and removing entries must be seen by later lookups
+    spec.attribute ("attr5", "five");
+    OIIO_CHECK_EQUAL (cspec.get_string_attribute ("attr5"), "five");
+    int six = 6;
+    spec.find_attribute ("attr6")->init ("renamed", TypeDesc::TypeInt, 1, &six);
+    OIIO_CHECK_ASSERT (cspec.find_attribute ("attr6") == NULL);
+    OIIO_CHECK_ASSERT (cspec.find_attribute ("ATTR6") == NULL);
+    spec.extra_attribs.reindex ();   // so the new name can be found
+    OIIO_CHECK_ASSERT (cspec.find_attribute ("renamed") != NULL);
+    // Changing values in place, or walking the list, keeps the index
+    spec.extra_attribs[10].init ("attr10", TypeDesc::TypeInt, 1, &six);
+    OIIO_CHECK_ASSERT (spec.extra_attribs.begin() != spec.extra_attribs.end());
+    OIIO_CHECK_EQUAL (cspec.get_int_attribute ("attr10", -1), 6);
+    spec.erase_attribute ("attr7");
+    OIIO_CHECK_ASSERT (cspec.find_attribute ("attr7") == NULL);
+    OIIO_CHECK_EQUAL (cspec.get_int_attribute ("attr8", -1), 8);
+    spec.attribute ("attr7", 77);
+    OIIO_CHECK_EQUAL (cspec.get_int_attribute ("attr7", -1), 77);
+
+    // Copies have their own index
+    ImageSpec copy (spec);
+    copy.erase_attribute ("attr9");
+    OIIO_CHECK_ASSERT (copy.find_attribute ("attr9") == NULL);
+    OIIO_CHECK_EQUAL (cspec.get_int_attribute ("attr9", -1), 9);
+    OIIO_CHECK_EQUAL (copy.extra_attribs.size(), spec.extra_attribs.size()-1);
+}
+
+
+
 int main (int argc, char *argv[])
 {
     test_imagespec_pixels ();
     test_imagespec_metadata_val ();
     test_imagespec_attribute_from_string ();
     test_get_attribute ();
+    test_attribute_index ();
 
     return unit_test_failures;
 }
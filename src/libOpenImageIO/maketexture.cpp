@@ -34,6 +34,7 @@
 #include <iostream>
 #include <iterator>
 #include <limits>
+#include <map>
 #include <sstream>
 
 #include <boost/version.hpp>
@@ -56,13 +57,11 @@
 #include "OpenImageIO/thread.h"
 #include "OpenImageIO/filter.h"
 #include "OpenImageIO/refcnt.h"
+#include "OpenImageIO/hash.h"
 
 OIIO_NAMESPACE_USING
 
 
-static spin_mutex maketx_mutex;   // for anything that needs locking
-
-
 
 static Filter2D *
 setup_filter (const ImageSpec &dstspec, const ImageSpec &srcspec,
@@ -326,7 +325,8 @@ resize_block (ImageBuf &dst, const ImageBuf &src, ROI roi, bool envlatlmode,
     DASSERT (dstspec.nchannels == srcspec.nchannels);
     DASSERT (dst.localpixels());
     bool ok;
-    if (src.localpixels() &&                      // Not a cached image
+    if (src.localpixels() && src.contiguous() &&  // Not a cached image
+        dst.contiguous() &&                       // or app's strided buffer
         !envlatlmode &&                           // not latlong wrap mode
         roi.xbegin == 0 &&                        // Region x at origin
         dstspec.width == roi.width() &&           // Full width ROI
@@ -348,32 +348,6 @@ resize_block (ImageBuf &dst, const ImageBuf &src, ROI roi, bool envlatlmode,
 
 
 
-// Copy src into dst, but only for the range [x0,x1) x [y0,y1).
-static void
-check_nan_block (const ImageBuf &src, ROI roi, int &found_nonfinite)
-{
-    int x0 = roi.xbegin, x1 = roi.xend, y0 = roi.ybegin, y1 = roi.yend;
-    const ImageSpec &spec (src.spec());
-    float *pel = ALLOCA (float, spec.nchannels);
-    for (int y = y0;  y < y1;  ++y) {
-        for (int x = x0;  x < x1;  ++x) {
-            src.getpixel (x, y, pel);
-            for (int c = 0;  c < spec.nchannels;  ++c) {
-                if (! isfinite(pel[c])) {
-                    spin_lock lock (maketx_mutex);
-                    if (found_nonfinite < 3)
-                        std::cerr << "maketx ERROR: Found " << pel[c]
-                                  << " at (x=" << x << ", y=" << y << ")\n";
-                    ++found_nonfinite;
-                    break;  // skip other channels, there's no point
-                }
-            }
-        }
-    }
-}
-
-
-
 inline Imath::V3f
 latlong_to_dir (float s, float t, bool y_is_up=true)
 {
@@ -430,6 +404,194 @@ lightprobe_to_envlatl (ImageBuf &dst, const ImageBuf &src, bool y_is_up,
 
 
 
+// Cube face directions, in the file order px, nx, py, ny, pz, nz of a
+// 1x6 stack: for each face, the major axis and the directions of +s (to
+// the right) and +t (down) across it.  See the comments at the top of
+// libtexture/environment.cpp.
+static const float cubeface_axes[6][3][3] = {
+    { { 1, 0, 0 }, {  0, 0, -1 }, { 0, -1,  0 } },   // px
+    { {-1, 0, 0 }, {  0, 0,  1 }, { 0, -1,  0 } },   // nx
+    { { 0, 1, 0 }, {  1, 0,  0 }, { 0,  0,  1 } },   // py
+    { { 0,-1, 0 }, {  1, 0,  0 }, { 0,  0, -1 } },   // ny
+    { { 0, 0, 1 }, {  1, 0,  0 }, { 0, -1,  0 } },   // pz
+    { { 0, 0,-1 }, { -1, 0,  0 }, { 0, -1,  0 } }    // nz
+};
+
+
+
+// Return the direction of position (s,t), on 0-1, of the given cube face.
+inline Imath::V3f
+cubeface_to_dir (int face, float s, float t)
+{
+    const float (*a)[3] = cubeface_axes[face];
+    float u = 2.0f*s - 1.0f, v = 2.0f*t - 1.0f;
+    Imath::V3f V (a[0][0] + u*a[1][0] + v*a[2][0],
+                  a[0][1] + u*a[1][1] + v*a[2][1],
+                  a[0][2] + u*a[1][2] + v*a[2][2]);
+    return V.normalize();
+}
+
+
+
+// The inverse of latlong_to_dir, matching the lookup's conventions.
+inline void
+dir_to_latlong (const Imath::V3f &V, bool y_is_up, float &s, float &t)
+{
+    if (y_is_up) {
+        s = atan2f (-V[0], V[2]) / (2.0f*(float)M_PI) + 0.5f;
+        t = 0.5f - atan2f (V[1], hypotf(V[2],-V[0])) / (float)M_PI;
+    } else {
+        s = atan2f (V[1], V[0]) / (2.0f*(float)M_PI) + 0.5f;
+        t = 0.5f - atan2f (V[2], hypotf(V[0],V[1])) / (float)M_PI;
+    }
+}
+
+
+
+// Resample the lat-long environment map src into dst, a 1x6 stack of
+// cube faces (px, nx, py, ny, pz, nz), whose edge texels lie exactly on
+// the cube's edges (the "oiio:sampleborder" convention), so that texels
+// shared by neighboring faces get the same directions.
+static bool
+envlatl_to_envcube (ImageBuf &dst, const ImageBuf &src, bool y_is_up,
+                    bool src_sampleborder, ROI roi=ROI::All(), int nthreads=0)
+{
+    ASSERT (dst.initialized() && src.nchannels() == dst.nchannels());
+    if (! roi.defined())
+        roi = get_roi (dst.spec());
+    roi.chend = std::min (roi.chend, dst.nchannels());
+
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            OIIO::bind(envlatl_to_envcube, OIIO::ref(dst),
+                        OIIO::cref(src), y_is_up, src_sampleborder,
+                        _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    const ImageSpec &dstspec (dst.spec());
+    const ImageSpec &srcspec (src.spec());
+    int nchannels = dstspec.nchannels;
+    ASSERT (dstspec.format == TypeDesc::FLOAT);
+
+    float *pixel = ALLOCA (float, nchannels);
+    int res = dstspec.width;
+    float scale = res > 1 ? 1.0f / (res - 1) : 0.0f;
+    float w = srcspec.width, h = srcspec.height;
+    float ymin = src.ybegin() + 0.5f, ymax = src.yend() - 0.5f;
+    for (ImageBuf::Iterator<float> d (dst, roi);  ! d.done();  ++d) {
+        int x = d.x() - dst.xbegin(), y = d.y() - dst.ybegin();
+        float fs = res > 1 ? x * scale : 0.5f;
+        float ft = res > 1 ? (y % res) * scale : 0.5f;
+        Imath::V3f V = cubeface_to_dir (y / res, fs, ft);
+        float s, t;
+        dir_to_latlong (V, y_is_up, s, t);
+        // Pixel (i,j) of src is at image plane (i+0.5,j+0.5).  Wrap
+        // around in s, but keep t within the rows at the poles.
+        float xs = src_sampleborder ? s * (w-1.0f) + 0.5f : s * w;
+        float yt = src_sampleborder ? t * (h-1.0f) + 0.5f : t * h;
+        src.interppixel (src.xbegin() + xs,
+                         Imath::clamp (src.ybegin() + yt, ymin, ymax),
+                         pixel, ImageBuf::WrapPeriodic);
+        for (int c = roi.chbegin;  c < roi.chend;  ++c)
+            d[c] = pixel[c];
+    }
+
+    return true;
+}
+
+
+
+// Bilinearly interpolate texel coordinates (x,y) of one face of a 1x6
+// stack of cube faces of resolution res, never straying off the face.
+static void
+envcube_interp (const ImageBuf &buf, int face, int res, float x, float y,
+                float *pixel, float *p0, float *p1, float *p2, float *p3)
+{
+    x = Imath::clamp (x, 0.0f, float(res-1));
+    y = Imath::clamp (y, 0.0f, float(res-1));
+    int xi, yi;
+    float xfrac = floorfrac (x, &xi);
+    float yfrac = floorfrac (y, &yi);
+    int xn = std::min (xi+1, res-1), yn = std::min (yi+1, res-1);
+    int x0 = buf.xbegin(), y0 = buf.ybegin() + face * res;
+    buf.getpixel (x0+xi, y0+yi, p0);
+    buf.getpixel (x0+xn, y0+yi, p1);
+    buf.getpixel (x0+xi, y0+yn, p2);
+    buf.getpixel (x0+xn, y0+yn, p3);
+    bilerp (p0, p1, p2, p3, xfrac, yfrac, buf.nchannels(), pixel);
+}
+
+
+
+// Downsample src, a 1x6 stack of cube faces, into dst, whose faces are
+// half the resolution.  Each face is filtered on its own, so that nothing
+// bleeds in from the faces that merely happen to be next to it in the
+// stack.  Since the edge texels of the faces lie exactly on the cube
+// edges, and so are shared with the neighboring faces, we filter those
+// only along the edge, from the edge texels of src, which keeps them
+// identical on both faces at every MIP level.
+static bool
+envcube_downsample (ImageBuf &dst, const ImageBuf &src,
+                    ROI roi=ROI::All(), int nthreads=0)
+{
+    ASSERT (dst.initialized() && src.nchannels() == dst.nchannels());
+    if (! roi.defined())
+        roi = get_roi (dst.spec());
+    roi.chend = std::min (roi.chend, dst.nchannels());
+
+    if (nthreads != 1 && roi.npixels() >= 1000) {
+        // Lots of pixels and request for multi threads? Parallelize.
+        ImageBufAlgo::parallel_image (
+            OIIO::bind(envcube_downsample, OIIO::ref(dst), OIIO::cref(src),
+                        _1 /*roi*/, 1 /*nthreads*/),
+            roi, nthreads);
+        return true;
+    }
+
+    // Serial case
+    ASSERT (dst.spec().format == TypeDesc::FLOAT);
+    int nchannels = src.nchannels();
+    float *pixel = ALLOCA (float, nchannels);
+    float *sum = ALLOCA (float, nchannels);
+    float *p = ALLOCA (float, 4*nchannels);
+    int res = dst.spec().width, srcres = src.spec().width;
+    float scale = res > 1 ? float(srcres-1) / float(res-1) : 0.0f;
+    static const float offsets[2] = { -0.5f, 0.5f };
+    for (ImageBuf::Iterator<float> d (dst, roi);  ! d.done();  ++d) {
+        int x = d.x() - dst.xbegin(), y = d.y() - dst.ybegin();
+        int face = y / res;
+        y -= face * res;
+        bool sedge = res > 1 && (x == 0 || x == res-1);
+        bool tedge = res > 1 && (y == 0 || y == res-1);
+        float sx = res > 1 ? x * scale : 0.5f * (srcres-1);
+        float sy = res > 1 ? y * scale : 0.5f * (srcres-1);
+        int ns = sedge ? 1 : 2, nt = tedge ? 1 : 2;
+        for (int c = 0;  c < nchannels;  ++c)
+            sum[c] = 0.0f;
+        for (int j = 0;  j < nt;  ++j) {
+            for (int i = 0;  i < ns;  ++i) {
+                envcube_interp (src, face, srcres,
+                                sedge ? sx : sx + offsets[i],
+                                tedge ? sy : sy + offsets[j], pixel,
+                                p, p+nchannels, p+2*nchannels, p+3*nchannels);
+                for (int c = 0;  c < nchannels;  ++c)
+                    sum[c] += pixel[c];
+            }
+        }
+        float w = 1.0f / (ns * nt);
+        for (int c = roi.chbegin;  c < roi.chend;  ++c)
+            d[c] = sum[c] * w;
+    }
+
+    return true;
+}
+
+
+
 static void
 fix_latl_edges (ImageBuf &buf)
 {
@@ -470,6 +632,230 @@ fix_latl_edges (ImageBuf &buf)
 
 
 
+// Compute the importance sampling tables for a lat-long environment map,
+// binning the luminance of buf into a table of (at most) width x width/2
+// cells, weighted by the solid angle of each row.  The result is written
+// as a comma-separated list: the table width and height, then the
+// marginal CDF over rows (height values), then the conditional CDF of
+// each row (width values per row).  Each CDF holds the cumulative
+// probability at the end of each bin, so its last entry is 1.
+static std::string
+envlatl_importance_table (const ImageBuf &buf, int width, bool sampleborder)
+{
+    const ImageSpec &spec (buf.spec());
+    width = Imath::clamp (width, 1, spec.width);
+    int height = Imath::clamp (width/2, 1, spec.height);
+    std::vector<double> cells (width*height, 0.0);
+    int nc = spec.nchannels;
+    float sscale = sampleborder ? 1.0f / std::max (spec.width-1, 1)
+                                : 1.0f / spec.width;
+    float tscale = sampleborder ? 1.0f / std::max (spec.height-1, 1)
+                                : 1.0f / spec.height;
+    float soffset = sampleborder ? 0.0f : 0.5f;
+    for (ImageBuf::ConstIterator<float> p (buf);  ! p.done();  ++p) {
+        float lum = (nc >= 3) ? (0.2126f*p[0] + 0.7152f*p[1] + 0.0722f*p[2])
+                              : p[0];
+        if (! (lum > 0.0f))   // also rejects NaN
+            continue;
+        float s = (p.x() - spec.x + soffset) * sscale;
+        float t = (p.y() - spec.y + soffset) * tscale;
+        int i = Imath::clamp (int(s * width), 0, width-1);
+        int j = Imath::clamp (int(t * height), 0, height-1);
+        cells[j*width+i] += lum;
+    }
+
+    std::vector<double> marginal (height);
+    std::vector<double> conditional (width*height);
+    double total = 0.0;
+    for (int j = 0;  j < height;  ++j) {
+        // Rows near the poles subtend less solid angle.
+        double sintheta = sin (M_PI * (j + 0.5) / height);
+        double *c = &conditional[j*width];
+        double rowsum = 0.0;
+        for (int i = 0;  i < width;  ++i)
+            c[i] = (rowsum += cells[j*width+i] * sintheta);
+        for (int i = 0;  i < width;  ++i)
+            c[i] = rowsum > 0.0 ? c[i] / rowsum : double(i+1) / width;
+        marginal[j] = (total += rowsum);
+    }
+    for (int j = 0;  j < height;  ++j)
+        marginal[j] = total > 0.0 ? marginal[j] / total : double(j+1) / height;
+
+    std::ostringstream os;
+    os << width << "," << height;
+    for (int j = 0;  j < height;  ++j)
+        os << "," << float(marginal[j]);
+    for (int i = 0;  i < width*height;  ++i)
+        os << "," << float(conditional[i]);
+    return os.str();
+}
+
+
+
+// Decode the "maketx:minmax" option (one of "", "min", "max", or
+// "minmax") for a texture with nbase channels of its own: set the first
+// channel of the appended min and max channels (or -1 if there are none).
+// Return false if the option is not recognized.
+static bool
+minmax_layout (string_view minmax, int nbase, int &minchan, int &maxchan)
+{
+    minchan = maxchan = -1;
+    if (minmax == "min") {
+        minchan = nbase;
+    } else if (minmax == "max") {
+        maxchan = nbase;
+    } else if (minmax == "minmax") {
+        minchan = nbase;
+        maxchan = 2*nbase;
+    } else if (minmax.size()) {
+        return false;
+    }
+    return true;
+}
+
+
+
+// Compute, into dst (of the given resolution and src's channels), the
+// min and max channels of src reduced conservatively: each dst pixel
+// gets the min (or max) over all the src pixels it overlaps.  The other
+// channels of dst are left zero.
+static void
+minmax_downsample (ImageBuf &dst, const ImageBuf &src, int width, int height,
+                   int nbase, int minchan, int maxchan)
+{
+    ImageSpec spec (width, height, src.nchannels(), TypeDesc::FLOAT);
+    dst.reset (spec);
+    ImageBufAlgo::zero (dst);
+    const ImageSpec &srcspec (src.spec());
+    int nc = src.nchannels();
+    float *srcpel = ALLOCA (float, nc);
+    float *pel = ALLOCA (float, nc);
+    for (int y = 0;  y < height;  ++y) {
+        int y0 = srcspec.y + (y * srcspec.height) / height;
+        int y1 = srcspec.y + ((y+1) * srcspec.height + height - 1) / height;
+        for (int x = 0;  x < width;  ++x) {
+            int x0 = srcspec.x + (x * srcspec.width) / width;
+            int x1 = srcspec.x + ((x+1) * srcspec.width + width - 1) / width;
+            for (int c = 0;  c < nbase;  ++c) {
+                if (minchan >= 0)
+                    pel[minchan+c] = std::numeric_limits<float>::max();
+                if (maxchan >= 0)
+                    pel[maxchan+c] = -std::numeric_limits<float>::max();
+            }
+            for (int j = y0;  j < y1;  ++j) {
+                for (int i = x0;  i < x1;  ++i) {
+                    src.getpixel (i, j, srcpel);
+                    for (int c = 0;  c < nbase;  ++c) {
+                        if (minchan >= 0)
+                            pel[minchan+c] = std::min (pel[minchan+c], srcpel[minchan+c]);
+                        if (maxchan >= 0)
+                            pel[maxchan+c] = std::max (pel[maxchan+c], srcpel[maxchan+c]);
+                    }
+                }
+            }
+            dst.setpixel (x, y, pel);
+        }
+    }
+}
+
+
+
+// Copy just the min and max channels of bounds (as computed by
+// minmax_downsample) into the same-sized image buf.
+static void
+minmax_replace (ImageBuf &buf, const ImageBuf &bounds,
+                int nbase, int minchan, int maxchan)
+{
+    int nc = buf.nchannels();
+    float *pel = ALLOCA (float, nc);
+    float *bpel = ALLOCA (float, nc);
+    for (int y = 0;  y < bounds.spec().height;  ++y) {
+        for (int x = 0;  x < bounds.spec().width;  ++x) {
+            int bx = buf.xbegin() + x, by = buf.ybegin() + y;
+            buf.getpixel (bx, by, pel);
+            bounds.getpixel (x, y, bpel);
+            for (int c = 0;  c < nbase;  ++c) {
+                if (minchan >= 0)
+                    pel[minchan+c] = bpel[minchan+c];
+                if (maxchan >= 0)
+                    pel[maxchan+c] = bpel[maxchan+c];
+            }
+            buf.setpixel (bx, by, pel);
+        }
+    }
+}
+
+
+
+// Number of slope moment channels appended by maketx:lean.
+static const int nlean_channels = 5;
+
+
+
+// Compute into dst the LEAN slope moments (bx, by, bx^2, by^2, bx*by)
+// of each pixel of src, where the slope b is taken from the first three
+// channels as a tangent-space normal (mode "normal" for normals in
+// [-1,1], "normal01" for normals stored as 0.5*n+0.5), with b = n.xy/n.z,
+// or from channel 0 as a height (mode "bump"), differentiated with
+// respect to s and t (the image's x and y, over the whole [0,1] range).
+// Because the moments are linear, ordinary MIP filtering of them yields
+// the mean slope and its covariance over any footprint.  Return false if
+// the mode is unknown or src lacks the channels it needs.
+static bool
+lean_moments (ImageBuf &dst, const ImageBuf &src, string_view mode)
+{
+    bool bump = (mode == "bump");
+    bool normal01 = (mode == "normal01");
+    if (! bump && ! normal01 && mode != "normal")
+        return false;
+    if (src.nchannels() < (bump ? 1 : 3))
+        return false;
+    const ImageSpec &srcspec (src.spec());
+    ImageSpec spec (srcspec.width, srcspec.height, nlean_channels,
+                    TypeDesc::FLOAT);
+    spec.x = srcspec.x;
+    spec.y = srcspec.y;
+    dst.reset (spec);
+    int nc = src.nchannels();
+    float *pel = ALLOCA (float, nc);
+    float *pel0 = ALLOCA (float, nc);
+    float *pel1 = ALLOCA (float, nc);
+    int xend = srcspec.x + srcspec.width, yend = srcspec.y + srcspec.height;
+    for (int y = srcspec.y;  y < yend;  ++y) {
+        for (int x = srcspec.x;  x < xend;  ++x) {
+            float bx, by;
+            if (bump) {
+                // Central differences, one-sided at the edges.
+                int x0 = std::max (x-1, srcspec.x), x1 = std::min (x+1, xend-1);
+                int y0 = std::max (y-1, srcspec.y), y1 = std::min (y+1, yend-1);
+                src.getpixel (x0, y, pel0);
+                src.getpixel (x1, y, pel1);
+                bx = x1 > x0 ? (pel1[0] - pel0[0]) / (x1 - x0) * srcspec.full_width : 0.0f;
+                src.getpixel (x, y0, pel0);
+                src.getpixel (x, y1, pel1);
+                by = y1 > y0 ? (pel1[0] - pel0[0]) / (y1 - y0) * srcspec.full_height : 0.0f;
+            } else {
+                src.getpixel (x, y, pel);
+                float nx = pel[0], ny = pel[1], nz = pel[2];
+                if (normal01) {
+                    nx = 2.0f*nx - 1.0f;
+                    ny = 2.0f*ny - 1.0f;
+                    nz = 2.0f*nz - 1.0f;
+                }
+                // Keep grazing (or bogus) normals from blowing up.
+                nz = std::max (nz, 1.0e-3f);
+                bx = nx / nz;
+                by = ny / nz;
+            }
+            float m[nlean_channels] = { bx, by, bx*bx, by*by, bx*by };
+            dst.setpixel (x, y, m);
+        }
+    }
+    return true;
+}
+
+
+
 static std::string
 formatres (const ImageSpec &spec, bool extended=false)
 {
@@ -492,6 +878,70 @@ formatres (const ImageSpec &spec, bool extended=false)
 
 
 
+// Compute a fast hash of the header and native pixels of the first
+// subimage of the given file, reading it a strip at a time so that even
+// huge sources need little memory.  Return the empty string if the file
+// can't be read.
+static std::string
+source_content_hash (const std::string &filename)
+{
+    ImageInput *in = ImageInput::open (filename);
+    if (! in)
+        return std::string();
+    const ImageSpec &spec (in->spec());
+    std::string header = spec.to_xml();
+    unsigned long long hash = xxhash::XXH64 (header.data(), header.size(), 0);
+    int striprows = spec.tile_width ? std::max (spec.tile_height, 1) : 64;
+    std::vector<char> strip (imagesize_t(spec.width) * striprows *
+                             std::max (spec.tile_depth, 1) *
+                             spec.pixel_bytes (true));
+    bool ok = true;
+    for (int z = spec.z;  ok && z < spec.z+spec.depth;
+         z += (spec.tile_width ? std::max (spec.tile_depth, 1) : 1)) {
+        for (int y = spec.y;  ok && y < spec.y+spec.height;  y += striprows) {
+            int yend = std::min (y+striprows, spec.y+spec.height);
+            size_t bytes;
+            if (spec.tile_width) {
+                int zend = std::min (z+std::max (spec.tile_depth, 1),
+                                     spec.z+spec.depth);
+                ok = in->read_tiles (spec.x, spec.x+spec.width, y, yend,
+                                     z, zend, TypeDesc::UNKNOWN, &strip[0]);
+                bytes = imagesize_t(spec.width) * (yend-y) * (zend-z) *
+                        spec.pixel_bytes (true);
+            } else {
+                ok = in->read_scanlines (y, yend, z, TypeDesc::UNKNOWN,
+                                         &strip[0]);
+                bytes = imagesize_t(spec.width) * (yend-y) *
+                        spec.pixel_bytes (true);
+            }
+            hash = xxhash::XXH64 (&strip[0], bytes, hash);
+        }
+    }
+    in->close ();
+    ImageInput::destroy (in);
+    return ok ? Strutil::format ("%016llx", hash) : std::string();
+}
+
+
+
+// Compute a hash of everything about the conversion settings that could
+// change the output texture: the mode and the configuration, ignoring
+// the options that only affect console messages.
+static std::string
+settings_hash (ImageBufAlgo::MakeTextureMode mode, const ImageSpec &configspec)
+{
+    ImageSpec settings = configspec;
+    settings.erase_attribute ("maketx:full_command_line");
+    settings.erase_attribute ("maketx:verbose");
+    settings.erase_attribute ("maketx:runstats");
+    settings.erase_attribute ("maketx:updatemode");
+    std::string s = Strutil::format ("%d ", (int)mode) + settings.to_xml();
+    return Strutil::format ("%016llx",
+                            xxhash::XXH64 (s.data(), s.size(), 0));
+}
+
+
+
 static void
 maketx_merge_spec (ImageSpec &dstspec, const ImageSpec &srcspec)
 {
@@ -509,6 +959,245 @@ maketx_merge_spec (ImageSpec &dstspec, const ImageSpec &srcspec)
 
 
 
+// For each tile (in the output tiling of spec) of the tile-index region
+// tiles, determine whether buf is a single color throughout it, and if
+// so store that color -- quantized to spec.format, as it will be in the
+// file -- in colors[tile*nchannels...] and set isconstant[tile].
+static bool
+constant_tiles_block (const ImageBuf &buf, const ImageSpec &spec, ROI tiles,
+                      std::vector<float> *colors, std::vector<char> *isconstant)
+{
+    int nc = spec.nchannels;
+    int nx = (spec.width + spec.tile_width - 1) / spec.tile_width;
+    int ny = (spec.height + spec.tile_height - 1) / spec.tile_height;
+    std::vector<char> quantized (nc * spec.format.size());
+    for (int tz = tiles.zbegin;  tz < tiles.zend;  ++tz) {
+        for (int ty = tiles.ybegin;  ty < tiles.yend;  ++ty) {
+            for (int tx = tiles.xbegin;  tx < tiles.xend;  ++tx) {
+                int x = buf.xbegin() + tx * spec.tile_width;
+                int y = buf.ybegin() + ty * spec.tile_height;
+                int z = buf.zbegin() + tz * spec.tile_depth;
+                ROI roi (x, std::min (x + spec.tile_width, buf.xend()),
+                         y, std::min (y + spec.tile_height, buf.yend()),
+                         z, std::min (z + spec.tile_depth, buf.zend()),
+                         0, nc);
+                size_t tile = (size_t(tz) * ny + ty) * nx + tx;
+                float *color = &(*colors)[tile * nc];
+                if (ImageBufAlgo::isConstantColor (buf, color, roi, 1)) {
+                    convert_types (TypeDesc::FLOAT, color, spec.format,
+                                   &quantized[0], nc);
+                    convert_types (spec.format, &quantized[0],
+                                   TypeDesc::FLOAT, color, nc);
+                    (*isconstant)[tile] = 1;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+
+
+// Build the "oiio:ConstantTiles" table that tells the ImageCache which
+// tiles of this level of buf (tiled as in spec) are a single color:
+//     nxtiles,nytiles,nztiles,nchannels,ncolors,
+//     ncolors*nchannels color values, then
+//     runs of (tile count, color index or -1) covering every tile
+// in order.  Return the empty string if there are no constant tiles.
+static std::string
+constant_tile_table (const ImageBuf &buf, const ImageSpec &spec)
+{
+    const int maxcolors = 256;  // Further colors are stored as ordinary tiles
+    int nc = spec.nchannels;
+    int nx = (spec.width + spec.tile_width - 1) / spec.tile_width;
+    int ny = (spec.height + spec.tile_height - 1) / spec.tile_height;
+    int nz = (spec.depth + spec.tile_depth - 1) / spec.tile_depth;
+    size_t ntiles = size_t(nx) * ny * nz;
+    std::vector<float> colors (ntiles * nc);
+    std::vector<char> isconstant (ntiles, 0);
+    ImageBufAlgo::parallel_image (OIIO::bind (constant_tiles_block,
+                                              OIIO::cref(buf), OIIO::cref(spec),
+                                              _1, &colors, &isconstant),
+                                  ROI (0, nx, 0, ny, 0, nz));
+
+    std::map<std::vector<float>, int> palette;
+    std::vector<float> palettecolors;
+    std::vector<std::pair<size_t,int> > runs;
+    for (size_t t = 0;  t < ntiles;  ++t) {
+        int index = -1;
+        if (isconstant[t]) {
+            std::vector<float> c (&colors[t*nc], &colors[t*nc] + nc);
+            std::map<std::vector<float>, int>::iterator found = palette.find (c);
+            if (found != palette.end()) {
+                index = found->second;
+            } else if ((int)palette.size() < maxcolors) {
+                index = (int) palette.size();
+                palette[c] = index;
+                palettecolors.insert (palettecolors.end(), c.begin(), c.end());
+            }
+        }
+        if (runs.size() && runs.back().second == index)
+            ++runs.back().first;
+        else
+            runs.push_back (std::make_pair (size_t(1), index));
+    }
+    if (palette.empty())
+        return std::string();
+
+    std::string table = Strutil::format ("%d,%d,%d,%d,%d", nx, ny, nz, nc,
+                                         (int)palette.size());
+    for (size_t i = 0;  i < palettecolors.size();  ++i)
+        table += Strutil::format (",%.9g", palettecolors[i]);
+    for (size_t i = 0;  i < runs.size();  ++i)
+        table += Strutil::format (",%d,%d", (int)runs[i].first, runs[i].second);
+    return table;
+}
+
+
+
+// Hash the pixels (in the output data format of spec) of each tile in
+// the tile-index region tiles, storing them in hashes[tile].
+static bool
+tile_hashes_block (const ImageBuf &buf, const ImageSpec &spec, ROI tiles,
+                   std::vector<unsigned long long> *hashes)
+{
+    int nx = (spec.width + spec.tile_width - 1) / spec.tile_width;
+    int ny = (spec.height + spec.tile_height - 1) / spec.tile_height;
+    std::vector<char> pixels (spec.tile_bytes (true));
+    for (int tz = tiles.zbegin;  tz < tiles.zend;  ++tz) {
+        for (int ty = tiles.ybegin;  ty < tiles.yend;  ++ty) {
+            for (int tx = tiles.xbegin;  tx < tiles.xend;  ++tx) {
+                int x = buf.xbegin() + tx * spec.tile_width;
+                int y = buf.ybegin() + ty * spec.tile_height;
+                int z = buf.zbegin() + tz * spec.tile_depth;
+                ROI roi (x, std::min (x + spec.tile_width, buf.xend()),
+                         y, std::min (y + spec.tile_height, buf.yend()),
+                         z, std::min (z + spec.tile_depth, buf.zend()),
+                         0, spec.nchannels);
+                buf.get_pixels (roi, spec.format, &pixels[0]);
+                // Seed with the size, so that edge tiles only match
+                // tiles with the same valid region.
+                unsigned long long seed = (roi.width() * 65536ULL +
+                                           roi.height()) * 65536ULL + roi.depth();
+                size_t tile = (size_t(tz) * ny + ty) * nx + tx;
+                (*hashes)[tile] = xxhash::XXH64 (&pixels[0],
+                                    roi.npixels() * spec.pixel_bytes(), seed);
+            }
+        }
+    }
+    return true;
+}
+
+
+
+// Build the "oiio:TileHashes" table that lets the ImageCache share the
+// pixels of identical tiles of this level of buf (tiled as in spec):
+//     nxtiles,nytiles,nztiles,ngroups,
+// then for each group of two or more identical tiles:
+//     hash (16 hex digits),ntiles,tile indices...
+// Return the empty string if no two tiles are alike.
+static std::string
+tile_hash_table (const ImageBuf &buf, const ImageSpec &spec)
+{
+    int nx = (spec.width + spec.tile_width - 1) / spec.tile_width;
+    int ny = (spec.height + spec.tile_height - 1) / spec.tile_height;
+    int nz = (spec.depth + spec.tile_depth - 1) / spec.tile_depth;
+    size_t ntiles = size_t(nx) * ny * nz;
+    std::vector<unsigned long long> hashes (ntiles);
+    ImageBufAlgo::parallel_image (OIIO::bind (tile_hashes_block,
+                                              OIIO::cref(buf), OIIO::cref(spec),
+                                              _1, &hashes),
+                                  ROI (0, nx, 0, ny, 0, nz));
+
+    typedef std::map<unsigned long long, std::vector<int> > GroupMap;
+    GroupMap groups;
+    for (size_t t = 0;  t < ntiles;  ++t)
+        groups[hashes[t]].push_back ((int)t);
+    std::string entries;
+    int ngroups = 0;
+    for (GroupMap::const_iterator g = groups.begin();  g != groups.end();  ++g) {
+        if (g->second.size() < 2)
+            continue;
+        ++ngroups;
+        entries += Strutil::format (",%016llx,%d", g->first, (int)g->second.size());
+        for (size_t i = 0;  i < g->second.size();  ++i)
+            entries += Strutil::format (",%d", g->second[i]);
+    }
+    if (! ngroups)
+        return std::string();
+    return Strutil::format ("%d,%d,%d,%d", nx, ny, nz, ngroups) + entries;
+}
+
+
+
+// Record a per-level table (such as "oiio:ConstantTiles") for the level
+// about to be opened with spec, replacing any table left there from the
+// previous level.  Formats without arbitrary metadata carry it in the
+// ImageDescription.
+static void
+set_level_table (ImageSpec &spec, string_view name, const std::string &table,
+                 bool arbitrary_metadata)
+{
+    if (arbitrary_metadata) {
+        if (table.size())
+            spec.attribute (name, table);
+        else
+            spec.erase_attribute (name);
+        return;
+    }
+    std::string desc = spec.get_string_attribute ("ImageDescription");
+    desc = boost::regex_replace (desc, boost::regex(name.str() + "=[^ ]*[ ]*"), "");
+    if (table.size()) {
+        if (desc.length() && ! Strutil::ends_with (desc, " "))
+            desc += " ";
+        desc += name.str() + "=";
+        desc += table;
+    }
+    if (desc.size())
+        spec.attribute ("ImageDescription", desc);
+    else
+        spec.erase_attribute ("ImageDescription");
+}
+
+
+
+// Outcome of writing one MIP level, filled in by write_miplevel.
+struct MipWriteResult {
+    bool ok;
+    std::string error;
+    double writetime;
+    MipWriteResult () : ok(true), writetime(0.0) { }
+};
+
+
+
+// Write buf as the next MIP level of out -- first appending a new level
+// with the given spec and mode, if doopen is true.  This runs as a task,
+// concurrently with the computation of the following level, so it must
+// only read buf (whose shared_ptr it holds to keep it alive).
+static void
+write_miplevel (ImageOutput *out, const std::string &outputfilename,
+                const ImageSpec &spec, ImageOutput::OpenMode mode,
+                bool doopen, OIIO::shared_ptr<ImageBuf> buf,
+                MipWriteResult *result)
+{
+    Timer writetimer;
+    if (doopen && ! out->open (outputfilename.c_str(), spec, mode)) {
+        result->ok = false;
+        result->error = Strutil::format ("Could not append \"%s\" : %s",
+                                         outputfilename, out->geterror());
+    } else if (! buf->write (out)) {
+        // ImageBuf::write transfers any errors from the ImageOutput to
+        // the ImageBuf.
+        result->ok = false;
+        result->error = Strutil::format ("Write failed \"%s\" : %s",
+                                         outputfilename, buf->geterror());
+    }
+    result->writetime = writetimer();
+}
+
+
+
 static bool
 write_mipmap (ImageBufAlgo::MakeTextureMode mode,
               OIIO::shared_ptr<ImageBuf> &img,
@@ -521,6 +1210,7 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
               size_t &peak_mem)
 {
     bool envlatlmode = (mode == ImageBufAlgo::MakeTxEnvLatl);
+    bool envcubemode = (mode == ImageBufAlgo::MakeTxEnvCube);
     bool orig_was_overscan =
         (img->spec().x || img->spec().y || img->spec().z ||
          img->spec().full_x || img->spec().full_y || img->spec().full_z);
@@ -551,6 +1241,11 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
     }
     if (envlatlmode && src_samples_border)
         fix_latl_edges (*img);
+    // Our cube maps always put the face edges on the cube edges, as
+    // OpenEXR's do, so that the faces' MIP levels can be made (and
+    // looked up) without reference to their neighbors.
+    if (envcubemode)
+        outspec.attribute ("oiio:sampleborder", 1);
 
     bool do_highlight_compensation = configspec.get_int_attribute ("maketx:highlightcomp", 0);
     float sharpen = configspec.get_float_attribute ("maketx:sharpen", 0.0f);
@@ -566,6 +1261,16 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
         filtername = "lanczos3";
     }
 
+    bool constant_tiles = configspec.get_int_attribute ("maketx:constant_tiles") != 0;
+    bool tile_hashes = configspec.get_int_attribute ("maketx:tile_hashes") != 0;
+    bool arbitrary_metadata = out->supports ("arbitrary_metadata");
+    if (constant_tiles)
+        set_level_table (outspec, "oiio:ConstantTiles",
+                         constant_tile_table (*img, outspec), arbitrary_metadata);
+    if (tile_hashes)
+        set_level_table (outspec, "oiio:TileHashes",
+                         tile_hash_table (*img, outspec), arbitrary_metadata);
+
     Timer writetimer;
     if (! out->open (outputfilename.c_str(), outspec)) {
         outstream << "maketx ERROR: Could not open \"" << outputfilename
@@ -581,16 +1286,25 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
         outstream << "  Top level is " << formatres(outspec) << std::endl;
     }
 
-    if (! img->write (out)) {
-        // ImageBuf::write transfers any errors from the ImageOutput to
-        // the ImageBuf.
-        outstream << "maketx ERROR: Write failed \" : " << img->geterror() << "\n";
-        out->close ();
-        return false;
-    }
-
     stat_writetime += writetimer();
 
+    // The levels are pipelined: each one is written (and compressed) by
+    // a task on the thread pool while the next level is computed from
+    // it, so that the cores aren't left idle during the I/O.  Because
+    // the writer may be reading img at the same time, nothing below may
+    // modify a level's pixels after its write has been queued.  Doctor
+    // the top level's windows now (see the resize trick below) for the
+    // same reason; ImageBuf::write doesn't care about them.
+    if (mipmap)
+        img->set_full (img->xbegin(), img->xend(), img->ybegin(),
+                       img->yend(), img->zbegin(), img->zend());
+    // (writeresult must outlive writer, whose destructor waits for any
+    // write still in flight when we return early.)
+    MipWriteResult writeresult;
+    task_set writer;
+    writer.push (OIIO::bind (write_miplevel, out, outputfilename, outspec,
+                             ImageOutput::Create, false, img, &writeresult));
+
     if (mipmap) {  // Mipmap levels:
         if (verbose)
             outstream << "  Mipmapping...\n" << std::flush;
@@ -599,7 +1313,18 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
         if (mipimages_unsplit.length())
             Strutil::split (mipimages_unsplit, mipimages, ";");
         bool allow_shift = configspec.get_int_attribute("maketx:allow_pixel_shift") != 0;
-        
+        // Min and max channels are reduced conservatively, not filtered.
+        int minchan, maxchan;
+        string_view minmax = configspec.get_string_attribute ("maketx:minmax");
+        int nsets = 1 + (minmax == "min" || minmax == "max") + 2*(minmax == "minmax");
+        // (Any slope moment channels come last, and are just filtered.)
+        int nlean = configspec.get_string_attribute ("maketx:lean").size()
+                  ? nlean_channels : 0;
+        int nbase = (img->nchannels() - nlean) / nsets;
+        minmax_layout (minmax, nbase, minchan, maxchan);
+        bool do_minmax = (minchan >= 0 || maxchan >= 0);
+        ImageBuf bounds;
+
         OIIO::shared_ptr<ImageBuf> small (new ImageBuf);
         while (outspec.width > 1 || outspec.height > 1) {
             Timer miptimer;
@@ -622,6 +1347,9 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
                 smallspec.tile_height = outspec.tile_height;
                 smallspec.tile_depth = outspec.tile_depth;
                 mipimages.erase (mipimages.begin());
+                if (do_minmax)
+                    minmax_downsample (bounds, *img, smallspec.width,
+                                       smallspec.height, nbase, minchan, maxchan);
             } else {
                 // Resize a factor of two smaller
                 smallspec = outspec;
@@ -635,7 +1363,7 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
                 smallspec.full_width = smallspec.width;
                 smallspec.full_height = smallspec.height;
                 smallspec.full_depth = smallspec.depth;
-                if (!allow_shift ||
+                if (!allow_shift || envcubemode ||
                     configspec.get_int_attribute("maketx:forcefloat", 1))
                     smallspec.set_format (TypeDesc::FLOAT);
 
@@ -652,10 +1380,18 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
                 smallspec.full_x = 0;
                 smallspec.full_y = 0;
                 small->reset (smallspec);  // Realocate with new size
-                img->set_full (img->xbegin(), img->xend(), img->ybegin(),
-                               img->yend(), img->zbegin(), img->zend());
-
-                if (filtername == "box" && !orig_was_overscan && sharpen <= 0.0f) {
+                // N.B. compute the bounds before the filtering below,
+                // which may replace img.
+                if (do_minmax)
+                    minmax_downsample (bounds, *img, smallspec.width,
+                                       smallspec.height, nbase, minchan, maxchan);
+
+                if (envcubemode && img->spec().height == 6*img->spec().width &&
+                      img->spec().width > 1) {
+                    // Cube faces are filtered separately; the filter
+                    // options don't apply.
+                    envcube_downsample (*small, *img);
+                } else if (filtername == "box" && !orig_was_overscan && sharpen <= 0.0f) {
                     ImageBufAlgo::parallel_image (OIIO::bind(resize_block, OIIO::ref(*small), OIIO::cref(*img), _1, envlatlmode, allow_shift),
                                                   OIIO::get_roi(small->spec()));
                 } else {
@@ -675,8 +1411,12 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
                         }
                         outstream << "\n";
                     }
-                    if (do_highlight_compensation)
-                        ImageBufAlgo::rangecompress (*img, *img);
+                    if (do_highlight_compensation) {
+                        // Not in place: img may still be being written.
+                        OIIO::shared_ptr<ImageBuf> compressed (new ImageBuf);
+                        ImageBufAlgo::rangecompress (*compressed, *img);
+                        std::swap (img, compressed);
+                    }
                     if (sharpen > 0.0f && sharpen_first) {
                         OIIO::shared_ptr<ImageBuf> sharp (new ImageBuf);
                         bool uok = ImageBufAlgo::unsharp_mask (*sharp, *img,
@@ -708,26 +1448,31 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
             outspec.set_format (outputdatatype);
             if (envlatlmode && src_samples_border)
                 fix_latl_edges (*small);
-
-            Timer writetimer;
-            // If the format explicitly supports MIP-maps, use that,
-            // otherwise try to simulate MIP-mapping with multi-image.
-            ImageOutput::OpenMode mode = out->supports ("mipmap") ?
-                ImageOutput::AppendMIPLevel : ImageOutput::AppendSubimage;
-            if (! out->open (outputfilename.c_str(), outspec, mode)) {
-                outstream << "maketx ERROR: Could not append \"" << outputfilename
-                          << "\" : " << out->geterror() << "\n";
-                return false;
-            }
-            if (! small->write (out)) {
-                // ImageBuf::write transfers any errors from the
-                // ImageOutput to the ImageBuf.
-                outstream << "maketx ERROR writing \"" << outputfilename
-                          << "\" : " << small->geterror() << "\n";
+            if (do_minmax && small->nchannels() == bounds.nchannels())
+                minmax_replace (*small, bounds, nbase, minchan, maxchan);
+
+            // Wait for the previous level to finish writing, then queue
+            // this one.  If the format explicitly supports MIP-maps, use
+            // that, otherwise try to simulate MIP-mapping with multi-image.
+            writer.wait ();
+            stat_writetime += writeresult.writetime;
+            if (! writeresult.ok) {
+                outstream << "maketx ERROR: " << writeresult.error << "\n";
                 out->close ();
                 return false;
             }
-            stat_writetime += writetimer();
+            ImageOutput::OpenMode mode = out->supports ("mipmap") ?
+                ImageOutput::AppendMIPLevel : ImageOutput::AppendSubimage;
+            if (constant_tiles)
+                set_level_table (outspec, "oiio:ConstantTiles",
+                                 constant_tile_table (*small, outspec),
+                                 arbitrary_metadata);
+            if (tile_hashes)
+                set_level_table (outspec, "oiio:TileHashes",
+                                 tile_hash_table (*small, outspec),
+                                 arbitrary_metadata);
+            writer.push (OIIO::bind (write_miplevel, out, outputfilename,
+                                     outspec, mode, true, small, &writeresult));
             if (verbose) {
                 size_t mem = Sysutil::memory_used(true);
                 peak_mem = std::max (peak_mem, mem);
@@ -736,10 +1481,21 @@ write_mipmap (ImageBufAlgo::MakeTextureMode mode,
                                               Strutil::memformat(mem))
                           << std::endl;
             }
-            std::swap (img, small);
+            // The writer holds its own reference to the level it's
+            // writing, so the next iteration must fill a fresh buffer.
+            img = small;
+            small.reset (new ImageBuf);
         }
     }
 
+    writer.wait ();
+    stat_writetime += writeresult.writetime;
+    if (! writeresult.ok) {
+        outstream << "maketx ERROR: " << writeresult.error << "\n";
+        out->close ();
+        return false;
+    }
+
     if (verbose)
         outstream << "  Wrote file: " << outputfilename << "  ("
                   << Strutil::memformat(Sysutil::memory_used(true)) << ")\n";
@@ -799,14 +1555,18 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         // No buffer supplied -- create one to read the file
         src.reset (new ImageBuf(filename));
         src->init_spec (filename, 0, 0); // force it to get the spec, not read
-    } else if (input->cachedpixels()) {
-        // Image buffer supplied that's backed by ImageCache -- create a
-        // copy (very light weight, just another cache reference)
+    } else if (input->cachedpixels() || input->local_tile_width()) {
+        // Image buffer supplied that's backed by ImageCache, or whose
+        // pixels are in a blocked layout that strides can't describe --
+        // create a copy (very light weight, just another cache reference
+        // or a copy-on-write share of the pixels)
         src.reset (new ImageBuf(*input));
     } else {
         // Image buffer supplied that has pixels -- wrap it
         src.reset (new ImageBuf(input->name(), input->spec(),
-                                (void *)input->localpixels()));
+                                (void *)input->localpixels(),
+                                input->pixel_stride(), input->scanline_stride(),
+                                input->z_stride()));
     }
     ASSERT (src.get());
 
@@ -858,9 +1618,37 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         }
     }
 
+    // In update mode, also record a hash of the source pixels and of the
+    // conversion settings in the texture, so that a source that merely
+    // got a new modification time (but is otherwise identical to what
+    // we made the existing texture from) doesn't need converting again.
+    // Only the header of the existing texture needs to be read.
+    std::string sourcehash;
+    if (updatemode && from_filename) {
+        std::string hash = source_content_hash (src->name());
+        if (hash.size())
+            sourcehash = hash + ":" + settings_hash (mode, configspec);
+        std::string lasthash;
+        if (sourcehash.size() && Filesystem::exists (outputfilename)) {
+            if (ImageInput *in = ImageInput::open (outputfilename)) {
+                lasthash = in->spec().get_string_attribute ("oiio:SourceHash");
+                ImageInput::destroy (in);
+            }
+        }
+        if (lasthash.size() && lasthash == sourcehash) {
+            // Bring the texture's time stamp up to date, so the cheaper
+            // check above succeeds next time.
+            Filesystem::last_write_time (outputfilename, in_time);
+            outstream << "maketx: no update required for \""
+                      << outputfilename << "\" (source pixels unchanged)\n";
+            return true;
+        }
+    }
+
     bool shadowmode = (mode == ImageBufAlgo::MakeTxShadow);
     bool envlatlmode = (mode == ImageBufAlgo::MakeTxEnvLatl || 
                         mode == ImageBufAlgo::MakeTxEnvLatlFromLightProbe);
+    bool envcubemode = (mode == ImageBufAlgo::MakeTxEnvCube);
 
     // Find an ImageIO plugin that can open the output file, and open it
     std::string outformat = configspec.get_string_attribute ("maketx:fileformatname",
@@ -898,13 +1686,19 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
     int local_mb_thresh = configspec.get_int_attribute("maketx:read_local_MB",
                                                     1024);
     bool read_local = (src->spec().image_bytes() < imagesize_t(local_mb_thresh * 1024*1024));
+    // In streaming mode, never read the file locally: the source pixels
+    // are paged through the ImageCache as they're needed.
+    bool stream = configspec.get_int_attribute ("maketx:stream") != 0;
+    if (stream)
+        read_local = false;
 
     bool verbose = configspec.get_int_attribute ("maketx:verbose") != 0;
     double misc_time_1 = alltime.lap();
     STATUS ("prep", misc_time_1);
     if (from_filename) {
         if (verbose)
-            outstream << "Reading file: " << src->name() << std::endl;
+            outstream << "Reading file: " << src->name()
+                      << (read_local ? "" : " (through ImageCache)") << std::endl;
         if (! src->read (0, 0, read_local)) {
             outstream  << "maketx ERROR: Could not read \"" 
                        << src->name() << "\" : " << src->geterror() << "\n";
@@ -929,14 +1723,55 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         src = latlong;
     }
 
+    if (envcubemode) {
+        // Cube maps are stored as a 1x6 stack of the faces, in the order
+        // px, nx, py, ny, pz, nz.  Take either such a stack, or a 2:1
+        // lat-long map to resample into one (at about the same angular
+        // resolution at the centers of the faces).
+        const ImageSpec &spec (src->spec());
+        if (spec.width == 2*spec.height) {
+            ImageSpec newspec = spec;
+            int res = pow2roundup (std::max (spec.height / 2, 1));
+            newspec.x = newspec.y = newspec.full_x = newspec.full_y = 0;
+            newspec.width = newspec.full_width = res;
+            newspec.height = newspec.full_height = 6 * res;
+            newspec.tile_width = newspec.tile_height = 0;
+            newspec.format = TypeDesc::FLOAT;
+            OIIO::shared_ptr<ImageBuf> cube (new ImageBuf(newspec));
+            bool y_is_up = (spec.get_string_attribute ("oiio:updirection") != "z");
+            envlatl_to_envcube (*cube, *src, y_is_up,
+                                spec.get_int_attribute ("oiio:sampleborder") != 0);
+            if (verbose)
+                outstream << "  Resampled lat-long map to "
+                          << res << "x" << res << " cube faces\n";
+            src = cube;
+        } else if (spec.height != 6*spec.width) {
+            outstream << "maketx ERROR: a cube map needs a 1x6 stack of faces "
+                      << "or a 2x1 lat-long image, not " << spec.width
+                      << "x" << spec.height << "\n";
+            return false;
+        }
+    }
+
     // Some things require knowing a bunch about the pixel statistics.
+    // They all come from one analysis pass over the source, which also
+    // finds out whether it's monochrome and where any NaN/Inf values are.
     bool constant_color_detect = configspec.get_int_attribute("maketx:constant_color_detect");
     bool opaque_detect = configspec.get_int_attribute("maketx:opaque_detect");
     bool compute_average_color = configspec.get_int_attribute("maketx:compute_average", 1);
-    ImageBufAlgo::PixelStats pixel_stats;
+    bool monochrome_detect = configspec.get_int_attribute("maketx:monochrome_detect");
+    bool checknan = configspec.get_int_attribute("maketx:checknan");
     bool compute_stats = (constant_color_detect || opaque_detect || compute_average_color);
-    if (compute_stats)
-        ImageBufAlgo::computePixelStats (pixel_stats, *src);
+    ImageBufAlgo::ImageAnalysis analysis;
+    bool analyzed = false;
+    if (compute_stats || monochrome_detect || checknan) {
+        if (! ImageBufAlgo::analyze (analysis, *src)) {
+            outstream << "maketx ERROR: " << src->geterror() << "\n";
+            return false;
+        }
+        analyzed = true;
+    }
+    ImageBufAlgo::PixelStats &pixel_stats (analysis.stats);
 
     // If requested - and we're a constant color - make a tiny texture instead
     // Only safe if the full/display window is the same as the data window.
@@ -953,7 +1788,8 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         isConstantColor = (pixel_stats.min == pixel_stats.max);
         if (isConstantColor)
             constantColor = pixel_stats.min;
-        if (isConstantColor && constant_color_detect) {
+        // (A cube map must keep its 1x6 layout.)
+        if (isConstantColor && constant_color_detect && ! envcubemode) {
             // Reset the image, to a new image, at the tile size
             ImageSpec newspec = src->spec();
             newspec.width  = std::min (configspec.tile_width, src->spec().width);
@@ -965,6 +1801,10 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
             std::string name = std::string(src->name()) + ".constant_color";
             src->reset(name, newspec);
             ImageBufAlgo::fill (*src, &constantColor[0]);
+            analysis.nonfinite_pixels = 0;  // min==max, so it's all finite
+            analysis.nonfinite_x.clear ();
+            analysis.nonfinite_y.clear ();
+            analysis.nonfinite_value.clear ();
             if (verbose) {
                 outstream << "  Constant color image detected. ";
                 outstream << "Creating " << newspec.width << "x" << newspec.height << " texture instead.\n";
@@ -989,10 +1829,10 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
     }
 
     // If requested - and we're a monochrome image - drop the extra channels
-    if (configspec.get_int_attribute("maketx:monochrome_detect") &&
+    if (monochrome_detect &&
           nchannels <= 0 &&
           src->nchannels() == 3 && src->spec().alpha_channel < 0 &&  // RGB only
-          ImageBufAlgo::isMonochrome(*src)) {
+          analysis.monochrome) {
         if (verbose)
             outstream << "  Monochrome image detected. Converting to single channel texture.\n";
         OIIO::shared_ptr<ImageBuf> newsrc (new ImageBuf(src->spec()));
@@ -1008,6 +1848,7 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         OIIO::shared_ptr<ImageBuf> newsrc (new ImageBuf(src->spec()));
         ImageBufAlgo::channels (*newsrc, *src, nchannels, NULL, NULL, NULL, true);
         std::swap (src, newsrc);
+        analyzed = false;   // channels dropped, nonfinite count is stale
     }
 
     std::string channelnames = configspec.get_string_attribute ("maketx:channelnames");
@@ -1149,6 +1990,11 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         configspec.attribute ("wrapmodes", "periodic,clamp");
         if (prman_metadata)
             dstspec.attribute ("PixarTextureFormat", "LatLong Environment");
+    } else if (envcubemode) {
+        dstspec.attribute ("textureformat", "CubeFace Environment");
+        configspec.attribute ("wrapmodes", "clamp,clamp");
+        if (prman_metadata)
+            dstspec.attribute ("PixarTextureFormat", "CubeFace Environment");
     } else {
         dstspec.attribute ("textureformat", "Plain Texture");
         if (prman_metadata)
@@ -1186,20 +2032,33 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
     }
     if (verbose && pixelsFixed)
         outstream << "  Warning: " << pixelsFixed << " nan/inf pixels fixed.\n";
+    if (pixelsFixed)
+        analyzed = false;
 
     // If --checknan was used and it's a floating point image, check for
     // nonfinite (NaN or Inf) values and abort if they are found.
-    if (configspec.get_int_attribute("maketx:checknan") &&
+    // The analysis pass already counted them, unless the pixels have
+    // changed since then.
+    if (checknan &&
                     (srcspec.format.basetype == TypeDesc::FLOAT ||
                      srcspec.format.basetype == TypeDesc::HALF ||
                      srcspec.format.basetype == TypeDesc::DOUBLE)) {
-        int found_nonfinite = 0;
-        ImageBufAlgo::parallel_image (OIIO::bind(check_nan_block, OIIO::ref(*src), _1, OIIO::ref(found_nonfinite)),
-                                      OIIO::get_roi(srcspec));
+        ImageBufAlgo::ImageAnalysis reanalysis;
+        if (! analyzed && ! ImageBufAlgo::analyze (reanalysis, *src)) {
+            outstream << "maketx ERROR: " << src->geterror() << "\n";
+            return false;
+        }
+        const ImageBufAlgo::ImageAnalysis &nan_analysis (analyzed ? analysis : reanalysis);
+        imagesize_t found_nonfinite = nan_analysis.nonfinite_pixels;
         if (found_nonfinite) {
-            if (found_nonfinite > 3)
+            for (size_t i = 0;  i < nan_analysis.nonfinite_x.size();  ++i)
+                outstream << "maketx ERROR: Found " << nan_analysis.nonfinite_value[i]
+                          << " at (x=" << nan_analysis.nonfinite_x[i]
+                          << ", y=" << nan_analysis.nonfinite_y[i] << ")\n";
+            if (found_nonfinite > nan_analysis.nonfinite_x.size())
                 outstream << "maketx ERROR: ...and Nan/Inf at "
-                          << (found_nonfinite-3) << " other pixels\n";
+                          << (found_nonfinite-nan_analysis.nonfinite_x.size())
+                          << " other pixels\n";
             return false;
         }
     }
@@ -1290,7 +2149,8 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         dstspec.set_format (TypeDesc::FLOAT);
 
     // Handle resize to power of two, if called for
-    if (configspec.get_int_attribute("maketx:resize")  &&  ! shadowmode) {
+    if (configspec.get_int_attribute("maketx:resize")  &&  ! shadowmode &&
+          ! envcubemode) {
         dstspec.width = pow2roundup (dstspec.width);
         dstspec.height = pow2roundup (dstspec.height);
         dstspec.full_width = dstspec.width;
@@ -1326,6 +2186,17 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         // No resize needed, no format conversion needed -- just stick to
         // the image we've already got
         toplevel = src;
+    } else if (! do_resize && stream &&
+               src->storage() == ImageBuf::IMAGECACHE) {
+        // Streaming: rather than make an in-memory float copy of the
+        // whole top level, leave it in the cache.  It is written in tile
+        // strips, the format conversion happening in the ImageOutput,
+        // and write_mipmap computes the next level by reading it through
+        // the cache, so only that (quarter size) level is ever held in
+        // memory.
+        if (verbose)
+            outstream << "  Streaming top level from the ImageCache\n";
+        toplevel = src;
     } else  if (! do_resize) {
         // Need format conversion, but no resize -- just copy the pixels
         toplevel.reset (new ImageBuf (dstspec));
@@ -1360,6 +2231,75 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
     // master copy.  We can release src.
     src.reset ();
 
+    // Append the min and/or max channels, if requested.  At the top level
+    // they are just copies of the texture's channels; write_mipmap will
+    // reduce them conservatively for the lower MIP levels.
+    int minmax_nbase = dstspec.nchannels, minchan = -1, maxchan = -1;
+    std::string minmax = configspec.get_string_attribute ("maketx:minmax");
+    if (! minmax_layout (minmax, minmax_nbase, minchan, maxchan)) {
+        outstream << "maketx ERROR: unknown min/max mode \"" << minmax
+                  << "\" (should be min, max, or minmax)\n";
+        return false;
+    }
+    if (minchan >= 0 || maxchan >= 0) {
+        int nc = minmax_nbase * (1 + (minchan >= 0) + (maxchan >= 0));
+        std::vector<int> channelorder (nc);
+        std::vector<std::string> channelnames (nc);
+        for (int c = 0;  c < nc;  ++c) {
+            channelorder[c] = c % minmax_nbase;
+            const std::string &name (dstspec.channelnames[c % minmax_nbase]);
+            if (c < minmax_nbase)
+                channelnames[c] = name;
+            else
+                channelnames[c] = (c >= maxchan && maxchan >= 0 ? "max." : "min.") + name;
+        }
+        OIIO::shared_ptr<ImageBuf> t (new ImageBuf);
+        if (! ImageBufAlgo::channels (*t, *toplevel, nc, &channelorder[0],
+                                      NULL, &channelnames[0])) {
+            outstream << "maketx ERROR: " << t->geterror() << "\n";
+            return false;
+        }
+        std::swap (t, toplevel);
+        dstspec.nchannels = nc;
+        dstspec.channelnames = channelnames;
+        dstspec.channelformats.clear ();
+    }
+
+    // Append the slope moment channels, if requested.  Unlike the min/max
+    // channels, these are filtered like any other channel.
+    int leanchan = -1;
+    std::vector<float> lean_constant, lean_average;
+    std::string lean = configspec.get_string_attribute ("maketx:lean");
+    if (lean.size()) {
+        ImageBuf moments;
+        if (! lean_moments (moments, *toplevel, lean)) {
+            outstream << "maketx ERROR: can't make slope moments of mode \""
+                      << lean << "\" (should be bump, normal, or normal01, "
+                      << "with 1 or 3 channels)\n";
+            return false;
+        }
+        if (isConstantColor || compute_average_color) {
+            ImageBufAlgo::PixelStats lean_stats;
+            ImageBufAlgo::computePixelStats (lean_stats, moments);
+            lean_constant = lean_stats.min;
+            lean_average = lean_stats.avg;
+        }
+        OIIO::shared_ptr<ImageBuf> t (new ImageBuf);
+        if (! ImageBufAlgo::channel_append (*t, *toplevel, moments)) {
+            outstream << "maketx ERROR: " << t->geterror() << "\n";
+            return false;
+        }
+        std::swap (t, toplevel);
+        static const char *lean_names[nlean_channels] = {
+            "lean.bx", "lean.by", "lean.bxx", "lean.byy", "lean.bxy"
+        };
+        leanchan = dstspec.nchannels;
+        for (int c = 0;  c < nlean_channels;  ++c)
+            dstspec.channelnames.push_back (lean_names[c]);
+        dstspec.nchannels += nlean_channels;
+        dstspec.channelformats.clear ();
+    }
+
 
     // Update the toplevel ImageDescription with the sha1 pixel hash and
     // constant color
@@ -1377,6 +2317,13 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
             std::string ("AverageColor=(\\[?") + fp_number_pattern + ",?)+\\]?[ ]*";
         desc = boost::regex_replace (desc, boost::regex(constcolor_pattern), "");
         desc = boost::regex_replace (desc, boost::regex(average_pattern), "");
+        desc = boost::regex_replace (desc, boost::regex("oiio:EnvImportance=[^ ]*[ ]*"), "");
+        desc = boost::regex_replace (desc, boost::regex("oiio:MinMaxChannels=[^ ]*[ ]*"), "");
+        desc = boost::regex_replace (desc, boost::regex("oiio:LeanChannels=[^ ]*[ ]*"), "");
+        desc = boost::regex_replace (desc, boost::regex("oiio:SourceHash=[^ ]*[ ]*"), "");
+        desc = boost::regex_replace (desc, boost::regex("oiio:ConstantTiles=[^ ]*[ ]*"), "");
+        desc = boost::regex_replace (desc, boost::regex("oiio:TileHashes=[^ ]*[ ]*"), "");
+        desc = boost::regex_replace (desc, boost::regex("oiio:PixelHash=[^ ]*[ ]*"), "");
         updatedDesc = true;
     }
     
@@ -1392,31 +2339,50 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         // NB if we change the sharpening algorithm, change the letter!
     }
 
+    // SHA-1 is stored as "oiio:SHA-1" for compatibility with older
+    // readers. Any other algorithm is stored as "oiio:PixelHash" with the
+    // value "algorithm:digest", so readers can tell which one was used.
     const int sha1_blocksize = 256;
+    std::string hashalgo = configspec.get_string_attribute ("maketx:hash_algorithm", "sha1");
+    Strutil::to_lower (hashalgo);
+    bool sha1 = Strutil::iequals (hashalgo, "sha1") ||
+                Strutil::iequals (hashalgo, "sha-1");
     std::string hash_digest = configspec.get_int_attribute("maketx:hash", 1) ?
-        ImageBufAlgo::computePixelHashSHA1 (*toplevel, addlHashData.str(),
-                                            ROI::All(), sha1_blocksize) : "";
+        ImageBufAlgo::computePixelHash (*toplevel, hashalgo, addlHashData.str(),
+                                        ROI::All(), sha1_blocksize) : "";
     if (hash_digest.length()) {
+        std::string hashattr = sha1 ? "oiio:SHA-1" : "oiio:PixelHash";
+        if (! sha1)
+            hash_digest = hashalgo + ":" + hash_digest;
         if (out->supports("arbitrary_metadata")) {
-            dstspec.attribute ("oiio:SHA-1", hash_digest);
+            dstspec.attribute (hashattr, hash_digest);
         } else {
             if (desc.length())
                 desc += " ";
-            desc += "oiio:SHA-1=";
+            desc += hashattr + "=";
             desc += hash_digest;
             updatedDesc = true;
         }
         if (verbose)
-            outstream << "  SHA-1: " << hash_digest << std::endl;
+            outstream << "  " << (sha1 ? "SHA-1" : "Pixel hash") << ": "
+                      << hash_digest << std::endl;
+    } else if (configspec.get_int_attribute("maketx:hash", 1)) {
+        outstream << "maketx WARNING: unknown hash algorithm \""
+                  << hashalgo << "\", no hash recorded\n";
     }
     double stat_hashtime = alltime.lap();
-    STATUS ("SHA-1 hash", stat_hashtime);
+    STATUS (sha1 ? "SHA-1 hash" : "pixel hash", stat_hashtime);
   
     if (isConstantColor) {
         std::ostringstream os; // Emulate a JSON array
         for (int i = 0; i < dstspec.nchannels; ++i) {
             if (i!=0) os << ",";
-            os << (i<(int)constantColor.size() ? constantColor[i] : 0.0f);
+            // Appended min/max channels start as copies of the others
+            int ci = i % minmax_nbase;
+            if (leanchan >= 0 && i >= leanchan)
+                os << lean_constant[i-leanchan];
+            else
+                os << (ci<(int)constantColor.size() ? constantColor[ci] : 0.0f);
         }
         if (out->supports("arbitrary_metadata")) {
             dstspec.attribute ("oiio:ConstantColor", os.str());
@@ -1435,7 +2401,12 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
         std::ostringstream os; // Emulate a JSON array
         for (int i = 0; i < dstspec.nchannels; ++i) {
             if (i!=0) os << ",";
-            os << (i<(int)pixel_stats.avg.size() ? pixel_stats.avg[i] : 0.0f);
+            // Appended min/max channels start as copies of the others
+            int ci = i % minmax_nbase;
+            if (leanchan >= 0 && i >= leanchan)
+                os << lean_average[i-leanchan];
+            else
+                os << (ci<(int)pixel_stats.avg.size() ? pixel_stats.avg[ci] : 0.0f);
         }
         if (out->supports("arbitrary_metadata")) {
             dstspec.attribute ("oiio:AverageColor", os.str());
@@ -1452,6 +2423,70 @@ make_texture_impl (ImageBufAlgo::MakeTextureMode mode,
             outstream << "  AverageColor: " << os.str() << std::endl;
     }
 
+    if (sourcehash.size()) {
+        if (out->supports("arbitrary_metadata")) {
+            dstspec.attribute ("oiio:SourceHash", sourcehash);
+        } else {
+            if (desc.length())
+                desc += " ";
+            desc += "oiio:SourceHash=";
+            desc += sourcehash;
+            updatedDesc = true;
+        }
+    }
+
+    if (minchan >= 0 || maxchan >= 0) {
+        std::string layout = Strutil::format ("%d,%d,%d", minmax_nbase,
+                                              minchan, maxchan);
+        if (out->supports("arbitrary_metadata")) {
+            dstspec.attribute ("oiio:MinMaxChannels", layout);
+        } else {
+            if (desc.length())
+                desc += " ";
+            desc += "oiio:MinMaxChannels=";
+            desc += layout;
+            updatedDesc = true;
+        }
+        if (verbose)
+            outstream << "  MinMaxChannels: " << layout << std::endl;
+    }
+
+    if (leanchan >= 0) {
+        std::string layout = Strutil::format ("%d", leanchan);
+        if (out->supports("arbitrary_metadata")) {
+            dstspec.attribute ("oiio:LeanChannels", layout);
+        } else {
+            if (desc.length())
+                desc += " ";
+            desc += "oiio:LeanChannels=";
+            desc += layout;
+            updatedDesc = true;
+        }
+        if (verbose)
+            outstream << "  LeanChannels: " << layout << std::endl;
+    }
+
+    int importance_res = configspec.get_int_attribute ("maketx:envlatl_importance");
+    if (envlatlmode && importance_res > 0) {
+        bool sampleborder = ! strcmp (out->format_name(), "openexr");
+        std::string table = envlatl_importance_table (*toplevel,
+                                                      importance_res,
+                                                      sampleborder);
+        if (out->supports("arbitrary_metadata")) {
+            dstspec.attribute ("oiio:EnvImportance", table);
+        } else {
+            if (desc.length())
+                desc += " ";
+            desc += "oiio:EnvImportance=";
+            desc += table;
+            updatedDesc = true;
+        }
+        if (verbose)
+            outstream << "  EnvImportance: "
+                      << table.substr (0, table.find (',', table.find (',')+1))
+                      << " table" << std::endl;
+    }
+
     if (updatedDesc) {
         dstspec.attribute ("ImageDescription", desc);
     }
@@ -0,0 +1,105 @@
+/*
+  Copyright 2017 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+#include <cstring>
+
+#include "OpenImageIO/sysutil.h"
+#include "OpenImageIO/strutil.h"
+
+#include "simd_dispatch.h"
+
+
+OIIO_NAMESPACE_BEGIN
+using namespace pvt;
+
+namespace {
+
+static SIMDKernels
+select_simd_kernels ()
+{
+    // Best first.  Each needs the CPU features it was compiled for.
+    struct Candidate {
+        const SIMDKernels *kernels;
+        unsigned int features;
+    };
+    const Candidate candidates[] = {
+        { simd_kernels_avx512 (), Sysutil::CPU_AVX512F | Sysutil::CPU_AVX2 | Sysutil::CPU_F16C },
+        { simd_kernels_avx2 (), Sysutil::CPU_AVX2 | Sysutil::CPU_F16C },
+        { simd_kernels_sse4 (), Sysutil::CPU_SSE41 }
+    };
+    const int ncandidates = int (sizeof(candidates) / sizeof(candidates[0]));
+
+    SIMDKernels k;
+    memset (&k, 0, sizeof(k));
+    k.name = "baseline";
+    string_view cap = Sysutil::getenv ("OPENIMAGEIO_SIMD");
+    if (cap == "0")
+        return k;
+    unsigned int features = Sysutil::cpu_features ();
+    bool allowed = cap.empty();
+    for (int i = 0;  i < ncandidates;  ++i) {
+        const SIMDKernels *c = candidates[i].kernels;
+        if (! allowed && c && Strutil::iequals (cap, c->name))
+            allowed = true;
+        if (! allowed || ! c ||
+              (features & candidates[i].features) != candidates[i].features)
+            continue;
+        // Entries the best set lacks come from the next best that has them.
+        if (! strcmp (k.name, "baseline"))
+            k.name = c->name;
+#define FILL(field) if (! k.field) k.field = c->field
+        FILL (uint8_to_float);
+        FILL (uint16_to_float);
+        FILL (half_to_float);
+        FILL (float_to_uint8);
+        FILL (float_to_uint16);
+        FILL (float_to_half);
+        FILL (add);
+        FILL (sub);
+        FILL (mul);
+        FILL (mad);
+#undef FILL
+    }
+    return k;
+}
+
+}  // anon namespace
+
+
+
+const SIMDKernels &
+pvt::simd_kernels ()
+{
+    static SIMDKernels kernels = select_simd_kernels ();
+    return kernels;
+}
+
+OIIO_NAMESPACE_END
@@ -0,0 +1,95 @@
+/*
+  Copyright 2017 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+// Runtime selection of SIMD kernels.
+//
+// The library as a whole is compiled for whatever instruction set USE_SIMD
+// asks for, which for builds that must run anywhere is the lowest common
+// denominator.  A few hot inner loops are also compiled, in
+// simd_kernels_*.cpp, for newer instruction sets, and simd_kernels()
+// picks the best of those that the CPU we are running on supports.
+//
+// This header is included by the per-instruction-set files, so it must
+// not bring in any code of its own (see simd_kernels.h).
+
+#ifndef OPENIMAGEIO_SIMD_DISPATCH_H
+#define OPENIMAGEIO_SIMD_DISPATCH_H
+
+#include <cstddef>
+
+#include "OpenImageIO/oiioversion.h"
+
+
+OIIO_NAMESPACE_BEGIN
+namespace pvt {
+
+
+/// A set of kernels for one instruction set.  Any entry may be NULL,
+/// which means the caller should use its own (baseline) code instead.
+/// Results are identical to the baseline code's.
+struct SIMDKernels {
+    const char *name;
+
+    // Bulk conversions, with the same default quantization as the bulk
+    // convert_type.  Half values are passed as their bit patterns.
+    void (*uint8_to_float) (const unsigned char *src, float *dst, size_t n);
+    void (*uint16_to_float) (const unsigned short *src, float *dst, size_t n);
+    void (*half_to_float) (const unsigned short *src, float *dst, size_t n);
+    void (*float_to_uint8) (const float *src, unsigned char *dst, size_t n);
+    void (*float_to_uint16) (const float *src, unsigned short *dst, size_t n);
+    void (*float_to_half) (const float *src, unsigned short *dst, size_t n);
+
+    // Pixel math on runs of floats: r[i] = a[i] op b[i] (op c[i]).
+    void (*add) (float *r, const float *a, const float *b, size_t n);
+    void (*sub) (float *r, const float *a, const float *b, size_t n);
+    void (*mul) (float *r, const float *a, const float *b, size_t n);
+    void (*mad) (float *r, const float *a, const float *b, const float *c,
+                 size_t n);
+};
+
+
+/// The best kernels for this CPU, chosen the first time it's called.
+/// Setting the environment variable OPENIMAGEIO_SIMD to "sse4", "avx2",
+/// or "avx512" caps the choice at that level, and to "0" disables the
+/// dispatched kernels entirely (for testing and comparisons).
+const SIMDKernels & simd_kernels ();
+
+/// The kernels for each instruction set, or NULL if the compiler wasn't
+/// able to build them.  They must only be called on CPUs that support
+/// the instruction set.
+const SIMDKernels * simd_kernels_sse4 ();
+const SIMDKernels * simd_kernels_avx2 ();
+const SIMDKernels * simd_kernels_avx512 ();
+
+
+}  // namespace pvt
+OIIO_NAMESPACE_END
+
+#endif // OPENIMAGEIO_SIMD_DISPATCH_H
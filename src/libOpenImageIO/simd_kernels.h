@@ -0,0 +1,374 @@
+/*
+  Copyright 2017 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+// The kernels of simd_dispatch.h.  Each simd_kernels_*.cpp defines
+// OIIO_SIMD_KERNELS_FUNC, OIIO_SIMD_KERNELS_NAME, and
+// OIIO_SIMD_KERNELS_ENABLED and then includes this file, and the build
+// compiles each of them with its own instruction set flags.
+//
+// Only intrinsics may be used here, and everything must have internal
+// linkage.  An inline function from a shared header (simd.h, fmath.h, or
+// even the standard library) would get an out-of-line copy compiled with
+// this file's flags, and the linker is free to pick that copy for the
+// rest of the library, which would then crash on older CPUs.
+
+#include <cstring>
+
+#if OIIO_SIMD_KERNELS_ENABLED
+#  include <immintrin.h>
+#endif
+
+#include "simd_dispatch.h"
+
+
+OIIO_NAMESPACE_BEGIN
+namespace pvt {
+
+#if OIIO_SIMD_KERNELS_ENABLED
+namespace {
+
+
+static void
+k_uint8_to_float (const unsigned char *src, float *dst, size_t n)
+{
+    const float scale = 1.0f / 255.0f;
+#if defined(__AVX512F__)
+    const __m512 scale16 = _mm512_set1_ps (scale);
+    for ( ; n >= 16; n -= 16, src += 16, dst += 16) {
+        __m512i i = _mm512_cvtepu8_epi32 (_mm_loadu_si128 ((const __m128i *)src));
+        _mm512_storeu_ps (dst, _mm512_mul_ps (_mm512_cvtepi32_ps (i), scale16));
+    }
+#endif
+#if defined(__AVX2__)
+    const __m256 scale8 = _mm256_set1_ps (scale);
+    for ( ; n >= 8; n -= 8, src += 8, dst += 8) {
+        __m256i i = _mm256_cvtepu8_epi32 (_mm_loadl_epi64 ((const __m128i *)src));
+        _mm256_storeu_ps (dst, _mm256_mul_ps (_mm256_cvtepi32_ps (i), scale8));
+    }
+#endif
+    const __m128 scale4 = _mm_set1_ps (scale);
+    for ( ; n >= 4; n -= 4, src += 4, dst += 4) {
+        int bytes;
+        memcpy (&bytes, src, 4);
+        __m128i i = _mm_cvtepu8_epi32 (_mm_cvtsi32_si128 (bytes));
+        _mm_storeu_ps (dst, _mm_mul_ps (_mm_cvtepi32_ps (i), scale4));
+    }
+    for ( ; n; --n)
+        *dst++ = (*src++) * scale;
+}
+
+
+
+static void
+k_uint16_to_float (const unsigned short *src, float *dst, size_t n)
+{
+    const float scale = 1.0f / 65535.0f;
+#if defined(__AVX512F__)
+    const __m512 scale16 = _mm512_set1_ps (scale);
+    for ( ; n >= 16; n -= 16, src += 16, dst += 16) {
+        __m512i i = _mm512_cvtepu16_epi32 (_mm256_loadu_si256 ((const __m256i *)src));
+        _mm512_storeu_ps (dst, _mm512_mul_ps (_mm512_cvtepi32_ps (i), scale16));
+    }
+#endif
+#if defined(__AVX2__)
+    const __m256 scale8 = _mm256_set1_ps (scale);
+    for ( ; n >= 8; n -= 8, src += 8, dst += 8) {
+        __m256i i = _mm256_cvtepu16_epi32 (_mm_loadu_si128 ((const __m128i *)src));
+        _mm256_storeu_ps (dst, _mm256_mul_ps (_mm256_cvtepi32_ps (i), scale8));
+    }
+#endif
+    const __m128 scale4 = _mm_set1_ps (scale);
+    for ( ; n >= 4; n -= 4, src += 4, dst += 4) {
+        __m128i i = _mm_cvtepu16_epi32 (_mm_loadl_epi64 ((const __m128i *)src));
+        _mm_storeu_ps (dst, _mm_mul_ps (_mm_cvtepi32_ps (i), scale4));
+    }
+    for ( ; n; --n)
+        *dst++ = (*src++) * scale;
+}
+
+
+
+// Scale, clamp, and round by adding 0.5 and truncating, exactly like the
+// bulk convert_type (and the scaled_conversion for its leftovers).
+static inline unsigned int
+quantize_one (float v, float max)
+{
+    float s = v * max;
+    s += (s < 0.0f ? -0.5f : 0.5f);
+    return (unsigned int) (s < 0.0f ? 0.0f : (s > max ? max : s));
+}
+
+
+
+static void
+k_float_to_uint8 (const float *src, unsigned char *dst, size_t n)
+{
+#if defined(__AVX512F__)
+    const __m512 max16 = _mm512_set1_ps (255.0f);
+    const __m512 zero16 = _mm512_setzero_ps ();
+    const __m512 half16 = _mm512_set1_ps (0.5f);
+    for ( ; n >= 16; n -= 16, src += 16, dst += 16) {
+        __m512 v = _mm512_mul_ps (_mm512_loadu_ps (src), max16);
+        v = _mm512_min_ps (max16, _mm512_max_ps (zero16, v));
+        __m512i i = _mm512_cvttps_epi32 (_mm512_add_ps (v, half16));
+        _mm_storeu_si128 ((__m128i *)dst, _mm512_cvtusepi32_epi8 (i));
+    }
+#endif
+#if defined(__AVX2__)
+    // The saturating packs work within 128-bit lanes, so a final permute
+    // puts the bytes back in order.
+    const __m256 max8 = _mm256_set1_ps (255.0f);
+    const __m256 zero8 = _mm256_setzero_ps ();
+    const __m256 half8 = _mm256_set1_ps (0.5f);
+    const __m256i order = _mm256_setr_epi32 (0, 4, 1, 5, 2, 6, 3, 7);
+    for ( ; n >= 32; n -= 32, src += 32, dst += 32) {
+        __m256i i[4];
+        for (int k = 0;  k < 4;  ++k) {
+            __m256 v = _mm256_mul_ps (_mm256_loadu_ps (src + 8*k), max8);
+            v = _mm256_min_ps (max8, _mm256_max_ps (zero8, v));
+            i[k] = _mm256_cvttps_epi32 (_mm256_add_ps (v, half8));
+        }
+        __m256i b = _mm256_packus_epi16 (_mm256_packs_epi32 (i[0], i[1]),
+                                         _mm256_packs_epi32 (i[2], i[3]));
+        _mm256_storeu_si256 ((__m256i *)dst,
+                             _mm256_permutevar8x32_epi32 (b, order));
+    }
+#endif
+    const __m128 max4 = _mm_set1_ps (255.0f);
+    const __m128 zero4 = _mm_setzero_ps ();
+    const __m128 half4 = _mm_set1_ps (0.5f);
+    for ( ; n >= 16; n -= 16, src += 16, dst += 16) {
+        __m128i i[4];
+        for (int k = 0;  k < 4;  ++k) {
+            __m128 v = _mm_mul_ps (_mm_loadu_ps (src + 4*k), max4);
+            v = _mm_min_ps (max4, _mm_max_ps (zero4, v));
+            i[k] = _mm_cvttps_epi32 (_mm_add_ps (v, half4));
+        }
+        __m128i b = _mm_packus_epi16 (_mm_packs_epi32 (i[0], i[1]),
+                                      _mm_packs_epi32 (i[2], i[3]));
+        _mm_storeu_si128 ((__m128i *)dst, b);
+    }
+    for ( ; n; --n)
+        *dst++ = (unsigned char) quantize_one (*src++, 255.0f);
+}
+
+
+
+static void
+k_float_to_uint16 (const float *src, unsigned short *dst, size_t n)
+{
+#if defined(__AVX512F__)
+    const __m512 max16 = _mm512_set1_ps (65535.0f);
+    const __m512 zero16 = _mm512_setzero_ps ();
+    const __m512 half16 = _mm512_set1_ps (0.5f);
+    for ( ; n >= 16; n -= 16, src += 16, dst += 16) {
+        __m512 v = _mm512_mul_ps (_mm512_loadu_ps (src), max16);
+        v = _mm512_min_ps (max16, _mm512_max_ps (zero16, v));
+        __m512i i = _mm512_cvttps_epi32 (_mm512_add_ps (v, half16));
+        _mm256_storeu_si256 ((__m256i *)dst, _mm512_cvtusepi32_epi16 (i));
+    }
+#endif
+#if defined(__AVX2__)
+    const __m256 max8 = _mm256_set1_ps (65535.0f);
+    const __m256 zero8 = _mm256_setzero_ps ();
+    const __m256 half8 = _mm256_set1_ps (0.5f);
+    for ( ; n >= 16; n -= 16, src += 16, dst += 16) {
+        __m256 v0 = _mm256_mul_ps (_mm256_loadu_ps (src), max8);
+        __m256 v1 = _mm256_mul_ps (_mm256_loadu_ps (src + 8), max8);
+        v0 = _mm256_min_ps (max8, _mm256_max_ps (zero8, v0));
+        v1 = _mm256_min_ps (max8, _mm256_max_ps (zero8, v1));
+        __m256i p = _mm256_packus_epi32 (_mm256_cvttps_epi32 (_mm256_add_ps (v0, half8)),
+                                         _mm256_cvttps_epi32 (_mm256_add_ps (v1, half8)));
+        _mm256_storeu_si256 ((__m256i *)dst, _mm256_permute4x64_epi64 (p, 0xd8));
+    }
+#endif
+    const __m128 max4 = _mm_set1_ps (65535.0f);
+    const __m128 zero4 = _mm_setzero_ps ();
+    const __m128 half4 = _mm_set1_ps (0.5f);
+    for ( ; n >= 8; n -= 8, src += 8, dst += 8) {
+        __m128 v0 = _mm_mul_ps (_mm_loadu_ps (src), max4);
+        __m128 v1 = _mm_mul_ps (_mm_loadu_ps (src + 4), max4);
+        v0 = _mm_min_ps (max4, _mm_max_ps (zero4, v0));
+        v1 = _mm_min_ps (max4, _mm_max_ps (zero4, v1));
+        __m128i p = _mm_packus_epi32 (_mm_cvttps_epi32 (_mm_add_ps (v0, half4)),
+                                      _mm_cvttps_epi32 (_mm_add_ps (v1, half4)));
+        _mm_storeu_si128 ((__m128i *)dst, p);
+    }
+    for ( ; n; --n)
+        *dst++ = (unsigned short) quantize_one (*src++, 65535.0f);
+}
+
+
+
+#if defined(__F16C__)
+// Half conversions round to nearest even, just like OpenEXR's half.  The
+// leftovers go through a small zero-padded buffer.
+static void
+k_half_to_float (const unsigned short *src, float *dst, size_t n)
+{
+#if defined(__AVX512F__)
+    for ( ; n >= 16; n -= 16, src += 16, dst += 16)
+        _mm512_storeu_ps (dst, _mm512_cvtph_ps (_mm256_loadu_si256 ((const __m256i *)src)));
+#endif
+    for ( ; n >= 8; n -= 8, src += 8, dst += 8)
+        _mm256_storeu_ps (dst, _mm256_cvtph_ps (_mm_loadu_si128 ((const __m128i *)src)));
+    if (n) {
+        unsigned short h[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        float f[8];
+        memcpy (h, src, n * sizeof(unsigned short));
+        _mm256_storeu_ps (f, _mm256_cvtph_ps (_mm_loadu_si128 ((const __m128i *)h)));
+        memcpy (dst, f, n * sizeof(float));
+    }
+}
+
+
+
+static void
+k_float_to_half (const float *src, unsigned short *dst, size_t n)
+{
+#if defined(__AVX512F__)
+    for ( ; n >= 16; n -= 16, src += 16, dst += 16)
+        _mm256_storeu_si256 ((__m256i *)dst,
+                             _mm512_cvtps_ph (_mm512_loadu_ps (src), _MM_FROUND_TO_NEAREST_INT));
+#endif
+    for ( ; n >= 8; n -= 8, src += 8, dst += 8)
+        _mm_storeu_si128 ((__m128i *)dst,
+                          _mm256_cvtps_ph (_mm256_loadu_ps (src), _MM_FROUND_TO_NEAREST_INT));
+    if (n) {
+        float f[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        unsigned short h[8];
+        memcpy (f, src, n * sizeof(float));
+        _mm_storeu_si128 ((__m128i *)h,
+                          _mm256_cvtps_ph (_mm256_loadu_ps (f), _MM_FROUND_TO_NEAREST_INT));
+        memcpy (dst, h, n * sizeof(unsigned short));
+    }
+}
+#endif
+
+
+
+// The pixel math kernels keep multiplies and adds separate (the build
+// also turns off contraction) so results match the baseline bit for bit.
+#if defined(__AVX512F__)
+#  define OIIO_KERNEL_BINOP(name, op16, op8, op4, op)                       \
+static void                                                                 \
+name (float *r, const float *a, const float *b, size_t n)                   \
+{                                                                           \
+    for ( ; n >= 16; n -= 16, r += 16, a += 16, b += 16)                    \
+        _mm512_storeu_ps (r, op16 (_mm512_loadu_ps (a), _mm512_loadu_ps (b))); \
+    for ( ; n >= 8; n -= 8, r += 8, a += 8, b += 8)                         \
+        _mm256_storeu_ps (r, op8 (_mm256_loadu_ps (a), _mm256_loadu_ps (b))); \
+    for ( ; n; --n)                                                         \
+        *r++ = *a++ op *b++;                                                \
+}
+#elif defined(__AVX2__)
+#  define OIIO_KERNEL_BINOP(name, op16, op8, op4, op)                       \
+static void                                                                 \
+name (float *r, const float *a, const float *b, size_t n)                   \
+{                                                                           \
+    for ( ; n >= 8; n -= 8, r += 8, a += 8, b += 8)                         \
+        _mm256_storeu_ps (r, op8 (_mm256_loadu_ps (a), _mm256_loadu_ps (b))); \
+    for ( ; n; --n)                                                         \
+        *r++ = *a++ op *b++;                                                \
+}
+#endif
+
+#ifdef OIIO_KERNEL_BINOP
+OIIO_KERNEL_BINOP (k_add, _mm512_add_ps, _mm256_add_ps, _mm_add_ps, +)
+OIIO_KERNEL_BINOP (k_sub, _mm512_sub_ps, _mm256_sub_ps, _mm_sub_ps, -)
+OIIO_KERNEL_BINOP (k_mul, _mm512_mul_ps, _mm256_mul_ps, _mm_mul_ps, *)
+#undef OIIO_KERNEL_BINOP
+
+
+
+static void
+k_mad (float *r, const float *a, const float *b, const float *c, size_t n)
+{
+#if defined(__AVX512F__)
+    for ( ; n >= 16; n -= 16, r += 16, a += 16, b += 16, c += 16) {
+        __m512 ab = _mm512_mul_ps (_mm512_loadu_ps (a), _mm512_loadu_ps (b));
+        _mm512_storeu_ps (r, _mm512_add_ps (ab, _mm512_loadu_ps (c)));
+    }
+#endif
+    for ( ; n >= 8; n -= 8, r += 8, a += 8, b += 8, c += 8) {
+        __m256 ab = _mm256_mul_ps (_mm256_loadu_ps (a), _mm256_loadu_ps (b));
+        _mm256_storeu_ps (r, _mm256_add_ps (ab, _mm256_loadu_ps (c)));
+    }
+    for ( ; n; --n) {
+        float ab = *a++ * *b++;
+        *r++ = ab + *c++;
+    }
+}
+#define OIIO_KERNEL_PIXELMATH 1
+#endif
+
+
+}  // anon namespace
+#endif // OIIO_SIMD_KERNELS_ENABLED
+
+
+
+const SIMDKernels *
+OIIO_SIMD_KERNELS_FUNC ()
+{
+#if OIIO_SIMD_KERNELS_ENABLED
+    // The 4-wide pixel math is no better than what the baseline compiles
+    // to, so only the 8- and 16-wide builds provide it.
+    static const SIMDKernels kernels = {
+        OIIO_SIMD_KERNELS_NAME,
+        k_uint8_to_float,
+        k_uint16_to_float,
+#if defined(__F16C__)
+        k_half_to_float,
+#else
+        NULL,
+#endif
+        k_float_to_uint8,
+        k_float_to_uint16,
+#if defined(__F16C__)
+        k_float_to_half,
+#else
+        NULL,
+#endif
+#ifdef OIIO_KERNEL_PIXELMATH
+        k_add, k_sub, k_mul, k_mad
+#else
+        NULL, NULL, NULL, NULL
+#endif
+    };
+    return &kernels;
+#else
+    return NULL;
+#endif
+}
+
+
+}  // namespace pvt
+OIIO_NAMESPACE_END
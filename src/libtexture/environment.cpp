@@ -30,6 +30,7 @@
 
 
 #include <math.h>
+#include <algorithm>
 #include <string>
 #include <sstream>
 #include <list>
@@ -317,6 +318,73 @@ vector_to_latlong (const Imath::V3f& R, bool y_is_up, float &s, float &t)
 
 
 
+/// Convert a direction vector to the cube face it points at (numbered in
+/// the order px, nx, py, ny, pz, nz) and the st coordinates on 0-1 within
+/// that face.  Also return, in major, the major axis component of the
+/// unit-length R, by whose square the face's texels shrink (in angle)
+/// away from its center.
+inline int
+vector_to_cubeface (const Imath::V3f& R, float &s, float &t, float &major)
+{
+    float ax = fabsf(R[0]), ay = fabsf(R[1]), az = fabsf(R[2]);
+    int face;
+    float ma, sc, tc;
+    if (ax >= ay && ax >= az) {
+        face = R[0] >= 0.0f ? 0 : 1;
+        ma = ax;
+        sc = R[0] >= 0.0f ? -R[2] : R[2];
+        tc = -R[1];
+    } else if (ay >= az) {
+        face = R[1] >= 0.0f ? 2 : 3;
+        ma = ay;
+        sc = R[0];
+        tc = R[1] >= 0.0f ? R[2] : -R[2];
+    } else {
+        face = R[2] >= 0.0f ? 4 : 5;
+        ma = az;
+        sc = R[2] >= 0.0f ? R[0] : -R[0];
+        tc = -R[1];
+    }
+    float invma = ma > 0.0f ? 1.0f / ma : 0.0f;
+    s = Imath::clamp (0.5f * (sc * invma + 1.0f), 0.0f, 1.0f);
+    t = Imath::clamp (0.5f * (tc * invma + 1.0f), 0.0f, 1.0f);
+    float len = R.length();
+    major = len > 0.0f ? ma / len : 1.0f;
+    return face;
+}
+
+
+
+/// Convert the st coordinates within a cube face of resolution res to
+/// those, relative to the whole image, that the samplers expect for a
+/// 1x6 stack of faces, such that a bilinear lookup never strays onto the
+/// next face in the stack.
+inline void
+cubeface_to_stack (const ImageCacheFile &texturefile, int res, int face,
+                   float &s, float &t)
+{
+    // Texel coordinates within the face
+    float x, y;
+    if (texturefile.sample_border()) {
+        x = s * (res-1);
+        y = t * (res-1);
+    } else {
+        x = Imath::clamp (s * res - 0.5f, 0.0f, float(res-1));
+        y = Imath::clamp (t * res - 0.5f, 0.0f, float(res-1));
+    }
+    y += face * res;
+    // ...and back to st over the whole image, inverting st_to_texel.
+    if (texturefile.sample_border()) {
+        s = res > 1 ? x / (res-1) : 0.0f;
+        t = y / (6*res-1);
+    } else {
+        s = (x + 0.5f) / res;
+        t = (y + 0.5f) / (6*res);
+    }
+}
+
+
+
 bool
 TextureSystemImpl::environment (ustring filename, TextureOpt &options,
                                 const Imath::V3f &R,
@@ -371,14 +439,28 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
         return missing_texture (options, nchannels, result,
                                 dresultds, dresultdt);
 
+    TraceScope trace (*m_imagecache, thread_info, TraceTextureLookup,
+                      texturefile->filename(), options.subimage);
+    trace.min_ticks (m_imagecache->trace_lookup_ticks ());
+
     const ImageSpec &spec (texturefile->spec(options.subimage, 0));
 
+    // Cube maps stored as a 1x6 stack of faces are looked up one face at
+    // a time, as ordinary 2D textures, which avoids the lat-long map's
+    // pole handling and its stretched footprints at high latitudes.
+    bool cube = (texturefile->m_envlayout == LayoutCubeOneBySix);
+
     // Environment maps dictate particular wrap modes
-    options.swrap = texturefile->m_sample_border ?
-        TextureOpt::WrapPeriodicSharedBorder : TextureOpt::WrapPeriodic;
+    if (cube) {
+        options.swrap = TextureOpt::WrapClamp;
+        options.envlayout = LayoutCubeOneBySix;
+    } else {
+        options.swrap = texturefile->m_sample_border ?
+            TextureOpt::WrapPeriodicSharedBorder : TextureOpt::WrapPeriodic;
+        options.envlayout = LayoutLatLong;
+    }
     options.twrap = TextureOpt::WrapClamp;
 
-    options.envlayout = LayoutLatLong;
     int actualchannels = Imath::clamp (spec.nchannels - options.firstchannel,
                                        0, nchannels);
 
@@ -428,9 +510,15 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
         minorlength = xfilt;
     }
 
+    // A bicubic lookup would reach past the edge of a cube face into
+    // whichever face is next to it in the stack, so use bilinear.
+    int interpmode = options.interpmode;
+    if (cube && interpmode > TextureOpt::InterpBilinear)
+        interpmode = TextureOpt::InterpBilinear;
+
     sampler_prototype sampler;
     long long *probecount;
-    switch (options.interpmode) {
+    switch (interpmode) {
     case TextureOpt::InterpClosest :
         sampler = &TextureSystemImpl::sample_closest;
         probecount = &stats.closest_interps;
@@ -471,26 +559,41 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
 
     ImageCacheFile::SubimageInfo &subinfo (texturefile->subimageinfo(options.subimage));
 
-    // FIXME -- assuming latlong
+    // Only the MIP levels that still hold all six faces are of use for a
+    // cube map (the last few, below one texel per face, can't).
+    int nmiplevels = (int)subinfo.levels.size();
+    if (cube) {
+        int m = 1;
+        while (m < nmiplevels && subinfo.spec(m).height == 6*subinfo.spec(m).width)
+            ++m;
+        nmiplevels = m;
+    }
+
     bool ok = true;
     float pos = -0.5f + 0.5f * invsamples;
     for (int sample = 0;  sample < nsamples;  ++sample, pos += invsamples) {
         Imath::V3f Rsamp = R + pos*Rmajor;
-        float s, t;
-        vector_to_latlong (Rsamp, texturefile->m_y_up, s, t);
+        float s, t, major = 1.0f;
+        int face = 0;
+        if (cube)
+            face = vector_to_cubeface (Rsamp, s, t, major);
+        else
+            vector_to_latlong (Rsamp, texturefile->m_y_up, s, t);
 
         // Determine the MIP-map level(s) we need: we will blend
         //  data(miplevel[0]) * (1-levelblend) + data(miplevel[1]) * levelblend
         int miplevel[2] = { -1, -1 };
         float levelblend = 0;
 
-        int nmiplevels = (int)subinfo.levels.size();
         for (int m = 0;  m < nmiplevels;  ++m) {
             // Compute the filter size in raster space at this MIP level.
             // Filters are in radians, and the vertical resolution of a
             // latlong map is PI radians.  So to compute the raster size of
-            // our filter width...
-            float filtwidth_ras = subinfo.spec(m).full_height * filtwidth * M_1_PI;
+            // our filter width...  A cube face spans 2 units of its
+            // plane, each subtending major^2 radians.
+            float filtwidth_ras = cube
+                ? subinfo.spec(m).width * filtwidth / (2.0f * major * major)
+                : subinfo.spec(m).full_height * filtwidth * M_1_PI;
             // Once the filter width is smaller than one texel at this level,
             // we've gone too far, so we know that we want to interpolate the
             // previous level and the current level.  Note that filtwidth_ras
@@ -534,7 +637,7 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
                 continue;
             ++npointson;
             int lev = miplevel[level];
-            if (options.interpmode == TextureOpt::InterpSmartBicubic) {
+            if (interpmode == TextureOpt::InterpSmartBicubic) {
                 if (lev == 0 ||
                     (texturefile->spec(options.subimage,lev).full_height < naturalres/2)) {
                     sampler = &TextureSystemImpl::sample_bicubic;
@@ -547,8 +650,12 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
                 *probecount += 1;
             }
 
-            OIIO_SIMD4_ALIGN float sval[4] = { s, 0.0f, 0.0f, 0.0f };
-            OIIO_SIMD4_ALIGN float tval[4] = { t, 0.0f, 0.0f, 0.0f };
+            float slev = s, tlev = t;
+            if (cube)
+                cubeface_to_stack (*texturefile, subinfo.spec(lev).width,
+                                   face, slev, tlev);
+            OIIO_SIMD4_ALIGN float sval[4] = { slev, 0.0f, 0.0f, 0.0f };
+            OIIO_SIMD4_ALIGN float tval[4] = { tlev, 0.0f, 0.0f, 0.0f };
             OIIO_SIMD4_ALIGN float weight[4] = { levelweight[level]*invsamples,
                                                  0.0f, 0.0f, 0.0f };
             float4 r, drds, drdt;
@@ -577,6 +684,88 @@ TextureSystemImpl::environment (TextureHandle *texture_handle_,
 
 
 
+
+
+/// Invert one of the CDFs baked by maketx: given cdf[0..n-1] (the
+/// cumulative probability at the end of each of n equal bins) and u in
+/// [0,1), return the continuous position in [0,1) it maps to, and store
+/// the density there in pdf.
+inline float
+sample_cdf (const float *cdf, int n, float u, float &pdf)
+{
+    int i = int (std::upper_bound (cdf, cdf+n-1, u) - cdf);
+    float lo = i ? cdf[i-1] : 0.0f;
+    float p = cdf[i] - lo;
+    float x = p > 0.0f ? (u - lo) / p : 0.5f;
+    pdf = p * n;
+    return (i + Imath::clamp (x, 0.0f, 1.0f)) / n;
+}
+
+
+
+bool
+TextureSystemImpl::environment_sample (ustring filename, TextureOpt &options,
+                                       float u1, float u2,
+                                       Imath::V3f &R, float &pdf)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texturefile = find_texturefile (filename, thread_info);
+    return environment_sample ((TextureHandle *)texturefile,
+                               (Perthread *)thread_info, options,
+                               u1, u2, R, pdf);
+}
+
+
+
+bool
+TextureSystemImpl::environment_sample (TextureHandle *texture_handle_,
+                                       Perthread *thread_info_,
+                                       TextureOpt &options,
+                                       float u1, float u2,
+                                       Imath::V3f &R, float &pdf)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    TextureFile *texturefile = verify_texturefile ((TextureFile *)texture_handle_, thread_info);
+    R.setValue (0.0f, 0.0f, 0.0f);
+    pdf = 0.0f;
+    if (! texturefile  ||  texturefile->broken())
+        return false;
+
+    const ImageCacheFile::SubimageInfo &subinfo (texturefile->subimageinfo(options.subimage));
+    int w = subinfo.env_importance_width;
+    int h = subinfo.env_importance_height;
+    if (! w) {
+        error ("No importance sampling tables in \"%s\" (see maketx --envlatl-importance)",
+               texturefile->filename().c_str());
+        return false;
+    }
+
+    // Choose a row from the marginal CDF, then a column from that row's
+    // conditional CDF.
+    const float *marginal = &subinfo.env_importance[0];
+    float tpdf, spdf;
+    float t = sample_cdf (marginal, h, u2, tpdf);
+    int row = Imath::clamp (int(t * h), 0, h-1);
+    float s = sample_cdf (marginal + h + row*w, w, u1, spdf);
+
+    // Invert vector_to_latlong for the chosen (s,t).
+    float phi = 2.0f * float(M_PI) * (s - 0.5f);
+    float elevation = float(M_PI) * (0.5f - t);
+    float sinphi, cosphi, sinelev, coselev;
+    sincos (phi, &sinphi, &cosphi);
+    sincos (elevation, &sinelev, &coselev);
+    if (texturefile->m_y_up)
+        R.setValue (-coselev * sinphi, sinelev, coselev * cosphi);
+    else
+        R.setValue (coselev * cosphi, coselev * sinphi, sinelev);
+
+    // Convert the pdf from st space to solid angle, which is 2*pi*pi*sin
+    // (theta) per unit st area, where theta is the angle from the pole.
+    if (coselev > 0.0f)
+        pdf = spdf * tpdf / (2.0f * float(M_PI) * float(M_PI) * coselev);
+    return true;
+}
+
 }  // end namespace pvt
 
 OIIO_NAMESPACE_END
@@ -0,0 +1,374 @@
+/*
+  Copyright 2017 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+
+
+// FileWatcher: tracks which of the files an ImageCache has referenced
+// were changed on disk, so that invalidate_all() need not stat them all.
+// Linux uses inotify on the files' directories; elsewhere (and for
+// directories on network file systems, where inotify only sees changes
+// made by this host) a background thread polls the files' modification
+// times.
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#  include <sys/inotify.h>
+#  include <sys/vfs.h>
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <errno.h>
+#endif
+
+#include "OpenImageIO/filesystem.h"
+#include "OpenImageIO/sysutil.h"
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/timer.h"
+#include "imagecache_pvt.h"
+
+
+OIIO_NAMESPACE_BEGIN
+    using namespace pvt;
+
+namespace pvt {
+
+namespace {
+
+// Watched files are known by the path we watch them under (directory,
+// slash, name), and each maps to the filename(s) the cache knows it by.
+typedef std::map<std::string, std::vector<ustring> > WatchedPaths;
+
+static std::string
+split_path (const std::string &path, std::string &dir)
+{
+    dir = Filesystem::parent_path (path);
+    if (dir.empty())
+        dir = ".";
+    return dir + "/" + Filesystem::filename (path);
+}
+
+
+#ifdef __linux__
+// Is the directory on a network (or FUSE) file system, whose changes
+// made by other hosts inotify never hears about?
+static bool
+remote_filesystem (const std::string &dir)
+{
+    struct statfs st;
+    if (statfs (dir.c_str(), &st) != 0)
+        return false;
+    switch ((unsigned int) st.f_type) {
+    case 0x6969:        // NFS
+    case 0x517B:        // SMB
+    case 0xFF534D42:    // CIFS
+    case 0xFE534D42:    // SMB2
+    case 0x5346414F:    // AFS
+    case 0x73757245:    // Coda
+    case 0x00C36400:    // Ceph
+    case 0x0BD00BD0:    // Lustre
+    case 0x47504653:    // GPFS
+    case 0x01021997:    // 9P
+    case 0x65735546:    // FUSE (sshfs, s3fs, ...)
+        return true;
+    default:
+        return false;
+    }
+}
+#endif
+
+}  // end anonymous namespace
+
+
+
+class FileWatcher::Impl {
+public:
+    Impl (float interval)
+        : m_interval(interval), m_lost(false), m_stop(false)
+#ifdef __linux__
+        , m_fd(-1)
+#endif
+    { }
+
+    ~Impl () {
+        if (m_poller) {
+            m_stop = true;
+            m_poller->join ();
+        }
+#ifdef __linux__
+        if (m_fd >= 0)
+            ::close (m_fd);
+#endif
+    }
+
+    // Set up the native backend, or the polling thread if there is none.
+    void start () {
+#ifdef __linux__
+        m_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd >= 0)
+            return;
+#endif
+        m_poller.reset (new thread (Poller (this)));
+    }
+
+    const char *backend () const {
+#ifdef __linux__
+        if (m_fd >= 0) {
+            lock_guard lock (m_mutex);
+            return m_poller ? "inotify+polling" : "inotify";
+        }
+#endif
+        return "polling";
+    }
+
+    void watch (const std::string &filename, ustring key) {
+        std::string dir, path = split_path (filename, dir);
+        lock_guard lock (m_mutex);
+        std::vector<ustring> &keys (m_paths[path]);
+        for (size_t i = 0;  i < keys.size();  ++i)
+            if (keys[i] == key)
+                return;
+        keys.push_back (key);
+#ifdef __linux__
+        if (m_fd >= 0) {
+            std::map<std::string,int>::const_iterator d = m_dirs.find (dir);
+            if (d == m_dirs.end()) {
+                if (remote_filesystem (dir)) {
+                    // Poll this directory's files instead (marked -1).
+                    m_dirs[dir] = -1;
+                } else {
+                    // Watch the directory rather than the file, which
+                    // catches files replaced by a rename and files that
+                    // don't exist yet.
+                    int wd = inotify_add_watch (m_fd, dir.c_str(),
+                                IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB |
+                                IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+                    if (wd >= 0) {
+                        m_dirs[dir] = wd;
+                        m_wds[wd] = dir;
+                    } else {
+                        // Can't watch it (e.g., no such directory):
+                        // report it as changed every time, as a stat
+                        // would have found.
+                        m_unwatched.push_back (key);
+                    }
+                    return;
+                }
+            } else if (d->second >= 0) {
+                return;
+            }
+            if (! m_poller)
+                m_poller.reset (new thread (Poller (this)));
+        }
+#endif
+        // Polling: remember what it looks like now.
+        m_mtimes[path] = Filesystem::exists (filename)
+                       ? (long long) Filesystem::last_write_time (filename) : -1;
+    }
+
+    bool changed (std::vector<ustring> &keys) {
+        lock_guard lock (m_mutex);
+#ifdef __linux__
+        if (m_fd >= 0)
+            read_events ();
+#endif
+        keys.insert (keys.end(), m_changed.begin(), m_changed.end());
+        keys.insert (keys.end(), m_unwatched.begin(), m_unwatched.end());
+        m_changed.clear ();
+        bool ok = ! m_lost;
+        m_lost = false;
+        return ok;
+    }
+
+private:
+    struct Poller {
+        Poller (Impl *impl) : m_impl(impl) { }
+        void operator() () { m_impl->poll_loop (); }
+        Impl *m_impl;
+    };
+
+    // Must hold m_mutex.
+    void path_changed (const std::string &path) {
+        WatchedPaths::const_iterator p = m_paths.find (path);
+        if (p != m_paths.end())
+            m_changed.insert (m_changed.end(), p->second.begin(),
+                              p->second.end());
+    }
+
+    void poll_loop () {
+        Timer timer;
+        while (! m_stop) {
+            if (timer() < m_interval) {
+                Sysutil::usleep (50000);
+                continue;
+            }
+            timer.reset ();
+            timer.start ();
+            // Stat under a copy of the list, so watch() and changed()
+            // aren't held up by slow file systems.
+            std::vector<std::pair<std::string,long long> > files;
+            {
+                lock_guard lock (m_mutex);
+                files.assign (m_mtimes.begin(), m_mtimes.end());
+            }
+            for (size_t i = 0;  i < files.size() && ! m_stop;  ++i) {
+                const std::string &path (files[i].first);
+                long long t = Filesystem::exists (path)
+                            ? (long long) Filesystem::last_write_time (path) : -1;
+                if (t != files[i].second) {
+                    lock_guard lock (m_mutex);
+                    m_mtimes[path] = t;
+                    path_changed (path);
+                }
+            }
+        }
+    }
+
+#ifdef __linux__
+    // Drain the pending inotify events.  Must hold m_mutex.
+    void read_events () {
+        char buf[16384] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        for (;;) {
+            ssize_t len = ::read (m_fd, buf, sizeof(buf));
+            if (len <= 0)
+                break;
+            for (char *p = buf;  p < buf + len; ) {
+                const struct inotify_event *ev = (const struct inotify_event *)p;
+                p += sizeof(struct inotify_event) + ev->len;
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    m_lost = true;  // events were dropped
+                    continue;
+                }
+                std::map<int,std::string>::iterator w = m_wds.find (ev->wd);
+                if (w == m_wds.end())
+                    continue;
+                const std::string &dir (w->second);
+                if (ev->mask & IN_MOVE_SELF) {
+                    // The watch would follow the directory to its new
+                    // name; drop it, which is reported as IN_IGNORED.
+                    inotify_rm_watch (m_fd, ev->wd);
+                    continue;
+                }
+                if (ev->mask & IN_DELETE_SELF)
+                    continue;   // IN_IGNORED follows
+                if (ev->mask & IN_IGNORED) {
+                    // The directory itself went away: everything in it
+                    // changed, and from now on can't be watched.
+                    std::string prefix = dir + "/";
+                    for (WatchedPaths::iterator f = m_paths.lower_bound (prefix);
+                         f != m_paths.end() &&
+                             f->first.compare (0, prefix.size(), prefix) == 0;
+                         ++f) {
+                        if (f->first.find ('/', prefix.size()) != std::string::npos)
+                            continue;  // in a subdirectory
+                        m_changed.insert (m_changed.end(), f->second.begin(),
+                                          f->second.end());
+                        m_unwatched.insert (m_unwatched.end(),
+                                            f->second.begin(), f->second.end());
+                    }
+                    m_dirs.erase (dir);
+                    m_wds.erase (w);
+                    continue;
+                }
+                if (ev->len)
+                    path_changed (dir + "/" + ev->name);
+            }
+        }
+    }
+#endif
+
+    float m_interval;                 ///< Polling interval (seconds)
+    mutable mutex m_mutex;            ///< Protects everything below
+    WatchedPaths m_paths;             ///< Watched paths -> cache filenames
+    std::vector<ustring> m_changed;   ///< Changed since last changed()
+    std::vector<ustring> m_unwatched; ///< Can't be watched, always changed
+    bool m_lost;                      ///< Lost track of some changes
+    std::map<std::string,long long> m_mtimes; ///< Polling: last mod times
+    boost::scoped_ptr<thread> m_poller; ///< Polling thread
+    atomic_int m_stop;                ///< Tell the polling thread to stop
+#ifdef __linux__
+    int m_fd;                         ///< inotify instance
+    std::map<std::string,int> m_dirs; ///< Watched (or, if -1, polled) dirs
+    std::map<int,std::string> m_wds;  ///< Watch descriptors -> directories
+#endif
+};
+
+
+
+void
+FileWatcher::start (float interval)
+{
+    stop ();
+    m_impl = new Impl (interval);
+    m_impl->start ();
+}
+
+
+
+void
+FileWatcher::stop ()
+{
+    delete m_impl;
+    m_impl = NULL;
+}
+
+
+
+const char *
+FileWatcher::backend () const
+{
+    return m_impl ? m_impl->backend() : "";
+}
+
+
+
+void
+FileWatcher::watch (const std::string &filename, ustring key)
+{
+    if (m_impl)
+        m_impl->watch (filename, key);
+}
+
+
+
+bool
+FileWatcher::changed (std::vector<ustring> &keys)
+{
+    return m_impl ? m_impl->changed (keys) : false;
+}
+
+
+}  // end namespace pvt
+
+OIIO_NAMESPACE_END
@@ -33,6 +33,8 @@
 #include <sstream>
 #include <vector>
 #include <cstring>
+#include <limits>
+#include <new>
 
 #include <OpenEXR/ImathMatrix.h>
 
@@ -53,10 +55,22 @@
 #include "OpenImageIO/texture.h"
 #include "OpenImageIO/simd.h"
 #include "imagecache_pvt.h"
+#include "imageio_pvt.h"
 
+#include <boost/checked_delete.hpp>
 #include <boost/foreach.hpp>
 #include <boost/scoped_array.hpp>
 
+#ifndef _WIN32
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <signal.h>
+# include <errno.h>
+# include <ctime>
+#endif
+
 
 OIIO_NAMESPACE_BEGIN
     using namespace pvt;
@@ -122,6 +136,48 @@ iorate_compare (const ImageCacheFileRef &a, const ImageCacheFileRef &b)
 }
 
 
+// Functor to compare texture lookup cost, sort in descending order
+static bool
+profile_compare (const ImageCacheFileRef &a, const ImageCacheFileRef &b)
+{
+    return a->profile_ticks() > b->profile_ticks();
+}
+
+
+static long long
+ticks_to_ns (long long ticks)
+{
+    return (long long) (FastTimer::seconds (ticks) * 1.0e9);
+}
+
+
+// Charge the phases of finding one tile to the "texture_profile"
+// statistics of the tile's MIP level, and to the thread's running total
+// of tile time (which the TextureSystem subtracts from filtering time).
+class TileProfileTimer {
+public:
+    TileProfileTimer (bool enabled, const TileID &id,
+                      ImageCachePerThreadInfo *thread_info)
+        : m_timer (enabled),
+          m_profile (enabled ? &id.file().levelinfo(id.subimage(),id.miplevel()).profile
+                             : NULL),
+          m_thread_info (thread_info)
+    { }
+    void lookup () { if (m_profile) charge (m_profile->lookup_ticks); }
+    void wait ()   { if (m_profile) charge (m_profile->wait_ticks); }
+    void decode () { if (m_profile) charge (m_profile->decode_ticks); }
+private:
+    FastTimer m_timer;
+    ImageCacheFile::LevelProfile *m_profile;
+    ImageCachePerThreadInfo *m_thread_info;
+    void charge (atomic_ll &phase) {
+        long long ticks = m_timer.lap_ticks ();
+        phase += ticks;
+        m_thread_info->profile_tile_ticks += ticks;
+    }
+};
+
+
 // Functor to compare amount of redundant reading, sort in descending order
 static bool
 redundantbytes_compare (const ImageCacheFileRef &a, const ImageCacheFileRef &b)
@@ -160,6 +216,29 @@ ImageCacheStatistics::init ()
     tile_locking_time = 0;
     find_file_time = 0;
     find_tile_time = 0;
+    prefetch_calls = 0;
+    prefetch_tiles_queued = 0;
+    nonblocking_tiles_queued = 0;
+    approximate_lookups = 0;
+    untiled_band_hits = 0;
+    disk_cache_hits = 0;
+    disk_cache_misses = 0;
+    shared_cache_hits = 0;
+    shared_cache_misses = 0;
+    remote_cache_hits = 0;
+    remote_cache_misses = 0;
+    file_reopens = 0;
+    concurrent_tile_reads = 0;
+    tiles_coalesced = 0;
+    procedural_tiles = 0;
+    files_from_index = 0;
+    file_reopen_time = 0;
+    tiles_compressed = 0;
+    compressed_bytes_raw = 0;
+    compressed_bytes = 0;
+    tiles_decompressed = 0;
+    compress_time = 0;
+    decompress_time = 0;
 
     // TextureSystem stats:
     texture_queries = 0;
@@ -174,8 +253,11 @@ ImageCacheStatistics::init ()
     aniso_probes = 0;
     max_aniso = 1;
     closest_interps = 0;
+    point_samples = 0;
     bilinear_interps = 0;
     cubic_interps = 0;
+    ewa_interps = 0;
+    ewa_texels = 0;
     file_retry_success = 0;
     tile_retry_success = 0;
 }
@@ -205,6 +287,29 @@ ImageCacheStatistics::merge (const ImageCacheStatistics &s)
     tile_locking_time += s.tile_locking_time;
     find_file_time += s.find_file_time;
     find_tile_time += s.find_tile_time;
+    prefetch_calls += s.prefetch_calls;
+    prefetch_tiles_queued += s.prefetch_tiles_queued;
+    nonblocking_tiles_queued += s.nonblocking_tiles_queued;
+    approximate_lookups += s.approximate_lookups;
+    untiled_band_hits += s.untiled_band_hits;
+    disk_cache_hits += s.disk_cache_hits;
+    disk_cache_misses += s.disk_cache_misses;
+    shared_cache_hits += s.shared_cache_hits;
+    shared_cache_misses += s.shared_cache_misses;
+    remote_cache_hits += s.remote_cache_hits;
+    remote_cache_misses += s.remote_cache_misses;
+    file_reopens += s.file_reopens;
+    concurrent_tile_reads += s.concurrent_tile_reads;
+    tiles_coalesced += s.tiles_coalesced;
+    procedural_tiles += s.procedural_tiles;
+    files_from_index += s.files_from_index;
+    file_reopen_time += s.file_reopen_time;
+    tiles_compressed += s.tiles_compressed;
+    compressed_bytes_raw += s.compressed_bytes_raw;
+    compressed_bytes += s.compressed_bytes;
+    tiles_decompressed += s.tiles_decompressed;
+    compress_time += s.compress_time;
+    decompress_time += s.decompress_time;
 
     // TextureSystem stats:
     texture_queries += s.texture_queries;
@@ -219,17 +324,69 @@ ImageCacheStatistics::merge (const ImageCacheStatistics &s)
     aniso_probes += s.aniso_probes;
     max_aniso = std::max (max_aniso, s.max_aniso);
     closest_interps += s.closest_interps;
+    point_samples += s.point_samples;
     bilinear_interps += s.bilinear_interps;
     cubic_interps += s.cubic_interps;
+    ewa_interps += s.ewa_interps;
+    ewa_texels += s.ewa_texels;
     file_retry_success += s.file_retry_success;
     tile_retry_success += s.tile_retry_success;
 }
 
 
 
+void
+LatencyRecorder::clear ()
+{
+    for (int b = 0;  b < NumBuckets;  ++b)
+        m_counts[b] = 0;
+    m_sum_ns = 0;
+    m_max_ns = 0;
+}
+
+
+
+void
+LatencyRecorder::record (double seconds)
+{
+    // Bucket b holds durations up to 2^((b+1)/4) microseconds.
+    int b = 0;
+    if (seconds > 1.0e-6)
+        b = std::min (int (BucketsPerDoubling * 1.4426950408889634 *
+                           log (seconds * 1.0e6)), int(NumBuckets) - 1);
+    long long ns = (long long) (seconds * 1.0e9);
+    m_counts[b] += 1;
+    m_sum_ns += ns;
+    for (long long old = m_max_ns;  ns > old;  old = m_max_ns)
+        if (m_max_ns.bool_compare_and_swap (old, ns))
+            break;
+}
+
+
+
+void
+LatencyRecorder::snapshot (ImageCache::LatencyHistogram &hist) const
+{
+    hist.upper.resize (NumBuckets);
+    hist.counts.resize (NumBuckets);
+    hist.count = 0;
+    for (int b = 0;  b < NumBuckets;  ++b) {
+        hist.upper[b] = 1.0e-6 * pow (2.0, double(b+1) / BucketsPerDoubling);
+        hist.counts[b] = m_counts[b];
+        hist.count += hist.counts[b];
+    }
+    // The count is totaled from the buckets, so it always matches them;
+    // the sum may include a duration recorded during the snapshot.
+    hist.sum = 1.0e-9 * m_sum_ns;
+    hist.max = 1.0e-9 * m_max_ns;
+}
+
+
+
 ImageCacheFile::LevelInfo::LevelInfo (const ImageSpec &spec_,
                                       const ImageSpec &nativespec_)
-    : spec(spec_), nativespec(nativespec_)
+    : spec(spec_), nativespec(nativespec_),
+      shared_metadata(false), shared_nativemetadata(false)
 {
     full_pixel_range = (spec.x == spec.full_x && spec.y == spec.full_y &&
                         spec.z == spec.full_z &&
@@ -254,33 +411,185 @@ ImageCacheFile::LevelInfo::LevelInfo (const ImageSpec &spec_,
     int total_tiles = nxtiles * nytiles * nztiles;
     ASSERT (total_tiles >= 1);
     tiles_read = new atomic_ll [round_to_multiple (total_tiles, 64) / 64];
+
+    // Read the table of single-color tiles that maketx may have left.
+    // Formats whose MIP levels share one header (such as OpenEXR) will
+    // show every level the top level's table, so only believe it if it
+    // matches this level's tiling.
+    string_view table = spec.get_string_attribute ("oiio:ConstantTiles");
+    int nx, ny, nz, nc, ncolors;
+    if (table.size() &&
+          Strutil::parse_int (table, nx) && Strutil::parse_char (table, ',') &&
+          Strutil::parse_int (table, ny) && Strutil::parse_char (table, ',') &&
+          Strutil::parse_int (table, nz) && Strutil::parse_char (table, ',') &&
+          Strutil::parse_int (table, nc) && Strutil::parse_char (table, ',') &&
+          Strutil::parse_int (table, ncolors) &&
+          nx == nxtiles && ny == nytiles && nz == nztiles &&
+          nc == spec.nchannels && ncolors > 0 && ncolors <= 32767) {
+        bool ok = true;
+        constant_colors.resize (size_t(ncolors) * nc);
+        for (size_t i = 0;  ok && i < constant_colors.size();  ++i)
+            ok = Strutil::parse_char (table, ',') &&
+                 Strutil::parse_float (table, constant_colors[i]);
+        constant_tiles.reserve (total_tiles);
+        while (ok && Strutil::parse_char (table, ',')) {
+            int run, index;
+            ok = Strutil::parse_int (table, run) && Strutil::parse_char (table, ',') &&
+                 Strutil::parse_int (table, index) && run > 0 &&
+                 index >= -1 && index < ncolors &&
+                 constant_tiles.size() + run <= size_t(total_tiles);
+            if (ok)
+                constant_tiles.insert (constant_tiles.end(), run, (short)index);
+        }
+        if (! ok || constant_tiles.size() != size_t(total_tiles)) {
+            constant_tiles.clear ();
+            constant_colors.clear ();
+        }
+    }
+
+    // Likewise for the content hashes of tiles with identical twins.
+    string_view hashes = spec.get_string_attribute ("oiio:TileHashes");
+    int ngroups;
+    if (hashes.size() &&
+          Strutil::parse_int (hashes, nx) && Strutil::parse_char (hashes, ',') &&
+          Strutil::parse_int (hashes, ny) && Strutil::parse_char (hashes, ',') &&
+          Strutil::parse_int (hashes, nz) && Strutil::parse_char (hashes, ',') &&
+          Strutil::parse_int (hashes, ngroups) &&
+          nx == nxtiles && ny == nytiles && nz == nztiles && ngroups > 0) {
+        bool ok = true;
+        tile_hashes.resize (total_tiles, 0);
+        for (int g = 0;  ok && g < ngroups;  ++g) {
+            ok = Strutil::parse_char (hashes, ',');
+            char *end = NULL;
+            unsigned long long hash = ok ? strtoull (hashes.data(), &end, 16) : 0;
+            ok &= (end && end > hashes.data() && end <= hashes.data()+hashes.size());
+            if (ok)
+                hashes.remove_prefix (end - hashes.data());
+            int n = 0;
+            ok = ok && Strutil::parse_char (hashes, ',') &&
+                 Strutil::parse_int (hashes, n) && n > 0;
+            for (int i = 0;  ok && i < n;  ++i) {
+                int t;
+                ok = Strutil::parse_char (hashes, ',') &&
+                     Strutil::parse_int (hashes, t) && t >= 0 && t < total_tiles;
+                if (ok)
+                    tile_hashes[t] = hash;
+            }
+        }
+        if (! ok)
+            tile_hashes.clear ();
+    }
 }
 
 
 
 ImageCacheFile::LevelInfo::LevelInfo (const LevelInfo &src)
     : spec(src.spec), nativespec(src.nativespec),
+      shared_metadata(src.shared_metadata),
+      shared_nativemetadata(src.shared_nativemetadata),
+      fullspec(src.fullspec), fullnativespec(src.fullnativespec),
       full_pixel_range(src.full_pixel_range),
       onetile(src.onetile),
       polecolorcomputed(src.polecolorcomputed),
       polecolor(src.polecolor),
       nxtiles(src.nxtiles),
       nytiles(src.nytiles),
-      nztiles(src.nztiles)
+      nztiles(src.nztiles),
+      constant_tiles(src.constant_tiles),
+      constant_colors(src.constant_colors),
+      tile_hashes(src.tile_hashes), tile_offsets(src.tile_offsets)
 {
     int nwords = round_to_multiple (nxtiles * nytiles * nztiles, 64) / 64;
     tiles_read = new atomic_ll [nwords];
     for (int i = 0; i < nwords; ++i)
         tiles_read[i] = src.tiles_read[i];
+    profile.lookups = src.profile.lookups;
+    profile.probes = src.profile.probes;
+    profile.lookup_ticks = src.profile.lookup_ticks;
+    profile.wait_ticks = src.profile.wait_ticks;
+    profile.decode_ticks = src.profile.decode_ticks;
+    profile.filter_ticks = src.profile.filter_ticks;
 }
 
 
 
+long long
+ImageCacheFile::profile_ticks () const
+{
+    long long ticks = 0;
+    for (int s = 0, send = subimages();  s < send;  ++s)
+        for (int m = 0, mend = miplevels(s);  m < mend;  ++m)
+            ticks += levelinfo(s,m).profile.total_ticks();
+    return ticks;
+}
+
+
+
+namespace {
+
+// The ImageInput through which the ImageCacheFile of a procedural image
+// learns its specs.  Tiles are normally generated by read_tile_procedural
+// without going through here at all.
+class ProceduralInput : public ImageInput {
+public:
+    ProceduralInput (ImageCache::TileProvider *provider)
+        : m_provider(provider), m_subimage(-1), m_miplevel(-1) { }
+    virtual ~ProceduralInput () { }
+    virtual const char *format_name (void) const { return "procedural"; }
+    virtual bool open (const std::string &name, ImageSpec &newspec) {
+        return seek_subimage (0, 0, newspec);
+    }
+    virtual bool close () {
+        m_subimage = -1;
+        m_miplevel = -1;
+        return true;
+    }
+    virtual int current_subimage (void) const { return m_subimage; }
+    virtual int current_miplevel (void) const { return m_miplevel; }
+    virtual bool seek_subimage (int subimage, int miplevel,
+                                ImageSpec &newspec) {
+        if (subimage == m_subimage && miplevel == m_miplevel) {
+            newspec = m_spec;
+            return true;
+        }
+        ImageSpec spec;
+        if (subimage < 0 || miplevel < 0 ||
+            ! m_provider->get_spec (subimage, miplevel, spec))
+            return false;
+        if (spec.tile_width <= 0 || spec.tile_height <= 0) {
+            error ("Procedural images must be tiled");
+            return false;
+        }
+        m_spec = spec;
+        m_subimage = subimage;
+        m_miplevel = miplevel;
+        newspec = m_spec;
+        return true;
+    }
+    virtual bool read_native_scanline (int y, int z, void *data) {
+        error ("Procedural images must be tiled");
+        return false;
+    }
+    virtual bool read_native_tile (int x, int y, int z, void *data) {
+        return m_provider->fill_tile (m_subimage, m_miplevel, x, y, z,
+                                      0, m_spec.nchannels, m_spec.format,
+                                      data);
+    }
+private:
+    ImageCache::TileProvider *m_provider;
+    int m_subimage, m_miplevel;
+};
+
+}  // anon namespace
+
+
+
 ImageCacheFile::ImageCacheFile (ImageCacheImpl &imagecache,
                                 ImageCachePerThreadInfo *thread_info,
                                 ustring filename,
                                 ImageInput::Creator creator,
-                                const ImageSpec *config)
+                                const ImageSpec *config,
+                                ImageCache::TileProvider *provider)
     : m_filename(filename), m_used(true), m_broken(false),
       m_texformat(TexFormatTexture),
       m_swrap(TextureOpt::WrapBlack), m_twrap(TextureOpt::WrapBlack),
@@ -288,12 +597,19 @@ ImageCacheFile::ImageCacheFile (ImageCacheImpl &imagecache,
       m_envlayout(LayoutTexture), m_y_up(false), m_sample_border(false),
       m_is_udim(false),
       m_tilesread(0), m_bytesread(0), m_timesopened(0), m_iotime(0),
-      m_mipused(false), m_validspec(false), m_errors_issued(0),
-      m_imagecache(imagecache), m_duplicate(NULL),
+      m_mipused(false), m_priority(0), m_quota(0), m_mem_used(0),
+      m_resident(new ResidentTiles),
+      m_validspec(false), m_errors_issued(0),
+      m_imagecache(imagecache),
+      m_extra_open(0), m_extra_busy(0), m_extra_allowed(false),
+      m_concurrent(false),
+      m_duplicate(NULL),
       m_total_imagesize(0),
       m_total_imagesize_ondisk(0),
-      m_inputcreator(creator),
-      m_configspec(config ? new ImageSpec(*config) : NULL)
+      m_inputcreator(creator), m_provider(provider),
+      m_configspec(config ? new ImageSpec(*config) : NULL),
+      m_mapping_size(0), m_untiled_band_bytes(0),
+      m_lru_prev(NULL), m_lru_next(NULL), m_lru_list(-1), m_open_cost(0)
 {
     m_filename_original = m_filename;
     m_filename = imagecache.resolve_filename (m_filename_original.string());
@@ -314,6 +630,7 @@ ImageCacheFile::ImageCacheFile (ImageCacheImpl &imagecache,
             m_filename.find("<u>") != m_filename.npos ||
             m_filename.find("<v>") != m_filename.npos)) {
         m_is_udim = true;
+        m_udim_pages.reset (new atomic_ll [udim_pages]);
     }
 }
 
@@ -326,6 +643,129 @@ ImageCacheFile::~ImageCacheFile ()
 
 
 
+void
+ImageCacheFile::tile_resident (const TileID &id)
+{
+    spin_lock lock (m_resident->mutex);
+    m_resident->tiles.insert (id);
+}
+
+
+
+void
+ImageCacheFile::tile_evicted (const TileID &id)
+{
+    spin_lock lock (m_resident->mutex);
+    m_resident->tiles.erase (id);
+}
+
+
+
+void
+ImageCacheFile::resident_tiles (std::vector<TileID> &ids) const
+{
+    spin_lock lock (m_resident->mutex);
+    ids.insert (ids.end(), m_resident->tiles.begin(), m_resident->tiles.end());
+}
+
+
+
+size_t
+ImageCacheFile::nresident () const
+{
+    spin_lock lock (m_resident->mutex);
+    return m_resident->tiles.size();
+}
+
+
+
+// Does b have the same metadata (extra_attribs and channel names) as a?
+static bool
+same_metadata (const ImageSpec &a, const ImageSpec &b)
+{
+    if (a.extra_attribs.size() != b.extra_attribs.size() ||
+          a.channelnames != b.channelnames)
+        return false;
+    for (size_t i = 0, e = a.extra_attribs.size();  i < e;  ++i) {
+        const ImageIOParameter &pa (a.extra_attribs[i]);
+        const ImageIOParameter &pb (b.extra_attribs[i]);
+        // Strings are ustrings, so comparing the bytes is enough
+        if (pa.name() != pb.name() || pa.type() != pb.type() ||
+              pa.nvalues() != pb.nvalues() || pa.interp() != pb.interp() ||
+              memcmp (pa.data(), pb.data(), pa.datasize()) != 0)
+            return false;
+    }
+    return true;
+}
+
+
+
+// Approximate bytes of memory taken by the metadata of spec.  The
+// characters of string attributes live in the ustring table, so don't
+// count them.
+static size_t
+metadata_bytes (const ImageSpec &spec)
+{
+    size_t bytes = spec.extra_attribs.size() * sizeof(ImageIOParameter);
+    for (size_t i = 0, e = spec.extra_attribs.size();  i < e;  ++i)
+        bytes += spec.extra_attribs[i].datasize();
+    for (size_t c = 0, e = spec.channelnames.size();  c < e;  ++c)
+        bytes += sizeof(std::string) + spec.channelnames[c].capacity();
+    return bytes;
+}
+
+
+
+// Drop the metadata of spec, freeing its memory.
+static void
+strip_metadata (ImageSpec &spec)
+{
+    spec.extra_attribs.free ();
+    std::vector<std::string> empty;
+    std::swap (spec.channelnames, empty);
+}
+
+
+
+void
+ImageCacheFile::SubimageInfo::share_metadata ()
+{
+    const ImageSpec &top (levels[0].spec);
+    for (size_t m = 0, e = levels.size();  m < e;  ++m) {
+        LevelInfo &lev (levels[m]);
+        if (m > 0 && same_metadata (top, lev.spec)) {
+            metadata_saved += metadata_bytes (lev.spec);
+            strip_metadata (lev.spec);
+            lev.shared_metadata = true;
+        }
+        if (same_metadata (top, lev.nativespec)) {
+            metadata_saved += metadata_bytes (lev.nativespec);
+            strip_metadata (lev.nativespec);
+            lev.shared_nativemetadata = true;
+        }
+    }
+}
+
+
+
+size_t
+ImageCacheFile::SubimageInfo::metadata_memory () const
+{
+    size_t bytes = 0;
+    spin_lock lock (metadata_mutex);
+    for (size_t m = 0, e = levels.size();  m < e;  ++m) {
+        const LevelInfo &lev (levels[m]);
+        bytes += metadata_bytes (lev.spec) + metadata_bytes (lev.nativespec);
+        if (lev.fullspec)
+            bytes += metadata_bytes (*lev.fullspec);
+        if (lev.fullnativespec)
+            bytes += metadata_bytes (*lev.fullnativespec);
+    }
+    return bytes;
+}
+
+
+
 void
 ImageCacheFile::SubimageInfo::init (const ImageSpec &spec, bool forcefloat)
 {
@@ -394,6 +834,54 @@ ImageCacheFile::SubimageInfo::init (const ImageSpec &spec, bool forcefloat)
         if (average_color.size() == size_t(spec.nchannels))
             has_average_color = true;
     }
+
+    // See if there are environment importance sampling tables
+    string_view importance = spec.get_string_attribute ("oiio:EnvImportance");
+    if (from_maketx && importance.size()) {
+        int w = 0, h = 0;
+        if (Strutil::parse_int (importance, w) &&
+              Strutil::parse_char (importance, ',') &&
+              Strutil::parse_int (importance, h) && w > 0 && h > 0) {
+            env_importance.reserve (h + w*h);
+            while (Strutil::parse_char (importance, ',')) {
+                float val;
+                if (! Strutil::parse_float (importance, val))
+                    break;
+                env_importance.push_back (val);
+            }
+        }
+        if (env_importance.size() == size_t(h + w*h)) {
+            env_importance_width = w;
+            env_importance_height = h;
+        } else {
+            env_importance.clear ();
+        }
+    }
+
+    // See if there are conservative min/max channels
+    string_view minmax = spec.get_string_attribute ("oiio:MinMaxChannels");
+    int nbase = 0, minchan = -1, maxchan = -1;
+    if (from_maketx && minmax.size() &&
+          Strutil::parse_int (minmax, nbase) &&
+          Strutil::parse_char (minmax, ',') &&
+          Strutil::parse_int (minmax, minchan) &&
+          Strutil::parse_char (minmax, ',') &&
+          Strutil::parse_int (minmax, maxchan) &&
+          nbase > 0 && (minchan >= 0 || maxchan >= 0) &&
+          minchan + nbase <= spec.nchannels &&
+          maxchan + nbase <= spec.nchannels) {
+        minmax_nbase = nbase;
+        min_channel = minchan;
+        max_channel = maxchan;
+    }
+
+    // See if there are LEAN slope moment channels (always five of them)
+    string_view lean = spec.get_string_attribute ("oiio:LeanChannels");
+    int leanchan = -1;
+    if (from_maketx && lean.size() &&
+          Strutil::parse_int (lean, leanchan) &&
+          leanchan >= 0 && leanchan + 5 <= spec.nchannels)
+        lean_channel = leanchan;
 }
 
 
@@ -409,8 +897,11 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
         return !m_broken;
     if (m_broken)        // Already failed an open -- it's broken
         return false;
+    TraceScope trace (m_imagecache, thread_info, TraceFileOpen, m_filename);
 
-    if (m_inputcreator)
+    if (m_provider)
+        m_input.reset (new ProceduralInput (m_provider));
+    else if (m_inputcreator)
         m_input.reset (m_inputcreator());
     else
         m_input.reset (ImageInput::create (m_filename.string(),
@@ -427,10 +918,21 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
         configspec = *m_configspec;
     if (imagecache().unassociatedalpha())
         configspec.attribute ("oiio:UnassociatedAlpha", 1);
+    // When reopening a file whose subimage and mip headers we already
+    // hold, all we need back from the reader is the pixels, so hint that
+    // it needn't bother parsing the metadata again.
+    if (validspec())
+        configspec.attribute ("oiio:PixelsOnly", 1);
+    // On a reopen, the subimages won't all be visited again, so ask a
+    // reader that supports concurrent tile reads to get ready for them
+    // up front.  (The first open seeks to every subimage anyway.)
+    if (validspec() && imagecache().concurrent_reads())
+        configspec.attribute ("oiio:ConcurrentReads", 1);
 
     ImageSpec nativespec, tempspec;
     m_broken = false;
     bool ok = true;
+    Timer opentimer;
     for (int tries = 0; tries <= imagecache().failure_retries(); ++tries) {
         ok = m_input->open (m_filename.c_str(), nativespec, configspec);
         if (ok) {
@@ -454,16 +956,96 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
     m_fileformat = ustring (m_input->format_name());
     ++m_timesopened;
     m_imagecache.incr_open_files ();
+    double opencost = opentimer();
+    if (validspec()) {
+        ++thread_info->m_stats.file_reopens;
+        thread_info->m_stats.file_reopen_time += opencost;
+    }
+    m_imagecache.file_opened (this, opencost);
     use ();
+    {
+        spin_lock lock (m_extra_mutex);
+        m_extra_allowed = true;
+    }
 
     // If we are simply re-opening a closed file, and the spec is still
     // valid, we're done, no need to reread the subimage and mip headers.
-    if (validspec())
-        return true;
+    // Otherwise, we know that we've opened this file for the very first
+    // time.  So read all the subimages, fill out all the fields of the
+    // ImageCacheFile.
+    if (! validspec() && ! init_subimages (thread_info, NULL))
+        return false;
+
+    if (imagecache().concurrent_reads() &&
+          m_input->supports ("concurrent_reads")) {
+        spin_lock lock (m_extra_mutex);
+        m_concurrent = true;
+    }
+    return true;
+}
+
+
+
+bool
+ImageCacheFile::seek_nativespec (const MetadataIndex::Entry *indexed,
+                                 int subimage, int miplevel,
+                                 ImageSpec &nativespec)
+{
+    if (! indexed)
+        return m_input->seek_subimage (subimage, miplevel, nativespec);
+    if (subimage >= (int)indexed->subimages.size() ||
+        miplevel >= (int)indexed->subimages[subimage].nativespecs.size())
+        return false;
+    nativespec = indexed->subimages[subimage].nativespecs[miplevel];
+    return true;
+}
+
+
+
+namespace {
+
+// The number of scanlines that an untiled file stores (and compresses)
+// together, or 1 if not known.  Reading any of them means decompressing
+// them all.
+int
+scanline_chunk_height (const ImageSpec &spec, ustring fileformat)
+{
+    int rows = spec.get_int_attribute ("tiff:RowsPerStrip", 0);
+    if (rows > 0)
+        return rows;
+    if (fileformat == "openexr") {
+        std::string comp = spec.get_string_attribute ("compression");
+        if (comp == "zip" || comp == "pxr24")
+            return 16;
+        if (comp == "piz" || comp == "b44" || comp == "b44a" || comp == "dwaa")
+            return 32;
+        if (comp == "dwab")
+            return 256;
+    }
+    return 1;
+}
+
+}  // end anonymous namespace
+
+
+
+bool
+ImageCacheFile::init_subimages (ImageCachePerThreadInfo *thread_info,
+                                const MetadataIndex::Entry *indexed)
+{
+    ImageSpec nativespec, tempspec;
+    if (! seek_nativespec (indexed, 0, 0, nativespec)) {
+        close ();
+        m_broken = true;
+        invalidate_spec ();
+        return false;
+    }
+
+    // If we're keeping an index, note the native specs as we read them.
+    MetadataIndex::Entry record;
+    bool recording = (! indexed && m_imagecache.metadata_index().enabled()
+                      && indexable());
 
-    // From here on, we know that we've opened this file for the very
-    // first time.  So read all the subimages, fill out all the fields
-    // of the ImageCacheFile.
     m_subimages.clear ();
     int nsubimages = 0;
 
@@ -475,8 +1057,12 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
     do {
         m_subimages.resize (nsubimages+1);
         SubimageInfo &si (subimageinfo(nsubimages));
+        if (recording)
+            record.subimages.resize (nsubimages+1);
         int nmip = 0;
         do {
+            if (recording)
+                record.subimages[nsubimages].nativespecs.push_back (nativespec);
             tempspec = nativespec;
             if (nmip == 0) {
                 // Things to do on MIP level 0, i.e. once per subimage
@@ -485,6 +1071,13 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
             if (tempspec.tile_width == 0 || tempspec.tile_height == 0) {
                 si.untiled = true;
                 int autotile = imagecache().autotile();
+                // An image too big to be sensibly cached as a single tile
+                // (such as a scanline EXR plate) is autotiled anyway.
+                int large = imagecache().autotile_large_MB();
+                if (! autotile && large > 0 &&
+                      tempspec.image_bytes() >= imagesize_t(large) * 1024 * 1024)
+                    autotile = 64;
+                si.autotile = autotile;
                 if (autotile) {
                     // Automatically make it appear as if it's tiled
                     if (imagecache().autoscanline()) {
@@ -492,7 +1085,16 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
                     } else {
                         tempspec.tile_width = std::min (tempspec.width, autotile);
                     }
-                    tempspec.tile_height = std::min (tempspec.height, autotile);
+                    // Make each row of tiles cover whole chunks of the
+                    // file's scanlines, so that no chunk is decompressed
+                    // for two tile rows.  (Only power-of-2 chunks up to
+                    // 256 scanlines, as the tile sizes must stay powers
+                    // of 2 and not grow wildly.)
+                    int chunk = scanline_chunk_height (tempspec, m_fileformat);
+                    int th = autotile;
+                    if (chunk > th && chunk <= 256 && ispow2 (chunk))
+                        th = chunk;
+                    tempspec.tile_height = std::min (tempspec.height, th);
                     tempspec.tile_depth = std::min (std::max(tempspec.depth,1), autotile);
                 } else {
                     // Don't auto-tile -- which really means, make it look like
@@ -518,9 +1120,33 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
             // ImageCache can't store differing formats per channel
             tempspec.channelformats.clear();
             LevelInfo levelinfo (tempspec, nativespec);
+            if (imagecache().mmap_tiles() && m_input && ! si.untiled &&
+                  nativespec.format == si.datatype) {
+                // Note where each tile is in the file, if they can all
+                // be used straight from a mapping of it.
+                const ImageSpec &s (levelinfo.spec);
+                std::vector<imagesize_t> &offsets (levelinfo.tile_offsets);
+                offsets.reserve (levelinfo.nxtiles * levelinfo.nytiles *
+                                 levelinfo.nztiles);
+                bool ok = true;
+                for (int z = 0; ok && z < levelinfo.nztiles; ++z)
+                    for (int y = 0; ok && y < levelinfo.nytiles; ++y)
+                        for (int x = 0; ok && x < levelinfo.nxtiles; ++x) {
+                            imagesize_t offset = 0;
+                            ok = m_input->native_tile_offset (
+                                          s.x + x * s.tile_width,
+                                          s.y + y * s.tile_height,
+                                          s.z + z * std::max (1, s.tile_depth),
+                                          offset);
+                            ok &= (offset % si.channelsize == 0);
+                            offsets.push_back (offset);
+                        }
+                if (! ok)
+                    offsets.clear ();
+            }
             si.levels.push_back (levelinfo);
             ++nmip;
-        } while (m_input->seek_subimage (nsubimages, nmip, nativespec));
+        } while (seek_nativespec (indexed, nsubimages, nmip, nativespec));
 
         // Special work for non-MIPmapped images -- but only if "automip"
         // is on, it's a non-mipmapped image, and it doesn't have a
@@ -535,6 +1161,7 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
             int w = tempspec.full_width;
             int h = tempspec.full_height;
             int d = tempspec.full_depth;
+            int autotile = si.untiled ? si.autotile : imagecache().autotile();
             while (w > 1 || h > 1 || d > 1) {
                 w = std::max (1, w/2);
                 h = std::max (1, h/2);
@@ -546,14 +1173,14 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
                 s.full_width = w;
                 s.full_height = h;
                 s.full_depth = d;
-                if (imagecache().autotile()) {
+                if (autotile) {
                     if (imagecache().autoscanline()) {
                        s.tile_width = w;
                     } else {
-                       s.tile_width = std::min (imagecache().autotile(), w);
+                       s.tile_width = std::min (autotile, w);
                     }
-                    s.tile_height = std::min (imagecache().autotile(), h);
-                    s.tile_depth = std::min (imagecache().autotile(), d);
+                    s.tile_height = std::min (autotile, h);
+                    s.tile_depth = std::min (autotile, d);
                 } else {
                     s.tile_width = w;
                     s.tile_height = h;
@@ -578,15 +1205,42 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
             m_input.reset ();
             return false;
         }
+        si.share_metadata ();
 
         ++nsubimages;
-    } while (m_input->seek_subimage (nsubimages, 0, nativespec));
+    } while (seek_nativespec (indexed, nsubimages, 0, nativespec));
     ASSERT ((size_t)nsubimages == m_subimages.size());
 
-    if (Filesystem::exists(m_filename.string()))
-        m_total_imagesize_ondisk = imagesize_t(Filesystem::file_size (m_filename));
-    else
-        m_total_imagesize_ondisk = 0;
+    if (indexed) {
+        // Already checked against the file by open_from_index.
+        m_total_imagesize_ondisk = imagesize_t (indexed->size);
+        m_mod_time = std::time_t (indexed->mod_time);
+    } else {
+        if (Filesystem::exists(m_filename.string()))
+            m_total_imagesize_ondisk = imagesize_t(Filesystem::file_size (m_filename));
+        else
+            m_total_imagesize_ondisk = 0;
+        m_mod_time = Filesystem::last_write_time (m_filename.string());
+    }
+
+    // If any level's tiles can be used straight from the file, map it.
+    // The mapping lives until the file is invalidated (and after that,
+    // until the last tile pointing into it is freed), no matter how many
+    // times the ImageInput is closed and reopened.
+    {
+        spin_lock lock (m_mapping_mutex);
+        m_mapping.reset ();
+        m_mapping_size = 0;
+    }
+    bool mappable = false;
+    for (size_t s = 0;  s < m_subimages.size();  ++s)
+        for (size_t m = 0;  m < m_subimages[s].levels.size();  ++m)
+            mappable |= ! m_subimages[s].levels[m].tile_offsets.empty();
+    if (mappable && ! map_file ()) {
+        for (size_t s = 0;  s < m_subimages.size();  ++s)
+            for (size_t m = 0;  m < m_subimages[s].levels.size();  ++m)
+                m_subimages[s].levels[m].tile_offsets.clear ();
+    }
 
     thread_info->m_stats.files_totalsize -= old_total_imagesize;
     thread_info->m_stats.files_totalsize += m_total_imagesize;
@@ -594,11 +1248,147 @@ ImageCacheFile::open (ImageCachePerThreadInfo *thread_info)
     thread_info->m_stats.files_totalsize_ondisk += m_total_imagesize_ondisk;
 
     init_from_spec ();  // Fill in the rest of the fields
+
+    if (indexed) {
+        // Restore the average colors that had been computed, rather than
+        // found in the file's metadata.
+        for (int s = 0;  s < nsubimages;  ++s) {
+            SubimageInfo &si (m_subimages[s]);
+            const MetadataIndex::SubimageEntry &se (indexed->subimages[s]);
+            if (se.has_average_color && ! si.has_average_color &&
+                  se.average_color.size() == size_t(si.spec(0).nchannels)) {
+                si.average_color = se.average_color;
+                si.has_average_color = true;
+            }
+        }
+    } else if (recording) {
+        record.size = (unsigned long long) m_total_imagesize_ondisk;
+        record.mod_time = (long long) m_mod_time;
+        record.fileformat = m_fileformat;
+        record.unassociatedalpha = imagecache().unassociatedalpha();
+        for (int s = 0;  s < nsubimages;  ++s) {
+            const SubimageInfo &si (m_subimages[s]);
+            record.subimages[s].has_average_color = si.has_average_color;
+            record.subimages[s].is_constant_image = si.is_constant_image;
+            record.subimages[s].average_color = si.average_color;
+        }
+        m_imagecache.metadata_index().add (m_filename, record);
+    }
+
+    for (int s = 0;  s < nsubimages;  ++s)
+        queue_automip (s);
+    return true;
+}
+
+
+
+bool
+ImageCacheFile::indexable () const
+{
+    // A custom reader or configuration hints could change what the specs
+    // look like, and mapped tiles need the file's tile offsets.
+    return ! m_inputcreator && ! m_provider && ! m_configspec && ! m_is_udim &&
+           ! imagecache().mmap_tiles();
+}
+
+
+
+bool
+ImageCacheFile::open_from_index (ImageCachePerThreadInfo *thread_info)
+{
+    MetadataIndex &index (m_imagecache.metadata_index());
+    if (! index.enabled() || m_broken || validspec() || ! indexable())
+        return false;
+    MetadataIndex::Entry entry;
+    if (! index.find (m_filename, entry) || entry.subimages.empty() ||
+          entry.unassociatedalpha != imagecache().unassociatedalpha())
+        return false;
+    // Only trust the entry if the file hasn't changed since.
+    if ((unsigned long long) Filesystem::file_size (m_filename) != entry.size ||
+          (long long) Filesystem::last_write_time (m_filename.string()) != entry.mod_time)
+        return false;
+    // The entry holds exactly what a real open would have found, so if
+    // init_subimages rejects it, the file is just as broken.
+    m_fileformat = entry.fileformat;
+    init_subimages (thread_info, &entry);
+    ++thread_info->m_stats.files_from_index;
     return true;
 }
 
 
 
+const ImageSpec &
+ImageCacheFile::complete_spec (int subimage, int miplevel, bool native) const
+{
+    const LevelInfo &lev (levelinfo (subimage, miplevel));
+    if (! (native ? lev.shared_nativemetadata : lev.shared_metadata))
+        return native ? lev.nativespec : lev.spec;
+    OIIO::shared_ptr<ImageSpec> &full (native ? lev.fullnativespec
+                                              : lev.fullspec);
+    spin_lock lock (subimageinfo(subimage).metadata_mutex);
+    if (! full) {
+        full.reset (new ImageSpec);
+        get_complete_spec (subimage, miplevel, native, *full);
+    }
+    return *full;
+}
+
+
+
+void
+ImageCacheFile::get_complete_spec (int subimage, int miplevel, bool native,
+                                   ImageSpec &spec) const
+{
+    const LevelInfo &lev (levelinfo (subimage, miplevel));
+    spec = native ? lev.nativespec : lev.spec;
+    if (native ? lev.shared_nativemetadata : lev.shared_metadata) {
+        const ImageSpec &top (this->spec (subimage, 0));
+        spec.extra_attribs = top.extra_attribs;
+        spec.channelnames = top.channelnames;
+    }
+}
+
+
+
+size_t
+ImageCacheFile::metadata_memory () const
+{
+    size_t bytes = 0;
+    for (int s = 0, send = subimages();  s < send;  ++s)
+        bytes += m_subimages[s].metadata_memory ();
+    return bytes;
+}
+
+
+
+size_t
+ImageCacheFile::metadata_saved () const
+{
+    size_t bytes = 0;
+    for (int s = 0, send = subimages();  s < send;  ++s)
+        bytes += m_subimages[s].metadata_saved;
+    return bytes;
+}
+
+
+
+size_t
+ImageCacheFile::automip_memory () const
+{
+    size_t bytes = 0;
+    counted_recursive_lock guard (m_input_mutex,
+                                  imagecache().lock_stats (LockFileInput));
+    for (int s = 0, send = subimages();  s < send;  ++s) {
+        if (AutomipLevels *am = m_subimages[s].automip.get()) {
+            spin_lock lock (am->mutex);
+            bytes += am->bytes;
+        }
+    }
+    return bytes;
+}
+
+
+
 void
 ImageCacheFile::init_from_spec ()
 {
@@ -662,6 +1452,8 @@ ImageCacheFile::init_from_spec ()
             m_envlayout = LayoutCubeThreeByTwo;
         else if (spec.width == w && spec.height == 6*h)
             m_envlayout = LayoutCubeOneBySix;
+        else if (spec.height == 6*spec.width)
+            m_envlayout = LayoutCubeOneBySix;  // no separate face window
         else
             m_envlayout = LayoutTexture;
     }
@@ -677,11 +1469,26 @@ ImageCacheFile::init_from_spec ()
         const Imath::M44f *m = (const Imath::M44f *)p->data();
         m_Mproj = c2w * (*m);
     }
-    // FIXME -- compute Mtex, Mras
+    // Screen space spans [-1,1] with y up; texture space spans [0,1]
+    // with t down, and raster space spans the pixel resolution.
+    Imath::M44f screentotex (0.5f, 0.0f, 0.0f, 0.0f,
+                             0.0f, -0.5f, 0.0f, 0.0f,
+                             0.0f, 0.0f, 1.0f, 0.0f,
+                             0.5f, 0.5f, 0.0f, 1.0f);
+    m_Mtex = m_Mproj * screentotex;
+    Imath::M44f textoras (float(spec.full_width), 0.0f, 0.0f, 0.0f,
+                          0.0f, float(spec.full_height), 0.0f, 0.0f,
+                          0.0f, 0.0f, 1.0f, 0.0f,
+                          float(spec.full_x), float(spec.full_y), 0.0f, 1.0f);
+    m_Mras = m_Mtex * textoras;
 #endif
 
-    // See if there's a SHA-1 hash in the image description
+    // See if there's a SHA-1 hash in the image description, or else a
+    // pixel hash by another algorithm (whose value is prefixed by the
+    // algorithm name, so it can't be mistaken for a SHA-1 fingerprint).
     std::string fing = spec.get_string_attribute ("oiio:SHA-1");
+    if (fing.empty())
+        fing = spec.get_string_attribute ("oiio:PixelHash");
     if (fing.length()) {
         m_fingerprint = ustring(fing);
         // If it looks like something other than OIIO wrote the file, forget
@@ -692,14 +1499,15 @@ ImageCacheFile::init_from_spec ()
             m_fingerprint.clear ();
     }
 
-    m_mod_time = Filesystem::last_write_time (m_filename.string());
-
     // Set all mipmap level read counts to zero
     int maxmip = 1;
     for (int s = 0, nsubimages = subimages();  s < nsubimages;  ++s)
         maxmip = std::max (maxmip, miplevels(s));
-    m_mipreadcount.clear ();
-    m_mipreadcount.resize(maxmip, 0);
+    {
+        spin_lock lock (m_extra_mutex);
+        m_mipreadcount.clear ();
+        m_mipreadcount.resize(maxmip, 0);
+    }
 
     DASSERT (! m_broken);
     m_validspec = true;
@@ -714,7 +1522,44 @@ ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
                            TypeDesc format, void *data)
 {
     ASSERT (chend > chbegin);
-    recursive_lock_guard guard (m_input_mutex);
+
+    // Another thread may already have read it along with its own tile.
+    if (take_coalesced_tile (subimage, miplevel, x, y, z, chbegin, chend, data))
+        return true;
+
+    // Procedural tiles are generated straight into the tile, without
+    // involving the ImageInput or its lock.  (Levels that the cache
+    // MIP-maps itself are made from the level below as for any file.)
+    if (m_provider && validspec() &&
+          ! (subimageinfo(subimage).unmipped && miplevel != 0))
+        return read_tile_procedural (thread_info, subimage, miplevel,
+                                     x, y, z, chbegin, chend, format, data);
+
+    // If the reader can fetch tiles without its ImageInput being locked,
+    // don't serialize on it at all.
+    if (m_imagecache.concurrent_reads()) {
+        bool ok = false;
+        if (read_tile_concurrent (thread_info, subimage, miplevel, x, y, z,
+                                  chbegin, chend, format, data, ok))
+            return ok;
+    }
+
+    // If another thread is busy reading through the main ImageInput,
+    // rather than wait for it, try to use a spare one.  (If we already
+    // hold the lock ourselves, try_lock will succeed.)
+    if (m_imagecache.max_inputs_per_file() > 1) {
+        if (m_input_mutex.try_lock ()) {
+            m_input_mutex.unlock ();
+        } else {
+            bool ok = false;
+            if (read_tile_extra (thread_info, subimage, miplevel, x, y, z,
+                                 chbegin, chend, format, data, ok))
+                return ok;
+        }
+    }
+
+    counted_recursive_lock guard (m_input_mutex,
+                                  imagecache().lock_stats (LockFileInput));
 
     if (! m_input && !m_broken) {
         // The file is already in the file cache, but the handle is
@@ -726,7 +1571,7 @@ ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
         m_input_mutex.unlock ();
         imagecache().check_max_files (thread_info);
         // Now we're back, whew!  Grab the lock again.
-        m_input_mutex.lock ();
+        lock_input_mutex ();
     }
 
     bool ok = open (thread_info);
@@ -738,7 +1583,7 @@ ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
         m_mipused = true;
 
     // count how many times this mipmap level was read
-    m_mipreadcount[miplevel]++;
+    thread_info->count_mip_read (this, miplevel);
 
     SubimageInfo &subinfo (subimageinfo(subimage));
 
@@ -764,47 +1609,360 @@ ImageCacheFile::read_tile (ImageCachePerThreadInfo *thread_info,
         return read_untiled (thread_info, subimage, miplevel,
                              x, y, z, chbegin, chend, format, data);
 
-    // Ordinary tiled
-    ImageSpec tmp;
-    if (m_input->current_subimage() != subimage ||
-        m_input->current_miplevel() != miplevel)
-        ok = m_input->seek_subimage (subimage, miplevel, tmp);
-    if (ok) {
-        for (int tries = 0; tries <= imagecache().failure_retries(); ++tries) {
-            const ImageSpec &spec (m_input->spec());
-            ok = m_input->read_tiles (x, x+spec.tile_width,
-                                      y, y+spec.tile_height,
-                                      z, z+spec.tile_depth,
-                                      chbegin, chend, format, data);
-            if (ok) {
-                if (tries)   // succeeded, but only after a failure!
-                    ++thread_info->m_stats.tile_retry_success;
-                (void) m_input->geterror ();  // Eat the errors
-                break;
-            }
-            if (tries < imagecache().failure_retries()) {
-                // We failed, but will wait a bit and try again.
+    // Ordinary tiled.  While we waited for the lock, the thread holding
+    // it may have read our tile as part of its run.  If the tiles to our
+    // right are wanted too, read them all with one call.
+    if (take_coalesced_tile (subimage, miplevel, x, y, z, chbegin, chend, data))
+        return true;
+    int ntiles = coalescible_run (thread_info, subimage, miplevel, x, y, z,
+                                  chbegin, chend, format);
+    if (ntiles > 1)
+        return read_tile_run (thread_info, subimage, miplevel, x, y, z,
+                              chbegin, chend, format, data, ntiles);
+    return read_tile_from (m_input.get(), thread_info, subimage, miplevel,
+                           x, y, z, chbegin, chend, format, data);
+}
+
+
+
+// The most tiles read on behalf of other threads that a file holds for
+// them to collect.
+static const size_t max_coalesced_tiles = 64;
+
+
+
+bool
+ImageCacheFile::take_coalesced_tile (int subimage, int miplevel,
+                                     int x, int y, int z,
+                                     int chbegin, int chend, void *data)
+{
+    spin_lock lock (m_coalesced_mutex);
+    for (std::deque<CoalescedTile>::iterator t = m_coalesced.begin();
+         t != m_coalesced.end();  ++t) {
+        if (t->x == x && t->y == y && t->z == z && t->subimage == subimage &&
+              t->miplevel == miplevel && t->chbegin == chbegin &&
+              t->chend == chend) {
+            memcpy (data, &t->pixels[0], t->pixels.size());
+            m_coalesced.erase (t);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+int
+ImageCacheFile::coalescible_run (ImageCachePerThreadInfo *thread_info,
+                                 int subimage, int miplevel,
+                                 int x, int y, int z, int chbegin, int chend,
+                                 TypeDesc format)
+{
+    int maxrun = imagecache().coalesce_tiles();
+    if (maxrun < 2 || format != datatype(subimage))
+        return 1;
+    const LevelInfo &lev (levelinfo (subimage, miplevel));
+    const ImageSpec &spec (lev.spec);
+    maxrun = std::min (maxrun, 1 + (spec.x + spec.width - x - 1) / spec.tile_width);
+    int whichtile = ((x - spec.x) / spec.tile_width)
+                  + ((y - spec.y) / spec.tile_height) * lev.nxtiles
+                  + ((z - spec.z) / spec.tile_depth) * (lev.nxtiles*lev.nytiles);
+    bool mappable = (lev.tile_offsets.size() && mapped() &&
+                     chbegin == 0 && chend == spec.nchannels);
+    bool dedup = (lev.tile_hashes.size() && imagecache().deduplicate_tiles());
+    int ntiles = 1;
+    for ( ;  ntiles < maxrun;  ++ntiles) {
+        int t = whichtile + ntiles;
+        if (mappable || (dedup && lev.tile_hashes[t]) ||
+              (lev.constant_tiles.size() && lev.constant_tiles[t] >= 0))
+            break;
+        TileID id (*this, subimage, miplevel, x + ntiles*spec.tile_width,
+                   y, z, chbegin, chend);
+        if (! imagecache().tile_awaiting_read (id, thread_info))
+            break;
+    }
+    return ntiles;
+}
+
+
+
+bool
+ImageCacheFile::read_tile_run (ImageCachePerThreadInfo *thread_info,
+                               int subimage, int miplevel,
+                               int x, int y, int z, int chbegin, int chend,
+                               TypeDesc format, void *data, int ntiles)
+{
+    const ImageSpec &spec (this->spec (subimage, miplevel));
+    stride_t pixelbytes = stride_t (chend - chbegin) * format.size();
+    size_t tilebytes = spec.tile_pixels() * pixelbytes;
+    std::vector<char> run (tilebytes * ntiles);
+    if (! read_tile_from (m_input.get(), thread_info, subimage, miplevel,
+                          x, y, z, chbegin, chend, format, &run[0], ntiles))
+        return false;
+
+    // Split the run back into tiles: ours goes straight to data, the
+    // rest wait in m_coalesced for their readers.
+    stride_t runystride = pixelbytes * spec.tile_width * ntiles;
+    stride_t runzstride = runystride * spec.tile_height;
+    stride_t tileystride = pixelbytes * spec.tile_width;
+    stride_t tilezstride = tileystride * spec.tile_height;
+    std::vector<CoalescedTile> others (ntiles - 1);
+    for (int t = 0;  t < ntiles;  ++t) {
+        char *dst = (char *)data;
+        if (t) {
+            CoalescedTile &c (others[t-1]);
+            c.subimage = subimage;  c.miplevel = miplevel;
+            c.x = x + t*spec.tile_width;  c.y = y;  c.z = z;
+            c.chbegin = chbegin;  c.chend = chend;
+            c.pixels.resize (tilebytes);
+            dst = &c.pixels[0];
+        }
+        OIIO::copy_image (chend - chbegin, spec.tile_width, spec.tile_height,
+                          spec.tile_depth, &run[t * tileystride], pixelbytes,
+                          pixelbytes, runystride, runzstride,
+                          dst, pixelbytes, tileystride, tilezstride);
+    }
+    {
+        spin_lock lock (m_coalesced_mutex);
+        for (size_t i = 0;  i < others.size();  ++i) {
+            m_coalesced.push_back (CoalescedTile());
+            std::swap (m_coalesced.back(), others[i]);
+        }
+        while (m_coalesced.size() > max_coalesced_tiles)
+            m_coalesced.pop_front ();
+    }
+    thread_info->m_stats.tiles_coalesced += ntiles - 1;
+    return true;
+}
+
+
+
+bool
+ImageCacheFile::read_tile_from (ImageInput *in,
+                                ImageCachePerThreadInfo *thread_info,
+                                int subimage, int miplevel,
+                                int x, int y, int z, int chbegin, int chend,
+                                TypeDesc format, void *data, int ntiles)
+{
+    bool ok = true;
+    ImageSpec tmp;
+    if (in->current_subimage() != subimage ||
+        in->current_miplevel() != miplevel)
+        ok = in->seek_subimage (subimage, miplevel, tmp);
+    if (ok) {
+        for (int tries = 0; tries <= imagecache().failure_retries(); ++tries) {
+            const ImageSpec &spec (in->spec());
+            ok = in->read_tiles (x, x+ntiles*spec.tile_width,
+                                 y, y+spec.tile_height,
+                                 z, z+spec.tile_depth,
+                                 chbegin, chend, format, data);
+            if (ok) {
+                if (tries)   // succeeded, but only after a failure!
+                    ++thread_info->m_stats.tile_retry_success;
+                (void) in->geterror ();  // Eat the errors
+                break;
+            }
+            if (tries < imagecache().failure_retries()) {
+                // We failed, but will wait a bit and try again.
                 Sysutil::usleep (1000 * 100);  // 100 ms
                 // TODO: should we attempt to close and re-open the file?
             }
         }
         if (! ok) {
-            std::string err = m_input->geterror();
+            std::string err = in->geterror();
             if (!err.empty() && errors_should_issue())
                 imagecache().error ("%s", err);
         }
     }
     if (ok) {
         size_t b = spec(subimage,miplevel).tile_bytes();
-        thread_info->m_stats.bytes_read += b;
-        m_bytesread += b;
-        ++m_tilesread;
+        for (int t = 0;  t < ntiles;  ++t) {
+            thread_info->m_stats.bytes_read += b;
+            thread_info->count_tile_read (this, b);
+        }
     }
     return ok;
 }
 
 
 
+bool
+ImageCacheFile::read_tile_concurrent (ImageCachePerThreadInfo *thread_info,
+                                      int subimage, int miplevel,
+                                      int x, int y, int z,
+                                      int chbegin, int chend,
+                                      TypeDesc format, void *data, bool &ok)
+{
+    // While m_extra_busy is nonzero, close() will wait for us before
+    // closing m_input, just as it does for reads from the extra inputs.
+    {
+        spin_lock lock (m_extra_mutex);
+        if (! m_concurrent || ! m_extra_allowed || ! validspec())
+            return false;
+        SubimageInfo &subinfo (subimageinfo(subimage));
+        if (subinfo.untiled || (subinfo.unmipped && miplevel != 0))
+            return false;   // Those need the full read_tile logic
+        ++m_extra_busy;
+    }
+
+    const ImageSpec &nspec (nativespec (subimage, miplevel));
+    TypeDesc nativeformat = nspec.format;
+    int nchans = nspec.nchannels;
+    size_t pixelsize = nativeformat.size() * nchans;
+    bool direct = (format == nativeformat && chbegin == 0 && chend == nchans);
+    std::vector<char> buf;
+    if (! direct)
+        buf.resize (nspec.tile_pixels() * pixelsize);
+    bool read = m_input->read_native_tile_at (subimage, miplevel, x, y, z,
+                                              direct ? data : &buf[0]);
+    if (read && ! direct)
+        convert_image (chend-chbegin, nspec.tile_width, nspec.tile_height,
+                       nspec.tile_depth, &buf[chbegin*nativeformat.size()],
+                       nativeformat, pixelsize, AutoStride, AutoStride,
+                       data, format, AutoStride, AutoStride, AutoStride);
+
+    spin_lock lock (m_extra_mutex);
+    --m_extra_busy;
+    if (! read)
+        return false;   // Let the ordinary path retry and report errors
+    if (miplevel > 0)
+        m_mipused = true;
+    thread_info->count_mip_read (this, miplevel);
+    size_t b = spec(subimage,miplevel).tile_bytes();
+    thread_info->m_stats.bytes_read += b;
+    ++thread_info->m_stats.concurrent_tile_reads;
+    thread_info->count_tile_read (this, b);
+    ok = true;
+    return true;
+}
+
+
+
+bool
+ImageCacheFile::read_tile_procedural (ImageCachePerThreadInfo *thread_info,
+                                      int subimage, int miplevel,
+                                      int x, int y, int z,
+                                      int chbegin, int chend,
+                                      TypeDesc format, void *data)
+{
+    if (! m_provider->fill_tile (subimage, miplevel, x, y, z,
+                                 chbegin, chend, format, data)) {
+        if (errors_should_issue())
+            imagecache().error ("Procedural image \"%s\" could not generate the tile at (%d,%d,%d) of subimage %d MIP level %d",
+                                m_filename, x, y, z, subimage, miplevel);
+        return false;
+    }
+    {
+        spin_lock lock (m_extra_mutex);
+        if (miplevel > 0)
+            m_mipused = true;
+        thread_info->count_mip_read (this, miplevel);
+    }
+    size_t b = spec(subimage,miplevel).tile_bytes();
+    thread_info->m_stats.bytes_read += b;
+    ++thread_info->m_stats.procedural_tiles;
+    thread_info->count_tile_read (this, b);
+    return true;
+}
+
+
+
+bool
+ImageCacheFile::read_tile_extra (ImageCachePerThreadInfo *thread_info,
+                                 int subimage, int miplevel,
+                                 int x, int y, int z, int chbegin, int chend,
+                                 TypeDesc format, void *data, bool &ok)
+{
+    // Grab an idle extra ImageInput, or note that we're going to open a
+    // new one.  While m_extra_busy is nonzero, close() will wait for us,
+    // so the spec and subimage info can't be invalidated underneath us.
+    ImageInput *in = NULL;
+    {
+        spin_lock lock (m_extra_mutex);
+        if (! m_extra_allowed || ! validspec())
+            return false;
+        SubimageInfo &subinfo (subimageinfo(subimage));
+        if (subinfo.untiled || (subinfo.unmipped && miplevel != 0))
+            return false;   // Those need the full read_tile logic
+        if (m_extra_inputs.size()) {
+            in = m_extra_inputs.back ();
+            m_extra_inputs.pop_back ();
+        } else if (m_extra_open+1 < m_imagecache.max_inputs_per_file()) {
+            ++m_extra_open;
+        } else {
+            return false;   // All in use, wait for the main one
+        }
+        ++m_extra_busy;
+        if (miplevel > 0)
+            m_mipused = true;
+    }
+    thread_info->count_mip_read (this, miplevel);
+
+    if (! in) {
+        // Open a new one. Failure is not an error -- just fall back to
+        // the main ImageInput.
+        if (m_inputcreator)
+            in = m_inputcreator ();
+        else
+            in = ImageInput::create (m_filename.string(),
+                                     m_imagecache.plugin_searchpath());
+        if (in) {
+            ImageSpec configspec, nativespec;
+            if (m_configspec)
+                configspec = *m_configspec;
+            if (imagecache().unassociatedalpha())
+                configspec.attribute ("oiio:UnassociatedAlpha", 1);
+            configspec.attribute ("oiio:PixelsOnly", 1);  // spec is valid
+            if (in->open (m_filename.c_str(), nativespec, configspec)) {
+                m_imagecache.incr_open_files ();
+            } else {
+                (void) in->geterror ();  // Eat the errors
+                delete in;
+                in = NULL;
+            }
+        }
+        if (! in) {
+            spin_lock lock (m_extra_mutex);
+            --m_extra_open;
+            --m_extra_busy;
+            thread_info->count_mip_read (this, miplevel, -1);
+            return false;
+        }
+    }
+
+    ok = read_tile_from (in, thread_info, subimage, miplevel,
+                         x, y, z, chbegin, chend, format, data);
+
+    spin_lock lock (m_extra_mutex);
+    m_extra_inputs.push_back (in);
+    --m_extra_busy;
+    return true;
+}
+
+
+
+void
+ImageCacheFile::close_extra_inputs ()
+{
+    for (atomic_backoff backoff;  ;  backoff()) {
+        spin_lock lock (m_extra_mutex);
+        m_extra_allowed = false;
+        m_concurrent = false;
+        if (m_extra_busy)
+            continue;   // wait for the in-progress reads to finish
+        for (size_t i = 0, e = m_extra_inputs.size();  i < e;  ++i) {
+            m_extra_inputs[i]->close ();
+            delete m_extra_inputs[i];
+            m_imagecache.decr_open_files ();
+        }
+        m_extra_inputs.clear ();
+        m_extra_open = 0;
+        return;
+    }
+}
+
+
+
 bool
 ImageCacheFile::read_unmipped (ImageCachePerThreadInfo *thread_info,
                                int subimage, int miplevel,
@@ -822,6 +1980,17 @@ ImageCacheFile::read_unmipped (ImageCachePerThreadInfo *thread_info,
     // N.B. No need to lock the mutex, since this is only called
     // from read_tile, which already holds the lock.
 
+    // JPEG can decode the first few levels directly at reduced size,
+    // which is both faster and better filtered than resampling.
+    if (read_dct_scaled (thread_info, subimage, miplevel, x, y, z,
+                         chbegin, chend, format, data))
+        return true;
+
+    // The levels may have been made all at once in the background.
+    if (read_automip (thread_info, subimage, miplevel, x, y, z,
+                      chbegin, chend, format, data))
+        return true;
+
     // Figure out the size and strides for a single tile, make an ImageBuf
     // to hold it temporarily.
     const ImageSpec &spec (this->spec(subimage,miplevel));
@@ -843,8 +2012,8 @@ ImageCacheFile::read_unmipped (ImageCachePerThreadInfo *thread_info,
 //    int z0 = z - (z % spec.tile_depth);
 //    int z1 = std::min (z0+spec.tile_depth-1, spec.full_depth-1);
 
-    // Save the contents of the per-thread microcache.  This is because
-    // a caller several levels up may be retaining a reference to
+    // Save the last-found tile of the per-thread microcache.  This is
+    // because a caller several levels up may be retaining a reference to
     // thread_info->tile and expecting it not to suddenly point to a
     // different tile id!  It's a very reasonable assumption that if you
     // ask to read the last-found tile, it will still be the last-found
@@ -852,7 +2021,6 @@ ImageCacheFile::read_unmipped (ImageCachePerThreadInfo *thread_info,
     // to get_pixels may recursively trigger more tiles to be read, and
     // totally change the microcache.  Simple solution: save & restore it.
     ImageCacheTileRef oldtile = thread_info->tile;
-    ImageCacheTileRef oldlasttile = thread_info->lasttile;
 
     // Auto-mipping will totally thrash the cache if the user unwisely
     // sets it to be too small compared to the image file that needs to
@@ -892,13 +2060,336 @@ ImageCacheFile::read_unmipped (ImageCachePerThreadInfo *thread_info,
 
     // Restore the microcache to the way it was before.
     thread_info->tile = oldtile;
-    thread_info->lasttile = oldlasttile;
 
     return ok;
 }
 
 
 
+namespace {
+
+// Task for automip_async: make the coarser levels of one subimage.
+struct AutomipTask {
+    AutomipTask (ImageCacheFile *file, int subimage,
+                 const ImageCacheFile::AutomipLevelsRef &am)
+        : file(file), subimage(subimage), am(am) { }
+    void operator() () {
+        file->build_automip (file->imagecache().get_perthread_info(),
+                             subimage, *am);
+    }
+    ImageCacheFileRef file;
+    int subimage;
+    ImageCacheFile::AutomipLevelsRef am;
+};
+
+
+
+// Interpolate row y of a finer level horizontally at the coarser level's
+// texel centers (with black outside the finer level).
+void
+automip_hrow (const float *finer, int fw, int fh, int nchans, int y,
+              const std::vector<int> &xlow, const std::vector<float> &xfrac,
+              float *out)
+{
+    int cw = (int) xlow.size();
+    if (y < 0 || y >= fh) {
+        std::fill (out, out + size_t(cw) * nchans, 0.0f);
+        return;
+    }
+    const float *row = finer + size_t(y) * fw * nchans;
+    for (int i = 0;  i < cw;  ++i, out += nchans) {
+        int x = xlow[i];
+        float s = xfrac[i], s1 = 1.0f - s;
+        const float *v0 = (x >= 0 && x < fw) ? row + x * nchans : NULL;
+        const float *v1 = (x+1 >= 0 && x+1 < fw) ? row + (x+1) * nchans : NULL;
+        for (int c = 0;  c < nchans;  ++c)
+            out[c] = (v0 ? v0[c] : 0.0f) * s1 + (v1 ? v1[c] : 0.0f) * s;
+    }
+}
+
+
+
+// Make a whole coarser automip level from the next finer one, with the
+// same bilinear interpolation (to the bit) that read_unmipped does for
+// each texel, but separably: each row of the finer level that's needed
+// is interpolated horizontally just once.
+void
+automip_downsample (const float *finer, int fw, int fh,
+                    float *coarser, int cw, int ch, int nchans)
+{
+    std::vector<int> xlow (cw);
+    std::vector<float> xfrac (cw);
+    for (int i = 0;  i < cw;  ++i) {
+        float xf = (i+0.5f) / cw;
+        xfrac[i] = floorfrac (xf * fw - 0.5, &xlow[i]);
+    }
+    size_t rowsize = size_t(cw) * nchans;
+    std::vector<float> rows (2 * rowsize);
+    float *h[2] = { &rows[0], &rows[rowsize] };
+    int hy[2] = { -2, -2 };   // finer rows in h[], -2 if none
+    for (int j = 0;  j < ch;  ++j, coarser += rowsize) {
+        float yf = (j+0.5f) / ch;
+        int ylow;
+        float t = floorfrac (yf * fh - 0.5, &ylow);
+        float t1 = 1.0f - t;
+        if (hy[0] != ylow) {
+            if (hy[1] == ylow) {
+                std::swap (h[0], h[1]);
+                std::swap (hy[0], hy[1]);
+            } else {
+                automip_hrow (finer, fw, fh, nchans, ylow, xlow, xfrac, h[0]);
+                hy[0] = ylow;
+            }
+        }
+        if (hy[1] != ylow+1) {
+            automip_hrow (finer, fw, fh, nchans, ylow+1, xlow, xfrac, h[1]);
+            hy[1] = ylow+1;
+        }
+        for (size_t k = 0;  k < rowsize;  ++k)
+            coarser[k] = t1 * h[0][k] + t * h[1][k];
+    }
+}
+
+}  // end anonymous namespace
+
+
+
+ImageCacheFile::AutomipLevels::~AutomipLevels ()
+{
+    imagecache.decr_mem (bytes);
+}
+
+
+
+void
+ImageCacheFile::queue_automip (int subimage)
+{
+    SubimageInfo &si (subimageinfo(subimage));
+    si.automip.reset ();
+    // Only for automipped subimages whose levels line up the way
+    // read_unmipped assumes, and not for JPEG, whose first levels
+    // read_dct_scaled does better.
+    if (! imagecache().automip_async() || ! si.unmipped || si.volume ||
+          si.levels.size() < 2 || m_fileformat == "jpeg")
+        return;
+    const ImageSpec &top (si.spec(0));
+    if (top.x || top.y || top.full_x || top.full_y || top.depth > 1 ||
+          top.width != top.full_width || top.height != top.full_height)
+        return;
+    AutomipLevelsRef am (new AutomipLevels (imagecache()));
+    for (size_t m = 0;  m < si.levels.size();  ++m)
+        am->rois.push_back (get_roi (si.spec(m)));
+    am->datatype = si.datatype;
+    am->nchannels = top.nchannels;
+    if (imagecache().queue_io_task (AutomipTask (this, subimage, am)))
+        si.automip = am;
+}
+
+
+
+void
+ImageCacheFile::build_automip (ImageCachePerThreadInfo *thread_info,
+                               int subimage, AutomipLevels &am)
+{
+    {
+        spin_lock lock (am.mutex);
+        if (am.state != AutomipLevels::Queued)
+            return;
+        am.state = AutomipLevels::Running;
+    }
+
+    // Level by level, each made from the one above it (as stored, so
+    // in the cached data type) for the whole level at once, and without
+    // holding any locks.
+    // The float copy of the top level (and the first coarser level's
+    // scratch buffer) count against the cache memory while we work.
+    std::vector<OIIO::shared_ptr<ImageBuf> > levels (am.rois.size());
+    size_t bytes = 0;
+    int nchans = am.nchannels;
+    const ROI &top (am.rois[0]);
+    int fw = top.width(), fh = top.height();
+    size_t scratch = (size_t(fw) * fh
+                      + size_t(am.rois[1].width()) * am.rois[1].height())
+                   * nchans * sizeof(float);
+    imagecache().incr_mem (scratch);
+    std::vector<float> finer (size_t(fw) * fh * nchans), coarser;
+    bool ok = imagecache().get_pixels (this, thread_info, subimage, 0,
+                                       top.xbegin, top.xend,
+                                       top.ybegin, top.yend, 0, 1,
+                                       0, nchans, TypeDesc::FLOAT, &finer[0]);
+    for (size_t m = 1;  ok && m < levels.size();  ++m) {
+        int cw = am.rois[m].width(), ch = am.rois[m].height();
+        coarser.resize (size_t(cw) * ch * nchans);
+        automip_downsample (&finer[0], fw, fh, &coarser[0], cw, ch, nchans);
+        ImageSpec spec (cw, ch, nchans, am.datatype);
+        levels[m].reset (new ImageBuf (spec));
+        ok = levels[m]->set_pixels (get_roi (spec), TypeDesc::FLOAT,
+                                    &coarser[0]);
+        if (am.datatype != TypeDesc::FLOAT)
+            levels[m]->get_pixels (get_roi (spec), TypeDesc::FLOAT,
+                                   &coarser[0]);
+        finer.swap (coarser);
+        fw = cw;
+        fh = ch;
+        bytes += spec.image_bytes();
+        imagecache().incr_mem (spec.image_bytes());
+    }
+    if (! ok) {
+        // Leave it to read_unmipped (which will report any errors)
+        (void) imagecache().geterror ();
+        levels.clear ();
+        imagecache().decr_mem (bytes);
+        bytes = 0;
+    }
+    imagecache().decr_mem (scratch);
+
+    spin_lock lock (am.mutex);
+    am.levels.swap (levels);
+    am.bytes = bytes;
+    am.state = AutomipLevels::Done;
+}
+
+
+
+bool
+ImageCacheFile::read_automip (ImageCachePerThreadInfo *thread_info,
+                              int subimage, int miplevel,
+                              int x, int y, int z, int chbegin, int chend,
+                              TypeDesc format, void *data)
+{
+    // Take our own reference under the file's lock, since the file may
+    // be invalidated (and its subimages rebuilt) at any time.
+    AutomipLevelsRef am;
+    {
+        counted_recursive_lock guard (m_input_mutex,
+                                      imagecache().lock_stats (LockFileInput));
+        if (! validspec() || subimage >= subimages())
+            return false;
+        am = subimageinfo(subimage).automip;
+    }
+    if (! am)
+        return false;
+    // If the I/O threads haven't gotten to it yet, do it ourselves.
+    build_automip (thread_info, subimage, *am);
+    OIIO::shared_ptr<ImageBuf> level;
+    for (;;) {
+        {
+            spin_lock lock (am->mutex);
+            if (am->state == AutomipLevels::Done) {
+                if (miplevel < (int)am->levels.size())
+                    level = am->levels[miplevel];
+                break;
+            }
+        }
+        Sysutil::usleep (100);
+    }
+    if (! level)
+        return false;
+    const ImageSpec &spec (this->spec(subimage,miplevel));
+    return level->get_pixels (ROI (x, x + spec.tile_width,
+                                   y, y + spec.tile_height,
+                                   z, z + std::max (spec.tile_depth, 1),
+                                   chbegin, chend),
+                              format, data);
+}
+
+
+
+// Helper routine for read_tile: read a tile of MIP level 1, 2 or 3 of
+// an untiled JPEG by letting libjpeg scale it down by 2, 4 or 8 as it
+// decodes, which is far cheaper than reading the full image and resizing
+// it. The rest of the level's tiles go into the cache along the way.
+// Return false, without an error, if that isn't possible, so the caller
+// builds the level the usual way.
+bool
+ImageCacheFile::read_dct_scaled (ImageCachePerThreadInfo *thread_info,
+                                 int subimage, int miplevel,
+                                 int x, int y, int z, int chbegin, int chend,
+                                 TypeDesc format, void *data)
+{
+    // libjpeg can scale by 1/2, 1/4, 1/8 as it decodes.  Our own
+    // ImageInput is opened for it, so no input mutex is needed.
+    if (m_fileformat != "jpeg" || miplevel < 1 || miplevel > 3 ||
+        subimage != 0 || m_inputcreator)
+        return false;
+    const ImageSpec &spec (this->spec(subimage,miplevel));
+    int tw = spec.tile_width;
+    int th = spec.tile_height;
+    if (spec.depth > 1 || tw < 1 || th < 1)
+        return false;
+    boost::scoped_ptr<ImageInput> in (ImageInput::create (m_filename.string(),
+                                            m_imagecache.plugin_searchpath()));
+    if (! in)
+        return false;
+    ImageSpec configspec, scaledspec;
+    if (m_configspec)
+        configspec = *m_configspec;
+    configspec.attribute ("oiio:PixelsOnly", 1);
+    configspec.attribute ("jpeg:scale_denom", 1 << miplevel);
+    if (! in->open (m_filename.c_str(), scaledspec, configspec)) {
+        (void) in->geterror ();  // Eat the errors, the caller falls back
+        return false;
+    }
+    // The decoded size rounds up, where our MIP levels round down, so it
+    // may be a pixel bigger; anything smaller means scaling didn't happen.
+    if (scaledspec.width < spec.width || scaledspec.height < spec.height ||
+        scaledspec.width > spec.width+1 || scaledspec.height > spec.height+1) {
+        in->close ();
+        return false;
+    }
+
+    // Read the whole level into a buffer padded out to whole tiles.
+    ASSERT (chend > chbegin);
+    int nchans = chend - chbegin;
+    size_t pixelsize = size_t (nchans * format.size());
+    int nxtiles = (spec.width + tw - 1) / tw;
+    int nytiles = (spec.height + th - 1) / th;
+    stride_t scanlinesize = std::max (nxtiles * tw, scaledspec.width) * pixelsize;
+    std::vector<char> buf (scanlinesize * std::max (nytiles * th, scaledspec.height));
+    m_imagecache.incr_open_files ();
+    bool ok = in->read_scanlines (0, scaledspec.height, 0, chbegin, chend,
+                                  format, &buf[0], pixelsize, scanlinesize);
+    if (! ok)
+        (void) in->geterror ();
+    in->close ();
+    m_imagecache.decr_open_files ();
+    if (! ok)
+        return false;
+    size_t b = scaledspec.image_bytes ();
+    thread_info->m_stats.bytes_read += b;
+    thread_info->count_tile_read (this, b);
+
+    // Put all the level's tiles in the cache, except the one we were
+    // asked for, which goes to the caller.
+    stride_t xstride=AutoStride, ystride=AutoStride, zstride=AutoStride;
+    spec.auto_stride (xstride, ystride, zstride, format, nchans, tw, th);
+    int x0 = (x - spec.x) - ((x - spec.x) % tw);
+    int y0 = (y - spec.y) - ((y - spec.y) % th);
+    for (int j = 0;  j < spec.height;  j += th) {
+        for (int i = 0;  i < spec.width;  i += tw) {
+            const char *tilestart = &buf[j*scanlinesize + i*pixelsize];
+            if (i == x0 && j == y0) {
+                convert_image (nchans, tw, th, 1, tilestart, format,
+                               pixelsize, scanlinesize, scanlinesize*th,
+                               data, format, xstride, ystride, zstride);
+                continue;
+            }
+            TileID id (*this, subimage, miplevel, i+spec.x, j+spec.y, z,
+                       chbegin, chend);
+            if (! imagecache().tile_in_cache (id, thread_info)) {
+                ImageCacheTileRef tile;
+                tile = new ImageCacheTile (id, tilestart, format, pixelsize,
+                                           scanlinesize, scanlinesize*th);
+                ok &= tile->valid ();
+                imagecache().add_tile_to_cache (tile, thread_info);
+            }
+        }
+    }
+    return ok;
+}
+
+
+
 // Helper routine for read_tile that handles the rare (but tricky) case
 // of reading a "tile" from a file that's scanline-oriented.
 bool
@@ -931,39 +2422,58 @@ ImageCacheFile::read_untiled (ImageCachePerThreadInfo *thread_info,
     spec.auto_stride (xstride, ystride, zstride, format, nchans, tw, th);
 
     bool ok = true;
-    if (imagecache().autotile()) {
+    if (subimageinfo(subimage).autotile) {
         // Auto-tile is on, with a tile size that isn't the whole image.
         // We're only being asked for one tile, but since it's a
         // scanline image, we are forced to read (at the very least) a
         // whole row of tiles.  So we add all those tiles to the cache,
         // if not already present, on the assumption that it's highly
-        // likely that they will also soon be requested.
+        // likely that they will also soon be requested, and keep the
+        // scanlines around a while in case some of them get evicted
+        // before they are.
         // FIXME -- I don't think this works properly for 3D images
         size_t pixelsize = size_t (nchans * format.size());
         // Because of the way we copy below, we need to allocate the
         // buffer to be an even multiple of the tile width, so round up.
         stride_t scanlinesize = tw * ((spec.width+tw-1)/tw);
         scanlinesize *= pixelsize;
-        boost::scoped_array<char> buf (new char [scanlinesize * th]); // a whole tile-row size
         int yy = y - spec.y;   // counting from top scanline
         // [y0,y1] is the range of scanlines to read for a tile-row
         int y0 = yy - (yy % th);
         int y1 = std::min (y0 + th - 1, spec.height - 1);
         y0 += spec.y;
         y1 += spec.y;
-        // Read the whole tile-row worth of scanlines
-        ok = m_input->read_scanlines (y0, y1+1, z, chbegin, chend,
-                                      format, (void *)&buf[0],
-                                      pixelsize, scanlinesize);
-        if (! ok) {
-            std::string err = m_input->geterror();
-            if (!err.empty() && errors_should_issue())
-                imagecache().error ("%s", err);
+        UntiledBandRef band = find_untiled_band (subimage, miplevel, y0, z,
+                                                 chbegin, chend, format);
+        bool fresh = ! band;
+        if (band) {
+            ++thread_info->m_stats.untiled_band_hits;
+        } else {
+            band.reset (new UntiledBand);
+            band->subimage = subimage;
+            band->miplevel = miplevel;
+            band->y = y0;
+            band->z = z;
+            band->chbegin = chbegin;
+            band->chend = chend;
+            band->format = format;
+            band->pixels.resize (scanlinesize * th); // a whole tile-row size
+            // Read the whole tile-row worth of scanlines
+            ok = m_input->read_scanlines (y0, y1+1, z, chbegin, chend,
+                                          format, (void *)&band->pixels[0],
+                                          pixelsize, scanlinesize);
+            if (! ok) {
+                std::string err = m_input->geterror();
+                if (!err.empty() && errors_should_issue())
+                    imagecache().error ("%s", err);
+            } else {
+                keep_untiled_band (band);
+            }
+            size_t b = (y1-y0+1) * spec.scanline_bytes();
+            thread_info->m_stats.bytes_read += b;
+            thread_info->count_tile_read (this, b);
         }
-        size_t b = (y1-y0+1) * spec.scanline_bytes();
-        thread_info->m_stats.bytes_read += b;
-        m_bytesread += b;
-        ++m_tilesread;
+        const char *buf = &band->pixels[0];
         // At this point, we aren't reading from the file any longer,
         // and to avoid deadlock, we MUST release the input lock prior
         // to any attempt to add_tile_to_cache, lest another thread add
@@ -973,7 +2483,10 @@ ImageCacheFile::read_untiled (ImageCachePerThreadInfo *thread_info,
 
         // For all tiles in the tile-row, enter them into the cache if not
         // already there.  Special case for the tile we're actually being
-        // asked for -- save it in 'data' rather than adding a tile.
+        // asked for -- save it in 'data' rather than adding a tile.  If
+        // the scanlines came from a kept band, its other tiles were
+        // already added when it was read, so only the requested one is
+        // needed now.
         int xx = x - spec.x;   // counting from left row
         int x0 = xx - (xx % tw); // start of the tile we are retrieving
         for (int i = 0;  i < spec.width;  i += tw) {
@@ -983,7 +2496,7 @@ ImageCacheFile::read_untiled (ImageCachePerThreadInfo *thread_info,
                                &buf[x0 * pixelsize], format, pixelsize,
                                scanlinesize, scanlinesize*th, data, format,
                                xstride, ystride, zstride);
-            } else {
+            } else if (fresh) {
                 // Not the tile we asked for, but it's in the same
                 // tile-row, so let's put it in the cache anyway so
                 // it'll be there when asked for.
@@ -1013,8 +2526,7 @@ ImageCacheFile::read_untiled (ImageCachePerThreadInfo *thread_info,
         }
         size_t b = spec.image_bytes();
         thread_info->m_stats.bytes_read += b;
-        m_bytesread += b;
-        ++m_tilesread;
+        thread_info->count_tile_read (this, b);
         // If we read the whole image, presumably we're done, so release
         // the file handle.
         close ();
@@ -1025,38 +2537,176 @@ ImageCacheFile::read_untiled (ImageCachePerThreadInfo *thread_info,
 
 
 
-void
-ImageCacheFile::close ()
+ImageCacheFile::UntiledBandRef
+ImageCacheFile::find_untiled_band (int subimage, int miplevel, int y, int z,
+                                   int chbegin, int chend,
+                                   TypeDesc format) const
 {
-    // N.B. close() does not need to lock the m_input_mutex, because close()
-    // itself is only called by routines that hold the lock.
-    if (opened()) {
-        m_input->close ();
-        m_input.reset ();
-        m_imagecache.decr_open_files ();
-    }
+    for (size_t i = 0, n = m_untiled_bands.size();  i < n;  ++i) {
+        const UntiledBand &b (*m_untiled_bands[i]);
+        if (b.y == y && b.z == z && b.subimage == subimage &&
+              b.miplevel == miplevel && b.chbegin == chbegin &&
+              b.chend == chend && b.format == format)
+            return m_untiled_bands[i];
+    }
+    return UntiledBandRef();
 }
 
 
 
 void
-ImageCacheFile::release ()
+ImageCacheFile::keep_untiled_band (const UntiledBandRef &band)
 {
-    recursive_lock_guard guard (m_input_mutex);
-    if (m_used)
-        m_used = false;
-    else
-        close ();
+    size_t limit = imagecache().untiled_band_memory();
+    if (! limit)
+        return;
+    m_untiled_bands.push_back (band);
+    m_untiled_band_bytes += band->pixels.size();
+    // Drop the oldest bands, but never the one just read
+    size_t drop = 0;
+    while (m_untiled_band_bytes > limit &&
+           drop < m_untiled_bands.size() - 1)
+        m_untiled_band_bytes -= m_untiled_bands[drop++]->pixels.size();
+    m_untiled_bands.erase (m_untiled_bands.begin(),
+                           m_untiled_bands.begin() + drop);
 }
 
 
 
-void
-ImageCacheFile::invalidate ()
+#ifndef _WIN32
+namespace {
+// Deleter for a shared_ptr that owns an mmap'ed region.
+struct Unmapper {
+    Unmapper (size_t size) : size(size) { }
+    void operator() (char *p) const { munmap (p, size); }
+    size_t size;
+};
+}
+#endif
+
+
+
+bool
+ImageCacheFile::map_file ()
 {
-    recursive_lock_guard guard (m_input_mutex);
+#ifdef _WIN32
+    return false;
+#else
+    int fd = ::open (m_filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *base = MAP_FAILED;
+    if (fstat (fd, &st) == 0 && st.st_size > 0)
+        base = mmap (NULL, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close (fd);   // The mapping stays valid
+    if (base == MAP_FAILED)
+        return false;
+    OIIO::shared_ptr<char> mapping ((char *)base,
+                                    Unmapper (size_t(st.st_size)));
+    spin_lock lock (m_mapping_mutex);
+    m_mapping.swap (mapping);
+    m_mapping_size = imagesize_t (st.st_size);
+    return true;
+#endif
+}
+
+
+
+OIIO::shared_ptr<char>
+ImageCacheFile::mapped_tile (const LevelInfo &lev, int whichtile,
+                             size_t size, TypeDesc format) const
+{
+    if (lev.tile_offsets.empty())
+        return OIIO::shared_ptr<char>();
+    // Take our own reference, since the file may be invalidated (and
+    // m_mapping reset) while we use it.
+    OIIO::shared_ptr<char> mapping;
+    imagesize_t mapping_size;
+    {
+        spin_lock lock (m_mapping_mutex);
+        mapping = m_mapping;
+        mapping_size = m_mapping_size;
+    }
+    // The tile's padding must lie within the mapping, too, so the last
+    // tile of the file is usually read into memory instead.
+    imagesize_t offset = lev.tile_offsets[whichtile];
+    if (! mapping || offset + size > mapping_size)
+        return OIIO::shared_ptr<char>();
+    // The padding is whatever follows the tile in the file, not zeros.
+    // SIMD loads of the last pixel may bring it in, which is harmless
+    // unless it holds NaNs or infinities, so only map the tile if its
+    // padding is all finite numbers of the pixel type.
+    const char *pels = mapping.get() + offset;
+    size_t pad = OIIO_SIMD_MAX_SIZE_BYTES;
+    const char *padding = pels + size - pad;
+    if (format == TypeDesc::FLOAT) {
+        for (size_t i = 0;  i < pad/sizeof(float);  ++i)
+            if (! isfinite (((const float *)padding)[i]))
+                return OIIO::shared_ptr<char>();
+    } else if (format == TypeDesc::HALF) {
+        for (size_t i = 0;  i < pad/sizeof(half);  ++i)
+            if (! ((const half *)padding)[i].isFinite())
+                return OIIO::shared_ptr<char>();
+    } else if (format == TypeDesc::DOUBLE) {
+        for (size_t i = 0;  i < pad/sizeof(double);  ++i)
+            if (! isfinite (((const double *)padding)[i]))
+                return OIIO::shared_ptr<char>();
+    }
+    // Share ownership of the whole mapping, so it outlives the tile.
+    return OIIO::shared_ptr<char> (mapping, (char *)pels);
+}
+
+
+
+void
+ImageCacheFile::close ()
+{
+    // N.B. close() does not need to lock the m_input_mutex, because close()
+    // itself is only called by routines that hold the lock.
+    close_extra_inputs ();
+    m_untiled_bands.clear ();
+    m_untiled_band_bytes = 0;
+    {
+        spin_lock lock (m_coalesced_mutex);
+        m_coalesced.clear ();
+    }
+    if (opened()) {
+        TraceScope trace (m_imagecache, NULL, TraceFileClose, m_filename);
+        m_input->close ();
+        m_input.reset ();
+        m_imagecache.decr_open_files ();
+        m_imagecache.file_closed (this);
+    }
+}
+
+
+
+void
+ImageCacheFile::release ()
+{
+    counted_recursive_lock guard (m_input_mutex,
+                                  imagecache().lock_stats (LockFileInput));
+    if (m_used)
+        m_used = false;
+    else
+        close ();
+}
+
+
+
+void
+ImageCacheFile::invalidate ()
+{
+    counted_recursive_lock guard (m_input_mutex,
+                                  imagecache().lock_stats (LockFileInput));
     close ();
     invalidate_spec ();
+    {
+        spin_lock lock (m_mapping_mutex);
+        m_mapping.reset ();
+        m_mapping_size = 0;
+    }
     m_broken = false;
     m_fingerprint.clear ();
     duplicate (NULL);
@@ -1094,6 +2744,9 @@ ImageCacheFile::get_average_color (float *avg, int subimage,
                              spec.z, spec.z+1, 0, spec.nchannels,
                              TypeDesc::TypeFloat, &si.average_color[0]);
             si.has_average_color = ok;
+            if (ok && indexable())
+                m_imagecache.metadata_index().set_average_color (
+                                      m_filename, subimage, si.average_color);
         }
     }
 
@@ -1121,7 +2774,8 @@ ImageCacheFile *
 ImageCacheImpl::find_file (ustring filename,
                            ImageCachePerThreadInfo *thread_info,
                            ImageInput::Creator creator,
-                           bool header_only, const ImageSpec *config)
+                           bool header_only, const ImageSpec *config,
+                           ImageCache::TileProvider *provider)
 {
     // Debugging aid: attribute "substitute_image" forces all image
     // references to be to one named file.
@@ -1137,7 +2791,7 @@ ImageCacheImpl::find_file (ustring filename,
     bool newfile = false;
     if (! tf) {  // was not found in microcache
 #if IMAGECACHE_TIME_STATS
-        Timer timer;
+        ScopedTimeAccumulator<double> timer (thread_info->m_stats.find_file_time);
 #endif
         size_t bin = m_files.lock_bin (filename);
         FilenameMap::iterator found = m_files.find (filename, false);
@@ -1146,21 +2800,20 @@ ImageCacheImpl::find_file (ustring filename,
         } else {
             // No such entry in the file cache.  Add it, but don't open yet.
             tf = new ImageCacheFile (*this, thread_info, filename, creator,
-                                     config);
+                                     config, provider);
             m_files.insert (filename, tf, false);
             newfile = true;
         }
         m_files.unlock_bin (bin);
 
         if (newfile) {
+            if (m_filewatcher.active() && ! tf->is_udim() && ! provider)
+                m_filewatcher.watch (tf->filename().string(), filename);
             check_max_files (thread_info);
             if (! tf->duplicate())
                 ++thread_info->m_stats.unique_files;
         }
         thread_info->filename (filename, tf);  // add to the microcache
-#if IMAGECACHE_TIME_STATS
-        thread_info->m_stats.find_file_time += timer();
-#endif
     }
 
     // Ensure that it's open and do other important housekeeping.
@@ -1187,18 +2840,21 @@ ImageCacheImpl::verify_file (ImageCacheFile *tf,
     // No need to have the file cache locked for this, though we lock
     // the tf->m_input_mutex if we need to open it.
     if (! tf->validspec()) {
-        Timer timer;
+        FastTimer timer;
         if (! thread_info)
             thread_info = get_perthread_info ();
-        recursive_lock_guard guard (tf->m_input_mutex);
+        counted_recursive_lock guard (tf->m_input_mutex,
+                                      lock_stats (LockFileInput));
         if (! tf->validspec()) {
-            tf->open (thread_info);
+            if (! tf->open_from_index (thread_info))
+                tf->open (thread_info);
             DASSERT (tf->m_broken || tf->validspec());
             double createtime = timer();
             ImageCacheStatistics &stats (thread_info->m_stats);
             stats.fileio_time += createtime;
             stats.fileopen_time += createtime;
-            tf->iotime() += createtime;
+            thread_info->count_iotime (tf, createtime);
+            m_open_latency.record (createtime);
 
             // What if we've opened another file, with a different name,
             // but the SAME pixels?  It can happen!  Bad user, bad!  But
@@ -1277,6 +2933,165 @@ ImageCacheImpl::clear_fingerprints ()
 
 
 
+namespace {
+
+// Deleter for tile pixels shared among tiles (deduplicated or constant),
+// which may outlive the tile that made them: the memory stays counted
+// against the cache (and the file that made it) until the last tile
+// sharing it lets go.
+struct PixelCharge {
+    PixelCharge (const OIIO::shared_ptr<char> &pixels, ImageCacheFile *file,
+                 size_t size, bool coarse)
+        : m_pixels(pixels), m_file(file), m_size(size), m_coarse(coarse) { }
+    void operator() (char *) {
+        m_file->imagecache().decr_mem (*m_file, m_size, m_coarse);
+        m_pixels.reset ();
+        m_file.reset ();
+    }
+private:
+    OIIO::shared_ptr<char> m_pixels;   // The real allocation
+    ImageCacheFileRef m_file;          // (kept alive until we're done)
+    size_t m_size;
+    bool m_coarse;
+};
+
+}   // end anon namespace
+
+
+
+OIIO::shared_ptr<char>
+ImageCacheImpl::find_tile_pixels (const std::string &key)
+{
+    spin_lock lock (m_tile_pixels_mutex);
+    std::map<std::string, OIIO::weak_ptr<char> >::iterator found = m_tile_pixels.find (key);
+    if (found == m_tile_pixels.end())
+        return OIIO::shared_ptr<char>();
+    return found->second.lock ();
+}
+
+
+
+void
+ImageCacheImpl::add_tile_pixels (const std::string &key,
+                                 const OIIO::shared_ptr<char> &pels)
+{
+    spin_lock lock (m_tile_pixels_mutex);
+    m_tile_pixels[key] = pels;
+    if (m_tile_pixels.size() >= m_tile_pixels_prune) {
+        // Forget the entries whose tiles have all been freed
+        typedef std::map<std::string, OIIO::weak_ptr<char> >::iterator Iter;
+        for (Iter i = m_tile_pixels.begin();  i != m_tile_pixels.end();  ) {
+            if (i->second.expired())
+                m_tile_pixels.erase (i++);
+            else
+                ++i;
+        }
+        m_tile_pixels_prune = std::max (size_t(1024), 2 * m_tile_pixels.size());
+    }
+}
+
+
+
+OIIO::shared_ptr<char>
+ImageCacheImpl::constant_tile_pixels (ImageCacheFile &file, bool coarse,
+                                      const char *pixel, int pixelsize,
+                                      size_t npixels, size_t size)
+{
+    std::string key = Strutil::format ("%d,%d,", (int)npixels, (int)size)
+                    + std::string (pixel, pixelsize);
+    spin_lock lock (m_constant_tiles_mutex);
+    OIIO::weak_ptr<char> &entry (m_constant_tiles[key]);
+    OIIO::shared_ptr<char> pels = entry.lock ();
+    if (! pels) {
+        // None of that color in memory (any more), so make them, counted
+        // against the cache until no tile uses them.
+        OIIO::shared_ptr<char> mem (new char [size],
+                                    boost::checked_array_deleter<char>());
+        memset (mem.get(), 0, size);
+        for (size_t p = 0;  p < npixels;  ++p)
+            memcpy (mem.get() + p*pixelsize, pixel, pixelsize);
+        incr_mem (file, size, coarse);
+        pels = OIIO::shared_ptr<char> (mem.get(),
+                                       PixelCharge (mem, &file, size, coarse));
+        entry = pels;
+        if (m_constant_tiles.size() >= m_constant_tiles_prune) {
+            // Forget the colors no tile uses any more
+            typedef std::map<std::string, OIIO::weak_ptr<char> >::iterator Iter;
+            for (Iter i = m_constant_tiles.begin();  i != m_constant_tiles.end();  ) {
+                if (i->second.expired())
+                    m_constant_tiles.erase (i++);
+                else
+                    ++i;
+            }
+            m_constant_tiles_prune = std::max (size_t(1024),
+                                               2 * m_constant_tiles.size());
+        }
+    }
+    return pels;
+}
+
+
+
+void
+ImageCacheImpl::lru_unlink (ImageCacheFile *file)
+{
+    int list = file->m_lru_list;
+    DASSERT (list >= 0);
+    (file->m_lru_prev ? file->m_lru_prev->m_lru_next
+                      : m_open_files_head[list]) = file->m_lru_next;
+    (file->m_lru_next ? file->m_lru_next->m_lru_prev
+                      : m_open_files_tail[list]) = file->m_lru_prev;
+    file->m_lru_prev = file->m_lru_next = NULL;
+    file->m_lru_list = -1;
+    --m_open_files_count[list];
+}
+
+
+
+void
+ImageCacheImpl::lru_link_head (ImageCacheFile *file, int list)
+{
+    DASSERT (file->m_lru_list < 0);
+    file->m_lru_prev = NULL;
+    file->m_lru_next = m_open_files_head[list];
+    (file->m_lru_next ? file->m_lru_next->m_lru_prev
+                      : m_open_files_tail[list]) = file;
+    m_open_files_head[list] = file;
+    file->m_lru_list = list;
+    ++m_open_files_count[list];
+}
+
+
+
+void
+ImageCacheImpl::file_opened (ImageCacheFile *file, double cost)
+{
+    counted_spin_lock lock (m_open_files_mutex,
+                            lock_stats (LockOpenFiles));
+    m_open_cost_total += cost;
+    ++m_open_cost_count;
+    file->m_open_cost = cost;
+    // "Expensive" means at least 4x the average, and at least 1 ms.
+    bool expensive = (cost >= 0.001 &&
+                      cost >= 4.0 * m_open_cost_total / m_open_cost_count);
+    if (file->m_lru_list >= 0)
+        lru_unlink (file);
+    lru_link_head (file, expensive ? 1 : 0);
+}
+
+
+
+void
+ImageCacheImpl::file_closed (ImageCacheFile *file)
+{
+    counted_spin_lock lock (m_open_files_mutex,
+                            lock_stats (LockOpenFiles));
+    if (file->m_lru_list >= 0)
+        lru_unlink (file);
+}
+
+
+
 void
 ImageCacheImpl::check_max_files (ImageCachePerThreadInfo *thread_info)
 {
@@ -1296,223 +3111,1593 @@ ImageCacheImpl::check_max_files (ImageCachePerThreadInfo *thread_info)
     // already in this function, no need for two threads to do it at
     // once.  If this means we may ephemerally be over the handle limit,
     // so be it.
-    if (! m_file_sweep_mutex.try_lock())
+    if (! counted_try_lock (m_file_sweep_mutex, lock_stats (LockFileSweep)))
         return;
+    TraceScope trace (*this, thread_info, TraceFileSweep);
+
+    // Only files that are open are in the LRU lists, so each step is
+    // O(1), no matter how many files the cache knows about.  Take the
+    // least recently opened file and move it to the front: if it was
+    // used since it last came up, release() just clears its used flag
+    // (a second chance), otherwise it closes the file, which takes it
+    // off the list.  Files that were much more expensive than average
+    // to open are only closed when no others are open, or when there
+    // are more of them than their own budget allows.  Give up after
+    // every open file has had two turns.
+    int steps = 0;
+    while (m_stat_open_files_current >= m_max_open_files) {
+        ImageCacheFile *victim = NULL;
+        {
+            counted_spin_lock lock (m_open_files_mutex,
+                                    lock_stats (LockOpenFiles));
+            if (steps++ > 2 * (m_open_files_count[0] + m_open_files_count[1]))
+                break;
+            int list = (! m_open_files_tail[0] ||
+                        m_open_files_count[1] > m_max_open_files_expensive);
+            victim = m_open_files_tail[list];
+            if (! victim)
+                break;
+            lru_unlink (victim);
+            lru_link_head (victim, list);
+        }
+        victim->release ();  // May reduce open files
+    }
+
+    m_file_sweep_mutex.unlock ();
+}
 
-    // Now, what we want to do is have a "clock hand" that sweeps across
-    // the cache, releasing files that haven't been used for a long
-    // time.  Because of multi-thread, rather than keep an iterator
-    // around for this (which could be invalidated since the last time
-    // we used it), we just remember the filename of the next file to
-    // check, then look it up fresh.  That is m_file_sweep_name.
 
-    // If we don't have a valid file_sweep_name, establish it by just
-    // looking up the filename of the first entry in the file cache.
-    if (! m_file_sweep_name) {
-        FilenameMap::iterator sweep = m_files.begin();
-        DASSERT (sweep != m_files.end() &&
-                "no way m_files can be empty and have too many files open");
-        m_file_sweep_name = sweep->first;
+
+void
+ImageCacheImpl::set_min_cache_size (long long newsize)
+{
+    long long oldsize = m_max_memory_bytes;
+    while (newsize > oldsize) {
+	if (atomic_compare_and_exchange ((long long *)&m_max_memory_bytes,
+                                         oldsize, newsize))
+            return;
+        oldsize = m_max_memory_bytes;
     }
+}
 
-    // Get a (locked) iterator for the next file to be examined.
-    FilenameMap::iterator sweep = m_files.find (m_file_sweep_name);
 
-    // Loop while we still have too many files open.  Also, be careful
-    // of looping for too long, exit the loop if we just keep spinning
-    // uncontrollably.
-    int full_loops = 0;
-    FilenameMap::iterator end = m_files.end();
-    while (m_stat_open_files_current >= m_max_open_files
-           && full_loops <= 100) {
-        // If we have fallen off the end of the cache, loop back to the
-        // beginning and increment our full_loops count.
-        if (sweep == end) {
-            sweep = m_files.begin();
-            ++full_loops;
+
+ImageCacheTile::ImageCacheTile (const TileID &id,
+                                ImageCachePerThreadInfo *thread_info,
+                                bool read_now)
+    : m_id (id), m_valid(true), m_compressed(false) // , m_used(true)
+{
+    m_used = true;
+    m_pixels_ready = false;
+    m_pixels_size = 0;
+    init_coarse ();
+    if (read_now) {
+        read (thread_info);
+    }
+    id.file().imagecache().incr_tiles (id.file(), 0);  // mem counted in read
+}
+
+
+
+ImageCacheTile::ImageCacheTile (const TileID &id, const void *pels,
+                    TypeDesc format,
+                    stride_t xstride, stride_t ystride, stride_t zstride)
+    : m_id (id), m_compressed(false) // , m_used(true)
+{
+    m_used = true;
+    m_pixels_size = 0;
+    init_coarse ();
+    ImageCacheFile &file (m_id.file ());
+    const ImageSpec &spec (file.spec(id.subimage(), id.miplevel()));
+    m_channelsize = file.datatype(id.subimage()).size();
+    m_pixelsize = id.nchannels() * m_channelsize;
+    size_t size = memsize_needed ();
+    ASSERT_MSG (size > 0 && memsize() == 0, "size was %llu, memsize = %llu",
+                (unsigned long long)size, (unsigned long long)memsize());
+    m_pixels = TileAllocator::instance().allocate (size, m_pixels_size);
+    // Clear the end pad values so there aren't NaNs sucked up by simd loads
+    memset (m_pixels.get() + size - OIIO_SIMD_MAX_SIZE_BYTES,
+            0, OIIO_SIMD_MAX_SIZE_BYTES);
+    m_valid = convert_image (id.nchannels(), spec.tile_width, spec.tile_height,
+                             spec.tile_depth, pels, format, xstride, ystride,
+                             zstride, m_pixels.get(), file.datatype(id.subimage()),
+                             m_pixelsize, m_pixelsize * spec.tile_width,
+                             m_pixelsize * spec.tile_width * spec.tile_height);
+    file.imagecache().incr_tiles (file, m_pixels_size, m_coarse);
+    m_pixels_ready = true;  // Caller sent us the pixels, no read necessary
+    // FIXME -- for shadow, fill in mindepth, maxdepth
+}
+
+
+
+ImageCacheTile::~ImageCacheTile ()
+{
+    if (! m_source)   // decompressed copies weren't counted
+        m_id.file().imagecache().decr_tiles (m_id.file(), memsize (), m_coarse);
+}
+
+
+
+// Slab and block sizes (and the slab header) are multiples of this.
+static const size_t tile_block_align = 64;
+// Slabs hold about this many bytes' worth of blocks (but at least one,
+// and at most max_blocks_per_slab).
+static const size_t tile_slab_target = 1024*1024;
+static const int max_blocks_per_slab = 256;
+
+
+
+struct TileAllocator::SizeClass {
+    size_t blocksize;       ///< Bytes per block
+    int blocks_per_slab;
+    size_t slabsize;        ///< Bytes per slab, header included
+    spin_mutex mutex;       ///< Protects everything below
+    Slab *head, *tail;      ///< Slabs with free blocks, entirely free last
+    int empty_slabs;        ///< How many of those are entirely free
+};
+
+
+
+struct TileAllocator::Slab {
+    SizeClass *sizeclass;
+    Slab *prev, *next;      ///< Neighbors in the sizeclass list
+    char *freelist;         ///< First free block; each holds the next
+    int nfree;              ///< Number of free blocks
+    bool listed;            ///< Is it in the sizeclass list?
+
+    static size_t header_bytes () {
+        return (sizeof(Slab) + tile_block_align-1) & ~(tile_block_align-1);
+    }
+    void unlink () {
+        (prev ? prev->next : sizeclass->head) = next;
+        (next ? next->prev : sizeclass->tail) = prev;
+        prev = next = NULL;
+        listed = false;
+    }
+    void link_head () {
+        prev = NULL;
+        next = sizeclass->head;
+        (next ? next->prev : sizeclass->tail) = this;
+        sizeclass->head = this;
+        listed = true;
+    }
+    void link_tail () {
+        next = NULL;
+        prev = sizeclass->tail;
+        (prev ? prev->next : sizeclass->head) = this;
+        sizeclass->tail = this;
+        listed = true;
+    }
+};
+
+
+
+struct TileAllocator::Deleter {
+    Deleter (Slab *slab) : slab(slab) { }
+    void operator() (char *block) const {
+        TileAllocator::instance().free (slab, block);
+    }
+    Slab *slab;
+};
+
+
+
+TileAllocator &
+TileAllocator::instance ()
+{
+    // Deliberately leaked, see the class comments.
+    static TileAllocator *allocator = new TileAllocator;
+    return *allocator;
+}
+
+
+
+TileAllocator::SizeClass *
+TileAllocator::size_class (size_t size)
+{
+    size_t blocksize = (size + tile_block_align-1) & ~(tile_block_align-1);
+    spin_lock lock (m_classes_mutex);
+    for (size_t i = 0;  i < m_classes.size();  ++i)
+        if (m_classes[i]->blocksize == blocksize)
+            return m_classes[i];
+    SizeClass *sc = new SizeClass;
+    sc->blocksize = blocksize;
+    sc->blocks_per_slab = (int) clamp (tile_slab_target / blocksize,
+                                       size_t(1), size_t(max_blocks_per_slab));
+    sc->slabsize = Slab::header_bytes() + sc->blocks_per_slab * blocksize;
+    sc->head = sc->tail = NULL;
+    sc->empty_slabs = 0;
+    m_classes.push_back (sc);
+    return sc;
+}
+
+
+
+OIIO::shared_ptr<char>
+TileAllocator::allocate (size_t size, size_t &blocksize)
+{
+    SizeClass *sc = size_class (size);
+    char *block = NULL;
+    Slab *slab = NULL;
+    while (! block) {
+        {
+            spin_lock lock (sc->mutex);
+            // Fill the most used slabs first, so that the others have a
+            // chance to become entirely free.
+            slab = sc->head;
+            if (slab) {
+                block = slab->freelist;
+                slab->freelist = *(char **)block;
+                if (slab->nfree-- == sc->blocks_per_slab)
+                    --sc->empty_slabs;
+                if (! slab->nfree)
+                    slab->unlink ();
+                break;
+            }
         }
-        // If we're STILL at the end, it must be that somehow the entire
-        // cache is empty.  So just declare ourselves done.
-        if (sweep == end)
-            break;
-        DASSERT (sweep->second);
-        sweep->second->release ();  // May reduce open files
-        ++sweep;
+        // Nothing free: get a new slab (without holding the lock), put
+        // all its blocks on its free list, and try again.
+        char *mem = new char [sc->slabsize];
+        Slab *s = new (mem) Slab;
+        s->sizeclass = sc;
+        s->prev = s->next = NULL;
+        s->freelist = NULL;
+        s->nfree = sc->blocks_per_slab;
+        for (int b = sc->blocks_per_slab-1;  b >= 0;  --b) {
+            char *blk = mem + Slab::header_bytes() + b * sc->blocksize;
+            *(char **)blk = s->freelist;
+            s->freelist = blk;
+        }
+        m_slab_bytes += sc->slabsize;
+        spin_lock lock (sc->mutex);
+        s->link_tail ();
+        ++sc->empty_slabs;
+    }
+    blocksize = sc->slabsize / sc->blocks_per_slab;
+    m_used_bytes += blocksize;
+    return OIIO::shared_ptr<char> (block, Deleter (slab));
+}
+
+
+
+void
+TileAllocator::free (Slab *slab, char *block)
+{
+    SizeClass *sc = slab->sizeclass;
+    bool release = false;
+    {
+        spin_lock lock (sc->mutex);
+        *(char **)block = slab->freelist;
+        slab->freelist = block;
+        ++slab->nfree;
+        if (slab->nfree == sc->blocks_per_slab) {
+            // Entirely free: keep one spare, give the rest back.
+            if (slab->listed)
+                slab->unlink ();
+            if (sc->empty_slabs) {
+                release = true;
+            } else {
+                slab->link_tail ();
+                ++sc->empty_slabs;
+            }
+        } else if (! slab->listed) {
+            slab->link_head ();
+        }
+    }
+    if (release) {
+        m_slab_bytes -= sc->slabsize;
+        delete [] (char *) slab;
     }
+    m_used_bytes -= sc->slabsize / sc->blocks_per_slab;
+}
 
-    // OK, by this point we have either closed enough files to be below
-    // the limit again, or the cache is empty, or we've looped over the
-    // cache too many times and are giving up.
 
-    // Now we must save the filename for next time.  Just set it to an
-    // empty string if we don't have a valid iterator at this point.
-    m_file_sweep_name = (sweep == end ? ustring() : sweep->first);
-    m_file_sweep_mutex.unlock ();
 
-    // N.B. As we exit, the iterators will go out of scope and we will
-    // retain no locks on the cache.
+namespace {
+
+// A small LZ77 byte codec in the style of LZ4, used for compressed
+// resident tiles ("compress_tiles").  The stream is a series of
+// sequences, each a token byte (literal count in the high nibble, match
+// length - 4 in the low nibble; 15 means more length bytes follow, 255
+// at a time), the literals, then a 2-byte little-endian match offset.
+// The final sequence has literals only.  Before compression the pixels
+// are split into byte planes and delta-coded along each plane, which
+// turns the smooth variation of texture data into long runs of small
+// values.
+
+inline unsigned int
+read32 (const unsigned char *p)
+{
+    unsigned int v;
+    memcpy (&v, p, 4);
+    return v;
+}
+
+
+
+inline bool
+put_length (unsigned char *dst, size_t &op, size_t cap, size_t len)
+{
+    for ( ;  len >= 255;  len -= 255) {
+        if (op >= cap)
+            return false;
+        dst[op++] = 255;
+    }
+    if (op >= cap)
+        return false;
+    dst[op++] = (unsigned char) len;
+    return true;
+}
+
+
+
+// Emit one sequence; mlen == 0 means the final, literal-only one.
+inline bool
+put_sequence (unsigned char *dst, size_t &op, size_t cap,
+              const unsigned char *lit, size_t nlit, size_t offset,
+              size_t mlen)
+{
+    if (op >= cap)
+        return false;
+    size_t ml = mlen ? mlen - 4 : 0;
+    dst[op++] = (unsigned char) ((std::min (nlit, size_t(15)) << 4) |
+                                 std::min (ml, size_t(15)));
+    if (nlit >= 15 && ! put_length (dst, op, cap, nlit - 15))
+        return false;
+    if (op + nlit > cap)
+        return false;
+    memcpy (dst + op, lit, nlit);
+    op += nlit;
+    if (! mlen)
+        return true;
+    if (op + 2 > cap)
+        return false;
+    dst[op++] = (unsigned char) (offset & 0xff);
+    dst[op++] = (unsigned char) (offset >> 8);
+    return ml < 15 || put_length (dst, op, cap, ml - 15);
+}
+
+
+
+// Compress n bytes of src into dst, returning the compressed size, or 0
+// if it wouldn't fit in cap bytes.
+size_t
+lz_compress (const unsigned char *src, size_t n, unsigned char *dst,
+             size_t cap)
+{
+    const int hashbits = 12;
+    unsigned int table[1 << hashbits];
+    memset (table, 0, sizeof(table));
+    size_t ip = 0, anchor = 0, op = 0;
+    // Leave the last bytes as literals, so matches never run off the end
+    size_t limit = n > 12 ? n - 12 : 0;
+    while (ip < limit) {
+        unsigned int seq = read32 (src + ip);
+        unsigned int h = (seq * 2654435761u) >> (32 - hashbits);
+        size_t cand = table[h];
+        table[h] = (unsigned int) ip;
+        if (cand < ip && ip - cand <= 65535 && read32 (src + cand) == seq) {
+            size_t mlen = 4;
+            while (ip + mlen < n - 5 && src[cand+mlen] == src[ip+mlen])
+                ++mlen;
+            if (! put_sequence (dst, op, cap, src + anchor, ip - anchor,
+                                ip - cand, mlen))
+                return 0;
+            ip += mlen;
+            anchor = ip;
+        } else {
+            ++ip;
+        }
+    }
+    if (! put_sequence (dst, op, cap, src + anchor, n - anchor, 0, 0))
+        return 0;
+    return op;
+}
+
+
+
+inline bool
+get_length (const unsigned char *src, size_t &ip, size_t n, size_t &len)
+{
+    unsigned char b = 255;
+    while (b == 255) {
+        if (ip >= n)
+            return false;
+        b = src[ip++];
+        len += b;
+    }
+    return true;
+}
+
+
+
+// Decompress n bytes of src into exactly size bytes of dst.
+bool
+lz_decompress (const unsigned char *src, size_t n, unsigned char *dst,
+               size_t size)
+{
+    size_t ip = 0, op = 0;
+    while (ip < n) {
+        unsigned char token = src[ip++];
+        size_t nlit = token >> 4;
+        if (nlit == 15 && ! get_length (src, ip, n, nlit))
+            return false;
+        if (ip + nlit > n || op + nlit > size)
+            return false;
+        memcpy (dst + op, src + ip, nlit);
+        ip += nlit;
+        op += nlit;
+        if (ip == n)
+            break;   // The final sequence has no match
+        if (ip + 2 > n)
+            return false;
+        size_t offset = src[ip] | (size_t(src[ip+1]) << 8);
+        ip += 2;
+        size_t mlen = token & 15;
+        if (mlen == 15 && ! get_length (src, ip, n, mlen))
+            return false;
+        mlen += 4;
+        if (offset == 0 || offset > op || op + mlen > size)
+            return false;
+        const unsigned char *m = dst + op - offset;
+        if (offset >= mlen) {
+            memcpy (dst + op, m, mlen);
+        } else {
+            for (size_t i = 0;  i < mlen;  ++i)   // overlapping run
+                dst[op+i] = m[i];
+        }
+        op += mlen;
+    }
+    return op == size;
+}
+
+}  // anon namespace
+
+
+
+// Header of a compressed tile's buffer.
+struct CompressedTileHeader {
+    unsigned int compressed_bytes;   ///< Bytes of codec data that follow
+};
+
+
+
+void
+ImageCacheTile::compress (ImageCachePerThreadInfo *thread_info)
+{
+    Timer timer;
+    const ImageSpec &spec (m_id.file().spec (m_id.subimage(), m_id.miplevel()));
+    size_t npixels = spec.tile_pixels();
+    size_t rawbytes = npixels * m_pixelsize;
+    // Split the pixels into byte planes and delta-code each one.
+    std::vector<unsigned char> &scratch (thread_info->tile_scratch);
+    scratch.resize (2 * rawbytes);
+    unsigned char *planes = &scratch[0];
+    const unsigned char *pels = (const unsigned char *) m_pixels.get();
+    for (int b = 0;  b < m_pixelsize;  ++b) {
+        unsigned char *plane = planes + b * npixels;
+        unsigned char prev = 0;
+        for (size_t p = 0;  p < npixels;  ++p) {
+            unsigned char v = pels[p * m_pixelsize + b];
+            plane[p] = (unsigned char) (v - prev);
+            prev = v;
+        }
+    }
+    // Only worth keeping if it saves at least 1/8 of the memory.
+    size_t cap = rawbytes - rawbytes/8;
+    size_t nbytes = lz_compress (planes, rawbytes, planes + rawbytes, cap);
+    if (nbytes) {
+        size_t total = sizeof(CompressedTileHeader) + nbytes;
+        m_pixels.reset (new char [total], boost::checked_array_deleter<char>());
+        CompressedTileHeader header;
+        header.compressed_bytes = (unsigned int) nbytes;
+        memcpy (m_pixels.get(), &header, sizeof(header));
+        memcpy (m_pixels.get() + sizeof(header), planes + rawbytes, nbytes);
+        m_pixels_size = total;
+        m_compressed = true;
+        ++thread_info->m_stats.tiles_compressed;
+        thread_info->m_stats.compressed_bytes_raw += rawbytes;
+        thread_info->m_stats.compressed_bytes += total;
+    }
+    thread_info->m_stats.compress_time += timer();
+}
+
+
+
+ImageCacheTile::ImageCacheTile (ImageCacheTile *compressed,
+                                ImageCachePerThreadInfo *thread_info)
+    : m_id (compressed->id()), m_pixels_size(0),
+      m_channelsize(compressed->m_channelsize),
+      m_pixelsize(compressed->m_pixelsize), m_valid(false),
+      m_pixels_ready(true), m_compressed(false),
+      m_coarse(compressed->m_coarse), m_credit(0),
+      m_source(compressed)
+{
+    DASSERT (compressed->compressed());
+    m_used = true;
+    Timer timer;
+    TraceScope trace (m_id.file().imagecache(), thread_info,
+                      TraceDecompress, m_id);
+    const ImageSpec &spec (m_id.file().spec (m_id.subimage(), m_id.miplevel()));
+    size_t npixels = spec.tile_pixels();
+    size_t rawbytes = npixels * m_pixelsize;
+    size_t size = rawbytes + OIIO_SIMD_MAX_SIZE_BYTES;
+    size_t blocksize;
+    m_pixels = TileAllocator::instance().allocate (size, blocksize);
+    memset (m_pixels.get() + rawbytes, 0, OIIO_SIMD_MAX_SIZE_BYTES);
+    CompressedTileHeader header;
+    memcpy (&header, compressed->m_pixels.get(), sizeof(header));
+    std::vector<unsigned char> &scratch (thread_info->tile_scratch);
+    scratch.resize (std::max (scratch.size(), rawbytes));
+    unsigned char *planes = &scratch[0];
+    m_valid = lz_decompress ((const unsigned char *) compressed->m_pixels.get()
+                                 + sizeof(header),
+                             header.compressed_bytes, planes, rawbytes);
+    // Undo the delta coding and gather the byte planes back into pixels.
+    unsigned char *pels = (unsigned char *) m_pixels.get();
+    for (int b = 0;  m_valid && b < m_pixelsize;  ++b) {
+        const unsigned char *plane = planes + b * npixels;
+        unsigned char v = 0;
+        for (size_t p = 0;  p < npixels;  ++p) {
+            v = (unsigned char) (v + plane[p]);
+            pels[p * m_pixelsize + b] = v;
+        }
+    }
+    ++thread_info->m_stats.tiles_decompressed;
+    thread_info->m_stats.decompress_time += timer();
+}
+
+
+
+void
+ImageCacheTile::init_coarse ()
+{
+    // A "coarse" MIP level is one of only a handful of tiles. There are
+    // few such tiles, they are cheap to keep, and they tend to be needed
+    // by every lookup with a wide filter footprint.
+    const ImageCacheFile::LevelInfo &lev (m_id.file().levelinfo (m_id.subimage(),
+                                                                 m_id.miplevel()));
+    m_coarse = (m_id.miplevel() > 0 &&
+                lev.nxtiles * lev.nytiles * lev.nztiles <= 4);
+    m_credit = 0;
+}
+
+
+
+TileIndex::TileIndex ()
+    : m_buckets (new Node * volatile [nbuckets])
+{
+    for (size_t i = 0;  i < nbuckets;  ++i)
+        m_buckets[i] = NULL;
+}
+
+
+
+TileIndex::~TileIndex ()
+{
+    for (size_t i = 0;  i < nbuckets;  ++i) {
+        for (Node *n = m_buckets[i];  n;  ) {
+            Node *next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+    delete [] m_buckets;
+}
+
+
+
+bool
+TileIndex::insert (ImageCacheTile *tile)
+{
+    // N.B. caller holds write_mutex(tile->id())
+    size_t b = whichbucket (tile->id());
+    for (Node *n = m_buckets[b];  n;  n = n->next)
+        if (n->id == tile->id())
+            return false;
+    Node *node = new Node (tile->id(), tile);
+    node->next = m_buckets[b];
+    // Publish the fully constructed node.
+    tileindex_store (&m_buckets[b], node);
+    return true;
+}
+
+
+
+TileIndex::Node *
+TileIndex::unlink (const TileID &id)
+{
+    // N.B. caller holds write_mutex(id)
+    size_t b = whichbucket (id);
+    Node * volatile *prev = &m_buckets[b];
+    for (Node *n = *prev;  n;  prev = &n->next, n = n->next) {
+        if (n->id == id) {
+            // Readers currently at n may still follow n->next, so leave
+            // it intact; just route new readers around n.
+            tileindex_store (prev, (Node *)n->next);
+            return n;
+        }
+    }
+    return NULL;
+}
+
+
+
+size_t
+ImageCacheTile::memsize_needed () const
+{
+    const ImageSpec &spec (file().spec(m_id.subimage(),m_id.miplevel()));
+    size_t s = spec.tile_pixels() * pixelsize();
+    // N.B. Round up so we can use a SIMD fetch for the last pixel and
+    // channel without running off the end.
+    s += OIIO_SIMD_MAX_SIZE_BYTES;
+    return s;
+}
+
+
+
+void
+ImageCacheTile::read (ImageCachePerThreadInfo *thread_info)
+{
+    ImageCacheFile &file (m_id.file());
+    TraceScope trace (file.imagecache(), thread_info, TraceTileRead, m_id);
+    m_channelsize = file.datatype(id().subimage()).size();
+    m_pixelsize = m_id.nchannels() * m_channelsize;
+    size_t size = memsize_needed ();
+    ASSERT (memsize() == 0 && size > OIIO_SIMD_MAX_SIZE_BYTES);
+    ImageCacheFile::LevelInfo &lev (file.levelinfo (m_id.subimage(), m_id.miplevel()));
+    int whichtile = ((m_id.x() - lev.spec.x) / lev.spec.tile_width)
+                  + ((m_id.y() - lev.spec.y) / lev.spec.tile_height) * lev.nxtiles
+                  + ((m_id.z() - lev.spec.z) / lev.spec.tile_depth) * (lev.nxtiles*lev.nytiles);
+    if (lev.constant_tiles.size() && lev.constant_tiles[whichtile] >= 0) {
+        // maketx recorded that this tile is a single color.  Rather than
+        // reading and decompressing it, point it at the shared pixels of
+        // that color, which count only once against the cache memory.
+        const float *color = &lev.constant_colors[lev.constant_tiles[whichtile] * lev.spec.nchannels];
+        char *pixel = ALLOCA (char, m_pixelsize);
+        convert_types (TypeDesc::FLOAT, color + m_id.chbegin(),
+                       file.datatype(m_id.subimage()), pixel, m_id.nchannels());
+        m_pixels = file.imagecache().constant_tile_pixels (file, m_coarse,
+                                           pixel, m_pixelsize,
+                                           lev.spec.tile_pixels(), size);
+        m_valid = true;
+        m_pixels_ready = true;
+        return;
+    }
+    // An uncompressed tile in exactly the layout we want can be used
+    // straight from the file's mapping: the OS page cache holds it, so it
+    // costs no copy and nothing against the cache memory.
+    if (m_id.chbegin() == 0 && m_id.chend() == lev.spec.nchannels) {
+        m_pixels = file.mapped_tile (lev, whichtile, size,
+                                     file.datatype (m_id.subimage()));
+        if (m_pixels) {
+            m_valid = true;
+            m_pixels_ready = true;
+            return;
+        }
+    }
+    // If maketx found identical twins of this tile, and one of them is
+    // already in memory (from this file or any other), share its pixels.
+    std::string dedupkey;
+    if (lev.tile_hashes.size() && lev.tile_hashes[whichtile] &&
+          file.imagecache().deduplicate_tiles()) {
+        dedupkey = Strutil::format ("%016llx,%s,%d,%d,%d",
+                                    lev.tile_hashes[whichtile],
+                                    file.datatype(m_id.subimage()),
+                                    m_id.chbegin(), m_id.chend(), (int)size);
+        m_pixels = file.imagecache().find_tile_pixels (dedupkey);
+        if (m_pixels) {
+            m_valid = true;
+            m_pixels_ready = true;
+            return;
+        }
+    }
+    m_pixels = TileAllocator::instance().allocate (size, m_pixels_size);
+    // Clear the end pad values so there aren't NaNs sucked up by simd loads
+    memset (m_pixels.get() + size - OIIO_SIMD_MAX_SIZE_BYTES,
+            0, OIIO_SIMD_MAX_SIZE_BYTES);
+    m_valid = file.read_tile (thread_info, m_id.subimage(), m_id.miplevel(),
+                              m_id.x(), m_id.y(), m_id.z(),
+                              m_id.chbegin(), m_id.chend(),
+                              file.datatype(m_id.subimage()), m_pixels.get());
+    // Tiles shared with identical twins are already memory-efficient.
+    if (m_valid && dedupkey.empty() && m_channelsize <= 2 &&
+          file.imagecache().compress_tiles())
+        compress (thread_info);
+    file.imagecache().incr_mem (file, m_pixels_size, m_coarse);
+    if (m_valid) {
+        // Figure out if it was read before
+        int index = whichtile / 64;
+        int64_t bitmask = int64_t (1ULL << (whichtile & 63));
+        int64_t oldval = lev.tiles_read[index].fetch_or (bitmask);
+        if (oldval & bitmask)   // Was it previously read?
+            thread_info->count_redundant_tile (&file, lev.spec.tile_bytes());
+        if (dedupkey.size()) {
+            // Hand the charge for the pixels over to the pixels
+            // themselves, since twins may keep them after we're gone.
+            m_pixels = OIIO::shared_ptr<char> (m_pixels.get(),
+                           PixelCharge (m_pixels, &file, m_pixels_size,
+                                        m_coarse));
+            m_pixels_size = 0;
+            file.imagecache().add_tile_pixels (dedupkey, m_pixels);
+        }
+    } else {
+        // (! m_valid)
+        m_used = false;  // Don't let it hold mem if invalid
+#if 0
+        std::cerr << "(1) error reading tile " << m_id.x() << ' ' << m_id.y()
+                  << ' ' << m_id.z()
+                  << " subimg=" << m_id.subimage()
+                  << " mip=" << m_id.miplevel()
+                  << " from " << file.filename() << "\n";
+#endif
+    }
+    m_pixels_ready = true;
+    // FIXME -- for shadow, fill in mindepth, maxdepth
+}
+
+
+
+void
+ImageCacheTile::wait_pixels_ready () const
+{
+    if (m_pixels_ready)
+        return;
+    TraceScope trace (m_id.file().imagecache(), NULL, TraceTileWait, m_id);
+    atomic_backoff backoff;
+    while (! m_pixels_ready) {
+        backoff();
+    }
+}
+
+
+
+const void *
+ImageCacheTile::data (int x, int y, int z, int c) const
+{
+    const ImageSpec &spec = m_id.file().spec (m_id.subimage(), m_id.miplevel());
+    size_t w = spec.tile_width;
+    size_t h = spec.tile_height;
+    size_t d = spec.tile_depth;
+    DASSERT (d >= 1);
+    x -= m_id.x();
+    y -= m_id.y();
+    z -= m_id.z();
+    if (x < 0 || x >= (int)w || y < 0 || y >= (int)h ||
+        z < 0 || z >= (int)d || c < m_id.chbegin() || c > m_id.chend())
+        return NULL;
+    size_t offset = ((z * h + y) * w + x) * pixelsize()
+                  + (c-m_id.chbegin()) * channelsize();
+    return (const void *)(m_pixels.get() + offset);
+}
+
+
+
+TileDiskCache::TileDiskCache ()
+    : m_base(NULL), m_nslots(0), m_next(0), m_fd(-1)
+{
+}
+
+
+
+bool
+TileDiskCache::init (const std::string &dir, imagesize_t size,
+                     std::string &err)
+{
+    close ();
+    lock_guard lock (m_mutex);
+    size_t nslots = size_t (size / slot_bytes);
+    if (nslots < 1) {
+        err = "disk cache size is smaller than one tile slot";
+        return false;
+    }
+#ifdef _WIN32
+    err = "disk cache is not supported on this platform";
+    return false;
+#else
+    std::string filename = dir + "/oiio_tilecache_XXXXXX";
+    std::vector<char> name (filename.begin(), filename.end());
+    name.push_back (0);
+    int fd = mkstemp (&name[0]);
+    if (fd < 0) {
+        err = Strutil::format ("could not create disk cache in \"%s\"", dir);
+        return false;
+    }
+    // Nobody else needs to find the file, and this way it vanishes when
+    // we're done with it, even if we crash.
+    unlink (&name[0]);
+    off_t bytes = off_t (nslots) * off_t (slot_bytes);
+    void *base = MAP_FAILED;
+    if (ftruncate (fd, bytes) == 0)
+        base = mmap (NULL, size_t(bytes), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ::close (fd);
+        err = Strutil::format ("could not map %s disk cache in \"%s\"",
+                               Strutil::memformat (bytes), dir);
+        return false;
+    }
+    m_fd = fd;
+    m_base = (char *) base;
+    m_nslots = nslots;
+    m_slot_id.clear ();
+    m_slot_id.resize (nslots);
+    m_slots.clear ();
+    m_next = 0;
+    return true;
+#endif
+}
+
+
+
+void
+TileDiskCache::close ()
+{
+    lock_guard lock (m_mutex);
+#ifndef _WIN32
+    if (m_base) {
+        munmap (m_base, m_nslots * slot_bytes);
+        ::close (m_fd);
+    }
+#endif
+    m_base = NULL;
+    m_fd = -1;
+    m_nslots = 0;
+    m_slot_id.clear ();
+    m_slots.clear ();
+    m_next = 0;
+}
+
+
+
+void
+TileDiskCache::store (ImageCacheTile &tile)
+{
+    if (! tile.valid() || ! tile.pixels_ready())
+        return;
+    const TileID &id (tile.id());
+    const ImageSpec &spec (id.file().spec (id.subimage(), id.miplevel()));
+    size_t bytes = spec.tile_pixels() * tile.pixelsize();
+    if (bytes > slot_bytes)
+        return;
+    lock_guard lock (m_mutex);
+    if (! m_base || m_slots.find (id) != m_slots.end())
+        return;
+    size_t slot = m_next;
+    m_next = (m_next + 1) % m_nslots;
+    if (m_slot_id[slot].file_ptr())
+        m_slots.erase (m_slot_id[slot]);
+    memcpy (m_base + slot * slot_bytes, tile.data(), bytes);
+    m_slot_id[slot] = id;
+    m_slots[id] = slot;
+}
+
+
+
+ImageCacheTile *
+TileDiskCache::load (const TileID &id)
+{
+    lock_guard lock (m_mutex);
+    SlotMap::iterator found = m_slots.find (id);
+    if (found == m_slots.end())
+        return NULL;
+    const char *pels = m_base + found->second * slot_bytes;
+    return new ImageCacheTile (id, pels, id.file().datatype(id.subimage()),
+                               AutoStride, AutoStride, AutoStride);
+}
+
+
+
+void
+TileDiskCache::invalidate (const ImageCacheFile *file)
+{
+    lock_guard lock (m_mutex);
+    for (size_t i = 0;  i < m_nslots;  ++i) {
+        if (m_slot_id[i].file_ptr() &&
+              (file == NULL || m_slot_id[i].file_ptr() == file)) {
+            m_slots.erase (m_slot_id[i]);
+            m_slot_id[i] = TileID();
+        }
+    }
+}
+
+
+
+namespace {
+
+// Layout of the start of a shared tile cache segment.
+struct SharedSegmentHeader {
+    volatile int magic;
+    int version;
+    char pad[56];
+};
+
+// Changed whenever the slot layout does, so that processes built with
+// different layouts can't misread each other's segments.
+static const int shared_cache_magic = 0x4f495432;  // "OIT2"
+
+// A slot lock held longer than this many seconds is presumed stale.
+static const long long shared_cache_lock_timeout = 2;
+
+}
+
+
+
+// Each slot of a shared tile cache is one of these, followed by
+// slot_bytes of pixels.
+struct SharedTileCache::SlotHeader {
+    volatile int lock;              // Pid of the process that has it, or 0
+    unsigned int bytes;             // Size of the pixels, 0 if empty
+    volatile long long locktime;    // When the lock was taken
+    unsigned long long filekey;
+    unsigned long long layout;      // layoutkey of the tile
+    int subimage, miplevel, x, y, z, chbegin, chend;
+    int pad[1];
+
+    bool matches (uint64_t key, uint64_t layoutkey, const TileID &id) const {
+        return bytes && filekey == key && layout == layoutkey &&
+               subimage == id.subimage() && miplevel == id.miplevel() &&
+               x == id.x() && y == id.y() && z == id.z() &&
+               chbegin == id.chbegin() && chend == id.chend();
+    }
+};
+
+
+
+SharedTileCache::SharedTileCache ()
+    : m_base(NULL), m_mapsize(0), m_nslots(0)
+{
+}
+
+
+
+bool
+SharedTileCache::init (const std::string &name, imagesize_t size,
+                       std::string &err)
+{
+    close ();
+#ifdef _WIN32
+    err = "shared tile cache is not supported on this platform";
+    return false;
+#else
+    // The segment holds pixels of our files, which other users have no
+    // business reading, and tiles we'd hand out as those files' pixels,
+    // which they mustn't be able to plant, so it's private to this user.
+    // Only the process that creates it sizes it; the others map whatever
+    // size that was, since resizing a segment under another process's
+    // mapping could crash it.
+    bool created = true;
+    int fd = shm_open (name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = shm_open (name.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        err = Strutil::format ("could not open shared memory \"%s\"", name);
+        return false;
+    }
+    struct stat st;
+    bool ok = (fstat (fd, &st) == 0);
+    if (ok && ! created && (st.st_uid != geteuid() || (st.st_mode & 077))) {
+        ::close (fd);
+        err = Strutil::format ("shared memory \"%s\" is accessible to other "
+                               "users, not using it", name);
+        return false;
+    }
+    if (ok && created) {
+        ok = (ftruncate (fd, off_t(size)) == 0 && fstat (fd, &st) == 0);
+        if (! ok)
+            shm_unlink (name.c_str());
+    }
+    // Give a process that has only just created it a moment to size it.
+    for (int tries = 0;  ok && st.st_size == 0 && tries < 100;  ++tries) {
+        Sysutil::usleep (10000);
+        ok = (fstat (fd, &st) == 0);
+    }
+    size_t stride = sizeof(SlotHeader) + slot_bytes;
+    size_t mapsize = ok ? size_t(st.st_size) : 0;
+    if (mapsize < sizeof(SharedSegmentHeader) + stride) {
+        ::close (fd);
+        err = Strutil::format ("shared memory \"%s\" is too small", name);
+        return false;
+    }
+    void *base = mmap (NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, 0);
+    ::close (fd);   // The mapping stays valid
+    if (base == MAP_FAILED) {
+        err = Strutil::format ("could not map shared memory \"%s\"", name);
+        return false;
+    }
+    // New segments are zero-filled, which is a valid empty cache, so all
+    // we need to do is claim it (or check that it's ours).
+    SharedSegmentHeader *header = (SharedSegmentHeader *) base;
+    atomic_compare_and_exchange (&header->magic, 0, shared_cache_magic);
+    if (header->magic != shared_cache_magic) {
+        munmap (base, mapsize);
+        err = Strutil::format ("shared memory \"%s\" is not a tile cache "
+                               "of this version", name);
+        return false;
+    }
+    spin_rw_write_lock lock (m_mutex);
+    m_base = (char *) base;
+    m_mapsize = mapsize;
+    m_nslots = (mapsize - sizeof(SharedSegmentHeader)) / stride;
+    return true;
+#endif
+}
+
+
+
+void
+SharedTileCache::close ()
+{
+    // Wait for any store or load still using the old mapping.
+    spin_rw_write_lock lock (m_mutex);
+#ifndef _WIN32
+    if (m_base)
+        munmap (m_base, m_mapsize);
+#endif
+    m_base = NULL;
+    m_mapsize = 0;
+    m_nslots = 0;
+}
+
+
+
+uint64_t
+SharedTileCache::filekey (const ImageCacheFile &file)
+{
+    if (! file.fingerprint().empty())
+        return farmhash::Hash64 (file.fingerprint().c_str(),
+                                 file.fingerprint().length());
+    std::string s = Strutil::format ("%s:%lld", file.filename(),
+                                     (long long) file.mod_time());
+    return farmhash::Hash64 (s.c_str(), s.length());
+}
+
+
+
+uint64_t
+SharedTileCache::layoutkey (const TileID &id)
+{
+    // Everything besides the file and tile coordinates that decides what
+    // the pixels of a tile are: its size (which autotile may have set)
+    // and data type (which forcefloat may have set), and the cache
+    // settings that change the decoded values.
+    const ImageCacheFile &file (id.file());
+    const ImageSpec &spec (file.spec (id.subimage(), id.miplevel()));
+    TypeDesc format = file.datatype (id.subimage());
+    long long k[7] = { spec.tile_width, spec.tile_height, spec.tile_depth,
+                       format.basetype, format.aggregate,
+                       file.imagecache().unassociatedalpha(),
+                       file.imagecache().automip() };
+    return farmhash::Hash64 ((const char *)k, sizeof(k));
+}
+
+
+
+SharedTileCache::SlotHeader *
+SharedTileCache::slot (const TileID &id, uint64_t filekey) const
+{
+    long long k[8] = { (long long)filekey, id.subimage(), id.miplevel(),
+                       id.x(), id.y(), id.z(), id.chbegin(), id.chend() };
+    uint64_t h = farmhash::Hash64 ((const char *)k, sizeof(k));
+    size_t stride = sizeof(SlotHeader) + slot_bytes;
+    return (SlotHeader *) (m_base + sizeof(SharedSegmentHeader)
+                           + (h % m_nslots) * stride);
+}
+
+
+
+bool
+SharedTileCache::lock_slot (SlotHeader *s)
+{
+#ifdef _WIN32
+    return false;
+#else
+    // Don't wait forever -- the holder may be a process that died.
+    int me = (int) getpid();
+    atomic_backoff backoff;
+    for (int tries = 0;  tries < 4096;  ++tries) {
+        if (atomic_compare_and_exchange (&s->lock, 0, me)) {
+            s->locktime = (long long) time (NULL);
+            return true;
+        }
+        backoff ();
+    }
+    // Take over the lock if its owner is gone, or has held it so long
+    // that it must be stopped or gone (making the pid's reuse harmless).
+    // Stores clear the slot's byte count before touching its pixels, so
+    // whatever a dead owner left half-written won't be mistaken for a
+    // tile.
+    int owner = s->lock;
+    if (owner == 0 || owner == me)
+        return false;
+    bool dead = (kill (owner, 0) != 0 && errno == ESRCH);
+    if (! dead && (long long) time (NULL) - s->locktime
+                      <= shared_cache_lock_timeout)
+        return false;
+    if (! atomic_compare_and_exchange (&s->lock, owner, me))
+        return false;
+    s->locktime = (long long) time (NULL);
+    return true;
+#endif
+}
+
+
+
+void
+SharedTileCache::unlock_slot (SlotHeader *s)
+{
+#ifndef _WIN32
+    atomic_compare_and_exchange (&s->lock, (int) getpid(), 0);
+#endif
+}
+
+
+
+void
+SharedTileCache::store (ImageCacheTile &tile)
+{
+    spin_rw_read_lock maplock (m_mutex);
+    if (! m_base || ! tile.valid() || ! tile.pixels_ready())
+        return;
+    const TileID &id (tile.id());
+    const ImageSpec &spec (id.file().spec (id.subimage(), id.miplevel()));
+    size_t bytes = spec.tile_pixels() * tile.pixelsize();
+    if (bytes > slot_bytes)
+        return;
+    uint64_t key = filekey (id.file());
+    uint64_t layout = layoutkey (id);
+    SlotHeader *s = slot (id, key);
+    if (! lock_slot (s))
+        return;
+    if (! s->matches (key, layout, id)) {
+        s->bytes = 0;
+        memcpy ((char *)(s+1), tile.data(), bytes);
+        s->filekey = key;
+        s->layout = layout;
+        s->subimage = id.subimage();
+        s->miplevel = id.miplevel();
+        s->x = id.x();
+        s->y = id.y();
+        s->z = id.z();
+        s->chbegin = id.chbegin();
+        s->chend = id.chend();
+        s->bytes = (unsigned int) bytes;
+    }
+    unlock_slot (s);
+}
+
+
+
+ImageCacheTile *
+SharedTileCache::load (const TileID &id)
+{
+    spin_rw_read_lock maplock (m_mutex);
+    if (! m_base)
+        return NULL;
+    TypeDesc format = id.file().datatype (id.subimage());
+    const ImageSpec &spec (id.file().spec (id.subimage(), id.miplevel()));
+    size_t bytes = spec.tile_pixels() * id.nchannels() * format.size();
+    uint64_t key = filekey (id.file());
+    SlotHeader *s = slot (id, key);
+    if (! lock_slot (s))
+        return NULL;
+    ImageCacheTile *tile = NULL;
+    if (s->matches (key, layoutkey (id), id) && s->bytes == bytes)
+        tile = new ImageCacheTile (id, (const char *)(s+1), format,
+                                   AutoStride, AutoStride, AutoStride);
+    unlock_slot (s);
+    return tile;
+}
+
+
+
+namespace {
+
+// The metadata index file starts with this, then the version number and
+// the number of entries.
+static const char metadata_index_magic[8] = "OIIOmdx";
+static const int metadata_index_version = 1;
+
+
+template<class T> inline void
+index_put (std::string &out, const T &val)
+{
+    out.append ((const char *)&val, sizeof(T));
+}
+
+
+inline void
+index_put_string (std::string &out, string_view s)
+{
+    index_put (out, (unsigned int) s.size());
+    out.append (s.data(), s.size());
 }
 
 
+// Cursor over the contents of a metadata index file.  Any attempt to
+// read past the end fails, and so does every read after that.
+struct IndexReader {
+    const char *p, *end;
+    bool ok;
+    IndexReader (const std::string &s)
+        : p(s.data()), end(s.data()+s.size()), ok(true) { }
+    bool get (void *val, size_t n) {
+        if (! ok || size_t(end - p) < n)
+            return ok = false;
+        memcpy (val, p, n);
+        p += n;
+        return true;
+    }
+    template<class T> bool get (T &val) { return get (&val, sizeof(T)); }
+    size_t remaining () const { return size_t(end - p); }
+    bool get_string (std::string &s) {
+        unsigned int n = 0;
+        if (! get (n) || size_t(end - p) < n)
+            return ok = false;
+        s.assign (p, n);
+        p += n;
+        return true;
+    }
+};
+
 
-void
-ImageCacheImpl::set_min_cache_size (long long newsize)
+static void
+index_put_spec (std::string &out, const ImageSpec &spec)
 {
-    long long oldsize = m_max_memory_bytes;
-    while (newsize > oldsize) {
-	if (atomic_compare_and_exchange ((long long *)&m_max_memory_bytes,
-                                         oldsize, newsize))
-            return;
-        oldsize = m_max_memory_bytes;
+    int fields[19] = { spec.x, spec.y, spec.z,
+                       spec.width, spec.height, spec.depth,
+                       spec.full_x, spec.full_y, spec.full_z,
+                       spec.full_width, spec.full_height, spec.full_depth,
+                       spec.tile_width, spec.tile_height, spec.tile_depth,
+                       spec.nchannels, spec.alpha_channel, spec.z_channel,
+                       int(spec.deep) };
+    index_put (out, fields);
+    index_put (out, spec.format);
+    index_put (out, (unsigned int) spec.channelformats.size());
+    for (size_t c = 0;  c < spec.channelformats.size();  ++c)
+        index_put (out, spec.channelformats[c]);
+    index_put (out, (unsigned int) spec.channelnames.size());
+    for (size_t c = 0;  c < spec.channelnames.size();  ++c)
+        index_put_string (out, spec.channelnames[c]);
+    // Pointers mean nothing to another process, so leave them out.
+    unsigned int nattribs = 0;
+    for (size_t i = 0;  i < spec.extra_attribs.size();  ++i)
+        nattribs += (spec.extra_attribs[i].type().basetype != TypeDesc::PTR);
+    index_put (out, nattribs);
+    for (size_t i = 0;  i < spec.extra_attribs.size();  ++i) {
+        const ImageIOParameter &p (spec.extra_attribs[i]);
+        if (p.type().basetype == TypeDesc::PTR)
+            continue;
+        index_put_string (out, p.name());
+        index_put (out, p.type());
+        index_put (out, p.nvalues());
+        if (p.type().basetype == TypeDesc::STRING) {
+            const ustring *s = (const ustring *) p.data();
+            for (size_t j = 0, n = p.datasize()/sizeof(ustring);  j < n;  ++j)
+                index_put_string (out, s[j]);
+        } else {
+            out.append ((const char *)p.data(), p.datasize());
+        }
     }
 }
 
 
+// Is t a TypeDesc that could have been written by index_put_spec?  One
+// read from a corrupt file might not even have a base type that
+// TypeDesc::size() can look up.
+inline bool
+index_valid_type (const TypeDesc &t)
+{
+    return t.basetype < TypeDesc::LASTBASE && t.arraylen >= 0 &&
+           (t.aggregate == TypeDesc::SCALAR || t.aggregate == TypeDesc::VEC2 ||
+            t.aggregate == TypeDesc::VEC3 || t.aggregate == TypeDesc::VEC4 ||
+            t.aggregate == TypeDesc::MATRIX33 ||
+            t.aggregate == TypeDesc::MATRIX44);
+}
 
-ImageCacheTile::ImageCacheTile (const TileID &id,
-                                ImageCachePerThreadInfo *thread_info,
-                                bool read_now)
-    : m_id (id), m_valid(true) // , m_used(true)
+
+// ... and one that could be the data type of pixels?
+inline bool
+index_valid_pixel_type (const TypeDesc &t)
 {
-    m_used = true;
-    m_pixels_ready = false;
-    m_pixels_size = 0;
-    if (read_now) {
-        read (thread_info);
-    }
-    id.file().imagecache().incr_tiles (0);  // mem counted separately in read
+    return index_valid_type (t) && t.basetype != TypeDesc::UNKNOWN &&
+           t.basetype != TypeDesc::STRING && t.basetype != TypeDesc::PTR;
 }
 
 
+// The most channels we'll believe an indexed spec has.
+static const int index_max_channels = 16384;
 
-ImageCacheTile::ImageCacheTile (const TileID &id, const void *pels,
-                    TypeDesc format,
-                    stride_t xstride, stride_t ystride, stride_t zstride)
-    : m_id (id) // , m_used(true)
+
+static bool
+index_get_spec (IndexReader &in, ImageSpec &spec)
 {
-    m_used = true;
-    m_pixels_size = 0;
-    ImageCacheFile &file (m_id.file ());
-    const ImageSpec &spec (file.spec(id.subimage(), id.miplevel()));
-    m_channelsize = file.datatype(id.subimage()).size();
-    m_pixelsize = id.nchannels() * m_channelsize;
-    size_t size = memsize_needed ();
-    ASSERT_MSG (size > 0 && memsize() == 0, "size was %llu, memsize = %llu",
-                (unsigned long long)size, (unsigned long long)memsize());
-    m_pixels.reset (new char [m_pixels_size = size]);
-    m_valid = convert_image (id.nchannels(), spec.tile_width, spec.tile_height,
-                             spec.tile_depth, pels, format, xstride, ystride,
-                             zstride, &m_pixels[0], file.datatype(id.subimage()),
-                             m_pixelsize, m_pixelsize * spec.tile_width,
-                             m_pixelsize * spec.tile_width * spec.tile_height);
-    id.file().imagecache().incr_tiles (size);
-    m_pixels_ready = true;  // Caller sent us the pixels, no read necessary
-    // FIXME -- for shadow, fill in mindepth, maxdepth
+    int fields[19];
+    unsigned int n = 0;
+    if (! in.get (fields) || ! in.get (spec.format) || ! in.get (n) ||
+          ! index_valid_pixel_type (spec.format))
+        return false;
+    spec.x = fields[0];  spec.y = fields[1];  spec.z = fields[2];
+    spec.width = fields[3];  spec.height = fields[4];  spec.depth = fields[5];
+    spec.full_x = fields[6];  spec.full_y = fields[7];  spec.full_z = fields[8];
+    spec.full_width = fields[9];  spec.full_height = fields[10];
+    spec.full_depth = fields[11];
+    spec.tile_width = fields[12];  spec.tile_height = fields[13];
+    spec.tile_depth = fields[14];
+    spec.nchannels = fields[15];
+    spec.alpha_channel = fields[16];
+    spec.z_channel = fields[17];
+    spec.deep = (fields[18] != 0);
+    // Untiled specs are written with a tile size of 0 x 0, anything else
+    // must be a real tile.
+    bool untiled = (spec.tile_width == 0 && spec.tile_height == 0);
+    if (spec.nchannels < 1 || spec.nchannels > index_max_channels ||
+          spec.width < 1 || spec.height < 1 || spec.depth < 1 ||
+          (! untiled && (spec.tile_width < 1 || spec.tile_height < 1)) ||
+          spec.tile_depth < 1 ||
+          spec.alpha_channel < -1 || spec.alpha_channel >= spec.nchannels ||
+          spec.z_channel < -1 || spec.z_channel >= spec.nchannels ||
+          (n != 0 && n != (unsigned int)spec.nchannels))
+        return false;
+    spec.channelformats.resize (n);
+    for (unsigned int c = 0;  c < n;  ++c)
+        if (! in.get (spec.channelformats[c]) ||
+              ! index_valid_pixel_type (spec.channelformats[c]))
+            return false;
+    if (! in.get (n) || n != (unsigned int)spec.nchannels)
+        return false;
+    spec.channelnames.resize (n);
+    for (unsigned int c = 0;  c < n;  ++c)
+        in.get_string (spec.channelnames[c]);
+    if (! in.get (n))
+        return false;
+    std::string name;
+    std::vector<std::string> strings;
+    std::vector<const char *> strptrs;
+    std::vector<char> values;
+    for (unsigned int i = 0;  i < n && in.ok;  ++i) {
+        TypeDesc type;
+        int nvalues = 0;
+        if (! in.get_string (name) || ! in.get (type) || ! in.get (nvalues) ||
+              nvalues < 1 || ! index_valid_type (type) ||
+              type.basetype == TypeDesc::PTR ||
+              type.numelements() < 1 || type.size() < 1)
+            return false;
+        // Don't let a corrupt count allocate more than the rest of the
+        // record could hold: each value takes type.size() bytes, and each
+        // of its strings at least a 4-byte length.
+        size_t valuebytes = (type.basetype == TypeDesc::STRING)
+                          ? sizeof(unsigned int) * type.numelements()
+                          : type.size();
+        if (size_t(nvalues) > in.remaining() / valuebytes)
+            return false;
+        size_t nelements = size_t(nvalues) * type.numelements();
+        if (type.basetype == TypeDesc::STRING) {
+            strings.resize (nelements);
+            strptrs.resize (nelements);
+            for (size_t j = 0;  j < nelements;  ++j) {
+                in.get_string (strings[j]);
+                strptrs[j] = strings[j].c_str();
+            }
+            if (in.ok)
+                spec.extra_attribs.push_back (ImageIOParameter (name, type,
+                                                  nvalues, &strptrs[0]));
+        } else {
+            values.resize (size_t(nvalues) * type.size());
+            if (in.get (&values[0], values.size()))
+                spec.extra_attribs.push_back (ImageIOParameter (name, type,
+                                                  nvalues, &values[0]));
+        }
+    }
+    return in.ok;
 }
 
+}  // end anon namespace
 
 
-ImageCacheTile::~ImageCacheTile ()
+
+bool
+MetadataIndex::init (const std::string &filename, std::string &err)
 {
-    m_id.file().imagecache().decr_tiles (memsize ());
+    spin_lock lock (m_mutex);
+    m_filename = filename;
+    m_entries.clear ();
+    m_dirty = false;
+    if (filename.empty() || ! Filesystem::exists (filename))
+        return true;
+
+    std::string contents;
+    contents.resize (size_t (Filesystem::file_size (filename)));
+    if (contents.empty() ||
+          Filesystem::read_bytes (filename, &contents[0], contents.size())
+              != contents.size()) {
+        err = Strutil::format ("could not read metadata index \"%s\"",
+                               filename);
+        return false;
+    }
+    IndexReader in (contents);
+    char magic[sizeof(metadata_index_magic)];
+    int version = 0;
+    unsigned int nentries = 0;
+    if (! in.get (magic) || memcmp (magic, metadata_index_magic, sizeof(magic))
+          || ! in.get (version) || version != metadata_index_version
+          || ! in.get (nentries)) {
+        // Written by some other version -- just start over.
+        m_dirty = true;
+        return true;
+    }
+    std::string name, format;
+    for (unsigned int e = 0;  e < nentries && in.ok;  ++e) {
+        Entry entry;
+        unsigned char unassoc = 0;
+        unsigned int nsubimages = 0;
+        in.get_string (name);
+        in.get (entry.size);
+        in.get (entry.mod_time);
+        in.get_string (format);
+        in.get (unassoc);
+        in.get (nsubimages);
+        entry.fileformat = ustring (format);
+        entry.unassociatedalpha = (unassoc != 0);
+        if (nsubimages == 0 || nsubimages > 65536)
+            in.ok = false;
+        for (unsigned int s = 0;  s < nsubimages && in.ok;  ++s) {
+            entry.subimages.push_back (SubimageEntry());
+            SubimageEntry &se (entry.subimages.back());
+            unsigned char hasavg = 0, isconst = 0;
+            unsigned int navg = 0, nlevels = 0;
+            in.get (hasavg);
+            in.get (isconst);
+            in.get (navg);
+            if (navg > (1<<16))
+                in.ok = false;
+            se.average_color.resize (navg);
+            if (navg)
+                in.get (&se.average_color[0], navg * sizeof(float));
+            se.has_average_color = (hasavg != 0);
+            se.is_constant_image = (isconst != 0);
+            in.get (nlevels);
+            if (nlevels == 0 || nlevels > 64)
+                in.ok = false;
+            se.nativespecs.resize (in.ok ? nlevels : 0);
+            for (unsigned int m = 0;  m < nlevels && in.ok;  ++m)
+                if (! index_get_spec (in, se.nativespecs[m]))
+                    in.ok = false;
+        }
+        if (in.ok)
+            m_entries[ustring(name)] = entry;
+    }
+    if (! in.ok) {
+        err = Strutil::format ("metadata index \"%s\" is corrupt, only %d "
+                               "of %d entries could be used", filename,
+                               (int)m_entries.size(), (int)nentries);
+        m_dirty = true;
+        return false;
+    }
+    return true;
 }
 
 
 
-size_t
-ImageCacheTile::memsize_needed () const
+bool
+MetadataIndex::save (std::string &err)
 {
-    const ImageSpec &spec (file().spec(m_id.subimage(),m_id.miplevel()));
-    size_t s = spec.tile_pixels() * pixelsize();
-    // N.B. Round up so we can use a SIMD fetch for the last pixel and
-    // channel without running off the end.
-    s += OIIO_SIMD_MAX_SIZE_BYTES;
-    return s;
+    std::string out;
+    std::string filename;
+    {
+        spin_lock lock (m_mutex);
+        if (m_filename.empty() || ! m_dirty)
+            return true;
+        out.append (metadata_index_magic, sizeof(metadata_index_magic));
+        index_put (out, metadata_index_version);
+        index_put (out, (unsigned int) m_entries.size());
+        for (EntryMap::const_iterator i = m_entries.begin();
+               i != m_entries.end();  ++i) {
+            const Entry &entry (i->second);
+            index_put_string (out, i->first);
+            index_put (out, entry.size);
+            index_put (out, entry.mod_time);
+            index_put_string (out, entry.fileformat);
+            index_put (out, (unsigned char) entry.unassociatedalpha);
+            index_put (out, (unsigned int) entry.subimages.size());
+            for (size_t s = 0;  s < entry.subimages.size();  ++s) {
+                const SubimageEntry &se (entry.subimages[s]);
+                index_put (out, (unsigned char) se.has_average_color);
+                index_put (out, (unsigned char) se.is_constant_image);
+                index_put (out, (unsigned int) se.average_color.size());
+                if (se.average_color.size())
+                    out.append ((const char *)&se.average_color[0],
+                                se.average_color.size() * sizeof(float));
+                index_put (out, (unsigned int) se.nativespecs.size());
+                for (size_t m = 0;  m < se.nativespecs.size();  ++m)
+                    index_put_spec (out, se.nativespecs[m]);
+            }
+        }
+        filename = m_filename;
+        m_dirty = false;
+    }
+
+    // Write to a temporary file and rename it into place, so that other
+    // processes never see a partially written index.
+    std::string tmpname = filename + "." + Filesystem::unique_path();
+    FILE *file = Filesystem::fopen (tmpname, "wb");
+    bool ok = (file != NULL);
+    if (file) {
+        ok = (fwrite (out.data(), 1, out.size(), file) == out.size());
+        ok &= (fclose (file) == 0);
+    }
+    std::string renameerr;
+    if (ok)
+        ok = Filesystem::rename (tmpname, filename, renameerr);
+    if (! ok) {
+        Filesystem::remove (tmpname);
+        err = Strutil::format ("could not write metadata index \"%s\"",
+                               filename);
+    }
+    return ok;
 }
 
 
 
-void
-ImageCacheTile::read (ImageCachePerThreadInfo *thread_info)
+bool
+MetadataIndex::find (ustring filename, Entry &entry) const
 {
-    ImageCacheFile &file (m_id.file());
-    m_channelsize = file.datatype(id().subimage()).size();
-    m_pixelsize = m_id.nchannels() * m_channelsize;
-    size_t size = memsize_needed ();
-    ASSERT (memsize() == 0 && size > OIIO_SIMD_MAX_SIZE_BYTES);
-    m_pixels.reset (new char [m_pixels_size = size]);
-    // Clear the end pad values so there aren't NaNs sucked up by simd loads
-    memset (m_pixels.get() + size - OIIO_SIMD_MAX_SIZE_BYTES,
-            0, OIIO_SIMD_MAX_SIZE_BYTES);
-    m_valid = file.read_tile (thread_info, m_id.subimage(), m_id.miplevel(),
-                              m_id.x(), m_id.y(), m_id.z(),
-                              m_id.chbegin(), m_id.chend(),
-                              file.datatype(m_id.subimage()), &m_pixels[0]);
-    m_id.file().imagecache().incr_mem (size);
-    if (m_valid) {
-        // Figure out if 
-        ImageCacheFile::LevelInfo &lev (file.levelinfo (m_id.subimage(), m_id.miplevel()));
-        int whichtile = ((m_id.x() - lev.spec.x) / lev.spec.tile_width)
-                      + ((m_id.y() - lev.spec.y) / lev.spec.tile_height) * lev.nxtiles
-                      + ((m_id.z() - lev.spec.z) / lev.spec.tile_depth) * (lev.nxtiles*lev.nytiles);
-        int index = whichtile / 64;
-        int64_t bitmask = int64_t (1ULL << (whichtile & 63));
-        int64_t oldval = lev.tiles_read[index].fetch_or (bitmask);
-        if (oldval & bitmask)   // Was it previously read?
-            file.register_redundant_tile (lev.spec.tile_bytes());
-    } else {
-        // (! m_valid)
-        m_used = false;  // Don't let it hold mem if invalid
-#if 0
-        std::cerr << "(1) error reading tile " << m_id.x() << ' ' << m_id.y()
-                  << ' ' << m_id.z()
-                  << " subimg=" << m_id.subimage()
-                  << " mip=" << m_id.miplevel()
-                  << " from " << file.filename() << "\n";
-#endif
-    }
-    m_pixels_ready = true;
-    // FIXME -- for shadow, fill in mindepth, maxdepth
+    spin_lock lock (m_mutex);
+    EntryMap::const_iterator found = m_entries.find (filename);
+    if (found == m_entries.end())
+        return false;
+    entry = found->second;
+    return true;
 }
 
 
 
 void
-ImageCacheTile::wait_pixels_ready () const
+MetadataIndex::add (ustring filename, const Entry &entry)
 {
-    atomic_backoff backoff;
-    while (! m_pixels_ready) {
-        backoff();
-    }
+    spin_lock lock (m_mutex);
+    if (m_filename.empty())
+        return;
+    m_entries[filename] = entry;
+    m_dirty = true;
 }
 
 
 
-const void *
-ImageCacheTile::data (int x, int y, int z, int c) const
+void
+MetadataIndex::set_average_color (ustring filename, int subimage,
+                                  const std::vector<float> &color)
 {
-    const ImageSpec &spec = m_id.file().spec (m_id.subimage(), m_id.miplevel());
-    size_t w = spec.tile_width;
-    size_t h = spec.tile_height;
-    size_t d = spec.tile_depth;
-    DASSERT (d >= 1);
-    x -= m_id.x();
-    y -= m_id.y();
-    z -= m_id.z();
-    if (x < 0 || x >= (int)w || y < 0 || y >= (int)h ||
-        z < 0 || z >= (int)d || c < m_id.chbegin() || c > m_id.chend())
-        return NULL;
-    size_t offset = ((z * h + y) * w + x) * pixelsize()
-                  + (c-m_id.chbegin()) * channelsize();
-    return (const void *)&m_pixels[offset];
+    spin_lock lock (m_mutex);
+    EntryMap::iterator found = m_entries.find (filename);
+    if (found == m_entries.end() || subimage < 0 ||
+          subimage >= (int)found->second.subimages.size())
+        return;
+    SubimageEntry &se (found->second.subimages[subimage]);
+    if (se.has_average_color && se.average_color == color)
+        return;
+    se.average_color = color;
+    se.has_average_color = true;
+    m_dirty = true;
 }
 
 
 
 ImageCacheImpl::ImageCacheImpl ()
-    : m_perthread_info (&cleanup_perthread_info)
+    : m_perthread_info (&cleanup_perthread_info), m_io_pool (NULL),
+      m_remoteserver (*this), m_tileindex_epoch (1)
 {
+    for (int i = 0;  i < 2;  ++i) {
+        m_open_files_head[i] = m_open_files_tail[i] = NULL;
+        m_open_files_count[i] = 0;
+    }
+    m_open_cost_total = 0;
+    m_open_cost_count = 0;
     init ();
+    m_io_pool = new thread_pool (m_io_threads);
 }
 
 
@@ -1535,17 +4720,56 @@ void
 ImageCacheImpl::init ()
 {
     set_max_open_files (100);
+    m_max_open_files_expensive = 25;
     m_max_memory_bytes = 256 * 1024 * 1024;   // 256 MB default cache size
     m_autotile = 0;
     m_autoscanline = false;
+    m_autotile_large_MB = 64;
+    m_untiled_band_memory_MB = 8;
     m_automip = false;
+    m_automip_async = false;
     m_forcefloat = false;
     m_accept_untiled = true;
     m_accept_unmipped = true;
     m_read_before_insert = false;
     m_deduplicate = true;
+    m_deduplicate_tiles = true;
+    m_mmap_tiles = false;
+    m_compress_tiles = false;
+    m_cache_channel_subsets = false;
+    m_tile_pixels_prune = 1024;
+    m_constant_tiles_prune = 1024;
     m_unassociatedalpha = false;
     m_failure_retries = 0;
+    m_io_threads = 4;
+    m_max_inputs_per_file = 1;
+    m_coalesce_tiles = 8;
+    m_concurrent_reads = true;
+    m_microcache_size = 16;
+    m_texture_profile = false;
+    m_lock_stats = false;
+    m_get_pixels_parallel = 64;
+    m_trace = false;
+    m_trace_events = 65536;
+    m_trace_lookup_us = 100.0f;
+    m_trace_lookup_ticks = (long long) (m_trace_lookup_us * 1.0e-6
+                                        / Timer::seconds (1));
+    m_tile_record = false;
+    m_eviction_policy = EvictClock;
+    m_auto_lod = false;
+    m_auto_lod_min_resolution = 256;
+    m_auto_lod_resolution = 0;
+    m_auto_lod_evicted = 0;
+    m_auto_lod_window_start = 0.0;
+    m_disk_cache_size = 0;
+    m_shared_cache_size = 256;
+    m_remote_cache_serve = 0;
+    m_remote_cache_serve_address = "127.0.0.1";
+    m_remote_cache_serve_threads = 4;
+    m_watch_files = 0;
+    m_watch_files_interval = 2.0f;
+    m_watch_automip = false;
+    m_mem_used_coarse = 0;
     m_latlong_y_up_default = true;
     m_Mw2c.makeIdentity();
     m_mem_used = 0;
@@ -1557,6 +4781,7 @@ ImageCacheImpl::init ()
     m_stat_open_files_created = 0;
     m_stat_open_files_current = 0;
     m_stat_open_files_peak = 0;
+    m_stat_open_files_closed = 0;
 
     // Allow environment variable to override default options
     const char *options = getenv ("OPENIMAGEIO_IMAGECACHE_OPTIONS");
@@ -1568,8 +4793,20 @@ ImageCacheImpl::init ()
 
 ImageCacheImpl::~ImageCacheImpl ()
 {
+    // Shut down the I/O threads first, abandoning any pending prefetches,
+    // and stop serving tiles to other hosts.
+    delete m_io_pool;
+    m_remoteserver.stop ();
     printstats ();
+    if (m_trace)
+        write_trace_file ();
+    if (m_tile_record)
+        write_tile_record ();
+    std::string err;
+    if (! m_metadata_index.save (err))
+        std::cerr << "ImageCache: " << err << "\n";
     erase_perthread_info ();
+    reclaim_tileindex_nodes (true);
 }
 
 
@@ -1578,13 +4815,100 @@ void
 ImageCacheImpl::mergestats (ImageCacheStatistics &stats) const
 {
     stats.init ();
-    spin_lock lock (m_perthread_info_mutex);
+    counted_spin_lock lock (m_perthread_info_mutex,
+                            lock_stats (LockPerthreadInfo));
     for (size_t i = 0;  i < m_all_perthread_info.size();  ++i)
         stats.merge (m_all_perthread_info[i]->m_stats);
 }
 
 
 
+void
+ImageCacheImpl::merge_file_stats () const
+{
+    counted_spin_lock lock (m_perthread_info_mutex,
+                            lock_stats (LockPerthreadInfo));
+    for (size_t i = 0;  i < m_all_perthread_info.size();  ++i) {
+        ImageCachePerThreadInfo *p = m_all_perthread_info[i];
+        if (! p)
+            continue;
+        FileStatsMap stats;
+        {
+            spin_lock tlock (p->file_stats_mutex);
+            stats.swap (p->file_stats);
+        }
+        for (FileStatsMap::iterator s = stats.begin(); s != stats.end(); ++s) {
+            ImageCacheFile *file = s->first;
+            const FileStats &f (s->second);
+            // N.B. m_perthread_info_mutex serializes all the merges.
+            file->m_tilesread += f.tilesread;
+            file->m_bytesread += f.bytesread;
+            file->m_redundant_tiles += f.redundant_tiles;
+            file->m_redundant_bytesread += f.redundant_bytesread;
+            file->m_iotime += f.iotime;
+            if (f.mipreadcount.size()) {
+                spin_lock flock (file->m_extra_mutex);
+                std::vector<size_t> &m (file->m_mipreadcount);
+                if (m.size() < f.mipreadcount.size())
+                    m.resize (f.mipreadcount.size(), 0);
+                for (size_t l = 0;  l < f.mipreadcount.size();  ++l)
+                    m[l] += f.mipreadcount[l];
+            }
+        }
+    }
+}
+
+
+
+std::string
+ImageCacheImpl::texture_profile_json (int maxfiles) const
+{
+    std::vector<ImageCacheFileRef> files;
+    for (FilenameMap::iterator f = m_files.begin(); f != m_files.end(); ++f) {
+        const ImageCacheFileRef &file (f->second);
+        if (! file->broken() && file->validspec() && file->profile_ticks())
+            files.push_back (file);
+    }
+    std::sort (files.begin(), files.end(), profile_compare);
+    if (maxfiles > 0 && files.size() > size_t(maxfiles))
+        files.resize (maxfiles);
+
+    std::ostringstream out;
+    out << "{ \"files\" : [";
+    for (size_t i = 0;  i < files.size();  ++i) {
+        const ImageCacheFileRef &file (files[i]);
+        out << (i ? "," : "") << "\n  { \"name\" : \""
+            << Strutil::escape_chars (file->filename().string()) << "\", "
+            << "\"total_ns\" : " << ticks_to_ns (file->profile_ticks())
+            << ", \"levels\" : [";
+        bool first = true;
+        for (int s = 0, send = file->subimages();  s < send;  ++s) {
+            for (int m = 0, mend = file->miplevels(s);  m < mend;  ++m) {
+                const ImageCacheFile::LevelProfile &p (file->levelinfo(s,m).profile);
+                if (! p.lookups && ! p.total_ticks())
+                    continue;
+                long long lookups = p.lookups;
+                out << (first ? "" : ",") << "\n      { "
+                    << "\"subimage\" : " << s << ", \"miplevel\" : " << m
+                    << ", \"lookups\" : " << lookups
+                    << Strutil::format (", \"probes_per_lookup\" : %.3g",
+                                        lookups ? double(p.probes)/lookups : 0.0)
+                    << ", \"lookup_ns\" : " << ticks_to_ns (p.lookup_ticks)
+                    << ", \"wait_ns\" : " << ticks_to_ns (p.wait_ticks)
+                    << ", \"decode_ns\" : " << ticks_to_ns (p.decode_ticks)
+                    << ", \"filter_ns\" : " << ticks_to_ns (p.filter_ticks)
+                    << " }";
+                first = false;
+            }
+        }
+        out << " ] }";
+    }
+    out << " ]\n}\n";
+    return out.str();
+}
+
+
+
 std::string
 ImageCacheImpl::onefile_stat_line (const ImageCacheFileRef &file,
                                    int i, bool includestats) const
@@ -1677,6 +5001,7 @@ ImageCacheImpl::getstats (int level) const
     // Merge all the threads
     ImageCacheStatistics stats;
     mergestats (stats);
+    merge_file_stats ();
 
     // Gather file list and statistics
     size_t total_opens = 0, total_tiles = 0;
@@ -1685,6 +5010,7 @@ ImageCacheImpl::getstats (int level) const
     imagesize_t total_redundant_bytes = 0;
     size_t total_untiled = 0, total_unmipped = 0, total_duplicates = 0;
     size_t total_constant = 0;
+    size_t total_metadata = 0, total_metadata_saved = 0, total_automip = 0;
     double total_iotime = 0;
     std::vector<ImageCacheFileRef> files;
     {
@@ -1697,6 +5023,9 @@ ImageCacheImpl::getstats (int level) const
             total_redundant_bytes += file->redundant_bytesread();
             total_bytes += file->bytesread();
             total_iotime += file->iotime();
+            total_metadata += file->metadata_memory();
+            total_metadata_saved += file->metadata_saved();
+            total_automip += file->automip_memory();
             if (file->duplicate()) {
                 ++total_duplicates;
                 continue;
@@ -1733,16 +5062,39 @@ ImageCacheImpl::getstats (int level) const
 #define STROPT(name) if (m_##name.size()) opt += Strutil::format(#name "=\"%s\" ", m_##name)
         opt += Strutil::format("max_memory_MB=%0.1f ", m_max_memory_bytes/(1024.0*1024.0));
         INTOPT(max_open_files);
+        INTOPT(max_open_files_expensive);
         INTOPT(autotile);
         INTOPT(autoscanline);
+        INTOPT(autotile_large_MB);
+        INTOPT(untiled_band_memory_MB);
         INTOPT(automip);
+        INTOPT(automip_async);
         INTOPT(forcefloat);
         INTOPT(accept_untiled);
         INTOPT(accept_unmipped);
         INTOPT(read_before_insert);
         INTOPT(deduplicate);
+        INTOPT(deduplicate_tiles);
+        INTOPT(mmap_tiles);
+        INTOPT(compress_tiles);
+        INTOPT(cache_channel_subsets);
         INTOPT(unassociatedalpha);
         INTOPT(failure_retries);
+        INTOPT(io_threads);
+        INTOPT(max_inputs_per_file);
+        INTOPT(coalesce_tiles);
+        BOOLOPT(concurrent_reads);
+        INTOPT(get_pixels_parallel);
+        INTOPT(microcache_size);
+        INTOPT(texture_profile);
+        INTOPT(lock_stats);
+        if (m_eviction_policy == EvictFrequency)
+            opt += "eviction_policy=\"frequency\" ";
+        STROPT(disk_cache_dir);
+        STROPT(shared_cache_name);
+        STROPT(metadata_index_file);
+        if (m_disk_cache_size > 0)
+            opt += Strutil::format("disk_cache_size=%0.1f ", m_disk_cache_size);
 #undef BOOLOPT
 #undef INTOPT
 #undef STROPT
@@ -1751,9 +5103,24 @@ ImageCacheImpl::getstats (int level) const
         if (stats.unique_files) {
             out << "  Images : " << stats.unique_files << " unique\n";
             out << "    ImageInputs : " << m_stat_open_files_created << " created, " << m_stat_open_files_current << " current, " << m_stat_open_files_peak << " peak\n";
+            if (stats.file_reopens)
+                out << "    Files reopened : " << stats.file_reopens << " times ("
+                    << Strutil::timeintervalformat (stats.file_reopen_time)
+                    << ")\n";
+            if (stats.files_from_index)
+                out << "    Set up from the metadata index : "
+                    << stats.files_from_index << "\n";
             out << "    Total pixel data size of all images referenced : " << Strutil::memformat (stats.files_totalsize) << "\n";
             out << "    Total actual file size of all images referenced : " << Strutil::memformat (stats.files_totalsize_ondisk) << "\n";
             out << "    Pixel data read : " << Strutil::memformat (stats.bytes_read) << "\n";
+            out << "    Image metadata in memory : " << Strutil::memformat (total_metadata);
+            if (total_metadata_saved)
+                out << " (" << Strutil::memformat (total_metadata_saved)
+                    << " saved by sharing it between MIP levels)";
+            out << "\n";
+            if (total_automip)
+                out << "    MIP levels made in the background : "
+                    << Strutil::memformat (total_automip) << "\n";
         } else {
             out << "  No images opened\n";
         }
@@ -1763,7 +5130,8 @@ ImageCacheImpl::getstats (int level) const
             out << "    File I/O time : " 
                 << Strutil::timeintervalformat (stats.fileio_time);
             {
-                spin_lock lock (m_perthread_info_mutex);
+                counted_spin_lock lock (m_perthread_info_mutex,
+                                        lock_stats (LockPerthreadInfo));
                 size_t nthreads = m_all_perthread_info.size();
                 if (nthreads > 1) {
                     double perthreadtime = stats.fileio_time / (float)nthreads;
@@ -1782,10 +5150,96 @@ ImageCacheImpl::getstats (int level) const
             out << "    total tile requests : " << stats.find_tile_calls << "\n";
             out << "    micro-cache misses : " << stats.find_tile_microcache_misses << " (" << 100.0*(double)stats.find_tile_microcache_misses/(double)stats.find_tile_calls << "%)\n";
             out << "    main cache misses : " << stats.find_tile_cache_misses << " (" << 100.0*(double)stats.find_tile_cache_misses/(double)stats.find_tile_calls << "%)\n";
+            ImageCache::LatencyHistogram misses;
+            m_miss_latency.snapshot (misses);
+            if (misses.count)
+                out << "    miss latency : median "
+                    << Strutil::timeintervalformat (misses.percentile(0.5), 6)
+                    << ", 99% "
+                    << Strutil::timeintervalformat (misses.percentile(0.99), 6)
+                    << ", max "
+                    << Strutil::timeintervalformat (misses.max, 6) << "\n";
+            if (stats.shared_cache_hits || stats.shared_cache_misses)
+                out << "    shared cache hits : " << stats.shared_cache_hits
+                    << ", misses : " << stats.shared_cache_misses << "\n";
+            if (stats.remote_cache_hits || stats.remote_cache_misses)
+                out << "    remote cache hits : " << stats.remote_cache_hits
+                    << ", misses : " << stats.remote_cache_misses << "\n";
+            if (stats.disk_cache_hits || stats.disk_cache_misses)
+                out << "    disk cache hits : " << stats.disk_cache_hits
+                    << ", misses : " << stats.disk_cache_misses << "\n";
+            if (stats.tiles_compressed) {
+                out << "    compressed tiles : " << stats.tiles_compressed
+                    << ", " << Strutil::memformat (stats.compressed_bytes_raw)
+                    << " -> " << Strutil::memformat (stats.compressed_bytes)
+                    << " (" << Strutil::timeintervalformat (stats.compress_time)
+                    << ")\n";
+                out << "    decompressed tiles : " << stats.tiles_decompressed
+                    << " (" << Strutil::timeintervalformat (stats.decompress_time)
+                    << ")\n";
+            }
             out << "    redundant reads: " << (unsigned long long) total_redundant_tiles
                 << " tiles, " << Strutil::memformat (total_redundant_bytes) << "\n";
+            if (stats.prefetch_calls)
+                out << "    prefetch requests : " << stats.prefetch_calls
+                    << " (" << stats.prefetch_tiles_queued
+                    << " tiles queued)\n";
+            if (stats.approximate_lookups || stats.nonblocking_tiles_queued)
+                out << "    nonblocking : " << stats.approximate_lookups
+                    << " approximate lookups, "
+                    << stats.nonblocking_tiles_queued << " tiles queued\n";
+            if (stats.untiled_band_hits)
+                out << "    untiled tiles refilled from kept scanlines : "
+                    << stats.untiled_band_hits << "\n";
+            if (stats.concurrent_tile_reads)
+                out << "    tiles read without locking the file : "
+                    << stats.concurrent_tile_reads << "\n";
+            if (stats.tiles_coalesced)
+                out << "    tiles read along with a neighbor : "
+                    << stats.tiles_coalesced << "\n";
+            if (stats.procedural_tiles)
+                out << "    procedural tiles generated : "
+                    << stats.procedural_tiles << "\n";
         }
         out << "    Peak cache memory : " << Strutil::memformat (m_mem_used) << "\n";
+        const TileAllocator &allocator (TileAllocator::instance());
+        if (allocator.slab_bytes())
+            out << "    Tile slab memory : "
+                << Strutil::memformat (allocator.slab_bytes()) << " ("
+                << Strutil::memformat (allocator.used_bytes())
+                << " in use, all caches)\n";
+        if (m_mem_used_coarse.fast_value())
+            out << "    Coarse MIP tile memory : "
+                << Strutil::memformat (m_mem_used_coarse) << "\n";
+        {
+            // Tile memory by the priority classes of set_file_priority,
+            // reported only if anybody has used them.
+            const int nclasses = 2*max_file_priority + 1;
+            long long classmem[nclasses] = { 0 };
+            int classfiles[nclasses] = { 0 };
+            int overquota = 0;
+            bool classes_used = false;
+            for (FilenameMap::iterator f = m_files.begin(); f != m_files.end(); ++f) {
+                const ImageCacheFileRef &file (f->second);
+                int c = file->priority() + max_file_priority;
+                classmem[c] += file->mem_used();
+                ++classfiles[c];
+                overquota += file->over_quota();
+                if (file->priority() || file->quota())
+                    classes_used = true;
+            }
+            if (classes_used) {
+                out << "    Tile memory by priority class :\n";
+                for (int c = nclasses-1;  c >= 0;  --c)
+                    if (classfiles[c])
+                        out << Strutil::format ("      %2d : %s (%d files)\n",
+                                    c - max_file_priority,
+                                    Strutil::memformat (classmem[c]),
+                                    classfiles[c]);
+                if (overquota)
+                    out << "      files over their quota : " << overquota << "\n";
+            }
+        }
         if (stats.tile_locking_time > 0.001)
             out << "    Tile mutex locking time : " << Strutil::timeintervalformat (stats.tile_locking_time) << "\n";
         if (stats.find_tile_time > 0.001)
@@ -1821,6 +5275,14 @@ ImageCacheImpl::getstats (int level) const
                                 Strutil::timeintervalformat(total_iotime));
     }
 
+    if (level >= 3) {
+        out << "  Lock contention:\n";
+        if (m_lock_stats)
+            out << lock_contention_stats ();
+        else
+            out << "    (not measured, set the \"lock_stats\" attribute)\n";
+    }
+
     // Try to point out hot spots
     if (level > 0) {
         if (total_duplicates)
@@ -1907,6 +5369,27 @@ ImageCacheImpl::getstats (int level) const
                 }
             }
         }
+        if (m_texture_profile) {
+            const int topN = 5;
+            long long total_ticks = 0;
+            BOOST_FOREACH (const ImageCacheFileRef &file, files)
+                total_ticks += file->profile_ticks();
+            std::sort (files.begin(), files.end(), profile_compare);
+            out << "  Top files by texture lookup cost:\n";
+            int nprinted = 0;
+            BOOST_FOREACH (const ImageCacheFileRef &file, files) {
+                if (nprinted >= topN || ! file->profile_ticks())
+                    break;
+                ++nprinted;
+                double t = FastTimer::seconds (file->profile_ticks());
+                out << Strutil::format ("    %d   %9s (%4.1f%%)   ", nprinted,
+                                        Strutil::timeintervalformat (t).c_str(),
+                                        100.0 * file->profile_ticks() / (double)total_ticks);
+                out << onefile_stat_line (file, -1, false) << "\n";
+            }
+            if (nprinted == 0)
+                out << "    (no lookups were profiled)\n";
+        }
         int nbroken = 0;
         BOOST_FOREACH (const ImageCacheFileRef &file, files) {
             if (file->broken() || !file->validspec())
@@ -1930,6 +5413,318 @@ ImageCacheImpl::getstats (int level) const
 
 
 
+void
+ImageCacheImpl::get_metrics (Metrics &metrics) const
+{
+    metrics.time = m_metrics_timer();
+    {
+        ImageCacheStatistics stats;
+        mergestats (stats);
+        metrics.tile_lookups = stats.find_tile_calls;
+        metrics.tile_misses = stats.find_tile_cache_misses;
+        metrics.bytes_read = stats.bytes_read;
+        metrics.fileio_time = stats.fileio_time;
+    }
+    m_miss_latency.snapshot (metrics.miss_latency);
+    m_open_latency.snapshot (metrics.open_latency);
+    metrics.memory_used = m_mem_used;
+    metrics.memory_limit = m_max_memory_bytes;
+    metrics.memory_by_priority.assign (2*max_file_priority + 1, 0);
+    metrics.files = 0;
+    // This locks each bin of the file map in turn, but never more than
+    // one at a time, so it holds up a lookup for a moment at most.
+    for (FilenameMap::iterator f = m_files.begin(); f != m_files.end(); ++f) {
+        const ImageCacheFileRef &file (f->second);
+        metrics.memory_by_priority[file->priority() + max_file_priority]
+            += file->mem_used();
+        ++metrics.files;
+    }
+    metrics.tiles = m_stat_tiles_current;
+    metrics.tiles_created = m_stat_tiles_created;
+    metrics.open_files = m_stat_open_files_current;
+    metrics.files_opened = m_stat_open_files_created;
+    metrics.files_closed = m_stat_open_files_closed;
+}
+
+
+
+void
+ImageCacheImpl::trace_event (ImageCachePerThreadInfo *thread_info,
+                             const TraceEvent &event)
+{
+    if (! thread_info)
+        thread_info = get_perthread_info ();
+    spin_lock lock (thread_info->trace_mutex);
+    std::vector<TraceEvent> &trace (thread_info->trace);
+    if (trace.size() < size_t(m_trace_events)) {
+        if (trace.empty())
+            trace.reserve (m_trace_events);
+        trace.push_back (event);
+    } else {
+        // Full: overwrite the oldest
+        trace[thread_info->trace_next] = event;
+        thread_info->trace_next = (thread_info->trace_next + 1) % trace.size();
+    }
+}
+
+
+
+void
+ImageCacheImpl::clear_trace ()
+{
+    spin_lock lock (m_perthread_info_mutex);
+    for (size_t i = 0;  i < m_all_perthread_info.size();  ++i) {
+        if (ImageCachePerThreadInfo *p = m_all_perthread_info[i]) {
+            spin_lock tlock (p->trace_mutex);
+            std::vector<TraceEvent>().swap (p->trace);
+            p->trace_next = 0;
+        }
+    }
+    m_trace_timer.reset ();
+    m_trace_timer.start ();
+}
+
+
+
+std::string
+ImageCacheImpl::trace_json () const
+{
+    static const char *names[NumTraceEventTypes] = {
+        "tile miss", "tile wait", "tile read", "decompress",
+        "file open", "file close", "file sweep", "tile sweep",
+        "texture lookup"
+    };
+    std::ostringstream out;
+    out << "{ \"displayTimeUnit\" : \"ms\", \"traceEvents\" : [";
+    bool first = true;
+    spin_lock lock (m_perthread_info_mutex);
+    for (size_t i = 0;  i < m_all_perthread_info.size();  ++i) {
+        ImageCachePerThreadInfo *p = m_all_perthread_info[i];
+        if (! p)
+            continue;
+        spin_lock tlock (p->trace_mutex);
+        const std::vector<TraceEvent> &trace (p->trace);
+        for (size_t e = 0;  e < trace.size();  ++e) {
+            // Oldest first
+            const TraceEvent &ev (trace[(e + p->trace_next) % trace.size()]);
+            out << (first ? "" : ",") << "\n  { \"name\" : \""
+                << names[ev.type] << "\", \"cat\" : \"imagecache\", "
+                << "\"ph\" : \"X\", \"pid\" : 1, \"tid\" : " << p->trace_tid
+                << Strutil::format (", \"ts\" : %.3f, \"dur\" : %.3f",
+                                    Timer::seconds (ev.begin) * 1.0e6,
+                                    Timer::seconds (ev.end - ev.begin) * 1.0e6);
+            if (ev.filename) {
+                out << ", \"args\" : { \"file\" : \""
+                    << Strutil::escape_chars (ev.filename.string()) << "\"";
+                if (ev.subimage >= 0)
+                    out << ", \"subimage\" : " << ev.subimage;
+                if (ev.miplevel >= 0)
+                    out << ", \"miplevel\" : " << ev.miplevel
+                        << ", \"x\" : " << ev.x << ", \"y\" : " << ev.y;
+                out << " }";
+            }
+            out << " }";
+            first = false;
+        }
+    }
+    out << " ]\n}\n";
+    return out.str();
+}
+
+
+
+void
+ImageCacheImpl::write_trace_file () const
+{
+    if (m_trace_file.empty())
+        return;
+    OIIO::ofstream out;
+    Filesystem::open (out, m_trace_file);
+    if (out)
+        out << trace_json ();
+    if (! out)
+        error ("Could not write trace file \"%s\"", m_trace_file);
+}
+
+
+
+namespace {
+
+// Task for the I/O threads: read one tile into the cache.
+struct PrefetchTileTask {
+    PrefetchTileTask (ImageCacheImpl *ic, const TileID &id)
+        : ic(ic), id(id) { }
+    void operator() () { ic->prefetch_tile (id); }
+    ImageCacheImpl *ic;
+    TileID id;
+};
+
+}
+
+
+
+// The tile record is a text file.  After the header line, each file is
+// introduced once, before its first tile, by a line
+//     F <index> <fingerprint or -> <filename>
+// and each tile is a line
+//     T <file index> <subimage> <miplevel> <x> <y> <z> <chbegin> <chend>
+// in the order the tiles first missed the cache.
+static const char *tile_record_header = "# OpenImageIO tile record 1";
+
+
+
+void
+ImageCacheImpl::record_tile (const TileID &id)
+{
+    spin_lock lock (m_tile_record_mutex);
+    if (m_tile_record)
+        m_tile_record_ids.push_back (id);
+}
+
+
+
+void
+ImageCacheImpl::write_tile_record ()
+{
+    std::vector<TileID> ids;
+    {
+        spin_lock lock (m_tile_record_mutex);
+        ids.swap (m_tile_record_ids);
+    }
+    if (m_tile_record_file.empty())
+        return;
+    OIIO::ofstream out;
+    Filesystem::open (out, m_tile_record_file);
+    if (out)
+        out << tile_record_header << "\n";
+    // A tile that was evicted and missed again is only listed the first
+    // time.
+    unordered_map<TileID, int, TileID::Hasher> seen;
+    unordered_map<const ImageCacheFile *, int> fileindex;
+    for (size_t i = 0, e = ids.size();  i < e && out;  ++i) {
+        const TileID &id (ids[i]);
+        if (! seen.insert (std::make_pair (id, 0)).second)
+            continue;
+        const ImageCacheFile *file = &id.file();
+        int f = (int) fileindex.size();
+        if (fileindex.insert (std::make_pair (file, f)).second)
+            out << "F " << f << ' '
+                << (file->fingerprint().size() ? file->fingerprint().c_str() : "-")
+                << ' ' << file->filename() << "\n";
+        else
+            f = fileindex[file];
+        out << "T " << f << ' ' << id.subimage() << ' ' << id.miplevel()
+            << ' ' << id.x() << ' ' << id.y() << ' ' << id.z()
+            << ' ' << id.chbegin() << ' ' << id.chend() << "\n";
+    }
+    if (! out)
+        error ("Could not write tile record file \"%s\"", m_tile_record_file);
+}
+
+
+
+bool
+ImageCacheImpl::replay_tile_record (const std::string &filename)
+{
+    if (filename.empty())
+        return true;
+    std::string text;
+    if (! Filesystem::read_text_file (filename, text) ||
+          ! Strutil::starts_with (text, tile_record_header)) {
+        error ("Could not read tile record file \"%s\"", filename);
+        return false;
+    }
+    if (m_io_threads < 1)
+        return true;   // Prefetching is disabled
+
+    ImageCachePerThreadInfo *thread_info = get_perthread_info ();
+    // Files that are gone, or whose fingerprint no longer matches the
+    // one recorded, stay NULL and their tiles are skipped.
+    std::vector<ImageCacheFile *> files;
+    std::istringstream in (text);
+    std::string line;
+    std::getline (in, line);   // header
+    while (std::getline (in, line)) {
+        string_view l (line);
+        if (Strutil::parse_prefix (l, "F ")) {
+            int f;
+            string_view finger;
+            if (! Strutil::parse_int (l, f) || f != (int)files.size())
+                continue;
+            Strutil::skip_whitespace (l);
+            finger = Strutil::parse_until (l);
+            if (finger.empty())
+                continue;
+            if (finger == "-")
+                finger = string_view();
+            Strutil::skip_whitespace (l);
+            ImageCacheFile *file = find_file (ustring(l), thread_info);
+            file = verify_file (file, thread_info);
+            if (file && (file->broken() || file->is_udim() ||
+                         (finger.size() && file->fingerprint() != finger)))
+                file = NULL;
+            files.push_back (file);
+        } else if (Strutil::parse_prefix (l, "T ")) {
+            int v[8];
+            bool ok = true;
+            for (int i = 0;  i < 8 && ok;  ++i)
+                ok = Strutil::parse_int (l, v[i]);
+            if (! ok || v[0] < 0 || v[0] >= (int)files.size() || ! files[v[0]])
+                continue;
+            ImageCacheFile *file = files[v[0]];
+            int subimage = v[1], miplevel = v[2];
+            if (subimage < 0 || subimage >= file->subimages() ||
+                miplevel < 0 || miplevel >= file->miplevels(subimage))
+                continue;
+            const ImageSpec &spec (file->spec (subimage, miplevel));
+            if (v[6] < 0 || v[7] > spec.nchannels || v[6] >= v[7] ||
+                (v[3] - spec.x) % spec.tile_width ||
+                (v[4] - spec.y) % spec.tile_height ||
+                (v[5] - spec.z) % spec.tile_depth)
+                continue;
+            TileID id (*file, subimage, miplevel, v[3], v[4], v[5],
+                       v[6], v[7]);
+            thread_info->enter_tileindex (m_tileindex_epoch.fast_value());
+            bool cached = (m_tileindex.find (id) != NULL);
+            thread_info->exit_tileindex ();
+            if (cached || ! m_pending_tiles.insert (id, 0))
+                continue;
+            m_io_pool->push (PrefetchTileTask (this, id));
+            ++thread_info->m_stats.prefetch_tiles_queued;
+        }
+    }
+    return true;
+}
+
+
+
+std::string
+ImageCacheImpl::lock_contention_stats () const
+{
+    static const char *names[NumLockSites] = {
+        "file input mutexes", "tile cache bins", "filename map bins",
+        "perthread info mutex", "open files mutex",
+        "file sweep (skipped)", "tile sweep (skipped)"
+    };
+    std::ostringstream out;
+    for (int i = 0;  i < NumLockSites;  ++i) {
+        const LockStats &s (m_lockstats[i]);
+        double t = Timer::seconds (s.wait_ticks);
+        out << Strutil::format ("    %-22s %10lld waits  %9s\n", names[i],
+                                (long long) s.waits,
+                                Strutil::timeintervalformat (t, 3));
+    }
+    long long waits;
+    double wait_time;
+    ustring::insert_contention (waits, wait_time);
+    out << Strutil::format ("    %-22s %10lld waits  %9s  (since startup)\n",
+                            "ustring table inserts", waits,
+                            Strutil::timeintervalformat (wait_time, 3));
+    return out.str();
+}
+
+
+
 void
 ImageCacheImpl::printstats () const
 {
@@ -1943,12 +5738,19 @@ ImageCacheImpl::printstats () const
 void
 ImageCacheImpl::reset_stats ()
 {
+    merge_file_stats ();
     {
-        spin_lock lock (m_perthread_info_mutex);
+        counted_spin_lock lock (m_perthread_info_mutex,
+                                lock_stats (LockPerthreadInfo));
         for (size_t i = 0;  i < m_all_perthread_info.size();  ++i)
             m_all_perthread_info[i]->m_stats.init ();
     }
 
+    for (int i = 0;  i < NumLockSites;  ++i)
+        m_lockstats[i].clear ();
+    m_miss_latency.clear ();
+    m_open_latency.clear ();
+
     {
         for (FilenameMap::iterator f = m_files.begin(); f != m_files.end(); ++f) {
             const ImageCacheFileRef &file (f->second);
@@ -1956,6 +5758,9 @@ ImageCacheImpl::reset_stats ()
             file->m_tilesread = 0;
             file->m_bytesread = 0;
             file->m_iotime = 0;
+            for (int s = 0, send = file->subimages();  s < send;  ++s)
+                for (int m = 0, mend = file->miplevels(s);  m < mend;  ++m)
+                    file->levelinfo(s,m).profile.clear ();
         }
     }
 }
@@ -1974,6 +5779,9 @@ ImageCacheImpl::attribute (string_view name, TypeDesc type,
     if (name == "max_open_files" && type == TypeDesc::INT) {
         set_max_open_files (*(const int *)val);
     }
+    else if (name == "max_open_files_expensive" && type == TypeDesc::INT) {
+        m_max_open_files_expensive = std::max (0, *(const int *)val);
+    }
     else if (name == "max_memory_MB" && type == TypeDesc::FLOAT) {
         float size = *(const float *)val;
 #ifdef NDEBUG
@@ -2033,6 +5841,16 @@ ImageCacheImpl::attribute (string_view name, TypeDesc type,
             do_invalidate = true;
         }
     }
+    else if (name == "autotile_large_MB" && type == TypeDesc::INT) {
+        int a = std::max (*(const int *)val, 0);
+        if (a != m_autotile_large_MB) {
+            m_autotile_large_MB = a;
+            do_invalidate = true;
+        }
+    }
+    else if (name == "untiled_band_memory_MB" && type == TypeDesc::INT) {
+        m_untiled_band_memory_MB = std::max (*(const int *)val, 0);
+    }
     else if (name == "automip" && type == TypeDesc::INT) {
         bool a = (*(const int *)val != 0);
         if (a != m_automip) {
@@ -2040,6 +5858,9 @@ ImageCacheImpl::attribute (string_view name, TypeDesc type,
             do_invalidate = true;
         }
     }
+    else if (name == "automip_async" && type == TypeDesc::INT) {
+        m_automip_async = (*(const int *)val != 0);
+    }
     else if (name == "forcefloat" && type == TypeDesc::INT) {
         bool a = (*(const int *)val != 0);
         if (a != m_forcefloat) {
@@ -2075,6 +5896,26 @@ ImageCacheImpl::attribute (string_view name, TypeDesc type,
             do_invalidate = true;
         }
     }
+    else if (name == "deduplicate_tiles" && type == TypeDesc::INT) {
+        m_deduplicate_tiles = (*(const int *)val != 0);
+    }
+    else if (name == "compress_tiles" && type == TypeDesc::INT) {
+        bool r = (*(const int *)val != 0);
+        if (r != m_compress_tiles) {
+            m_compress_tiles = r;
+            do_invalidate = true;
+        }
+    }
+    else if (name == "mmap_tiles" && type == TypeDesc::INT) {
+        bool r = (*(const int *)val != 0);
+        if (r != m_mmap_tiles) {
+            m_mmap_tiles = r;
+            do_invalidate = true;
+        }
+    }
+    else if (name == "cache_channel_subsets" && type == TypeDesc::INT) {
+        m_cache_channel_subsets = (*(const int *)val != 0);
+    }
     else if (name == "unassociatedalpha" && type == TypeDesc::INT) {
         bool r = (*(const int *)val != 0);
         if (r != m_unassociatedalpha) {
@@ -2085,6 +5926,187 @@ ImageCacheImpl::attribute (string_view name, TypeDesc type,
     else if (name == "failure_retries" && type == TypeDesc::INT) {
         m_failure_retries = *(const int *)val;
     }
+    else if (name == "disk_cache_dir" && type == TypeDesc::STRING) {
+        std::string dir (*(const char **)val);
+        if (dir != m_disk_cache_dir) {
+            m_disk_cache_dir = dir;
+            init_disk_cache ();
+        }
+    }
+    else if (name == "disk_cache_size" && (type == TypeDesc::FLOAT ||
+                                           type == TypeDesc::INT)) {
+        float size = (type == TypeDesc::FLOAT) ? *(const float *)val
+                                               : float (*(const int *)val);
+        if (size != m_disk_cache_size) {
+            m_disk_cache_size = std::max (size, 0.0f);
+            init_disk_cache ();
+        }
+    }
+    else if (name == "shared_cache_name" && type == TypeDesc::STRING) {
+        std::string shmname (*(const char **)val);
+        if (shmname != m_shared_cache_name) {
+            m_shared_cache_name = shmname;
+            init_shared_cache ();
+        }
+    }
+    else if (name == "shared_cache_size" && (type == TypeDesc::FLOAT ||
+                                             type == TypeDesc::INT)) {
+        float size = (type == TypeDesc::FLOAT) ? *(const float *)val
+                                               : float (*(const int *)val);
+        if (size != m_shared_cache_size) {
+            m_shared_cache_size = std::max (size, 0.0f);
+            init_shared_cache ();
+        }
+    }
+    else if (name == "auto_lod" && type == TypeDesc::INT) {
+        m_auto_lod = (*(const int *)val != 0);
+        if (! m_auto_lod)
+            m_auto_lod_resolution = 0;
+    }
+    else if (name == "auto_lod_min_resolution" && type == TypeDesc::INT) {
+        m_auto_lod_min_resolution = std::max (*(const int *)val, 1);
+    }
+    else if (name == "remote_cache" && type == TypeDesc::STRING) {
+        std::string server (*(const char **)val);
+        if (server != m_remote_cache) {
+            m_remote_cache = server;
+            std::string err;
+            if (! m_remotecache.init (m_remote_cache, err))
+                error ("%s", err);
+        }
+    }
+    else if (name == "remote_cache_serve" && type == TypeDesc::INT) {
+        int port = std::max (*(const int *)val, 0);
+        if (port != m_remote_cache_serve) {
+            m_remote_cache_serve = port;
+            init_remote_server ();
+        }
+    }
+    else if (name == "remote_cache_serve_address" && type == TypeDesc::STRING) {
+        std::string address (*(const char **)val);
+        if (address != m_remote_cache_serve_address) {
+            m_remote_cache_serve_address = address;
+            if (m_remote_cache_serve)
+                init_remote_server ();
+        }
+    }
+    else if (name == "remote_cache_serve_threads" && type == TypeDesc::INT) {
+        int n = std::max (*(const int *)val, 1);
+        if (n != m_remote_cache_serve_threads) {
+            m_remote_cache_serve_threads = n;
+            if (m_remote_cache_serve)
+                init_remote_server ();
+        }
+    }
+    else if (name == "watch_files" && type == TypeDesc::INT) {
+        int w = *(const int *)val != 0;
+        if (w != m_watch_files) {
+            m_watch_files = w;
+            init_file_watcher ();
+        }
+    }
+    else if (name == "watch_files_interval" && type == TypeDesc::FLOAT) {
+        float interval = std::max (*(const float *)val, 0.01f);
+        if (interval != m_watch_files_interval) {
+            m_watch_files_interval = interval;
+            if (m_watch_files)
+                init_file_watcher ();
+        }
+    }
+    else if (name == "metadata_index" && type == TypeDesc::STRING) {
+        std::string indexfile (*(const char **)val);
+        if (indexfile != m_metadata_index_file) {
+            m_metadata_index_file = indexfile;
+            init_metadata_index ();
+        }
+    }
+    else if (name == "eviction_policy" && type == TypeDesc::STRING) {
+        string_view policy (*(const char **)val);
+        if (policy == "clock")
+            m_eviction_policy = EvictClock;
+        else if (policy == "frequency")
+            m_eviction_policy = EvictFrequency;
+        else
+            return false;
+    }
+    else if (name == "get_pixels_parallel" && type == TypeDesc::INT) {
+        m_get_pixels_parallel = std::max (*(const int *)val, 0);
+    }
+    else if (name == "max_inputs_per_file" && type == TypeDesc::INT) {
+        m_max_inputs_per_file = std::max (*(const int *)val, 1);
+    }
+    else if (name == "coalesce_tiles" && type == TypeDesc::INT) {
+        m_coalesce_tiles = std::max (*(const int *)val, 1);
+    }
+    else if (name == "concurrent_reads" && type == TypeDesc::INT) {
+        m_concurrent_reads = (*(const int *)val != 0);
+    }
+    else if (name == "texture_profile" && type == TypeDesc::INT) {
+        m_texture_profile = (*(const int *)val != 0);
+    }
+    else if (name == "trace" && type == TypeDesc::INT) {
+        bool trace = (*(const int *)val != 0);
+        if (trace && ! m_trace) {
+            clear_trace ();
+            m_trace = true;
+        } else if (! trace && m_trace) {
+            m_trace = false;
+            write_trace_file ();
+        }
+    }
+    else if (name == "trace_events" && type == TypeDesc::INT) {
+        m_trace_events = std::max (*(const int *)val, 1);
+    }
+    else if (name == "trace_lookup_us" && type == TypeDesc::FLOAT) {
+        m_trace_lookup_us = std::max (*(const float *)val, 0.0f);
+        m_trace_lookup_ticks = (long long) (m_trace_lookup_us * 1.0e-6
+                                            / Timer::seconds (1));
+    }
+    else if (name == "trace_file" && type == TypeDesc::STRING) {
+        m_trace_file = std::string (*(const char **)val);
+    }
+    else if (name == "tile_record" && type == TypeDesc::INT) {
+        bool record = (*(const int *)val != 0);
+        if (record && ! m_tile_record) {
+            spin_lock lock (m_tile_record_mutex);
+            m_tile_record_ids.clear ();
+            m_tile_record = true;
+        } else if (! record && m_tile_record) {
+            m_tile_record = false;
+            write_tile_record ();
+        }
+    }
+    else if (name == "tile_record_file" && type == TypeDesc::STRING) {
+        m_tile_record_file = std::string (*(const char **)val);
+    }
+    else if (name == "tile_replay_file" && type == TypeDesc::STRING) {
+        return replay_tile_record (std::string (*(const char **)val));
+    }
+    else if (name == "lock_stats" && type == TypeDesc::INT) {
+        m_lock_stats = (*(const int *)val != 0);
+        // The bin locks of the concurrent maps count into the same
+        // stats, if asked to.
+        LockStats *t = lock_stats (LockTileCacheBins);
+        m_tilecache.count_contention (t ? &t->waits : NULL,
+                                      t ? &t->wait_ticks : NULL);
+        LockStats *f = lock_stats (LockFileMapBins);
+        m_files.count_contention (f ? &f->waits : NULL,
+                                  f ? &f->wait_ticks : NULL);
+    }
+    else if (name == "microcache_size" && type == TypeDesc::INT) {
+        int size = Imath::clamp (*(const int *)val, 1, 1024);
+        if (size != m_microcache_size) {
+            m_microcache_size = size;
+            // Each thread resizes its own microcache when it notices
+            // the purge request.
+            purge_perthread_microcaches ();
+        }
+    }
+    else if (name == "io_threads" && type == TypeDesc::INT) {
+        m_io_threads = std::max (*(const int *)val, 0);
+        if (m_io_pool)
+            m_io_pool->resize (m_io_threads);
+    }
     else if (name == "latlong_up" && type == TypeDesc::STRING) {
         bool y_up = ! strcmp ("y", *(const char **)val);
         if (y_up != m_latlong_y_up_default) {
@@ -2117,20 +6139,50 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
     }
 
     ATTR_DECODE ("max_open_files", int, m_max_open_files);
+    ATTR_DECODE ("max_open_files_expensive", int, m_max_open_files_expensive);
     ATTR_DECODE ("max_memory_MB", float, m_max_memory_bytes/(1024.0*1024.0));
     ATTR_DECODE ("max_memory_MB", int, m_max_memory_bytes/(1024*1024));
     ATTR_DECODE ("statistics:level", int, m_statslevel);
     ATTR_DECODE ("max_errors_per_file", int, m_max_errors_per_file);
     ATTR_DECODE ("autotile", int, m_autotile);
     ATTR_DECODE ("autoscanline", int, m_autoscanline);
+    ATTR_DECODE ("autotile_large_MB", int, m_autotile_large_MB);
+    ATTR_DECODE ("untiled_band_memory_MB", int, m_untiled_band_memory_MB);
     ATTR_DECODE ("automip", int, m_automip);
+    ATTR_DECODE ("automip_async", int, m_automip_async);
     ATTR_DECODE ("forcefloat", int, m_forcefloat);
     ATTR_DECODE ("accept_untiled", int, m_accept_untiled);
     ATTR_DECODE ("accept_unmipped", int, m_accept_unmipped);
     ATTR_DECODE ("read_before_insert", int, m_read_before_insert);
     ATTR_DECODE ("deduplicate", int, m_deduplicate);
+    ATTR_DECODE ("deduplicate_tiles", int, m_deduplicate_tiles);
+    ATTR_DECODE ("mmap_tiles", int, m_mmap_tiles);
+    ATTR_DECODE ("compress_tiles", int, m_compress_tiles);
+    ATTR_DECODE ("cache_channel_subsets", int, m_cache_channel_subsets);
     ATTR_DECODE ("unassociatedalpha", int, m_unassociatedalpha);
     ATTR_DECODE ("failure_retries", int, m_failure_retries);
+    ATTR_DECODE ("io_threads", int, m_io_threads);
+    ATTR_DECODE ("max_inputs_per_file", int, m_max_inputs_per_file);
+    ATTR_DECODE ("coalesce_tiles", int, m_coalesce_tiles);
+    ATTR_DECODE ("concurrent_reads", int, m_concurrent_reads);
+    ATTR_DECODE ("get_pixels_parallel", int, m_get_pixels_parallel);
+    ATTR_DECODE ("microcache_size", int, m_microcache_size);
+    ATTR_DECODE ("texture_profile", int, m_texture_profile);
+    ATTR_DECODE ("lock_stats", int, m_lock_stats);
+    ATTR_DECODE ("trace", int, m_trace);
+    ATTR_DECODE ("trace_events", int, m_trace_events);
+    ATTR_DECODE ("trace_lookup_us", float, m_trace_lookup_us);
+    ATTR_DECODE ("tile_record", int, m_tile_record);
+    ATTR_DECODE ("disk_cache_size", float, m_disk_cache_size);
+    ATTR_DECODE ("disk_cache_size", int, m_disk_cache_size);
+    ATTR_DECODE ("shared_cache_size", float, m_shared_cache_size);
+    ATTR_DECODE ("shared_cache_size", int, m_shared_cache_size);
+    ATTR_DECODE ("remote_cache_serve", int, m_remote_cache_serve);
+    ATTR_DECODE ("auto_lod", int, m_auto_lod);
+    ATTR_DECODE ("auto_lod_min_resolution", int, m_auto_lod_min_resolution);
+    ATTR_DECODE ("remote_cache_serve_threads", int, m_remote_cache_serve_threads);
+    ATTR_DECODE ("watch_files", int, m_watch_files);
+    ATTR_DECODE ("watch_files_interval", float, m_watch_files_interval);
     ATTR_DECODE ("total_files", int, m_files.size());
 
     // The cases that don't fit in the simple ATTR_DECODE scheme
@@ -2142,6 +6194,26 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
         *(ustring *)val = m_plugin_searchpath;
         return true;
     }
+    if (name == "stat:texture_profile" && type == TypeDesc::STRING) {
+        *(ustring *)val = ustring (texture_profile_json ());
+        return true;
+    }
+    if (name == "trace_file" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (m_trace_file).c_str();
+        return true;
+    }
+    if (name == "tile_record_file" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (m_tile_record_file).c_str();
+        return true;
+    }
+    if (name == "stat:trace" && type == TypeDesc::STRING) {
+        *(ustring *)val = ustring (trace_json ());
+        return true;
+    }
+    if (name == "stat:lock_contention" && type == TypeDesc::STRING) {
+        *(ustring *)val = ustring (lock_contention_stats ());
+        return true;
+    }
     if (name == "worldtocommon" && (type == TypeDesc::TypeMatrix ||
                                     type == TypeDesc(TypeDesc::FLOAT,16))) {
         *(Imath::M44f *)val = m_Mw2c;
@@ -2160,6 +6232,35 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
         *(const char **)val = m_substitute_image.c_str();
         return true;
     }
+    if (name == "disk_cache_dir" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (m_disk_cache_dir).c_str();
+        return true;
+    }
+    if (name == "shared_cache_name" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (m_shared_cache_name).c_str();
+        return true;
+    }
+    if (name == "remote_cache" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (m_remote_cache).c_str();
+        return true;
+    }
+    if (name == "remote_cache_serve_address" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (m_remote_cache_serve_address).c_str();
+        return true;
+    }
+    if (name == "watch_files_backend" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (m_filewatcher.backend()).c_str();
+        return true;
+    }
+    if (name == "metadata_index" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (m_metadata_index_file).c_str();
+        return true;
+    }
+    if (name == "eviction_policy" && type == TypeDesc::STRING) {
+        *(const char **)val = ustring (m_eviction_policy == EvictFrequency
+                                       ? "frequency" : "clock").c_str();
+        return true;
+    }
     if (name == "all_filenames" && type.basetype == TypeDesc::STRING &&
             type.is_sized_array()) {
         ustring *names = (ustring *) val;
@@ -2173,6 +6274,9 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
     if (Strutil::starts_with(name, "stat:")) {
         // Stats we can just grab
         ATTR_DECODE ("stat:cache_memory_used", long long, m_mem_used);
+        ATTR_DECODE ("stat:cache_memory_used_coarse", long long, m_mem_used_coarse);
+        ATTR_DECODE ("stat:tile_slab_bytes", long long,
+                     TileAllocator::instance().slab_bytes());
         ATTR_DECODE ("stat:tiles_created", int, m_stat_tiles_created);
         ATTR_DECODE ("stat:tiles_current", int, m_stat_tiles_current);
         ATTR_DECODE ("stat:tiles_peak", int, m_stat_tiles_peak);
@@ -2198,6 +6302,27 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
         ATTR_DECODE ("stat:tile_locking_time", float, stats.tile_locking_time);
         ATTR_DECODE ("stat:find_file_time", float, stats.find_file_time);
         ATTR_DECODE ("stat:find_tile_time", float, stats.find_tile_time);
+        ATTR_DECODE ("stat:prefetch_calls", long long, stats.prefetch_calls);
+        ATTR_DECODE ("stat:prefetch_tiles_queued", long long, stats.prefetch_tiles_queued);
+        ATTR_DECODE ("stat:nonblocking_tiles_queued", long long, stats.nonblocking_tiles_queued);
+        ATTR_DECODE ("stat:approximate_lookups", long long, stats.approximate_lookups);
+        ATTR_DECODE ("stat:untiled_band_hits", long long, stats.untiled_band_hits);
+        ATTR_DECODE ("stat:disk_cache_hits", long long, stats.disk_cache_hits);
+        ATTR_DECODE ("stat:disk_cache_misses", long long, stats.disk_cache_misses);
+        ATTR_DECODE ("stat:shared_cache_hits", long long, stats.shared_cache_hits);
+        ATTR_DECODE ("stat:shared_cache_misses", long long, stats.shared_cache_misses);
+        ATTR_DECODE ("stat:remote_cache_hits", long long, stats.remote_cache_hits);
+        ATTR_DECODE ("stat:auto_lod_resolution", int, (int)m_auto_lod_resolution);
+        ATTR_DECODE ("stat:remote_cache_misses", long long, stats.remote_cache_misses);
+        ATTR_DECODE ("stat:file_reopens", long long, stats.file_reopens);
+        ATTR_DECODE ("stat:concurrent_tile_reads", long long, stats.concurrent_tile_reads);
+        ATTR_DECODE ("stat:tiles_coalesced", long long, stats.tiles_coalesced);
+        ATTR_DECODE ("stat:procedural_tiles", long long, stats.procedural_tiles);
+        ATTR_DECODE ("stat:files_from_index", long long, stats.files_from_index);
+        ATTR_DECODE ("stat:file_reopen_time", float, stats.file_reopen_time);
+        ATTR_DECODE ("stat:tiles_compressed", long long, stats.tiles_compressed);
+        ATTR_DECODE ("stat:tiles_decompressed", long long, stats.tiles_decompressed);
+        ATTR_DECODE ("stat:decompress_time", float, stats.decompress_time);
     }
 
     return false;
@@ -2206,6 +6331,21 @@ ImageCacheImpl::getattribute (string_view name, TypeDesc type,
 
 
 
+namespace {
+
+// Task for the I/O threads: read one tile a nonblocking lookup missed.
+struct PendingTileTask {
+    PendingTileTask (ImageCacheImpl *ic, const TileID &id)
+        : ic(ic), id(id) { }
+    void operator() () { ic->read_pending_tile (id); }
+    ImageCacheImpl *ic;
+    TileID id;
+};
+
+}
+
+
+
 bool
 ImageCacheImpl::find_tile_main_cache (const TileID &id, ImageCacheTileRef &tile,
                            ImageCachePerThreadInfo *thread_info)
@@ -2214,24 +6354,58 @@ ImageCacheImpl::find_tile_main_cache (const TileID &id, ImageCacheTileRef &tile,
     ImageCacheStatistics &stats (thread_info->m_stats);
 
     ++stats.find_tile_microcache_misses;
+    TileProfileTimer profile (m_texture_profile, id, thread_info);
 
     {
 #if IMAGECACHE_TIME_STATS
-        Timer timer1;
+        FastTimer timer1;
 #endif
+        // First try the lock-free index. Taking our reference to the tile
+        // while still inside the read epoch guarantees it can't be freed
+        // out from under us.
+        thread_info->enter_tileindex (m_tileindex_epoch.fast_value());
+        tile = m_tileindex.find (id);
+        thread_info->exit_tileindex ();
+        if (tile) {
+#if IMAGECACHE_TIME_STATS
+            stats.find_tile_time += timer1();
+#endif
+            profile.lookup ();
+            if (thread_info->nonblocking && ! tile->pixels_ready()) {
+                // Somebody is still reading it, don't wait for them.
+                tile.reset ();
+                thread_info->tile_pending = true;
+                return false;
+            }
+            tile->wait_pixels_ready ();
+            profile.wait ();
+            tile->use ();
+            DASSERT (id == tile->id());
+            return true;
+        }
+
+        // Not in the index, but it may have been added to the cache
+        // proper and not yet to the index, so check there too.
         TileCache::iterator found = m_tilecache.find (id);
 #if IMAGECACHE_TIME_STATS
         stats.find_tile_time += timer1();
 #endif
+        profile.lookup ();
         if (found) {
             tile = (*found).second;
             found.unlock();  // release the lock
+            if (thread_info->nonblocking && ! tile->pixels_ready()) {
+                tile.reset ();
+                thread_info->tile_pending = true;
+                return false;
+            }
             // We found the tile in the cache, but we need to make sure we
             // wait until the pixels are ready to read.  We purposely have
             // released the lock (above) before calling wait_pixels_ready,
             // otherwise we could deadlock if another thread reading the
             // pixels needs to lock the cache because it's doing automip.
             tile->wait_pixels_ready ();
+            profile.wait ();
             tile->use ();
             DASSERT (id == tile->id());
             DASSERT (tile);
@@ -2241,24 +6415,96 @@ ImageCacheImpl::find_tile_main_cache (const TileID &id, ImageCacheTileRef &tile,
 
     // The tile was not found in cache.
 
+    // A nonblocking find hands the read to the I/O threads (only once
+    // per tile, however many lookups want it meanwhile).  With no I/O
+    // threads there's nobody to hand it to, so read it ourselves.
+    if (thread_info->nonblocking && m_io_threads > 0) {
+        if (m_pending_tiles.insert (id, 0)) {
+            m_io_pool->push (PendingTileTask (this, id));
+            ++stats.nonblocking_tiles_queued;
+        }
+        tile.reset ();
+        thread_info->tile_pending = true;
+        return false;
+    }
+
     ++stats.find_tile_cache_misses;
+    TraceScope trace (*this, thread_info, TraceTileMiss, id);
+    LatencyScope latency (m_miss_latency);
+    if (m_tile_record)
+        record_tile (id);
+
+    // Maybe another process on this machine has already read it.  (The
+    // tiles of procedural images are only meaningful to this process.)
+    bool shareable = ! id.file().procedural();
+    if (m_sharedcache.enabled() && shareable) {
+        FastTimer timer;
+        tile = m_sharedcache.load (id);
+        if (tile) {
+            ++stats.shared_cache_hits;
+            stats.fileio_time += timer();
+            add_tile_to_cache (tile, thread_info);
+            profile.decode ();
+            DASSERT (id == tile->id());
+            return tile->valid();
+        }
+        ++stats.shared_cache_misses;
+    }
+
+    // Maybe it's been spilled to the disk cache, where the pixels are
+    // already decoded and just need copying back into memory.
+    if (m_diskcache.enabled()) {
+        FastTimer timer;
+        tile = m_diskcache.load (id);
+        if (tile) {
+            ++stats.disk_cache_hits;
+            stats.fileio_time += timer();
+            add_tile_to_cache (tile, thread_info);
+            profile.decode ();
+            DASSERT (id == tile->id());
+            return tile->valid();
+        }
+        ++stats.disk_cache_misses;
+    }
+
+    // Maybe the tile server has it, which is much kinder to the file
+    // server than every render node reading it for itself.
+    if (m_remotecache.enabled() && shareable && ! thread_info->serving_remote) {
+        FastTimer timer;
+        tile = m_remotecache.load (id);
+        if (tile) {
+            ++stats.remote_cache_hits;
+            stats.fileio_time += timer();
+            add_tile_to_cache (tile, thread_info);
+            profile.decode ();
+            DASSERT (id == tile->id());
+            if (m_sharedcache.enabled() && tile->valid())
+                m_sharedcache.store (*tile);
+            return tile->valid();
+        }
+        ++stats.remote_cache_misses;
+    }
 
     // Yes, we're creating and reading a tile with no lock -- this is to
     // prevent all the other threads from blocking because of our
     // expensive disk read.  We believe this is safe, since underneath
     // the ImageCacheFile will lock itself for the read_tile and there are
     // no other non-threadsafe side effects.
-    Timer timer;
+    FastTimer timer;
     tile = new ImageCacheTile (id, thread_info, m_read_before_insert);
     // N.B. the ImageCacheTile ctr starts the tile out as 'used'
     DASSERT (tile);
     DASSERT (id == tile->id());
     double readtime = timer();
     stats.fileio_time += readtime;
-    id.file().iotime() += readtime;
+    thread_info->count_iotime (&id.file(), readtime);
 
     add_tile_to_cache (tile, thread_info);
+    profile.decode ();
     DASSERT (id == tile->id());
+    if (m_sharedcache.enabled() && shareable && tile->valid() &&
+          tile->memsize() && ! tile->compressed())
+        m_sharedcache.store (*tile);   // (not worth it for shared pixels)
     return tile->valid();
 }
 
@@ -2282,7 +6528,11 @@ ImageCacheImpl::add_tile_to_cache (ImageCacheTileRef &tile,
             // Still not in cache, add ours to the cache.
             // N.B. at this time, we do not hold any locks.
             check_max_mem (thread_info);
-            m_tilecache.insert (tile->id(), tile);
+            spin_lock lock (m_tileindex.write_mutex (tile->id()));
+            if (m_tilecache.insert (tile->id(), tile)) {
+                m_tileindex.insert (tile.get());
+                tile->id().file().tile_resident (tile->id());
+            }
         }
     }
 
@@ -2293,11 +6543,11 @@ ImageCacheImpl::add_tile_to_cache (ImageCacheTileRef &tile,
     // to read the pixels.
     if (ourtile) {
         if (! tile->pixels_ready ()) {
-            Timer timer;
+            FastTimer timer;
             tile->read (thread_info);
             double readtime = timer();
             thread_info->m_stats.fileio_time += readtime;
-            tile->id().file().iotime() += readtime;
+            thread_info->count_iotime (&tile->id().file(), readtime);
         }
     } else {
         tile->wait_pixels_ready ();
@@ -2319,8 +6569,11 @@ ImageCacheImpl::check_max_mem (ImageCachePerThreadInfo *thread_info)
     if (m_tilecache.empty())
         return;
     // Early out if we aren't exceeding the tile memory limit
-    if (m_mem_used < (long long)m_max_memory_bytes)
+    if (m_mem_used < (long long)m_max_memory_bytes) {
+        if (m_auto_lod_resolution)
+            update_auto_lod (0);
         return;
+    }
 
     // Try to grab the tile_sweep_mutex lock. If somebody else holds it,
     // just return -- leave the memory limit enforcement to whomever is
@@ -2328,8 +6581,10 @@ ImageCacheImpl::check_max_mem (ImageCachePerThreadInfo *thread_info)
     // once.  If this means we may ephemerally be over the memory limit
     // (because another thread adds a tile before we have freed enough
     // here), so be it.
-    if (! m_tile_sweep_mutex.try_lock())
+    if (! counted_try_lock (m_tile_sweep_mutex, lock_stats (LockTileSweep)))
         return;
+    TraceScope trace (*this, thread_info, TraceTileSweep);
+    long long mem_before = m_mem_used;
 
     // Now, what we want to do is have a "clock hand" that sweeps across
     // the cache, releasing tiles that haven't been used for a long
@@ -2369,20 +6624,32 @@ ImageCacheImpl::check_max_mem (ImageCachePerThreadInfo *thread_info)
             break;
         DASSERT (sweep->second);
 
-        if (! sweep->second->release ()) {
+        if (! keep_tile (sweep->second.get())) {
             // This is a tile we should delete.  To keep iterating
             // safely, we have a good trick:
             // 1. remember the TileID of the tile to delete
             TileID todelete = sweep->first;
             size_t size = sweep->second->memsize();
             ASSERT (m_mem_used >= (long long)size);
+            // (If there's a disk cache, hang on to the tile so we can
+            // spill its pixels there.)
+            ImageCacheTileRef victim;
+            if (m_diskcache.enabled() && size &&   // not shared pixels
+                  ! sweep->second->compressed())
+                victim = sweep->second;
             // 2. Increment the iterator to the next item to be visited
             // in the cache and then unlock it (since it can't be locked
             // for the subsequent erase() call).
             ++sweep;
             sweep.unlock ();
-            // 3. Erase the tile we wish to delete
-            m_tilecache.erase (todelete);
+            // 3. Erase the tile we wish to delete, and free the memory
+            // right away if no reader is in the lock-free index.
+            erase_tile (todelete);
+            reclaim_tileindex_nodes ();
+            if (victim) {
+                m_diskcache.store (*victim);
+                victim.reset ();
+            }
                 // std::cerr << "  Freed tile, recovering " << size << "\n";
             // 4. Re-lock the iterator, which now points to the next
             // item the from the cache to examine.
@@ -2392,17 +6659,276 @@ ImageCacheImpl::check_max_mem (ImageCachePerThreadInfo *thread_info)
         }
     }
 
-    // OK, by this point we have either freed enough tiles to be below
-    // the limit again, or the cache is empty, or we've looped over the
-    // cache too many times and are giving up.
+    // OK, by this point we have either freed enough tiles to be below
+    // the limit again, or the cache is empty, or we've looped over the
+    // cache too many times and are giving up.
+
+    // Now we must save the tileid for next time.  Just set it to an
+    // empty ID if we don't have a valid iterator at this point.
+    m_tile_sweep_id = (sweep == end ? TileID() : sweep->first);
+    m_tile_sweep_mutex.unlock ();
+    if (m_auto_lod)
+        update_auto_lod (std::max (mem_before - (long long)m_mem_used, 0LL));
+
+    // N.B. As we exit, the iterators will go out of scope and we will
+    // retain no locks on the cache.
+}
+
+
+
+// Length of the windows over which "auto_lod" measures how hard the
+// cache is thrashing.
+static const double auto_lod_window = 1.0;
+
+
+
+void
+ImageCacheImpl::update_auto_lod (long long evicted)
+{
+    if (evicted)
+        m_auto_lod_evicted += evicted;
+    if (m_auto_lod_timer() - m_auto_lod_window_start < auto_lod_window ||
+          ! m_auto_lod_mutex.try_lock())
+        return;
+    double now = m_auto_lod_timer();
+    if (now - m_auto_lod_window_start >= auto_lod_window) {
+        // Evicting half the cache's worth of tiles within one window
+        // means the working set doesn't fit.  Halve the resolution cap
+        // (starting from half the largest texture), which for a big
+        // texture cuts its footprint by 4x.  Once evictions are rare
+        // again, double it, until it no longer limits anything.
+        double turnover = double (m_auto_lod_evicted)
+                        / std::max (double (m_max_memory_bytes), 1.0);
+        m_auto_lod_evicted = 0;
+        m_auto_lod_window_start = now;
+        int cap = m_auto_lod_resolution;
+        if (turnover >= 0.5 && m_auto_lod) {
+            int newcap = cap ? cap / 2
+                             : pow2roundup (largest_resolution_in_use()) / 2;
+            newcap = std::max (newcap, m_auto_lod_min_resolution);
+            if (! cap || newcap < cap)
+                m_auto_lod_resolution = newcap;
+        } else if (cap && (turnover < 0.05 || ! m_auto_lod)) {
+            cap *= 2;
+            if (cap >= largest_resolution_in_use() || ! m_auto_lod)
+                cap = 0;
+            m_auto_lod_resolution = cap;
+        }
+    }
+    m_auto_lod_mutex.unlock ();
+}
+
+
+
+int
+ImageCacheImpl::largest_resolution_in_use ()
+{
+    int res = 0;
+    for (FilenameMap::iterator f = m_files.begin(); f != m_files.end(); ++f) {
+        const ImageCacheFileRef &file (f->second);
+        if (file->broken() || ! file->validspec() || ! file->mem_used())
+            continue;
+        for (int s = 0;  s < file->subimages();  ++s) {
+            const ImageSpec &spec (file->spec (s, 0));
+            res = std::max (res, std::max (spec.width, spec.height));
+        }
+    }
+    return res;
+}
+
+
+
+bool
+ImageCacheImpl::keep_tile (ImageCacheTile *tile)
+{
+    // Files over their quota give up their tiles first, used or not.
+    // Otherwise the file's priority class shifts how many sweeps of
+    // neglect its tiles may survive, on top of the policy's own credit.
+    const ImageCacheFile &file (tile->id().file());
+    if (file.over_quota()) {
+        tile->release ();
+        return false;
+    }
+    int priority = file.priority();
+    if (m_eviction_policy == EvictClock && priority == 0)
+        return tile->release ();
+    int &credit (tile->credit());
+    if (m_eviction_policy == EvictClock) {
+        if (tile->release ()) {
+            if (priority < 0)
+                return false;
+            credit = priority;
+            return true;
+        }
+        if (credit > 0) {
+            --credit;
+            return true;
+        }
+        return false;
+    }
+
+    // EvictFrequency: a tile earns a credit each sweep in which it was
+    // found used (up to a cap), and spends one each sweep in which it was
+    // not; it's evicted only when it is both unused and out of credit.
+    // So a tile touched once (e.g. by a bake pass scanning through) goes
+    // after two sweeps, while the frequently used working set survives
+    // several sweeps of neglect.  Coarse MIP tiles get a higher cap, as
+    // long as they don't hog more than their share of the cache.
+    const int max_credit = 3;
+    const int max_coarse_credit = 8;
+    bool coarse = tile->coarse() &&
+        m_mem_used_coarse.fast_value() < m_max_memory_bytes.fast_value()/8;
+    if (tile->release ()) {
+        int cap = (coarse ? max_coarse_credit : max_credit) + priority;
+        if (credit < cap)
+            ++credit;
+        else if (credit > cap)
+            credit = cap;
+        return true;
+    }
+    if (credit > 0) {
+        --credit;
+        return true;
+    }
+    return false;
+}
+
+
+
+void
+ImageCacheImpl::init_file_watcher ()
+{
+    if (! m_watch_files) {
+        m_filewatcher.stop ();
+        return;
+    }
+    m_filewatcher.start (m_watch_files_interval);
+    m_watch_automip = m_automip;
+    for (FilenameMap::iterator f = m_files.begin(); f != m_files.end(); ++f)
+        if (! f->second->is_udim())
+            m_filewatcher.watch (f->second->filename().string(), f->first);
+}
+
+
+
+void
+ImageCacheImpl::init_disk_cache ()
+{
+    if (m_disk_cache_dir.empty() || m_disk_cache_size <= 0.0f) {
+        m_diskcache.close ();
+        return;
+    }
+    std::string err;
+    imagesize_t bytes = imagesize_t (m_disk_cache_size * 1024.0 * 1024.0);
+    if (! m_diskcache.init (m_disk_cache_dir, bytes, err))
+        error ("%s", err);
+}
+
+
+
+void
+ImageCacheImpl::init_shared_cache ()
+{
+    if (m_shared_cache_name.empty() || m_shared_cache_size <= 0.0f) {
+        m_sharedcache.close ();
+        return;
+    }
+    std::string err;
+    imagesize_t bytes = imagesize_t (m_shared_cache_size * 1024.0 * 1024.0);
+    if (! m_sharedcache.init (m_shared_cache_name, bytes, err))
+        error ("%s", err);
+}
+
+
+
+void
+ImageCacheImpl::init_remote_server ()
+{
+    std::string err;
+    if (! m_remoteserver.start (m_remote_cache_serve_address,
+                                m_remote_cache_serve,
+                                m_remote_cache_serve_threads, err))
+        error ("%s", err);
+}
+
+
+
+void
+ImageCacheImpl::init_metadata_index ()
+{
+    std::string err;
+    if (! m_metadata_index.save (err))
+        error ("%s", err);
+    if (! m_metadata_index.init (m_metadata_index_file, err))
+        error ("%s", err);
+}
+
+
+
+void
+ImageCacheImpl::erase_tile (const TileID &id)
+{
+    TileIndex::Node *node = NULL;
+    {
+        spin_lock lock (m_tileindex.write_mutex (id));
+        m_tilecache.erase (id);
+        node = m_tileindex.unlink (id);
+        id.file().tile_evicted (id);
+    }
+    if (node)
+        retire_tileindex_node (node);
+}
+
 
-    // Now we must save the tileid for next time.  Just set it to an
-    // empty ID if we don't have a valid iterator at this point.
-    m_tile_sweep_id = (sweep == end ? TileID() : sweep->first);
-    m_tile_sweep_mutex.unlock ();
 
-    // N.B. As we exit, the iterators will go out of scope and we will
-    // retain no locks on the cache.
+void
+ImageCacheImpl::retire_tileindex_node (TileIndex::Node *node)
+{
+    // Tag the node with the current epoch, then advance the epoch. Any
+    // reader that could still see the node entered the index no later
+    // than the tagged epoch; readers entering later can't find it.
+    spin_lock lock (m_tileindex_retired_mutex);
+    node->retired_epoch = m_tileindex_epoch.fast_value();
+    ++m_tileindex_epoch;
+    m_tileindex_retired.push_back (node);
+}
+
+
+
+void
+ImageCacheImpl::reclaim_tileindex_nodes (bool force)
+{
+    // Find the oldest epoch that any reader is still inside of.
+    long long minepoch = std::numeric_limits<long long>::max();
+    if (! force) {
+        counted_spin_lock lock (m_perthread_info_mutex,
+                                lock_stats (LockPerthreadInfo));
+        for (size_t i = 0, e = m_all_perthread_info.size();  i < e;  ++i) {
+            if (! m_all_perthread_info[i])
+                continue;
+            long long epoch = m_all_perthread_info[i]->tileindex_epoch.load();
+            if (epoch && epoch < minepoch)
+                minepoch = epoch;
+        }
+    }
+
+    std::vector<TileIndex::Node *> todelete;
+    {
+        spin_lock lock (m_tileindex_retired_mutex);
+        size_t keep = 0;
+        for (size_t i = 0, e = m_tileindex_retired.size();  i < e;  ++i) {
+            TileIndex::Node *node = m_tileindex_retired[i];
+            if (node->retired_epoch < minepoch)
+                todelete.push_back (node);
+            else
+                m_tileindex_retired[keep++] = node;
+        }
+        m_tileindex_retired.resize (keep);
+    }
+    // Delete outside the lock, since dropping the last reference to a
+    // tile calls back into the cache to adjust the memory statistics.
+    for (size_t i = 0, e = todelete.size();  i < e;  ++i)
+        delete todelete[i];
 }
 
 
@@ -2469,6 +6995,7 @@ ImageCacheImpl::get_image_info (ImageCacheFile *file,
     }
     ATTR_DECODE (s_broken, int, file->broken());
     if (Strutil::starts_with (dataname, "stat:")) {
+        merge_file_stats ();
         ATTR_DECODE ("stat:tilesread", long long, file->m_tilesread);
         ATTR_DECODE ("stat:bytesread", long long, file->m_bytesread);
         ATTR_DECODE ("stat:redundant_tiles", long long, file->m_redundant_tiles);
@@ -2476,6 +7003,8 @@ ImageCacheImpl::get_image_info (ImageCacheFile *file,
         ATTR_DECODE ("stat:timesopened", int, file->m_timesopened);
         ATTR_DECODE ("stat:iotime", float, file->m_iotime);
         ATTR_DECODE ("stat:mipused", int, file->m_mipused);
+        ATTR_DECODE ("stat:memory_used", long long, file->m_mem_used);
+        ATTR_DECODE ("stat:tiles_resident", int, file->nresident());
         ATTR_DECODE ("stat:is_duplicate", int, bool(file->duplicate()));
         ATTR_DECODE ("stat:image_size", long long, file->m_total_imagesize);
         ATTR_DECODE ("stat:file_size", long long, file->m_total_imagesize_ondisk);
@@ -2498,6 +7027,18 @@ ImageCacheImpl::get_image_info (ImageCacheFile *file,
     if (file->is_udim()) {
         return false;     // UDIM-like files fail all other queries
     }
+    if (Strutil::starts_with (dataname, "stat:") &&
+          subimage >= 0 && subimage < file->subimages() &&
+          miplevel >= 0 && miplevel < file->miplevels(subimage)) {
+        // Per-level "texture_profile" statistics
+        const ImageCacheFile::LevelProfile &p (file->levelinfo(subimage,miplevel).profile);
+        ATTR_DECODE ("stat:lookups", long long, p.lookups);
+        ATTR_DECODE ("stat:probes", long long, p.probes);
+        ATTR_DECODE ("stat:lookup_ns", long long, ticks_to_ns (p.lookup_ticks));
+        ATTR_DECODE ("stat:wait_ns", long long, ticks_to_ns (p.wait_ticks));
+        ATTR_DECODE ("stat:decode_ns", long long, ticks_to_ns (p.decode_ticks));
+        ATTR_DECODE ("stat:filter_ns", long long, ticks_to_ns (p.filter_ticks));
+    }
     if (dataname == s_subimages && datatype == TypeDesc::TypeInt) {
         *(int *)data = file->subimages();
         return true;
@@ -2614,8 +7155,9 @@ ImageCacheImpl::get_image_info (ImageCacheFile *file,
     }
 
     // general case -- handle anything else that's able to be found by
-    // spec.find_attribute().
-    const ImageIOParameter *p = spec.find_attribute (dataname.string());
+    // spec.find_attribute() in the level's (possibly shared) metadata.
+    const ImageIOParameter *p =
+        file->metadata_spec(subimage,miplevel).find_attribute (dataname.string());
     if (p && p->type().arraylen == datatype.arraylen) {
         // First test for exact type match
         if (p->type() == datatype) {
@@ -2642,13 +7184,13 @@ bool
 ImageCacheImpl::get_imagespec (ustring filename, ImageSpec &spec,
                                int subimage, int miplevel, bool native)
 {
-    const ImageSpec *specptr = imagespec (filename, subimage, miplevel, native);
-    if (specptr) {
-        spec = *specptr;
-        return true;
-    } else {
-        return false;  // imagespec() already handled the errors
+    ImageCachePerThreadInfo *thread_info = get_perthread_info ();
+    ImageCacheFile *file = find_file (filename, thread_info, NULL, true);
+    if (! file) {
+        error ("Image file \"%s\" not found", filename);
+        return false;
     }
+    return get_imagespec (file, thread_info, spec, subimage, miplevel, native);
 }
 
 
@@ -2659,13 +7201,13 @@ ImageCacheImpl::get_imagespec (ImageCacheFile *file,
                                ImageSpec &spec,
                                int subimage, int miplevel, bool native)
 {
-    const ImageSpec *specptr = imagespec (file, thread_info, subimage, miplevel, native);
-    if (specptr) {
-        spec = *specptr;
-        return true;
-    } else {
-        return false;  // imagespec() already handled the errors
-    }
+    // Copy the complete spec directly, rather than through imagespec(),
+    // so that MIP levels sharing their metadata don't keep a full copy.
+    file = verify_imagespec_file (file, thread_info, subimage, miplevel);
+    if (! file)
+        return false;
+    file->get_complete_spec (subimage, miplevel, native, spec);
+    return true;
 }
 
 
@@ -2689,6 +7231,19 @@ const ImageSpec *
 ImageCacheImpl::imagespec (ImageCacheFile *file,
                            ImageCachePerThreadInfo *thread_info,
                            int subimage, int miplevel, bool native)
+{
+    file = verify_imagespec_file (file, thread_info, subimage, miplevel);
+    if (! file)
+        return NULL;
+    return &file->complete_spec (subimage, miplevel, native);
+}
+
+
+
+ImageCacheFile *
+ImageCacheImpl::verify_imagespec_file (ImageCacheFile *file,
+                                       ImageCachePerThreadInfo *thread_info,
+                                       int subimage, int miplevel)
 {
     if (! file) {
         error ("Image file handle was NULL");
@@ -2718,9 +7273,7 @@ ImageCacheImpl::imagespec (ImageCacheFile *file,
                    miplevel, file->miplevels(subimage));
         return NULL;
     }
-    const ImageSpec *spec = native ? &file->nativespec (subimage,miplevel)
-                                   : &file->spec (subimage, miplevel);
-    return spec;
+    return file;
 }
 
 
@@ -2737,6 +7290,82 @@ ImageCacheImpl::subimage_from_name (ImageCacheFile *file, ustring subimagename)
 
 
 
+namespace {
+
+// Failures of the bands of a parallel get_pixels, and the errors they
+// left (in their own threads' error messages).
+struct GetPixelsErrors {
+    GetPixelsErrors () { failures = 0; }
+    atomic_int failures;
+    spin_mutex mutex;
+    std::string message;
+};
+
+
+// Task for a parallel get_pixels: copy one band of tile rows, using the
+// perthread info of whichever thread runs it.
+struct GetPixelsBand {
+    GetPixelsBand (ImageCacheImpl *ic, ImageCacheFile *file,
+                   int subimage, int miplevel, int xbegin, int xend,
+                   int ybegin, int yend, int zbegin, int zend,
+                   int chbegin, int chend, int cache_chbegin, int cache_chend,
+                   TypeDesc format, void *result, stride_t xstride,
+                   stride_t ystride, stride_t zstride, GetPixelsErrors *errors)
+        : ic(ic), file(file), subimage(subimage), miplevel(miplevel),
+          xbegin(xbegin), xend(xend), ybegin(ybegin), yend(yend),
+          zbegin(zbegin), zend(zend), chbegin(chbegin), chend(chend),
+          cache_chbegin(cache_chbegin), cache_chend(cache_chend),
+          format(format), result(result), xstride(xstride),
+          ystride(ystride), zstride(zstride), errors(errors) { }
+    void operator() () {
+        if (ic->get_pixels_serial (file, ic->get_perthread_info (),
+                                   subimage, miplevel, xbegin, xend,
+                                   ybegin, yend, zbegin, zend, chbegin, chend,
+                                   cache_chbegin, cache_chend, format, result,
+                                   xstride, ystride, zstride))
+            return;
+        std::string err = ic->geterror ();
+        spin_lock lock (errors->mutex);
+        ++errors->failures;
+        if (err.size() && errors->message.find (err) == std::string::npos)
+            errors->message += (errors->message.size() ? "\n" : "") + err;
+    }
+    ImageCacheImpl *ic;
+    ImageCacheFile *file;
+    int subimage, miplevel, xbegin, xend, ybegin, yend, zbegin, zend;
+    int chbegin, chend, cache_chbegin, cache_chend;
+    TypeDesc format;
+    void *result;
+    stride_t xstride, ystride, zstride;
+    GetPixelsErrors *errors;
+};
+
+
+// Task for get_tiles: find the tiles of one row.
+struct GetTileRow {
+    GetTileRow (ImageCacheImpl *ic, ImageCacheFile *file,
+                int subimage, int miplevel, int xbegin, int xend,
+                int tile_width, int y, int z, int chbegin, int chend,
+                ImageCache::Tile **tiles)
+        : ic(ic), file(file), subimage(subimage), miplevel(miplevel),
+          xbegin(xbegin), xend(xend), tile_width(tile_width), y(y), z(z),
+          chbegin(chbegin), chend(chend), tiles(tiles) { }
+    void operator() () {
+        ImageCachePerThreadInfo *thread_info = ic->get_perthread_info ();
+        for (int x = xbegin;  x < xend;  x += tile_width)
+            *tiles++ = ic->get_tile (file, thread_info, subimage, miplevel,
+                                     x, y, z, chbegin, chend);
+    }
+    ImageCacheImpl *ic;
+    ImageCacheFile *file;
+    int subimage, miplevel, xbegin, xend, tile_width, y, z, chbegin, chend;
+    ImageCache::Tile **tiles;
+};
+
+}  // end anonymous namespace
+
+
+
 bool
 ImageCacheImpl::get_pixels (ustring filename, int subimage, int miplevel,
                             int xbegin, int xend, int ybegin, int yend,
@@ -2827,7 +7456,6 @@ ImageCacheImpl::get_pixels (ImageCacheFile *file,
     if (! thread_info)
         thread_info = get_perthread_info ();
     const ImageSpec &spec (file->spec(subimage, miplevel));
-    bool ok = true;
 
     // Compute channels and stride if not given (assume all channels,
     // contiguous data layout for strides).
@@ -2838,13 +7466,81 @@ ImageCacheImpl::get_pixels (ImageCacheFile *file,
     int result_nchans = chend - chbegin;
     if (cache_chbegin < 0 || cache_chend < 0 ||
             cache_chbegin > chbegin || cache_chend < chend) {
-        cache_chbegin = 0;
-        cache_chend = spec.nchannels;
+        if (m_cache_channel_subsets) {
+            // Cache (and read from the file) just the channels asked for
+            cache_chbegin = chbegin;
+            cache_chend = chend;
+        } else {
+            cache_chbegin = 0;
+            cache_chend = spec.nchannels;
+        }
     }
-    int cache_nchans = cache_chend - cache_chbegin;
     ImageSpec::auto_stride (xstride, ystride, zstride, format, result_nchans,
                             xend-xbegin, yend-ybegin);
 
+    // A request spanning many tiles is split into bands of whole tile
+    // rows, which the thread pool copies concurrently, so that the tile
+    // misses of the bands are read and decoded at the same time instead
+    // of one after another.
+    int y0 = std::max (ybegin, spec.y);
+    int y1 = std::min (yend, spec.y + spec.height);
+    int x0 = std::max (xbegin, spec.x);
+    int x1 = std::min (xend, spec.x + spec.width);
+    if (m_get_pixels_parallel > 0 && y1 > y0 && x1 > x0) {
+        int th = spec.tile_height, tw = spec.tile_width;
+        int ytfirst = (y0 - spec.y) / th, ytlast = (y1 - 1 - spec.y) / th;
+        int xtfirst = (x0 - spec.x) / tw, xtlast = (x1 - 1 - spec.x) / tw;
+        int ntilerows = ytlast - ytfirst + 1;
+        long long ntiles = (long long) ntilerows * (xtlast - xtfirst + 1)
+                         * std::max (zend - zbegin, 1) / spec.tile_depth;
+        if (ntilerows >= 2 && ntiles >= m_get_pixels_parallel) {
+            GetPixelsErrors errors;
+            task_set tasks;
+            for (int t = ytfirst;  t <= ytlast;  ++t) {
+                // The first and last bands also take the rows (if any)
+                // outside the image.
+                int yb = (t == ytfirst) ? ybegin : spec.y + t * th;
+                int ye = (t == ytlast) ? yend : spec.y + (t+1) * th;
+                tasks.push (GetPixelsBand (this, file, subimage, miplevel,
+                                xbegin, xend, yb, ye, zbegin, zend,
+                                chbegin, chend, cache_chbegin, cache_chend,
+                                format, (char *)result + (yb-ybegin) * ystride,
+                                xstride, ystride, zstride, &errors));
+            }
+            tasks.wait ();
+            if (errors.failures) {
+                if (errors.message.size())
+                    error ("%s", errors.message);
+                return false;
+            }
+            return true;
+        }
+    }
+
+    return get_pixels_serial (file, thread_info, subimage, miplevel,
+                              xbegin, xend, ybegin, yend, zbegin, zend,
+                              chbegin, chend, cache_chbegin, cache_chend,
+                              format, result, xstride, ystride, zstride);
+}
+
+
+
+bool
+ImageCacheImpl::get_pixels_serial (ImageCacheFile *file,
+                                   ImageCachePerThreadInfo *thread_info,
+                                   int subimage, int miplevel,
+                                   int xbegin, int xend, int ybegin, int yend,
+                                   int zbegin, int zend, int chbegin, int chend,
+                                   int cache_chbegin, int cache_chend,
+                                   TypeDesc format, void *result,
+                                   stride_t xstride, stride_t ystride,
+                                   stride_t zstride)
+{
+    const ImageSpec &spec (file->spec(subimage, miplevel));
+    bool ok = true;
+    int result_nchans = chend - chbegin;
+    int cache_nchans = cache_chend - cache_chbegin;
+
     // result_pixelsize, scanlinesize, and zplanesize assume contiguous
     // layout.  This may or may not be the same as the strides passed by
     // the caller.
@@ -2995,6 +7691,83 @@ ImageCacheImpl::get_tile (ImageHandle *file, Perthread *thread_info,
 
 
 
+bool
+ImageCacheImpl::get_tiles (ustring filename, int subimage, int miplevel,
+                           const ROI &roi, std::vector<Tile *> &tiles)
+{
+    ImageCachePerThreadInfo *thread_info = get_perthread_info ();
+    ImageCacheFile *file = find_file (filename, thread_info);
+    return get_tiles (file, thread_info, subimage, miplevel, roi, tiles);
+}
+
+
+
+bool
+ImageCacheImpl::get_tiles (ImageHandle *file, Perthread *thread_info,
+                           int subimage, int miplevel,
+                           const ROI &roi, std::vector<Tile *> &tiles)
+{
+    tiles.clear ();
+    if (! thread_info)
+        thread_info = get_perthread_info ();
+    file = verify_file (file, thread_info);
+    if (! file || file->broken() || file->is_udim())
+        return false;
+    if (subimage < 0 || subimage >= file->subimages() ||
+        miplevel < 0 || miplevel >= file->miplevels(subimage))
+        return false;
+
+    const ImageSpec &spec (file->spec(subimage,miplevel));
+    ROI r = get_roi (spec);
+    r.chbegin = 0;
+    r.chend = spec.nchannels;
+    if (roi.defined())
+        r = roi_intersection (r, roi);
+    if (r.npixels() == 0 || r.chend <= r.chbegin)
+        return true;
+
+    // Snap the region to the tile grid
+    int tw = spec.tile_width, th = spec.tile_height, td = spec.tile_depth;
+    int xtbegin = spec.x + (r.xbegin-spec.x) / tw * tw;
+    int ytbegin = spec.y + (r.ybegin-spec.y) / th * th;
+    int ztbegin = spec.z + (r.zbegin-spec.z) / td * td;
+    int nx = (r.xend - xtbegin + tw - 1) / tw;
+    int ny = (r.yend - ytbegin + th - 1) / th;
+    int nz = (r.zend - ztbegin + td - 1) / td;
+    tiles.resize (size_t(nx) * ny * nz, NULL);
+
+    // Find the rows of tiles on the thread pool if there are enough of
+    // them, so that the misses are all read concurrently.
+    bool parallel = (m_get_pixels_parallel > 0 && ny * nz >= 2 &&
+                     (long long) tiles.size() >= m_get_pixels_parallel);
+    task_set tasks;
+    Tile **row = &tiles[0];
+    for (int z = ztbegin;  z < r.zend;  z += td) {
+        for (int y = ytbegin;  y < r.yend;  y += th, row += nx) {
+            GetTileRow task (this, file, subimage, miplevel, xtbegin, r.xend,
+                             tw, y, z, r.chbegin, r.chend, row);
+            if (parallel)
+                tasks.push (task);
+            else
+                task ();
+        }
+    }
+    tasks.wait ();
+
+    for (size_t i = 0;  i < tiles.size();  ++i) {
+        if (! tiles[i]) {
+            for (size_t j = 0;  j < tiles.size();  ++j)
+                if (tiles[j])
+                    release_tile (tiles[j]);
+            tiles.clear ();
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
 void
 ImageCacheImpl::release_tile (ImageCache::Tile *tile) const
 {
@@ -3008,6 +7781,182 @@ ImageCacheImpl::release_tile (ImageCache::Tile *tile) const
 
 
 
+namespace {
+
+// Task for preload_files: open one file and store its handle.
+struct PreloadFileTask {
+    PreloadFileTask (ImageCacheImpl *ic, ustring filename,
+                     ImageCache::ImageHandle **handle)
+        : ic(ic), filename(filename), handle(handle) { }
+    void operator() () {
+        *handle = ic->get_image_handle (filename, ic->get_perthread_info());
+    }
+    ImageCacheImpl *ic;
+    ustring filename;
+    ImageCache::ImageHandle **handle;
+};
+
+}
+
+
+
+std::vector<ImageCache::ImageHandle *>
+ImageCacheImpl::preload_files (array_view<const ustring> filenames,
+                               int nthreads)
+{
+    std::vector<ImageHandle *> handles (filenames.size(), NULL);
+    if (handles.empty())
+        return handles;
+    // The waiting thread runs tasks too, so a private pool only needs
+    // nthreads-1 workers of its own.
+    boost::scoped_ptr<thread_pool> pool;
+    if (nthreads > 0)
+        pool.reset (new thread_pool (nthreads - 1));
+    task_set tasks (pool.get());
+    for (size_t i = 0, e = filenames.size();  i < e;  ++i)
+        tasks.push (PreloadFileTask (this, filenames[i], &handles[i]));
+    tasks.wait ();
+    return handles;
+}
+
+
+
+bool
+ImageCacheImpl::prefetch_tiles (ustring filename, int subimage, int miplevel,
+                                const ROI &roi)
+{
+    ImageCachePerThreadInfo *thread_info = get_perthread_info ();
+    ImageCacheFile *file = find_file (filename, thread_info);
+    return prefetch_tiles (file, thread_info, subimage, miplevel, roi);
+}
+
+
+
+bool
+ImageCacheImpl::set_file_priority (ustring filename, int priority,
+                                   imagesize_t quota)
+{
+    ImageCachePerThreadInfo *thread_info = get_perthread_info ();
+    ImageCacheFile *file = find_file (filename, thread_info);
+    return set_file_priority (file, priority, quota);
+}
+
+
+
+bool
+ImageCacheImpl::set_file_priority (ImageHandle *file, int priority,
+                                   imagesize_t quota)
+{
+    file = verify_file (file, get_perthread_info ());
+    if (! file || file->broken())
+        return false;
+    file->m_priority = clamp (priority, -max_file_priority, max_file_priority);
+    file->m_quota = quota;
+    return true;
+}
+
+
+
+bool
+ImageCacheImpl::prefetch_tiles (ImageHandle *file, Perthread *thread_info,
+                                int subimage, int miplevel, const ROI &roi)
+{
+    if (! thread_info)
+        thread_info = get_perthread_info ();
+    file = verify_file (file, thread_info);
+    if (! file || file->broken() || file->is_udim())
+        return false;
+    if (subimage < 0 || subimage >= file->subimages() ||
+        miplevel < 0 || miplevel >= file->miplevels(subimage))
+        return false;
+    ++thread_info->m_stats.prefetch_calls;
+    if (m_io_threads < 1)
+        return true;   // Prefetching is disabled
+
+    const ImageSpec &spec (file->spec(subimage,miplevel));
+    ROI r = get_roi (spec);
+    r.chbegin = 0;
+    r.chend = spec.nchannels;
+    if (roi.defined())
+        r = roi_intersection (r, roi);
+    if (r.npixels() == 0 || r.chend <= r.chbegin)
+        return true;
+    // Queue the tiles that lookups will later ask for: those hold all the
+    // channels, unless get_pixels caches just the channels requested.
+    if (! m_cache_channel_subsets) {
+        r.chbegin = 0;
+        r.chend = spec.nchannels;
+    }
+
+    // Snap the region to the tile grid and queue every tile in it that
+    // isn't already cached (or queued).  All of them are registered as
+    // pending before any is queued, so that the I/O thread reading the
+    // first tile of a row can read its waiting neighbors in the same call.
+    int xtbegin = spec.x + (r.xbegin-spec.x) / spec.tile_width * spec.tile_width;
+    int ytbegin = spec.y + (r.ybegin-spec.y) / spec.tile_height * spec.tile_height;
+    int ztbegin = spec.z + (r.zbegin-spec.z) / spec.tile_depth * spec.tile_depth;
+    std::vector<TileID> queue;
+    for (int z = ztbegin;  z < r.zend;  z += spec.tile_depth) {
+        for (int y = ytbegin;  y < r.yend;  y += spec.tile_height) {
+            for (int x = xtbegin;  x < r.xend;  x += spec.tile_width) {
+                TileID id (*file, subimage, miplevel, x, y, z,
+                           r.chbegin, r.chend);
+                thread_info->enter_tileindex (m_tileindex_epoch.fast_value());
+                bool cached = (m_tileindex.find (id) != NULL);
+                thread_info->exit_tileindex ();
+                if (! cached && m_pending_tiles.insert (id, 0))
+                    queue.push_back (id);
+            }
+        }
+    }
+    for (size_t i = 0, e = queue.size();  i < e;  ++i)
+        m_io_pool->push (PrefetchTileTask (this, queue[i]));
+    thread_info->m_stats.prefetch_tiles_queued += queue.size();
+    return true;
+}
+
+
+
+void
+ImageCacheImpl::prefetch_tile (const TileID &id)
+{
+    ImageCachePerThreadInfo *thread_info = get_perthread_info ();
+    // find_tile pages the tile in if it's not already resident (another
+    // thread may have needed it before we got to it).
+    find_tile (id, thread_info);
+    m_pending_tiles.erase (id);
+}
+
+
+
+bool
+ImageCacheImpl::tile_awaiting_read (const TileID &id,
+                                    ImageCachePerThreadInfo *thread_info)
+{
+    int dummy;
+    if (m_pending_tiles.retrieve (id, dummy))
+        return true;
+    thread_info->enter_tileindex (m_tileindex_epoch.fast_value());
+    const ImageCacheTile *tile = m_tileindex.find (id);
+    bool waiting = (tile && ! tile->pixels_ready());
+    thread_info->exit_tileindex ();
+    return waiting;
+}
+
+
+
+void
+ImageCacheImpl::read_pending_tile (const TileID &id)
+{
+    ImageCachePerThreadInfo *thread_info = get_perthread_info ();
+    find_tile (id, thread_info);
+    // Only now that it's in the cache may another nonblocking miss on
+    // it queue it again (e.g., if it's been evicted since).
+    m_pending_tiles.erase (id);
+}
+
+
+
 TypeDesc
 ImageCacheImpl::tile_format (const Tile *tile) const
 {
@@ -3058,6 +8007,25 @@ ImageCacheImpl::add_file (ustring filename, ImageInput::Creator creator,
 
 
 
+bool
+ImageCacheImpl::add_procedural_file (ustring filename,
+                                     TileProvider *provider)
+{
+    if (! provider) {
+        error ("add_procedural_file needs a TileProvider");
+        return false;
+    }
+    ImageCachePerThreadInfo *thread_info = get_perthread_info ();
+    ImageCacheFile *file = find_file (filename, thread_info, NULL,
+                                      false, NULL, provider);
+    file = verify_file (file, thread_info);
+    if (!file || file->broken() || file->is_udim())
+        return false;
+    return true;
+}
+
+
+
 bool
 ImageCacheImpl::add_tile (ustring filename, int subimage, int miplevel,
                           int x, int y, int z, int chbegin, int chend,
@@ -3104,20 +8072,18 @@ ImageCacheImpl::invalidate (ustring filename)
             return;  // no such file
     }
 
-    // Iterate over the entire tilecache, record the TileID's of all
-    // tiles that are from the file we are invalidating.
+    // Record the TileID's of all the file's tiles in the cache.
     std::vector<TileID> tiles_to_delete;
-    for (TileCache::iterator tci = m_tilecache.begin(), e = m_tilecache.end();
-             tci != e;  ++tci) {
-        if (&(*tci).second->file() == file)
-            tiles_to_delete.push_back ((*tci).second->id());
-    }
+    file->resident_tiles (tiles_to_delete);
     // N.B. at this point, we hold no locks!
 
     // Safely erase all the tiles we found
     BOOST_FOREACH (const TileID &id, tiles_to_delete) {
-        m_tilecache.erase (id);
+        erase_tile (id);
     }
+    reclaim_tileindex_nodes ();
+
+    m_diskcache.invalidate (file);
 
     // Invalidate the file itself (close it and clear its spec)
     file->invalidate ();
@@ -3148,8 +8114,10 @@ ImageCacheImpl::invalidate_all (bool force)
             tiles_to_delete.push_back (t->second->id());
         }
         BOOST_FOREACH (const TileID &id, tiles_to_delete) {
-            m_tilecache.erase (id);
+            erase_tile (id);
         }
+        reclaim_tileindex_nodes ();
+        m_diskcache.invalidate (NULL);
         // Invalidate (close and clear spec) all individual files
         for (FilenameMap::iterator fileit = m_files.begin(), e = m_files.end();
                  fileit != e;  ++fileit) {
@@ -3165,13 +8133,31 @@ ImageCacheImpl::invalidate_all (bool force)
     // Not forced... we need to look for particular files that seem
     // to need invalidation.
 
-    // Make a list of all files that need to be invalidated
+    // If we're watching the files, only the ones the watcher saw change
+    // need it -- unless it lost track, or automip was switched, which
+    // calls for checking everything.
     std::vector<ustring> all_files;
+    bool automip_changed = (m_automip != m_watch_automip);
+    m_watch_automip = m_automip;
+    if (m_filewatcher.active() &&
+            m_filewatcher.changed (all_files) && ! automip_changed) {
+        std::sort (all_files.begin(), all_files.end());
+        all_files.erase (std::unique (all_files.begin(), all_files.end()),
+                         all_files.end());
+        BOOST_FOREACH (ustring f, all_files)
+            invalidate (f);
+        purge_perthread_microcaches ();
+        return;
+    }
+    all_files.clear ();
+
+    // Make a list of all files that need to be invalidated
     for (FilenameMap::iterator fileit = m_files.begin(), e = m_files.end();
              fileit != e;  ++fileit) {
         ImageCacheFileRef &f (fileit->second);
         ustring name = f->filename();
-        recursive_lock_guard guard (f->m_input_mutex);
+        counted_recursive_lock guard (f->m_input_mutex,
+                                      lock_stats (LockFileInput));
         // If the file was broken when we opened it, or if it no longer
         // exists, definitely invalidate it.
         if (f->broken() || ! Filesystem::exists(name.string())) {
@@ -3212,8 +8198,10 @@ ImageCacheImpl::invalidate_all (bool force)
 
 
 namespace {
-// Mutex to protect all the UDIM table access.
-static mutex_pool<spin_rw_mutex,ustring,ustringHash,8> udim_lookup_mutex_pool;
+// Mutex to protect all the UDIM table access.  The tables are read by
+// every lookup outside the page table and written only the first time
+// each tile is seen, so use big-reader locks.
+static mutex_pool<spin_brw_mutex,ustring,ustringHash,8> udim_lookup_mutex_pool;
 // static spin_rw_mutex udim_lookup_mutex;
 }
 
@@ -3228,16 +8216,27 @@ ImageCacheImpl::resolve_udim (ImageCacheFile *udimfile, float &s, float &t)
     s = s - utile;
     t = t - vtile;
 
+    // Fast path: once a tile in the usual UDIM range is resolved, its
+    // file is found in the page table with no locking, hashing, or
+    // string work.  The (never freed) ImageCacheFile pointer is stored
+    // as an integer so it can be read atomically.
+    int page = (utile < 10) ? utile + 10*vtile : ImageCacheFile::udim_pages;
+    if (page < ImageCacheFile::udim_pages) {
+        long long p = udimfile->m_udim_pages[page];
+        if (p)
+            return (ImageCacheFile *)(intptr_t)p;
+    }
+
     // Synthesized a single combined ID that we'll use as an index.
     uint64_t id = (uint64_t(vtile) << 32) + uint64_t(utile);
 
     // Which is our mutex from the pool? Use a hash baseed on the filename.
-    spin_rw_mutex &udim_lookup_mutex (udim_lookup_mutex_pool[udimfile->filename()]);
+    spin_brw_mutex &udim_lookup_mutex (udim_lookup_mutex_pool[udimfile->filename()]);
 
     // First, try a read lock and see if we already have an entry
     ImageCacheFile *realfile = NULL;
     {
-        spin_rw_mutex::read_lock_guard rlock (udim_lookup_mutex);
+        spin_brw_read_lock rlock (udim_lookup_mutex);
         UdimLookupMap::iterator f = udimfile->m_udim_lookup.find (id);
         if (f != udimfile->m_udim_lookup.end())
             realfile = f->second;
@@ -3264,7 +8263,7 @@ ImageCacheImpl::resolve_udim (ImageCacheFile *udimfile, float &s, float &t)
         // Now grab the actual write lock, and double check that it hasn't
         // been added by another thread during the brief time when we
         // weren't holding any lock.
-        spin_rw_mutex::write_lock_guard rlock (udim_lookup_mutex);
+        spin_brw_write_lock rlock (udim_lookup_mutex);
         UdimLookupMap::iterator f = udimfile->m_udim_lookup.find (id);
         if (f == udimfile->m_udim_lookup.end()) {
             // Not yet in the lookup table, so create one so we don't have
@@ -3272,6 +8271,8 @@ ImageCacheImpl::resolve_udim (ImageCacheFile *udimfile, float &s, float &t)
             udimfile->m_udim_lookup[id] = realfile;
             // std::cout << "Associate " << id << " with " << (void*)realfile << "\n";
         }
+        if (realfile && page < ImageCacheFile::udim_pages)
+            udimfile->m_udim_pages[page] = (long long)(intptr_t)realfile;
     }
     return realfile;
 }
@@ -3283,8 +8284,10 @@ ImageCacheImpl::create_thread_info ()
 {
     ImageCachePerThreadInfo *p = new ImageCachePerThreadInfo;
     // printf ("New perthread %p\n", (void *)p);
-    spin_lock lock (m_perthread_info_mutex);
+    counted_spin_lock lock (m_perthread_info_mutex,
+                            lock_stats (LockPerthreadInfo));
     m_all_perthread_info.push_back (p);
+    p->trace_tid = (int) m_all_perthread_info.size();
     p->shared = true;  // both the IC and the caller point to it
     return p;
 }
@@ -3296,7 +8299,8 @@ ImageCacheImpl::destroy_thread_info (ImageCachePerThreadInfo *thread_info)
 {
     if (! thread_info)
         return;
-    spin_lock lock (m_perthread_info_mutex);
+    counted_spin_lock lock (m_perthread_info_mutex,
+                            lock_stats (LockPerthreadInfo));
     for (size_t i = 0;  i < m_all_perthread_info.size();  ++i) {
         if (m_all_perthread_info[i] == thread_info) {
             m_all_perthread_info[i] = NULL;
@@ -3314,23 +8318,22 @@ ImageCacheImpl::get_perthread_info (ImageCachePerThreadInfo *p)
     if (!p)
         p = m_perthread_info.get();
     if (! p) {
-        p = new ImageCachePerThreadInfo;
+        p = new ImageCachePerThreadInfo (m_microcache_size);
         m_perthread_info.reset (p);
         // printf ("New perthread %p\n", (void *)p);
-        spin_lock lock (m_perthread_info_mutex);
+        counted_spin_lock lock (m_perthread_info_mutex,
+                                lock_stats (LockPerthreadInfo));
         m_all_perthread_info.push_back (p);
+        p->trace_tid = (int) m_all_perthread_info.size();
         p->shared = true;  // both the IC and the thread point to it
     }
     if (p->purge) {  // has somebody requested a tile purge?
         // This is safe, because it's our thread.
-        spin_lock lock (m_perthread_info_mutex);
-        p->tile = NULL;
-        p->lasttile = NULL;
+        counted_spin_lock lock (m_perthread_info_mutex,
+                                lock_stats (LockPerthreadInfo));
+        p->set_microcache_size (m_microcache_size);
         p->purge = 0;
-        for (int i = 0;  i < ImageCachePerThreadInfo::nlastfile;  ++i) {
-            p->last_filename[i] = ustring();
-            p->last_file[i] = NULL;
-        }
+        p->clear_filecache ();
     }
     return p;
 }
@@ -3340,13 +8343,13 @@ ImageCacheImpl::get_perthread_info (ImageCachePerThreadInfo *p)
 void
 ImageCacheImpl::erase_perthread_info ()
 {
-    spin_lock lock (m_perthread_info_mutex);
+    counted_spin_lock lock (m_perthread_info_mutex,
+                            lock_stats (LockPerthreadInfo));
     for (size_t i = 0;  i < m_all_perthread_info.size();  ++i) {
         ImageCachePerThreadInfo *p = m_all_perthread_info[i];
         if (p) {
             // Clear the microcache.
-            p->tile = NULL;
-            p->lasttile = NULL;
+            p->clear_microcache ();
             if (p->shared) {
                 // Pointed to by both thread-specific-ptr and our list.
                 // Just remove from out list, then ownership is only
@@ -3369,8 +8372,7 @@ ImageCacheImpl::cleanup_perthread_info (ImageCachePerThreadInfo *p)
     spin_lock lock (m_perthread_info_mutex);
     if (p) {
         // Clear the microcache.
-        p->tile = NULL;
-        p->lasttile = NULL;
+        p->clear_microcache ();
         if (! p->shared)  // If we own it, delete it
             delete p;
         else
@@ -3384,7 +8386,8 @@ void
 ImageCacheImpl::purge_perthread_microcaches ()
 {
     // Mark the per-thread microcaches as invalid
-    spin_lock lock (m_perthread_info_mutex);
+    counted_spin_lock lock (m_perthread_info_mutex,
+                            lock_stats (LockPerthreadInfo));
     for (size_t i = 0, e = m_all_perthread_info.size();  i < e;  ++i)
         if (m_all_perthread_info[i])
             m_all_perthread_info[i]->purge = 1;
@@ -3484,4 +8487,153 @@ ImageCache::destroy (ImageCache *x)
     destroy (x, false);
 }
 
+
+
+namespace {
+
+// Write one Prometheus sample, preceded by its HELP and TYPE lines if
+// help isn't empty.
+template<typename T>
+void
+prometheus_sample (std::ostream &out, string_view prefix, string_view name,
+                   string_view type, string_view help, T value,
+                   string_view labels = string_view())
+{
+    if (help.size())
+        out << "# HELP " << prefix << "_" << name << " " << help << "\n"
+            << "# TYPE " << prefix << "_" << name << " " << type << "\n";
+    out << prefix << "_" << name << labels << " " << value << "\n";
+}
+
+
+
+// Write a LatencyHistogram as a Prometheus histogram, with one bucket per
+// doubling so that a scrape stays a reasonable size.
+void
+prometheus_histogram (std::ostream &out, string_view prefix,
+                      string_view name, string_view help,
+                      const ImageCache::LatencyHistogram &hist)
+{
+    const int perdoubling = pvt::LatencyRecorder::BucketsPerDoubling;
+    out << "# HELP " << prefix << "_" << name << " " << help << "\n"
+        << "# TYPE " << prefix << "_" << name << " histogram\n";
+    long long n = 0;
+    for (size_t b = 0;  b+1 < hist.counts.size();  ++b) {
+        n += hist.counts[b];
+        if ((b+1) % perdoubling == 0)
+            out << prefix << "_" << name << "_bucket{le=\""
+                << hist.upper[b] << "\"} " << n << "\n";
+    }
+    out << prefix << "_" << name << "_bucket{le=\"+Inf\"} " << hist.count << "\n"
+        << prefix << "_" << name << "_sum " << hist.sum << "\n"
+        << prefix << "_" << name << "_count " << hist.count << "\n";
+}
+
+
+
+// Write one StatsD gauge.
+template<typename T>
+void
+statsd_gauge (std::ostream &out, string_view prefix, string_view name,
+              T value)
+{
+    out << prefix << "." << name << ":" << value << "|g\n";
+}
+
+
+
+void
+statsd_histogram (std::ostream &out, string_view prefix, string_view name,
+                  const ImageCache::LatencyHistogram &hist)
+{
+    std::string n (name);
+    statsd_gauge (out, prefix, n+".count", hist.count);
+    statsd_gauge (out, prefix, n+".p50", hist.percentile (0.5));
+    statsd_gauge (out, prefix, n+".p90", hist.percentile (0.9));
+    statsd_gauge (out, prefix, n+".p99", hist.percentile (0.99));
+    statsd_gauge (out, prefix, n+".max", hist.max);
+}
+
+} // end anonymous namespace
+
+
+
+std::string
+ImageCache::format_metrics (const Metrics &m, string_view format,
+                            string_view prefix)
+{
+    std::ostringstream out;
+    out.imbue (std::locale::classic());  // Force "C" locale with '.' decimal
+    out.precision (9);
+    double hitratio = m.tile_lookups
+                    ? 1.0 - double(m.tile_misses) / double(m.tile_lookups) : 1.0;
+    int maxpriority = int(m.memory_by_priority.size()) / 2;
+    if (format == "prometheus") {
+        prometheus_sample (out, prefix, "uptime_seconds", "gauge",
+                           "Seconds since the cache was created", m.time);
+        prometheus_sample (out, prefix, "tile_lookups_total", "counter",
+                           "Tile lookups",
+                           m.tile_lookups);
+        prometheus_sample (out, prefix, "tile_misses_total", "counter",
+                           "Tile lookups that had to bring the tile into memory",
+                           m.tile_misses);
+        prometheus_sample (out, prefix, "tile_hit_ratio", "gauge",
+                           "Fraction of tile lookups found in memory", hitratio);
+        prometheus_histogram (out, prefix, "tile_miss_seconds",
+                              "Time to bring in a missed tile", m.miss_latency);
+        prometheus_histogram (out, prefix, "file_open_seconds",
+                              "Time to open a file", m.open_latency);
+        prometheus_sample (out, prefix, "read_bytes_total", "counter",
+                           "Pixel data read from files", m.bytes_read);
+        prometheus_sample (out, prefix, "fileio_seconds_total", "counter",
+                           "Time spent on file I/O", m.fileio_time);
+        prometheus_sample (out, prefix, "memory_used_bytes", "gauge",
+                           "Tile memory in use", m.memory_used);
+        prometheus_sample (out, prefix, "memory_limit_bytes", "gauge",
+                           "Tile memory limit", m.memory_limit);
+        for (int c = 0;  c < int(m.memory_by_priority.size());  ++c)
+            prometheus_sample (out, prefix, "memory_priority_bytes", "gauge",
+                               c ? "" : "Tile memory by file priority class",
+                               m.memory_by_priority[c],
+                               Strutil::format ("{priority=\"%d\"}", c - maxpriority));
+        prometheus_sample (out, prefix, "tiles", "gauge",
+                           "Tiles in memory", m.tiles);
+        prometheus_sample (out, prefix, "tiles_created_total", "counter",
+                           "Tiles created", m.tiles_created);
+        prometheus_sample (out, prefix, "files", "gauge",
+                           "Files known to the cache", m.files);
+        prometheus_sample (out, prefix, "open_files", "gauge",
+                           "Files currently open", m.open_files);
+        prometheus_sample (out, prefix, "files_opened_total", "counter",
+                           "Files opened", m.files_opened);
+        prometheus_sample (out, prefix, "files_closed_total", "counter",
+                           "Files closed", m.files_closed);
+    } else if (format == "statsd") {
+        statsd_gauge (out, prefix, "uptime_seconds", m.time);
+        statsd_gauge (out, prefix, "tile_lookups", m.tile_lookups);
+        statsd_gauge (out, prefix, "tile_misses", m.tile_misses);
+        statsd_gauge (out, prefix, "tile_hit_ratio", hitratio);
+        statsd_histogram (out, prefix, "tile_miss_seconds", m.miss_latency);
+        statsd_histogram (out, prefix, "file_open_seconds", m.open_latency);
+        statsd_gauge (out, prefix, "read_bytes", m.bytes_read);
+        statsd_gauge (out, prefix, "fileio_seconds", m.fileio_time);
+        statsd_gauge (out, prefix, "memory_used_bytes", m.memory_used);
+        statsd_gauge (out, prefix, "memory_limit_bytes", m.memory_limit);
+        for (int c = 0;  c < int(m.memory_by_priority.size());  ++c)
+            statsd_gauge (out, prefix,
+                          Strutil::format ("memory_priority_bytes.%d", c - maxpriority),
+                          m.memory_by_priority[c]);
+        statsd_gauge (out, prefix, "tiles", m.tiles);
+        statsd_gauge (out, prefix, "tiles_created", m.tiles_created);
+        statsd_gauge (out, prefix, "files", m.files);
+        statsd_gauge (out, prefix, "open_files", m.open_files);
+        statsd_gauge (out, prefix, "files_opened", m.files_opened);
+        statsd_gauge (out, prefix, "files_closed", m.files_closed);
+    } else {
+        pvt::error ("format_metrics: unknown format \"%s\"", format);
+        return std::string();
+    }
+    return out.str();
+}
+
 OIIO_NAMESPACE_END
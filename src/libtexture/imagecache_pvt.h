@@ -36,10 +36,18 @@
 #ifndef OPENIMAGEIO_IMAGECACHE_PVT_H
 #define OPENIMAGEIO_IMAGECACHE_PVT_H
 
+#include <deque>
+#include <map>
+
 #include <boost/version.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/scoped_array.hpp>
 #include <boost/thread/tss.hpp>
+#if OIIO_CPLUSPLUS_VERSION >= 11
+# include <unordered_set>
+#else
+# include <boost/unordered_set.hpp>
+#endif
 #if BOOST_VERSION >= 104900
 # include <boost/container/flat_map.hpp>
 #endif
@@ -51,6 +59,7 @@
 #include "OpenImageIO/refcnt.h"
 #include "OpenImageIO/hash.h"
 #include "OpenImageIO/imagebuf.h"
+#include "OpenImageIO/timer.h"
 #include "OpenImageIO/unordered_map_concurrent.h"
 
 
@@ -58,25 +67,24 @@ OIIO_NAMESPACE_BEGIN
 
 namespace pvt {
 
-#ifndef NDEBUG
+// Timing statistics for finding files and tiles.  These use FastTimer,
+// which is cheap enough to leave on in optimized builds; change the
+// following to 0 to compile them out entirely.
+#ifndef IMAGECACHE_TIME_STATS
 # define IMAGECACHE_TIME_STATS 1
-#else
-    // Change the following to 1 to get timing statistics even for
-    // optimized runs.  Note that this has some performance penalty.
-# define IMAGECACHE_TIME_STATS 0
 #endif
 
 #define IMAGECACHE_USE_RW_MUTEX 1
 
-// Should we compute and store shadow matrices? Not if we don't support
-// shadow maps!
-#define USE_SHADOW_MATRICES 0
+// Should we compute and store shadow matrices? Needed for shadow maps.
+#define USE_SHADOW_MATRICES 1
 
 
 using boost::thread_specific_ptr;
 
 class ImageCacheImpl;
 class ImageCachePerThreadInfo;
+class TileID;
 
 const char * texture_format_name (TexFormat f);
 const char * texture_type_name (TexFormat f);
@@ -89,6 +97,150 @@ typedef unordered_map<uint64_t,ImageCacheFile*> UdimLookupMap;
 
 
 
+/// The ImageCache locks whose contention is measured when the
+/// "lock_stats" attribute is set.
+enum LockSite {
+    LockFileInput,        ///< ImageCacheFile::m_input_mutex, all files
+    LockTileCacheBins,    ///< Bin locks of the main tile cache
+    LockFileMapBins,      ///< Bin locks of the filename map
+    LockPerthreadInfo,    ///< m_perthread_info_mutex
+    LockOpenFiles,        ///< m_open_files_mutex
+    LockFileSweep,        ///< m_file_sweep_mutex (try_lock only)
+    LockTileSweep,        ///< m_tile_sweep_mutex (try_lock only)
+    NumLockSites
+};
+
+
+
+/// Contention counts for one lock site: how many acquisitions found the
+/// lock already held by another thread, and the total time (in Timer
+/// ticks) they spent waiting for it.  Uncontended acquisitions are not
+/// counted, so that gathering the stats doesn't itself make every
+/// thread write to the same cache line.  For the sites that are only
+/// ever try_lock'ed, a wait is a skipped sweep and takes no time.
+struct LockStats {
+    atomic_ll waits;
+    atomic_ll wait_ticks;
+
+    LockStats () { clear (); }
+    void clear () { waits = 0;  wait_ticks = 0; }
+};
+
+
+
+/// Lock m.  If stats is not NULL and another thread holds the lock,
+/// count and time the wait.
+template<class Mutex>
+inline void
+counted_lock (Mutex &m, LockStats *stats)
+{
+    if (! stats) {
+        m.lock ();
+    } else if (! m.try_lock ()) {
+        Timer timer;
+        m.lock ();
+        stats->waits += 1;
+        stats->wait_ticks += timer.ticks();
+    }
+}
+
+
+
+/// Try to lock m, and if that fails and stats is not NULL, count it.
+template<class Mutex>
+inline bool
+counted_try_lock (Mutex &m, LockStats *stats)
+{
+    if (m.try_lock ())
+        return true;
+    if (stats)
+        stats->waits += 1;
+    return false;
+}
+
+
+
+/// Scoped lock of a mutex with counted_lock.
+template<class Mutex>
+class counted_lock_guard {
+public:
+    counted_lock_guard (Mutex &m, LockStats *stats) : m_mutex(m) {
+        counted_lock (m_mutex, stats);
+    }
+    ~counted_lock_guard () { m_mutex.unlock (); }
+private:
+    counted_lock_guard (const counted_lock_guard &); // Do not implement
+    counted_lock_guard& operator= (const counted_lock_guard &); // Do not implement
+    Mutex &m_mutex;
+};
+
+typedef counted_lock_guard<recursive_mutex> counted_recursive_lock;
+typedef counted_lock_guard<spin_mutex> counted_spin_lock;
+
+
+
+/// Kinds of span recorded by the "trace" option.
+enum TraceEventType {
+    TraceTileMiss,        ///< Finding a tile that was not in the cache
+    TraceTileWait,        ///< Waiting for another thread to read a tile
+    TraceTileRead,        ///< Reading (and decoding) a tile from a file
+    TraceDecompress,      ///< Decompressing a tile kept compressed
+    TraceFileOpen,        ///< Opening a file's ImageInput
+    TraceFileClose,       ///< Closing a file's ImageInput
+    TraceFileSweep,       ///< Closing files to stay under max_open_files
+    TraceTileSweep,       ///< Evicting tiles to stay under max_memory_MB
+    TraceTextureLookup,   ///< A slow TextureSystem lookup
+    NumTraceEventTypes
+};
+
+
+
+/// One span of time recorded by the "trace" option, in Timer ticks
+/// since the tracing began, with the file (and the subimage, MIP level
+/// and tile origin) it concerned, if any.
+struct TraceEvent {
+    long long begin, end;
+    ustring filename;
+    short type, subimage, miplevel;
+    int x, y;
+};
+
+
+
+/// Lock-free record of durations, bucketed as an
+/// ImageCache::LatencyHistogram.  Recording one is a few atomic adds, so
+/// threads never wait on each other for it, and a snapshot can be taken
+/// at any time while they record.
+class LatencyRecorder {
+public:
+    enum { BucketsPerDoubling = 4, Doublings = 32,
+           NumBuckets = BucketsPerDoubling * Doublings };
+
+    LatencyRecorder () { clear (); }
+    void clear ();
+    void record (double seconds);
+    void snapshot (ImageCache::LatencyHistogram &hist) const;
+
+private:
+    atomic_ll m_counts[NumBuckets];
+    atomic_ll m_sum_ns;
+    atomic_ll m_max_ns;
+};
+
+
+
+/// Record the time between construction and destruction.
+class LatencyScope {
+public:
+    LatencyScope (LatencyRecorder &recorder) : m_recorder(recorder) { }
+    ~LatencyScope () { m_recorder.record (m_timer()); }
+private:
+    LatencyRecorder &m_recorder;
+    FastTimer m_timer;
+};
+
+
+
 /// Structure to hold IC and TS statistics.  We combine into a single
 /// structure to minimize the number of costly thread_specific_ptr
 /// retrievals.  If somebody is using the ImageCache without a
@@ -117,6 +269,29 @@ struct ImageCacheStatistics {
     double tile_locking_time;
     double find_file_time;
     double find_tile_time;
+    long long prefetch_calls;
+    long long prefetch_tiles_queued;
+    long long nonblocking_tiles_queued;
+    long long approximate_lookups;
+    long long untiled_band_hits;
+    long long disk_cache_hits;
+    long long disk_cache_misses;
+    long long shared_cache_hits;
+    long long shared_cache_misses;
+    long long remote_cache_hits;
+    long long remote_cache_misses;
+    long long file_reopens;
+    long long concurrent_tile_reads;
+    long long tiles_coalesced;
+    long long procedural_tiles;
+    double file_reopen_time;
+    long long tiles_compressed;
+    long long compressed_bytes_raw;
+    long long compressed_bytes;
+    long long tiles_decompressed;
+    double compress_time;
+    double decompress_time;
+    long long files_from_index;
 
     // TextureSystem-specific fields below:
     long long texture_queries;
@@ -131,8 +306,11 @@ struct ImageCacheStatistics {
     long long aniso_probes;
     float max_aniso;
     long long closest_interps;
+    long long point_samples;
     long long bilinear_interps;
     long long cubic_interps;
+    long long ewa_interps;
+    long long ewa_texels;
     int file_retry_success;
     int tile_retry_success;
     
@@ -143,6 +321,72 @@ struct ImageCacheStatistics {
 
 
 
+/// MetadataIndex is an optional persistent record of what the ImageCache
+/// learned from the headers of each file it opened -- the native specs
+/// of every subimage and MIP level, and any average colors -- so that a
+/// later process can set up its ImageCacheFiles without opening the
+/// files at all until it needs their pixels.  Entries are keyed by file
+/// name and are only trusted while the file's size and modification
+/// time still match (the fingerprint, if any, rides along in the specs).
+/// The index is saved in the host's native byte order, as it is meant to
+/// be a local cache, not an interchange format.  Thread-safe.
+class MetadataIndex {
+public:
+    struct SubimageEntry {
+        std::vector<ImageSpec> nativespecs;  ///< One for each MIP level
+        bool has_average_color;
+        bool is_constant_image;
+        std::vector<float> average_color;
+        SubimageEntry () : has_average_color(false), is_constant_image(false) { }
+    };
+    struct Entry {
+        unsigned long long size;        ///< File size when it was read
+        long long mod_time;             ///< Modification time when read
+        ustring fileformat;             ///< Name of the reader
+        bool unassociatedalpha;         ///< Was "oiio:UnassociatedAlpha" in effect?
+        std::vector<SubimageEntry> subimages;
+        Entry () : size(0), mod_time(0), unassociatedalpha(false) { }
+    };
+
+    MetadataIndex () : m_dirty(false) { }
+    ~MetadataIndex () { }
+
+    /// Forget any current index (without saving it) and use the named
+    /// index file, loading its entries if it exists.  An empty name
+    /// disables the index.  Return true if ok, or false (storing a
+    /// message in err) if the file exists but can't be read, in which
+    /// case the index starts out empty but will still be saved.
+    bool init (const std::string &filename, std::string &err);
+
+    /// Write the index back to its file, if it has changed.  Return true
+    /// if ok, or false (storing a message in err) on failure.
+    bool save (std::string &err);
+
+    /// Is there an index file?
+    bool enabled () const { return ! m_filename.empty(); }
+
+    /// If there's an entry for the file, copy it to entry and return
+    /// true, otherwise return false.
+    bool find (ustring filename, Entry &entry) const;
+
+    /// Add (or replace) the entry for a file.
+    void add (ustring filename, const Entry &entry);
+
+    /// Record an average color computed for a subimage of a file that's
+    /// already in the index.
+    void set_average_color (ustring filename, int subimage,
+                            const std::vector<float> &color);
+
+private:
+    typedef unordered_map<ustring, Entry, ustringHash> EntryMap;
+    mutable spin_mutex m_mutex;
+    std::string m_filename;         ///< Where the index lives
+    EntryMap m_entries;
+    bool m_dirty;                   ///< Changed since loaded?
+};
+
+
+
 /// Unique in-memory record for each image file on disk.  Note that
 /// this class is not in and of itself thread-safe.  It's critical that
 /// any calling routine use a mutex any time a ImageCacheFile's methods are
@@ -158,10 +402,13 @@ public:
     ImageCacheFile (ImageCacheImpl &imagecache,
                     ImageCachePerThreadInfo *thread_info, ustring filename,
                     ImageInput::Creator creator=NULL,
-                    const ImageSpec *config=NULL);
+                    const ImageSpec *config=NULL,
+                    ImageCache::TileProvider *provider=NULL);
     ~ImageCacheFile ();
 
     bool broken () const { return m_broken; }
+    /// Are the tiles generated by a TileProvider?
+    bool procedural () const { return m_provider != NULL; }
     int subimages () const { return (int)m_subimages.size(); }
     int miplevels (int subimage) const {
         return (int)m_subimages[subimage].levels.size();
@@ -175,6 +422,31 @@ public:
     const ImageSpec & nativespec (int subimage, int miplevel) const {
         return levelinfo(subimage,miplevel).nativespec;
     }
+    /// The spec holding the metadata (extra_attribs and channel names)
+    /// of the given level, which may be the level's own spec or the one
+    /// of the subimage's top level.
+    const ImageSpec & metadata_spec (int subimage, int miplevel,
+                                     bool native=false) const {
+        const LevelInfo &lev (levelinfo(subimage,miplevel));
+        if (native ? lev.shared_nativemetadata : lev.shared_metadata)
+            return spec (subimage, 0);
+        return native ? lev.nativespec : lev.spec;
+    }
+    /// A complete spec of the given level, including any metadata it
+    /// shares.  Levels that share metadata get a full copy made the
+    /// first time it's asked for, which lives as long as the specs.
+    const ImageSpec & complete_spec (int subimage, int miplevel,
+                                     bool native) const;
+    /// Copy a complete spec of the given level into spec, without
+    /// keeping a full copy around.
+    void get_complete_spec (int subimage, int miplevel, bool native,
+                            ImageSpec &spec) const;
+    /// Approximate bytes taken by the metadata of all the specs, and the
+    /// bytes saved by not duplicating it in every MIP level.
+    size_t metadata_memory () const;
+    size_t metadata_saved () const;
+    /// Bytes taken by the MIP levels made by background automip tasks.
+    size_t automip_memory () const;
     ustring filename (void) const { return m_filename; }
     ustring fileformat (void) const { return m_fileformat; }
     TexFormat textureformat () const { return m_texformat; }
@@ -207,6 +479,25 @@ public:
         return (TypeDesc::BASETYPE) m_subimages[subimage].datatype.basetype;
     }
     bool mipused (void) const { return m_mipused; }
+    /// Cache priority class (see ImageCache::set_file_priority).
+    int priority () const { return m_priority; }
+    /// Tile memory quota in bytes, or 0 if none.
+    imagesize_t quota () const { return m_quota; }
+    /// Bytes of tile memory currently held by this file's tiles.
+    long long mem_used () const { return m_mem_used.fast_value(); }
+    bool over_quota () const {
+        return m_quota && m_mem_used.fast_value() > (long long)m_quota;
+    }
+
+    /// Record that a tile of this file was added to (or erased from) the
+    /// main tile cache.  Called by ImageCacheImpl, holding the tile's
+    /// TileIndex write mutex.
+    void tile_resident (const TileID &id);
+    void tile_evicted (const TileID &id);
+    /// Append the IDs of this file's tiles in the main tile cache.
+    void resident_tiles (std::vector<TileID> &ids) const;
+    /// How many of this file's tiles are in the main tile cache.
+    size_t nresident () const;
     bool sample_border (void) const { return m_sample_border; }
     bool is_udim (void) const { return m_is_udim; }
     const std::vector<size_t> &mipreadcount (void) const { return m_mipreadcount; }
@@ -214,15 +505,16 @@ public:
     void invalidate ();
 
     size_t timesopened () const { return m_timesopened; }
-    size_t tilesread () const { return m_tilesread; }
-    imagesize_t bytesread () const { return m_bytesread; }
-    double & iotime () { return m_iotime; }
+    // N.B. The read counts and I/O time are kept per thread as they
+    // happen, and only reflect what ImageCacheImpl::merge_file_stats has
+    // gathered so far.
+    size_t tilesread () const { return (size_t) m_tilesread.load(); }
+    imagesize_t bytesread () const { return (imagesize_t) m_bytesread.load(); }
+    double iotime () const { return m_iotime; }
+    // Total "texture_profile" ticks charged to all levels of this file.
+    long long profile_ticks () const;
     size_t redundant_tiles () const { return (size_t) m_redundant_tiles.load(); }
     imagesize_t redundant_bytesread () const { return (imagesize_t) m_redundant_bytesread.load(); }
-    void register_redundant_tile (imagesize_t bytesread) {
-        m_redundant_tiles += 1;
-        m_redundant_bytesread += (long long) bytesread;
-    }
 
     std::time_t mod_time () const { return m_mod_time; }
     ustring fingerprint () const { return m_fingerprint; }
@@ -233,22 +525,97 @@ public:
     // success, false on failure.
     bool get_average_color (float *avg, int subimage, int chbegin, int chend);
 
+    /// Lookup cost of one MIP level, gathered only when the
+    /// "texture_profile" attribute is set.  Times are in FastTimer ticks.
+    struct LevelProfile {
+        atomic_ll lookups;          ///< Filtered lookups that used the level
+        atomic_ll probes;           ///< Filter probes (or texels, for EWA)
+        atomic_ll lookup_ticks;     ///< Finding tiles in the main cache
+        atomic_ll wait_ticks;       ///< Waiting on other threads' tile reads
+        atomic_ll decode_ticks;     ///< Reading and decoding tiles
+        atomic_ll filter_ticks;     ///< Filtering, net of the tile times
+        LevelProfile () { clear (); }
+        void clear () {
+            lookups = 0;  probes = 0;  lookup_ticks = 0;
+            wait_ticks = 0;  decode_ticks = 0;  filter_ticks = 0;
+        }
+        long long total_ticks () const {
+            return lookup_ticks + wait_ticks + decode_ticks + filter_ticks;
+        }
+    };
+
     /// Info for each MIP level that isn't in the ImageSpec, or that we
     /// precompute.
+    ///
+    /// When a level's metadata (extra_attribs and channel names) is the
+    /// same as that of the subimage's top level spec -- as it nearly
+    /// always is -- it is only kept there, and spec and nativespec hold
+    /// just the level's dimensions and formats (see share_metadata).
+    /// Use ImageCacheFile::metadata_spec() to find the metadata of a
+    /// level, and complete_spec() for a full ImageSpec.
     struct LevelInfo {
         ImageSpec spec;             ///< ImageSpec for the mip level
         ImageSpec nativespec;       ///< Native ImageSpec for the mip level
+        bool shared_metadata;       ///< spec's metadata is level 0's
+        bool shared_nativemetadata; ///< nativespec's metadata is level 0's
+        // Complete copies of spec and nativespec, made on demand by
+        // complete_spec() if their metadata is shared.  Protected by the
+        // subimage's metadata_mutex.
+        mutable OIIO::shared_ptr<ImageSpec> fullspec, fullnativespec;
         bool full_pixel_range;      ///< pixel data window matches image window
         bool onetile;               ///< Whole level fits on one tile
         mutable bool polecolorcomputed;     ///< Pole color was computed
         mutable std::vector<float> polecolor;///< Pole colors
         int nxtiles, nytiles, nztiles; ///< Number of tiles in each dimension
         atomic_ll *tiles_read;      ///< Bitfield for tiles read at least once
+        mutable LevelProfile profile;   ///< Lookup costs, if profiling
+        // Single-color tiles recorded by maketx ("oiio:ConstantTiles"):
+        // for each tile, an index into constant_colors (nchannels floats
+        // per color), or -1 if it's an ordinary tile.  Empty if the level
+        // has no constant tiles.
+        std::vector<short> constant_tiles;
+        std::vector<float> constant_colors;
+        // Content hashes from maketx ("oiio:TileHashes") of the tiles
+        // that have identical twins, or 0 for unique tiles.  Empty if
+        // the level has none.
+        std::vector<unsigned long long> tile_hashes;
+        // Byte position in the file of each tile, if every tile of the
+        // level can be mapped straight from it (see "mmap_tiles").
+        std::vector<imagesize_t> tile_offsets;
         LevelInfo (const ImageSpec &spec, const ImageSpec &nativespec);  ///< Initialize based on spec
         LevelInfo (const LevelInfo &src); // needed for vector<LevelInfo>
         ~LevelInfo () { delete [] tiles_read; }
     };
 
+    /// The coarser MIP levels of an un-MIPmapped subimage, made all at
+    /// once, level by level, by a background task (see "automip_async")
+    /// rather than tile by tile as they are needed.  Whoever gets to a
+    /// queued task first (the I/O thread, or a thread that needs one of
+    /// its tiles) runs it; others needing its tiles wait for it to be
+    /// done.  Shared with the task, so that it outlives an invalidation.
+    /// The levels count against the cache's memory for as long as they
+    /// exist.  SubimageInfo::automip is protected by m_input_mutex.
+    struct AutomipLevels {
+        enum State { Queued, Running, Done };
+        AutomipLevels (ImageCacheImpl &ic)
+            : nchannels(0), state(Queued), bytes(0), imagecache(ic) { }
+        ~AutomipLevels ();
+        std::vector<ROI> rois;          ///< Pixel window of each level
+        TypeDesc datatype;              ///< Type of pixels we store internally
+        int nchannels;
+        spin_mutex mutex;               ///< Protects the rest
+        State state;
+        std::vector<OIIO::shared_ptr<ImageBuf> > levels; ///< [0] is empty
+        size_t bytes;                   ///< Size of levels
+        ImageCacheImpl &imagecache;     ///< Whose memory they count in
+    };
+    typedef OIIO::shared_ptr<AutomipLevels> AutomipLevelsRef;
+
+    /// Make the levels of the background automip task am for the given
+    /// subimage, unless it has already been started elsewhere.
+    void build_automip (ImageCachePerThreadInfo *thread_info, int subimage,
+                        AutomipLevels &am);
+
     /// Info for each subimage
     ///
     struct SubimageInfo {
@@ -257,6 +624,8 @@ public:
         unsigned int channelsize;       ///< Channel size, in bytes
         unsigned int pixelsize;         ///< Pixel size, in bytes
         bool untiled;                   ///< Not tiled
+        int autotile;                   ///< Emulated tile size if untiled, or 0
+        AutomipLevelsRef automip;       ///< Background automip, or NULL
         bool unmipped;                  ///< Not really MIP-mapped
         bool volume;                    ///< It's a volume image
         bool full_pixel_range;          ///< pixel data window matches image window
@@ -264,6 +633,19 @@ public:
         bool has_average_color;         ///< We have an average color
         std::vector<float> average_color; ///< Average color
         spin_mutex average_color_mutex; ///< protect average_color
+        // Importance sampling tables baked by maketx for lat-long
+        // environment maps: the marginal CDF (env_importance_height
+        // values) followed by the conditional CDF of each row
+        // (env_importance_width values each).  Empty if not present.
+        int env_importance_width, env_importance_height;
+        std::vector<float> env_importance;
+        size_t metadata_saved;          ///< Bytes saved by share_metadata
+        mutable spin_mutex metadata_mutex; ///< protect levels' full specs
+        // Conservative min/max channels appended by maketx: the number
+        // of texture channels they bound, and the first channel of each
+        // (-1 if not present).
+        int minmax_nbase, min_channel, max_channel;
+        int lean_channel;     ///< First LEAN slope moment channel, or -1
 
         // The scale/offset accounts for crops or overscans, converting
         // 0-1 texture space relative to the "display/full window" into 
@@ -273,12 +655,21 @@ public:
 
         SubimageInfo () : datatype(TypeDesc::UNKNOWN),
                           channelsize(0), pixelsize(0),
-                          untiled(false), unmipped(false), volume(false),
+                          untiled(false), autotile(0),
+                          unmipped(false), volume(false),
                           full_pixel_range(false),
                           is_constant_image(false), has_average_color(false),
+                          env_importance_width(0), env_importance_height(0),
+                          metadata_saved(0), minmax_nbase(0), min_channel(-1), max_channel(-1),
+                          lean_channel(-1),
                           sscale(1.0f), soffset(0.0f),
                           tscale(1.0f), toffset(0.0f) { }
         void init (const ImageSpec &spec, bool forcefloat);
+        /// Once all the levels are added, drop each level's private copy
+        /// of any metadata identical to that of levels[0].spec.
+        void share_metadata ();
+        /// Approximate bytes taken by the metadata of all the levels.
+        size_t metadata_memory () const;
         ImageSpec &spec (int m) { return levels[m].spec; }
         const ImageSpec &spec (int m) const { return levels[m].spec; }
         const ImageSpec &nativespec (int m) const { return levels[m].nativespec; }
@@ -302,6 +693,20 @@ public:
         return m_subimages[subimage].levels[miplevel];
     }
 
+    /// Return the pixels of tile number whichtile of the level, pointing
+    /// directly into the read-only mapping of the file, or an empty
+    /// pointer if that tile can't be mapped.  size is the number of
+    /// bytes the tile needs (including padding), and format the data
+    /// type of its pixels.
+    OIIO::shared_ptr<char> mapped_tile (const LevelInfo &lev, int whichtile,
+                                        size_t size, TypeDesc format) const;
+
+    /// Is the file mapped?
+    bool mapped () const {
+        spin_lock lock (m_mapping_mutex);
+        return m_mapping.get() != NULL;
+    }
+
     /// Do we currently have a valid spec?
     bool validspec () const {
         DASSERT ((m_validspec == false || m_subimages.size() > 0) &&
@@ -309,6 +714,9 @@ public:
         return m_validspec;
     }
 
+    /// Map the whole file into memory, read-only.  Return true on success.
+    bool map_file ();
+
     /// Forget the specs we know
     void invalidate_spec () {
         m_validspec = false;
@@ -334,35 +742,90 @@ private:
 #if USE_SHADOW_MATRICES
     Imath::M44f m_Mlocal;           ///< shadows: world-to-local (light) matrix
     Imath::M44f m_Mproj;            ///< shadows: world-to-pseudo-NDC
-    Imath::M44f m_Mtex;             ///< shadows: world-to-pNDC with camera z
-    Imath::M44f m_Mras;             ///< shadows: world-to-raster with camera z
+    Imath::M44f m_Mtex;             ///< shadows: common-to-texture (s,t)
+    Imath::M44f m_Mras;             ///< shadows: common-to-raster
 #endif
     EnvLayout m_envlayout;          ///< env map: which layout?
     bool m_y_up;                    ///< latlong: is y "up"? (else z is up)
     bool m_sample_border;           ///< are edge samples exactly on the border?
     bool m_is_udim;                 ///< Is tiled/UDIM?
     ustring m_fileformat;           ///< File format name
-    size_t m_tilesread;             ///< Tiles read from this file
-    imagesize_t m_bytesread;        ///< Bytes read from this file
+    atomic_ll m_tilesread;          ///< Tiles read from this file
+    atomic_ll m_bytesread;          ///< Bytes read from this file
     atomic_ll m_redundant_tiles;    ///< Redundant tile reads
     atomic_ll m_redundant_bytesread;///< Redundant bytes read
     size_t m_timesopened;           ///< Separate times we opened this file
     double m_iotime;                ///< I/O time for this file
     bool m_mipused;                 ///< MIP level >0 accessed
+    int m_priority;                 ///< Cache priority class
+    imagesize_t m_quota;            ///< Tile memory quota (0 = none)
+    atomic_ll m_mem_used;           ///< Tile memory used by this file
+    struct ResidentTiles;
+    boost::scoped_ptr<ResidentTiles> m_resident; ///< Tiles in the cache
     volatile bool m_validspec;      ///< If false, reread spec upon open
     mutable int m_errors_issued;    ///< Errors issued for this file
     std::vector<size_t> m_mipreadcount; ///< Tile reads per mip level
     ImageCacheImpl &m_imagecache;   ///< Back pointer for ImageCache
     mutable recursive_mutex m_input_mutex; ///< Mutex protecting the ImageInput
+    // Extra ImageInputs, used only for ordinary tile reads when m_input is
+    // busy (see max_inputs_per_file).  All protected by m_extra_mutex.
+    std::vector<ImageInput *> m_extra_inputs; ///< Idle extra ImageInputs
+    int m_extra_open;               ///< Extra ImageInputs open (idle or busy)
+    int m_extra_busy;               ///< Extra ImageInputs being read from
+    bool m_extra_allowed;           ///< May extras be used? (m_input open)
+    bool m_concurrent;              ///< m_input supports read_native_tile_at?
+    spin_mutex m_extra_mutex;       ///< Protects the extra inputs & m_mipreadcount
     std::time_t m_mod_time;         ///< Time file was last updated
     ustring m_fingerprint;          ///< Optional cryptographic fingerprint
     ImageCacheFile *m_duplicate;    ///< Is this a duplicate?
     imagesize_t m_total_imagesize;  ///< Total size, uncompressed
     imagesize_t m_total_imagesize_ondisk;  ///< Total size, compressed on disk
     ImageInput::Creator m_inputcreator; ///< Custom ImageInput-creator
+    ImageCache::TileProvider *m_provider; ///< Tile generator, if procedural
     boost::scoped_ptr<ImageSpec> m_configspec; // Optional configuration hints
+    mutable spin_mutex m_mapping_mutex; ///< Protects m_mapping*
+    OIIO::shared_ptr<char> m_mapping; ///< Read-only map of the file, or NULL
+    imagesize_t m_mapping_size;     ///< Size of m_mapping
+    // Place in the ImageCacheImpl's LRU lists of open files, protected by
+    // its m_open_files_mutex (see ImageCacheImpl::check_max_files).
+    // Scanlines read from an untiled, autotiled file for one row of its
+    // emulated tiles.  The most recently read bands are kept (up to
+    // untiled_band_memory_MB, but always the latest one) so that tiles of
+    // the row evicted from the cache can be refilled without rereading
+    // and reconverting the scanlines.  Protected by m_input_mutex, and
+    // dropped whenever the file is closed.
+    struct UntiledBand {
+        int subimage, miplevel, y, z, chbegin, chend;
+        TypeDesc format;
+        std::vector<char> pixels;
+    };
+    typedef OIIO::shared_ptr<UntiledBand> UntiledBandRef;
+    std::vector<UntiledBandRef> m_untiled_bands; ///< Oldest first
+    size_t m_untiled_band_bytes;    ///< Total size of m_untiled_bands
+    // Tiles read by read_tile_run on behalf of other threads that are
+    // waiting for them, until those threads collect them.  Oldest first,
+    // and at most max_coalesced_tiles (a reader that found its tile some
+    // other way leaves its entry to age out).  Protected by
+    // m_coalesced_mutex, and dropped whenever the file is closed.
+    struct CoalescedTile {
+        int subimage, miplevel, x, y, z, chbegin, chend;
+        std::vector<char> pixels;
+    };
+    std::deque<CoalescedTile> m_coalesced;
+    spin_mutex m_coalesced_mutex;   ///< Protects m_coalesced
+    ImageCacheFile *m_lru_prev;     ///< Next more recently opened file
+    ImageCacheFile *m_lru_next;     ///< Next less recently opened file
+    int m_lru_list;                 ///< Which list it's on, or -1 if none
+    double m_open_cost;             ///< Time the last open took
     UdimLookupMap m_udim_lookup;    ///< Used for decoding udim tiles
                                     // protected by mutex elsewhere!
+    // Flat "page table" for UDIM-like files: the concrete file of each
+    // already-resolved tile in the usual 10-wide UDIM range (1001-1999),
+    // indexed by udim number - 1001.  The pointers are stored in atomics
+    // so resolve_udim can read them without a lock.  Tiles outside the
+    // range are only in m_udim_lookup.
+    static const int udim_pages = 10*100;
+    boost::scoped_array<atomic_ll> m_udim_pages;
 
 
     /// We will need to read pixels from the file, so be sure it's
@@ -371,16 +834,96 @@ private:
 
     bool opened () const { return m_input.get() != NULL; }
 
+    /// If the metadata index has a still-valid entry for this file, set
+    /// up the subimages from it without opening the file, and return
+    /// true.  Otherwise, return false and leave the file untouched.
+    bool open_from_index (ImageCachePerThreadInfo *thread_info);
+
+    /// May this file's specs be recorded in, or taken from, the metadata
+    /// index?  Not if anything but the file itself could affect them.
+    bool indexable () const;
+
+    /// Fill in all the subimages and MIP levels, from the native specs
+    /// of the indexed entry if it's not NULL, otherwise from the open
+    /// ImageInput.  Return true if ok.
+    bool init_subimages (ImageCachePerThreadInfo *thread_info,
+                         const MetadataIndex::Entry *indexed);
+
+    /// Retrieve the native spec of the given subimage and MIP level from
+    /// the indexed entry, or if it's NULL, by seeking the ImageInput.
+    bool seek_nativespec (const MetadataIndex::Entry *indexed,
+                          int subimage, int miplevel, ImageSpec &nativespec);
+
     /// Force the file to open, thread-safe.
-    bool forceopen (ImageCachePerThreadInfo *thread_info) {
-        recursive_lock_guard guard (m_input_mutex);
-        return open (thread_info);
-    }
+    bool forceopen (ImageCachePerThreadInfo *thread_info);
 
     /// Close and delete the ImageInput, if currently open
     ///
     void close (void);
 
+    /// If the main ImageInput is busy, try to read the tile through one of
+    /// the extra ImageInputs instead, so that independent tiles of the
+    /// same file can be read and decompressed concurrently.  Return true
+    /// if it was handled this way (storing the read status in ok), or
+    /// false if the caller should wait for the main ImageInput.
+    bool read_tile_extra (ImageCachePerThreadInfo *thread_info,
+                          int subimage, int miplevel, int x, int y, int z,
+                          int chbegin, int chend, TypeDesc format,
+                          void *data, bool &ok);
+
+    /// If the main ImageInput supports "concurrent_reads", read the tile
+    /// through read_native_tile_at without taking m_input_mutex, so that
+    /// threads needing different tiles of the file don't wait for each
+    /// other.  Return true if it was handled this way (storing the read
+    /// status in ok), or false if the caller should use the ordinary path
+    /// (which is also how read failures get their error messages).
+    bool read_tile_concurrent (ImageCachePerThreadInfo *thread_info,
+                               int subimage, int miplevel, int x, int y, int z,
+                               int chbegin, int chend, TypeDesc format,
+                               void *data, bool &ok);
+
+    /// Have m_provider generate a tile of a procedural image.  No lock is
+    /// held, so any number of threads may be generating tiles at once.
+    bool read_tile_procedural (ImageCachePerThreadInfo *thread_info,
+                               int subimage, int miplevel, int x, int y, int z,
+                               int chbegin, int chend, TypeDesc format,
+                               void *data);
+
+    /// Read an ordinary tile from the given (opened) ImageInput.  If
+    /// ntiles > 1, read that many horizontally adjacent tiles starting
+    /// with this one in a single read_tiles call, into one contiguous
+    /// region ntiles tiles wide.
+    bool read_tile_from (ImageInput *in, ImageCachePerThreadInfo *thread_info,
+                         int subimage, int miplevel, int x, int y, int z,
+                         int chbegin, int chend, TypeDesc format, void *data,
+                         int ntiles = 1);
+
+    /// If this tile was already read as part of another thread's run
+    /// (see read_tile_run), move its pixels into data and return true.
+    bool take_coalesced_tile (int subimage, int miplevel, int x, int y,
+                              int z, int chbegin, int chend, void *data);
+
+    /// How many tiles, starting with this one and going right along its
+    /// row, are being waited for by somebody (up to the "coalesce_tiles"
+    /// limit)?  Tiles that ImageCacheTile::read won't read from the file
+    /// (constant, mapped, or deduplicated tiles) end the run.
+    int coalescible_run (ImageCachePerThreadInfo *thread_info,
+                         int subimage, int miplevel, int x, int y, int z,
+                         int chbegin, int chend, TypeDesc format);
+
+    /// Read this tile and the ntiles-1 to its right with one read_tiles
+    /// from the main ImageInput, keeping the others in m_coalesced for
+    /// the threads that will ask for them.  Must hold m_input_mutex.
+    bool read_tile_run (ImageCachePerThreadInfo *thread_info,
+                        int subimage, int miplevel, int x, int y, int z,
+                        int chbegin, int chend, TypeDesc format, void *data,
+                        int ntiles);
+
+    /// Wait for any in-progress reads from the extra ImageInputs (or
+    /// concurrent reads from the main one) to finish, then close and
+    /// delete the extras.
+    void close_extra_inputs ();
+
     /// Load the requested tile, from a file that's not really tiled.
     /// Preconditions: the ImageInput is already opened, and we already did
     /// a seek_subimage to the right subimage and MIP level.
@@ -388,6 +931,29 @@ private:
                        int subimage, int miplevel, int x, int y, int z,
                        int chbegin, int chend, TypeDesc format, void *data);
 
+    /// Find the kept band of scanlines read for the tile row starting at
+    /// y, or return an empty reference.  Call with m_input_mutex held.
+    UntiledBandRef find_untiled_band (int subimage, int miplevel, int y,
+                                      int z, int chbegin, int chend,
+                                      TypeDesc format) const;
+
+    /// Keep a newly read band of scanlines, discarding the oldest bands
+    /// as needed to stay within untiled_band_memory_MB.  Call with
+    /// m_input_mutex held.
+    void keep_untiled_band (const UntiledBandRef &band);
+
+    /// If automip_async is on, queue a background task to make all the
+    /// coarser levels of the subimage, if it is un-MIPmapped.
+    void queue_automip (int subimage);
+
+    /// If the subimage's coarser levels are (being) made by a background
+    /// automip task, copy the requested tile from there, first waiting
+    /// for the task if needed, and return true.  Return false if the
+    /// tile must be made the usual way.
+    bool read_automip (ImageCachePerThreadInfo *thread_info,
+                       int subimage, int miplevel, int x, int y, int z,
+                       int chbegin, int chend, TypeDesc format, void *data);
+
     /// Load the requested tile, from a file that's not really MIPmapped.
     /// Preconditions: the ImageInput is already opened, and we already did
     /// a seek_subimage to the right subimage.
@@ -395,9 +961,17 @@ private:
                         int subimage, int miplevel, int x, int y, int z,
                         int chbegin, int chend, TypeDesc format, void *data);
 
-    void lock_input_mutex () {
-        m_input_mutex.lock ();
-    }
+    /// For the first few MIP levels of an un-MIPmapped JPEG, decode the
+    /// whole level at once at reduced size (DCT scaling), put its tiles
+    /// in the cache, and return the requested one in data.  Returns false
+    /// (without an error) if that can't be done, so the caller should
+    /// fall back to read_unmipped's resampling.
+    bool read_dct_scaled (ImageCachePerThreadInfo *thread_info,
+                          int subimage, int miplevel, int x, int y, int z,
+                          int chbegin, int chend, TypeDesc format, void *data);
+
+    /// Lock m_input_mutex, counting the wait if "lock_stats" is set.
+    void lock_input_mutex ();
 
     void unlock_input_mutex () {
         m_input_mutex.unlock ();
@@ -544,6 +1118,21 @@ private:
 
 
 
+/// The IDs of one file's tiles that are in the main tile cache, so
+/// that invalidating the file costs in proportion to its own tiles
+/// rather than to the whole cache.
+struct ImageCacheFile::ResidentTiles {
+#if OIIO_CPLUSPLUS_VERSION >= 11
+    typedef std::unordered_set<TileID, TileID::Hasher> TileSet;
+#else /* FIXME(C++11): remove this after making C++11 the baseline */
+    typedef boost::unordered_set<TileID, TileID::Hasher> TileSet;
+#endif
+    TileSet tiles;
+    mutable spin_mutex mutex;   ///< Protects tiles
+};
+
+
+
 
 /// Record for a single image tile.
 ///
@@ -560,6 +1149,13 @@ public:
     ImageCacheTile (const TileID &id, const void *pels, TypeDesc format,
                     stride_t xstride, stride_t ystride, stride_t zstride);
 
+    /// Construct a thread's private, decompressed copy of a compressed
+    /// tile of the main cache (see "compress_tiles").  It isn't counted
+    /// in the cache's tiles or memory; marking it used marks the
+    /// compressed original.
+    ImageCacheTile (ImageCacheTile *compressed,
+                    ImageCachePerThreadInfo *thread_info);
+
     ~ImageCacheTile ();
 
     /// Actually read the pixels.  The caller had better be the thread
@@ -567,7 +1163,7 @@ public:
     void read (ImageCachePerThreadInfo *thread_info);
 
     /// Return pointer to the raw pixel data
-    const void *data (void) const { return &m_pixels[0]; }
+    const void *data (void) const { return m_pixels.get(); }
 
     /// Return pointer to the pixel data for a particular pixel.  Be
     /// extremely sure the pixel is within this tile!
@@ -575,22 +1171,22 @@ public:
 
     /// Return pointer to the floating-point pixel data
     const float *floatdata (void) const {
-        return (const float *) &m_pixels[0];
+        return (const float *) m_pixels.get();
     }
 
     /// Return a pointer to the character data
     const unsigned char *bytedata (void) const {
-        return (unsigned char *) &m_pixels[0];
+        return (unsigned char *) m_pixels.get();
     }
 
     /// Return a pointer to unsigned short data
     const unsigned short *ushortdata (void) const {
-        return (unsigned short *) &m_pixels[0];
+        return (unsigned short *) m_pixels.get();
     }
 
     /// Return a pointer to half data
     const half *halfdata (void) const {
-        return (half *) &m_pixels[0];
+        return (half *) m_pixels.get();
     }
 
     /// Return the id for this tile.
@@ -600,6 +1196,10 @@ public:
     const ImageCacheFile & file () const { return m_id.file(); }
 
     /// Return the actual allocated memory size for this tile's pixels.
+    /// Tiles whose pixels are shared with other tiles report 0, since
+    /// they don't own their memory.  (Deduplicated pixels carry their
+    /// own charge, released when the last tile holding them goes, so
+    /// all of their tiles report 0, even the one that read them.)
     ///
     size_t memsize () const {
         return m_pixels_size;
@@ -609,9 +1209,15 @@ public:
     ///
     size_t memsize_needed () const;
 
-    /// Mark the tile as recently used.
-    ///
-    void use () { m_used = 1; }
+    /// Mark the tile as recently used.  Skip the store if it's already
+    /// marked, so that hits on a hot tile don't keep dirtying its cache
+    /// line.
+    void use () {
+        if (! m_used.fast_value())
+            m_used = 1;
+        if (m_source)
+            m_source->use ();
+    }
 
     /// Mark the tile as not recently used, return its previous value.
     ///
@@ -627,8 +1233,19 @@ public:
     ///
     int used (void) const { return m_used; }
 
+    /// Is this tile from a coarse MIP level (one with only a few tiles)?
+    bool coarse () const { return m_coarse; }
+
+    /// Eviction credit for the "frequency" eviction policy.  Only ever
+    /// touched by the thread holding the tile sweep mutex.
+    int &credit () { return m_credit; }
+
     bool valid (void) const { return m_valid; }
 
+    /// Are the pixels held compressed?  If so, data() is not pixels, and
+    /// users need a decompressed copy (see ImageCacheImpl::find_tile).
+    bool compressed () const { return m_compressed; }
+
     /// Are the pixels ready for use?  If false, they're still being
     /// read from disk.
     bool pixels_ready () const { return m_pixels_ready; }
@@ -642,13 +1259,21 @@ public:
 
 private:
     TileID m_id;                  ///< ID of this tile
-    boost::scoped_array<char> m_pixels;  ///< The pixel data
+    OIIO::shared_ptr<char> m_pixels;  ///< The pixel data (maybe shared)
     size_t m_pixels_size;         ///< How much m_pixels has allocated
     int m_channelsize;            ///< How big is each channel (bytes)
     int m_pixelsize;              ///< How big is each pixel (bytes)
     bool m_valid;                 ///< Valid pixels
     volatile bool m_pixels_ready; ///< The pixels have been read from disk
+    bool m_compressed;            ///< m_pixels holds the compressed pixels
+    bool m_coarse;                ///< From a coarse MIP level
+    int m_credit;                 ///< Eviction credit (see credit())
     atomic_int m_used;            ///< Used recently
+    intrusive_ptr<ImageCacheTile> m_source; ///< Compressed original, if a copy
+
+    void init_coarse ();
+    // Replace the pixels with their compressed form, if it's smaller.
+    void compress (ImageCachePerThreadInfo *thread_info);
 };
 
 
@@ -663,6 +1288,388 @@ typedef intrusive_ptr<ImageCacheTile> ImageCacheTileRef;
 /// main tile cache.
 typedef unordered_map_concurrent<TileID, ImageCacheTileRef, TileID::Hasher, std::equal_to<TileID>, 32> TileCache;
 
+/// Tiles that nonblocking lookups have queued for the I/O threads but
+/// that aren't yet in the cache.
+typedef unordered_map_concurrent<TileID, int, TileID::Hasher, std::equal_to<TileID>, 8> PendingTileMap;
+
+
+/// Pointer load with acquire semantics and pointer store with release
+/// semantics, used by the lock-free TileIndex.
+template<class T>
+inline T* tileindex_load (T* const volatile *p)
+{
+#if defined(OIIO_USE_GCC_NEW_ATOMICS)
+    return __atomic_load_n (p, __ATOMIC_ACQUIRE);
+#elif defined(USE_GCC_ATOMICS)
+    T* r = *p;
+    __sync_synchronize ();
+    return r;
+#else
+    // MSVC: volatile reads have acquire semantics.
+    return *p;
+#endif
+}
+
+template<class T>
+inline void tileindex_store (T* volatile *p, T* val)
+{
+#if defined(OIIO_USE_GCC_NEW_ATOMICS)
+    __atomic_store_n (p, val, __ATOMIC_RELEASE);
+#elif defined(USE_GCC_ATOMICS)
+    __sync_synchronize ();
+    *p = val;
+#else
+    // MSVC: volatile writes have release semantics.
+    *p = val;
+#endif
+}
+
+
+
+/// TileIndex is a read-mostly hash table mirroring the contents of the
+/// main TileCache, whose lookups take no locks and write no shared
+/// memory.  The TileCache remains the authority (it is what the sweeper
+/// and invalidation iterate over); every tile added to it is also
+/// inserted here, and every tile erased from it is also unlinked from
+/// here.
+///
+/// Readers walk the bucket chains with plain acquire loads.  Writers
+/// serialize per bucket stripe, publish new nodes at the head of a chain
+/// with a release store, and never free an unlinked node directly --
+/// instead they hand it back to the ImageCacheImpl, which frees it (and
+/// drops its tile reference) only once no reader could still be looking
+/// at it.  That epoch-based reclamation is what makes it safe for a
+/// reader to take a reference to a tile it found without any lock.
+class TileIndex {
+public:
+    struct Node {
+        Node (const TileID &id, ImageCacheTile *tile)
+            : id(id), tile(tile), next(NULL), retired_epoch(0) { }
+        TileID id;
+        ImageCacheTileRef tile;
+        Node * volatile next;
+        long long retired_epoch;
+    };
+
+    TileIndex ();
+    ~TileIndex ();
+
+    /// Find the tile with the given id, or return NULL. The caller must
+    /// be inside a read epoch (see ImageCachePerThreadInfo::
+    /// enter_tileindex), and must take its own reference to the tile
+    /// before leaving it.
+    ImageCacheTile *find (const TileID &id) const {
+        Node *n = tileindex_load (&m_buckets[whichbucket(id)]);
+        for ( ;  n;  n = tileindex_load (&n->next))
+            if (n->id == id)
+                return n->tile.get();
+        return NULL;
+    }
+
+    /// Return the writer mutex guarding the given id.  The caller must
+    /// hold it around insert() and unlink(), as well as around the
+    /// matching TileCache insert or erase, so that the two tables can't
+    /// be seen to disagree by another writer.
+    spin_mutex &write_mutex (const TileID &id) {
+        return m_write_mutex[whichbucket(id)];
+    }
+
+    /// Add the tile, unless its id is already present (in which case
+    /// return false).
+    bool insert (ImageCacheTile *tile);
+
+    /// Unlink the node with the given id and return it so that it can be
+    /// retired, or return NULL if there is no such node.
+    Node *unlink (const TileID &id);
+
+private:
+    static const int log2buckets = 16;
+    static const size_t nbuckets = size_t(1) << log2buckets;
+
+    size_t whichbucket (const TileID &id) const {
+        uint64_t h = murmur::fmix (uint64_t(id.hash()));
+        return size_t(h) & (nbuckets-1);
+    }
+
+    Node * volatile *m_buckets;  ///< Heads of the bucket chains
+    // Writers lock a stripe of buckets; readers never lock.
+    mutex_pool<spin_mutex, size_t, hash<size_t>, 64> m_write_mutex;
+};
+
+
+
+/// TileAllocator hands out tile pixel buffers carved from slabs of
+/// equal-size blocks, one set of slabs for each distinct tile size.  A
+/// freed block goes back on its slab's free list and is reused by the
+/// next tile of that size, so the constant churn of same-size tiles
+/// doesn't fragment the heap.  A slab whose blocks are all free is
+/// returned to the system, except for one spare of each size.  There is
+/// one allocator for the whole process, which is never destroyed, so
+/// tiles may safely outlive the ImageCache that made them. Thread-safe.
+class TileAllocator {
+public:
+    /// Return a buffer of at least size bytes.  Set blocksize to the
+    /// memory it really accounts for, including its share of the slab.
+    OIIO::shared_ptr<char> allocate (size_t size, size_t &blocksize);
+
+    /// Total bytes of all the slabs obtained from the system.
+    long long slab_bytes () const { return m_slab_bytes; }
+    /// Total bytes of the blocks currently handed out.
+    long long used_bytes () const { return m_used_bytes; }
+
+    static TileAllocator &instance ();
+
+private:
+    struct SizeClass;
+    struct Slab;
+    struct Deleter;
+    TileAllocator () : m_slab_bytes(0), m_used_bytes(0) { }
+    SizeClass *size_class (size_t size);
+    void free (Slab *slab, char *block);
+
+    spin_mutex m_classes_mutex;         ///< Protects m_classes
+    std::vector<SizeClass *> m_classes; ///< One for each block size
+    atomic_ll m_slab_bytes;
+    atomic_ll m_used_bytes;
+};
+
+
+
+/// TileDiskCache is an optional second cache tier: tiles evicted from
+/// memory are written, already decoded, to fixed-size slots of a
+/// memory-mapped file on a local disk, so that a later miss on the same
+/// tile can be satisfied by a copy rather than a re-read and decompress
+/// of the original file.  Slots are recycled in FIFO order.  Tiles too
+/// big for a slot are not spilled.  Thread-safe.
+class TileDiskCache {
+public:
+    TileDiskCache ();
+    ~TileDiskCache () { close (); }
+
+    /// (Re)create the backing file in the given directory with room for
+    /// the given number of bytes, discarding any current contents.
+    /// Return true if ok, or false (storing a message in err) if the
+    /// file could not be made.
+    bool init (const std::string &dir, imagesize_t size, std::string &err);
+
+    /// Discard the contents and release the backing file.
+    void close ();
+
+    /// Is there a backing file?
+    bool enabled () const { return m_base != NULL; }
+
+    /// Save the pixels of a tile that's being evicted from memory.
+    void store (ImageCacheTile &tile);
+
+    /// If the tile is in the disk cache, return a new memory tile made
+    /// from its pixels, otherwise return NULL.
+    ImageCacheTile *load (const TileID &id);
+
+    /// Forget all tiles belonging to the given file (or all tiles, if
+    /// file is NULL).
+    void invalidate (const ImageCacheFile *file);
+
+    /// Size of each slot.
+    static const size_t slot_bytes = 256*1024;
+
+private:
+    typedef unordered_map<TileID, size_t, TileID::Hasher> SlotMap;
+    mutex m_mutex;
+    char *m_base;                   ///< Start of the mapped file
+    size_t m_nslots;                ///< Number of slots
+    std::vector<TileID> m_slot_id;  ///< Tile in each slot (empty if none)
+    SlotMap m_slots;                ///< Which slot holds each tile
+    size_t m_next;                  ///< Next slot to (re)use
+    int m_fd;                       ///< File descriptor of the mapped file
+};
+
+
+
+/// SharedTileCache is an optional tier of decoded tiles in a named POSIX
+/// shared memory segment, so that cooperating processes on the same
+/// host can share tiles that any one of them has read.  Since TileIDs
+/// hold process-local pointers, tiles are identified across processes
+/// by a 64-bit key for the file (from its fingerprint if it has one,
+/// otherwise its name and modification time) plus the tile coordinates.
+/// A slot only answers for a tile whose size, data type, and the cache
+/// settings that change decoded pixels all match the ones it was stored
+/// with, since processes sharing a segment needn't be configured alike.
+/// The segment is a direct-mapped table of fixed-size slots, each with
+/// its own lock word; a new tile simply replaces whatever tile
+/// previously hashed to its slot.  A process that can't get a slot lock
+/// promptly treats it as a miss; the lock word holds the owner's pid and
+/// when it was taken, so a lock whose owner died (or that has been held
+/// implausibly long) is taken over rather than lost for good.
+/// Thread-safe and process-safe.
+class SharedTileCache {
+public:
+    SharedTileCache ();
+    ~SharedTileCache () { close (); }
+
+    /// Attach to (creating if necessary) the named shared memory segment,
+    /// of the given size if it's created.  Return true if ok, or false
+    /// (storing a message in err) if it couldn't be attached.
+    bool init (const std::string &name, imagesize_t size, std::string &err);
+
+    /// Detach from the shared segment (it persists for other processes).
+    void close ();
+
+    /// Are we attached to a segment?  (Just a hint for whether to call
+    /// store and load, which check again under the lock.)
+    bool enabled () const { return m_base != NULL; }
+
+    /// Publish the pixels of a tile we have read.
+    void store (ImageCacheTile &tile);
+
+    /// If the tile is in the shared cache, return a new memory tile made
+    /// from its pixels, otherwise return NULL.
+    ImageCacheTile *load (const TileID &id);
+
+    /// Size of the pixel area of each slot.
+    static const size_t slot_bytes = 256*1024;
+
+private:
+    struct SlotHeader;
+    SlotHeader *slot (const TileID &id, uint64_t filekey) const;
+    static uint64_t filekey (const ImageCacheFile &file);
+    static uint64_t layoutkey (const TileID &id);
+    static bool lock_slot (SlotHeader *s);
+    static void unlock_slot (SlotHeader *s);
+
+    // Held for reading by store and load, and for writing while the
+    // segment is mapped or unmapped.
+    mutable spin_rw_mutex m_mutex;
+    char * volatile m_base;         ///< Start of the mapped segment
+    size_t m_mapsize;               ///< Size of the mapping
+    size_t m_nslots;                ///< Number of slots
+};
+
+
+
+/// RemoteTileCache is an optional tier of decoded tiles fetched over TCP
+/// from another ImageCache -- a peer render node, or a rack-local
+/// machine dedicated to it -- that serves its tiles with a
+/// RemoteTileServer.  Tiles are asked for by the file's name and
+/// fingerprint plus the tile coordinates, so only files with a
+/// fingerprint (as written by maketx) use the tier.  A server that fails
+/// or doesn't answer promptly is left alone for a few seconds, so a dead
+/// peer costs little.  Thread-safe.
+class RemoteTileCache {
+public:
+    RemoteTileCache ();
+    ~RemoteTileCache () { close (); }
+
+    /// Use the server at "host" or "host:port".  Return true if ok, or
+    /// false (storing a message in err) if the address is malformed.
+    bool init (const std::string &server, std::string &err);
+
+    /// Stop using the server.
+    void close ();
+
+    /// Is there a server?
+    bool enabled () const {
+        spin_lock lock (m_mutex);
+        return m_impl.get() != NULL;
+    }
+
+    /// If the server can supply the tile, return a new memory tile made
+    /// from its pixels, otherwise return NULL.
+    ImageCacheTile *load (const TileID &id);
+
+private:
+    class Impl;
+    // Lookups in progress hold their own reference, so init() and
+    // close() may replace the server while they run.
+    OIIO::shared_ptr<Impl> m_impl;
+    mutable spin_mutex m_mutex;   ///< Protects m_impl
+};
+
+
+
+/// RemoteTileServer answers RemoteTileCache requests from other hosts
+/// with tiles from an ImageCache, reading them (into that cache) if they
+/// aren't already resident.
+class RemoteTileServer {
+public:
+    RemoteTileServer (ImageCacheImpl &ic);
+    ~RemoteTileServer () { stop (); }
+
+    /// Start serving on the given TCP port of the local interface with
+    /// the given IP address, with nthreads threads, stopping any previous
+    /// server first.  A port of 0 just stops.  Return true if ok, or
+    /// false (storing a message in err).
+    bool start (const std::string &address, int port, int nthreads,
+                std::string &err);
+
+    /// Stop serving and wait for the server threads to finish.
+    void stop ();
+
+private:
+    class Impl;
+    ImageCacheImpl &m_ic;
+    Impl *m_impl;
+};
+
+
+
+/// FileWatcher keeps track of which files were changed on disk since it
+/// was last asked, so that invalidate_all() need not check every file.
+/// It uses inotify where available, otherwise (and for files on network
+/// file systems) a background thread that polls the files' modification
+/// times.  Thread-safe.
+class FileWatcher {
+public:
+    FileWatcher () : m_impl(NULL) { }
+    ~FileWatcher () { stop (); }
+
+    /// Start watching (forgetting any earlier watches), polling every
+    /// interval seconds if there's no native notification.
+    void start (float interval);
+
+    /// Stop watching.
+    void stop ();
+
+    /// Are we watching?
+    bool active () const { return m_impl != NULL; }
+
+    /// Name of the mechanism used ("inotify", "polling", or
+    /// "inotify+polling").
+    const char *backend () const;
+
+    /// Watch the file, reporting changes to it under the name key.
+    void watch (const std::string &filename, ustring key);
+
+    /// Append to keys the names of the watched files changed since the
+    /// last call (or that can't be watched).  Return false if changes may
+    /// have been missed, in which case the caller must check all files.
+    bool changed (std::vector<ustring> &keys);
+
+private:
+    class Impl;
+    Impl *m_impl;
+};
+
+
+
+/// One thread's counts of its reads from one file, kept privately by the
+/// thread so that many threads using the same file don't all write to
+/// the ImageCacheFile, and gathered into the file's totals by
+/// ImageCacheImpl::merge_file_stats.
+struct FileStats {
+    long long tilesread;            ///< Tiles (or scanline bands) read
+    long long bytesread;            ///< Bytes read
+    long long redundant_tiles;      ///< Tiles read that had been before
+    long long redundant_bytesread;  ///< Bytes of those tiles
+    double iotime;                  ///< Time opening and reading the file
+    std::vector<long long> mipreadcount; ///< Tile reads per MIP level
+
+    FileStats () : tilesread(0), bytesread(0), redundant_tiles(0),
+                   redundant_bytesread(0), iotime(0.0) { }
+};
+
+typedef unordered_map<ImageCacheFile *, FileStats> FileStatsMap;
+
+
 
 /// A very small amount of per-thread data that saves us from locking
 /// the mutex quite as often.  We store things here used by both
@@ -671,23 +1678,55 @@ typedef unordered_map_concurrent<TileID, ImageCacheTileRef, TileID::Hasher, std:
 /// even if you are using only ImageCache but not TextureSystem.
 class ImageCachePerThreadInfo {
 public:
-    // Store just a few filename/fileptr pairs
-    static const int nlastfile = 4;
+    // Direct-mapped cache of recently used filename/fileptr pairs,
+    // indexed by the (precomputed) ustring hash, so that lookups by name
+    // cost about the same as using a TextureHandle directly.
+    static const int nlastfile = 64;
     ustring last_filename[nlastfile];
     ImageCacheFile *last_file[nlastfile];
-    int next_last_file;
-    // We have a two-tile "microcache", storing the last two tiles needed.
-    ImageCacheTileRef tile, lasttile;
+    // The tile "microcache" is a small set-associative cache of the
+    // most recently needed tiles, indexed by TileID hash, with each set
+    // kept in most-recently-used order.  'tile' is always the tile most
+    // recently found.
+    static const int microcache_ways = 4;
+    ImageCacheTileRef tile;
+    std::vector<ImageCacheTileRef> microcache;
+    unsigned int microcache_setmask;
     atomic_int purge;   // If set, tile ptrs need purging!
     ImageCacheStatistics m_stats;
+    std::vector<unsigned char> tile_scratch; ///< For (de)compressing tiles
+    // FastTimer ticks this thread has spent in find_tile_main_cache while
+    // "texture_profile" is on, so filter times can exclude them.
+    long long profile_tile_ticks;
+    // Ring buffer of this thread's "trace" events, oldest at trace_next
+    // once it's full.  The lock only keeps out the exporting thread.
+    spin_mutex trace_mutex;
+    std::vector<TraceEvent> trace;
+    size_t trace_next;
+    int trace_tid;     // Thread number for the trace output
+    // This thread's per-file counters, since the last merge_file_stats.
+    // The lock only keeps out the merging thread.
+    spin_mutex file_stats_mutex;
+    FileStatsMap file_stats;
     bool shared;   // Pointed to both by the IC and the thread_specific_ptr
-
-    ImageCachePerThreadInfo ()
-        : next_last_file(0), shared(false)
+    bool nonblocking;  // find_tile queues missing tiles rather than reading
+    bool tile_pending; // find_tile failed because of nonblocking
+    bool serving_remote; // A RemoteTileServer thread: skip the remote tier
+    // Epoch in which this thread is reading the lock-free TileIndex, or 0
+    // if it's not. Padded to its own cache line, since other threads read
+    // it when reclaiming retired index nodes.
+    char pad0_[OIIO_CACHE_LINE_SIZE];
+    atomic_ll tileindex_epoch;
+    char pad1_[OIIO_CACHE_LINE_SIZE];
+
+    ImageCachePerThreadInfo (int microcache_size = 16)
+        : profile_tile_ticks(0), trace_next(0), trace_tid(0),
+          shared(false), nonblocking(false), tile_pending(false),
+          serving_remote(false), tileindex_epoch(0)
     {
         // std::cout << "Creating PerThreadInfo " << (void*)this << "\n";
-        for (int i = 0;  i < nlastfile;  ++i)
-            last_file[i] = NULL;
+        clear_filecache ();
+        set_microcache_size (microcache_size);
         purge = 0;
     }
 
@@ -695,21 +1734,94 @@ public:
         // std::cout << "Destroying PerThreadInfo " << (void*)this << "\n";
     }
 
-    // Add a new filename/fileptr pair to our microcache
+    // Count a tile (or other chunk of pixels) of the file having been
+    // read, and how many bytes it was.
+    void count_tile_read (ImageCacheFile *file, size_t bytes) {
+        spin_lock lock (file_stats_mutex);
+        FileStats &f (file_stats[file]);
+        ++f.tilesread;
+        f.bytesread += (long long) bytes;
+    }
+
+    // Count n more (or, if negative, fewer) tile reads from the MIP level.
+    void count_mip_read (ImageCacheFile *file, int miplevel, int n = 1) {
+        spin_lock lock (file_stats_mutex);
+        std::vector<long long> &m (file_stats[file].mipreadcount);
+        if (int(m.size()) <= miplevel)
+            m.resize (miplevel+1, 0);
+        m[miplevel] += n;
+    }
+
+    // Count a tile read from the file that had been read before.
+    void count_redundant_tile (ImageCacheFile *file, size_t bytes) {
+        spin_lock lock (file_stats_mutex);
+        FileStats &f (file_stats[file]);
+        ++f.redundant_tiles;
+        f.redundant_bytesread += (long long) bytes;
+    }
+
+    // Count time spent opening or reading the file.
+    void count_iotime (ImageCacheFile *file, double t) {
+        spin_lock lock (file_stats_mutex);
+        file_stats[file].iotime += t;
+    }
+
+    // Add a new filename/fileptr pair to our microcache, replacing
+    // whatever was in its slot.
     void filename (ustring n, ImageCacheFile *f) {
-        last_filename[next_last_file] = n;
-        last_file[next_last_file] = f;
-        ++next_last_file;
-        next_last_file %= nlastfile;
+        int i = filecache_slot (n);
+        last_filename[i] = n;
+        last_file[i] = f;
     }
 
     // See if a filename has a fileptr in the microcache
     ImageCacheFile *find_file (ustring n) const {
-        for (int i = 0;  i < nlastfile;  ++i)
-            if (last_filename[i] == n)
-                return last_file[i];
-        return NULL;
+        int i = filecache_slot (n);
+        return last_filename[i] == n ? last_file[i] : NULL;
+    }
+
+    // Forget all filename/fileptr pairs in the microcache.
+    void clear_filecache () {
+        for (int i = 0;  i < nlastfile;  ++i) {
+            last_filename[i] = ustring();
+            last_file[i] = NULL;
+        }
+    }
+
+    static int filecache_slot (ustring n) {
+        // Fold in the high bits, in case the low ones are poorly mixed.
+        size_t h = n.hash();
+        return int ((h ^ (h >> 16)) & (nlastfile-1));
+    }
+
+    // Empty the tile microcache and resize it to hold (at least) the
+    // given number of tiles, rounded up to a power-of-two number of sets.
+    void set_microcache_size (int size) {
+        int nsets = pow2roundup (std::max ((size + microcache_ways - 1)
+                                           / microcache_ways, 1));
+        tile = NULL;
+        microcache.clear ();
+        microcache.resize (nsets * microcache_ways);
+        microcache_setmask = (unsigned int)(nsets - 1);
+    }
+
+    // Drop all tile references held by the microcache.
+    void clear_microcache () {
+        tile = NULL;
+        for (size_t i = 0, e = microcache.size();  i < e;  ++i)
+            microcache[i] = NULL;
+    }
+
+    // Return the first way of the microcache set that tile id maps to.
+    ImageCacheTileRef *microcache_set (const TileID &id) {
+        return &microcache[(id.hash() & microcache_setmask) * microcache_ways];
     }
+
+    // Announce that we're about to read the TileIndex. The store is a
+    // full memory barrier, so it is visible before any of our reads of
+    // the index are.
+    void enter_tileindex (long long epoch) { tileindex_epoch.store (epoch); }
+    void exit_tileindex () { tileindex_epoch.store (0); }
 };
 
 
@@ -771,13 +1883,63 @@ public:
     const std::string &searchpath () const { return m_searchpath; }
     const std::string &plugin_searchpath () const { return m_plugin_searchpath; }
     int autotile () const { return m_autotile; }
+    int autotile_large_MB () const { return m_autotile_large_MB; }
+    size_t untiled_band_memory () const {
+        return size_t(m_untiled_band_memory_MB) * 1024 * 1024;
+    }
     bool autoscanline () const { return m_autoscanline; }
     bool automip () const { return m_automip; }
+    bool automip_async () const { return m_automip_async; }
+
+    /// The MIP resolution that texture lookups without priority are
+    /// currently limited to because of memory pressure, if "auto_lod" is
+    /// on (0 if they aren't limited).
+    int auto_lod_resolution () {
+        if (! m_auto_lod_resolution)
+            return 0;
+        update_auto_lod (0);   // Maybe the pressure is off now
+        return m_auto_lod_resolution;
+    }
     bool forcefloat () const { return m_forcefloat; }
+    bool deduplicate_tiles () const { return m_deduplicate_tiles; }
+    bool mmap_tiles () const { return m_mmap_tiles; }
+    MetadataIndex &metadata_index () { return m_metadata_index; }
+    bool compress_tiles () const { return m_compress_tiles; }
+    bool cache_channel_subsets () const { return m_cache_channel_subsets; }
     bool accept_untiled () const { return m_accept_untiled; }
     bool accept_unmipped () const { return m_accept_unmipped; }
     bool unassociatedalpha () const { return m_unassociatedalpha; }
     int failure_retries () const { return m_failure_retries; }
+    int max_inputs_per_file () const { return m_max_inputs_per_file; }
+    int coalesce_tiles () const { return m_coalesce_tiles; }
+    bool concurrent_reads () const { return m_concurrent_reads; }
+    int microcache_size () const { return m_microcache_size; }
+    bool texture_profile () const { return m_texture_profile; }
+
+    /// Is the "trace" attribute set?
+    bool tracing () const { return m_trace; }
+
+    /// Timer ticks since tracing began.
+    long long trace_ticks () const { return m_trace_timer.ticks(); }
+
+    /// TextureSystem lookups taking fewer Timer ticks aren't traced.
+    long long trace_lookup_ticks () const { return m_trace_lookup_ticks; }
+
+    /// Add the event to the trace of the given thread (or the calling
+    /// thread, if thread_info is NULL), overwriting its oldest event if
+    /// its buffer is full.
+    void trace_event (ImageCachePerThreadInfo *thread_info,
+                      const TraceEvent &event);
+
+    /// Return all threads' trace events in the Chrome trace event JSON
+    /// format (which Perfetto and chrome://tracing both read).
+    std::string trace_json () const;
+
+    /// The contention counters for the given lock site, or NULL if the
+    /// "lock_stats" attribute is off.
+    LockStats *lock_stats (LockSite site) const {
+        return m_lock_stats ? &m_lockstats[site] : NULL;
+    }
     bool latlong_y_up_default () const { return m_latlong_y_up_default; }
     void get_commontoworld (Imath::M44f &result) const {
         result = m_Mc2w;
@@ -845,6 +2007,18 @@ public:
                      stride_t zstride=AutoStride,
                      int cache_chbegin = 0, int cache_chend = -1);
 
+    /// Copy a region of pixels tile by tile, once get_pixels has resolved
+    /// its channel ranges and strides.  This is also what each band of a
+    /// parallel get_pixels runs.
+    bool get_pixels_serial (ImageCacheFile *file,
+                            ImageCachePerThreadInfo *thread_info,
+                            int subimage, int miplevel, int xbegin, int xend,
+                            int ybegin, int yend, int zbegin, int zend,
+                            int chbegin, int chend,
+                            int cache_chbegin, int cache_chend,
+                            TypeDesc format, void *result, stride_t xstride,
+                            stride_t ystride, stride_t zstride);
+
     /// Find the ImageCacheFile record for the named image, or NULL if
     /// no such file can be found.  This returns a plain old pointer,
     /// which is ok because the file hash table has ref-counted pointers
@@ -856,7 +2030,8 @@ public:
                                ImageCachePerThreadInfo *thread_info,
                                ImageInput::Creator creator=NULL,
                                bool header_only=false,
-                               const ImageSpec *config=NULL);
+                               const ImageSpec *config=NULL,
+                               ImageCache::TileProvider *provider=NULL);
 
     /// Verify & prep the ImageCacheFile record for the named image,
     /// return the pointer (which may have changed for deduplication),
@@ -880,6 +2055,9 @@ public:
         return handle  &&  ! handle->broken();
     }
 
+    virtual std::vector<ImageHandle *>
+        preload_files (array_view<const ustring> filenames, int nthreads);
+
     /// Is the tile specified by the TileID already in the cache?
     bool tile_in_cache (const TileID &id,
                         ImageCachePerThreadInfo *thread_info) {
@@ -901,22 +2079,41 @@ public:
     bool find_tile (const TileID &id, ImageCachePerThreadInfo *thread_info) {
         ++thread_info->m_stats.find_tile_calls;
         ImageCacheTileRef &tile (thread_info->tile);
-        if (tile) {
-            if (tile->id() == id) {
-                tile->use ();
-                return true;    // already have the tile we want
-            }
-            // Tile didn't match, maybe lasttile will?  Swap tile
-            // and last tile.  Then the new one will either match,
-            // or we'll fall through and replace tile.
-            tile.swap (thread_info->lasttile);
-            if (tile && tile->id() == id) {
+        if (tile && tile->id() == id) {
+            tile->use ();
+            return true;    // already have the tile we want
+        }
+        // Not the last tile, maybe it's elsewhere in its microcache set?
+        // If so, move it to the front of the set.
+        const int ways = ImageCachePerThreadInfo::microcache_ways;
+        ImageCacheTileRef *set = thread_info->microcache_set (id);
+        for (int w = 0;  w < ways;  ++w) {
+            if (set[w] && set[w]->id() == id) {
+                for ( ;  w > 0;  --w)
+                    set[w].swap (set[w-1]);
+                tile = set[0];
                 tile->use ();
                 return true;
             }
         }
-        return find_tile_main_cache (id, tile, thread_info);
-        // N.B. find_tile_main_cache marks the tile as used
+        if (! find_tile_main_cache (id, tile, thread_info))
+            return false;
+        // Compressed tiles are decompressed into a copy that lives only
+        // in this thread's microcache.
+        if (tile->compressed()) {
+            tile = new ImageCacheTile (tile.get(), thread_info);
+            if (! tile->valid())
+                return false;
+        }
+        // N.B. find_tile_main_cache marks the tile as used.  Add it to
+        // the front of its set, dropping the least recently used way.
+        // Look up the set again, because reading the tile may have
+        // purged (and resized) the microcache.
+        set = thread_info->microcache_set (id);
+        for (int w = ways-1;  w > 0;  --w)
+            set[w].swap (set[w-1]);
+        set[0] = tile;
+        return true;
     }
 
     virtual Tile *get_tile (ustring filename, int subimage, int miplevel,
@@ -924,12 +2121,52 @@ public:
     virtual Tile *get_tile (ImageHandle *file, Perthread *thread_info,
                             int subimage, int miplevel,
                             int x, int y, int z, int chbegin, int chend);
+    virtual bool get_tiles (ustring filename, int subimage, int miplevel,
+                            const ROI &roi, std::vector<Tile *> &tiles);
+    virtual bool get_tiles (ImageHandle *file, Perthread *thread_info,
+                            int subimage, int miplevel, const ROI &roi,
+                            std::vector<Tile *> &tiles);
     virtual void release_tile (Tile *tile) const;
     virtual TypeDesc tile_format (const Tile *tile) const;
     virtual ROI tile_roi (const Tile *tile) const;
     virtual const void * tile_pixels (Tile *tile, TypeDesc &format) const;
+    virtual bool prefetch_tiles (ustring filename, int subimage, int miplevel,
+                                 const ROI &roi);
+    virtual bool prefetch_tiles (ImageHandle *file, Perthread *thread_info,
+                                 int subimage, int miplevel, const ROI &roi);
+    virtual bool set_file_priority (ustring filename, int priority,
+                                    imagesize_t quota = 0);
+    virtual bool set_file_priority (ImageHandle *file, int priority,
+                                    imagesize_t quota = 0);
+
+    /// Read one tile on behalf of prefetch_tiles.  Called by the I/O
+    /// threads.
+    void prefetch_tile (const TileID &id);
+
+    /// Read one tile queued by a nonblocking find_tile.  Called by the
+    /// I/O threads.
+    void read_pending_tile (const TileID &id);
+
+    /// Is somebody waiting for this tile to be read: is it queued for the
+    /// I/O threads, or in the cache with its pixels not yet ready?
+    bool tile_awaiting_read (const TileID &id,
+                             ImageCachePerThreadInfo *thread_info);
+
+    /// Number of I/O threads (0 if prefetching is disabled).
+    int io_threads () const { return m_io_threads; }
+
+    /// Run the task on one of the I/O threads and return true, or return
+    /// false if there are none.
+    bool queue_io_task (const thread_pool::Task &task) {
+        if (m_io_threads < 1)
+            return false;
+        m_io_pool->push (task);
+        return true;
+    }
     virtual bool add_file (ustring filename, ImageInput::Creator creator,
                            const ImageSpec *config);
+    virtual bool add_procedural_file (ustring filename,
+                                      TileProvider *provider);
     virtual bool add_tile (ustring filename, int subimage, int miplevel,
                            int x, int y, int z,  int chbegin, int chend,
                            TypeDesc format, const void *buffer,
@@ -943,6 +2180,7 @@ public:
 
     virtual std::string geterror () const;
     virtual std::string getstats (int level=1) const;
+    virtual void get_metrics (Metrics &metrics) const;
     virtual void reset_stats ();
     virtual void invalidate (ustring filename);
     virtual void invalidate_all (bool force=false);
@@ -951,6 +2189,9 @@ public:
     ///
     void mergestats (ImageCacheStatistics &merged) const;
 
+    /// Gather all the threads' per-file counters into the files' totals.
+    void merge_file_stats () const;
+
     void operator delete (void *todel) { ::delete ((char *)todel); }
 
     /// Called when a new file is opened, so that the system can track
@@ -967,29 +2208,88 @@ public:
     /// the number of simultyaneously-opened files.
     void decr_open_files (void) {
         --m_stat_open_files_current;
+        ++m_stat_open_files_closed;
     }
 
+    /// Durations of tile misses and of file opens, for get_metrics.
+    LatencyRecorder &miss_latency () { return m_miss_latency; }
+    LatencyRecorder &open_latency () { return m_open_latency; }
+
+    /// Called when the main ImageInput of a file has been opened, and
+    /// how long that took, to put it in the right list of open files.
+    void file_opened (ImageCacheFile *file, double cost);
+
+    /// Called when the main ImageInput of a file has been closed.
+    void file_closed (ImageCacheFile *file);
+
     /// Called when a new tile is created, to update all the stats.
     ///
-    void incr_tiles (size_t size) {
+    void incr_tiles (ImageCacheFile &file, size_t size, bool coarse=false) {
         ++m_stat_tiles_created;
         ++m_stat_tiles_current;
         if (m_stat_tiles_current > m_stat_tiles_peak)
             m_stat_tiles_peak = m_stat_tiles_current;
         m_mem_used += size;
+        file.m_mem_used += size;
+        if (coarse)
+            m_mem_used_coarse += size;
     }
 
+    /// Return a tile pixel buffer of the given size (in bytes), holding
+    /// npixels copies of the pixelsize-byte value pixel (followed by
+    /// zero padding), shared by every tile of that one color.  A new
+    /// buffer is counted against the cache memory (and file) until the
+    /// last tile using it is freed.
+    OIIO::shared_ptr<char> constant_tile_pixels (ImageCacheFile &file,
+                                                 bool coarse,
+                                                 const char *pixel,
+                                                 int pixelsize,
+                                                 size_t npixels, size_t size);
+
+    /// Return the pixels of a tile already in memory whose contents have
+    /// the given key (see ImageCacheTile::read), or an empty pointer if
+    /// there aren't any.
+    OIIO::shared_ptr<char> find_tile_pixels (const std::string &key);
+
+    /// Remember that pels holds the pixels of tiles with the given key.
+    void add_tile_pixels (const std::string &key,
+                          const OIIO::shared_ptr<char> &pels);
+
     /// Called when a tile's pixel memory is allocated, but a new tile
     /// is not created.
-    void incr_mem (size_t size) {
+    void incr_mem (ImageCacheFile &file, size_t size, bool coarse=false) {
         m_mem_used += size;
+        file.m_mem_used += size;
+        if (coarse)
+            m_mem_used_coarse += size;
+    }
+
+    /// Called when memory that isn't any one tile's (such as the levels
+    /// made by background automip tasks) is allocated or freed.
+    void incr_mem (size_t size) { m_mem_used += size; }
+    void decr_mem (size_t size) {
+        m_mem_used -= size;
+        DASSERT (m_mem_used >= 0);
+    }
+
+    /// Called when pixel memory counted by incr_mem is freed, but no
+    /// tile is destroyed.
+    void decr_mem (ImageCacheFile &file, size_t size, bool coarse=false) {
+        m_mem_used -= size;
+        file.m_mem_used -= size;
+        if (coarse)
+            m_mem_used_coarse -= size;
+        DASSERT (m_mem_used >= 0);
     }
 
     /// Called when a tile is destroyed, to update all the stats.
     ///
-    void decr_tiles (size_t size) {
+    void decr_tiles (ImageCacheFile &file, size_t size, bool coarse=false) {
         --m_stat_tiles_current;
         m_mem_used -= size;
+        file.m_mem_used -= size;
+        if (coarse)
+            m_mem_used_coarse -= size;
         DASSERT (m_mem_used >= 0);
     }
 
@@ -1033,15 +2333,80 @@ public:
 private:
     void init ();
 
+    /// Verify the file for imagespec() and get_imagespec(), and check
+    /// that it has the given subimage and MIP level.  Return the
+    /// verified file, or NULL (having issued the error) if it's no good.
+    ImageCacheFile *verify_imagespec_file (ImageCacheFile *file,
+                                           ImageCachePerThreadInfo *thread_info,
+                                           int subimage, int miplevel);
+
     /// Find a tile identified by 'id' in the tile cache, paging it in if
     /// needed, and store a reference to the tile.  Return true if ok,
     /// false if no such tile exists in the file or could not be read.
+    /// If thread_info->nonblocking is set, a tile that isn't resident
+    /// yet is queued for the I/O threads instead, and false is returned
+    /// with thread_info->tile_pending set.
     bool find_tile_main_cache (const TileID &id, ImageCacheTileRef &tile,
                                ImageCachePerThreadInfo *thread_info);
 
     /// Enforce the max memory for tile data.
     void check_max_mem (ImageCachePerThreadInfo *thread_info);
 
+    /// Account for evicted bytes of tiles, and if a whole "auto_lod"
+    /// window has passed, lower the auto LOD resolution cap if we have
+    /// been thrashing, or raise it if we have not.
+    void update_auto_lod (long long evicted);
+
+    /// The largest finest-level resolution of the files we've read
+    /// tiles from.
+    int largest_resolution_in_use ();
+
+    /// Priority classes of set_file_priority run from -max_file_priority
+    /// to max_file_priority.
+    static const int max_file_priority = 2;
+
+    /// Tile eviction policies for check_max_mem.
+    enum EvictionPolicy {
+        EvictClock,      ///< One-bit clock: evict if unused since last sweep
+        EvictFrequency   ///< Clock with per-tile use credit, MIP-aware
+    };
+
+    /// Called by the sweeper (holding m_tile_sweep_mutex) for each tile
+    /// it visits: age the tile according to the eviction policy, and
+    /// return true if it should stay in the cache, false to evict it.
+    bool keep_tile (ImageCacheTile *tile);
+
+    /// Erase the tile from both the TileCache and the TileIndex.
+    void erase_tile (const TileID &id);
+
+    /// Set up the disk cache according to m_disk_cache_dir and
+    /// m_disk_cache_size.
+    void init_disk_cache ();
+
+    /// Start or stop m_filewatcher according to m_watch_files, watching
+    /// all the files already known.
+    void init_file_watcher ();
+
+    /// Attach to the shared cache according to m_shared_cache_name and
+    /// m_shared_cache_size.
+    void init_shared_cache ();
+
+    /// (Re)start the tile server according to m_remote_cache_serve and
+    /// m_remote_cache_serve_threads.
+    void init_remote_server ();
+
+    /// Save the current metadata index (if any) and switch to the one
+    /// named by m_metadata_index_file.
+    void init_metadata_index ();
+
+    /// Hand an unlinked TileIndex node over for deferred deletion.
+    void retire_tileindex_node (TileIndex::Node *node);
+
+    /// Free any retired TileIndex nodes that no reader could still be
+    /// looking at.  If force is true, free them all (only safe when no
+    /// other threads are using the cache).
+    void reclaim_tileindex_nodes (bool force=false);
+
     /// Internal statistics printing routine
     ///
     void printstats () const;
@@ -1050,6 +2415,34 @@ private:
     std::string onefile_stat_line (const ImageCacheFileRef &file,
                                    int i, bool includestats=true) const;
 
+    /// Return the per-file, per-MIP-level lookup profile as JSON, files
+    /// in order of decreasing total cost.  If maxfiles > 0, only include
+    /// that many of the most costly files.
+    std::string texture_profile_json (int maxfiles = 0) const;
+
+    /// Discard all threads' trace events and restart the trace clock.
+    void clear_trace ();
+
+    /// Write trace_json() to the "trace_file", if one was given.
+    void write_trace_file () const;
+
+    /// Append a tile that missed the cache to the "tile_record".
+    void record_tile (const TileID &id);
+
+    /// Write the tiles recorded so far to the "tile_record_file", in the
+    /// order they were first missed, and forget them.
+    void write_tile_record ();
+
+    /// Queue prefetches of the tiles listed in a file written by
+    /// write_tile_record, in order.  Return false (having issued an
+    /// error) if the file couldn't be read.
+    bool replay_tile_record (const std::string &filename);
+
+    /// Return a description of the contention measured for each lock
+    /// site (and the ustring table) since "lock_stats" was set or the
+    /// stats were last reset, one line per lock, for getstats().
+    std::string lock_contention_stats () const;
+
     /// Search the fingerprint table for the given fingerprint.  If it
     /// doesn't already have an entry in the fingerprint map, then add
     /// one, mapping the it to file.  In either case, return the file it
@@ -1075,27 +2468,106 @@ private:
     std::string m_plugin_searchpath; ///< Colon-separated plugin directory list
     int m_autotile;              ///< if nonzero, pretend tiles of this size
     bool m_autoscanline;         ///< autotile using full width tiles
+    int m_autotile_large_MB;     ///< Autotile untiled images this big anyway
+    int m_untiled_band_memory_MB; ///< Scanline bands kept per untiled file
     bool m_automip;              ///< auto-mipmap on demand?
+    bool m_automip_async;        ///< auto-mipmap whole levels in background?
     bool m_forcefloat;           ///< force all cache tiles to be float
     bool m_accept_untiled;       ///< Accept untiled images?
     bool m_accept_unmipped;      ///< Accept unmipped images?
     bool m_read_before_insert;   ///< Read tiles before adding to cache?
     bool m_deduplicate;          ///< Detect duplicate files?
+    bool m_deduplicate_tiles;    ///< Share pixels of identical tiles?
+    bool m_mmap_tiles;           ///< Map uncompressed tiles from the file?
+    bool m_compress_tiles;       ///< Keep 8- and 16-bit tiles compressed?
+    bool m_cache_channel_subsets; ///< get_pixels caches just asked-for chans
     bool m_unassociatedalpha;    ///< Keep unassociated alpha files as they are?
     int m_failure_retries;       ///< Times to re-try disk failures
+    int m_max_inputs_per_file;   ///< Max concurrent ImageInputs per file
+    int m_coalesce_tiles;        ///< Max adjacent waited-for tiles per read
+    bool m_concurrent_reads;     ///< Read tiles without the file lock?
+    int m_get_pixels_parallel;   ///< Tiles for get_pixels to go parallel
+    int m_microcache_size;       ///< Tiles in each per-thread microcache
+    bool m_texture_profile;      ///< Gather per-level lookup costs?
+    bool m_lock_stats;           ///< Count contended lock acquisitions?
+    mutable LockStats m_lockstats[NumLockSites]; ///< ... by lock site
+    bool m_trace;                ///< Record events for trace_json?
+    int m_trace_events;          ///< Trace buffer size, events per thread
+    float m_trace_lookup_us;     ///< Trace texture lookups at least this slow
+    long long m_trace_lookup_ticks; ///< ... the same, in Timer ticks
+    std::string m_trace_file;    ///< Write the trace here when it stops
+    Timer m_trace_timer;         ///< Clock for the trace events
+    bool m_tile_record;          ///< Record the tiles that miss?
+    std::string m_tile_record_file; ///< Write the tile record here
+    spin_mutex m_tile_record_mutex; ///< Protects m_tile_record_ids
+    std::vector<TileID> m_tile_record_ids; ///< Tiles missed, in order
+    EvictionPolicy m_eviction_policy; ///< How check_max_mem picks victims
+    bool m_auto_lod;             ///< Cap texture resolution under pressure?
+    int m_auto_lod_min_resolution; ///< ... but never below this
+    atomic_int m_auto_lod_resolution; ///< The current cap (0 = none)
+    atomic_ll m_auto_lod_evicted; ///< Bytes evicted this window
+    double m_auto_lod_window_start; ///< When this window started
+    Timer m_auto_lod_timer;      ///< Clock for the windows
+    spin_mutex m_auto_lod_mutex; ///< Held while adjusting the cap
+    int m_io_threads;            ///< Number of prefetch I/O threads
+    thread_pool *m_io_pool;      ///< Threads servicing prefetch_tiles
+    PendingTileMap m_pending_tiles; ///< Tiles queued by nonblocking finds
     bool m_latlong_y_up_default; ///< Is +y the default "up" for latlong?
     Imath::M44f m_Mw2c;          ///< world-to-"common" matrix
     Imath::M44f m_Mc2w;          ///< common-to-world matrix
     ustring m_substitute_image;  ///< Substitute this image for all others
 
+    // Files with an open ImageInput, most recently opened (or given a
+    // second chance) first, in two lists: [1] for those that were much
+    // more expensive than average to open, [0] for the rest.
+    spin_mutex m_open_files_mutex; ///< Protects the lists and open costs
+    ImageCacheFile *m_open_files_head[2];
+    ImageCacheFile *m_open_files_tail[2];
+    int m_open_files_count[2];
+    int m_max_open_files_expensive; ///< Budget for list [1]
+    double m_open_cost_total;    ///< Total time of the opens so far
+    long long m_open_cost_count; ///< Number of opens timed
+    void lru_unlink (ImageCacheFile *file);
+    void lru_link_head (ImageCacheFile *file, int list);
+
     mutable FilenameMap m_files; ///< Map file names to ImageCacheFile's
-    ustring m_file_sweep_name;   ///< Sweeper for "clock" paging algorithm
     spin_mutex m_file_sweep_mutex; ///< Ensure only one in check_max_files
 
     spin_mutex m_fingerprints_mutex; ///< Protect m_fingerprints
     FingerprintMap m_fingerprints;  ///< Map fingerprints to files
+    spin_mutex m_constant_tiles_mutex; ///< Protect m_constant_tiles
+    std::map<std::string, OIIO::weak_ptr<char> > m_constant_tiles;
+                                 ///< Shared pixels of single-color tiles
+    size_t m_constant_tiles_prune; ///< Prune m_constant_tiles at this size
+    spin_mutex m_tile_pixels_mutex; ///< Protect m_tile_pixels
+    std::map<std::string, OIIO::weak_ptr<char> > m_tile_pixels;
+                                 ///< Pixels of in-memory tiles, by content
+    size_t m_tile_pixels_prune;  ///< Prune m_tile_pixels at this size
 
     TileCache m_tilecache;       ///< Our in-memory tile cache
+    TileDiskCache m_diskcache;   ///< Second-tier cache of evicted tiles
+    std::string m_disk_cache_dir; ///< Where to put the disk cache
+    float m_disk_cache_size;     ///< Size of the disk cache (MB)
+    SharedTileCache m_sharedcache; ///< Cross-process tier of decoded tiles
+    std::string m_shared_cache_name; ///< Name of the shared memory segment
+    float m_shared_cache_size;   ///< Size of the shared cache (MB)
+    RemoteTileCache m_remotecache; ///< Tier of tiles from a tile server
+    std::string m_remote_cache;  ///< Address of that tile server
+    RemoteTileServer m_remoteserver; ///< Serves our tiles to other hosts
+    int m_remote_cache_serve;    ///< Port to serve tiles on (0 = don't)
+    std::string m_remote_cache_serve_address; ///< Interface to serve on
+    int m_remote_cache_serve_threads; ///< Threads serving tiles
+    FileWatcher m_filewatcher;   ///< Notices files changed on disk
+    int m_watch_files;           ///< Use m_filewatcher in invalidate_all?
+    float m_watch_files_interval; ///< Polling interval of m_filewatcher
+    bool m_watch_automip;        ///< m_automip at last invalidate_all
+    MetadataIndex m_metadata_index; ///< Persistent record of file specs
+    std::string m_metadata_index_file; ///< Where m_metadata_index lives
+    atomic_ll m_mem_used_coarse; ///< Memory used by coarse MIP level tiles
+    TileIndex m_tileindex;       ///< Lock-free lookup index of m_tilecache
+    atomic_ll m_tileindex_epoch; ///< Current TileIndex reclamation epoch
+    spin_mutex m_tileindex_retired_mutex; ///< Protect retired list
+    std::vector<TileIndex::Node *> m_tileindex_retired; ///< Awaiting free
     TileID m_tile_sweep_id;      ///< Sweeper for "clock" paging algorithm
     spin_mutex m_tile_sweep_mutex; ///< Ensure only one in check_max_mem
 
@@ -1117,6 +2589,10 @@ private:
     atomic_int m_stat_open_files_created;
     atomic_int m_stat_open_files_current;
     atomic_int m_stat_open_files_peak;
+    atomic_int m_stat_open_files_closed;
+    LatencyRecorder m_miss_latency;
+    LatencyRecorder m_open_latency;
+    Timer m_metrics_timer;       ///< Clock for Metrics::time
 
     // Simulate an atomic double with a long long!
     void incr_time_stat (double &stat, double incr) {
@@ -1146,6 +2622,76 @@ private:
 
 
 
+/// Record the time from construction to destruction as a trace event of
+/// the given type, if the ImageCache is tracing (and, if min_ticks was
+/// called, only if it took at least that long).  If thread_info is NULL,
+/// the event goes to the calling thread's trace.
+class TraceScope {
+public:
+    TraceScope (ImageCacheImpl &ic, ImageCachePerThreadInfo *thread_info,
+                TraceEventType type, ustring filename = ustring(),
+                int subimage = -1, int miplevel = -1, int x = 0, int y = 0)
+        : m_ic(ic), m_thread_info(thread_info), m_min_ticks(0)
+    {
+        m_event.begin = -1;
+        if (ic.tracing ())
+            begin (type, filename, subimage, miplevel, x, y);
+    }
+    TraceScope (ImageCacheImpl &ic, ImageCachePerThreadInfo *thread_info,
+                TraceEventType type, const TileID &id)
+        : m_ic(ic), m_thread_info(thread_info), m_min_ticks(0)
+    {
+        m_event.begin = -1;
+        if (ic.tracing ())
+            begin (type, id.file().filename(), id.subimage(), id.miplevel(),
+                   id.x(), id.y());
+    }
+    ~TraceScope () {
+        if (m_event.begin < 0)
+            return;
+        m_event.end = m_ic.trace_ticks ();
+        if (m_event.end - m_event.begin >= m_min_ticks)
+            m_ic.trace_event (m_thread_info, m_event);
+    }
+    /// Only record the span if it lasts at least this many Timer ticks.
+    void min_ticks (long long ticks) { m_min_ticks = ticks; }
+private:
+    ImageCacheImpl &m_ic;
+    ImageCachePerThreadInfo *m_thread_info;
+    long long m_min_ticks;
+    TraceEvent m_event;
+    void begin (TraceEventType type, ustring filename,
+                int subimage, int miplevel, int x, int y) {
+        m_event.filename = filename;
+        m_event.type = (short) type;
+        m_event.subimage = (short) subimage;
+        m_event.miplevel = (short) miplevel;
+        m_event.x = x;
+        m_event.y = y;
+        m_event.begin = m_ic.trace_ticks ();
+    }
+};
+
+
+
+inline bool
+ImageCacheFile::forceopen (ImageCachePerThreadInfo *thread_info)
+{
+    counted_recursive_lock guard (m_input_mutex,
+                                  m_imagecache.lock_stats (LockFileInput));
+    return open (thread_info);
+}
+
+
+
+inline void
+ImageCacheFile::lock_input_mutex ()
+{
+    counted_lock (m_input_mutex, m_imagecache.lock_stats (LockFileInput));
+}
+
+
+
 }  // end namespace pvt
 
 OIIO_NAMESPACE_END
@@ -0,0 +1,688 @@
+/*
+  Copyright 2017 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+
+// The remote tile tier: a client that asks a peer ImageCache for tiles
+// over TCP, and the server that answers such requests from its own
+// cache.  Kept in its own file so that the asio headers don't weigh on
+// the rest of libtexture.
+
+// The boost::asio library uses functionality only available since Windows XP,
+// thus _WIN32_WINNT must be set to _WIN32_WINNT_WINXP (0x0501) or greater.
+#if defined(_WIN32) && !defined(_WIN32_WINNT)
+#  define _WIN32_WINNT 0x0501
+#endif
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#  include <sys/socket.h>
+#  include <sys/time.h>
+#endif
+
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/timer.h"
+#include "imagecache_pvt.h"
+
+using namespace boost::asio;
+
+
+OIIO_NAMESPACE_BEGIN
+    using namespace pvt;
+
+namespace pvt {
+
+namespace {
+
+// The protocol: the client sends a TileRequest followed by the file's
+// fingerprint and name, and the server answers with a TileReply
+// followed by 'size' bytes of decoded pixels, in the file's data type,
+// for the requested channels (or no pixels if it couldn't supply the
+// tile).  A connection carries any number of such exchanges in turn.
+
+const uint32_t request_magic = 0x4f494952;   // "OIIR"
+const uint32_t reply_magic = 0x4f494941;     // "OIIA"
+const char default_port[] = "10111";
+const uint32_t max_name_length = 4096;
+
+struct TileRequest {
+    uint32_t magic;
+    uint32_t fingerlen;   ///< Length of the fingerprint that follows
+    uint32_t namelen;     ///< Length of the filename that follows
+    int32_t subimage, miplevel, x, y, z, chbegin, chend;
+};
+
+struct TileReply {
+    uint32_t magic;
+    uint32_t found;       ///< 1 if pixels follow
+    uint64_t size;        ///< Bytes of pixels that follow
+};
+
+
+// How long a client waits on a server (to connect, or for each read and
+// write) before giving up on it, and how long it then leaves it alone
+// before trying it again.  The server gives a client the same time for
+// each part of an exchange, but lets it keep an idle connection between
+// exchanges for longer.
+const int io_timeout_ms = 2000;
+const double retry_seconds = 5.0;
+const int idle_timeout_seconds = 60;
+
+
+void
+set_timeouts (ip::tcp::socket &s)
+{
+#ifdef _WIN32
+    DWORD ms = io_timeout_ms;
+    setsockopt (s.native_handle(), SOL_SOCKET, SO_RCVTIMEO,
+                (const char *)&ms, sizeof(ms));
+    setsockopt (s.native_handle(), SOL_SOCKET, SO_SNDTIMEO,
+                (const char *)&ms, sizeof(ms));
+#else
+    struct timeval tv;
+    tv.tv_sec = io_timeout_ms / 1000;
+    tv.tv_usec = (io_timeout_ms % 1000) * 1000;
+    setsockopt (s.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt (s.native_handle(), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#endif
+    s.set_option (ip::tcp::no_delay (true));
+}
+
+}   // anon namespace
+
+
+
+class RemoteTileCache::Impl {
+public:
+    Impl (const std::vector<ip::tcp::endpoint> &endpoints)
+        : m_endpoints(endpoints), m_connecting(false), m_retry_at(0.0) { }
+    ~Impl () {
+        for (size_t i = 0;  i < m_idle.size();  ++i)
+            delete m_idle[i];
+    }
+
+    // Fetch the bytes of pixels of a tile into pixels.
+    bool fetch (const TileID &id, string_view finger, size_t bytes,
+                std::vector<char> &pixels);
+
+private:
+    // An idle connection (reused = true), or a new one, or NULL if there
+    // are none to be had right now.
+    ip::tcp::socket *connect (bool &reused);
+    bool connect_within_timeout (ip::tcp::socket &s);
+    bool exchange (ip::tcp::socket &s, const TileID &id, string_view finger,
+                   size_t bytes, std::vector<char> &pixels, bool &found);
+    void give_back (ip::tcp::socket *s) {
+        spin_lock lock (m_mutex);
+        m_idle.push_back (s);
+    }
+    void failed (ip::tcp::socket *s) {
+        delete s;
+        spin_lock lock (m_mutex);
+        m_retry_at = m_clock() + retry_seconds;
+    }
+
+    static void connected (boost::system::error_code *result,
+                           const boost::system::error_code &ec) {
+        *result = ec;
+    }
+    static void deadline (ip::tcp::socket *s,
+                          const boost::system::error_code &ec) {
+        if (ec != boost::asio::error::operation_aborted) {
+            boost::system::error_code ignored;
+            s->close (ignored);   // Aborts the connect
+        }
+    }
+
+    std::vector<ip::tcp::endpoint> m_endpoints;  ///< Resolved by init()
+    io_service m_io;         ///< Only run by the thread that's connecting
+    spin_mutex m_mutex;                    ///< Protects the members below
+    std::vector<ip::tcp::socket *> m_idle; ///< Connections not in use
+    bool m_connecting;       ///< Some thread is making a new connection
+    double m_retry_at;       ///< Don't connect before this time
+    Timer m_clock;
+};
+
+
+
+ip::tcp::socket *
+RemoteTileCache::Impl::connect (bool &reused)
+{
+    {
+        spin_lock lock (m_mutex);
+        if (! m_idle.empty()) {
+            ip::tcp::socket *s = m_idle.back();
+            m_idle.pop_back ();
+            reused = true;
+            return s;
+        }
+        // Only one thread at a time waits for a new connection; the
+        // others just miss rather than all hang on a server that may be
+        // down.  Nor do we hang on one that failed recently.
+        if (m_connecting || m_clock() < m_retry_at)
+            return NULL;
+        m_connecting = true;
+    }
+    reused = false;
+    ip::tcp::socket *s = new ip::tcp::socket (m_io);
+    bool ok = connect_within_timeout (*s);
+    if (ok)
+        set_timeouts (*s);
+    spin_lock lock (m_mutex);
+    m_connecting = false;
+    if (! ok) {
+        delete s;
+        m_retry_at = m_clock() + retry_seconds;
+        return NULL;
+    }
+    return s;
+}
+
+
+
+bool
+RemoteTileCache::Impl::connect_within_timeout (ip::tcp::socket &s)
+{
+    // A blocking connect could wait minutes for a host that's down or
+    // firewalled, so connect asynchronously and close the socket if it
+    // hasn't connected by the deadline.
+    boost::system::error_code ec = boost::asio::error::would_block;
+    deadline_timer timer (m_io);
+    timer.expires_from_now (boost::posix_time::milliseconds (io_timeout_ms));
+    timer.async_wait (boost::bind (&Impl::deadline, &s, placeholders::error));
+    async_connect (s, m_endpoints.begin(), m_endpoints.end(),
+                   boost::bind (&Impl::connected, &ec, placeholders::error));
+    m_io.reset ();
+    while (ec == boost::asio::error::would_block && m_io.run_one ())
+        ;
+    timer.cancel ();
+    m_io.poll ();   // Let the cancelled wait finish before timer goes away
+    return ! ec && s.is_open();
+}
+
+
+
+bool
+RemoteTileCache::Impl::fetch (const TileID &id, string_view finger,
+                              size_t bytes, std::vector<char> &pixels)
+{
+    // An idle connection may have been dropped by the server in the
+    // meantime, which is no reason to give up on the server; try once
+    // more with a new connection.
+    for (;;) {
+        bool reused = false;
+        ip::tcp::socket *s = connect (reused);
+        if (! s)
+            return false;
+        bool found = false;
+        if (exchange (*s, id, finger, bytes, pixels, found)) {
+            if (s->is_open())
+                give_back (s);
+            else
+                delete s;
+            return found;
+        }
+        if (! reused) {
+            failed (s);
+            return false;
+        }
+        delete s;
+    }
+}
+
+
+
+// One request and its reply over s.  Return false if the connection
+// failed, or true with found saying whether there were pixels.
+bool
+RemoteTileCache::Impl::exchange (ip::tcp::socket &s, const TileID &id,
+                                 string_view finger, size_t bytes,
+                                 std::vector<char> &pixels, bool &found)
+{
+    ustring filename = id.file().filename();
+    TileRequest req;
+    req.magic = request_magic;
+    req.fingerlen = (uint32_t) finger.size();
+    req.namelen = (uint32_t) filename.size();
+    req.subimage = id.subimage();
+    req.miplevel = id.miplevel();
+    req.x = id.x();
+    req.y = id.y();
+    req.z = id.z();
+    req.chbegin = id.chbegin();
+    req.chend = id.chend();
+    std::vector<const_buffer> out;
+    out.push_back (buffer (&req, sizeof(req)));
+    out.push_back (buffer (finger.data(), finger.size()));
+    out.push_back (buffer (filename.c_str(), filename.size()));
+    boost::system::error_code ec;
+    TileReply reply;
+    write (s, out, ec);
+    if (! ec)
+        read (s, buffer (&reply, sizeof(reply)), ec);
+    if (ec || reply.magic != reply_magic)
+        return false;
+    if (reply.found && reply.size != bytes) {
+        // The server is fine, it just has a different idea of this
+        // tile. Hang up rather than read pixels we can't use, but keep
+        // asking it for others.
+        boost::system::error_code ignored;
+        s.close (ignored);
+        return true;
+    }
+    if (reply.found) {
+        pixels.resize (bytes);
+        read (s, buffer (&pixels[0], bytes), ec);
+        if (ec)
+            return false;
+    }
+    found = reply.found != 0;
+    return true;
+}
+
+
+
+RemoteTileCache::RemoteTileCache ()
+{
+}
+
+
+
+bool
+RemoteTileCache::init (const std::string &server, std::string &err)
+{
+    close ();
+    if (server.empty())
+        return true;
+    // "host" or "host:port"
+    std::string host = server, port = default_port;
+    size_t colon = server.rfind (':');
+    if (colon != std::string::npos) {
+        host = server.substr (0, colon);
+        port = server.substr (colon+1);
+    }
+    if (host.empty() || port.empty()) {
+        err = Strutil::format ("bad remote tile cache address \"%s\"", server);
+        return false;
+    }
+    // Resolve the name now, since a lookup can block for as long as the
+    // name server takes, and we mustn't do that on a cache miss.
+    boost::system::error_code ec;
+    io_service io;
+    ip::tcp::resolver resolver (io);
+    ip::tcp::resolver::query query (host, port);
+    ip::tcp::resolver::iterator i = resolver.resolve (query, ec), end;
+    std::vector<ip::tcp::endpoint> endpoints;
+    for ( ;  ! ec && i != end;  ++i)
+        endpoints.push_back (*i);
+    if (endpoints.empty()) {
+        err = Strutil::format ("could not resolve remote tile cache \"%s\": %s",
+                               server, ec ? ec.message() : "no addresses");
+        return false;
+    }
+    OIIO::shared_ptr<Impl> impl (new Impl (endpoints));
+    spin_lock lock (m_mutex);
+    m_impl = impl;
+    return true;
+}
+
+
+
+void
+RemoteTileCache::close ()
+{
+    // The old server goes away when the last lookup using it is done.
+    OIIO::shared_ptr<Impl> old;
+    spin_lock lock (m_mutex);
+    m_impl.swap (old);
+}
+
+
+
+ImageCacheTile *
+RemoteTileCache::load (const TileID &id)
+{
+    // Without a fingerprint there's no telling whether the server's file
+    // of the same name has the same pixels.
+    OIIO::shared_ptr<Impl> impl;
+    {
+        spin_lock lock (m_mutex);
+        impl = m_impl;
+    }
+    if (! impl || id.file().fingerprint().empty())
+        return NULL;
+    TypeDesc format = id.file().datatype (id.subimage());
+    const ImageSpec &spec (id.file().spec (id.subimage(), id.miplevel()));
+    size_t bytes = spec.tile_pixels() * id.nchannels() * format.size();
+    std::vector<char> pixels;
+    if (! impl->fetch (id, id.file().fingerprint(), bytes, pixels))
+        return NULL;
+    return new ImageCacheTile (id, &pixels[0], format,
+                               AutoStride, AutoStride, AutoStride);
+}
+
+
+
+namespace {
+
+// One client connection to a RemoteTileServer.  Each exchange is a
+// chain of asynchronous reads and a write, and only one is outstanding
+// at a time.  Each of those steps has a deadline (socket timeouts don't
+// apply to asynchronous reads), so a client that goes quiet is hung up
+// on.  The handlers of a connection all run through its strand, so they
+// never run concurrently even with several threads running the
+// io_service.
+class ServerConnection
+    : public boost::enable_shared_from_this<ServerConnection> {
+public:
+    ServerConnection (io_service &io, ImageCacheImpl &ic)
+        : m_socket(io), m_strand(io), m_timer(io), m_ic(ic) { }
+
+    ip::tcp::socket &socket () { return m_socket; }
+
+    void start () {
+        // Between exchanges, the client may be holding on to the
+        // connection for later.
+        set_deadline (idle_timeout_seconds * 1000);
+        async_read (m_socket, buffer (&m_req, sizeof(m_req)),
+                    m_strand.wrap (boost::bind (&ServerConnection::got_request,
+                                   shared_from_this(), placeholders::error)));
+    }
+
+private:
+    void got_request (const boost::system::error_code &ec) {
+        if (ec || m_req.magic != request_magic ||
+              m_req.fingerlen > max_name_length ||
+              m_req.namelen > max_name_length || ! m_req.namelen) {
+            hang_up ();
+            return;
+        }
+        m_names.resize (m_req.fingerlen + m_req.namelen);
+        set_deadline (io_timeout_ms);
+        async_read (m_socket, buffer (&m_names[0], m_names.size()),
+                    m_strand.wrap (boost::bind (&ServerConnection::got_names,
+                                   shared_from_this(), placeholders::error)));
+    }
+
+    void got_names (const boost::system::error_code &ec) {
+        if (ec) {
+            hang_up ();
+            return;
+        }
+        serve ();
+        set_deadline (io_timeout_ms);
+        async_write (m_socket, buffer (m_reply),
+                     m_strand.wrap (boost::bind (&ServerConnection::wrote,
+                                    shared_from_this(), placeholders::error)));
+    }
+
+    void wrote (const boost::system::error_code &ec) {
+        if (ec)
+            hang_up ();
+        else
+            start ();
+    }
+
+    // (Re)start the clock on the operation about to be started.  Any wait
+    // already pending is cancelled.
+    void set_deadline (int ms) {
+        m_timer.expires_from_now (boost::posix_time::milliseconds (ms));
+        m_timer.async_wait (m_strand.wrap (boost::bind (&ServerConnection::expired,
+                                           shared_from_this(), placeholders::error)));
+    }
+
+    void expired (const boost::system::error_code &ec) {
+        // Cancelled, or reset after it went off but before we got here
+        if (ec == boost::asio::error::operation_aborted ||
+              m_timer.expires_at() > deadline_timer::traits_type::now())
+            return;
+        hang_up ();   // Aborts the pending read or write
+    }
+
+    // Close the socket and stop the clock, so that the last handler
+    // holding on to us returns and we go away.
+    void hang_up () {
+        boost::system::error_code ignored;
+        m_timer.cancel (ignored);
+        m_socket.close (ignored);
+    }
+
+    // Fill in m_reply for m_req.
+    void serve ();
+
+    ip::tcp::socket m_socket;
+    io_service::strand m_strand;
+    deadline_timer m_timer;
+    ImageCacheImpl &m_ic;
+    TileRequest m_req;
+    std::string m_names;
+    std::vector<char> m_reply;
+};
+
+
+
+void
+ServerConnection::serve ()
+{
+    TileReply reply;
+    reply.magic = reply_magic;
+    reply.found = 0;
+    reply.size = 0;
+    m_reply.assign ((const char *)&reply, (const char *)(&reply+1));
+
+    ImageCachePerThreadInfo *thread_info = m_ic.get_perthread_info ();
+    // Our own misses mustn't go back out to the remote tier, which may
+    // well be a peer pointing right back at us.
+    thread_info->serving_remote = true;
+    // Only ever answer for a fingerprinted file whose fingerprint the
+    // client already knows -- checked before even looking at the file.
+    if (! m_req.fingerlen)
+        return;
+    string_view finger (m_names.data(), m_req.fingerlen);
+    ustring filename (m_names.data() + m_req.fingerlen, m_req.namelen);
+    ImageCacheFile *file = m_ic.find_file (filename, thread_info);
+    file = m_ic.verify_file (file, thread_info);
+    if (! file || file->broken() || file->is_udim() ||
+          file->fingerprint() != finger)
+        return;
+    int subimage = m_req.subimage, miplevel = m_req.miplevel;
+    if (subimage < 0 || subimage >= file->subimages() ||
+          miplevel < 0 || miplevel >= file->miplevels(subimage))
+        return;
+    const ImageSpec &spec (file->spec (subimage, miplevel));
+    if (m_req.chbegin < 0 || m_req.chend > spec.nchannels ||
+          m_req.chbegin >= m_req.chend ||
+          (m_req.x - spec.x) % spec.tile_width ||
+          (m_req.y - spec.y) % spec.tile_height ||
+          (m_req.z - spec.z) % spec.tile_depth)
+        return;
+    TileID id (*file, subimage, miplevel, m_req.x, m_req.y, m_req.z,
+               m_req.chbegin, m_req.chend);
+    if (! m_ic.find_tile (id, thread_info) || ! thread_info->tile ||
+          ! thread_info->tile->valid())
+        return;
+    size_t bytes = spec.tile_pixels() * thread_info->tile->pixelsize();
+    const char *pixels = (const char *) thread_info->tile->data();
+    reply.found = 1;
+    reply.size = bytes;
+    m_reply.assign ((const char *)&reply, (const char *)(&reply+1));
+    m_reply.insert (m_reply.end(), pixels, pixels + bytes);
+}
+
+}   // anon namespace
+
+
+
+class RemoteTileServer::Impl {
+public:
+    Impl (ImageCacheImpl &ic) : m_ic(ic), m_acceptor(m_io) { }
+
+    bool start (const std::string &address, int port, int nthreads,
+                std::string &err);
+    void stop ();
+
+private:
+    void accept ();
+    void accepted (boost::shared_ptr<ServerConnection> conn,
+                   const boost::system::error_code &ec);
+
+    ImageCacheImpl &m_ic;
+    io_service m_io;
+    ip::tcp::acceptor m_acceptor;
+    thread_group m_threads;
+};
+
+
+
+// Run the server's io_service until it's stopped.
+struct RunIOService {
+    RunIOService (io_service &io) : io(io) { }
+    void operator() () {
+        boost::system::error_code ec;
+        io.run (ec);
+    }
+    io_service &io;
+};
+
+
+
+bool
+RemoteTileServer::Impl::start (const std::string &address, int port,
+                               int nthreads, std::string &err)
+{
+    boost::system::error_code ec;
+    ip::address ipaddr = ip::address::from_string (address, ec);
+    if (ec) {
+        err = Strutil::format ("could not serve tiles on \"%s\": %s",
+                               address, ec.message());
+        return false;
+    }
+    ip::tcp::endpoint endpoint (ipaddr, (unsigned short) port);
+    m_acceptor.open (endpoint.protocol(), ec);
+    if (! ec)
+        m_acceptor.set_option (ip::tcp::acceptor::reuse_address (true), ec);
+    if (! ec)
+        m_acceptor.bind (endpoint, ec);
+    if (! ec)
+        m_acceptor.listen (socket_base::max_connections, ec);
+    if (ec) {
+        err = Strutil::format ("could not serve tiles on %s port %d: %s",
+                               address, port, ec.message());
+        return false;
+    }
+    accept ();
+    for (int i = 0;  i < std::max (nthreads, 1);  ++i)
+        m_threads.create_thread (RunIOService (m_io));
+    return true;
+}
+
+
+
+void
+RemoteTileServer::Impl::stop ()
+{
+    m_io.stop ();
+    m_threads.join_all ();
+}
+
+
+
+void
+RemoteTileServer::Impl::accept ()
+{
+    boost::shared_ptr<ServerConnection> conn (new ServerConnection (m_io, m_ic));
+    m_acceptor.async_accept (conn->socket(),
+                             boost::bind (&Impl::accepted, this, conn,
+                                          placeholders::error));
+}
+
+
+
+void
+RemoteTileServer::Impl::accepted (boost::shared_ptr<ServerConnection> conn,
+                                  const boost::system::error_code &ec)
+{
+    if (! ec) {
+        set_timeouts (conn->socket());
+        conn->start ();
+    }
+    if (m_acceptor.is_open())
+        accept ();
+}
+
+
+
+RemoteTileServer::RemoteTileServer (ImageCacheImpl &ic)
+    : m_ic(ic), m_impl(NULL)
+{
+}
+
+
+
+bool
+RemoteTileServer::start (const std::string &address, int port, int nthreads,
+                         std::string &err)
+{
+    stop ();
+    if (port <= 0)
+        return true;
+    m_impl = new Impl (m_ic);
+    if (! m_impl->start (address, port, nthreads, err)) {
+        delete m_impl;
+        m_impl = NULL;
+        return false;
+    }
+    return true;
+}
+
+
+
+void
+RemoteTileServer::stop ()
+{
+    if (m_impl) {
+        m_impl->stop ();
+        delete m_impl;
+        m_impl = NULL;
+    }
+}
+
+}  // end namespace pvt
+
+OIIO_NAMESPACE_END
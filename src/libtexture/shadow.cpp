@@ -0,0 +1,306 @@
+/*
+  Copyright 2016 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+/// \file
+/// Implementation of shadow map lookups: percentage-closer filtering
+/// (PCF) of depth maps made with "maketx --shadow".
+
+
+#include <math.h>
+#include <algorithm>
+#include <limits>
+
+#include <OpenEXR/half.h>
+#include <OpenEXR/ImathMatrix.h>
+
+#include "OpenImageIO/dassert.h"
+#include "OpenImageIO/typedesc.h"
+#include "OpenImageIO/varyingref.h"
+#include "OpenImageIO/ustring.h"
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/fmath.h"
+#include "OpenImageIO/simd.h"
+#include "OpenImageIO/imageio.h"
+#include "OpenImageIO/texture.h"
+#include "OpenImageIO/imagecache.h"
+#include "imagecache_pvt.h"
+#include "texture_pvt.h"
+
+
+OIIO_NAMESPACE_BEGIN
+    using namespace pvt;
+    using namespace simd;
+
+namespace {  // anonymous
+
+static EightBitConverter<float> uchar2float;
+
+// Most texels we'll visit along each axis of the PCF footprint.  Larger
+// footprints are covered by that many evenly spaced, equally weighted
+// taps instead.
+static const int shadow_max_taps = 32;
+
+
+// Figure out the texels (and the weight of each) along one axis of the
+// PCF footprint spanning texel-space [lo,hi], where texel i covers
+// [i,i+1).  Pads the arrays with zero-weight taps up to a multiple of 4.
+// Return the number of taps.
+int
+pcf_taps (float lo, float hi, int *texel, float *weight)
+{
+    int n = 0;
+    if (hi - lo <= shadow_max_taps - 2) {
+        // Small footprint -- each texel is weighted by its overlap.
+        for (int i = ifloor(lo), e = ifloor(hi);  i <= e;  ++i) {
+            float w = std::min (hi, float(i+1)) - std::max (lo, float(i));
+            if (w > 0.0f) {
+                texel[n] = i;
+                weight[n] = w;
+                ++n;
+            }
+        }
+    } else {
+        float cellwidth = (hi - lo) / shadow_max_taps;
+        for ( ;  n < shadow_max_taps;  ++n) {
+            texel[n] = ifloor (lo + (n + 0.5f) * cellwidth);
+            weight[n] = cellwidth;
+        }
+    }
+    for (int i = n;  i & 3;  ++i) {
+        texel[i] = texel[0];
+        weight[i] = 0.0f;
+    }
+    return n;
+}
+
+
+inline float
+shadow_depth (const unsigned char *texel, TypeDesc::BASETYPE pixeltype)
+{
+    if (pixeltype == TypeDesc::FLOAT)
+        return *(const float *)texel;
+    if (pixeltype == TypeDesc::HALF)
+        return float (*(const half *)texel);
+    if (pixeltype == TypeDesc::UINT16)
+        return float (*(const unsigned short *)texel) * (1.0f/65535.0f);
+    DASSERT (pixeltype == TypeDesc::UINT8);
+    return uchar2float (*texel);
+}
+
+}  // end anonymous namespace
+
+
+namespace pvt {   // namespace pvt
+
+
+
+bool
+TextureSystemImpl::shadow (ustring filename, TextureOpt &options,
+                           const Imath::V3f &P, const Imath::V3f &dPdx,
+                           const Imath::V3f &dPdy, float *result,
+                           float *dresultds, float *dresultdt)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texturefile = find_texturefile (filename, thread_info);
+    return shadow ((TextureHandle *)texturefile, (Perthread *)thread_info,
+                   options, P, dPdx, dPdy, result, dresultds, dresultdt);
+}
+
+
+
+bool
+TextureSystemImpl::shadow (TextureHandle *texture_handle_,
+                           Perthread *thread_info_, TextureOpt &options,
+                           const Imath::V3f &P, const Imath::V3f &dPdx,
+                           const Imath::V3f &dPdy, float *result,
+                           float *dresultds, float *dresultdt)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    TextureFile *texturefile = verify_texturefile ((TextureFile *)texture_handle_, thread_info);
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    ++stats.shadow_batches;
+    ++stats.shadow_queries;
+
+    if (! texturefile  ||  texturefile->broken())
+        return missing_texture (options, 1, result, dresultds, dresultdt);
+
+    // The shadow value isn't differentiated.
+    if (dresultds) *dresultds = 0.0f;
+    if (dresultdt) *dresultdt = 0.0f;
+    return shadow_lookup (*texturefile, thread_info, options,
+                          P, dPdx, dPdy, result);
+}
+
+
+
+bool
+TextureSystemImpl::shadow (ustring filename, TextureOptions &options,
+                           Runflag *runflags, int beginactive, int endactive,
+                           VaryingRef<Imath::V3f> P,
+                           VaryingRef<Imath::V3f> dPdx,
+                           VaryingRef<Imath::V3f> dPdy,
+                           float *result, float *dresultds, float *dresultdt)
+{
+    Perthread *thread_info = get_perthread_info();
+    TextureHandle *texture_handle = get_texture_handle (filename, thread_info);
+    return shadow (texture_handle, thread_info, options,
+                   runflags, beginactive, endactive,
+                   P, dPdx, dPdy, result, dresultds, dresultdt);
+}
+
+
+
+bool
+TextureSystemImpl::shadow (TextureHandle *texture_handle_,
+                           Perthread *thread_info_, TextureOptions &options,
+                           Runflag *runflags, int beginactive, int endactive,
+                           VaryingRef<Imath::V3f> P,
+                           VaryingRef<Imath::V3f> dPdx,
+                           VaryingRef<Imath::V3f> dPdy,
+                           float *result, float *dresultds, float *dresultdt)
+{
+    // Verify the file and count the batch just once, rather than once
+    // per point.
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    TextureFile *texturefile = verify_texturefile ((TextureFile *)texture_handle_, thread_info);
+    bool valid = (texturefile && ! texturefile->broken());
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    ++stats.shadow_batches;
+
+    bool ok = true;
+    for (int i = beginactive;  i < endactive;  ++i) {
+        if (! runflags[i])
+            continue;
+        ++stats.shadow_queries;
+        TextureOpt opt (options, i);
+        float *ds = dresultds ? dresultds + i : NULL;
+        float *dt = dresultdt ? dresultdt + i : NULL;
+        if (! valid) {
+            ok &= missing_texture (opt, 1, result + i, ds, dt);
+            continue;
+        }
+        if (ds) *ds = 0.0f;
+        if (dt) *dt = 0.0f;
+        ok &= shadow_lookup (*texturefile, thread_info, opt,
+                             P[i], dPdx[i], dPdy[i], result + i);
+    }
+    return ok;
+}
+
+
+
+bool
+TextureSystemImpl::shadow_lookup (TextureFile &texturefile,
+                                  PerThreadInfo *thread_info,
+                                  TextureOpt &options,
+                                  const Imath::V3f &P, const Imath::V3f &dPdx,
+                                  const Imath::V3f &dPdy, float *result)
+{
+    *result = 0.0f;
+    const ImageSpec &spec (texturefile.spec (options.subimage, 0));
+    TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(options.subimage);
+
+    // Project P, and P offset by each derivative, into the shadow map's
+    // raster space, and find the depth of P as seen from the light.
+    Imath::V3f st, stx, sty, Plight;
+    texturefile.m_Mras.multVecMatrix (P, st);
+    texturefile.m_Mras.multVecMatrix (P+dPdx, stx);
+    texturefile.m_Mras.multVecMatrix (P+dPdy, sty);
+    texturefile.m_Mlocal.multVecMatrix (P, Plight);
+    float depth = Plight.z - options.bias;
+
+    // The PCF footprint is the box bounding the filter, in texels.  It
+    // is never smaller than one texel, which amounts to bilinearly
+    // interpolating the results of the depth comparisons.
+    float sradius = 0.5f * (options.swidth * std::max (fabsf(stx.x-st.x), fabsf(sty.x-st.x))
+                            + options.sblur * spec.full_width);
+    float tradius = 0.5f * (options.twidth * std::max (fabsf(stx.y-st.y), fabsf(sty.y-st.y))
+                            + options.tblur * spec.full_height);
+    sradius = std::max (sradius, 0.5f);
+    tradius = std::max (tradius, 0.5f);
+    float scenter = st.x, tcenter = st.y;
+
+    int stex[shadow_max_taps+4], ttex[shadow_max_taps+4];
+    float sweight[shadow_max_taps+4], tweight[shadow_max_taps+4];
+    int ns = pcf_taps (scenter - sradius, scenter + sradius, stex, sweight);
+    int nt = pcf_taps (tcenter - tradius, tcenter + tradius, ttex, tweight);
+
+    int tile_chbegin = 0, tile_chend = spec.nchannels;
+    if (spec.nchannels > m_max_tile_channels) {
+        tile_chbegin = options.firstchannel;
+        tile_chend = options.firstchannel+1;
+    }
+    TileID id (texturefile, options.subimage, 0, 0, 0, 0,
+               tile_chbegin, tile_chend);
+    size_t channelsize = texturefile.channelsize(options.subimage);
+    size_t chanoffset = (options.firstchannel - id.chbegin()) * channelsize;
+
+    // Compare the depths four texels at a time.  Texels outside the map
+    // (which is always black-wrapped) count as unoccluded.
+    const float far = std::numeric_limits<float>::max();
+    float4 occluded = 0.0f, total = 0.0f;
+    float4 depth4 = depth;
+    for (int j = 0;  j < nt;  ++j) {
+        int t = ttex[j];
+        bool tvalid = (t >= spec.y && t < spec.y+spec.height);
+        int tile_t = tvalid ? (t - spec.y) % spec.tile_height : 0;
+        for (int i = 0;  i < ns;  i += 4) {
+            float d[4] = { far, far, far, far };
+            for (int k = 0;  k < 4 && i+k < ns && tvalid;  ++k) {
+                int s = stex[i+k];
+                if (s < spec.x || s >= spec.x+spec.width)
+                    continue;
+                int tile_s = (s - spec.x) % spec.tile_width;
+                id.xy (s - tile_s, t - tile_t);
+                bool ok = find_tile (id, thread_info);
+                if (! ok)
+                    error ("%s", m_imagecache->geterror());
+                TileRef &tile (thread_info->tile);
+                if (! tile  ||  ! tile->valid())
+                    return false;
+                size_t offset = tile->pixelsize() * (tile_t * spec.tile_width + tile_s)
+                              + chanoffset;
+                d[k] = shadow_depth (tile->bytedata() + offset, pixeltype);
+            }
+            float4 w = float4(tweight[j]) * float4(sweight+i);
+            total += w;
+            occluded += blend0 (w, float4(d) < depth4);
+        }
+    }
+    float sum = reduce_add (total);
+    *result = sum > 0.0f ? reduce_add (occluded) / sum : 0.0f;
+    return true;
+}
+
+
+
+}  // end namespace pvt
+
+OIIO_NAMESPACE_END
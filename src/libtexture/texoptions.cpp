@@ -51,6 +51,7 @@ static float default_time = 0;
 static float default_bias = 0;
 static float default_fill = 0;
 static int   default_samples = 1;
+static float default_rnd = 0;
 
 static const ustring wrap_type_name[] = {
     // MUST match the order of TextureOptions::Wrap
@@ -80,7 +81,8 @@ TextureOptions::TextureOptions ()
       missingcolor(NULL),
       samples(default_samples),
       rwrap(TextureOptions::WrapDefault),
-      rblur(default_blur), rwidth(default_width)
+      rblur(default_blur), rwidth(default_width),
+      rnd(default_rnd)
 {
 }
 
@@ -102,7 +104,8 @@ TextureOptions::TextureOptions (const TextureOpt &opt)
       missingcolor((void *)opt.missingcolor),
       samples((int *)&opt.samples),
       rwrap((Wrap)opt.rwrap), rblur((float *)&opt.rblur),
-      rwidth((float *)&opt.rwidth)
+      rwidth((float *)&opt.rwidth),
+      rnd((float *)&opt.rnd)
 {
 }
 
@@ -125,6 +128,8 @@ TextureOpt::TextureOpt (const TextureOptions &opt, int index)
       samples(opt.samples[index]),
       rwrap((Wrap)opt.rwrap),
       rblur(opt.rblur[index]), rwidth(opt.rwidth[index]),
+      nonblocking(false), approximate(false), priority(0),
+      rnd(opt.rnd[index]), pointsample(false),
       envlayout(0)
 {
 }
@@ -34,6 +34,7 @@
 #include <sstream>
 #include <list>
 
+#include <OpenEXR/half.h>
 #include <OpenEXR/ImathMatrix.h>
 
 #include "OpenImageIO/dassert.h"
@@ -43,6 +44,7 @@
 #include "OpenImageIO/strutil.h"
 #include "OpenImageIO/thread.h"
 #include "OpenImageIO/fmath.h"
+#include "OpenImageIO/simd.h"
 #include "OpenImageIO/filter.h"
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/texture.h"
@@ -55,6 +57,7 @@
 OIIO_NAMESPACE_BEGIN
 using namespace pvt;
 using namespace f3dpvt;
+using namespace simd;
 
 namespace {  // anonymous
 
@@ -73,6 +76,41 @@ OIIO_FORCEINLINE float half2float (half val) {
     return float(val);
 }
 
+static float4 u8scale (1.0f/255.0f);
+static float4 u16scale (1.0f/65535.0f);
+
+// Load the (first four channels of the) texel at p, of the given pixel
+// type, into a float4.
+OIIO_FORCEINLINE float4 load_texel4 (const unsigned char *p,
+                                     TypeDesc::BASETYPE pixeltype) {
+    if (pixeltype == TypeDesc::UINT8)
+        return float4(p) * u8scale;
+    if (pixeltype == TypeDesc::UINT16)
+        return float4((const unsigned short *)p) * u16scale;
+    if (pixeltype == TypeDesc::HALF)
+        return float4((const half *)p);
+    DASSERT (pixeltype == TypeDesc::FLOAT);
+    return float4((const float *)p);
+}
+
+
+// If the tile holding texel (x,y,z) is known to be a single color (see
+// "oiio:ConstantTiles", which the field3d reader sets for the empty
+// blocks of sparse fields), return its channel values, otherwise NULL.
+// Lookups that stay within such a tile don't need the tile at all.
+OIIO_FORCEINLINE const float *
+constant_tile_color (const pvt::ImageCacheFile::LevelInfo &levelinfo,
+                     const ImageSpec &spec, int x, int y, int z)
+{
+    if (levelinfo.constant_tiles.empty())
+        return NULL;
+    int whichtile = (x - spec.x) / spec.tile_width
+                  + ((y - spec.y) / spec.tile_height) * levelinfo.nxtiles
+                  + ((z - spec.z) / spec.tile_depth) * (levelinfo.nxtiles*levelinfo.nytiles);
+    int index = levelinfo.constant_tiles[whichtile];
+    return index >= 0 ? &levelinfo.constant_colors[index * spec.nchannels] : NULL;
+}
+
 
 }  // end anonymous namespace
 
@@ -80,6 +118,68 @@ namespace pvt {   // namespace pvt
 
 
 
+bool
+TextureSystemImpl::texture3d_setup (TextureFile *texturefile,
+                                    TextureOpt &options)
+{
+    if (options.subimagename) {
+        // If subimage was specified by name, figure out its index.
+        int s = m_imagecache->subimage_from_name (texturefile, options.subimagename);
+        if (s < 0) {
+            error ("Unknown subimage \"%s\" in texture \"%s\"",
+                   options.subimagename.c_str(), texturefile->filename().c_str());
+            return false;
+        }
+        options.subimage = s;
+        options.subimagename.clear();
+    }
+
+    const ImageSpec &spec (texturefile->spec(options.subimage, 0));
+
+    // Figure out the wrap functions
+    if (options.swrap == TextureOpt::WrapDefault)
+        options.swrap = (TextureOpt::Wrap)texturefile->swrap();
+    if (options.swrap == TextureOpt::WrapPeriodic && ispow2(spec.width))
+        options.swrap = TextureOpt::WrapPeriodicPow2;
+    if (options.twrap == TextureOpt::WrapDefault)
+        options.twrap = (TextureOpt::Wrap)texturefile->twrap();
+    if (options.twrap == TextureOpt::WrapPeriodic && ispow2(spec.height))
+        options.twrap = TextureOpt::WrapPeriodicPow2;
+    if (options.rwrap == TextureOpt::WrapDefault)
+        options.rwrap = (TextureOpt::Wrap)texturefile->rwrap();
+    if (options.rwrap == TextureOpt::WrapPeriodic && ispow2(spec.depth))
+        options.rwrap = TextureOpt::WrapPeriodicPow2;
+
+    return true;
+}
+
+
+
+void
+TextureSystemImpl::texture3d_localP (TextureFile *texturefile,
+                                     PerThreadInfo *thread_info,
+                                     const TextureOpt &options,
+                                     const Imath::V3f &P, Imath::V3f &Plocal)
+{
+    // Do the volume lookup in local space.  There's not actually a way
+    // to ask for point transforms via the ImageInput interface, so use
+    // knowledge of the few volume reader internals to the back doors.
+    if (texturefile->fileformat() == s_field3d) {
+        if (! texturefile->opened()) {
+            // We need a valid ImageInput pointer below.  If the handle
+            // has been invalidated, force it open again.
+            texturefile->forceopen (thread_info);
+        }
+        Field3DInput_Interface *f3di = (Field3DInput_Interface *)texturefile->imageinput();
+        ASSERT (f3di);
+        f3di->worldToLocal (P, Plocal, options.time);
+    } else {
+        Plocal = P;
+    }
+}
+
+
+
 bool
 TextureSystemImpl::texture3d (ustring filename, TextureOpt &options,
                               const Imath::V3f &P,
@@ -142,6 +242,7 @@ TextureSystemImpl::texture3d (TextureHandle *texture_handle_,
         &TextureSystemImpl::texture3d_lookup_nomip,
         &TextureSystemImpl::texture3d_lookup_trilinear_mipmap,
         &TextureSystemImpl::texture3d_lookup_trilinear_mipmap,
+        &TextureSystemImpl::texture3d_lookup,
         &TextureSystemImpl::texture3d_lookup
     };
     texture3d_lookup_prototype lookup = lookup_functions[(int)options.mipmode];
@@ -159,53 +260,19 @@ TextureSystemImpl::texture3d (TextureHandle *texture_handle_,
         return missing_texture (options, nchannels, result,
                                 dresultds, dresultdt, dresultdr);
 
-    if (options.subimagename) {
-        // If subimage was specified by name, figure out its index.
-        int s = m_imagecache->subimage_from_name (texturefile, options.subimagename);
-        if (s < 0) {
-            error ("Unknown subimage \"%s\" in texture \"%s\"",
-                   options.subimagename.c_str(), texturefile->filename().c_str());
-            return false;
-        }
-        options.subimage = s;
-        options.subimagename.clear();
-    }
+    TraceScope trace (*m_imagecache, thread_info, TraceTextureLookup,
+                      texturefile->filename(), options.subimage);
+    trace.min_ticks (m_imagecache->trace_lookup_ticks ());
 
+    if (! texture3d_setup (texturefile, options))
+        return false;
     const ImageSpec &spec (texturefile->spec(options.subimage, 0));
 
-    // Figure out the wrap functions
-    if (options.swrap == TextureOpt::WrapDefault)
-        options.swrap = (TextureOpt::Wrap)texturefile->swrap();
-    if (options.swrap == TextureOpt::WrapPeriodic && ispow2(spec.width))
-        options.swrap = TextureOpt::WrapPeriodicPow2;
-    if (options.twrap == TextureOpt::WrapDefault)
-        options.twrap = (TextureOpt::Wrap)texturefile->twrap();
-    if (options.twrap == TextureOpt::WrapPeriodic && ispow2(spec.height))
-        options.twrap = TextureOpt::WrapPeriodicPow2;
-    if (options.rwrap == TextureOpt::WrapDefault)
-        options.rwrap = (TextureOpt::Wrap)texturefile->rwrap();
-    if (options.rwrap == TextureOpt::WrapPeriodic && ispow2(spec.depth))
-        options.rwrap = TextureOpt::WrapPeriodicPow2;
-
     int actualchannels = Imath::clamp (spec.nchannels - options.firstchannel,
                                        0, nchannels);
 
-    // Do the volume lookup in local space.  There's not actually a way
-    // to ask for point transforms via the ImageInput interface, so use
-    // knowledge of the few volume reader internals to the back doors.
     Imath::V3f Plocal;
-    if (texturefile->fileformat() == s_field3d) {
-        if (! texturefile->opened()) {
-            // We need a valid ImageInput pointer below.  If the handle
-            // has been invalidated, force it open again.
-            texturefile->forceopen (thread_info);
-        }
-        Field3DInput_Interface *f3di = (Field3DInput_Interface *)texturefile->imageinput();
-        ASSERT (f3di);
-        f3di->worldToLocal (P, Plocal, options.time);
-    } else {
-        Plocal = P;
-    }
+    texture3d_localP (texturefile, thread_info, options, P, Plocal);
 
     // FIXME: we don't bother with this for dPdx, dPdy, and dPdz only
     // because we know that we don't currently filter volume lookups and
@@ -283,6 +350,79 @@ TextureSystemImpl::texture3d (TextureHandle *texture_handle,
 
 
 
+bool
+TextureSystemImpl::texture3d_ray (ustring filename, TextureOpt &options,
+                                  const Imath::V3f &P,
+                                  const Imath::V3f &dPdstep,
+                                  int nsteps, int nchannels, float *result)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texturefile = find_texturefile (filename, thread_info);
+    return texture3d_ray ((TextureHandle *)texturefile,
+                          (Perthread *)thread_info, options,
+                          P, dPdstep, nsteps, nchannels, result);
+}
+
+
+
+bool
+TextureSystemImpl::texture3d_ray (TextureHandle *texture_handle_,
+                                  Perthread *thread_info_,
+                                  TextureOpt &options,
+                                  const Imath::V3f &P,
+                                  const Imath::V3f &dPdstep,
+                                  int nsteps, int nchannels, float *result)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    TextureFile *texturefile = verify_texturefile ((TextureFile *)texture_handle_, thread_info);
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    ++stats.texture3d_batches;
+    stats.texture3d_queries += nsteps;
+
+    if (! texturefile  ||  texturefile->broken()) {
+        bool ok = true;
+        for (int i = 0;  i < nsteps;  ++i)
+            ok &= missing_texture (options, nchannels, result + i*nchannels,
+                                   NULL, NULL);
+        return ok;
+    }
+
+    // Resolve the file, subimage, and wrap modes once for the whole ray,
+    // rather than once per sample as separate texture3d() calls would.
+    if (! texture3d_setup (texturefile, options))
+        return false;
+    const ImageSpec &spec (texturefile->spec(options.subimage, 0));
+    Imath::V3f zero (0.0f, 0.0f, 0.0f);
+    bool ok = true;
+    int save_firstchannel = options.firstchannel;
+    for (int i = 0;  i < nsteps;  ++i) {
+        // N.B. Consecutive samples along a ray will usually land in the
+        // same tile as the previous one, which the per-thread microcache
+        // hands back without a search of the main cache.
+        Imath::V3f Plocal;
+        texture3d_localP (texturefile, thread_info, options,
+                          P + float(i) * dPdstep, Plocal);
+        float *r = result + i*nchannels;
+        // Handle >4 channel lookups in groups of 4.
+        for (int c = 0;  c < nchannels;  c += 4) {
+            int n = std::min (nchannels - c, 4);
+            options.firstchannel = save_firstchannel + c;
+            int actualchannels = Imath::clamp (spec.nchannels - options.firstchannel,
+                                               0, n);
+            ok &= texture3d_lookup_nomip (*texturefile, thread_info, options,
+                                          n, actualchannels, Plocal,
+                                          dPdstep, zero, zero, r + c,
+                                          NULL, NULL, NULL);
+            if (actualchannels < n && options.firstchannel == 0 && m_gray_to_rgb)
+                fill_gray_channels (spec, n, r + c, NULL, NULL, NULL);
+        }
+    }
+    options.firstchannel = save_firstchannel; // restore what we changed
+    return ok;
+}
+
+
+
 bool
 TextureSystemImpl::texture3d_lookup_nomip (TextureFile &texturefile,
                             PerThreadInfo *thread_info, 
@@ -377,6 +517,19 @@ TextureSystemImpl::accum3d_sample_closest (const Imath::V3f &P, int miplevel,
         return true;
     }
 
+    if (const float *color = constant_tile_color (levelinfo, spec,
+                                                  stex, ttex, rtex)) {
+        // Inside a single-color tile: no need to find the tile
+        for (int c = 0;  c < actualchannels;  ++c)
+            accum[c] += weight * color[options.firstchannel + c];
+        if (nchannels_result > actualchannels && options.fill) {
+            float f = weight * options.fill;
+            for (int c = actualchannels;  c < nchannels_result;  ++c)
+                accum[c] += f;
+        }
+        return true;
+    }
+
     int tile_chbegin = 0, tile_chend = spec.nchannels;
     if (spec.nchannels > m_max_tile_channels) {
         // For files with many channels, narrow the range we cache
@@ -519,7 +672,14 @@ TextureSystemImpl::accum3d_sample_bilinear (const Imath::V3f &P, int miplevel,
     TileID id (texturefile, options.subimage, miplevel, 0, 0, 0,
                tile_chbegin, tile_chend);
     int startchan_in_tile = options.firstchannel - id.chbegin();
-    if (onetile &&
+    const float *constcolor = NULL;
+    if (onetile && valid_storage.ivalid == all_valid)
+        constcolor = constant_tile_color (levelinfo, spec,
+                                          stex[0], ttex[0], rtex[0]);
+    if (constcolor) {
+        // All eight texels are in one single-color tile, which we never
+        // need to fetch.  (Only the first actualchannels are used.)
+    } else if (onetile &&
         valid_storage.ivalid == all_valid) {
         // Shortcut if all the texels we need are on the same tile
         id.xyz (stex[0] - tile_s, ttex[0] - tile_t, rtex[0] - tile_r);
@@ -576,147 +736,49 @@ TextureSystemImpl::accum3d_sample_bilinear (const Imath::V3f &P, int miplevel,
             }
         }
     }
-    // FIXME -- optimize the above loop by unrolling
 
-    if (pixeltype == TypeDesc::UINT8) {
-        for (int c = 0;  c < actualchannels;  ++c)
-            accum[c] += weight * trilerp (uchar2float(texel[0][0][0][c]), uchar2float(texel[0][0][1][c]),
-                                          uchar2float(texel[0][1][0][c]), uchar2float(texel[0][1][1][c]),
-                                          uchar2float(texel[1][0][0][c]), uchar2float(texel[1][0][1][c]),
-                                          uchar2float(texel[1][1][0][c]), uchar2float(texel[1][1][1][c]),
-                                          sfrac, tfrac, rfrac);
-        if (daccumds) {
-            float scalex = weight * spec.full_width;
-            float scaley = weight * spec.full_height;
-            float scalez = weight * spec.full_depth;
-            for (int c = 0;  c < actualchannels;  ++c) {
-                daccumds[c] += scalex * bilerp(
-                    uchar2float(texel[0][0][1][c]) - uchar2float(texel[0][0][0][c]),
-                    uchar2float(texel[0][1][1][c]) - uchar2float(texel[0][1][0][c]),
-                    uchar2float(texel[1][0][1][c]) - uchar2float(texel[1][0][0][c]),
-                    uchar2float(texel[1][1][1][c]) - uchar2float(texel[1][1][0][c]),
-                    tfrac, rfrac
-                );
-                daccumdt[c] += scaley * bilerp(
-                    uchar2float(texel[0][1][0][c]) - uchar2float(texel[0][0][0][c]),
-                    uchar2float(texel[0][1][1][c]) - uchar2float(texel[0][0][1][c]),
-                    uchar2float(texel[1][1][0][c]) - uchar2float(texel[1][0][0][c]),
-                    uchar2float(texel[1][1][1][c]) - uchar2float(texel[1][0][1][c]),
-                    sfrac, rfrac
-                );
-                daccumdr[c] += scalez * bilerp(
-                    uchar2float(texel[0][1][0][c]) - uchar2float(texel[1][1][0][c]),
-                    uchar2float(texel[0][1][1][c]) - uchar2float(texel[1][1][1][c]),
-                    uchar2float(texel[0][0][1][c]) - uchar2float(texel[1][0][0][c]),
-                    uchar2float(texel[0][1][1][c]) - uchar2float(texel[1][1][1][c]),
-                    sfrac, tfrac
-                );
-            }
-        }
-    } else if (pixeltype == TypeDesc::UINT16) {
-        for (int c = 0;  c < actualchannels;  ++c)
-            accum[c] += weight * trilerp (ushort2float(((const uint16_t *)texel[0][0][0])[c]), ushort2float(((const uint16_t *)texel[0][0][1])[c]),
-                                          ushort2float(((const uint16_t *)texel[0][1][0])[c]), ushort2float(((const uint16_t *)texel[0][1][1])[c]),
-                                          ushort2float(((const uint16_t *)texel[1][0][0])[c]), ushort2float(((const uint16_t *)texel[1][0][1])[c]),
-                                          ushort2float(((const uint16_t *)texel[1][1][0])[c]), ushort2float(((const uint16_t *)texel[1][1][1])[c]),
-                                          sfrac, tfrac, rfrac);
-        if (daccumds) {
-            float scalex = weight * spec.full_width;
-            float scaley = weight * spec.full_height;
-            float scalez = weight * spec.full_depth;
-            for (int c = 0;  c < actualchannels;  ++c) {
-                daccumds[c] += scalex * bilerp(
-                    ushort2float(((const uint16_t *)texel[0][0][1])[c]) - ushort2float(((const uint16_t *)texel[0][0][0])[c]),
-                    ushort2float(((const uint16_t *)texel[0][1][1])[c]) - ushort2float(((const uint16_t *)texel[0][1][0])[c]),
-                    ushort2float(((const uint16_t *)texel[1][0][1])[c]) - ushort2float(((const uint16_t *)texel[1][0][0])[c]),
-                    ushort2float(((const uint16_t *)texel[1][1][1])[c]) - ushort2float(((const uint16_t *)texel[1][1][0])[c]),
-                    tfrac, rfrac
-                );
-                daccumdt[c] += scaley * bilerp(
-                    ushort2float(((const uint16_t *)texel[0][1][0])[c]) - ushort2float(((const uint16_t *)texel[0][0][0])[c]),
-                    ushort2float(((const uint16_t *)texel[0][1][1])[c]) - ushort2float(((const uint16_t *)texel[0][0][1])[c]),
-                    ushort2float(((const uint16_t *)texel[1][1][0])[c]) - ushort2float(((const uint16_t *)texel[1][0][0])[c]),
-                    ushort2float(((const uint16_t *)texel[1][1][1])[c]) - ushort2float(((const uint16_t *)texel[1][0][1])[c]),
-                    sfrac, rfrac
-                );
-                daccumdr[c] += scalez * bilerp(
-                    ushort2float(((const uint16_t *)texel[0][1][0])[c]) - ushort2float(((const uint16_t *)texel[1][1][0])[c]),
-                    ushort2float(((const uint16_t *)texel[0][1][1])[c]) - ushort2float(((const uint16_t *)texel[1][1][1])[c]),
-                    ushort2float(((const uint16_t *)texel[0][0][1])[c]) - ushort2float(((const uint16_t *)texel[1][0][0])[c]),
-                    ushort2float(((const uint16_t *)texel[0][1][1])[c]) - ushort2float(((const uint16_t *)texel[1][1][1])[c]),
-                    sfrac, tfrac
-                );
-            }
-        }
-    } else if (pixeltype == TypeDesc::HALF) {
-        for (int c = 0;  c < actualchannels;  ++c)
-            accum[c] += weight * trilerp (half2float(((const half *)texel[0][0][0])[c]), half2float(((const half *)texel[0][0][1])[c]),
-                                          half2float(((const half *)texel[0][1][0])[c]), half2float(((const half *)texel[0][1][1])[c]),
-                                          half2float(((const half *)texel[1][0][0])[c]), half2float(((const half *)texel[1][0][1])[c]),
-                                          half2float(((const half *)texel[1][1][0])[c]), half2float(((const half *)texel[1][1][1])[c]),
-                                          sfrac, tfrac, rfrac);
-        if (daccumds) {
-            float scalex = weight * spec.full_width;
-            float scaley = weight * spec.full_height;
-            float scalez = weight * spec.full_depth;
-            for (int c = 0;  c < actualchannels;  ++c) {
-                daccumds[c] += scalex * bilerp(
-                    half2float(((const half *)texel[0][0][1])[c]) - half2float(((const half *)texel[0][0][0])[c]),
-                    half2float(((const half *)texel[0][1][1])[c]) - half2float(((const half *)texel[0][1][0])[c]),
-                    half2float(((const half *)texel[1][0][1])[c]) - half2float(((const half *)texel[1][0][0])[c]),
-                    half2float(((const half *)texel[1][1][1])[c]) - half2float(((const half *)texel[1][1][0])[c]),
-                    tfrac, rfrac
-                );
-                daccumdt[c] += scaley * bilerp(
-                    half2float(((const half *)texel[0][1][0])[c]) - half2float(((const half *)texel[0][0][0])[c]),
-                    half2float(((const half *)texel[0][1][1])[c]) - half2float(((const half *)texel[0][0][1])[c]),
-                    half2float(((const half *)texel[1][1][0])[c]) - half2float(((const half *)texel[1][0][0])[c]),
-                    half2float(((const half *)texel[1][1][1])[c]) - half2float(((const half *)texel[1][0][1])[c]),
-                    sfrac, rfrac
-                );
-                daccumdr[c] += scalez * bilerp(
-                    half2float(((const half *)texel[0][1][0])[c]) - half2float(((const half *)texel[1][1][0])[c]),
-                    half2float(((const half *)texel[0][1][1])[c]) - half2float(((const half *)texel[1][1][1])[c]),
-                    half2float(((const half *)texel[0][0][1])[c]) - half2float(((const half *)texel[1][0][0])[c]),
-                    half2float(((const half *)texel[0][1][1])[c]) - half2float(((const half *)texel[1][1][1])[c]),
-                    sfrac, tfrac
-                );
-            }
-        }
+    // Convert the eight corner texels to float4's (any channels beyond
+    // actualchannels are ignored; the tiles are padded for these loads),
+    // and interpolate all channels at once.
+    float4 tex[2][2][2];
+    if (constcolor) {
+        float4 color;
+        color.load (constcolor + options.firstchannel, actualchannels);
+        for (int k = 0;  k < 2;  ++k)
+            for (int j = 0;  j < 2;  ++j)
+                for (int i = 0;  i < 2;  ++i)
+                    tex[k][j][i] = color;
     } else {
-        // General case for float tiles
-        trilerp_mad ((const float *)texel[0][0][0], (const float *)texel[0][0][1],
-                     (const float *)texel[0][1][0], (const float *)texel[0][1][1],
-                     (const float *)texel[1][0][0], (const float *)texel[1][0][1],
-                     (const float *)texel[1][1][0], (const float *)texel[1][1][1],
-                     sfrac, tfrac, rfrac, weight, actualchannels, accum);
-        if (daccumds) {
-            float scalex = weight * spec.full_width;
-            float scaley = weight * spec.full_height;
-            float scalez = weight * spec.full_depth;
-            for (int c = 0;  c < actualchannels;  ++c) {
-                daccumds[c] += scalex * bilerp(
-                    ((const float *) texel[0][0][1])[c] - ((const float *) texel[0][0][0])[c],
-                    ((const float *) texel[0][1][1])[c] - ((const float *) texel[0][1][0])[c],
-                    ((const float *) texel[1][0][1])[c] - ((const float *) texel[1][0][0])[c],
-                    ((const float *) texel[1][1][1])[c] - ((const float *) texel[1][1][0])[c],
-                    tfrac, rfrac
-                );
-                daccumdt[c] += scaley * bilerp(
-                    ((const float *) texel[0][1][0])[c] - ((const float *) texel[0][0][0])[c],
-                    ((const float *) texel[0][1][1])[c] - ((const float *) texel[0][0][1])[c],
-                    ((const float *) texel[1][1][0])[c] - ((const float *) texel[1][0][0])[c],
-                    ((const float *) texel[1][1][1])[c] - ((const float *) texel[1][0][1])[c],
-                    sfrac, rfrac
-                );
-                daccumdr[c] += scalez * bilerp(
-                    ((const float *) texel[0][1][0])[c] - ((const float *) texel[1][1][0])[c],
-                    ((const float *) texel[0][1][1])[c] - ((const float *) texel[1][1][1])[c],
-                    ((const float *) texel[0][0][1])[c] - ((const float *) texel[1][0][0])[c],
-                    ((const float *) texel[0][1][1])[c] - ((const float *) texel[1][1][1])[c],
-                    sfrac, tfrac
-                );
-            }
+        for (int k = 0;  k < 2;  ++k)
+            for (int j = 0;  j < 2;  ++j)
+                for (int i = 0;  i < 2;  ++i)
+                    tex[k][j][i] = load_texel4 (texel[k][j][i], pixeltype);
+    }
+
+    float4 result = float4(weight) * trilerp (tex[0][0][0], tex[0][0][1],
+                                              tex[0][1][0], tex[0][1][1],
+                                              tex[1][0][0], tex[1][0][1],
+                                              tex[1][1][0], tex[1][1][1],
+                                              sfrac, tfrac, rfrac);
+    for (int c = 0;  c < actualchannels;  ++c)
+        accum[c] += result[c];
+    if (daccumds) {
+        float4 ds = float4(weight * spec.full_width) *
+            bilerp (tex[0][0][1] - tex[0][0][0], tex[0][1][1] - tex[0][1][0],
+                    tex[1][0][1] - tex[1][0][0], tex[1][1][1] - tex[1][1][0],
+                    tfrac, rfrac);
+        float4 dt = float4(weight * spec.full_height) *
+            bilerp (tex[0][1][0] - tex[0][0][0], tex[0][1][1] - tex[0][0][1],
+                    tex[1][1][0] - tex[1][0][0], tex[1][1][1] - tex[1][0][1],
+                    sfrac, rfrac);
+        float4 dr = float4(weight * spec.full_depth) *
+            bilerp (tex[1][0][0] - tex[0][0][0], tex[1][0][1] - tex[0][0][1],
+                    tex[1][1][0] - tex[0][1][0], tex[1][1][1] - tex[0][1][1],
+                    sfrac, tfrac);
+        for (int c = 0;  c < actualchannels;  ++c) {
+            daccumds[c] += ds[c];
+            daccumdt[c] += dt[c];
+            daccumdr[c] += dr[c];
         }
     }
 
@@ -162,6 +162,58 @@ public:
                           VaryingRef<float> dsdy, VaryingRef<float> dtdy,
                           int nchannels, float *result,
                           float *dresultds=NULL, float *dresultdt=NULL);
+    virtual bool texture_batch (ustring filename, TextureOpt &options,
+                                unsigned int mask,
+                                const float *s, const float *t,
+                                const float *dsdx, const float *dtdx,
+                                const float *dsdy, const float *dtdy,
+                                int nchannels, float *result,
+                                float *dresultds=NULL,
+                                float *dresultdt=NULL);
+    virtual bool texture_batch (TextureHandle *texture_handle,
+                                Perthread *thread_info, TextureOpt &options,
+                                unsigned int mask,
+                                const float *s, const float *t,
+                                const float *dsdx, const float *dtdx,
+                                const float *dsdy, const float *dtdy,
+                                int nchannels, float *result,
+                                float *dresultds=NULL,
+                                float *dresultdt=NULL);
+    virtual bool texture_batch_faces (ustring filename, TextureOpt &options,
+                                unsigned int mask, const int *faceid,
+                                const float *s, const float *t,
+                                const float *dsdx, const float *dtdx,
+                                const float *dsdy, const float *dtdy,
+                                int nchannels, float *result,
+                                float *dresultds=NULL,
+                                float *dresultdt=NULL);
+    virtual bool texture_batch_faces (TextureHandle *texture_handle,
+                                Perthread *thread_info, TextureOpt &options,
+                                unsigned int mask, const int *faceid,
+                                const float *s, const float *t,
+                                const float *dsdx, const float *dtdx,
+                                const float *dsdy, const float *dtdy,
+                                int nchannels, float *result,
+                                float *dresultds=NULL,
+                                float *dresultdt=NULL);
+    virtual bool texture_bounds (ustring filename, TextureOpt &options,
+                                 float s, float t, float dsdx, float dtdx,
+                                 float dsdy, float dtdy, int nchannels,
+                                 float *minval, float *maxval);
+    virtual bool texture_bounds (TextureHandle *texture_handle,
+                                 Perthread *thread_info, TextureOpt &options,
+                                 float s, float t, float dsdx, float dtdx,
+                                 float dsdy, float dtdy, int nchannels,
+                                 float *minval, float *maxval);
+    virtual bool texture_slopes (ustring filename, TextureOpt &options,
+                                 float s, float t, float dsdx, float dtdx,
+                                 float dsdy, float dtdy,
+                                 float *slope, float *variance);
+    virtual bool texture_slopes (TextureHandle *texture_handle,
+                                 Perthread *thread_info, TextureOpt &options,
+                                 float s, float t, float dsdx, float dtdx,
+                                 float dsdy, float dtdy,
+                                 float *slope, float *variance);
 
 
     virtual bool texture3d (ustring filename, TextureOpt &options,
@@ -197,28 +249,30 @@ public:
                             float *dresultds=NULL, float *dresultdt=NULL,
                             float *dresultdr=NULL);
 
+    virtual bool texture3d_ray (ustring filename, TextureOpt &options,
+                                const Imath::V3f &P, const Imath::V3f &dPdstep,
+                                int nsteps, int nchannels, float *result);
+    virtual bool texture3d_ray (TextureHandle *texture_handle,
+                                Perthread *thread_info, TextureOpt &options,
+                                const Imath::V3f &P, const Imath::V3f &dPdstep,
+                                int nsteps, int nchannels, float *result);
+
     virtual bool shadow (ustring filename, TextureOpt &options,
                          const Imath::V3f &P, const Imath::V3f &dPdx,
                          const Imath::V3f &dPdy, float *result,
-                         float *dresultds=NULL, float *dresultdt=NULL) {
-        return false;
-    }
+                         float *dresultds=NULL, float *dresultdt=NULL);
     virtual bool shadow (TextureHandle *texture_handle, Perthread *thread_info,
                          TextureOpt &options,
                          const Imath::V3f &P, const Imath::V3f &dPdx,
                          const Imath::V3f &dPdy, float *result,
-                         float *dresultds=NULL, float *dresultdt=NULL) {
-        return false;
-    }
+                         float *dresultds=NULL, float *dresultdt=NULL);
     virtual bool shadow (ustring filename, TextureOptions &options,
                          Runflag *runflags, int beginactive, int endactive,
                          VaryingRef<Imath::V3f> P,
                          VaryingRef<Imath::V3f> dPdx,
                          VaryingRef<Imath::V3f> dPdy,
                          float *result,
-                         float *dresultds=NULL, float *dresultdt=NULL) {
-        return false;
-    }
+                         float *dresultds=NULL, float *dresultdt=NULL);
     virtual bool shadow (TextureHandle *texture_handle, Perthread *thread_info,
                          TextureOptions &options,
                          Runflag *runflags, int beginactive, int endactive,
@@ -226,10 +280,7 @@ public:
                          VaryingRef<Imath::V3f> dPdx,
                          VaryingRef<Imath::V3f> dPdy,
                          float *result,
-                         float *dresultds=NULL, float *dresultdt=NULL) {
-        return false;
-    }
-
+                         float *dresultds=NULL, float *dresultdt=NULL);
 
     virtual bool environment (ustring filename, TextureOpt &options,
                               const Imath::V3f &R, const Imath::V3f &dRdx,
@@ -255,6 +306,14 @@ public:
                               VaryingRef<Imath::V3f> dRdy,
                               int nchannels, float *result,
                               float *dresultds=NULL, float *dresultdt=NULL);
+    virtual bool environment_sample (ustring filename, TextureOpt &options,
+                                     float u1, float u2,
+                                     Imath::V3f &R, float &pdf);
+    virtual bool environment_sample (TextureHandle *texture_handle,
+                                     Perthread *thread_info,
+                                     TextureOpt &options,
+                                     float u1, float u2,
+                                     Imath::V3f &R, float &pdf);
 
     virtual std::string resolve_filename (const std::string &filename) const;
 
@@ -292,6 +351,20 @@ public:
                              int chbegin, int chend,
                              TypeDesc format, void *result);
 
+    virtual bool get_mip_level (ustring filename, int subimage,
+                                int miplevel, int chbegin, int chend,
+                                TypeDesc format, void *result);
+    virtual bool get_mip_level (TextureHandle *texture_handle,
+                                Perthread *thread_info, int subimage,
+                                int miplevel, int chbegin, int chend,
+                                TypeDesc format, void *result);
+
+    virtual bool prefetch (ustring filename, int subimage, int miplevel,
+                           const ROI &roi);
+    virtual bool prefetch (TextureHandle *texture_handle,
+                           Perthread *thread_info, int subimage,
+                           int miplevel, const ROI &roi);
+
     virtual std::string geterror () const;
     virtual std::string getstats (int level=1, bool icstats=true) const;
     virtual void reset_stats ();
@@ -346,6 +419,18 @@ private:
         return m_imagecache->find_tile (id, thread_info);
     }
 
+    /// The finest MIP resolution a lookup with these options may use
+    /// (0 for no limit): the lesser of "max_resolution" and the cache's
+    /// automatic cap, unless the lookup has priority.
+    int max_resolution (const TextureOpt &options) const {
+        if (options.priority > 0)
+            return 0;
+        int autocap = m_imagecache->auto_lod_resolution ();
+        if (! m_max_resolution || ! autocap)
+            return std::max (m_max_resolution, autocap);
+        return std::min (m_max_resolution, autocap);
+    }
+
     // Define a prototype of a member function pointer for texture
     // lookups.
     // If simd is nonzero, it's guaranteed that all float* inputs and
@@ -372,6 +457,71 @@ private:
                          float _dsdy, float _dtdy,
                          float *result, float *dresultds, float *resultdt);
     
+    /// The anisotropic lookup of texture_lookup, starting from an
+    /// already-computed filter ellipse (as done by the batched lookups,
+    /// which find the ellipses for several points at once).
+    bool texture_lookup_ellipse (TextureFile &texfile,
+                         PerThreadInfo *thread_info,
+                         TextureOpt &options,
+                         int nchannels_result, int actualchannels,
+                         float s, float t,
+                         float majorlength, float minorlength, float theta,
+                         int naturalsres, int naturaltres,
+                         float *result, float *dresultds, float *resultdt);
+
+    /// Scalar fallback for texture_batch: look up each lane in the mask
+    /// with the single-point texture() and scatter into SoA results.
+    bool texture_batch_lanes (TextureHandle *texture_handle,
+                              Perthread *thread_info, TextureOpt &options,
+                              unsigned int mask,
+                              const float *s, const float *t,
+                              const float *dsdx, const float *dtdx,
+                              const float *dsdy, const float *dtdy,
+                              int nchannels, float *result,
+                              float *dresultds, float *dresultdt);
+
+    /// Reorder the texture_batch lane indices order[0..nlanes-1] so that
+    /// lanes likely to start in the same MIP level and tile are adjacent.
+    void sort_batch_lanes (TextureFile &texturefile, TextureOpt &options,
+                           const float *s, const float *t,
+                           const float *majorlength, const float *minorlength,
+                           const float *theta, int *order, int nlanes);
+
+    /// Is a lookup with these options and derivatives nothing but a
+    /// point sample of the closest texel of MIP level 0?
+    bool is_point_sample (const TextureOpt &options,
+                          float dsdx, float dtdx, float dsdy, float dtdy) const {
+        if (options.pointsample)
+            return true;
+        return (options.interpmode == TextureOpt::InterpClosest &&
+                ! options.nonblocking &&
+                dsdx == 0.0f && dtdx == 0.0f && dsdy == 0.0f && dtdy == 0.0f &&
+                options.sblur == 0.0f && options.tblur == 0.0f &&
+                max_resolution (options) == 0);
+    }
+
+    /// Lookup function (a texture_lookup_prototype) for point samples.
+    bool texture_lookup_point (TextureFile &texfile,
+                         PerThreadInfo *thread_info,
+                         TextureOpt &options,
+                         int nchannels_result, int actualchannels,
+                         float _s, float _t,
+                         float _dsdx, float _dtdx,
+                         float _dsdy, float _dtdy,
+                         float *result, float *dresultds, float *resultdt);
+
+    /// Fetch the closest MIP level 0 texel for each of the lanes
+    /// [0,nlanes) of s and t (arrays padded to a multiple of 4) whose
+    /// bit is set in mask, storing it (with fill for the channels past
+    /// actualchannels) in result[lane].  Texel coordinates are computed
+    /// four lanes at a time.
+    bool point_samples (TextureFile &texfile, PerThreadInfo *thread_info,
+                        TextureOpt &options,
+                        int nchannels_result, int actualchannels,
+                        unsigned int mask, int nlanes,
+                        const float *s, const float *t,
+                        simd::float4 *result);
+
     bool texture_lookup_nomip (TextureFile &texfile, 
                          PerThreadInfo *thread_info, 
                          TextureOpt &options,
@@ -389,6 +539,32 @@ private:
                          float _dsdx, float _dtdx,
                          float _dsdy, float _dtdy,
                          float *result, float *dresultds, float *resultdt);
+
+    /// Elliptical weighted average lookup: a Gaussian filter over every
+    /// texel inside the (blurred, aniso-clamped) filter ellipse, on the
+    /// two MIP levels that bracket the minor axis.
+    bool texture_lookup_ewa (TextureFile &texfile,
+                         PerThreadInfo *thread_info,
+                         TextureOpt &options,
+                         int nchannels_result, int actualchannels,
+                         float _s, float _t,
+                         float _dsdx, float _dtdx,
+                         float _dsdy, float _dtdy,
+                         float *result, float *dresultds, float *resultdt);
+
+    /// Stochastic lookup: a single bilinear (or closest) probe, at one
+    /// of the positions along the major axis that the anisotropic filter
+    /// would use, on one of its two MIP levels, chosen by options.rnd in
+    /// proportion to their weights.  Averaged over many lookups with
+    /// independent rnd, this converges to the anisotropic filter.
+    bool texture_lookup_stochastic (TextureFile &texfile,
+                         PerThreadInfo *thread_info,
+                         TextureOpt &options,
+                         int nchannels_result, int actualchannels,
+                         float _s, float _t,
+                         float _dsdx, float _dtdx,
+                         float _dsdy, float _dtdy,
+                         float *result, float *dresultds, float *resultdt);
     
     // For the samplers, it's guaranteed that all float* inputs and outputs
     // are padded to length 'simd' and aligned to a simd*4-byte boundary
@@ -414,12 +590,68 @@ private:
                           int nchannels_result, int actualchannels,
                           const float *weight, simd::float4 *accum,
                           simd::float4 *daccumds, simd::float4 *daccumdt);
+    /// Gaussian EWA filter of the texels of one MIP level that fall
+    /// within the ellipse centered at (s,t) with semi-axis vectors
+    /// (smajor,tmajor) and (sminor,tminor), given in st space.
+    bool sample_ewa (float s, float t, float smajor, float tmajor,
+                     float sminor, float tminor,
+                     int level, TextureFile &texturefile,
+                     PerThreadInfo *thread_info, TextureOpt &options,
+                     int nchannels_result, int actualchannels,
+                     simd::float4 *accum, simd::float4 *daccumds,
+                     simd::float4 *daccumdt, int &ntexels);
     bool sample_bicubic  (int nsamples, const float *s, const float *t,
                           int level, TextureFile &texturefile,
                           PerThreadInfo *thread_info, TextureOpt &options,
                           int nchannels_result, int actualchannels,
                           const float *weight, simd::float4 *accum,
                           simd::float4 *daccumds, simd::float4 *daccumdt);
+    // Run sampler for a nonblocking lookup: at miplevel if its tiles
+    // are resident, else at the finest coarser level whose tiles are.
+    bool sample_nonblocking (sampler_prototype sampler,
+                             int nsamples, const float *s, const float *t,
+                             int level, TextureFile &texturefile,
+                             PerThreadInfo *thread_info, TextureOpt &options,
+                             int nchannels_result, int actualchannels,
+                             const float *weight, simd::float4 *accum,
+                             simd::float4 *daccumds, simd::float4 *daccumdt);
+    // The implementations of sample_bilinear and sample_bicubic, for a
+    // way of loading texels (TEXEL) and of wrapping texel coordinates
+    // (WRAP); the common combinations are compiled specially.
+    template<class TEXEL, class WRAP>
+    bool sample_bilinear_t (int nsamples, const float *s, const float *t,
+                            int level, TextureFile &texturefile,
+                            PerThreadInfo *thread_info, TextureOpt &options,
+                            int nchannels_result, int actualchannels,
+                            const float *weight, simd::float4 *accum,
+                            simd::float4 *daccumds, simd::float4 *daccumdt,
+                            const TEXEL &texel, const WRAP &wrap);
+    template<class TEXEL, class WRAP>
+    bool sample_bicubic_t (int nsamples, const float *s, const float *t,
+                           int level, TextureFile &texturefile,
+                           PerThreadInfo *thread_info, TextureOpt &options,
+                           int nchannels_result, int actualchannels,
+                           const float *weight, simd::float4 *accum,
+                           simd::float4 *daccumds, simd::float4 *daccumdt,
+                           const TEXEL &texel, const WRAP &wrap);
+
+    /// Percentage-closer filtered shadow lookup of a single point of a
+    /// valid shadow map, storing the fraction occluded in *result.
+    bool shadow_lookup (TextureFile &texturefile, PerThreadInfo *thread_info,
+                        TextureOpt &options,
+                        const Imath::V3f &P, const Imath::V3f &dPdx,
+                        const Imath::V3f &dPdy, float *result);
+
+    /// Per-lookup setup for texture3d on a valid file: resolve a named
+    /// subimage and the default wrap modes in options.  Return false if
+    /// the named subimage doesn't exist.
+    bool texture3d_setup (TextureFile *texturefile, TextureOpt &options);
+
+    /// Transform P into the local space of the volume texture.
+    void texture3d_localP (TextureFile *texturefile,
+                           PerThreadInfo *thread_info,
+                           const TextureOpt &options,
+                           const Imath::V3f &P, Imath::V3f &Plocal);
 
     // Define a prototype of a member function pointer for texture3d
     // lookups.
@@ -532,8 +764,10 @@ private:
     Imath::M44f m_Mc2w;          ///< common-to-world matrix
     bool m_gray_to_rgb;          ///< automatically copy gray to rgb channels?
     bool m_flip_t;               ///< Flip direction of t coord?
+    bool m_batch_sort;           ///< Group texture_batch lanes by tile?
     int m_max_tile_channels;     ///< narrow tile ID channel range when
                                  ///<   the file has more channels
+    int m_max_resolution;        ///< Cap on MIP resolution (0 = none)
     /// Saved error string, per-thread
     ///
     mutable thread_specific_ptr< std::string > m_errormessage;
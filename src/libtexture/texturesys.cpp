@@ -45,6 +45,7 @@
 #include "OpenImageIO/strutil.h"
 #include "OpenImageIO/sysutil.h"
 #include "OpenImageIO/thread.h"
+#include "OpenImageIO/timer.h"
 #include "OpenImageIO/fmath.h"
 #include "OpenImageIO/simd.h"
 #include "OpenImageIO/filter.h"
@@ -95,6 +96,72 @@ OIIO_FORCEINLINE float4 half2float4 (const half *h) {
 }
 
 
+// Channel c of the texel whose data starts at p, converted to float.
+inline float texel_channel (const char *p, int c, TypeDesc::BASETYPE pixeltype)
+{
+    if (pixeltype == TypeDesc::UINT8)
+        return uchar2float (((const unsigned char *)p)[c]);
+    if (pixeltype == TypeDesc::UINT16)
+        return convert_type<uint16_t,float> (((const uint16_t *)p)[c]);
+    if (pixeltype == TypeDesc::HALF)
+        return ((const half *)p)[c];
+    DASSERT (pixeltype == TypeDesc::FLOAT);
+    return ((const float *)p)[c];
+}
+
+
+// Gaussian weights for the EWA filter, indexed by the value of the
+// normalized ellipse function q = A*du^2 + B*du*dv + C*dv^2, which is in
+// [0,1) inside the filter footprint.  The Gaussian is offset so that it
+// falls to zero at the edge of the ellipse.  dweight holds d(weight)/dq,
+// used for the derivatives of the filtered result.
+struct EWAWeightTable {
+    enum { size = 256 };
+    float weight[size];
+    float dweight[size];
+    EWAWeightTable () {
+        const float alpha = 2.0f;
+        const float edge = expf (-alpha);
+        for (int i = 0;  i < size;  ++i) {
+            float g = expf (-alpha * (i + 0.5f) / size);
+            weight[i] = g - edge;
+            dweight[i] = -alpha * g;
+        }
+    }
+};
+
+static EWAWeightTable ewa_weights;
+
+
+// Charge the cost of filtering the lookups into one MIP level to that
+// level's "texture_profile" statistics: the time since construction (or
+// the previous charge), net of the time the ImageCache spent finding and
+// reading tiles in the meantime.
+class FilterProfileTimer {
+public:
+    FilterProfileTimer (bool enabled, ImageCachePerThreadInfo *thread_info)
+        : m_timer (enabled), m_thread_info (thread_info),
+          m_tile_ticks (thread_info->profile_tile_ticks)
+    { }
+    void charge (TextureSystemImpl::TextureFile &texturefile,
+                 int subimage, int miplevel, int nprobes) {
+        if (! m_timer.ticking ())
+            return;
+        long long ticks = m_timer.lap_ticks ();
+        long long tile_ticks = m_thread_info->profile_tile_ticks - m_tile_ticks;
+        m_tile_ticks = m_thread_info->profile_tile_ticks;
+        ImageCacheFile::LevelProfile &p (texturefile.levelinfo(subimage,miplevel).profile);
+        p.lookups += 1;
+        p.probes += nprobes;
+        p.filter_ticks += std::max (ticks - tile_ticks, 0LL);
+    }
+private:
+    FastTimer m_timer;
+    ImageCachePerThreadInfo *m_thread_info;
+    long long m_tile_ticks;
+};
+
+
 static const OIIO_SIMD4_ALIGN mask4 channel_masks[5] = {
     mask4(false, false, false, false),
     mask4(true,  false, false, false),
@@ -298,6 +365,131 @@ const wrap_impl_simd wrap_functions_simd[] = {
 
 
 
+// The bilinear and bicubic samplers are templates on how to load a texel
+// and how to wrap texel coordinates, so that the common combinations get
+// their own copies with no per-texel branches or indirect calls.  The
+// Any flavors decide at runtime and handle everything else.
+
+namespace {
+
+struct TexelUInt8 {
+    float4 operator() (const unsigned char *p) const {
+        return uchar2float4 (p);
+    }
+};
+
+struct TexelHalf {
+    float4 operator() (const unsigned char *p) const {
+        return half2float4 ((const half *)p);
+    }
+};
+
+struct TexelFloat {
+    float4 operator() (const unsigned char *p) const {
+        return float4 ((const float *)p);
+    }
+};
+
+struct TexelAny {
+    TexelAny (TypeDesc::BASETYPE pixeltype) : pixeltype(pixeltype) { }
+    float4 operator() (const unsigned char *p) const {
+        if (pixeltype == TypeDesc::UINT8)
+            return uchar2float4 (p);
+        if (pixeltype == TypeDesc::UINT16)
+            return ushort2float4 ((const unsigned short *)p);
+        if (pixeltype == TypeDesc::HALF)
+            return half2float4 ((const half *)p);
+        DASSERT (pixeltype == TypeDesc::FLOAT);
+        return float4 ((const float *)p);
+    }
+    TypeDesc::BASETYPE pixeltype;
+};
+
+// s and t both wrapped by F.  st() wraps the (s0,s1,t0,t1) texel
+// coordinates of a bilinear lookup at once; s() and t() wrap four
+// coordinates in one direction.
+template<wrap_impl_simd F>
+struct WrapSame {
+    simd::mask4 st (simd::int4 &st, const simd::int4 &xy,
+                    const simd::int4 &wh) const { return F (st, xy, wh); }
+    simd::mask4 s (simd::int4 &c, const simd::int4 &origin,
+                   const simd::int4 &width) const { return F (c, origin, width); }
+    simd::mask4 t (simd::int4 &c, const simd::int4 &origin,
+                   const simd::int4 &width) const { return F (c, origin, width); }
+};
+
+struct WrapAny {
+    WrapAny (const TextureOpt &options, const ImageSpec &spec,
+             TextureSystemImpl::wrap_impl swrap_func,
+             TextureSystemImpl::wrap_impl twrap_func)
+        : swrap_func (swrap_func), twrap_func (twrap_func),
+          swrap_simd (wrap_functions_simd[(int)options.swrap]),
+          twrap_simd (wrap_functions_simd[(int)options.twrap]),
+          x(spec.x), y(spec.y), width(spec.width), height(spec.height) { }
+    simd::mask4 st (simd::int4 &st, const simd::int4 &xy,
+                    const simd::int4 &wh) const {
+        if (swrap_func == twrap_func) {
+            // Both directions use the same wrap function, call in parallel.
+            return swrap_simd (st, xy, wh);
+        }
+        simd::mask4 valid;
+        valid.load (swrap_func (st[0], x, width),
+                    swrap_func (st[1], x, width),
+                    twrap_func (st[2], y, height),
+                    twrap_func (st[3], y, height));
+        return valid;
+    }
+    simd::mask4 s (simd::int4 &c, const simd::int4 &origin,
+                   const simd::int4 &width) const { return swrap_simd (c, origin, width); }
+    simd::mask4 t (simd::int4 &c, const simd::int4 &origin,
+                   const simd::int4 &width) const { return twrap_simd (c, origin, width); }
+    TextureSystemImpl::wrap_impl swrap_func, twrap_func;
+    wrap_impl_simd swrap_simd, twrap_simd;
+    int x, y, width, height;
+};
+
+
+// Which specialized sampler handles this pixel type and pair of wrap
+// modes: texel kind * 8 + wrap, or 0 for the generic one.
+inline int
+sampler_variant (TypeDesc::BASETYPE pixeltype, TextureOpt::Wrap swrap,
+                 TextureOpt::Wrap twrap)
+{
+    int texel = pixeltype == TypeDesc::UINT8 ? 1
+              : pixeltype == TypeDesc::HALF  ? 2
+              : pixeltype == TypeDesc::FLOAT ? 3 : 0;
+    int wrap = swrap != twrap ? 0
+             : (swrap == TextureOpt::WrapBlack || swrap == TextureOpt::WrapDefault) ? 1
+             : swrap == TextureOpt::WrapClamp        ? 2
+             : swrap == TextureOpt::WrapPeriodic     ? 3
+             : swrap == TextureOpt::WrapPeriodicPow2 ? 4 : 0;
+    return (texel && wrap) ? texel * 8 + wrap : 0;
+}
+
+}  // anon namespace
+
+
+#define OIIO_SAMPLER_ARGS_AT(miplevel) nsamples, s_, t_, miplevel,        \
+        texturefile, thread_info, options, nchannels_result, actualchannels,\
+        weight_, accum_, daccumds_, daccumdt_
+#define OIIO_SAMPLER_ARGS OIIO_SAMPLER_ARGS_AT (miplevel)
+
+#define OIIO_SAMPLER_VARIANT(v,sampler,TEXEL,WRAPF)                         \
+    case v : return sampler (OIIO_SAMPLER_ARGS, TEXEL(), WrapSame<WRAPF>());
+
+#define OIIO_SAMPLER_VARIANT_WRAPS(t,sampler,TEXEL)                         \
+    OIIO_SAMPLER_VARIANT (t*8+1, sampler, TEXEL, wrap_black_simd)           \
+    OIIO_SAMPLER_VARIANT (t*8+2, sampler, TEXEL, wrap_clamp_simd)           \
+    OIIO_SAMPLER_VARIANT (t*8+3, sampler, TEXEL, wrap_periodic_simd)        \
+    OIIO_SAMPLER_VARIANT (t*8+4, sampler, TEXEL, wrap_periodic_pow2_simd)
+
+#define OIIO_SAMPLER_VARIANT_CASES(sampler)                                 \
+    OIIO_SAMPLER_VARIANT_WRAPS (1, sampler, TexelUInt8)                     \
+    OIIO_SAMPLER_VARIANT_WRAPS (2, sampler, TexelHalf)                      \
+    OIIO_SAMPLER_VARIANT_WRAPS (3, sampler, TexelFloat)
+
+
+
 
 const char *
 texture_format_name (TexFormat f)
@@ -344,7 +536,9 @@ TextureSystemImpl::init ()
     m_Mw2c.makeIdentity();
     m_gray_to_rgb = false;
     m_flip_t = false;
+    m_batch_sort = false;
     m_max_tile_channels = 5;
+    m_max_resolution = 0;
     delete hq_filter;
     hq_filter = Filter1D::create ("b-spline", 4);
     m_statslevel = 0;
@@ -390,7 +584,10 @@ TextureSystemImpl::getstats (int level, bool icstats) const
 #define STROPT(name) if (m_##name.size()) opt += Strutil::format(#name "=\"%s\" ", m_##name)
         INTOPT(gray_to_rgb);
         INTOPT(flip_t);
+        INTOPT(batch_sort);
         INTOPT(max_tile_channels);
+        if (m_max_resolution)
+            INTOPT(max_resolution);
 #undef BOOLOPT
 #undef INTOPT
 #undef STROPT
@@ -406,9 +603,16 @@ TextureSystemImpl::getstats (int level, bool icstats) const
         out << "    environment :  " << stats.environment_queries
             << " queries in " << stats.environment_batches << " batches\n";
         out << "  Interpolations :\n";
-        out << "    closest  : " << stats.closest_interps << "\n";
+        out << "    closest  : " << stats.closest_interps;
+        if (stats.point_samples)
+            out << " (" << stats.point_samples << " point samples)";
+        out << "\n";
         out << "    bilinear : " << stats.bilinear_interps << "\n";
         out << "    bicubic  : " << stats.cubic_interps << "\n";
+        if (stats.ewa_interps)
+            out << Strutil::format ("    ewa      : %lld (avg %.3g texels)\n",
+                                    stats.ewa_interps,
+                                    (double)stats.ewa_texels/(double)stats.ewa_interps);
         if (stats.aniso_queries)
             out << Strutil::format ("  Average anisotropic probes : %.3g\n",
                                     (double)stats.aniso_probes/(double)stats.aniso_queries);
@@ -473,10 +677,18 @@ TextureSystemImpl::attribute (string_view name, TypeDesc type,
         m_flip_t = *(const int *)val;
         return true;
     }
+    if (name == "batch_sort" && type == TypeDesc::TypeInt) {
+        m_batch_sort = *(const int *)val;
+        return true;
+    }
     if (name == "m_max_tile_channels" && type == TypeDesc::TypeInt) {
         m_max_tile_channels = *(const int *)val;
         return true;
     }
+    if (name == "max_resolution" && type == TypeDesc::TypeInt) {
+        m_max_resolution = std::max (*(const int *)val, 0);
+        return true;
+    }
     if (name == "statistics:level" && type == TypeDesc::TypeInt) {
         m_statslevel = *(const int *)val;
         // DO NOT RETURN! pass the same message to the image cache
@@ -511,10 +723,18 @@ TextureSystemImpl::getattribute (string_view name, TypeDesc type,
         *(int *)val = m_flip_t;
         return true;
     }
+    if (name == "batch_sort" && type == TypeDesc::TypeInt) {
+        *(int *)val = m_batch_sort;
+        return true;
+    }
     if (name == "m_max_tile_channels" && type == TypeDesc::TypeInt) {
         *(int *)val = m_max_tile_channels;
         return true;
     }
+    if (name == "max_resolution" && type == TypeDesc::TypeInt) {
+        *(int *)val = m_max_resolution;
+        return true;
+    }
 
     // If not one of these, maybe it's an attribute meant for the image cache?
     return m_imagecache->getattribute (name, type, val);
@@ -641,7 +861,8 @@ TextureSystemImpl::get_texels (ustring filename, TextureOpt &options,
         error ("Texture file \"%s\" not found", filename);
         return false;
     }
-    return get_texels (filename, options, miplevel, xbegin, xend,
+    return get_texels ((TextureHandle *)texfile, (Perthread *)thread_info,
+                       options, miplevel, xbegin, xend,
                        ybegin, yend, zbegin, zend, chbegin, chend,
                        format, result);
 }
@@ -682,11 +903,10 @@ TextureSystemImpl::get_texels (TextureHandle *texture_handle_,
     }
     const ImageSpec &spec (texfile->spec(subimage, miplevel));
 
-    // FIXME -- this could be WAY more efficient than starting from
-    // scratch for each pixel within the rectangle.  Instead, we should
-    // grab a whole tile at a time and memcpy it rapidly.  But no point
-    // doing anything more complicated (not to mention bug-prone) until
-    // somebody reports this routine as being a bottleneck.
+    // The ImageCache copies whole tile spans at a time (converting with
+    // the SIMD kernels of convert_types), and splits big requests into
+    // bands of tile rows copied in parallel, so let it do the channels
+    // the file has.  We only need to add the fill for the rest.
     int nchannels = chend - chbegin;
     int actualchannels = Imath::clamp (spec.nchannels - chbegin, 0, nchannels);
     int tile_chbegin = 0, tile_chend = spec.nchannels;
@@ -695,53 +915,45 @@ TextureSystemImpl::get_texels (TextureHandle *texture_handle_,
         tile_chbegin = chbegin;
         tile_chend = chbegin+actualchannels;
     }
-    TileID tileid (*texfile, subimage, miplevel, 0, 0, 0,
-                   tile_chbegin, tile_chend);
     size_t formatchannelsize = format.size();
-    size_t formatpixelsize = nchannels * formatchannelsize;
-    size_t scanlinesize = (xend-xbegin) * formatpixelsize;
-    size_t zplanesize = (yend-ybegin) * scanlinesize;
+    stride_t formatpixelsize = nchannels * formatchannelsize;
     bool ok = true;
-    for (int z = zbegin;  z < zend;  ++z) {
-        if (z < spec.z || z >= (spec.z+std::max(spec.depth,1))) {
-            // nonexistant planes
-            memset (result, 0, zplanesize);
-            result = (void *) ((char *) result + zplanesize);
-            continue;
-        }
-        tileid.z (z - ((z - spec.z) % std::max (1, spec.tile_depth)));
-        for (int y = ybegin;  y < yend;  ++y) {
-            if (y < spec.y || y >= (spec.y+spec.height)) {
-                // nonexistant scanlines
-                memset (result, 0, scanlinesize);
-                result = (void *) ((char *) result + scanlinesize);
-                continue;
-            }
-            tileid.y (y - ((y - spec.y) % spec.tile_height));
-            for (int x = xbegin;  x < xend;  ++x) {
-                if (x < spec.x || x >= (spec.x+spec.width)) {
-                    // nonexistant columns
-                    memset (result, 0, formatpixelsize);
-                    result = (void *) ((char *) result + formatpixelsize);
-                    continue;
-                }
-                tileid.x (x - ((x - spec.x) % spec.tile_width));
-                ok &= find_tile (tileid, thread_info);
-                TileRef &tile (thread_info->tile);
-                const char *data;
-                if (tile && (data = (const char *)tile->data (x, y, z, chbegin))) {
-                    convert_types (texfile->datatype(subimage), data,
-                                   format, result, actualchannels);
-                    for (int c = actualchannels;  c < nchannels;  ++c)
-                        convert_types (TypeDesc::FLOAT, &options.fill, format,
-                                       (char *)result+c*formatchannelsize, 1);
-                } else {
-                    memset (result, 0, formatpixelsize);
-                }
-                result = (void *) ((char *) result + formatpixelsize);
+    if (actualchannels > 0) {
+        ok = m_imagecache->get_pixels (texfile, thread_info, subimage, miplevel,
+                                       xbegin, xend, ybegin, yend, zbegin, zend,
+                                       chbegin, chbegin+actualchannels,
+                                       format, result, formatpixelsize,
+                                       AutoStride, AutoStride,
+                                       tile_chbegin, tile_chend);
+    } else {
+        memset (result, 0, formatpixelsize * imagesize_t(xend-xbegin)
+                           * (yend-ybegin) * (zend-zbegin));
+    }
+
+    if (ok && actualchannels < nchannels) {
+        // Channels the file doesn't have get the fill value, but only
+        // within the data window (outside it, everything stays 0).
+        char *fill = ALLOCA (char, formatpixelsize);
+        for (int c = actualchannels;  c < nchannels;  ++c)
+            convert_types (TypeDesc::FLOAT, &options.fill, format,
+                           fill + c*formatchannelsize, 1);
+        size_t fillbytes = (nchannels - actualchannels) * formatchannelsize;
+        fill += actualchannels * formatchannelsize;
+        int x0 = std::max (xbegin, spec.x), x1 = std::min (xend, spec.x+spec.width);
+        int y0 = std::max (ybegin, spec.y), y1 = std::min (yend, spec.y+spec.height);
+        int z0 = std::max (zbegin, spec.z);
+        int z1 = std::min (zend, spec.z+std::max(spec.depth,1));
+        char *p = (char *)result + actualchannels * formatchannelsize;
+        for (int z = z0;  z < z1;  ++z)
+            for (int y = y0;  y < y1;  ++y) {
+                char *px = p + formatpixelsize * ((imagesize_t(z-zbegin)*(yend-ybegin)
+                                                   + (y-ybegin)) * (xend-xbegin)
+                                                  + (x0-xbegin));
+                for (int x = x0;  x < x1;  ++x, px += formatpixelsize)
+                    memcpy (px, fill, fillbytes);
             }
-        }
     }
+
     if (! ok) {
         std::string err = m_imagecache->geterror();
         if (! err.empty())
@@ -752,6 +964,110 @@ TextureSystemImpl::get_texels (TextureHandle *texture_handle_,
 
 
 
+bool
+TextureSystemImpl::get_mip_level (ustring filename, int subimage,
+                                  int miplevel, int chbegin, int chend,
+                                  TypeDesc format, void *result)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texfile = find_texturefile (filename, thread_info);
+    if (! texfile) {
+        error ("Texture file \"%s\" not found", filename);
+        return false;
+    }
+    return get_mip_level ((TextureHandle *)texfile, (Perthread *)thread_info,
+                          subimage, miplevel, chbegin, chend, format, result);
+}
+
+
+
+bool
+TextureSystemImpl::get_mip_level (TextureHandle *texture_handle_,
+                                  Perthread *thread_info_, int subimage,
+                                  int miplevel, int chbegin, int chend,
+                                  TypeDesc format, void *result)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    TextureFile *texfile = verify_texturefile ((TextureFile *)texture_handle_, thread_info);
+    if (! texfile) {
+        error ("Invalid texture handle NULL");
+        return false;
+    }
+    if (texfile->broken()) {
+        if (texfile->errors_should_issue())
+            error ("Invalid texture file \"%s\"", texfile->filename());
+        return false;
+    }
+    if (subimage < 0 || subimage >= texfile->subimages() ||
+          miplevel < 0 || miplevel >= texfile->miplevels(subimage)) {
+        if (texfile->errors_should_issue())
+            error ("get_mip_level asked for nonexistant subimage %d MIP level %d of \"%s\"",
+                   subimage, miplevel, texfile->filename());
+        return false;
+    }
+    const ImageSpec &spec (texfile->spec(subimage, miplevel));
+
+    // Queue every tile of the level for the I/O threads first, so they
+    // are read (and adjacent ones coalesced) while the copy proceeds.
+    ROI roi = get_roi (spec);
+    roi.chbegin = 0;
+    roi.chend = spec.nchannels;
+    if (spec.nchannels > m_max_tile_channels) {
+        roi.chbegin = chbegin;
+        roi.chend = std::min (chend, spec.nchannels);
+    }
+    if (roi.chend > roi.chbegin)
+        m_imagecache->prefetch_tiles ((ImageCache::ImageHandle *)texfile,
+                                      thread_info, subimage, miplevel, roi);
+
+    TextureOpt options;
+    options.subimage = subimage;
+    return get_texels (texture_handle_, thread_info_, options, miplevel,
+                       spec.x, spec.x+spec.width, spec.y, spec.y+spec.height,
+                       spec.z, spec.z+std::max(spec.depth,1), chbegin, chend,
+                       format, result);
+}
+
+
+
+bool
+TextureSystemImpl::prefetch (ustring filename, int subimage, int miplevel,
+                             const ROI &roi)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texfile = find_texturefile (filename, thread_info);
+    if (! texfile) {
+        error ("Texture file \"%s\" not found", filename);
+        return false;
+    }
+    return prefetch ((TextureHandle *)texfile, (Perthread *)thread_info,
+                     subimage, miplevel, roi);
+}
+
+
+
+bool
+TextureSystemImpl::prefetch (TextureHandle *texture_handle_,
+                             Perthread *thread_info_, int subimage,
+                             int miplevel, const ROI &roi)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    TextureFile *texfile = verify_texturefile ((TextureFile *)texture_handle_, thread_info);
+    if (! texfile) {
+        error ("Invalid texture handle NULL");
+        return false;
+    }
+    if (texfile->broken()) {
+        if (texfile->errors_should_issue())
+            error ("Invalid texture file \"%s\"", texfile->filename());
+        return false;
+    }
+    return m_imagecache->prefetch_tiles ((ImageCache::ImageHandle *)texfile,
+                                         thread_info, subimage, miplevel, roi);
+}
+
+
+
 std::string
 TextureSystemImpl::geterror () const
 {
@@ -966,7 +1282,9 @@ TextureSystemImpl::texture (TextureHandle *texture_handle_,
         &TextureSystemImpl::texture_lookup_nomip,
         &TextureSystemImpl::texture_lookup_trilinear_mipmap,
         &TextureSystemImpl::texture_lookup_trilinear_mipmap,
-        &TextureSystemImpl::texture_lookup
+        &TextureSystemImpl::texture_lookup,
+        &TextureSystemImpl::texture_lookup_ewa,
+        &TextureSystemImpl::texture_lookup_stochastic
     };
     texture_lookup_prototype lookup = lookup_functions[(int)options.mipmode];
 
@@ -996,6 +1314,10 @@ TextureSystemImpl::texture (TextureHandle *texture_handle_,
         options.subimagename.clear();
     }
 
+    TraceScope trace (*m_imagecache, thread_info, TraceTextureLookup,
+                      texturefile->filename(), options.subimage);
+    trace.min_ticks (m_imagecache->trace_lookup_ticks ());
+
     const ImageCacheFile::SubimageInfo &subinfo (texturefile->subimageinfo(options.subimage));
     const ImageSpec &spec (texturefile->spec(options.subimage, 0));
 
@@ -1047,6 +1369,9 @@ TextureSystemImpl::texture (TextureHandle *texture_handle_,
         dtdy *= subinfo.tscale;
     }
 
+    if (is_point_sample (options, dsdx, dtdx, dsdy, dtdy))
+        lookup = &TextureSystemImpl::texture_lookup_point;
+
     bool ok;
     // Everything from the lookup function on down will assume that there
     // is space for a float4 in all of the result locations, so if that's
@@ -1098,6 +1423,245 @@ TextureSystemImpl::texture (TextureHandle *texture_handle_,
 
 
 
+bool
+TextureSystemImpl::texture_bounds (ustring filename, TextureOpt &options,
+                                   float s, float t, float dsdx, float dtdx,
+                                   float dsdy, float dtdy, int nchannels,
+                                   float *minval, float *maxval)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texturefile = find_texturefile (filename, thread_info);
+    return texture_bounds ((TextureHandle *)texturefile,
+                           (Perthread *)thread_info, options,
+                           s, t, dsdx, dtdx, dsdy, dtdy,
+                           nchannels, minval, maxval);
+}
+
+
+
+bool
+TextureSystemImpl::texture_bounds (TextureHandle *texture_handle_,
+                                   Perthread *thread_info_, TextureOpt &options,
+                                   float s, float t, float dsdx, float dtdx,
+                                   float dsdy, float dtdy, int nchannels,
+                                   float *minval, float *maxval)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    TextureFile *texturefile = (TextureFile *)texture_handle_;
+    if (texturefile && texturefile->is_udim())
+        texturefile = m_imagecache->resolve_udim (texturefile, s, t);
+    texturefile = verify_texturefile (texturefile, thread_info);
+    if (! texturefile  ||  texturefile->broken()) {
+        error ("Texture file not found");
+        return false;
+    }
+
+    if (options.subimagename) {
+        int sub = m_imagecache->subimage_from_name (texturefile, options.subimagename);
+        if (sub < 0) {
+            error ("Unknown subimage \"%s\" in texture \"%s\"",
+                   options.subimagename, texturefile->filename());
+            return false;
+        }
+        options.subimage = sub;
+        options.subimagename.clear();
+    }
+
+    const ImageCacheFile::SubimageInfo &subinfo (texturefile->subimageinfo(options.subimage));
+    if (subinfo.min_channel < 0 && subinfo.max_channel < 0) {
+        error ("\"%s\" has no min/max channels (use maketx --minmax)",
+               texturefile->filename());
+        return false;
+    }
+    const ImageSpec &spec0 (texturefile->spec(options.subimage, 0));
+    if (options.swrap == TextureOpt::WrapDefault)
+        options.swrap = (TextureOpt::Wrap)texturefile->swrap();
+    if (options.swrap == TextureOpt::WrapPeriodic && ispow2(spec0.width))
+        options.swrap = TextureOpt::WrapPeriodicPow2;
+    if (options.twrap == TextureOpt::WrapDefault)
+        options.twrap = (TextureOpt::Wrap)texturefile->twrap();
+    if (options.twrap == TextureOpt::WrapPeriodic && ispow2(spec0.height))
+        options.twrap = TextureOpt::WrapPeriodicPow2;
+    wrap_impl swrap_func = wrap_functions[(int)options.swrap];
+    wrap_impl twrap_func = wrap_functions[(int)options.twrap];
+
+    if (m_flip_t) {
+        t = 1.0f - t;
+        dtdx *= -1.0f;
+        dtdy *= -1.0f;
+    }
+    if (! subinfo.full_pixel_range) {  // remap st for overscan or crop
+        s = s * subinfo.sscale + subinfo.soffset;
+        dsdx *= subinfo.sscale;
+        dsdy *= subinfo.sscale;
+        t = t * subinfo.tscale + subinfo.toffset;
+        dtdx *= subinfo.tscale;
+        dtdy *= subinfo.tscale;
+    }
+
+    // The st box surrounding the footprint, padded by a couple of
+    // finest-level texels so that it also covers the neighbors that a
+    // bilinear or bicubic lookup may touch.
+    float sradius = (fabsf(dsdx) + fabsf(dsdy)) * 0.5f + options.sblur
+                  + 2.0f / spec0.full_width;
+    float tradius = (fabsf(dtdx) + fabsf(dtdy)) * 0.5f + options.tblur
+                  + 2.0f / spec0.full_height;
+
+    // Choose the finest MIP level where the box is no more than a texel
+    // across, so that we touch at most 3x3 texels.  Each texel of the
+    // min and max channels bounds every finer texel it overlaps.
+    int nlevels = (int) subinfo.levels.size();
+    int miplevel = 0;
+    while (miplevel < nlevels-1) {
+        const ImageSpec &spec (texturefile->spec (options.subimage, miplevel));
+        if (2.0f*sradius*spec.full_width <= 1.0f &&
+            2.0f*tradius*spec.full_height <= 1.0f)
+            break;
+        ++miplevel;
+    }
+    const ImageSpec &spec (texturefile->spec (options.subimage, miplevel));
+    const ImageCacheFile::LevelInfo &levelinfo (texturefile->levelinfo(options.subimage,miplevel));
+    TypeDesc::BASETYPE pixeltype = texturefile->pixeltype(options.subimage);
+
+    int sbegin, tbegin, send, tend;
+    float sfrac, tfrac;
+    st_to_texel (s - sradius, t - tradius, *texturefile, spec,
+                 sbegin, tbegin, sfrac, tfrac);
+    st_to_texel (s + sradius, t + tradius, *texturefile, spec,
+                 send, tend, sfrac, tfrac);
+    send = std::min (send + 2, sbegin + spec.width);
+    tend = std::min (tend + 2, tbegin + spec.height);
+
+    for (int c = 0;  c < nchannels;  ++c) {
+        minval[c] = std::numeric_limits<float>::max();
+        maxval[c] = -std::numeric_limits<float>::max();
+    }
+    bool black = false;   // did we touch a black border?
+    bool ok = true;
+    int firstchannel = options.firstchannel;
+    int nbounded = Imath::clamp (subinfo.minmax_nbase - firstchannel,
+                                 0, nchannels);
+    TileID id (*texturefile, options.subimage, miplevel, 0, 0, 0,
+               0, spec.nchannels);
+    for (int tt = tbegin;  tt < tend;  ++tt) {
+        for (int ss = sbegin;  ss < send;  ++ss) {
+            int stex = ss, ttex = tt;
+            bool svalid = swrap_func (stex, spec.x, spec.width);
+            bool tvalid = twrap_func (ttex, spec.y, spec.height);
+            if (! levelinfo.full_pixel_range) {
+                svalid &= (stex >= spec.x && stex < (spec.x+spec.width));
+                tvalid &= (ttex >= spec.y && ttex < (spec.y+spec.height));
+            }
+            if (! (svalid & tvalid)) {
+                black = true;
+                continue;
+            }
+            int tile_s = (stex - spec.x) % spec.tile_width;
+            int tile_t = (ttex - spec.y) % spec.tile_height;
+            id.xy (stex - tile_s, ttex - tile_t);
+            if (! find_tile (id, thread_info) || ! thread_info->tile) {
+                error ("%s", m_imagecache->geterror());
+                ok = false;
+                continue;
+            }
+            const TileRef &tile (thread_info->tile);
+            int offset = id.nchannels() * (tile_t * spec.tile_width + tile_s);
+            const char *texel = (const char *)tile->data()
+                                + offset * TypeDesc(pixeltype).size();
+            for (int c = 0;  c < nbounded;  ++c) {
+                if (subinfo.min_channel >= 0)
+                    minval[c] = std::min (minval[c],
+                        texel_channel (texel, subinfo.min_channel+firstchannel+c, pixeltype));
+                if (subinfo.max_channel >= 0)
+                    maxval[c] = std::max (maxval[c],
+                        texel_channel (texel, subinfo.max_channel+firstchannel+c, pixeltype));
+            }
+        }
+    }
+
+    for (int c = 0;  c < nchannels;  ++c) {
+        if (c >= nbounded || subinfo.min_channel < 0)
+            minval[c] = -std::numeric_limits<float>::max();
+        else if (black)
+            minval[c] = std::min (minval[c], 0.0f);
+        if (c >= nbounded || subinfo.max_channel < 0)
+            maxval[c] = std::numeric_limits<float>::max();
+        else if (black)
+            maxval[c] = std::max (maxval[c], 0.0f);
+    }
+    return ok;
+}
+
+
+
+bool
+TextureSystemImpl::texture_slopes (ustring filename, TextureOpt &options,
+                                   float s, float t, float dsdx, float dtdx,
+                                   float dsdy, float dtdy,
+                                   float *slope, float *variance)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texturefile = find_texturefile (filename, thread_info);
+    return texture_slopes ((TextureHandle *)texturefile,
+                           (Perthread *)thread_info, options,
+                           s, t, dsdx, dtdx, dsdy, dtdy, slope, variance);
+}
+
+
+
+bool
+TextureSystemImpl::texture_slopes (TextureHandle *texture_handle_,
+                                   Perthread *thread_info_, TextureOpt &options,
+                                   float s, float t, float dsdx, float dtdx,
+                                   float dsdy, float dtdy,
+                                   float *slope, float *variance)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    TextureFile *texturefile = (TextureFile *)texture_handle_;
+    if (texturefile && texturefile->is_udim())
+        texturefile = m_imagecache->resolve_udim (texturefile, s, t);
+    texturefile = verify_texturefile (texturefile, thread_info);
+    if (! texturefile  ||  texturefile->broken()) {
+        error ("Texture file not found");
+        return false;
+    }
+
+    if (options.subimagename) {
+        int sub = m_imagecache->subimage_from_name (texturefile, options.subimagename);
+        if (sub < 0) {
+            error ("Unknown subimage \"%s\" in texture \"%s\"",
+                   options.subimagename, texturefile->filename());
+            return false;
+        }
+        options.subimage = sub;
+        options.subimagename.clear();
+    }
+
+    const ImageCacheFile::SubimageInfo &subinfo (texturefile->subimageinfo(options.subimage));
+    if (subinfo.lean_channel < 0) {
+        error ("\"%s\" has no slope moment channels (use maketx --lean)",
+               texturefile->filename());
+        return false;
+    }
+
+    // The moments filter linearly, so an ordinary lookup of them yields
+    // the footprint's mean slope and mean squared slope.
+    float m[5];
+    int firstchannel = options.firstchannel;
+    options.firstchannel = subinfo.lean_channel;
+    bool ok = texture (texture_handle_, thread_info_, options,
+                       s, t, dsdx, dtdx, dsdy, dtdy, 5, m);
+    options.firstchannel = firstchannel;
+    slope[0] = m[0];
+    slope[1] = m[1];
+    variance[0] = std::max (m[2] - m[0]*m[0], 0.0f);
+    variance[1] = std::max (m[3] - m[1]*m[1], 0.0f);
+    variance[2] = m[4] - m[0]*m[1];
+    return ok;
+}
+
+
+
 bool
 TextureSystemImpl::texture_lookup_nomip (TextureFile &texturefile,
                             PerThreadInfo *thread_info, 
@@ -1127,10 +1691,12 @@ TextureSystemImpl::texture_lookup_nomip (TextureFile &texturefile,
     OIIO_SIMD4_ALIGN float sval[4] = { s, 0.0f, 0.0f, 0.0f };
     OIIO_SIMD4_ALIGN float tval[4] = { t, 0.0f, 0.0f, 0.0f };
     static OIIO_SIMD4_ALIGN float weight[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+    FilterProfileTimer profile (m_imagecache->texture_profile(), thread_info);
     bool ok = (this->*sampler) (1, sval, tval, 0 /*miplevel*/,
                                 texturefile, thread_info, options,
                                 nchannels_result, actualchannels, weight,
                                 (float4 *)result, (float4 *)dresultds, (float4 *)dresultdt);
+    profile.charge (texturefile, options.subimage, 0, 1);
 
     // Update stats
     ImageCacheStatistics &stats (thread_info->m_stats);
@@ -1147,12 +1713,146 @@ TextureSystemImpl::texture_lookup_nomip (TextureFile &texturefile,
 
 
 
-// Scale the derivs as dictated by 'width' and 'blur', and also make sure
-// they are all some minimum value to make the subsequent math clean.
-inline void
-adjust_width (float &dsdx, float &dtdx, float &dsdy, float &dtdy,
-              float swidth, float twidth)
-{
+bool
+TextureSystemImpl::texture_lookup_point (TextureFile &texturefile,
+                            PerThreadInfo *thread_info,
+                            TextureOpt &options,
+                            int nchannels_result, int actualchannels,
+                            float s, float t,
+                            float dsdx, float dtdx,
+                            float dsdy, float dtdy,
+                            float *result, float *dresultds, float *dresultdt)
+{
+    OIIO_SIMD4_ALIGN float sval[4] = { s, s, s, s };
+    OIIO_SIMD4_ALIGN float tval[4] = { t, t, t, t };
+    bool ok = point_samples (texturefile, thread_info, options,
+                             nchannels_result, actualchannels, 1, 1,
+                             sval, tval, (float4 *)result);
+    if (dresultds) {
+        ((simd::float4 *)dresultds)->clear();
+        ((simd::float4 *)dresultdt)->clear();
+    }
+    return ok;
+}
+
+
+
+bool
+TextureSystemImpl::point_samples (TextureFile &texturefile,
+                                  PerThreadInfo *thread_info,
+                                  TextureOpt &options,
+                                  int nchannels_result, int actualchannels,
+                                  unsigned int mask, int nlanes,
+                                  const float *s_, const float *t_,
+                                  float4 *result)
+{
+    const ImageSpec &spec (texturefile.spec (options.subimage, 0));
+    const ImageCacheFile::LevelInfo &levelinfo (texturefile.levelinfo(options.subimage, 0));
+    TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(options.subimage);
+    wrap_impl swrap_func = wrap_functions[(int)options.swrap];
+    wrap_impl twrap_func = wrap_functions[(int)options.twrap];
+    int firstchannel = options.firstchannel;
+    int tile_chbegin = 0, tile_chend = spec.nchannels;
+    if (spec.nchannels > m_max_tile_channels) {
+        // For files with many channels, narrow the range we cache
+        tile_chbegin = options.firstchannel;
+        tile_chend = options.firstchannel+actualchannels;
+    }
+    TileID id (texturefile, options.subimage, 0, 0, 0, 0,
+               tile_chbegin, tile_chend);
+    simd::mask4 channel_mask = channel_masks[actualchannels];
+    float4 fill = float4::Zero();
+    if (nchannels_result > actualchannels)
+        fill = blend0not (float4(options.fill), channel_mask);
+
+    // Texel coordinates, as in st_to_texel
+    float4 sscale, soffset, tscale, toffset;
+    if (texturefile.m_sample_border == 0) {
+        sscale = float4 ((float)spec.width);
+        soffset = float4 (spec.x - 0.5f);
+        tscale = float4 ((float)spec.height);
+        toffset = float4 (spec.y - 0.5f);
+    } else {
+        sscale = float4 ((float)(spec.width-1));
+        soffset = float4 ((float)spec.x);
+        tscale = float4 ((float)(spec.height-1));
+        toffset = float4 ((float)spec.y);
+    }
+
+    bool allok = true;
+    int npoints = 0;
+    for (int b = 0;  b < nlanes;  b += 4) {
+        if (! ((mask >> b) & 0xf))
+            continue;
+        // Round to the closest texel the way sample_closest does: a
+        // fraction of exactly 0.5 stays with the lower texel.
+        float4 sf = float4(s_+b) * sscale + soffset;
+        float4 tf = float4(t_+b) * tscale + toffset;
+        float4 sfloor = floor (sf), tfloor = floor (tf);
+        OIIO_SIMD4_ALIGN int sint[4], tint[4];
+        (int4(sfloor) - bitcast_to_int4 ((sf - sfloor) > float4(0.5f))).store (sint);
+        (int4(tfloor) - bitcast_to_int4 ((tf - tfloor) > float4(0.5f))).store (tint);
+        for (int j = 0;  j < 4 && b+j < nlanes;  ++j) {
+            int lane = b + j;
+            if (! (mask & (1 << lane)))
+                continue;
+            ++npoints;
+            int stex = sint[j], ttex = tint[j];
+            bool svalid = swrap_func (stex, spec.x, spec.width);
+            bool tvalid = twrap_func (ttex, spec.y, spec.height);
+            if (! levelinfo.full_pixel_range) {
+                svalid &= (stex >= spec.x && stex < (spec.x+spec.width)); // data window
+                tvalid &= (ttex >= spec.y && ttex < (spec.y+spec.height));
+            }
+            if (! (svalid & tvalid)) {
+                // Black wrap, and no fill either
+                result[lane].clear();
+                continue;
+            }
+            int tile_s = (stex - spec.x) % spec.tile_width;
+            int tile_t = (ttex - spec.y) % spec.tile_height;
+            id.xy (stex - tile_s, ttex - tile_t);
+            bool ok = find_tile (id, thread_info);
+            if (! ok)
+                error ("%s", m_imagecache->geterror());
+            TileRef &tile (thread_info->tile);
+            if (! tile  ||  ! ok) {
+                allok = false;
+                result[lane] = fill;
+                continue;
+            }
+            int offset = id.nchannels() * (tile_t * spec.tile_width + tile_s)
+                            + (firstchannel - id.chbegin());
+            DASSERT ((size_t)offset < spec.nchannels*spec.tile_pixels());
+            simd::float4 texel_simd;
+            if (pixeltype == TypeDesc::UINT8) {
+                texel_simd = uchar2float4 (tile->bytedata() + offset);
+            } else if (pixeltype == TypeDesc::UINT16) {
+                texel_simd = ushort2float4 (tile->ushortdata() + offset);
+            } else if (pixeltype == TypeDesc::HALF) {
+                texel_simd = half2float4 (tile->halfdata() + offset);
+            } else {
+                DASSERT (pixeltype == TypeDesc::FLOAT);
+                texel_simd.load (tile->floatdata() + offset);
+            }
+            result[lane] = blend0 (texel_simd, channel_mask) + fill;
+        }
+    }
+
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    stats.closest_interps += npoints;
+    stats.point_samples += npoints;
+    return allok;
+}
+
+
+
+// Scale the derivs as dictated by 'width' and 'blur', and also make sure
+// they are all some minimum value to make the subsequent math clean.
+inline void
+adjust_width (float &dsdx, float &dtdx, float &dsdy, float &dtdy,
+              float swidth, float twidth)
+{
     // Trust user not to use nonsensical width<0
     dsdx *= swidth;
     dtdx *= twidth;
@@ -1190,6 +1890,30 @@ adjust_width (float &dsdx, float &dtdx, float &dsdy, float &dtdy,
 
 
 
+// Four-lane version of adjust_width.  The degenerate-derivative clamping
+// is rare, so it's done with the scalar code for just the lanes that
+// need it.
+inline void
+adjust_width (float4 &dsdx, float4 &dtdx, float4 &dsdy, float4 &dtdy,
+              float swidth, float twidth)
+{
+    dsdx *= swidth;
+    dtdx *= twidth;
+    dsdy *= swidth;
+    dtdy *= twidth;
+    static const float eps = 1.0e-8f, eps2 = eps*eps;
+    float4 dxlen2 = dsdx*dsdx + dtdx*dtdx;
+    float4 dylen2 = dsdy*dsdy + dtdy*dtdy;
+    mask4 tiny = (dxlen2 < eps2) | (dylen2 < eps2);
+    if (reduce_or (tiny)) {
+        for (int i = 0;  i < 4;  ++i)
+            if (tiny[i])
+                adjust_width (dsdx[i], dtdx[i], dsdy[i], dtdy[i], 1.0f, 1.0f);
+    }
+}
+
+
+
 // Adjust the ellipse major and minor axes based on the blur, if nonzero.
 // Trust user not to use nonsensical blur<0
 inline void
@@ -1225,12 +1949,14 @@ adjust_blur (float &majorlength, float &minorlength, float theta,
 // pixel-sized (and then we will sample several times along the major
 // axis in order to handle anisotropy), but we make adjustments in
 // corner cases where the ideal sampling is too high or too low resolution
-// given the MIPmap levels we have available.
+// given the MIPmap levels we have available.  Levels larger than maxres
+// (if nonzero) in either dimension are not used, unless there's nothing
+// coarser.
 inline void
 compute_miplevels (TextureSystemImpl::TextureFile &texturefile,
                    TextureOpt &options,
                    float majorlength, float minorlength, float &aspect,
-                   int *miplevel, float *levelweight)
+                   int *miplevel, float *levelweight, int maxres)
 {
     ImageCacheFile::SubimageInfo &subinfo (texturefile.subimageinfo(options.subimage));
     float levelblend = 0.0f;
@@ -1274,6 +2000,19 @@ compute_miplevels (TextureSystemImpl::TextureFile &texturefile,
             aspect = Imath::clamp (majorlength * r * 2.0f, 1.0f, float(options.anisotropic));
         }
     }
+    if (maxres > 0 && miplevel[0] < nmiplevels-1) {
+        int minlevel = 0;
+        while (minlevel < nmiplevels-1 &&
+               std::max (subinfo.spec(minlevel).width,
+                         subinfo.spec(minlevel).height) > maxres)
+            ++minlevel;
+        if (miplevel[0] < minlevel) {
+            miplevel[0] = minlevel;
+            miplevel[1] = std::max (miplevel[1], minlevel);
+            if (miplevel[0] == miplevel[1])
+                levelblend = 0;
+        }
+    }
     if (options.mipmode == TextureOpt::MipModeOneLevel) {
         miplevel[0] = miplevel[1];
         levelblend = 0;
@@ -1302,6 +2041,7 @@ TextureSystemImpl::texture_lookup_trilinear_mipmap (TextureFile &texturefile,
         ((simd::float4 *)dresultdt)->clear();
     }
 
+    FilterProfileTimer profile (m_imagecache->texture_profile(), thread_info);
     adjust_width (dsdx, dtdx, dsdy, dtdy, options.swidth, options.twidth);
 
     // Determine the MIP-map level(s) we need: we will blend
@@ -1316,7 +2056,7 @@ TextureSystemImpl::texture_lookup_trilinear_mipmap (TextureFile &texturefile,
     filtwidth += std::max (options.sblur, options.tblur);
     float aspect = 1.0f;
     compute_miplevels (texturefile, options, filtwidth, filtwidth, aspect,
-                       miplevel, levelweight);
+                       miplevel, levelweight, max_resolution (options));
 
     static const sampler_prototype sample_functions[] = {
         // Must be in the same order as InterpMode enum
@@ -1347,6 +2087,7 @@ TextureSystemImpl::texture_lookup_trilinear_mipmap (TextureFile &texturefile,
                                 texturefile, thread_info, options,
                                 nchannels_result, actualchannels, weight,
                                 &r, dresultds ? &drds : NULL, dresultds ? &drdt : NULL);
+        profile.charge (texturefile, options.subimage, miplevel[level], 1);
         ++npointson;
         float4 lw = levelweight[level];
         r_sum += lw * r;
@@ -1432,6 +2173,35 @@ ellipse_axes (float dsdx, float dtdx, float dsdy, float dtdy,
 
 
 
+// Four-lane version of ellipse_axes (without the optional ABCF).  The
+// math is done in float rather than double, which is plenty once
+// adjust_width has clamped away degenerate derivatives.
+inline void
+ellipse_axes (const float4 &dsdx, const float4 &dtdx,
+              const float4 &dsdy, const float4 &dtdy,
+              float4 &majorlength, float4 &minorlength, float4 &theta)
+{
+    float4 A = dtdx*dtdx + dtdy*dtdy;
+    float4 B = -2.0f * (dsdx * dtdx + dsdy * dtdy);
+    float4 C = dsdx*dsdx + dsdy*dsdy;
+    float4 AminusC = A - C;
+    float4 root = sqrt (AminusC*AminusC + B*B);
+    float4 Aprime = (A + C - root) * 0.5f;
+    float4 Cprime = (A + C + root) * 0.5f;
+    majorlength = min (sqrt (max (Cprime, float4::Zero())), float4(1000.0f));
+    minorlength = min (sqrt (max (Aprime, float4::Zero())), float4(1000.0f));
+    // There's no SIMD atan2 (yet), so the angle is done per lane.
+    for (int i = 0;  i < 4;  ++i) {
+#ifdef TEX_FAST_MATH
+        theta[i] = fast_atan2 (B[i], AminusC[i]) * 0.5f + float(M_PI_2);
+#else
+        theta[i] = atan2f (B[i], AminusC[i]) * 0.5f + float(M_PI_2);
+#endif
+    }
+}
+
+
+
 // Given the aspect ratio, major axis orientation angle, and axis lengths,
 // calculate the smajor & tmajor values that give the orientation of the
 // line on which samples should be distributed.  If there are n samples,
@@ -1513,9 +2283,6 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
     // Scale by 'width'
     adjust_width (dsdx, dtdx, dsdy, dtdy, options.swidth, options.twidth);
 
-    // Determine the MIP-map level(s) we need: we will blend
-    //    data(miplevel[0]) * (1-levelblend) + data(miplevel[1]) * levelblend
-    float smajor, tmajor;
     float majorlength, minorlength;
     float theta;
 
@@ -1526,6 +2293,30 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
     // or bicubic texture probes, and therefore runtime!
     ellipse_axes (dsdx, dtdx, dsdy, dtdy, majorlength, minorlength, theta);
 
+    return texture_lookup_ellipse (texturefile, thread_info, options,
+                                   nchannels_result, actualchannels, s, t,
+                                   majorlength, minorlength, theta,
+                                   naturalsres, naturaltres,
+                                   result, dresultds, dresultdt);
+}
+
+
+
+bool
+TextureSystemImpl::texture_lookup_ellipse (TextureFile &texturefile,
+                            PerThreadInfo *thread_info,
+                            TextureOpt &options,
+                            int nchannels_result, int actualchannels,
+                            float s, float t,
+                            float majorlength, float minorlength, float theta,
+                            int naturalsres, int naturaltres,
+                            float *result, float *dresultds, float *dresultdt)
+{
+    // Determine the MIP-map level(s) we need: we will blend
+    //    data(miplevel[0]) * (1-levelblend) + data(miplevel[1]) * levelblend
+    float smajor, tmajor;
+    FilterProfileTimer profile (m_imagecache->texture_profile(), thread_info);
+
     adjust_blur (majorlength, minorlength, theta, options.sblur, options.tblur);
 
     float aspect, trueaspect;
@@ -1534,7 +2325,7 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
     int miplevel[2] = { -1, -1 };
     float levelweight[2] = { 0, 0 };
     compute_miplevels (texturefile, options, majorlength, minorlength, aspect,
-                       miplevel, levelweight);
+                       miplevel, levelweight, max_resolution (options));
 
     float *lineweight = ALLOCA (float, round_to_multiple_of_pow2(2*options.anisotropic, 4));
     float invsamples;
@@ -1628,6 +2419,7 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
             }
             break;
         }
+        profile.charge (texturefile, options.subimage, lev, nsamples);
 
         float4 lw = levelweight[level];
         r_sum += lw * r;
@@ -1658,6 +2450,592 @@ TextureSystemImpl::texture_lookup (TextureFile &texturefile,
 
 
 
+bool
+TextureSystemImpl::texture_lookup_stochastic (TextureFile &texturefile,
+                            PerThreadInfo *thread_info,
+                            TextureOpt &options,
+                            int nchannels_result, int actualchannels,
+                            float s, float t,
+                            float dsdx, float dtdx,
+                            float dsdy, float dtdy,
+                            float *result, float *dresultds, float *dresultdt)
+{
+    DASSERT ((dresultds == NULL) == (dresultdt == NULL));
+    FilterProfileTimer profile (m_imagecache->texture_profile(), thread_info);
+
+    // Find the filter ellipse, MIP levels, and probe weights just as the
+    // anisotropic lookup does...
+    adjust_width (dsdx, dtdx, dsdy, dtdy, options.swidth, options.twidth);
+    float majorlength, minorlength, theta;
+    ellipse_axes (dsdx, dtdx, dsdy, dtdy, majorlength, minorlength, theta);
+    adjust_blur (majorlength, minorlength, theta, options.sblur, options.tblur);
+    float aspect, trueaspect;
+    aspect = anisotropic_aspect (majorlength, minorlength, options, trueaspect);
+
+    int miplevel[2] = { -1, -1 };
+    float levelweight[2] = { 0, 0 };
+    compute_miplevels (texturefile, options, majorlength, minorlength, aspect,
+                       miplevel, levelweight, max_resolution (options));
+
+    float smajor, tmajor, invsamples;
+    float *lineweight = ALLOCA (float, round_to_multiple_of_pow2(2*options.anisotropic, 4));
+    int nsamples = compute_ellipse_sampling (aspect, theta, majorlength,
+                                             minorlength, smajor, tmajor,
+                                             invsamples, lineweight);
+
+    // ...but rather than visit them all, let rnd pick one of the two
+    // levels and then one probe, each in proportion to its weight, and
+    // reuse what's left of rnd's precision for each successive choice.
+    float u = Imath::clamp (options.rnd, 0.0f, 1.0f - std::numeric_limits<float>::epsilon());
+    int lev = miplevel[0];
+    if (levelweight[1] > 0.0f && u >= levelweight[0]) {
+        lev = miplevel[1];
+        u = (u - levelweight[0]) / levelweight[1];
+    } else if (levelweight[0] > 0.0f) {
+        u = u / levelweight[0];
+    }
+    int sample = 0;
+    for (float cdf = lineweight[0];  sample < nsamples-1 && u >= cdf;  )
+        cdf += lineweight[++sample];
+    float pos = 2.0f * ((sample + 0.5f) * invsamples - 0.5f);
+    // (The lengths are diameters, as in texture_lookup_ellipse.)
+    OIIO_SIMD4_ALIGN float sval[4] = { s + pos * 0.5f * smajor, 0.0f, 0.0f, 0.0f };
+    OIIO_SIMD4_ALIGN float tval[4] = { t + pos * 0.5f * tmajor, 0.0f, 0.0f, 0.0f };
+    OIIO_SIMD4_ALIGN float weight[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+
+    // A bicubic probe would touch 16 texels and, often, four tiles, so
+    // all but closest lookups use a single bilinear footprint.
+    bool ok;
+    float4 r, drds, drdt;
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    if (options.interpmode == TextureOpt::InterpClosest) {
+        ok = sample_closest (1, sval, tval, lev, texturefile, thread_info,
+                             options, nchannels_result, actualchannels,
+                             weight, &r, NULL, NULL);
+        ++stats.closest_interps;
+        if (dresultds) {
+            drds.clear();
+            drdt.clear();
+        }
+    } else {
+        ok = sample_bilinear (1, sval, tval, lev, texturefile, thread_info,
+                              options, nchannels_result, actualchannels,
+                              weight, &r, dresultds ? &drds : NULL,
+                              dresultds ? &drdt : NULL);
+        ++stats.bilinear_interps;
+    }
+    profile.charge (texturefile, options.subimage, lev, 1);
+
+    *(simd::float4 *)(result) = r;
+    if (dresultds) {
+        *(simd::float4 *)(dresultds) = drds;
+        *(simd::float4 *)(dresultdt) = drdt;
+    }
+
+    stats.aniso_queries += 1;
+    stats.aniso_probes += 1;
+    if (trueaspect > stats.max_aniso)
+        stats.max_aniso = trueaspect;
+    return ok;
+}
+
+
+
+bool
+TextureSystemImpl::texture_lookup_ewa (TextureFile &texturefile,
+                            PerThreadInfo *thread_info,
+                            TextureOpt &options,
+                            int nchannels_result, int actualchannels,
+                            float s, float t,
+                            float dsdx, float dtdx,
+                            float dsdy, float dtdy,
+                            float *result, float *dresultds, float *dresultdt)
+{
+    DASSERT ((dresultds == NULL) == (dresultdt == NULL));
+    FilterProfileTimer profile (m_imagecache->texture_profile(), thread_info);
+
+    // Find the filter ellipse and MIP levels just as the anisotropic
+    // lookup does, so the two modes blur (and clamp anisotropy) alike.
+    adjust_width (dsdx, dtdx, dsdy, dtdy, options.swidth, options.twidth);
+    float majorlength, minorlength, theta;
+    ellipse_axes (dsdx, dtdx, dsdy, dtdy, majorlength, minorlength, theta);
+    adjust_blur (majorlength, minorlength, theta, options.sblur, options.tblur);
+    float aspect, trueaspect;
+    aspect = anisotropic_aspect (majorlength, minorlength, options, trueaspect);
+
+    int miplevel[2] = { -1, -1 };
+    float levelweight[2] = { 0, 0 };
+    compute_miplevels (texturefile, options, majorlength, minorlength, aspect,
+                       miplevel, levelweight, max_resolution (options));
+
+    // The lengths are diameters; we need the semi-axis vectors.
+    float sintheta, costheta;
+#ifdef TEX_FAST_MATH
+    fast_sincos (theta, &sintheta, &costheta);
+#else
+    sincos (theta, &sintheta, &costheta);
+#endif
+    float smajor = 0.5f * majorlength * costheta;
+    float tmajor = 0.5f * majorlength * sintheta;
+    float sminor = -0.5f * minorlength * sintheta;
+    float tminor = 0.5f * minorlength * costheta;
+
+    bool ok = true;
+    int npointson = 0, ntexels = 0;
+    float4 r_sum, drds_sum, drdt_sum;
+    r_sum.clear();
+    if (dresultds) {
+        drds_sum.clear(); drdt_sum.clear();
+    }
+    for (int level = 0;  level < 2;  ++level) {
+        if (! levelweight[level])  // No contribution from this level, skip it
+            continue;
+        ++npointson;
+        float4 r, drds, drdt;
+        int n = 0;
+        ok &= sample_ewa (s, t, smajor, tmajor, sminor, tminor,
+                          miplevel[level], texturefile, thread_info, options,
+                          nchannels_result, actualchannels,
+                          &r, dresultds ? &drds : NULL,
+                          dresultds ? &drdt : NULL, n);
+        profile.charge (texturefile, options.subimage, miplevel[level], n);
+        ntexels += n;
+        float4 lw = levelweight[level];
+        r_sum += lw * r;
+        if (dresultds) {
+            drds_sum += lw * drds;
+            drdt_sum += lw * drdt;
+        }
+    }
+
+    *(simd::float4 *)(result) = r_sum;
+    if (dresultds) {
+        *(simd::float4 *)(dresultds) = drds_sum;
+        *(simd::float4 *)(dresultdt) = drdt_sum;
+    }
+
+    // Update stats
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    stats.ewa_interps += npointson;
+    stats.ewa_texels += ntexels;
+    if (trueaspect > stats.max_aniso)
+        stats.max_aniso = trueaspect;
+    return ok;
+}
+
+
+
+bool
+TextureSystemImpl::texture_batch (ustring filename, TextureOpt &options,
+                                  unsigned int mask,
+                                  const float *s, const float *t,
+                                  const float *dsdx, const float *dtdx,
+                                  const float *dsdy, const float *dtdy,
+                                  int nchannels, float *result,
+                                  float *dresultds, float *dresultdt)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texturefile = find_texturefile (filename, thread_info);
+    return texture_batch ((TextureHandle *)texturefile,
+                          (Perthread *)thread_info, options, mask,
+                          s, t, dsdx, dtdx, dsdy, dtdy,
+                          nchannels, result, dresultds, dresultdt);
+}
+
+
+
+bool
+TextureSystemImpl::texture_batch_lanes (TextureHandle *texture_handle,
+                                        Perthread *thread_info,
+                                        TextureOpt &options, unsigned int mask,
+                                        const float *s, const float *t,
+                                        const float *dsdx, const float *dtdx,
+                                        const float *dsdy, const float *dtdy,
+                                        int nchannels, float *result,
+                                        float *dresultds, float *dresultdt)
+{
+    float *r = OIIO_ALLOCA (float, 3*nchannels);
+    float *drds = dresultds ? r + nchannels : NULL;
+    float *drdt = dresultds ? r + 2*nchannels : NULL;
+    bool ok = true;
+    for (int i = 0;  i < BatchWidth;  ++i) {
+        if (! (mask & (1 << i)))
+            continue;
+        ok &= texture (texture_handle, thread_info, options,
+                       s[i], t[i], dsdx[i], dtdx[i], dsdy[i], dtdy[i],
+                       nchannels, r, drds, drdt);
+        for (int c = 0;  c < nchannels;  ++c)
+            result[c*BatchWidth+i] = r[c];
+        if (dresultds) {
+            for (int c = 0;  c < nchannels;  ++c) {
+                dresultds[c*BatchWidth+i] = drds[c];
+                dresultdt[c*BatchWidth+i] = drdt[c];
+            }
+        }
+    }
+    return ok;
+}
+
+
+
+// Store one lane's (up to 4 channel) lookup into SoA batch results.
+inline void
+scatter_batch_lane (int lane, int nchannels,
+                    const float4 &r, const float4 &drds, const float4 &drdt,
+                    float *result, float *dresultds, float *dresultdt)
+{
+    const int w = TextureSystem::BatchWidth;
+    for (int c = 0;  c < nchannels;  ++c)
+        result[c*w+lane] = r[c];
+    if (dresultds) {
+        for (int c = 0;  c < nchannels;  ++c) {
+            dresultds[c*w+lane] = drds[c];
+            dresultdt[c*w+lane] = drdt[c];
+        }
+    }
+}
+
+
+
+// Sort the lane indices order[0..nlanes-1] so that lanes whose lookups
+// start in the same MIP level and tile are adjacent.  The key is only a
+// guess at the tile -- it uses the ellipse center and the finer of the
+// two MIP levels the filter will blend, and ignores wrapping -- but a
+// wrong guess only costs coherence, never correctness.
+void
+TextureSystemImpl::sort_batch_lanes (TextureFile &texturefile,
+                                     TextureOpt &options,
+                                     const float *s, const float *t,
+                                     const float *majorlength,
+                                     const float *minorlength,
+                                     const float *theta,
+                                     int *order, int nlanes)
+{
+    const ImageCacheFile::SubimageInfo &subinfo (texturefile.subimageinfo(options.subimage));
+    unsigned long long key[BatchWidth];
+    for (int n = 0;  n < nlanes;  ++n) {
+        int i = order[n];
+        float major = majorlength[i], minor = minorlength[i];
+        adjust_blur (major, minor, theta[i], options.sblur, options.tblur);
+        float aspect, trueaspect;
+        aspect = anisotropic_aspect (major, minor, options, trueaspect);
+        int miplevel[2] = { -1, -1 };
+        float levelweight[2] = { 0, 0 };
+        compute_miplevels (texturefile, options, major, minor, aspect,
+                           miplevel, levelweight, max_resolution (options));
+        int lev = levelweight[0] != 0.0f ? miplevel[0] : miplevel[1];
+        const ImageSpec &spec (subinfo.spec(lev));
+        int tw = std::max (spec.tile_width, 1);
+        int th = std::max (spec.tile_height, 1);
+        int tx = ifloor (s[i] * spec.full_width + spec.full_x - spec.x) / tw;
+        int ty = ifloor (t[i] * spec.full_height + spec.full_y - spec.y) / th;
+        key[i] = ((unsigned long long)lev << 48)
+               | ((unsigned long long)(ty & 0xffffff) << 24)
+               | (unsigned long long)(tx & 0xffffff);
+    }
+    // Insertion sort: at most BatchWidth entries, and keeps lane order
+    // within a tile.
+    for (int n = 1;  n < nlanes;  ++n) {
+        int i = order[n];
+        int m = n;
+        for ( ;  m > 0 && key[order[m-1]] > key[i];  --m)
+            order[m] = order[m-1];
+        order[m] = i;
+    }
+}
+
+
+
+bool
+TextureSystemImpl::texture_batch (TextureHandle *texture_handle_,
+                                  Perthread *thread_info_,
+                                  TextureOpt &options, unsigned int mask,
+                                  const float *s_, const float *t_,
+                                  const float *dsdx_, const float *dtdx_,
+                                  const float *dsdy_, const float *dtdy_,
+                                  int nchannels, float *result,
+                                  float *dresultds, float *dresultdt)
+{
+    DASSERT ((dresultds == NULL) == (dresultdt == NULL));
+    mask &= (1U << BatchWidth) - 1;
+    if (! mask)
+        return true;
+
+    // A batch is point sampled if the options say so, or if every lane
+    // is a zero-width closest lookup.
+    bool pointsample = options.pointsample;
+    if (! pointsample && is_point_sample (options, 0, 0, 0, 0)) {
+        pointsample = true;
+        for (int i = 0;  i < BatchWidth && pointsample;  ++i)
+            if (mask & (1 << i))
+                pointsample = is_point_sample (options, dsdx_[i], dtdx_[i],
+                                               dsdy_[i], dtdy_[i]);
+    }
+
+    // Only the default anisotropic filter and point samples are batched.
+    // UDIM textures (whose file may differ per lane), the other MIP
+    // modes, and lookups of more than 4 channels are done one lane at a
+    // time.
+    TextureFile *texturefile = (TextureFile *)texture_handle_;
+    if (! texturefile || texturefile->is_udim() || nchannels > 4 ||
+        (! pointsample && options.mipmode != TextureOpt::MipModeDefault &&
+         options.mipmode != TextureOpt::MipModeAniso))
+        return texture_batch_lanes (texture_handle_, thread_info_, options,
+                                    mask, s_, t_, dsdx_, dtdx_, dsdy_, dtdy_,
+                                    nchannels, result, dresultds, dresultdt);
+
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info((PerThreadInfo *)thread_info_);
+    texturefile = verify_texturefile (texturefile, thread_info);
+
+    ImageCacheStatistics &stats (thread_info->m_stats);
+    ++stats.texture_batches;
+    for (unsigned int m = mask;  m;  m &= m-1)
+        ++stats.texture_queries;
+
+    float4 r, drds, drdt;
+    float *drdsp = dresultds ? (float *)&drds : NULL;
+    float *drdtp = dresultds ? (float *)&drdt : NULL;
+
+    if (! texturefile  ||  texturefile->broken()) {
+        bool ok = missing_texture (options, nchannels, (float *)&r,
+                                   drdsp, drdtp);
+        for (int i = 0;  i < BatchWidth;  ++i)
+            if (mask & (1 << i))
+                scatter_batch_lane (i, nchannels, r, drds, drdt,
+                                    result, dresultds, dresultdt);
+        return ok;
+    }
+
+    if (options.subimagename) {
+        // If subimage was specified by name, figure out its index.
+        int s = m_imagecache->subimage_from_name (texturefile, options.subimagename);
+        if (s < 0) {
+            error ("Unknown subimage \"%s\" in texture \"%s\"",
+                   options.subimagename, texturefile->filename());
+            return false;
+        }
+        options.subimage = s;
+        options.subimagename.clear();
+    }
+
+    const ImageCacheFile::SubimageInfo &subinfo (texturefile->subimageinfo(options.subimage));
+    const ImageSpec &spec (texturefile->spec(options.subimage, 0));
+
+    int actualchannels = Imath::clamp (spec.nchannels - options.firstchannel, 0, nchannels);
+    bool gray_to_rgb = (actualchannels < nchannels && options.firstchannel == 0
+                        && m_gray_to_rgb);
+
+    // Figure out the wrap functions
+    if (options.swrap == TextureOpt::WrapDefault)
+        options.swrap = (TextureOpt::Wrap)texturefile->swrap();
+    if (options.swrap == TextureOpt::WrapPeriodic && ispow2(spec.width))
+        options.swrap = TextureOpt::WrapPeriodicPow2;
+    if (options.twrap == TextureOpt::WrapDefault)
+        options.twrap = (TextureOpt::Wrap)texturefile->twrap();
+    if (options.twrap == TextureOpt::WrapPeriodic && ispow2(spec.height))
+        options.twrap = TextureOpt::WrapPeriodicPow2;
+
+    if (subinfo.is_constant_image && options.swrap != TextureOpt::WrapBlack &&
+          options.twrap != TextureOpt::WrapBlack) {
+        // Constant color texture, non-black wrap -- every lane gets the
+        // same answer, with zero derivs.
+        r.clear();  drds.clear();  drdt.clear();
+        for (int c = 0; c < actualchannels; ++c)
+            r[c] = subinfo.average_color[c+options.firstchannel];
+        for (int c = actualchannels; c < nchannels; ++c)
+            r[c] = options.fill;
+        if (gray_to_rgb)
+            fill_gray_channels (spec, nchannels, (float *)&r, drdsp, drdtp);
+        for (int i = 0;  i < BatchWidth;  ++i)
+            if (mask & (1 << i))
+                scatter_batch_lane (i, nchannels, r, drds, drdt,
+                                    result, dresultds, dresultdt);
+        return true;
+    }
+
+    if (pointsample) {
+        // No footprints needed, just remap st and fetch the texels.
+        OIIO_SIMD4_ALIGN float ss[BatchWidth], tt[BatchWidth];
+        for (int b = 0;  b < BatchWidth;  b += 4) {
+            float4 s (s_+b), t (t_+b);
+            if (m_flip_t)
+                t = 1.0f - t;
+            if (! subinfo.full_pixel_range) {
+                s = s * subinfo.sscale + subinfo.soffset;
+                t = t * subinfo.tscale + subinfo.toffset;
+            }
+            s.store (ss+b);
+            t.store (tt+b);
+        }
+        float4 texels[BatchWidth];
+        bool ok = point_samples (*texturefile, thread_info, options,
+                                 nchannels, actualchannels, mask, BatchWidth,
+                                 ss, tt, texels);
+        drds.clear();  drdt.clear();
+        for (int i = 0;  i < BatchWidth;  ++i) {
+            if (! (mask & (1 << i)))
+                continue;
+            r = texels[i];
+            if (gray_to_rgb)
+                fill_gray_channels (spec, nchannels, (float *)&r, drdsp, drdtp);
+            scatter_batch_lane (i, nchannels, r, drds, drdt,
+                                result, dresultds, dresultdt);
+        }
+        return ok;
+    }
+
+    // Compute the filter footprints for all the lanes, four at a time.
+    float ss[BatchWidth], tt[BatchWidth];
+    float majorlength[BatchWidth], minorlength[BatchWidth], theta[BatchWidth];
+    int sres[BatchWidth], tres[BatchWidth];
+    for (int b = 0;  b < BatchWidth;  b += 4) {
+        if (! ((mask >> b) & 0xf))
+            continue;
+        float4 s (s_+b), t (t_+b);
+        float4 dsdx (dsdx_+b), dtdx (dtdx_+b), dsdy (dsdy_+b), dtdy (dtdy_+b);
+        if (m_flip_t) {
+            t = 1.0f - t;
+            dtdx = -dtdx;
+            dtdy = -dtdy;
+        }
+        if (! subinfo.full_pixel_range) {  // remap st for overscan or crop
+            s = s * subinfo.sscale + subinfo.soffset;
+            dsdx *= subinfo.sscale;
+            dsdy *= subinfo.sscale;
+            t = t * subinfo.tscale + subinfo.toffset;
+            dtdx *= subinfo.tscale;
+            dtdy *= subinfo.tscale;
+        }
+
+        // Natural resolution of the bare derivs (see texture_lookup).
+        float4 eps (1e-8f);
+        int4 (1.0f / max (max (abs(dsdx), abs(dsdy)), eps)).store (sres+b);
+        int4 (1.0f / max (max (abs(dtdx), abs(dtdy)), eps)).store (tres+b);
+
+        adjust_width (dsdx, dtdx, dsdy, dtdy, options.swidth, options.twidth);
+        float4 major, minor, th;
+        ellipse_axes (dsdx, dtdx, dsdy, dtdy, major, minor, th);
+        s.store (ss+b);
+        t.store (tt+b);
+        major.store (majorlength+b);
+        minor.store (minorlength+b);
+        th.store (theta+b);
+    }
+
+    // Decide the order in which to visit the lanes.  Normally that's
+    // just lane order, but with "batch_sort" we group the lanes that
+    // will (probably) touch the same tile so that each tile is found in
+    // the per-thread microcache once per batch instead of once per lane.
+    int order[BatchWidth];
+    int nlanes = 0;
+    for (int i = 0;  i < BatchWidth;  ++i)
+        if (mask & (1 << i))
+            order[nlanes++] = i;
+    if (m_batch_sort && nlanes > 2)
+        sort_batch_lanes (*texturefile, options, ss, tt, majorlength,
+                          minorlength, theta, order, nlanes);
+
+    bool ok = true;
+    for (int n = 0;  n < nlanes;  ++n) {
+        int i = order[n];
+        ok &= texture_lookup_ellipse (*texturefile, thread_info, options,
+                                      nchannels, actualchannels,
+                                      ss[i], tt[i], majorlength[i],
+                                      minorlength[i], theta[i],
+                                      sres[i], tres[i],
+                                      (float *)&r, drdsp, drdtp);
+        if (gray_to_rgb)
+            fill_gray_channels (spec, nchannels, (float *)&r, drdsp, drdtp);
+        if (m_flip_t && dresultds)
+            drdt = -drdt;
+        scatter_batch_lane (i, nchannels, r, drds, drdt,
+                            result, dresultds, dresultdt);
+    }
+    return ok;
+}
+
+
+
+bool
+TextureSystemImpl::texture_batch_faces (ustring filename, TextureOpt &options,
+                                        unsigned int mask, const int *faceid,
+                                        const float *s, const float *t,
+                                        const float *dsdx, const float *dtdx,
+                                        const float *dsdy, const float *dtdy,
+                                        int nchannels, float *result,
+                                        float *dresultds, float *dresultdt)
+{
+    PerThreadInfo *thread_info = m_imagecache->get_perthread_info ();
+    TextureFile *texturefile = find_texturefile (filename, thread_info);
+    return texture_batch_faces ((TextureHandle *)texturefile,
+                                (Perthread *)thread_info, options, mask,
+                                faceid, s, t, dsdx, dtdx, dsdy, dtdy,
+                                nchannels, result, dresultds, dresultdt);
+}
+
+
+
+bool
+TextureSystemImpl::texture_batch_faces (TextureHandle *texture_handle,
+                                        Perthread *thread_info,
+                                        TextureOpt &options,
+                                        unsigned int mask, const int *faceid,
+                                        const float *s, const float *t,
+                                        const float *dsdx, const float *dtdx,
+                                        const float *dsdy, const float *dtdy,
+                                        int nchannels, float *result,
+                                        float *dresultds, float *dresultdt)
+{
+    mask &= (1U << BatchWidth) - 1;
+    bool ok = true;
+    // A lane naming a face the file doesn't have is an error; it gets the
+    // fill value.  (A missing or broken file is left to texture_batch.)
+    PerThreadInfo *ti = m_imagecache->get_perthread_info ((PerThreadInfo *)thread_info);
+    TextureFile *texturefile = verify_texturefile ((TextureFile *)texture_handle, ti);
+    if (texturefile && ! texturefile->broken() && ! texturefile->is_udim()) {
+        int nfaces = texturefile->subimages();
+        for (int i = 0;  i < BatchWidth;  ++i) {
+            if (! (mask & (1U << i)) || (faceid[i] >= 0 && faceid[i] < nfaces))
+                continue;
+            error ("Invalid face %d (of %d) in texture \"%s\"",
+                   faceid[i], nfaces, texturefile->filename());
+            mask &= ~(1U << i);
+            ok = false;
+            for (int c = 0;  c < nchannels;  ++c) {
+                result[c*BatchWidth+i] = options.fill;
+                if (dresultds) {
+                    dresultds[c*BatchWidth+i] = 0.0f;
+                    dresultdt[c*BatchWidth+i] = 0.0f;
+                }
+            }
+        }
+    }
+    // Peel off the lanes of one face at a time, and look them up as a
+    // regular batch so that they share the face's tiles.  Each face gets
+    // its own copy of the options, since texture_batch resolves the wrap
+    // modes against the resolution of the subimage.
+    while (mask) {
+        int first = 0;
+        while (! (mask & (1U << first)))
+            ++first;
+        int face = faceid[first];
+        unsigned int facemask = 0;
+        for (int i = 0;  i < BatchWidth;  ++i)
+            if ((mask & (1U << i)) && faceid[i] == face)
+                facemask |= (1U << i);
+        mask &= ~facemask;
+        TextureOpt faceopt (options);
+        faceopt.subimage = face;
+        faceopt.subimagename.clear ();
+        ok &= texture_batch (texture_handle, thread_info, faceopt, facemask,
+                             s, t, dsdx, dtdx, dsdy, dtdy,
+                             nchannels, result, dresultds, dresultdt);
+    }
+    return ok;
+}
+
+
+
 const float *
 TextureSystemImpl::pole_color (TextureFile &texturefile,
                                PerThreadInfo *thread_info,
@@ -1746,6 +3124,47 @@ TextureSystemImpl::fade_to_pole (float t, float *accum, float &weight,
 
 
 
+bool
+TextureSystemImpl::sample_nonblocking (sampler_prototype sampler,
+                                       int nsamples, const float *s_,
+                                       const float *t_, int miplevel,
+                                       TextureFile &texturefile,
+                                       PerThreadInfo *thread_info,
+                                       TextureOpt &options,
+                                       int nchannels_result, int actualchannels,
+                                       const float *weight_, float4 *accum_,
+                                       float4 *daccumds_, float4 *daccumdt_)
+{
+    // Files the cache MIP-maps itself make their levels from the finer
+    // ones as they're read, which the I/O threads can't be left to do
+    // out of order, so those just block.
+    int nlevels = texturefile.miplevels (options.subimage);
+    bool nonblocking = m_imagecache->io_threads() > 0 &&
+                       ! texturefile.subimageinfo(options.subimage).unmipped;
+    options.nonblocking = false;   // so the sampler doesn't recurse
+    bool ok = false;
+    for (int lev = miplevel;  lev < nlevels;  ++lev) {
+        // Anything missing from the coarsest level we wait for, so that
+        // there's always an answer.
+        thread_info->nonblocking = nonblocking && lev < nlevels-1;
+        thread_info->tile_pending = false;
+        ok = (this->*sampler) (OIIO_SAMPLER_ARGS_AT (lev));
+        thread_info->nonblocking = false;
+        if (! thread_info->tile_pending) {
+            if (lev != miplevel) {
+                options.approximate = true;
+                ++thread_info->m_stats.approximate_lookups;
+            }
+            break;
+        }
+    }
+    thread_info->tile_pending = false;
+    options.nonblocking = true;
+    return ok;
+}
+
+
+
 bool
 TextureSystemImpl::sample_closest (int nsamples, const float *s_,
                                    const float *t_, int miplevel,
@@ -1756,6 +3175,9 @@ TextureSystemImpl::sample_closest (int nsamples, const float *s_,
                                    const float *weight_,
                                    float4 *accum_, float4 *daccumds_, float4 *daccumdt_)
 {
+    if (options.nonblocking)
+        return sample_nonblocking (&TextureSystemImpl::sample_closest,
+                                   OIIO_SAMPLER_ARGS);
     bool allok = true;
     const ImageSpec &spec (texturefile.spec (options.subimage, miplevel));
     const ImageCacheFile::LevelInfo &levelinfo (texturefile.levelinfo(options.subimage,miplevel));
@@ -1805,8 +3227,11 @@ TextureSystemImpl::sample_closest (int nsamples, const float *s_,
         int tile_t = (ttex - spec.y) % spec.tile_height;
         id.xy (stex - tile_s, ttex - tile_t);
         bool ok = find_tile (id, thread_info);
-        if (! ok)
+        if (! ok) {
+            if (thread_info->tile_pending)
+                return false;   // nonblocking, try a coarser level
             error ("%s", m_imagecache->geterror());
+        }
         TileRef &tile (thread_info->tile);
         if (! tile  ||  ! ok) {
             allok = false;
@@ -1922,13 +3347,36 @@ TextureSystemImpl::sample_bilinear (int nsamples, const float *s_,
                                     int nchannels_result, int actualchannels,
                                     const float *weight_,
                                     float4 *accum_, float4 *daccumds_, float4 *daccumdt_)
+{
+    if (options.nonblocking)
+        return sample_nonblocking (&TextureSystemImpl::sample_bilinear,
+                                   OIIO_SAMPLER_ARGS);
+    TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(options.subimage);
+    switch (sampler_variant (pixeltype, options.swrap, options.twrap)) {
+        OIIO_SAMPLER_VARIANT_CASES (sample_bilinear_t)
+    }
+    const ImageSpec &spec (texturefile.spec (options.subimage, miplevel));
+    WrapAny wrap (options, spec, wrap_functions[(int)options.swrap],
+                  wrap_functions[(int)options.twrap]);
+    return sample_bilinear_t (OIIO_SAMPLER_ARGS, TexelAny (pixeltype), wrap);
+}
+
+
+
+template<class TEXEL, class WRAP>
+bool
+TextureSystemImpl::sample_bilinear_t (int nsamples, const float *s_,
+                                      const float *t_, int miplevel,
+                                      TextureFile &texturefile,
+                                      PerThreadInfo *thread_info,
+                                      TextureOpt &options,
+                                      int nchannels_result, int actualchannels,
+                                      const float *weight_, float4 *accum_,
+                                      float4 *daccumds_, float4 *daccumdt_,
+                                      const TEXEL &texel, const WRAP &wrap)
 {
     const ImageSpec &spec (texturefile.spec (options.subimage, miplevel));
     const ImageCacheFile::LevelInfo &levelinfo (texturefile.levelinfo(options.subimage,miplevel));
-    TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(options.subimage);
-    wrap_impl swrap_func = wrap_functions[(int)options.swrap];
-    wrap_impl twrap_func = wrap_functions[(int)options.twrap];
-    wrap_impl_simd wrap_func = (swrap_func == twrap_func) ? wrap_functions_simd[(int)options.swrap] : NULL;
     simd::int4 xy (spec.x, spec.y);
     simd::int4 widthheight (spec.width, spec.height);
     simd::int4 tilewh (spec.tile_width, spec.tile_height);
@@ -1983,16 +3431,7 @@ TextureSystemImpl::sample_bilinear (int nsamples, const float *s_,
         enum { S0=0, S1=1, T0=2, T1=3 };
     
         simd::int4 sttex (sint, sint+1, tint, tint+1); // Texel coords: s0,s1,t0,t1
-        simd::mask4 stvalid;
-        if (wrap_func) {
-            // Both directions use the same wrap function, call in parallel.
-            stvalid = wrap_func (sttex, xy, widthheight);
-        } else {
-            stvalid.load (swrap_func (sttex[S0], spec.x, spec.width),
-                          swrap_func (sttex[S1], spec.x, spec.width),
-                          twrap_func (sttex[T0], spec.y, spec.height),
-                          twrap_func (sttex[T1], spec.y, spec.height));
-        }
+        simd::mask4 stvalid = wrap.st (sttex, xy, widthheight);
     
         // Account for crop windows
         if (! levelinfo.full_pixel_range) {
@@ -2016,8 +3455,11 @@ TextureSystemImpl::sample_bilinear (int nsamples, const float *s_,
             // Shortcut if all the texels we need are on the same tile
             id.xy (sttex[S0] - tile_st[S0], sttex[T0] - tile_st[T0]);
             bool ok = find_tile (id, thread_info);
-            if (! ok)
+            if (! ok) {
+                if (thread_info->tile_pending)
+                    return false;   // nonblocking, try a coarser level
                 error ("%s", m_imagecache->geterror());
+            }
             TileRef &tile (thread_info->tile);
             if (! tile->valid())
                 return false;
@@ -2025,32 +3467,11 @@ TextureSystemImpl::sample_bilinear (int nsamples, const float *s_,
             int offset = pixelsize * (tile_st[T0] * spec.tile_width + tile_st[S0]);
             const unsigned char *p = tile->bytedata() + offset 
                                    + channelsize * (firstchannel - id.chbegin());
-            if (pixeltype == TypeDesc::UINT8) {
-                texel_simd[0][0] = uchar2float4 (p);
-                texel_simd[0][1] = uchar2float4 (p+pixelsize);
-                p += pixelsize * spec.tile_width;
-                texel_simd[1][0] = uchar2float4 (p);
-                texel_simd[1][1] = uchar2float4 (p+pixelsize);
-            } else if (pixeltype == TypeDesc::UINT16) {
-                texel_simd[0][0] = ushort2float4 ((uint16_t *)p);
-                texel_simd[0][1] = ushort2float4 ((uint16_t *)(p+pixelsize));
-                p += pixelsize * spec.tile_width;
-                texel_simd[1][0] = ushort2float4 ((uint16_t *)p);
-                texel_simd[1][1] = ushort2float4 ((uint16_t *)(p+pixelsize));
-            } else if (pixeltype == TypeDesc::HALF) {
-                texel_simd[0][0] = half2float4 ((half *)p);
-                texel_simd[0][1] = half2float4 ((half *)(p+pixelsize));
-                p += pixelsize * spec.tile_width;
-                texel_simd[1][0] = half2float4 ((half *)p);
-                texel_simd[1][1] = half2float4 ((half *)(p+pixelsize));
-            } else {
-                DASSERT (pixeltype == TypeDesc::FLOAT);
-                texel_simd[0][0].load ((const float *)p);
-                texel_simd[0][1].load ((const float *)(p+pixelsize));
-                p += pixelsize * spec.tile_width;
-                texel_simd[1][0].load ((const float *)p);
-                texel_simd[1][1].load ((const float *)(p+pixelsize));
-            }
+            texel_simd[0][0] = texel (p);
+            texel_simd[0][1] = texel (p+pixelsize);
+            p += pixelsize * spec.tile_width;
+            texel_simd[1][0] = texel (p);
+            texel_simd[1][1] = texel (p+pixelsize);
         } else {
             bool noreusetile = (options.swrap == TextureOpt::WrapMirror);
             simd::int4 tile_st = (sttex - xy) % tilewh;
@@ -2075,8 +3496,11 @@ TextureSystemImpl::sample_bilinear (int nsamples, const float *s_,
                     if (i == 0 || tile_s == 0 || noreusetile) {
                         id.xy (tile_edge[S0+i], tile_edge[T0+j]);
                         bool ok = find_tile (id, thread_info);
-                        if (! ok)
+                        if (! ok) {
+                            if (thread_info->tile_pending)
+                                return false;   // nonblocking, try a coarser level
                             error ("%s", m_imagecache->geterror());
+                        }
                         if (! thread_info->tile->valid()) {
                             return false;
                         }
@@ -2087,16 +3511,7 @@ TextureSystemImpl::sample_bilinear (int nsamples, const float *s_,
                     int offset = pixelsize * (tile_t * spec.tile_width + tile_s);
                     offset += (firstchannel - id.chbegin()) * channelsize;
                     DASSERT (offset < spec.tile_width*spec.tile_height*spec.tile_depth*pixelsize);
-                    if (pixeltype == TypeDesc::UINT8)
-                        texel_simd[j][i] = uchar2float4 ((const unsigned char *)(tile->bytedata() + offset));
-                    else if (pixeltype == TypeDesc::UINT16)
-                        texel_simd[j][i] = ushort2float4 ((const unsigned short *)(tile->bytedata() + offset));
-                    else if (pixeltype == TypeDesc::HALF)
-                        texel_simd[j][i] = half2float4 ((const half *)(tile->bytedata() + offset));
-                    else {
-                        DASSERT (pixeltype == TypeDesc::FLOAT);
-                        texel_simd[j][i].load ((const float *)(tile->bytedata() + offset));
-                    }
+                    texel_simd[j][i] = texel (tile->bytedata() + offset);
                 }
             }
         }
@@ -2252,12 +3667,36 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
                                    int nchannels_result, int actualchannels,
                                    const float *weight_,
                                    float4 *accum_, float4 *daccumds_, float4 *daccumdt_)
+{
+    if (options.nonblocking)
+        return sample_nonblocking (&TextureSystemImpl::sample_bicubic,
+                                   OIIO_SAMPLER_ARGS);
+    TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(options.subimage);
+    switch (sampler_variant (pixeltype, options.swrap, options.twrap)) {
+        OIIO_SAMPLER_VARIANT_CASES (sample_bicubic_t)
+    }
+    const ImageSpec &spec (texturefile.spec (options.subimage, miplevel));
+    WrapAny wrap (options, spec, wrap_functions[(int)options.swrap],
+                  wrap_functions[(int)options.twrap]);
+    return sample_bicubic_t (OIIO_SAMPLER_ARGS, TexelAny (pixeltype), wrap);
+}
+
+
+
+template<class TEXEL, class WRAP>
+bool
+TextureSystemImpl::sample_bicubic_t (int nsamples, const float *s_,
+                                     const float *t_, int miplevel,
+                                     TextureFile &texturefile,
+                                     PerThreadInfo *thread_info,
+                                     TextureOpt &options,
+                                     int nchannels_result, int actualchannels,
+                                     const float *weight_, float4 *accum_,
+                                     float4 *daccumds_, float4 *daccumdt_,
+                                     const TEXEL &texel, const WRAP &wrap)
 {
     const ImageSpec &spec (texturefile.spec (options.subimage, miplevel));
     const ImageCacheFile::LevelInfo &levelinfo (texturefile.levelinfo(options.subimage,miplevel));
-    TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(options.subimage);
-    wrap_impl_simd swrap_func_simd = wrap_functions_simd[(int)options.swrap];
-    wrap_impl_simd twrap_func_simd = wrap_functions_simd[(int)options.twrap];
 
     int4 spec_x_simd (spec.x);
     int4 spec_y_simd (spec.y);
@@ -2323,8 +3762,8 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
         simd::int4 stex, ttex;       // Texel coords for each row and column
         stex = sint + (*(int4 *)iota_1);
         ttex = tint + (*(int4 *)iota_1);
-        simd::mask4 svalid = swrap_func_simd (stex, spec_x_simd, spec_width_simd);
-        simd::mask4 tvalid = twrap_func_simd (ttex, spec_y_simd, spec_height_simd);
+        simd::mask4 svalid = wrap.s (stex, spec_x_simd, spec_width_simd);
+        simd::mask4 tvalid = wrap.t (ttex, spec_y_simd, spec_height_simd);
         bool allvalid = reduce_and(svalid & tvalid);
         bool anyvalid = reduce_or (svalid | tvalid);
         if (! levelinfo.full_pixel_range && anyvalid) {
@@ -2365,8 +3804,11 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
             // Shortcut if all the texels we need are on the same tile
             id.xy (stex[0] - tile_s, ttex[0] - tile_t);
             bool ok = find_tile (id, thread_info);
-            if (! ok)
+            if (! ok) {
+                if (thread_info->tile_pending)
+                    return false;   // nonblocking, try a coarser level
                 error ("%s", m_imagecache->geterror());
+            }
             TileRef &tile (thread_info->tile);
             if (! tile) {
                 return false;
@@ -2376,23 +3818,9 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
             int offset = pixelsize * (tile_t * spec.tile_width + tile_s);
             const unsigned char *base = tile->bytedata() + offset + firstchannel_offset_bytes;
             DASSERT (tile->data());
-            if (pixeltype == TypeDesc::UINT8) {
-                for (int j = 0, j_offset = 0;  j < 4;  ++j, j_offset += pixelsize*spec.tile_width)
-                    for (int i = 0, i_offset = j_offset;  i < 4;  ++i, i_offset += pixelsize)
-                        texel_simd[j][i] = uchar2float4 (base + i_offset);
-            } else if (pixeltype == TypeDesc::UINT16) {
-                for (int j = 0, j_offset = 0;  j < 4;  ++j, j_offset += pixelsize*spec.tile_width)
-                    for (int i = 0, i_offset = j_offset;  i < 4;  ++i, i_offset += pixelsize)
-                        texel_simd[j][i] = ushort2float4 ((const uint16_t *)(base + i_offset));
-            } else if (pixeltype == TypeDesc::HALF) {
-                for (int j = 0, j_offset = 0;  j < 4;  ++j, j_offset += pixelsize*spec.tile_width)
-                    for (int i = 0, i_offset = j_offset;  i < 4;  ++i, i_offset += pixelsize)
-                        texel_simd[j][i] = half2float4 ((const half *)(base + i_offset));
-            } else {
-                for (int j = 0, j_offset = 0;  j < 4;  ++j, j_offset += pixelsize*spec.tile_width)
-                    for (int i = 0, i_offset = j_offset;  i < 4;  ++i, i_offset += pixelsize)
-                        texel_simd[j][i].load ((const float *)(base + i_offset));
-            }
+            for (int j = 0, j_offset = 0;  j < 4;  ++j, j_offset += pixelsize*spec.tile_width)
+                for (int i = 0, i_offset = j_offset;  i < 4;  ++i, i_offset += pixelsize)
+                    texel_simd[j][i] = texel (base + i_offset);
         } else {
             simd::int4 tile_s, tile_t;   // texel offset WITHIN its tile
             simd::int4 tile_s_edge, tile_t_edge;  // coordinate of the tile edge
@@ -2420,8 +3848,11 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
                     if (i == 0 || tile_s[i] == 0 || options.swrap == TextureOpt::WrapMirror) {
                         id.xy (tile_s_edge[i], tile_t_edge[j]);
                         bool ok = find_tile (id, thread_info);
-                        if (! ok)
+                        if (! ok) {
+                            if (thread_info->tile_pending)
+                                return false;   // nonblocking, try a coarser level
                             error ("%s", m_imagecache->geterror());
+                        }
                         DASSERT (thread_info->tile->id() == id);
                         if (! thread_info->tile->valid())
                             return false;
@@ -2429,15 +3860,7 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
                     TileRef &tile (thread_info->tile);
                     DASSERT (tile->data());
                     int offset = row_offset_bytes + column_offset_bytes[i];
-                    // const unsigned char *pixelptr = tile->bytedata() + offset[i];
-                    if (pixeltype == TypeDesc::UINT8)
-                        texel_simd[j][i] = uchar2float4 (tile->bytedata() + offset);
-                    else if (pixeltype == TypeDesc::UINT16)
-                        texel_simd[j][i] = ushort2float4 ((const uint16_t *)(tile->bytedata() + offset));
-                    else if (pixeltype == TypeDesc::HALF)
-                        texel_simd[j][i] = half2float4 ((const half *)(tile->bytedata() + offset));
-                    else
-                        texel_simd[j][i].load ((const float *)(tile->bytedata() + offset));
+                    texel_simd[j][i] = texel (tile->bytedata() + offset);
                 }
             }
         }
@@ -2564,6 +3987,169 @@ TextureSystemImpl::sample_bicubic (int nsamples, const float *s_,
 
 
 
+bool
+TextureSystemImpl::sample_ewa (float s, float t, float smajor, float tmajor,
+                               float sminor, float tminor, int miplevel,
+                               TextureFile &texturefile,
+                               PerThreadInfo *thread_info,
+                               TextureOpt &options,
+                               int nchannels_result, int actualchannels,
+                               float4 *accum_, float4 *daccumds_,
+                               float4 *daccumdt_, int &ntexels)
+{
+    bool allok = true;
+    const ImageSpec &spec (texturefile.spec (options.subimage, miplevel));
+    const ImageCacheFile::LevelInfo &levelinfo (texturefile.levelinfo(options.subimage,miplevel));
+    TypeDesc::BASETYPE pixeltype = texturefile.pixeltype(options.subimage);
+    wrap_impl swrap_func = wrap_functions[(int)options.swrap];
+    wrap_impl twrap_func = wrap_functions[(int)options.twrap];
+    bool use_fill = (nchannels_result > actualchannels && options.fill);
+    int firstchannel = options.firstchannel;
+    int tile_chbegin = 0, tile_chend = spec.nchannels;
+    if (spec.nchannels > m_max_tile_channels) {
+        // For files with many channels, narrow the range we cache
+        tile_chbegin = options.firstchannel;
+        tile_chend = options.firstchannel+actualchannels;
+    }
+    TileID id (texturefile, options.subimage, miplevel, 0, 0, 0,
+               tile_chbegin, tile_chend);
+
+    // Ellipse center, in continuous texel coordinates of this level.
+    int stex, ttex;
+    float sfrac, tfrac;
+    st_to_texel (s, t, texturefile, spec, stex, ttex, sfrac, tfrac);
+    float sc = stex + sfrac, tc = ttex + tfrac;
+
+    // Implicit ellipse A*du^2 + B*du*dv + C*dv^2 < F in texel space, from
+    // the semi-axis vectors (Heckbert's EWA).  Adding 1 to A and C widens
+    // the ellipse by about a texel, which serves as the reconstruction
+    // filter and keeps a magnified footprint from missing every texel.
+    float ux = smajor * spec.width, vx = tmajor * spec.height;
+    float uy = sminor * spec.width, vy = tminor * spec.height;
+    float A = vx*vx + vy*vy + 1.0f;
+    float B = -2.0f * (ux*vx + uy*vy);
+    float C = ux*ux + uy*uy + 1.0f;
+    float F = A*C - 0.25f*B*B;
+    float tradius = sqrtf (A);   // t half-extent of the ellipse
+    float Finv = 1.0f / F;
+    A *= Finv;  B *= Finv;  C *= Finv;    // now inside means q < 1
+
+    const int tablesize = EWAWeightTable::size;
+    static const OIIO_SIMD4_ALIGN float iota_start[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    float4 iota = *(const float4 *)iota_start;
+    float4 A4 (A), twoA4 (2.0f*A), B4 (B);
+    float4 accum, daccumds, daccumdt;
+    accum.clear();
+    daccumds.clear();
+    daccumdt.clear();
+    float wsum = 0.0f, nonfill = 0.0f;
+    float dwds = 0.0f, dwdt = 0.0f;
+    int n = 0;
+    for (int j = (int) ceilf (tc - tradius), j1 = ifloor (tc + tradius);
+         j <= j1;  ++j) {
+        // Solve for the span of this row that's inside the ellipse.
+        float dv = j - tc;
+        float disc = B*B*dv*dv - 4.0f*A*(C*dv*dv - 1.0f);
+        if (disc <= 0.0f)
+            continue;
+        float root = sqrtf (disc), inv2A = 0.5f / A;
+        int i0 = (int) ceilf (sc + (-B*dv - root) * inv2A);
+        int i1 = ifloor (sc + (-B*dv + root) * inv2A);
+        int jj = j;
+        bool tvalid = twrap_func (jj, spec.y, spec.height);
+        if (! levelinfo.full_pixel_range)
+            tvalid &= (jj >= spec.y && jj < (spec.y+spec.height));
+        float4 Bdv (B*dv), Cdv2 (C*dv*dv), twoCdv (2.0f*C*dv);
+
+        // Evaluate the filter weights four texels at a time.
+        for (int i = i0;  i <= i1;  i += 4) {
+            float4 du = float4 (float(i) - sc) + iota;
+            float4 q = (A4 * du + Bdv) * du + Cdv2;
+            OIIO_SIMD4_ALIGN int index[4];
+            OIIO_SIMD4_ALIGN float dqds[4], dqdt[4];
+            min (max (int4 (q * float(tablesize)), int4::Zero()),
+                 int4 (tablesize-1)).store (index);
+            if (daccumds_) {
+                // Moving the center by +1 texel moves du, dv by -1.
+                (-(twoA4 * du + Bdv)).store (dqds);
+                (-(B4 * du + twoCdv)).store (dqdt);
+            }
+            for (int k = 0, e = std::min (4, i1-i+1);  k < e;  ++k) {
+                float w = ewa_weights.weight[index[k]];
+                float dw = ewa_weights.dweight[index[k]];
+                wsum += w;
+                if (daccumds_) {
+                    dwds += dw * dqds[k];
+                    dwdt += dw * dqdt[k];
+                }
+                ++n;
+                int ii = i + k;
+                bool svalid = swrap_func (ii, spec.x, spec.width);
+                if (! levelinfo.full_pixel_range)
+                    svalid &= (ii >= spec.x && ii < (spec.x+spec.width));
+                if (! (svalid & tvalid)) {
+                    nonfill += w;
+                    continue;
+                }
+                int tile_s = (ii - spec.x) % spec.tile_width;
+                int tile_t = (jj - spec.y) % spec.tile_height;
+                id.xy (ii - tile_s, jj - tile_t);
+                bool ok = find_tile (id, thread_info);
+                if (! ok)
+                    error ("%s", m_imagecache->geterror());
+                TileRef &tile (thread_info->tile);
+                if (! tile  ||  ! ok) {
+                    allok = false;
+                    continue;
+                }
+                int offset = id.nchannels() * (tile_t * spec.tile_width + tile_s)
+                                + (firstchannel - id.chbegin());
+                DASSERT ((size_t)offset < spec.nchannels*spec.tile_pixels());
+                simd::float4 texel_simd;
+                if (pixeltype == TypeDesc::UINT8) {
+                    texel_simd = uchar2float4 (tile->bytedata() + offset);
+                } else if (pixeltype == TypeDesc::UINT16) {
+                    texel_simd = ushort2float4 (tile->ushortdata() + offset);
+                } else if (pixeltype == TypeDesc::HALF) {
+                    texel_simd = half2float4 (tile->halfdata() + offset);
+                } else {
+                    DASSERT (pixeltype == TypeDesc::FLOAT);
+                    texel_simd.load (tile->floatdata() + offset);
+                }
+                accum += w * texel_simd;
+                if (daccumds_) {
+                    daccumds += (dw * dqds[k]) * texel_simd;
+                    daccumdt += (dw * dqdt[k]) * texel_simd;
+                }
+            }
+        }
+    }
+    ntexels = n;
+
+    // Normalize.  The +1 widening guarantees the ellipse covers at least
+    // one texel, so wsum is only zero in degenerate cases.
+    float winv = wsum > 0.0f ? 1.0f / wsum : 0.0f;
+    accum *= winv;
+    simd::mask4 channel_mask = channel_masks[actualchannels];
+    if (daccumds_) {
+        // Quotient rule on accum/wsum, then texel units to st units.
+        float4 ds = (daccumds - accum * dwds) * (winv * float(spec.width));
+        float4 dt = (daccumdt - accum * dwdt) * (winv * float(spec.height));
+        *daccumds_ = blend0 (ds, channel_mask);
+        *daccumdt_ = blend0 (dt, channel_mask);
+    }
+    accum = blend0 (accum, channel_mask);
+    if (use_fill) {
+        // Add the weighted fill color
+        nonfill *= winv;
+        accum += blend0not (float4((1.0f - nonfill) * options.fill), channel_mask);
+    }
+    *accum_ = accum;
+    return allok;
+}
+
+
+
 void
 TextureSystemImpl::visualize_ellipse (const std::string &name,
                                       float dsdx, float dtdx,
@@ -8,9 +8,19 @@
 
 // If compiling with MFC, you might want to add #include "StdAfx.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "OpenImageIO/SHA1.h"
 #include "OpenImageIO/hash.h"
 #include "OpenImageIO/dassert.h"
+#include "OpenImageIO/simd.h"
+
+// The SHA extensions (SHA-NI) do the whole SHA-1 compression in hardware.
+#if defined(__SHA__) && defined(__SSE4_1__)
+#  define OIIO_SHA1_SHANI 1
+#  include <immintrin.h>
+#endif
 
 #ifdef SHA1_UTILITY_FUNCTIONS
 #define SHA1_MAX_FILE_BUFFER 8000
@@ -89,6 +99,203 @@ SHA1::digest ()
 
 
 
+std::string
+SHA1::hex_digest (const Hash &h)
+{
+    static const char hexdigits[] = "0123456789ABCDEF";
+    char d[40];
+    for (int i = 0;  i < 20;  ++i) {
+        d[2*i]   = hexdigits[h.hash[i] >> 4];
+        d[2*i+1] = hexdigits[h.hash[i] & 15];
+    }
+    return std::string (d, 40);
+}
+
+
+
+namespace {
+
+#if OIIO_SHA1_SHANI
+// Five groups of 4 SHA-1 rounds with the SHA extensions, starting at
+// group `first`.  Each group takes the next 4 message words (computed
+// with sha1msg1/sha1msg2 beyond the first 16) and the rotated e from the
+// previous group (sha1nexte).  F, the round function, must be an
+// immediate, hence the template.
+template<int F>
+inline void
+sha1_shani_groups (int first, const unsigned char *data, __m128i w[4],
+                   __m128i &abcd, __m128i &eprev, const __m128i &e0)
+{
+    const __m128i bswap = _mm_set_epi64x (0x0001020304050607ULL,
+                                          0x08090a0b0c0d0e0fULL);
+    for (int i = first;  i < first+5;  ++i) {
+        if (i < 4)
+            w[i] = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)(data + 16*i)), bswap);
+        else
+            w[i&3] = _mm_sha1msg2_epu32 (_mm_xor_si128 (_mm_sha1msg1_epu32 (w[i&3], w[(i+1)&3]),
+                                                        w[(i+2)&3]),
+                                         w[(i+3)&3]);
+        __m128i e = i ? _mm_sha1nexte_epu32 (eprev, w[i&3])
+                      : _mm_add_epi32 (e0, w[0]);
+        eprev = abcd;
+        abcd = _mm_sha1rnds4_epu32 (abcd, e, F);
+    }
+}
+
+
+
+// Compress nblocks 64 byte blocks into state using the SHA extensions.
+static void
+sha1_transform_shani (uint32_t state[5], const unsigned char *data,
+                      size_t nblocks)
+{
+    __m128i abcd = _mm_shuffle_epi32 (_mm_loadu_si128 ((const __m128i *)state),
+                                      0x1B);
+    __m128i e0 = _mm_set_epi32 (int(state[4]), 0, 0, 0);
+    for ( ;  nblocks--;  data += 64) {
+        __m128i abcd_save = abcd, eprev;
+        __m128i w[4];
+        sha1_shani_groups<0> ( 0, data, w, abcd, eprev, e0);
+        sha1_shani_groups<1> ( 5, data, w, abcd, eprev, e0);
+        sha1_shani_groups<2> (10, data, w, abcd, eprev, e0);
+        sha1_shani_groups<3> (15, data, w, abcd, eprev, e0);
+        e0 = _mm_sha1nexte_epu32 (eprev, e0);
+        abcd = _mm_add_epi32 (abcd, abcd_save);
+    }
+    _mm_storeu_si128 ((__m128i *)state, _mm_shuffle_epi32 (abcd, 0x1B));
+    state[4] = uint32_t (_mm_extract_epi32 (e0, 3));
+}
+#endif
+
+
+
+inline uint32_t
+load_be32 (const unsigned char *p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+           (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+
+
+// Hash up to VINT::elements buffers at once, one per SIMD lane.  Each
+// lane's message is its whole 64 byte blocks read in place, then one or
+// two blocks holding the rest, the 0x80 terminator and the bit length.
+// Lanes with fewer blocks than the longest one simply stop updating
+// their state once they run out.
+template<class VINT>
+static void
+sha1_lanes (int n, const void * const *data, const size_t *size,
+            SHA1::Hash *hashes)
+{
+    const int L = VINT::elements;
+    DASSERT (n >= 1 && n <= L);
+    unsigned char tail[L][128];
+    size_t nfull[L], nblocks[L], maxblocks = 0;
+    memset (tail, 0, sizeof(tail));
+    for (int l = 0;  l < L;  ++l) {
+        if (l >= n) {
+            nfull[l] = nblocks[l] = 0;
+            continue;
+        }
+        nfull[l] = size[l] / 64;
+        size_t r = size[l] % 64;
+        memcpy (tail[l], (const unsigned char *)data[l] + 64*nfull[l], r);
+        tail[l][r] = 0x80;
+        int ntail = (r + 9 > 64) ? 2 : 1;
+        unsigned long long bits = (unsigned long long)size[l] * 8;
+        for (int i = 0;  i < 8;  ++i)
+            tail[l][64*ntail-1-i] = (unsigned char)(bits >> (8*i));
+        nblocks[l] = nfull[l] + ntail;
+        maxblocks = std::max (maxblocks, nblocks[l]);
+    }
+
+    VINT h[5] = { VINT(0x67452301), VINT(int(0xEFCDAB89)),
+                  VINT(int(0x98BADCFE)), VINT(0x10325476),
+                  VINT(int(0xC3D2E1F0)) };
+    const VINT k0 (0x5A827999), k1 (0x6ED9EBA1);
+    const VINT k2 (int(0x8F1BBCDC)), k3 (int(0xCA62C1D6));
+    OIIO_SIMD_ALIGN int words[16][L];
+    OIIO_SIMD_ALIGN int active[L];
+    for (size_t b = 0;  b < maxblocks;  ++b) {
+        // Transpose the lanes' blocks so that w[t] holds word t of each.
+        for (int l = 0;  l < L;  ++l) {
+            const unsigned char *blk = tail[l];   // zeros if finished
+            active[l] = b < nblocks[l] ? -1 : 0;
+            if (b < nfull[l])
+                blk = (const unsigned char *)data[l] + 64*b;
+            else if (b < nblocks[l])
+                blk = tail[l] + 64*(b-nfull[l]);
+            for (int t = 0;  t < 16;  ++t)
+                words[t][l] = int (load_be32 (blk + 4*t));
+        }
+        VINT w[16];
+        for (int t = 0;  t < 16;  ++t)
+            w[t].load (words[t]);
+        VINT a = h[0], bb = h[1], c = h[2], d = h[3], e = h[4];
+        for (int t = 0;  t < 80;  ++t) {
+            if (t >= 16)
+                w[t&15] = rotl32 (w[(t+13)&15] ^ w[(t+8)&15] ^
+                                  w[(t+2)&15] ^ w[t&15], 1);
+            VINT f, k;
+            if (t < 20) {
+                f = d ^ (bb & (c ^ d));          k = k0;
+            } else if (t < 40) {
+                f = bb ^ c ^ d;                  k = k1;
+            } else if (t < 60) {
+                f = (bb & c) | (d & (bb | c));   k = k2;
+            } else {
+                f = bb ^ c ^ d;                  k = k3;
+            }
+            VINT tmp = rotl32 (a, 5) + f + e + k + w[t&15];
+            e = d;  d = c;  c = rotl32 (bb, 30);  bb = a;  a = tmp;
+        }
+        VINT act;
+        act.load (active);
+        h[0] += a & act;
+        h[1] += bb & act;
+        h[2] += c & act;
+        h[3] += d & act;
+        h[4] += e & act;
+    }
+
+    OIIO_SIMD_ALIGN int state[5][L];
+    for (int i = 0;  i < 5;  ++i)
+        h[i].store (state[i]);
+    for (int l = 0;  l < n;  ++l)
+        for (int i = 0;  i < 5;  ++i)
+            for (int j = 0;  j < 4;  ++j)
+                hashes[l].hash[4*i+j] = (unsigned char)(uint32_t(state[i][l]) >> (24-8*j));
+}
+
+}  // end anon namespace
+
+
+
+void
+SHA1::hash_many (int n, const void * const *data, const size_t *size,
+                 Hash *hashes)
+{
+#if OIIO_SHA1_SHANI
+    // With the SHA extensions, one stream at a time is fastest.
+    for (int i = 0;  i < n;  ++i) {
+        SHA1 sha (data[i], size[i]);
+        sha.gethash (hashes[i]);
+    }
+#else
+# if OIIO_SIMD_AVX >= 2
+    typedef simd::int8 VINT;
+# else
+    typedef simd::int4 VINT;
+# endif
+    for (int i = 0;  i < n;  i += VINT::elements)
+        sha1_lanes<VINT> (std::min (n-i, int(VINT::elements)),
+                          data+i, size+i, hashes+i);
+#endif
+}
+
+
+
 
 CSHA1::CSHA1()
 {
@@ -117,6 +324,11 @@ void CSHA1::Reset()
 
 void CSHA1::Transform(UINT_32* pState, const UINT_8* pBuffer)
 {
+#if OIIO_SHA1_SHANI
+	sha1_transform_shani(pState, pBuffer, 1);
+	return;
+#endif
+
 	UINT_32 a = pState[0], b = pState[1], c = pState[2], d = pState[3], e = pState[4];
 
 	memcpy(m_block, pBuffer, 64);
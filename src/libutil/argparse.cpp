@@ -318,8 +318,21 @@ ArgOption::add_argument (const char *argv)
 
 
 
+namespace {
+// The name without its leading "-" or "--"
+inline string_view
+undashed (string_view name)
+{
+    if (name.size() && name[0] == '-')
+        name.remove_prefix (name.size() > 1 && name[1] == '-' ? 2 : 1);
+    return name;
+}
+}
+
+
+
 ArgParse::ArgParse (int argc, const char **argv)
-    : m_argc(argc), m_argv(argv), m_global(NULL)
+    : m_argc(argc), m_argv(argv), m_global(NULL), m_aborted(false)
 {
 }
 
@@ -341,22 +354,24 @@ ArgParse::~ArgParse()
 // Each command line argument is parsed and checked to see if it matches an
 // existing option.  If there is no match, and error is reported and the
 // function returns early.  If there is a match, all the arguments for
-// that option are parsed and the associated variables are set.
+// that option are parsed and the associated variables are set.  A
+// callback may call abort() to stop parsing once it returns.
 int
 ArgParse::parse (int xargc, const char **xargv)
 {
     m_argc = xargc;
     m_argv = xargv;
+    m_aborted = false;
 
-    for (int i = 1; i < m_argc; i++) {
+    for (int i = 1; i < m_argc && ! m_aborted; i++) {
         if (m_argv[i][0] == '-' && 
               (isalpha (m_argv[i][1]) || m_argv[i][1] == '-')) {     // flag
             // Look up only the part before a ':'
-            std::string argname = m_argv[i];
+            string_view argname (m_argv[i]);
             size_t colon = argname.find_first_of (':');
-            if (colon != std::string::npos)
-                argname.erase (colon, std::string::npos);
-            ArgOption *option = find_option (argname.c_str());
+            if (colon != string_view::npos)
+                argname = argname.substr (0, colon);
+            ArgOption *option = find_option (argname);
             if (option == NULL) {
                 error ("Invalid option \"%s\"", m_argv[i]);
                 return -1;
@@ -447,6 +462,12 @@ ArgParse::options (const char *intro, ...)
         // Last argument is description
         option->description ((const char *) va_arg (ap, const char *));
         m_option.push_back(option);
+        // The names live as long as the options, so they can be the keys.
+        if (option->name().size()) {
+            string_view name (option->name());
+            m_byname.insert (std::make_pair (name, option));
+            m_byundashed.insert (std::make_pair (undashed (name), option));
+        }
     }
 
     va_end (ap);
@@ -455,24 +476,19 @@ ArgParse::options (const char *intro, ...)
 
 
 
-// Find an option by name in the option vector
+// Find an option by name, without allocating: the exact name if there is
+// one, otherwise one that differs only in having one dash or two.
 ArgOption *
-ArgParse::find_option (const char *name)
+ArgParse::find_option (string_view name)
 {
-    for (std::vector<ArgOption *>::const_iterator i = m_option.begin();
-         i != m_option.end(); i++) {
-        const char *opt = (*i)->name().c_str();
-        if (! strcmp(name, opt))
-            return *i;
-        // Match even if the user mixes up one dash or two
-        if (name[0] == '-' && name[1] == '-' && opt[0] == '-' && opt[1] != '-')
-            if (! strcmp (name+1, opt))
-                return *i;
-        if (name[0] == '-' && name[1] != '-' && opt[0] == '-' && opt[1] == '-')
-            if (! strcmp (name, opt+1))
-                return *i;
+    std::map<string_view,ArgOption *>::const_iterator i = m_byname.find (name);
+    if (i != m_byname.end())
+        return i->second;
+    if (name.size() && name[0] == '-') {
+        i = m_byundashed.find (undashed (name));
+        if (i != m_byundashed.end())
+            return i->second;
     }
-
     return NULL;
 }
 
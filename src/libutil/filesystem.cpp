@@ -30,6 +30,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <algorithm>
@@ -45,13 +46,21 @@
 #include "OpenImageIO/ustring.h"
 #include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/refcnt.h"
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/sysutil.h"
+#include "OpenImageIO/hash.h"
 
 #ifdef _WIN32
 // # include <windows.h>   // Already done by platform.h
 # include <shellapi.h>
 # include <direct.h>
+# include <io.h>
+# include <sys/stat.h>
 #else
 # include <unistd.h>
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
 #endif
 
 
@@ -264,6 +273,170 @@ Filesystem::get_directory_entries (const std::string &dirname,
 
 
 
+namespace {
+
+// Shared by the threads of a walk_directory: the directories still to be
+// listed, and how many are queued or being listed by some thread (when
+// that reaches zero, the walk is done).
+struct DirectoryWalk {
+    mutex m_mutex;
+    std::vector<std::string> m_queue;
+    int m_pending;
+    Filesystem::DirectoryWalkCallback m_callback;
+    void *m_data;
+};
+
+
+
+struct DirectoryWalkWorker {
+    DirectoryWalk *walk;
+
+    void operator() () {
+        for (;;) {
+            std::string dirname;
+            {
+                lock_guard lock (walk->m_mutex);
+                if (walk->m_pending == 0)
+                    return;   // Nothing left anywhere
+                if (walk->m_queue.size()) {
+                    // Newest first, so the walk goes deep and the queue
+                    // stays short.
+                    dirname = walk->m_queue.back();
+                    walk->m_queue.pop_back();
+                }
+            }
+            if (dirname.empty()) {
+                // Others are still listing, and may find more work
+                Sysutil::usleep (100);
+                continue;
+            }
+            list (dirname);
+            lock_guard lock (walk->m_mutex);
+            --walk->m_pending;
+        }
+    }
+
+    void list (const std::string &dirname) {
+        try {
+#ifdef _WIN32
+            std::wstring wdirpath = Strutil::utf8_to_utf16 (dirname);
+            for (boost::filesystem::directory_iterator s (wdirpath);
+#else
+            for (boost::filesystem::directory_iterator s (dirname);
+#endif
+                 s != boost::filesystem::directory_iterator();  ++s) {
+                std::string path = s->path().string();
+                bool isdir = boost::filesystem::is_directory (s->symlink_status());
+                if (walk->m_callback (walk->m_data, path, isdir) && isdir) {
+                    lock_guard lock (walk->m_mutex);
+                    walk->m_queue.push_back (path);
+                    ++walk->m_pending;
+                }
+            }
+        } catch (...) {
+            // Unreadable directory -- skip it, as "ls -R" would
+        }
+    }
+};
+
+
+
+struct CollectedEntries {
+    spin_mutex mutex;
+    std::vector<std::pair<std::string,bool> > entries;
+};
+
+bool
+collect_entry (void *data, const std::string &path, bool is_directory)
+{
+    CollectedEntries *c = (CollectedEntries *) data;
+    spin_lock lock (c->mutex);
+    c->entries.push_back (std::make_pair (path, is_directory));
+    return true;
+}
+
+// Order paths as a tree: compare them with the separators sorting before
+// every other character, so that "a/b" is followed by "a/b/c" before
+// "a/b.exr".
+inline int
+tree_rank (char c)
+{
+#ifdef _WIN32
+    if (c == '\\')
+        return -1;
+#endif
+    return c == '/' ? -1 : (unsigned char) c;
+}
+
+bool
+tree_order (const std::pair<std::string,bool> &a,
+            const std::pair<std::string,bool> &b)
+{
+    size_t n = std::min (a.first.size(), b.first.size());
+    for (size_t i = 0;  i < n;  ++i) {
+        int ra = tree_rank (a.first[i]), rb = tree_rank (b.first[i]);
+        if (ra != rb)
+            return ra < rb;
+    }
+    return a.first.size() < b.first.size();
+}
+
+} // anon namespace
+
+
+
+bool
+Filesystem::walk_directory (const std::string &dirname,
+                            DirectoryWalkCallback callback,
+                            void *opaque_data, int nthreads)
+{
+    if (dirname.size() && ! is_directory(dirname))
+        return false;
+    if (nthreads <= 0)
+        nthreads = std::max (1, (int) Sysutil::hardware_concurrency());
+    DirectoryWalk walk;
+    walk.m_queue.push_back (dirname.size() ? dirname : std::string("."));
+    walk.m_pending = 1;
+    walk.m_callback = callback;
+    walk.m_data = opaque_data;
+    DirectoryWalkWorker worker;
+    worker.walk = &walk;
+    if (nthreads == 1) {
+        worker ();
+        return true;
+    }
+    thread_group threads;
+    for (int i = 0;  i < nthreads;  ++i)
+        threads.create_thread (worker);
+    threads.join_all ();
+    return true;
+}
+
+
+
+bool
+Filesystem::walk_directory (const std::string &dirname,
+                            std::vector<std::string> &filenames,
+                            std::vector<bool> *isdir, int nthreads)
+{
+    filenames.clear ();
+    if (isdir)
+        isdir->clear ();
+    CollectedEntries c;
+    if (! walk_directory (dirname, collect_entry, &c, nthreads))
+        return false;
+    std::sort (c.entries.begin(), c.entries.end(), tree_order);
+    filenames.reserve (c.entries.size());
+    for (size_t i = 0;  i < c.entries.size();  ++i) {
+        filenames.push_back (c.entries[i].first);
+        if (isdir)
+            isdir->push_back (c.entries[i].second);
+    }
+    return true;
+}
+
+
+
 bool
 Filesystem::path_is_absolute (const std::string &path, bool dot_is_absolute)
 {
@@ -736,6 +909,102 @@ Filesystem::file_size (string_view path)
 
 
 
+namespace {
+
+// Worker for hash_file: repeatedly claims the next group of chunks and
+// hashes them together, from the mapped file if there is one, otherwise
+// reading them with pread.
+struct FileHashWorker {
+    enum { group = 8 };
+    Filesystem::IOProxy *io;
+    const unsigned char *mapped;
+    uint64_t size;
+    size_t chunksize;
+    int ngroups;
+    atomic_int *next;
+    SHA1::Hash *leaves;
+    atomic_int *failed;
+
+    void operator() () {
+        std::vector<unsigned char> buf;
+        for (int g = (*next)++;  g < ngroups && ! *failed;  g = (*next)++) {
+            const void *data[group];
+            size_t sizes[group];
+            int n = 0;
+            for (uint64_t pos = uint64_t(g) * group * chunksize;
+                 n < group && pos < size;  ++n, pos += chunksize) {
+                sizes[n] = size_t (std::min (uint64_t(chunksize), size-pos));
+                if (mapped) {
+                    data[n] = mapped + pos;
+                } else {
+                    buf.resize (size_t(group) * chunksize);
+                    unsigned char *p = &buf[size_t(n) * chunksize];
+                    if (io->pread (p, sizes[n], int64_t(pos)) != sizes[n]) {
+                        *failed = 1;
+                        return;
+                    }
+                    data[n] = p;
+                }
+            }
+            SHA1::hash_many (n, data, sizes, leaves + size_t(g) * group);
+        }
+    }
+};
+
+} // anon namespace
+
+
+
+std::string
+Filesystem::hash_file (string_view filename, size_t chunksize, int nthreads)
+{
+    if (chunksize == 0)
+        chunksize = 4*1024*1024;
+    if (! is_regular (filename))
+        return std::string();
+    uint64_t size = file_size (filename);
+    if (size == 0)
+        return SHA1::digest (NULL, 0);
+
+    IOMappedFile mapped (filename);
+    IOFile file (mapped.mmap() ? string_view() : filename, IOProxy::Read);
+    IOProxy *io = mapped.mmap() ? (IOProxy *)&mapped : (IOProxy *)&file;
+    if (io->mode() != IOProxy::Read)
+        return std::string();
+
+    size_t nchunks = size_t ((size + chunksize - 1) / chunksize);
+    int ngroups = int ((nchunks + FileHashWorker::group - 1) / FileHashWorker::group);
+    std::vector<SHA1::Hash> leaves (nchunks);
+    atomic_int next (0), failed (0);
+    FileHashWorker worker;
+    worker.io = io;
+    worker.mapped = (const unsigned char *) mapped.mmap();
+    worker.size = size;
+    worker.chunksize = chunksize;
+    worker.ngroups = ngroups;
+    worker.next = &next;
+    worker.leaves = &leaves[0];
+    worker.failed = &failed;
+    if (nthreads <= 0)
+        nthreads = std::max (1, (int) Sysutil::hardware_concurrency());
+    nthreads = std::min (nthreads, ngroups);
+    if (nthreads <= 1) {
+        worker ();
+    } else {
+        thread_group threads;
+        for (int i = 0;  i < nthreads;  ++i)
+            threads.create_thread (worker);
+        threads.join_all ();
+    }
+    if (failed)
+        return std::string();
+    if (nchunks == 1)
+        return SHA1::hex_digest (leaves[0]);
+    return SHA1::digest (&leaves[0], nchunks * sizeof(SHA1::Hash));
+}
+
+
+
 void
 Filesystem::convert_native_arguments (int argc, const char *argv[])
 {
@@ -1065,4 +1334,494 @@ Filesystem::scan_for_matching_filenames(const std::string &pattern_,
     return true;
 }
 
+
+
+
+bool
+Filesystem::IOProxy::seek (int64_t offset, int origin)
+{
+    if (origin == SEEK_CUR)
+        offset += tell();
+    else if (origin == SEEK_END)
+        offset += int64_t(size());
+    if (offset < 0)
+        return false;
+    return seek (offset);
+}
+
+
+
+size_t
+Filesystem::IOProxy::read (void *buf, size_t size)
+{
+    size_t n = pread (buf, size, m_pos);
+    m_pos += n;
+    return n;
+}
+
+
+
+size_t
+Filesystem::IOProxy::write (const void *buf, size_t size)
+{
+    size_t n = pwrite (buf, size, m_pos);
+    m_pos += n;
+    return n;
+}
+
+
+
+Filesystem::IOFile::IOFile (string_view filename, Mode mode)
+    : IOProxy (filename, mode), m_file(NULL), m_auto_close(true),
+      m_filepos(0)
+{
+    m_file = Filesystem::fopen (m_filename, mode == Write ? "wb" : "rb");
+    if (! m_file)
+        m_mode = Closed;
+}
+
+
+
+Filesystem::IOFile::IOFile (FILE *file, Mode mode)
+    : IOProxy ("", file ? mode : Closed), m_file(file), m_auto_close(false),
+      m_filepos(-1)
+{
+}
+
+
+
+Filesystem::IOFile::~IOFile ()
+{
+    close ();
+}
+
+
+
+void
+Filesystem::IOFile::close ()
+{
+    if (m_file && m_auto_close)
+        fclose (m_file);
+    m_file = NULL;
+    m_mode = Closed;
+}
+
+
+
+bool
+Filesystem::IOFile::seek (int64_t offset)
+{
+    // Just note the position; the FILE* is repositioned lazily by the
+    // next read or write, so runs of sequential reads don't pay for it.
+    if (! m_file || offset < 0)
+        return false;
+    m_pos = offset;
+    return true;
+}
+
+
+
+static inline bool
+fseek64 (FILE *file, int64_t pos)
+{
+#ifdef _WIN32
+    return _fseeki64 (file, __int64(pos), SEEK_SET) == 0;
+#else
+    return fseeko (file, off_t(pos), SEEK_SET) == 0;
+#endif
+}
+
+
+
+size_t
+Filesystem::IOFile::read (void *buf, size_t size)
+{
+    if (! m_file || m_mode != Read)
+        return 0;
+    if (m_filepos != m_pos && ! fseek64 (m_file, m_pos)) {
+        m_filepos = -1;
+        return 0;
+    }
+    size_t n = fread (buf, 1, size, m_file);
+    m_pos += n;
+    m_filepos = m_pos;
+    return n;
+}
+
+
+
+size_t
+Filesystem::IOFile::write (const void *buf, size_t size)
+{
+    if (! m_file || m_mode != Write)
+        return 0;
+    if (m_filepos != m_pos && ! fseek64 (m_file, m_pos)) {
+        m_filepos = -1;
+        return 0;
+    }
+    size_t n = fwrite (buf, 1, size, m_file);
+    m_pos += n;
+    m_filepos = m_pos;
+    return n;
+}
+
+
+
+size_t
+Filesystem::IOFile::pread (void *buf, size_t size, int64_t offset)
+{
+    if (! m_file || offset < 0)
+        return 0;
+#ifdef _WIN32
+    // A positioned ReadFile moves the OS file pointer out from under the
+    // FILE*, so make the next read() reposition it.
+    HANDLE h = (HANDLE) _get_osfhandle (_fileno (m_file));
+    OVERLAPPED ov;
+    memset (&ov, 0, sizeof(ov));
+    ov.Offset = DWORD(offset);
+    ov.OffsetHigh = DWORD(offset >> 32);
+    DWORD n = 0;
+    m_filepos = -1;
+    if (! ReadFile (h, buf, DWORD(size), &n, &ov))
+        return 0;
+    return size_t(n);
+#else
+    ssize_t n = ::pread (fileno(m_file), buf, size, off_t(offset));
+    return n < 0 ? 0 : size_t(n);
+#endif
+}
+
+
+
+size_t
+Filesystem::IOFile::pwrite (const void *buf, size_t size, int64_t offset)
+{
+    if (! m_file || m_mode != Write || offset < 0)
+        return 0;
+    fflush (m_file);   // Buffered bytes must land before these
+#ifdef _WIN32
+    HANDLE h = (HANDLE) _get_osfhandle (_fileno (m_file));
+    OVERLAPPED ov;
+    memset (&ov, 0, sizeof(ov));
+    ov.Offset = DWORD(offset);
+    ov.OffsetHigh = DWORD(offset >> 32);
+    DWORD n = 0;
+    m_filepos = -1;
+    if (! WriteFile (h, buf, DWORD(size), &n, &ov))
+        return 0;
+    return size_t(n);
+#else
+    ssize_t n = ::pwrite (fileno(m_file), buf, size, off_t(offset));
+    return n < 0 ? 0 : size_t(n);
+#endif
+}
+
+
+
+size_t
+Filesystem::IOFile::size () const
+{
+    if (! m_file)
+        return 0;
+    if (m_mode == Write)
+        fflush (m_file);
+#ifdef _WIN32
+    struct __stat64 st;
+    if (_fstat64 (_fileno (m_file), &st) != 0)
+        return 0;
+#else
+    struct stat st;
+    if (fstat (fileno(m_file), &st) != 0)
+        return 0;
+#endif
+    return size_t(st.st_size);
+}
+
+
+
+void
+Filesystem::IOFile::flush ()
+{
+    if (m_file)
+        fflush (m_file);
+}
+
+
+
+size_t
+Filesystem::IOMemReader::pread (void *buf, size_t size, int64_t offset)
+{
+    if (offset < 0 || size_t(offset) >= m_size)
+        return 0;
+    size = std::min (size, m_size - size_t(offset));
+    memcpy (buf, m_buf + offset, size);
+    return size;
+}
+
+
+
+Filesystem::IOMappedFile::IOMappedFile (string_view filename)
+    : IOProxy (filename, Read), m_buf(NULL), m_size(0)
+{
+#ifdef _WIN32
+    m_mapping = NULL;
+    HANDLE file = CreateFileW (Strutil::utf8_to_utf16(m_filename).c_str(),
+                               GENERIC_READ, FILE_SHARE_READ, NULL,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file != INVALID_HANDLE_VALUE) {
+        LARGE_INTEGER len;
+        if (GetFileSizeEx (file, &len) && len.QuadPart > 0) {
+            m_mapping = CreateFileMappingW (file, NULL, PAGE_READONLY,
+                                            0, 0, NULL);
+            if (m_mapping) {
+                m_buf = (const char *) MapViewOfFile (m_mapping, FILE_MAP_READ,
+                                                      0, 0, 0);
+                if (m_buf)
+                    m_size = size_t (len.QuadPart);
+            }
+        }
+        CloseHandle (file);   // The mapping keeps its own reference
+    }
+#else
+    int fd = ::open (m_filename.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat st;
+        if (fstat (fd, &st) == 0 && st.st_size > 0) {
+            void *p = ::mmap (NULL, size_t(st.st_size), PROT_READ,
+                              MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                m_buf = (const char *) p;
+                m_size = size_t (st.st_size);
+            }
+        }
+        ::close (fd);   // The mapping keeps its own reference
+    }
+#endif
+    if (! m_buf)
+        close ();
+}
+
+
+
+Filesystem::IOMappedFile::~IOMappedFile ()
+{
+    close ();
+}
+
+
+
+void
+Filesystem::IOMappedFile::close ()
+{
+#ifdef _WIN32
+    if (m_buf)
+        UnmapViewOfFile (m_buf);
+    if (m_mapping)
+        CloseHandle (m_mapping);
+    m_mapping = NULL;
+#else
+    if (m_buf)
+        munmap ((void *) m_buf, m_size);
+#endif
+    m_buf = NULL;
+    m_size = 0;
+    m_mode = Closed;
+}
+
+
+
+size_t
+Filesystem::IOMappedFile::pread (void *buf, size_t size, int64_t offset)
+{
+    if (offset < 0 || size_t(offset) >= m_size)
+        return 0;
+    size = std::min (size, m_size - size_t(offset));
+    memcpy (buf, m_buf + offset, size);
+    return size;
+}
+
+
+
+size_t
+Filesystem::IOVecOutput::pread (void *buf, size_t size, int64_t offset)
+{
+    if (offset < 0 || size_t(offset) >= m_buf.size())
+        return 0;
+    size = std::min (size, m_buf.size() - size_t(offset));
+    memcpy (buf, &m_buf[offset], size);
+    return size;
+}
+
+
+
+size_t
+Filesystem::IOVecOutput::pwrite (const void *buf, size_t size, int64_t offset)
+{
+    if (offset < 0)
+        return 0;
+    if (size_t(offset) + size > m_buf.size())
+        m_buf.resize (size_t(offset) + size);
+    if (size)
+        memcpy (&m_buf[offset], buf, size);
+    return size;
+}
+
+
+
+// Smallest read after a seek; each sequential read doubles it, up to
+// the buffer size.
+static const size_t buffered_reader_min_chunk = 16384;
+
+
+
+Filesystem::IOBufferedReader::IOBufferedReader (size_t bufsize)
+    : m_io(NULL), m_owned(NULL),
+      m_bufsize(std::max (bufsize, buffered_reader_min_chunk)),
+      m_chunk(buffered_reader_min_chunk), m_bufpos(0),
+      m_start(NULL), m_next(NULL), m_end(NULL), m_mapped(false),
+      m_back_limit(-1)
+{
+}
+
+
+
+Filesystem::IOBufferedReader::~IOBufferedReader ()
+{
+    delete m_owned;
+}
+
+
+
+void
+Filesystem::IOBufferedReader::reset (IOProxy *io)
+{
+    if (io != m_owned) {
+        delete m_owned;
+        m_owned = NULL;
+    }
+    m_io = io;
+    m_chunk = buffered_reader_min_chunk;
+    m_bufpos = 0;
+    m_back_limit = -1;
+    m_mapped = io && io->mmap();
+    if (m_mapped) {
+        m_start = (const unsigned char *) io->mmap();
+        m_end = m_start + io->size();
+    } else {
+        m_start = m_buf.size() ? &m_buf[0] : NULL;
+        m_end = m_start;
+    }
+    m_next = m_start;
+}
+
+
+
+void
+Filesystem::IOBufferedReader::reset (FILE *file)
+{
+    delete m_owned;
+    m_owned = file ? new IOFile (file, IOProxy::Read) : NULL;
+    reset (m_owned);
+}
+
+
+
+void
+Filesystem::IOBufferedReader::seek (int64_t offset)
+{
+    offset = std::max (offset, int64_t(0));
+    if (m_mapped) {
+        m_next = m_start + std::min (offset, int64_t(m_end - m_start));
+        return;
+    }
+    if (offset >= m_bufpos && offset <= m_bufpos + (m_end - m_start)) {
+        m_next = m_start + (offset - m_bufpos);
+        return;
+    }
+    // Stepping back to not long before what we hold suggests we're
+    // walking backward, so the next fill should end where this buffer
+    // starts.  Any other jump starts over with small reads.
+    if (offset < m_bufpos && m_bufpos - offset <= int64_t(m_bufsize))
+        m_back_limit = m_bufpos;
+    else
+        m_back_limit = -1;
+    m_chunk = buffered_reader_min_chunk;
+    m_bufpos = offset;
+    m_next = m_end = m_start;
+}
+
+
+
+bool
+Filesystem::IOBufferedReader::fill (size_t need)
+{
+    // Make sure at least need bytes starting at m_next are in the buffer.
+    if (! m_io || m_mapped)
+        return false;
+    int64_t pos = tell();
+    size_t remain = size_t (m_end - m_next);
+    size_t nextoff = size_t (m_next - m_start);
+    size_t want = std::max (need, m_chunk);
+    int64_t readpos = pos + int64_t(remain);
+    if (m_back_limit > pos && ! remain &&
+          m_back_limit - pos >= int64_t(need)) {
+        // Walking backward: take the bytes just before m_back_limit.
+        readpos = std::max (int64_t(0), m_back_limit - int64_t(want));
+        readpos = std::min (readpos, pos);
+        want = size_t (m_back_limit - readpos);
+    }
+    m_back_limit = -1;
+    if (m_buf.size() < want)
+        m_buf.resize (want);
+    if (remain)
+        memmove (&m_buf[0], &m_buf[nextoff], remain);
+    size_t n = m_io->pread (&m_buf[remain], want - remain, readpos);
+    m_start = &m_buf[0];
+    m_bufpos = remain ? pos : readpos;
+    m_next = m_start + (pos - m_bufpos);
+    m_end = m_start + remain + n;
+    m_chunk = std::min (m_chunk * 2, m_bufsize);
+    return size_t(m_end - m_next) >= need;
+}
+
+
+
+bool
+Filesystem::IOBufferedReader::read_slow (void *buf, size_t size)
+{
+    // Use up what's buffered, then read big requests straight into the
+    // caller's memory.
+    unsigned char *out = (unsigned char *) buf;
+    size_t n = size_t (m_end - m_next);
+    memcpy (out, m_next, n);
+    m_next += n;
+    out += n;
+    size -= n;
+    if (! m_io || m_mapped)
+        return false;
+    if (size >= m_bufsize) {
+        int64_t pos = tell();
+        size_t r = m_io->pread (out, size, pos);
+        seek (pos + int64_t(r));
+        return r == size;
+    }
+    fill (size);
+    n = std::min (size, size_t (m_end - m_next));
+    memcpy (out, m_next, n);
+    m_next += n;
+    return n == size;
+}
+
+
+
+const unsigned char *
+Filesystem::IOBufferedReader::take_slow (size_t size)
+{
+    if (! fill (size))
+        return NULL;
+    const unsigned char *p = m_next;
+    m_next += size;
+    return p;
+}
+
 OIIO_NAMESPACE_END
@@ -30,10 +30,12 @@
 
 #include <sstream>
 #include <fstream>
+#include <algorithm>
 
 #include "OpenImageIO/platform.h"
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/filesystem.h"
+#include "OpenImageIO/hash.h"
 #include "OpenImageIO/unittest.h"
 
 #ifndef _WIN32
@@ -441,6 +443,197 @@ void test_scan_sequences ()
 
 
 
+static void
+test_ioproxy ()
+{
+    std::cout << "Testing IOMemReader\n";
+    const char text[] = "0123456789";
+    Filesystem::IOMemReader mem (text, 10);
+    char buf[8];
+    OIIO_CHECK_EQUAL (mem.read (buf, 4), 4);
+    OIIO_CHECK_EQUAL (std::string (buf, 4), "0123");
+    OIIO_CHECK_EQUAL (mem.tell(), 4);
+    OIIO_CHECK_EQUAL (mem.pread (buf, 8, 7), 3);   // Clipped at the end
+    OIIO_CHECK_EQUAL (std::string (buf, 3), "789");
+    OIIO_CHECK_EQUAL (mem.tell(), 4);              // pread doesn't move
+    OIIO_CHECK_ASSERT (mem.seek (-2, SEEK_END));
+    OIIO_CHECK_EQUAL (mem.read (buf, 8), 2);
+    OIIO_CHECK_EQUAL (std::string (buf, 2), "89");
+    OIIO_CHECK_ASSERT (mem.mmap() == text);
+
+    std::cout << "Testing IOVecOutput\n";
+    std::vector<unsigned char> vec;
+    Filesystem::IOVecOutput out (vec);
+    OIIO_CHECK_EQUAL (out.write ("abc", 3), 3);
+    out.seek (6);
+    OIIO_CHECK_EQUAL (out.write ("xy", 2), 2);    // Grows, zero-filled
+    OIIO_CHECK_EQUAL (vec.size(), 8);
+    OIIO_CHECK_EQUAL (vec[4], 0);
+    OIIO_CHECK_EQUAL (out.pwrite ("Z", 1, 1), 1);
+    OIIO_CHECK_EQUAL (std::string ((const char *)&vec[0], 3), "aZc");
+
+    std::cout << "Testing IOFile\n";
+    {
+        Filesystem::IOFile f ("testioproxy", Filesystem::IOProxy::Write);
+        OIIO_CHECK_ASSERT (f.opened());
+        OIIO_CHECK_EQUAL (f.write (text, 10), 10);
+        OIIO_CHECK_EQUAL (f.pwrite ("AB", 2, 2), 2);
+        OIIO_CHECK_EQUAL (f.size(), 10);
+    }
+    {
+        Filesystem::IOFile f ("testioproxy", Filesystem::IOProxy::Read);
+        OIIO_CHECK_ASSERT (f.opened());
+        OIIO_CHECK_EQUAL (f.size(), 10);
+        OIIO_CHECK_EQUAL (f.pread (buf, 4, 6), 4);
+        OIIO_CHECK_EQUAL (std::string (buf, 4), "6789");
+        OIIO_CHECK_EQUAL (f.read (buf, 5), 5);  // pread didn't disturb it
+        OIIO_CHECK_EQUAL (std::string (buf, 5), "01AB4");
+        f.seek (8);
+        OIIO_CHECK_EQUAL (f.read (buf, 5), 2);
+        OIIO_CHECK_EQUAL (std::string (buf, 2), "89");
+    }
+    std::cout << "Testing IOMappedFile\n";
+    {
+        Filesystem::IOMappedFile f ("testioproxy");
+        OIIO_CHECK_ASSERT (f.opened());
+        OIIO_CHECK_EQUAL (f.size(), 10);
+        OIIO_CHECK_ASSERT (f.mmap() &&
+                           ! memcmp (f.mmap(), "01AB456789", 10));
+        OIIO_CHECK_EQUAL (f.pread (buf, 8, 6), 4);
+        OIIO_CHECK_EQUAL (std::string (buf, 4), "6789");
+    }
+    Filesystem::remove ("testioproxy");
+    OIIO_CHECK_ASSERT (! Filesystem::IOMappedFile ("noexist").opened());
+    Filesystem::IOFile missing ("noexist", Filesystem::IOProxy::Read);
+    OIIO_CHECK_ASSERT (! missing.opened());
+}
+
+
+
+static void
+test_buffered_reader ()
+{
+    std::cout << "Testing IOBufferedReader\n";
+    // Bigger than the (smallest possible) buffer, to make it refill
+    std::vector<unsigned char> data (100000);
+    for (size_t i = 0;  i < data.size();  ++i)
+        data[i] = (unsigned char) ((i * 7) ^ (i >> 8));
+    {
+        Filesystem::IOFile f ("testbufreader", Filesystem::IOProxy::Write);
+        f.write (&data[0], data.size());
+    }
+    FILE *file = Filesystem::fopen ("testbufreader", "rb");
+    Filesystem::IOMemReader mem (&data[0], data.size());
+    for (int mapped = 0;  mapped <= 1;  ++mapped) {
+        Filesystem::IOBufferedReader r (16384);
+        if (mapped)
+            r.reset (&mem);
+        else
+            r.reset (file);
+        // Sequential bytes
+        int bad = 0;
+        for (size_t i = 0;  i < data.size();  ++i)
+            bad += (r.getc() != data[i]);
+        OIIO_CHECK_EQUAL (bad, 0);
+        OIIO_CHECK_EQUAL (r.getc(), -1);
+        // Rows read bottom to top, as many formats store them
+        for (int row = 99;  row >= 0;  --row) {
+            r.seek (row * 1000);
+            const unsigned char *p = r.take (1000);
+            OIIO_CHECK_ASSERT (p && ! memcmp (p, &data[row*1000], 1000));
+        }
+        // A read larger than the buffer, and running off the end
+        std::vector<unsigned char> big (60000);
+        r.seek (30000);
+        OIIO_CHECK_ASSERT (r.read (&big[0], big.size()));
+        OIIO_CHECK_ASSERT (! memcmp (&big[0], &data[30000], big.size()));
+        OIIO_CHECK_EQUAL (r.tell(), 90000);
+        OIIO_CHECK_ASSERT (r.take (20000) == NULL);
+        OIIO_CHECK_EQUAL (r.tell(), 90000);
+        OIIO_CHECK_ASSERT (! r.read (&big[0], 20000));
+        OIIO_CHECK_ASSERT (! memcmp (&big[0], &data[90000], 10000));
+    }
+    fclose (file);
+    Filesystem::remove ("testbufreader");
+}
+
+
+
+static void
+test_walk_directory ()
+{
+    std::cout << "Testing walk_directory\n";
+    std::string err;
+    Filesystem::create_directory ("testwalk", err);
+    Filesystem::create_directory ("testwalk/b", err);
+    Filesystem::create_directory ("testwalk/b/c", err);
+    const char *files[] = { "testwalk/a.exr", "testwalk/b.exr",
+                            "testwalk/b/x.tif", "testwalk/b/c/y.tif", NULL };
+    for (int i = 0;  files[i];  ++i) {
+        Filesystem::IOFile f (files[i], Filesystem::IOProxy::Write);
+        f.write ("x", 1);
+    }
+    std::vector<std::string> names, expected;
+    std::vector<bool> isdir;
+    OIIO_CHECK_ASSERT (Filesystem::walk_directory ("testwalk", names, &isdir, 4));
+    OIIO_CHECK_EQUAL (names.size(), 6);
+    OIIO_CHECK_EQUAL (isdir.size(), names.size());
+    // Each directory right before its contents, whatever the threads did
+    const char *order[] = { "testwalk/a.exr", "testwalk/b", "testwalk/b/c",
+                            "testwalk/b/c/y.tif", "testwalk/b/x.tif",
+                            "testwalk/b.exr", NULL };
+    for (int i = 0;  order[i] && i < (int)names.size();  ++i) {
+        OIIO_CHECK_EQUAL (names[i], std::string(order[i]));
+        OIIO_CHECK_EQUAL (isdir[i], Filesystem::is_directory (order[i]));
+    }
+    // Same set of entries as the serial recursive listing
+    Filesystem::get_directory_entries ("testwalk", expected, true);
+    std::sort (expected.begin(), expected.end());
+    std::vector<std::string> sorted (names);
+    std::sort (sorted.begin(), sorted.end());
+    OIIO_CHECK_ASSERT (sorted == expected);
+    OIIO_CHECK_ASSERT (! Filesystem::walk_directory ("testwalk/a.exr", names));
+    for (int i = 3;  i >= 0;  --i)
+        Filesystem::remove (files[i]);
+    Filesystem::remove ("testwalk/b/c");
+    Filesystem::remove ("testwalk/b");
+    Filesystem::remove ("testwalk");
+}
+
+
+
+static void
+test_hash_file ()
+{
+    std::cout << "Testing hash_file\n";
+    const size_t chunk = 64*1024;
+    std::vector<unsigned char> data (19*chunk + 1234);
+    for (size_t i = 0;  i < data.size();  ++i)
+        data[i] = (unsigned char)((i * 2654435761u) >> 13);
+    {
+        Filesystem::IOFile f ("testhash", Filesystem::IOProxy::Write);
+        f.write (&data[0], data.size());
+    }
+    // The SHA-1 of the chunk digests, in order
+    SHA1 tree;
+    for (size_t pos = 0;  pos < data.size();  pos += chunk) {
+        SHA1::Hash h;
+        SHA1 leaf (&data[pos], std::min (chunk, data.size()-pos));
+        leaf.gethash (h);
+        tree.append (&h, sizeof(h));
+    }
+    std::string expected = tree.digest();
+    OIIO_CHECK_EQUAL (Filesystem::hash_file ("testhash", chunk, 1), expected);
+    OIIO_CHECK_EQUAL (Filesystem::hash_file ("testhash", chunk, 4), expected);
+    // One chunk is just the file's SHA-1
+    OIIO_CHECK_EQUAL (Filesystem::hash_file ("testhash", data.size()),
+                      SHA1::digest (&data[0], data.size()));
+    OIIO_CHECK_EQUAL (Filesystem::hash_file ("testhash_nonexistent"), "");
+    Filesystem::remove ("testhash");
+}
+
+
+
 int main (int argc, char *argv[])
 {
     test_filename_decomposition ();
@@ -448,6 +641,10 @@ int main (int argc, char *argv[])
     test_file_status ();
     test_frame_sequences ();
     test_scan_sequences ();
+    test_ioproxy ();
+    test_buffered_reader ();
+    test_walk_directory ();
+    test_hash_file ();
 
     return unit_test_failures;
 }
@@ -46,6 +46,7 @@
 
 
 #include <cmath>
+#include <algorithm>
 #include <cstring>
 #include <string>
 #include <iostream>
@@ -843,4 +844,65 @@ Filter2D::destroy (Filter2D *filt)
 }
 
 
+
+namespace {
+// Adapters that let FilterTable1D::tabulate sample each kind of filter.
+struct Filter1DEval {
+    Filter1DEval (const Filter1D &f) : filter(f) { }
+    float operator() (float x) const { return filter(x); }
+    const Filter1D &filter;
+};
+
+struct Filter2DAxisEval {
+    Filter2DAxisEval (const Filter2D &f, int axis) : filter(f), axis(axis) { }
+    float operator() (float x) const {
+        return axis == 0 ? filter.xfilt(x) : filter.yfilt(x);
+    }
+    const Filter2D &filter;
+    int axis;
+};
+}
+
+
+
+template<class FUNC>
+void
+FilterTable1D::tabulate (const FUNC &filt, float radius, int resolution)
+{
+    resolution = std::max (2, resolution);
+    m_radius = radius;
+    m_scale = radius > 0.0f ? (0.5f * resolution) / radius : 0.0f;
+    m_umax = float (resolution);
+    m_table.resize (resolution + 2);
+    // Several filters (gaussian, for one) cut off to 0 exactly at the
+    // edge of their support, so sample the end points just inside it,
+    // lest the last interval interpolate toward a value that's only
+    // correct at a single point.
+    float edge = radius * (1.0f - 1.0e-6f);
+    float step = (2.0f * radius) / resolution;
+    m_table[0] = filt (-edge);
+    for (int i = 1;  i < resolution;  ++i)
+        m_table[i] = filt (float(i) * step - radius);
+    m_table[resolution] = filt (edge);
+    m_table[resolution+1] = m_table[resolution];  // pad for the lerp
+}
+
+
+
+void
+FilterTable1D::init (const Filter1D &filter, int resolution)
+{
+    tabulate (Filter1DEval(filter), 0.5f * filter.width(), resolution);
+}
+
+
+
+void
+FilterTable1D::init (const Filter2D &filter, int axis, int resolution)
+{
+    float radius = 0.5f * (axis == 0 ? filter.width() : filter.height());
+    tabulate (Filter2DAxisEval(filter,axis), radius, resolution);
+}
+
+
 OIIO_NAMESPACE_END
@@ -38,6 +38,7 @@
 #include <OpenImageIO/imagebufalgo_util.h>
 #include <OpenImageIO/argparse.h>
 #include <OpenImageIO/filter.h>
+#include <OpenImageIO/simd.h>
 
 OIIO_NAMESPACE_USING;
 
@@ -95,6 +96,61 @@ void time_filter (Filter1D *f, const FilterDesc *filtdesc, size_t n)
 }
 
 
+// Check that tabulated filters closely match the filters they came from,
+// and that the SIMD evaluation matches the scalar one.
+static void
+test_filter_table ()
+{
+    std::cout << "Testing FilterTable1D\n";
+    for (int i = 0, e = Filter1D::num_filters(); i < e; ++i) {
+        FilterDesc filtdesc;
+        Filter1D::get_filterdesc (i, &filtdesc);
+        Filter1D *f = Filter1D::create (filtdesc.name, filtdesc.width);
+        FilterTable1D table (*f);
+        float r = table.radius();
+        OIIO_CHECK_EQUAL (r, 0.5f * f->width());
+        // Stay a couple of table entries clear of the support edge, where
+        // box and sinc jump to 0.
+        float edge = r - 2.0f * f->width() / FilterTable1D::DefaultResolution;
+        float maxerr = 0.0f;
+        const int n = 10000;
+        for (int j = 0; j <= n; ++j) {
+            float x = -edge + 2.0f * edge * j / n;
+            maxerr = std::max (maxerr, fabsf (table(x) - (*f)(x)));
+        }
+        if (verbose)
+            std::cout << Strutil::format ("  %-15s max table error %g\n",
+                                          filtdesc.name, maxerr);
+        OIIO_CHECK_ASSERT (maxerr < 1.0e-5f);
+        OIIO_CHECK_EQUAL (table(r * 1.01f), 0.0f);
+        OIIO_CHECK_EQUAL (table(-r * 1.01f), 0.0f);
+        // The SIMD evaluation should give just what the scalar one does,
+        // inside and outside the support.
+        simd::float8 x8 (-1.1f*r, -0.7f*r, -0.3f*r, -0.01f, 0.0f,
+                         0.45f*r, 0.9f*r, 1.2f*r);
+        simd::float8 y8 = table (x8);
+        for (int k = 0; k < 8; ++k)
+            OIIO_CHECK_EQUAL (y8[k], table(x8[k]));
+        Filter1D::destroy (f);
+    }
+
+    // Tabulate each axis of a non-square separable 2D filter.
+    Filter2D *f2 = Filter2D::create ("lanczos3", 6.0f, 12.0f);
+    FilterTable1D xtable, ytable;
+    OIIO_CHECK_ASSERT (xtable.empty());
+    xtable.init (*f2, 0);
+    ytable.init (*f2, 1);
+    OIIO_CHECK_EQUAL (xtable.radius(), 3.0f);
+    OIIO_CHECK_EQUAL (ytable.radius(), 6.0f);
+    for (float x = -2.9f; x < 2.9f; x += 0.1f) {
+        OIIO_CHECK_ASSERT (fabsf (xtable(x) - f2->xfilt(x)) < 1.0e-4f);
+        OIIO_CHECK_ASSERT (fabsf (ytable(2.0f*x) - f2->yfilt(2.0f*x)) < 1.0e-4f);
+    }
+    Filter2D::destroy (f2);
+}
+
+
+
 
 int
 main (int argc, char *argv[])
@@ -109,6 +165,8 @@ main (int argc, char *argv[])
 
     getargs (argc, argv);
 
+    test_filter_table ();
+
     ImageBuf graph (ImageSpec (graphxres, graphyres, 3, TypeDesc::UINT8));
     float white[3] = { 1, 1, 1 };
     float black[3] = { 0, 0, 0 };
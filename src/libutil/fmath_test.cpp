@@ -171,6 +171,34 @@ void test_convert_type (double tolerance = 1e-6)
 
 
 
+// The SIMD array conversions from float must give exactly the same
+// (clamped, rounded) results as the one-value-at-a-time conversions.
+template<typename D>
+void test_convert_type_array ()
+{
+    std::vector<float> src;
+    for (int i = -300;  i < 3*int(std::numeric_limits<D>::max())/2;  ++i)
+        src.push_back (float(i) / std::numeric_limits<D>::max());
+    for (int i = 0;  i < 300;  ++i)  // exact ties
+        src.push_back ((i + 0.5f) / std::numeric_limits<D>::max());
+    src.push_back (std::numeric_limits<float>::infinity());
+    src.push_back (-std::numeric_limits<float>::infinity());
+    src.push_back (1.0e30f);
+    src.push_back (-1.0e30f);
+    src.push_back (0.333f);   // ragged end
+    std::vector<D> dst (src.size());
+    convert_type (&src[0], &dst[0], src.size());
+    for (size_t i = 0;  i < src.size();  ++i) {
+        D d = convert_type<float,D> (src[i]);
+        if (dst[i] != d) {
+            OIIO_CHECK_EQUAL (dst[i], d);
+            break;
+        }
+    }
+}
+
+
+
 template<typename S, typename D>
 void do_convert_type (const std::vector<S> &svec, std::vector<D> &dvec)
 {
@@ -219,6 +247,38 @@ void test_bit_range_convert ()
 
 
 
+void test_swap_endian ()
+{
+    // Long enough to use the SIMD path, with a ragged end.
+    std::vector<uint16_t> s (37), s2;
+    std::vector<uint32_t> i (37), i2;
+    std::vector<uint64_t> l (37), l2;
+    for (int n = 0;  n < 37;  ++n) {
+        s[n] = uint16_t (0x0102 + n);
+        i[n] = 0x01020304 + n;
+        l[n] = 0x0102030405060708ULL + n;
+    }
+    s2 = s;  i2 = i;  l2 = l;
+    swap_endian (&s2[0], 37);
+    swap_endian (&i2[0], 37);
+    swap_endian (&l2[0], 37);
+    for (int n = 0;  n < 37;  ++n) {
+        uint16_t ss = s[n];  swap_endian (&ss);
+        uint32_t ii = i[n];  swap_endian (&ii);
+        uint64_t ll = l[n];  swap_endian (&ll);
+        OIIO_CHECK_EQUAL (s2[n], ss);
+        OIIO_CHECK_EQUAL (i2[n], ii);
+        OIIO_CHECK_EQUAL (l2[n], ll);
+    }
+    OIIO_CHECK_EQUAL (s2[0], 0x0201);
+    OIIO_CHECK_EQUAL (i2[0], 0x04030201U);
+    std::vector<uint32_t> copy (37);
+    swap_endian_copy (&i2[0], &copy[0], 37, 4);
+    OIIO_CHECK_ASSERT (copy == i);
+}
+
+
+
 int main (int argc, char *argv[])
 {
 #if !defined(NDEBUG) || defined(OIIO_CI) || defined(OIIO_CODECOV)
@@ -232,6 +292,7 @@ int main (int argc, char *argv[])
     getargs (argc, argv);
 
     test_int_helpers ();
+    test_swap_endian ();
 
     std::cout << "\nround trip convert char/float/char\n";
     test_convert_type<char,float> ();
@@ -251,6 +312,9 @@ int main (int argc, char *argv[])
     test_convert_type<double,long> ();
     std::cout << "round trip convert float/unsigned int/float\n";
     test_convert_type<float, unsigned int> ();
+    std::cout << "array convert float/unsigned char, float/unsigned short\n";
+    test_convert_type_array<unsigned char> ();
+    test_convert_type_array<unsigned short> ();
 
     benchmark_convert_type<unsigned char, float> ();
     benchmark_convert_type<float, unsigned char> ();
@@ -165,6 +165,37 @@ test_farmhashchar (const char *str)
 
 
 
+static void
+test_sha1 ()
+{
+    std::cout << "Testing SHA1\n";
+    OIIO_CHECK_EQUAL (SHA1::digest ("abc", 3),
+                      "A9993E364706816ABA3E25717850C26C9CD0D89D");
+    OIIO_CHECK_EQUAL (SHA1::digest ("", 0),
+                      "DA39A3EE5E6B4B0D3255BFEF95601890AFD80709");
+
+    // hash_many must agree with one-at-a-time hashing for every length
+    // class around the padding boundaries, for unequal lengths hashed
+    // together, and for more buffers than there are SIMD lanes.
+    static const size_t sizes[] = { 0, 1, 3, 55, 56, 63, 64, 65, 119,
+                                    120, 127, 128, 1000, 4096, 65537,
+                                    100, 100, 100 };
+    const int n = int (sizeof(sizes) / sizeof(sizes[0]));
+    std::vector<unsigned char> buf (65537);
+    for (size_t i = 0;  i < buf.size();  ++i)
+        buf[i] = (unsigned char)((i * 7919) >> 3);
+    std::vector<const void *> ptrs (n);
+    for (int i = 0;  i < n;  ++i)
+        ptrs[i] = &buf[i];   // vary the alignment, too
+    std::vector<SHA1::Hash> hashes (n);
+    SHA1::hash_many (n, &ptrs[0], sizes, &hashes[0]);
+    for (int i = 0;  i < n;  ++i)
+        OIIO_CHECK_EQUAL (SHA1::hex_digest (hashes[i]),
+                          SHA1::digest (ptrs[i], sizes[i]));
+}
+
+
+
 static void
 getargs (int argc, char *argv[])
 {
@@ -205,6 +236,8 @@ int main (int argc, char *argv[])
 
     getargs (argc, argv);
 
+    test_sha1 ();
+
     double t;
 
     std::cout << "All times are seconds per " << iterations << " bytes.\n\n";
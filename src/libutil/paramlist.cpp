@@ -34,6 +34,7 @@
 #include "OpenImageIO/dassert.h"
 #include "OpenImageIO/ustring.h"
 #include "OpenImageIO/paramlist.h"
+#include "OpenImageIO/thread.h"
 
 
 OIIO_NAMESPACE_BEGIN
@@ -105,23 +106,141 @@ ParamValue::clear_value ()
 
 
 
+// The name index of a ParamValueList is an open-addressed hash table
+// keyed on the case-folded names.  Each slot (one per distinct name, up
+// to case) records the first and last list positions carrying that name,
+// and next[] chains each position to the following one with the same
+// name, so both case-sensitive and case-insensitive lookups only visit
+// the entries that could possibly match.
+struct ParamValueList::Index {
+    struct Slot {
+        size_t hash;
+        int first, last;      // list positions, first < 0 for empty slots
+    };
+    size_t mask;              // slots.size() - 1, a power of 2 minus 1
+    size_t nnames;            // number of occupied slots
+    std::vector<Slot> slots;
+    std::vector<int> next;    // next position with the same name, or -1
+
+    Index (size_t n) : nnames(0) {
+        size_t size = 16;
+        while (size < 2*n)
+            size *= 2;
+        mask = size - 1;
+        Slot empty = { 0, -1, -1 };
+        slots.resize (size, empty);
+        next.reserve (n);
+    }
+
+    // Find the slot for name (with hash h), or the empty slot where it
+    // would go.
+    size_t probe (string_view name, size_t h,
+                  const std::vector<ParamValue> &vals) const {
+        size_t i = h & mask;
+        while (slots[i].first >= 0 &&
+               (slots[i].hash != h ||
+                ! Strutil::iequals (vals[slots[i].first].name(), name)))
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    // Add list position p, which must be the next one not yet indexed.
+    // Return false if the table is too full to take another name.
+    bool append (const std::vector<ParamValue> &vals, int p) {
+        ustring name = vals[p].name();
+        size_t h = hash (name);
+        Slot &s (slots[probe (name, h, vals)]);
+        if (s.first < 0) {
+            if (2 * (nnames + 1) > slots.size())
+                return false;
+            s.hash = h;
+            s.first = p;
+            ++nnames;
+        } else {
+            next[s.last] = p;
+        }
+        s.last = p;
+        next.push_back (-1);
+        return true;
+    }
+
+    // Case-insensitive hash, so that names differing only in case
+    // share a slot.
+    static size_t hash (string_view s) {
+        size_t h = 2166136261u;   // FNV-1a
+        for (size_t i = 0, e = s.size(); i < e; ++i) {
+            unsigned char c = s[i];
+            if (c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+            h = (h ^ c) * 16777619u;
+        }
+        return h;
+    }
+};
+
+// Lists shorter than this are simply searched.
+static const size_t index_min_size = 16;
+
+// Serializes the construction of indices by concurrent const lookups.
+static spin_mutex index_mutex;
+
+
+
+const ParamValueList::Index *
+ParamValueList::get_index () const
+{
+    if (m_vals.size() < index_min_size)
+        return NULL;
+    Index *index = m_index;
+    atomic_thread_fence (memory_order_acquire);
+    if (! index) {
+        spin_lock lock (index_mutex);
+        index = m_index;
+        if (! index) {
+            index = new Index (m_vals.size());
+            for (size_t p = 0, n = m_vals.size(); p < n; ++p)
+                index->append (m_vals, int(p));  // sized to never fill up
+            // Finish building before any other thread can see it
+            atomic_thread_fence (memory_order_release);
+            m_index = index;
+        }
+    }
+    return index;
+}
+
+
+
+void
+ParamValueList::index_appended ()
+{
+    if (! m_index->append (m_vals, int(m_vals.size()-1)))
+        free_index ();   // too full -- rebuild it at the next lookup
+}
+
+
+
+void
+ParamValueList::free_index ()
+{
+    delete m_index;
+    m_index = NULL;
+}
+
+
+
 ParamValueList::const_iterator
 ParamValueList::find (ustring name, TypeDesc type, bool casesensitive) const
 {
-    if (casesensitive) {
+    if (casesensitive && ! get_index()) {
+        // Short list: just compare the ustring pointers
         for (const_iterator i = cbegin(), e = cend(); i != e; ++i) {
             if (i->name() == name &&
                   (type == TypeDesc::UNKNOWN || type == i->type()))
                 return i;
         }
-    } else {
-        for (const_iterator i = cbegin(), e = cend(); i != e; ++i) {
-            if (Strutil::iequals (i->name(), name) &&
-                  (type == TypeDesc::UNKNOWN || type == i->type()))
-                return i;
-        }
+        return cend();
     }
-    return cend();
+    return find (string_view(name), type, casesensitive);
 }
 
 
@@ -129,7 +248,20 @@ ParamValueList::find (ustring name, TypeDesc type, bool casesensitive) const
 ParamValueList::const_iterator
 ParamValueList::find (string_view name, TypeDesc type, bool casesensitive) const
 {
-    if (casesensitive) {
+    const Index *index = get_index ();
+    if (index) {
+        // Only the entries chained from the name's slot can match.  One
+        // renamed in place since the index was built may no longer
+        // match at all, so check every hit's name.
+        size_t slot = index->probe (name, Index::hash(name), m_vals);
+        for (int p = index->slots[slot].first; p >= 0; p = index->next[p]) {
+            const ParamValue &v (m_vals[p]);
+            if ((casesensitive ? v.name() == name
+                               : Strutil::iequals (v.name(), name)) &&
+                  (type == TypeDesc::UNKNOWN || type == v.type()))
+                return cbegin() + p;
+        }
+    } else if (casesensitive) {
         return find (ustring(name), type, casesensitive);
     } else {
         for (const_iterator i = cbegin(), e = cend(); i != e; ++i) {
@@ -146,20 +278,9 @@ ParamValueList::find (string_view name, TypeDesc type, bool casesensitive) const
 ParamValueList::iterator
 ParamValueList::find (ustring name, TypeDesc type, bool casesensitive)
 {
-    if (casesensitive) {
-        for (iterator i = begin(), e = end(); i != e; ++i) {
-            if (i->name() == name &&
-                  (type == TypeDesc::UNKNOWN || type == i->type()))
-                return i;
-        }
-    } else {
-        for (iterator i = begin(), e = end(); i != e; ++i) {
-            if (Strutil::iequals (i->name(), name) &&
-                  (type == TypeDesc::UNKNOWN || type == i->type()))
-                return i;
-        }
-    }
-    return end();
+    const ParamValueList &constself (*this);
+    size_t pos = constself.find (name, type, casesensitive) - cbegin();
+    return m_vals.begin() + pos;
 }
 
 
@@ -167,16 +288,9 @@ ParamValueList::find (ustring name, TypeDesc type, bool casesensitive)
 ParamValueList::iterator
 ParamValueList::find (string_view name, TypeDesc type, bool casesensitive)
 {
-    if (casesensitive) {
-        return find (ustring(name), type, casesensitive);
-    } else {
-        for (iterator i = begin(), e = end(); i != e; ++i) {
-            if (Strutil::iequals (i->name(), name) &&
-                  (type == TypeDesc::UNKNOWN || type == i->type()))
-                return i;
-        }
-    }
-    return end();
+    const ParamValueList &constself (*this);
+    size_t pos = constself.find (name, type, casesensitive) - cbegin();
+    return m_vals.begin() + pos;
 }
 
 
@@ -613,6 +613,128 @@ void test_special ()
 
 
 
+// Tests for the 8- and 16-wide types, which share one API.
+template<typename FVEC, typename IVEC, typename MVEC>
+void test_wide ()
+{
+    const int N = FVEC::elements;
+    std::cout << "test_wide " << FVEC::type_name() << " "
+              << IVEC::type_name() << " " << MVEC::type_name() << "\n";
+
+    float fvals[16];
+    int ivals[16];
+    for (int i = 0; i < N; ++i) {
+        fvals[i] = float(i);
+        ivals[i] = i;
+    }
+    FVEC fiota = FVEC::Iota();
+    IVEC iiota = IVEC::Iota();
+    OIIO_CHECK_SIMD_EQUAL (FVEC(fvals), fiota);
+    OIIO_CHECK_SIMD_EQUAL (IVEC(ivals), iiota);
+    OIIO_CHECK_SIMD_EQUAL (FVEC(iiota), fiota);
+    OIIO_CHECK_SIMD_EQUAL (IVEC(fiota + FVEC(0.5f)), iiota);
+    OIIO_CHECK_SIMD_EQUAL (FVEC(fiota.lo(), fiota.hi()), fiota);
+    OIIO_CHECK_SIMD_EQUAL (IVEC(iiota.lo(), iiota.hi()), iiota);
+
+    // Partial and masked loads and stores
+    for (int n = 0; n <= N; ++n) {
+        FVEC f (-1.0f);
+        f.load (fvals, n);
+        IVEC iv (-1);
+        iv.load (ivals, n);
+        float fstored[16];
+        int istored[16];
+        for (int i = 0; i < N; ++i) {
+            fstored[i] = -1.0f;
+            istored[i] = -1;
+        }
+        fiota.store (fstored, n);
+        iiota.store (istored, n);
+        for (int i = 0; i < N; ++i) {
+            OIIO_CHECK_EQUAL (f[i], i < n ? float(i) : 0.0f);
+            OIIO_CHECK_EQUAL (iv[i], i < n ? i : 0);
+            OIIO_CHECK_EQUAL (fstored[i], i < n ? float(i) : -1.0f);
+            OIIO_CHECK_EQUAL (istored[i], i < n ? i : -1);
+        }
+    }
+    {
+        MVEC odd = (iiota & IVEC(1)) == IVEC(1);
+        float fstored[16];
+        int istored[16];
+        for (int i = 0; i < N; ++i) {
+            fstored[i] = -1.0f;
+            istored[i] = -1;
+        }
+        fiota.store (fstored, odd);
+        iiota.store (istored, odd);
+        for (int i = 0; i < N; ++i) {
+            OIIO_CHECK_EQUAL (bool(odd[i]), (i & 1) == 1);
+            OIIO_CHECK_EQUAL (fstored[i], (i & 1) ? float(i) : -1.0f);
+            OIIO_CHECK_EQUAL (istored[i], (i & 1) ? i : -1);
+        }
+        OIIO_CHECK_EQUAL (odd.bitmask(), N == 8 ? 0xaa : 0xaaaa);
+        OIIO_CHECK_SIMD_EQUAL (MVEC::from_bitmask (odd.bitmask()), odd);
+        OIIO_CHECK_SIMD_EQUAL (MVEC(odd.lo(), odd.hi()), odd);
+        OIIO_CHECK_SIMD_EQUAL (!odd, (iiota & IVEC(1)) == IVEC(0));
+        OIIO_CHECK_SIMD_EQUAL (odd | !odd, MVEC::True());
+        OIIO_CHECK_SIMD_EQUAL (odd & !odd, MVEC::False());
+        OIIO_CHECK_ASSERT (any (odd) && ! all (odd) && ! none (odd));
+
+        // Gather, plain and masked
+        IVEC rev = IVEC(N-1) - iiota;
+        OIIO_CHECK_SIMD_EQUAL (gather (fvals, rev), FVEC(float(N-1)) - fiota);
+        OIIO_CHECK_SIMD_EQUAL (gather (ivals, rev), rev);
+        OIIO_CHECK_SIMD_EQUAL (gather (fvals, rev, odd),
+                               select (odd, FVEC(float(N-1)) - fiota, FVEC::Zero()));
+        OIIO_CHECK_SIMD_EQUAL (gather (ivals, rev, odd),
+                               select (odd, rev, IVEC::Zero()));
+    }
+
+    // Arithmetic, comparisons, and reductions
+    FVEC a = fiota + FVEC(1.0f);
+    OIIO_CHECK_SIMD_EQUAL (a - fiota, FVEC::One());
+    OIIO_CHECK_SIMD_EQUAL ((a * a) / a, a);
+    OIIO_CHECK_SIMD_EQUAL (-a + a, FVEC::Zero());
+    OIIO_CHECK_SIMD_EQUAL (iiota * IVEC(2), iiota + iiota);
+    OIIO_CHECK_SIMD_EQUAL (iiota << 2, iiota * IVEC(4));
+    OIIO_CHECK_SIMD_EQUAL ((iiota << 2) >> 2, iiota);
+    OIIO_CHECK_SIMD_EQUAL (srl (IVEC(-1), 28), IVEC(15));
+    OIIO_CHECK_SIMD_EQUAL (~(~iiota), iiota);
+    OIIO_CHECK_SIMD_EQUAL (-iiota + iiota, IVEC::Zero());
+    OIIO_CHECK_EQUAL (reduce_add (fiota), float(N*(N-1)/2));
+    OIIO_CHECK_EQUAL (reduce_add (iiota), N*(N-1)/2);
+    OIIO_CHECK_EQUAL ((fiota < FVEC(3.0f)).bitmask(), 0x7);
+    OIIO_CHECK_EQUAL ((fiota <= FVEC(3.0f)).bitmask(), 0xf);
+    OIIO_CHECK_EQUAL ((fiota == FVEC(3.0f)).bitmask(), 0x8);
+    OIIO_CHECK_EQUAL ((fiota != FVEC(3.0f)).bitmask(), (N == 8 ? 0xff : 0xffff) & ~0x8);
+    OIIO_CHECK_EQUAL ((iiota < IVEC(3)).bitmask(), 0x7);
+    OIIO_CHECK_EQUAL ((iiota > IVEC(3)).bitmask(), (N == 8 ? 0xff : 0xffff) & ~0xf);
+    OIIO_CHECK_EQUAL ((iiota >= IVEC(3)).bitmask(), (N == 8 ? 0xff : 0xffff) & ~0x7);
+
+    // Math functions
+    FVEC h = fiota - FVEC(3.5f);
+    OIIO_CHECK_SIMD_EQUAL (abs(h), select (h < FVEC::Zero(), -h, h));
+    OIIO_CHECK_SIMD_EQUAL (abs(IVEC(-3)), IVEC(3));
+    OIIO_CHECK_SIMD_EQUAL (floor(h), fiota - FVEC(4.0f));
+    OIIO_CHECK_SIMD_EQUAL (ceil(h), fiota - FVEC(3.0f));
+    OIIO_CHECK_SIMD_EQUAL (floori(h), iiota - IVEC(4));
+    OIIO_CHECK_SIMD_EQUAL (min(h, FVEC::Zero()), select (h < FVEC::Zero(), h, FVEC::Zero()));
+    OIIO_CHECK_SIMD_EQUAL (max(iiota, IVEC(2)), select (iiota < IVEC(2), IVEC(2), iiota));
+    OIIO_CHECK_SIMD_EQUAL (sqrt (a*a), a);
+    OIIO_CHECK_SIMD_EQUAL_THRESH (rsqrt (a*a), FVEC::One() / a, 1e-6f);
+    OIIO_CHECK_SIMD_EQUAL_THRESH (rsqrt_fast (a*a), FVEC::One() / a, 0.0005f);
+    OIIO_CHECK_SIMD_EQUAL_THRESH (rcp_fast (a), FVEC::One() / a, 0.0005f);
+    OIIO_CHECK_SIMD_EQUAL (madd (a, a, a), a*a+a);
+    OIIO_CHECK_SIMD_EQUAL (msub (a, a, a), a*a-a);
+    OIIO_CHECK_SIMD_EQUAL (nmadd (a, a, a), a-a*a);
+    OIIO_CHECK_SIMD_EQUAL (nmsub (a, a, a), -(a*a)-a);
+    OIIO_CHECK_SIMD_EQUAL_THRESH (log (exp (h)), h, 1e-5f);
+    OIIO_CHECK_SIMD_EQUAL (blend0 (a, a > FVEC(4.0f)),
+                           select (a > FVEC(4.0f), a, FVEC::Zero()));
+}
+
+
+
 void test_mathfuncs ()
 {
     std::cout << "test_mathfuncs\n";
@@ -924,22 +1046,25 @@ void test_timing ()
     benchmark_function ("transpose m44", size, mat_transpose, mx, 1);
     benchmark_function ("transpose m44 with simd", size, mat_transpose_simd, mx, 1);
 
+    // The simd math functions are overloaded for each vector width, so
+    // pick out the float4 ones explicitly.
+    typedef float4 (*float4_func)(const float4&);
     benchmark_function ("expf", size, expf, 0.67f);
     benchmark_function ("fast_exp", size, fast_exp_float, 0.67f);
-    benchmark_function ("simd::exp", size, simd::exp, float4(0.67f));
+    benchmark_function ("simd::exp", size, (float4_func)simd::exp, float4(0.67f));
     benchmark_function ("simd::fast_exp", size, fast_exp_float4, float4(0.67f));
 
     benchmark_function ("logf", size, logf, 0.67f);
     benchmark_function ("fast_log", size, fast_log_float, 0.67f);
-    benchmark_function ("simd::log", size, simd::log, float4(0.67f));
+    benchmark_function ("simd::log", size, (float4_func)simd::log, float4(0.67f));
     benchmark_function ("simd::fast_log", size, fast_log_float4, float4(0.67f));
     benchmark_function2 ("powf", size, powf, 0.67f, 0.67f);
     benchmark_function2 ("simd fast_pow_pos", size, fast_pow_pos, float4(0.67f), float4(0.67f));
     benchmark_function ("sqrt", size, sqrtf, 4.0f);
-    benchmark_function ("simd::sqrt", size, simd::sqrt, float4(1.0f,4.0f,9.0f,16.0f));
+    benchmark_function ("simd::sqrt", size, (float4_func)simd::sqrt, float4(1.0f,4.0f,9.0f,16.0f));
     benchmark_function ("rsqrt", size, rsqrtf, 4.0f);
-    benchmark_function ("simd::rsqrt", size, simd::rsqrt, float4(1.0f,4.0f,9.0f,16.0f));
-    benchmark_function ("simd::rsqrt_fast", size, simd::rsqrt_fast, float4(1.0f,4.0f,9.0f,16.0f));
+    benchmark_function ("simd::rsqrt", size, (float4_func)simd::rsqrt, float4(1.0f,4.0f,9.0f,16.0f));
+    benchmark_function ("simd::rsqrt_fast", size, (float4_func)simd::rsqrt_fast, float4(1.0f,4.0f,9.0f,16.0f));
     benchmark_function ("normalize Imath", size, norm_imath, Imath::V3f(1.0f,4.0f,9.0f));
     benchmark_function ("normalize Imath with simd", size, norm_imath_simd, Imath::V3f(1.0f,4.0f,9.0f));
     benchmark_function ("normalize Imath with simd fast", size, norm_imath_simd_fast, Imath::V3f(1.0f,4.0f,9.0f));
@@ -1023,6 +1148,10 @@ main (int argc, char *argv[])
     test_component_access<mask4> ();
     test_bitwise_mask4 ();
 
+    std::cout << "\n";
+    test_wide<float8,int8,mask8> ();
+    test_wide<float16,int16,mask16> ();
+
     test_constants();
     test_special();
     test_mathfuncs();
@@ -61,19 +61,21 @@ static bool wedge = false;
 
 volatile long long accum = 0;
 spin_rw_mutex mymutex;
+spin_brw_mutex mybrwmutex;
 
 
 
 
+template<class MUTEX>
 static void
-do_accum (int iterations)
+do_accum (MUTEX *mutex, int iterations)
 {
     for (int i = 0;  i < iterations;  ++i) {
         if ((i % (read_write_ratio+1)) == read_write_ratio) {
-            spin_rw_write_lock lock (mymutex);
+            typename MUTEX::write_lock_guard lock (*mutex);
             accum += 1;
         } else {
-            spin_rw_read_lock lock (mymutex);
+            typename MUTEX::read_lock_guard lock (*mutex);
             // meaningless test to force examination of the variable
             if (accum < 0)
                 break;
@@ -83,12 +85,13 @@ do_accum (int iterations)
 
 
 
-void test_spin_rw (int numthreads, int iterations)
+template<class MUTEX>
+void test_spin_rw (MUTEX *mutex, int numthreads, int iterations)
 {
     accum = 0;
     boost::thread_group threads;
     for (int i = 0;  i < numthreads;  ++i) {
-        threads.create_thread (boost::bind(do_accum,iterations));
+        threads.create_thread (boost::bind(do_accum<MUTEX>,mutex,iterations));
     }
     if (verbose)
         std::cout << "Created " << threads.size() << " threads\n";
@@ -101,6 +104,54 @@ void test_spin_rw (int numthreads, int iterations)
 
 
 
+// Test spin_seqlock: one writer keeps changing a pair of numbers that
+// should always sum to zero, while the readers check that every copy
+// they read through the seqlock does.
+spin_seqlock myseqlock;
+struct SeqPair { long long a, b; };
+SeqPair seqpair = { 0, 0 };
+atomic_int seq_torn;
+
+
+
+static void
+do_seqlock_write (int iterations)
+{
+    for (int i = 1;  i <= iterations;  ++i) {
+        spin_seqlock::write_lock_guard lock (myseqlock);
+        seqpair.a = i;
+        seqpair.b = -i;
+    }
+}
+
+
+
+static void
+do_seqlock_read (int iterations)
+{
+    for (int i = 0;  i < iterations;  ++i) {
+        SeqPair p = myseqlock.read (seqpair);
+        if (p.a + p.b != 0)
+            ++seq_torn;
+    }
+}
+
+
+
+void test_seqlock (int numthreads, int iterations)
+{
+    seq_torn = 0;
+    boost::thread_group threads;
+    threads.create_thread (boost::bind(do_seqlock_write,iterations));
+    for (int i = 0;  i < numthreads;  ++i)
+        threads.create_thread (boost::bind(do_seqlock_read,iterations));
+    threads.join_all ();
+    OIIO_CHECK_EQUAL (seq_torn, 0);
+    OIIO_CHECK_EQUAL (seqpair.a, iterations);
+}
+
+
+
 static void
 getargs (int argc, char *argv[])
 {
@@ -149,15 +200,23 @@ int main (int argc, char *argv[])
         int its = iterations/nt;
 
         double range;
-        double t = time_trial (boost::bind(test_spin_rw,nt,its),
+        double t = time_trial (boost::bind(test_spin_rw<spin_rw_mutex>,
+                                           &mymutex,nt,its),
                                ntrials, &range);
-
         std::cout << Strutil::format ("%2d\t%s\t%5.1fs, range %.1f\t(%d iters/thread)\n",
                                       nt, Strutil::timeintervalformat(t),
                                       t, range, its);
+        t = time_trial (boost::bind(test_spin_rw<spin_brw_mutex>,
+                                    &mybrwmutex,nt,its),
+                        ntrials, &range);
+        std::cout << Strutil::format ("%2d\t%s\t%5.1fs, range %.1f\t(%d iters/thread, big-reader lock)\n",
+                                      nt, Strutil::timeintervalformat(t),
+                                      t, range, its);
         if (! wedge)
             break;    // don't loop if we're not wedging
     }
 
+    test_seqlock (std::min (numthreads, 8), std::min (iterations, 1000000));
+
     return unit_test_failures;
 }
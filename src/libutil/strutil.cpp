@@ -622,6 +622,19 @@ Strutil::parse_prefix (string_view &str, string_view prefix, bool eat)
 
 
 
+// Copy (up to bufsize-1 chars of) str to buf, 0-terminated, so that
+// strtol and strtod stop at the end of the string_view instead of reading
+// on into whatever follows it, without allocating.
+static void
+terminated_copy (string_view str, char *buf, size_t bufsize)
+{
+    size_t n = std::min (str.size(), bufsize-1);
+    memcpy (buf, str.data(), n);
+    buf[n] = 0;
+}
+
+
+
 bool
 Strutil::parse_int (string_view &str, int &val, bool eat)
 {
@@ -629,12 +642,14 @@ Strutil::parse_int (string_view &str, int &val, bool eat)
     skip_whitespace (p);
     if (! p.size())
         return false;
-    const char *end = p.begin();
-    int v = strtol (p.begin(), (char**)&end, 10);
-    if (end == p.begin())
+    char buf[64];
+    terminated_copy (p, buf, sizeof(buf));
+    char *end = buf;
+    int v = strtol (buf, &end, 10);
+    if (end == buf)
         return false;  // no integer found
     if (eat) {
-        p.remove_prefix (end-p.begin());
+        p.remove_prefix (end-buf);
         str = p;
     }
     val = v;
@@ -650,12 +665,14 @@ Strutil::parse_float (string_view &str, float &val, bool eat)
     skip_whitespace (p);
     if (! p.size())
         return false;
-    const char *end = p.begin();
-    float v = (float) strtod (p.begin(), (char**)&end);
-    if (end == p.begin())
-        return false;  // no integer found
+    char buf[64];
+    terminated_copy (p, buf, sizeof(buf));
+    char *end = buf;
+    float v = (float) strtod (buf, &end);
+    if (end == buf)
+        return false;  // no float found
     if (eat) {
-        p.remove_prefix (end-p.begin());
+        p.remove_prefix (end-buf);
         str = p;
     }
     val = v;
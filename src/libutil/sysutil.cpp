@@ -76,6 +76,15 @@
 # include <sys/ioctl.h>
 #endif
 
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+# define OIIO_X86_CPU 1
+# if defined(_MSC_VER)
+#  include <intrin.h>
+# else
+#  include <cpuid.h>
+# endif
+#endif
+
 #include <OpenImageIO/dassert.h>
 #include <OpenImageIO/sysutil.h>
 #include <OpenImageIO/strutil.h>
@@ -521,4 +530,104 @@ Sysutil::max_open_files ()
     return size_t(-1); // Couldn't figure out, so return effectively infinity
 }
 
+
+
+#ifdef OIIO_X86_CPU
+static void
+cpuid (unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+    __cpuidex ((int *)regs, int(leaf), int(subleaf));
+#else
+    __cpuid_count (leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+
+
+// Which register state the OS saves on context switches (XCR0).  Only
+// call it if cpuid says OSXSAVE.
+static unsigned long long
+xgetbv0 ()
+{
+#if defined(_MSC_VER)
+    return _xgetbv (0);
+#else
+    unsigned int eax, edx;
+    __asm__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+
+
+static unsigned int
+detect_cpu_features ()
+{
+    unsigned int regs[4] = { 0, 0, 0, 0 };
+    cpuid (0, 0, regs);
+    unsigned int maxleaf = regs[0];
+    if (maxleaf < 1)
+        return 0;
+    cpuid (1, 0, regs);
+    const unsigned int ecx = regs[2], edx = regs[3];
+    unsigned int f = 0;
+    if (edx & (1u << 26)) f |= CPU_SSE2;
+    if (ecx & (1u << 0))  f |= CPU_SSE3;
+    if (ecx & (1u << 9))  f |= CPU_SSSE3;
+    if (ecx & (1u << 19)) f |= CPU_SSE41;
+    if (ecx & (1u << 20)) f |= CPU_SSE42;
+    // The AVX family is only usable if the OS saves the wider registers.
+    bool osxsave = (ecx & (1u << 27)) != 0;
+    unsigned long long xcr0 = osxsave ? xgetbv0 () : 0;
+    bool ymm = (xcr0 & 0x6) == 0x6;        // SSE and AVX state
+    bool zmm = ymm && (xcr0 & 0xe0) == 0xe0;   // opmask, ZMM0-15, ZMM16-31
+    if (! ymm)
+        return f;
+    if (ecx & (1u << 28)) f |= CPU_AVX;
+    if (ecx & (1u << 12)) f |= CPU_FMA;
+    if (ecx & (1u << 29)) f |= CPU_F16C;
+    if (maxleaf >= 7) {
+        cpuid (7, 0, regs);
+        const unsigned int ebx = regs[1];
+        if (ebx & (1u << 5))  f |= CPU_AVX2;
+        if (zmm && (ebx & (1u << 16))) f |= CPU_AVX512F;
+    }
+    return f;
+}
+#endif
+
+
+
+unsigned int
+Sysutil::cpu_features ()
+{
+#ifdef OIIO_X86_CPU
+    static unsigned int features = detect_cpu_features ();
+    return features;
+#else
+    return 0;
+#endif
+}
+
+
+
+std::string
+Sysutil::cpu_feature_names ()
+{
+    static const char *names[] = { "sse2", "sse3", "ssse3", "sse41", "sse42",
+                                   "avx", "avx2", "fma", "f16c", "avx512f",
+                                   NULL };
+    unsigned int f = cpu_features ();
+    std::string result;
+    for (int i = 0;  names[i];  ++i) {
+        if (f & (1u << i)) {
+            if (result.size())
+                result += ',';
+            result += names[i];
+        }
+    }
+    return result;
+}
+
 OIIO_NAMESPACE_END
@@ -0,0 +1,287 @@
+/*
+  Copyright 2016 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+#include <algorithm>
+#include <deque>
+#include <utility>
+
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/sysutil.h"
+
+#if OIIO_CPLUSPLUS_VERSION >= 11
+# include <condition_variable>
+#endif
+
+
+OIIO_NAMESPACE_BEGIN
+
+namespace {
+#if OIIO_CPLUSPLUS_VERSION >= 11
+typedef std::condition_variable condition_variable;
+typedef std::unique_lock<mutex> unique_lock;
+#else
+typedef boost::condition_variable condition_variable;
+typedef boost::unique_lock<mutex> unique_lock;
+#endif
+}
+
+
+
+class thread_pool::Impl {
+public:
+    typedef std::pair<Task,task_set*> Job;
+
+    Impl (int nthreads) : m_size(0), m_generation(0) {
+        set_size (nthreads);
+    }
+
+    ~Impl () {
+        stop_workers ();
+    }
+
+    int size () const {
+        lock_guard lock (m_mutex);
+        return m_size;
+    }
+
+    void resize (int nthreads) {
+        bool shrink = false;
+        {
+            lock_guard lock (m_mutex);
+            int oldsize = m_size;
+            set_size (nthreads);
+            shrink = (m_size < oldsize && int(m_threads.size()) > m_size);
+        }
+        if (shrink) {
+            // Retire the whole current crew.  The queue is untouched, and
+            // new workers will be launched on demand by the next push (or
+            // by whoever is waiting on the queued tasks).
+            stop_workers ();
+            lock_guard lock (m_mutex);
+            if (! m_queue.empty())
+                launch_workers ();
+        }
+    }
+
+    void push (const Task &task, task_set *ts) {
+        {
+            lock_guard lock (m_mutex);
+            m_queue.push_back (Job (task, ts));
+            if (int(m_threads.size()) < m_size)
+                launch_workers ();
+        }
+        m_cv.notify_one ();
+    }
+
+    bool run_one_task () {
+        Job job;
+        {
+            lock_guard lock (m_mutex);
+            if (m_queue.empty())
+                return false;
+            job = m_queue.front ();
+            m_queue.pop_front ();
+        }
+        run (job);
+        return true;
+    }
+
+    size_t jobs_in_queue () const {
+        lock_guard lock (m_mutex);
+        return m_queue.size ();
+    }
+
+    bool this_thread_is_in_pool () const {
+        lock_guard lock (m_mutex);
+        thread::id me = this_thread_id ();
+        for (size_t i = 0, e = m_threads.size(); i < e; ++i)
+            if (m_threads[i]->get_id() == me)
+                return true;
+        return false;
+    }
+
+private:
+    // Each worker remembers the generation it was launched in, and exits
+    // as soon as the pool's generation changes.
+    void worker (int generation) {
+        unique_lock lock (m_mutex);
+        for (;;) {
+            while (m_queue.empty() && generation == m_generation)
+                m_cv.wait (lock);
+            if (generation != m_generation)
+                return;
+            Job job = m_queue.front ();
+            m_queue.pop_front ();
+            lock.unlock ();
+            run (job);
+            lock.lock ();
+        }
+    }
+
+    static void run (Job &job) {
+        job.first ();
+        if (job.second)
+            job.second->task_done ();
+    }
+
+    // Launch workers until we have m_size of them. Caller holds m_mutex.
+    void launch_workers () {
+        while (int(m_threads.size()) < m_size)
+            m_threads.push_back (new thread (&Impl::worker, this,
+                                             int(m_generation)));
+    }
+
+    // Tell all current workers to exit and join them.
+    void stop_workers () {
+        std::vector<thread *> crew;
+        {
+            lock_guard lock (m_mutex);
+            ++m_generation;
+            crew.swap (m_threads);
+        }
+        m_cv.notify_all ();
+        for (size_t i = 0, e = crew.size(); i < e; ++i) {
+            if (crew[i]->joinable())
+                crew[i]->join ();
+            delete crew[i];
+        }
+    }
+
+    void set_size (int nthreads) {
+        if (nthreads < 0)
+            nthreads = int(Sysutil::hardware_concurrency()) - 1;
+        m_size = std::max (nthreads, 0);
+    }
+
+    static thread::id this_thread_id () {
+#if OIIO_CPLUSPLUS_VERSION >= 11
+        return std::this_thread::get_id ();
+#else
+        return boost::this_thread::get_id ();
+#endif
+    }
+
+    mutable mutex m_mutex;
+    condition_variable m_cv;
+    std::deque<Job> m_queue;
+    std::vector<thread *> m_threads;
+    int m_size;
+    int m_generation;
+};
+
+
+
+thread_pool::thread_pool (int nthreads)
+    : m_impl (new Impl (nthreads))
+{
+}
+
+
+
+thread_pool::~thread_pool ()
+{
+    delete m_impl;
+}
+
+
+
+int
+thread_pool::size () const
+{
+    return m_impl->size ();
+}
+
+
+
+void
+thread_pool::resize (int nthreads)
+{
+    m_impl->resize (nthreads);
+}
+
+
+
+void
+thread_pool::push (const Task &task, task_set *ts)
+{
+    m_impl->push (task, ts);
+}
+
+
+
+bool
+thread_pool::run_one_task ()
+{
+    return m_impl->run_one_task ();
+}
+
+
+
+size_t
+thread_pool::jobs_in_queue () const
+{
+    return m_impl->jobs_in_queue ();
+}
+
+
+
+bool
+thread_pool::this_thread_is_in_pool () const
+{
+    return m_impl->this_thread_is_in_pool ();
+}
+
+
+
+thread_pool *
+default_thread_pool ()
+{
+    static thread_pool shared_pool;
+    return &shared_pool;
+}
+
+
+
+void
+task_set::wait ()
+{
+    // Rather than block, lend a hand with anything still in the queue.
+    // Once the queue is drained, the only thing left to do is wait for
+    // the workers to finish the tasks they already picked up.
+    atomic_backoff backoff;
+    while (m_pending > 0) {
+        if (! m_pool->run_one_task ())
+            backoff ();
+    }
+}
+
+
+OIIO_NAMESPACE_END
@@ -0,0 +1,198 @@
+/*
+  Copyright 2016 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+#include <iostream>
+
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/sysutil.h"
+#include "OpenImageIO/timer.h"
+#include "OpenImageIO/argparse.h"
+#include "OpenImageIO/ustring.h"
+
+#include <boost/bind.hpp>
+
+#include "OpenImageIO/unittest.h"
+
+
+OIIO_NAMESPACE_USING;
+
+// Test thread_pool and task_set: push lots of little tasks that each
+// atomically bump a counter, and make sure that every one of them ran by
+// the time wait() returns.
+
+static int iterations = 100000;
+static int numthreads = 16;
+static int ntrials = 1;
+static bool verbose = false;
+static bool wedge = false;
+
+static atomic_int accum (0);
+
+
+
+static void
+do_accum (int amount)
+{
+    accum += amount;
+}
+
+
+
+// A task that does its own nested parallel work on the same pool.
+static void
+do_nested (thread_pool *pool, int ntasks)
+{
+    task_set tasks (pool);
+    for (int i = 0;  i < ntasks;  ++i)
+        tasks.push (boost::bind (do_accum, 1));
+    tasks.wait ();
+}
+
+
+
+void
+test_thread_pool (int numthreads, int iterations)
+{
+    thread_pool pool (numthreads-1);
+    OIIO_CHECK_EQUAL (pool.size(), numthreads-1);
+    accum = 0;
+    {
+        task_set tasks (&pool);
+        for (int i = 0;  i < iterations;  ++i)
+            tasks.push (boost::bind (do_accum, 1));
+        tasks.wait ();
+    }
+    OIIO_CHECK_EQUAL (accum, iterations);
+    OIIO_CHECK_EQUAL (pool.jobs_in_queue(), 0);
+}
+
+
+
+void
+test_nested ()
+{
+    // Nested task sets must not deadlock, even if there are fewer
+    // workers than outer tasks.
+    thread_pool pool (2);
+    accum = 0;
+    task_set tasks (&pool);
+    for (int i = 0;  i < 16;  ++i)
+        tasks.push (boost::bind (do_nested, &pool, 100));
+    tasks.wait ();
+    OIIO_CHECK_EQUAL (accum, 16*100);
+}
+
+
+
+void
+test_resize ()
+{
+    thread_pool pool (4);
+    accum = 0;
+    task_set tasks (&pool);
+    for (int i = 0;  i < 1000;  ++i)
+        tasks.push (boost::bind (do_accum, 1));
+    tasks.wait ();
+    pool.resize (1);
+    OIIO_CHECK_EQUAL (pool.size(), 1);
+    for (int i = 0;  i < 1000;  ++i)
+        tasks.push (boost::bind (do_accum, 1));
+    tasks.wait ();
+    OIIO_CHECK_EQUAL (accum, 2000);
+
+    // A pool with no workers still gets everything done, by the waiter.
+    pool.resize (0);
+    OIIO_CHECK_EQUAL (pool.size(), 0);
+    for (int i = 0;  i < 1000;  ++i)
+        tasks.push (boost::bind (do_accum, 1));
+    tasks.wait ();
+    OIIO_CHECK_EQUAL (accum, 3000);
+    OIIO_CHECK_ASSERT (! pool.this_thread_is_in_pool());
+}
+
+
+
+static void
+getargs (int argc, char *argv[])
+{
+    bool help = false;
+    ArgParse ap;
+    ap.options ("thread_test\n"
+                OIIO_INTRO_STRING "\n"
+                "Usage:  thread_test [options]",
+                // "%*", parse_files, "",
+                "--help", &help, "Print help message",
+                "-v", &verbose, "Verbose mode",
+                "--threads %d", &numthreads,
+                    ustring::format("Number of threads (default: %d)", numthreads).c_str(),
+                "--iters %d", &iterations,
+                    ustring::format("Number of iterations (default: %d)", iterations).c_str(),
+                "--trials %d", &ntrials, "Number of trials",
+                "--wedge", &wedge, "Do a wedge test",
+                NULL);
+    if (ap.parse (argc, (const char**)argv) < 0) {
+        std::cerr << ap.geterror() << std::endl;
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+    if (help) {
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+}
+
+
+
+int main (int argc, char *argv[])
+{
+    getargs (argc, argv);
+
+    test_nested ();
+    test_resize ();
+
+    std::cout << "hw threads = " << Sysutil::hardware_concurrency() << "\n";
+    std::cout << "threads\ttime (best of " << ntrials << ")\n";
+    std::cout << "-------\t----------\n";
+
+    static int threadcounts[] = { 1, 2, 4, 8, 12, 16, 20, 24, 28, 32, 64, 128, 1024, 1<<30 };
+    for (int i = 0; threadcounts[i] <= numthreads; ++i) {
+        int nt = wedge ? threadcounts[i] : numthreads;
+        double range;
+        double t = time_trial (boost::bind(test_thread_pool,nt,iterations),
+                               ntrials, &range);
+        std::cout << Strutil::format ("%2d\t%5.1f   range %.2f\t(%d tasks)\n",
+                                      nt, t, range, iterations);
+        if (! wedge)
+            break;    // don't loop if we're not wedging
+    }
+
+    return unit_test_failures;
+}
@@ -59,9 +59,66 @@ public:
         Timer::seconds_per_tick = (1e-9*static_cast<double>(time_info.numer))/
                                        static_cast<double>(time_info.denom);
 #endif
+        mark_calibration_start ();
     }
+
+    static Timer::ticks_t os_now () { return Timer(false).now(); }
+
+    // Note the two clocks at the start of the FastTimer calibration
+    // interval.  Doing it at load time means that by the time anybody
+    // converts FastTimer ticks to seconds, the interval is usually long
+    // enough already for an accurate rate.
+    static void mark_calibration_start () {
+        calib_os_start = os_now ();
+        calib_fast_start = FastTimer::now ();
+    }
+
+    // Seconds per FastTimer tick, measured against the OS clock over at
+    // least min_interval seconds since mark_calibration_start().
+    static double calibrate_fast (double min_interval = 0.02) {
+#if ! OIIO_FASTTIMER_CYCLE_COUNTER
+        return Timer::seconds (1);   // FastTimer uses the Timer clock
+#else
+        if (! calib_os_start)   // called during static initialization
+            mark_calibration_start ();
+        Timer::ticks_t os_end;
+        FastTimer::ticks_t fast_end;
+        do {
+            os_end = os_now ();
+            fast_end = FastTimer::now ();
+        } while (Timer::seconds (os_end - calib_os_start) < min_interval);
+        if (fast_end <= calib_fast_start)
+            return Timer::seconds (1);  // counter not running?
+        return Timer::seconds (os_end - calib_os_start)
+                   / double (fast_end - calib_fast_start);
+#endif
+    }
+
+    static Timer::ticks_t calib_os_start;
+    static FastTimer::ticks_t calib_fast_start;
 };
 
+Timer::ticks_t TimerSetupOnce::calib_os_start = 0;
+FastTimer::ticks_t TimerSetupOnce::calib_fast_start = 0;
+
 static TimerSetupOnce once;
 
+
+
+double
+FastTimer::seconds_per_tick ()
+{
+    // Thread-safe one-time initialization of the function-level static.
+    static double spt = TimerSetupOnce::calibrate_fast ();
+    return spt;
+}
+
+
+
+FastTimer::ticks_t
+FastTimer::os_now ()
+{
+    return TimerSetupOnce::os_now ();
+}
+
 OIIO_NAMESPACE_END
@@ -161,5 +161,43 @@ main (int argc, char **argv)
     OIIO_CHECK_EQUAL_THRESH (all(),       0.6, eps);
     std::cout << "Checkpoint2: All " << all() << " selective " << selective() << "\n";
 
+    // FastTimer: compare its cost to Timer's, and check its calibration
+    // against the OS clock and that the accumulator adds up correctly.
+    {
+        Timer timer;
+        int n = 10000000;
+        FastTimer::ticks_t total = 0;
+        for (int i = 0;  i < n;  ++i) {
+            FastTimer t;
+            total += t.ticks();
+        }
+        DoNotOptimize (total);
+        std::cout << "FastTimer begin/end cost is "
+                  << double(n)/timer() << " /sec\n";
+        std::cout << "FastTimer seconds per tick: "
+                  << FastTimer::seconds_per_tick() << "\n";
+    }
+    FastTimer fast;
+    FastTimer fastselective (false);
+    FastTimer::ticks_t accum_ticks = 0;
+    double accum_seconds = 0.0;
+    Sysutil::usleep (interval);
+    OIIO_CHECK_EQUAL_THRESH (fastselective(), 0.0, eps);
+    OIIO_CHECK_EQUAL_THRESH (fast(), 0.1, eps);
+    {
+        ScopedTimeAccumulator<> ta (accum_ticks);
+        ScopedTimeAccumulator<double> ts (accum_seconds);
+        fastselective.start ();
+        Sysutil::usleep (interval);
+    }
+    fastselective.stop ();
+    OIIO_CHECK_EQUAL_THRESH (fastselective(), 0.1, eps);
+    OIIO_CHECK_EQUAL_THRESH (fast(), 0.2, eps);
+    OIIO_CHECK_EQUAL_THRESH (FastTimer::seconds(accum_ticks), 0.1, eps);
+    OIIO_CHECK_EQUAL_THRESH (accum_seconds, 0.1, eps);
+    double fastlap = fast.lap ();
+    OIIO_CHECK_EQUAL_THRESH (fastlap, 0.2, eps);
+    OIIO_CHECK_EQUAL_THRESH (fast(), 0.2, eps);
+
     return unit_test_failures;
 }
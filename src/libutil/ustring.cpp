@@ -32,6 +32,7 @@
 
 #include "OpenImageIO/export.h"
 #include "OpenImageIO/thread.h"
+#include "OpenImageIO/timer.h"
 #include "OpenImageIO/strutil.h"
 #include "OpenImageIO/dassert.h"
 #include "OpenImageIO/ustring.h"
@@ -61,17 +62,49 @@ typedef null_lock<null_mutex> ustring_write_lock_t;
 #endif
 
 
+// Write-lock a table's mutex for the life of the guard, counting (and
+// timing) the times another thread already held it.  Only the contended
+// case is timed, so an uncontended insert costs the same as before.
+template<class Mutex>
+class counted_write_lock {
+public:
+    counted_write_lock (Mutex &m, atomic_ll &waits, atomic_ll &wait_ticks)
+        : m_mutex(m)
+    {
+        if (! m_mutex.try_lock()) {
+            Timer timer;
+            m_mutex.lock ();
+            waits += 1;
+            wait_ticks += timer.ticks();
+        }
+    }
+    ~counted_write_lock () { m_mutex.unlock (); }
+private:
+    Mutex &m_mutex;
+};
+
+
+
 // NOTE: BASE_CAPACITY must be a power of 2
+//
+// Lookups of strings already in the table take no lock at all, only
+// inserts do.  This works because nothing in the table is ever modified
+// or freed once a reader can see it: a TableRep is fully built before its
+// pointer is stored in an empty slot, and growing makes a complete new
+// slot array before publishing it (the old one is leaked, just like the
+// reps themselves, so readers still probing it stay safe).  A lock-free
+// probe that doesn't find the string -- because it really is new, or was
+// inserted so recently that the probe missed it -- falls back to insert(),
+// which checks again under the lock.
 template <unsigned BASE_CAPACITY = 1 << 20, unsigned POOL_SIZE = 4 << 20>
 struct TableRepMap {
     TableRepMap() :
-        mask(BASE_CAPACITY - 1),
-        entries(static_cast<ustring::TableRep**>(calloc(BASE_CAPACITY, sizeof(ustring::TableRep*)))),
+        slots(make_slots(BASE_CAPACITY - 1)),
         num_entries(0),
         pool(static_cast<char*>(malloc(POOL_SIZE))),
         pool_offset(0),
         memory_usage(sizeof(*this) + POOL_SIZE + sizeof(ustring::TableRep*) * BASE_CAPACITY),
-        num_lookups(0) {}
+        num_lookups(0) { lock_waits = 0;  lock_wait_ticks = 0; }
 
     ~TableRepMap() { /* just let memory leak */ }
 
@@ -90,8 +123,11 @@ struct TableRepMap {
         return num_lookups;
     }
 
+    long long get_lock_waits() { return lock_waits; }
+
+    long long get_lock_wait_ticks() { return lock_wait_ticks; }
+
     const char* lookup(string_view str, size_t hash) {
-        ustring_read_lock_t lock(mutex);
 #if 0
         // NOTE: this simple increment adds a substantial amount of overhead
         // so keep it off by default, unless the user really wants it
@@ -99,63 +135,84 @@ struct TableRepMap {
         // can skew the number of lookups compared to release builds
         ++num_lookups;
 #endif
-        size_t pos = hash & mask, dist = 0;
+        const Slots *s = slots;
+        atomic_thread_fence (memory_order_acquire);
+        size_t pos = hash & s->mask, dist = 0;
         for (;;) {
-            if (entries[pos] == 0) return 0;
-            if (entries[pos]->hashed == hash &&
-                entries[pos]->length == str.length() &&
-                strncmp(entries[pos]->c_str(), str.data(), str.length()) == 0)
-                return entries[pos]->c_str();
+            const ustring::TableRep *rep = s->entries[pos];
+            if (rep == 0) return 0;
+            atomic_thread_fence (memory_order_acquire);
+            if (rep->hashed == hash &&
+                rep->length == str.length() &&
+                strncmp(rep->c_str(), str.data(), str.length()) == 0)
+                return rep->c_str();
             ++dist;
-            pos = (pos + dist) & mask; // quadratic probing
+            pos = (pos + dist) & s->mask; // quadratic probing
         }
     }
 
     const char* insert(string_view str, size_t hash) {
-        ustring_write_lock_t lock(mutex);
-        size_t pos = hash & mask, dist = 0;
+        counted_write_lock<ustring_mutex_t> lock(mutex, lock_waits, lock_wait_ticks);
+        Slots *s = slots;
+        size_t pos = hash & s->mask, dist = 0;
         for (;;) {
-            if (entries[pos] == 0) break; // found insert pos
-            if (entries[pos]->hashed == hash &&
-                entries[pos]->length == str.length() &&
-                strncmp(entries[pos]->c_str(), str.data(), str.length()) == 0)
-                return entries[pos]->c_str(); // same string is already inserted, return the one that is already in the table
+            const ustring::TableRep *rep = s->entries[pos];
+            if (rep == 0) break; // found insert pos
+            if (rep->hashed == hash &&
+                rep->length == str.length() &&
+                strncmp(rep->c_str(), str.data(), str.length()) == 0)
+                return rep->c_str(); // same string is already inserted, return the one that is already in the table
             ++dist;
-            pos = (pos + dist) & mask; // quadratic probing
+            pos = (pos + dist) & s->mask; // quadratic probing
         }
 
         ustring::TableRep* rep = make_rep(str, hash);
-        entries[pos] = rep;
+        atomic_thread_fence (memory_order_release);  // rep before pointer
+        s->entries[pos] = rep;
         ++num_entries;
-        if (2 * num_entries > mask) grow(); // maintain 0.5 load factor
-        return rep->c_str();                // rep is now in the table
+        if (2 * num_entries > s->mask) grow(); // maintain 0.5 load factor
+        return rep->c_str();                   // rep is now in the table
     }
 
 private:
+    // The slot array and its size, allocated together so that readers
+    // always see a matching pair.
+    struct Slots {
+        size_t mask;
+        ustring::TableRep * volatile entries[1];
+    };
+
+    static Slots* make_slots(size_t mask) {
+        Slots *s = static_cast<Slots*>(calloc(1, sizeof(Slots) + mask * sizeof(ustring::TableRep*)));
+        s->mask = mask;
+        return s;
+    }
+
     void grow() {
-        size_t new_mask = mask * 2 + 1;
+        const Slots *old = slots;
+        Slots *s = make_slots(old->mask * 2 + 1);
 
-        // NOTE: only increment by half because we are doubling the entries and freeing the old
-        memory_usage += (mask + 1) * sizeof(ustring::TableRep*);
+        // NOTE: the old slots can't be freed, since readers may still be
+        // probing them, so count the whole new array
+        memory_usage += (s->mask + 1) * sizeof(ustring::TableRep*);
 
-        ustring::TableRep** new_entries = static_cast<ustring::TableRep**>(calloc(new_mask + 1, sizeof(ustring::TableRep*)));
         size_t to_copy = num_entries;
         for (size_t i = 0; to_copy != 0; i++) {
-            if (entries[i] == 0)  continue;
-            size_t pos = entries[i]->hashed & new_mask, dist = 0;
+            ustring::TableRep *rep = old->entries[i];
+            if (rep == 0)  continue;
+            size_t pos = rep->hashed & s->mask, dist = 0;
             for (;;) {
-                if (new_entries[pos] == 0)
+                if (s->entries[pos] == 0)
                     break;
                 ++dist;
-                pos = (pos + dist) & new_mask; // quadratic probing
+                pos = (pos + dist) & s->mask; // quadratic probing
             }
-            new_entries[pos] = entries[i];
+            s->entries[pos] = rep;
             to_copy--;
         }
 
-        free(entries);
-        entries = new_entries;
-        mask    = new_mask;
+        atomic_thread_fence (memory_order_release);  // contents before pointer
+        slots = s;
     }
 
     ustring::TableRep* make_rep(string_view str, size_t hash) {
@@ -179,14 +236,15 @@ private:
         return result;
     }
 
-    OIIO_CACHE_ALIGN ustring_mutex_t mutex;
-    size_t mask;
-    ustring::TableRep** entries;
+    OIIO_CACHE_ALIGN ustring_mutex_t mutex;  // held only by inserts (and stats)
+    Slots * volatile slots;
     size_t num_entries;
     char* pool;
     size_t pool_offset;
     size_t memory_usage;
     OIIO_CACHE_ALIGN size_t num_lookups;
+    atomic_ll lock_waits;       // inserts that found the mutex held
+    atomic_ll lock_wait_ticks;  // ... and how long they waited for it
 };
 
 #if 0
@@ -225,6 +283,20 @@ struct UstringTable {
         return num;
     }
 
+    long long get_lock_waits() {
+        long long num = 0;
+        for (int i = 0; i < NUM_BINS; i++)
+            num += bins[i].get_lock_waits();
+        return num;
+    }
+
+    long long get_lock_wait_ticks() {
+        long long num = 0;
+        for (int i = 0; i < NUM_BINS; i++)
+            num += bins[i].get_lock_wait_ticks();
+        return num;
+    }
+
 private:
     enum {
         BIN_SHIFT = 5,
@@ -393,7 +465,8 @@ ustring::make_unique (string_view strref)
 
     // Check the ustring table to see if this string already exists.  If so,
     // construct from its canonical representation.
-    // NOTE: all locking is performed internally to the table implementation
+    // NOTE: all locking is performed internally to the table implementation,
+    // and only an insert of a new string takes a lock.
     const char* result = table.lookup(strref, hash);
     return result ? result : table.insert(strref, hash);
 }
@@ -414,6 +487,10 @@ ustring::getstats (bool verbose)
         out << "  unique strings: " << n_e << "\n";
         out << "  ustring memory: " << Strutil::memformat(mem)
             << "\n";
+        if (long long waits = table.get_lock_waits())
+        out << "  insert lock waits: " << waits << " ("
+            << Strutil::timeintervalformat(Timer::seconds(table.get_lock_wait_ticks()), 3)
+            << ")\n";
     } else {
         if (n_l) // NOTE: see #if 0 above
         out << "requests: " << n_l << ", ";
@@ -430,4 +507,12 @@ ustring::memory ()
     return table.get_memory_usage();
 }
 
+void
+ustring::insert_contention (long long &waits, double &wait_seconds)
+{
+    UstringTable &table (ustring_table());
+    waits = table.get_lock_waits();
+    wait_seconds = Timer::seconds (table.get_lock_wait_ticks());
+}
+
 OIIO_NAMESPACE_END
@@ -31,6 +31,7 @@
 
 #include <iostream>
 #include <cstdio>
+#include <cstring>
 
 #include "OpenImageIO/thread.h"
 #include "OpenImageIO/ustring.h"
@@ -56,6 +57,7 @@ static int ntrials = 1;
 static bool verbose = false;
 static bool wedge = false;
 static spin_mutex print_mutex;  // make the prints not clobber each other
+static atomic_int mismatches;   // lookups that returned the wrong string
 
 
 
@@ -70,6 +72,11 @@ create_lotso_ustrings (int iterations)
         char buf[20];
         sprintf (buf, "%d", i);
         ustring s (buf);
+        // Other threads are inserting the same strings (and growing the
+        // table) concurrently, so this also exercises the lock-free
+        // lookup of strings that already exist.
+        if (strcmp (s.c_str(), buf) != 0 || ustring(buf).c_str() != s.c_str())
+            ++mismatches;
     }
 }
 
@@ -82,7 +89,7 @@ void test_ustring_lock (int numthreads, int iterations)
         threads.create_thread (boost::bind (create_lotso_ustrings, iterations));
     }
     threads.join_all ();
-    OIIO_CHECK_ASSERT (true);  // If we make it here without crashing, pass
+    OIIO_CHECK_EQUAL (mismatches, 0);
 }
 
 
@@ -47,8 +47,10 @@
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/imagebufalgo.h"
+#include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/thread.h"
 #include "OpenImageIO/filter.h"
+#include "OpenImageIO/sysutil.h"
 
 OIIO_NAMESPACE_USING
 
@@ -63,6 +65,11 @@ static bool verbose = false;
 static bool runstats = false;
 static int nthreads = 0;    // default: use #cores threads if available
 
+// Batch mode: many textures converted by one process
+static std::string manifest;
+static int batch_jobs = 0;           // default: as many as threads
+static float batch_memory_MB = 0;    // default: half the physical memory
+
 // Conversion modes.  If none are true, we just make an ordinary texture.
 static bool mipmapmode = false;
 static bool shadowmode = false;
@@ -199,13 +206,20 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
     bool nomipmap = false;
     bool prman_metadata = false;
     bool constant_color_detect = false;
+    bool constant_tiles = false;
+    bool tile_hashes = false;
+    std::string hash_algorithm = "sha1";
     bool monochrome_detect = false;
     bool opaque_detect = false;
     bool compute_average = true;
+    int envlatl_importance = 0;
+    std::string minmax;   // "", min, max, minmax
+    std::string lean;     // "", bump, normal, normal01
     int nchannels = -1;
     bool prman = false;
     bool oiio = false;
     bool ignore_unassoc = false;  // ignore unassociated alpha tags
+    bool stream = false;
     bool unpremult = false;
     bool sansattrib = false;
     float sharpen = 0.0f;
@@ -225,6 +239,9 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
                   "-v", &verbose, "Verbose status messages",
                   "-o %s", &outputfilename, "Output filename",
                   "--threads %d", &nthreads, "Number of threads (default: #cores)",
+                  "--manifest %s", &manifest, "Read more input files (one per line, optionally followed by an output name) from a file",
+                  "--jobs %d", &batch_jobs, "Maximum number of textures to convert at once (default: #threads)",
+                  "--batch-memory %f", &batch_memory_MB, "Memory budget (MB) for textures being converted at once (default: half of RAM)",
                   "-u", &updatemode, "Update mode",
                   "--format %s", &fileformatname, "Specify output file format (default: guess from extension)",
                   "--nchannels %d", &nchannels, "Specify the number of output image channels.",
@@ -233,7 +250,7 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
                           "uint8, sint8, uint16, sint16, half, float",
                   "--tile %d %d", &tile[0], &tile[1], "Specify tile size",
                   "--separate", &separate, "Use planarconfig separate (default: contiguous)",
-                  "--compression %s", &compression, "Set the compression method (default = zip, if possible)",
+                  "--compression %s", &compression, "Set the compression method (default = zip, if possible; zstd where supported)",
                   "--fovcot %f", &fovcot, "Override the frame aspect ratio. Default is width/height.",
                   "--wrap %s", &wrap, "Specify wrap mode (black, clamp, periodic, mirror)",
                   "--swrap %s", &swrap, "Specific s wrap mode separately",
@@ -265,10 +282,14 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
                   "--sattrib %L %L", &string_attrib_names, &string_attrib_values, "Sets string metadata attribute (name, value)",
                   "--sansattrib", &sansattrib, "Write command line into Software & ImageHistory but remove --sattrib and --attrib options",
                   "--constant-color-detect", &constant_color_detect, "Create 1-tile textures from constant color inputs",
+                  "--constant-tiles", &constant_tiles, "Record single-color tiles so the texture cache can share their pixels",
+                  "--tile-hashes", &tile_hashes, "Record hashes of identical tiles so the texture cache can share their pixels",
+                  "--hash-algorithm %s", &hash_algorithm, "Algorithm for the pixel hash (sha1 [default], xxhash64)",
                   "--monochrome-detect", &monochrome_detect, "Create 1-channel textures from monochrome inputs",
                   "--opaque-detect", &opaque_detect, "Drop alpha channel that is always 1.0",
                   "--no-compute-average %!", &compute_average, "Don't compute and store average color",
                   "--ignore-unassoc", &ignore_unassoc, "Ignore unassociated alpha tags in input (don't autoconvert)",
+                  "--stream", &stream, "Stream the top level from the ImageCache rather than holding it in memory",
                   "--runstats", &runstats, "Print runtime statistics",
                   "--stats", &runstats, "", // DEPRECATED 1.6
                   "--mipimage %L", &mipimages, "Specify an individual MIP level",
@@ -276,7 +297,10 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
                   "--shadow", &shadowmode, "Create shadow map",
                   "--envlatl", &envlatlmode, "Create lat/long environment map",
                   "--lightprobe", &lightprobemode, "Create lat/long environment map from a light probe",
-//                  "--envcube", &envcubemode, "Create cubic env map (file order: px, nx, py, ny, pz, nz) (UNIMP)",
+                  "--envlatl-importance %d", &envlatl_importance, "Store environment map importance sampling tables of the given width",
+                  "--minmax %s", &minmax, "Append conservative min and/or max MIP channels (options: min, max, minmax)",
+                  "--lean %s", &lean, "Append LEAN slope moment channels (options: bump, normal, normal01)",
+                  "--envcube", &envcubemode, "Create cube-face env map, from a 1x6 stack of faces (px, nx, py, ny, pz, nz) or a lat/long image",
                   "<SEPARATOR>", colortitle_help_string().c_str(),
                   "--colorconvert %s %s", &incolorspace, &outcolorspace,
                           colorconvert_help_string().c_str(),
@@ -296,7 +320,7 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
         ap.usage ();
         exit (EXIT_FAILURE);
     }
-    if (filenames.empty()) {
+    if (filenames.empty() && manifest.empty()) {
         ap.briefusage ();
         std::cout << "\nFor detailed help: maketx --help\n";
         exit (EXIT_SUCCESS);
@@ -319,10 +343,6 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
         exit (EXIT_FAILURE);
     }
 
-    if (filenames.size() != 1) {
-        std::cerr << "maketx ERROR: requires exactly one input filename\n";
-        exit (EXIT_FAILURE);
-    }
 
 
 //    std::cout << "Converting " << filenames[0] << " to " << outputfilename << "\n";
@@ -370,10 +390,22 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
     configspec.attribute ("maketx:nomipmap", nomipmap);
     configspec.attribute ("maketx:updatemode", updatemode);
     configspec.attribute ("maketx:constant_color_detect", constant_color_detect);
+    configspec.attribute ("maketx:constant_tiles", constant_tiles);
+    configspec.attribute ("maketx:tile_hashes", tile_hashes);
+    if (hash_algorithm != "sha1")
+        configspec.attribute ("maketx:hash_algorithm", hash_algorithm);
     configspec.attribute ("maketx:monochrome_detect", monochrome_detect);
     configspec.attribute ("maketx:opaque_detect", opaque_detect);
     configspec.attribute ("maketx:compute_average", compute_average);
+    if (envlatl_importance)
+        configspec.attribute ("maketx:envlatl_importance", envlatl_importance);
+    if (minmax.size())
+        configspec.attribute ("maketx:minmax", minmax);
+    if (lean.size())
+        configspec.attribute ("maketx:lean", lean);
     configspec.attribute ("maketx:unpremult", unpremult);
+    if (stream)
+        configspec.attribute ("maketx:stream", 1);
     configspec.attribute ("maketx:incolorspace", incolorspace);
     configspec.attribute ("maketx:outcolorspace", outcolorspace);
     configspec.attribute ("maketx:checknan", checknan);
@@ -440,6 +472,146 @@ getargs (int argc, char *argv[], ImageSpec &configspec)
 
 
 
+// One texture of a batch.
+struct BatchJob {
+    std::string input, output;
+    imagesize_t mem;          // Estimated memory needed to convert it
+    bool ok;
+};
+
+
+
+// Build the list of textures to convert from the input files and the
+// manifest (if any), whose lines each name an input and, optionally, its
+// output; blank lines and those starting with '#' are skipped.  If there
+// is more than one, the -o option, if given, must name a directory for
+// the outputs, which otherwise go next to the inputs.  Return false (and
+// print why) on error.
+static bool
+batch_jobs_list (std::vector<BatchJob> &jobs)
+{
+    std::vector<std::pair<std::string,std::string> > files;
+    for (size_t i = 0;  i < filenames.size();  ++i)
+        files.push_back (std::make_pair (filenames[i], std::string()));
+    if (manifest.size()) {
+        std::string contents;
+        if (! Filesystem::read_text_file (manifest, contents)) {
+            std::cerr << "maketx ERROR: could not read manifest \""
+                      << manifest << "\"\n";
+            return false;
+        }
+        std::vector<string_view> lines;
+        Strutil::split (contents, lines, "\n");
+        for (size_t i = 0;  i < lines.size();  ++i) {
+            std::vector<std::string> words;
+            Strutil::split (Strutil::strip (lines[i]), words);
+            if (words.empty() || words[0][0] == '#')
+                continue;
+            files.push_back (std::make_pair (words[0], words.size() > 1
+                                             ? words[1] : std::string()));
+        }
+    }
+    if (files.size() > 1 && outputfilename.size() &&
+          ! Filesystem::is_directory (outputfilename)) {
+        std::cerr << "maketx ERROR: with more than one input, -o must name "
+                  << "a directory\n";
+        return false;
+    }
+    for (size_t i = 0;  i < files.size();  ++i) {
+        BatchJob job;
+        job.input = files[i].first;
+        job.output = files[i].second;
+        if (job.output.empty() && files.size() == 1)
+            job.output = outputfilename;
+        else if (job.output.empty() && outputfilename.size())
+            job.output = outputfilename + "/" + Filesystem::replace_extension (
+                             Filesystem::filename (job.input), ".tx");
+        // The top level is converted to float, and the source, the top
+        // level, and the next MIP level may all be in memory at once.
+        job.mem = 0;
+        if (ImageInput *in = ImageInput::open (job.input)) {
+            job.mem = 3 * in->spec().image_pixels() * in->spec().nchannels
+                    * sizeof(float);
+            ImageInput::destroy (in);
+        }
+        job.ok = false;
+        jobs.push_back (job);
+    }
+    return true;
+}
+
+
+
+static spin_mutex batch_output_mutex;
+static atomic_ll batch_mem_in_use;
+static atomic_int batch_running;
+
+
+
+static void
+run_batch_job (BatchJob *job, ImageBufAlgo::MakeTextureMode mode,
+               const ImageSpec *configspec)
+{
+    // Keep each texture's messages together.
+    std::ostringstream out;
+    job->ok = ImageBufAlgo::make_texture (mode, job->input, job->output,
+                                          *configspec, &out);
+    {
+        spin_lock lock (batch_output_mutex);
+        std::cout << out.str() << std::flush;
+    }
+    batch_mem_in_use -= (long long) job->mem;
+    --batch_running;
+}
+
+
+
+// Convert all the jobs, several at a time: each is a task on the shared
+// thread pool, whose parallel loops also run on the pool, so its threads
+// stay busy while some conversions are reading, hashing, or writing.  A
+// job isn't started until there is room for it in the memory budget
+// (unless nothing else is running), or while --jobs are already running.
+static bool
+run_batch (std::vector<BatchJob> &jobs, ImageBufAlgo::MakeTextureMode mode,
+           const ImageSpec &configspec)
+{
+    int maxjobs = batch_jobs;
+    if (maxjobs <= 0)
+        OIIO::getattribute ("threads", maxjobs);
+    maxjobs = std::max (maxjobs, 1);
+    long long budget = batch_memory_MB > 0
+                     ? (long long)(batch_memory_MB * 1024 * 1024)
+                     : (long long)(Sysutil::physical_memory() / 2);
+    batch_mem_in_use = 0;
+    batch_running = 0;
+    task_set tasks;
+    for (size_t i = 0;  i < jobs.size();  ++i) {
+        // While waiting, lend a hand to the running conversions.
+        while (batch_running > 0 &&
+               (batch_running >= maxjobs ||
+                batch_mem_in_use + (long long)jobs[i].mem > budget)) {
+            if (! tasks.pool()->run_one_task ())
+                Sysutil::usleep (1000);
+        }
+        batch_mem_in_use += (long long) jobs[i].mem;
+        ++batch_running;
+        tasks.push (OIIO::bind (run_batch_job, &jobs[i], mode, &configspec));
+    }
+    tasks.wait ();
+
+    bool ok = true;
+    for (size_t i = 0;  i < jobs.size();  ++i) {
+        if (! jobs[i].ok) {
+            std::cerr << "maketx ERROR: failed to convert \""
+                      << jobs[i].input << "\"\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+
+
 int
 main (int argc, char *argv[])
 {
@@ -463,9 +635,17 @@ main (int argc, char *argv[])
         mode = ImageBufAlgo::MakeTxEnvLatl;
     if (lightprobemode)
         mode = ImageBufAlgo::MakeTxEnvLatlFromLightProbe;
-    bool ok = ImageBufAlgo::make_texture (mode, filenames[0],
-                                          outputfilename, configspec,
-                                          &std::cout);
+    if (envcubemode)
+        mode = ImageBufAlgo::MakeTxEnvCube;
+    std::vector<BatchJob> jobs;
+    if (! batch_jobs_list (jobs))
+        return EXIT_FAILURE;
+    bool ok;
+    if (jobs.size() == 1)
+        ok = ImageBufAlgo::make_texture (mode, jobs[0].input, jobs[0].output,
+                                         configspec, &std::cout);
+    else
+        ok = run_batch (jobs, mode, configspec);
     if (runstats)
         std::cout << "\n" << ic->getstats();
 
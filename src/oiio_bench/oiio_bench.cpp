@@ -0,0 +1,810 @@
+/*
+  Copyright 2016 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+/// \file
+/// oiio_bench -- a suite of canned, reproducible benchmarks of the
+/// TextureSystem, ImageCache, ImageBufAlgo and ImageBuf::get_pixels.
+///
+/// Every workload makes its own input (textures are generated into a
+/// data directory the first time they are needed, from fixed seeds), is
+/// timed as the best of several trials at each of a series of thread
+/// counts, and is reported as time per operation, throughput, and
+/// speedup over one thread.  The results may be saved as JSON, and a
+/// previously saved file may be given as a baseline, in which case any
+/// workload that got slower by more than the tolerance is flagged and
+/// the program exits with a failure status.
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "OpenImageIO/argparse.h"
+#include "OpenImageIO/imageio.h"
+#include "OpenImageIO/imagebuf.h"
+#include "OpenImageIO/imagebufalgo.h"
+#include "OpenImageIO/texture.h"
+#include "OpenImageIO/filesystem.h"
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/sysutil.h"
+#include "OpenImageIO/thread.h"
+#include "OpenImageIO/timer.h"
+#include "OpenImageIO/ustring.h"
+
+
+OIIO_NAMESPACE_USING;
+
+
+static int maxthreads = 0;
+static std::string threadlist;
+static int ntrials = 3;
+static bool quick = false;
+static bool verbose = false;
+static bool list_only = false;
+static bool help = false;
+static std::string filter;
+static std::string datadir = "oiio_bench_data";
+static std::string json_filename;
+static std::string baseline_filename;
+static float tolerance = 10.0f;    // percent slower that counts as regressed
+
+
+
+static void
+getargs (int argc, const char *argv[])
+{
+    ArgParse ap;
+    ap.options ("oiio_bench -- canned, reproducible OpenImageIO benchmarks\n"
+                OIIO_INTRO_STRING "\n"
+                "Usage:  oiio_bench [options]",
+                "--help", &help, "Print help message",
+                "-v", &verbose, "Verbose status messages",
+                "--list", &list_only, "List the workloads and exit",
+                "--filter %s", &filter, "Only run the workloads whose names contain this string",
+                "--threads %d", &maxthreads, "Most threads to scale up to (default 0 = #cores)",
+                "--threadlist %s", &threadlist, "Comma-separated thread counts to run (default: 1,2,4,... up to --threads)",
+                "--trials %d", &ntrials, "Number of trials for each timing (the best is kept)",
+                "--quick", &quick, "Smaller images and fewer operations, for a fast run",
+                "--datadir %s", &datadir, "Directory for the generated input images",
+                "--json %s", &json_filename, "Write the results as JSON to this file (\"-\" for stdout)",
+                "--baseline %s", &baseline_filename, "Compare against the results saved in this JSON file",
+                "--tolerance %f", &tolerance, "Percent slower than the baseline that counts as a regression (default: 10)",
+                NULL);
+    if (ap.parse (argc, argv) < 0) {
+        std::cerr << ap.geterror() << std::endl;
+        ap.usage ();
+        exit (EXIT_FAILURE);
+    }
+    if (help) {
+        ap.usage ();
+        exit (EXIT_SUCCESS);
+    }
+    if (maxthreads <= 0)
+        maxthreads = Sysutil::hardware_concurrency ();
+    ntrials = std::max (ntrials, 1);
+}
+
+
+
+// The thread counts to run each workload at: the ones listed, or else
+// powers of 2 up to maxthreads (and maxthreads itself).
+static std::vector<int>
+thread_counts ()
+{
+    std::vector<int> counts;
+    if (threadlist.size()) {
+        std::vector<std::string> vals;
+        Strutil::split (threadlist, vals, ",");
+        for (size_t i = 0;  i < vals.size();  ++i)
+            if (Strutil::from_string<int>(vals[i]) > 0)
+                counts.push_back (Strutil::from_string<int>(vals[i]));
+    } else {
+        for (int n = 1;  n < maxthreads;  n *= 2)
+            counts.push_back (n);
+        counts.push_back (maxthreads);
+    }
+    return counts;
+}
+
+
+
+// A small, fast generator, so that every run makes the very same
+// sequence of "random" lookups.
+struct BenchRandom {
+    BenchRandom (unsigned int seed) : state(seed*2654435761u + 1) { }
+    float operator() () {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    }
+    unsigned int state;
+};
+
+
+
+/// One benchmark: setup() prepares everything it needs (outside of the
+/// timing), and run(n) performs one trial's worth of work using n
+/// threads, which consists of ops(n) operations.
+class Benchmark {
+public:
+    Benchmark (const std::string &name, const std::string &units,
+               const std::string &description)
+        : m_name(name), m_units(units), m_description(description) { }
+    virtual ~Benchmark () { }
+
+    const std::string &name () const { return m_name; }
+    const std::string &units () const { return m_units; }
+    const std::string &description () const { return m_description; }
+
+    virtual bool setup () { return true; }
+    virtual void teardown () { }
+    virtual void run (int nthreads) = 0;
+    virtual double ops (int nthreads) const = 0;
+
+private:
+    std::string m_name, m_units, m_description;
+};
+
+
+
+// Functor for time_trial
+struct RunTrial {
+    RunTrial (Benchmark *bench, int nthreads) : bench(bench), nthreads(nthreads) { }
+    void operator() () { bench->run (nthreads); }
+    Benchmark *bench;
+    int nthreads;
+};
+
+
+
+struct Result {
+    std::string name;      ///< Workload name
+    std::string units;     ///< What one operation is
+    int threads;           ///< Number of threads
+    double ops;            ///< Operations per trial (all threads together)
+    double seconds;        ///< Time of the best trial
+    double range;          ///< Spread of the trial times
+    double speedup;        ///< Throughput relative to one thread (or 0)
+    double baseline_ns;    ///< ns/op of the baseline, or 0 if none
+
+    double ns_per_op () const { return seconds * 1.0e9 / ops; }
+    double ops_per_sec () const { return ops / seconds; }
+    // Percent change of time per op relative to the baseline
+    double change () const {
+        return baseline_ns > 0 ? 100.0 * (ns_per_op() / baseline_ns - 1.0) : 0.0;
+    }
+};
+
+static std::vector<Result> results;
+static std::map<std::string,double> baseline;   // "name@threads" -> ns/op
+static std::string baseline_mode;
+
+
+
+////////////////////////////////////////////////////////////////////////
+// The canned input images.  They are made from fixed seeds, so they are
+// the same from run to run, and are only generated if not already in
+// the data directory.
+
+static std::string
+datafile (const std::string &name)
+{
+    return datadir + "/" + name;
+}
+
+
+
+// Make a MIP-mapped tiled texture of the given resolution, filled with
+// noise from the given seed, unless it already exists.
+static bool
+make_bench_texture (const std::string &filename, int res, int seed)
+{
+    if (Filesystem::exists (filename))
+        return true;
+    if (verbose)
+        std::cout << "  Generating " << filename << "\n";
+    ImageSpec spec (res, res, 3, TypeDesc::UINT8);
+    ImageBuf src (spec);
+    ImageBufAlgo::noise (src, "uniform", 0.0f, 1.0f, false, seed);
+    ImageSpec config;
+    config.tile_width = 64;
+    config.tile_height = 64;
+    config.format = TypeDesc::UINT8;
+    std::string tmpname = filename + ".tmp.tx";
+    if (! ImageBufAlgo::make_texture (ImageBufAlgo::MakeTxTexture, src,
+                                      tmpname, config)) {
+        std::cerr << "oiio_bench: could not make " << filename << ": "
+                  << OIIO::geterror() << "\n";
+        return false;
+    }
+    // Rename at the end, so that an interrupted run never leaves behind
+    // a partial file that later runs would trust.
+    std::string err;
+    if (! Filesystem::rename (tmpname, filename, err)) {
+        std::cerr << "oiio_bench: " << err << "\n";
+        return false;
+    }
+    return true;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// Texture lookups
+
+enum TexPattern {
+    TexCoherent,     ///< Scanline order over the image, fixed filter size
+    TexIncoherent,   ///< Random coordinates, fixed filter size
+    TexMipMix,       ///< Scanline order, random filter sizes over all levels
+    TexUdim,         ///< Scanline order over a 2x2 UDIM set
+    TexThrash        ///< Many files, with a cache far smaller than them
+};
+
+
+class TextureBench : public Benchmark {
+public:
+    TextureBench (const std::string &name, TexPattern pattern,
+                  const std::string &description)
+        : Benchmark (name, "lookups", description),
+          m_pattern(pattern), m_texsys(NULL) { }
+    ~TextureBench () { teardown (); }
+
+    virtual bool setup ();
+    virtual void teardown () {
+        if (m_texsys)
+            TextureSystem::destroy (m_texsys);
+        m_texsys = NULL;
+    }
+    virtual void run (int nthreads);
+    virtual double ops (int nthreads) const {
+        return double(nthreads) * lookups_per_thread ();
+    }
+
+    // The work of one thread
+    void lookups (int thread);
+
+private:
+    TexPattern m_pattern;
+    TextureSystem *m_texsys;
+    std::vector<ustring> m_files;
+    std::vector<TextureSystem::TextureHandle *> m_handles;
+    int m_res;            ///< Resolution of the "rendered" raster
+
+    int lookups_per_thread () const { return quick ? (1 << 16) : (1 << 19); }
+};
+
+
+
+bool
+TextureBench::setup ()
+{
+    int texres = quick ? 1024 : 2048;
+    m_files.clear ();
+    m_res = texres / 2;
+    if (m_pattern == TexUdim) {
+        static const int tiles[] = { 1001, 1002, 1011, 1012 };
+        for (int i = 0;  i < 4;  ++i) {
+            std::string f = datafile (Strutil::format ("udim_%d_%d.tx",
+                                                       texres/2, tiles[i]));
+            if (! make_bench_texture (f, texres/2, 100+i))
+                return false;
+        }
+        m_files.push_back (ustring (datafile (Strutil::format ("udim_%d_<UDIM>.tx", texres/2))));
+    } else if (m_pattern == TexThrash) {
+        int nfiles = quick ? 32 : 64;
+        for (int i = 0;  i < nfiles;  ++i) {
+            std::string f = datafile (Strutil::format ("thrash_%03d.tx", i));
+            if (! make_bench_texture (f, 256, 200+i))
+                return false;
+            m_files.push_back (ustring (f));
+        }
+        m_res = 256;
+    } else {
+        std::string f = datafile (Strutil::format ("tex_%d.tx", texres));
+        if (! make_bench_texture (f, texres, 1))
+            return false;
+        m_files.push_back (ustring (f));
+    }
+
+    m_texsys = TextureSystem::create (false /* not shared */);
+    if (m_pattern == TexThrash) {
+        // Far less cache and fewer open files than the set needs
+        m_texsys->attribute ("max_memory_MB", 4.0f);
+        m_texsys->attribute ("max_open_files", 8);
+    } else {
+        m_texsys->attribute ("max_memory_MB", 1024.0f);
+    }
+    m_handles.clear ();
+    for (size_t i = 0;  i < m_files.size();  ++i) {
+        m_handles.push_back (m_texsys->get_texture_handle (m_files[i]));
+        if (! m_handles.back()) {
+            std::cerr << "oiio_bench: " << m_texsys->geterror() << "\n";
+            return false;
+        }
+    }
+    // One untimed pass, so the trials measure a warm cache (except where
+    // the cache is too small to ever be warm, which is the point).
+    run (1);
+    return true;
+}
+
+
+
+struct TextureWorker {
+    TextureWorker (TextureBench *bench, int thread) : bench(bench), thread(thread) { }
+    void operator() () { bench->lookups (thread); }
+    TextureBench *bench;
+    int thread;
+};
+
+
+
+void
+TextureBench::run (int nthreads)
+{
+    if (nthreads <= 1) {
+        lookups (0);
+        return;
+    }
+    thread_group threads;
+    for (int i = 0;  i < nthreads;  ++i)
+        threads.create_thread (TextureWorker (this, i));
+    threads.join_all ();
+}
+
+
+
+void
+TextureBench::lookups (int thread)
+{
+    TextureSystem::Perthread *perthread = m_texsys->get_perthread_info ();
+    TextureOpt opt;
+    opt.swrap = opt.twrap = TextureOpt::WrapPeriodic;
+    BenchRandom rand (thread + 1);
+    float result[3];
+    int n = lookups_per_thread ();
+    int res = m_res;
+    // Each thread starts at a different place, to not all be fighting
+    // over the very same tiles.
+    int start = thread * 57557;
+    float d = 1.0f / res;
+    int nfiles = (int) m_handles.size();
+    for (int i = 0;  i < n;  ++i) {
+        int pixel = (start + i) % (res * res);
+        float s = (pixel % res + 0.5f) * d;
+        float t = (pixel / res + 0.5f) * d;
+        float ds = d, dt = d;
+        TextureSystem::TextureHandle *handle = m_handles[0];
+        switch (m_pattern) {
+        case TexCoherent :
+            break;
+        case TexIncoherent :
+            s = rand ();
+            t = rand ();
+            break;
+        case TexMipMix :
+            // Filter widths from 1/4096 to 1/2 of the texture
+            ds = dt = powf (2.0f, -1.0f - 11.0f * rand ());
+            break;
+        case TexUdim :
+            s *= 2.0f;
+            t *= 2.0f;
+            break;
+        case TexThrash :
+            // Short coherent runs, each on a different file
+            handle = m_handles[(i / 16 + thread * 7) % nfiles];
+            break;
+        }
+        m_texsys->texture (handle, perthread, opt, s, t, ds, 0.0f, 0.0f, dt,
+                           3, result);
+        DoNotOptimize (result[0]);
+    }
+}
+
+
+
+////////////////////////////////////////////////////////////////////////
+// ImageBufAlgo kernels
+
+enum IBAKernel { IBAAdd, IBAOver, IBAResize, IBAColorconvert, IBAStats };
+
+
+class IBABench : public Benchmark {
+public:
+    IBABench (const std::string &name, IBAKernel kernel, int res,
+              const std::string &description)
+        : Benchmark (name, "pixels", description),
+          m_kernel(kernel), m_res(res) { }
+
+    virtual bool setup () {
+        ImageSpec spec (m_res, m_res, 4, TypeDesc::FLOAT);
+        m_A.reset (spec);
+        m_B.reset (spec);
+        ImageBufAlgo::noise (m_A, "uniform", 0.0f, 1.0f, false, 1);
+        ImageBufAlgo::noise (m_B, "uniform", 0.0f, 1.0f, false, 2);
+        if (m_kernel == IBAResize)
+            spec.width = spec.height = spec.full_width = spec.full_height = m_res/2;
+        m_dst.reset (spec);
+        return true;
+    }
+    virtual void teardown () {
+        m_A.clear ();
+        m_B.clear ();
+        m_dst.clear ();
+    }
+    virtual void run (int nthreads) {
+        ROI roi;   // whole image
+        switch (m_kernel) {
+        case IBAAdd :
+            ImageBufAlgo::add (m_dst, m_A, m_B, roi, nthreads);
+            break;
+        case IBAOver :
+            ImageBufAlgo::over (m_dst, m_A, m_B, roi, nthreads);
+            break;
+        case IBAResize :
+            ImageBufAlgo::resize (m_dst, m_A, "", 0.0f, roi, nthreads);
+            break;
+        case IBAColorconvert :
+            ImageBufAlgo::colorconvert (m_dst, m_A, "linear", "sRGB", false,
+                                        NULL, roi, nthreads);
+            break;
+        case IBAStats : {
+            ImageBufAlgo::PixelStats stats;
+            ImageBufAlgo::computePixelStats (stats, m_A, roi, nthreads);
+            DoNotOptimize (stats.avg[0]);
+            break;
+            }
+        }
+    }
+    // Ops are source pixels
+    virtual double ops (int nthreads) const { return double(m_res) * m_res; }
+
+private:
+    IBAKernel m_kernel;
+    int m_res;
+    ImageBuf m_A, m_B, m_dst;
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+// ImageBuf::get_pixels conversions
+
+class GetPixelsBench : public Benchmark {
+public:
+    GetPixelsBench (const std::string &name, TypeDesc from, TypeDesc to,
+                    const std::string &description)
+        : Benchmark (name, "pixels", description), m_from(from), m_to(to) { }
+
+    virtual bool setup () {
+        m_res = quick ? 1024 : 2048;
+        ImageSpec spec (m_res, m_res, 4, m_from);
+        m_buf.reset (spec);
+        ImageBufAlgo::noise (m_buf, "uniform", 0.0f, 1.0f, false, 3);
+        m_result.resize (size_t(m_res) * m_res * 4 * m_to.size());
+        return true;
+    }
+    virtual void teardown () {
+        m_buf.clear ();
+        std::vector<char> empty;
+        std::swap (m_result, empty);
+    }
+    virtual void run (int nthreads) {
+        // Each thread converts one band of scanlines
+        if (nthreads <= 1) {
+            band (0, 1);
+            return;
+        }
+        thread_group threads;
+        for (int i = 0;  i < nthreads;  ++i)
+            threads.create_thread (Band (this, i, nthreads));
+        threads.join_all ();
+    }
+    virtual double ops (int nthreads) const { return double(m_res) * m_res; }
+
+    // Functor for the threads
+    struct Band {
+        Band (GetPixelsBench *bench, int i, int n) : bench(bench), i(i), n(n) { }
+        void operator() () { bench->band (i, n); }
+        GetPixelsBench *bench;
+        int i, n;
+    };
+
+    void band (int i, int n) {
+        int ybegin = m_res * i / n, yend = m_res * (i+1) / n;
+        size_t offset = size_t(ybegin) * m_res * 4 * m_to.size();
+        m_buf.get_pixels (ROI (0, m_res, ybegin, yend, 0, 1, 0, 4),
+                          m_to, &m_result[offset]);
+    }
+
+private:
+    TypeDesc m_from, m_to;
+    int m_res;
+    ImageBuf m_buf;
+    std::vector<char> m_result;
+};
+
+
+
+////////////////////////////////////////////////////////////////////////
+
+static std::vector<Benchmark *>
+make_benchmarks ()
+{
+    std::vector<Benchmark *> b;
+    b.push_back (new TextureBench ("texture_coherent", TexCoherent,
+                 "Scanline-order lookups of one texture, filter between MIP levels 1 and 2"));
+    b.push_back (new TextureBench ("texture_incoherent", TexIncoherent,
+                 "Random-coordinate lookups of one texture"));
+    b.push_back (new TextureBench ("texture_mipmix", TexMipMix,
+                 "Scanline-order lookups with random filter widths spanning every MIP level"));
+    b.push_back (new TextureBench ("texture_udim", TexUdim,
+                 "Scanline-order lookups across a 2x2 UDIM set"));
+    b.push_back (new TextureBench ("texture_cache_thrash", TexThrash,
+                 "Lookups cycling over many files, with a 4 MB cache and 8 open files"));
+    int sizes[] = { 256, 1024, 2048 };
+    int nsizes = quick ? 2 : 3;
+    for (int i = 0;  i < nsizes;  ++i) {
+        int r = sizes[i];
+        b.push_back (new IBABench (Strutil::format ("iba_add_%d", r), IBAAdd, r,
+                     Strutil::format ("ImageBufAlgo::add of two %dx%d RGBA float images", r, r)));
+        b.push_back (new IBABench (Strutil::format ("iba_over_%d", r), IBAOver, r,
+                     Strutil::format ("ImageBufAlgo::over of two %dx%d RGBA float images", r, r)));
+        b.push_back (new IBABench (Strutil::format ("iba_resize_%d", r), IBAResize, r,
+                     Strutil::format ("ImageBufAlgo::resize of a %dx%d RGBA float image to half size", r, r)));
+        b.push_back (new IBABench (Strutil::format ("iba_colorconvert_%d", r), IBAColorconvert, r,
+                     Strutil::format ("ImageBufAlgo::colorconvert linear to sRGB of a %dx%d RGBA float image", r, r)));
+        b.push_back (new IBABench (Strutil::format ("iba_stats_%d", r), IBAStats, r,
+                     Strutil::format ("ImageBufAlgo::computePixelStats of a %dx%d RGBA float image", r, r)));
+    }
+    b.push_back (new GetPixelsBench ("getpixels_float_to_uint8",
+                 TypeDesc::FLOAT, TypeDesc::UINT8, "ImageBuf::get_pixels, float to uint8"));
+    b.push_back (new GetPixelsBench ("getpixels_float_to_half",
+                 TypeDesc::FLOAT, TypeDesc::HALF, "ImageBuf::get_pixels, float to half"));
+    b.push_back (new GetPixelsBench ("getpixels_float_to_float",
+                 TypeDesc::FLOAT, TypeDesc::FLOAT, "ImageBuf::get_pixels, float to float (copy)"));
+    b.push_back (new GetPixelsBench ("getpixels_uint8_to_float",
+                 TypeDesc::UINT8, TypeDesc::FLOAT, "ImageBuf::get_pixels, uint8 to float"));
+    b.push_back (new GetPixelsBench ("getpixels_half_to_float",
+                 TypeDesc::HALF, TypeDesc::FLOAT, "ImageBuf::get_pixels, half to float"));
+    return b;
+}
+
+
+
+static std::string
+baseline_key (const std::string &name, int threads)
+{
+    return Strutil::format ("%s@%d", name, threads);
+}
+
+
+
+// Return the text following "key" : in obj, or an empty view.
+static string_view
+json_value (string_view obj, string_view key)
+{
+    std::string quoted = Strutil::format ("\"%s\"", key);
+    size_t pos = obj.find (quoted);
+    if (pos == string_view::npos)
+        return string_view();
+    obj.remove_prefix (pos + quoted.size());
+    if (! Strutil::parse_char (obj, ':'))
+        return string_view();
+    Strutil::skip_whitespace (obj);
+    return obj;
+}
+
+
+
+// Read the results back from a JSON file written by write_json.  This is
+// not a general JSON parser -- it just picks the fields it needs out of
+// each result record.
+static bool
+read_baseline (const std::string &filename)
+{
+    std::string text;
+    if (! Filesystem::read_text_file (filename, text)) {
+        std::cerr << "oiio_bench: could not read baseline \"" << filename << "\"\n";
+        return false;
+    }
+    string_view mode = json_value (text, "mode");
+    string_view m;
+    if (Strutil::parse_string (mode, m))
+        baseline_mode = m;
+    string_view all (text);
+    size_t pos = all.find ("\"results\"");
+    if (pos == string_view::npos) {
+        std::cerr << "oiio_bench: no results in baseline \"" << filename << "\"\n";
+        return false;
+    }
+    all.remove_prefix (pos);
+    while ((pos = all.find ('{')) != string_view::npos) {
+        all.remove_prefix (pos + 1);
+        string_view obj = all.substr (0, all.find ('}'));
+        string_view name, v;
+        int threads = 0;
+        float ns = 0.0f;
+        v = json_value (obj, "name");
+        if (! Strutil::parse_string (v, name))
+            continue;
+        v = json_value (obj, "threads");
+        if (! Strutil::parse_int (v, threads))
+            continue;
+        v = json_value (obj, "ns_per_op");
+        if (! Strutil::parse_float (v, ns) || ns <= 0.0f)
+            continue;
+        baseline[baseline_key (name, threads)] = ns;
+    }
+    return true;
+}
+
+
+
+static void
+write_json (std::ostream &out)
+{
+    out << "{ \"oiio_bench\" : { \"version\" : \"" << OIIO_VERSION_STRING
+        << "\", \"mode\" : \"" << (quick ? "quick" : "full")
+        << "\", \"hardware_threads\" : " << Sysutil::hardware_concurrency()
+        << ", \"trials\" : " << ntrials << " },\n";
+    out << "  \"results\" : [";
+    for (size_t i = 0;  i < results.size();  ++i) {
+        const Result &r (results[i]);
+        out << (i ? "," : "") << "\n    { \"name\" : \""
+            << Strutil::escape_chars (r.name) << "\", "
+            << "\"units\" : \"" << r.units << "\", "
+            << "\"threads\" : " << r.threads
+            << Strutil::format (", \"ops\" : %.0f", r.ops)
+            << Strutil::format (", \"seconds\" : %.6g", r.seconds)
+            << Strutil::format (", \"range\" : %.3g", r.range)
+            << Strutil::format (", \"ns_per_op\" : %.6g", r.ns_per_op())
+            << Strutil::format (", \"ops_per_sec\" : %.6g", r.ops_per_sec());
+        if (r.speedup > 0)
+            out << Strutil::format (", \"speedup\" : %.3f", r.speedup);
+        if (r.baseline_ns > 0)
+            out << Strutil::format (", \"baseline_ns_per_op\" : %.6g", r.baseline_ns)
+                << Strutil::format (", \"change_percent\" : %.2f", r.change());
+        out << " }";
+    }
+    out << " ]\n}\n";
+}
+
+
+
+int
+main (int argc, const char *argv[])
+{
+    Filesystem::convert_native_arguments (argc, argv);
+    getargs (argc, argv);
+
+    std::vector<Benchmark *> benchmarks = make_benchmarks ();
+    if (list_only) {
+        for (size_t b = 0;  b < benchmarks.size();  ++b)
+            std::cout << Strutil::format ("%-28s %s\n", benchmarks[b]->name(),
+                                          benchmarks[b]->description());
+        return EXIT_SUCCESS;
+    }
+
+    if (baseline_filename.size() && ! read_baseline (baseline_filename))
+        return EXIT_FAILURE;
+    if (baseline_mode.size() && baseline_mode != (quick ? "quick" : "full"))
+        std::cerr << "oiio_bench: warning: the baseline was a \""
+                  << baseline_mode << "\" run, but this one is not\n";
+    if (! Filesystem::is_directory (datadir) &&
+          ! Filesystem::create_directory (datadir)) {
+        std::cerr << "oiio_bench: could not create \"" << datadir << "\"\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<int> counts = thread_counts ();
+    // Text output goes to stderr if the JSON is going to stdout
+    std::ostream &out (json_filename == "-" ? std::cerr : std::cout);
+    out << "oiio_bench " << OIIO_VERSION_STRING << ": "
+        << ntrials << " trials, up to " << counts.back() << " threads"
+        << (quick ? " (quick)" : "") << "\n";
+
+    int regressions = 0;
+    for (size_t b = 0;  b < benchmarks.size();  ++b) {
+        Benchmark *bench = benchmarks[b];
+        if (filter.size() && bench->name().find (filter) == std::string::npos)
+            continue;
+        if (! bench->setup ()) {
+            std::cerr << "oiio_bench: could not set up " << bench->name() << "\n";
+            bench->teardown ();
+            continue;
+        }
+        out << "\n" << bench->name() << " -- " << bench->description() << "\n";
+        double single_rate = 0.0;
+        for (size_t c = 0;  c < counts.size();  ++c) {
+            Result r;
+            r.name = bench->name();
+            r.units = bench->units();
+            r.threads = counts[c];
+            r.ops = bench->ops (r.threads);
+            r.seconds = time_trial (RunTrial (bench, r.threads), ntrials,
+                                    &r.range);
+            if (r.threads == 1)
+                single_rate = r.ops_per_sec();
+            r.speedup = single_rate > 0 ? r.ops_per_sec() / single_rate : 0.0;
+            std::map<std::string,double>::const_iterator found =
+                baseline.find (baseline_key (r.name, r.threads));
+            r.baseline_ns = found != baseline.end() ? found->second : 0.0;
+
+            out << Strutil::format ("  %3d threads: %10.2f ns/op  %9.3f M %s/s",
+                                    r.threads, r.ns_per_op(),
+                                    r.ops_per_sec() * 1.0e-6, r.units);
+            if (r.speedup > 0)
+                out << Strutil::format ("  speedup %5.2fx", r.speedup);
+            if (r.baseline_ns > 0) {
+                out << Strutil::format ("  %+6.1f%% vs baseline", r.change());
+                if (r.change() > tolerance) {
+                    out << "  REGRESSION";
+                    ++regressions;
+                }
+            }
+            out << "\n";
+            results.push_back (r);
+        }
+        bench->teardown ();
+    }
+
+    if (json_filename == "-") {
+        write_json (std::cout);
+    } else if (json_filename.size()) {
+        OIIO::ofstream json;
+        Filesystem::open (json, json_filename);
+        if (! json) {
+            std::cerr << "oiio_bench: could not write \"" << json_filename << "\"\n";
+            return EXIT_FAILURE;
+        }
+        write_json (json);
+    }
+
+    for (size_t b = 0;  b < benchmarks.size();  ++b)
+        delete benchmarks[b];
+
+    if (baseline.size()) {
+        out << "\n";
+        if (regressions)
+            out << regressions << " timings were more than " << tolerance
+                << "% slower than the baseline\n";
+        else
+            out << "No timings were more than " << tolerance
+                << "% slower than the baseline\n";
+    }
+    return regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -61,8 +61,8 @@ ImageRec::ImageRec (const std::string &name, int nsubimages,
                     const int *miplevels, const ImageSpec *specs)
     : m_name(name), m_elaborated(true),
       m_metadata_modified(false), m_pixels_modified(true),
-      m_was_output(false),
-      m_imagecache(NULL)
+      m_was_output(false), m_frame_invariant(false),
+      m_imagecache(NULL), m_readpolicy(ReadDefault)
 {
     int specnum = 0;
     m_subimages.resize (nsubimages);
@@ -87,8 +87,8 @@ ImageRec::ImageRec (ImageRec &img, int subimage_to_copy,
                     int miplevel_to_copy, bool writable, bool copy_pixels)
     : m_name(img.name()), m_elaborated(true),
       m_metadata_modified(false), m_pixels_modified(false),
-      m_was_output(false),
-      m_imagecache(img.m_imagecache)
+      m_was_output(false), m_frame_invariant(false),
+      m_imagecache(img.m_imagecache), m_readpolicy(ReadDefault)
 {
     img.read ();
     int first_subimage = std::max (0, subimage_to_copy);
@@ -130,8 +130,8 @@ ImageRec::ImageRec (ImageRec &A, ImageRec &B, int subimage_to_copy,
                     TypeDesc pixeltype)
     : m_name(A.name()), m_elaborated(true),
       m_metadata_modified(false), m_pixels_modified(false),
-      m_was_output(false),
-      m_imagecache(A.m_imagecache)
+      m_was_output(false), m_frame_invariant(false),
+      m_imagecache(A.m_imagecache), m_readpolicy(ReadDefault)
 {
     A.read ();
     B.read ();
@@ -188,8 +188,8 @@ ImageRec::ImageRec (ImageRec &A, ImageRec &B, int subimage_to_copy,
 ImageRec::ImageRec (ImageBufRef img, bool copy_pixels)
     : m_name(img->name()), m_elaborated(true),
       m_metadata_modified(false), m_pixels_modified(false),
-      m_was_output(false),
-      m_imagecache(img->imagecache())
+      m_was_output(false), m_frame_invariant(false),
+      m_imagecache(img->imagecache()), m_readpolicy(ReadDefault)
 {
     m_subimages.resize (1);
     m_subimages[0].m_miplevels.resize (1);
@@ -207,8 +207,8 @@ ImageRec::ImageRec (const std::string &name, const ImageSpec &spec,
                     ImageCache *imagecache)
     : m_name(name), m_elaborated(true),
       m_metadata_modified(false), m_pixels_modified(true),
-      m_was_output(false),
-      m_imagecache(imagecache)
+      m_was_output(false), m_frame_invariant(false),
+      m_imagecache(imagecache), m_readpolicy(ReadDefault)
 {
     int subimages = 1;
     m_subimages.resize (subimages);
@@ -226,13 +226,21 @@ ImageRec::ImageRec (const std::string &name, const ImageSpec &spec,
 
 
 
+void
+SubimageRec::elaborate () const
+{
+    if (m_pending)
+        m_owner->read_subimage (m_index);
+}
+
+
+
 bool
 ImageRec::read (ReadPolicy readpolicy)
 {
     if (elaborated())
         return true;
     static ustring u_subimages("subimages"), u_miplevels("miplevels");
-    static boost::regex regex_sha ("SHA-1=[[:xdigit:]]*[ ]*");
     int subimages = 0;
     ustring uname (name());
     if (! m_imagecache->get_image_info (uname, 0, 0, u_subimages,
@@ -240,62 +248,52 @@ ImageRec::read (ReadPolicy readpolicy)
         error ("file not found: \"%s\"", name());
         return false;  // Image not found
     }
+    m_readpolicy = readpolicy;
     m_subimages.resize (subimages);
     bool allok = true;
     for (int s = 0;  s < subimages;  ++s) {
+        // Only set up the specs now.  Most commands only touch some of the
+        // subimages of a many-part file, so each one's pixels are read by
+        // read_subimage when its ImageBufs are first asked for, and ones
+        // never touched can be copied straight from the file on output.
         int miplevels = 0;
         m_imagecache->get_image_info (uname, s, 0, u_miplevels,
                                       TypeDesc::TypeInt, &miplevels);
         m_subimages[s].m_miplevels.resize (miplevels);
         m_subimages[s].m_specs.resize (miplevels);
+        m_subimages[s].m_owner = this;
+        m_subimages[s].m_index = s;
+        m_subimages[s].m_pending = true;
         for (int m = 0;  m < miplevels;  ++m) {
-            // Force a read now for reasonable-sized first images in the
-            // file. This can greatly speed up the multithread case for
-            // tiled images by not having multiple threads working on the
-            // same image lock against each other on the file handle.
-            // We guess that "reasonable size" is 50 MB, that's enough to
-            // hold a 2048x1536 RGBA float image.  Larger things will 
-            // simply fall back on ImageCache.
-            bool forceread = (s == 0 && m == 0 &&
-                              m_imagecache->imagespec(uname,s,m)->image_bytes() < 50*1024*1024);
             ImageBuf *ib = new ImageBuf (name(), m_imagecache);
-
-            // If we were requested to bypass the cache, force a full read.
-            if (readpolicy & ReadNoCache)
-                forceread = true;
-
-            // Convert to float unless asked to keep native.
-            TypeDesc convert = (readpolicy & ReadNative)
-                             ? ib->nativespec().format : TypeDesc::FLOAT;
-            if (! forceread &&
-                convert != TypeDesc::UINT8 && convert != TypeDesc::UINT16 &&
-                convert != TypeDesc::HALF &&  convert != TypeDesc::FLOAT) {
-                // If we're still trying to use the cache but it doesn't
-                // support the native type, force a full read.
-                forceread = true;
-            }
-
-            bool ok = ib->read (s, m, forceread, convert);
+            bool ok = ib->init_spec (name(), s, m);
             if (!ok)
                 error ("%s", ib->geterror());
             allok &= ok;
-            // Remove any existing SHA-1 hash from the spec.
-            ib->specmod().erase_attribute ("oiio:SHA-1");
-            std::string desc = ib->spec().get_string_attribute ("ImageDescription");
-            if (desc.size())
-                ib->specmod().attribute ("ImageDescription",
-                                         boost::regex_replace (desc, regex_sha, ""));
-
             m_subimages[s].m_miplevels[m].reset (ib);
-            m_subimages[s].m_specs[m] = ib->spec();
+            // The spec as it will be once the pixels are read: converted
+            // to float unless asked to keep native, and in the file's type
+            // if the pixels stay in the cache.
+            ImageSpec spec = ib->spec();
+            TypeDesc convert = (readpolicy & ReadNative)
+                             ? ib->nativespec().format : TypeDesc::FLOAT;
+            if (convert != spec.format || (readpolicy & ReadNoCache))
+                spec.format = convert;
+            strip_sha1 (spec);
             // For ImageRec purposes, we need to restore a few of the
             // native settings.
             const ImageSpec &nativespec (ib->nativespec());
-            // m_subimages[s].m_specs[m].format = nativespec.format;
-            m_subimages[s].m_specs[m].tile_width  = nativespec.tile_width;
-            m_subimages[s].m_specs[m].tile_height = nativespec.tile_height;
-            m_subimages[s].m_specs[m].tile_depth  = nativespec.tile_depth;
+            spec.tile_width  = nativespec.tile_width;
+            spec.tile_height = nativespec.tile_height;
+            spec.tile_depth  = nativespec.tile_depth;
+            m_subimages[s].m_specs[m] = spec;
         }
+        // The first subimage is wanted by nearly every command (and its
+        // read errors are reported by whoever called read()), and deep
+        // images change their specs when read, so don't leave those
+        // pending.
+        if (s == 0 || (miplevels && m_subimages[s].m_miplevels[0]->spec().deep))
+            allok &= read_pixels (s);
     }
 
     m_time = Filesystem::last_write_time (name());
@@ -304,6 +302,86 @@ ImageRec::read (ReadPolicy readpolicy)
 }
 
 
+
+void
+ImageRec::strip_sha1 (ImageSpec &spec)
+{
+    static boost::regex regex_sha ("SHA-1=[[:xdigit:]]*[ ]*");
+    spec.erase_attribute ("oiio:SHA-1");
+    std::string desc = spec.get_string_attribute ("ImageDescription");
+    if (desc.size())
+        spec.attribute ("ImageDescription",
+                        boost::regex_replace (desc, regex_sha, ""));
+}
+
+
+
+bool
+ImageRec::read_subimage (int s)
+{
+    if (! subimage_pending (s))
+        return true;
+    bool ok = read_pixels (s);
+    if (! ok)
+        read_error (name(), geterror());
+    return ok;
+}
+
+
+
+bool
+ImageRec::read_pixels (int s)
+{
+    SubimageRec &sub (m_subimages[s]);
+    if (! sub.m_pending)
+        return true;
+    sub.m_pending = false;
+    bool allok = true;
+    for (int m = 0, e = sub.miplevels();  m < e;  ++m) {
+        ImageBuf *ib = sub.m_miplevels[m].get();
+        // Force a read now for reasonable-sized first images in the
+        // file. This can greatly speed up the multithread case for
+        // tiled images by not having multiple threads working on the
+        // same image lock against each other on the file handle.
+        // We guess that "reasonable size" is 50 MB, that's enough to
+        // hold a 2048x1536 RGBA float image.  Larger things will 
+        // simply fall back on ImageCache.
+        bool forceread = (s == 0 && m == 0 &&
+                          ib->spec().image_bytes() < 50*1024*1024);
+
+        // If we were requested to bypass the cache, force a full read.
+        if (m_readpolicy & ReadNoCache)
+            forceread = true;
+
+        // Convert to float unless asked to keep native.
+        TypeDesc convert = (m_readpolicy & ReadNative)
+                         ? ib->nativespec().format : TypeDesc::FLOAT;
+        if (! forceread &&
+            convert != TypeDesc::UINT8 && convert != TypeDesc::UINT16 &&
+            convert != TypeDesc::HALF &&  convert != TypeDesc::FLOAT) {
+            // If we're still trying to use the cache but it doesn't
+            // support the native type, force a full read.
+            forceread = true;
+        }
+
+        bool ok = ib->read (s, m, forceread, convert);
+        if (!ok)
+            error ("%s", ib->geterror());
+        allok &= ok;
+        // Remove any existing SHA-1 hash from the spec.
+        strip_sha1 (ib->specmod());
+        // Keep any changes already made to our copy of the spec, but
+        // the pixels are now what they are.
+        ImageSpec &spec (sub.m_specs[m]);
+        spec.format = ib->spec().format;
+        spec.channelformats = ib->spec().channelformats;
+        if (ib->deep())
+            spec = ib->spec();
+    }
+    return allok;
+}
+
+
 namespace {
 static spin_mutex err_mutex;
 }
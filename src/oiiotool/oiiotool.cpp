@@ -31,7 +31,10 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
 #include <cmath>
+#include <ctime>
 #include <iostream>
 #include <iterator>
 #include <vector>
@@ -41,6 +44,15 @@
 #include <utility>
 #include <ctype.h>
 #include <map>
+#include <set>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
 
 #include <boost/foreach.hpp>
 #include <boost/regex.hpp>
@@ -51,12 +63,14 @@
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/imagebufalgo.h"
+#include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/sysutil.h"
 #include "OpenImageIO/strutil.h"
 #include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/filter.h"
 #include "OpenImageIO/color.h"
 #include "OpenImageIO/timer.h"
+#include "OpenImageIO/thread.h"
 
 #include "oiiotool.h"
 
@@ -65,7 +79,30 @@ using namespace OiioTool;
 using namespace ImageBufAlgo;
 
 
+#if OIIO_CPLUSPLUS_VERSION >= 11
+// With --parallel-frames, each thread running frames of a sequence needs
+// its own options, image stack and labels, so the state is per-thread.
+// The main thread's copy is the one used for everything else.
+static thread_local Oiiotool ot;
+#else
 static Oiiotool ot;
+#endif
+
+// The option table is built once (per thread) and reused for every frame
+// of a sequence; only the parse of each frame's substituted command line
+// is redone.  The flags it binds must outlive any one getargs call.
+struct OiiotoolArgs {
+    OiiotoolArgs () : ready(false), help(false), sansattrib(false) { }
+    ArgParse ap;
+    bool ready;
+    bool help;
+    bool sansattrib;
+};
+#if OIIO_CPLUSPLUS_VERSION >= 11
+static thread_local OiiotoolArgs ot_args;
+#else
+static OiiotoolArgs ot_args;
+#endif
 
 
 // Macro to fully set up the "action" function that straightforwardly
@@ -91,6 +128,21 @@ static Oiiotool ot;
     }
 
 
+// Like UNARY_IMAGE_OP, but for an op whose output pixels depend only on
+// the same input pixels, so it may compute just the demanded region.
+#define UNARY_PIXEL_OP(name,impl)                                      \
+    static int action_##name (int argc, const char *argv[]) {          \
+        const int nargs = 1, ninputs = 1;                              \
+        if (ot.postpone_callback (ninputs, action_##name, argc, argv)) \
+            return 0;                                                  \
+        ASSERT (argc == nargs);                                        \
+        OiiotoolSimpleUnaryOp<IBAunary> op (impl, ot, #name,           \
+                                            argc, argv, ninputs);      \
+        op.pixelwise (true);                                           \
+        return op();                                                   \
+    }
+
+
 #define BINARY_IMAGE_OP(name,impl)                                     \
     static int action_##name (int argc, const char *argv[]) {          \
         const int nargs = 1, ninputs = 2;                              \
@@ -126,7 +178,10 @@ Oiiotool::Oiiotool ()
       total_imagecache_readtime (0.0),
       enable_function_timing(true),
       peak_memory(0),
-      num_outputs(0)
+      num_outputs(0),
+      parallel_frames(1),
+      frame_index(0),
+      frame_cache(NULL)
 {
     clear_options ();
 }
@@ -173,6 +228,9 @@ Oiiotool::clear_options ()
     output_dither = false;
     output_force_tiles = false;
     metadata_nosoftwareattrib = false;
+    async_write = false;
+    async_write_limit = 1024;
+    profile_file.clear ();
     diff_warnthresh = 1.0e-6f;
     diff_warnpercent = 0;
     diff_hardwarn = std::numeric_limits<float>::max();
@@ -181,6 +239,8 @@ Oiiotool::clear_options ()
     diff_hardfail = std::numeric_limits<float>::max();
     m_pending_callback = NULL;
     m_pending_argc = 0;
+    m_argc = 0;
+    m_argv = NULL;
 }
 
 
@@ -268,6 +328,272 @@ Oiiotool::postpone_callback (int required_images, CallbackFunction func,
 
 
 
+// Clock for --profile record start times, started with the program.
+static Timer profile_clock;
+
+
+
+static long long
+imagecache_tile_misses (ImageCache *ic)
+{
+    int misses = 0;
+    if (ic)
+        ic->getattribute ("stat:find_tile_cache_misses", TypeDesc::INT, &misses);
+    return misses;
+}
+
+
+
+void
+Oiiotool::profile_start (ProfileRecord &rec, string_view command)
+{
+    rec.command = command;
+    rec.frame = frame_index;
+    rec.start = profile_clock();
+    rec.cpu = double(std::clock()) / CLOCKS_PER_SEC;
+    rec.memory = (long long) Sysutil::memory_used();
+    rec.pixels = 0;
+    rec.tile_misses = imagecache_tile_misses (imagecache);
+}
+
+
+
+void
+Oiiotool::profile_end (ProfileRecord &rec, imagesize_t pixels)
+{
+    rec.wall = profile_clock() - rec.start;
+    rec.cpu = double(std::clock()) / CLOCKS_PER_SEC - rec.cpu;
+    size_t mem = check_peak_memory ();
+    rec.memory = (long long)mem - rec.memory;
+    rec.pixels = pixels;
+    rec.tile_misses = imagecache_tile_misses (imagecache) - rec.tile_misses;
+    profile_records.push_back (rec);
+}
+
+
+
+// Sort profile records with the most expensive first.
+static bool
+profile_record_slower (const ProfileRecord &a, const ProfileRecord &b)
+{
+    return a.wall > b.wall;
+}
+
+
+
+static std::string
+json_escape (string_view s)
+{
+    std::string r;
+    for (size_t i = 0;  i < s.size();  ++i) {
+        if (s[i] == '"' || s[i] == '\\')
+            r += '\\';
+        if ((unsigned char)s[i] >= ' ')
+            r += s[i];
+    }
+    return r;
+}
+
+
+
+void
+Oiiotool::write_profile ()
+{
+    OIIO::ofstream file;
+    std::ostream *out = &std::cout;
+    if (profile_file != "-") {
+        Filesystem::open (file, profile_file);
+        if (! file) {
+            error ("--profile", Strutil::format ("Could not open \"%s\"",
+                                                 profile_file));
+            return;
+        }
+        out = &file;
+    }
+
+    if (Strutil::iends_with (profile_file, ".json")) {
+        // Chrome trace event format (chrome://tracing, Perfetto): one
+        // complete event per op, one row per sequence frame.
+        *out << "{\"traceEvents\":[\n";
+        for (size_t i = 0;  i < profile_records.size();  ++i) {
+            const ProfileRecord &r (profile_records[i]);
+            *out << Strutil::format ("{\"name\":\"%s\",\"cat\":\"oiiotool\","
+                                     "\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+                                     "\"ts\":%.0f,\"dur\":%.0f,\"args\":{"
+                                     "\"cpu_ms\":%.3f,\"memory_delta\":%lld,"
+                                     "\"pixels\":%llu,\"tile_misses\":%lld}}%s\n",
+                                     json_escape (r.command), r.frame,
+                                     r.start * 1.0e6, r.wall * 1.0e6,
+                                     r.cpu * 1000.0, r.memory,
+                                     (unsigned long long)r.pixels,
+                                     r.tile_misses,
+                                     i+1 < profile_records.size() ? "," : "");
+        }
+        *out << "]}\n";
+        return;
+    }
+
+    std::vector<ProfileRecord> sorted (profile_records);
+    std::stable_sort (sorted.begin(), sorted.end(), profile_record_slower);
+    *out << Strutil::format ("%-32s %6s %10s %10s %10s %12s %8s\n",
+                             "command", "frame", "wall", "cpu", "memory",
+                             "pixels", "misses");
+    for (size_t i = 0;  i < sorted.size();  ++i) {
+        const ProfileRecord &r (sorted[i]);
+        *out << Strutil::format ("%-32s %6d %9.3fs %9.3fs %10s %12llu %8lld\n",
+                                 r.command, r.frame, r.wall, r.cpu,
+                                 (r.memory < 0 ? "-" : "")
+                                     + Strutil::memformat (std::abs (r.memory)),
+                                 (unsigned long long)r.pixels, r.tile_misses);
+    }
+}
+
+
+
+bool
+Oiiotool::demand_roi (int argc, const char *argv[], ROI &roi) const
+{
+    // ArgParse hands each callback a pointer into the argument list it
+    // is walking, so the next command starts argc slots later. Postponed
+    // callbacks get a copy of their arguments and won't match.
+    if (! m_argv || argv < m_argv || argv >= m_argv + m_argc)
+        return false;
+    int next = int(argv - m_argv) + argc;
+    if (next + 1 >= m_argc)
+        return false;
+    string_view cmd (m_argv[next]);
+    cmd = cmd.substr (0, cmd.find (':'));
+    if (cmd != "--crop" && cmd != "-crop" && cmd != "--cut" && cmd != "-cut")
+        return false;
+    // Only literal, fully specified geometries -- anything relative to
+    // the image or needing expression expansion is left alone.
+    const char *geom = m_argv[next+1];
+    if (strchr (geom, '{'))
+        return false;
+    int x, y, w, h, xmax, ymax;
+    if (sscanf (geom, "%d,%d,%d,%d", &x, &y, &xmax, &ymax) == 4) {
+        w = xmax - x + 1;
+        h = ymax - y + 1;
+    } else if (sscanf (geom, "%dx%d%d%d", &w, &h, &x, &y) != 4 &&
+               sscanf (geom, "%dx%d+%d+%d", &w, &h, &x, &y) != 4) {
+        return false;
+    }
+    if (w <= 0 || h <= 0)
+        return false;
+    roi = ROI (x, x+w, y, y+h);
+    return true;
+}
+
+
+
+int
+Oiiotool::frame_invariant_args (int argc, const char *argv[]) const
+{
+    // As for demand_roi, the position in the argument list identifies
+    // the command; a postponed callback's copied arguments don't.
+    if (! frame_cache || ! m_argv || argv < m_argv || argv >= m_argv + m_argc)
+        return -1;
+    int pos = int(argv - m_argv);
+    for (int i = 0;  i < argc;  ++i)
+        if (frame_cache->varying (pos+i) || strchr (argv[i], '{'))
+            return -1;
+    return pos;
+}
+
+
+
+FrameCache::FrameCache (int argc, const std::vector<int> &sequence_args,
+                        imagesize_t limit)
+    : m_varying (argc+1, false), m_limit(limit), m_bytes(0)
+{
+    m_hits = 0;
+    for (size_t i = 0;  i < sequence_args.size();  ++i)
+        m_varying[sequence_args[i]] = true;
+}
+
+
+
+ImageRecRef
+FrameCache::copy (ImageRec &img)
+{
+    ImageRecRef r (new ImageRec (img, -1, -1, true, true));
+    r->metadata_modified (img.metadata_modified());
+    r->pixels_modified (img.pixels_modified());
+    r->frame_invariant (true);
+    return r;
+}
+
+
+
+bool
+FrameCache::find (int pos, Entry &entry)
+{
+    ImageRecRef result;
+    {
+        spin_lock lock (m_mutex);
+        std::map<int,Entry>::const_iterator found = m_entries.find (pos);
+        if (found == m_entries.end())
+            return false;
+        entry = found->second;
+    }
+    // Entries are never altered once kept, so copying the pixels needs
+    // no lock.
+    entry.result = copy (*entry.result);
+    ++m_hits;
+    return true;
+}
+
+
+
+bool
+FrameCache::insert (int pos, const Entry &entry)
+{
+    // Deep images just aren't worth the trouble of accounting for.
+    imagesize_t bytes = 0;
+    ImageRec &img (*entry.result);
+    for (int s = 0;  s < img.subimages();  ++s) {
+        for (int m = 0;  m < img.miplevels(s);  ++m) {
+            if (img.spec(s,m)->deep)
+                return false;
+            bytes += img.spec(s,m)->image_bytes();
+        }
+    }
+    {
+        spin_lock lock (m_mutex);
+        if (m_entries.count (pos) || m_bytes + bytes > m_limit)
+            return false;
+        m_bytes += bytes;   // Reserve before copying outside the lock
+    }
+    Entry kept (entry);
+    kept.result = copy (img);
+    spin_lock lock (m_mutex);
+    if (! m_entries.insert (std::make_pair (pos, kept)).second) {
+        m_bytes -= bytes;   // Another frame thread kept it first
+        return false;
+    }
+    return true;
+}
+
+
+
+int
+FrameCache::entries () const
+{
+    spin_lock lock (m_mutex);
+    return int(m_entries.size());
+}
+
+
+
+imagesize_t
+FrameCache::bytes () const
+{
+    spin_lock lock (m_mutex);
+    return m_bytes;
+}
+
+
+
 void
 Oiiotool::process_pending ()
 {
@@ -288,6 +614,10 @@ Oiiotool::process_pending ()
 
 
 
+// An error ends the command line being run: the rest of its commands are
+// skipped and it returns a failure status. It does not exit the process,
+// because other frames of a --parallel-frames sequence, background writes,
+// or (with --server) later jobs may still be running or to come.
 void
 Oiiotool::error (string_view command, string_view explanation)
 {
@@ -295,7 +625,16 @@ Oiiotool::error (string_view command, string_view explanation)
     if (explanation.length())
         std::cerr << " : " << explanation;
     std::cerr << "\n";
-    exit (-1);
+    return_value = EXIT_FAILURE;
+    ot_args.ap.abort ();
+}
+
+
+
+void
+OiioTool::read_error (string_view filename, string_view explanation)
+{
+    ot.error (Strutil::format ("read %s", filename), explanation);
 }
 
 
@@ -313,20 +652,20 @@ Oiiotool::warning (string_view command, string_view explanation)
 
 int
 Oiiotool::extract_options (std::map<std::string,std::string> &options,
-                           std::string command)
+                           string_view command)
 {
-    // std::cout << "extract_options '" << command << "'\n";
+    // Scan the ":name=value" pieces in place rather than copying the
+    // rest of the command for each one; only the map entries allocate.
     int noptions = 0;
     size_t pos;
-    while ((pos = command.find_first_of(":")) != std::string::npos) {
-        command = command.substr (pos+1, std::string::npos);
-        size_t e = command.find_first_of("=");
-        if (e != std::string::npos) {
-            std::string name = command.substr(0,e);
-            std::string value = command.substr(e+1,command.find_first_of(":")-(e+1));
+    while ((pos = command.find_first_of(':')) != string_view::npos) {
+        command.remove_prefix (pos+1);
+        size_t e = command.find_first_of('=');
+        if (e != string_view::npos) {
+            string_view name = command.substr (0, e);
+            string_view value = command.substr (e+1, command.find_first_of(':')-(e+1));
             options[name] = value;
             ++noptions;
-            // std::cout << "'" << name << "' -> '" << value << "'\n";
         }
     }
     return noptions;
@@ -339,9 +678,13 @@ static int
 set_threads (int argc, const char *argv[])
 {
     ASSERT (argc == 2);
+    // When frames run in parallel, handle_sequence has already set the
+    // threads once for all of them; they must not resize the shared
+    // thread pool out from under each other.
+    if (ot.parallel_frames > 1)
+        return 0;
     int nthreads = atoi(argv[1]);
     OIIO::attribute ("threads", nthreads);
-    OIIO::attribute ("exr_threads", nthreads);
     return 0;
 }
 
@@ -577,6 +920,12 @@ adjust_output_options (string_view filename,
     spec.erase_attribute ("oiio:SHA-1");
     spec.erase_attribute ("oiio:ConstantColor");
     spec.erase_attribute ("oiio:AverageColor");
+    spec.erase_attribute ("oiio:EnvImportance");
+    spec.erase_attribute ("oiio:MinMaxChannels");
+    spec.erase_attribute ("oiio:SourceHash");
+    spec.erase_attribute ("oiio:ConstantTiles");
+    spec.erase_attribute ("oiio:TileHashes");
+    spec.erase_attribute ("oiio:PixelHash");
 }
 
 
@@ -1614,7 +1963,8 @@ public:
     virtual int impl (ImageBuf **img) {
         return ImageBufAlgo::colorconvert (*img[0], *img[1],
                                            fromspace, tospace, false,
-                                           &ot.colorconfig);
+                                           &ot.colorconfig,
+                                           demand_roi (img[1]->roi()));
     }
     string_view fromspace, tospace;
 };
@@ -1905,10 +2255,10 @@ action_channels (int argc, const char *argv[])
     else if (chanlist == "RGBA")
         chanlist = "R,G,B,A";
 
-    // Decode the channel set, make the full list of ImageSpec's we'll
-    // need to describe the new ImageRec with the altered channels.
+    // Decode the channel set, to check it and count the MIP levels of
+    // the new ImageRec.  Its ImageBufs are left empty, since
+    // IBA::channels sets them up (as views of A when it can).
     std::vector<int> allmiplevels;
-    std::vector<ImageSpec> allspecs;
     for (int s = 0, subimages = ot.allsubimages ? A->subimages() : 1;
          s < subimages;  ++s) {
         std::vector<std::string> newchannelnames;
@@ -1923,18 +2273,11 @@ action_channels (int argc, const char *argv[])
         }
         int miplevels = ot.allsubimages ? A->miplevels(s) : 1;
         allmiplevels.push_back (miplevels);
-        for (int m = 0;  m < miplevels;  ++m) {
-            ImageSpec spec = *A->spec(s,m);
-            spec.nchannels = (int)newchannelnames.size();
-            spec.channelformats.clear();
-            spec.default_channel_names ();
-            allspecs.push_back (spec);
-        }
     }
 
     // Create the replacement ImageRec
     ImageRecRef R (new ImageRec(A->name(), (int)allmiplevels.size(),
-                                &allmiplevels[0], &allspecs[0]));
+                                &allmiplevels[0]));
     ot.push (R);
 
     // Subimage by subimage, MIP level by MIP level, copy/shuffle the
@@ -2320,9 +2663,9 @@ BINARY_IMAGE_COLOR_OP (divc, ImageBufAlgo::div, 1);
 BINARY_IMAGE_COLOR_OP (absdiffc, ImageBufAlgo::absdiff, 0);
 BINARY_IMAGE_COLOR_OP (powc, ImageBufAlgo::pow, 1.0f);
 
-UNARY_IMAGE_OP (abs, ImageBufAlgo::abs);
-UNARY_IMAGE_OP (unpremult, ImageBufAlgo::unpremult);
-UNARY_IMAGE_OP (premult, ImageBufAlgo::premult);
+UNARY_PIXEL_OP (abs, ImageBufAlgo::abs);
+UNARY_PIXEL_OP (unpremult, ImageBufAlgo::unpremult);
+UNARY_PIXEL_OP (premult, ImageBufAlgo::premult);
 
 
 
@@ -3035,8 +3378,10 @@ public:
                       << (filtername.size() ? filtername.c_str() : "default")
                       << " filter\n";
         }
+        // The result was allocated at full size in setup(), but if the
+        // next command crops it, only filter the pixels that survive.
         return ImageBufAlgo::resize (*img[0], *img[1], filtername,
-                                     0.0f, img[0]->roi());
+                                     0.0f, demand_roi (img[0]->roi()));
     }
 };
 
@@ -3915,6 +4260,272 @@ action_histogram (int argc, const char *argv[])
 
 
 
+// Everything needed to write one (non-texture) output file, holding its
+// own copy-on-write copies of the images so that later commands can't
+// disturb it and it can be written by another thread.
+struct OutputJob {
+    std::string command, filename;
+    ImageOutput *out;
+    std::vector<ImageSpec> subimagespecs;              // [subimage]
+    std::vector< std::vector<ImageSpec> > specs;       // [subimage][miplevel]
+    std::vector< std::vector<ImageBufRef> > images;    // [subimage][miplevel]
+    bool adjust_time;
+    std::time_t time;
+    bool opened;
+    std::vector<std::string> errors, warnings;
+    imagesize_t bytes;            // Local pixel memory held by images
+
+    OutputJob () : out(NULL), adjust_time(false), time(0), opened(false),
+                   bytes(0) { }
+    ~OutputJob () { delete out; }
+};
+
+
+
+// Do a and b describe pixel data laid out and encoded the same way?
+static bool
+same_pixel_layout (const ImageSpec &a, const ImageSpec &b)
+{
+    return a.x == b.x && a.y == b.y && a.z == b.z &&
+           a.width == b.width && a.height == b.height && a.depth == b.depth &&
+           a.tile_width == b.tile_width && a.tile_height == b.tile_height &&
+           a.tile_depth == b.tile_depth && a.nchannels == b.nchannels &&
+           a.format == b.format && a.channelformats == b.channelformats &&
+           a.channelnames == b.channelnames &&
+           Strutil::iequals (a.get_string_attribute ("compression"),
+                             b.get_string_attribute ("compression")) &&
+           Strutil::iequals (a.get_string_attribute ("planarconfig"),
+                             b.get_string_attribute ("planarconfig")) &&
+           a.get_int_attribute ("CompressionQuality") ==
+               b.get_int_attribute ("CompressionQuality") &&
+           a.get_int_attribute ("oiio:BitsPerSample") ==
+               b.get_int_attribute ("oiio:BitsPerSample") &&
+           a.get_int_attribute ("oiio:UnassociatedAlpha") ==
+               b.get_int_attribute ("oiio:UnassociatedAlpha");
+}
+
+
+
+// If ib is still just a view of its file through the ImageCache (so no
+// pixel ops have touched it) and spec asks for the same pixel layout
+// and encoding that the file already has, let out copy the pixels
+// straight from the file with copy_image, which for some formats copies
+// the compressed data without decoding it.  Return true if that was
+// attempted, with ok set to whether it succeeded; return false if the
+// caller should write ib the usual way.
+static bool
+copy_file_pixels (ImageOutput *out, const ImageBuf &ib,
+                  const ImageSpec &spec, bool &ok, std::string &err)
+{
+    // Only formats whose copy_image can skip decoding are worth it; the
+    // generic copy_image holds the whole image in memory, which
+    // ImageBuf::write is careful not to do for cached images.
+    string_view fmt (out->format_name());
+    if (fmt != "openexr" && fmt != "tiff" && fmt != "jpeg")
+        return false;
+    if (ib.storage() != ImageBuf::IMAGECACHE || ib.deep() ||
+        ib.name().empty() || ! same_pixel_layout (spec, ib.nativespec()))
+        return false;
+    ImageInput *in = ImageInput::open (ib.name());
+    if (! in)
+        return false;
+    ImageSpec inspec;
+    bool attempted = false;
+    if (in->seek_subimage (ib.subimage(), ib.miplevel(), inspec) &&
+        same_pixel_layout (inspec, ib.nativespec()) &&
+        Strutil::iequals (in->format_name(), out->format_name())) {
+        attempted = true;
+        ok = out->copy_image (in);
+        if (! ok)
+            err = out->geterror();
+    }
+    in->close ();
+    delete in;
+    return attempted;
+}
+
+
+
+// Write the file described by job, recording (not reporting) any errors
+// and warnings, since it may not be running on the thread whose Oiiotool
+// state should hear about them. If peakmem is given -- only by a caller
+// writing on that state's own thread -- sample its peak memory as each
+// level is written.
+static void
+write_output_job (OutputJob &job, Oiiotool *peakmem = NULL)
+{
+    ImageOutput *out = job.out;
+    const std::string &filename (job.filename);
+    int nsubimages = int (job.images.size());
+    ImageOutput::OpenMode mode = ImageOutput::Create;
+    if (nsubimages > 1 && out->supports("multiimage"))
+        job.opened = out->open (filename, nsubimages, &job.subimagespecs[0]);
+    else
+        job.opened = out->open (filename, job.subimagespecs[0], mode);
+    if (! job.opened) {
+        std::string err = out->geterror();
+        job.errors.push_back (err.size() ? err : std::string("unknown error"));
+        return;
+    }
+
+    // Output all the subimages and MIP levels
+    bool ok = true;
+    for (int s = 0;  s < nsubimages;  ++s) {
+        for (int m = 0, mend = int(job.images[s].size());  m < mend && ok;  ++m) {
+            if (s > 0 || m > 0) {  // already opened first subimage/level
+                if (! out->open (filename, job.specs[s][m], mode)) {
+                    std::string err = out->geterror();
+                    job.errors.push_back (err.size() ? err : std::string("unknown error"));
+                    ok = false;
+                    break;
+                }
+            }
+            std::string err;
+            if (copy_file_pixels (out, *job.images[s][m], job.specs[s][m],
+                                  ok, err)) {
+                if (! ok) {
+                    job.errors.push_back (err.size() ? err : std::string("unknown error"));
+                    break;
+                }
+            } else if (! job.images[s][m]->write (out)) {
+                job.errors.push_back (job.images[s][m]->geterror());
+                ok = false;
+                break;
+            }
+            if (peakmem)
+                peakmem->check_peak_memory ();
+            if (mend > 1) {
+                if (out->supports("mipmap")) {
+                    mode = ImageOutput::AppendMIPLevel;  // for next level
+                } else if (out->supports("multiimage")) {
+                    mode = ImageOutput::AppendSubimage;
+                } else {
+                    job.warnings.push_back (Strutil::format ("%s does not support MIP-maps for %s",
+                                                              out->format_name(), filename));
+                    break;
+                }
+            }
+        }
+        mode = ImageOutput::AppendSubimage;  // for next subimage
+        if (nsubimages > 1 && ! out->supports("multiimage")) {
+            job.warnings.push_back (Strutil::format ("%s does not support multiple subimages for %s",
+                                                      out->format_name(), filename));
+            break;
+        }
+    }
+
+    out->close ();
+    delete out;
+    job.out = NULL;
+    // Release the images as soon as they're written
+    job.images.clear ();
+
+    if (job.adjust_time && ok)
+        Filesystem::last_write_time (filename, job.time);
+}
+
+
+
+// Report a finished job's errors and warnings to the calling thread's
+// Oiiotool state.
+static void
+report_output_job (const OutputJob &job)
+{
+    for (size_t i = 0;  i < job.warnings.size();  ++i)
+        ot.warning (job.command, job.warnings[i]);
+    for (size_t i = 0;  i < job.errors.size();  ++i)
+        ot.error (job.command, job.errors[i]);
+}
+
+
+
+// Background writer for --async-write: output jobs are encoded and
+// written by a small pool of its own threads, so compression and disk
+// I/O overlap whatever the command line does next. Queued jobs may only
+// hold so much pixel memory; past that, whoever pushes another job helps
+// write the backlog first.
+class OutputQueue {
+public:
+    OutputQueue () : m_pool(2), m_tasks(&m_pool) { m_bytes = 0; }
+
+    // Queue the job, taking ownership of it.
+    void push (OutputJob *job, imagesize_t maxbytes) {
+        while (m_bytes > 0 && imagesize_t(m_bytes) + job->bytes > maxbytes)
+            help ();
+        {
+            spin_lock lock (m_mutex);
+            m_pending.insert (job->filename);
+        }
+        m_bytes += (long long) job->bytes;
+        m_tasks.push (OIIO::bind (&OutputQueue::run, this, job));
+    }
+
+    // Block until no queued or running job is writing filename.
+    void wait_for (const std::string &filename) {
+        while (pending (filename))
+            help ();
+    }
+
+    // Wait for every job to finish, then report all of their errors and
+    // warnings to the calling thread's Oiiotool state.
+    void finish () {
+        m_tasks.wait ();
+        report ();
+    }
+
+    // Report the errors and warnings of the jobs finished so far.
+    void report () {
+        std::vector<OutputJob *> done;
+        {
+            spin_lock lock (m_mutex);
+            done.swap (m_done);
+        }
+        for (size_t i = 0;  i < done.size();  ++i) {
+            report_output_job (*done[i]);
+            delete done[i];
+        }
+    }
+
+private:
+    void run (OutputJob *job) {
+        imagesize_t bytes = job->bytes;
+        write_output_job (*job);
+        spin_lock lock (m_mutex);
+        m_pending.erase (m_pending.find (job->filename));
+        m_done.push_back (job);
+        m_bytes -= (long long) bytes;
+    }
+
+    bool pending (const std::string &filename) {
+        spin_lock lock (m_mutex);
+        return m_pending.find (filename) != m_pending.end();
+    }
+
+    // Write a queued job in this thread if there is one, else wait a bit.
+    void help () {
+        if (! m_pool.run_one_task ())
+            Sysutil::usleep (1000);
+    }
+
+    thread_pool m_pool;
+    task_set m_tasks;
+    atomic_ll m_bytes;
+    spin_mutex m_mutex;                      // Protects m_pending, m_done
+    std::multiset<std::string> m_pending;    // Files queued or being written
+    std::vector<OutputJob *> m_done;         // Finished, not yet reported
+};
+
+
+
+static OutputQueue &
+output_queue ()
+{
+    static OutputQueue queue;
+    return queue;
+}
+
+
+
 static int
 input_file (int argc, const char *argv[])
 {
@@ -3944,6 +4555,9 @@ input_file (int argc, const char *argv[])
             break;
         }
         Timer timer (ot.enable_function_timing);
+        // Don't read a file that --async-write is still writing
+        if (ot.async_write)
+            output_queue().wait_for (filename);
         int exists = 1;
         // ustring filename (argv[i]);
         if (ot.input_config_set) {
@@ -3974,11 +4588,12 @@ input_file (int argc, const char *argv[])
                 }
                 ot.error ("read", err.size() ? err : "(unknown error)");
             }
-            exit (1);
+            return 0;
         }
         if (ot.debug || ot.verbose)
             std::cout << "Reading " << filename << "\n";
         ot.push (ImageRecRef (new ImageRec (filename, ot.imagecache)));
+        ot.curimg->frame_invariant (ot.frame_invariant_args (1, argv+i) >= 0);
         if (readnow) {
             ot.curimg->read (ReadNoCache);
         }
@@ -4277,6 +4892,7 @@ output_file (int argc, const char *argv[])
     }
 
     if (ot.dryrun) {
+        delete out;
         ot.curimg = saveimg;
         ot.output_dataformat = saved_output_dataformat;
         ot.output_bitspersample = saved_bitspersample;
@@ -4306,10 +4922,24 @@ output_file (int argc, const char *argv[])
                                          configspec, &std::cout);
         if (!ok)
             ot.error (command, "Could not make texture");
+        if (ot.output_adjust_time && ok) {
+            std::string metadatatime = ir->spec(0,0)->get_string_attribute ("DateTime");
+            std::time_t in_time = ir->time();
+            if (! metadatatime.empty())
+                DateTime_to_time_t (metadatatime.c_str(), in_time);
+            Filesystem::last_write_time (filename, in_time);
+        }
 
     } else {
         // Non-texture case
-        std::vector<ImageSpec> subimagespecs (ir->subimages());
+        OutputJob *job = new OutputJob;
+        job->command = command;
+        job->filename = filename;
+        job->out = out;
+        out = NULL;   // the job owns it now
+        job->subimagespecs.resize (ir->subimages());
+        job->specs.resize (ir->subimages());
+        job->images.resize (ir->subimages());
         for (int s = 0;  s < ir->subimages();  ++s) {
             ImageSpec spec = *ir->spec(s,0);
             adjust_output_options (filename, spec, ot, supports_tiles, fileoptions);
@@ -4319,77 +4949,54 @@ output_file (int argc, const char *argv[])
             // If it's not tiled and MIP-mapped, remove any "textureformat"
             if (! spec.tile_pixels() || ir->miplevels(s) <= 1)
                 spec.erase_attribute ("textureformat");
-            subimagespecs[s] = spec;
-        }
-
-        // Do the initial open
-        ImageOutput::OpenMode mode = ImageOutput::Create;
-        if (ir->subimages() > 1 && out->supports("multiimage")) {
-            if (! out->open (filename, ir->subimages(), &subimagespecs[0])) {
-                std::string err = out->geterror();
-                ot.error (command, err.size() ? err.c_str() : "unknown error");
-                return 0;
-            }
-        } else {
-            if (! out->open (filename, subimagespecs[0], mode)) {
-                std::string err = out->geterror();
-                ot.error (command, err.size() ? err.c_str() : "unknown error");
-                return 0;
-            }
-        }
-
-        // Output all the subimages and MIP levels
-        for (int s = 0, send = ir->subimages();  s < send;  ++s) {
-            for (int m = 0, mend = ir->miplevels(s);  m < mend && ok;  ++m) {
+            job->subimagespecs[s] = spec;
+            for (int m = 0, mend = ir->miplevels(s);  m < mend;  ++m) {
                 ImageSpec spec = *ir->spec(s,m);
                 adjust_output_options (filename, spec, ot, supports_tiles, fileoptions);
-                if (s > 0 || m > 0) {  // already opened first subimage/level
-                    if (! out->open (filename, spec, mode)) {
-                        std::string err = out->geterror();
-                        ot.error (command, err.size() ? err.c_str() : "unknown error");
-                        ok = false;
-                        break;
-                    }
-                }
-                if (! (*ir)(s,m).write (out)) {
-                    ot.error (command, (*ir)(s,m).geterror());
-                    ok = false;
-                    break;
-                }
-                ot.check_peak_memory();
-                if (mend > 1) {
-                    if (out->supports("mipmap")) {
-                        mode = ImageOutput::AppendMIPLevel;  // for next level
-                    } else if (out->supports("multiimage")) {
-                        mode = ImageOutput::AppendSubimage;
-                    } else {
-                        ot.warning (command, Strutil::format ("%s does not support MIP-maps for %s",
-                                                               out->format_name(), filename));
-                        break;
-                    }
+                job->specs[s].push_back (spec);
+                ImageBufRef ib;
+                if (ir->subimage_pending (s)) {
+                    // No command ever touched this subimage's pixels, so
+                    // rather than reading them in, write them through the
+                    // cache (or copy them raw, see copy_file_pixels).
+                    ib.reset (new ImageBuf (ir->name(), ot.imagecache));
+                    ib->read (s, m);   // (a failure shows up when written)
+                } else {
+                    // Copy-on-write: shares the pixels unless they change
+                    ib.reset (new ImageBuf ((*ir)(s,m)));
                 }
+                if (ib->localpixels())
+                    job->bytes += ib->spec().image_bytes();
+                job->images[s].push_back (ib);
             }
-            mode = ImageOutput::AppendSubimage;  // for next subimage
-            if (send > 1 && ! out->supports("multiimage")) {
-                ot.warning (command, Strutil::format ("%s does not support multiple subimages for %s",
-                                                       out->format_name(), filename));
-                break;
-            }
+        }
+        if (ot.output_adjust_time) {
+            job->adjust_time = true;
+            std::string metadatatime = ir->spec(0,0)->get_string_attribute ("DateTime");
+            job->time = ir->time();
+            if (! metadatatime.empty())
+                DateTime_to_time_t (metadatatime.c_str(), job->time);
         }
 
-        out->close ();
+        if (ot.async_write) {
+            output_queue().push (job, imagesize_t(ot.async_write_limit) * 1024*1024);
+            output_queue().report ();
+        } else {
+            write_output_job (*job, &ot);
+            report_output_job (*job);
+            bool opened = job->opened;
+            delete job;
+            if (! opened) {
+                ot.curimg = saveimg;
+                ot.output_dataformat = saved_output_dataformat;
+                ot.output_bitspersample = saved_bitspersample;
+                return 0;
+            }
+        }
     }
 
     delete out;
 
-    if (ot.output_adjust_time && ok) {
-        std::string metadatatime = ir->spec(0,0)->get_string_attribute ("DateTime");
-        std::time_t in_time = ir->time();
-        if (! metadatatime.empty())
-            DateTime_to_time_t (metadatatime.c_str(), in_time);
-        Filesystem::last_write_time (filename, in_time);
-    }
-
     ot.check_peak_memory();
     ot.curimg = saveimg;
     ot.output_dataformat = saved_output_dataformat;
@@ -4532,278 +5139,413 @@ print_help (ArgParse &ap)
 
 
 
-static void
+static int
+action_server (int argc, const char *argv[])
+{
+    // main() handles a leading --server; anywhere else it's a mistake.
+    ot.error (argv[0], "must be the first argument");
+    return 0;
+}
+
+
+
+// Parse and run the commands of one command line. Return false if it
+// should go no further: it asked for help, was malformed, or hit an error.
+static bool
 getargs (int argc, char *argv[])
 {
-    bool help = false;
+    bool &help (ot_args.help);
+    help = false;
 
-    bool sansattrib = false;
+    bool &sansattrib (ot_args.sansattrib);
+    sansattrib = false;
     for (int i = 0; i < argc; ++i)
         if (!strcmp(argv[i],"--sansattrib") || !strcmp(argv[i],"-sansattrib"))
             sansattrib = true;
     ot.full_command_line = command_line_string (argc, argv, sansattrib);
 
-    ArgParse ap (argc, (const char **)argv);
-    ap.options ("oiiotool -- simple image processing operations\n"
-                OIIO_INTRO_STRING "\n"
-                "Usage:  oiiotool [filename,option,action]...\n",
-                "%*", input_file, "",
-                "<SEPARATOR>", "Options (general):",
-                "--help", &help, "Print help message",
-                "-v", &ot.verbose, "Verbose status messages",
-                "-q %!", &ot.verbose, "Quiet mode (turn verbose off)",
-                "-n", &ot.dryrun, "No saved output (dry run)",
-                "--debug", &ot.debug, "Debug mode",
-                "--runstats", &ot.runstats, "Print runtime statistics",
-                "-a", &ot.allsubimages, "Do operations on all subimages/miplevels",
-                "--info", &ot.printinfo, "Print resolution and metadata on all inputs",
-                "--metamatch %s", &ot.printinfo_metamatch,
-                    "Regex: which metadata is printed with -info -v",
-                "--no-metamatch %s", &ot.printinfo_nometamatch,
-                    "Regex: which metadata is excluded with -info -v",
-                "--stats", &ot.printstats, "Print pixel statistics on all inputs",
-                "--dumpdata %@", set_dumpdata, NULL, "Print all pixel data values (options: empty=0)",
-                "--hash", &ot.hash, "Print SHA-1 hash of each input image",
-                "--colorcount %@ %s", action_colorcount, NULL,
-                    "Count of how many pixels have the given color (argument: color;color;...) (options: eps=color)",
-                "--rangecheck %@ %s %s", action_rangecheck, NULL, NULL,
-                    "Count of how many pixels are outside the low and high color arguments (each is a comma-separated color value list)",
-//                "-u", &ot.updatemode, "Update mode: skip outputs when the file exists and is newer than all inputs",
-                "--no-clobber", &ot.noclobber, "Do not overwrite existing files",
-                "--noclobber", &ot.noclobber, "", // synonym
-                "--threads %@ %d", set_threads, NULL, "Number of threads (default 0 == #cores)",
-                "--frames %s", NULL, "Frame range for '#' or printf-style wildcards",
-                "--framepadding %d", NULL, "Frame number padding digits (ignored when using printf-style wildcards)",
-                "--views %s", NULL, "Views for %V/%v wildcards (comma-separated, defaults to left,right)",
-                "--wildcardoff", NULL, "Disable numeric wildcard expansion for subsequent command line arguments",
-                "--wildcardon", NULL, "Enable numeric wildcard expansion for subsequent command line arguments",
-                "--no-autopremult %@", unset_autopremult, NULL, "Turn off automatic premultiplication of images with unassociated alpha",
-                "--autopremult %@", set_autopremult, NULL, "Turn on automatic premultiplication of images with unassociated alpha",
-                "--autoorient", &ot.autoorient, "Automatically --reorient all images upon input",
-                "--auto-orient", &ot.autoorient, "", // symonym for --autoorient
-                "--autocc", &ot.autocc, "Automatically color convert based on filename",
-                "--noautocc %!", &ot.autocc, "Turn off automatic color conversion",
-                "--native %@", set_native, &ot.nativeread, "Keep native pixel data type (bypass cache if necessary)",
-                "--cache %@ %d", set_cachesize, &ot.cachesize, "ImageCache size (in MB: default=4096)",
-                "--autotile %@ %d", set_autotile, &ot.autotile, "Autotile size for cached images (default=4096)",
-                "<SEPARATOR>", "Commands that read images:",
-                "-i %@ %s", input_file, NULL, "Input file (argument: filename) (options: now=0:printinfo=0:autocc=0)",
-                "--iconfig %@ %s %s", set_input_attribute, NULL, NULL, "Sets input config attribute (name, value) (options: type=...)",
-                "<SEPARATOR>", "Commands that write images:",
-                "-o %@ %s", output_file, NULL, "Output the current image to the named file",
-                "-otex %@ %s", output_file, NULL, "Output the current image as a texture",
-                "-oenv %@ %s", output_file, NULL, "Output the current image as a latlong env map",
-                "<SEPARATOR>", "Options that affect subsequent image output:",
-                "-d %@ %s", set_dataformat, NULL,
-                    "'-d TYPE' sets the output data format of all channels, "
-                    "'-d CHAN=TYPE' overrides a single named channel (multiple -d args are allowed). "
-                    "Data types include: uint8, sint8, uint10, uint12, uint16, sint16, uint32, sint32, half, float, double",
-                "--scanline", &ot.output_scanline, "Output scanline images",
-                "--tile %@ %d %d", output_tiles, &ot.output_tilewidth, &ot.output_tileheight,
-                    "Output tiled images (tilewidth, tileheight)",
-                "--force-tiles", &ot.output_force_tiles, "", // undocumented
-                "--compression %s", &ot.output_compression, "Set the compression method",
-                "--quality %d", &ot.output_quality, "Set the compression quality, 1-100",
-                "--dither", &ot.output_dither, "Add dither to 8-bit output",
-                "--planarconfig %s", &ot.output_planarconfig,
-                    "Force planarconfig (contig, separate, default)",
-                "--adjust-time", &ot.output_adjust_time,
-                    "Adjust file times to match DateTime metadata",
-                "--noautocrop %!", &ot.output_autocrop, 
-                    "Do not automatically crop images whose formats don't support separate pixel data and full/display windows",
-                "--autotrim", &ot.output_autotrim, 
-                    "Automatically trim black borders upon output to file formats that support separate pixel data and full/display windows",
-                "<SEPARATOR>", "Options that change current image metadata (but not pixel values):",
-                "--attrib %@ %s %s", set_any_attribute, NULL, NULL, "Sets metadata attribute (name, value) (options: type=...)",
-                "--sattrib %@ %s %s", set_string_attribute, NULL, NULL, "Sets string metadata attribute (name, value)",
-                "--caption %@ %s", set_caption, NULL, "Sets caption (ImageDescription metadata)",
-                "--keyword %@ %s", set_keyword, NULL, "Add a keyword",
-                "--clear-keywords %@", clear_keywords, NULL, "Clear all keywords",
-                "--nosoftwareattrib", &ot.metadata_nosoftwareattrib, "Do not write command line into Exif:ImageHistory, Software metadata attributes",
-                "--sansattrib", &sansattrib, "Write command line into Software & ImageHistory but remove --sattrib and --attrib options",
-                "--orientation %@ %d", set_orientation, NULL, "Set the assumed orientation",
-                "--orientcw %@", rotate_orientation, NULL, "Rotate orientation metadata 90 deg clockwise",
-                "--orientccw %@", rotate_orientation, NULL, "Rotate orientation metadata 90 deg counter-clockwise",
-                "--orient180 %@", rotate_orientation, NULL, "Rotate orientation metadata 180 deg",
-                "--rotcw %@", rotate_orientation, NULL, "", // DEPRECATED(1.5), back compatibility
-                "--rotccw %@", rotate_orientation, NULL, "", // DEPRECATED(1.5), back compatibility
-                "--rot180 %@", rotate_orientation, NULL, "", // DEPRECATED(1.5), back compatibility
-                "--origin %@ %s", set_origin, NULL,
-                    "Set the pixel data window origin (e.g. +20+10)",
-                "--fullsize %@ %s", set_fullsize, NULL, "Set the display window (e.g., 1920x1080, 1024x768+100+0, -20-30)",
-                "--fullpixels %@", set_full_to_pixels, NULL, "Set the 'full' image range to be the pixel data window",
-                "--chnames %@ %s", set_channelnames, NULL,
-                    "Set the channel names (comma-separated)",
-                "<SEPARATOR>", "Options that affect subsequent actions:",
-                "--fail %g", &ot.diff_failthresh, "Failure threshold difference (0.000001)",
-                "--failpercent %g", &ot.diff_failpercent, "Allow this percentage of failures in diff (0)",
-                "--hardfail %g", &ot.diff_hardfail, "Fail diff if any one pixel exceeds this error (infinity)",
-                "--warn %g", &ot.diff_warnthresh, "Warning threshold difference (0.00001)",
-                "--warnpercent %g", &ot.diff_warnpercent, "Allow this percentage of warnings in diff (0)",
-                "--hardwarn %g", &ot.diff_hardwarn, "Warn if any one pixel difference exceeds this error (infinity)",
-                "<SEPARATOR>", "Actions:",
-                "--create %@ %s %d", action_create, NULL, NULL,
-                        "Create a blank image (args: geom, channels)",
-                "--pattern %@ %s %s %d", action_pattern, NULL, NULL, NULL,
-                        "Create a patterned image (args: pattern, geom, channels). Patterns: black, fill, checker, noise",
-                "--kernel %@ %s %s", action_kernel, NULL, NULL,
-                        "Create a centered convolution kernel (args: name, geom)",
-                "--capture %@", action_capture, NULL,
-                        "Capture an image (options: camera=%d)",
-                "--diff %@", action_diff, NULL, "Print report on the difference of two images (modified by --fail, --failpercent, --hardfail, --warn, --warnpercent --hardwarn)",
-                "--pdiff %@", action_pdiff, NULL, "Print report on the perceptual difference of two images (modified by --fail, --failpercent, --hardfail, --warn, --warnpercent --hardwarn)",
-                "--add %@", action_add, NULL, "Add two images",
-                "--addc %s %@", action_addc, NULL, "Add to all channels a scalar or per-channel constants (e.g.: 0.5 or 1,1.25,0.5)",
-                "--cadd %s %@", action_addc, NULL, "", // Deprecated synonym
-                "--sub %@", action_sub, NULL, "Subtract two images",
-                "--subc %s %@", action_subc, NULL, "Subtract from all channels a scalar or per-channel constants (e.g.: 0.5 or 1,1.25,0.5)",
-                "--csub %s %@", action_subc, NULL, "", // Deprecated synonym
-                "--mul %@", action_mul, NULL, "Multiply two images",
-                "--mulc %s %@", action_mulc, NULL, "Multiply the image values by a scalar or per-channel constants (e.g.: 0.5 or 1,1.25,0.5)",
-                "--cmul %s %@", action_mulc, NULL, "", // Deprecated synonym
-                "--div %@", action_div, NULL, "Divide first image by second image",
-                "--divc %s %@", action_divc, NULL, "Divide the image values by a scalar or per-channel constants (e.g.: 0.5 or 1,1.25,0.5)",
-                "--mad %@", action_mad, NULL, "Multiply two images, add a third",
-                "--invert %@", action_invert, NULL, "Take the color inverse (subtract from 1)",
-                "--abs %@", action_abs, NULL, "Take the absolute value of the image pixels",
-                "--absdiff %@", action_absdiff, NULL, "Absolute difference between two images",
-                "--absdiffc %s %@", action_absdiffc, NULL, "Absolute difference versus a scalar or per-channel constant (e.g.: 0.5 or 1,1.25,0.5)",
-                "--powc %s %@", action_powc, NULL, "Raise the image values to a scalar or per-channel power (e.g.: 2.2 or 2.2,2.2,2.2,1.0)",
-                "--cpow %s %@", action_powc, NULL, "", // Depcrcated synonym
-                "--noise %@", action_noise, NULL, "Add noise to an image (options: type=gaussian:mean=0:stddev=0.1, type=uniform:min=0:max=0.1, type=salt:value=0:portion=0.1, seed=0",
-                "--chsum %@", action_chsum, NULL,
-                    "Turn into 1-channel image by summing channels (options: weight=r,g,...)",
-                "--crop %@ %s", action_crop, NULL, "Set pixel data resolution and offset, cropping or padding if necessary (WxH+X+Y or xmin,ymin,xmax,ymax)",
-                "--croptofull %@", action_croptofull, NULL, "Crop or pad to make pixel data region match the \"full\" region",
-                "--trim %@", action_trim, NULL, "Crop to the minimal ROI containing nonzero pixel values",
-                "--cut %@ %s", action_cut, NULL, "Cut out the ROI and reposition to the origin (WxH+X+Y or xmin,ymin,xmax,ymax)",
-                "--paste %@ %s", action_paste, NULL, "Paste fg over bg at the given position (e.g., +100+50)",
-                "--mosaic %@ %s", action_mosaic, NULL,
-                        "Assemble images into a mosaic (arg: WxH; options: pad=0)",
-                "--over %@", action_over, NULL, "'Over' composite of two images",
-                "--zover %@", action_zover, NULL, "Depth composite two images with Z channels (options: zeroisinf=%d)",
-                "--deepmerge %@", action_deepmerge, NULL, "Merge/composite two deep images",
-                "--histogram %@ %s %d", action_histogram, NULL, NULL, "Histogram one channel (options: cumulative=0)",
-                "--rotate90 %@", action_rotate90, NULL, "Rotate the image 90 degrees clockwise",
-                "--rotate180 %@", action_rotate180, NULL, "Rotate the image 180 degrees",
-                "--flipflop %@", action_rotate180, NULL, "", // Deprecated synonym for --rotate180
-                "--rotate270 %@", action_rotate270, NULL, "Rotate the image 270 degrees clockwise (or 90 degrees CCW)",
-                "--flip %@", action_flip, NULL, "Flip the image vertically (top<->bottom)",
-                "--flop %@", action_flop, NULL, "Flop the image horizontally (left<->right)",
-                "--reorient %@", action_reorient, NULL, "Rotate and/or flop the image to transform the pixels to match the Orientation metadata",
-                "--transpose %@", action_transpose, NULL, "Transpose the image",
-                "--cshift %@ %s", action_cshift, NULL, "Circular shift the image (e.g.: +20-10)",
-                "--resample %@ %s", action_resample, NULL, "Resample (640x480, 50%)",
-                "--resize %@ %s", action_resize, NULL, "Resize (640x480, 50%) (options: filter=%s)",
-                "--fit %@ %s", action_fit, NULL, "Resize to fit within a window size (options: filter=%s, pad=%d)",
-                "--pixelaspect %@ %g", action_pixelaspect, NULL, "Scale up the image's width or height to match the given pixel aspect ratio (options: filter=%s)",
-                "--rotate %@ %g", action_rotate, NULL, "Rotate pixels (argument is degrees clockwise) around the center of the display window (options: filter=%s, center=%f,%f, recompute_roi=%d",
-                "--warp %@ %s", action_warp, NULL, "Warp pixels (argument is a 3x3 matrix, separated by commas) (options: filter=%s, recompute_roi=%d)",
-                "--convolve %@", action_convolve, NULL,
-                    "Convolve with a kernel",
-                "--blur %@ %s", action_blur, NULL,
-                    "Blur the image (arg: WxH; options: kernel=name)",
-                "--median %@ %s", action_median, NULL,
-                    "Median filter the image (arg: WxH)",
-                "--dilate %@ %s", action_dilate, NULL,
-                    "Dilate (area maximum) the image (arg: WxH)",
-                "--erode %@ %s", action_erode, NULL,
-                    "Erode (area minimum) the image (arg: WxH)",
-                "--unsharp %@", action_unsharp, NULL,
-                    "Unsharp mask (options: kernel=gaussian, width=3, contrast=1, threshold=0)",
-                "--laplacian %@", action_laplacian, NULL,
-                    "Laplacian filter the image",
-                "--fft %@", action_fft, NULL,
-                    "Take the FFT of the image",
-                "--ifft %@", action_ifft, NULL,
-                    "Take the inverse FFT of the image",
-                "--polar %@", action_polar, NULL,
-                    "Convert complex (real,imag) to polar (amplitude,phase)",
-                "--unpolar %@", action_unpolar, NULL,
-                    "Convert polar (amplitude,phase) to complex (real,imag)",
-                "--fixnan %@ %s", action_fixnan, NULL, "Fix NaN/Inf values in the image (options: none, black, box3, error)",
-                "--fillholes %@", action_fillholes, NULL,
-                    "Fill in holes (where alpha is not 1)",
-                "--clamp %@", action_clamp, NULL, "Clamp values (options: min=..., max=..., clampalpha=0)",
-                "--rangecompress %@", action_rangecompress, NULL,
-                    "Compress the range of pixel values with a log scale (options: luma=0|1)",
-                "--rangeexpand %@", action_rangeexpand, NULL,
-                    "Un-rangecompress pixel values back to a linear scale (options: luma=0|1)",
-                "--line %@ %s", action_line, NULL,
-                    "Render a poly-line (args: x1,y1,x2,y2... ; options: color=)",
-                "--box %@ %s", action_box, NULL,
-                    "Render a box (args: x1,y1,x2,y2 ; options: color=)",
-                "--fill %@ %s", action_fill, NULL, "Fill a region (options: color=)",
-                "--text %@ %s", action_text, NULL,
-                    "Render text into the current image (options: x=, y=, size=, color=)",
-                // "--noise_uniform %@", action_noise_uniform, NULL, "Add uniform noise to the image (options: min=, max=)",
-                // "--noise_gaussian %@", action_noise_gaussian, NULL, "Add Gaussian noise to the image (options: mean=, stddev=)",
-                // "--noise_salt %@", action_noise_saltpepp, NULL, "Add 'salt & pepper' noise to the image (options: min=, max=)",
-                "<SEPARATOR>", "Manipulating channels or subimages:",
-                "--ch %@ %s", action_channels, NULL,
-                    "Select or shuffle channels (e.g., \"R,G,B\", \"B,G,R\", \"2,3,4\")",
-                "--chappend %@", action_chappend, NULL,
-                    "Append the channels of the last two images",
-                "--unmip %@", action_unmip, NULL, "Discard all but the top level of a MIPmap",
-                "--selectmip %@ %d", action_selectmip, NULL,
-                    "Select just one MIP level (0 = highest res)",
-                "--subimage %@ %s", action_select_subimage, NULL, "Select just one subimage (by index or name)",
-                "--sisplit %@", action_subimage_split, NULL,
-                    "Split the top image's subimges into separate images",
-                "--siappend %@", action_subimage_append, NULL,
-                    "Append the last two images into one multi-subimage image",
-                "--siappendall %@", action_subimage_append_all, NULL,
-                    "Append all images on the stack into a single multi-subimage image",
-                "--deepen %@", action_deepen, NULL, "Deepen normal 2D image to deep",
-                "--flatten %@", action_flatten, NULL, "Flatten deep image to non-deep",
-                "<SEPARATOR>", "Image stack manipulation:",
-                "--dup %@", action_dup, NULL,
-                    "Duplicate the current image (push a copy onto the stack)",
-                "--swap %@", action_swap, NULL,
-                    "Swap the top two images on the stack.",
-                "--pop %@", action_pop, NULL,
-                    "Throw away the current image",
-                "--label %@ %s", action_label, NULL,
-                    "Label the top image",
-                "<SEPARATOR>", "Color management:",
-                "--colorconfig %@ %s", set_colorconfig, NULL,
-                    "Explicitly specify an OCIO configuration file",
-                "--iscolorspace %@ %s", set_colorspace, NULL,
-                    "Set the assumed color space (without altering pixels)",
-                "--tocolorspace %@ %s", action_tocolorspace, NULL,
-                    "Convert the current image's pixels to a named color space",
-                "--colorconvert %@ %s %s", action_colorconvert, NULL, NULL,
-                    "Convert pixels from 'src' to 'dst' color space (without regard to its previous interpretation)",
-                "--ociolook %@ %s", action_ociolook, NULL,
-                    "Apply the named OCIO look (options: from=, to=, inverse=, key=, value=)",
-                "--ociodisplay %@ %s %s", action_ociodisplay, NULL, NULL,
-                    "Apply the named OCIO display and view (options: from=, looks=, key=, value=)",
-                "--ociofiletransform %@ %s", action_ociofiletransform, NULL,
-                    "Apply the named OCIO filetransform (options: inverse=)",
-                "--unpremult %@", action_unpremult, NULL,
-                    "Divide all color channels of the current image by the alpha to \"un-premultiply\"",
-                "--premult %@", action_premult, NULL,
-                    "Multiply all color channels of the current image by the alpha",
-                NULL);
+    ArgParse &ap (ot_args.ap);
+    ot.set_command_line (argc, (const char **)argv);
+    if (! ot_args.ready) {
+        ap.options ("oiiotool -- simple image processing operations\n"
+                    OIIO_INTRO_STRING "\n"
+                    "Usage:  oiiotool [filename,option,action]...\n",
+                    "%*", input_file, "",
+                    "<SEPARATOR>", "Options (general):",
+                    "--help", &help, "Print help message",
+                    "-v", &ot.verbose, "Verbose status messages",
+                    "-q %!", &ot.verbose, "Quiet mode (turn verbose off)",
+                    "-n", &ot.dryrun, "No saved output (dry run)",
+                    "--debug", &ot.debug, "Debug mode",
+                    "--runstats", &ot.runstats, "Print runtime statistics",
+                    "--server %@ %s", action_server, NULL, "Serve command lines sent to this local socket (must be the first argument)",
+                    "--profile %s", &ot.profile_file, "Write per-command time, memory, pixel and tile miss profile to a file (.json for a Chrome trace, '-' for a table on stdout)",
+                    "-a", &ot.allsubimages, "Do operations on all subimages/miplevels",
+                    "--info", &ot.printinfo, "Print resolution and metadata on all inputs",
+                    "--metamatch %s", &ot.printinfo_metamatch,
+                        "Regex: which metadata is printed with -info -v",
+                    "--no-metamatch %s", &ot.printinfo_nometamatch,
+                        "Regex: which metadata is excluded with -info -v",
+                    "--stats", &ot.printstats, "Print pixel statistics on all inputs",
+                    "--dumpdata %@", set_dumpdata, NULL, "Print all pixel data values (options: empty=0)",
+                    "--hash", &ot.hash, "Print SHA-1 hash of each input image",
+                    "--colorcount %@ %s", action_colorcount, NULL,
+                        "Count of how many pixels have the given color (argument: color;color;...) (options: eps=color)",
+                    "--rangecheck %@ %s %s", action_rangecheck, NULL, NULL,
+                        "Count of how many pixels are outside the low and high color arguments (each is a comma-separated color value list)",
+    //                "-u", &ot.updatemode, "Update mode: skip outputs when the file exists and is newer than all inputs",
+                    "--no-clobber", &ot.noclobber, "Do not overwrite existing files",
+                    "--noclobber", &ot.noclobber, "", // synonym
+                    "--threads %@ %d", set_threads, NULL, "Number of threads (default 0 == #cores)",
+                    "--frames %s", NULL, "Frame range for '#' or printf-style wildcards",
+                    "--framepadding %d", NULL, "Frame number padding digits (ignored when using printf-style wildcards)",
+                    "--views %s", NULL, "Views for %V/%v wildcards (comma-separated, defaults to left,right)",
+                    "--parallel-frames %d", NULL, "Number of frames of a sequence to process concurrently (default 1)",
+                    "--frame-cache %d", NULL, "Memory (in MB) for results of commands that are the same in every frame of a sequence (default=1024, 0 disables)",
+                    "--wildcardoff", NULL, "Disable numeric wildcard expansion for subsequent command line arguments",
+                    "--wildcardon", NULL, "Enable numeric wildcard expansion for subsequent command line arguments",
+                    "--no-autopremult %@", unset_autopremult, NULL, "Turn off automatic premultiplication of images with unassociated alpha",
+                    "--autopremult %@", set_autopremult, NULL, "Turn on automatic premultiplication of images with unassociated alpha",
+                    "--autoorient", &ot.autoorient, "Automatically --reorient all images upon input",
+                    "--auto-orient", &ot.autoorient, "", // symonym for --autoorient
+                    "--autocc", &ot.autocc, "Automatically color convert based on filename",
+                    "--noautocc %!", &ot.autocc, "Turn off automatic color conversion",
+                    "--native %@", set_native, &ot.nativeread, "Keep native pixel data type (bypass cache if necessary)",
+                    "--cache %@ %d", set_cachesize, &ot.cachesize, "ImageCache size (in MB: default=4096)",
+                    "--autotile %@ %d", set_autotile, &ot.autotile, "Autotile size for cached images (default=4096)",
+                    "<SEPARATOR>", "Commands that read images:",
+                    "-i %@ %s", input_file, NULL, "Input file (argument: filename) (options: now=0:printinfo=0:autocc=0)",
+                    "--iconfig %@ %s %s", set_input_attribute, NULL, NULL, "Sets input config attribute (name, value) (options: type=...)",
+                    "<SEPARATOR>", "Commands that write images:",
+                    "-o %@ %s", output_file, NULL, "Output the current image to the named file",
+                    "-otex %@ %s", output_file, NULL, "Output the current image as a texture",
+                    "-oenv %@ %s", output_file, NULL, "Output the current image as a latlong env map",
+                    "--async-write", &ot.async_write, "Write subsequent (non-texture) outputs in the background",
+                    "--async-write-limit %d", &ot.async_write_limit, "Pixel memory (in MB) that queued background writes may hold (default=1024)",
+                    "<SEPARATOR>", "Options that affect subsequent image output:",
+                    "-d %@ %s", set_dataformat, NULL,
+                        "'-d TYPE' sets the output data format of all channels, "
+                        "'-d CHAN=TYPE' overrides a single named channel (multiple -d args are allowed). "
+                        "Data types include: uint8, sint8, uint10, uint12, uint16, sint16, uint32, sint32, half, float, double",
+                    "--scanline", &ot.output_scanline, "Output scanline images",
+                    "--tile %@ %d %d", output_tiles, &ot.output_tilewidth, &ot.output_tileheight,
+                        "Output tiled images (tilewidth, tileheight)",
+                    "--force-tiles", &ot.output_force_tiles, "", // undocumented
+                    "--compression %s", &ot.output_compression, "Set the compression method",
+                    "--quality %d", &ot.output_quality, "Set the compression quality, 1-100",
+                    "--dither", &ot.output_dither, "Add dither to 8-bit output",
+                    "--planarconfig %s", &ot.output_planarconfig,
+                        "Force planarconfig (contig, separate, default)",
+                    "--adjust-time", &ot.output_adjust_time,
+                        "Adjust file times to match DateTime metadata",
+                    "--noautocrop %!", &ot.output_autocrop, 
+                        "Do not automatically crop images whose formats don't support separate pixel data and full/display windows",
+                    "--autotrim", &ot.output_autotrim, 
+                        "Automatically trim black borders upon output to file formats that support separate pixel data and full/display windows",
+                    "<SEPARATOR>", "Options that change current image metadata (but not pixel values):",
+                    "--attrib %@ %s %s", set_any_attribute, NULL, NULL, "Sets metadata attribute (name, value) (options: type=...)",
+                    "--sattrib %@ %s %s", set_string_attribute, NULL, NULL, "Sets string metadata attribute (name, value)",
+                    "--caption %@ %s", set_caption, NULL, "Sets caption (ImageDescription metadata)",
+                    "--keyword %@ %s", set_keyword, NULL, "Add a keyword",
+                    "--clear-keywords %@", clear_keywords, NULL, "Clear all keywords",
+                    "--nosoftwareattrib", &ot.metadata_nosoftwareattrib, "Do not write command line into Exif:ImageHistory, Software metadata attributes",
+                    "--sansattrib", &sansattrib, "Write command line into Software & ImageHistory but remove --sattrib and --attrib options",
+                    "--orientation %@ %d", set_orientation, NULL, "Set the assumed orientation",
+                    "--orientcw %@", rotate_orientation, NULL, "Rotate orientation metadata 90 deg clockwise",
+                    "--orientccw %@", rotate_orientation, NULL, "Rotate orientation metadata 90 deg counter-clockwise",
+                    "--orient180 %@", rotate_orientation, NULL, "Rotate orientation metadata 180 deg",
+                    "--rotcw %@", rotate_orientation, NULL, "", // DEPRECATED(1.5), back compatibility
+                    "--rotccw %@", rotate_orientation, NULL, "", // DEPRECATED(1.5), back compatibility
+                    "--rot180 %@", rotate_orientation, NULL, "", // DEPRECATED(1.5), back compatibility
+                    "--origin %@ %s", set_origin, NULL,
+                        "Set the pixel data window origin (e.g. +20+10)",
+                    "--fullsize %@ %s", set_fullsize, NULL, "Set the display window (e.g., 1920x1080, 1024x768+100+0, -20-30)",
+                    "--fullpixels %@", set_full_to_pixels, NULL, "Set the 'full' image range to be the pixel data window",
+                    "--chnames %@ %s", set_channelnames, NULL,
+                        "Set the channel names (comma-separated)",
+                    "<SEPARATOR>", "Options that affect subsequent actions:",
+                    "--fail %g", &ot.diff_failthresh, "Failure threshold difference (0.000001)",
+                    "--failpercent %g", &ot.diff_failpercent, "Allow this percentage of failures in diff (0)",
+                    "--hardfail %g", &ot.diff_hardfail, "Fail diff if any one pixel exceeds this error (infinity)",
+                    "--warn %g", &ot.diff_warnthresh, "Warning threshold difference (0.00001)",
+                    "--warnpercent %g", &ot.diff_warnpercent, "Allow this percentage of warnings in diff (0)",
+                    "--hardwarn %g", &ot.diff_hardwarn, "Warn if any one pixel difference exceeds this error (infinity)",
+                    "<SEPARATOR>", "Actions:",
+                    "--create %@ %s %d", action_create, NULL, NULL,
+                            "Create a blank image (args: geom, channels)",
+                    "--pattern %@ %s %s %d", action_pattern, NULL, NULL, NULL,
+                            "Create a patterned image (args: pattern, geom, channels). Patterns: black, fill, checker, noise",
+                    "--kernel %@ %s %s", action_kernel, NULL, NULL,
+                            "Create a centered convolution kernel (args: name, geom)",
+                    "--capture %@", action_capture, NULL,
+                            "Capture an image (options: camera=%d)",
+                    "--diff %@", action_diff, NULL, "Print report on the difference of two images (modified by --fail, --failpercent, --hardfail, --warn, --warnpercent --hardwarn)",
+                    "--pdiff %@", action_pdiff, NULL, "Print report on the perceptual difference of two images (modified by --fail, --failpercent, --hardfail, --warn, --warnpercent --hardwarn)",
+                    "--add %@", action_add, NULL, "Add two images",
+                    "--addc %s %@", action_addc, NULL, "Add to all channels a scalar or per-channel constants (e.g.: 0.5 or 1,1.25,0.5)",
+                    "--cadd %s %@", action_addc, NULL, "", // Deprecated synonym
+                    "--sub %@", action_sub, NULL, "Subtract two images",
+                    "--subc %s %@", action_subc, NULL, "Subtract from all channels a scalar or per-channel constants (e.g.: 0.5 or 1,1.25,0.5)",
+                    "--csub %s %@", action_subc, NULL, "", // Deprecated synonym
+                    "--mul %@", action_mul, NULL, "Multiply two images",
+                    "--mulc %s %@", action_mulc, NULL, "Multiply the image values by a scalar or per-channel constants (e.g.: 0.5 or 1,1.25,0.5)",
+                    "--cmul %s %@", action_mulc, NULL, "", // Deprecated synonym
+                    "--div %@", action_div, NULL, "Divide first image by second image",
+                    "--divc %s %@", action_divc, NULL, "Divide the image values by a scalar or per-channel constants (e.g.: 0.5 or 1,1.25,0.5)",
+                    "--mad %@", action_mad, NULL, "Multiply two images, add a third",
+                    "--invert %@", action_invert, NULL, "Take the color inverse (subtract from 1)",
+                    "--abs %@", action_abs, NULL, "Take the absolute value of the image pixels",
+                    "--absdiff %@", action_absdiff, NULL, "Absolute difference between two images",
+                    "--absdiffc %s %@", action_absdiffc, NULL, "Absolute difference versus a scalar or per-channel constant (e.g.: 0.5 or 1,1.25,0.5)",
+                    "--powc %s %@", action_powc, NULL, "Raise the image values to a scalar or per-channel power (e.g.: 2.2 or 2.2,2.2,2.2,1.0)",
+                    "--cpow %s %@", action_powc, NULL, "", // Depcrcated synonym
+                    "--noise %@", action_noise, NULL, "Add noise to an image (options: type=gaussian:mean=0:stddev=0.1, type=uniform:min=0:max=0.1, type=salt:value=0:portion=0.1, seed=0",
+                    "--chsum %@", action_chsum, NULL,
+                        "Turn into 1-channel image by summing channels (options: weight=r,g,...)",
+                    "--crop %@ %s", action_crop, NULL, "Set pixel data resolution and offset, cropping or padding if necessary (WxH+X+Y or xmin,ymin,xmax,ymax)",
+                    "--croptofull %@", action_croptofull, NULL, "Crop or pad to make pixel data region match the \"full\" region",
+                    "--trim %@", action_trim, NULL, "Crop to the minimal ROI containing nonzero pixel values",
+                    "--cut %@ %s", action_cut, NULL, "Cut out the ROI and reposition to the origin (WxH+X+Y or xmin,ymin,xmax,ymax)",
+                    "--paste %@ %s", action_paste, NULL, "Paste fg over bg at the given position (e.g., +100+50)",
+                    "--mosaic %@ %s", action_mosaic, NULL,
+                            "Assemble images into a mosaic (arg: WxH; options: pad=0)",
+                    "--over %@", action_over, NULL, "'Over' composite of two images",
+                    "--zover %@", action_zover, NULL, "Depth composite two images with Z channels (options: zeroisinf=%d)",
+                    "--deepmerge %@", action_deepmerge, NULL, "Merge/composite two deep images",
+                    "--histogram %@ %s %d", action_histogram, NULL, NULL, "Histogram one channel (options: cumulative=0)",
+                    "--rotate90 %@", action_rotate90, NULL, "Rotate the image 90 degrees clockwise",
+                    "--rotate180 %@", action_rotate180, NULL, "Rotate the image 180 degrees",
+                    "--flipflop %@", action_rotate180, NULL, "", // Deprecated synonym for --rotate180
+                    "--rotate270 %@", action_rotate270, NULL, "Rotate the image 270 degrees clockwise (or 90 degrees CCW)",
+                    "--flip %@", action_flip, NULL, "Flip the image vertically (top<->bottom)",
+                    "--flop %@", action_flop, NULL, "Flop the image horizontally (left<->right)",
+                    "--reorient %@", action_reorient, NULL, "Rotate and/or flop the image to transform the pixels to match the Orientation metadata",
+                    "--transpose %@", action_transpose, NULL, "Transpose the image",
+                    "--cshift %@ %s", action_cshift, NULL, "Circular shift the image (e.g.: +20-10)",
+                    "--resample %@ %s", action_resample, NULL, "Resample (640x480, 50%)",
+                    "--resize %@ %s", action_resize, NULL, "Resize (640x480, 50%) (options: filter=%s)",
+                    "--fit %@ %s", action_fit, NULL, "Resize to fit within a window size (options: filter=%s, pad=%d)",
+                    "--pixelaspect %@ %g", action_pixelaspect, NULL, "Scale up the image's width or height to match the given pixel aspect ratio (options: filter=%s)",
+                    "--rotate %@ %g", action_rotate, NULL, "Rotate pixels (argument is degrees clockwise) around the center of the display window (options: filter=%s, center=%f,%f, recompute_roi=%d",
+                    "--warp %@ %s", action_warp, NULL, "Warp pixels (argument is a 3x3 matrix, separated by commas) (options: filter=%s, recompute_roi=%d)",
+                    "--convolve %@", action_convolve, NULL,
+                        "Convolve with a kernel",
+                    "--blur %@ %s", action_blur, NULL,
+                        "Blur the image (arg: WxH; options: kernel=name)",
+                    "--median %@ %s", action_median, NULL,
+                        "Median filter the image (arg: WxH)",
+                    "--dilate %@ %s", action_dilate, NULL,
+                        "Dilate (area maximum) the image (arg: WxH)",
+                    "--erode %@ %s", action_erode, NULL,
+                        "Erode (area minimum) the image (arg: WxH)",
+                    "--unsharp %@", action_unsharp, NULL,
+                        "Unsharp mask (options: kernel=gaussian, width=3, contrast=1, threshold=0)",
+                    "--laplacian %@", action_laplacian, NULL,
+                        "Laplacian filter the image",
+                    "--fft %@", action_fft, NULL,
+                        "Take the FFT of the image",
+                    "--ifft %@", action_ifft, NULL,
+                        "Take the inverse FFT of the image",
+                    "--polar %@", action_polar, NULL,
+                        "Convert complex (real,imag) to polar (amplitude,phase)",
+                    "--unpolar %@", action_unpolar, NULL,
+                        "Convert polar (amplitude,phase) to complex (real,imag)",
+                    "--fixnan %@ %s", action_fixnan, NULL, "Fix NaN/Inf values in the image (options: none, black, box3, error)",
+                    "--fillholes %@", action_fillholes, NULL,
+                        "Fill in holes (where alpha is not 1)",
+                    "--clamp %@", action_clamp, NULL, "Clamp values (options: min=..., max=..., clampalpha=0)",
+                    "--rangecompress %@", action_rangecompress, NULL,
+                        "Compress the range of pixel values with a log scale (options: luma=0|1)",
+                    "--rangeexpand %@", action_rangeexpand, NULL,
+                        "Un-rangecompress pixel values back to a linear scale (options: luma=0|1)",
+                    "--line %@ %s", action_line, NULL,
+                        "Render a poly-line (args: x1,y1,x2,y2... ; options: color=)",
+                    "--box %@ %s", action_box, NULL,
+                        "Render a box (args: x1,y1,x2,y2 ; options: color=)",
+                    "--fill %@ %s", action_fill, NULL, "Fill a region (options: color=)",
+                    "--text %@ %s", action_text, NULL,
+                        "Render text into the current image (options: x=, y=, size=, color=)",
+                    // "--noise_uniform %@", action_noise_uniform, NULL, "Add uniform noise to the image (options: min=, max=)",
+                    // "--noise_gaussian %@", action_noise_gaussian, NULL, "Add Gaussian noise to the image (options: mean=, stddev=)",
+                    // "--noise_salt %@", action_noise_saltpepp, NULL, "Add 'salt & pepper' noise to the image (options: min=, max=)",
+                    "<SEPARATOR>", "Manipulating channels or subimages:",
+                    "--ch %@ %s", action_channels, NULL,
+                        "Select or shuffle channels (e.g., \"R,G,B\", \"B,G,R\", \"2,3,4\")",
+                    "--chappend %@", action_chappend, NULL,
+                        "Append the channels of the last two images",
+                    "--unmip %@", action_unmip, NULL, "Discard all but the top level of a MIPmap",
+                    "--selectmip %@ %d", action_selectmip, NULL,
+                        "Select just one MIP level (0 = highest res)",
+                    "--subimage %@ %s", action_select_subimage, NULL, "Select just one subimage (by index or name)",
+                    "--sisplit %@", action_subimage_split, NULL,
+                        "Split the top image's subimges into separate images",
+                    "--siappend %@", action_subimage_append, NULL,
+                        "Append the last two images into one multi-subimage image",
+                    "--siappendall %@", action_subimage_append_all, NULL,
+                        "Append all images on the stack into a single multi-subimage image",
+                    "--deepen %@", action_deepen, NULL, "Deepen normal 2D image to deep",
+                    "--flatten %@", action_flatten, NULL, "Flatten deep image to non-deep",
+                    "<SEPARATOR>", "Image stack manipulation:",
+                    "--dup %@", action_dup, NULL,
+                        "Duplicate the current image (push a copy onto the stack)",
+                    "--swap %@", action_swap, NULL,
+                        "Swap the top two images on the stack.",
+                    "--pop %@", action_pop, NULL,
+                        "Throw away the current image",
+                    "--label %@ %s", action_label, NULL,
+                        "Label the top image",
+                    "<SEPARATOR>", "Color management:",
+                    "--colorconfig %@ %s", set_colorconfig, NULL,
+                        "Explicitly specify an OCIO configuration file",
+                    "--iscolorspace %@ %s", set_colorspace, NULL,
+                        "Set the assumed color space (without altering pixels)",
+                    "--tocolorspace %@ %s", action_tocolorspace, NULL,
+                        "Convert the current image's pixels to a named color space",
+                    "--colorconvert %@ %s %s", action_colorconvert, NULL, NULL,
+                        "Convert pixels from 'src' to 'dst' color space (without regard to its previous interpretation)",
+                    "--ociolook %@ %s", action_ociolook, NULL,
+                        "Apply the named OCIO look (options: from=, to=, inverse=, key=, value=)",
+                    "--ociodisplay %@ %s %s", action_ociodisplay, NULL, NULL,
+                        "Apply the named OCIO display and view (options: from=, looks=, key=, value=)",
+                    "--ociofiletransform %@ %s", action_ociofiletransform, NULL,
+                        "Apply the named OCIO filetransform (options: inverse=)",
+                    "--unpremult %@", action_unpremult, NULL,
+                        "Divide all color channels of the current image by the alpha to \"un-premultiply\"",
+                    "--premult %@", action_premult, NULL,
+                        "Multiply all color channels of the current image by the alpha",
+                    NULL);
+        ot_args.ready = true;
+    }
 
     if (ap.parse(argc, (const char**)argv) < 0) {
         std::cerr << ap.geterror() << std::endl;
         print_help (ap);
-        exit (EXIT_SUCCESS);
+        return false;
     }
+    if (ap.aborted())
+        return false;
     if (help) {
         print_help (ap);
-        exit (EXIT_SUCCESS);
+        return false;
     }
     if (argc <= 1) {
         ap.briefusage ();
         std::cout << "\nFor detailed help: oiiotool --help\n";
-        exit (EXIT_SUCCESS);
+        return false;
     }
+    return true;
 }
 
 
 
+// The expanded sequence: everything needed to build the command line for
+// each frame, shared (read-only) by the threads running the frames.
+struct SequenceFrames {
+    SequenceFrames (int argc, const char **argv,
+                    const std::vector<int> &sequence_args,
+                    const std::vector< std::vector<std::string> > &filenames,
+                    size_t nfilenames, Timer &totaltime,
+                    FrameCache *cache)
+        : argc(argc), argv(argv), sequence_args(sequence_args),
+          filenames(filenames), nfilenames(nfilenames),
+          totaltime(totaltime), cache(cache), mainot(NULL)
+    { next = 0;  failed = 0; }
+    int argc;
+    const char **argv;
+    const std::vector<int> &sequence_args;
+    const std::vector< std::vector<std::string> > &filenames;
+    size_t nfilenames;
+    Timer &totaltime;
+    FrameCache *cache;        // Frame-invariant results, or NULL
+    atomic_int next;          // Next frame not yet claimed by a thread
+    atomic_int failed;        // Nonzero once any frame has failed
+    Oiiotool *mainot;         // Main thread's state, when frames are threaded
+    spin_mutex merge_mutex;   // Protects merging results into *mainot
+};
+
+
+
+// Claim and run frames of the sequence until there are none left, using
+// the calling thread's Oiiotool state. A thread other than the main one
+// starts from a default state that shares only the main thread's
+// ImageCache and --parallel-frames setting; every other option comes
+// from the frame's own command line, which is parsed in full for each
+// frame. Afterwards it folds its results (errors, output counts,
+// timings) back into the main thread's state.
+struct SequenceFrameRunner {
+    SequenceFrameRunner (SequenceFrames *frames) : frames(frames) { }
+    void operator() () {
+        SequenceFrames &f (*frames);
+        bool threaded = (f.mainot && f.mainot != &ot);
+        if (threaded) {
+            ot.imagecache = f.mainot->imagecache;
+            ot.parallel_frames = f.mainot->parallel_frames;
+        }
+        ot.frame_cache = f.cache;
+        run_frames (f);
+        ot.frame_cache = NULL;
+        if (threaded) {
+            spin_lock lock (f.merge_mutex);
+            Oiiotool &mainot (*f.mainot);
+            if (ot.return_value != EXIT_SUCCESS)
+                mainot.return_value = ot.return_value;
+            mainot.num_outputs += ot.num_outputs;
+            mainot.runstats |= ot.runstats;
+            for (Oiiotool::TimingMap::const_iterator t = ot.function_times.begin();
+                 t != ot.function_times.end();  ++t)
+                mainot.function_times[t->first] += t->second;
+            mainot.peak_memory = std::max (mainot.peak_memory, ot.peak_memory);
+            if (ot.profiling())
+                mainot.profile_file = ot.profile_file;
+            mainot.profile_records.insert (mainot.profile_records.end(),
+                                           ot.profile_records.begin(),
+                                           ot.profile_records.end());
+        }
+    }
+    // A frame that fails (or asks for help) ends the sequence: frames
+    // already running on other threads finish, but no more are started.
+    void run_frames (SequenceFrames &f) {
+        std::vector<const char *> seq_argv (f.argv, f.argv+f.argc+1);
+        for (int i = f.next++;  i < int(f.nfilenames) && ! f.failed;
+             i = f.next++) {
+            if (ot.debug)
+                std::cout << "SEQUENCE " << i << "\n";
+            ot.frame_index = i;
+            for (size_t j = 0;  j < f.sequence_args.size();  ++j) {
+                size_t a = f.sequence_args[j];
+                seq_argv[a] = f.filenames[a][i].c_str();
+                if (ot.debug)
+                    std::cout << "  " << f.argv[a] << " -> " << seq_argv[a] << "\n";
+            }
+
+            ot.clear_options (); // Careful to reset all command line options!
+            bool ok = getargs (f.argc, (char **)&seq_argv[0]);
+            if (ok) {
+                ot.process_pending ();
+                if (ot.pending_callback())
+                    ot.warning (Strutil::format ("pending '%s' command never executed", ot.pending_callback_name()));
+            }
+            // Clear the stack at the end of each iteration
+            ot.curimg.reset ();
+            ot.image_stack.clear();
+            if (! ok || ot.return_value != EXIT_SUCCESS) {
+                f.failed = 1;
+                break;
+            }
+
+            if (ot.runstats)
+                std::cout << "End iteration " << i << ": "
+                        << Strutil::timeintervalformat(f.totaltime(),2) << "  "
+                        << Strutil::memformat(Sysutil::memory_used()) << "\n";
+            if (ot.debug)
+                std::cout << "\n";
+        }
+    }
+    SequenceFrames *frames;
+};
+
+
+
 // Check if any of the command line arguments contains numeric ranges or
 // wildcards.  If not, just return 'false'.  But if they do, the
 // remainder of processing will happen here (and return 'true').
@@ -4828,6 +5570,9 @@ handle_sequence (int argc, const char **argv)
     Strutil::split (default_views, views, ",");
 
     int framepadding = 0;
+    int parallel_frames = 1;
+    int frame_cache_mb = 1024;
+    const char *threads_arg = NULL;
     std::vector<int> sequence_args;  // Args with sequence numbers
     std::vector<bool> sequence_is_output;
     bool is_sequence = false;
@@ -4854,6 +5599,17 @@ handle_sequence (int argc, const char **argv)
         else if ((strarg == "--views" || strarg == "-views") && a < argc-1) {
             Strutil::split (argv[++a], views, ",");
         }
+        else if ((strarg == "--parallel-frames" || strarg == "-parallel-frames")
+                 && a < argc-1) {
+            parallel_frames = std::max (1, atoi (argv[++a]));
+        }
+        else if ((strarg == "--frame-cache" || strarg == "-frame-cache")
+                 && a < argc-1) {
+            frame_cache_mb = std::max (0, atoi (argv[++a]));
+        }
+        else if ((strarg == "--threads" || strarg == "-threads") && a < argc-1) {
+            threads_arg = argv[++a];
+        }
         else if (strarg == "--wildcardoff" || strarg == "-wildcardoff") {
             wildcard_on = false;
         }
@@ -4938,73 +5694,79 @@ handle_sequence (int argc, const char **argv)
     // OK, now we just call getargs once for each item in the sequences,
     // substituting the i-th sequence entry for its respective argument
     // every time.
-    std::vector<const char *> seq_argv (argv, argv+argc+1);
-    for (size_t i = 0;  i < nfilenames;  ++i) {
-        if (ot.debug)
-            std::cout << "SEQUENCE " << i << "\n";
-        for (size_t j = 0;  j < sequence_args.size();  ++j) {
-            size_t a = sequence_args[j];
-            seq_argv[a] = filenames[a][i].c_str();
-            if (ot.debug)
-                std::cout << "  " << argv[a] << " -> " << seq_argv[a] << "\n";
-        }
-
-        ot.clear_options (); // Careful to reset all command line options!
-        getargs (argc, (char **)&seq_argv[0]);
-
-        ot.process_pending ();
-        if (ot.pending_callback())
-            ot.warning (Strutil::format ("pending '%s' command never executed", ot.pending_callback_name()));
-        // Clear the stack at the end of each iteration
-        ot.curimg.reset ();
-        ot.image_stack.clear();
-
-        if (ot.runstats)
-            std::cout << "End iteration " << i << ": "
-                    << Strutil::timeintervalformat(totaltime(),2) << "  "
-                    << Strutil::memformat(Sysutil::memory_used()) << "\n";
-        if (ot.debug)
-            std::cout << "\n";
+    // Commands that come out the same in every frame -- reading and
+    // resizing a fixed background plate, say -- are computed only once,
+    // as long as their results fit in frame_cache_mb.
+    FrameCache cache (argc, sequence_args,
+                      imagesize_t(frame_cache_mb) * 1024*1024);
+    bool use_cache = (frame_cache_mb > 0 && nfilenames > 1);
+    SequenceFrames frames (argc, argv, sequence_args, filenames,
+                           nfilenames, totaltime, use_cache ? &cache : NULL);
+    if (parallel_frames > 1 && nfilenames > 1) {
+#if OIIO_CPLUSPLUS_VERSION >= 11
+        // Each thread runs whole frames with its own Oiiotool state, all
+        // of them sharing the ImageCache and the IBA thread pool.
+        if (threads_arg)
+            OIIO::attribute ("threads", atoi (threads_arg));
+        ot.parallel_frames = parallel_frames;
+        frames.mainot = &ot;
+        thread_group threads;
+        for (int t = 0, n = std::min (parallel_frames, int(nfilenames));  t < n;  ++t)
+            threads.create_thread (SequenceFrameRunner (&frames));
+        threads.join_all ();
+#else
+        ot.warning ("--parallel-frames requires a C++11 build; running frames in sequence");
+        SequenceFrameRunner runner (&frames);
+        runner ();
+#endif
+    } else {
+        SequenceFrameRunner runner (&frames);
+        runner ();
     }
 
+    if (ot.runstats && use_cache)
+        std::cout << "Frame cache: " << cache.entries() << " results kept ("
+                  << Strutil::memformat (cache.bytes()) << "), reused "
+                  << cache.hits() << " times\n";
     return true;
 }
 
 
 
-int
-main (int argc, char *argv[])
+// Run one complete oiiotool command line (argv[0] being the program
+// name) against the current state, and return its exit status.
+static int
+run_command_line (int argc, char *argv[])
 {
-#if OIIO_MSVS_BEFORE_2015
-     // When older Visual Studio is used, float values in scientific foramt
-     // are printed with three digit exponent. We change this behaviour to
-     // fit Linux way.
-    _set_output_format (_TWO_DIGIT_EXPONENT);
-#endif
-
     Timer totaltime;
 
-    ot.imagecache = ImageCache::create (false);
-    ASSERT (ot.imagecache);
-    ot.imagecache->attribute ("forcefloat", 1);
-    ot.imagecache->attribute ("max_memory_MB", float(ot.cachesize));
-    ot.imagecache->attribute ("autotile", ot.autotile);
-    if (ot.autotile)
-        ot.imagecache->attribute ("autoscanline", 1);
-
     Filesystem::convert_native_arguments (argc, (const char **)argv);
     if (handle_sequence (argc, (const char **)argv)) {
         // Deal with sequence
 
     } else {
         // Not a sequence
-        getargs (argc, argv);
-        ot.process_pending ();
-        if (ot.pending_callback())
-            ot.warning (Strutil::format ("pending '%s' command never executed", ot.pending_callback_name()));
+        if (! getargs (argc, argv) && ot.return_value == EXIT_SUCCESS) {
+            // Help or usage was asked for, or the command line was
+            // malformed; there's nothing else to do.
+            output_queue().finish ();
+            return ot.return_value;
+        }
+        if (ot.return_value == EXIT_SUCCESS) {
+            ot.process_pending ();
+            if (ot.pending_callback())
+                ot.warning (Strutil::format ("pending '%s' command never executed", ot.pending_callback_name()));
+        }
     }
 
-    if (!ot.printinfo && !ot.printstats && !ot.dumpdata && !ot.dryrun) {
+    // Finish any background writes and report their errors
+    output_queue().finish ();
+
+    if (ot.profiling())
+        ot.write_profile ();
+
+    if (ot.return_value == EXIT_SUCCESS && !ot.printinfo && !ot.printstats &&
+            !ot.dumpdata && !ot.dryrun) {
         if (ot.curimg && !ot.curimg->was_output() &&
             (ot.curimg->metadata_modified() || ot.curimg->pixels_modified()))
             ot.warning ("modified images without outputting them. Did you forget -o?");
@@ -5037,3 +5799,243 @@ main (int argc, char *argv[])
 
     return ot.return_value;
 }
+
+
+
+#ifndef _WIN32
+// Split a line sent to the server into arguments: whitespace separates
+// them, and single quotes, double quotes and backslashes work as they do
+// in a POSIX shell (without any expansion).
+static void
+split_command_line (string_view line, std::vector<std::string> &args)
+{
+    std::string arg;
+    bool inarg = false;
+    char quote = 0;
+    for (size_t i = 0;  i < line.size();  ++i) {
+        char c = line[i];
+        if (quote) {
+            if (c == quote)
+                quote = 0;
+            else if (c == '\\' && quote == '"' && i+1 < line.size()
+                     && (line[i+1] == '"' || line[i+1] == '\\'))
+                arg += line[++i];
+            else
+                arg += c;
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+            inarg = true;
+        } else if (c == '\\' && i+1 < line.size()) {
+            arg += line[++i];
+            inarg = true;
+        } else if (isspace ((unsigned char)c)) {
+            if (inarg)
+                args.push_back (arg);
+            arg.clear ();
+            inarg = false;
+        } else {
+            arg += c;
+            inarg = true;
+        }
+    }
+    if (inarg)
+        args.push_back (arg);
+}
+
+
+
+// Read one newline-terminated line from fd (without the newline). Return
+// false if the connection closed before a full line arrived.
+static bool
+read_line (int fd, std::string &line)
+{
+    line.clear ();
+    char c;
+    for (;;) {
+        ssize_t r = read (fd, &c, 1);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        if (c == '\n')
+            return true;
+        line += c;
+    }
+}
+
+
+
+// Put the global state back the way a fresh process would have it, but
+// keep the warm parts: the ImageCache (minus any files changed on disk),
+// the loaded plugins, the color config with its cached processors.
+static void
+reset_for_next_job (int threads)
+{
+    ot.clear_options ();
+    ot.curimg.reset ();
+    ot.image_stack.clear ();
+    ot.image_labels.clear ();
+    ot.return_value = EXIT_SUCCESS;
+    ot.num_outputs = 0;
+    ot.function_times.clear ();
+    ot.profile_records.clear ();
+    ot.peak_memory = 0;
+    ot.frame_index = 0;
+    ot.frame_cache = NULL;
+    ot.parallel_frames = 1;
+    ot.total_readtime.reset ();
+    ot.total_writetime.reset ();
+    ot.total_imagecache_readtime = 0.0;
+    OIIO::attribute ("threads", threads);
+    ot.imagecache->invalidate_all (false);
+}
+
+
+
+// oiiotool --server <socket>: listen on a local (Unix domain) socket. Each
+// connection sends one command line, terminated by a newline, with the
+// same arguments that would follow "oiiotool" in a shell. The job's
+// standard output and error are sent back over the connection as it runs,
+// followed by a final line "oiiotool-exit <status>". The line "quit" shuts
+// the server down, and "metrics [format]" gets back the ImageCache's health
+// metrics, as ImageCache::format_metrics formats them (by default for
+// Prometheus), instead of running a job.
+static int
+run_server (const char *path)
+{
+    int listener = socket (AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset (&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (listener < 0 || strlen(path) >= sizeof(addr.sun_path)) {
+        std::cerr << "oiiotool ERROR: --server : bad socket \"" << path << "\"\n";
+        return EXIT_FAILURE;
+    }
+    strcpy (addr.sun_path, path);
+    // Remove a socket left behind by a previous server, but never any
+    // other kind of file.
+    struct stat st;
+    if (stat (path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink (path);
+    if (bind (listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen (listener, 64) < 0) {
+        std::cerr << "oiiotool ERROR: --server : could not listen on \""
+                  << path << "\": " << strerror(errno) << "\n";
+        close (listener);
+        return EXIT_FAILURE;
+    }
+    // A client hanging up mid-job must not kill the server.
+    signal (SIGPIPE, SIG_IGN);
+    int threads = 0;
+    OIIO::getattribute ("threads", threads);
+    std::cout << "oiiotool: serving on " << path << std::endl;
+
+    for (;;) {
+        int conn = accept (listener, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+        std::string line;
+        if (! read_line (conn, line)) {
+            close (conn);
+            continue;
+        }
+        string_view request = Strutil::strip (line);
+        if (request == "quit") {
+            close (conn);
+            break;
+        }
+        if (request == "metrics" || Strutil::starts_with (request, "metrics ")) {
+            string_view format = Strutil::strip (request.substr (7));
+            ImageCache::Metrics metrics;
+            ot.imagecache->get_metrics (metrics);
+            std::string text = ImageCache::format_metrics (metrics,
+                                    format.size() ? format : "prometheus");
+            if (text.empty())
+                text = "oiiotool ERROR: metrics : " + OIIO::geterror() + "\n";
+            for (size_t done = 0;  done < text.size();  ) {
+                ssize_t w = write (conn, text.data()+done, text.size()-done);
+                if (w < 0 && errno == EINTR)
+                    continue;
+                if (w <= 0)
+                    break;   // The client went away
+                done += size_t(w);
+            }
+            close (conn);
+            continue;
+        }
+        std::vector<std::string> args;
+        args.push_back ("oiiotool");
+        split_command_line (line, args);
+        std::vector<char *> argv;
+        for (size_t i = 0;  i < args.size();  ++i)
+            argv.push_back (&args[i][0]);
+        argv.push_back (NULL);
+
+        // Send the job's output to the client.
+        std::cout.flush ();  std::cerr.flush ();
+        fflush (stdout);  fflush (stderr);
+        int saved_stdout = dup (1), saved_stderr = dup (2);
+        dup2 (conn, 1);
+        dup2 (conn, 2);
+
+        int status = run_command_line (int(args.size()), &argv[0]);
+
+        std::cout.flush ();  std::cerr.flush ();
+        fflush (stdout);  fflush (stderr);
+        dup2 (saved_stdout, 1);
+        dup2 (saved_stderr, 2);
+        close (saved_stdout);
+        close (saved_stderr);
+
+        std::string done = Strutil::format ("oiiotool-exit %d\n", status);
+        if (write (conn, done.data(), done.size()) < 0) {
+            // The client went away; nothing else to do.
+        }
+        close (conn);
+        reset_for_next_job (threads);
+    }
+
+    close (listener);
+    unlink (path);
+    return EXIT_SUCCESS;
+}
+#endif
+
+
+
+int
+main (int argc, char *argv[])
+{
+#if OIIO_MSVS_BEFORE_2015
+     // When older Visual Studio is used, float values in scientific foramt
+     // are printed with three digit exponent. We change this behaviour to
+     // fit Linux way.
+    _set_output_format (_TWO_DIGIT_EXPONENT);
+#endif
+
+    ot.imagecache = ImageCache::create (false);
+    ASSERT (ot.imagecache);
+    ot.imagecache->attribute ("forcefloat", 1);
+    ot.imagecache->attribute ("max_memory_MB", float(ot.cachesize));
+    ot.imagecache->attribute ("autotile", ot.autotile);
+    if (ot.autotile)
+        ot.imagecache->attribute ("autoscanline", 1);
+
+    if (argc >= 2 && (!strcmp (argv[1], "--server") || !strcmp (argv[1], "-server"))) {
+        if (argc != 3) {
+            std::cerr << "oiiotool ERROR: --server takes just a socket name\n";
+            return EXIT_FAILURE;
+        }
+#ifndef _WIN32
+        return run_server (argv[2]);
+#else
+        std::cerr << "oiiotool ERROR: --server is not supported on this platform\n";
+        return EXIT_FAILURE;
+#endif
+    }
+
+    return run_command_line (argc, argv);
+}
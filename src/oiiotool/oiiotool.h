@@ -35,6 +35,7 @@
 #include "OpenImageIO/refcnt.h"
 #include "OpenImageIO/timer.h"
 #include "OpenImageIO/sysutil.h"
+#include "OpenImageIO/thread.h"
 
 
 OIIO_NAMESPACE_BEGIN
@@ -44,6 +45,7 @@ typedef int (*CallbackFunction)(int argc,const char*argv[]);
 
 class ImageRec;
 typedef shared_ptr<ImageRec> ImageRecRef;
+class FrameCache;
 
 
 /// Polycy hints for reading images
@@ -61,6 +63,20 @@ enum ReadPolicy {
 
 
 
+// One entry of the --profile log: the cost of one op invocation.
+struct ProfileRecord {
+    std::string command;        // Command as typed, with options
+    int frame;                  // Sequence frame index (0 if no sequence)
+    double start;               // Seconds since oiiotool started
+    double wall;                // Elapsed seconds
+    double cpu;                 // Process CPU seconds (all threads)
+    long long memory;           // Change in process memory, in bytes
+    imagesize_t pixels;         // Result pixels, summed over subimages
+    long long tile_misses;      // ImageCache tile misses during the op
+};
+
+
+
 class Oiiotool {
 public:
     // General options
@@ -102,6 +118,9 @@ public:
     bool output_dither;
     bool output_force_tiles; // for debugging
     bool metadata_nosoftwareattrib;
+    bool async_write;                 // write outputs in the background
+    int async_write_limit;            // MB of pixels queued writes may hold
+    std::string profile_file;         // --profile output ("-" is stdout)
 
     // Options for --diff
     float diff_warnthresh;
@@ -126,6 +145,10 @@ public:
     bool enable_function_timing;
     size_t peak_memory;
     int num_outputs;                         // Count of outputs written
+    int parallel_frames;                     // Sequence frames run at once
+    int frame_index;                         // Sequence frame being run
+    FrameCache *frame_cache;                 // Results reused across frames
+    std::vector<ProfileRecord> profile_records; // --profile log
 
     Oiiotool ();
 
@@ -152,6 +175,28 @@ public:
     void process_pending ();
 
     CallbackFunction pending_callback () const { return m_pending_callback; }
+
+    // Remember the argument list that ArgParse is walking, so that
+    // demand_roi() can look ahead at the commands that follow.
+    void set_command_line (int argc, const char **argv) {
+        m_argc = argc;  m_argv = argv;
+    }
+
+    // If the command whose arguments are argv[0..argc-1] is immediately
+    // followed by a --crop or --cut with a literal WxH+X+Y or
+    // xmin,ymin,xmax,ymax geometry, store the region it will keep in roi
+    // and return true. Ops whose output pixels depend only on the same
+    // input pixels can use this to skip computing pixels that will be
+    // discarded right away. Return false if there is no such hint.
+    bool demand_roi (int argc, const char *argv[], ROI &roi) const;
+
+    // If frame_cache is set (we are running the frames of a sequence)
+    // and the command whose arguments are argv[0..argc-1] is the same in
+    // every frame -- none of them has a frame or view wildcard or an
+    // {expression} -- return the position of argv[0] on the command
+    // line, which identifies the command across frames. Otherwise (or
+    // for a postponed callback) return -1.
+    int frame_invariant_args (int argc, const char *argv[]) const;
     const char *pending_callback_name () const { return m_pending_argv[0]; }
 
     void push (const ImageRecRef &img) {
@@ -205,11 +250,20 @@ public:
     string_view express (string_view str);
 
     int extract_options (std::map<std::string,std::string> &options,
-                         std::string command);
+                         string_view command);
 
     void error (string_view command, string_view explanation="");
     void warning (string_view command, string_view explanation="");
 
+    // --profile support: profile_start fills in the starting counters
+    // of rec, profile_end turns them into deltas and appends rec to the
+    // log, and write_profile writes the log to profile_file as a Chrome
+    // trace (for a ".json" name) or as a table sorted by time.
+    bool profiling () const { return ! profile_file.empty(); }
+    void profile_start (ProfileRecord &rec, string_view command);
+    void profile_end (ProfileRecord &rec, imagesize_t pixels);
+    void write_profile ();
+
     size_t check_peak_memory () {
         size_t mem = Sysutil::memory_used();
         peak_memory = std::max (peak_memory, mem);
@@ -220,6 +274,8 @@ private:
     CallbackFunction m_pending_callback;
     int m_pending_argc;
     const char *m_pending_argv[4];
+    int m_argc;
+    const char **m_argv;
 
     void express_error (const string_view expr, const string_view s, string_view explanation);
 
@@ -236,14 +292,20 @@ typedef shared_ptr<ImageBuf> ImageBufRef;
 
 class SubimageRec {
 public:
+    SubimageRec () : m_owner(NULL), m_index(0), m_pending(false) { }
     int miplevels() const { return (int) m_miplevels.size(); }
+    // Accessing the ImageBufs reads a pending subimage; the specs are
+    // valid without that.
     ImageBuf * operator() () {
+        elaborate ();
         return miplevels() ? m_miplevels[0].get() : NULL;
     }
     ImageBuf * operator[] (int i) {
+        elaborate ();
         return i < miplevels() ? m_miplevels[i].get() : NULL;
     }
     const ImageBuf * operator[] (int i) const {
+        elaborate ();
         return i < miplevels() ? m_miplevels[i].get() : NULL;
     }
     ImageSpec * spec (int i) {
@@ -252,9 +314,15 @@ public:
     const ImageSpec * spec (int i) const {
         return i < miplevels() ? &m_specs[i] : NULL;
     }
+    // Is this a subimage of a file whose pixels haven't been read yet?
+    bool pending () const { return m_pending; }
 private:
     std::vector<ImageBufRef> m_miplevels;
     std::vector<ImageSpec> m_specs;
+    ImageRec *m_owner;      // Who can read us, if pending
+    int m_index;            // Which subimage of m_owner we are
+    bool m_pending;
+    void elaborate () const;
     friend class ImageRec;
 };
 
@@ -265,7 +333,8 @@ public:
     ImageRec (const std::string &name, ImageCache *imagecache)
         : m_name(name), m_elaborated(false),
           m_metadata_modified(false), m_pixels_modified(false),
-          m_imagecache(imagecache)
+          m_frame_invariant(false),
+          m_imagecache(imagecache), m_readpolicy(ReadDefault)
     { }
 
     // Initialize an ImageRec with a collection of prepared ImageSpec's.
@@ -342,8 +411,19 @@ public:
     // it's lazily kept as name only, without reading the file.)
     bool elaborated () const { return m_elaborated; }
 
+    // Read the file's subimage and MIP level specs.  The pixels of each
+    // subimage are read only when its ImageBufs are first accessed.
     bool read (ReadPolicy readpolicy = ReadDefault);
 
+    // Read the pixels of a subimage that read() left pending, reporting
+    // any error with read_error().
+    bool read_subimage (int subimage);
+
+    // Is the given subimage still pending (its pixels never accessed)?
+    bool subimage_pending (int subimage) const {
+        return subimage < subimages() && m_subimages[subimage].pending();
+    }
+
     // ir(subimg,mip) references a specific MIP level of a subimage
     // ir(subimg) references the first MIP level of a subimage
     // ir() references the first MIP level of the first subimage
@@ -366,16 +446,27 @@ public:
     bool metadata_modified () const { return m_metadata_modified; }
     void metadata_modified (bool mod) {
         m_metadata_modified = mod;
-        if (mod)
+        if (mod) {
             was_output(false);
+            m_frame_invariant = false;
+        }
     }
     bool pixels_modified () const { return m_pixels_modified; }
     void pixels_modified (bool mod) {
         m_pixels_modified = mod;
-        if (mod)
+        if (mod) {
             was_output(false);
+            m_frame_invariant = false;
+        }
     }
 
+    // Is this image the same in every frame of the sequence being run?
+    // True for an input file named without wildcards and for the result
+    // of an op whose arguments and inputs are all frame-invariant.
+    // Modifying the image in place clears it.
+    bool frame_invariant () const { return m_frame_invariant; }
+    void frame_invariant (bool inv) { m_frame_invariant = inv; }
+
     std::time_t time() const { return m_time; }
 
     // This should be called if for some reason the underlying
@@ -407,19 +498,85 @@ private:
     bool m_metadata_modified;
     bool m_pixels_modified;
     bool m_was_output;
+    bool m_frame_invariant;
     std::vector<SubimageRec> m_subimages;
     std::time_t m_time;  //< Modification time of the input file
     ImageCache *m_imagecache;
+    ReadPolicy m_readpolicy;  //< How read() was asked to read the pixels
     mutable std::string m_err;
 
     // Add to the error message
     void append_error (string_view message) const;
 
+    // Remove any SHA-1 hash of the file's pixels from a spec.
+    static void strip_sha1 (ImageSpec &spec);
+
+    // Read a pending subimage's pixels, recording any errors.
+    bool read_pixels (int subimage);
+
 };
 
 
 
 
+// The results of frame-invariant ops, kept across the frames of a
+// sequence so that each is computed only once. An entry is identified by
+// the position of its command on the command line. The cache owns
+// private copies of the results, which callers copy again before use, so
+// that nothing done to an image later in a frame can alter an entry.
+class FrameCache {
+public:
+    // Record what running an op did besides producing its result: the
+    // first image read sets the output format and tile size (see
+    // Oiiotool::read), and a reused result must do the same.
+    struct Entry {
+        Entry () : dataformat(TypeDesc::UNKNOWN), bitspersample(0),
+                   tilewidth(0), tileheight(0) { }
+        ImageRecRef result;
+        TypeDesc dataformat;
+        int bitspersample;
+        int tilewidth, tileheight;
+    };
+
+    // argc is the length of the command line, sequence_args the
+    // positions of its arguments that change from frame to frame, and
+    // limit the most pixel memory (in bytes) the cache may hold.
+    FrameCache (int argc, const std::vector<int> &sequence_args,
+                imagesize_t limit);
+
+    // Does the argument at position a of the command line change from
+    // frame to frame?
+    bool varying (int a) const {
+        return a < 0 || a >= int(m_varying.size()) || m_varying[a];
+    }
+
+    // Look up the result of the command at position pos, and if there is
+    // one, fill in entry (whose result is then a fresh copy) and return
+    // true.
+    bool find (int pos, Entry &entry);
+
+    // Keep a copy of entry.result for the command at position pos, if it
+    // fits within the memory limit. Return true if it was kept.
+    bool insert (int pos, const Entry &entry);
+
+    // Statistics: results reused, results kept, and their pixel memory.
+    int hits () const { return m_hits; }
+    int entries () const;
+    imagesize_t bytes () const;
+
+private:
+    std::vector<bool> m_varying;
+    std::map<int,Entry> m_entries;
+    imagesize_t m_limit;
+    imagesize_t m_bytes;
+    atomic_int m_hits;
+    mutable spin_mutex m_mutex;
+
+    static ImageRecRef copy (ImageRec &img);
+};
+
+
+
 struct print_info_options {
     bool verbose;
     bool filenameprefix;
@@ -451,6 +608,11 @@ bool print_info (Oiiotool &ot, const std::string &filename,
                  long long &totalsize, std::string &error);
 
 
+// Report a failure to read the pixels of the named file.  (Used when
+// pixels are read lazily, after any command would check for errors.)
+void read_error (string_view filename, string_view explanation);
+
+
 // Set an attribute of the given image.  The type should be one of
 // TypeDesc::INT (decode the value as an int), FLOAT, STRING, or UNKNOWN
 // (look at the string and try to discern whether it's an int, float, or
@@ -527,6 +689,13 @@ public:
         ir.resize (ninputs+1);  // including reserving a spot for result
         for (int i = 0; i < ninputs; ++i)
             ir[ninputs-i] = ot.pop();
+        ot.demand_roi (argc, argv, m_demand);
+        // The result can be kept for the next frames only if the
+        // command and all of its inputs are frame-invariant.
+        m_framepos = ot.frame_invariant_args (argc, argv);
+        for (int i = 1; i <= ninputs && m_framepos >= 0; ++i)
+            if (! ir[i] || ! ir[i]->frame_invariant())
+                m_framepos = -1;
     }
     virtual ~OiiotoolOp () {}
 
@@ -537,6 +706,9 @@ public:
         // Set up a timer to automatically record how much time is spent in
         // every class of operation.
         Timer timer (ot.enable_function_timing);
+        ProfileRecord prof;
+        if (ot.profiling())
+            ot.profile_start (prof, args[0]);
         if (ot.debug) {
             std::cout << "Performing '" << opname() << "'";
             if (nargs() > 1)
@@ -546,6 +718,16 @@ public:
             std::cout << "\n";
         }
 
+        // A frame-invariant op that ran in an earlier frame of the
+        // sequence just pushes (a copy of) the result it had then.
+        if (m_framepos >= 0 && reuse_frame_result ()) {
+            ot.function_times[opname()] += timer();
+            return 0;
+        }
+        FrameCache::Entry before;
+        before.dataformat = ot.output_dataformat;
+        before.tilewidth = ot.output_tilewidth;
+
         // Parse the options.
         options.clear ();
         options["allsubimages"] = ot.allsubimages;
@@ -595,6 +777,16 @@ public:
         // Optional cleanup after processing all the subimages
         cleanup ();
 
+        if (ot.profiling()) {
+            imagesize_t pixels = 0;
+            for (int s = 0;  nimages() && s < subimages;  ++s)
+                pixels += (*ir[0])(s).spec().image_pixels();
+            ot.profile_end (prof, pixels);
+        }
+
+        if (m_framepos >= 0)
+            keep_frame_result (before);
+
         // Add the time we spent to the stats total for this op type.
         ot.function_times[opname()] += timer();
         return 0;
@@ -629,6 +821,18 @@ public:
     int nimages () const { return m_nimages; }
     string_view opname () const { return m_opname; }
 
+    // For pixelwise ops: return the part of the natural result region
+    // 'roi' that the next command will keep (see Oiiotool::demand_roi),
+    // or roi itself if there is no such hint or it would be empty.
+    ROI demand_roi (ROI roi) const {
+        if (! m_demand.defined() || ! roi.defined())
+            return roi;
+        ROI r = roi_intersection (m_demand, roi);
+        r.zbegin = roi.zbegin;    r.zend = roi.zend;
+        r.chbegin = roi.chbegin;  r.chend = roi.chend;
+        return r.npixels() ? r : roi;
+    }
+
 protected:
     Oiiotool &ot;
     std::string m_opname;
@@ -638,6 +842,53 @@ protected:
     std::vector<ImageBuf *> img;
     std::vector<string_view> args;
     std::map<std::string,std::string> options;
+    ROI m_demand;
+    int m_framepos;     // Command line position if frame-invariant, or -1
+
+    // Push the result this op had in an earlier frame, if there is one,
+    // and return true; else return false.
+    bool reuse_frame_result () {
+        FrameCache::Entry entry;
+        if (! ot.frame_cache->find (m_framepos, entry))
+            return false;
+        if (ot.debug)
+            std::cout << "  Reusing the result of '" << opname()
+                      << "' from an earlier frame\n";
+        if (ot.output_dataformat == TypeDesc::UNKNOWN &&
+                entry.dataformat != TypeDesc::UNKNOWN) {
+            ot.output_dataformat = entry.dataformat;
+            if (! ot.output_bitspersample)
+                ot.output_bitspersample = entry.bitspersample;
+        }
+        if (! ot.output_tilewidth && entry.tilewidth && ! ot.output_scanline) {
+            ot.output_tilewidth = entry.tilewidth;
+            ot.output_tileheight = entry.tileheight;
+        }
+        ir[0] = entry.result;
+        ot.push (ir[0]);
+        return true;
+    }
+
+    // After the op ran without errors, offer its result to be reused by
+    // the following frames. 'before' holds the output format and tile
+    // width from before the op read its inputs.
+    void keep_frame_result (const FrameCache::Entry &before) {
+        if (ot.return_value != EXIT_SUCCESS || ! ir[0] || ot.curimg != ir[0]
+                || ir[0]->has_error())
+            return;
+        ir[0]->frame_invariant (true);
+        FrameCache::Entry entry;
+        entry.result = ir[0];
+        if (before.dataformat == TypeDesc::UNKNOWN) {
+            entry.dataformat = ot.output_dataformat;
+            entry.bitspersample = ot.output_bitspersample;
+        }
+        if (! before.tilewidth) {
+            entry.tilewidth = ot.output_tilewidth;
+            entry.tileheight = ot.output_tileheight;
+        }
+        ot.frame_cache->insert (m_framepos, entry);
+    }
 };
 
 
@@ -652,13 +903,19 @@ class OiiotoolSimpleUnaryOp : public OiiotoolOp {
 public:
     OiiotoolSimpleUnaryOp (IBLIMPL opimpl, Oiiotool &ot, string_view opname,
                            int argc, const char *argv[], int ninputs)
-        : OiiotoolOp (ot, opname, argc, argv, 1), opimpl(opimpl)
+        : OiiotoolOp (ot, opname, argc, argv, 1), opimpl(opimpl),
+          m_pixelwise(false)
     {}
     virtual int impl (ImageBuf **img) {
-        return opimpl (*img[0], *img[1], ROI(), 0);
+        return opimpl (*img[0], *img[1],
+                       m_pixelwise ? demand_roi (img[1]->roi()) : ROI(), 0);
     }
+    // Mark the op as pixelwise (each output pixel depends only on the
+    // same input pixel), which lets it honor demand_roi().
+    void pixelwise (bool p) { m_pixelwise = p; }
 protected:
     IBLIMPL opimpl;
+    bool m_pixelwise;
 };
 
 template<typename IBLIMPL=IBAbinary>
@@ -669,7 +926,17 @@ public:
         : OiiotoolOp (ot, opname, argc, argv, 2), opimpl(opimpl)
     {}
     virtual int impl (ImageBuf **img) {
-        return opimpl (*img[0], *img[1], *img[2], ROI(), 0);
+        ROI roi = roi_union (img[1]->roi(), img[2]->roi());
+        ROI droi = demand_roi (roi);
+        if (droi == roi)
+            return opimpl (*img[0], *img[1], *img[2], ROI(), 0);
+        // Match the full window that the un-hinted call would have made.
+        bool ok = opimpl (*img[0], *img[1], *img[2], droi, 0);
+        ROI full = roi_union (img[1]->roi_full(), img[2]->roi_full());
+        if (ok)
+            img[0]->set_full (full.xbegin, full.xend, full.ybegin, full.yend,
+                              full.zbegin, full.zend);
+        return ok;
     }
 protected:
     IBLIMPL opimpl;
@@ -690,7 +957,8 @@ public:
         int nvals = Strutil::extract_from_list_string (val, args[1]);
         val.resize (nvals);
         val.resize (nchans, val.size() == 1 ? val.back() : defaultval);
-        return opimpl (*img[0], *img[1], &val[0], ROI(), 0);
+        return opimpl (*img[0], *img[1], &val[0],
+                       demand_roi (img[1]->roi()), 0);
     }
 protected:
     IBLIMPL opimpl;
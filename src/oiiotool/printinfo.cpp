@@ -425,6 +425,11 @@ print_stats (Oiiotool &ot,
         printf ("%sTotal deep samples in all pixels: %llu\n", indent, (unsigned long long)totalsamples);
         printf ("%sPixels with deep samples   : %llu\n", indent, (unsigned long long)(npixels-emptypixels));
         printf ("%sPixels with no deep samples: %llu\n", indent, (unsigned long long)emptypixels);
+        std::string chtypes;
+        for (int c = 0; c < nchannels; ++c)
+            chtypes += Strutil::format ("%s%s", c ? "," : "", dd->channeltype(c));
+        printf ("%sDeep data memory: %s (%s)\n", indent,
+                Strutil::memformat (dd->memsize()).c_str(), chtypes.c_str());
         printf ("%sSamples/pixel histogram:\n", indent);
         size_t grandtotal = 0;
         for (size_t i = 0, e = nsamples_histogram.size();  i < e;  ++i)
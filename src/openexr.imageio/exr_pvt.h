@@ -0,0 +1,75 @@
+/*
+  Copyright 2017 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+#ifndef OPENIMAGEIO_EXR_PVT_H
+#define OPENIMAGEIO_EXR_PVT_H
+
+#include <OpenEXR/ImfInputFile.h>
+#include <OpenEXR/ImfTiledInputFile.h>
+#ifdef USE_OPENEXR_VERSION2
+#include <OpenEXR/ImfInputPart.h>
+#include <OpenEXR/ImfTiledInputPart.h>
+#endif
+
+#include "OpenImageIO/imageio.h"
+
+
+OIIO_PLUGIN_NAMESPACE_BEGIN
+
+namespace OpenEXR_pvt {
+
+/// The OpenEXR library objects through which an OpenEXRInput reads the
+/// pixels of its current subimage.  At most one of them is non-NULL.
+struct InputHandles {
+    Imf::InputFile *scanline;
+    Imf::TiledInputFile *tiled;
+#ifdef USE_OPENEXR_VERSION2
+    Imf::InputPart *scanline_part;
+    Imf::TiledInputPart *tiled_part;
+#endif
+    int nmiplevels;         ///< MIP levels in the current subimage
+
+    InputHandles () : scanline(NULL), tiled(NULL),
+#ifdef USE_OPENEXR_VERSION2
+                      scanline_part(NULL), tiled_part(NULL),
+#endif
+                      nmiplevels(0) { }
+};
+
+/// If in is an OpenEXRInput with a flat (non-deep) current subimage,
+/// fill out h and return true; otherwise return false.  This lets
+/// OpenEXROutput::copy_image copy compressed chunks straight across.
+bool input_handles (ImageInput *in, InputHandles &h);
+
+}  // namespace OpenEXR_pvt
+
+OIIO_PLUGIN_NAMESPACE_END
+
+#endif  // OPENIMAGEIO_EXR_PVT_H
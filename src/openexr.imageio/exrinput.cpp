@@ -37,6 +37,7 @@
 #include <numeric>
 
 #include <OpenEXR/ImfTestFile.h>
+#include <OpenEXR/ImfVersion.h>
 #include <OpenEXR/ImfInputFile.h>
 #include <OpenEXR/ImfTiledInputFile.h>
 #include <OpenEXR/ImfChannelList.h>
@@ -77,6 +78,13 @@
 
 #include <OpenEXR/ImfCRgbaFile.h>
 
+// OpenEXR 2.3 lets us supply the thread pool that it runs tasks on.
+#if defined(OPENEXR_VERSION_MAJOR) && \
+    (OPENEXR_VERSION_MAJOR*10000+OPENEXR_VERSION_MINOR*100+OPENEXR_VERSION_PATCH) >= 20300
+#define OIIO_EXR_THREAD_PROVIDER 1
+#include <OpenEXR/IlmThreadPool.h>
+#endif
+
 #include "OpenImageIO/dassert.h"
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/thread.h"
@@ -86,8 +94,11 @@
 #include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/deepdata.h"
 #include "OpenImageIO/sysutil.h"
+#include "OpenImageIO/refcnt.h"
+#include "exr_pvt.h"
 
 #include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
 
@@ -139,6 +150,45 @@ private:
 
 
 
+// Input stream that reads from a Filesystem::IOProxy.  If the proxy's
+// bytes are all in memory, OpenEXR reads them in place.
+class OpenEXRProxyInputStream : public Imf::IStream
+{
+public:
+    OpenEXRProxyInputStream (Filesystem::IOProxy *io)
+        : Imf::IStream (io->filename().c_str()), m_io(io),
+          m_mem((const char *) io->mmap())
+    {
+        m_io->seek (0);
+    }
+    virtual bool isMemoryMapped () const { return m_mem != NULL; }
+    virtual bool read (char c[], int n) {
+        if (m_io->read (c, size_t(n)) != size_t(n))
+            throw Iex::InputExc ("Unexpected end of file.");
+        return m_io->tell() < int64_t(m_io->size());
+    }
+    virtual char *readMemoryMapped (int n) {
+        int64_t pos = m_io->tell();
+        if (! m_mem || pos + n > int64_t(m_io->size()))
+            throw Iex::InputExc ("Unexpected end of file.");
+        m_io->seek (pos + n);
+        return const_cast<char *>(m_mem) + pos;
+    }
+    virtual Imath::Int64 tellg () {
+        return m_io->tell();
+    }
+    virtual void seekg (Imath::Int64 pos) {
+        if (! m_io->seek (int64_t(pos)))
+            throw Iex::InputExc ("Seek failed.");
+    }
+
+private:
+    Filesystem::IOProxy *m_io;
+    const char *m_mem;
+};
+
+
+
 class OpenEXRInput : public ImageInput {
 public:
     OpenEXRInput ();
@@ -147,10 +197,14 @@ public:
     virtual int supports (string_view feature) const {
         return (feature == "arbitrary_metadata"
              || feature == "exif"   // Because of arbitrary_metadata
-             || feature == "iptc"); // Because of arbitrary_metadata
+             || feature == "iptc"   // Because of arbitrary_metadata
+             || feature == "ioproxy"
+             || feature == "random_access");
     }
     virtual bool valid_file (const std::string &filename) const;
     virtual bool open (const std::string &name, ImageSpec &newspec);
+    virtual bool open (const std::string &name, ImageSpec &newspec,
+                       const ImageSpec &config);
     virtual bool close ();
     virtual int current_subimage (void) const { return m_subimage; }
     virtual int current_miplevel (void) const { return m_miplevel; }
@@ -175,6 +229,9 @@ public:
                                          DeepData &deepdata);
 
 private:
+    friend bool OpenEXR_pvt::input_handles (ImageInput *in,
+                                            OpenEXR_pvt::InputHandles &h);
+
     struct PartInfo {
         bool initialized;
         ImageSpec spec;
@@ -188,17 +245,39 @@ private:
         Imath::Box2i top_displaywindow;
         std::vector<Imf::PixelType> pixeltype; ///< Imf pixel type for each chan
         std::vector<int> chanbytes;       ///< Size (in bytes) of each channel
+#ifdef USE_OPENEXR_VERSION2
+        // Imf access objects for the part, made the first time we seek
+        // to it and kept until close(), so that going back and forth
+        // between parts is free.  Only the one matching the part's
+        // type is non-NULL.
+        Imf::InputPart *scanline_input_part;
+        Imf::TiledInputPart *tiled_input_part;
+        Imf::DeepScanLineInputPart *deep_scanline_input_part;
+        Imf::DeepTiledInputPart *deep_tiled_input_part;
+#endif
 
-        PartInfo () : initialized(false) { }
+        PartInfo () : initialized(false)
+#ifdef USE_OPENEXR_VERSION2
+            , scanline_input_part(NULL), tiled_input_part(NULL),
+              deep_scanline_input_part(NULL), deep_tiled_input_part(NULL)
+#endif
+            { }
         ~PartInfo () { }
-        void parse_header (const Imf::Header *header);
+        void parse_header (const Imf::Header *header, bool pixels_only);
         void query_channels (const Imf::Header *header);
+#ifdef USE_OPENEXR_VERSION2
+        // Make the Imf access object for this part if we haven't yet.
+        void open_part (Imf::MultiPartInputFile &file, int partnum);
+        void close_part ();
+#endif
     };
 
     std::vector<PartInfo> m_parts;        ///< Image parts
-    OpenEXRInputStream *m_input_stream;   ///< Stream for input file
+    Imf::IStream *m_input_stream;         ///< Stream for input file
+    Filesystem::IOProxy *m_io;            ///< Caller's proxy (not owned)
 #ifdef USE_OPENEXR_VERSION2
     Imf::MultiPartInputFile *m_input_multipart;   ///< Multipart input
+    // The current part's access objects (owned by its PartInfo)
     Imf::InputPart *m_scanline_input_part;
     Imf::TiledInputPart *m_tiled_input_part;
     Imf::DeepScanLineInputPart *m_deep_scanline_input_part;
@@ -215,9 +294,13 @@ private:
     int m_subimage;                       ///< What subimage are we looking at?
     int m_nsubimages;                     ///< How many subimages are there?
     int m_miplevel;                       ///< What MIP level are we looking at?
+    bool m_pixels_only;                   ///< Caller doesn't need metadata
+    bool m_header_only;                   ///< Caller doesn't need pixels
+    std::vector<Imf::Header> m_headers;   ///< Headers read by header_only_open
 
     void init () {
         m_input_stream = NULL;
+        m_io = NULL;
         m_input_multipart = NULL;
         m_scanline_input_part = NULL;
         m_tiled_input_part = NULL;
@@ -227,7 +310,25 @@ private:
         m_input_tiled = NULL;
         m_subimage = -1;
         m_miplevel = -1;
+        m_pixels_only = false;
+        m_header_only = false;
+        m_headers.clear ();
     }
+
+    // Read just the header(s) of the file from m_input_stream, without
+    // making any of the Imf objects that set up for decoding pixels.
+    bool read_headers_only ();
+
+#ifdef USE_OPENEXR_VERSION2
+    // Read the sample counts and then the samples of the deep scanlines
+    // (or rows of tiles) [begin,end) of the current part, into the
+    // arrays that fb describes, allocating deepdata's samples in
+    // between.  For tiles, [xtbegin,xtend) is the range of tile columns.
+    bool read_deep_pixels (const Imf::DeepFrameBuffer &fb, DeepData &deepdata,
+                           std::vector<unsigned int> &all_samples,
+                           std::vector<void*> &pointerbuf,
+                           int begin, int end, int xtbegin, int xtend);
+#endif
 };
 
 
@@ -312,26 +413,150 @@ static StringMap exr_tag_to_oiio_std;
 
 namespace pvt {
 
+#ifdef OIIO_EXR_THREAD_PROVIDER
+
+// OpenEXR thread provider that runs its line buffer and tile tasks on
+// OIIO's shared thread pool, so that EXR decompression and everything
+// else OIIO does together stay within the "threads" attribute.
+//
+// OpenEXR's caller blocks until its tasks are done, rather than helping
+// to run them, and it may hold a file's ImageCache mutex that every pool
+// worker is waiting for in its own ImageCache read.  So each task is
+// queued for whichever comes first: a free worker, or the caller itself,
+// which runs the task if no worker has picked it up by the time it has
+// briefly spun.  Either way the task is run by a thread that isn't
+// waiting on anything, so it can't deadlock, and when the pool is busy
+// the work just stays in the thread that asked for it.  The caller can't
+// help with other queued tasks the way task_set::wait() does, since any
+// of those might want the very lock it holds.
+class OIIOExrThreadProvider : public IlmThread::ThreadPoolProvider {
+public:
+    OIIOExrThreadProvider () : m_limit(-1) { }
+    virtual ~OIIOExrThreadProvider () { finish (); }
+
+    /// limit < 0 means to queue tasks on the shared pool without any cap
+    /// beyond the pool's size, 0 means to run every task in the calling
+    /// thread, and > 0 means to have at most that many of OpenEXR's tasks
+    /// queued or running on the pool at once.
+    void configure (int limit) { m_limit = limit; }
+
+    virtual int numThreads () const {
+        int n = default_thread_pool()->size();
+        return m_limit < 0 ? n : std::min (n, int(m_limit));
+    }
+
+    virtual void setNumThreads (int count) {
+        // Imf::setGlobalThreadCount() from elsewhere in the app
+        configure (count);
+    }
+
+    virtual void addTask (IlmThread::Task *task) {
+        thread_pool *pool = default_thread_pool();
+        int limit = m_limit;
+        if (limit == 0 || pool->size() == 0
+              || (limit > 0 && m_pending >= limit)) {
+            task->execute ();
+            delete task;
+            return;
+        }
+        intrusive_ptr<Job> job (new Job (task, &m_pending));
+        pool->push (RunJob (job));
+        // Give a free worker the chance to take it, then do it ourselves
+        // if none did.
+        atomic_backoff backoff;
+        for (int i = 0;  i < spins && ! job->claimed();  ++i)
+            backoff ();
+        job->run ();
+    }
+
+    virtual void finish () {
+        atomic_backoff backoff;
+        while (m_pending > 0)
+            backoff ();
+    }
+
+private:
+    // A task that will be run exactly once, by whichever of a pool
+    // worker or the adding thread claims it first.
+    class Job : public RefCnt {
+    public:
+        Job (IlmThread::Task *task, atomic_int *pending)
+            : m_task(task), m_pending(pending), m_claimed(0) {
+            ++(*m_pending);
+        }
+        bool claimed () const { return m_claimed != 0; }
+        void run () {
+            if (! m_claimed.bool_compare_and_swap (0, 1))
+                return;
+            m_task->execute ();
+            delete m_task;   // Tells the task's group that it's done
+            --(*m_pending);
+        }
+    private:
+        IlmThread::Task *m_task;
+        atomic_int *m_pending;
+        atomic_int m_claimed;
+    };
+
+    struct RunJob {
+        RunJob (const intrusive_ptr<Job> &job) : m_job(job) { }
+        void operator() () { m_job->run (); }
+        intrusive_ptr<Job> m_job;
+    };
+
+    // Rounds of atomic_backoff (the last ones yield) the adding thread
+    // waits for a worker before running a task itself.
+    static const int spins = 32;
+
+    atomic_int m_limit;
+    atomic_int m_pending;
+};
+
+#endif
+
+
+
 void set_exr_threads ()
 {
-    static int exr_threads = 0;  // lives in exrinput.cpp
+    static int exr_threads = -2;  // lives in exrinput.cpp; -2 = not set yet
+    static int oiio_pool_threads = -1;
     static spin_mutex exr_threads_mutex;  
 
-    int oiio_threads = 1;
+    int oiio_threads = 0;
     OIIO::getattribute ("exr_threads", oiio_threads);
-    
-    // 0 means all threads in OIIO, but single-threaded in OpenEXR
-    // -1 means single-threaded in OIIO
+    int nthreads = 0;
+    OIIO::getattribute ("threads", nthreads);
+
+    spin_lock lock (exr_threads_mutex);
+    if (exr_threads == oiio_threads && oiio_pool_threads == nthreads)
+        return;
+    exr_threads = oiio_threads;
+    oiio_pool_threads = nthreads;
+    // 0 means to share OIIO's threads, -1 means single-threaded in
+    // OpenEXR, and anything else is how many of OIIO's threads OpenEXR
+    // may have busy at once.
+#ifdef OIIO_EXR_THREAD_PROVIDER
+    static OIIOExrThreadProvider *provider = NULL;
+    if (! provider) {
+        provider = new OIIOExrThreadProvider;  // owned by OpenEXR
+        IlmThread::ThreadPool::globalThreadPool().setThreadProvider (provider);
+    }
+    provider->configure (oiio_threads == 0 ? -1
+                         : (oiio_threads == -1 ? 0 : oiio_threads));
+#else
+    // Without a thread provider, the best we can do to share is to give
+    // OpenEXR as many threads as OIIO itself would use, which means
+    // resizing it whenever "threads" changes.
     if (oiio_threads == 0) {
-        oiio_threads = Sysutil::hardware_concurrency();
+        if (nthreads <= 0)
+            nthreads = Sysutil::hardware_concurrency();
     } else if (oiio_threads == -1) {
-        oiio_threads = 0;
-    }
-    spin_lock lock (exr_threads_mutex);
-    if (exr_threads != oiio_threads) {
-        exr_threads = oiio_threads;
-        Imf::setGlobalThreadCount (exr_threads);
+        nthreads = 0;
+    } else {
+        nthreads = oiio_threads;
     }
+    Imf::setGlobalThreadCount (nthreads);
+#endif
 }
 
 } // namespace pvt
@@ -353,18 +578,60 @@ OpenEXRInput::valid_file (const std::string &filename) const
 
 
 
+bool
+OpenEXRInput::open (const std::string &name, ImageSpec &newspec,
+                    const ImageSpec &config)
+{
+    // "oiio:PixelsOnly" is a hint that the caller has opened this file
+    // before and already has everything it needs except the pixels, so
+    // we may skip the quick checks and the metadata.
+    m_pixels_only = config.get_int_attribute ("oiio:PixelsOnly", 0) != 0;
+    // "oiio:HeaderOnly" is a promise that the caller only wants the
+    // ImageSpec, not the pixels, so we need not make the decoders.
+    m_header_only = config.get_int_attribute ("oiio:HeaderOnly", 0) != 0
+                 && ! m_pixels_only;
+    const ImageIOParameter *p = config.find_attribute ("oiio:ioproxy",
+                                                       TypeDesc::PTR);
+    if (p)
+        m_io = *(Filesystem::IOProxy * const *) p->data();
+    return open (name, newspec);
+}
+
+
+
 bool
 OpenEXRInput::open (const std::string &name, ImageSpec &newspec)
 {
-    // Quick check to reject non-exr files
-    if (! Filesystem::is_regular (name)) {
-        error ("Could not open file \"%s\"", name.c_str());
-        return false;
-    }
-    bool tiled;
-    if (! Imf::isOpenExrFile (name.c_str(), tiled)) {
-        error ("\"%s\" is not an OpenEXR file", name.c_str());
-        return false;
+    // Quick check to reject non-exr files.  With OpenEXR 2.x we only need
+    // it for the error message, so skip it when the caller has already
+    // seen this file.  Older versions need it to learn if it's tiled.
+    bool tiled = false;
+#ifdef USE_OPENEXR_VERSION2
+    bool quick_check = ! m_pixels_only;
+#else
+    bool quick_check = true;
+#endif
+    if (quick_check && m_io) {
+        char header[8];
+        if (m_io->pread (header, sizeof(header), 0) != sizeof(header) ||
+                ! Imf::isImfMagic (header)) {
+            error ("\"%s\" is not an OpenEXR file", name.c_str());
+            return false;
+        }
+        int version = (unsigned char)header[4] |
+                      ((unsigned char)header[5] << 8) |
+                      ((unsigned char)header[6] << 16) |
+                      ((unsigned char)header[7] << 24);
+        tiled = Imf::isTiled (version);
+    } else if (quick_check) {
+        if (! Filesystem::is_regular (name)) {
+            error ("Could not open file \"%s\"", name.c_str());
+            return false;
+        }
+        if (! Imf::isOpenExrFile (name.c_str(), tiled)) {
+            error ("\"%s\" is not an OpenEXR file", name.c_str());
+            return false;
+        }
     }
 
     pvt::set_exr_threads ();
@@ -372,7 +639,10 @@ OpenEXRInput::open (const std::string &name, ImageSpec &newspec)
     m_spec = ImageSpec(); // Clear everything with default constructor
     
     try {
-        m_input_stream = new OpenEXRInputStream (name.c_str());
+        if (m_io)
+            m_input_stream = new OpenEXRProxyInputStream (m_io);
+        else
+            m_input_stream = new OpenEXRInputStream (name.c_str());
     } catch (const std::exception &e) {
         m_input_stream = NULL;
         error ("OpenEXR exception: %s", e.what());
@@ -384,6 +654,21 @@ OpenEXRInput::open (const std::string &name, ImageSpec &newspec)
     }
 
 #ifdef USE_OPENEXR_VERSION2
+    if (m_header_only) {
+        if (! read_headers_only ()) {
+            close ();
+            return false;
+        }
+        m_nsubimages = (int) m_headers.size();
+        m_parts.resize (m_nsubimages);
+        m_subimage = -1;
+        m_miplevel = -1;
+        bool ok = seek_subimage (0, 0, newspec);
+        if (! ok)
+            close ();
+        return ok;
+    }
+
     try {
         m_input_multipart = new Imf::MultiPartInputFile (*m_input_stream);
     } catch (const std::exception &e) {
@@ -436,6 +721,55 @@ OpenEXRInput::open (const std::string &name, ImageSpec &newspec)
 
 
 
+#ifdef USE_OPENEXR_VERSION2
+bool
+OpenEXRInput::read_headers_only ()
+{
+    try {
+        char magic[8];
+        if (! m_input_stream->read (magic, sizeof(magic)) ||
+                ! Imf::isImfMagic (magic)) {
+            error ("Not an OpenEXR file");
+            return false;
+        }
+        int version = (unsigned char)magic[4] |
+                      ((unsigned char)magic[5] << 8) |
+                      ((unsigned char)magic[6] << 16) |
+                      ((unsigned char)magic[7] << 24);
+        bool multipart = Imf::isMultiPart (version);
+        for (;;) {
+            m_headers.push_back (Imf::Header());
+            Imf::Header &header (m_headers.back());
+            header.readFrom (*m_input_stream, version);
+            if (! multipart) {
+                // As MultiPartInputFile would, give a single part file
+                // the type its version field implies.
+                if (! header.hasType())
+                    header.setType (Imf::isTiled (version) ? Imf::TILEDIMAGE
+                                                           : Imf::SCANLINEIMAGE);
+                break;
+            }
+            // The list of part headers ends with an empty one, which
+            // is just its terminating null byte.
+            Imath::Int64 pos = m_input_stream->tellg ();
+            char c = 0;
+            if (! m_input_stream->read (&c, 1) || c == 0)
+                break;
+            m_input_stream->seekg (pos);
+        }
+    } catch (const std::exception &e) {
+        error ("OpenEXR exception: %s", e.what());
+        return false;
+    } catch (...) {   // catch-all for edge cases or compiler bugs
+        error ("OpenEXR exception: unknown");
+        return false;
+    }
+    return true;
+}
+#endif
+
+
+
 // Count number of MIPmap levels
 inline int
 numlevels (int width, int roundingmode)
@@ -453,7 +787,8 @@ numlevels (int width, int roundingmode)
 
 
 void
-OpenEXRInput::PartInfo::parse_header (const Imf::Header *header)
+OpenEXRInput::PartInfo::parse_header (const Imf::Header *header,
+                                      bool pixels_only)
 {
     if (initialized)
         return;
@@ -530,6 +865,12 @@ OpenEXRInput::PartInfo::parse_header (const Imf::Header *header)
         // FIXME - detect Shadow
     }
 
+    if (pixels_only) {
+        // The caller only wants the data layout; skip the metadata.
+        initialized = true;
+        return;
+    }
+
     const Imf::CompressionAttribute *compressattr;
     compressattr = header->findTypedAttribute<Imf::CompressionAttribute>("compression");
     if (compressattr) {
@@ -852,59 +1193,63 @@ OpenEXRInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
 #ifdef USE_OPENEXR_VERSION2
         if (m_input_multipart)
             header = &(m_input_multipart->header(subimage));
+        else if (m_header_only)
+            header = &m_headers[subimage];
 #else
         if (m_input_tiled)
             header = &(m_input_tiled->header());
         if (m_input_scanline)
             header = &(m_input_scanline->header());
 #endif
-        part.parse_header (header);
+        part.parse_header (header, m_pixels_only);
         part.initialized = true;
     }
 
-#ifdef USE_OPENEXR_VERSION2
     if (subimage != m_subimage) {
-        delete m_scanline_input_part;  m_scanline_input_part = NULL;
-        delete m_tiled_input_part;  m_tiled_input_part = NULL;
-        delete m_deep_scanline_input_part;  m_deep_scanline_input_part = NULL;
-        delete m_deep_tiled_input_part;  m_deep_tiled_input_part = NULL;
+#ifdef USE_OPENEXR_VERSION2
+        m_scanline_input_part = NULL;
+        m_tiled_input_part = NULL;
+        m_deep_scanline_input_part = NULL;
+        m_deep_tiled_input_part = NULL;
         try {
-            if (part.spec.deep) {
-                if (part.spec.tile_width)
-                    m_deep_tiled_input_part = new Imf::DeepTiledInputPart (*m_input_multipart, subimage);
-                else
-                    m_deep_scanline_input_part = new Imf::DeepScanLineInputPart (*m_input_multipart, subimage);
-            } else {
-                if (part.spec.tile_width)
-                    m_tiled_input_part = new Imf::TiledInputPart (*m_input_multipart, subimage);
-                else
-                    m_scanline_input_part = new Imf::InputPart (*m_input_multipart, subimage);
-            }
+            if (m_input_multipart)
+                part.open_part (*m_input_multipart, subimage);
         } catch (const std::exception &e) {
             error ("OpenEXR exception: %s", e.what());
-            m_scanline_input_part = NULL;
-            m_tiled_input_part = NULL;
-            m_deep_scanline_input_part = NULL;
-            m_deep_tiled_input_part = NULL;
+            part.close_part ();
+            m_subimage = m_miplevel = -1;
             return false;
         } catch (...) {   // catch-all for edge cases or compiler bugs
             error ("OpenEXR exception: unknown");
-            m_scanline_input_part = NULL;
-            m_tiled_input_part = NULL;
-            m_deep_scanline_input_part = NULL;
-            m_deep_tiled_input_part = NULL;
+            part.close_part ();
+            m_subimage = m_miplevel = -1;
             return false;
         }
-    }
+        m_scanline_input_part = part.scanline_input_part;
+        m_tiled_input_part = part.tiled_input_part;
+        m_deep_scanline_input_part = part.deep_scanline_input_part;
+        m_deep_tiled_input_part = part.deep_tiled_input_part;
 #endif
-
-    m_subimage = subimage;
+        // Only copy the whole spec (with all its metadata) when we
+        // change parts.  Switching MIP levels within a part just fixes
+        // up the geometry below.
+        m_subimage = subimage;
+        m_miplevel = -1;
+        m_spec = part.spec;
+    }
 
     if (miplevel < 0 || miplevel >= part.nmiplevels)   // out of range
         return false;
 
     m_miplevel = miplevel;
-    m_spec = part.spec;
+    m_spec.x = part.spec.x;
+    m_spec.y = part.spec.y;
+    m_spec.width = part.spec.width;
+    m_spec.height = part.spec.height;
+    m_spec.full_x = part.spec.full_x;
+    m_spec.full_y = part.spec.full_y;
+    m_spec.full_width = part.spec.full_width;
+    m_spec.full_height = part.spec.full_height;
 
     if (miplevel == 0 && part.levelmode == Imf::ONE_LEVEL) {
         newspec = m_spec;
@@ -961,14 +1306,49 @@ OpenEXRInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
 
 
 
+#ifdef USE_OPENEXR_VERSION2
+void
+OpenEXRInput::PartInfo::open_part (Imf::MultiPartInputFile &file, int partnum)
+{
+    if (scanline_input_part || tiled_input_part ||
+          deep_scanline_input_part || deep_tiled_input_part)
+        return;   // already open
+    if (spec.deep) {
+        if (spec.tile_width)
+            deep_tiled_input_part = new Imf::DeepTiledInputPart (file, partnum);
+        else
+            deep_scanline_input_part = new Imf::DeepScanLineInputPart (file, partnum);
+    } else {
+        if (spec.tile_width)
+            tiled_input_part = new Imf::TiledInputPart (file, partnum);
+        else
+            scanline_input_part = new Imf::InputPart (file, partnum);
+    }
+}
+
+
+
+void
+OpenEXRInput::PartInfo::close_part ()
+{
+    delete scanline_input_part;  scanline_input_part = NULL;
+    delete tiled_input_part;  tiled_input_part = NULL;
+    delete deep_scanline_input_part;  deep_scanline_input_part = NULL;
+    delete deep_tiled_input_part;  deep_tiled_input_part = NULL;
+}
+#endif
+
+
+
 bool
 OpenEXRInput::close ()
 {
+#ifdef USE_OPENEXR_VERSION2
+    for (size_t p = 0;  p < m_parts.size();  ++p)
+        m_parts[p].close_part ();
+#endif
+    m_parts.clear ();
     delete m_input_multipart;
-    delete m_scanline_input_part;
-    delete m_tiled_input_part;
-    delete m_deep_scanline_input_part;
-    delete m_deep_tiled_input_part;
     delete m_input_scanline;
     delete m_input_tiled;
     delete m_input_stream;
@@ -978,6 +1358,25 @@ OpenEXRInput::close ()
 
 
 
+bool
+OpenEXR_pvt::input_handles (ImageInput *in, OpenEXR_pvt::InputHandles &h)
+{
+    OpenEXRInput *exr = dynamic_cast<OpenEXRInput *> (in);
+    if (! exr || exr->m_subimage < 0 || exr->m_spec.deep)
+        return false;
+    h = InputHandles();
+    h.scanline = exr->m_input_scanline;
+    h.tiled = exr->m_input_tiled;
+#ifdef USE_OPENEXR_VERSION2
+    h.scanline_part = exr->m_scanline_input_part;
+    h.tiled_part = exr->m_tiled_input_part;
+#endif
+    h.nmiplevels = exr->m_parts[exr->m_subimage].nmiplevels;
+    return true;
+}
+
+
+
 bool
 OpenEXRInput::read_native_scanline (int y, int z, void *data)
 {
@@ -1169,6 +1568,158 @@ OpenEXRInput::read_native_tiles (int xbegin, int xend, int ybegin, int yend,
 
 
 
+#ifdef USE_OPENEXR_VERSION2
+// One band of a deep read: a range of scanlines (or of rows of tiles)
+// with its own stream and Imf part for the file, so that it can be
+// decoded while the other bands are.  The first band uses the
+// OpenEXRInput's own part instead.
+struct DeepBand {
+    int begin, end;
+    boost::shared_ptr<OpenEXRInputStream> stream;
+    boost::shared_ptr<Imf::MultiPartInputFile> file;
+    boost::shared_ptr<Imf::DeepScanLineInputPart> own_scanline;
+    boost::shared_ptr<Imf::DeepTiledInputPart> own_tiled;
+    Imf::DeepScanLineInputPart *scanline;
+    Imf::DeepTiledInputPart *tiled;
+    std::string err;
+    DeepBand () : begin(0), end(0), scanline(NULL), tiled(NULL) { }
+};
+
+
+
+// First pass for a band: open its own part if it doesn't have one yet,
+// and read its sample counts into the arrays that fb points to.
+static void
+deep_band_counts (DeepBand *band, const std::string &filename, int partnum,
+                  bool tiled, const Imf::DeepFrameBuffer &fb,
+                  int xtbegin, int xtend, int miplevel)
+{
+    try {
+        if (! band->scanline && ! band->tiled) {
+            band->stream.reset (new OpenEXRInputStream (filename.c_str()));
+            band->file.reset (new Imf::MultiPartInputFile (*band->stream));
+            if (tiled) {
+                band->own_tiled.reset (new Imf::DeepTiledInputPart (*band->file, partnum));
+                band->tiled = band->own_tiled.get();
+            } else {
+                band->own_scanline.reset (new Imf::DeepScanLineInputPart (*band->file, partnum));
+                band->scanline = band->own_scanline.get();
+            }
+        }
+        if (tiled) {
+            band->tiled->setFrameBuffer (fb);
+            band->tiled->readPixelSampleCounts (xtbegin, xtend-1,
+                                                band->begin, band->end-1,
+                                                miplevel, miplevel);
+        } else {
+            band->scanline->setFrameBuffer (fb);
+            band->scanline->readPixelSampleCounts (band->begin, band->end-1);
+        }
+    } catch (const std::exception &e) {
+        band->err = e.what();
+    } catch (...) {   // catch-all for edge cases or compiler bugs
+        band->err = "unknown exception";
+    }
+}
+
+
+
+// Second pass for a band, once the samples have been allocated: read
+// the sample values.
+static void
+deep_band_pixels (DeepBand *band, int xtbegin, int xtend, int miplevel)
+{
+    try {
+        if (band->tiled)
+            band->tiled->readTiles (xtbegin, xtend-1,
+                                    band->begin, band->end-1,
+                                    miplevel, miplevel);
+        else
+            band->scanline->readPixels (band->begin, band->end-1);
+    } catch (const std::exception &e) {
+        band->err = e.what();
+    } catch (...) {   // catch-all for edge cases or compiler bugs
+        band->err = "unknown exception";
+    }
+}
+
+
+
+bool
+OpenEXRInput::read_deep_pixels (const Imf::DeepFrameBuffer &fb,
+                                DeepData &deepdata,
+                                std::vector<unsigned int> &all_samples,
+                                std::vector<void*> &pointerbuf,
+                                int begin, int end, int xtbegin, int xtend)
+{
+    // Big reads of real files are split into bands of scanlines (whole
+    // multiples of 32, so that no compressed chunk is shared by two
+    // bands) or of rows of tiles, each decoded by its own task: all
+    // the sample counts first, then one exact allocation, then all the
+    // samples.
+    if (end <= begin) {
+        deepdata.set_all_samples (all_samples);
+        return true;
+    }
+    bool tiled = (m_deep_tiled_input_part != NULL);
+    int nthreads = threads();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    int align = tiled ? 1 : 32;
+    int nbands = std::min (nthreads, (end - begin) / (tiled ? 1 : 64));
+    if (nbands < 2 || m_io || all_samples.size() < 64*1024)
+        nbands = 1;
+    int bandsize = round_to_multiple ((end - begin + nbands - 1) / nbands,
+                                      align);
+    std::vector<DeepBand> bands;
+    for (int b = begin;  b < end;  b += bandsize) {
+        bands.push_back (DeepBand());
+        bands.back().begin = b;
+        bands.back().end = std::min (b + bandsize, end);
+    }
+    bands[0].scanline = m_deep_scanline_input_part;
+    bands[0].tiled = m_deep_tiled_input_part;
+    const std::string filename = m_input_stream->fileName();
+
+    {
+        task_set tasks;
+        for (size_t b = 1;  b < bands.size();  ++b)
+            tasks.push (OIIO::bind (deep_band_counts, &bands[b],
+                                    OIIO::cref(filename), m_subimage, tiled,
+                                    OIIO::cref(fb), xtbegin, xtend,
+                                    m_miplevel));
+        deep_band_counts (&bands[0], filename, m_subimage, tiled, fb,
+                          xtbegin, xtend, m_miplevel);
+    }
+    for (size_t b = 0;  b < bands.size();  ++b) {
+        if (bands[b].err.size()) {
+            error ("Failed OpenEXR read: %s", bands[b].err);
+            return false;
+        }
+    }
+
+    deepdata.set_all_samples (all_samples);
+    deepdata.get_pointers (pointerbuf);
+
+    {
+        task_set tasks;
+        for (size_t b = 1;  b < bands.size();  ++b)
+            tasks.push (OIIO::bind (deep_band_pixels, &bands[b],
+                                    xtbegin, xtend, m_miplevel));
+        deep_band_pixels (&bands[0], xtbegin, xtend, m_miplevel);
+    }
+    for (size_t b = 0;  b < bands.size();  ++b) {
+        if (bands[b].err.size()) {
+            error ("Failed OpenEXR read: %s", bands[b].err);
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+
+
 bool
 OpenEXRInput::read_native_deep_scanlines (int ybegin, int yend, int z,
                                           int chbegin, int chend,
@@ -1190,8 +1741,9 @@ OpenEXRInput::read_native_deep_scanlines (int ybegin, int yend, int z,
         std::vector<TypeDesc> channeltypes;
         m_spec.get_channelformats (channeltypes);
         deepdata.init (npixels, nchans,
-                       array_view<const TypeDesc>(&channeltypes[chbegin], chend-chbegin),
-                       spec().channelnames);
+                       array_view<const TypeDesc>(&channeltypes[chbegin], nchans),
+                       array_view<const std::string>(&m_spec.channelnames[chbegin], nchans),
+                       m_spec.width);
         std::vector<unsigned int> all_samples (npixels);
         std::vector<void*> pointerbuf (npixels*nchans);
         Imf::DeepFrameBuffer frameBuffer;
@@ -1213,17 +1765,11 @@ OpenEXRInput::read_native_deep_scanlines (int ybegin, int yend, int z,
                                   deepdata.samplesize()); // stride of data sample
             frameBuffer.insert (m_spec.channelnames[c].c_str(), slice);
         }
-        m_deep_scanline_input_part->setFrameBuffer (frameBuffer);
-
-        // Get the sample counts for each pixel and compute the total
-        // number of samples and resize the data area appropriately.
-        m_deep_scanline_input_part->readPixelSampleCounts (ybegin, yend-1);
-        deepdata.set_all_samples (all_samples);
-        deepdata.get_pointers (pointerbuf);
 
-        // Read the pixels
-        m_deep_scanline_input_part->readPixels (ybegin, yend-1);
-        // deepdata.import_chansamp (pointerbuf);
+        // Get the sample counts for each pixel, resize the data area to
+        // exactly the total number of samples, and read the pixels.
+        return read_deep_pixels (frameBuffer, deepdata, all_samples,
+                                 pointerbuf, ybegin, yend, 0, 0);
     } catch (const std::exception &e) {
         error ("Failed OpenEXR read: %s", e.what());
         return false;
@@ -1232,8 +1778,6 @@ OpenEXRInput::read_native_deep_scanlines (int ybegin, int yend, int z,
         return false;
     }
 
-    return true;
-
 #else
     return false;
 #endif
@@ -1265,8 +1809,9 @@ OpenEXRInput::read_native_deep_tiles (int xbegin, int xend,
         std::vector<TypeDesc> channeltypes;
         m_spec.get_channelformats (channeltypes);
         deepdata.init (npixels, nchans,
-                       array_view<const TypeDesc>(&channeltypes[chbegin], chend-chbegin),
-                       spec().channelnames);
+                       array_view<const TypeDesc>(&channeltypes[chbegin], nchans),
+                       array_view<const std::string>(&m_spec.channelnames[chbegin], nchans),
+                       int(width));
         std::vector<unsigned int> all_samples (npixels);
         std::vector<void*> pointerbuf (npixels * nchans);
         Imf::DeepFrameBuffer frameBuffer;
@@ -1287,7 +1832,6 @@ OpenEXRInput::read_native_deep_tiles (int xbegin, int xend,
                                   deepdata.samplesize()); // stride of data sample
             frameBuffer.insert (m_spec.channelnames[c].c_str(), slice);
         }
-        m_deep_tiled_input_part->setFrameBuffer (frameBuffer);
 
         int xtiles = round_to_multiple (xend-xbegin, m_spec.tile_width) / m_spec.tile_width;
         int ytiles = round_to_multiple (yend-ybegin, m_spec.tile_height) / m_spec.tile_height;
@@ -1295,19 +1839,11 @@ OpenEXRInput::read_native_deep_tiles (int xbegin, int xend,
         int firstxtile = (xbegin - m_spec.x) / m_spec.tile_width;
         int firstytile = (ybegin - m_spec.y) / m_spec.tile_height;
 
-        // Get the sample counts for each pixel and compute the total
-        // number of samples and resize the data area appropriately.
-        m_deep_tiled_input_part->readPixelSampleCounts (
-                firstxtile, firstxtile+xtiles-1,
-                firstytile, firstytile+ytiles-1);
-        deepdata.set_all_samples (all_samples);
-        deepdata.get_pointers (pointerbuf);
-
-        // Read the pixels
-        m_deep_tiled_input_part->readTiles (
-                firstxtile, firstxtile+xtiles-1,
-                firstytile, firstytile+ytiles-1,
-                m_miplevel, m_miplevel);
+        // Get the sample counts for each pixel, resize the data area to
+        // exactly the total number of samples, and read the pixels.
+        return read_deep_pixels (frameBuffer, deepdata, all_samples,
+                                 pointerbuf, firstytile, firstytile+ytiles,
+                                 firstxtile, firstxtile+xtiles);
     } catch (const std::exception &e) {
         error ("Failed OpenEXR read: %s", e.what());
         return false;
@@ -1316,8 +1852,6 @@ OpenEXRInput::read_native_deep_tiles (int xbegin, int xend,
         return false;
     }
 
-    return true;
-
 #else
     return false;
 #endif
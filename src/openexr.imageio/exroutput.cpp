@@ -30,6 +30,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <errno.h>
 #include <fstream>
@@ -70,6 +71,8 @@
 #ifdef USE_OPENEXR_VERSION2
 #include <OpenEXR/ImfStringVectorAttribute.h>
 #include <OpenEXR/ImfMultiPartOutputFile.h>
+#include <OpenEXR/ImfInputFile.h>
+#include <OpenEXR/ImfTiledInputFile.h>
 #include <OpenEXR/ImfPartType.h>
 #include <OpenEXR/ImfOutputPart.h>
 #include <OpenEXR/ImfTiledOutputPart.h>
@@ -83,9 +86,14 @@
 #include "OpenImageIO/deepdata.h"
 #include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/thread.h"
+#include "OpenImageIO/imagebufalgo_util.h"
 #include "OpenImageIO/strutil.h"
 #include "OpenImageIO/sysutil.h"
 #include "OpenImageIO/fmath.h"
+#include "exr_pvt.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
 
@@ -130,6 +138,145 @@ private:
 
 
 
+// Output stream that writes to a Filesystem::IOProxy.
+class OpenEXRProxyOutputStream : public Imf::OStream
+{
+public:
+    OpenEXRProxyOutputStream (Filesystem::IOProxy *io)
+        : Imf::OStream (io->filename().c_str()), m_io(io)
+    {
+        m_io->seek (0);
+    }
+    virtual void write (const char c[], int n) {
+        if (m_io->write (c, size_t(n)) != size_t(n))
+            throw Iex::ErrnoExc ("File output failed.");
+    }
+    virtual Imath::Int64 tellp () {
+        return m_io->tell();
+    }
+    virtual void seekp (Imath::Int64 pos) {
+        if (! m_io->seek (int64_t(pos)))
+            throw Iex::ErrnoExc ("File output failed.");
+    }
+
+private:
+    Filesystem::IOProxy *m_io;
+};
+
+
+
+// Output stream that accumulates the file in memory.
+class OpenEXRMemoryOutputStream : public Imf::OStream
+{
+public:
+    OpenEXRMemoryOutputStream () : Imf::OStream ("<memory>"), m_pos(0) { }
+    virtual void write (const char c[], int n) {
+        if (m_pos + n > m_data.size())
+            m_data.resize (m_pos + n);
+        memcpy (&m_data[m_pos], c, n);
+        m_pos += n;
+    }
+    virtual Imath::Int64 tellp () {
+        return m_pos;
+    }
+    virtual void seekp (Imath::Int64 pos) {
+        m_pos = size_t(pos);
+    }
+    const std::vector<char> &data () const { return m_data; }
+
+private:
+    std::vector<char> m_data;
+    size_t m_pos;
+};
+
+
+
+// Input stream that reads back what an OpenEXRMemoryOutputStream wrote.
+class OpenEXRMemoryInputStream : public Imf::IStream
+{
+public:
+    OpenEXRMemoryInputStream (const std::vector<char> &data)
+        : Imf::IStream ("<memory>"), m_data(data), m_pos(0) { }
+    virtual bool read (char c[], int n) {
+        if (m_pos + n > m_data.size())
+            throw Iex::InputExc ("Unexpected end of file.");
+        memcpy (c, &m_data[m_pos], n);
+        m_pos += n;
+        return m_pos < m_data.size();
+    }
+    virtual Imath::Int64 tellg () {
+        return m_pos;
+    }
+    virtual void seekg (Imath::Int64 pos) {
+        m_pos = size_t(pos);
+    }
+    virtual void clear () { }
+
+private:
+    const std::vector<char> &m_data;
+    size_t m_pos;
+};
+
+
+
+// One part of a multi-part file whose pixels are buffered while the
+// application writes them, then compressed on the thread pool into an
+// in-memory single-part file as soon as the application moves on to the
+// next part.  OpenEXROutput::close() waits for all of them and copies
+// the compressed chunks into the real file, in part order.  This lets
+// the parts of an AOV-heavy file compress concurrently instead of one
+// after another.
+struct OpenEXRDeferredPart {
+    ImageSpec spec;                       ///< Native spec of the part
+    Imf::Header header;
+    std::vector<Imf::PixelType> pixeltype;
+    std::vector<char> pixels;             ///< All native pixels of the part
+    OpenEXRMemoryOutputStream encoded;    ///< The compressed part
+    std::string err;                      ///< Non-empty if encoding failed
+};
+
+
+
+// Compress all of part->pixels into part->encoded.  This runs as a task
+// on the thread pool, so errors are stashed in part->err.
+static void
+encode_deferred_part (OpenEXRDeferredPart *part)
+{
+    const ImageSpec &spec (part->spec);
+    size_t pixelbytes = spec.pixel_bytes (true);
+    stride_t scanlinebytes = (stride_t) spec.scanline_bytes (true);
+    char *buf = &part->pixels[0]
+              - spec.x * pixelbytes
+              - spec.y * scanlinebytes;
+    try {
+        Imf::FrameBuffer frameBuffer;
+        size_t chanoffset = 0;
+        for (int c = 0;  c < spec.nchannels;  ++c) {
+            frameBuffer.insert (spec.channelnames[c].c_str(),
+                                Imf::Slice (part->pixeltype[c],
+                                            buf + chanoffset,
+                                            pixelbytes, scanlinebytes));
+            chanoffset += spec.channelformat(c).size();
+        }
+        if (spec.tile_width) {
+            Imf::TiledOutputFile out (part->encoded, part->header);
+            out.setFrameBuffer (frameBuffer);
+            out.writeTiles (0, out.numXTiles()-1, 0, out.numYTiles()-1);
+        } else {
+            Imf::OutputFile out (part->encoded, part->header);
+            out.setFrameBuffer (frameBuffer);
+            out.writePixels (spec.height);
+        }
+    } catch (const std::exception &e) {
+        part->err = e.what();
+    } catch (...) {  // catch-all for edge cases or compiler bugs
+        part->err = "unknown exception";
+    }
+    std::vector<char>().swap (part->pixels);  // free the raw pixels
+}
+
+
+
 class OpenEXROutput : public ImageOutput {
 public:
     OpenEXROutput ();
@@ -158,9 +305,10 @@ public:
     virtual bool write_deep_tiles (int xbegin, int xend, int ybegin, int yend,
                                    int zbegin, int zend,
                                    const DeepData &deepdata);
+    virtual bool copy_image (ImageInput *in);
 
 private:
-    OpenEXROutputStream *m_output_stream; ///< Stream for output file
+    Imf::OStream *m_output_stream;        ///< Stream for output file
     Imf::OutputFile *m_output_scanline;   ///< Input for scanline files
     Imf::TiledOutputFile *m_output_tiled; ///< Input for tiled files
 #ifdef USE_OPENEXR_VERSION2
@@ -187,6 +335,10 @@ private:
     std::vector<unsigned char> m_scratch; ///< Scratch space for us to use
     std::vector<ImageSpec> m_subimagespecs; ///< Saved subimage specs
     std::vector<Imf::Header> m_headers;
+    std::vector<boost::shared_ptr<OpenEXRDeferredPart> > m_deferred;
+                                          ///< Parts compressed in parallel
+    OpenEXRDeferredPart *m_deferred_part; ///< Current part, if deferred
+    boost::scoped_ptr<task_set> m_encode_tasks; ///< Deferred part encoding
 
     // Initialize private members to pre-opened state
     void init (void) {
@@ -202,6 +354,9 @@ private:
         m_miplevel = -1;
         std::vector<ImageSpec>().swap (m_subimagespecs);  // clear and free
         std::vector<Imf::Header>().swap (m_headers);
+        m_deferred.clear ();
+        m_deferred_part = NULL;
+        m_encode_tasks.reset ();
     }
 
     // Set up the header based on the given spec.  Also may doctor the 
@@ -222,6 +377,17 @@ private:
     // Helper: if the channel names are nonsensical, fix them to keep the
     // app from shooting itself in the foot.
     void sanity_check_channelnames ();
+
+    // If parts are being compressed in parallel, set up the buffer that
+    // will collect the pixels of the current part (m_subimage).
+    void begin_deferred_part ();
+
+    // Hand the current part, if deferred, to the thread pool to compress.
+    void end_deferred_part ();
+
+    // Wait for all deferred parts to compress and copy them into the
+    // multi-part file.  Return false on error.
+    bool finish_deferred_parts ();
 };
 
 
@@ -319,6 +485,8 @@ OpenEXROutput::supports (string_view feature) const
         return true;
     if (feature == "iptc")   // Because of arbitrary_metadata
         return true;
+    if (feature == "ioproxy")  // N.B. Not for multi-part or deep files
+        return true;
 #ifdef USE_OPENEXR_VERSION2
     if (feature == "multiimage")
         return true;  // N.B. But OpenEXR does not support "appendsubimage"
@@ -355,13 +523,23 @@ OpenEXROutput::open (const std::string &name, const ImageSpec &userspec,
         m_miplevel = 0;
         m_headers.resize (1);
         m_spec = userspec;  // Stash the spec
+        Filesystem::IOProxy *io = NULL;
+        const ImageIOParameter *ioparam = m_spec.find_attribute ("oiio:ioproxy",
+                                                                 TypeDesc::PTR);
+        if (ioparam) {
+            io = *(Filesystem::IOProxy * const *) ioparam->data();
+            m_spec.erase_attribute ("oiio:ioproxy");
+        }
         sanity_check_channelnames ();
 
         if (! spec_to_header (m_spec, m_subimage, m_headers[m_subimage]))
             return false;
 
         try {
-            m_output_stream = new OpenEXROutputStream (name.c_str());
+            if (io)
+                m_output_stream = new OpenEXRProxyOutputStream (io);
+            else
+                m_output_stream = new OpenEXROutputStream (name.c_str());
             if (m_spec.tile_width) {
                 m_output_tiled = new Imf::TiledOutputFile (*m_output_stream,
                                                            m_headers[m_subimage]);
@@ -397,11 +575,12 @@ OpenEXROutput::open (const std::string &name, const ImageSpec &userspec,
             return false;
         }
         // Move on to next subimage
-        ++m_subimage;
-        if (m_subimage >= m_nsubimages) {
+        if (m_subimage+1 >= m_nsubimages) {
             error ("More subimages than originally declared.");
             return false;
         }
+        end_deferred_part ();
+        ++m_subimage;
         // Close the current subimage, open the next one
         try {
             if (m_tiled_output_part) {
@@ -438,6 +617,7 @@ OpenEXROutput::open (const std::string &name, const ImageSpec &userspec,
         m_spec = m_subimagespecs[m_subimage];
         sanity_check_channelnames ();
         compute_pixeltypes(m_spec);
+        begin_deferred_part ();
         return true;
 #else
         // OpenEXR 1.x does not support subimages (multi-part)
@@ -498,6 +678,11 @@ OpenEXROutput::open (const std::string &name, int subimages,
     m_subimage = 0;
     m_nmiplevels = 1;
     m_miplevel = 0;
+    if (specs[0].find_attribute ("oiio:ioproxy", TypeDesc::PTR)) {
+        // See the FIXME below: multi-part output can only go to a file.
+        error ("OpenEXR multi-part and deep files can't be written to an IOProxy");
+        return false;
+    }
     m_subimagespecs.assign (specs, specs+subimages);
     m_headers.resize (subimages);
     std::string filetype;
@@ -525,6 +710,22 @@ OpenEXROutput::open (const std::string &name, int subimages,
     sanity_check_channelnames ();
     compute_pixeltypes(m_spec);
 
+    // Unless asked not to, compress flat, single-level parts concurrently
+    // on the thread pool.  This holds each part's uncompressed pixels in
+    // memory until it has been compressed.
+    bool parallel = (subimages > 1 && ! deep &&
+                     specs[0].get_int_attribute ("openexr:parallelparts", 1));
+    for (int s = 0;  parallel && s < subimages;  ++s) {
+        int nmiplevels, levelmode, roundingmode;
+        figure_mip (m_subimagespecs[s], nmiplevels, levelmode, roundingmode);
+        if (levelmode != Imf::ONE_LEVEL)
+            parallel = false;
+    }
+    if (parallel) {
+        m_deferred.resize (subimages);
+        m_encode_tasks.reset (new task_set);
+    }
+
     // Create an ImfMultiPartOutputFile
     try {
         // m_output_stream = new OpenEXROutputStream (name.c_str());
@@ -578,6 +779,7 @@ OpenEXROutput::open (const std::string &name, int subimages,
         return false;
     }
 
+    begin_deferred_part ();
     return true;
 #else
     // No support for OpenEXR 2.x -- one subimage only
@@ -940,10 +1142,20 @@ OpenEXROutput::put_parameter (const std::string &name, TypeDesc type,
         return true;
     }
 
+    // A hint to the writer, not metadata for the file
+    if (Strutil::iequals (xname, "openexr:parallelparts"))
+        return true;
+
     // Special handling of any remaining "oiio:*" metadata.
     if (Strutil::istarts_with (xname, "oiio:")) {
         if (Strutil::iequals (xname, "oiio:ConstantColor") ||
             Strutil::iequals (xname, "oiio:AverageColor") ||
+            Strutil::iequals (xname, "oiio:EnvImportance") ||
+            Strutil::iequals (xname, "oiio:MinMaxChannels") ||
+            Strutil::iequals (xname, "oiio:SourceHash") ||
+            Strutil::iequals (xname, "oiio:ConstantTiles") ||
+            Strutil::iequals (xname, "oiio:TileHashes") ||
+            Strutil::iequals (xname, "oiio:PixelHash") ||
             Strutil::iequals (xname, "oiio:SHA-1")) {
             // let these fall through and get stored as metadata
         } else {
@@ -1263,6 +1475,12 @@ OpenEXROutput::close ()
         return true;
     }
 
+    bool ok = true;
+    if (m_deferred.size()) {
+        end_deferred_part ();
+        ok = finish_deferred_parts ();
+    }
+
     delete m_output_scanline;  m_output_scanline = NULL;
     delete m_output_tiled;  m_output_tiled = NULL;
     delete m_scanline_output_part;  m_scanline_output_part = NULL;
@@ -1271,7 +1489,80 @@ OpenEXROutput::close ()
     delete m_output_stream;  m_output_stream = NULL;
 
     init ();      // re-initialize
-    return true;  // How can we fail?
+    return ok;
+}
+
+
+
+void
+OpenEXROutput::begin_deferred_part ()
+{
+    m_deferred_part = NULL;
+    if (m_subimage < 0 || m_subimage >= (int)m_deferred.size())
+        return;
+    boost::shared_ptr<OpenEXRDeferredPart> part (new OpenEXRDeferredPart);
+    part->spec = m_spec;
+    part->header = m_headers[m_subimage];
+    part->pixeltype = m_pixeltype;
+    part->pixels.resize (m_spec.image_bytes (true), 0);
+    m_deferred[m_subimage] = part;
+    m_deferred_part = part.get();
+}
+
+
+
+void
+OpenEXROutput::end_deferred_part ()
+{
+    if (m_deferred_part)
+        m_encode_tasks->push (OIIO::bind (encode_deferred_part,
+                                          m_deferred_part));
+    m_deferred_part = NULL;
+}
+
+
+
+bool
+OpenEXROutput::finish_deferred_parts ()
+{
+#ifdef USE_OPENEXR_VERSION2
+    if (m_encode_tasks)
+        m_encode_tasks->wait ();
+    // Copying compressed chunks is cheap, so this serial part is all I/O.
+    bool ok = true;
+    for (size_t s = 0;  s < m_deferred.size();  ++s) {
+        OpenEXRDeferredPart *part = m_deferred[s].get();
+        if (! part)
+            continue;   // written directly, e.g. by copy_image
+        if (part->err.size()) {
+            error ("Failed OpenEXR write: %s", part->err);
+            ok = false;
+            continue;
+        }
+        try {
+            OpenEXRMemoryInputStream in (part->encoded.data());
+            if (part->spec.tile_width) {
+                Imf::TiledInputFile infile (in);
+                Imf::TiledOutputPart out (*m_output_multipart, int(s));
+                out.copyPixels (infile);
+            } else {
+                Imf::InputFile infile (in);
+                Imf::OutputPart out (*m_output_multipart, int(s));
+                out.copyPixels (infile);
+            }
+        } catch (const std::exception &e) {
+            error ("Failed OpenEXR write: %s", e.what());
+            ok = false;
+        } catch (...) {  // catch-all for edge cases or compiler bugs
+            error ("Failed OpenEXR write: unknown exception");
+            ok = false;
+        }
+        m_deferred[s].reset ();
+    }
+    return ok;
+#else
+    return true;
+#endif
 }
 
 
@@ -1292,6 +1583,14 @@ OpenEXROutput::write_scanline (int y, int z, TypeDesc format,
     m_spec.auto_stride (xstride, format, spec().nchannels);
     data = to_native_scanline (format, data, xstride, m_scratch);
 
+    if (m_deferred_part) {
+        // Just collect the pixels; the part is compressed later
+        imagesize_t nativebytes = m_spec.scanline_bytes (true);
+        memcpy (&m_deferred_part->pixels[(y - m_spec.y) * nativebytes],
+                data, nativebytes);
+        return true;
+    }
+
     // Compute where OpenEXR needs to think the full buffers starts.
     // OpenImageIO requires that 'data' points to where client stored
     // the bytes to be written, but OpenEXR's frameBuffer.insert() wants
@@ -1372,6 +1671,14 @@ OpenEXROutput::write_scanlines (int ybegin, int yend, int z,
                                              xstride, ystride, zstride,
                                              m_scratch);
 
+        if (m_deferred_part) {
+            // Just collect the pixels; the part is compressed later
+            memcpy (&m_deferred_part->pixels[(ybegin - m_spec.y) * scanlinebytes],
+                    d, nscanlines * scanlinebytes);
+            data = (const char *)data + ystride*nscanlines;
+            continue;
+        }
+
         // Compute where OpenEXR needs to think the full buffers starts.
         // OpenImageIO requires that 'data' points to where client stored
         // the bytes to be written, but OpenEXR's frameBuffer.insert() wants
@@ -1477,6 +1784,21 @@ OpenEXROutput::write_tiles (int xbegin, int xend, int ybegin, int yend,
                                 format, data, xstride, ystride, zstride,
                                 m_scratch);
 
+    if (m_deferred_part) {
+        // Just collect the pixels (clipped to the image) into the whole
+        // part; it is compressed later.
+        stride_t rowbytes = (xend - xbegin) * pixelbytes;
+        int x1 = std::min (xend, m_spec.x+m_spec.width);
+        int y1 = std::min (yend, m_spec.y+m_spec.height);
+        stride_t partrow = m_spec.width * pixelbytes;
+        for (int y = ybegin;  y < y1;  ++y)
+            memcpy (&m_deferred_part->pixels[(y - m_spec.y) * partrow
+                                             + (xbegin - m_spec.x) * pixelbytes],
+                    (const char *)data + (y - ybegin) * rowbytes,
+                    (x1 - xbegin) * pixelbytes);
+        return true;
+    }
+
     // clamp to the image edge
     xend = std::min (xend, m_spec.x+m_spec.width);
     yend = std::min (yend, m_spec.y+m_spec.height);
@@ -1676,5 +1998,86 @@ OpenEXROutput::write_deep_tiles (int xbegin, int xend, int ybegin, int yend,
 }
 
 
-OIIO_PLUGIN_NAMESPACE_END
 
+// Can the pixels of a file with header src be copied, still compressed,
+// into a file with header dst?  These are the things that the Imf
+// copyPixels methods insist match.
+static bool
+raw_copy_compatible (const Imf::Header &src, const Imf::Header &dst)
+{
+    if (src.dataWindow() != dst.dataWindow() ||
+        src.lineOrder() != dst.lineOrder() ||
+        src.compression() != dst.compression() ||
+        ! (src.channels() == dst.channels()))
+        return false;
+    if (src.hasTileDescription() != dst.hasTileDescription())
+        return false;
+    if (src.hasTileDescription() &&
+        ! (src.tileDescription() == dst.tileDescription()))
+        return false;
+    return true;
+}
+
+
+
+// If both the output and input objects exist and their headers are
+// compatible, copy the compressed pixel data from in to out and return
+// true.  Return false if it can't be done (throws on I/O errors).
+template<class OUT, class IN>
+static bool
+copy_raw_pixels (OUT *out, IN *in)
+{
+    if (! out || ! in || ! raw_copy_compatible (in->header(), out->header()))
+        return false;
+    out->copyPixels (*in);
+    return true;
+}
+
+
+
+bool
+OpenEXROutput::copy_image (ImageInput *in)
+{
+    // When reading from another OpenEXR file whose data window, channels,
+    // compression, tiling, and line order all match ours, copy the
+    // compressed chunks straight across rather than decompressing and
+    // recompressing every pixel.  This makes metadata-only edits of big
+    // files nearly free.  MIP-maps are copied level by level the
+    // ordinary way, since Imf copies all levels at once.
+    OpenEXR_pvt::InputHandles h;
+    if (in && OpenEXR_pvt::input_handles (in, h) && h.nmiplevels == 1 &&
+            (! m_spec.tile_width || m_levelmode == Imf::ONE_LEVEL)) {
+        try {
+            bool copied = copy_raw_pixels (m_output_scanline, h.scanline)
+                       || copy_raw_pixels (m_output_tiled, h.tiled)
+#ifdef USE_OPENEXR_VERSION2
+                       || copy_raw_pixels (m_output_scanline, h.scanline_part)
+                       || copy_raw_pixels (m_output_tiled, h.tiled_part)
+                       || copy_raw_pixels (m_scanline_output_part, h.scanline)
+                       || copy_raw_pixels (m_scanline_output_part, h.scanline_part)
+                       || copy_raw_pixels (m_tiled_output_part, h.tiled)
+                       || copy_raw_pixels (m_tiled_output_part, h.tiled_part)
+#endif
+                       ;
+            if (copied) {
+                // The part is already compressed, so don't defer it
+                if (m_deferred_part) {
+                    m_deferred[m_subimage].reset ();
+                    m_deferred_part = NULL;
+                }
+                return true;
+            }
+        } catch (const std::exception &e) {
+            error ("Failed OpenEXR copy: %s", e.what());
+            return false;
+        } catch (...) {  // catch-all for edge cases or compiler bugs
+            error ("Failed OpenEXR copy: unknown exception");
+            return false;
+        }
+    }
+
+    return ImageOutput::copy_image (in);
+}
+
+
+OIIO_PLUGIN_NAMESPACE_END
@@ -67,6 +67,34 @@ OIIO_PLUGIN_NAMESPACE_BEGIN
 
 namespace PNG_pvt {
 
+/// libpng read, write and flush callbacks for images that come from or
+/// go to a Filesystem::IOProxy (passed as the io_ptr) instead of a FILE*.
+///
+inline void
+io_read (png_structp sp, png_bytep data, png_size_t length)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) png_get_io_ptr (sp);
+    if (io->read (data, length) != length)
+        png_error (sp, "Read error");
+}
+
+inline void
+io_write (png_structp sp, png_bytep data, png_size_t length)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) png_get_io_ptr (sp);
+    if (io->write (data, length) != length)
+        png_error (sp, "Write error");
+}
+
+inline void
+io_flush (png_structp sp)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) png_get_io_ptr (sp);
+    io->flush ();
+}
+
+
+
 /// Initializes a PNG read struct.
 /// \return empty string on success, error message on failure.
 ///
@@ -589,6 +617,23 @@ write_row (png_structp& sp, png_byte *data)
 
 
 
+/// Writes a chunk of the given type directly, bypassing libpng's own
+/// image row encoding.
+///
+inline bool
+write_chunk (png_structp& sp, const char *name, const unsigned char *data,
+             size_t length)
+{
+    // Must call this setjmp in every function that does PNG writes
+    if (setjmp (png_jmpbuf(sp))) {
+        return false;
+    }
+    png_write_chunk (sp, (png_bytep)name, (png_bytep)data, length);
+    return true;
+}
+
+
+
 /// Helper function - finalizes writing the image.
 ///
 inline void
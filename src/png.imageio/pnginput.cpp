@@ -51,6 +51,9 @@ public:
     PNGInput () { init(); }
     virtual ~PNGInput () { close(); }
     virtual const char * format_name (void) const { return "png"; }
+    virtual int supports (string_view feature) const {
+        return (feature == "ioproxy");
+    }
     virtual bool valid_file (const std::string &filename) const;
     virtual bool open (const std::string &name, ImageSpec &newspec);
     virtual bool open (const std::string &name, ImageSpec &newspec,
@@ -62,6 +65,7 @@ public:
 private:
     std::string m_filename;           ///< Stash the filename
     FILE *m_file;                     ///< Open image handle
+    Filesystem::IOProxy *m_io;        ///< Caller's proxy (not owned), or NULL
     png_structp m_png;                ///< PNG read structure pointer
     png_infop m_info;                 ///< PNG image info structure pointer
     int m_bit_depth;                  ///< PNG bit depth
@@ -78,6 +82,7 @@ private:
     void init () {
         m_subimage = -1;
         m_file = NULL;
+        m_io = NULL;
         m_png = NULL;
         m_info = NULL;
         m_buf.clear ();
@@ -136,14 +141,20 @@ PNGInput::open (const std::string &name, ImageSpec &newspec)
     m_filename = name;
     m_subimage = 0;
 
-    m_file = Filesystem::fopen (name, "rb");
-    if (! m_file) {
-        error ("Could not open file \"%s\"", name.c_str());
-        return false;
-    }
-
     unsigned char sig[8];
-    if (fread (sig, 1, sizeof(sig), m_file) != sizeof(sig)) {
+    size_t nsig = 0;
+    if (m_io) {
+        m_io->seek (0);
+        nsig = m_io->read (sig, sizeof(sig));
+    } else {
+        m_file = Filesystem::fopen (name, "rb");
+        if (! m_file) {
+            error ("Could not open file \"%s\"", name.c_str());
+            return false;
+        }
+        nsig = fread (sig, 1, sizeof(sig), m_file);
+    }
+    if (nsig != sizeof(sig)) {
         error ("Not a PNG file");
         return false;   // Read failed
     }
@@ -160,7 +171,10 @@ PNGInput::open (const std::string &name, ImageSpec &newspec)
         return false;
     }
 
-    png_init_io (m_png, m_file);
+    if (m_io)
+        png_set_read_fn (m_png, m_io, PNG_pvt::io_read);
+    else
+        png_init_io (m_png, m_file);
     png_set_sig_bytes (m_png, 8);  // already read 8 bytes
 
     PNG_pvt::read_info (m_png, m_info, m_bit_depth, m_color_type,
@@ -182,6 +196,10 @@ PNGInput::open (const std::string &name, ImageSpec &newspec,
     // Check 'config' for any special requests
     if (config.get_int_attribute("oiio:UnassociatedAlpha", 0) == 1)
         m_keep_unassociated_alpha = true;
+    const ImageIOParameter *p = config.find_attribute ("oiio:ioproxy",
+                                                       TypeDesc::PTR);
+    if (p)
+        m_io = *(Filesystem::IOProxy * const *) p->data();
     return open (name, newspec);
 }
 
@@ -274,8 +292,11 @@ PNGInput::read_native_scanline (int y, int z, void *data)
             // up to.  Easy fix: close the file and re-open.
             ImageSpec dummyspec;
             int subimage = current_subimage();
-            if (! close ()  ||
-                ! open (m_filename, dummyspec)  ||
+            Filesystem::IOProxy *io = m_io;
+            if (! close ())
+                return false;
+            m_io = io;
+            if (! open (m_filename, dummyspec)  ||
                 ! seek_subimage (subimage, dummyspec))
                 return false;    // Somehow, the re-open failed
             assert (m_next_scanline == 0 && current_subimage() == subimage);
@@ -39,6 +39,7 @@
 #include "OpenImageIO/dassert.h"
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/strutil.h"
+#include "OpenImageIO/thread.h"
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
 
@@ -49,7 +50,7 @@ public:
     virtual ~PNGOutput ();
     virtual const char * format_name (void) const { return "png"; }
     virtual int supports (string_view feature) const {
-        return (feature == "alpha");
+        return (feature == "alpha" || feature == "ioproxy");
     }
     virtual bool open (const std::string &name, const ImageSpec &spec,
                        OpenMode mode=Create);
@@ -63,6 +64,7 @@ public:
 private:
     std::string m_filename;           ///< Stash the filename
     FILE *m_file;                     ///< Open image handle
+    Filesystem::IOProxy *m_io;        ///< Caller's proxy (not owned), or NULL
     png_structp m_png;                ///< PNG read structure pointer
     png_infop m_info;                 ///< PNG image info structure pointer
     unsigned int m_dither;
@@ -72,15 +74,21 @@ private:
     std::vector<unsigned char> m_scratch;
     std::vector<png_text> m_pngtext;
     std::vector<unsigned char> m_tilebuffer;
+    int m_nthreads;                   ///< >1 if we deflate in parallel
+    int m_zlevel, m_zstrategy;        ///< zlib settings for our encoder
+    std::vector<unsigned char> m_rows;  ///< Rows buffered for our encoder
 
     // Initialize private members to pre-opened state
     void init (void) {
         m_file = NULL;
+        m_io = NULL;
         m_png = NULL;
         m_info = NULL;
         m_convert_alpha = true;
         m_gamma = 1.0;
         m_pngtext.clear ();
+        m_nthreads = 1;
+        std::vector<unsigned char>().swap (m_rows);
     }
 
     // Add a parameter to the output
@@ -88,6 +96,10 @@ private:
                         const void *data);
 
     void finish_image ();
+
+    // Filter and deflate the buffered rows on m_nthreads threads and
+    // write them as the IDAT stream, followed by IEND.
+    bool write_parallel_image ();
 };
 
 
@@ -139,10 +151,17 @@ PNGOutput::open (const std::string &name, const ImageSpec &userspec,
     if (m_spec.format != TypeDesc::UINT8 && m_spec.format != TypeDesc::UINT16)
         m_spec.set_format (TypeDesc::UINT8);
 
-    m_file = Filesystem::fopen (name, "wb");
-    if (! m_file) {
-        error ("Could not open file \"%s\"", name.c_str());
-        return false;
+    const ImageIOParameter *ioparam = m_spec.find_attribute ("oiio:ioproxy",
+                                                             TypeDesc::PTR);
+    if (ioparam) {
+        m_io = *(Filesystem::IOProxy * const *) ioparam->data();
+        m_spec.erase_attribute ("oiio:ioproxy");
+    } else {
+        m_file = Filesystem::fopen (name, "wb");
+        if (! m_file) {
+            error ("Could not open file \"%s\"", name.c_str());
+            return false;
+        }
     }
 
     std::string s = PNG_pvt::create_write_struct (m_png, m_info,
@@ -153,29 +172,44 @@ PNGOutput::open (const std::string &name, const ImageSpec &userspec,
         return false;
     }
 
-    png_init_io (m_png, m_file);
-    png_set_compression_level (m_png, std::max (std::min (m_spec.get_int_attribute ("png:compressionLevel", 6/* medium speed vs size tradeoff */), Z_BEST_COMPRESSION), Z_NO_COMPRESSION));
+    if (m_io)
+        png_set_write_fn (m_png, m_io, PNG_pvt::io_write, PNG_pvt::io_flush);
+    else
+        png_init_io (m_png, m_file);
+    m_zlevel = std::max (std::min (m_spec.get_int_attribute ("png:compressionLevel", 6/* medium speed vs size tradeoff */), Z_BEST_COMPRESSION), Z_NO_COMPRESSION);
+    png_set_compression_level (m_png, m_zlevel);
     std::string compression = m_spec.get_string_attribute ("compression");
     if (compression.empty ()) {
-        png_set_compression_strategy(m_png, Z_DEFAULT_STRATEGY);
+        m_zstrategy = Z_DEFAULT_STRATEGY;
     }
     else if (Strutil::iequals (compression, "default")) {
-        png_set_compression_strategy(m_png, Z_DEFAULT_STRATEGY);
+        m_zstrategy = Z_DEFAULT_STRATEGY;
     }
     else if (Strutil::iequals (compression, "filtered")) {
-        png_set_compression_strategy(m_png, Z_FILTERED);
+        m_zstrategy = Z_FILTERED;
     }
     else if (Strutil::iequals (compression, "huffman")) {
-        png_set_compression_strategy(m_png, Z_HUFFMAN_ONLY);
+        m_zstrategy = Z_HUFFMAN_ONLY;
     }
     else if (Strutil::iequals (compression, "rle")) {
-        png_set_compression_strategy(m_png, Z_RLE);
+        m_zstrategy = Z_RLE;
     }
     else if (Strutil::iequals (compression, "fixed")) {
-        png_set_compression_strategy(m_png, Z_FIXED);
+        m_zstrategy = Z_FIXED;
     }
     else {
-        png_set_compression_strategy(m_png, Z_DEFAULT_STRATEGY);
+        m_zstrategy = Z_DEFAULT_STRATEGY;
+    }
+    png_set_compression_strategy(m_png, m_zstrategy);
+
+    // "png:threads" opts in to our own encoder, which deflates blocks of
+    // rows in parallel: 1 (the default) leaves it all to libpng, 0 means
+    // use as many threads as OIIO is allowed.
+    m_nthreads = m_spec.get_int_attribute ("png:threads", 1);
+    if (m_nthreads <= 0) {
+        m_nthreads = threads();
+        if (m_nthreads <= 0)
+            OIIO::getattribute ("threads", m_nthreads);
     }
 
     PNG_pvt::write_info (m_png, m_info, m_color_type, m_spec, m_pngtext,
@@ -192,6 +226,10 @@ PNGOutput::open (const std::string &name, const ImageSpec &userspec,
     if (m_spec.tile_width && m_spec.tile_height)
         m_tilebuffer.resize (m_spec.image_bytes());
 
+    // Our own encoder needs every (unfiltered) row before it starts.
+    if (m_nthreads > 1)
+        m_rows.resize (m_spec.image_bytes());
+
     return true;
 }
 
@@ -200,7 +238,7 @@ PNGOutput::open (const std::string &name, const ImageSpec &userspec,
 bool
 PNGOutput::close ()
 {
-    if (! m_file) {   // already closed
+    if (! m_file && ! m_io) {   // already closed
         init ();
         return true;
     }
@@ -214,11 +252,22 @@ PNGOutput::close ()
         std::vector<unsigned char>().swap (m_tilebuffer);
     }
 
+    if (m_nthreads > 1 && m_png) {
+        // We write IEND ourselves, so don't let libpng finish the image.
+        ok &= write_parallel_image ();
+        png_destroy_write_struct (&m_png, &m_info);
+        m_png = NULL;
+        m_info = NULL;
+    }
+
     if (m_png)
         PNG_pvt::finish_image (m_png);
     PNG_pvt::destroy_write_struct (m_png, m_info);
 
-    fclose (m_file);
+    if (m_file)
+        fclose (m_file);
+    else
+        m_io->flush ();
     m_file = NULL;
 
     init ();      // re-initialize
@@ -289,6 +338,12 @@ PNGOutput::write_scanline (int y, int z, TypeDesc format,
     if (littleendian() && m_spec.format == TypeDesc::UINT16)
         swap_endian ((unsigned short *)data, m_spec.width*m_spec.nchannels);
 
+    if (m_nthreads > 1) {
+        memcpy (&m_rows[y * m_spec.scanline_bytes()], data,
+                m_spec.scanline_bytes());
+        return true;
+    }
+
     if (!PNG_pvt::write_row (m_png, (png_byte *)data)) {
         error ("PNG library error");
         return false;
@@ -310,5 +365,217 @@ PNGOutput::write_tile (int x, int y, int z, TypeDesc format,
 }
 
 
-OIIO_PLUGIN_NAMESPACE_END
 
+namespace {
+
+inline int
+paeth_predictor (int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs (p - a), pb = abs (p - b), pc = abs (p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return (pb <= pc) ? b : c;
+}
+
+
+
+// Apply PNG filter type f to one row of n bytes with bpp bytes per
+// pixel, given the previous unfiltered row (or NULL for the first).
+// Store the result in out, or if out is NULL, just return the sum of
+// the absolute (signed) residuals of every step'th pixel.
+static unsigned int
+png_filter_row (int f, const unsigned char *row, const unsigned char *prev,
+                size_t n, int bpp, unsigned char *out, int step = 1)
+{
+    unsigned int sum = 0;
+    for (size_t p = 0;  p < n;  p += size_t(bpp) * step) {
+        for (size_t i = p;  i < p + bpp;  ++i) {
+            int a = (i >= size_t(bpp)) ? row[i-bpp] : 0;
+            int b = prev ? prev[i] : 0;
+            int c = (prev && i >= size_t(bpp)) ? prev[i-bpp] : 0;
+            int pred = 0;
+            switch (f) {
+            case 1 : pred = a;  break;
+            case 2 : pred = b;  break;
+            case 3 : pred = (a + b) / 2;  break;
+            case 4 : pred = paeth_predictor (a, b, c);  break;
+            }
+            unsigned char r = (unsigned char) (row[i] - pred);
+            if (out)
+                out[i] = r;
+            else
+                sum += (r < 128) ? r : 256 - r;
+        }
+    }
+    return sum;
+}
+
+
+
+// Task for write_parallel_image: filter rows [ybegin,yend).  The filter
+// for each row is picked with the usual minimum sum of absolute
+// differences heuristic, but estimated from every 4th pixel, which is
+// nearly as good and several times cheaper than trying them all on the
+// whole row.
+struct PNGFilterTask {
+    const unsigned char *rows;   // Unfiltered image
+    unsigned char *filtered;     // Result: filter byte + row, each row
+    size_t rowbytes;
+    int bpp;
+    int ybegin, yend;
+
+    void operator() () {
+        for (int y = ybegin;  y < yend;  ++y) {
+            const unsigned char *row = rows + y * rowbytes;
+            const unsigned char *prev = y ? row - rowbytes : NULL;
+            int best = 0;
+            unsigned int bestsum = png_filter_row (0, row, prev, rowbytes,
+                                                   bpp, NULL, 4);
+            for (int f = 1;  f <= 4 && bestsum;  ++f) {
+                unsigned int sum = png_filter_row (f, row, prev, rowbytes,
+                                                   bpp, NULL, 4);
+                if (sum < bestsum) {
+                    best = f;
+                    bestsum = sum;
+                }
+            }
+            unsigned char *out = filtered + y * (rowbytes + 1);
+            out[0] = (unsigned char) best;
+            png_filter_row (best, row, prev, rowbytes, bpp, out + 1);
+        }
+    }
+};
+
+
+
+// Task for write_parallel_image: deflate one block of filtered bytes as
+// a raw deflate stream, primed with the 32k of data before it so that
+// the ratio barely suffers.  All but the last block end on a sync flush
+// (a byte boundary with no final block), so the blocks can simply be
+// concatenated.
+struct PNGDeflateTask {
+    const unsigned char *begin, *end;  // Block to compress
+    const unsigned char *dict;         // Start of preceding data to prime
+    bool last;
+    int level, strategy;
+    std::vector<unsigned char> *out;
+    uLong *adler;                      // Adler-32 of the block
+    atomic_int *failures;
+
+    void operator() () {
+        *adler = adler32 (adler32 (0, NULL, 0), begin, uInt(end - begin));
+        z_stream z;
+        memset (&z, 0, sizeof(z));
+        if (deflateInit2 (&z, level, Z_DEFLATED, -15, 8, strategy) != Z_OK) {
+            ++(*failures);
+            return;
+        }
+        if (dict < begin)
+            deflateSetDictionary (&z, dict, uInt(begin - dict));
+        out->resize (deflateBound (&z, uLong(end - begin)) + 16);
+        z.next_in = (Bytef *) begin;
+        z.avail_in = uInt (end - begin);
+        z.next_out = (Bytef *) &(*out)[0];
+        z.avail_out = uInt (out->size());
+        int r = deflate (&z, last ? Z_FINISH : Z_SYNC_FLUSH);
+        if (r != (last ? Z_STREAM_END : Z_OK) || z.avail_in)
+            ++(*failures);
+        out->resize (z.total_out);
+        deflateEnd (&z);
+    }
+};
+
+}  // end anon namespace
+
+
+
+bool
+PNGOutput::write_parallel_image ()
+{
+    size_t rowbytes = m_spec.scanline_bytes();
+    int bpp = int (m_spec.pixel_bytes());
+    int height = m_spec.height;
+    std::vector<unsigned char> filtered (size_t(height) * (rowbytes + 1));
+
+    // Filter in parallel.  Each row only needs the unfiltered row above.
+    task_set tasks;
+    PNGFilterTask ftask;
+    ftask.rows = &m_rows[0];
+    ftask.filtered = &filtered[0];
+    ftask.rowbytes = rowbytes;
+    ftask.bpp = bpp;
+    int rows_per_task = std::max (1, (height + m_nthreads - 1) / m_nthreads);
+    for (int y = 0;  y < height;  y += rows_per_task) {
+        ftask.ybegin = y;
+        ftask.yend = std::min (y + rows_per_task, height);
+        tasks.push (ftask);
+    }
+    tasks.wait ();
+    std::vector<unsigned char>().swap (m_rows);
+
+    // Deflate blocks of rows in parallel -- a few per thread to balance
+    // the load, but not so small that priming and flushing them costs
+    // much.
+    const size_t window = 32768, min_block = 256*1024;
+    size_t nbytes = filtered.size();
+    size_t block = std::max (min_block, nbytes / (4 * m_nthreads) + 1);
+    int nblocks = int ((nbytes + block - 1) / block);
+    std::vector<std::vector<unsigned char> > packed (nblocks);
+    std::vector<uLong> adlers (nblocks);
+    atomic_int failures (0);
+    PNGDeflateTask dtask;
+    dtask.level = m_zlevel;
+    dtask.strategy = m_zstrategy;
+    dtask.failures = &failures;
+    for (int b = 0;  b < nblocks;  ++b) {
+        size_t offset = b * block;
+        dtask.begin = &filtered[0] + offset;
+        dtask.end = &filtered[0] + std::min (offset + block, nbytes);
+        dtask.dict = &filtered[0] + (offset > window ? offset - window : 0);
+        dtask.last = (b == nblocks-1);
+        dtask.out = &packed[b];
+        dtask.adler = &adlers[b];
+        tasks.push (dtask);
+    }
+    tasks.wait ();
+    if (failures) {
+        error ("Could not compress PNG image data");
+        return false;
+    }
+
+    // Stitch the zlib stream together: header, blocks, Adler-32 of it all.
+    std::vector<unsigned char> zdata;
+    int flevel = (m_zstrategy >= Z_HUFFMAN_ONLY || m_zlevel < 2) ? 0
+               : (m_zlevel < 6 ? 1 : (m_zlevel == 6 ? 2 : 3));
+    unsigned int header = (0x78 << 8) | (flevel << 6);
+    header += 31 - header % 31;
+    zdata.push_back ((unsigned char) (header >> 8));
+    zdata.push_back ((unsigned char) (header & 0xff));
+    uLong adler = adler32 (0, NULL, 0);
+    for (int b = 0;  b < nblocks;  ++b) {
+        zdata.insert (zdata.end(), packed[b].begin(), packed[b].end());
+        std::vector<unsigned char>().swap (packed[b]);
+        size_t len = std::min (block, nbytes - b * block);
+        adler = adler32_combine (adler, adlers[b], z_off_t(len));
+    }
+    for (int i = 3;  i >= 0;  --i)
+        zdata.push_back ((unsigned char) ((adler >> (8*i)) & 0xff));
+
+    const size_t max_chunk = 1 << 20;
+    for (size_t offset = 0;  offset < zdata.size();  offset += max_chunk) {
+        if (! PNG_pvt::write_chunk (m_png, "IDAT", &zdata[offset],
+                                    std::min (max_chunk, zdata.size() - offset))) {
+            error ("PNG library error");
+            return false;
+        }
+    }
+    if (! PNG_pvt::write_chunk (m_png, "IEND", NULL, 0)) {
+        error ("PNG library error");
+        return false;
+    }
+    return true;
+}
+
+
+OIIO_PLUGIN_NAMESPACE_END
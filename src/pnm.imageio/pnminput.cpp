@@ -35,18 +35,21 @@
 #include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/fmath.h"
 #include "OpenImageIO/imageio.h"
+#include "OpenImageIO/thread.h"
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
 
 class PNMInput : public ImageInput {
 public:
-    PNMInput() { }
+    PNMInput() : m_ascii_nvals(0), m_ascii_decoded(false) { }
     virtual ~PNMInput() { close(); }
     virtual const char* format_name (void) const { return "pnm"; }
     virtual bool open (const std::string &name, ImageSpec &newspec);
     virtual bool close ();
     virtual int current_subimage (void) const { return 0; }
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
 
 private:
     enum PNMType {
@@ -55,13 +58,17 @@ private:
 
     OIIO::ifstream m_file;
     std::streampos m_header_end_pos; // file position after the header
-    std::string m_current_line; ///< Buffer the image pixels
-    const char * m_pos;
     PNMType m_pnm_type;
     unsigned int m_max_val;
     float m_scaling_factor;
-
-    bool read_file_scanline (void * data, int y);
+    std::vector<unsigned char> m_buf;    ///< Raw bytes of binary scanlines
+    std::vector<unsigned char> m_pixels; ///< Whole decoded ASCII image
+    imagesize_t m_ascii_nvals;           ///< Good values in m_pixels
+    bool m_ascii_decoded;
+
+    bool read_binary_scanlines (int ybegin, int yend, void *data);
+    bool read_ascii_scanlines (int ybegin, int yend, void *data);
+    bool decode_ascii ();
     bool read_file_header ();
 };
 
@@ -83,65 +90,6 @@ OIIO_PLUGIN_EXPORTS_BEGIN
 OIIO_PLUGIN_EXPORTS_END
 
 
-inline bool
-nextLine (std::istream &file, std::string &current_line, const char * &pos)
-{   
-    if (!file.good())
-        return false;
-    getline (file, current_line);
-    if (file.fail())
-        return false;
-    pos = current_line.c_str();
-    return true;
-}
-
-
-
-inline const char * 
-nextToken (std::istream &file, std::string &current_line, const char * &pos)
-{		
-    while (1) {
-        while (isspace (*pos)) 
-            pos++;
-        if (*pos)
-            break;
-        else 
-            nextLine (file, current_line, pos);
-    }
-    return pos;
-}
-
-
-
-inline const char *
-skipComments (std::istream &file, std::string &current_line,
-              const char * & pos, char comment = '#')
-{		
-    while (1) {
-        nextToken (file, current_line, pos);
-        if (*pos == comment)
-            nextLine (file, current_line, pos);
-        else 
-            break;
-    }
-    return pos;
-}
-
-
-
-inline bool
-nextVal (std::istream & file, std::string &current_line,
-         const char * &pos, int &val, char comment = '#')
-{
-    skipComments (file, current_line, pos, comment);
-    if (!isdigit (*pos))
-        return false;
-    val = strtol (pos,(char**) &pos, 10);
-    return true;
-}
-
-
-
 template <class T> 
 inline void 
 invert (const T *read, T *write, imagesize_t nvals)
@@ -152,31 +100,83 @@ invert (const T *read, T *write, imagesize_t nvals)
 
 
 
-template <class T> 
-inline bool 
-ascii_to_raw (std::istream &file, std::string &current_line, const char * &pos,
-              T *write, imagesize_t nvals, T max)
+// Parse the whitespace-separated decimal values (and '#' comments to
+// the end of the line) of the range [p,end), rescaling each from
+// [0,max] to the full range of T.  Value k of the range lands in
+// write[first+k], for those that fall below nvals; with write NULL, the
+// values are only counted.  Returns the number of values seen, stopping
+// (and clearing ok) at anything that isn't a value or comment.
+template <class T>
+inline imagesize_t
+ascii_to_raw (const char *p, const char *end, T *write, imagesize_t first,
+              imagesize_t nvals, unsigned int max, bool &ok)
 {
-    if (max)
-        for (imagesize_t i=0; i < nvals; i++) {
-            int tmp;
-            if (!nextVal (file, current_line, pos, tmp))
-                return false;
-            write[i] = std::min ((int)max, tmp) * std::numeric_limits<T>::max() / max;
+    imagesize_t n = 0;
+    while (p < end) {
+        if (isspace ((unsigned char) *p)) {
+            ++p;
+        } else if (*p == '#') {
+            while (p < end && *p != '\n')
+                ++p;
+        } else if (isdigit ((unsigned char) *p)) {
+            unsigned int val = 0;
+            for ( ;  p < end && isdigit ((unsigned char) *p);  ++p)
+                if (val <= max)   // past max it clamps anyway; don't overflow
+                    val = val * 10 + (*p - '0');
+            if (write && first + n < nvals)
+                write[first + n] = max ? T (std::min (val, max)
+                                            * std::numeric_limits<T>::max() / max)
+                                       : std::numeric_limits<T>::max();
+            ++n;
+        } else {
+            ok = false;
+            break;
         }
-    else
-        for (imagesize_t i=0; i < nvals; i++) 
-            write[i] = std::numeric_limits<T>::max();
-    return true;
+    }
+    return n;
 }
 
 
 
+// One block of lines of an ASCII PNM body.  The first pass over all
+// blocks (write == NULL) counts their values, the second, knowing where
+// each block's values begin, converts them.
+struct AsciiBlock {
+    const char *begin, *end;
+    imagesize_t first, count;
+    bool ok;
+};
+
+struct AsciiTask {
+    AsciiBlock *block;
+    unsigned char *write;
+    imagesize_t nvals;
+    unsigned int max;
+    bool wide;
+
+    void operator() () {
+        block->ok = true;
+        if (wide)
+            block->count = ascii_to_raw (block->begin, block->end,
+                                         (unsigned short *)write, block->first,
+                                         nvals, max, block->ok);
+        else
+            block->count = ascii_to_raw (block->begin, block->end,
+                                         write, block->first,
+                                         nvals, max, block->ok);
+    }
+};
+
+
+
 template <class T> 
 inline void 
 raw_to_raw (const T *read, T *write, imagesize_t nvals, T max)
 {
-    if (max)
+    if (max == std::numeric_limits<T>::max()) {
+        if (read != write)
+            memcpy (write, read, nvals * sizeof(T));
+    } else if (max)
         for (imagesize_t i=0; i < nvals; i++) {
             int tmp = read[i];
             write[i] = std::min ((int)max, tmp) * std::numeric_limits<T>::max() / max;
@@ -204,16 +204,15 @@ unpack (const unsigned char * read, unsigned char * write, imagesize_t size)
 inline void
 unpack_floats(const unsigned char * read, float * write, imagesize_t numsamples, float scaling_factor)
 {
-    float *read_floats = (float *)read;
-
-    if((scaling_factor < 0 && bigendian()) || (scaling_factor > 0 && littleendian())) {
-        swap_endian(read_floats, numsamples);
-    }
+    if((scaling_factor < 0 && bigendian()) || (scaling_factor > 0 && littleendian()))
+        swap_endian_copy (read, write, numsamples, sizeof(float));
+    else
+        memcpy (write, read, numsamples * sizeof(float));
 
     float absfactor = fabs(scaling_factor);
-    for(imagesize_t i = 0; i < numsamples; i++) {
-        write[i] = absfactor * read_floats[i];
-    }
+    if (absfactor != 1.0f)
+        for(imagesize_t i = 0; i < numsamples; i++)
+            write[i] *= absfactor;
 }
 
 
@@ -243,79 +242,154 @@ read_int (std::istream &in, T &dest, char comment='#')
 
 
 
-bool 
-PNMInput::read_file_scanline (void * data, int y)
+bool
+PNMInput::read_binary_scanlines (int ybegin, int yend, void *data)
 {
     try {
 
-    std::vector<unsigned char> buf;
-    bool good = true;
     if (!m_file)
         return false;
     int nsamples = m_spec.width * m_spec.nchannels;
+    size_t rowbytes = (m_pnm_type == P4) ? (m_spec.width + 7) / 8
+                                         : m_spec.scanline_bytes();
+    int nrows = yend - ybegin;
+
+    // The rows are fixed size, so [ybegin,yend) is one contiguous run of
+    // the file -- reversed for PFM, which is stored bottom-to-top.
+    int file_scanline = ybegin - m_spec.y;
+    if (m_pnm_type == PF || m_pnm_type == Pf)
+        file_scanline = m_spec.height - 1 - (yend - 1 - m_spec.y);
+    std::streamoff offset = std::streamoff(file_scanline) * rowbytes;
+    m_file.seekg (m_header_end_pos + offset, std::ios_base::beg);
+    m_buf.resize (nrows * rowbytes);
+    m_file.read ((char*)&m_buf[0], m_buf.size());
+    if (!m_file.good()) {
+        error ("Hit end of file unexpectedly");
+        return false;
+    }
 
-    // PFM files are bottom-to-top, so we need to seek to the right spot
-    if (m_pnm_type == PF || m_pnm_type == Pf) {
-        int file_scanline = m_spec.height - 1 - (y-m_spec.y);
-        std::streampos offset = file_scanline * m_spec.scanline_bytes();
-        m_file.seekg (m_header_end_pos + offset, std::ios_base::beg);
+    for (int y = ybegin;  y < yend;  ++y) {
+        int r = (m_pnm_type == PF || m_pnm_type == Pf) ? yend - 1 - y
+                                                       : y - ybegin;
+        const unsigned char *buf = &m_buf[r * rowbytes];
+        unsigned char *out = (unsigned char *)data
+                           + (y - ybegin) * m_spec.scanline_bytes();
+        switch (m_pnm_type) {
+            case P4:
+                unpack (buf, out, nsamples);
+                break;
+            case P5:
+            case P6:
+                if (m_max_val > std::numeric_limits<unsigned char>::max()) {
+                    if (littleendian())
+                        swap_endian_copy (buf, out, nsamples, 2);
+                    else
+                        memcpy (out, buf, rowbytes);
+                    raw_to_raw ((unsigned short *)out, (unsigned short *)out,
+                                nsamples, (unsigned short)m_max_val);
+                } else {
+                    raw_to_raw (buf, out, nsamples, (unsigned char)m_max_val);
+                }
+                break;
+            case Pf:
+            case PF:
+                unpack_floats (buf, (float *)out, nsamples, m_scaling_factor);
+                break;
+            default:
+                return false;
+        }
     }
+    return true;
 
-    if ((m_pnm_type >= P4 && m_pnm_type <= P6) || m_pnm_type == PF || m_pnm_type == Pf){
-        int numbytes;
-        if (m_pnm_type == P4)
-            numbytes = (m_spec.width + 7) / 8;
-        else if(m_pnm_type == PF || m_pnm_type == Pf)
-            numbytes = m_spec.nchannels * 4 * m_spec.width;
-        else
-            numbytes = m_spec.scanline_bytes();
-        buf.resize (numbytes);
-        m_file.read ((char*)&buf[0], numbytes);
-        if (!m_file.good())
-            return false;
     }
+    catch (const std::exception &e) {
+        error ("PNM exception: %s", e.what());
+        return false;
+    }
+}
 
-    switch (m_pnm_type) {
-        //Ascii 
-        case P1:
-            good &= ascii_to_raw (m_file, m_current_line, m_pos, (unsigned char *) data,
-                                  nsamples, (unsigned char)m_max_val);
-            invert ((unsigned char *)data, (unsigned char *)data, nsamples); 
-            break;
-        case P2:
-        case P3:
-            if (m_max_val > std::numeric_limits<unsigned char>::max())
-                good &= ascii_to_raw (m_file, m_current_line, m_pos, (unsigned short *) data,
-                                      nsamples, (unsigned short)m_max_val);
-            else 
-                good &= ascii_to_raw (m_file, m_current_line, m_pos, (unsigned char *) data,
-                                      nsamples, (unsigned char)m_max_val);
-            break;
-        //Raw
-        case P4:
-            unpack (&buf[0], (unsigned char *)data, nsamples);
-            break;
-        case P5:
-        case P6:
-            if (m_max_val > std::numeric_limits<unsigned char>::max()) {
-                if (littleendian())
-                    swap_endian ((unsigned short *)&buf[0], nsamples);
-                raw_to_raw ((unsigned short *)&buf[0], (unsigned short *) data, 
-                            nsamples, (unsigned short)m_max_val);
-            } else {
-                raw_to_raw ((unsigned char *)&buf[0], (unsigned char *) data, 
-                            nsamples, (unsigned char)m_max_val);
+
+
+bool
+PNMInput::decode_ascii ()
+{
+    try {
+
+    m_ascii_decoded = true;
+    m_ascii_nvals = 0;
+    if (!m_file)
+        return false;
+
+    // Slurp the whole body
+    m_file.seekg (0, std::ios_base::end);
+    std::streamoff len = std::streamoff (m_file.tellg()) - m_header_end_pos;
+    m_file.seekg (m_header_end_pos, std::ios_base::beg);
+    std::vector<char> text (std::max (std::streamoff(1), len));
+    m_file.read (&text[0], len);
+    if (m_file.gcount() != len)
+        return false;
+
+    imagesize_t nvals = m_spec.image_pixels() * m_spec.nchannels;
+    m_pixels.resize (m_spec.image_bytes());
+    bool wide = (m_max_val > std::numeric_limits<unsigned char>::max());
+
+    // Values and comments never cross a newline, so the text divides at
+    // line ends into blocks that can be parsed independently.  Bodies too
+    // small to be worth it stay in one block.
+    int nthreads = threads();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    const std::streamoff min_block = 256*1024;
+    nthreads = (int) std::max (std::streamoff(1),
+                               std::min (std::streamoff(nthreads),
+                                         len / min_block));
+    std::vector<AsciiBlock> blocks;
+    const char *p = &text[0], *end = p + len;
+    for (int b = 0;  b < nthreads && p < end;  ++b) {
+        const char *e = (b == nthreads-1) ? end
+                      : &text[0] + len * (b+1) / nthreads;
+        e = std::max (e, p);
+        while (e < end && *e++ != '\n')
+            ;
+        AsciiBlock block = { p, e, 0, 0, true };
+        blocks.push_back (block);
+        p = e;
+    }
+
+    AsciiTask task;
+    task.nvals = nvals;
+    task.max = m_max_val;
+    task.wide = wide;
+    for (int pass = 0;  pass < 2;  ++pass) {
+        task.write = pass ? &m_pixels[0] : NULL;
+        task_set tasks;
+        for (size_t b = 0;  b < blocks.size();  ++b) {
+            task.block = &blocks[b];
+            if (blocks.size() == 1)
+                task ();
+            else
+                tasks.push (task);
+        }
+        tasks.wait ();
+        if (pass == 0) {
+            // Where each block's values begin; stop at the first block
+            // with garbage in it.
+            imagesize_t first = 0;
+            for (size_t b = 0;  b < blocks.size();  ++b) {
+                blocks[b].first = first;
+                first += blocks[b].count;
+                if (! blocks[b].ok) {
+                    blocks.resize (b+1);
+                    break;
+                }
             }
-            break;
-        //Floating point
-        case Pf:
-        case PF:
-            unpack_floats(&buf[0], (float *)data, nsamples, m_scaling_factor);
-            break;
-        default:
-            return false;
+            m_ascii_nvals = std::min (first, nvals);
+        }
     }
-    return good;
+
+    if (m_pnm_type == P1)
+        invert (&m_pixels[0], &m_pixels[0], m_ascii_nvals);
+    return true;
 
     }
     catch (const std::exception &e) {
@@ -326,6 +400,23 @@ PNMInput::read_file_scanline (void * data, int y)
 
 
 
+bool
+PNMInput::read_ascii_scanlines (int ybegin, int yend, void *data)
+{
+    if (! m_ascii_decoded && ! decode_ascii ())
+        return false;
+    imagesize_t nsamples = imagesize_t(m_spec.width) * m_spec.nchannels;
+    if (imagesize_t(yend - m_spec.y) * nsamples > m_ascii_nvals) {
+        error ("Hit end of file unexpectedly");
+        return false;
+    }
+    memcpy (data, &m_pixels[(ybegin - m_spec.y) * m_spec.scanline_bytes()],
+            (yend - ybegin) * m_spec.scanline_bytes());
+    return true;
+}
+
+
+
 bool
 PNMInput::read_file_header ()
 {
@@ -451,9 +542,8 @@ PNMInput::open (const std::string &name, ImageSpec &newspec)
     close(); //close previously opened file
     
     Filesystem::open (m_file, name, std::ios::in|std::ios::binary);
- 
-    m_current_line = "";
-    m_pos = m_current_line.c_str();
+    m_ascii_decoded = false;
+    m_ascii_nvals = 0;
 
     if (!read_file_header())
         return false;
@@ -468,6 +558,9 @@ bool
 PNMInput::close ()
 {
     m_file.close();
+    std::vector<unsigned char>().swap (m_buf);
+    std::vector<unsigned char>().swap (m_pixels);
+    m_ascii_decoded = false;
     return true;
 }
 
@@ -475,12 +568,20 @@ PNMInput::close ()
 
 bool
 PNMInput::read_native_scanline (int y, int z, void *data)
+{
+    return read_native_scanlines (y, y+1, z, data);
+}
+
+
+
+bool
+PNMInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
 {
     if (z)
         return false;
-    if (!read_file_scanline (data, y))
-        return false;
-    return true;
+    if (m_pnm_type >= P1 && m_pnm_type <= P3)
+        return read_ascii_scanlines (ybegin, yend, data);
+    return read_binary_scanlines (ybegin, yend, data);
 }
 
 OIIO_PLUGIN_NAMESPACE_END
@@ -152,6 +152,9 @@ private:
 
         std::vector<ChannelInfo> channel_info;
         std::map<int16_t, ChannelInfo *> channel_id_map;
+        //True once the channel compression and row positions have been
+        //read, which is deferred until the layer is first read
+        bool channels_loaded;
 
         char bm_key[4];
         uint8_t opacity;
@@ -226,6 +229,9 @@ private:
     double m_background_color[4];
     ///< Do not convert unassociated alpha
     bool m_keep_unassociated_alpha;
+    //psd:CompositeOnly config option, skip the layer records and only
+    //read the merged image (subimage 0)
+    bool m_composite_only;
 
 
     FileHeader m_header;
@@ -569,13 +575,21 @@ PSDInput::open (const std::string &name, ImageSpec &newspec)
     if (!load_layers ())
         return false;
 
-    // Global Mask Info
-    if (!load_global_mask_info ())
-        return false;
+    if (m_composite_only) {
+        // Nothing else in the layer and mask section is needed for the
+        // merged image, so go straight to the Image Data Section
+        m_file.seekg (m_layer_mask_info.end);
+        if (!check_io ())
+            return false;
+    } else {
+        // Global Mask Info
+        if (!load_global_mask_info ())
+            return false;
 
-    // Global Additional Layer Info
-    if (!load_global_additional ())
-        return false;
+        // Global Additional Layer Info
+        if (!load_global_additional ())
+            return false;
+    }
 
     // Image Data
     if (!load_image_data ())
@@ -601,6 +615,7 @@ PSDInput::open (const std::string &name, ImageSpec &newspec,
                 const ImageSpec &config)
 {
     m_WantRaw = config.get_int_attribute ("psd:RawData", 0) != 0;
+    m_composite_only = config.get_int_attribute ("psd:CompositeOnly", 0) != 0;
 
     if (config.get_int_attribute("oiio:UnassociatedAlpha", 0) == 1)
         m_keep_unassociated_alpha = true;
@@ -701,6 +716,10 @@ PSDInput::read_native_scanline (int y, int z, void *data)
     if (y < 0 || y > m_spec.height)
         return false;
 
+    // Layer channel data is only indexed when the layer is first read
+    if (m_subimage > 0 && !load_layer_channels (m_layers[m_subimage - 1]))
+        return false;
+
     if (m_channel_buffers.size () < m_channels[m_subimage].size ())
         m_channel_buffers.resize (m_channels[m_subimage].size ());
 
@@ -777,6 +796,7 @@ PSDInput::init ()
     m_rle_buffer.clear ();
     m_transparency_index = -1;
     m_keep_unassociated_alpha = false;
+    m_composite_only = false;
     m_background_color[0] = 1.0;
     m_background_color[1] = 1.0;
     m_background_color[2] = 1.0;
@@ -1314,18 +1334,31 @@ PSDInput::load_layers ()
         m_image_data.transparency = true;
         layer_info.layer_count = -layer_info.layer_count;
     }
+    // The transparency flag is all the merged image needs from here
+    if (m_composite_only)
+        return check_io ();
+
     m_layers.resize (layer_info.layer_count);
     for (int16_t layer_nbr = 0; layer_nbr < layer_info.layer_count; ++layer_nbr) {
         Layer &layer = m_layers[layer_nbr];
         if (!load_layer (layer))
             return false;
     }
-    for (int16_t layer_nbr = 0; layer_nbr < layer_info.layer_count; ++layer_nbr) {
-        Layer &layer = m_layers[layer_nbr];
-        if (!load_layer_channels (layer))
-            return false;
+    // The channel image data follows the layer records, stored in the
+    // same order.  Only note where each channel starts; its compression
+    // and RLE lengths are read by load_layer_channels when needed.
+    std::streampos pos = m_file.tellg ();
+    BOOST_FOREACH (Layer &layer, m_layers) {
+        BOOST_FOREACH (ChannelInfo &channel_info, layer.channel_info) {
+            channel_info.data_pos = pos;
+            pos += (std::streamoff)channel_info.data_length;
+        }
     }
-    return true;
+    if (pos > layer_info.end) {
+        error ("[Layer Info] channel data exceeds section length");
+        return false;
+    }
+    return check_io ();
 }
 
 
@@ -1344,6 +1377,7 @@ PSDInput::load_layer (Layer &layer)
     layer.width = std::abs((int)layer.right - (int)layer.left);
     layer.height = std::abs((int)layer.bottom - (int)layer.top);
     layer.channel_info.resize (layer.channel_count);
+    layer.channels_loaded = false;
     for(uint16_t channel = 0; channel < layer.channel_count; channel++) {
         ChannelInfo &channel_info = layer.channel_info[channel];
         read_bige<int16_t> (channel_info.channel_id);
@@ -1450,11 +1484,16 @@ PSDInput::load_layer (Layer &layer)
 bool
 PSDInput::load_layer_channels (Layer &layer)
 {
+    if (layer.channels_loaded)
+        return true;
+
     for (uint16_t channel = 0; channel < layer.channel_count; ++channel) {
         ChannelInfo &channel_info = layer.channel_info[channel];
+        m_file.seekg (channel_info.data_pos);
         if (!load_layer_channel (layer, channel_info))
             return false;
     }
+    layer.channels_loaded = true;
     return true;
 }
 
@@ -1522,11 +1561,20 @@ bool
 PSDInput::read_rle_lengths (uint32_t height, std::vector<uint32_t> &rle_lengths)
 {
     rle_lengths.resize (height);
-    for (uint32_t row = 0; row < height && m_file; ++row) {
-        if (m_header.version == 1)
-            read_bige<uint16_t> (rle_lengths[row]);
-        else
-            read_bige<uint32_t> (rle_lengths[row]);
+    if (!height)
+        return true;
+
+    // Read the whole table at once rather than one value per row
+    if (m_header.version == 1) {
+        std::vector<uint16_t> lengths (height);
+        m_file.read ((char *)&lengths[0], height * sizeof(uint16_t));
+        if (!bigendian ())
+            swap_endian (&lengths[0], height);
+        std::copy (lengths.begin (), lengths.end (), rle_lengths.begin ());
+    } else {
+        m_file.read ((char *)&rle_lengths[0], height * sizeof(uint32_t));
+        if (!bigendian ())
+            swap_endian (&rle_lengths[0], height);
     }
     return check_io ();
 }
@@ -40,7 +40,7 @@ OIIO_PLUGIN_NAMESPACE_BEGIN
 
 class PtexInput : public ImageInput {
 public:
-    PtexInput () : m_ptex(NULL) { init(); }
+    PtexInput () : m_ptex(NULL), m_cache(NULL) { init(); }
     virtual ~PtexInput () { close(); }
     virtual const char * format_name (void) const { return "ptex"; }
     virtual int supports (string_view feature) const {
@@ -49,6 +49,8 @@ public:
              || feature == "iptc"); // Because of arbitrary_metadata
     }
     virtual bool open (const std::string &name, ImageSpec &newspec);
+    virtual bool open (const std::string &name, ImageSpec &newspec,
+                       const ImageSpec &config);
     virtual bool close ();
     virtual int current_subimage (void) const { return m_subimage; }
     virtual int current_miplevel (void) const { return m_miplevel; }
@@ -58,6 +60,8 @@ public:
 
 private:
     PtexTexture *m_ptex;
+    PtexCache *m_cache;
+    size_t m_cache_bytes;   ///< Memory the Ptex library may hold for us
     int m_subimage;
     int m_miplevel;
     int m_numFaces;
@@ -74,6 +78,10 @@ private:
         if (m_ptex)
             m_ptex->release();
         m_ptex = NULL;
+        if (m_cache)
+            m_cache->release();
+        m_cache = NULL;
+        m_cache_bytes = 8 * 1024 * 1024;
         m_subimage = -1;
         m_miplevel = -1;
     }
@@ -101,17 +109,37 @@ OIIO_PLUGIN_EXPORTS_END
 
 
 
+bool
+PtexInput::open (const std::string &name, ImageSpec &newspec,
+                 const ImageSpec &config)
+{
+    // "ptex:maxmem" (in MB) bounds the face data that the Ptex library
+    // keeps around between reads.
+    int maxmem = config.get_int_attribute ("ptex:maxmem", 8);
+    m_cache_bytes = size_t(std::max (maxmem, 1)) * 1024 * 1024;
+    return open (name, newspec);
+}
+
+
+
 bool
 PtexInput::open (const std::string &name, ImageSpec &newspec)
 {
+    // Read through a private PtexCache with a small memory limit instead
+    // of a bare PtexTexture, which would hold on to every face it ever
+    // loaded.  Caching of the pixels is the job of whoever is reading
+    // them (e.g., the ImageCache, which sees each face as a subimage and
+    // each face resolution as a MIP level), so the Ptex library should
+    // only keep what it needs to decode the next tile.
     Ptex::String perr;
-    m_ptex = PtexTexture::open (name.c_str(), perr, true /*premultiply*/);
+    m_cache = PtexCache::create (1 /*maxFiles*/, m_cache_bytes,
+                                 true /*premultiply*/);
+    m_ptex = m_cache ? m_cache->get (name.c_str(), perr) : NULL;
+    if (! m_ptex && perr.empty())
+        perr = "could not open \"" + name + "\"";
     if (! perr.empty()) {
-        if (m_ptex) {
-            m_ptex->release ();
-            m_ptex = NULL;
-        }
         error ("%s", perr.c_str());
+        init ();
         return false;
     }
 
@@ -128,8 +156,10 @@ PtexInput::open (const std::string &name, ImageSpec &newspec)
 bool
 PtexInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
 {
-    if (m_subimage == subimage && m_miplevel == miplevel)
+    if (m_subimage == subimage && m_miplevel == miplevel) {
+        newspec = m_spec;
         return true;   // Already fine
+    }
 
     if (subimage < 0 || subimage >= m_numFaces)
         return false;
@@ -284,10 +314,16 @@ PtexInput::read_native_tile (int x, int y, int z, void *data)
 
     bool ok = true;
     void *tiledata = f->getData();
-    if (tiledata) {
-        memcpy (data, tiledata, m_spec.tile_bytes());
-    } else {
+    if (! tiledata) {
         ok = false;
+    } else if (f->isConstant()) {
+        // Constant faces and tiles only store a single pixel
+        size_t pixelbytes = m_spec.pixel_bytes();
+        imagesize_t npixels = m_spec.tile_pixels();
+        for (imagesize_t p = 0;  p < npixels;  ++p)
+            memcpy ((char *)data + p*pixelbytes, tiledata, pixelbytes);
+    } else {
+        memcpy (data, tiledata, m_spec.tile_bytes());
     }
 
     if (m_isTiled)
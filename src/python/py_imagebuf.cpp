@@ -28,7 +28,6 @@
   (This is the Modified BSD License)
 */
 
-#include <boost/scoped_array.hpp>
 
 #include "py_oiio.h"
 #include "OpenImageIO/platform.h"
@@ -77,11 +76,31 @@ ImageBuf_reset_name_config (ImageBuf &buf, const std::string &name,
 void
 ImageBuf_reset_spec (ImageBuf &buf, const ImageSpec &spec)
 {
+    ScopedGILRelease gil;   // allocates (and zeroes) the pixels
     buf.reset (spec);
 }
 
 
 
+bool
+ImageBuf_init_spec (ImageBuf &buf, const std::string &filename,
+                    int subimage, int miplevel)
+{
+    ScopedGILRelease gil;
+    return buf.init_spec (filename, subimage, miplevel);
+}
+
+
+
+bool
+ImageBuf_copy_pixels (ImageBuf &dst, const ImageBuf &src)
+{
+    ScopedGILRelease gil;
+    return dst.copy_pixels (src);
+}
+
+
+
 bool
 ImageBuf_read (ImageBuf &buf, int subimage=0, int miplevel=0,
                bool force=false, TypeDesc convert=TypeDesc::UNKNOWN)
@@ -128,6 +147,14 @@ ImageBuf_make_writeable (ImageBuf &buf, bool keep_cache_type)
 }
 
 
+bool
+ImageBuf_pin_tiles (ImageBuf &buf, ROI roi)
+{
+    ScopedGILRelease gil;
+    return buf.pin_tiles (roi);
+}
+
+
 
 void
 ImageBuf_set_write_format (ImageBuf &buf, TypeDesc::BASETYPE format)
@@ -306,12 +333,16 @@ ImageBuf_get_pixels (const ImageBuf &buf, TypeDesc format, ROI roi=ROI::All())
     roi.chend = std::min (roi.chend, buf.nchannels()+1);
 
     size_t size = (size_t) roi.npixels() * roi.nchannels() * format.size();
-    boost::scoped_array<char> data (new char [size]);
-    if (! buf.get_pixels (roi, format, &data[0])) {
-        return object(handle<>(Py_None));
+    char *data = NULL;
+    object array = Python_array_alloc (format, size, data);
+    bool ok;
+    {
+        ScopedGILRelease gil;
+        ok = buf.get_pixels (roi, format, data);
     }
-
-    return C_array_to_Python_array (data.get(), format, size);
+    if (! ok)
+        return object(handle<>(Py_None));
+    return array;
 }
 
 BOOST_PYTHON_FUNCTION_OVERLOADS(ImageBuf_get_pixels_overloads,
@@ -358,6 +389,7 @@ ImageBuf_set_pixels_tuple (ImageBuf &buf, ROI roi, tuple data)
     py_to_stdvector (vals, data);
     if (size > vals.size())
         return false;   // Not enough data to fill our ROI
+    ScopedGILRelease gil;
     buf.set_pixels (roi, TypeDesc::TypeFloat, &vals[0]);
     return true;
 }
@@ -379,12 +411,58 @@ ImageBuf_set_pixels_array (ImageBuf &buf, ROI roi, numeric::array data)
     if (!addr || size > pylen)
         return false;   // Not enough data to fill our ROI
 
+    ScopedGILRelease gil;
     buf.set_pixels (roi, type, addr);
     return true;
 }
 
 
 
+// A writable memoryview aliasing the ImageBuf's own pixel memory, shaped
+// (depth,) height, width, nchannels, with no copy at all.  None if the
+// pixels aren't held locally (e.g. backed by the ImageCache), are deep,
+// or aren't laid out contiguously (a strided view or a blocked layout).
+// The view keeps the ImageBuf alive, but is only meaningful until the
+// ImageBuf is reset or reallocated.
+object
+ImageBuf_localpixels (ImageBuf &buf)
+{
+#if PY_MAJOR_VERSION >= 3
+    if (! buf.localpixels() || buf.deep() || ! buf.contiguous())
+        return object();
+    const ImageSpec &spec (buf.spec());
+    const char *code;
+    switch (spec.format.basetype) {
+    case TypeDesc::HALF : code = "e"; break;
+    case TypeDesc::UINT8 :
+    case TypeDesc::INT8 :
+    case TypeDesc::UINT16 :
+    case TypeDesc::INT16 :
+    case TypeDesc::UINT32 :
+    case TypeDesc::INT32 :
+    case TypeDesc::FLOAT :
+    case TypeDesc::DOUBLE : code = python_array_code (spec.format); break;
+    default : return object();
+    }
+    Py_ssize_t shape[4] = { spec.depth, spec.height, spec.width,
+                            spec.nchannels };
+    int skip = spec.depth > 1 ? 0 : 1;
+    Py_buffer view;
+    memset (&view, 0, sizeof(view));
+    view.buf = buf.localpixels ();
+    view.len = Py_ssize_t (spec.image_bytes ());
+    view.itemsize = Py_ssize_t (spec.format.size ());
+    view.format = const_cast<char *>(code);
+    view.ndim = 4 - skip;
+    view.shape = shape + skip;
+    return object (handle<> (PyMemoryView_FromBuffer (&view)));
+#else
+    return object();
+#endif
+}
+
+
+
 DeepData&
 ImageBuf_deepdataref (ImageBuf *ib)
 {
@@ -421,7 +499,7 @@ void declare_imagebuf()
         .def("reset", &ImageBuf_reset_name_config)
         .def("reset", &ImageBuf_reset_spec)
         .add_property ("initialized", &ImageBuf::initialized)
-        .def("init_spec", &ImageBuf::init_spec)
+        .def("init_spec", &ImageBuf_init_spec)
         .def("read",  &ImageBuf_read,
              ImageBuf_read_overloads())
         .def("read",  &ImageBuf_read2,
@@ -431,9 +509,16 @@ void declare_imagebuf()
         // FIXME -- write(ImageOut&)
         .def("make_writeable", &ImageBuf_make_writeable,
              (arg("keep_cache_type")=false))
+        .def("pin_tiles", &ImageBuf_pin_tiles,
+             (arg("roi")=ROI::All()))
+        .def("unpin_tiles", &ImageBuf::unpin_tiles)
         .def("set_write_format", &ImageBuf_set_write_format)
         .def("set_write_tiles", &ImageBuf::set_write_tiles,
              (arg("width")=0, arg("height")=0, arg("depth")=0))
+        .def("set_local_tiles", &ImageBuf::set_local_tiles,
+             (arg("width"), arg("height")=0))
+        .add_property ("local_tile_width", &ImageBuf::local_tile_width)
+        .add_property ("local_tile_height", &ImageBuf::local_tile_height)
 
         .def("spec", &ImageBuf::spec,
                 return_value_policy<copy_const_reference>())
@@ -483,7 +568,7 @@ void declare_imagebuf()
         .def("pixelindex", &ImageBuf::pixelindex,
              (arg("x"), arg("y"), arg("z"), arg("check_range")=false))
         .def("copy_metadata", &ImageBuf::copy_metadata)
-        .def("copy_pixels", &ImageBuf::copy_pixels)
+        .def("copy_pixels", &ImageBuf_copy_pixels)
         .def("copy",  &ImageBuf_copy,
              ImageBuf_copy_overloads())
         .def("copy",  &ImageBuf_copy2,
@@ -509,6 +594,8 @@ void declare_imagebuf()
         .def("setpixel", &ImageBuf_setpixel1)
         .def("get_pixels", &ImageBuf_get_pixels, ImageBuf_get_pixels_overloads())
         .def("get_pixels", &ImageBuf_get_pixels_bt, ImageBuf_get_pixels_bt_overloads())
+        .def("localpixels", &ImageBuf_localpixels,
+             with_custodian_and_ward_postcall<0,1>())
         .def("set_pixels", &ImageBuf_set_pixels_tuple)
         .def("set_pixels", &ImageBuf_set_pixels_array)
 
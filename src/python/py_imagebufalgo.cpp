@@ -752,6 +752,19 @@ IBA_computePixelHashSHA1 (const ImageBuf &src,
 
 
 
+std::string
+IBA_computePixelHash (const ImageBuf &src, const std::string &algorithm,
+                      const std::string &extrainfo = std::string(),
+                      ROI roi = ROI::All(),
+                      int blocksize = 0, int nthreads=0)
+{
+    ScopedGILRelease gil;
+    return ImageBufAlgo::computePixelHash (src, algorithm, extrainfo, roi,
+                                           blocksize, nthreads);
+}
+
+
+
 bool
 IBA_warp (ImageBuf &dst, const ImageBuf &src, tuple values_M,
           const std::string &filtername = "", float filterwidth = 0.0f,
@@ -884,6 +897,27 @@ IBA_erode (ImageBuf &dst, const ImageBuf &src,
 
 
 
+bool
+IBA_box_blur (ImageBuf &dst, const ImageBuf &src,
+              int width, int height, ROI roi, int nthreads)
+{
+    ScopedGILRelease gil;
+    return ImageBufAlgo::box_blur (dst, src, width, height, roi, nthreads);
+}
+
+
+
+bool
+IBA_gaussian_blur (ImageBuf &dst, const ImageBuf &src,
+                   float sigmax, float sigmay, ROI roi, int nthreads)
+{
+    ScopedGILRelease gil;
+    return ImageBufAlgo::gaussian_blur (dst, src, sigmax, sigmay,
+                                        roi, nthreads);
+}
+
+
+
 bool
 IBA_laplacian (ImageBuf &dst, const ImageBuf &src, ROI roi, int nthreads)
 {
@@ -1119,6 +1153,34 @@ IBA_isConstantColor (const ImageBuf &src,
 
 
 
+bool
+IBA_integral_image (ImageBuf &dst, const ImageBuf &src,
+                    ROI roi, int nthreads)
+{
+    ScopedGILRelease gil;
+    return ImageBufAlgo::integral_image (dst, src, roi, nthreads);
+}
+
+
+
+object
+IBA_area_sum (const ImageBuf &sat, ROI roi = ROI::All())
+{
+    std::vector<float> sum (sat.nchannels());
+    bool r;
+    {
+        ScopedGILRelease gil;
+        r = ImageBufAlgo::area_sum (sat, roi, &sum[0]);
+    }
+    if (r) {
+        return C_to_tuple (&sum[0], (int)sum.size(), PyFloat_FromDouble);
+    } else {
+        return object();
+    }
+}
+
+
+
 bool IBA_isConstantChannel (const ImageBuf &src, int channel, float val,
                             ROI roi, int nthreads)
 {
@@ -1256,6 +1318,7 @@ void declare_imagebufalgo()
         .value("MakeTxEnvLatl", ImageBufAlgo::MakeTxEnvLatl)
         .value("MakeTxEnvLatlFromLightProbe",
                                 ImageBufAlgo::MakeTxEnvLatlFromLightProbe)
+        .value("MakeTxEnvCube", ImageBufAlgo::MakeTxEnvCube)
         .export_values()
     ;
 
@@ -1585,6 +1648,15 @@ void declare_imagebufalgo()
              (arg("src"), arg("roi")=ROI::All(), arg("nthreads")=0))
         .staticmethod("isConstantColor")
 
+        .def("integral_image", &IBA_integral_image,
+             (arg("dst"), arg("src"),
+              arg("roi")=ROI::All(), arg("nthreads")=0))
+        .staticmethod("integral_image")
+
+        .def("area_sum", &IBA_area_sum,
+             (arg("sat"), arg("roi")=ROI::All()))
+        .staticmethod("area_sum")
+
         .def("isConstantChannel", &IBA_isConstantChannel,
              (arg("src"), arg("channel"), arg("val"),
               arg("roi")=ROI::All(), arg("nthreads")=0))
@@ -1605,6 +1677,11 @@ void declare_imagebufalgo()
               arg("blocksize")=0, arg("nthreads")=0))
         .staticmethod("computePixelHashSHA1")
 
+        .def("computePixelHash", &IBA_computePixelHash,
+             (arg("src"), arg("algorithm"), arg("extrainfo")="",
+              arg("roi")=ROI::All(), arg("blocksize")=0, arg("nthreads")=0))
+        .staticmethod("computePixelHash")
+
         .def("warp", &IBA_warp,
              (arg("dst"), arg("src"), arg("M"),
               arg("filtername")="", arg("filterwidth")=0.0f,
@@ -1671,6 +1748,18 @@ void declare_imagebufalgo()
               arg("roi")=ROI::All(), arg("nthreads")=0))
         .staticmethod("erode")
 
+        .def("box_blur", &IBA_box_blur,
+             (arg("dst"), arg("src"),
+              arg("width")=3, arg("height")=-1,
+              arg("roi")=ROI::All(), arg("nthreads")=0))
+        .staticmethod("box_blur")
+
+        .def("gaussian_blur", &IBA_gaussian_blur,
+             (arg("dst"), arg("src"),
+              arg("sigmax"), arg("sigmay")=-1.0f,
+              arg("roi")=ROI::All(), arg("nthreads")=0))
+        .staticmethod("gaussian_blur")
+
         .def("laplacian", &IBA_laplacian,
              (arg("dst"), arg("src"),
               arg("roi")=ROI::All(), arg("nthreads")=0))
@@ -28,10 +28,13 @@
   (This is the Modified BSD License)
 */
 
-#include <boost/scoped_array.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include "py_oiio.h"
 #include "OpenImageIO/ustring.h"
+#include "OpenImageIO/thread.h"
 
 namespace PyOpenImageIO
 {
@@ -79,24 +82,138 @@ object ImageCacheWrap::get_pixels (const std::string &filename_,
                        int ybegin, int yend, int zbegin, int zend,
                        TypeDesc datatype)
 { 
-    ScopedGILRelease gil;
     ustring filename (filename_);
     int chbegin = 0, chend = 0;
-    if (! m_cache->get_image_info (filename, subimage, miplevel,
-                                   ustring("channels"), TypeDesc::INT, &chend))
+    bool ok;
+    {
+        ScopedGILRelease gil;
+        ok = m_cache->get_image_info (filename, subimage, miplevel,
+                                      ustring("channels"), TypeDesc::INT, &chend);
+    }
+    if (! ok)
         return object(handle<>(Py_None));  // couldn't open file
 
+    // Read straight into the Python array; it must be created (and
+    // returned) with the GIL held.
     size_t size = size_t ((xend-xbegin) * (yend-ybegin) * (zend-zbegin) *
                           (chend-chbegin) * datatype.size());
-    boost::scoped_array<char> data (new char [size]);
-    if (! m_cache->get_pixels (filename, subimage, miplevel, xbegin, xend,
-                               ybegin, yend, zbegin, zend, datatype, &data[0]))
+    char *data = NULL;
+    object array = Python_array_alloc (datatype, size, data);
+    {
+        ScopedGILRelease gil;
+        ok = m_cache->get_pixels (filename, subimage, miplevel, xbegin, xend,
+                                  ybegin, yend, zbegin, zend, datatype, data);
+    }
+    if (! ok)
         return object(handle<>(Py_None));   // get_pixels failed;
+    return array;
+}
+
+
+static void
+get_pixels_region_task (ImageCache *cache, ustring filename, int subimage,
+                        int miplevel, const ROI &roi, TypeDesc format,
+                        void *data, char *ok)
+{
+    ImageCache::Perthread *thread_info = cache->get_perthread_info ();
+    ImageCache::ImageHandle *handle = cache->get_image_handle (filename,
+                                                               thread_info);
+    *ok = handle && cache->get_pixels (handle, thread_info, subimage,
+                                       miplevel, roi.xbegin, roi.xend,
+                                       roi.ybegin, roi.yend, roi.zbegin,
+                                       roi.zend, roi.chbegin, roi.chend,
+                                       format, data);
+}
+
+
+
+// Fetch a whole list of regions of one image into a single writable
+// buffer, where they are stored one after another, each contiguous
+// (channels of a region being clamped to those in the file).  The
+// regions are fetched in parallel (nthreads at once, or with the default
+// thread pool if 0) without holding the GIL.  Returns a list of
+// per-region success flags, or None if the file can't be opened.
+object
+ImageCacheWrap::get_pixels_regions (const std::string &filename_,
+                                    int subimage, int miplevel, object rois,
+                                    object buffer, TypeDesc format,
+                                    int nthreads)
+{
+    ustring filename (filename_);
+    int nchannels = 0;
+    bool ok;
+    {
+        ScopedGILRelease gil;
+        ok = m_cache->get_image_info (filename, subimage, miplevel,
+                                      ustring("channels"), TypeDesc::INT,
+                                      &nchannels);
+    }
+    if (! ok)
+        return object(handle<>(Py_None));  // couldn't open file
+    if (format == TypeDesc::UNKNOWN)
+        format = TypeDesc::FLOAT;
+
+    size_t n = len (rois);
+    std::vector<ROI> regions (n);
+    std::vector<size_t> offsets (n);
+    size_t total = 0;
+    for (size_t i = 0;  i < n;  ++i) {
+        ROI roi = extract<ROI> (rois[i]);
+        roi.chend = std::min (roi.chend, nchannels);
+        if (! roi.defined() || roi.chbegin < 0 || roi.nchannels() <= 0) {
+            PyErr_SetString (PyExc_ValueError,
+                             "get_pixels_regions needs defined regions");
+            throw_error_already_set ();
+        }
+        regions[i] = roi;
+        offsets[i] = total;
+        total += roi.npixels() * roi.nchannels() * format.size();
+    }
+    PyWritableBuffer buf (buffer);
+    if (! buf.data())
+        throw_error_already_set ();
+    if (buf.size() < total) {
+        PyErr_SetString (PyExc_ValueError,
+                         "get_pixels_regions buffer is too small");
+        throw_error_already_set ();
+    }
+
+    std::vector<char> rok (n, 0);
+    {
+        ScopedGILRelease gil;
+        boost::scoped_ptr<thread_pool> pool;
+        if (nthreads > 0)
+            pool.reset (new thread_pool (nthreads - 1));
+        task_set tasks (pool.get());
+        char *data = (char *) buf.data();
+        for (size_t i = 0;  i < n;  ++i)
+            tasks.push (boost::bind (get_pixels_region_task, m_cache,
+                                     filename, subimage, miplevel,
+                                     boost::cref(regions[i]), format,
+                                     data + offsets[i], &rok[i]));
+        tasks.wait ();
+    }
+    list result;
+    for (size_t i = 0;  i < n;  ++i)
+        result.append (bool (rok[i]));
+    return result;
+}
 
-    return C_array_to_Python_array (data.get(), datatype, size);
+
+
+object
+ImageCacheWrap_get_pixels_regions_bt (ImageCacheWrap &ic,
+                                      const std::string &filename,
+                                      int subimage, int miplevel, object rois,
+                                      object buffer, TypeDesc::BASETYPE format,
+                                      int nthreads)
+{
+    return ic.get_pixels_regions (filename, subimage, miplevel, rois, buffer,
+                                  format, nthreads);
 }
 
 
+
 //Not sure how to expose this to Python. 
 /*
 Tile *get_tile (ImageCache &ic, ustring filename, int subimage,
@@ -206,6 +323,13 @@ void declare_imagecache()
         // .def("get_imagespec", &ImageCacheWrap::get_imagespec,
         //      (arg("subimage")=0)),
         .def("get_pixels", &ImageCacheWrap::get_pixels)
+        .def("get_pixels_regions", &ImageCacheWrap::get_pixels_regions,
+             (arg("filename"), arg("subimage"), arg("miplevel"),
+              arg("rois"), arg("buffer"),
+              arg("format")=TypeDesc(TypeDesc::FLOAT), arg("nthreads")=0))
+        .def("get_pixels_regions", &ImageCacheWrap_get_pixels_regions_bt,
+             (arg("filename"), arg("subimage"), arg("miplevel"),
+              arg("rois"), arg("buffer"), arg("format"), arg("nthreads")=0))
 //      .def("get_tile", &ImageCacheWrap::get_tile)
 //      .def("release_tile", &ImageCacheWrap::release_tile)
 //      .def("tile_pixels", &ImageCacheWrap::tile_pixels)
@@ -28,7 +28,12 @@
   (This is the Modified BSD License)
 */
 
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
 #include "py_oiio.h"
+#include "OpenImageIO/thread.h"
 
 namespace PyOpenImageIO
 {
@@ -125,6 +130,7 @@ int ImageInputWrap::supports (const std::string &feature) const
 
 bool ImageInputWrap::close()
 {
+    ScopedGILRelease gil;
     return m_input->close();
 }
 
@@ -147,38 +153,135 @@ bool ImageInputWrap::seek_subimage(int subimage, int miplevel)
 
 
 
+// Bytes per pixel when reading channels [chbegin,chend) as format (or in
+// the native format if UNKNOWN).  chend < 0 means all channels; it's
+// clamped to the channels the file actually has.
+static size_t
+read_pixel_bytes (const ImageSpec &spec, int chbegin, int &chend,
+                  TypeDesc format)
+{
+    bool native = (format.basetype == TypeDesc::UNKNOWN);
+    if (chend < 0)
+        chend = spec.nchannels;
+    chend = clamp (chend, chbegin+1, spec.nchannels);
+    size_t nchans = size_t(chend - chbegin);
+    return native ? spec.pixel_bytes(chbegin, chend, native)
+                  : size_t(nchans * format.size());
+}
+
+
+
 // The read_image method is a bit different from the c++ interface. 
 // "function" is a function which takes a float, and the 
 // PyProgressCallback function is called automatically.
 object
 ImageInputWrap::read_image (int chbegin, int chend, TypeDesc format)
 {
-    // Allocate our own temp buffer and try to read the image into it.
-    // If the read fails, return None.
+    // Allocate the Python array and try to read the image straight into
+    // it.  If the read fails, return None.
     const ImageSpec &spec = m_input->spec();
-    bool native = (format.basetype == TypeDesc::UNKNOWN);
-    if (chend < 0)
-        chend = spec.nchannels;
-    chend = clamp (chend, chbegin+1, spec.nchannels);
-    size_t nchans = size_t(chend - chbegin);
-    size_t pixelsize = native ? spec.pixel_bytes(chbegin, chend, native)
-                              : size_t(nchans * format.size());
-    size_t size = size_t(spec.image_pixels()) * pixelsize;
-    char *data = new char[size];
+    size_t size = size_t(spec.image_pixels()) *
+                  read_pixel_bytes (spec, chbegin, chend, format);
+    char *data = NULL;
+    object array = Python_array_alloc (format, size, data);
     bool ok;
     {
         ScopedGILRelease gil;
         ok = m_input->read_image (chbegin, chend, format, data);
     }
-    if (! ok) {
-        delete [] data;  // never mind
+    if (! ok)
         return object(handle<>(Py_None));
+    return array;
+}
+
+
+
+// Read the image into a caller-supplied writable buffer (bytearray,
+// array, NumPy array...) of at least the right number of bytes, without
+// any intermediate copy.
+bool
+ImageInputWrap::read_image_into (object buffer, TypeDesc format,
+                                 int chbegin, int chend)
+{
+    const ImageSpec &spec = m_input->spec();
+    size_t size = size_t(spec.image_pixels()) *
+                  read_pixel_bytes (spec, chbegin, chend, format);
+    PyWritableBuffer buf (buffer);
+    if (! buf.data())
+        throw_error_already_set ();
+    if (buf.size() < size)
+        return false;   // Not enough room for the pixels
+    ScopedGILRelease gil;
+    return m_input->read_image (chbegin, chend, format, buf.data());
+}
+
+
+// Read all of subimage 0 of filename into data, if it fits in size bytes.
+static void
+read_image_into_task (const std::string &filename, TypeDesc format,
+                      void *data, size_t size, char *ok)
+{
+    ImageInput *in = ImageInput::open (filename);
+    if (! in)
+        return;
+    const ImageSpec &spec = in->spec();
+    int chend = -1;
+    size_t need = size_t(spec.image_pixels()) *
+                  read_pixel_bytes (spec, 0, chend, format);
+    *ok = (need <= size && in->read_image (format, data));
+    in->close ();
+    ImageInput::destroy (in);
+}
+
+
+
+// Read a whole list of files, each into the matching caller-supplied
+// buffer, in parallel (nthreads at once, or the default thread pool if 0)
+// and without holding the GIL.  Returns a list of per-file success flags.
+object
+ImageInputWrap::read_images_into (object filenames, object buffers,
+                                  TypeDesc format, int nthreads)
+{
+    size_t n = len (filenames);
+    if (size_t(len (buffers)) != n) {
+        PyErr_SetString (PyExc_ValueError,
+                         "read_images_into needs one buffer per file");
+        throw_error_already_set ();
+    }
+    std::vector<std::string> names (n);
+    std::vector<boost::shared_ptr<PyWritableBuffer> > bufs (n);
+    for (size_t i = 0;  i < n;  ++i) {
+        names[i] = extract<std::string> (filenames[i]);
+        bufs[i].reset (new PyWritableBuffer (buffers[i]));
+        if (! bufs[i]->data())
+            throw_error_already_set ();
+    }
+    std::vector<char> ok (n, 0);
+    {
+        ScopedGILRelease gil;
+        boost::scoped_ptr<thread_pool> pool;
+        if (nthreads > 0)
+            pool.reset (new thread_pool (nthreads - 1));
+        task_set tasks (pool.get());
+        for (size_t i = 0;  i < n;  ++i)
+            tasks.push (boost::bind (read_image_into_task, boost::cref(names[i]),
+                                     format, bufs[i]->data(), bufs[i]->size(),
+                                     &ok[i]));
+        tasks.wait ();
     }
-    object array = C_array_to_Python_array (data, format, size);
+    list result;
+    for (size_t i = 0;  i < n;  ++i)
+        result.append (bool (ok[i]));
+    return result;
+}
 
-    // clean up and return the array handle
-    delete [] data;
-    return array;
+
+object
+ImageInputWrap_read_images_into_bt (object filenames, object buffers,
+                                    TypeDesc::BASETYPE format, int nthreads)
+{
+    return ImageInputWrap::read_images_into (filenames, buffers, format,
+                                             nthreads);
 }
 
 
@@ -213,6 +316,15 @@ ImageInputWrap_read_image_default_chans (ImageInputWrap& in,
 }
 
 
+bool
+ImageInputWrap_read_image_into_bt (ImageInputWrap& in, object buffer,
+                                   TypeDesc::BASETYPE format,
+                                   int chbegin, int chend)
+{
+    return in.read_image_into (buffer, format, chbegin, chend);
+}
+
+
 
 object
 ImageInputWrap::read_scanline (int y, int z, TypeDesc format)
@@ -242,32 +354,43 @@ object
 ImageInputWrap::read_scanlines (int ybegin, int yend, int z,
                                 int chbegin, int chend, TypeDesc format)
 {
-    // Allocate our own temp buffer and try to read the scanline into it.
-    // If the read fails, return None.
+    // Allocate the Python array and try to read the scanlines straight
+    // into it.  If the read fails, return None.
     ASSERT (m_input);
     const ImageSpec &spec = m_input->spec();
-    bool native = (format.basetype == TypeDesc::UNKNOWN);
-    chend = clamp (chend, chbegin+1, spec.nchannels);
-    size_t nchans = size_t(chend - chbegin);
-    size_t pixelsize = native ? spec.pixel_bytes(chbegin, chend, native)
-                              : size_t(nchans * format.size());
-    size_t size = size_t((yend-ybegin) * spec.width) * pixelsize;
-    char *data = new char[size];
+    size_t size = size_t((yend-ybegin) * spec.width) *
+                  read_pixel_bytes (spec, chbegin, chend, format);
+    char *data = NULL;
+    object array = Python_array_alloc (format, size, data);
     bool ok;
     {
         ScopedGILRelease gil;
         ok = m_input->read_scanlines (ybegin, yend, z, chbegin, chend, format, data);
     }
-    if (! ok) {
-        delete [] data;  // never mind
+    if (! ok)
         return object(handle<>(Py_None));
-    }
+    return array;
+}
 
-    object array = C_array_to_Python_array (data, format, size);
 
-    // clean up and return the array handle
-    delete [] data;
-    return array;
+
+bool
+ImageInputWrap::read_scanlines_into (object buffer, int ybegin, int yend,
+                                     int z, int chbegin, int chend,
+                                     TypeDesc format)
+{
+    ASSERT (m_input);
+    const ImageSpec &spec = m_input->spec();
+    size_t size = size_t((yend-ybegin) * spec.width) *
+                  read_pixel_bytes (spec, chbegin, chend, format);
+    PyWritableBuffer buf (buffer);
+    if (! buf.data())
+        throw_error_already_set ();
+    if (buf.size() < size)
+        return false;   // Not enough room for the pixels
+    ScopedGILRelease gil;
+    return m_input->read_scanlines (ybegin, yend, z, chbegin, chend,
+                                    format, buf.data());
 }
 
 
@@ -288,6 +411,17 @@ ImageInputWrap_read_scanlines_default (ImageInputWrap& in, int ybegin, int yend,
 }
 
 
+bool
+ImageInputWrap_read_scanlines_into_bt (ImageInputWrap& in, object buffer,
+                                       int ybegin, int yend, int z,
+                                       int chbegin, int chend,
+                                       TypeDesc::BASETYPE format)
+{
+    return in.read_scanlines_into (buffer, ybegin, yend, z, chbegin, chend,
+                                   format);
+}
+
+
 
 object
 ImageInputWrap::read_tile (int x, int y, int z, TypeDesc format)
@@ -320,34 +454,42 @@ ImageInputWrap::read_tiles (int xbegin, int xend, int ybegin, int yend,
                             int zbegin, int zend, int chbegin, int chend,
                             TypeDesc format)
 {
-    // Allocate our own temp buffer and try to read the scanline into it.
-    // If the read fails, return None.
+    // Allocate the Python array and try to read the tiles straight into
+    // it.  If the read fails, return None.
     const ImageSpec &spec = m_input->spec();
-    bool native = (format.basetype == TypeDesc::UNKNOWN);
-    if (chend < 0)
-        chend = spec.nchannels;
-    chend = clamp (chend, chbegin+1, spec.nchannels);
-    size_t nchans = size_t(chend - chbegin);
-    size_t pixelsize = native ? spec.pixel_bytes(chbegin, chend, native)
-                              : size_t(nchans * format.size());
-    size_t size = size_t((xend-xbegin) * (yend-ybegin) * (zend-zbegin)) * pixelsize;
-    char *data = new char[size];
+    size_t size = size_t((xend-xbegin) * (yend-ybegin) * (zend-zbegin)) *
+                  read_pixel_bytes (spec, chbegin, chend, format);
+    char *data = NULL;
+    object array = Python_array_alloc (format, size, data);
     bool ok;
     {
         ScopedGILRelease gil;
         ok = m_input->read_tiles (xbegin, xend, ybegin, yend,
                                   zbegin, zend, chbegin, chend, format, data);
     }
-    if (! ok) {
-        delete [] data;  // never mind
+    if (! ok)
         return object(handle<>(Py_None));
-    }
+    return array;
+}
 
-    object array = C_array_to_Python_array (data, format, size);
 
-    // clean up and return the array handle
-    delete [] data;
-    return array;
+
+bool
+ImageInputWrap::read_tiles_into (object buffer, int xbegin, int xend,
+                                 int ybegin, int yend, int zbegin, int zend,
+                                 int chbegin, int chend, TypeDesc format)
+{
+    const ImageSpec &spec = m_input->spec();
+    size_t size = size_t((xend-xbegin) * (yend-ybegin) * (zend-zbegin)) *
+                  read_pixel_bytes (spec, chbegin, chend, format);
+    PyWritableBuffer buf (buffer);
+    if (! buf.data())
+        throw_error_already_set ();
+    if (buf.size() < size)
+        return false;   // Not enough room for the pixels
+    ScopedGILRelease gil;
+    return m_input->read_tiles (xbegin, xend, ybegin, yend, zbegin, zend,
+                                chbegin, chend, format, buf.data());
 }
 
 
@@ -372,6 +514,17 @@ ImageInputWrap_read_tiles_default (ImageInputWrap& in,
 }
 
 
+bool
+ImageInputWrap_read_tiles_into_bt (ImageInputWrap& in, object buffer,
+                                   int xbegin, int xend, int ybegin, int yend,
+                                   int zbegin, int zend, int chbegin, int chend,
+                                   TypeDesc::BASETYPE format)
+{
+    return in.read_tiles_into (buffer, xbegin, xend, ybegin, yend,
+                               zbegin, zend, chbegin, chend, format);
+}
+
+
 
 
 object
@@ -414,13 +567,21 @@ ImageInputWrap::read_native_deep_tiles (int xbegin, int xend, int ybegin, int ye
 
 object
 ImageInputWrap::read_native_deep_image ()
+{
+    return read_native_deep_image_chans (0, m_input->spec().nchannels);
+}
+
+
+
+object
+ImageInputWrap::read_native_deep_image_chans (int chbegin, int chend)
 {
     DeepData* dd = NULL;
     bool ok = true;
     {
         ScopedGILRelease gil;
         dd = new DeepData;
-        ok = m_input->read_native_deep_image (*dd);
+        ok = m_input->read_native_deep_image (chbegin, chend, *dd);
     }
     if (ok)
         return object(dd);
@@ -477,9 +638,33 @@ void declare_imageinput()
         .def("read_image",       &ImageInputWrap_read_image_bt_chans)
         .def("read_image",       &ImageInputWrap_read_image_default)
         .def("read_image",       &ImageInputWrap_read_image_default_chans)
+        .def("read_image_into",  &ImageInputWrap::read_image_into,
+             (arg("buffer"), arg("format")=TypeDesc(TypeDesc::FLOAT),
+              arg("chbegin")=0, arg("chend")=-1))
+        .def("read_image_into",  &ImageInputWrap_read_image_into_bt,
+             (arg("buffer"), arg("format"), arg("chbegin")=0, arg("chend")=-1))
+        .def("read_scanlines_into", &ImageInputWrap::read_scanlines_into,
+             (arg("buffer"), arg("ybegin"), arg("yend"), arg("z"),
+              arg("chbegin"), arg("chend"),
+              arg("format")=TypeDesc(TypeDesc::FLOAT)))
+        .def("read_scanlines_into", &ImageInputWrap_read_scanlines_into_bt)
+        .def("read_tiles_into",  &ImageInputWrap::read_tiles_into,
+             (arg("buffer"), arg("xbegin"), arg("xend"), arg("ybegin"),
+              arg("yend"), arg("zbegin"), arg("zend"),
+              arg("chbegin"), arg("chend"),
+              arg("format")=TypeDesc(TypeDesc::FLOAT)))
+        .def("read_tiles_into",  &ImageInputWrap_read_tiles_into_bt)
+        .def("read_images_into", &ImageInputWrap::read_images_into,
+             (arg("filenames"), arg("buffers"),
+              arg("format")=TypeDesc(TypeDesc::FLOAT), arg("nthreads")=0))
+        .def("read_images_into", &ImageInputWrap_read_images_into_bt,
+             (arg("filenames"), arg("buffers"), arg("format"),
+              arg("nthreads")=0))
+        .staticmethod("read_images_into")
         .def("read_native_deep_scanlines", &ImageInputWrap::read_native_deep_scanlines)
         .def("read_native_deep_tiles",     &ImageInputWrap::read_native_deep_tiles)
         .def("read_native_deep_image",     &ImageInputWrap::read_native_deep_image)
+        .def("read_native_deep_image",     &ImageInputWrap::read_native_deep_image_chans)
         .def("geterror",         &ImageInputWrap::geterror)
     ;
 }
@@ -42,7 +42,10 @@ object ImageOutputWrap::create (const std::string &filename,
                                 const std::string& plugin_searchpath="")
 {
     ImageOutputWrap *iow = new ImageOutputWrap;
-    iow->m_output = ImageOutput::create(filename, plugin_searchpath);
+    {
+        ScopedGILRelease gil;
+        iow->m_output = ImageOutput::create(filename, plugin_searchpath);
+    }
     if (iow->m_output == NULL) {
         delete iow;
         return object(handle<>(Py_None));
@@ -68,6 +71,7 @@ const ImageSpec& ImageOutputWrap::spec () const
 bool ImageOutputWrap::open (const std::string &name, const ImageSpec &newspec,
                             ImageOutput::OpenMode mode=ImageOutput::Create)
 {
+    ScopedGILRelease gil;
     return m_output->open(name, newspec, mode);
 }
 
@@ -86,6 +90,7 @@ bool ImageOutputWrap::open_specs (const std::string &name, tuple &specs)
         }
         Cspecs[i] = s();
     }
+    ScopedGILRelease gil;
     return m_output->open (name, int(length), &Cspecs[0]);
 }
 
@@ -93,6 +98,7 @@ bool ImageOutputWrap::open_specs (const std::string &name, tuple &specs)
 
 bool ImageOutputWrap::close()
 {
+    ScopedGILRelease gil;
     return m_output->close();
 }
     
@@ -389,6 +395,7 @@ ImageOutputWrap::write_deep_image (const DeepData &deepdata)
 
 bool ImageOutputWrap::copy_image (ImageInputWrap *iiw)
 {
+    ScopedGILRelease gil;
     return m_output->copy_image(iiw->m_input);
 }
 
@@ -80,27 +80,106 @@ typedesc_from_python_array_code (char code)
 
 
 object
-C_array_to_Python_array (const char *data, TypeDesc type, size_t size)
+Python_array_alloc (TypeDesc type, size_t size, char *&data)
 {
-    // Figure out what kind of array to return and create it
+    // Figure out what kind of array to return, and make one of the right
+    // length by repeating a single zero element (one allocation, rather
+    // than building it from an intermediate string).
     object arr_module(handle<>(PyImport_ImportModule("array")));
-    object array = arr_module.attr("array")(python_array_code(type));
+    list zero;
+    zero.append (0);
+    object array = arr_module.attr("array")(python_array_code(type), zero);
+    size_t itemsize = extract<size_t> (array.attr("itemsize"));
+    array = array * int((size + itemsize - 1) / itemsize);
+
+    // buffer_info() is (address, length) of the array's storage.
+    tuple info = extract<tuple> (array.attr("buffer_info")());
+    data = (char *) PyLong_AsVoidPtr (object(info[0]).ptr());
+    return array;
+}
+
+
 
-    // Create a Python byte array (or string for Python2) to hold the
-    // data.
+object
+C_array_to_Python_array (const char *data, TypeDesc type, size_t size)
+{
+    char *dst = NULL;
+    object array = Python_array_alloc (type, size, dst);
+    memcpy (dst, data, size);
+    return array;
+}
+
+
+
+PyWritableBuffer::PyWritableBuffer (const object &obj)
+    : m_data(NULL), m_size(0)
+{
 #if PY_MAJOR_VERSION >= 3
-    object string_py(handle<>(PyBytes_FromStringAndSize(data, size)));
+    if (PyObject_GetBuffer (obj.ptr(), &m_view,
+                            PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) == 0) {
+        m_data = m_view.buf;
+        m_size = size_t (m_view.len);
+    } else {
+        m_view.obj = NULL;
+    }
 #else
-    object string_py(handle<>(PyString_FromStringAndSize(data, size)));
+    Py_ssize_t len = 0;
+    if (PyObject_AsWriteBuffer (obj.ptr(), &m_data, &len) == 0)
+        m_size = size_t (len);
+    else
+        m_data = NULL;
 #endif
+}
+
 
-    // Copy the data from the string to the array, then return the array.
-#if (PY_MAJOR_VERSION < 3) || (PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION < 2)
-    array.attr("fromstring")(string_py);
+
+PyWritableBuffer::~PyWritableBuffer ()
+{
+#if PY_MAJOR_VERSION >= 3
+    if (m_view.obj)
+        PyBuffer_Release (&m_view);
+#endif
+}
+
+
+
+PyReadableBuffer::PyReadableBuffer (const object &obj)
+    : m_data(NULL), m_size(0), m_format(0)
+{
+#if PY_MAJOR_VERSION >= 3
+    if (PyObject_GetBuffer (obj.ptr(), &m_view,
+                            PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == 0) {
+        m_data = m_view.buf;
+        m_size = size_t (m_view.len);
+        if (m_view.format) {
+            // Skip any byte order/alignment prefix, e.g. "<f" or "=f".
+            const char *f = m_view.format;
+            while (*f == '@' || *f == '=' || *f == '<' || *f == '>' || *f == '!')
+                ++f;
+            m_format = f[0] && ! f[1] ? f[0] : '?';
+        } else {
+            m_format = 'B';   // NULL format means unsigned bytes
+        }
+    } else {
+        m_view.obj = NULL;
+    }
 #else
-    array.attr("frombytes")(string_py);
+    Py_ssize_t len = 0;
+    if (PyObject_AsReadBuffer (obj.ptr(), &m_data, &len) == 0)
+        m_size = size_t (len);
+    else
+        m_data = NULL;
+#endif
+}
+
+
+
+PyReadableBuffer::~PyReadableBuffer ()
+{
+#if PY_MAJOR_VERSION >= 3
+    if (m_view.obj)
+        PyBuffer_Release (&m_view);
 #endif
-    return array;
 }
 
 
@@ -369,6 +448,7 @@ OIIO_DECLARE_PYMODULE(OIIO_PYMODULE_NAME) {
     declare_imageoutput();
     declare_imagebuf();
     declare_imagecache();
+    declare_texturesystem();
 
     declare_imagebufalgo();
     
@@ -38,6 +38,7 @@
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/typedesc.h"
 #include "OpenImageIO/imagecache.h"
+#include "OpenImageIO/texture.h"
 #include "OpenImageIO/imagebuf.h"
 #include "OpenImageIO/deepdata.h"
 
@@ -60,6 +61,7 @@ void declare_typedesc();
 void declare_roi();
 void declare_deepdata();
 void declare_imagecache();
+void declare_texturesystem();
 void declare_imagebuf();
 void declare_imagebufalgo();
 void declare_paramvalue();
@@ -67,6 +69,11 @@ void declare_global();
 
 bool PyProgressCallback(void*, float);
 object C_array_to_Python_array (const char *data, TypeDesc type, size_t size);
+
+// Create a Python array of the element type C_array_to_Python_array
+// would pick for 'type', big enough for 'size' bytes, and point 'data' at
+// its storage so the caller can fill it in place instead of copying.
+object Python_array_alloc (TypeDesc type, size_t size, char *&data);
 const char * python_array_code (TypeDesc format);
 TypeDesc typedesc_from_python_array_code (char code);
 
@@ -261,6 +268,50 @@ private:
 
 
 
+// Holds the storage of a writable, contiguous Python buffer object
+// (bytearray, array.array, NumPy array, ...) so pixels can be read straight
+// into it.  The exporter can't resize or free it while this is alive,
+// which makes it safe to fill with the GIL released.  If obj is not
+// suitable, data() is NULL and a Python exception is pending.
+class PyWritableBuffer {
+public:
+    PyWritableBuffer (const object &obj);
+    ~PyWritableBuffer ();
+    void *data () const { return m_data; }
+    size_t size () const { return m_size; }
+private:
+#if PY_MAJOR_VERSION >= 3
+    Py_buffer m_view;
+#endif
+    void *m_data;
+    size_t m_size;
+};
+
+
+
+// Holds the storage of a contiguous Python buffer object for reading,
+// the counterpart of PyWritableBuffer.  Where the buffer describes its
+// elements (Python 3), format() is their struct code (such as 'f'), or 0
+// if unknown.  If obj is not suitable, data() is NULL and a Python
+// exception is pending.
+class PyReadableBuffer {
+public:
+    PyReadableBuffer (const object &obj);
+    ~PyReadableBuffer ();
+    const void *data () const { return m_data; }
+    size_t size () const { return m_size; }
+    char format () const { return m_format; }
+private:
+#if PY_MAJOR_VERSION >= 3
+    Py_buffer m_view;
+#endif
+    const void *m_data;
+    size_t m_size;
+    char m_format;
+};
+
+
+
 class ImageInputWrap {
 private:
     /// Friend declaration for ImageOutputWrap::copy_image
@@ -294,6 +345,16 @@ public:
     object read_native_deep_tiles (int xbegin, int xend, int ybegin, int yend,
                                    int zbegin, int zend, int chbegin, int chend);
     object read_native_deep_image ();
+    object read_native_deep_image_chans (int chbegin, int chend);
+    bool read_image_into (object buffer, TypeDesc format,
+                          int chbegin, int chend);
+    bool read_scanlines_into (object buffer, int ybegin, int yend, int z,
+                              int chbegin, int chend, TypeDesc format);
+    bool read_tiles_into (object buffer, int xbegin, int xend,
+                          int ybegin, int yend, int zbegin, int zend,
+                          int chbegin, int chend, TypeDesc format);
+    static object read_images_into (object filenames, object buffers,
+                                    TypeDesc format, int nthreads);
     std::string geterror() const;
 };
 
@@ -380,6 +441,9 @@ public:
                        int subimage, int miplevel, int xbegin, int xend,
                        int ybegin, int yend, int zbegin, int zend,
                        TypeDesc datatype);
+    object get_pixels_regions (const std::string &filename,
+                               int subimage, int miplevel, object rois,
+                               object buffer, TypeDesc format, int nthreads);
 
     //First needs to be exposed to python in imagecache.cpp
     /*
@@ -402,6 +466,27 @@ public:
 };
 
 
+class TextureSystemWrap {
+private:
+    TextureSystem *m_texsys;
+public:
+    static TextureSystemWrap *create (bool);
+    static void destroy (TextureSystemWrap*);
+    void attribute_int    (const std::string&, int );
+    void attribute_float  (const std::string&, float);
+    void attribute_string (const std::string&, const std::string&);
+    std::string resolve_filename (const std::string& filename);
+    bool texture (const std::string &filename, object s, object t,
+                  object result, int nchannels, object dsdx, object dtdx,
+                  object dsdy, object dtdy, const std::string &wrap,
+                  int firstchannel, int nthreads);
+    std::string geterror () const;
+    std::string getstats (int) const;
+    void invalidate (ustring);
+    void invalidate_all (bool);
+};
+
+
 
 } // namespace PyOpenImageIO
 
@@ -0,0 +1,299 @@
+/*
+  Copyright 2016 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "py_oiio.h"
+#include "OpenImageIO/ustring.h"
+#include "OpenImageIO/thread.h"
+
+namespace PyOpenImageIO
+{
+using namespace boost::python;
+
+TextureSystemWrap* TextureSystemWrap::create (bool shared=true)
+{
+    TextureSystemWrap *tsw = new TextureSystemWrap;
+    tsw->m_texsys = TextureSystem::create(shared);
+    return tsw;
+}
+
+void TextureSystemWrap::destroy (TextureSystemWrap *x)
+{
+    TextureSystem::destroy(x->m_texsys);
+}
+
+std::string TextureSystemWrap::resolve_filename (const std::string &val)
+{
+    ScopedGILRelease gil;
+    return m_texsys->resolve_filename(val);
+}
+
+
+
+// Number of points handed to each task of a batched texture() call.
+static const size_t texture_task_points = 1024;
+
+
+
+// Everything shared by the tasks of one batched texture() call.
+struct TexturePoints {
+    TextureSystem *texsys;
+    ustring filename;
+    TextureOpt opt;
+    const float *src[6];   // s, t, dsdx, dtdx, dsdy, dtdy; NULL means 0
+    int nchannels;
+    float *result;
+};
+
+
+
+// Look up points [begin,end) with texture_batch, BatchWidth lanes at a
+// time, and scatter the channel-major batch results into the point-major
+// result array.
+static void
+texture_points_task (const TexturePoints &job, size_t begin, size_t end,
+                     char *ok)
+{
+    const int B = TextureSystem::BatchWidth;
+    TextureSystem *texsys = job.texsys;
+    TextureSystem::Perthread *thread_info = texsys->get_perthread_info ();
+    TextureSystem::TextureHandle *handle =
+        texsys->get_texture_handle (job.filename, thread_info);
+    TextureOpt opt (job.opt);
+    const float * const *src = job.src;
+    int nchannels = job.nchannels;
+    float *result = job.result;
+    float zero[B], in[6][B];
+    for (int i = 0;  i < B;  ++i)
+        zero[i] = 0.0f;
+    float *r = OIIO_ALLOCA (float, nchannels*B);
+    *ok = 1;
+    for (size_t p = begin;  p < end;  p += B) {
+        int n = int (std::min (size_t(B), end - p));
+        const float *lanes[6];
+        for (int a = 0;  a < 6;  ++a) {
+            if (! src[a]) {
+                lanes[a] = zero;
+            } else if (n == B) {
+                lanes[a] = src[a] + p;
+            } else {
+                // Partial last batch: don't read past the caller's arrays
+                for (int i = 0;  i < B;  ++i)
+                    in[a][i] = i < n ? src[a][p+i] : 0.0f;
+                lanes[a] = in[a];
+            }
+        }
+        unsigned int mask = (n == B) ? ((1u << B) - 1) : ((1u << n) - 1);
+        if (! texsys->texture_batch (handle, thread_info, opt, mask,
+                                     lanes[0], lanes[1], lanes[2], lanes[3],
+                                     lanes[4], lanes[5], nchannels, r))
+            *ok = 0;
+        for (int i = 0;  i < n;  ++i)
+            for (int c = 0;  c < nchannels;  ++c)
+                result[(p+i)*nchannels+c] = r[c*B+i];
+    }
+}
+
+
+
+// Get the float contents of an optional per-point input array: NULL for
+// None, otherwise the contents, which must be npoints floats.
+static const float *
+point_array (const object &obj, boost::shared_ptr<PyReadableBuffer> &buf,
+             size_t &npoints, const char *name)
+{
+    if (obj.ptr() == Py_None)
+        return NULL;
+    buf.reset (new PyReadableBuffer (obj));
+    if (! buf->data())
+        throw_error_already_set ();
+    if (buf->format() && buf->format() != 'f') {
+        PyErr_Format (PyExc_TypeError,
+                      "texture: '%s' must hold 32-bit floats", name);
+        throw_error_already_set ();
+    }
+    size_t n = buf->size() / sizeof(float);
+    if (npoints == size_t(-1))
+        npoints = n;
+    if (n != npoints) {
+        PyErr_Format (PyExc_ValueError,
+                      "texture: '%s' has %d points, expected %d", name,
+                      int(n), int(npoints));
+        throw_error_already_set ();
+    }
+    return (const float *) buf->data();
+}
+
+
+
+// Filtered texture lookups for whole arrays of points: s, t, and the
+// (optional, None for 0) derivatives are float buffers with one value
+// per point, and the writable result receives nchannels floats per point.  The points
+// are looked up in batches, in parallel (nthreads at once, or with the
+// default thread pool if 0), without holding the GIL.
+bool
+TextureSystemWrap::texture (const std::string &filename, object s, object t,
+                            object result, int nchannels, object dsdx,
+                            object dtdx, object dsdy, object dtdy,
+                            const std::string &wrap, int firstchannel,
+                            int nthreads)
+{
+    if (s.ptr() == Py_None || t.ptr() == Py_None || nchannels < 1) {
+        PyErr_SetString (PyExc_ValueError,
+                         "texture needs s, t, and nchannels >= 1");
+        throw_error_already_set ();
+    }
+    size_t npoints = size_t(-1);
+    boost::shared_ptr<PyReadableBuffer> bufs[6];
+    TexturePoints job;
+    job.src[0] = point_array (s, bufs[0], npoints, "s");
+    job.src[1] = point_array (t, bufs[1], npoints, "t");
+    job.src[2] = point_array (dsdx, bufs[2], npoints, "dsdx");
+    job.src[3] = point_array (dtdx, bufs[3], npoints, "dtdx");
+    job.src[4] = point_array (dsdy, bufs[4], npoints, "dsdy");
+    job.src[5] = point_array (dtdy, bufs[5], npoints, "dtdy");
+    PyWritableBuffer res (result);
+    if (! res.data())
+        throw_error_already_set ();
+    if (res.size() < npoints * nchannels * sizeof(float)) {
+        PyErr_SetString (PyExc_ValueError, "texture result is too small");
+        throw_error_already_set ();
+    }
+
+    job.texsys = m_texsys;
+    job.filename = ustring (filename);
+    job.opt.firstchannel = firstchannel;
+    TextureOpt::parse_wrapmodes (wrap.c_str(), job.opt.swrap, job.opt.twrap);
+    job.nchannels = nchannels;
+    job.result = (float *) res.data();
+    size_t ntasks = (npoints + texture_task_points - 1) / texture_task_points;
+    std::vector<char> ok (ntasks, 0);
+    {
+        ScopedGILRelease gil;
+        boost::scoped_ptr<thread_pool> pool;
+        if (nthreads > 0)
+            pool.reset (new thread_pool (nthreads - 1));
+        task_set tasks (pool.get());
+        for (size_t i = 0;  i < ntasks;  ++i) {
+            size_t begin = i * texture_task_points;
+            size_t end = std::min (begin + texture_task_points, npoints);
+            tasks.push (boost::bind (texture_points_task, boost::cref(job),
+                                     begin, end, &ok[i]));
+        }
+        tasks.wait ();
+    }
+    return std::find (ok.begin(), ok.end(), 0) == ok.end();
+}
+
+
+
+std::string TextureSystemWrap::geterror () const
+{
+    return m_texsys->geterror();
+}
+
+std::string TextureSystemWrap::getstats (int level=1) const
+{
+    ScopedGILRelease gil;
+    return m_texsys->getstats(level);
+}
+
+void TextureSystemWrap::invalidate (ustring filename)
+{
+    ScopedGILRelease gil;
+    return m_texsys->invalidate(filename);
+}
+
+void TextureSystemWrap::invalidate_all (bool force=false)
+{
+    ScopedGILRelease gil;
+    return m_texsys->invalidate_all(force);
+}
+
+
+
+void
+TextureSystemWrap::attribute_int (const std::string &name, int val)
+{
+    m_texsys->attribute (name, val);
+}
+
+
+void
+TextureSystemWrap::attribute_float (const std::string &name, float val)
+{
+    m_texsys->attribute (name, val);
+}
+
+
+void
+TextureSystemWrap::attribute_string (const std::string &name,
+                                     const std::string &val)
+{
+    m_texsys->attribute (name, val);
+}
+
+
+
+
+void declare_texturesystem()
+{
+    class_<TextureSystemWrap, boost::noncopyable>("TextureSystem", no_init)
+        .def("create", &TextureSystemWrap::create,
+                 (arg("shared")),
+                 return_value_policy<manage_new_object>())
+        .staticmethod("create")
+        .def("destroy", &TextureSystemWrap::destroy)
+        .staticmethod("destroy")
+        .def("attribute", &TextureSystemWrap::attribute_float)
+        .def("attribute", &TextureSystemWrap::attribute_int)
+        .def("attribute", &TextureSystemWrap::attribute_string)
+        .def("resolve_filename", &TextureSystemWrap::resolve_filename)
+        .def("texture", &TextureSystemWrap::texture,
+             (arg("filename"), arg("s"), arg("t"), arg("result"),
+              arg("nchannels")=3,
+              arg("dsdx")=object(), arg("dtdx")=object(),
+              arg("dsdy")=object(), arg("dtdy")=object(),
+              arg("wrap")="default", arg("firstchannel")=0,
+              arg("nthreads")=0))
+        .def("geterror",       &TextureSystemWrap::geterror)
+        .def("getstats",       &TextureSystemWrap::getstats)
+        .def("invalidate",     &TextureSystemWrap::invalidate)
+        .def("invalidate_all", &TextureSystemWrap::invalidate_all)
+    ;
+}
+
+} // namespace PyOpenImageIO
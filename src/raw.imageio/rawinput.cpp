@@ -28,12 +28,25 @@
   (This is the Modified BSD License)
 */
 
+#include <csetjmp>
+#include <cstdio>
+#include <vector>
+
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/fmath.h"
 #include <iostream>
 #include <time.h>       /* time_t, struct tm, gmtime */
 #include <libraw/libraw.h>
 
+extern "C" {
+#include "jpeglib.h"
+}
+
+// Decoding JPEG thumbnails needs libjpeg's in-memory source.
+#if JPEG_LIB_VERSION >= 80 || defined(MEM_SRCDST_SUPPORTED)
+#define OIIO_RAW_JPEG_THUMBNAILS 1
+#endif
+
 
 // This plugin utilises LibRaw:
 // http://www.libraw.org/
@@ -44,7 +57,8 @@ OIIO_PLUGIN_NAMESPACE_BEGIN
 
 class RawInput : public ImageInput {
 public:
-    RawInput () : m_process(true), m_image(NULL) {}
+    RawInput () : m_process(true), m_unpacked(false), m_thumbnail(false),
+                  m_miplevel(0), m_image(NULL) {}
     virtual ~RawInput() { close(); }
     virtual const char * format_name (void) const { return "raw"; }
     virtual int supports (string_view feature) const {
@@ -56,14 +70,31 @@ public:
                        const ImageSpec &config);
     virtual bool close();
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual int current_subimage (void) const { return 0; }
+    virtual int current_miplevel (void) const { return m_miplevel; }
+    virtual bool seek_subimage (int subimage, int miplevel, ImageSpec &newspec);
 
 private:
     bool process();
+    bool unpack();
     bool m_process;
+    bool m_unpacked;             ///< Has the raw data been unpacked?
+    bool m_thumbnail;            ///< Reading the embedded thumbnail
+    int m_miplevel;              ///< 1 for the half-size demosaic
+    int m_width0, m_height0;     ///< Full resolution size
     LibRaw m_processor;
     libraw_processed_image_t *m_image;
+    std::vector<unsigned char> m_thumb;  ///< Thumbnail pixels
 
     void read_tiff_metadata (const std::string &filename);
+
+    // Make the spec and pixels those of the embedded thumbnail.
+    bool open_thumbnail ();
+    bool decode_jpeg_thumbnail (const unsigned char *data, size_t size);
+
+    // Size of the image LibRaw will make at the given MIP level (1
+    // meaning a half_size demosaic).
+    void level_size (int miplevel, int &width, int &height);
 };
 
 
@@ -113,13 +144,16 @@ RawInput::open (const std::string &name, ImageSpec &newspec,
         return false;
     }
 
-    if ( (ret = m_processor.unpack() ) != LIBRAW_SUCCESS) {
-        error ("Could not unpack \"%s\", %s",name.c_str(), libraw_strerror(ret));
-        return false;
-    }
+    // The raw data is not unpacked until pixels are read, so getting the
+    // metadata or the thumbnail never pays for it.
+    m_unpacked = false;
+    m_miplevel = 0;
 
     // Forcing the Libraw to adjust sizes based on the capture device orientation
+    m_processor.imgdata.params.half_size = 0;
     m_processor.adjust_sizes_info_only();
+    m_width0 = m_processor.imgdata.sizes.iwidth;
+    m_height0 = m_processor.imgdata.sizes.iheight;
  
     // Set file information
     m_spec = ImageSpec(m_processor.imgdata.sizes.iwidth,
@@ -280,10 +314,13 @@ RawInput::open (const std::string &name, ImageSpec &newspec,
     if (other.artist[0])
         m_spec.attribute ("Artist", other.artist);
 
-    // FIXME -- thumbnail possibly in m_processor.imgdata.thumbnail
-
     read_tiff_metadata (name);
 
+    // The embedded thumbnail instead of the raw image, if asked for
+    m_thumbnail = config.get_int_attribute ("raw:Thumbnail", 0) != 0;
+    if (m_thumbnail && ! open_thumbnail ())
+        return false;
+
     // Copy the spec to return to the user
     newspec = m_spec;
     return true;
@@ -291,6 +328,159 @@ RawInput::open (const std::string &name, ImageSpec &newspec,
 
 
 
+bool
+RawInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
+{
+    if (subimage != 0)
+        return false;
+    if (miplevel == m_miplevel) {
+        newspec = m_spec;
+        return true;
+    }
+    // Level 1 is LibRaw's half_size demosaic, which is far cheaper than
+    // the full one, and only exists for Bayer sensor images.
+    if (miplevel < 0 || miplevel > 1 || ! m_process || m_thumbnail)
+        return false;
+    int width, height;
+    level_size (miplevel, width, height);
+    if (miplevel == 1 && width == m_width0 && height == m_height0) {
+        level_size (0, width, height);
+        return false;
+    }
+    if (m_image) {
+        LibRaw::dcraw_clear_mem (m_image);
+        m_image = NULL;
+    }
+    m_spec.width = m_spec.full_width = width;
+    m_spec.height = m_spec.full_height = height;
+    m_miplevel = miplevel;
+    newspec = m_spec;
+    return true;
+}
+
+
+
+void
+RawInput::level_size (int miplevel, int &width, int &height)
+{
+    m_processor.imgdata.params.half_size = (miplevel == 1);
+    m_processor.adjust_sizes_info_only ();
+    width = m_processor.imgdata.sizes.iwidth;
+    height = m_processor.imgdata.sizes.iheight;
+}
+
+
+
+bool
+RawInput::open_thumbnail ()
+{
+    int ret;
+    if ((ret = m_processor.unpack_thumb()) != LIBRAW_SUCCESS) {
+        error ("No thumbnail available, %s", libraw_strerror(ret));
+        return false;
+    }
+    libraw_processed_image_t *thumb = m_processor.dcraw_make_mem_thumb (&ret);
+    if (! thumb) {
+        error ("LibRaw failed to create the thumbnail, %s",
+               libraw_strerror(ret));
+        return false;
+    }
+
+    bool ok = true;
+    if (thumb->type == LIBRAW_IMAGE_BITMAP
+          && (thumb->bits == 8 || thumb->bits == 16)) {
+        m_spec.width = thumb->width;
+        m_spec.height = thumb->height;
+        m_spec.nchannels = thumb->colors;
+        m_spec.set_format (thumb->bits == 16 ? TypeDesc::UINT16
+                                             : TypeDesc::UINT8);
+        m_thumb.assign (thumb->data, thumb->data + thumb->data_size);
+    } else if (thumb->type == LIBRAW_IMAGE_JPEG) {
+        ok = decode_jpeg_thumbnail (thumb->data, thumb->data_size);
+    } else {
+        error ("Unsupported thumbnail format");
+        ok = false;
+    }
+    LibRaw::dcraw_clear_mem (thumb);
+    if (! ok)
+        return false;
+    if (m_thumb.size() < m_spec.image_bytes()) {
+        error ("Thumbnail is too small for its resolution");
+        return false;
+    }
+
+    m_spec.x = m_spec.y = 0;
+    m_spec.full_x = m_spec.full_y = 0;
+    m_spec.full_width = m_spec.width;
+    m_spec.full_height = m_spec.height;
+    m_spec.default_channel_names ();
+    m_spec.alpha_channel = -1;
+    // The demosaicing options don't apply to the camera's thumbnail
+    m_spec.erase_attribute ("raw:Demosaic");
+    m_spec.erase_attribute ("raw:ColorSpace");
+    m_spec.erase_attribute ("raw:Exposure");
+    m_spec.attribute ("oiio:ColorSpace", "sRGB");
+    m_spec.attribute ("raw:Thumbnail", 1);
+    return true;
+}
+
+
+
+namespace {
+struct thumbnail_error_mgr {
+    jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+};
+
+void
+thumbnail_error_exit (j_common_ptr cinfo)
+{
+    thumbnail_error_mgr *mgr = (thumbnail_error_mgr *)cinfo->err;
+    longjmp (mgr->setjmp_buffer, 1);
+}
+}  // anon namespace
+
+
+
+bool
+RawInput::decode_jpeg_thumbnail (const unsigned char *data, size_t size)
+{
+#ifdef OIIO_RAW_JPEG_THUMBNAILS
+    jpeg_decompress_struct cinfo;
+    thumbnail_error_mgr jerr;
+    cinfo.err = jpeg_std_error (&jerr.pub);
+    jerr.pub.error_exit = thumbnail_error_exit;
+    if (setjmp (jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress (&cinfo);
+        error ("Could not decode the JPEG thumbnail");
+        return false;
+    }
+    jpeg_create_decompress (&cinfo);
+    jpeg_mem_src (&cinfo, (unsigned char *)data, (unsigned long)size);
+    jpeg_read_header (&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress (&cinfo);
+    m_spec.width = cinfo.output_width;
+    m_spec.height = cinfo.output_height;
+    m_spec.nchannels = cinfo.output_components;
+    m_spec.set_format (TypeDesc::UINT8);
+    size_t stride = size_t(cinfo.output_width) * cinfo.output_components;
+    m_thumb.resize (stride * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = (JSAMPROW) &m_thumb[cinfo.output_scanline * stride];
+        jpeg_read_scanlines (&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress (&cinfo);
+    jpeg_destroy_decompress (&cinfo);
+    return true;
+#else
+    error ("This build can't decode JPEG thumbnails");
+    return false;
+#endif
+}
+
+
+
 void
 RawInput::read_tiff_metadata (const std::string &filename)
 {
@@ -326,6 +516,26 @@ RawInput::close()
         LibRaw::dcraw_clear_mem(m_image);
         m_image = NULL;
     }
+    std::vector<unsigned char>().swap (m_thumb);
+    m_unpacked = false;
+    m_thumbnail = false;
+    m_miplevel = 0;
+    return true;
+}
+
+
+
+bool
+RawInput::unpack()
+{
+    if (! m_unpacked) {
+        int ret = m_processor.unpack();
+        if (ret != LIBRAW_SUCCESS) {
+            error("Could not unpack the raw data, %s", libraw_strerror(ret));
+            return false;
+        }
+        m_unpacked = true;
+    }
     return true;
 }
 
@@ -335,6 +545,9 @@ bool
 RawInput::process()
 {
     if (!m_image) {
+        if (! unpack())
+            return false;
+        m_processor.imgdata.params.half_size = (m_miplevel == 1);
         int ret = m_processor.dcraw_process();
         if (ret != LIBRAW_SUCCESS) {
             error("Processing image failed, %s", libraw_strerror(ret));
@@ -357,6 +570,14 @@ RawInput::process()
             return false;
         }
 
+        if (m_image->width != m_spec.width || m_image->height != m_spec.height) {
+            error("LibRaw returned a %dx%d image, expected %dx%d",
+                  m_image->width, m_image->height, m_spec.width, m_spec.height);
+            LibRaw::dcraw_clear_mem(m_image);
+            m_image = NULL;
+            return false;
+        }
+
     }
     return true;
 }
@@ -369,9 +590,17 @@ RawInput::read_native_scanline (int y, int z, void *data)
     if (y < 0 || y >= m_spec.height) // out of range scanline
         return false;
 
+    if (m_thumbnail) {
+        size_t bytes = m_spec.scanline_bytes(true);
+        memcpy(data, &m_thumb[y * bytes], bytes);
+        return true;
+    }
+
     if (! m_process) {
         // The user has selected not to apply any debayering.
         // We take the raw data directly
+        if (! unpack())
+            return false;
         unsigned short *scanline = &((m_processor.imgdata.rawdata.raw_image)[m_spec.width*y]);
         memcpy(data, scanline, m_spec.scanline_bytes(true));
         return true;
@@ -56,21 +56,22 @@ public:
     virtual bool seek_subimage (int subimage, int miplevel, ImageSpec &newspec);
     virtual bool close ();
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
 
 private:
     std::string m_filename;           ///< Stash the filename
     FILE *m_file;                     ///< Open image handle
     RLAHeader m_rla;                  ///< Wavefront RLA header
-    std::vector<unsigned char> m_buf; ///< Buffer the image pixels
     int m_subimage;                   ///< Current subimage index
     std::vector<uint32_t> m_sot;      ///< Scanline offsets table
     int m_stride;                     ///< Number of bytes a contig pixel takes
+    Filesystem::IOBufferedReader m_reader; ///< Bulk reads of the RLE records
 
     /// Reset everything to initial state
     ///
     void init () {
         m_file = NULL;
-        m_buf.clear ();
     }
 
     /// Helper: raw read, with error detection
@@ -106,15 +107,16 @@ private:
     
     /// Helper: read and decode a single channel group consisting of
     /// channels [first_channel .. first_channel+num_channels-1], which
-    /// all share the same number of significant bits.
-    bool decode_channel_group (int first_channel, short num_channels,
-                               short num_bits, int y);
+    /// all share the same number of significant bits, into the
+    /// scanline at buf.
+    bool decode_channel_group (unsigned char *buf, int first_channel,
+                               short num_channels, short num_bits);
 
     /// Helper: decode a span of n RLE-encoded bytes from encoded[0..elen-1]
     /// into buf[0],buf[stride],buf[2*stride]...buf[(n-1)*stride].
     /// Return the number of encoded bytes we ate to fill buf.
     size_t decode_rle_span (unsigned char *buf, int n, int stride,
-                            const char *encoded, size_t elen);
+                            const unsigned char *encoded, size_t elen);
     
     /// Helper: determine channel TypeDesc
     inline TypeDesc get_channel_typedesc (short chan_type, short chan_bits);
@@ -175,7 +177,8 @@ RLAInput::open (const std::string &name, ImageSpec &newspec)
         error ("Could not open file \"%s\"", name.c_str());
         return false;
     }
-    
+    m_reader.reset (m_file);
+
     // set a bogus subimage index so that seek_subimage actually seeks
     m_subimage = 1;
     return seek_subimage (0, 0, newspec);
@@ -434,6 +437,7 @@ RLAInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
 bool
 RLAInput::close ()
 {
+    m_reader.reset ((Filesystem::IOProxy *)NULL);
     if (m_file) {
         fclose (m_file);
         m_file = NULL;
@@ -447,21 +451,36 @@ RLAInput::close ()
 
 size_t
 RLAInput::decode_rle_span (unsigned char *buf, int n, int stride,
-                           const char *encoded, size_t elen)
+                           const unsigned char *encoded, size_t elen)
 {
     size_t e = 0;
     while (n > 0 && e < elen) {
-        signed char count = (signed char) encoded[e++];
+        int count = (signed char) encoded[e++];
         if (count >= 0) {
             // run count positive: value repeated count+1 times
-            for (int i = 0;  i <= count && n;  ++i, buf += stride, --n)
-                *buf = encoded[e];
-            ++e;
+            if (e >= elen)
+                break;
+            unsigned char value = encoded[e++];
+            int len = std::min (count + 1, n);
+            n -= len;
+            for ( ;  len >= 4;  len -= 4, buf += 4*stride) {
+                buf[0] = value;  buf[stride] = value;
+                buf[2*stride] = value;  buf[3*stride] = value;
+            }
+            for ( ;  len;  --len, buf += stride)
+                *buf = value;
         } else {
             // run count negative: repeat bytes literally
-            count = -count;  // make it positive
-            for ( ; count && n > 0 && e < elen; --count, buf += stride, --n)
-                *buf = encoded[e++];
+            int len = std::min (std::min (-count, n), int(elen - e));
+            const unsigned char *in = encoded + e;
+            e += len;
+            n -= len;
+            for ( ;  len >= 4;  len -= 4, in += 4, buf += 4*stride) {
+                buf[0] = in[0];  buf[stride] = in[1];
+                buf[2*stride] = in[2];  buf[3*stride] = in[3];
+            }
+            for ( ;  len;  --len, buf += stride)
+                *buf = *in++;
         }
     }
     if (n != 0) {
@@ -474,8 +493,8 @@ RLAInput::decode_rle_span (unsigned char *buf, int n, int stride,
 
 
 bool
-RLAInput::decode_channel_group (int first_channel, short num_channels,
-                                short num_bits, int y)
+RLAInput::decode_channel_group (unsigned char *buf, int first_channel,
+                                short num_channels, short num_bits)
 {
     // Some preliminaries -- figure out various sizes and offsets
     int chsize;         // size of the channels in this group, in bytes
@@ -502,27 +521,32 @@ RLAInput::decode_channel_group (int first_channel, short num_channels,
     // The channels are simply contatenated together in order.
     // Each channel starts with a length, from which we know how many
     // bytes of encoded RLE data to read.  Then there are RLE
-    // spans for each 8-bit slice of the channel.
-    std::vector<char> encoded;
+    // spans for each 8-bit slice of the channel.  The records are
+    // decoded in place in m_reader's buffer.
     for (int c = 0;  c < num_channels;  ++c) {
         // Read the length
-        uint16_t length; // number of encoded bytes
-        if (!read (&length)) {
+        const unsigned char *len = m_reader.take (2);
+        if (! len) {
             error ("Read error: couldn't read RLE record length");
             return false;
         }
+        size_t length = (len[0] << 8) | len[1]; // number of encoded bytes
         // Read the encoded RLE record
-        encoded.resize (length);
-        if (!read (&encoded[0], length)) {
+        const unsigned char *encoded = m_reader.take (length);
+        if (! encoded) {
             error ("Read error: couldn't read RLE data span");
             return false;
         }
 
         if (chantype == TypeDesc::FLOAT) {
             // Special case -- float data is just dumped raw, no RLE
+            if (length < m_spec.width * sizeof(float)) {
+                error ("Read error: short float record");
+                return false;
+            }
             for (int x = 0;  x < m_spec.width;  ++x)
-                *((float *)&m_buf[offset+c*chsize+x*pixelsize]) =
-                    ((float *)&encoded[0])[x];
+                memcpy (&buf[offset+c*chsize+x*pixelsize],
+                        encoded + x*sizeof(float), sizeof(float));
             continue;
         }
 
@@ -531,9 +555,9 @@ RLAInput::decode_channel_group (int first_channel, short num_channels,
         // and strides to decode_rle_span.
         size_t eoffset = 0;
         for (int bytes = 0;  bytes < chsize;  ++bytes) {
-            size_t e = decode_rle_span (&m_buf[offset+c*chsize+bytes],
+            size_t e = decode_rle_span (&buf[offset+c*chsize+bytes],
                                         m_spec.width, pixelsize,
-                                        &encoded[eoffset], length);
+                                        encoded + eoffset, length - eoffset);
             if (! e)
                 return false;
             eoffset += e;
@@ -545,16 +569,16 @@ RLAInput::decode_channel_group (int first_channel, short num_channels,
     if (littleendian()) {
         if (chsize == 2) {
             if (num_channels == m_spec.nchannels)
-                swap_endian ((uint16_t *)&m_buf[0], num_channels*m_spec.width);
+                swap_endian ((uint16_t *)&buf[0], num_channels*m_spec.width);
             else
                 for (int x = 0;  x < m_spec.width;  ++x)
-                    swap_endian ((uint16_t *)&m_buf[offset+x*pixelsize], num_channels);
+                    swap_endian ((uint16_t *)&buf[offset+x*pixelsize], num_channels);
         } else if (chsize == 4 && chantype != TypeDesc::FLOAT) {
             if (num_channels == m_spec.nchannels)
-                swap_endian ((uint32_t *)&m_buf[0], num_channels*m_spec.width);
+                swap_endian ((uint32_t *)&buf[0], num_channels*m_spec.width);
             else
                 for (int x = 0;  x < m_spec.width;  ++x)
-                    swap_endian ((uint32_t *)&m_buf[offset+x*pixelsize], num_channels);
+                    swap_endian ((uint32_t *)&buf[offset+x*pixelsize], num_channels);
         }
     }
 
@@ -567,28 +591,28 @@ RLAInput::decode_channel_group (int first_channel, short num_channels,
     } else if (num_bits == 10) {
         // fast, common case -- use templated hard-code
         for (int x = 0;  x < m_spec.width;  ++x) {
-            uint16_t *b = (uint16_t *)(&m_buf[offset+x*pixelsize]);
+            uint16_t *b = (uint16_t *)(&buf[offset+x*pixelsize]);
             for (int c = 0;  c < num_channels;  ++c)
                 b[c] = bit_range_convert<10,16> (b[c]);
         }
     } else if (num_bits < 8) {
         // rare case, use slow code to make this clause short and simple
         for (int x = 0;  x < m_spec.width;  ++x) {
-            uint8_t *b = (uint8_t *)&m_buf[offset+x*pixelsize];
+            uint8_t *b = (uint8_t *)&buf[offset+x*pixelsize];
             for (int c = 0;  c < num_channels;  ++c)
                 b[c] = bit_range_convert (b[c], num_bits, 8);
         }
     } else if (num_bits > 8 && num_bits < 16) {
         // rare case, use slow code to make this clause short and simple
         for (int x = 0;  x < m_spec.width;  ++x) {
-            uint16_t *b = (uint16_t *)&m_buf[offset+x*pixelsize];
+            uint16_t *b = (uint16_t *)&buf[offset+x*pixelsize];
             for (int c = 0;  c < num_channels;  ++c)
                 b[c] = bit_range_convert (b[c], num_bits, 16);
         }
     } else if (num_bits > 16 && num_bits < 32) {
         // rare case, use slow code to make this clause short and simple
         for (int x = 0;  x < m_spec.width;  ++x) {
-            uint32_t *b = (uint32_t *)&m_buf[offset+x*pixelsize];
+            uint32_t *b = (uint32_t *)&buf[offset+x*pixelsize];
             for (int c = 0;  c < num_channels;  ++c)
                 b[c] = bit_range_convert (b[c], num_bits, 32);
         }
@@ -601,34 +625,47 @@ RLAInput::decode_channel_group (int first_channel, short num_channels,
 bool
 RLAInput::read_native_scanline (int y, int z, void *data)
 {
-    // By convention, RLA images store their images bottom-to-top.
-    y = m_spec.height - (y - m_spec.y) - 1;
-
-    // Seek to scanline start, based on the scanline offset table
-    fseek (m_file, m_sot[y], SEEK_SET);
-
-    // Now decode and interleave the channels.  
-    // The channels are non-interleaved (i.e. rrrrrgggggbbbbb...).
-    // Color first, then matte, then auxiliary channels.  We can't
-    // decode all in one shot, though, because the data type and number
-    // of significant bits may be may be different for each class of
-    // channels, so we deal with them separately and interleave into
-    // our buffer as we go.
-    size_t size = m_spec.scanline_bytes(true);
-    m_buf.resize (size);
-    if (m_rla.NumOfColorChannels > 0)
-        if (!decode_channel_group(0, m_rla.NumOfColorChannels, m_rla.NumOfChannelBits, y))
-            return false;
-    if (m_rla.NumOfMatteChannels > 0)
-        if (!decode_channel_group(m_rla.NumOfColorChannels, m_rla.NumOfMatteChannels,
-                                  m_rla.NumOfMatteBits, y))
-            return false;
-    if (m_rla.NumOfAuxChannels > 0)
-        if (!decode_channel_group(m_rla.NumOfColorChannels + m_rla.NumOfMatteChannels,
-                                  m_rla.NumOfAuxChannels, m_rla.NumOfAuxBits, y))
-            return false;
+    return read_native_scanlines (y, y+1, z, data);
+}
 
-    memcpy (data, &m_buf[0], size);
+
+
+bool
+RLAInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
+{
+    if (ybegin < m_spec.y || yend > m_spec.y + m_spec.height || ybegin >= yend)
+        return false;
+
+    // By convention, RLA images store their images bottom-to-top, so
+    // walk our scanlines backward to visit the file front to back.
+    size_t size = m_spec.scanline_bytes(true);
+    for (int y = yend - 1;  y >= ybegin;  --y) {
+        // Seek to scanline start, based on the scanline offset table
+        m_reader.seek (m_sot[m_spec.height - (y - m_spec.y) - 1]);
+
+        // Now decode and interleave the channels straight into the
+        // caller's memory.
+        // The channels are non-interleaved (i.e. rrrrrgggggbbbbb...).
+        // Color first, then matte, then auxiliary channels.  We can't
+        // decode all in one shot, though, because the data type and number
+        // of significant bits may be may be different for each class of
+        // channels, so we deal with them separately and interleave into
+        // our buffer as we go.
+        unsigned char *buf = (unsigned char *)data + (y - ybegin) * size;
+        if (m_rla.NumOfColorChannels > 0)
+            if (!decode_channel_group(buf, 0, m_rla.NumOfColorChannels,
+                                      m_rla.NumOfChannelBits))
+                return false;
+        if (m_rla.NumOfMatteChannels > 0)
+            if (!decode_channel_group(buf, m_rla.NumOfColorChannels,
+                                      m_rla.NumOfMatteChannels,
+                                      m_rla.NumOfMatteBits))
+                return false;
+        if (m_rla.NumOfAuxChannels > 0)
+            if (!decode_channel_group(buf, m_rla.NumOfColorChannels + m_rla.NumOfMatteChannels,
+                                      m_rla.NumOfAuxChannels, m_rla.NumOfAuxBits))
+                return false;
+    }
     return true;
 }
 
@@ -96,12 +96,15 @@ class SgiInput : public ImageInput {
     virtual bool open (const std::string &name, ImageSpec &spec);
     virtual bool close (void);
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
  private:
     FILE *m_fd;
     std::string m_filename;
     sgi_pvt::SgiHeader m_sgi_header;
     std::vector<uint32_t> start_tab;
     std::vector<uint32_t> length_tab;
+    Filesystem::IOBufferedReader m_reader;
 
     void init() {
         m_fd = NULL;
@@ -118,11 +121,11 @@ class SgiInput : public ImageInput {
     // Return true if ok, false if there was a read error.
     bool read_offset_tables();
 
-    // read channel scanline data from file, uncompress it and save the data to
-    // 'out' buffer; 'out' should be allocate before call to this method.
+    // read channel scanline data from file, uncompress it and save the data
+    // to 'out', whose successive pixels are 'stride' bytes apart.
     // Return true if ok, false if there was a read error.
     bool uncompress_rle_channel (int scanline_off, int scanline_len,
-                                 unsigned char *out);
+                                 unsigned char *out, int stride);
 
     /// Helper: read, with error detection
     ///
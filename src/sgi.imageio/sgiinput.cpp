@@ -122,6 +122,8 @@ SgiInput::open (const std::string &name, ImageSpec &spec)
             return false;
     }
 
+    m_reader.reset (m_fd);
+
     spec = m_spec;
     return true;
 }
@@ -131,52 +133,66 @@ SgiInput::open (const std::string &name, ImageSpec &spec)
 bool
 SgiInput::read_native_scanline (int y, int z, void *data)
 {
-    if (y < 0 || y > m_spec.height)
-        return false;
+    return read_native_scanlines (y, y+1, z, data);
+}
 
-    y = m_spec.height - y - 1;
+
+
+bool
+SgiInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
+{
+    if (ybegin < 0 || yend > m_spec.height || ybegin >= yend)
+        return false;
 
     int bpc = m_sgi_header.bpc;
-    std::vector<std::vector<unsigned char> > channeldata (m_spec.nchannels);
-    if (m_sgi_header.storage == sgi_pvt::RLE) {
-        // reading and uncompressing first channel (red in RGBA images)
-        for (int c = 0;  c < m_spec.nchannels;  ++c) {
-            int off = y + c*m_spec.height;  // offset for this scanline/channel
-            int scanline_offset = start_tab[off];
-            int scanline_length = length_tab[off];
-            channeldata[c].resize (m_spec.width * bpc);
-            uncompress_rle_channel (scanline_offset, scanline_length,
-                                    &(channeldata[c][0]));
-        }
-    } else {
-        // non-RLE case -- just read directly into our channel data
-        for (int c = 0;  c < m_spec.nchannels;  ++c) {
-            int off = y + c*m_spec.height;  // offset for this scanline/channel
-            int scanline_offset = sgi_pvt::SGI_HEADER_LEN + off * m_spec.width * bpc;
-            fseek (m_fd, scanline_offset, SEEK_SET);
-            channeldata[c].resize (m_spec.width * bpc);
-            if (! fread (&(channeldata[c][0]), 1, m_spec.width * bpc))
+    int nchans = m_spec.nchannels;
+    int pixelbytes = nchans * bpc;
+    size_t rowbytes = size_t(m_spec.width) * pixelbytes;
+    size_t chanrow = size_t(m_spec.width) * bpc;
+    unsigned char *cdata = (unsigned char *)data;
+
+    // The file stores each channel as a plane of bottom-to-top scanlines,
+    // so walk each channel's rows in file order (our rows in descending
+    // order), decoding straight into the interleaved result.
+    for (int c = 0;  c < nchans;  ++c) {
+        if (m_sgi_header.storage == sgi_pvt::RLE) {
+            for (int y = yend-1;  y >= ybegin;  --y) {
+                int off = (m_spec.height - y - 1) + c*m_spec.height;
+                if (! uncompress_rle_channel (start_tab[off], length_tab[off],
+                                              cdata + (y-ybegin)*rowbytes + c*bpc,
+                                              pixelbytes))
+                    return false;
+            }
+        } else {
+            // Verbatim: the rows we want are contiguous in the file
+            int off = (m_spec.height - yend) + c*m_spec.height;
+            m_reader.seek (sgi_pvt::SGI_HEADER_LEN + off * int64_t(chanrow));
+            const unsigned char *in = m_reader.take (chanrow * (yend-ybegin));
+            if (! in) {
+                error ("Read error");
                 return false;
-        }
-    }
-
-    if (m_spec.nchannels == 1) {
-        // If just one channel, no interleaving is necessary, just memcpy
-        memcpy (data, &(channeldata[0][0]), channeldata[0].size());
-    } else {
-        unsigned char *cdata = (unsigned char *)data;
-        for (int x = 0; x < m_spec.width; ++x) {
-            for (int c = 0;  c < m_spec.nchannels;  ++c) {
-                *cdata++ = channeldata[c][x*bpc];
-                if (bpc == 2)
-                    *cdata++ = channeldata[c][x*bpc+1];
+            }
+            for (int y = yend-1;  y >= ybegin;  --y, in += chanrow) {
+                unsigned char *out = cdata + (y-ybegin)*rowbytes + c*bpc;
+                if (nchans == 1) {
+                    memcpy (out, in, chanrow);
+                } else if (bpc == 1) {
+                    for (int x = 0;  x < m_spec.width;  ++x)
+                        out[x*pixelbytes] = in[x];
+                } else {
+                    for (int x = 0;  x < m_spec.width;  ++x) {
+                        out[x*pixelbytes]   = in[2*x];
+                        out[x*pixelbytes+1] = in[2*x+1];
+                    }
+                }
             }
         }
     }
 
     // Swap endianness if needed
     if (bpc == 2 && littleendian())
-        swap_endian ((unsigned short *)data, m_spec.width*m_spec.nchannels);
+        swap_endian ((unsigned short *)data,
+                     m_spec.width * nchans * (yend-ybegin));
 
     return true;
 }
@@ -185,75 +201,92 @@ SgiInput::read_native_scanline (int y, int z, void *data)
 
 bool
 SgiInput::uncompress_rle_channel(int scanline_off, int scanline_len,
-                                 unsigned char *out)
+                                 unsigned char *out, int stride)
 {
     int bpc = m_sgi_header.bpc;
-    std::vector<unsigned char> rle_scanline (scanline_len);
-    fseek (m_fd, scanline_off, SEEK_SET);
-    if (! fread (&rle_scanline[0], 1, scanline_len))
+    m_reader.seek (scanline_off);
+    const unsigned char *in = m_reader.take (scanline_len);
+    if (! in) {
+        error ("Read error");
         return false;
+    }
+    const unsigned char *inend = in + scanline_len;
     int limit = m_spec.width;
-    int i = 0;
     if (bpc == 1) {
-        // 1 bit per channel
-        while (i < scanline_len) {
+        // 1 byte per channel
+        while (in < inend) {
             // Read a byte, it is the count.
-            unsigned char value = rle_scanline[i++];
+            unsigned char value = *in++;
             int count = value & 0x7F;
             // If the count is zero, we're done
             if (! count)
                 break;
+            if (count > limit)
+                break;
+            limit -= count;
             // If the high bit is set, we just copy the next 'count' values
             if (value & 0x80) {
-                while (count--) {
-                    DASSERT (i < scanline_len && limit > 0);
-                    *(out++) = rle_scanline[i++];
-                    --limit;
+                if (inend - in < count)
+                    break;
+                for ( ;  count >= 4;  count -= 4, in += 4, out += 4*stride) {
+                    out[0]        = in[0];
+                    out[stride]   = in[1];
+                    out[2*stride] = in[2];
+                    out[3*stride] = in[3];
                 }
+                for ( ;  count;  --count, out += stride)
+                    *out = *in++;
             }
             // If the high bit is zero, we copy the NEXT value, count times
             else {
-                value = rle_scanline[i++];
-                while (count--) {
-                    DASSERT (limit > 0);
-                    *(out++) = value;
-                    --limit;
+                if (in >= inend)
+                    break;
+                value = *in++;
+                for ( ;  count >= 4;  count -= 4, out += 4*stride) {
+                    out[0] = value;  out[stride] = value;
+                    out[2*stride] = value;  out[3*stride] = value;
                 }
+                for ( ;  count;  --count, out += stride)
+                    *out = value;
             }
         }
     } else {
-        // 2 bits per channel
+        // 2 bytes per channel
         ASSERT (bpc == 2);
-        while (i < scanline_len) {
-            // Read a byte, it is the count.
-            unsigned short value = (rle_scanline[i] << 8) | rle_scanline[i+1];
-            i += 2;
-            int count = value & 0x7F;
+        while (inend - in >= 2) {
+            // Read a short, it is the count.
+            int count = in[1] & 0x7F;
+            bool literal = (in[1] & 0x80) != 0;
+            in += 2;
             // If the count is zero, we're done
             if (! count)
                 break;
+            if (count > limit)
+                break;
+            limit -= count;
             // If the high bit is set, we just copy the next 'count' values
-            if (value & 0x80) {
-                while (count--) {
-                    DASSERT (i+1 < scanline_len && limit > 0);
-                    *(out++) = rle_scanline[i++];
-                    *(out++) = rle_scanline[i++];
-                    --limit;
+            if (literal) {
+                if (inend - in < 2*count)
+                    break;
+                for ( ;  count;  --count, in += 2, out += stride) {
+                    out[0] = in[0];
+                    out[1] = in[1];
                 }
             }
             // If the high bit is zero, we copy the NEXT value, count times
             else {
-                while (count--) {
-                    DASSERT (limit > 0);
-                    *(out++) = rle_scanline[i];
-                    *(out++) = rle_scanline[i+1];
-                    --limit;
+                if (inend - in < 2)
+                    break;
+                unsigned char hi = in[0], lo = in[1];
+                in += 2;
+                for ( ;  count;  --count, out += stride) {
+                    out[0] = hi;
+                    out[1] = lo;
                 }
-                i += 2;
             }
         }
     }
-    if (i != scanline_len || limit != 0) {
+    if (in != inend || limit != 0) {
         error ("Corrupt RLE data");
         return false;
     }
@@ -266,6 +299,7 @@ SgiInput::uncompress_rle_channel(int scanline_off, int scanline_len,
 bool
 SgiInput::close()
 {
+    m_reader.reset ((Filesystem::IOProxy *)NULL);
     if (m_fd)
         fclose (m_fd);
     init ();
@@ -35,6 +35,10 @@
 
 
 
+#include <ctime>
+#include <new>
+
+#include "OpenImageIO/strutil.h"
 #include "socket_pvt.h"
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
@@ -55,6 +59,121 @@ socket_write (ip::tcp::socket &s, TypeDesc &type, const void *data, int size)
     return bytes;
 }
 
+
+
+bool
+is_local_host (const std::string &host)
+{
+    return host == "127.0.0.1" || host == "::1" ||
+           Strutil::iequals (host, "localhost");
+}
+
+
+
+// The ring's memory starts with a header holding the capacity and the
+// reader's tail, padded so the payloads start on a cache line boundary.
+struct RingHeader {
+    uint64_t capacity;
+    atomic_ll tail;
+};
+static const size_t ring_header_size = 64;
+
+
+
+bool
+ShmRing::create (const std::string &basename, size_t capacity)
+{
+    using namespace boost::interprocess;
+    close ();
+    // Names must be unique across processes, so mix in the time and our
+    // address, and count up past any that are taken.
+    unsigned long long salt = (unsigned long long) time (NULL) ^
+                              (unsigned long long) (size_t) this;
+    for (int attempt = 0;  attempt < 16;  ++attempt) {
+        std::string name = Strutil::format ("%s_%llx_%d", basename,
+                                            salt, attempt);
+        try {
+            shared_memory_object shm (create_only, name.c_str(), read_write);
+            m_name = name;
+            m_owner = true;
+            shm.truncate (offset_t (ring_header_size + capacity));
+            mapped_region region (shm, read_write);
+            m_region.swap (region);
+        } catch (interprocess_exception &) {
+            if (m_owner) {
+                // Created it but couldn't size or map it -- give up
+                close ();
+                return false;
+            }
+            continue;   // name taken, try the next
+        }
+        RingHeader *header = new (m_region.get_address()) RingHeader;
+        header->capacity = capacity;
+        header->tail = 0;
+        m_tail = &header->tail;
+        m_data = (unsigned char *)m_region.get_address() + ring_header_size;
+        m_capacity = capacity;
+        return true;
+    }
+    return false;
+}
+
+
+
+bool
+ShmRing::open (const std::string &name)
+{
+    using namespace boost::interprocess;
+    close ();
+    try {
+        shared_memory_object shm (open_only, name.c_str(), read_write);
+        mapped_region region (shm, read_write);
+        m_region.swap (region);
+    } catch (interprocess_exception &) {
+        return false;
+    }
+    if (m_region.get_size() < ring_header_size) {
+        close ();
+        return false;
+    }
+    RingHeader *header = (RingHeader *) m_region.get_address();
+    if (header->capacity > m_region.get_size() - ring_header_size) {
+        close ();
+        return false;
+    }
+    m_name = name;
+    m_tail = &header->tail;
+    m_data = (unsigned char *)m_region.get_address() + ring_header_size;
+    m_capacity = size_t (header->capacity);
+    return true;
+}
+
+
+
+void
+ShmRing::unlink ()
+{
+    if (m_owner)
+        boost::interprocess::shared_memory_object::remove (m_name.c_str());
+    m_owner = false;
+}
+
+
+
+void
+ShmRing::close ()
+{
+    boost::interprocess::mapped_region empty;
+    m_region.swap (empty);
+    if (m_owner)
+        boost::interprocess::shared_memory_object::remove (m_name.c_str());
+    m_name.clear ();
+    m_owner = false;
+    m_data = NULL;
+    m_tail = NULL;
+    m_capacity = 0;
+}
+
 }
 
 OIIO_PLUGIN_NAMESPACE_END
@@ -39,6 +39,7 @@
 
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/refcnt.h"
+#include "OpenImageIO/atomic.h"
 
 #include <map>
 
@@ -51,6 +52,8 @@
 #endif
 
 #include <boost/asio.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
@@ -58,6 +61,95 @@ OIIO_PLUGIN_NAMESPACE_BEGIN
 using namespace boost::asio;
 
 
+// The protocol: the writer connects and sends the spec (a uint32 length
+// followed by its XML), then a Hello naming the transport options it
+// would like, and the reader answers with a uint32 of the option flags
+// it accepted.  After that, each batch of one or more scanlines or
+// tiles (in the order they are written and read) is a MessageHeader
+// followed by its payload -- or, for a same-host peer that accepted the
+// shared memory ring, just the header, with the payload already in the
+// ring and the socket carrying only the signal that it is there.
+
+namespace socket_pvt {
+
+const char default_port[] = "10110";
+
+const char default_host[] = "127.0.0.1";
+
+const uint32_t message_magic = 0x4f49494f;  // "OIIO"
+
+enum TransportFlags {
+    MSG_SHM  = 1,    ///< Payload is in the shared memory ring
+    MSG_ZLIB = 2     ///< Payload is zlib compressed
+};
+
+/// Sent once by the writer after the spec.  The ring's name (namelen
+/// bytes) follows it.
+struct Hello {
+    uint32_t magic;
+    uint32_t flags;      ///< TransportFlags the writer would like
+    uint32_t namelen;    ///< Length of the ring name that follows
+    uint32_t pad;
+};
+
+/// Precedes every batch of scanlines or tiles.
+struct MessageHeader {
+    uint32_t magic;
+    uint32_t flags;      ///< TransportFlags of this payload
+    uint32_t count;      ///< Number of scanlines or tiles in the batch
+    uint32_t pad;
+    uint64_t size;       ///< Bytes of payload, on the wire or in the ring
+    uint64_t rawsize;    ///< Bytes of payload once uncompressed
+    uint64_t offset;     ///< Where the payload starts in the ring
+    uint64_t ringend;    ///< Ring position the reader gives back when done
+};
+
+std::size_t socket_write (ip::tcp::socket &s, TypeDesc &type, const void *data, int size);
+
+/// Is the host name one that means this machine?
+bool is_local_host (const std::string &host);
+
+
+
+/// A ring buffer in named shared memory.  The writer create()s it and
+/// copies payloads in at positions it chooses; the reader open()s it,
+/// copies them out, and advances tail() to give the space back.
+/// Positions are monotonic byte counts, taken modulo capacity().
+class ShmRing {
+public:
+    ShmRing () : m_owner(false), m_data(NULL), m_tail(NULL), m_capacity(0) { }
+    ~ShmRing () { close (); }
+
+    /// Create a new ring of the given capacity, named uniquely from
+    /// basename.  Return true on success.
+    bool create (const std::string &basename, size_t capacity);
+    /// Attach to the ring a peer created.
+    bool open (const std::string &name);
+    /// Detach, and remove the ring if we created it.
+    void close ();
+    /// Remove the ring's name (once the peer has attached), so that it
+    /// can't outlive us even if we don't exit cleanly.
+    void unlink ();
+
+    bool valid () const { return m_data != NULL; }
+    const std::string &name () const { return m_name; }
+    size_t capacity () const { return m_capacity; }
+    unsigned char *data () { return m_data; }
+    /// Everything before this position has been consumed by the reader.
+    atomic_ll &tail () { return *m_tail; }
+
+private:
+    boost::interprocess::mapped_region m_region;
+    std::string m_name;
+    bool m_owner;
+    unsigned char *m_data;
+    atomic_ll *m_tail;
+    size_t m_capacity;
+};
+
+}  // namespace socket_pvt
+
+
 
 class SocketOutput : public ImageOutput {
  public:
@@ -80,9 +172,22 @@ class SocketOutput : public ImageOutput {
     io_service io;
     ip::tcp::socket socket;
     std::vector<unsigned char> m_scratch;
+    socket_pvt::ShmRing m_ring;      // Payload transport for local peers
+    long long m_ring_head;           // Ring position of the next payload
+    uint32_t m_flags;                // TransportFlags the reader accepted
+    int m_batch;                     // Scanlines or tiles per message
+    socket_pvt::MessageHeader m_pending;     // The batch being gathered
+    std::vector<unsigned char> m_batchbuf;   // Its payload, if not in ring
+    std::vector<unsigned char> m_compressed;
 
     bool connect_to_server (const std::string &name);
     bool send_spec_to_server (const ImageSpec &spec);
+    bool negotiate_transport (const std::string &host,
+                              std::map<std::string, std::string> &args);
+    // Add one scanline or tile to the batch, sending it if it's full.
+    bool send (const void *data, size_t size);
+    // Send the batch gathered so far.
+    bool flush ();
 };
 
 
@@ -105,23 +210,22 @@ class SocketInput : public ImageInput {
     io_service io;
     ip::tcp::socket socket;
     OIIO::shared_ptr <ip::tcp::acceptor> acceptor;
+    socket_pvt::ShmRing m_ring;          // Payload transport for local peers
+    const unsigned char *m_avail;        // Unread part of the current batch
+    size_t m_navail;
+    long long m_release;                 // Give ring back to here when done
+    std::vector<unsigned char> m_batchbuf;
+    std::vector<unsigned char> m_compressed;
     
     bool accept_connection (const std::string &name);
     bool get_spec_from_client (ImageSpec &spec);
+    bool negotiate_transport ();
+    // Read the next size bytes of scanline or tile data.
+    bool receive (void *data, size_t size);
 
     friend class SocketOutput;
 };
 
-namespace socket_pvt {
-
-const char default_port[] = "10110";
-
-const char default_host[] = "127.0.0.1";
-
-std::size_t socket_write (ip::tcp::socket &s, TypeDesc &type, const void *data, int size);
-
-}
-
 OIIO_PLUGIN_NAMESPACE_END
 
 
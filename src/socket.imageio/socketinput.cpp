@@ -28,6 +28,8 @@
   (This is the Modified BSD License)
 */
 
+#include <zlib.h>
+
 #include "OpenImageIO/imageio.h"
 #include "socket_pvt.h"
 
@@ -51,7 +53,7 @@ OIIO_PLUGIN_EXPORTS_END
 
 
 SocketInput::SocketInput()
-        : socket (io)
+        : socket (io), m_avail(NULL), m_navail(0), m_release(-1)
 {
 }
 
@@ -93,7 +95,8 @@ SocketInput::open (const std::string &name, ImageSpec &newspec,
         return false;
     }
 
-    if (! (accept_connection (name) && get_spec_from_client (newspec))) {
+    if (! (accept_connection (name) && get_spec_from_client (newspec) &&
+           negotiate_transport ())) {
         return false;
     }
     // Also send information about endianess etc.
@@ -108,18 +111,7 @@ SocketInput::open (const std::string &name, ImageSpec &newspec,
 bool
 SocketInput::read_native_scanline (int y, int z, void *data)
 {    
-    try {
-        boost::asio::read (socket, buffer (reinterpret_cast<char *> (data),
-                m_spec.scanline_bytes ()));
-    } catch (boost::system::system_error &err) {
-        error ("Error while reading: %s", err.what ());
-        return false;
-    } catch (...) {
-        error ("Error while reading: unknown exception");
-        return false;
-    }
-
-    return true;
+    return receive (data, m_spec.scanline_bytes ());
 }
 
 
@@ -127,9 +119,74 @@ SocketInput::read_native_scanline (int y, int z, void *data)
 bool
 SocketInput::read_native_tile (int x, int y, int z, void *data)
 {
+    return receive (data, m_spec.tile_bytes ());
+}
+
+
+
+bool
+SocketInput::receive (void *data, size_t size)
+{
+    unsigned char *out = (unsigned char *) data;
     try {
-        boost::asio::read (socket, buffer (reinterpret_cast<char *> (data),
-                m_spec.tile_bytes ()));
+        while (size) {
+            if (! m_navail) {
+                // Start on the next batch
+                socket_pvt::MessageHeader header;
+                boost::asio::read (socket, buffer (&header, sizeof(header)));
+                if (header.magic != socket_pvt::message_magic) {
+                    error ("Corrupt message from the socket");
+                    return false;
+                }
+                if (header.flags & socket_pvt::MSG_SHM) {
+                    // The payload is already in the ring -- use it there
+                    if (! m_ring.valid() ||
+                          header.offset + header.size > m_ring.capacity()) {
+                        error ("Corrupt message from the socket");
+                        return false;
+                    }
+                    m_avail = m_ring.data() + header.offset;
+                    m_navail = size_t (header.size);
+                    m_release = (long long) header.ringend;
+                } else if (header.flags & socket_pvt::MSG_ZLIB) {
+                    m_compressed.resize (size_t (header.size));
+                    m_batchbuf.resize (size_t (header.rawsize));
+                    boost::asio::read (socket, buffer (m_compressed));
+                    uLongf rawsize = uLongf (header.rawsize);
+                    if (uncompress (&m_batchbuf[0], &rawsize, &m_compressed[0],
+                                    uLong (header.size)) != Z_OK
+                          || rawsize != header.rawsize) {
+                        error ("Corrupt compressed data from the socket");
+                        return false;
+                    }
+                    m_avail = &m_batchbuf[0];
+                    m_navail = m_batchbuf.size();
+                } else if (header.size <= size) {
+                    // Uncompressed, and all wanted: read straight into
+                    // the caller's memory.
+                    boost::asio::read (socket, buffer (out, size_t (header.size)));
+                    out += header.size;
+                    size -= size_t (header.size);
+                    continue;
+                } else {
+                    m_batchbuf.resize (size_t (header.size));
+                    boost::asio::read (socket, buffer (m_batchbuf));
+                    m_avail = &m_batchbuf[0];
+                    m_navail = m_batchbuf.size();
+                }
+            }
+            size_t n = std::min (size, m_navail);
+            memcpy (out, m_avail, n);
+            out += n;
+            size -= n;
+            m_avail += n;
+            m_navail -= n;
+            if (! m_navail && m_release >= 0) {
+                // Done with this batch, so the writer may reuse its space
+                m_ring.tail() = m_release;
+                m_release = -1;
+            }
+        }
     } catch (boost::system::system_error &err) {
         error ("Error while reading: %s", err.what ());
         return false;
@@ -147,6 +204,10 @@ bool
 SocketInput::close ()
 {
     socket.close();
+    m_ring.close ();
+    m_avail = NULL;
+    m_navail = 0;
+    m_release = -1;
     return true;
 }
 
@@ -209,5 +270,35 @@ SocketInput::get_spec_from_client (ImageSpec &spec)
     return true;
 }
 
+
+
+bool
+SocketInput::negotiate_transport ()
+{
+    // Accept compression always, and the ring if we can attach to it.
+    uint32_t accepted = socket_pvt::MSG_ZLIB;
+    try {
+        socket_pvt::Hello hello;
+        boost::asio::read (socket, buffer (&hello, sizeof(hello)));
+        if (hello.magic != socket_pvt::message_magic) {
+            error ("Unrecognized transport request from the socket");
+            return false;
+        }
+        std::string ringname (hello.namelen, '\0');
+        if (hello.namelen)
+            boost::asio::read (socket, buffer (&ringname[0], hello.namelen));
+        if ((hello.flags & socket_pvt::MSG_SHM) && m_ring.open (ringname))
+            accepted |= socket_pvt::MSG_SHM;
+        boost::asio::write (socket, buffer (&accepted, sizeof(accepted)));
+    } catch (boost::system::system_error &err) {
+        error ("Error while negotiating transport: %s", err.what ());
+        return false;
+    } catch (...) {
+        error ("Error while negotiating transport: unknown exception");
+        return false;
+    }
+    return true;
+}
+
 OIIO_PLUGIN_NAMESPACE_END
 
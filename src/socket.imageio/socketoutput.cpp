@@ -29,8 +29,12 @@
 */
 
 #include <boost/lexical_cast.hpp>
+#include <zlib.h>
 
 #include "OpenImageIO/imageio.h"
+#include "OpenImageIO/strutil.h"
+#include "OpenImageIO/sysutil.h"
+#include "OpenImageIO/thread.h"
 #include "socket_pvt.h"
 
 
@@ -51,9 +55,9 @@ OIIO_PLUGIN_EXPORTS_END
 
 
 SocketOutput::SocketOutput()
-    : socket (io)
+    : socket (io), m_ring_head(0), m_flags(0), m_batch(1)
 {
-
+    memset (&m_pending, 0, sizeof(m_pending));
 }
 
 
@@ -71,7 +75,17 @@ bool
 SocketOutput::open (const std::string &name, const ImageSpec &newspec,
                     OpenMode mode)
 {
-    if (! (connect_to_server (name) && send_spec_to_server (newspec))) {
+    std::map<std::string, std::string> rest_args;
+    std::string baseurl;
+    rest_args["port"] = socket_pvt::default_port;
+    rest_args["host"] = socket_pvt::default_host;
+    if (! Strutil::get_rest_arguments (name, baseurl, rest_args)) {
+        error ("Invalid 'open ()' argument: %s", name.c_str ());
+        return false;
+    }
+
+    if (! (connect_to_server (name) && send_spec_to_server (newspec) &&
+           negotiate_transport (rest_args["host"], rest_args))) {
         return false;
     }
 
@@ -90,16 +104,8 @@ SocketOutput::write_scanline (int y, int z, TypeDesc format,
                               const void *data, stride_t xstride)
 {
     data = to_native_scanline (format, data, xstride, m_scratch);
-
-    try {
-        socket_pvt::socket_write (socket, format, data, m_spec.scanline_bytes ());
-    } catch (boost::system::system_error &err) {
-        error ("Error while writing: %s", err.what ());
+    if (! send (data, m_spec.scanline_bytes ()))
         return false;
-    } catch (...) {
-        error ("Error while writing: unknown exception");
-        return false;
-    }
 
     ++m_next_scanline;
 
@@ -114,9 +120,98 @@ SocketOutput::write_tile (int x, int y, int z,
                           stride_t xstride, stride_t ystride, stride_t zstride)
 {
     data = to_native_tile (format, data, xstride, ystride, zstride, m_scratch);
+    return send (data, m_spec.tile_bytes ());
+}
+
+
+
+bool
+SocketOutput::send (const void *data, size_t size)
+{
+    if (m_ring.valid() && size <= m_ring.capacity()) {
+        // Same-host peer: copy the payload into the ring, and send only
+        // the header (once the batch is full) over the socket.
+        if (m_pending.count && ! (m_pending.flags & socket_pvt::MSG_SHM)
+              && ! flush ())
+            return false;
+        const long long cap = (long long) m_ring.capacity();
+        long long pos = m_ring_head % cap;
+        if (pos + (long long)size > cap) {
+            // Payloads don't wrap, and a batch is contiguous, so send what
+            // we have and start this one at the front of the ring.
+            if (m_pending.count && ! flush ())
+                return false;
+            m_ring_head += cap - pos;
+            pos = 0;
+        }
+        if (m_ring_head + (long long)size - m_ring.tail() > cap) {
+            // Wait for the reader to give back enough room -- which it
+            // can only do for batches it has been told about.
+            if (m_pending.count && ! flush ())
+                return false;
+            for (atomic_backoff backoff;
+                 m_ring_head + (long long)size - m_ring.tail() > cap;  )
+                backoff ();
+        }
+        memcpy (m_ring.data() + pos, data, size);
+        if (! m_pending.count) {
+            memset (&m_pending, 0, sizeof(m_pending));
+            m_pending.flags = socket_pvt::MSG_SHM;
+            m_pending.offset = (uint64_t) pos;
+            m_pending.size = 0;
+        }
+        m_pending.size += size;
+        m_ring_head += size;
+        m_pending.ringend = (uint64_t) m_ring_head;
+    } else {
+        if (m_pending.count && (m_pending.flags & socket_pvt::MSG_SHM)
+              && ! flush ())
+            return false;
+        if (! m_pending.count)
+            memset (&m_pending, 0, sizeof(m_pending));
+        m_batchbuf.insert (m_batchbuf.end(), (const unsigned char *)data,
+                           (const unsigned char *)data + size);
+        m_pending.size = m_batchbuf.size();
+    }
+    if (++m_pending.count >= (uint32_t) m_batch)
+        return flush ();
+    return true;
+}
+
+
+
+bool
+SocketOutput::flush ()
+{
+    if (! m_pending.count)
+        return true;
+    socket_pvt::MessageHeader header = m_pending;
+    header.magic = socket_pvt::message_magic;
+    header.rawsize = header.size;
+    std::vector<const_buffer> bufs;
+    bufs.push_back (buffer (&header, sizeof(header)));
+    if (! (header.flags & socket_pvt::MSG_SHM)) {
+        const unsigned char *payload = &m_batchbuf[0];
+        if (m_flags & socket_pvt::MSG_ZLIB) {
+            // Fastest zlib level: for a remote viewer, cutting the bytes
+            // on the wire matters, not squeezing out the last few.
+            uLongf zsize = compressBound (uLong (m_batchbuf.size()));
+            m_compressed.resize (zsize);
+            if (compress2 (&m_compressed[0], &zsize, payload,
+                           uLong (m_batchbuf.size()), 1) == Z_OK
+                  && zsize < m_batchbuf.size()) {
+                header.flags |= socket_pvt::MSG_ZLIB;
+                header.size = zsize;
+                payload = &m_compressed[0];
+            }
+        }
+        bufs.push_back (buffer (payload, size_t(header.size)));
+    }
+    m_pending.count = 0;
+    m_batchbuf.clear ();
 
     try {
-        socket_pvt::socket_write (socket, format, data, m_spec.tile_bytes ());
+        boost::asio::write (socket, bufs);
     } catch (boost::system::system_error &err) {
         error ("Error while writing: %s", err.what ());
         return false;
@@ -124,7 +219,6 @@ SocketOutput::write_tile (int x, int y, int z,
         error ("Error while writing: unknown exception");
         return false;
     }
-
     return true;
 }
 
@@ -133,8 +227,16 @@ SocketOutput::write_tile (int x, int y, int z,
 bool
 SocketOutput::close ()
 {
-    socket.close();
-    return true;
+    bool ok = true;
+    if (socket.is_open()) {
+        ok = flush ();
+        socket.close();
+    }
+    m_ring.close ();
+    m_flags = 0;
+    m_pending.count = 0;
+    m_batchbuf.clear ();
+    return ok;
 }
 
 
@@ -170,6 +272,57 @@ SocketOutput::send_spec_to_server(const ImageSpec& spec)
 
 
 
+bool
+SocketOutput::negotiate_transport (const std::string &host,
+                                   std::map<std::string, std::string> &args)
+{
+    // Ask for the shared memory ring when the peer is on this host
+    // (unless "shm=0"), and for compression if "compress=1".
+    m_batch = std::max (1, Strutil::from_string<int> (args["batch"]));
+    bool useshm = socket_pvt::is_local_host (host);
+    if (args.find("shm") != args.end())
+        useshm = Strutil::from_string<int> (args["shm"]) != 0;
+    socket_pvt::Hello hello;
+    memset (&hello, 0, sizeof(hello));
+    hello.magic = socket_pvt::message_magic;
+    if (useshm) {
+        size_t ringsize = 32 << 20;
+        if (args.find("ringsize") != args.end())
+            ringsize = size_t (std::max (1, Strutil::from_string<int> (args["ringsize"]))) << 20;
+        if (m_ring.create ("oiio_socket", ringsize))
+            hello.flags |= socket_pvt::MSG_SHM;
+    }
+    if (Strutil::from_string<int> (args["compress"]))
+        hello.flags |= socket_pvt::MSG_ZLIB;
+    std::string ringname = m_ring.name ();
+    hello.namelen = (uint32_t) ringname.size();
+
+    uint32_t accepted = 0;
+    try {
+        std::vector<const_buffer> bufs;
+        bufs.push_back (buffer (&hello, sizeof(hello)));
+        bufs.push_back (buffer (ringname.c_str(), ringname.size()));
+        boost::asio::write (socket, bufs);
+        boost::asio::read (socket, buffer (&accepted, sizeof(accepted)));
+    } catch (boost::system::system_error &err) {
+        error ("Error while negotiating transport: %s", err.what ());
+        return false;
+    } catch (...) {
+        error ("Error while negotiating transport: unknown exception");
+        return false;
+    }
+
+    m_flags = accepted & hello.flags;
+    if (m_flags & socket_pvt::MSG_SHM)
+        m_ring.unlink ();    // the reader has it mapped now
+    else
+        m_ring.close ();
+    m_ring_head = 0;
+    return true;
+}
+
+
+
 bool
 SocketOutput::connect_to_server (const std::string &name)
 {
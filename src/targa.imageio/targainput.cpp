@@ -38,6 +38,7 @@
 #include "OpenImageIO/typedesc.h"
 #include "OpenImageIO/imageio.h"
 #include "OpenImageIO/fmath.h"
+#include "OpenImageIO/filesystem.h"
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
 
@@ -54,6 +55,8 @@ public:
                        const ImageSpec &config);
     virtual bool close ();
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
 
 private:
     std::string m_filename;           ///< Stash the filename
@@ -64,6 +67,7 @@ private:
     tga_alpha_type m_alpha;           ///< Alpha type
     bool m_keep_unassociated_alpha;   ///< Do not convert unassociated alpha
     std::vector<unsigned char> m_buf; ///< Buffer the image pixels
+    Filesystem::IOBufferedReader m_reader; ///< Bulk reads of pixel data
 
     /// Reset everything to initial state
     ///
@@ -80,8 +84,8 @@ private:
     bool readimg ();
 
     /// Helper function: decode a pixel.
-    inline void decode_pixel (unsigned char *in, unsigned char *out,
-                              unsigned char *palette, int& bytespp,
+    inline void decode_pixel (const unsigned char *in, unsigned char *out,
+                              const unsigned char *palette, int& bytespp,
                               int& palbytespp, int& alphabits);
 
     /// Helper: read, with error detection
@@ -488,8 +492,8 @@ TGAInput::open (const std::string &name, ImageSpec &newspec,
 
 
 inline void
-TGAInput::decode_pixel (unsigned char *in, unsigned char *out,
-                        unsigned char *palette, int& bytespp,
+TGAInput::decode_pixel (const unsigned char *in, unsigned char *out,
+                        const unsigned char *palette, int& bytespp,
                         int& palbytespp, int& alphabits)
 {
     unsigned int k = 0;
@@ -631,91 +635,79 @@ TGAInput::readimg ()
 
     m_buf.resize (m_spec.image_bytes());
 
+    // The pixels follow the header (where open() left the file), and
+    // are read through m_reader in large chunks rather than a pixel at
+    // a time.
+    m_reader.reset (m_file);
+    m_reader.seek (ftell (m_file));
+
     // read palette, if there is any
-    unsigned char *palette = NULL;
+    std::vector<unsigned char> palette;
     if (m_tga.cmap_type) {
-        palette = new unsigned char[palbytespp * m_tga.cmap_length];
-        if (! fread (palette, palbytespp, m_tga.cmap_length))
+        palette.resize (palbytespp * m_tga.cmap_length);
+        if (! m_reader.read (&palette[0], palette.size())) {
+            error ("Read error");
             return false;
+        }
     }
+    const unsigned char *pal = palette.size() ? &palette[0] : NULL;
 
+    const int nc = m_spec.nchannels;
+    const int width = m_spec.width;
     unsigned char pixel[4];
     if (m_tga.type < TYPE_PALETTED_RLE) {
-        // uncompressed image data
-        unsigned char in[4];
+        // uncompressed image data, one bottom-to-top scanline at a time
         for (int y = m_spec.height - 1; y >= 0; y--) {
-            for (int x = 0; x < m_spec.width; x++) {
-                if (! fread (in, bytespp, 1))
-                    return false;
-                decode_pixel (in, pixel, palette,
-                              bytespp, palbytespp, alphabits);
-                memcpy (&m_buf[y * m_spec.width * m_spec.nchannels
-                        + x * m_spec.nchannels],
-                        pixel, m_spec.nchannels);
+            const unsigned char *in = m_reader.take (width * bytespp);
+            if (! in) {
+                error ("Read error");
+                return false;
+            }
+            unsigned char *out = &m_buf[y * width * nc];
+            for (int x = 0; x < width; x++, in += bytespp, out += nc) {
+                decode_pixel (in, pixel, pal, bytespp, palbytespp, alphabits);
+                memcpy (out, pixel, nc);
             }
         }
     } else {
-        // Run Length Encoded image
-        unsigned char in[5];
-        int packet_size;
-        for (int y = m_spec.height - 1; y >= 0; y--) {
-            for (int x = 0; x < m_spec.width; x++) {
-                if (! fread (in, 1 + bytespp, 1))
-                    return false;
-                packet_size = 1 + (in[0] & 0x7f);
-                decode_pixel (&in[1], pixel, palette,
-                              bytespp, palbytespp, alphabits);
-                if (in[0] & 0x80) {  // run length packet
-                    /*std::cerr << "[tga] run length packet "
-                              << packet_size << "\n";*/
-                    for (int i = 0; i < packet_size; i++) {
-                        memcpy (&m_buf[y * m_spec.width * m_spec.nchannels
-                                + x * m_spec.nchannels],
-                                pixel, m_spec.nchannels);
-                        if (i < packet_size - 1) {
-                            x++;
-                            if (x >= m_spec.width) {
-                                // run spans across multiple scanlines
-                                x = 0;
-                                if (y > 0)
-                                    y--;
-                                else
-                                    goto loop_break;
-                            }
-                        }
-                    }
-                } else { // non-rle packet
-                    /*std::cerr << "[tga] non-run length packet "
-                              << packet_size << "\n";*/
-                    for (int i = 0; i < packet_size; i++) {
-                        memcpy (&m_buf[y * m_spec.width * m_spec.nchannels
-                                + x * m_spec.nchannels],
-                                pixel, m_spec.nchannels);
-                        if (i < packet_size - 1) {
-                            x++;
-                            if (x >= m_spec.width) {
-                                // run spans across multiple scanlines
-                                x = 0;
-                                if (y > 0)
-                                    y--;
-                                else
-                                    goto loop_break;
-                            }
-                            // skip the packet header byte
-                            if (! fread (&in[1], bytespp, 1))
-                                return false;
-                            decode_pixel(&in[1], pixel, palette,
-                                         bytespp, palbytespp, alphabits);
-                        }
-                    }
+        // Run Length Encoded image.  Packets may span scanlines, so keep
+        // a running output position, in file (bottom-to-top) order.
+        int x = 0, y = m_spec.height - 1;
+        unsigned char *out = &m_buf[y * width * nc];
+        while (y >= 0) {
+            int header = m_reader.getc ();
+            if (header < 0) {
+                error ("Read error");
+                return false;
+            }
+            int packet_size = 1 + (header & 0x7f);
+            bool run = (header & 0x80) != 0;
+            const unsigned char *in = m_reader.take (run ? bytespp
+                                                     : packet_size * bytespp);
+            if (! in) {
+                error ("Read error");
+                return false;
+            }
+            if (run)  // run length packet: decode once, replicate
+                decode_pixel (in, pixel, pal, bytespp, palbytespp, alphabits);
+            while (packet_size--) {
+                if (! run) {  // non-rle packet
+                    decode_pixel (in, pixel, pal, bytespp, palbytespp, alphabits);
+                    in += bytespp;
+                }
+                memcpy (out, pixel, nc);
+                out += nc;
+                if (++x >= width) {
+                    // runs may span across multiple scanlines
+                    x = 0;
+                    if (--y < 0)
+                        break;
+                    out = &m_buf[y * width * nc];
                 }
             }
-            loop_break:;
         }
     }
 
-    delete [] palette;
-
     // flip the image, if necessary
     if (m_tga.cmap_type)
         bytespp = palbytespp;
@@ -769,6 +761,7 @@ TGAInput::readimg ()
 bool
 TGAInput::close ()
 {
+    m_reader.reset ((Filesystem::IOProxy *)NULL);
     if (m_file) {
         fclose (m_file);
         m_file = NULL;
@@ -783,13 +776,29 @@ TGAInput::close ()
 bool
 TGAInput::read_native_scanline (int y, int z, void *data)
 {
-    if (m_buf.empty ())
-        readimg ();
+    return read_native_scanlines (y, y+1, z, data);
+}
+
+
+
+bool
+TGAInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
+{
+    if (ybegin < 0 || yend > m_spec.height || ybegin >= yend)
+        return false;
+    if (m_buf.empty () && ! readimg ()) {
+        m_buf.clear ();
+        return false;
+    }
 
-    if (m_tga.attr & FLAG_Y_FLIP)
-        y = m_spec.height - y - 1;
     size_t size = spec().scanline_bytes();
-    memcpy (data, &m_buf[0] + y * size, size);
+    if (m_tga.attr & FLAG_Y_FLIP) {
+        unsigned char *out = (unsigned char *)data;
+        for (int y = ybegin;  y < yend;  ++y, out += size)
+            memcpy (out, &m_buf[0] + (m_spec.height - y - 1) * size, size);
+    } else {
+        memcpy (data, &m_buf[0] + ybegin * size, size * (yend - ybegin));
+    }
     return true;
 }
 
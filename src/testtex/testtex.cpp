@@ -107,6 +107,7 @@ static int ntrials = 1;
 static int testicwrite = 0;
 static bool test_derivs = false;
 static bool test_statquery = false;
+static bool batch = false;
 static Imath::M33f xform;
 static mutex error_mutex;
 void *dummyptr;
@@ -156,7 +157,7 @@ getargs (int argc, const char *argv[])
                   "--wrap %s", &wrapmodes, "Set wrap mode (default, black, clamp, periodic, mirror, overscan)",
                   "--aniso %d", &anisotropic,
                       Strutil::format("Set max anisotropy (default: %d)", anisotropic).c_str(),
-                  "--mipmode %d", &mipmode, "Set mip mode (default: 0 = aniso)",
+                  "--mipmode %d", &mipmode, "Set mip mode (default: 0 = aniso, 5 = EWA, 6 = stochastic)",
                   "--interpmode %d", &interpmode, "Set interp mode (default: 3 = smart bicubic)",
                   "--missing %f %f %f", &missing[0], &missing[1], &missing[2],
                         "Specify missing texture color",
@@ -164,6 +165,7 @@ getargs (int argc, const char *argv[])
                   "--automip", &automip, "Set auto-MIPmap for the image cache",
                   "--blocksize %d", &blocksize, "Set blocksize (n x n) for batches",
                   "--handle", &use_handle, "Use texture handle rather than name lookup",
+                  "--batch", &batch, "Use the SIMD batched texture_batch() lookups",
                   "--searchpath %s", &searchpath, "Search path for files",
                   "--filtertest", &filtertest, "Test the filter sizes",
                   "--nowarp", &nowarp, "Do not warp the image->texture mapping",
@@ -548,6 +550,70 @@ plain_tex_region (ImageBuf &image, ustring filename, Mapping2D mapping,
 
 
 
+void
+batch_tex_region (ImageBuf &image, ustring filename, Mapping2D mapping,
+                  ImageBuf *image_ds, ImageBuf *image_dt, ROI roi)
+{
+    const int w = TextureSystem::BatchWidth;
+    TextureSystem::Perthread *perthread_info = texsys->get_perthread_info ();
+    TextureSystem::TextureHandle *texture_handle = texsys->get_texture_handle (filename);
+    int nchannels = nchannels_override ? nchannels_override : image.nchannels();
+
+    TextureOpt opt;
+    initialize_opt (opt, nchannels);
+
+    float s[w], t[w], dsdx[w], dtdx[w], dsdy[w], dtdy[w];
+    float *result = ALLOCA (float, w*std::max (3, nchannels));
+    float *dresultds = test_derivs ? ALLOCA (float, w*nchannels) : NULL;
+    float *dresultdt = test_derivs ? ALLOCA (float, w*nchannels) : NULL;
+    float *pixel = ALLOCA (float, std::max (3, nchannels));
+    for (int y = roi.ybegin;  y < roi.yend;  ++y) {
+        for (int x = roi.xbegin;  x < roi.xend;  x += w) {
+            int n = std::min (w, roi.xend - x);
+            unsigned int mask = (1U << n) - 1;
+            for (int i = 0;  i < n;  ++i)
+                mapping (x+i, y, s[i], t[i], dsdx[i], dtdx[i], dsdy[i], dtdy[i]);
+
+            // Call the texture system to do the filtering.
+            bool ok;
+            if (use_handle)
+                ok = texsys->texture_batch (texture_handle, perthread_info,
+                                            opt, mask, s, t, dsdx, dtdx,
+                                            dsdy, dtdy, nchannels,
+                                            result, dresultds, dresultdt);
+            else
+                ok = texsys->texture_batch (filename, opt, mask,
+                                            s, t, dsdx, dtdx, dsdy, dtdy,
+                                            nchannels, result,
+                                            dresultds, dresultdt);
+            if (! ok) {
+                std::string e = texsys->geterror ();
+                if (! e.empty()) {
+                    lock_guard lock (error_mutex);
+                    std::cerr << "ERROR: " << e << "\n";
+                }
+            }
+
+            // Save filtered pixels back to the image.
+            for (int i = 0;  i < n;  ++i) {
+                for (int c = 0;  c < nchannels;  ++c)
+                    pixel[c] = result[c*w+i] * scalefactor;
+                image.setpixel (x+i, y, pixel);
+                if (test_derivs) {
+                    for (int c = 0;  c < nchannels;  ++c)
+                        pixel[c] = dresultds[c*w+i];
+                    image_ds->setpixel (x+i, y, pixel);
+                    for (int c = 0;  c < nchannels;  ++c)
+                        pixel[c] = dresultdt[c*w+i];
+                    image_dt->setpixel (x+i, y, pixel);
+                }
+            }
+        }
+    }
+}
+
+
+
 void
 test_plain_texture (Mapping2D mapping)
 {
@@ -576,7 +642,8 @@ test_plain_texture (Mapping2D mapping)
             std::cout << "iter " << iter << " file " << filename << "\n";
         }
 
-        OIIO::ImageBufAlgo::parallel_image (OIIO::bind(plain_tex_region, OIIO::ref(image), filename, mapping,
+        OIIO::ImageBufAlgo::parallel_image (OIIO::bind(batch ? batch_tex_region : plain_tex_region,
+                                                  OIIO::ref(image), filename, mapping,
                                                   test_derivs ? &image_ds : NULL,
                                                   test_derivs ? &image_dt : NULL, _1),
                                       get_roi(image.spec()), nthreads);
@@ -0,0 +1,134 @@
+/*
+  Copyright 2016 Larry Gritz and the other authors and contributors.
+  All Rights Reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+  * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+  * Neither the name of the software's owners nor the names of its
+    contributors may be used to endorse or promote products derived from
+    this software without specific prior written permission.
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+  (This is the Modified BSD License)
+*/
+
+#ifndef OPENIMAGEIO_TIFF_PVT_H
+#define OPENIMAGEIO_TIFF_PVT_H
+
+#include <tiffio.h>
+
+#include "OpenImageIO/filesystem.h"
+#include "OpenImageIO/imageio.h"
+
+
+OIIO_PLUGIN_NAMESPACE_BEGIN
+
+namespace TIFF_pvt {
+
+// libtiff client procs for a TIFF that is read from or written to a
+// Filesystem::IOProxy (passed as the thandle_t) rather than a named file.
+
+inline tsize_t
+io_readproc (thandle_t handle, tdata_t data, tsize_t size)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) handle;
+    return tsize_t (io->read (data, size_t(size)));
+}
+
+inline tsize_t
+io_writeproc (thandle_t handle, tdata_t data, tsize_t size)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) handle;
+    return tsize_t (io->write (data, size_t(size)));
+}
+
+inline toff_t
+io_seekproc (thandle_t handle, toff_t offset, int origin)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) handle;
+    if (! io->seek (int64_t(offset), origin))
+        return toff_t(-1);
+    return toff_t (io->tell());
+}
+
+inline int
+io_closeproc (thandle_t handle)
+{
+    // The proxy belongs to the caller, who will close it.
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) handle;
+    io->flush ();
+    return 0;
+}
+
+inline toff_t
+io_sizeproc (thandle_t handle)
+{
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) handle;
+    return toff_t (io->size());
+}
+
+inline int
+io_mapproc (thandle_t handle, tdata_t *base, toff_t *size)
+{
+    // If the proxy's bytes are all in memory, let libtiff use them in
+    // place, with no copying.
+    Filesystem::IOProxy *io = (Filesystem::IOProxy *) handle;
+    const void *mem = io->mmap ();
+    if (! mem)
+        return 0;
+    *base = (tdata_t) mem;
+    *size = toff_t (io->size());
+    return 1;
+}
+
+inline void
+io_unmapproc (thandle_t handle, tdata_t base, toff_t size)
+{
+}
+
+
+
+/// Open a TIFF on an IOProxy.  Mode is as for TIFFOpen, except that the
+/// 'm' flag is added unless the proxy's bytes are addressable in memory.
+inline TIFF *
+open_ioproxy (Filesystem::IOProxy *io, const char *mode)
+{
+    std::string m (mode);
+    if (m[0] == 'r' && ! io->mmap())
+        m += 'm';
+    io->seek (0);
+    const std::string &name (io->filename());
+    return TIFFClientOpen (name.size() ? name.c_str() : "ioproxy", m.c_str(),
+                           (thandle_t) io, io_readproc, io_writeproc,
+                           io_seekproc, io_closeproc, io_sizeproc,
+                           io_mapproc, io_unmapproc);
+}
+
+
+
+/// The libtiff handle of a TIFFInput, set to the directory of its current
+/// subimage, or NULL if in is not a TIFFInput.  This lets
+/// TIFFOutput::copy_image copy compressed strips and tiles straight across.
+TIFF *input_handle (ImageInput *in);
+
+}  // namespace TIFF_pvt
+
+OIIO_PLUGIN_NAMESPACE_END
+
+#endif  // OPENIMAGEIO_TIFF_PVT_H
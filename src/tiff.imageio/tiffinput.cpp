@@ -34,9 +34,14 @@
 #include <cmath>
 
 #include <boost/regex.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread/tss.hpp>
 
 #include <tiffio.h>
+#include <zlib.h>
+#ifdef USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
 
 #include "OpenImageIO/dassert.h"
 #include "OpenImageIO/typedesc.h"
@@ -46,6 +51,8 @@
 #include "OpenImageIO/filesystem.h"
 #include "OpenImageIO/fmath.h"
 
+#include "tiff_pvt.h"
+
 
 OIIO_PLUGIN_NAMESPACE_BEGIN
 
@@ -99,7 +106,11 @@ public:
     virtual bool valid_file (const std::string &filename) const;
     virtual int supports (string_view feature) const {
         return (feature == "exif"
-             || feature == "iptc");
+             || feature == "iptc"
+             || feature == "ioproxy"
+             || (feature == "concurrent_reads" && concurrent_reads_ok())
+             || (feature == "random_access" && ! m_no_random_access &&
+                 ! m_use_rgba_interface));
         // N.B. No support for arbitrary metadata.
     }
     virtual bool open (const std::string &name, ImageSpec &newspec);
@@ -116,7 +127,18 @@ public:
     }
     virtual bool seek_subimage (int subimage, int miplevel, ImageSpec &newspec);
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        void *data);
+    virtual bool read_native_scanlines (int ybegin, int yend, int z,
+                                        int chbegin, int chend, void *data);
     virtual bool read_native_tile (int x, int y, int z, void *data);
+    virtual bool read_native_tiles (int xbegin, int xend, int ybegin, int yend,
+                                    int zbegin, int zend,
+                                    int chbegin, int chend, void *data);
+    virtual bool native_tile_offset (int x, int y, int z,
+                                     imagesize_t &offset);
+    virtual bool read_native_tile_at (int subimage, int miplevel,
+                                      int x, int y, int z, void *data);
     virtual bool read_scanline (int y, int z, TypeDesc format, void *data,
                                 stride_t xstride);
     virtual bool read_scanlines (int ybegin, int yend, int z,
@@ -131,7 +153,10 @@ public:
                              stride_t xstride, stride_t ystride, stride_t zstride);
 
 private:
+    friend TIFF *TIFF_pvt::input_handle (ImageInput *in);
+
     TIFF *m_tif;                     ///< libtiff handle
+    Filesystem::IOProxy *m_io;       ///< Caller's proxy (not owned), or NULL
     std::string m_filename;          ///< Stash the filename
     std::vector<unsigned char> m_scratch; ///< Scratch space for us to use
     std::vector<unsigned char> m_scratch2; ///< More scratch
@@ -144,6 +169,7 @@ private:
     bool m_convert_alpha;            ///< Do we need to associate alpha?
     bool m_separate;                 ///< Separate planarconfig?
     bool m_testopenconfig;           ///< Debug aid to test open-with-config
+    bool m_pixels_only;              ///< Caller doesn't need the metadata
     bool m_use_rgba_interface;       ///< Sometimes we punt
     unsigned short m_planarconfig;   ///< Planar config of the file
     unsigned short m_bitspersample;  ///< Of the *file*, not the client's view
@@ -153,9 +179,30 @@ private:
     std::vector<unsigned short> m_colormap;  ///< Color map for palette images
     std::vector<uint32_t> m_rgbadata; ///< Sometimes we punt
 
+    // Where the tiles of one directory are and how to decode them
+    // without libtiff, so that read_native_tile_at can be called from
+    // many threads at once.  Noted by seek_subimage for each directory
+    // that qualifies; m_concurrent is guarded by m_concurrent_mutex.
+    struct ConcurrentTiles {
+        std::vector<uint64_t> offsets, bytecounts;
+        int x, y, z, width, height, depth;
+        int tile_width, tile_height, tile_depth;
+        int nchans, valbytes;
+        unsigned short compression, predictor;
+        bool swapped;
+    };
+    std::vector<ConcurrentTiles *> m_concurrent; ///< By directory
+    std::vector<char> m_dir_seen;    ///< Directories seek_subimage noted
+    int m_ndirs;                     ///< Directories in the file, or 0
+    int m_concurrent_ready;          ///< Entries of m_concurrent filled
+    bool m_concurrent_failed;        ///< Some directory doesn't qualify
+    spin_mutex m_concurrent_mutex;
+    boost::scoped_ptr<Filesystem::IOFile> m_pread_file; ///< Unless m_io
+
     // Reset everything to initial state
     void init () {
         m_tif = NULL;
+        m_io = NULL;
         m_subimage = -1;
         m_emulate_mipmap = false;
         m_keep_unassociated_alpha = false;
@@ -163,8 +210,24 @@ private:
         m_separate = false;
         m_inputchannels = 0;
         m_testopenconfig = false;
+        m_pixels_only = false;
         m_colormap.clear();
         m_use_rgba_interface = false;
+        m_ndirs = 0;
+        m_concurrent_ready = 0;
+        m_concurrent_failed = false;
+    }
+
+    // Open m_tif on the proxy we were given, or else on m_filename.
+    TIFF *open_tif () {
+        if (m_io)
+            return TIFF_pvt::open_ioproxy (m_io, "r");
+#ifdef _WIN32
+        std::wstring wfilename = Strutil::utf8_to_utf16 (m_filename);
+        return TIFFOpenW (wfilename.c_str(), "rm");
+#else
+        return TIFFOpen (m_filename.c_str(), "rm");
+#endif
     }
 
     void close_tif () {
@@ -174,8 +237,24 @@ private:
             if (m_rgbadata.size())
                 std::vector<uint32_t>().swap(m_rgbadata); // release
         }
+        for (size_t i = 0;  i < m_concurrent.size();  ++i)
+            delete m_concurrent[i];
+        m_concurrent.clear ();
+        m_dir_seen.clear ();
+        m_pread_file.reset ();
     }
 
+    // Once the file is open, concurrent reads are ok when seek_subimage
+    // has visited every directory and found they all qualify.
+    bool concurrent_reads_ok () const {
+        return ! m_tif || (! m_concurrent_failed && m_ndirs > 0 &&
+                           m_concurrent_ready == m_ndirs);
+    }
+
+    // Note the tile layout of the current directory in m_concurrent, if
+    // read_native_tile_at can read and decode its tiles on its own.
+    void note_concurrent_tiles ();
+
     // Read tags from the current directory of m_tif and fill out spec.
     // If read_meta is false, assume that m_spec already contains valid
     // metadata and should not be cleared or rewritten.
@@ -197,6 +276,15 @@ private:
 
     void invert_photometric (int n, void *data);
 
+    // Is this a planar file whose planes can be read individually and
+    // just interleaved, so a channel subset needn't read the others?
+    bool separate_subset_ok () const;
+
+    // If the current subimage is made of LZW or Deflate compressed
+    // strips that we know how to decode ourselves, return the number of
+    // rows per strip and the predictor, otherwise return 0.
+    uint32 parallel_strip_rows (unsigned short &predictor);
+
     // Calling TIFFGetField (tif, tag, &dest) is supposed to work fine for
     // simple types... as long as the tag types in the file are the correct
     // advertised types.  But for some types -- which we never expect, but
@@ -382,6 +470,9 @@ static CompressionCode tiff_compressions[] = {
     { COMPRESSION_T85,           "T85" },         // TIFF/FX T.85 JBIG
     { COMPRESSION_T43,           "T43" },         // TIFF/FX T.43 color layered JBIG
     { COMPRESSION_LZMA,          "lzma" },        // LZMA2
+#endif
+#ifdef COMPRESSION_ZSTD
+    { COMPRESSION_ZSTD,          "zstd" },        // Zstandard
 #endif
     { -1, NULL }
 };
@@ -457,7 +548,31 @@ TIFFInput::open (const std::string &name, ImageSpec &newspec,
     // OIIO components.
     if (config.get_int_attribute("oiio:DebugOpenConfig!", 0))
         m_testopenconfig = true;
-    return open (name, newspec);
+    // The caller has seen this file before and only needs the data
+    // layout and pixels, so don't bother gathering the metadata.
+    if (config.get_int_attribute("oiio:PixelsOnly", 0))
+        m_pixels_only = true;
+    const ImageIOParameter *p = config.find_attribute ("oiio:ioproxy",
+                                                       TypeDesc::PTR);
+    if (p)
+        m_io = *(Filesystem::IOProxy * const *) p->data();
+    if (! open (name, newspec))
+        return false;
+    // "oiio:ConcurrentReads" means the caller will want to use
+    // read_native_tile_at from many threads, so visit every directory
+    // now rather than waiting for the caller to seek to them.
+    if (config.get_int_attribute ("oiio:ConcurrentReads", 0) &&
+          m_ndirs > 1 && ! m_concurrent_failed) {
+        ImageSpec tmp;
+        for (int d = 1;  d < m_ndirs && ! m_concurrent_failed;  ++d)
+            if (! seek_subimage (m_emulate_mipmap ? 0 : d,
+                                 m_emulate_mipmap ? d : 0, tmp))
+                break;
+        (void) geterror ();   // A failure is not an error here
+        if (! seek_subimage (0, 0, tmp))
+            return false;
+    }
+    return true;
 }
 
 
@@ -490,12 +605,7 @@ TIFFInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
     bool read_meta = !(m_emulate_mipmap && m_tif && m_subimage >= 0);
 
     if (! m_tif) {
-#ifdef _WIN32
-        std::wstring wfilename = Strutil::utf8_to_utf16 (m_filename);
-        m_tif = TIFFOpenW (wfilename.c_str(), "rm");
-#else
-        m_tif = TIFFOpen (m_filename.c_str(), "rm");
-#endif
+        m_tif = open_tif ();
         if (m_tif == NULL) {
             std::string e = oiio_tiff_last_error();
             error ("Could not open file: %s", e.length() ? e : m_filename);
@@ -530,6 +640,7 @@ TIFFInput::seek_subimage (int subimage, int miplevel, ImageSpec &newspec)
             error ("No support for data format of \"%s\"", m_filename.c_str());
             return false;
         }
+        note_concurrent_tiles ();
         return true;
     } else {
         std::string e = oiio_tiff_last_error();
@@ -752,7 +863,7 @@ TIFFInput::readspec (bool read_meta)
 
     // Use the table for all the obvious things that can be mindlessly
     // shoved into the image spec.
-    if (read_meta) {
+    if (read_meta && ! m_pixels_only) {
         for (int i = 0;  tiff_tag_table[i].name;  ++i)
             find_tag (tiff_tag_table[i].tifftag,
                       tiff_tag_table[i].tifftype, tiff_tag_table[i].name);
@@ -906,6 +1017,16 @@ TIFFInput::readspec (bool read_meta)
     if (! read_meta)
         return;
 
+    // If the caller only wants pixels, the one thing below that matters
+    // is whether subimages are really MIP levels.
+    if (m_pixels_only) {
+        char *s = NULL;
+        TIFFGetField (m_tif, TIFFTAG_PIXAR_TEXTUREFORMAT, &s);
+        if (s)
+            m_emulate_mipmap = true;
+        return;
+    }
+
     short resunit = -1;
     TIFFGetField (m_tif, TIFFTAG_RESOLUTIONUNIT, &resunit);
     switch (resunit) {
@@ -953,12 +1074,7 @@ TIFFInput::readspec (bool read_meta)
         // I'm not sure what state TIFFReadEXIFDirectory leaves us.
         // So to be safe, close and re-seek.
         TIFFClose (m_tif);
-#ifdef _WIN32
-        std::wstring wfilename = Strutil::utf8_to_utf16 (m_filename);
-        m_tif = TIFFOpenW (wfilename.c_str(), "rm");
-#else
-        m_tif = TIFFOpen (m_filename.c_str(), "rm");
-#endif
+        m_tif = open_tif ();
         TIFFSetDirectory (m_tif, m_subimage);
 
         // A few tidbits to look for
@@ -1046,6 +1162,60 @@ TIFFInput::readspec (bool read_meta)
         desc = boost::regex_replace (desc, boost::regex(average_pattern), "");
         updatedDesc = true;
     }
+    found = desc.rfind ("oiio:EnvImportance=");
+    if (found != std::string::npos) {
+        size_t begin = desc.find_first_of ('=', found) + 1;
+        size_t end = std::min (desc.find_first_of (' ', begin), desc.size());
+        string_view s = string_view (desc.data()+begin, end-begin);
+        m_spec.attribute ("oiio:EnvImportance", s);
+        desc.erase (found, std::min (end+1, desc.size()) - found);
+        updatedDesc = true;
+    }
+    found = desc.rfind ("oiio:MinMaxChannels=");
+    if (found != std::string::npos) {
+        size_t begin = desc.find_first_of ('=', found) + 1;
+        size_t end = std::min (desc.find_first_of (' ', begin), desc.size());
+        string_view s = string_view (desc.data()+begin, end-begin);
+        m_spec.attribute ("oiio:MinMaxChannels", s);
+        desc.erase (found, std::min (end+1, desc.size()) - found);
+        updatedDesc = true;
+    }
+    found = desc.rfind ("oiio:SourceHash=");
+    if (found != std::string::npos) {
+        size_t begin = desc.find_first_of ('=', found) + 1;
+        size_t end = std::min (desc.find_first_of (' ', begin), desc.size());
+        string_view s = string_view (desc.data()+begin, end-begin);
+        m_spec.attribute ("oiio:SourceHash", s);
+        desc.erase (found, std::min (end+1, desc.size()) - found);
+        updatedDesc = true;
+    }
+    found = desc.rfind ("oiio:ConstantTiles=");
+    if (found != std::string::npos) {
+        size_t begin = desc.find_first_of ('=', found) + 1;
+        size_t end = std::min (desc.find_first_of (' ', begin), desc.size());
+        string_view s = string_view (desc.data()+begin, end-begin);
+        m_spec.attribute ("oiio:ConstantTiles", s);
+        desc.erase (found, std::min (end+1, desc.size()) - found);
+        updatedDesc = true;
+    }
+    found = desc.rfind ("oiio:TileHashes=");
+    if (found != std::string::npos) {
+        size_t begin = desc.find_first_of ('=', found) + 1;
+        size_t end = std::min (desc.find_first_of (' ', begin), desc.size());
+        string_view s = string_view (desc.data()+begin, end-begin);
+        m_spec.attribute ("oiio:TileHashes", s);
+        desc.erase (found, std::min (end+1, desc.size()) - found);
+        updatedDesc = true;
+    }
+    found = desc.rfind ("oiio:PixelHash=");
+    if (found != std::string::npos) {
+        size_t begin = desc.find_first_of ('=', found) + 1;
+        size_t end = std::min (desc.find_first_of (' ', begin), desc.size());
+        string_view s = string_view (desc.data()+begin, end-begin);
+        m_spec.attribute ("oiio:PixelHash", s);
+        desc.erase (found, std::min (end+1, desc.size()) - found);
+        updatedDesc = true;
+    }
     found = desc.rfind ("oiio:SHA-1=");
     if (found == std::string::npos)  // back compatibility with < 1.5
         found = desc.rfind ("SHA-1=");
@@ -1081,6 +1251,15 @@ TIFFInput::close ()
 
 
 
+TIFF *
+TIFF_pvt::input_handle (ImageInput *in)
+{
+    TIFFInput *tiffin = dynamic_cast<TIFFInput *> (in);
+    return (tiffin && tiffin->m_subimage >= 0) ? tiffin->m_tif : NULL;
+}
+
+
+
 /// Helper: Convert n pixels from separate (RRRGGGBBB) to contiguous
 /// (RGBRGBRGB) planarconfig.
 void
@@ -1245,8 +1424,11 @@ TIFFInput::read_native_scanline (int y, int z, void *data)
             ImageSpec dummyspec;
             int old_subimage = current_subimage();
             int old_miplevel = current_miplevel();
-            if (! close ()  ||
-                ! open (m_filename, dummyspec)  ||
+            Filesystem::IOProxy *io = m_io;
+            if (! close ())
+                return false;
+            m_io = io;
+            if (! open (m_filename, dummyspec)  ||
                 ! seek_subimage (old_subimage, old_miplevel, dummyspec)) {
                 return false;    // Somehow, the re-open failed
             }
@@ -1357,6 +1539,448 @@ TIFFInput::read_native_scanline (int y, int z, void *data)
 
 
 
+namespace {
+
+// Decode one strip of TIFF-flavored LZW (MSB-first codes, with the code
+// width growing one code early).  Return false for the old-style
+// LSB-first variant or for corrupt data, in which case the caller should
+// let libtiff handle it.
+static bool
+lzw_decode (const unsigned char *in, size_t insize,
+            unsigned char *out, size_t outsize)
+{
+    if (insize >= 2 && in[0] == 0 && (in[1] & 0x1))
+        return false;    // Old-style (pre-6.0) LZW
+    const int clear_code = 256, eoi_code = 257, max_codes = 4096;
+    unsigned short prefix[max_codes];
+    unsigned char suffix[max_codes], first[max_codes];
+    unsigned short length[max_codes];
+    for (int i = 0;  i < 256;  ++i) {
+        prefix[i] = 0;
+        suffix[i] = first[i] = (unsigned char) i;
+        length[i] = 1;
+    }
+    int width = 9, next = 258, old = -1;
+    unsigned int bits = 0;
+    int nbits = 0;
+    size_t op = 0;
+    const unsigned char *inend = in + insize;
+    while (op < outsize) {
+        while (nbits < width && in < inend) {
+            bits = (bits << 8) | *in++;
+            nbits += 8;
+        }
+        if (nbits < width)
+            break;    // Ran out of codes
+        int code = int (bits >> (nbits - width)) & ((1 << width) - 1);
+        nbits -= width;
+        if (code == eoi_code)
+            break;
+        if (code == clear_code) {
+            width = 9;
+            next = 258;
+            old = -1;
+            continue;
+        }
+        if (old < 0) {
+            if (code > 255)
+                return false;
+            out[op++] = (unsigned char) code;
+            old = code;
+            continue;
+        }
+        if (code > next || (code == next && next >= max_codes))
+            return false;
+        if (next < max_codes) {
+            // The new entry is the old string plus the first character
+            // of this one (which, if code is the new entry itself, is
+            // the first character of the old string).
+            prefix[next] = (unsigned short) old;
+            first[next] = first[old];
+            suffix[next] = (code == next) ? first[old] : first[code];
+            length[next] = (unsigned short) (length[old] + 1);
+            ++next;
+            if (next >= (1 << width) - 1 && width < 12)
+                ++width;
+        }
+        // Write out the string for code, back to front, truncating it
+        // if it would overflow the strip.
+        size_t len = length[code];
+        size_t end = std::min (op + len, outsize);
+        int c = code;
+        for (size_t p = op + len;  p > op;  c = prefix[c]) {
+            --p;
+            if (p < end)
+                out[p] = suffix[c];
+        }
+        op = end;
+        old = code;
+    }
+    return op == outsize;
+}
+
+
+
+
+// Undo the horizontal differencing predictor on one row of nvals values
+// of nchans channels each.
+template<class T>
+static void
+undo_horizontal_predictor (T *row, int nvals, int nchans)
+{
+    for (int i = nchans;  i < nvals;  ++i)
+        row[i] = T (row[i] + row[i-nchans]);
+}
+
+
+
+// Undo the floating point predictor on one row of nvals values of
+// nchans channels each and valbytes bytes per value: the bytes were
+// differenced, and spread into planes from most to least significant.
+static void
+undo_float_predictor (unsigned char *row, int nvals, int nchans,
+                      int valbytes, std::vector<unsigned char> &tmp)
+{
+    size_t rowbytes = size_t(nvals) * valbytes;
+    for (size_t i = nchans;  i < rowbytes;  ++i)
+        row[i] = (unsigned char) (row[i] + row[i-nchans]);
+    tmp.assign (row, row+rowbytes);
+    for (int v = 0;  v < nvals;  ++v)
+        for (int b = 0;  b < valbytes;  ++b)
+            row[v*valbytes+b] = tmp[(littleendian() ? valbytes-b-1 : b) * nvals + v];
+}
+
+
+
+// Decompress nrows rows (of rowbytes bytes, nvals values of nchans
+// channels and valbytes bytes each) of a strip or tile into out, then
+// undo the predictor and byte swapping.  Return false if the data is
+// not something we can decode, or is corrupt.
+static bool
+decode_chunk (const unsigned char *in, size_t insize,
+              unsigned short compression, unsigned short predictor,
+              bool swapped, int nrows, size_t rowbytes,
+              int nvals, int nchans, int valbytes,
+              unsigned char *out, std::vector<unsigned char> &tmp)
+{
+    size_t bytes = size_t(nrows) * rowbytes;
+    bool ok = false;
+    if (compression == COMPRESSION_NONE) {
+        ok = (insize >= bytes);
+        if (ok)
+            memcpy (out, in, bytes);
+        predictor = PREDICTOR_NONE;   // Only used with compression
+    } else if (compression == COMPRESSION_LZW) {
+        ok = lzw_decode (insize ? in : NULL, insize, out, bytes);
+    } else {
+#ifdef USE_LIBDEFLATE
+        // libdeflate inflates a whole chunk much faster than zlib, but
+        // can't stop early, so reading part of a chunk falls back to zlib.
+        libdeflate_decompressor *d = insize ? libdeflate_alloc_decompressor () : NULL;
+        if (d) {
+            size_t n = 0;
+            libdeflate_result r = libdeflate_zlib_decompress (d, in, insize,
+                                                              out, bytes, &n);
+            libdeflate_free_decompressor (d);
+            if (r == LIBDEFLATE_SUCCESS)
+                ok = (n == bytes);
+            else if (r != LIBDEFLATE_INSUFFICIENT_SPACE)
+                return false;   // corrupt
+        }
+#endif
+        // Deflate: stop after the rows we need, ignoring the rest.
+        z_stream z;
+        memset (&z, 0, sizeof(z));
+        if (! ok && insize && inflateInit (&z) == Z_OK) {
+            z.next_in = (Bytef *) in;
+            z.avail_in = (uInt) insize;
+            z.next_out = (Bytef *) out;
+            z.avail_out = (uInt) bytes;
+            int r = inflate (&z, Z_FINISH);
+            ok = (r == Z_STREAM_END || r == Z_OK || r == Z_BUF_ERROR)
+                 && z.avail_out == 0;
+            inflateEnd (&z);
+        }
+    }
+    if (! ok)
+        return false;
+    for (int r = 0;  r < nrows;  ++r) {
+        unsigned char *row = out + r * rowbytes;
+        if (predictor == PREDICTOR_FLOATINGPOINT) {
+            undo_float_predictor (row, nvals, nchans, valbytes, tmp);
+            continue;
+        }
+        if (swapped) {
+            if (valbytes == 2)
+                swap_endian ((unsigned short *)row, nvals);
+            else if (valbytes == 4)
+                swap_endian ((unsigned int *)row, nvals);
+        }
+        if (predictor == PREDICTOR_HORIZONTAL) {
+            if (valbytes == 1)
+                undo_horizontal_predictor (row, nvals, nchans);
+            else if (valbytes == 2)
+                undo_horizontal_predictor ((unsigned short *)row, nvals, nchans);
+            else
+                undo_horizontal_predictor ((unsigned int *)row, nvals, nchans);
+        }
+    }
+    return true;
+}
+
+
+
+// Task for read_native_scanlines: decompress a range of strips, undo
+// the predictor and byte swapping, and copy the rows that were asked
+// for to the caller's buffer.
+struct StripDecodeTask {
+    const std::vector<unsigned char> *raw; // Raw strips, from strip0 on
+    int sbegin, send;            // Strips to decode (relative to strip0)
+    int strip0row;               // First row of strip 0 (image relative)
+    int ybegin, yend;            // Rows wanted (image relative)
+    int rowsperstrip;
+    size_t scanline_bytes;
+    int nvals, nchans, valbytes; // Values per row, channels, value size
+    unsigned short compression, predictor;
+    bool swapped;
+    unsigned char *data;         // Row ybegin of the caller's buffer
+    atomic_int *failures;
+
+    void operator() () {
+        std::vector<unsigned char> strip, tmp;
+        for (int s = sbegin;  s < send;  ++s) {
+            int row0 = strip0row + s * rowsperstrip;
+            int nrows = rowsperstrip;
+            int r0 = std::max (row0, ybegin), r1 = std::min (row0 + nrows, yend);
+            // Decode only through the last row we need.
+            nrows = r1 - row0;
+            strip.resize (size_t(nrows) * scanline_bytes);
+            const std::vector<unsigned char> &in (raw[s]);
+            if (! decode_chunk (in.size() ? &in[0] : NULL, in.size(),
+                                compression, predictor, swapped,
+                                nrows, scanline_bytes, nvals, nchans,
+                                valbytes, &strip[0], tmp)) {
+                ++(*failures);
+                return;
+            }
+            memcpy (data + (r0 - ybegin) * scanline_bytes,
+                    &strip[(r0 - row0) * scanline_bytes],
+                    (r1 - r0) * scanline_bytes);
+        }
+    }
+};
+
+}  // end anon namespace
+
+
+
+uint32
+TIFFInput::parallel_strip_rows (unsigned short &predictor)
+{
+    if (m_use_rgba_interface || m_separate || TIFFIsTiled (m_tif) ||
+          m_spec.depth > 1 || m_spec.channelformats.size() ||
+          m_photometric == PHOTOMETRIC_PALETTE ||
+          m_photometric == PHOTOMETRIC_SEPARATED ||
+          m_inputchannels != m_spec.nchannels ||
+          (m_bitspersample != 8 && m_bitspersample != 16 &&
+           m_bitspersample != 32) ||
+          int(m_spec.format.size()) * 8 != m_bitspersample ||
+          (m_compression != COMPRESSION_LZW &&
+           m_compression != COMPRESSION_ADOBE_DEFLATE &&
+           m_compression != COMPRESSION_DEFLATE))
+        return 0;
+    unsigned short fillorder = FILLORDER_MSB2LSB;
+    TIFFGetFieldDefaulted (m_tif, TIFFTAG_FILLORDER, &fillorder);
+    predictor = PREDICTOR_NONE;
+    TIFFGetFieldDefaulted (m_tif, TIFFTAG_PREDICTOR, &predictor);
+    if (fillorder != FILLORDER_MSB2LSB ||
+          (predictor != PREDICTOR_NONE && predictor != PREDICTOR_HORIZONTAL &&
+           predictor != PREDICTOR_FLOATINGPOINT))
+        return 0;
+    uint32 rowsperstrip = 0;
+    TIFFGetFieldDefaulted (m_tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
+    return std::min (rowsperstrip, uint32(m_spec.height));
+}
+
+
+
+bool
+TIFFInput::read_native_scanlines (int ybegin, int yend, int z, void *data)
+{
+    // Strips are independently compressed, so when many of them are
+    // wanted, read their raw bytes (that has to be serial) and decode
+    // them in parallel.  Anything unusual goes through libtiff a
+    // scanline at a time, as does a failure to decode any strip.
+    yend = std::min (yend, m_spec.y+m_spec.height);
+    int nthreads = threads();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    unsigned short predictor = PREDICTOR_NONE;
+    uint32 rowsperstrip = (nthreads > 1 && yend - ybegin > 1)
+                        ? parallel_strip_rows (predictor) : 0;
+    int y0 = ybegin - m_spec.y, y1 = yend - m_spec.y;
+    int strip0 = rowsperstrip ? y0 / int(rowsperstrip) : 0;
+    int nstrips = rowsperstrip ? (y1 - 1) / int(rowsperstrip) + 1 - strip0 : 0;
+    if (nstrips < 2)
+        return ImageInput::read_native_scanlines (ybegin, yend, z, data);
+
+    std::vector<std::vector<unsigned char> > raw (nstrips);
+    for (int s = 0;  s < nstrips;  ++s) {
+        tstrip_t strip = TIFFComputeStrip (m_tif, uint32((strip0 + s) * rowsperstrip), 0);
+        tmsize_t size = TIFFRawStripSize (m_tif, strip);
+        if (size <= 0)
+            return ImageInput::read_native_scanlines (ybegin, yend, z, data);
+        raw[s].resize (size);
+        if (TIFFReadRawStrip (m_tif, strip, &raw[s][0], size) < 0) {
+            error ("%s", oiio_tiff_last_error());
+            return false;
+        }
+    }
+
+    atomic_int failures (0);
+    StripDecodeTask task;
+    task.raw = &raw[0];
+    task.strip0row = strip0 * int(rowsperstrip);
+    task.ybegin = y0;
+    task.yend = y1;
+    task.rowsperstrip = int(rowsperstrip);
+    task.scanline_bytes = m_spec.scanline_bytes (true);
+    task.nvals = m_spec.width * m_spec.nchannels;
+    task.nchans = m_spec.nchannels;
+    task.valbytes = int(m_spec.format.size());
+    task.compression = m_compression;
+    task.predictor = predictor;
+    task.swapped = TIFFIsByteSwapped (m_tif);
+    task.data = (unsigned char *) data;
+    task.failures = &failures;
+    nthreads = std::min (nthreads, nstrips);
+    int per_task = (nstrips + nthreads - 1) / nthreads;
+    task_set tasks;
+    for (int s = 0;  s < nstrips;  s += per_task) {
+        task.sbegin = s;
+        task.send = std::min (s + per_task, nstrips);
+        tasks.push (task);
+    }
+    tasks.wait ();
+    if (failures)
+        return ImageInput::read_native_scanlines (ybegin, yend, z, data);
+
+    if (m_photometric == PHOTOMETRIC_MINISWHITE)
+        invert_photometric ((yend - ybegin) * task.nvals, data);
+    return true;
+}
+
+
+
+bool
+TIFFInput::separate_subset_ok () const
+{
+    return m_separate && ! m_use_rgba_interface &&
+        m_photometric != PHOTOMETRIC_PALETTE &&
+        m_photometric != PHOTOMETRIC_SEPARATED &&
+        m_inputchannels == m_spec.nchannels &&
+        m_spec.channelformats.empty() &&
+        m_bitspersample == 8 * m_spec.format.size() &&
+        (m_bitspersample == 8 || m_bitspersample == 16 ||
+         m_bitspersample == 32);
+}
+
+
+
+bool
+TIFFInput::read_native_scanlines (int ybegin, int yend, int z,
+                                  int chbegin, int chend, void *data)
+{
+    // For separate planarconfig, each channel is its own plane in the
+    // file, so read only the planes that were asked for.  (LZW-style
+    // sequential access needs every plane of every row to be walked, so
+    // leave that to the generic code.)
+    chend = clamp (chend, chbegin+1, m_spec.nchannels);
+    if ((chbegin == 0 && chend == m_spec.nchannels) ||
+        ! separate_subset_ok() || m_no_random_access)
+        return ImageInput::read_native_scanlines (ybegin, yend, z,
+                                                  chbegin, chend, data);
+    yend = std::min (yend, m_spec.y+m_spec.height);
+    size_t valbytes = m_spec.format.size();
+    size_t subset_bytes = valbytes * (chend - chbegin);
+    stride_t subset_ystride = subset_bytes * m_spec.width;
+    m_scratch.resize (m_spec.width * valbytes);
+    for (int y = ybegin;  y < yend;  ++y) {
+        unsigned char *row = (unsigned char *)data + (y-ybegin)*subset_ystride;
+        for (int c = chbegin;  c < chend;  ++c) {
+            if (TIFFReadScanline (m_tif, &m_scratch[0], y - m_spec.y, c) < 0) {
+                error ("%s", oiio_tiff_last_error());
+                return false;
+            }
+            copy_image (1, m_spec.width, 1, 1, &m_scratch[0], valbytes,
+                        valbytes, AutoStride, AutoStride,
+                        row + (c-chbegin)*valbytes, subset_bytes,
+                        AutoStride, AutoStride);
+        }
+    }
+    m_next_scanline = yend - m_spec.y;
+    if (m_photometric == PHOTOMETRIC_MINISWHITE)
+        invert_photometric ((yend-ybegin) * m_spec.width * (chend-chbegin),
+                            data);
+    return true;
+}
+
+
+
+bool
+TIFFInput::read_native_tiles (int xbegin, int xend, int ybegin, int yend,
+                              int zbegin, int zend,
+                              int chbegin, int chend, void *data)
+{
+    // Same idea as for scanlines: separate planes of a tile can be read
+    // one at a time, so skip the ones nobody asked for.
+    chend = clamp (chend, chbegin+1, m_spec.nchannels);
+    if ((chbegin == 0 && chend == m_spec.nchannels) ||
+        ! separate_subset_ok())
+        return ImageInput::read_native_tiles (xbegin, xend, ybegin, yend,
+                                              zbegin, zend, chbegin, chend,
+                                              data);
+    if (! m_spec.valid_tile_range (xbegin, xend, ybegin, yend, zbegin, zend))
+        return false;
+    size_t valbytes = m_spec.format.size();
+    size_t subset_bytes = valbytes * (chend - chbegin);
+    stride_t subset_ystride = (xend-xbegin) * subset_bytes;
+    stride_t subset_zstride = (yend-ybegin) * subset_ystride;
+    stride_t plane_ystride = m_spec.tile_width * valbytes;
+    stride_t plane_zstride = m_spec.tile_height * plane_ystride;
+    int tile_depth = std::max (1, m_spec.tile_depth);
+    m_scratch.resize (m_spec.tile_pixels() * valbytes);
+    for (int z = zbegin;  z < zend;  z += tile_depth) {
+        int zd = std::min (zend-z, tile_depth);
+        for (int y = ybegin;  y < yend;  y += m_spec.tile_height) {
+            int yh = std::min (yend-y, m_spec.tile_height);
+            for (int x = xbegin;  x < xend;  x += m_spec.tile_width) {
+                int xw = std::min (xend-x, m_spec.tile_width);
+                unsigned char *tilestart = (unsigned char *)data
+                    + (z-zbegin)*subset_zstride + (y-ybegin)*subset_ystride
+                    + (x-xbegin)*subset_bytes;
+                for (int c = chbegin;  c < chend;  ++c) {
+                    if (TIFFReadTile (m_tif, &m_scratch[0], x - m_spec.x,
+                                      y - m_spec.y, z, c) < 0) {
+                        error ("%s", oiio_tiff_last_error());
+                        return false;
+                    }
+                    copy_image (1, xw, yh, zd, &m_scratch[0], valbytes,
+                                valbytes, plane_ystride, plane_zstride,
+                                tilestart + (c-chbegin)*valbytes,
+                                subset_bytes, subset_ystride, subset_zstride);
+                }
+            }
+        }
+    }
+    if (m_photometric == PHOTOMETRIC_MINISWHITE)
+        invert_photometric (int((xend-xbegin) * (yend-ybegin) * (zend-zbegin)
+                                * (chend-chbegin)), data);
+    return true;
+}
+
+
+
 bool
 TIFFInput::read_native_tile (int x, int y, int z, void *data)
 {
@@ -1442,6 +2066,194 @@ TIFFInput::read_native_tile (int x, int y, int z, void *data)
 
 
 
+bool
+TIFFInput::native_tile_offset (int x, int y, int z, imagesize_t &offset)
+{
+    // Only when read_native_tile would just copy the raw tile bytes
+    // (and read_tile would not associate alpha afterwards).
+    if (! m_spec.tile_width || m_use_rgba_interface ||
+        m_compression != COMPRESSION_NONE || m_separate || m_convert_alpha ||
+        TIFFIsByteSwapped (m_tif) || m_spec.channelformats.size() ||
+        m_bitspersample != 8 * m_spec.format.size() ||
+        (m_photometric != PHOTOMETRIC_MINISBLACK &&
+         m_photometric != PHOTOMETRIC_RGB) ||
+        m_inputchannels != m_spec.nchannels)
+        return false;
+    ttile_t tile = TIFFComputeTile (m_tif, x - m_spec.x, y - m_spec.y, z, 0);
+    if (tile >= TIFFNumberOfTiles (m_tif))
+        return false;
+#ifdef TIFF_VERSION_BIG
+    uint64 *offsets = NULL, *bytecounts = NULL;
+#else
+    uint32 *offsets = NULL, *bytecounts = NULL;
+#endif
+    if (! TIFFGetField (m_tif, TIFFTAG_TILEOFFSETS, &offsets) ||
+        ! TIFFGetField (m_tif, TIFFTAG_TILEBYTECOUNTS, &bytecounts) ||
+        ! offsets || ! bytecounts ||
+        imagesize_t(bytecounts[tile]) < m_spec.tile_bytes(true))
+        return false;
+    offset = imagesize_t (offsets[tile]);
+    return true;
+}
+
+
+
+void
+TIFFInput::note_concurrent_tiles ()
+{
+    if (m_concurrent_failed)
+        return;
+    if (! m_ndirs) {
+        if (! TIFFIsTiled (m_tif)) {
+            m_concurrent_failed = true;
+            return;
+        }
+        m_ndirs = TIFFNumberOfDirectories (m_tif);
+        m_concurrent.resize (m_ndirs, NULL);
+        m_dir_seen.resize (m_ndirs, 0);
+    }
+    int dir = m_subimage;
+    if (dir < 0 || dir >= m_ndirs || m_dir_seen[dir])
+        return;
+    m_dir_seen[dir] = 1;
+
+    // Just the layouts that read_native_tile would deliver untouched,
+    // other than decompression, predictor and byte order.
+    unsigned short fillorder = FILLORDER_MSB2LSB;
+    TIFFGetFieldDefaulted (m_tif, TIFFTAG_FILLORDER, &fillorder);
+    unsigned short predictor = PREDICTOR_NONE;
+    TIFFGetFieldDefaulted (m_tif, TIFFTAG_PREDICTOR, &predictor);
+    if (! TIFFIsTiled (m_tif) || m_use_rgba_interface || m_separate ||
+          m_convert_alpha || m_spec.channelformats.size() ||
+          (m_photometric != PHOTOMETRIC_MINISBLACK &&
+           m_photometric != PHOTOMETRIC_RGB) ||
+          m_inputchannels != m_spec.nchannels ||
+          (m_bitspersample != 8 && m_bitspersample != 16 &&
+           m_bitspersample != 32) ||
+          int(m_spec.format.size()) * 8 != m_bitspersample ||
+          (m_compression != COMPRESSION_NONE &&
+           m_compression != COMPRESSION_LZW &&
+           m_compression != COMPRESSION_ADOBE_DEFLATE &&
+           m_compression != COMPRESSION_DEFLATE) ||
+          fillorder != FILLORDER_MSB2LSB ||
+          (predictor != PREDICTOR_NONE && predictor != PREDICTOR_HORIZONTAL &&
+           predictor != PREDICTOR_FLOATINGPOINT)) {
+        m_concurrent_failed = true;
+        return;
+    }
+#ifdef TIFF_VERSION_BIG
+    uint64 *offsets = NULL, *bytecounts = NULL;
+#else
+    uint32 *offsets = NULL, *bytecounts = NULL;
+#endif
+    size_t ntiles = TIFFNumberOfTiles (m_tif);
+    if (! TIFFGetField (m_tif, TIFFTAG_TILEOFFSETS, &offsets) ||
+          ! TIFFGetField (m_tif, TIFFTAG_TILEBYTECOUNTS, &bytecounts) ||
+          ! offsets || ! bytecounts) {
+        m_concurrent_failed = true;
+        return;
+    }
+    if (! m_io && ! m_pread_file) {
+        // Our own handle, since libtiff's has its own idea of position.
+        m_pread_file.reset (new Filesystem::IOFile (m_filename,
+                                                    Filesystem::IOProxy::Read));
+        if (! m_pread_file->opened ()) {
+            m_pread_file.reset ();
+            m_concurrent_failed = true;
+            return;
+        }
+    }
+    ConcurrentTiles *ct = new ConcurrentTiles;
+    ct->offsets.assign (offsets, offsets + ntiles);
+    ct->bytecounts.assign (bytecounts, bytecounts + ntiles);
+    ct->x = m_spec.x;
+    ct->y = m_spec.y;
+    ct->z = m_spec.z;
+    ct->width = m_spec.width;
+    ct->height = m_spec.height;
+    ct->depth = std::max (1, m_spec.depth);
+    ct->tile_width = m_spec.tile_width;
+    ct->tile_height = m_spec.tile_height;
+    ct->tile_depth = std::max (1, m_spec.tile_depth);
+    ct->nchans = m_spec.nchannels;
+    ct->valbytes = int(m_spec.format.size());
+    ct->compression = m_compression;
+    ct->predictor = predictor;
+    ct->swapped = TIFFIsByteSwapped (m_tif);
+    spin_lock lock (m_concurrent_mutex);
+    m_concurrent[dir] = ct;
+    ++m_concurrent_ready;
+}
+
+
+
+bool
+TIFFInput::read_native_tile_at (int subimage, int miplevel,
+                                int x, int y, int z, void *data)
+{
+    int dir = m_emulate_mipmap ? (subimage == 0 ? miplevel : -1)
+                               : (miplevel == 0 ? subimage : -1);
+    const ConcurrentTiles *ct = NULL;
+    {
+        spin_lock lock (m_concurrent_mutex);
+        if (dir >= 0 && dir < int(m_concurrent.size()))
+            ct = m_concurrent[dir];
+    }
+    if (! ct)   // Not one we can do on our own
+        return ImageInput::read_native_tile_at (subimage, miplevel,
+                                                x, y, z, data);
+
+    // Everything from here on is safe to do from many threads at once:
+    // ct is never changed once made, and the reads are positional.
+    x -= ct->x;
+    y -= ct->y;
+    z -= ct->z;
+    if (x < 0 || y < 0 || z < 0 ||
+          x >= ct->width || y >= ct->height || z >= ct->depth)
+        return false;
+    size_t nxtiles = (ct->width + ct->tile_width - 1) / ct->tile_width;
+    size_t nytiles = (ct->height + ct->tile_height - 1) / ct->tile_height;
+    size_t tile = (size_t(z / ct->tile_depth) * nytiles
+                   + size_t(y / ct->tile_height)) * nxtiles
+                   + size_t(x / ct->tile_width);
+    if (tile >= ct->offsets.size())
+        return false;
+    int nrows = ct->tile_height * ct->tile_depth;
+    int nvals = ct->tile_width * ct->nchans;
+    size_t rowbytes = size_t(nvals) * ct->valbytes;
+    size_t tilebytes = rowbytes * nrows;
+    int64_t offset = int64_t (ct->offsets[tile]);
+    size_t count = size_t (ct->bytecounts[tile]);
+
+    Filesystem::IOProxy *io = m_io ? m_io : m_pread_file.get();
+    const unsigned char *mem = (const unsigned char *) io->mmap();
+    if (mem && size_t(offset) + count > io->size())
+        return false;
+    if (ct->compression == COMPRESSION_NONE && ! mem) {
+        // Read straight into the caller's buffer, then fix byte order.
+        if (count < tilebytes || io->pread (data, tilebytes, offset) != tilebytes)
+            return false;
+        if (ct->swapped && ct->valbytes == 2)
+            swap_endian ((unsigned short *)data, int(tilebytes / 2));
+        else if (ct->swapped && ct->valbytes == 4)
+            swap_endian ((unsigned int *)data, int(tilebytes / 4));
+        return true;
+    }
+    std::vector<unsigned char> raw, tmp;
+    const unsigned char *in = mem ? mem + offset : NULL;
+    if (! mem) {
+        raw.resize (count);
+        if (count == 0 || io->pread (&raw[0], count, offset) != count)
+            return false;
+        in = &raw[0];
+    }
+    return decode_chunk (in, count, ct->compression, ct->predictor,
+                         ct->swapped, nrows, rowbytes, nvals, ct->nchans,
+                         ct->valbytes, (unsigned char *)data, tmp);
+}
+
+
+
 bool TIFFInput::read_scanline (int y, int z, TypeDesc format, void *data,
                                stride_t xstride)
 {
@@ -36,6 +36,10 @@
 #include <iostream>
 
 #include <tiffio.h>
+#include <zlib.h>
+#ifdef USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
 
 // Some EXIF tags that don't seem to be in tiff.h
 #ifndef EXIFTAG_SECURITYCLASSIFICATION
@@ -51,8 +55,11 @@
 #include "OpenImageIO/strutil.h"
 #include "OpenImageIO/sysutil.h"
 #include "OpenImageIO/timer.h"
+#include "OpenImageIO/thread.h"
 #include "OpenImageIO/fmath.h"
 
+#include "tiff_pvt.h"
+
 #include <boost/scoped_array.hpp>
 
 
@@ -83,6 +90,11 @@ public:
     virtual bool write_tile (int x, int y, int z,
                              TypeDesc format, const void *data,
                              stride_t xstride, stride_t ystride, stride_t zstride);
+    virtual bool write_tiles (int xbegin, int xend, int ybegin, int yend,
+                              int zbegin, int zend, TypeDesc format,
+                              const void *data, stride_t xstride,
+                              stride_t ystride, stride_t zstride);
+    virtual bool copy_image (ImageInput *in);
 
 private:
     TIFF *m_tif;
@@ -97,6 +109,7 @@ private:
     int m_photometric;
     unsigned int m_bitspersample;  ///< Of the *file*, not the client's view
     int m_outputchans;   // Number of channels for the output
+    int m_zipquality;    // Deflate level (-1 = zlib's default)
 
     // Initialize private members to pre-opened state
     void init (void) {
@@ -105,6 +118,7 @@ private:
         m_compression = COMPRESSION_ADOBE_DEFLATE;
         m_photometric = PHOTOMETRIC_RGB;
         m_outputchans = 0;
+        m_zipquality = -1;
     }
 
     // Convert planar contiguous to planar separate data format
@@ -115,6 +129,10 @@ private:
     bool put_parameter (const std::string &name, TypeDesc type,
                         const void *data);
     bool write_exif_data ();
+    // Can tiles be compressed by us, rather than by libtiff, so that
+    // write_tiles can do many at once?  If so, return true and the
+    // predictor that libtiff would have applied.
+    bool parallel_tile_compression (int &predictor);
 };
 
 
@@ -187,6 +205,9 @@ static CompressionCode tiff_compressions[] = {
 //  { COMPRESSION_T85,           "T85" },         // TIFF/FX T.85 JBIG
 //  { COMPRESSION_T43,           "T43" },         // TIFF/FX T.43 color layered JBIG
 //  { COMPRESSION_LZMA,          "lzma" },        // LZMA2
+#endif
+#ifdef COMPRESSION_ZSTD
+    { COMPRESSION_ZSTD,          "zstd" },        // Zstandard
 #endif
     { -1, NULL }
 };
@@ -239,6 +260,8 @@ TIFFOutput::supports (string_view feature) const
         return true;
     if (feature == "iptc")
         return true;
+    if (feature == "ioproxy")
+        return true;
     // N.B. TIFF doesn't support arbitrary metadata.
 
     // FIXME: we could support "volumes" and "empty"
@@ -280,13 +303,21 @@ TIFFOutput::open (const std::string &name, const ImageSpec &userspec,
     if (m_spec.depth < 1)
         m_spec.depth = 1;
 
-    // Open the file
+    // Open the file, or the proxy we were given instead of one
+    const ImageIOParameter *ioparam = m_spec.find_attribute ("oiio:ioproxy",
+                                                             TypeDesc::PTR);
+    if (ioparam) {
+        Filesystem::IOProxy *io = *(Filesystem::IOProxy * const *) ioparam->data();
+        m_spec.erase_attribute ("oiio:ioproxy");
+        m_tif = TIFF_pvt::open_ioproxy (io, mode == AppendSubimage ? "a" : "w");
+    } else {
 #ifdef _WIN32
-    std::wstring wname = Strutil::utf8_to_utf16 (name);
-    m_tif = TIFFOpenW (wname.c_str(), mode == AppendSubimage ? "a" : "w");
+        std::wstring wname = Strutil::utf8_to_utf16 (name);
+        m_tif = TIFFOpenW (wname.c_str(), mode == AppendSubimage ? "a" : "w");
 #else
-    m_tif = TIFFOpen (name.c_str(), mode == AppendSubimage ? "a" : "w");
+        m_tif = TIFFOpen (name.c_str(), mode == AppendSubimage ? "a" : "w");
 #endif
+    }
     if (! m_tif) {
         error ("Can't open \"%s\" for output.", name.c_str());
         return false;
@@ -397,7 +428,11 @@ TIFFOutput::open (const std::string &name, const ImageSpec &userspec,
     TIFFSetField (m_tif, TIFFTAG_COMPRESSION, m_compression);
 
     // Use predictor when using compression
-    if (m_compression == COMPRESSION_LZW || m_compression == COMPRESSION_ADOBE_DEFLATE) {
+    bool zstd = false;
+#ifdef COMPRESSION_ZSTD
+    zstd = (m_compression == COMPRESSION_ZSTD);
+#endif
+    if (m_compression == COMPRESSION_LZW || m_compression == COMPRESSION_ADOBE_DEFLATE || zstd) {
         if (m_spec.format == TypeDesc::FLOAT || m_spec.format == TypeDesc::DOUBLE || m_spec.format == TypeDesc::HALF) {
             TIFFSetField (m_tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
             // N.B. Very old versions of libtiff did not support this
@@ -412,9 +447,18 @@ TIFFOutput::open (const std::string &name, const ImageSpec &userspec,
         }
         if (m_compression == COMPRESSION_ADOBE_DEFLATE) {
             int q = m_spec.get_int_attribute ("tiff:zipquality", -1);
+            if (q >= 0) {
+                m_zipquality = OIIO::clamp(q, 1, 9);
+                TIFFSetField (m_tif, TIFFTAG_ZIPQUALITY, m_zipquality);
+            }
+        }
+#ifdef TIFFTAG_ZSTD_LEVEL
+        if (zstd) {
+            int q = m_spec.get_int_attribute ("tiff:zstdlevel", -1);
             if (q >= 0)
-                TIFFSetField (m_tif, TIFFTAG_ZIPQUALITY, OIIO::clamp(q, 1, 9));
+                TIFFSetField (m_tif, TIFFTAG_ZSTD_LEVEL, OIIO::clamp(q, 1, 22));
         }
+#endif
     } else if (m_compression == COMPRESSION_JPEG) {
         TIFFSetField (m_tif, TIFFTAG_JPEGQUALITY,
                       m_spec.get_int_attribute("CompressionQuality", 95));
@@ -1059,5 +1103,333 @@ TIFFOutput::write_tile (int x, int y, int z,
     return true;
 }
 
-OIIO_PLUGIN_NAMESPACE_END
 
+
+
+namespace {
+
+// Task for write_tiles: apply the predictor to one native tile in place
+// and deflate it as libtiff's ZIP codec would (with libdeflate, if we
+// have it, which is much faster; the bytes differ from zlib's but any
+// inflater reads them the same).
+struct TileCompressTask {
+    std::vector<unsigned char> *tile;    // Native tile, modified in place
+    std::vector<unsigned char> *packed;  // Compressed result
+    size_t rowbytes;                     // Bytes per tile row
+    int nchans, valbytes;
+    int predictor, level;
+    atomic_int *failures;
+
+    void operator() () {
+        unsigned char *buf = &(*tile)[0];
+        size_t nbytes = tile->size();
+        size_t nrows = nbytes / rowbytes;
+        int nvals = int (rowbytes / valbytes);
+        std::vector<unsigned char> tmp;
+        for (size_t r = 0;  r < nrows;  ++r) {
+            unsigned char *row = buf + r * rowbytes;
+            if (predictor == PREDICTOR_HORIZONTAL) {
+                if (valbytes == 1)
+                    horizontal_diff (row, nvals);
+                else if (valbytes == 2)
+                    horizontal_diff ((unsigned short *)row, nvals);
+                else
+                    horizontal_diff ((unsigned int *)row, nvals);
+            } else if (predictor == PREDICTOR_FLOATINGPOINT) {
+                // Spread the bytes into planes, most significant first,
+                // then difference them.
+                tmp.assign (row, row + rowbytes);
+                for (int v = 0;  v < nvals;  ++v)
+                    for (int b = 0;  b < valbytes;  ++b)
+                        row[(littleendian() ? valbytes-b-1 : b) * nvals + v]
+                            = tmp[v*valbytes+b];
+                for (size_t i = rowbytes-1;  i >= size_t(nchans);  --i)
+                    row[i] = (unsigned char) (row[i] - row[i-nchans]);
+            }
+        }
+#ifdef USE_LIBDEFLATE
+        libdeflate_compressor *c = libdeflate_alloc_compressor (level < 0 ? 6 : level);
+        if (c) {
+            packed->resize (libdeflate_zlib_compress_bound (c, nbytes));
+            size_t n = libdeflate_zlib_compress (c, buf, nbytes,
+                                                 &(*packed)[0], packed->size());
+            libdeflate_free_compressor (c);
+            packed->resize (n);
+            if (! n)
+                ++(*failures);
+            return;
+        }
+#endif
+        z_stream z;
+        memset (&z, 0, sizeof(z));
+        if (deflateInit (&z, level) != Z_OK) {
+            ++(*failures);
+            return;
+        }
+        packed->resize (deflateBound (&z, uLong(nbytes)));
+        z.next_in = (Bytef *) buf;
+        z.avail_in = (uInt) nbytes;
+        z.next_out = (Bytef *) &(*packed)[0];
+        z.avail_out = (uInt) packed->size();
+        int r = deflate (&z, Z_FINISH);
+        packed->resize (z.total_out);
+        deflateEnd (&z);
+        if (r != Z_STREAM_END)
+            ++(*failures);
+    }
+
+    template<class T>
+    void horizontal_diff (T *row, int nvals) {
+        for (int i = nvals-1;  i >= nchans;  --i)
+            row[i] = T (row[i] - row[i-nchans]);
+    }
+};
+
+}  // end anon namespace
+
+
+
+bool
+TIFFOutput::parallel_tile_compression (int &predictor)
+{
+    if ((m_compression != COMPRESSION_ADOBE_DEFLATE &&
+         m_compression != COMPRESSION_DEFLATE) ||
+          m_photometric == PHOTOMETRIC_SEPARATED ||
+          (m_planarconfig == PLANARCONFIG_SEPARATE && m_spec.nchannels > 1) ||
+          m_spec.format.size()*8 != m_bitspersample)
+        return false;
+    uint16 pred = PREDICTOR_NONE, fillorder = FILLORDER_MSB2LSB;
+    TIFFGetFieldDefaulted (m_tif, TIFFTAG_PREDICTOR, &pred);
+    TIFFGetFieldDefaulted (m_tif, TIFFTAG_FILLORDER, &fillorder);
+    predictor = pred;
+    if (fillorder != FILLORDER_MSB2LSB)
+        return false;
+    if (predictor == PREDICTOR_NONE || predictor == PREDICTOR_FLOATINGPOINT)
+        return true;
+    return (predictor == PREDICTOR_HORIZONTAL &&
+            (m_bitspersample == 8 || m_bitspersample == 16 ||
+             m_bitspersample == 32));
+}
+
+
+
+bool
+TIFFOutput::write_tiles (int xbegin, int xend, int ybegin, int yend,
+                         int zbegin, int zend, TypeDesc format,
+                         const void *data, stride_t xstride,
+                         stride_t ystride, stride_t zstride)
+{
+    // Deflating tiles is by far the most expensive part of writing a
+    // zip compressed TIFF, and each tile is independent.  So when we
+    // know how to do exactly what libtiff would, convert the tiles
+    // serially, compress them in parallel, and hand them to libtiff in
+    // the usual order as raw tiles.  The file is identical either way.
+    if (! m_spec.valid_tile_range (xbegin, xend, ybegin, yend, zbegin, zend))
+        return false;
+    int nthreads = threads();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    int tw = m_spec.tile_width, th = m_spec.tile_height;
+    int td = std::max (1, m_spec.tile_depth);
+    int ntiles = ((xend-xbegin+tw-1)/tw) * ((yend-ybegin+th-1)/th)
+               * ((zend-zbegin+td-1)/td);
+    int predictor = PREDICTOR_NONE;
+    if (nthreads <= 1 || ntiles < 2 || ! parallel_tile_compression (predictor))
+        return ImageOutput::write_tiles (xbegin, xend, ybegin, yend,
+                                         zbegin, zend, format, data,
+                                         xstride, ystride, zstride);
+
+    stride_t native_pixel_bytes = (stride_t) m_spec.pixel_bytes (true);
+    if (format == TypeDesc::UNKNOWN && xstride == AutoStride)
+        xstride = native_pixel_bytes;
+    m_spec.auto_stride (xstride, ystride, zstride, format, m_spec.nchannels,
+                        xend-xbegin, yend-ybegin);
+    stride_t pixelsize = (format == TypeDesc::UNKNOWN) ? native_pixel_bytes
+                                    : stride_t(format.size() * m_spec.nchannels);
+    imagesize_t tile_bytes = m_spec.tile_bytes (true);
+
+    std::vector<std::vector<unsigned char> > tiles (ntiles), packed (ntiles);
+    std::vector<char> buf;
+    std::vector<unsigned char> scratch;
+    atomic_int failures (0);
+    TileCompressTask task;
+    task.rowbytes = size_t (tw) * native_pixel_bytes;
+    task.nchans = m_spec.nchannels;
+    task.valbytes = int (m_spec.format.size());
+    task.predictor = predictor;
+    task.level = m_zipquality;
+    task.failures = &failures;
+    task_set tasks;
+    int t = 0;
+    for (int z = zbegin;  z < zend;  z += td) {
+        int zd = std::min (zend-z, td);
+        for (int y = ybegin;  y < yend;  y += th) {
+            int yh = std::min (yend-y, th);
+            for (int x = xbegin;  x < xend;  x += tw, ++t) {
+                int xw = std::min (xend-x, tw);
+                const char *tilestart = (const char *)data + (z-zbegin)*zstride
+                                      + (y-ybegin)*ystride + (x-xbegin)*xstride;
+                stride_t txs = xstride, tys = ystride, tzs = zstride;
+                if (xw != tw || yh != th || zd != td) {
+                    // Stage partial tiles (at the image edge) in a
+                    // padded buffer.
+                    buf.assign (pixelsize * m_spec.tile_pixels(), 0);
+                    OIIO::copy_image (m_spec.nchannels, xw, yh, zd,
+                                      tilestart, pixelsize, xstride, ystride,
+                                      zstride, &buf[0], pixelsize,
+                                      pixelsize*tw, pixelsize*tw*th);
+                    tilestart = &buf[0];
+                    txs = pixelsize;
+                    tys = pixelsize*tw;
+                    tzs = pixelsize*tw*th;
+                }
+                const void *native = to_native_tile (format, tilestart, txs,
+                                                     tys, tzs, scratch,
+                                                     m_dither, x - m_spec.x,
+                                                     y - m_spec.y, z - m_spec.z);
+                tiles[t].assign ((const unsigned char *)native,
+                                 (const unsigned char *)native + tile_bytes);
+                task.tile = &tiles[t];
+                task.packed = &packed[t];
+                tasks.push (task);
+            }
+        }
+    }
+    tasks.wait ();
+    if (failures) {
+        error ("Could not compress tiles");
+        return false;
+    }
+
+    t = 0;
+    for (int z = zbegin;  z < zend;  z += td) {
+        for (int y = ybegin;  y < yend;  y += th) {
+            for (int x = xbegin;  x < xend;  x += tw, ++t) {
+                ttile_t tile = TIFFComputeTile (m_tif, x - m_spec.x,
+                                                y - m_spec.y, z - m_spec.z, 0);
+                if (TIFFWriteRawTile (m_tif, tile, &packed[t][0],
+                                      tmsize_t(packed[t].size())) < 0) {
+                    std::string err = oiio_tiff_last_error();
+                    error ("TIFFWriteRawTile failed writing tile x=%d,y=%d,z=%d (%s)",
+                           x, y, z, err.size() ? err.c_str() : "unknown error");
+                    return false;
+                }
+                std::vector<unsigned char>().swap (packed[t]);
+                ++m_checkpointItems;
+            }
+        }
+    }
+
+    if (m_checkpointTimer() > DEFAULT_CHECKPOINT_INTERVAL_SECONDS
+        && m_checkpointItems >= MIN_SCANLINES_OR_TILES_PER_CHECKPOINT) {
+        TIFFCheckpointDirectory (m_tif);
+        m_checkpointTimer.lap();
+        m_checkpointItems = 0;
+    }
+    return true;
+}
+
+
+
+// Are the compressed strips or tiles of the current directory of src
+// valid, unchanged, as the strips or tiles of the current directory of
+// dst?  That requires that everything that goes into encoding and
+// decoding them be the same.
+static bool
+raw_copy_compatible (TIFF *src, TIFF *dst)
+{
+    if (TIFFIsTiled (src) != TIFFIsTiled (dst) ||
+        TIFFIsByteSwapped (src) != TIFFIsByteSwapped (dst))
+        return false;
+    static const ttag_t tags32[] = {
+        TIFFTAG_IMAGEWIDTH, TIFFTAG_IMAGELENGTH, TIFFTAG_IMAGEDEPTH,
+        TIFFTAG_ROWSPERSTRIP, TIFFTAG_TILEWIDTH, TIFFTAG_TILELENGTH,
+        TIFFTAG_TILEDEPTH, 0
+    };
+    for (int i = 0;  tags32[i];  ++i) {
+        uint32 a = 0, b = 0;
+        TIFFGetFieldDefaulted (src, tags32[i], &a);
+        TIFFGetFieldDefaulted (dst, tags32[i], &b);
+        if (a != b)
+            return false;
+    }
+    static const ttag_t tags16[] = {
+        TIFFTAG_BITSPERSAMPLE, TIFFTAG_SAMPLESPERPIXEL, TIFFTAG_SAMPLEFORMAT,
+        TIFFTAG_PLANARCONFIG, TIFFTAG_COMPRESSION, TIFFTAG_PREDICTOR,
+        TIFFTAG_PHOTOMETRIC, TIFFTAG_FILLORDER, 0
+    };
+    for (int i = 0;  tags16[i];  ++i) {
+        uint16 a = 0, b = 0;
+        TIFFGetFieldDefaulted (src, tags16[i], &a);
+        TIFFGetFieldDefaulted (dst, tags16[i], &b);
+        if (a != b)
+            return false;
+    }
+    // The alpha association must agree, or the same values would mean
+    // something different in the new file.
+    uint16 na = 0, nb = 0;
+    uint16 *ea = NULL, *eb = NULL;
+    TIFFGetField (src, TIFFTAG_EXTRASAMPLES, &na, &ea);
+    TIFFGetField (dst, TIFFTAG_EXTRASAMPLES, &nb, &eb);
+    if (na != nb || (na && memcmp (ea, eb, na * sizeof(uint16))))
+        return false;
+    // JPEG keeps shared tables outside the strips, and subsampled YCbCr
+    // has its own layout; don't try to be clever with either.
+    uint16 compression = COMPRESSION_NONE, photometric = PHOTOMETRIC_RGB;
+    TIFFGetFieldDefaulted (src, TIFFTAG_COMPRESSION, &compression);
+    TIFFGetFieldDefaulted (src, TIFFTAG_PHOTOMETRIC, &photometric);
+    return (compression != COMPRESSION_JPEG &&
+            compression != COMPRESSION_OJPEG &&
+            photometric != PHOTOMETRIC_YCBCR);
+}
+
+
+
+bool
+TIFFOutput::copy_image (ImageInput *in)
+{
+    // When the input is a TIFF file whose current directory is encoded
+    // exactly as ours will be, copy its compressed strips or tiles
+    // straight across instead of decompressing and recompressing every
+    // pixel.  This must be called before any pixels are written.
+    TIFF *intif = TIFF_pvt::input_handle (in);
+    if (! intif || ! m_tif || ! raw_copy_compatible (intif, m_tif))
+        return ImageOutput::copy_image (in);
+
+    bool tiled = TIFFIsTiled (intif);
+#ifdef TIFF_VERSION_BIG
+    uint64 *bytecounts = NULL;
+#else
+    uint32 *bytecounts = NULL;
+#endif
+    if (! TIFFGetField (intif, tiled ? TIFFTAG_TILEBYTECOUNTS
+                                     : TIFFTAG_STRIPBYTECOUNTS, &bytecounts)
+        || ! bytecounts)
+        return ImageOutput::copy_image (in);
+    uint32 nchunks = tiled ? TIFFNumberOfTiles (intif)
+                           : TIFFNumberOfStrips (intif);
+    std::vector<unsigned char> buf;
+    for (uint32 i = 0;  i < nchunks;  ++i) {
+        tmsize_t size = tmsize_t (bytecounts[i]);
+        if (size <= 0)
+            continue;   // never written, leave it that way
+        buf.resize (size);
+        tmsize_t r = tiled ? TIFFReadRawTile (intif, i, &buf[0], size)
+                           : TIFFReadRawStrip (intif, i, &buf[0], size);
+        if (r < 0) {
+            error ("%s", oiio_tiff_last_error());
+            return false;
+        }
+        tmsize_t w = tiled ? TIFFWriteRawTile (m_tif, i, &buf[0], r)
+                           : TIFFWriteRawStrip (m_tif, i, &buf[0], r);
+        if (w < 0) {
+            std::string err = oiio_tiff_last_error();
+            error ("Could not copy %s %d (%s)", tiled ? "tile" : "strip", i,
+                   err.size() ? err.c_str() : "unknown error");
+            return false;
+        }
+    }
+    return true;
+}
+
+OIIO_PLUGIN_NAMESPACE_END
@@ -149,6 +149,14 @@ WebpOutput::open (const std::string &name, const ImageSpec &spec,
         compression_quality = *static_cast<const int*>(qual->data());
     }
     m_webp_config.quality = compression_quality;
+#if WEBP_ENCODER_ABI_VERSION >= 0x0201
+    // Let libwebp use more threads for the encode, unless we were
+    // asked to keep to one.
+    int nthreads = threads();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    m_webp_config.thread_level = (nthreads != 1) ? 1 : 0;
+#endif
     
     // forcing UINT8 format
     m_spec.set_format (TypeDesc::UINT8);
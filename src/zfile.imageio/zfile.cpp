@@ -34,6 +34,8 @@
 
 #include "zlib.h"
 
+#include <boost/scoped_ptr.hpp>
+
 #include "OpenImageIO/dassert.h"
 #include "OpenImageIO/typedesc.h"
 #include "OpenImageIO/imageio.h"
@@ -58,6 +60,106 @@ struct ZfileHeader {
 static const int zfile_magic = 0x2f0867ab;
 static const int zfile_magic_endian = 0xab67082f;  // other endianness
 
+// A "blocked" Zfile is not gzipped as a whole.  After the usual header
+// (with this magic number instead) come a ZfileBlockedHeader and an
+// index of nbands ZfileBand entries, then the bands: each holds
+// bandheight scanlines (fewer for the last) deflated on their own, so
+// they can be compressed in parallel and read in any order.
+static const int zfile_blocked_magic = 0x2f0867ac;
+static const int zfile_blocked_magic_endian = 0xac67082f;
+
+struct ZfileBlockedHeader {
+    int bandheight;
+    int nbands;
+};
+
+struct ZfileBand {
+    uint64_t offset;      // where the band's deflated data starts
+    uint64_t size;        // its length in bytes
+};
+
+static const size_t zfile_index_offset =
+    sizeof(ZfileHeader) + sizeof(ZfileBlockedHeader);
+
+
+
+// Read and inflate one band of nrows scanlines into out, using scratch
+// for the deflated bytes.  Safe to call from many threads at once.
+static bool
+read_band (Filesystem::IOProxy *io, const ZfileBand &band, int nrows,
+           int width, bool swab, float *out,
+           std::vector<unsigned char> &scratch)
+{
+    scratch.resize (size_t(band.size));
+    if (! band.size ||
+          io->pread (&scratch[0], scratch.size(), int64_t(band.offset))
+              != scratch.size())
+        return false;
+    uLongf rawsize = uLongf(nrows) * width * sizeof(float);
+    uLongf expected = rawsize;
+    if (uncompress ((Bytef *)out, &rawsize, &scratch[0],
+                    uLong(scratch.size())) != Z_OK || rawsize != expected)
+        return false;
+    if (swab)
+        swap_endian (out, nrows * width);
+    return true;
+}
+
+
+
+// Inflate bands [bbegin,bend) into consecutive rows of data, which
+// begins at band b0 and ends after row yend (relative to band b0).
+struct BandDecodeTask {
+    Filesystem::IOProxy *io;
+    const ZfileBand *bands;
+    int b0, bbegin, bend;
+    int bandheight, nrows, width;
+    bool swab;
+    float *data;
+    atomic_int *failures;
+
+    void operator() () {
+        std::vector<unsigned char> scratch;
+        for (int b = bbegin;  b < bend;  ++b) {
+            int row0 = (b - b0) * bandheight;
+            int n = std::min (bandheight, nrows - row0);
+            if (! read_band (io, bands[b], n, width, swab,
+                             data + size_t(row0) * width, scratch)) {
+                ++(*failures);
+                return;
+            }
+        }
+    }
+};
+
+
+
+// Deflate bands [bbegin,bend) of the rows into out[].
+struct BandCompressTask {
+    const float *rows;
+    int bandheight, nrows, width;
+    std::vector<unsigned char> *out;
+    int bbegin, bend;
+    atomic_int *failures;
+
+    void operator() () {
+        for (int b = bbegin;  b < bend;  ++b) {
+            int row0 = b * bandheight;
+            int n = std::min (bandheight, nrows - row0);
+            uLong rawsize = uLong(n) * width * sizeof(float);
+            uLongf zsize = compressBound (rawsize);
+            out[b].resize (zsize);
+            if (compress2 (&out[b][0], &zsize,
+                           (const Bytef *)(rows + size_t(row0) * width),
+                           rawsize, Z_DEFAULT_COMPRESSION) != Z_OK) {
+                ++(*failures);
+                return;
+            }
+            out[b].resize (zsize);
+        }
+    }
+};
+
 }  // end anon namespace
 
 
@@ -69,20 +171,48 @@ public:
     virtual const char * format_name (void) const { return "zfile"; }
     virtual bool valid_file (const std::string &filename) const;
     virtual bool open (const std::string &name, ImageSpec &newspec);
+    virtual int supports (string_view feature) const {
+        return (feature == "concurrent_reads" && m_blocked);
+    }
     virtual bool close ();
     virtual bool read_native_scanline (int y, int z, void *data);
+    virtual bool read_native_tile (int x, int y, int z, void *data);
+    virtual bool read_native_tiles (int xbegin, int xend, int ybegin, int yend,
+                                    int zbegin, int zend, void *data);
+    virtual bool read_native_tile_at (int subimage, int miplevel,
+                                      int x, int y, int z, void *data);
 
 private:
     std::string m_filename;       ///< Stash the filename
     gzFile m_gz;                  ///< Handle for compressed files
     bool m_swab;                  ///< swap bytes for other endianness?
     int m_next_scanline;          ///< Which scanline is the next to be read?
+    bool m_blocked;               ///< Independently deflated bands?
+    boost::scoped_ptr<Filesystem::IOFile> m_io;  ///< Blocked file
+    int m_bandheight;             ///< Scanlines per band (blocked)
+    std::vector<ZfileBand> m_bands;    ///< Band index (blocked)
+    int m_cached_band;            ///< Which band m_band holds, or -1
+    std::vector<float> m_band;    ///< Band for scanline reads (blocked)
 
     // Reset everything to initial state
     void init () {
         m_gz = 0;
         m_swab = false;
         m_next_scanline = 0;
+        m_blocked = false;
+        m_io.reset ();
+        m_bandheight = 0;
+        m_bands.clear ();
+        m_cached_band = -1;
+        m_band.clear ();
+    }
+
+    // Set up to read a blocked file, whose header we've read.
+    bool open_blocked ();
+
+    // Scanlines in band b.
+    int band_rows (int b) const {
+        return std::min (m_bandheight, m_spec.height - b * m_bandheight);
     }
 };
 
@@ -108,12 +238,23 @@ private:
     gzFile m_gz;                  ///< Handle for compressed files
     std::vector<unsigned char> m_scratch;
     std::vector<unsigned char> m_tilebuffer;
+    int m_bandheight;             ///< Scanlines per band, if blocked
+    std::vector<ZfileBand> m_bands;    ///< Index of the bands written
+    std::vector<float> m_rows;    ///< Scanlines not yet compressed
+    uint64_t m_filepos;           ///< Where the next band goes
 
     // Initialize private members to pre-opened state
     void init (void) {
         m_file = NULL;
         m_gz = 0;
+        m_bandheight = 0;
+        m_bands.clear ();
+        m_rows.clear ();
+        m_filepos = 0;
     }
+
+    // Compress the buffered scanlines (in parallel) and write the bands.
+    bool flush_bands ();
 };
 
 
@@ -154,7 +295,9 @@ ZfileInput::valid_file (const std::string &filename) const
     ZfileHeader header;
     gzread (gz, &header, sizeof(header));
 
-    bool ok = (header.magic == zfile_magic || header.magic == zfile_magic_endian);
+    bool ok = (header.magic == zfile_magic || header.magic == zfile_magic_endian ||
+               header.magic == zfile_blocked_magic ||
+               header.magic == zfile_blocked_magic_endian);
     gzclose (gz);
     return ok;
 }
@@ -179,12 +322,17 @@ ZfileInput::open (const std::string &name, ImageSpec &newspec)
     ASSERT (sizeof(header) == 136);
     gzread (m_gz, &header, sizeof(header));
 
-    if (header.magic != zfile_magic && header.magic != zfile_magic_endian) {
+    if (header.magic != zfile_magic && header.magic != zfile_magic_endian &&
+        header.magic != zfile_blocked_magic &&
+        header.magic != zfile_blocked_magic_endian) {
         error ("Not a valid Zfile");
         return false;
     }
 
-    m_swab = (header.magic == zfile_magic_endian);
+    m_swab = (header.magic == zfile_magic_endian ||
+              header.magic == zfile_blocked_magic_endian);
+    m_blocked = (header.magic == zfile_blocked_magic ||
+                 header.magic == zfile_blocked_magic_endian);
     if (m_swab) {
         swap_endian (&header.width);
         swap_endian (&header.height);
@@ -204,12 +352,60 @@ ZfileInput::open (const std::string &name, ImageSpec &newspec)
     m_spec.attribute ("worldtocamera", TypeDesc::TypeMatrix,
                       (float *)&header.worldtocamera);
 
+    if (m_blocked && ! open_blocked ())
+        return false;
+
     newspec = spec ();
     return true;
 }
 
 
 
+bool
+ZfileInput::open_blocked ()
+{
+    // The whole file isn't a gzip stream (gzread just passed the header
+    // through), so from here on read it directly, a band at a time.
+    gzclose (m_gz);
+    m_gz = 0;
+    m_io.reset (new Filesystem::IOFile (m_filename, Filesystem::IOProxy::Read));
+    ZfileBlockedHeader bheader;
+    if (m_io->pread (&bheader, sizeof(bheader), sizeof(ZfileHeader))
+            != sizeof(bheader)) {
+        error ("Zfile \"%s\": could not read the band index", m_filename);
+        return false;
+    }
+    if (m_swab) {
+        swap_endian (&bheader.bandheight);
+        swap_endian (&bheader.nbands);
+    }
+    if (bheader.bandheight < 1 || m_spec.height < 1 ||
+        bheader.nbands != (m_spec.height + bheader.bandheight - 1) / bheader.bandheight) {
+        error ("Zfile \"%s\": corrupt band index", m_filename);
+        return false;
+    }
+    m_bandheight = bheader.bandheight;
+    m_bands.resize (bheader.nbands);
+    size_t indexbytes = m_bands.size() * sizeof(ZfileBand);
+    if (m_io->pread (&m_bands[0], indexbytes, zfile_index_offset) != indexbytes) {
+        error ("Zfile \"%s\": could not read the band index", m_filename);
+        return false;
+    }
+    if (m_swab)
+        swap_endian ((uint64_t *)&m_bands[0], 2 * m_bands.size());
+
+    // Present the bands as full-width tiles, so that they may be read
+    // in any order (and given to the ImageCache as they are).
+    m_spec.tile_width = m_spec.width;
+    m_spec.tile_height = m_bandheight;
+    m_spec.tile_depth = 1;
+    m_spec.attribute ("compression", "zip");
+    m_spec.attribute ("zfile:bandheight", m_bandheight);
+    return true;
+}
+
+
+
 bool
 ZfileInput::close ()
 {
@@ -227,6 +423,26 @@ ZfileInput::close ()
 bool
 ZfileInput::read_native_scanline (int y, int z, void *data)
 {
+    if (m_blocked) {
+        if (y < 0 || y >= m_spec.height)
+            return false;
+        int b = y / m_bandheight;
+        if (b != m_cached_band) {
+            m_band.resize (size_t(m_bandheight) * m_spec.width);
+            std::vector<unsigned char> scratch;
+            m_cached_band = -1;
+            if (! read_band (m_io.get(), m_bands[b], band_rows(b), m_spec.width,
+                             m_swab, &m_band[0], scratch)) {
+                error ("Zfile \"%s\": could not read band %d", m_filename, b);
+                return false;
+            }
+            m_cached_band = b;
+        }
+        memcpy (data, &m_band[size_t(y - b * m_bandheight) * m_spec.width],
+                m_spec.width * sizeof(float));
+        return true;
+    }
+
     if (m_next_scanline > y) {
         // User is trying to read an earlier scanline than the one we're
         // up to.  Easy fix: close the file and re-open.
@@ -250,6 +466,96 @@ ZfileInput::read_native_scanline (int y, int z, void *data)
 
 
 
+bool
+ZfileInput::read_native_tile (int x, int y, int z, void *data)
+{
+    if (! m_blocked)
+        return false;
+    if (! read_native_tile_at (0, 0, x, y, z, data)) {
+        error ("Zfile \"%s\": could not read the band at row %d", m_filename, y);
+        return false;
+    }
+    return true;
+}
+
+
+
+bool
+ZfileInput::read_native_tile_at (int subimage, int miplevel,
+                                 int x, int y, int z, void *data)
+{
+    if (! m_blocked)
+        return ImageInput::read_native_tile_at (subimage, miplevel,
+                                                x, y, z, data);
+    y -= m_spec.y;
+    if (subimage != 0 || miplevel != 0 || y < 0 || y >= m_spec.height)
+        return false;
+    int b = y / m_bandheight;
+    int n = band_rows (b);
+    std::vector<unsigned char> scratch;
+    if (! read_band (m_io.get(), m_bands[b], n, m_spec.width, m_swab,
+                     (float *)data, scratch))
+        return false;
+    if (n < m_bandheight)   // the last band doesn't fill its tile
+        memset ((float *)data + size_t(n) * m_spec.width, 0,
+                size_t(m_bandheight - n) * m_spec.width * sizeof(float));
+    return true;
+}
+
+
+
+bool
+ZfileInput::read_native_tiles (int xbegin, int xend, int ybegin, int yend,
+                               int zbegin, int zend, void *data)
+{
+    if (! m_blocked || ! m_spec.valid_tile_range (xbegin, xend, ybegin, yend,
+                                                  zbegin, zend))
+        return ImageInput::read_native_tiles (xbegin, xend, ybegin, yend,
+                                              zbegin, zend, data);
+
+    // Each band is one whole tile row, so inflate them all in parallel
+    // straight into the caller's buffer.
+    int b0 = (ybegin - m_spec.y) / m_bandheight;
+    int nrows = std::min (yend, m_spec.y + m_spec.height) - ybegin;
+    int nbands = (nrows + m_bandheight - 1) / m_bandheight;
+    int nthreads = threads();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    nthreads = std::max (1, std::min (nthreads, nbands));
+    int per_task = (nbands + nthreads - 1) / nthreads;
+
+    atomic_int failures (0);
+    BandDecodeTask task;
+    task.io = m_io.get();
+    task.bands = &m_bands[0];
+    task.b0 = b0;
+    task.bandheight = m_bandheight;
+    task.nrows = nrows;
+    task.width = m_spec.width;
+    task.swab = m_swab;
+    task.data = (float *) data;
+    task.failures = &failures;
+    task_set tasks;
+    for (int b = b0;  b < b0 + nbands;  b += per_task) {
+        task.bbegin = b;
+        task.bend = std::min (b + per_task, b0 + nbands);
+        tasks.push (task);
+    }
+    tasks.wait ();
+    if (failures) {
+        error ("Zfile \"%s\": could not read bands", m_filename);
+        return false;
+    }
+    // Zero the rows of a partial last tile past the end of the image.
+    int wantrows = yend - ybegin;
+    if (wantrows > nrows)
+        memset ((float *)data + size_t(nrows) * m_spec.width, 0,
+                size_t(wantrows - nrows) * m_spec.width * sizeof(float));
+    return true;
+}
+
+
+
 
 bool
 ZfileOutput::open (const std::string &name, const ImageSpec &userspec,
@@ -303,7 +609,15 @@ ZfileOutput::open (const std::string &name, const ImageSpec &userspec,
     else
         memcpy (header.worldtoscreen, ident, 16*sizeof(float));
 
-    if (m_spec.get_string_attribute ("compression", "none") != std::string("none")) {
+    bool compress = (m_spec.get_string_attribute ("compression", "none")
+                     != std::string("none"));
+    if (compress)
+        m_bandheight = std::max (0, m_spec.get_int_attribute ("zfile:bandheight", 0));
+    if (m_bandheight) {
+        // Blocked: deflate bands ourselves, so write the file plainly
+        header.magic = zfile_blocked_magic;
+        m_file = Filesystem::fopen (name, "wb");
+    } else if (compress) {
         FILE *fd = Filesystem::fopen (name, "wb");
         if (fd) {
             m_gz = gzdopen (fileno (fd), "wb");
@@ -328,6 +642,22 @@ ZfileOutput::open (const std::string &name, const ImageSpec &userspec,
     	}
     }
 
+    if (m_bandheight) {
+        // Leave room for the band index, which close() fills in
+        ZfileBlockedHeader bheader;
+        bheader.bandheight = m_bandheight;
+        bheader.nbands = (m_spec.height + m_bandheight - 1) / m_bandheight;
+        m_bands.assign (bheader.nbands, ZfileBand());
+        if (fwrite (&bheader, sizeof(bheader), 1, m_file) != 1 ||
+            fwrite (&m_bands[0], sizeof(ZfileBand), m_bands.size(), m_file)
+                != m_bands.size()) {
+            error ("Failed write zfile::open");
+            return false;
+        }
+        m_bands.clear ();
+        m_filepos = zfile_index_offset + bheader.nbands * sizeof(ZfileBand);
+    }
+
     // If user asked for tiles -- which this format doesn't support, emulate
     // it by buffering the whole image.this form
     if (m_spec.tile_width && m_spec.tile_height)
@@ -350,6 +680,19 @@ ZfileOutput::close ()
         std::vector<unsigned char>().swap (m_tilebuffer);
     }
 
+    if (m_bandheight && m_file) {
+        // Write the last bands, then go back and fill in the index
+        ok &= flush_bands ();
+        int nbands = (m_spec.height + m_bandheight - 1) / m_bandheight;
+        m_bands.resize (nbands, ZfileBand());
+        if (ok && (fseek (m_file, zfile_index_offset, SEEK_SET) ||
+                   fwrite (&m_bands[0], sizeof(ZfileBand), m_bands.size(),
+                           m_file) != m_bands.size())) {
+            error ("Failed to write the Zfile band index");
+            ok = false;
+        }
+    }
+
     if (m_gz) {
         gzclose (m_gz);
         m_gz = 0;
@@ -379,7 +722,17 @@ ZfileOutput::write_scanline (int y, int z, TypeDesc format,
         data = &m_scratch[0];
     }
 
-    if (m_gz)
+    if (m_bandheight) {
+        // Gather scanlines until there are enough bands to keep every
+        // thread compressing.
+        m_rows.insert (m_rows.end(), (const float *)data,
+                       (const float *)data + m_spec.width);
+        int nthreads = threads();
+        if (nthreads <= 0)
+            OIIO::getattribute ("threads", nthreads);
+        if (m_rows.size() >= size_t(std::max (1, nthreads)) * m_bandheight * m_spec.width)
+            return flush_bands ();
+    } else if (m_gz)
         gzwrite (m_gz, data, m_spec.width*sizeof(float));
     else {
     	size_t b = fwrite (data, sizeof(float), m_spec.width, m_file);
@@ -394,6 +747,57 @@ ZfileOutput::write_scanline (int y, int z, TypeDesc format,
 
 
 
+bool
+ZfileOutput::flush_bands ()
+{
+    int nrows = int (m_rows.size() / m_spec.width);
+    if (! nrows)
+        return true;
+    int nbands = (nrows + m_bandheight - 1) / m_bandheight;
+    std::vector<std::vector<unsigned char> > out (nbands);
+    int nthreads = threads();
+    if (nthreads <= 0)
+        OIIO::getattribute ("threads", nthreads);
+    nthreads = std::max (1, std::min (nthreads, nbands));
+    int per_task = (nbands + nthreads - 1) / nthreads;
+
+    atomic_int failures (0);
+    BandCompressTask task;
+    task.rows = &m_rows[0];
+    task.bandheight = m_bandheight;
+    task.nrows = nrows;
+    task.width = m_spec.width;
+    task.out = &out[0];
+    task.failures = &failures;
+    task_set tasks;
+    for (int b = 0;  b < nbands;  b += per_task) {
+        task.bbegin = b;
+        task.bend = std::min (b + per_task, nbands);
+        tasks.push (task);
+    }
+    tasks.wait ();
+    m_rows.clear ();
+    if (failures) {
+        error ("Zfile compression failed");
+        return false;
+    }
+
+    for (int b = 0;  b < nbands;  ++b) {
+        ZfileBand band;
+        band.offset = m_filepos;
+        band.size = out[b].size();
+        if (fwrite (&out[b][0], 1, out[b].size(), m_file) != out[b].size()) {
+            error ("Failed write of Zfile band");
+            return false;
+        }
+        m_filepos += band.size;
+        m_bands.push_back (band);
+    }
+    return true;
+}
+
+
+
 bool
 ZfileOutput::write_tile (int x, int y, int z, TypeDesc format,
                        const void *data, stride_t xstride,
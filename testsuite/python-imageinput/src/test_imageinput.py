@@ -1,5 +1,6 @@
 #!/usr/bin/env python 
 
+import array
 import OpenImageIO as oiio
 
 
@@ -186,6 +187,32 @@ def test_readtile (filename, sub=0, mip=0, type=oiio.UNKNOWN) :
     print
 
 
+# Read the whole image into a preallocated array with read_image_into,
+# and make sure it matches what read_image returns.
+def test_readimage_into (filename, type=oiio.FLOAT) :
+    input = oiio.ImageInput.open (filename)
+    if not input :
+        print 'Could not open "' + filename + '"'
+        print "\tError: ", oiio.geterror()
+        print
+        return
+    print 'Opened "' + filename + '" as a ' + input.format_name()
+    spec = input.spec ()
+    buf = array.array ('f', [0.0]) * (spec.image_pixels() * spec.nchannels)
+    print "read_image_into returned", input.read_image_into (buf, type)
+    print "matches read_image:", buf == input.read_image (type)
+    small = array.array ('f', [0.0]) * 16
+    print "too small a buffer returns", input.read_image_into (small, type)
+    input.close ()
+    print
+    bufs = [ array.array ('f', [0.0]) * len(buf),
+             array.array ('f', [0.0]) * len(buf) ]
+    print "read_images_into returned", \
+          oiio.ImageInput.read_images_into ([filename, "badname.tif"], bufs)
+    print "first matches read_image_into:", bufs[0] == buf
+    print
+
+
 def write (image, filename, format=oiio.UNKNOWN) :
     if not image.has_error :
         image.set_write_format (format)
@@ -253,6 +280,8 @@ try:
     print "Test read_image into FLOAT:"
     test_readimage ("testu16.tif", method="image", type=oiio.FLOAT,
                     keep_unknown=True, print_pixels=False)
+    print "Test read_image_into FLOAT array:"
+    test_readimage_into ("testu16.tif")
 
     print "Done."
 except Exception as detail: